@@ -1,6 +1,13 @@
 #define M_PI 3.14159265359
 #define ONE_BY_PI (1 / 3.14159265359)
 
+// quantized mesh positions are integers scaled by 2^w, float positions are read with w = 1
+#ifdef _QUANTIZED_POSITION
+	#define decodePosition(p) ((p).xyz * exp2((p).w))
+#else
+	#define decodePosition(p) ((p).xyz)
+#endif
+
 layout (binding=15) uniform samplerCube u_radiancemap;
 
 struct PixelData {
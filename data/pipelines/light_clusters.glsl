@@ -0,0 +1,27 @@
+// lights assigned to froxel clusters by light_clusters.shd, matches LightClusterState in pipeline.cpp
+#define MAX_CLUSTER_LIGHTS 127
+
+layout(std140, binding = 4) uniform Drawcall {
+	uvec4 u_cluster_grid; // xyz = clusters count, w = lights count
+	vec4 u_cluster_depth; // x = near, y = far, z = log(far / near)
+	uvec4 u_cluster_lights; // x = first light in b_lights, in vec4s
+};
+
+// LightData in pipeline.cpp, 4 vec4s per light - rot, pos & range, attenuation & color, dir & fov,
+// followed by a vec4 per light - tile in the local shadow atlas, xy = origin, zw = face size, zw = 0 if the light has no shadow
+layout(std430, binding = 0) readonly buffer Lights {
+	vec4 b_lights[];
+};
+
+// per cluster, lights count followed by MAX_CLUSTER_LIGHTS light indices
+layout(std430, binding = 1) buffer Clusters {
+	uint b_clusters[];
+};
+
+// view depth slices grow exponentially, so clusters are about as deep as they are wide
+uint getClusterIndex(vec2 screen_uv, float view_depth) {
+	uvec2 xy = min(uvec2(screen_uv * u_cluster_grid.xy), u_cluster_grid.xy - 1);
+	float slice = log(max(view_depth, u_cluster_depth.x) / u_cluster_depth.x) / u_cluster_depth.z * u_cluster_grid.z;
+	uint z = min(uint(slice), u_cluster_grid.z - 1);
+	return xy.x + (xy.y + z * u_cluster_grid.y) * u_cluster_grid.x;
+}
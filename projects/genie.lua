@@ -12,12 +12,15 @@ local ROOT_DIR = path.getabsolute("../")
 local LOCATION = "tmp/" .. ide_dir
 local BINARY_DIR = LOCATION .. "/bin/"
 build_app = false
+build_server = false
 build_studio = true
 local working_dir = nil
 local debug_args = nil
 local release_args = nil
 local plugins = {}
 local base_plugins = {}
+-- renderer runs headless in the server, physics, animation and navigation use its scene
+local server_plugins = { "renderer", "physics", "animation", "navigation", "lua_script" }
 local embed_resources = false
 build_studio_callbacks = {}
 build_app_callbacks = {}
@@ -60,6 +63,23 @@ function linkPlugin(plugin_name)
 			forceLink("setStudioApp_" .. plugin_name)
 		end
 	end
+
+	if build_server and is_server_plugin(plugin_name) then
+		project "server"
+		links {plugin_name}
+		if _OPTIONS["static-plugins"] then	
+			forceLink ("s_" .. plugin_name .. "_plugin_register")
+		end
+	end
+end
+
+function is_server_plugin(plugin)
+	for _, v in ipairs(server_plugins) do
+		if v == plugin then
+			return true
+		end
+	end
+	return false
 end
 
 newoption {
@@ -132,6 +152,11 @@ newoption {
 	description = "Do build app."
 }
 
+newoption {
+	trigger = "with-server",
+	description = "Do build headless dedicated server."
+}
+
 newoption {
 	trigger = "with-game",
 	description = "Build game plugin."
@@ -221,6 +246,10 @@ if _OPTIONS["with-app"] then
 	build_app = true
 end
 
+if _OPTIONS["with-server"] then
+	build_server = true
+end
+
 function detect_plugins()
 	local f = io.popen([[if exist ..\plugins dir /B ..\plugins]])
 	if not f then return end
@@ -765,6 +794,64 @@ if build_app then
 		defaultConfigurations()
 end
 
+if build_server then
+	project "server"
+		if working_dir then
+			debugdir ("../../" .. working_dir)
+		else 
+			debugdir "../data"
+		end
+
+		kind "ConsoleApp"
+		
+		local def = ""
+		for _, plugin in ipairs(plugins) do
+			if is_server_plugin(plugin) then
+				if def ~= "" then 
+					def = def .. ",";
+				end
+				def = def .. "\"" .. plugin .. "\""
+			end
+		end
+		if def ~= "" then
+			defines { "LUMIXENGINE_PLUGINS=" .. def }
+		end
+
+		includedirs { "../src", "../src/server" }
+		links { "engine" }
+		if _OPTIONS["static-plugins"] then	
+			if has_plugin("renderer") then
+				linkOpenGL()
+			end
+			if has_plugin("physics") then
+				linkPhysX()
+			end
+			linkLib "freetype"
+			linkLib "recast"
+			
+			configuration { "vs*" }
+				links { "psapi", "dxguid", "winmm" }
+
+			configuration {}
+		end
+		
+		linkLib "luajit"
+		linkLib "recast"
+		files { "../src/server/main.cpp" }
+
+		configuration { "linux" }
+			links { "GL", "X11", "dl", "rt" }
+		
+		configuration {}
+		
+		configuration {"vs*"}
+			links { "winmm", "imm32", "version" }
+		configuration {}
+
+		useLua()
+		defaultConfigurations()
+end
+
 for _, plugin in ipairs(base_plugins) do
 	linkPlugin(plugin)
 end
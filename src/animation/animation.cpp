@@ -12,19 +12,12 @@ namespace Lumix
 {
 
 
-enum class Version
-{
-	FIRST = 0,
-
-	LAST
-};
-
-
 const ResourceType Animation::TYPE("animation");
 
 
 Animation::Animation(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
+	, m_allocator(allocator)
 	, m_mem(allocator)
 	, m_translations(allocator)
 	, m_rotations(allocator)
@@ -34,112 +27,187 @@ Animation::Animation(const Path& path, ResourceManager& resource_manager, IAlloc
 
 
 struct AnimationSampler {
+	struct SampleTime {
+		bool is_end;
+		u16 anim_t;
+		u32 frame_idx;
+		float frame_t;
+	};
+
+	static SampleTime getSampleTime(const Animation& anim, Time time) {
+		SampleTime res = {};
+		res.is_end = !(time < anim.getLength());
+		if (res.is_end) return res;
+
+		const u64 anim_t_highres = ((u64)time.raw() << 16) / (anim.m_length.raw());
+		ASSERT(anim_t_highres <= 0xffFF);
+		res.anim_t = u16(anim_t_highres);
+		const u64 frame_48_16 = (anim.m_frame_count - 1) * anim_t_highres;
+		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
+		res.frame_idx = u32(frame_48_16 >> 16);
+		res.frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
+		return res;
+	}
+
+	// returns idx in [1, count) such that times[idx - 1] <= t < times[idx], or count - 1 if t is after the last key
+	// `cursor` is the result of the previous lookup, forward playback usually finds the key in a few steps
+	static u32 findKey(const u16* times, u32 count, u16 t, u32* cursor) {
+		ASSERT(count > 1);
+		if (cursor) {
+			u32 idx = *cursor;
+			if (idx > 0 && idx < count && times[idx - 1] <= t) {
+				for (u32 end = minimum(idx + 4, count); idx < end; ++idx) {
+					if (times[idx] > t) {
+						*cursor = idx;
+						return idx;
+					}
+				}
+			}
+		}
+
+		// first key after t
+		u32 lo = 1;
+		u32 hi = count - 1;
+		while (lo < hi) {
+			const u32 mid = (lo + hi) >> 1;
+			if (times[mid] > t) hi = mid;
+			else lo = mid + 1;
+		}
+		if (cursor) *cursor = lo;
+		return lo;
+	}
+
+	static float getKeyT(const u16* times, u32 idx, u16 t) {
+		return clamp(float(t - times[idx - 1]) / (times[idx] - times[idx - 1]), 0.f, 1.f);
+	}
+
+	// keys are not aligned in memory
+	static Vec3 getKey(const Animation::TranslationCurve& curve, u32 idx) {
+		QuantizedVec3 key;
+		memcpy(&key, curve.keys + idx * sizeof(key), sizeof(key));
+		return dequantize(key, curve.min, curve.to_float);
+	}
+
+	static Quat getKey(const Animation::RotationCurve& curve, u32 idx) {
+		CompressedQuat key;
+		memcpy(&key, curve.keys + idx * sizeof(key), sizeof(key));
+		return decompress(key);
+	}
+
+	static Vec3 sample(const Animation::TranslationCurve& curve, const SampleTime& time, u32* cursor = nullptr) {
+		if (!curve.keys) return curve.min;
+		if (time.is_end) return getKey(curve, curve.count - 1);
+		if (curve.times) {
+			const u32 idx = findKey(curve.times, curve.count, time.anim_t, cursor);
+			return lerp(getKey(curve, idx - 1), getKey(curve, idx), getKeyT(curve.times, idx, time.anim_t));
+		}
+		return lerp(getKey(curve, time.frame_idx), getKey(curve, time.frame_idx + 1), time.frame_t);
+	}
+
+	// keys to nlerp between, so the caller can interpolate several curves at once
+	static void getKeys(const Animation::RotationCurve& curve, const SampleTime& time, u32* cursor, Quat& from, Quat& to, float& t) {
+		if (!curve.keys) {
+			from = to = curve.constant;
+			t = 0;
+		}
+		else if (time.is_end) {
+			from = to = getKey(curve, curve.count - 1);
+			t = 0;
+		}
+		else if (curve.times) {
+			const u32 idx = findKey(curve.times, curve.count, time.anim_t, cursor);
+			from = getKey(curve, idx - 1);
+			to = getKey(curve, idx);
+			t = getKeyT(curve.times, idx, time.anim_t);
+		}
+		else {
+			from = getKey(curve, time.frame_idx);
+			to = getKey(curve, time.frame_idx + 1);
+			t = time.frame_t;
+		}
+	}
+
+	static Quat sample(const Animation::RotationCurve& curve, const SampleTime& time, u32* cursor = nullptr) {
+		Quat from, to;
+		float t;
+		getKeys(curve, time, cursor, from, to, t);
+		return t == 0 ? from : nlerp(from, to, t);
+	}
+
+	template <bool use_weight>
+	static void apply(Vec3& pos, const Vec3& anim_pos, float weight) {
+		if constexpr (use_weight) pos = lerp(pos, anim_pos, weight);
+		else pos = anim_pos;
+	}
+
+	template <bool use_weight>
+	static void apply(Quat& rot, const Quat& anim_rot, float weight) {
+		if constexpr (use_weight) rot = nlerp(rot, anim_rot, weight);
+		else rot = anim_rot;
+	}
+
 	template <bool use_mask, bool use_weight>
 	static void getRelativePose(const Animation& anim, Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) {
 		ASSERT(!pose.is_absolute);
 		ASSERT(model.isReady());
 
-		Vec3* pos = pose.positions;
-		Quat* rot = pose.rotations;
-
-		if (time < anim.getLength()) {
-			const u64 anim_t_highres = ((u64)time.raw() << 16) / (anim.m_length.raw());
-			ASSERT(anim_t_highres <= 0xffFF);
-			const u16 anim_t = u16(anim_t_highres);
-			const u64 frame_48_16 = (anim.m_frame_count - 1) * anim_t_highres;
-			ASSERT((frame_48_16 & 0xffFF00000000) == 0);
-			const u32 frame_idx = u32(frame_48_16 >> 16);
-			const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
-		
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
-
-				Vec3 anim_pos;
-				if (curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
-					}
-					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-					anim_pos = lerp(curve.pos[idx - 1], curve.pos[idx], t);
-				}
-				else {
-					anim_pos = lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
-				}
-
-				const int model_bone_index = iter.value();
-				if constexpr (use_weight) {
-					pos[model_bone_index] = lerp(pos[model_bone_index], anim_pos, weight);
-				}
-				else {
-					pos[model_bone_index] = anim_pos;
-				}
+		const SampleTime sample_time = getSampleTime(anim, time);
+		for (const Animation::TranslationCurve& curve : anim.m_translations) {
+			Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
+			if (!iter.isValid()) continue;
+			if constexpr(use_mask) {
+				if (mask->bones.find(curve.name) == mask->bones.end()) continue;
 			}
+			apply<use_weight>(pose.positions[iter.value()], sample(curve, sample_time), weight);
+		}
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
+		for (const Animation::RotationCurve& curve : anim.m_rotations) {
+			Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
+			if (!iter.isValid()) continue;
+			if constexpr(use_mask) {
+				if (mask->bones.find(curve.name) == mask->bones.end()) continue;
+			}
+			apply<use_weight>(pose.rotations[iter.value()], sample(curve, sample_time), weight);
+		}
+	}
 
-				Quat anim_rot;
-				if(curve.times) {
-					u32 idx = 1;
-					for (u32 c = curve.count; idx < c; ++idx) {
-						if (curve.times[idx] > anim_t) break;
-					}
-					const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-					anim_rot = nlerp(curve.rot[idx - 1], curve.rot[idx], t);
-				}
-				else {
-					anim_rot = nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
-				}
+	template <bool use_weight>
+	static void getRelativePose(const Animation& anim, Time time, Pose& pose, AnimationBinding& binding, float weight) {
+		ASSERT(!pose.is_absolute);
 
-				const int model_bone_index = iter.value();
-				if constexpr (use_weight) {
-					rot[model_bone_index] = nlerp(rot[model_bone_index], anim_rot, weight);
-				}
-				else {
-					rot[model_bone_index] = anim_rot;
-				}
-			}
+		const SampleTime sample_time = getSampleTime(anim, time);
+		for (AnimationBinding::Entry& e : binding.translations) {
+			apply<use_weight>(pose.positions[e.bone], sample(anim.m_translations[e.curve], sample_time, &e.key), weight);
 		}
-		else {
-			for (const Animation::TranslationCurve& curve : anim.m_translations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
-				}
 
-				const int model_bone_index = iter.value();
-				if constexpr (use_weight) {
-					pos[model_bone_index] = lerp(pos[model_bone_index], curve.pos[curve.count - 1], weight);
-				}
-				else {
-					pos[model_bone_index] = curve.pos[curve.count - 1];
-				}
+		// rotations are interpolated 4 at a time
+		const float weights[4] = { weight, weight, weight, weight };
+		for (u32 i = 0, c = binding.rotations.size(); i < c; i += 4) {
+			const u32 n = minimum(c - i, 4);
+			Quat from[4];
+			Quat to[4];
+			float t[4];
+			for (u32 j = 0; j < n; ++j) {
+				AnimationBinding::Entry& e = binding.rotations[i + j];
+				getKeys(anim.m_rotations[e.curve], sample_time, &e.key, from[j], to[j], t[j]);
+			}
+			for (u32 j = n; j < 4; ++j) {
+				from[j] = to[j] = Quat::IDENTITY;
+				t[j] = 0;
 			}
+			Quat res[4];
+			nlerp4(res, from, to, t);
 
-			for (const Animation::RotationCurve& curve : anim.m_rotations) {
-				Model::BoneMap::const_iterator iter = model.getBoneIndex(curve.name);
-				if (!iter.isValid()) continue;
-				if constexpr(use_mask) {
-					if (mask->bones.find(curve.name) == mask->bones.end()) continue;
+			if constexpr (use_weight) {
+				Quat current[4];
+				for (u32 j = 0; j < 4; ++j) {
+					current[j] = j < n ? pose.rotations[binding.rotations[i + j].bone] : Quat::IDENTITY;
 				}
+				nlerp4(res, current, res, weights);
+			}
 
-				const int model_bone_index = iter.value();
-				if constexpr (use_weight) {
-					rot[model_bone_index] = nlerp(rot[model_bone_index], curve.rot[curve.count - 1], weight);
-				}
-				else {
-					rot[model_bone_index] = curve.rot[curve.count - 1];
-				}
+			for (u32 j = 0; j < n; ++j) {
+				pose.rotations[binding.rotations[i + j].bone] = res[j];
 			}
 		}
 	}
@@ -164,33 +232,52 @@ void Animation::getRelativePose(Time time, Pose& pose, const Model& model, float
 	}
 }
 
-Vec3 Animation::getTranslation(Time time, u32 curve_idx) const
-{
-	const TranslationCurve& curve = m_translations[curve_idx];
-	if (time < m_length) {
-		const u64 anim_t_highres = ((u64)time.raw() << 16) / (m_length.raw());
-		ASSERT(anim_t_highres <= 0xffFF);
-		const u16 anim_t = u16(anim_t_highres);
-
-		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
+void Animation::getRelativePose(Time time, Pose& pose, AnimationBinding& binding, float weight) const {
+	ASSERT(binding.animation == this && binding.animation_generation == m_generation);
+	if (weight < 0.9999f) {
+		AnimationSampler::getRelativePose<true>(*this, time, pose, binding, weight);
+	}
+	else {
+		AnimationSampler::getRelativePose<false>(*this, time, pose, binding, weight);
+	}
+}
 
-			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return lerp(curve.pos[idx - 1], curve.pos[idx], t);
-		}
+bool Animation::isBound(const Model& model, const AnimationBinding& binding) const {
+	return binding.animation == this
+		&& binding.animation_generation == m_generation
+		&& binding.model == &model
+		&& binding.model_generation == model.getBonesGeneration();
+}
 
-		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
-		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
-		const u32 frame_idx = u32(frame_48_16 >> 16);
-		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
+void Animation::bind(const Model& model, const BoneMask* mask, AnimationBinding& binding) const {
+	ASSERT(model.isReady());
+	binding.animation = this;
+	binding.model = &model;
+	binding.animation_generation = m_generation;
+	binding.model_generation = model.getBonesGeneration();
+	binding.translations.clear();
+	binding.rotations.clear();
+
+	for (u32 i = 0, c = m_translations.size(); i < c; ++i) {
+		const u32 name = m_translations[i].name;
+		Model::BoneMap::const_iterator iter = model.getBoneIndex(name);
+		if (!iter.isValid()) continue;
+		if (mask && !mask->bones.find(name).isValid()) continue;
+		binding.translations.push({i, (u32)iter.value(), 1});
+	}
 
-		return lerp(curve.pos[frame_idx], curve.pos[frame_idx + 1], frame_t);
+	for (u32 i = 0, c = m_rotations.size(); i < c; ++i) {
+		const u32 name = m_rotations[i].name;
+		Model::BoneMap::const_iterator iter = model.getBoneIndex(name);
+		if (!iter.isValid()) continue;
+		if (mask && !mask->bones.find(name).isValid()) continue;
+		binding.rotations.push({i, (u32)iter.value(), 1});
 	}
+}
 
-	return curve.pos[curve.count - 1];
+Vec3 Animation::getTranslation(Time time, u32 curve_idx) const
+{
+	return AnimationSampler::sample(m_translations[curve_idx], AnimationSampler::getSampleTime(*this, time));
 }
 
 int Animation::getTranslationCurveIndex(u32 name_hash) const {
@@ -209,31 +296,7 @@ int Animation::getRotationCurveIndex(u32 name_hash) const {
 
 Quat Animation::getRotation(Time time, u32 curve_idx) const
 {
-	const RotationCurve& curve = m_rotations[curve_idx];
-	if (time < m_length) {
-		const u64 anim_t_highres = ((u64)time.raw() << 16) / (m_length.raw());
-		ASSERT(anim_t_highres <= 0xffFF);
-		const u16 anim_t = u16(anim_t_highres);
-
-		if (curve.times) {
-			u32 idx = 1;
-			for (u32 c = curve.count; idx < c; ++idx) {
-				if (curve.times[idx] > anim_t) break;
-			}
-
-			const float t = float(anim_t - curve.times[idx - 1]) / (curve.times[idx] - curve.times[idx - 1]);
-			return nlerp(curve.rot[idx - 1], curve.rot[idx], t);
-		}
-
-		const u64 frame_48_16 = (m_frame_count - 1) * anim_t_highres;
-		ASSERT((frame_48_16 & 0xffFF00000000) == 0);
-		const u32 frame_idx = u32(frame_48_16 >> 16);
-		const float frame_t = (frame_48_16 & 0xffFF) / float(0xffFF);
-
-		return nlerp(curve.rot[frame_idx], curve.rot[frame_idx + 1], frame_t);
-	}
-
-	return curve.rot[curve.count - 1];
+	return AnimationSampler::sample(m_rotations[curve_idx], AnimationSampler::getSampleTime(*this, time));
 }
 
 void Animation::getRelativePose(Time time, Pose& pose, const Model& model, const BoneMask* mask) const {
@@ -245,11 +308,42 @@ void Animation::getRelativePose(Time time, Pose& pose, const Model& model, const
 	}
 }
 
-bool Animation::load(u64 mem_size, const u8* mem)
+// files older than FileVersion::COMPRESSED store full precision keys, they are compressed when loaded
+static void compressLegacyCurves(InputMemoryStream& in, OutputMemoryStream& out, IAllocator& allocator)
+{
+	Array<u16> times(allocator);
+	Array<Vec3> positions(allocator);
+	Array<Quat> rotations(allocator);
+	for (u32 pass = 0; pass < 2; ++pass) {
+		const u32 count = in.read<u32>();
+		out.write(count);
+		for (u32 i = 0; i < count; ++i) {
+			const u32 name = in.read<u32>();
+			const Animation::CurveType type = in.read<Animation::CurveType>();
+			const u32 keys_count = in.read<u32>();
+			times.resize(type == Animation::CurveType::KEYFRAMED ? keys_count : 0);
+			if (!times.empty()) in.read(times.begin(), times.byte_size());
+			if (pass == 0) {
+				positions.resize(keys_count);
+				in.read(positions.begin(), positions.byte_size());
+				writeTranslationCurve(out, name, type, times, positions, 0);
+			}
+			else {
+				rotations.resize(keys_count);
+				in.read(rotations.begin(), rotations.byte_size());
+				writeRotationCurve(out, name, type, times, rotations, 0);
+			}
+		}
+	}
+}
+
+bool Animation::loadAsync(u64 mem_size, const u8* mem)
 {
+	PROFILE_FUNCTION();
 	m_translations.clear();
 	m_rotations.clear();
 	m_mem.clear();
+	++m_generation;
 	Header header;
 	InputMemoryStream file(mem, mem_size);
 	file.read(&header, sizeof(header));
@@ -257,43 +351,64 @@ bool Animation::load(u64 mem_size, const u8* mem)
 		logError("Animation") << getPath() << " is not an animation file";
 		return false;
 	}
+	if (header.version > (u32)FileVersion::LATEST) {
+		logError("Animation") << "Unsupported version of animation " << getPath();
+		return false;
+	}
 
 	file.read(&m_root_motion_bone_idx, sizeof(m_root_motion_bone_idx));
 	m_length = header.length;
 	m_frame_count = header.frame_count;
-	u32 translations_count;
-	file.read(&translations_count, sizeof(translations_count));
-	const u32 size = u32(file.size() - file.getPosition());
-	m_mem.resize(size);
-	file.read(&m_mem[0], size);
+	if (header.version < (u32)FileVersion::COMPRESSED) {
+		OutputMemoryStream compressed(m_allocator);
+		compressLegacyCurves(file, compressed, m_allocator);
+		m_mem.resize((u32)compressed.getPos());
+		memcpy(m_mem.begin(), compressed.getData(), m_mem.size());
+	}
+	else {
+		m_mem.resize(u32(file.size() - file.getPosition()));
+		file.read(m_mem.begin(), m_mem.size());
+	}
 
+	InputMemoryStream blob(m_mem.begin(), m_mem.size());
+	const u32 translations_count = blob.read<u32>();
 	m_translations.resize(translations_count);
-
-	InputMemoryStream blob(&m_mem[0], size);
-	for (int i = 0; i < m_translations.size(); ++i) {
-		TranslationCurve& curve = m_translations[i];
+	for (TranslationCurve& curve : m_translations) {
 		curve.name = blob.read<u32>();
 		const Animation::CurveType type = blob.read<Animation::CurveType>();
 		curve.count = blob.read<u32>();
-		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
+		ASSERT(curve.count > 1 || type == Animation::CurveType::CONSTANT);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.pos = (const Vec3*)blob.skip(curve.count * sizeof(Vec3));
+		blob.read(curve.min);
+		if (type == Animation::CurveType::CONSTANT) {
+			curve.to_float = Vec3::ZERO;
+			curve.keys = nullptr;
+		}
+		else {
+			blob.read(curve.to_float);
+			curve.keys = (const u8*)blob.skip(curve.count * sizeof(QuantizedVec3));
+		}
 	}
 	
 	const u32 rotations_count = blob.read<u32>();
 	m_rotations.resize(rotations_count);
-
-	for (int i = 0; i < m_rotations.size(); ++i) {
-		RotationCurve& curve = m_rotations[i];
+	for (RotationCurve& curve : m_rotations) {
 		curve.name = blob.read<u32>();
 		const Animation::CurveType type = blob.read<Animation::CurveType>();
 		curve.count = blob.read<u32>();
-		ASSERT(curve.count > 1 || type != Animation::CurveType::KEYFRAMED);
+		ASSERT(curve.count > 1 || type == Animation::CurveType::CONSTANT);
 		curve.times = type == Animation::CurveType::KEYFRAMED ? (const u16*)blob.skip(curve.count * sizeof(u16)) : nullptr;
-		curve.rot = (const Quat*)blob.skip(curve.count * sizeof(Quat));
+		if (type == Animation::CurveType::CONSTANT) {
+			blob.read(curve.constant);
+			curve.keys = nullptr;
+		}
+		else {
+			curve.constant = Quat::IDENTITY;
+			curve.keys = (const u8*)blob.skip(curve.count * sizeof(CompressedQuat));
+		}
 	}
 
-	m_size = file.size();
+	m_size = m_mem.byte_size();
 	return true;
 }
 
@@ -1,12 +1,16 @@
 #pragma once
 
+#include "engine/array.h"
+#include "engine/crt.h"
 #include "engine/hash_map.h"
 #include "engine/math.h"
 #include "engine/resource.h"
+#include "engine/stream.h"
 
 namespace Lumix
 {
 
+struct Animation;
 struct Model;
 struct Pose;
 struct Quat;
@@ -21,6 +25,96 @@ struct BoneMask
 };
 
 
+// animation curve -> model bone tables, so sampling does not need to look up bones by name
+struct AnimationBinding
+{
+	struct Entry {
+		u32 curve;
+		u32 bone;
+		// key found by the last sample, keyframed curves only
+		u32 key;
+	};
+
+	AnimationBinding(IAllocator& allocator) : translations(allocator), rotations(allocator) {}
+
+	const Animation* animation = nullptr;
+	const Model* model = nullptr;
+	u32 animation_generation = 0;
+	u32 model_generation = 0;
+	Array<Entry> translations;
+	Array<Entry> rotations;
+};
+
+
+// translation key, quantized to the [min, min + 0xffFF * to_float] range of its curve
+struct QuantizedVec3
+{
+	u16 x, y, z;
+};
+
+
+// rotation key, "smallest three" - the largest component is dropped and recomputed from the other three
+// bits 0-44 are the other three components, 15 bits each, bits 45-46 are the index of the dropped one
+struct CompressedQuat
+{
+	u16 data[3];
+};
+
+
+inline QuantizedVec3 quantize(const Vec3& v, const Vec3& min, const Vec3& to_float)
+{
+	auto q = [](float v, float min, float to_float) -> u16 {
+		if (to_float <= 0) return 0;
+		return (u16)clamp((v - min) / to_float + 0.5f, 0.f, 65535.f);
+	};
+	return { q(v.x, min.x, to_float.x), q(v.y, min.y, to_float.y), q(v.z, min.z, to_float.z) };
+}
+
+
+inline Vec3 dequantize(const QuantizedVec3& v, const Vec3& min, const Vec3& to_float)
+{
+	return Vec3(min.x + v.x * to_float.x, min.y + v.y * to_float.y, min.z + v.z * to_float.z);
+}
+
+
+inline CompressedQuat compress(const Quat& q)
+{
+	const float c[4] = { q.x, q.y, q.z, q.w };
+	u32 largest = 0;
+	for (u32 i = 1; i < 4; ++i) {
+		if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
+	}
+	// q and -q are the same rotation, the dropped component is always positive
+	const float sign = c[largest] < 0 ? -1.f : 1.f;
+	u64 packed = (u64)largest << 45;
+	for (u32 i = 0, j = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const float v = clamp(c[i] * sign * 0.70710678f + 0.5f, 0.f, 1.f);
+		packed |= (u64)u32(v * 32767 + 0.5f) << (j * 15);
+		++j;
+	}
+	return { { u16(packed), u16(packed >> 16), u16(packed >> 32) } };
+}
+
+
+inline Quat decompress(const CompressedQuat& q)
+{
+	const u64 packed = q.data[0] | ((u64)q.data[1] << 16) | ((u64)q.data[2] << 32);
+	const u32 largest = u32(packed >> 45) & 3;
+	float c[4];
+	float sum = 0;
+	for (u32 i = 0, j = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const u32 v = u32(packed >> (j * 15)) & 0x7fff;
+		c[i] = (v / 32767.f - 0.5f) * 1.41421356f;
+		sum += c[i] * c[i];
+		++j;
+	}
+	c[largest] = sqrtf(maximum(1 - sum, 0.f));
+	return Quat(c[0], c[1], c[2], c[3]);
+}
+
+
 struct Animation final : Resource
 {
 	public:
@@ -30,7 +124,17 @@ struct Animation final : Resource
 	public:
 		enum class CurveType : u8 {
 			KEYFRAMED,
-			SAMPLED
+			SAMPLED,
+			// one key
+			CONSTANT
+		};
+
+		enum class FileVersion : u32 {
+			FIRST = 3,
+			// QuantizedVec3 positions with the curve's range, CompressedQuat rotations, constant curves
+			COMPRESSED,
+
+			LATEST = COMPRESSED
 		};
 
 		struct Header
@@ -53,36 +157,108 @@ struct Animation final : Resource
 		int getRotationCurveIndex(u32 name_hash) const;
 		void getRelativePose(Time time, Pose& pose, const Model& model, const BoneMask* mask) const;
 		void getRelativePose(Time time, Pose& pose, const Model& model, float weight, const BoneMask* mask) const;
+		// `binding` must be up to date, see isBound
+		void getRelativePose(Time time, Pose& pose, AnimationBinding& binding, float weight) const;
+		void bind(const Model& model, const BoneMask* mask, AnimationBinding& binding) const;
+		bool isBound(const Model& model, const AnimationBinding& binding) const;
 		Time getLength() const { return m_length; }
 
 	private:
 		void unload() override;
-		bool load(u64 size, const u8* mem) override;
+		bool load(u64 size, const u8* mem) override { return loadAsync(size, mem); }
+		bool isAsyncLoadSupported() const override { return true; }
+		bool loadAsync(u64 size, const u8* mem) override;
 
 	private:
 		Time m_length;
+		// keys are decompressed when sampled, constant curves have no keys
 		struct TranslationCurve
 		{
 			u32 name;
 			u32 count;
 			const u16* times;
-			const Vec3* pos;
+			// QuantizedVec3s
+			const u8* keys;
+			// the value of constant curves
+			Vec3 min;
+			Vec3 to_float;
 		};
 		struct RotationCurve
 		{
 			u32 name;
 			u32 count;
 			const u16* times;
-			const Quat* rot;
+			// CompressedQuats
+			const u8* keys;
+			Quat constant;
 		};
 		Array<TranslationCurve> m_translations;
 		Array<RotationCurve> m_rotations;
+		IAllocator& m_allocator;
 		Array<u8> m_mem;
 		u32 m_frame_count = 0;
+		u32 m_generation = 0;
 		int m_root_motion_bone_idx;
 
 		friend struct AnimationSampler;
 };
 
 
+// writes a curve in Animation::FileVersion::COMPRESSED format, `times` are empty for sampled curves
+// curves with all keys within `max_error` of the first one are written as constant
+inline void writeTranslationCurve(OutputMemoryStream& out, u32 name, Animation::CurveType type, Span<const u16> times, Span<const Vec3> keys, float max_error)
+{
+	ASSERT(keys.length() > 0);
+	Vec3 min = keys[0];
+	Vec3 max = keys[0];
+	for (const Vec3& k : keys) {
+		min = Vec3(minimum(min.x, k.x), minimum(min.y, k.y), minimum(min.z, k.z));
+		max = Vec3(maximum(max.x, k.x), maximum(max.y, k.y), maximum(max.z, k.z));
+	}
+	out.write(name);
+	if (max.x - min.x <= max_error && max.y - min.y <= max_error && max.z - min.z <= max_error) {
+		out.write(Animation::CurveType::CONSTANT);
+		out.write((u32)1);
+		out.write(keys[0]);
+		return;
+	}
+
+	out.write(type);
+	out.write(keys.length());
+	if (type == Animation::CurveType::KEYFRAMED) out.write(times.begin(), times.length() * sizeof(times[0]));
+	const Vec3 to_float = (max - min) * (1.f / 0xffFF);
+	out.write(min);
+	out.write(to_float);
+	for (const Vec3& k : keys) out.write(quantize(k, min, to_float));
+}
+
+
+inline void writeRotationCurve(OutputMemoryStream& out, u32 name, Animation::CurveType type, Span<const u16> times, Span<const Quat> keys, float max_error)
+{
+	ASSERT(keys.length() > 0);
+	const Quat& q0 = keys[0];
+	bool is_constant = true;
+	for (const Quat& k : keys) {
+		// q and -q are the same rotation
+		const float d = q0.x * k.x + q0.y * k.y + q0.z * k.z + q0.w * k.w < 0 ? -1.f : 1.f;
+		if (fabsf(k.x * d - q0.x) > max_error || fabsf(k.y * d - q0.y) > max_error || fabsf(k.z * d - q0.z) > max_error || fabsf(k.w * d - q0.w) > max_error) {
+			is_constant = false;
+			break;
+		}
+	}
+	out.write(name);
+	if (is_constant) {
+		out.write(Animation::CurveType::CONSTANT);
+		out.write((u32)1);
+		out.write(q0);
+		return;
+	}
+
+	out.write(type);
+	out.write(keys.length());
+	if (type == Animation::CurveType::KEYFRAMED) out.write(times.begin(), times.length() * sizeof(times[0]));
+	for (const Quat& k : keys) out.write(compress(k));
+}
+
+
 } // namespace Lumix
@@ -6,14 +6,19 @@
 #include "animation/property_animation.h"
 #include "engine/associative_array.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/engine.h"
+#include "engine/hash.h"
 #include "engine/lua_wrapper.h"
+#include "engine/os.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/simd.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "nodes.h"
 #include "renderer/model.h"
@@ -53,11 +58,32 @@ struct AnimationSceneImpl final : AnimationScene
 		u32 default_set = 0;
 		Anim::RuntimeContext* ctx = nullptr;
 		LocalRigidTransform root_motion = {{0, 0, 0}, {0, 0, 0, 1}};
-
+		// controller's bone masks for LOD 1 and 2
+		u32 lod_masks[2] = { 0xffFFffFF, 0xffFFffFF };
+		u32 frames_to_update = 0;
+		// time of skipped updates
+		float accumulated_time = 0;
+		// results of the parallel update, applied on the main thread in applyAnimatorUpdate
+		bool pose_changed = false;
+		bool root_motion_moved = false;
+		Transform root_motion_tr;
+		// pose evaluation state between updateAnimatorController and evaluateAnimatorPose
+		bool needs_pose = false;
+		// pose is evaluated, waits for IK chains solved in update
+		bool needs_ik = false;
+		u32 first_ik_chain = 0;
+		u32 ik_chains_count = 0;
+		u32 lod = 0;
+		// animators with equal nonzero keys evaluate to the same pose
+		u64 pose_key = 0;
+		// animator the pose is copied from, -1 to evaluate own pose
+		i32 pose_source = -1;
+
+		static constexpr u32 MAX_IK_COUNT = 4;
 		struct IK {
 			float weight = 0;
 			Vec3 target;
-		} inverse_kinematics[4];
+		} inverse_kinematics[MAX_IK_COUNT];
 	};
 
 
@@ -87,6 +113,40 @@ struct AnimationSceneImpl final : AnimationScene
 	};
 
 
+	// events emitted by one thread, merged into m_events by flushEvents
+	struct EventQueue
+	{
+		struct Event {
+			AnimationEventType type;
+			EntityRef entity;
+			u32 offset;
+			u32 size;
+		};
+
+		EventQueue(OS::ThreadID thread_id, IAllocator& allocator)
+			: thread_id(thread_id)
+			, events(allocator)
+			, data(allocator)
+		{}
+
+		OS::ThreadID thread_id;
+		Array<Event> events;
+		OutputMemoryStream data;
+	};
+
+
+	struct EventList
+	{
+		EventList(IAllocator& allocator)
+			: events(allocator)
+			, data(allocator)
+		{}
+
+		Array<AnimationEvent> events;
+		OutputMemoryStream data;
+	};
+
+
 	AnimationSceneImpl(Engine& engine, IPlugin& anim_system, Universe& universe, IAllocator& allocator)
 		: m_universe(universe)
 		, m_engine(engine)
@@ -94,9 +154,14 @@ struct AnimationSceneImpl final : AnimationScene
 		, m_animables(allocator)
 		, m_property_animators(allocator)
 		, m_animators(allocator)
-		, m_event_stream(allocator)
+		, m_event_queues(allocator)
+		, m_events(allocator)
 		, m_allocator(allocator)
 		, m_animator_map(allocator)
+		, m_pose_sources(allocator)
+		, m_ik_chains(allocator)
+		, m_ik_order(allocator)
+		, m_ik_batches(allocator)
 	{
 		m_is_game_running = false;
 		m_render_scene = static_cast<RenderScene*>(universe.getScene(crc32("renderer")));
@@ -113,15 +178,89 @@ struct AnimationSceneImpl final : AnimationScene
 			, &AnimationSceneImpl::createAnimator
 			, &AnimationSceneImpl::destroyAnimator);
 		ASSERT(m_render_scene);
+		m_instance_id = atomicIncrement(&s_instance_counter);
+		for (u32 i = 0; i < (u32)AnimationEventType::COUNT; ++i) m_events.emplace(allocator);
+	}
+
+
+	~AnimationSceneImpl()
+	{
+		for (EventQueue* queue : m_event_queues) LUMIX_DELETE(m_allocator, queue);
 	}
 
 
 	int getVersion() const override { return (int)AnimationSceneVersion::LATEST; }
+	bool isDeserializeThreadSafe() const override { return true; }
 
 
-	const OutputMemoryStream& getEventStream() const override
+	EventQueue& getEventQueue() {
+		struct Cache {
+			i32 scene_id;
+			EventQueue* queue = nullptr;
+		};
+		static thread_local Cache cache;
+		if (cache.queue && cache.scene_id == m_instance_id) return *cache.queue;
+
+		const OS::ThreadID thread_id = OS::getCurrentThreadID();
+		MutexGuard guard(m_event_queues_mutex);
+		cache.scene_id = m_instance_id;
+		for (EventQueue* queue : m_event_queues) {
+			if (queue->thread_id == thread_id) {
+				cache.queue = queue;
+				return *queue;
+			}
+		}
+		cache.queue = LUMIX_NEW(m_allocator, EventQueue)(thread_id, m_allocator);
+		m_event_queues.push(cache.queue);
+		return *cache.queue;
+	}
+
+
+	void emitEvent(AnimationEventType type, EntityRef entity, const void* data, u32 size) override
+	{
+		ASSERT(type < AnimationEventType::COUNT);
+		EventQueue& queue = getEventQueue();
+		queue.events.push({type, entity, (u32)queue.data.getPos(), size});
+		queue.data.write(data, size);
+	}
+
+
+	Span<const AnimationEvent> getEvents(AnimationEventType type) const override
 	{
-		return m_event_stream;
+		const EventList& list = m_events[(u32)type];
+		return Span(list.events.begin(), list.events.size());
+	}
+
+
+	const u8* getEventsData(AnimationEventType type) const override
+	{
+		return m_events[(u32)type].data.getData();
+	}
+
+
+	void clearEvents()
+	{
+		for (EventList& list : m_events) {
+			list.events.clear();
+			list.data.clear();
+		}
+	}
+
+
+	// main thread, after all workers are finished
+	void flushEvents()
+	{
+		PROFILE_FUNCTION();
+		MutexGuard guard(m_event_queues_mutex);
+		for (EventQueue* queue : m_event_queues) {
+			for (const EventQueue::Event& event : queue->events) {
+				EventList& list = m_events[(u32)event.type];
+				list.events.push({event.entity, (u32)list.data.getPos(), event.size});
+				list.data.write(queue->data.getData() + event.offset, event.size);
+			}
+			queue->events.clear();
+			queue->data.clear();
+		}
 	}
 
 
@@ -537,9 +676,10 @@ struct AnimationSceneImpl final : AnimationScene
 
 	void updateAnimator(EntityRef entity, float time_delta) override {
 		Animator& animator = m_animators[m_animator_map[entity]];
-		updateAnimator(animator, time_delta);
-		processEventStream();
-		m_event_stream.clear();
+		if (updateAnimatorController(animator, time_delta, 0)) evaluateAnimatorPose(animator, false);
+		applyAnimatorUpdate(animator);
+		flushEvents();
+		processEvents();
 	}
 
 	void setAnimatorInput(EntityRef entity, u32 input_idx, float value) override {
@@ -600,154 +740,460 @@ struct AnimationSceneImpl final : AnimationScene
 		return animator.default_set;
 	}
 
-	void updateAnimator(Animator& animator, float time_delta)
+	void setAnimatorLODSettings(const AnimatorLODSettings& settings) override { m_lod_settings = settings; }
+	const AnimatorLODSettings& getAnimatorLODSettings() const override { return m_lod_settings; }
+
+	struct LODCamera {
+		bool valid = false;
+		ShiftedFrustum frustum;
+		DVec3 pos;
+		bool is_ortho;
+		// radius * screen_size_multiplier / distance = screen size
+		float screen_size_multiplier;
+	};
+
+	LODCamera getLODCamera() const {
+		LODCamera res;
+		if (!m_lod_settings.enabled) return res;
+		const EntityPtr camera = m_render_scene->getActiveCamera();
+		if (!camera.isValid()) return res;
+
+		const Viewport vp = m_render_scene->getCameraViewport((EntityRef)camera);
+		res.valid = true;
+		res.frustum = vp.getFrustum();
+		res.pos = vp.pos;
+		res.is_ortho = vp.is_ortho;
+		res.screen_size_multiplier = vp.is_ortho ? 1 / vp.ortho_size : 1 / tanf(vp.fov * 0.5f);
+		return res;
+	}
+
+	// 0, 1, 2, or 3 if the animator is not visible
+	u32 computeLOD(const Animator& animator, const LODCamera& camera) const {
+		enum { OFFSCREEN = 3 };
+		if (!camera.valid) return 0;
+		if (!m_universe.hasComponent(animator.entity, MODEL_INSTANCE_TYPE)) return 0;
+		const Model* model = m_render_scene->getModelInstanceModel(animator.entity);
+		if (!model || !model->isReady()) return 0;
+
+		const Transform tr = m_universe.getTransform(animator.entity);
+		const float radius = model->getBoundingRadius() * tr.scale;
+		if (!camera.frustum.intersectsAABB(tr.pos - Vec3(radius), Vec3(radius * 2))) return OFFSCREEN;
+
+		const float dist = camera.is_ortho ? 1.f : maximum(float((tr.pos - camera.pos).length()), 0.001f);
+		const float screen_size = radius * camera.screen_size_multiplier / dist;
+		if (screen_size < m_lod_settings.screen_size[1]) return 2;
+		if (screen_size < m_lod_settings.screen_size[0]) return 1;
+		return 0;
+	}
+
+	// hash of everything evaluateAnimatorPose depends on, 0 if the pose can not be shared
+	u64 computePoseKey(const Animator& animator, u32 mask, bool use_ik) const {
+		if (use_ik) {
+			for (const Animator::IK& ik : animator.inverse_kinematics) {
+				if (ik.weight != 0) return 0;
+			}
+		}
+
+		const Anim::RuntimeContext& ctx = *animator.ctx;
+		struct {
+			const void* controller;
+			const void* model;
+			u64 data;
+			u64 inputs;
+			u64 animations;
+			u32 mask;
+			u32 padding = 0;
+		} key;
+		key.controller = animator.resource;
+		key.model = ctx.model;
+		key.data = hash64(ctx.data.getData(), (u32)ctx.data.getPos());
+		key.inputs = hash64(ctx.inputs.begin(), ctx.inputs.byte_size());
+		key.animations = hash64(ctx.animations.begin(), ctx.animations.byte_size());
+		key.mask = mask;
+		const u64 res = hash64(&key, sizeof(key));
+		return res == 0 ? 1 : res;
+	}
+
+	// can run on any thread, updates controller's state and root motion, returns true if the pose should be evaluated
+	// changes which touch other entities are stored in `animator` and applied by applyAnimatorUpdate
+	bool updateAnimatorController(Animator& animator, float time_delta, u32 lod)
 	{
-		if (!animator.resource || !animator.resource->isReady()) return;
+		animator.pose_changed = false;
+		animator.root_motion_moved = false;
+		animator.needs_pose = false;
+		animator.pose_key = 0;
+		animator.pose_source = -1;
+		if (!animator.resource || !animator.resource->isReady()) return false;
 		if (!animator.ctx) {
 			animator.ctx = animator.resource->createRuntime(animator.default_set);
+			animator.lod_masks[0] = animator.resource->getBoneMaskIndex("lod1");
+			animator.lod_masks[1] = animator.resource->getBoneMaskIndex("lod2");
 		}
 
 		const EntityRef entity = animator.entity;
-		if (!m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) return;
+		if (!m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) return false;
 
 		Model* model = m_render_scene->getModelInstanceModel(entity);
-		if (!model->isReady()) return;
+		if (!model->isReady()) return false;
 
-		Pose* pose = m_render_scene->lockPose(entity);
-		if (!pose) return;
+		if (!m_render_scene->lockPose(entity)) return false;
 
 		animator.ctx->model = model;
 		animator.ctx->time_delta = Time::fromSeconds(time_delta);
 		// TODO
-		animator.ctx->root_bone_hash = crc32("RigRoot");
+		animator.ctx->root_bone_hash = StringHash("RigRoot");
 		animator.resource->update(*animator.ctx, Ref(animator.root_motion));
 
-		if (animator.resource->m_flags.isSet(Anim::Controller::Flags::USE_ROOT_MOTION)) {
+		const bool use_root_motion = animator.resource->m_flags.isSet(Anim::Controller::Flags::USE_ROOT_MOTION);
+		if (use_root_motion) {
 			Transform tr = m_universe.getTransform(entity);
 			tr.rot = tr.rot * animator.root_motion.rot; 
 			tr.pos = tr.pos + tr.rot.rotate(animator.root_motion.pos);
-			m_universe.setTransform(entity, tr);
+			animator.root_motion_tr = tr;
+			animator.root_motion_moved = true;
 		}
 
-		model->getRelativePose(*pose);
-		animator.resource->getPose(*animator.ctx, Ref(*pose));
-		
-		for (Animator::IK& ik : animator.inverse_kinematics) {
-			if (ik.weight == 0) break;
-			const u32 idx = u32(&ik - animator.inverse_kinematics);
-			updateIK(animator.resource->m_ik[idx], ik, *pose, *model);
+		animator.lod = lod;
+		animator.needs_pose = true;
+		if (m_pose_sharing) {
+			animator.pose_key = computePoseKey(animator, getAnimatorMask(animator), useIK(animator));
 		}
+		return true;
+	}
 
-		pose->computeAbsolute(*model);
+	u32 getAnimatorMask(const Animator& animator) const {
+		return animator.lod == 0 ? 0xffFFffFF : animator.lod_masks[animator.lod == 1 ? 0 : 1];
+	}
 
-		m_render_scene->unlockPose(entity, true);
+	bool useIK(const Animator& animator) const {
+		return animator.lod == 0 || !m_lod_settings.ik_only_in_lod0;
 	}
 
-	static LocalRigidTransform getAbsolutePosition(const Pose& pose, const Model& model, int bone_index)
+	// can run on any thread, after updateAnimatorController
+	// with `defer_ik`, IK chains are left to update, which solves chains of all animators in batches
+	void evaluateAnimatorPose(Animator& animator, bool defer_ik)
 	{
-		const Model::Bone& bone = model.getBone(bone_index);
-		LocalRigidTransform bone_transform{pose.positions[bone_index], pose.rotations[bone_index]};
-		if (bone.parent_idx < 0)
-		{
-			return bone_transform;
+		ASSERT(animator.needs_pose);
+		const EntityRef entity = animator.entity;
+		Model* model = animator.ctx->model;
+		Pose* pose = m_render_scene->lockPose(entity);
+
+		model->getRelativePose(*pose);
+		animator.resource->getPose(*animator.ctx, Ref(*pose), getAnimatorMask(animator));
+		
+		const u32 ik_count = getIKChainsCount(animator);
+		if (ik_count > 0 && defer_ik) {
+			animator.needs_ik = true;
+			animator.needs_pose = false;
+			return;
+		}
+
+		if (ik_count > 0) {
+			IKChain chains[Animator::MAX_IK_COUNT];
+			for (u32 i = 0; i < ik_count; ++i) chains[i].ik = i;
+			prepareIKChains(Span(chains, ik_count), animator, *pose, *model);
+			for (u32 i = 0; i < ik_count; ++i) {
+				if (chains[i].bones_count == 0) continue;
+				IKChain* const batch[4] = { &chains[i], &chains[i], &chains[i], &chains[i] };
+				solveIKBatch(batch);
+				applyIKChain(chains[i], *pose);
+			}
 		}
-		return getAbsolutePosition(pose, model, bone.parent_idx) * bone_transform;
+		finishAnimatorPose(animator);
 	}
 
-	static void updateIK(Anim::Controller::IK& res_ik, Animator::IK& ik, Pose& pose, Model& model)
+	void finishAnimatorPose(Animator& animator)
 	{
-		u32 indices[Anim::Controller::IK::MAX_BONES_COUNT];
-		LocalRigidTransform transforms[Anim::Controller::IK::MAX_BONES_COUNT];
-		Vec3 old_pos[Anim::Controller::IK::MAX_BONES_COUNT];
-		float len[Anim::Controller::IK::MAX_BONES_COUNT - 1];
-		float len_sum = 0;
-		for (int i = 0; i < res_ik.bones_count; ++i) {
-			auto iter = model.getBoneIndex(res_ik.bones[i]);
-			if (!iter.isValid()) return;
+		Pose* pose = m_render_scene->lockPose(animator.entity);
+		pose->computeAbsolute(*animator.ctx->model);
+
+		// bone attachments are updated in applyAnimatorUpdate, they set transforms of other entities
+		m_render_scene->unlockPose(animator.entity, false);
+		animator.pose_changed = true;
+		animator.needs_pose = false;
+		animator.needs_ik = false;
+	}
+
+	// can run on any thread, `src` must have its pose evaluated
+	void copyAnimatorPose(Animator& dst, const Animator& src)
+	{
+		ASSERT(dst.needs_pose && !src.needs_pose);
+		Pose* dst_pose = m_render_scene->lockPose(dst.entity);
+		const Pose* src_pose = m_render_scene->lockPose(src.entity);
+		ASSERT(dst_pose->count == src_pose->count);
+		memcpy(dst_pose->positions, src_pose->positions, sizeof(dst_pose->positions[0]) * src_pose->count);
+		memcpy(dst_pose->rotations, src_pose->rotations, sizeof(dst_pose->rotations[0]) * src_pose->count);
+		dst_pose->is_absolute = src_pose->is_absolute;
+		m_render_scene->unlockPose(src.entity, false);
+		m_render_scene->unlockPose(dst.entity, false);
+		dst.pose_changed = true;
+		dst.needs_pose = false;
+	}
+
+	void enablePoseSharing(bool enable) override { m_pose_sharing = enable; }
+	void setAnimatorTimeQuantum(float seconds) override { m_time_quantum = maximum(seconds, 0.f); }
 
-			indices[i] = iter.value();
+	void offsetAnimatorTime(EntityRef entity, float seconds) override {
+		Animator& animator = m_animators[m_animator_map[entity]];
+		animator.accumulated_time = maximum(animator.accumulated_time + seconds, 0.f);
+	}
+
+	u32 bakeAnimations(Model& model, Span<Animation* const> animations, float fps) override {
+		PROFILE_FUNCTION();
+		if (!model.isReady() || model.getBoneCount() == 0 || fps <= 0) return BakedAnimation::INVALID;
+		for (Animation* anim : animations) {
+			if (!anim || !anim->isReady()) return BakedAnimation::INVALID;
 		}
 
-		// convert from bone space to object space
-		const Model::Bone& first_bone = model.getBone(indices[0]);
-		LocalRigidTransform roots_parent;
-		if (first_bone.parent_idx >= 0) {
-			roots_parent = getAbsolutePosition(pose, model, first_bone.parent_idx);
+		const u32 bones_count = (u32)model.getBoneCount();
+		Array<BakedAnimationClip> clips(m_allocator);
+		u32 frames_count = 0;
+		for (Animation* anim : animations) {
+			BakedAnimationClip& clip = clips.emplace();
+			clip.first_frame = frames_count;
+			clip.frames_count = maximum(u32(anim->getLength().seconds() * fps) + 1, 1u);
+			clip.fps = fps;
+			frames_count += clip.frames_count;
 		}
-		else {
-			roots_parent.pos = Vec3::ZERO;
-			roots_parent.rot = Quat::IDENTITY;
-		}
-
-		LocalRigidTransform parent_tr = roots_parent;
-		for (int i = 0; i < res_ik.bones_count; ++i) {
-			LocalRigidTransform tr{pose.positions[indices[i]], pose.rotations[indices[i]]};
-			transforms[i] = parent_tr * tr;
-			old_pos[i] = transforms[i].pos;
-			if (i > 0) {
-				len[i - 1] = (transforms[i].pos - transforms[i - 1].pos).length();
-				len_sum += len[i - 1];
+
+		Array<LocalRigidTransform> poses(m_allocator);
+		poses.resize(frames_count * bones_count);
+		Pose pose(m_allocator);
+		pose.resize(bones_count);
+		for (u32 i = 0; i < animations.length(); ++i) {
+			const Animation* anim = animations[i];
+			const float length = anim->getLength().seconds();
+			for (u32 f = 0; f < clips[i].frames_count; ++f) {
+				model.getRelativePose(pose);
+				const float t = minimum(f / fps, length);
+				anim->getRelativePose(Time::fromSeconds(t), pose, model, nullptr);
+				pose.computeAbsolute(model);
+				LocalRigidTransform* dst = &poses[(clips[i].first_frame + f) * bones_count];
+				for (u32 b = 0; b < bones_count; ++b) {
+					dst[b] = {pose.positions[b], pose.rotations[b]};
+				}
 			}
-			parent_tr = transforms[i];
 		}
 
-		Vec3 target = ik.target;
-		Vec3 to_target = target - transforms[0].pos;
-		if (len_sum * len_sum < to_target.squaredLength()) {
-			to_target.normalize();
-			target = transforms[0].pos + to_target * len_sum;
+		return m_render_scene->createBakedAnimation(model, clips, poses);
+	}
+
+	// main thread
+	void applyAnimatorUpdate(Animator& animator) {
+		if (animator.root_motion_moved) m_universe.setTransform(animator.entity, animator.root_motion_tr);
+		if (animator.pose_changed) m_render_scene->unlockPose(animator.entity, true);
+		animator.root_motion_moved = false;
+		animator.pose_changed = false;
+	}
+
+	// FABRIK chain, prepared from the pose, positions solved 4 chains at a time by solveIKBatch
+	struct IKChain {
+		static constexpr u32 MAX_BONES_COUNT = Anim::Controller::IK::MAX_BONES_COUNT;
+
+		u32 animator;
+		u32 ik;
+		// 0 if the chain is not solved
+		u32 bones_count;
+		u32 max_iterations;
+		float weight;
+		Vec3 target;
+		u32 indices[MAX_BONES_COUNT];
+		LocalRigidTransform roots_parent;
+		// object space
+		LocalRigidTransform transforms[MAX_BONES_COUNT];
+		Vec3 old_pos[MAX_BONES_COUNT];
+		float len[MAX_BONES_COUNT - 1];
+	};
+
+	// chains of one animator are prepared from the pose before any of them is applied
+	// chains sharing the same root's parent compute its absolute transform only once
+	static void prepareIKChains(Span<IKChain> chains, const Animator& animator, const Pose& pose, const Model& model)
+	{
+		i32 prev_parent = -2;
+		LocalRigidTransform prev_parent_tr;
+		for (IKChain& chain : chains) {
+			const Anim::Controller::IK& res_ik = animator.resource->m_ik[chain.ik];
+			chain.bones_count = 0;
+			if (res_ik.bones_count < 2) continue;
+			bool valid = true;
+			for (u32 i = 0; i < res_ik.bones_count; ++i) {
+				auto iter = model.getBoneIndex(res_ik.bones[i]);
+				if (!iter.isValid()) {
+					valid = false;
+					break;
+				}
+				chain.indices[i] = iter.value();
+			}
+			if (!valid) continue;
+
+			// convert from bone space to object space
+			const i32 parent_idx = model.getBone(chain.indices[0]).parent_idx;
+			if (parent_idx != prev_parent) {
+				prev_parent = parent_idx;
+				prev_parent_tr = {Vec3::ZERO, Quat::IDENTITY};
+				for (i32 b = parent_idx; b >= 0; b = model.getBone(b).parent_idx) {
+					prev_parent_tr = LocalRigidTransform{pose.positions[b], pose.rotations[b]} * prev_parent_tr;
+				}
+			}
+			chain.roots_parent = prev_parent_tr;
+
+			chain.bones_count = res_ik.bones_count;
+			chain.max_iterations = res_ik.max_iterations;
+			chain.weight = animator.inverse_kinematics[chain.ik].weight;
+			float len_sum = 0;
+			LocalRigidTransform parent_tr = chain.roots_parent;
+			for (u32 i = 0; i < chain.bones_count; ++i) {
+				const u32 idx = chain.indices[i];
+				chain.transforms[i] = parent_tr * LocalRigidTransform{pose.positions[idx], pose.rotations[idx]};
+				chain.old_pos[i] = chain.transforms[i].pos;
+				if (i > 0) {
+					chain.len[i - 1] = (chain.transforms[i].pos - chain.transforms[i - 1].pos).length();
+					len_sum += chain.len[i - 1];
+				}
+				parent_tr = chain.transforms[i];
+			}
+
+			Vec3 target = animator.inverse_kinematics[chain.ik].target;
+			Vec3 to_target = target - chain.transforms[0].pos;
+			if (len_sum * len_sum < to_target.squaredLength()) {
+				to_target.normalize();
+				target = chain.transforms[0].pos + to_target * len_sum;
+			}
+			chain.target = target;
 		}
+	}
 
-		for (int iteration = 0; iteration < res_ik.max_iterations; ++iteration) {
-			transforms[res_ik.bones_count - 1].pos = target;
-			
-			for (int i = res_ik.bones_count - 1; i > 1; --i) {
-				Vec3 dir = (transforms[i - 1].pos - transforms[i].pos).normalized();
-				transforms[i - 1].pos = transforms[i].pos + dir * len[i - 1];
+	// moves p[to] `len` away from p[from] towards its current position, for each lane
+	static LUMIX_FORCE_INLINE void fabrikStep(float4* x, float4* y, float4* z, u32 from, u32 to, float4 len)
+	{
+		const float4 dx = f4Sub(x[to], x[from]);
+		const float4 dy = f4Sub(y[to], y[from]);
+		const float4 dz = f4Sub(z[to], z[from]);
+		const float4 sq = f4Add(f4Add(f4Mul(dx, dx), f4Mul(dy, dy)), f4Mul(dz, dz));
+		const float4 k = f4Div(len, f4Sqrt(f4Max(sq, f4Splat(1e-12f))));
+		x[to] = f4Add(x[from], f4Mul(dx, k));
+		y[to] = f4Add(y[from], f4Mul(dy, k));
+		z[to] = f4Add(z[from], f4Mul(dz, k));
+	}
+
+	// solves positions of 4 chains with the same bones and iterations count, lanes can repeat a chain
+	static void solveIKBatch(IKChain* const* chains)
+	{
+		const u32 n = chains[0]->bones_count;
+		float4 x[IKChain::MAX_BONES_COUNT], y[IKChain::MAX_BONES_COUNT], z[IKChain::MAX_BONES_COUNT];
+		float4 len[IKChain::MAX_BONES_COUNT - 1];
+		alignas(16) float tmp[3][4];
+		for (u32 i = 0; i < n; ++i) {
+			for (u32 l = 0; l < 4; ++l) {
+				const Vec3& p = chains[l]->transforms[i].pos;
+				tmp[0][l] = p.x;
+				tmp[1][l] = p.y;
+				tmp[2][l] = p.z;
 			}
+			x[i] = f4Load(tmp[0]);
+			y[i] = f4Load(tmp[1]);
+			z[i] = f4Load(tmp[2]);
+			if (i == 0) continue;
+			for (u32 l = 0; l < 4; ++l) tmp[0][l] = chains[l]->len[i - 1];
+			len[i - 1] = f4Load(tmp[0]);
+		}
+		for (u32 l = 0; l < 4; ++l) {
+			tmp[0][l] = chains[l]->target.x;
+			tmp[1][l] = chains[l]->target.y;
+			tmp[2][l] = chains[l]->target.z;
+		}
+		const float4 tx = f4Load(tmp[0]);
+		const float4 ty = f4Load(tmp[1]);
+		const float4 tz = f4Load(tmp[2]);
+
+		for (u32 iteration = 0; iteration < chains[0]->max_iterations; ++iteration) {
+			x[n - 1] = tx;
+			y[n - 1] = ty;
+			z[n - 1] = tz;
+			for (u32 i = n - 1; i > 1; --i) fabrikStep(x, y, z, i, i - 1, len[i - 1]);
+			for (u32 i = 1; i < n; ++i) fabrikStep(x, y, z, i - 1, i, len[i - 1]);
+		}
 
-			for (int i = 1; i < res_ik.bones_count; ++i) {
-				Vec3 dir = (transforms[i].pos - transforms[i - 1].pos).normalized();
-				transforms[i].pos = transforms[i - 1].pos + dir * len[i - 1];
+		for (u32 i = 0; i < n; ++i) {
+			f4Store(tmp[0], x[i]);
+			f4Store(tmp[1], y[i]);
+			f4Store(tmp[2], z[i]);
+			for (u32 l = 0; l < 4; ++l) {
+				chains[l]->transforms[i].pos = Vec3(tmp[0][l], tmp[1][l], tmp[2][l]);
 			}
 		}
+	}
 
-		// compute rotations from new positions
-		for (int i = res_ik.bones_count - 2; i >= 0; --i) {
-			Vec3 old_d = old_pos[i + 1] - old_pos[i];
-			Vec3 new_d = transforms[i + 1].pos - transforms[i].pos;
+	// computes rotations from solved positions and blends the chain into the pose
+	static void applyIKChain(IKChain& chain, Pose& pose)
+	{
+		const u32 n = chain.bones_count;
+		LocalRigidTransform* transforms = chain.transforms;
+		for (i32 i = n - 2; i >= 0; --i) {
+			const Vec3 old_d = chain.old_pos[i + 1] - chain.old_pos[i];
+			const Vec3 new_d = transforms[i + 1].pos - transforms[i].pos;
 
-			Quat rel_rot = Quat::vec3ToVec3(old_d, new_d);
+			const Quat rel_rot = Quat::vec3ToVec3(old_d, new_d);
 			transforms[i].rot = rel_rot * transforms[i].rot;
 		}
 
 		// convert from object space to bone space
-		LocalRigidTransform ik_out[Anim::Controller::IK::MAX_BONES_COUNT];
-		for (int i = res_ik.bones_count - 1; i > 0; --i) {
+		LocalRigidTransform ik_out[IKChain::MAX_BONES_COUNT];
+		for (u32 i = n - 1; i > 0; --i) {
 			transforms[i] = transforms[i - 1].inverted() * transforms[i];
 			ik_out[i].pos = transforms[i].pos;
 		}
-		for (int i = res_ik.bones_count - 2; i > 0; --i) {
+		for (u32 i = n - 2; i > 0; --i) {
 			ik_out[i].rot = transforms[i].rot;
 		}
-		ik_out[res_ik.bones_count - 1].rot = pose.rotations[indices[res_ik.bones_count - 1]];
+		ik_out[n - 1].rot = pose.rotations[chain.indices[n - 1]];
+		ik_out[0].rot = chain.roots_parent.rot.conjugated() * transforms[0].rot;
+		ik_out[0].pos = pose.positions[chain.indices[0]];
 
-		if (first_bone.parent_idx >= 0) {
-			ik_out[0].rot = roots_parent.rot.conjugated() * transforms[0].rot;
+		const float w = chain.weight;
+		for (u32 i = 0; i < n; ++i) {
+			const u32 idx = chain.indices[i];
+			pose.positions[idx] = lerp(pose.positions[idx], ik_out[i].pos, w);
+			pose.rotations[idx] = nlerp(pose.rotations[idx], ik_out[i].rot, w);
 		}
-		else {
-			ik_out[0].rot = transforms[0].rot;
+	}
+
+	// chains with the same bones and iterations count are grouped in batches of 4 lanes
+	static void batchIKChains(Span<IKChain> chains, Array<u64>& order, Array<IKChain*>& batches)
+	{
+		PROFILE_FUNCTION();
+		order.clear();
+		batches.clear();
+		for (u32 i = 0; i < chains.length(); ++i) {
+			const IKChain& chain = chains[i];
+			if (chain.bones_count == 0) continue;
+			order.push(((u64)chain.bones_count << 48) | ((u64)chain.max_iterations << 32) | i);
 		}
-		ik_out[0].pos = pose.positions[indices[0]];
+		qsort(order.begin(), order.size(), sizeof(order[0]), [](const void* a, const void* b) -> int {
+			const u64 ka = *(const u64*)a;
+			const u64 kb = *(const u64*)b;
+			return ka < kb ? -1 : (ka > kb ? 1 : 0);
+		});
 
-		const float w = ik.weight;
-		for (u32 i = 0; i < res_ik.bones_count; ++i) {
-			const u32 idx = indices[i];
-			pose.positions[idx] = lerp(pose.positions[idx], ik_out[i].pos, w);
-			pose.rotations[idx] = nlerp(pose.rotations[idx], ik_out[i].rot, w);
+		for (i32 i = 0, c = order.size(); i < c;) {
+			IKChain* first = &chains[u32(order[i])];
+			const u64 key = order[i] >> 32;
+			u32 count = 0;
+			while (count < 4 && i < c && (order[i] >> 32) == key) {
+				batches.push(&chains[u32(order[i])]);
+				++count;
+				++i;
+			}
+			for (u32 l = count; l < 4; ++l) batches.push(first);
 		}
 	}
 
+	u32 getIKChainsCount(const Animator& animator) const {
+		if (!useIK(animator)) return 0;
+		u32 count = 0;
+		while (count < Animator::MAX_IK_COUNT && animator.inverse_kinematics[count].weight != 0) ++count;
+		return count;
+	}
 
 	void applyPropertyAnimator(EntityRef entity, PropertyAnimator& animator)
 	{
@@ -801,9 +1247,63 @@ struct AnimationSceneImpl final : AnimationScene
 		PROFILE_FUNCTION();
 		if (m_animables.size() == 0) return;
 
-		JobSystem::forEach(m_animables.size(), [&](int idx){
-			Animable& animable = m_animables.at(idx);
-			updateAnimable(animable, time_delta);
+		JobSystem::forEach(m_animables.size(), 0, [&](u32 from, u32 to){
+			for (u32 i = from; i < to; ++i) {
+				Animable& animable = m_animables.at(i);
+				updateAnimable(animable, time_delta);
+			}
+		});
+	}
+
+
+	// IK chains of all animators evaluated with deferred IK, solved 4 chains at a time
+	void updateIK()
+	{
+		m_ik_chains.clear();
+		for (i32 i = 0, c = m_animators.size(); i < c; ++i) {
+			Animator& animator = m_animators[i];
+			if (!animator.needs_ik) continue;
+			animator.first_ik_chain = m_ik_chains.size();
+			animator.ik_chains_count = getIKChainsCount(animator);
+			for (u32 j = 0; j < animator.ik_chains_count; ++j) {
+				IKChain& chain = m_ik_chains.emplace();
+				chain.animator = i;
+				chain.ik = j;
+			}
+		}
+		if (m_ik_chains.empty()) return;
+
+		PROFILE_FUNCTION();
+		Profiler::pushInt("chains", m_ik_chains.size());
+		JobSystem::forEach(m_animators.size(), 16, [&](u32 from, u32 to){
+			PROFILE_BLOCK("prepare IK");
+			for (u32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (!animator.needs_ik) continue;
+				const Pose& pose = *m_render_scene->lockPose(animator.entity);
+				prepareIKChains(Span(&m_ik_chains[animator.first_ik_chain], animator.ik_chains_count), animator, pose, *animator.ctx->model);
+				m_render_scene->unlockPose(animator.entity, false);
+			}
+		});
+
+		batchIKChains(m_ik_chains, m_ik_order, m_ik_batches);
+		JobSystem::forEach(m_ik_batches.size() / 4, 8, [&](u32 from, u32 to){
+			PROFILE_BLOCK("solve IK");
+			for (u32 idx = from; idx < to; ++idx) solveIKBatch(&m_ik_batches[idx * 4]);
+		});
+
+		JobSystem::forEach(m_animators.size(), 16, [&](u32 from, u32 to){
+			PROFILE_BLOCK("apply IK");
+			for (u32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (!animator.needs_ik) continue;
+				Pose& pose = *m_render_scene->lockPose(animator.entity);
+				for (u32 i = 0; i < animator.ik_chains_count; ++i) {
+					IKChain& chain = m_ik_chains[animator.first_ik_chain + i];
+					if (chain.bones_count > 0) applyIKChain(chain, pose);
+				}
+				finishAnimatorPose(animator);
+			}
 		});
 	}
 
@@ -814,58 +1314,107 @@ struct AnimationSceneImpl final : AnimationScene
 		if (!m_is_game_running) return;
 		if (paused) return;
 
-		m_event_stream.clear();
+		clearEvents();
 
 		updateAnimables(time_delta);
 		updatePropertyAnimators(time_delta);
 
-		i32 animator_idx = 0;
-		JobSystem::runOnWorkers([&](){
+		// workers touch only their animator's data, anything that changes other entities is applied after all animators are updated
+		const LODCamera lod_camera = getLODCamera();
+		JobSystem::forEach(m_animators.size(), 16, [&](u32 from, u32 to){
 			PROFILE_BLOCK("update animators");
-			for(;;) {
-				const i32 idx = atomicIncrement(&animator_idx) - 1;
-				if (idx >= (i32)m_animators.size()) return;
-				updateAnimator(m_animators[idx], time_delta);
+			for (u32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				animator.needs_pose = false;
+				const u32 lod = computeLOD(animator, lod_camera);
+				const u32 interval = maximum(lod < 3 ? m_lod_settings.update_interval[lod] : m_lod_settings.offscreen_update_interval, 1u);
+				animator.accumulated_time += time_delta;
+				if (animator.frames_to_update >= interval) animator.frames_to_update = interval - 1;
+				if (animator.frames_to_update > 0) {
+					--animator.frames_to_update;
+					continue;
+				}
+				float dt = animator.accumulated_time;
+				// with quantized time, animators started at the same time keep the same state and can share poses
+				if (m_time_quantum > 0) dt = floorf(dt / m_time_quantum) * m_time_quantum;
+				if (m_time_quantum > 0 && dt <= 0 && animator.ctx) continue;
+				animator.frames_to_update = interval - 1;
+				animator.accumulated_time -= dt;
+				updateAnimatorController(animator, dt, lod);
 			}
 		});
 
-		processEventStream();
+		if (m_pose_sharing) {
+			PROFILE_BLOCK("find shared poses");
+			m_pose_sources.clear();
+			for (i32 i = 0, c = m_animators.size(); i < c; ++i) {
+				Animator& animator = m_animators[i];
+				if (!animator.needs_pose || animator.pose_key == 0) continue;
+				auto iter = m_pose_sources.find(animator.pose_key);
+				if (iter.isValid()) animator.pose_source = iter.value();
+				else m_pose_sources.insert(animator.pose_key, i);
+			}
+		}
+
+		JobSystem::forEach(m_animators.size(), 16, [&](u32 from, u32 to){
+			PROFILE_BLOCK("evaluate poses");
+			for (u32 idx = from; idx < to; ++idx) {
+				Animator& animator = m_animators[idx];
+				if (animator.needs_pose && animator.pose_source < 0) evaluateAnimatorPose(animator, true);
+			}
+		});
+
+		updateIK();
+
+		if (m_pose_sharing) {
+			JobSystem::forEach(m_animators.size(), 64, [&](u32 from, u32 to){
+				PROFILE_BLOCK("copy shared poses");
+				for (u32 idx = from; idx < to; ++idx) {
+					Animator& animator = m_animators[idx];
+					if (animator.needs_pose) copyAnimatorPose(animator, m_animators[animator.pose_source]);
+				}
+			});
+		}
+
+		PROFILE_BLOCK("apply animators");
+		Array<EntityRef> moved_entities(getFrameAllocator());
+		Array<Transform> moved_transforms(getFrameAllocator());
+		for (Animator& animator : m_animators) {
+			if (!animator.root_motion_moved) continue;
+			moved_entities.push(animator.entity);
+			moved_transforms.push(animator.root_motion_tr);
+			animator.root_motion_moved = false;
+		}
+		m_universe.setTransforms(Span<const EntityRef>(moved_entities.begin(), moved_entities.end()), Span<const Transform>(moved_transforms.begin(), moved_transforms.end()));
+		// after root motion, attachments depend on the parent's transform
+		for (Animator& animator : m_animators) {
+			if (animator.pose_changed) applyAnimatorUpdate(animator);
+		}
+
+		flushEvents();
+		processEvents();
 	}
 
 
-	void processEventStream()
+	void processEvents()
 	{
-		InputMemoryStream blob(m_event_stream);
-		u32 set_input_type = crc32("set_input");
-		while (blob.getPosition() < blob.size())
-		{
-			u32 type;
-			u8 size;
-			EntityRef entity;
-			blob.read(type);
-			blob.read(entity);
-			blob.read(size);
-			if (type == set_input_type)
-			{
-				Anim::SetInputEvent event;
-				blob.read(event);
-				Animator& ctrl = m_animators[m_animator_map[entity]];
-				if (ctrl.resource->isReady())
-				{
-					Anim::InputDecl& decl = ctrl.resource->m_inputs;
-					Anim::InputDecl::Input& input = decl.inputs[event.input_idx];
-					switch (input.type)
-					{
-						case Anim::InputDecl::BOOL: *(bool*)&ctrl.ctx->inputs[input.offset] = event.b_value; break;
-						case Anim::InputDecl::U32: *(u32*)&ctrl.ctx->inputs[input.offset] = event.i_value; break;
-						case Anim::InputDecl::FLOAT: *(float*)&ctrl.ctx->inputs[input.offset] = event.f_value; break;
-						default: ASSERT(false); break;
-					}
-				}
-			}
-			else
-			{
-				blob.skip(size);
+		const EventList& list = m_events[(u32)AnimationEventType::SET_INPUT];
+		for (const AnimationEvent& event : list.events) {
+			Anim::SetInputEvent set_input;
+			ASSERT(event.size == sizeof(set_input));
+			memcpy(&set_input, list.data.getData() + event.offset, sizeof(set_input));
+			auto iter = m_animator_map.find(event.entity);
+			if (!iter.isValid()) continue;
+			Animator& ctrl = m_animators[iter.value()];
+			if (!ctrl.resource || !ctrl.resource->isReady() || !ctrl.ctx) continue;
+
+			Anim::InputDecl& decl = ctrl.resource->m_inputs;
+			Anim::InputDecl::Input& input = decl.inputs[set_input.input_idx];
+			switch (input.type) {
+				case Anim::InputDecl::BOOL: *(bool*)&ctrl.ctx->inputs[input.offset] = set_input.b_value; break;
+				case Anim::InputDecl::U32: *(u32*)&ctrl.ctx->inputs[input.offset] = set_input.i_value; break;
+				case Anim::InputDecl::FLOAT: *(float*)&ctrl.ctx->inputs[input.offset] = set_input.f_value; break;
+				default: ASSERT(false); break;
 			}
 		}
 	}
@@ -918,6 +1467,8 @@ struct AnimationSceneImpl final : AnimationScene
 		m_animator_map.insert(entity, m_animators.size());
 		Animator& animator = m_animators.emplace();
 		animator.entity = entity;
+		// spread skipped updates of animators in the same LOD over frames
+		animator.frames_to_update = entity.index & 7;
 
 		m_universe.onComponentCreated(entity, ANIMATOR_TYPE, this);
 	}
@@ -929,6 +1480,13 @@ struct AnimationSceneImpl final : AnimationScene
 	IAllocator& m_allocator;
 	Universe& m_universe;
 	IPlugin& m_anim_system;
+	AnimatorLODSettings m_lod_settings;
+	bool m_pose_sharing = false;
+	float m_time_quantum = 0;
+	HashMap<u64, i32> m_pose_sources;
+	Array<IKChain> m_ik_chains;
+	Array<u64> m_ik_order;
+	Array<IKChain*> m_ik_batches;
 	Engine& m_engine;
 	AssociativeArray<EntityRef, Animable> m_animables;
 	AssociativeArray<EntityRef, PropertyAnimator> m_property_animators;
@@ -936,10 +1494,18 @@ struct AnimationSceneImpl final : AnimationScene
 	Array<Animator> m_animators;
 	RenderScene* m_render_scene;
 	bool m_is_game_running;
-	OutputMemoryStream m_event_stream;
+	static i32 s_instance_counter;
+	i32 m_instance_id;
+	Mutex m_event_queues_mutex;
+	Array<EventQueue*> m_event_queues;
+	// indexed by AnimationEventType
+	Array<EventList> m_events;
 };
 
 
+i32 AnimationSceneImpl::s_instance_counter = 0;
+
+
 AnimationScene* AnimationScene::create(Engine& engine, IPlugin& plugin, Universe& universe, IAllocator& allocator)
 {
 	return LUMIX_NEW(allocator, AnimationSceneImpl)(engine, plugin, universe, allocator);
@@ -2,6 +2,7 @@
 
 
 #include "engine/lumix.h"
+#include "engine/crc32.h"
 #include "engine/plugin.h"
 
 
@@ -13,7 +14,7 @@ namespace Lumix
 
 struct Animation;
 struct IAllocator;
-struct OutputMemoryStream;
+struct Model;
 struct Path;
 
 namespace Anim
@@ -30,13 +31,65 @@ struct Animable
 };
 
 
+// animators far from the active camera are updated less often and with fewer bones
+// LOD is picked by the radius of the model's bounding sphere relative to half of the screen height
+// controller's bone masks named "lod1" and "lod2" (if any) limit sampled bones in those LODs
+struct AnimatorLODSettings
+{
+	bool enabled = true;
+	// screen size below which LOD 1 / LOD 2 is used
+	float screen_size[2] = { 0.15f, 0.05f };
+	// in frames, for LOD 0, 1, 2
+	u32 update_interval[3] = { 1, 2, 4 };
+	// animators outside of the camera frustum use LOD 2 bone mask
+	u32 offscreen_update_interval = 8;
+	bool ik_only_in_lod0 = true;
+};
+
+
+// events emitted by animators, each consumer reads only events of its type
+enum class AnimationEventType : u8
+{
+	SET_INPUT, // Anim::SetInputEvent
+	SOUND, // SoundAnimationEvent
+	LUA_CALL, // name of the called function, not zero terminated
+
+	COUNT
+};
+
+
+// event type names are resolved once, when the controller is loaded, not when events are processed
+inline AnimationEventType getAnimationEventType(u32 name_hash)
+{
+	switch (name_hash) {
+		case StringHash("set_input"): return AnimationEventType::SET_INPUT;
+		case StringHash("sound"): return AnimationEventType::SOUND;
+		case StringHash("lua_call"): return AnimationEventType::LUA_CALL;
+		default: return AnimationEventType::COUNT;
+	}
+}
+
+
+struct AnimationEvent
+{
+	EntityRef entity;
+	// payload in getEventsData
+	u32 offset;
+	u32 size;
+};
+
+
 struct AnimationScene : IScene
 {
 	static AnimationScene* create(Engine& engine, IPlugin& plugin, Universe& universe, IAllocator& allocator);
 	static void destroy(AnimationScene& scene);
 	static void registerLuaAPI(lua_State* L);
 
-	virtual const OutputMemoryStream& getEventStream() const = 0;
+	// can be called from any thread, events are delivered after the update of all animators
+	virtual void emitEvent(AnimationEventType type, EntityRef entity, const void* data, u32 size) = 0;
+	// events emitted in the last update
+	virtual Span<const AnimationEvent> getEvents(AnimationEventType type) const = 0;
+	virtual const u8* getEventsData(AnimationEventType type) const = 0;
 	virtual Path getPropertyAnimation(EntityRef entity) = 0;
 	virtual void setPropertyAnimation(EntityRef entity, const Path& path) = 0;
 	virtual bool isPropertyAnimatorEnabled(EntityRef entity) = 0;
@@ -58,6 +111,17 @@ struct AnimationScene : IScene
 	virtual void setAnimatorDefaultSet(EntityRef entity, u32 idx) = 0;
 	virtual u32 getAnimatorDefaultSet(EntityRef entity) = 0;
 	virtual float getAnimationLength(int animation_idx) = 0;
+	virtual void setAnimatorLODSettings(const AnimatorLODSettings& settings) = 0;
+	virtual const AnimatorLODSettings& getAnimatorLODSettings() const = 0;
+	// animators with the same controller, model, state and inputs evaluate one pose and copy it
+	virtual void enablePoseSharing(bool enable) = 0;
+	// animators' time advances in multiples of `seconds`, so crowds stay in sync and share more poses, 0 to disable
+	virtual void setAnimatorTimeQuantum(float seconds) = 0;
+	// shifts animator's time on its next update, e.g. to desynchronize a crowd
+	virtual void offsetAnimatorTime(EntityRef entity, float seconds) = 0;
+	// samples `animations` at `fps` into a renderer's baked animation, clip i is animations[i]
+	// returns BakedAnimation::INVALID if the model or any animation is not ready
+	virtual u32 bakeAnimations(Model& model, Span<Animation* const> animations, float fps) = 0;
 };
 
 
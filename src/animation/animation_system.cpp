@@ -100,7 +100,7 @@ struct AnimationSystemImpl final : IPlugin
 	void destroyScene(IScene* scene) override;
 	const char* getName() const override { return "animation"; }
 
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
 	Engine& m_engine;
 	AnimResourceManager<Animation> m_animation_manager;
 	AnimResourceManager<PropertyAnimation> m_property_animation_manager;
@@ -109,7 +109,7 @@ struct AnimationSystemImpl final : IPlugin
 
 
 AnimationSystemImpl::AnimationSystemImpl(Engine& engine)
-	: m_allocator(engine.getAllocator())
+	: m_allocator(engine.getAllocator(), "animation")
 	, m_engine(engine)
 	, m_animation_manager(m_allocator)
 	, m_property_animation_manager(m_allocator)
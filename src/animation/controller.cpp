@@ -92,7 +92,14 @@ void Controller::update(RuntimeContext& ctx, Ref<LocalRigidTransform> root_motio
 	}
 }
 
-void Controller::getPose(RuntimeContext& ctx, Ref<Pose> pose) {
+u32 Controller::getBoneMaskIndex(const char* name) const {
+	for (u32 i = 0, c = m_bone_masks.size(); i < c; ++i) {
+		if (equalStrings(m_bone_masks[i].name, name)) return i;
+	}
+	return 0xffFFffFF;
+}
+
+void Controller::getPose(RuntimeContext& ctx, Ref<Pose> pose, u32 mask) {
 	ASSERT(&ctx.controller == this);
 	ctx.input_runtime.set(ctx.data.getData(), ctx.data.getPos());
 	
@@ -104,7 +111,7 @@ void Controller::getPose(RuntimeContext& ctx, Ref<Pose> pose) {
 		root_bind_pose.rot = pose->rotations[root_bone_idx];
 	}
 	
-	m_root->getPose(ctx, 1.f, pose, 0xffFFffFF);
+	m_root->getPose(ctx, 1.f, pose, mask);
 	
 	// TODO this should be in AnimationNode
 	if (root_bone_iter.isValid()) {
@@ -27,7 +27,9 @@ public:
 	RuntimeContext* createRuntime(u32 anim_set);
 	void destroyRuntime(RuntimeContext& ctx);
 	void update(RuntimeContext& ctx, Ref<LocalRigidTransform> root_motion);
-	void getPose(RuntimeContext& ctx, Ref<struct Pose> pose);
+	void getPose(RuntimeContext& ctx, Ref<struct Pose> pose, u32 mask = 0xffFFffFF);
+	// 0xffFFffFF if there's no such mask
+	u32 getBoneMaskIndex(const char* name) const;
 	void initEmpty();
 	void destroy();
 
@@ -11,6 +11,7 @@
 #include "editor/world_editor.h"
 #include "engine/crc32.h"
 #include "engine/engine.h"
+#include "engine/file_system.h"
 #include "engine/hash_map.h"
 #include "engine/log.h"
 #include "engine/os.h"
@@ -74,7 +75,7 @@ struct AnimationAssetBrowserPlugin : AssetBrowser::IPlugin
 };
 
 
-struct PropertyAnimationAssetBrowserPlugin : AssetBrowser::IPlugin
+struct PropertyAnimationAssetBrowserPlugin : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 {
 	explicit PropertyAnimationAssetBrowserPlugin(StudioApp& app)
 		: m_app(app)
@@ -82,6 +83,21 @@ struct PropertyAnimationAssetBrowserPlugin : AssetBrowser::IPlugin
 		app.getAssetCompiler().registerExtension("anp", PropertyAnimation::TYPE);
 	}
 
+	bool compile(const Path& src) override {
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> src_data(m_app.getAllocator());
+		if (!fs.getContentSync(src, Ref(src_data))) return false;
+
+		OutputMemoryStream compiled(m_app.getAllocator());
+		if (!PropertyAnimation::compile(Span<const u8>(src_data.begin(), src_data.size()), compiled)) {
+			logError("Animation") << "Failed to compile " << src;
+			return false;
+		}
+		return m_app.getAssetCompiler().writeCompiledResource(src.c_str(), Span(compiled.getMutableData(), (u32)compiled.getPos()));
+	}
+
+	bool isThreadSafe() const override { return true; }
+
 	bool canCreateResource() const override { return true; }
 	const char* getFileDialogFilter() const override { return "Property animation\0*.anp\0"; }
 	const char* getFileDialogExtensions() const override { return "anp"; }
@@ -285,6 +301,8 @@ struct AnimControllerAssetBrowserPlugin : AssetBrowser::IPlugin, AssetCompiler::
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 	void onGUI(Span<Resource*> resources) override {}
 
 
@@ -396,6 +414,8 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		
 		const char* act_exts[] = { "act", nullptr };
 		m_app.getAssetCompiler().addPlugin(*m_anim_ctrl_plugin, act_exts);
+		const char* anp_exts[] = { "anp", nullptr };
+		m_app.getAssetCompiler().addPlugin(*m_prop_anim_plugin, anp_exts);
 
 		AssetBrowser& asset_browser = m_app.getAssetBrowser();
 		asset_browser.addPlugin(*m_animtion_plugin);
@@ -412,6 +432,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 	~StudioAppPlugin()
 	{
 		m_app.getAssetCompiler().removePlugin(*m_anim_ctrl_plugin);
+		m_app.getAssetCompiler().removePlugin(*m_prop_anim_plugin);
 
 		AssetBrowser& asset_browser = m_app.getAssetBrowser();
 		asset_browser.removePlugin(*m_animtion_plugin);
@@ -80,10 +80,22 @@ RuntimeContext::RuntimeContext(Controller& controller, IAllocator& allocator)
 	, inputs(allocator)
 	, controller(controller)
 	, animations(allocator)
+	, bindings(allocator)
 	, input_runtime(nullptr, 0)
 {
 }
 
+AnimationBinding& RuntimeContext::getBinding(u32 slot, u32 mask_idx) {
+	const u32 masks_count = controller.m_bone_masks.size();
+	if (bindings.empty()) {
+		const u32 count = animations.size() * (masks_count + 1);
+		bindings.reserve(count);
+		for (u32 i = 0; i < count; ++i) bindings.emplace(controller.m_allocator);
+	}
+	const u32 mask_offset = mask_idx < masks_count ? mask_idx + 1 : 0;
+	return bindings[slot * (masks_count + 1) + mask_offset];
+}
+
 static u32 getInputByteOffset(Controller& controller, u32 input_idx) {
 	u32 offset = 0;
 	for (u32 i = 0; i < input_idx; ++i) {
@@ -169,15 +181,20 @@ void Blend1DNode::skip(RuntimeContext& ctx) const {
 	ctx.input_runtime.skip(sizeof(Time));
 }
 
-static void getPose(const RuntimeContext& ctx, Time time, float weight, u32 slot, Ref<Pose> pose, u32 mask_idx) {
+static void getPose(RuntimeContext& ctx, Time time, float weight, u32 slot, Ref<Pose> pose, u32 mask_idx) {
 	Animation* anim = ctx.animations[slot];
 	if (!anim) return;
+	if (!anim->isReady()) return;
 	if (!ctx.model->isReady()) return;
 
 	const Time anim_time = time % anim->getLength();
 
-	const BoneMask* mask = mask_idx < (u32)ctx.controller.m_bone_masks.size() ? &ctx.controller.m_bone_masks[mask_idx] : nullptr;
-	anim->getRelativePose(anim_time, pose, *ctx.model, weight, mask);
+	AnimationBinding& binding = ctx.getBinding(slot, mask_idx);
+	if (!anim->isBound(*ctx.model, binding)) {
+		const BoneMask* mask = mask_idx < (u32)ctx.controller.m_bone_masks.size() ? &ctx.controller.m_bone_masks[mask_idx] : nullptr;
+		anim->bind(*ctx.model, mask, binding);
+	}
+	anim->getRelativePose(anim_time, pose, binding, weight);
 }
 
 void Blend1DNode::getPose(RuntimeContext& ctx, float weight, Ref<Pose> pose, u32 mask) const {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "animation/animation.h"
 #include "engine/array.h"
 #include "engine/stream.h"
 
@@ -21,10 +22,14 @@ struct RuntimeContext {
 
 	void setInput(u32 input_idx, float value);
 	void setInput(u32 input_idx, bool value);
+	// mask_idx out of range means no mask
+	AnimationBinding& getBinding(u32 slot, u32 mask_idx);
 
 	Controller& controller;
 	Array<u8> inputs;
 	Array<Animation*> animations;
+	// (slot, bone mask or none) -> binding of animations[slot] to model
+	Array<AnimationBinding> bindings;
 	OutputMemoryStream data;
 	
 	u32 root_bone_hash = 0;
@@ -4,6 +4,7 @@
 #include "engine/log.h"
 #include "engine/reflection.h"
 #include "engine/serializer.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
@@ -49,9 +50,71 @@ bool PropertyAnimation::save(TextSerializer& serializer)
 }
 
 
+bool PropertyAnimation::compile(Span<const u8> src, OutputMemoryStream& dst)
+{
+	InputMemoryStream file(src.begin(), src.length());
+	TextDeserializer serializer(file);
+
+	dst.write(BINARY_MAGIC);
+	dst.write(BinaryVersion::LATEST);
+	i32 count;
+	serializer.read(Ref(count));
+	dst.write(count);
+	for (i32 i = 0; i < count; ++i) {
+		char tmp[32];
+		serializer.read(Span(tmp));
+		dst.writeString(tmp);
+		serializer.read(Span(tmp));
+		dst.writeString(tmp);
+
+		i32 keys_count;
+		serializer.read(Ref(keys_count));
+		dst.write(keys_count);
+		// frames and values are interleaved in text, but stored as two arrays, so they can be loaded by memcpy
+		const u64 frames_pos = dst.getPos();
+		if (keys_count > 0) dst.skip(keys_count * (sizeof(i32) + sizeof(float)));
+		for (i32 j = 0; j < keys_count; ++j) {
+			i32 frame;
+			float value;
+			serializer.read(Ref(frame));
+			serializer.read(Ref(value));
+			memcpy(dst.getMutableData() + frames_pos + j * sizeof(i32), &frame, sizeof(frame));
+			memcpy(dst.getMutableData() + frames_pos + keys_count * sizeof(i32) + j * sizeof(float), &value, sizeof(value));
+		}
+	}
+	return true;
+}
+
+
 bool PropertyAnimation::load(u64 size, const u8* mem)
 {
 	InputMemoryStream file(mem, size);
+	// text is loaded only from resources compiled before the binary format was added
+	if (size >= sizeof(u32) * 2 && file.read<u32>() == BINARY_MAGIC) {
+		if (file.read<BinaryVersion>() > BinaryVersion::LATEST) {
+			logError("Animation") << "Unsupported property animation version " << getPath();
+			return false;
+		}
+		const i32 count = file.read<i32>();
+		curves.reserve(count);
+		for (i32 i = 0; i < count; ++i) {
+			Curve& curve = curves.emplace(m_allocator);
+			char tmp[32];
+			file.readString(Span(tmp));
+			curve.cmp_type = Reflection::getComponentType(tmp);
+			file.readString(Span(tmp));
+			curve.property = Reflection::getProperty(curve.cmp_type, tmp);
+
+			const i32 keys_count = file.read<i32>();
+			curve.frames.resize(keys_count);
+			curve.values.resize(keys_count);
+			file.read(curve.frames.begin(), curve.frames.byte_size());
+			file.read(curve.values.begin(), curve.values.byte_size());
+		}
+		return true;
+	}
+
+	file.rewind();
 	TextDeserializer serializer(file);
 	
 	int count;
@@ -62,6 +125,7 @@ bool PropertyAnimation::load(u64 size, const u8* mem)
 		serializer.read(Span(tmp));
 		curve.cmp_type = Reflection::getComponentType(tmp);
 		serializer.read(Span(tmp));
+		curve.property = Reflection::getProperty(curve.cmp_type, tmp);
 		
 		int keys_count;
 		serializer.read(Ref(keys_count));
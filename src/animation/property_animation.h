@@ -14,6 +14,13 @@ namespace Reflection { struct  PropertyBase; }
 struct PropertyAnimation final : Resource
 {
 public:
+	static constexpr u32 BINARY_MAGIC = 0x5f414e50; // == '_ANP'
+	enum class BinaryVersion : u32 {
+		FIRST,
+
+		LATEST
+	};
+
 	struct Curve
 	{
 		Curve(IAllocator& allocator) : frames(allocator), values(allocator) {}
@@ -30,6 +37,8 @@ public:
 	ResourceType getType() const override { return TYPE; }
 	Curve& addCurve();
 	bool save(TextSerializer& serializer);
+	// converts text source to the binary format, which is what is loaded at runtime
+	static bool compile(Span<const u8> src, struct OutputMemoryStream& dst);
 
 	IAllocator& m_allocator;
 	Array<Curve> curves;
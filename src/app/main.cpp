@@ -11,7 +11,12 @@
 #include "engine/os.h"
 #include "engine/path_utils.h"
 #include "engine/plugin_manager.h"
+#include "engine/profiler.h"
+#include "engine/profiler_stats.h"
 #include "engine/reflection.h"
+#include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/string.h"
 #include "engine/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/pipeline.h"
@@ -26,7 +31,9 @@ static const ComponentType LUA_SCRIPT_TYPE = Reflection::getComponentType("lua_s
 struct Runner final : OS::Interface
 {
 	Runner() 
-		: m_allocator(m_main_allocator) 
+		: m_main_allocator(m_default_allocator)
+		, m_allocator(m_main_allocator)
+		, m_benchmark(m_allocator)
 	{
 		if (!JobSystem::init(getCPUsCount(), m_allocator)) {
 			logError("Engine") << "Failed to initialize job system.";
@@ -58,6 +65,7 @@ struct Runner final : OS::Interface
 		while (m_engine->getFileSystem().hasWork()) {
 			sleep(100);
 			m_engine->getFileSystem().processCallbacks();
+			m_engine->getResourceManager().update();
 		}
 
 		m_pipeline->setUniverse(m_universe);
@@ -81,23 +89,227 @@ struct Runner final : OS::Interface
 		lua_scene->setScriptPath(env, 0, Path("pipelines/sky.lua"));
 	}
 
+	// so builds can be profiled on machines without the studio
+	void startProfilerCapture() {
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-profiler_capture")) {
+				if (!parser.next()) break;
+				char path[MAX_PATH_LENGTH];
+				parser.getCurrent(path, lengthOf(path));
+				Profiler::startCapture(path);
+			}
+			else if (parser.currentEquals("-profiler_stream")) {
+				char ip[64];
+				char port_str[16];
+				if (!parser.next()) break;
+				parser.getCurrent(ip, lengthOf(ip));
+				if (!parser.next()) break;
+				parser.getCurrent(port_str, lengthOf(port_str));
+				i32 port;
+				if (!fromCString(Span(port_str, stringLength(port_str)), Ref(port))) {
+					logError("App") << "Invalid profiler stream port " << port_str;
+					continue;
+				}
+				Profiler::startRemoteCapture(ip, (u16)port);
+			}
+		}
+	}
+
+	// -benchmark_universe can be used multiple times, each universe runs -benchmark_frames frames
+	void parseBenchmarkCommandLine() {
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-benchmark_universe")) {
+				if (!parser.next()) break;
+				char name[MAX_PATH_LENGTH];
+				parser.getCurrent(name, lengthOf(name));
+				m_benchmark.universes.emplace(name);
+			}
+			else if (parser.currentEquals("-benchmark_frames")) {
+				if (!parser.next()) break;
+				char tmp[16];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				i32 frames;
+				if (fromCString(Span(tmp, stringLength(tmp)), Ref(frames)) && frames > 0) m_benchmark.frames = frames;
+			}
+			else if (parser.currentEquals("-benchmark_output")) {
+				if (!parser.next()) break;
+				char path[MAX_PATH_LENGTH];
+				parser.getCurrent(path, lengthOf(path));
+				m_benchmark.output_path = path;
+			}
+			else if (parser.currentEquals("-record_input")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_input_record_path.data, lengthOf(m_input_record_path.data));
+			}
+			else if (parser.currentEquals("-replay_input")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_input_replay_path.data, lengthOf(m_input_replay_path.data));
+			}
+		}
+	}
+
+	bool startInputReplay() {
+		OS::InputFile file;
+		if (!file.open(m_input_replay_path)) {
+			logError("App") << "Failed to open " << m_input_replay_path;
+			return false;
+		}
+		Array<u8> data(m_allocator);
+		data.resize((int)file.size());
+		const bool read = file.read(data.begin(), data.byte_size());
+		file.close();
+		if (!read) {
+			logError("App") << "Failed to read " << m_input_replay_path;
+			return false;
+		}
+		InputMemoryStream blob(data.begin(), data.byte_size());
+		return m_engine->getInputSystem().startReplay(blob);
+	}
+
+	void saveInputRecording() {
+		InputSystem& input = m_engine->getInputSystem();
+		if (!input.isRecording()) return;
+		OutputMemoryStream blob(m_allocator);
+		input.stopRecording(blob);
+		OS::OutputFile file;
+		if (!file.open(m_input_record_path)) {
+			logError("App") << "Failed to create " << m_input_record_path;
+			return;
+		}
+		if (!file.write(blob.getData(), blob.getPos())) logError("App") << "Failed to write " << m_input_record_path;
+		file.close();
+	}
+
+	void waitForLoading() {
+		while (m_engine->getFileSystem().hasWork()) {
+			sleep(10);
+			m_engine->getFileSystem().processCallbacks();
+			m_engine->getResourceManager().update();
+		}
+	}
+
+	bool loadUniverse(const char* name) {
+		const StaticString<MAX_PATH_LENGTH> manifest_path("universes/", name, "/resources.manifest");
+		m_engine->getResourceManager().prefetch(Path(manifest_path));
+		const StaticString<MAX_PATH_LENGTH> path("universes/", name, "/entities.unv");
+		OS::MappedFile file;
+		if (!m_engine->getFileSystem().open(path, Ref(file))) {
+			logError("App") << "Failed to open " << path;
+			return false;
+		}
+
+		InputMemoryStream blob(file.getData(), file.size());
+		// skip the header written by the editor, see WorldEditor::load
+		u32 hash = 0;
+		blob.read(hash);
+		blob.skip(hash == 0xffFFffFF ? 3 * sizeof(u32) : sizeof(u32));
+
+		EntityMap entity_map(m_allocator);
+		const bool res = m_engine->deserialize(*m_universe, blob, Ref(entity_map));
+		file.close();
+		if (!res) logError("App") << "Failed to deserialize " << path;
+		return res;
+	}
+
+	void startBenchmarkUniverse() {
+		m_pipeline->setUniverse(nullptr);
+		m_engine->destroyUniverse(*m_universe);
+		m_universe = &m_engine->createUniverse(true);
+		const char* name = m_benchmark.universes[m_benchmark.universe_idx];
+		logInfo("App") << "Benchmarking " << name;
+		if (loadUniverse(name)) {
+			m_engine->startGame(*m_universe);
+			waitForLoading();
+		}
+		m_pipeline->setUniverse(m_universe);
+
+		RenderScene* render_scene = (RenderScene*)m_universe->getScene(crc32("renderer"));
+		const EntityPtr camera = render_scene->getActiveCamera();
+		if (camera.isValid()) {
+			const Viewport viewport = m_viewport;
+			m_viewport = render_scene->getCameraViewport((EntityRef)camera);
+			m_viewport.w = viewport.w;
+			m_viewport.h = viewport.h;
+		}
+		m_benchmark.frame = 0;
+		m_benchmark.stats.clear();
+		// every universe replays the same input from the start, the run lasts as long as the recording
+		if (m_input_replay_path[0] && startInputReplay()) {
+			m_benchmark.frames = m_engine->getInputSystem().getReplayFramesCount();
+		}
+	}
+
+	void benchmarkFrame() {
+		m_benchmark.stats.frame();
+		++m_benchmark.frame;
+		if (m_benchmark.frame < m_benchmark.frames) return;
+
+		OutputMemoryStream& json = m_benchmark.json;
+		json << (m_benchmark.universe_idx == 0 ? "{\n\"" : ",\n\"") << m_benchmark.universes[m_benchmark.universe_idx].data << "\": ";
+		m_benchmark.stats.writeJSON(json);
+
+		++m_benchmark.universe_idx;
+		if (m_benchmark.universe_idx < (u32)m_benchmark.universes.size()) {
+			startBenchmarkUniverse();
+			return;
+		}
+
+		json << "}\n";
+		OS::OutputFile file;
+		if (file.open(m_benchmark.output_path)) {
+			if (!file.write(json.getData(), json.getPos())) {
+				logError("App") << "Failed to write " << m_benchmark.output_path;
+			}
+			file.close();
+		}
+		else {
+			logError("App") << "Failed to create " << m_benchmark.output_path;
+		}
+		OS::quit();
+	}
+
 	void onInit() override {
+		startProfilerCapture();
+		parseBenchmarkCommandLine();
+
 		Engine::InitArgs init_data;
 		#ifdef LUMIXENGINE_PLUGINS
 			const char* plugins[] = { LUMIXENGINE_PLUGINS };
 			init_data.plugins = Span(plugins);
 		#endif
+		// created by studio's "Pack data"
+		if (OS::fileExists("data.pak")) init_data.pack_path = "data.pak";
 		m_engine = Engine::create(init_data, m_allocator);
 
 		m_universe = &m_engine->createUniverse(true);
 		initRenderPipeline();
-		initDemoScene();
 
 		OS::showCursor(false);
 		onResize();
+
+		if (!m_benchmark.universes.empty()) {
+			// same simulation in every run regardless of frame rate
+			m_engine->setFixedTimeDelta(1 / 60.f);
+			startBenchmarkUniverse();
+		}
+		else {
+			initDemoScene();
+			if (m_input_replay_path[0] && !startInputReplay()) OS::quit();
+		}
+		if (m_input_record_path[0] && !m_engine->getInputSystem().isReplaying()) m_engine->getInputSystem().startRecording();
 	}
 
 	void shutdown() {
+		saveInputRecording();
+		Profiler::stopCapture();
 		m_engine->destroyUniverse(*m_universe);
 		Pipeline::destroy(m_pipeline);
 		Engine::destroy(m_engine, m_allocator);
@@ -128,15 +340,32 @@ struct Runner final : OS::Interface
 		m_pipeline->setViewport(m_viewport);
 		m_pipeline->render(false);
 		m_renderer->frame();
+		if (!m_benchmark.universes.empty()) benchmarkFrame();
+		else if (m_input_replay_path[0] && !m_engine->getInputSystem().isReplaying()) OS::quit();
 	}
 
-	DefaultAllocator m_main_allocator;
+	DefaultAllocator m_default_allocator;
+	SmallAllocator m_main_allocator;
 	Debug::Allocator m_allocator;
 	Engine* m_engine = nullptr;
 	Renderer* m_renderer = nullptr;
 	Universe* m_universe = nullptr;
 	Pipeline* m_pipeline = nullptr;
 	Viewport m_viewport;
+	StaticString<MAX_PATH_LENGTH> m_input_record_path;
+	StaticString<MAX_PATH_LENGTH> m_input_replay_path;
+
+	struct Benchmark {
+		Benchmark(IAllocator& allocator) : universes(allocator), stats(allocator), json(allocator) {}
+
+		Array<StaticString<MAX_PATH_LENGTH>> universes;
+		StaticString<MAX_PATH_LENGTH> output_path{"benchmark.json"};
+		u32 frames = 1000;
+		u32 universe_idx = 0;
+		u32 frame = 0;
+		ProfilerStats stats;
+		OutputMemoryStream json;
+	} m_benchmark;
 };
 
 int main(int args, char* argv[])
@@ -33,6 +33,16 @@ struct LUMIX_AUDIO_API AudioDevice
 
 	static constexpr int MAX_PLAYING_SOUNDS = 256;
 
+	// pcm source pulled by the device's mixing thread, the device owns it and destroys it there
+	struct IStream
+	{
+		virtual ~IStream() {}
+		// interleaved i16, returns fewer than `frames` at the end of the stream
+		virtual u32 read(i16* out, u32 frames) = 0;
+		virtual void seek(u32 frame) = 0;
+		virtual void destroy() = 0;
+	};
+
 	using BufferHandle = i32;
 	static constexpr BufferHandle INVALID_BUFFER_HANDLE = -1;
 
@@ -42,6 +52,8 @@ struct LUMIX_AUDIO_API AudioDevice
 	static void destroy(AudioDevice& device);
 
 	virtual BufferHandle createBuffer(const void* data, int size_bytes, int channels, int sample_rate, int flags) = 0;
+	// the stream is destroyed by the device even if this fails
+	virtual BufferHandle createStreamBuffer(IStream* stream, u32 frames_count, int channels, int sample_rate, int flags) = 0;
 	virtual void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
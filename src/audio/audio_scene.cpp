@@ -5,10 +5,12 @@
 #include "clip.h"
 #include "engine/associative_array.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/allocator.h"
 #include "engine/lua_wrapper.h"
 #include "engine/math.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
@@ -22,11 +24,15 @@ static const ComponentType LISTENER_TYPE = Reflection::getComponentType("audio_l
 static const ComponentType AMBIENT_SOUND_TYPE = Reflection::getComponentType("ambient_sound");
 static const ComponentType ECHO_ZONE_TYPE = Reflection::getComponentType("echo_zone");
 static const ComponentType CHORUS_ZONE_TYPE = Reflection::getComponentType("chorus_zone");
+static const ComponentType ANIMABLE_TYPE = Reflection::getComponentType("animable");
+static const ComponentType ANIMATOR_TYPE = Reflection::getComponentType("animator");
 
 
 enum class AudioSceneVersion : int
 {
 	CHORUS = 0,
+	STREAMED_CLIPS,
+	CLIP_PRIORITY,
 
 	LAST
 };
@@ -47,15 +53,38 @@ struct AmbientSound
 };
 
 
+// virtual if buffer_id is invalid, such sounds only advance their time and are not mixed
 struct PlayingSound
 {
 	AudioDevice::BufferHandle buffer_id;
 	EntityPtr entity;
+	// nullptr if the slot is free
 	AudioScene::ClipInfo* clip;
+	float volume;
+	float time;
 	bool is_3d;
 };
 
 
+struct VoiceCandidate
+{
+	u8 priority;
+	float audibility;
+	u32 sound;
+};
+
+
+// higher priority first, louder first within the same priority
+static int compareVoiceCandidates(const void* a, const void* b)
+{
+	const VoiceCandidate* ca = (const VoiceCandidate*)a;
+	const VoiceCandidate* cb = (const VoiceCandidate*)b;
+	if (ca->priority != cb->priority) return ca->priority > cb->priority ? -1 : 1;
+	if (ca->audibility != cb->audibility) return ca->audibility > cb->audibility ? -1 : 1;
+	return 0;
+}
+
+
 struct AudioSceneImpl final : AudioScene
 {
 	AudioSceneImpl(AudioSystem& system, Universe& context, IAllocator& allocator)
@@ -73,6 +102,7 @@ struct AudioSceneImpl final : AudioScene
 		{
 			i.entity = INVALID_ENTITY;
 			i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+			i.clip = nullptr;
 		}
 		context.registerComponentType(LISTENER_TYPE
 			, this
@@ -122,39 +152,39 @@ struct AudioSceneImpl final : AudioScene
 	{
 		if (!m_animation_scene) return;
 		
-		InputMemoryStream blob(m_animation_scene->getEventStream());
-		u32 sound_type = crc32("sound");
-		while (blob.getPosition() < blob.size())
-		{
-			u32 type;
-			u8 size;
-			EntityRef entity;
-			blob.read(type);
-			blob.read(entity);
-			blob.read(size);
-			if (type == sound_type)
-			{
-				SoundAnimationEvent event;
-				blob.read(event);
-				ClipInfo* clip = getClipInfo(event.clip);
-				if (clip)
-				{
-					play(entity, clip, event.is_3d);
-				}
-			}
-			else
-			{
-				blob.skip(size);
-			}
+		const u8* data = m_animation_scene->getEventsData(AnimationEventType::SOUND);
+		for (const AnimationEvent& anim_event : m_animation_scene->getEvents(AnimationEventType::SOUND)) {
+			SoundAnimationEvent event;
+			ASSERT(anim_event.size == sizeof(event));
+			memcpy(&event, data + anim_event.offset, sizeof(event));
+			ClipInfo* clip = getClipInfo(event.clip);
+			if (clip) play(anim_event.entity, clip, event.is_3d);
 		}
 	}
 
+	SceneUpdateAccess getUpdateAccess() const override
+	{
+		SceneUpdateAccess access;
+		access.flags = SceneUpdateAccess::READ_TRANSFORMS;
+		// animation event stream
+		access.read_components = SceneUpdateAccess::mask(ANIMABLE_TYPE) | SceneUpdateAccess::mask(ANIMATOR_TYPE);
+		access.write_components = SceneUpdateAccess::mask(LISTENER_TYPE) 
+			| SceneUpdateAccess::mask(AMBIENT_SOUND_TYPE)
+			| SceneUpdateAccess::mask(ECHO_ZONE_TYPE)
+			| SceneUpdateAccess::mask(CHORUS_ZONE_TYPE);
+		return access;
+	}
+
+	bool isDeserializeThreadSafe() const override { return true; }
+
+
 	void update(float time_delta, bool paused) override
 	{
 		if (m_listener.entity.isValid())
 		{
 			const EntityRef listener = (EntityRef) m_listener.entity;
 			const DVec3 pos = m_universe.getPosition(listener);
+			m_listener_pos = pos;
 			m_device.setListenerPosition(pos);
 			const Matrix orientation = m_universe.getRotation(listener).toMatrix();
 			const Vec3 front = orientation.getZVector();
@@ -162,30 +192,161 @@ struct AudioSceneImpl final : AudioScene
 			m_device.setListenerOrientation(front.x, front.y, front.z, up.x, up.y, up.z);
 		}
 
-		for (PlayingSound & sound : m_playing_sounds)
+		updateVoices(time_delta);
+		m_device.update(time_delta);
+
+		updateAnimationEvents();
+	}
+
+
+	// same attenuation as the devices, 1 / distance further than 1m from the listener
+	float getAudibility(const PlayingSound& sound) const
+	{
+		if (!sound.is_3d || !sound.entity.isValid()) return sound.volume;
+		const double dist2 = (m_universe.getPosition((EntityRef)sound.entity) - m_listener_pos).squaredLength();
+		return dist2 > 1 ? float(sound.volume / sqrt(dist2)) : sound.volume;
+	}
+
+
+	// time is tracked by the scene, so virtual sounds end and loop without the device
+	void updateVoices(float time_delta)
+	{
+		PROFILE_FUNCTION();
+		VoiceCandidate candidates[AudioDevice::MAX_PLAYING_SOUNDS];
+		u32 candidates_count = 0;
+		for (PlayingSound& sound : m_playing_sounds)
 		{
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE) continue;
-			if (!sound.entity.isValid()) continue;
+			if (!sound.clip) continue;
 
-			if (sound.is_3d)
+			const bool is_real = sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE;
+			const float length = sound.clip->clip->getLengthSeconds();
+			sound.time += time_delta;
+			if (sound.time >= length)
 			{
-				auto pos = m_universe.getPosition((EntityRef)sound.entity);
-				m_device.setSourcePosition(sound.buffer_id, pos);
+				if (sound.clip->looped && length > 0)
+				{
+					sound.time = fmodf(sound.time, length);
+				}
+				else if (!is_real || m_device.isEnd(sound.buffer_id))
+				{
+					releaseSound(sound);
+					continue;
+				}
 			}
 
-			auto* clip_info = sound.clip;
-			if (!clip_info->looped && m_device.isEnd(sound.buffer_id))
+			const float audibility = getAudibility(sound);
+			if (audibility < INAUDIBLE_VOLUME)
 			{
-				m_device.stop(sound.buffer_id);
-				sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+				if (is_real) virtualizeSound(sound);
+				continue;
 			}
+
+			VoiceCandidate& candidate = candidates[candidates_count];
+			++candidates_count;
+			candidate.priority = sound.clip->priority;
+			// real voices are preferred a bit, so similar sounds do not keep swapping
+			candidate.audibility = is_real ? audibility * 1.25f : audibility;
+			candidate.sound = u32(&sound - m_playing_sounds);
 		}
-		m_device.update(time_delta);
 
-		updateAnimationEvents();
+		qsort(candidates, candidates_count, sizeof(candidates[0]), compareVoiceCandidates);
+
+		// free device buffers first
+		for (u32 i = m_max_voices; i < candidates_count; ++i)
+		{
+			PlayingSound& sound = m_playing_sounds[candidates[i].sound];
+			if (sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE) virtualizeSound(sound);
+		}
+
+		for (u32 i = 0, c = minimum(candidates_count, m_max_voices); i < c; ++i)
+		{
+			PlayingSound& sound = m_playing_sounds[candidates[i].sound];
+			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE && !realizeSound(sound)) continue;
+			if (sound.is_3d && sound.entity.isValid())
+			{
+				m_device.setSourcePosition(sound.buffer_id, m_universe.getPosition((EntityRef)sound.entity));
+			}
+		}
 	}
 
 
+	bool realizeSound(PlayingSound& sound)
+	{
+		ASSERT(sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE);
+		Clip* clip = sound.clip->clip;
+		if (!clip->isReady()) return false;
+
+		int flags = sound.is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
+		AudioDevice::BufferHandle buffer;
+		if (clip->isStreamed()) {
+			AudioDevice::IStream* stream = clip->createStream();
+			if (!stream) return false;
+			buffer = m_device.createStreamBuffer(stream, clip->getFramesCount(), clip->getChannels(), clip->getSampleRate(), flags);
+		}
+		else {
+			buffer = m_device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
+		}
+		if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return false;
+		if (sound.time > 0) m_device.setCurrentTime(buffer, sound.time);
+		m_device.play(buffer, sound.clip->looped);
+		m_device.setVolume(buffer, sound.volume);
+
+		const DVec3 pos = sound.entity.isValid() ? m_universe.getPosition((EntityRef)sound.entity) : m_listener_pos;
+		m_device.setSourcePosition(buffer, pos);
+		sound.buffer_id = buffer;
+
+		for (const EchoZone& zone : m_echo_zones)
+		{
+			const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
+			const double r2 = zone.radius * zone.radius;
+			if (dist2 > r2) continue;
+
+			const float w = float(dist2 / r2);
+			m_device.setEcho(buffer, 1, 1 - w, zone.delay, zone.delay);
+			break;
+		}
+
+		for (const ChorusZone& zone : m_chorus_zones)
+		{
+			const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
+			double r2 = zone.radius * zone.radius;
+			if (dist2 > r2) continue;
+
+			m_device.setChorus(buffer, 1, 1, 0, 1, zone.delay, 0);
+			break;
+		}
+		++m_real_voices_count;
+		return true;
+	}
+
+
+	void virtualizeSound(PlayingSound& sound)
+	{
+		ASSERT(sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE);
+		const float time = m_device.getCurrentTime(sound.buffer_id);
+		if (time >= 0) sound.time = time;
+		m_device.stop(sound.buffer_id);
+		sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		--m_real_voices_count;
+	}
+
+
+	void releaseSound(PlayingSound& sound)
+	{
+		if (sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
+		{
+			m_device.stop(sound.buffer_id);
+			sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+			--m_real_voices_count;
+		}
+		sound.clip = nullptr;
+	}
+
+
+	void setMaxVoices(u32 count) override { m_max_voices = minimum(count, (u32)AudioDevice::MAX_PLAYING_SOUNDS); }
+	u32 getMaxVoices() const override { return m_max_voices; }
+
+
 	bool isAmbientSound3D(EntityRef entity) override
 	{
 		return m_ambient_sounds[entity].is_3d;
@@ -213,11 +374,7 @@ struct AudioSceneImpl final : AudioScene
 		m_animation_scene = nullptr;
 		for (auto& i : m_playing_sounds)
 		{
-			if (i.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				m_device.stop(i.buffer_id);
-				i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
+			if (i.clip) releaseSound(i);
 		}
 
 		for (AmbientSound& sound : m_ambient_sounds)
@@ -356,6 +513,8 @@ struct AudioSceneImpl final : AudioScene
 
 			serializer.write(clip->volume);
 			serializer.write(clip->looped);
+			serializer.write(clip->streamed);
+			serializer.write(clip->priority);
 			serializer.writeString(clip->name);
 			serializer.writeString(clip->clip->getPath().c_str());
 		}
@@ -407,12 +566,15 @@ struct AudioSceneImpl final : AudioScene
 			clip->volume = 1;
 			serializer.read(clip->volume);
 			serializer.read(clip->looped);
+			serializer.read(clip->streamed);
+			serializer.read(clip->priority);
 			serializer.readString(Span(clip->name));
 			clip->name_hash = crc32(clip->name);
 			char path[MAX_PATH_LENGTH];
 			serializer.readString(Span(path));
 
 			clip->clip = m_system.getEngine().getResourceManager().load<Clip>(Path(path));
+			clip->clip->setStreamed(clip->streamed);
 		}
 
 		serializer.read(count);
@@ -474,11 +636,7 @@ struct AudioSceneImpl final : AudioScene
 	{
 		for (auto& i : m_playing_sounds)
 		{
-			if (i.clip == info && i.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE)
-			{
-				m_device.stop(i.buffer_id);
-				i.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
-			}
+			if (i.clip == info) releaseSound(i);
 		}
 
 		for (AmbientSound& sound : m_ambient_sounds)
@@ -539,56 +697,30 @@ struct AudioSceneImpl final : AudioScene
 		}
 		auto* new_res = m_system.getEngine().getResourceManager().load<Clip>(path);
 		m_clips[clip_id]->clip = static_cast<Clip*>(new_res);
+		m_clips[clip_id]->clip->setStreamed(m_clips[clip_id]->streamed);
 	}
 
 
+	// the sound starts as virtual if it is inaudible or all voices are taken, update() can make it real later
 	SoundHandle play(EntityRef entity, ClipInfo* clip_info, bool is_3d) override
 	{
+		if (!clip_info->clip->isReady()) return INVALID_SOUND_HANDLE;
+
 		for (PlayingSound& sound : m_playing_sounds)
 		{
-			if (sound.buffer_id == AudioDevice::INVALID_BUFFER_HANDLE)
+			if (sound.clip) continue;
+
+			sound.is_3d = is_3d;
+			sound.buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+			sound.entity = entity;
+			sound.clip = clip_info;
+			sound.volume = clip_info->volume;
+			sound.time = 0;
+			if (m_real_voices_count < m_max_voices && getAudibility(sound) >= INAUDIBLE_VOLUME)
 			{
-				auto* clip = clip_info->clip;
-				if (!clip->isReady()) return INVALID_SOUND_HANDLE;
-
-				int flags = is_3d ? (int)AudioDevice::BufferFlags::IS3D : 0;
-				auto buffer = m_device.createBuffer(
-					clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), flags);
-				if (buffer == AudioDevice::INVALID_BUFFER_HANDLE) return INVALID_SOUND_HANDLE;
-				m_device.play(buffer, clip_info->looped);
-				m_device.setVolume(buffer, clip_info->volume);
-
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_device.setSourcePosition(buffer, pos);
-
-				sound.is_3d = is_3d;
-				sound.buffer_id = buffer;
-				sound.entity = entity;
-				sound.clip = clip_info;
-
-				for (const EchoZone& zone : m_echo_zones)
-				{
-					const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
-					const double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
-
-					const float w = float(dist2 / r2);
-					m_device.setEcho(buffer, 1, 1 - w, zone.delay, zone.delay);
-					break;
-				}
-
-				for (const ChorusZone& zone : m_chorus_zones)
-				{
-					const double dist2 = (pos - m_universe.getPosition(zone.entity)).squaredLength();
-					double r2 = zone.radius * zone.radius;
-					if (dist2 > r2) continue;
-
-					m_device.setChorus(buffer, 1, 1, 0, 1, zone.delay, 0);
-					break;
-				}
-
-				return SoundHandle(&sound - m_playing_sounds);
+				realizeSound(sound);
 			}
+			return SoundHandle(&sound - m_playing_sounds);
 		}
 
 		return INVALID_SOUND_HANDLE;
@@ -598,8 +730,7 @@ struct AudioSceneImpl final : AudioScene
 	void stop(SoundHandle sound_id) override
 	{
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.stop(m_playing_sounds[sound_id].buffer_id);
-		m_playing_sounds[sound_id].buffer_id = AudioDevice::INVALID_BUFFER_HANDLE;
+		if (m_playing_sounds[sound_id].clip) releaseSound(m_playing_sounds[sound_id]);
 	}
 
 
@@ -610,14 +741,18 @@ struct AudioSceneImpl final : AudioScene
 	{
 		ASSERT(sound_id != AudioScene::INVALID_SOUND_HANDLE);
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setVolume(m_playing_sounds[sound_id].buffer_id, volume);
+		PlayingSound& sound = m_playing_sounds[sound_id];
+		sound.volume = volume;
+		if (sound.buffer_id != AudioDevice::INVALID_BUFFER_HANDLE) m_device.setVolume(sound.buffer_id, volume);
 	}
 
 
 	void setEcho(SoundHandle sound_id, float wet_dry_mix, float feedback, float left_delay, float right_delay) override
 	{
 		ASSERT(sound_id >= 0 && sound_id < (int)lengthOf(m_playing_sounds));
-		m_device.setEcho(m_playing_sounds[sound_id].buffer_id, wet_dry_mix, feedback, left_delay, right_delay);
+		// virtual sounds get echo from zones when they become real
+		const AudioDevice::BufferHandle buffer = m_playing_sounds[sound_id].buffer_id;
+		if (buffer != AudioDevice::INVALID_BUFFER_HANDLE) m_device.setEcho(buffer, wet_dry_mix, feedback, left_delay, right_delay);
 	}
 
 	Universe& getUniverse() override { return m_universe; }
@@ -633,7 +768,12 @@ struct AudioSceneImpl final : AudioScene
 	Array<ClipInfo*> m_clips;
 	AudioSystem& m_system;
 	PlayingSound m_playing_sounds[AudioDevice::MAX_PLAYING_SOUNDS];
+	u32 m_max_voices = 32;
+	u32 m_real_voices_count = 0;
+	DVec3 m_listener_pos = DVec3(0);
 	AnimationScene* m_animation_scene = nullptr;
+
+	static constexpr float INAUDIBLE_VOLUME = 0.001f;
 };
 
 
@@ -663,6 +803,7 @@ void AudioScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(playSound);
 	REGISTER_FUNCTION(setVolume);
 	REGISTER_FUNCTION(setMasterVolume);
+	REGISTER_FUNCTION(setMaxVoices);
 
 	#undef REGISTER_FUNCTION
 }
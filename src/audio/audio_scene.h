@@ -55,6 +55,10 @@ struct AudioScene : IScene
 		char name[30];
 		u32 name_hash;
 		bool looped;
+		// decoded while playing, for long clips such as music
+		bool streamed = false;
+		// when there are more sounds than voices, sounds with lower priority become virtual first
+		u8 priority = 0;
 		float volume = 1;
 	};
 
@@ -87,6 +91,9 @@ struct AudioScene : IScene
 	virtual SoundHandle play(EntityRef entity, ClipInfo* clip, bool is_3d) = 0;
 	virtual void stop(SoundHandle sound_id) = 0;
 	virtual void setVolume(SoundHandle sound_id, float volume) = 0;
+	// max number of sounds mixed by the device, the rest only advance their time
+	virtual void setMaxVoices(u32 count) = 0;
+	virtual u32 getMaxVoices() const = 0;
 
 	virtual void setEcho(SoundHandle sound_id,
 		float wet_dry_mix,
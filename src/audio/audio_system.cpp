@@ -62,6 +62,9 @@ struct AudioSystemImpl final : AudioSystem
 		, m_manager(engine.getAllocator())
 		, m_device(nullptr)
 	{
+		registerProperties(m_engine.getAllocator());
+		AudioScene::registerLuaAPI(m_engine.getState());
+		m_manager.create(Clip::TYPE, m_engine.getResourceManager());
 	}
 
 
@@ -72,13 +75,9 @@ struct AudioSystemImpl final : AudioSystem
 	}
 
 
-	void init() override
-	{
-		registerProperties(m_engine.getAllocator());
-		AudioScene::registerLuaAPI(m_engine.getState());
-		m_device = AudioDevice::create(m_engine);
-		m_manager.create(Clip::TYPE, m_engine.getResourceManager());
-	}
+	// opening the device can take a while, it does not touch anything shared
+	void init() override { m_device = AudioDevice::create(m_engine); }
+	bool isInitThreadSafe() const override { return true; }
 
 
 	Engine& getEngine() override { return m_engine; }
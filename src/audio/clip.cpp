@@ -1,5 +1,6 @@
 #include "clip.h"
 #include "engine/allocator.h"
+#include "engine/array.h"
 #include "engine/crt.h"
 #include "engine/lumix.h"
 #include "engine/profiler.h"
@@ -16,19 +17,97 @@ namespace Lumix
 const ResourceType Clip::TYPE("clip");
 
 
+struct VorbisStream final : AudioDevice::IStream
+{
+	VorbisStream(IAllocator& allocator, const Array<u8>& compressed, int channels)
+		: m_allocator(allocator)
+		, m_compressed(allocator)
+		, m_channels(channels)
+	{
+		m_compressed.resize(compressed.size());
+		memcpy(m_compressed.begin(), compressed.begin(), compressed.byte_size());
+	}
+
+	~VorbisStream()
+	{
+		if (m_vorbis) stb_vorbis_close(m_vorbis);
+	}
+
+	bool open()
+	{
+		int error;
+		m_vorbis = stb_vorbis_open_memory(m_compressed.begin(), m_compressed.size(), &error, nullptr);
+		return m_vorbis != nullptr;
+	}
+
+	u32 read(i16* out, u32 frames) override
+	{
+		return stb_vorbis_get_samples_short_interleaved(m_vorbis, m_channels, out, frames * m_channels);
+	}
+
+	void seek(u32 frame) override { stb_vorbis_seek(m_vorbis, frame); }
+	void destroy() override { LUMIX_DELETE(m_allocator, this); }
+
+	IAllocator& m_allocator;
+	Array<u8> m_compressed;
+	stb_vorbis* m_vorbis = nullptr;
+	int m_channels;
+};
+
+
 void Clip::unload()
 {
 	m_data.clear();
+	m_compressed.clear();
+	m_frames = 0;
+}
+
+
+void Clip::setStreamed(bool streamed)
+{
+	if (m_streamed == streamed) return;
+	m_streamed = streamed;
+	if (isReady()) getResourceManager().reload(*this);
+}
+
+
+AudioDevice::IStream* Clip::createStream()
+{
+	ASSERT(m_streamed);
+	VorbisStream* stream = LUMIX_NEW(m_allocator, VorbisStream)(m_allocator, m_compressed, m_channels);
+	if (!stream->open())
+	{
+		LUMIX_DELETE(m_allocator, stream);
+		return nullptr;
+	}
+	return stream;
 }
 
 
 bool Clip::load(u64 size, const u8* mem)
 {
 	PROFILE_FUNCTION();
+	if (m_streamed)
+	{
+		int error;
+		stb_vorbis* vorbis = stb_vorbis_open_memory(mem, (int)size, &error, nullptr);
+		if (!vorbis) return false;
+		const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+		m_channels = info.channels;
+		m_sample_rate = info.sample_rate;
+		m_frames = stb_vorbis_stream_length_in_samples(vorbis);
+		stb_vorbis_close(vorbis);
+
+		m_compressed.resize((u32)size);
+		memcpy(m_compressed.begin(), mem, size);
+		return true;
+	}
+
 	short* output = nullptr;
 	auto res = stb_vorbis_decode_memory((unsigned char*)mem, (int)size, &m_channels, &m_sample_rate, &output);
 	if (res <= 0) return false;
 
+	m_frames = res;
 	m_data.resize(res * m_channels);
 	memcpy(&m_data[0], output, res * m_channels * sizeof(m_data[0]));
 	free(output);
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "audio_device.h"
 #include "engine/array.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
@@ -15,7 +16,9 @@ struct Clip final : Resource
 public:
 	Clip(const Path& path, ResourceManager& manager, IAllocator& allocator)
 		: Resource(path, manager, allocator)
+		, m_allocator(allocator)
 		, m_data(allocator)
+		, m_compressed(allocator)
 	{
 	}
 
@@ -27,14 +30,24 @@ public:
 	int getSampleRate() const { return m_sample_rate; }
 	int getSize() const { return m_data.size() * sizeof(m_data[0]); }
 	u16* getData() { return &m_data[0]; }
-	float getLengthSeconds() const { return m_data.size() / float(m_channels * m_sample_rate); }
+	float getLengthSeconds() const { return m_frames / float(m_sample_rate); }
+	u32 getFramesCount() const { return m_frames; }
+	// streamed clips keep only the compressed data, pcm is decoded while playing
+	bool isStreamed() const { return m_streamed; }
+	void setStreamed(bool streamed);
+	// decodes a streamed clip, the stream has its own copy of the compressed data
+	AudioDevice::IStream* createStream();
 
 	static const ResourceType TYPE;
 
 private:
+	IAllocator& m_allocator;
 	int m_channels;
 	int m_sample_rate;
+	u32 m_frames = 0;
+	bool m_streamed = false;
 	Array<u16> m_data;
+	Array<u8> m_compressed;
 };
 
 
@@ -79,9 +79,14 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin
 		{
 			stopAudio();
 
-			auto handle =
-				device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
-			device.play(handle, true);
+			AudioDevice::BufferHandle handle = AudioDevice::INVALID_BUFFER_HANDLE;
+			if (!clip->isStreamed()) {
+				handle = device.createBuffer(clip->getData(), clip->getSize(), clip->getChannels(), clip->getSampleRate(), 0);
+			}
+			else if (AudioDevice::IStream* stream = clip->createStream()) {
+				handle = device.createStreamBuffer(stream, clip->getFramesCount(), clip->getChannels(), clip->getSampleRate(), 0);
+			}
+			if (handle != AudioDevice::INVALID_BUFFER_HANDLE) device.play(handle, true);
 			m_playing_clip = handle;
 		}
 	}
@@ -189,6 +194,13 @@ struct ClipManagerUI final : StudioApp::GUIPlugin
 					}
 					ImGui::InputFloat("Volume", &clip_info->volume);
 					ImGui::Checkbox("Looped", &clip_info->looped);
+					if (ImGui::Checkbox("Streamed", &clip_info->streamed) && clip_info->clip) {
+						clip_info->clip->setStreamed(clip_info->streamed);
+					}
+					int priority = clip_info->priority;
+					if (ImGui::InputInt("Priority", &priority)) {
+						clip_info->priority = (u8)clamp(priority, 0, 255);
+					}
 					if (ImGui::Button("Remove")) {
 						audio_scene->removeClip(clip_info);
 						--clip_count;
@@ -1,13 +1,15 @@
 #include "audio_device.h"
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/log.h"
 #include "engine/engine.h"
 #include "engine/plugin.h"
 #include "engine/log.h"
 #include "engine/math.h"
-#include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
+#include "engine/simd.h"
 #include <alsa/asoundlib.h>
 
 
@@ -41,51 +43,245 @@ struct AudioDeviceImpl : AudioDevice
 			LOOPED = 1 << 2
 		};
 
-		Buffer(IAllocator& allocator) : data(allocator) {}
+		Buffer(IAllocator& allocator) : data(allocator), ring(allocator) {}
 		
+		// written by the game thread before CREATE is queued, the mixing thread only reads them
 		Array<u8> data;
+		AudioDevice::IStream* stream = nullptr;
+		u32 stream_frames = 0;
 		int channels;
 		int sample_rate;
 		int flags;
-		int cursor;
-		u8 runtime_flags;
+
+		// game thread only
+		bool playing = false;
+
+		// written only by the mixing thread
+		volatile i32 free = 1;
+		volatile u32 published_cursor = 0;
+
+		// mixing thread only
+		// in frames
+		double cursor;
+		float volume;
+		float frequency;
+		DVec3 position;
+		// bumped when the cursor is set by a command, restarts stream decoding
+		u32 generation = 0;
+		u8 runtime_flags = 0;
+
+		// streamed buffers, mixing thread only
+		// ring is indexed by absolute frame, which keeps growing across loops
+		Array<i16> ring;
+		u64 ring_begin = 0;
+		u64 ring_end = 0;
+		u64 loop_base = 0;
+		u32 stream_pos = 0;
+		u32 stream_generation = 0;
+
+		u32 getFramesCount() const { return stream ? stream_frames : data.size() / (2 * channels); }
 	};
 
 
-	BufferHandle createBuffer(const void* data,
-		int size_bytes,
-		int channels,
-		int sample_rate,
-		int flags) override
+	// parameter change queued by the game thread, executed by the mixing thread before the next block is mixed
+	struct Command
+	{
+		enum class Type : u8
+		{
+			CREATE,
+			PLAY,
+			PAUSE,
+			STOP,
+			SET_VOLUME,
+			SET_FREQUENCY,
+			SET_CURSOR,
+			SET_SOURCE_POSITION,
+			SET_MASTER_VOLUME,
+			SET_LISTENER_POSITION,
+			SET_LISTENER_ORIENTATION
+		};
+
+		Type type;
+		bool looped;
+		BufferHandle buffer;
+		double value;
+		DVec3 position;
+		Vec3 front;
+		Vec3 up;
+	};
+
+
+	// what is mixed from a playing buffer in the current block
+	struct Voice
+	{
+		const i16* data;
+		u32 frames;
+		u32 channels;
+		double cursor;
+		double step;
+		float gain_left;
+		float gain_right;
+		bool looped;
+		u32 buffer;
+		u32 generation;
+		Buffer* stream;
+	};
+
+
+	// single producer, single consumer, the game thread waits only if the mixing thread falls behind by a whole ring
+	void pushCommand(const Command& cmd)
+	{
+		const u32 write = m_commands_write;
+		while (write - m_commands_read == COMMANDS_CAPACITY) OS::sleep(1);
+		m_commands[write % COMMANDS_CAPACITY] = cmd;
+		memoryBarrier();
+		m_commands_write = write + 1;
+	}
+
+
+	void pushCommand(Command::Type type, BufferHandle buffer, double value = 0)
+	{
+		Command cmd;
+		cmd.type = type;
+		cmd.buffer = buffer;
+		cmd.value = value;
+		pushCommand(cmd);
+	}
+
+
+	void executeCommands()
+	{
+		PROFILE_FUNCTION();
+		const u32 end = m_commands_write;
+		memoryBarrier();
+		for (u32 i = m_commands_read; i != end; ++i)
+		{
+			const Command& cmd = m_commands[i % COMMANDS_CAPACITY];
+			Buffer* buffer = cmd.buffer >= 0 ? &m_buffers[cmd.buffer] : nullptr;
+			switch (cmd.type)
+			{
+				case Command::Type::CREATE:
+					buffer->runtime_flags = (u8)Buffer::RuntimeFlags::READY;
+					buffer->cursor = 0;
+					buffer->volume = 1;
+					buffer->frequency = (float)buffer->sample_rate;
+					buffer->position = m_listener_pos;
+					++buffer->generation;
+					break;
+				case Command::Type::PLAY:
+					buffer->runtime_flags |= (u8)Buffer::RuntimeFlags::PLAYING;
+					if (cmd.looped)
+					{
+						buffer->runtime_flags |= (u8)Buffer::RuntimeFlags::LOOPED;
+					}
+					else
+					{
+						buffer->runtime_flags &= ~(u8)Buffer::RuntimeFlags::LOOPED;
+					}
+					break;
+				case Command::Type::PAUSE: buffer->runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING; break;
+				case Command::Type::STOP:
+					buffer->runtime_flags = 0;
+					if (buffer->stream)
+					{
+						buffer->stream->destroy();
+						buffer->stream = nullptr;
+					}
+					// the game thread can reuse the slot after this
+					memoryBarrier();
+					buffer->free = 1;
+					break;
+				case Command::Type::SET_VOLUME: buffer->volume = (float)cmd.value; break;
+				case Command::Type::SET_FREQUENCY: buffer->frequency = (float)cmd.value; break;
+				case Command::Type::SET_CURSOR:
+					buffer->cursor = cmd.value;
+					buffer->published_cursor = (u32)cmd.value;
+					++buffer->generation;
+					break;
+				case Command::Type::SET_SOURCE_POSITION: buffer->position = cmd.position; break;
+				case Command::Type::SET_MASTER_VOLUME: m_master_volume = (float)cmd.value; break;
+				case Command::Type::SET_LISTENER_POSITION: m_listener_pos = cmd.position; break;
+				case Command::Type::SET_LISTENER_ORIENTATION:
+					m_listener_front = cmd.front;
+					m_listener_up = cmd.up;
+					break;
+			}
+		}
+		memoryBarrier();
+		m_commands_read = end;
+	}
+
+
+	// finds a slot the mixing thread is done with
+	BufferHandle allocBuffer(int channels, int sample_rate, int flags)
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(flags == 0); // nothing else supported yet
-		for(int i = 0, c = m_buffers.size(); i < c; ++i)
+		ASSERT(channels == 1 || channels == 2);
+		for (int i = 0, c = m_buffers.size(); i < c; ++i)
 		{
 			Buffer& buffer = m_buffers[i];
-			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::READY)) continue;
+			if (!buffer.free) continue;
 
+			memoryBarrier();
+			buffer.free = 0;
 			buffer.channels = channels;
 			buffer.sample_rate = sample_rate;
 			buffer.flags = flags;
-			buffer.data.resize(size_bytes);
-			buffer.runtime_flags = (u8)Buffer::RuntimeFlags::READY;
-			buffer.cursor = 0;
-			memcpy(&buffer.data[0], data, size_bytes);
-
+			buffer.stream = nullptr;
+			buffer.playing = false;
+			buffer.published_cursor = 0;
 			return i;
 		}
 		return INVALID_BUFFER_HANDLE;
 	}
 
 
+	BufferHandle createBuffer(const void* data,
+		int size_bytes,
+		int channels,
+		int sample_rate,
+		int flags) override
+	{
+		const BufferHandle handle = allocBuffer(channels, sample_rate, flags);
+		if (handle == INVALID_BUFFER_HANDLE) return INVALID_BUFFER_HANDLE;
+
+		Buffer& buffer = m_buffers[handle];
+		buffer.data.resize(size_bytes);
+		memcpy(&buffer.data[0], data, size_bytes);
+		pushCommand(Command::Type::CREATE, handle);
+		return handle;
+	}
+
+
+	BufferHandle createStreamBuffer(IStream* stream,
+		u32 frames_count,
+		int channels,
+		int sample_rate,
+		int flags) override
+	{
+		const BufferHandle handle = allocBuffer(channels, sample_rate, flags);
+		if (handle == INVALID_BUFFER_HANDLE)
+		{
+			stream->destroy();
+			return INVALID_BUFFER_HANDLE;
+		}
+
+		Buffer& buffer = m_buffers[handle];
+		buffer.data.clear();
+		buffer.stream = stream;
+		buffer.stream_frames = frames_count;
+		buffer.stream_pos = 0;
+		buffer.ring.resize(STREAM_RING_FRAMES * channels);
+		pushCommand(Command::Type::CREATE, handle);
+		return handle;
+	}
+
+
 	void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
 		float left_delay,
 		float right_delay) override 
 	{
-		MutexGuard lock(m_mutex);
 		ASSERT(false); // not implemented yet
 	}
 
@@ -98,142 +294,312 @@ struct AudioDeviceImpl : AudioDevice
 		float delay,
 		i32 phase) override
 	{
-		MutexGuard lock(m_mutex);
 		ASSERT(false); // not implemented yet
 	}
 
 
-	void mix(u16* output, int size_bytes)
+	// inverse distance attenuation and constant power panning, sources behind the listener are a bit quieter
+	void getGains(const Buffer& buffer, float& left, float& right) const
 	{
-		memset(output, 0, size_bytes);
+		float gain = buffer.volume * m_master_volume;
+		if ((buffer.flags & (int)BufferFlags::IS3D) == 0 || buffer.channels != 1)
+		{
+			left = right = gain;
+			return;
+		}
 
-		MutexGuard lock(m_mutex);
-		for (Buffer& buffer : m_buffers)
+		const Vec3 dir = (buffer.position - m_listener_pos).toFloat();
+		const float dist = dir.length();
+		if (dist < 0.001f)
+		{
+			left = right = gain * 0.70710678f;
+			return;
+		}
+		const Vec3 n = dir * (1 / dist);
+		gain /= maximum(dist, 1.f);
+		const Vec3 right_dir = crossProduct(m_listener_front, m_listener_up);
+		const float pan = clamp(dotProduct(n, right_dir), -1.f, 1.f);
+		const float front = dotProduct(n, m_listener_front);
+		if (front < 0) gain *= 1 + 0.3f * front;
+		const float angle = (pan + 1) * PI * 0.25f;
+		left = gain * cosf(angle);
+		right = gain * sinf(angle);
+	}
+
+
+	// linear interpolation, returns number of produced frames
+	static u32 resample(Voice& voice, float* left, float* right, u32 frames)
+	{
+		const double end = voice.frames;
+		u32 i = 0;
+		for (; i < frames; ++i)
 		{
-			if((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING) == 0) continue;
-			
-			mixBuffer(output, size_bytes, buffer);
+			if (voice.cursor >= end)
+			{
+				if (!voice.looped) break;
+				voice.cursor = fmod(voice.cursor, end);
+			}
+			const u32 idx = (u32)voice.cursor;
+			const float t = float(voice.cursor - idx);
+			const u32 next = idx + 1 < voice.frames ? idx + 1 : (voice.looped ? 0 : idx);
+			if (voice.channels == 1)
+			{
+				const float a = voice.data[idx];
+				const float b = voice.data[next];
+				left[i] = a + (b - a) * t;
+			}
+			else
+			{
+				const float la = voice.data[idx * 2];
+				const float lb = voice.data[next * 2];
+				const float ra = voice.data[idx * 2 + 1];
+				const float rb = voice.data[next * 2 + 1];
+				left[i] = la + (lb - la) * t;
+				right[i] = ra + (rb - ra) * t;
+			}
+			voice.cursor += voice.step;
 		}
+		return i;
 	}
 
 
-	void mixBuffer(u16* output, int size_bytes, Buffer& buffer)
+	// decodes ahead, frames before `from` are not needed anymore
+	static void refillStream(Buffer& buffer, u64 from, bool looped)
 	{
-		ASSERT(buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING);
-		ASSERT(buffer.channels == 1); // nothing else supported yet
-		if (buffer.cursor >= buffer.data.size()) return;
-		int total = size_bytes;
-		bool is_looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
-		do
+		PROFILE_FUNCTION();
+		const u32 frames = buffer.stream_frames;
+		const u32 channels = buffer.channels;
+		buffer.ring_begin = maximum(buffer.ring_begin, from);
+		while (buffer.ring_end - buffer.ring_begin < STREAM_RING_FRAMES)
 		{
-			int to_copy = minimum(total, buffer.data.size() - buffer.cursor);
-			memcpy(output, &buffer.data[buffer.cursor], to_copy);
-			buffer.cursor += to_copy;
-			if(is_looped) buffer.cursor = buffer.cursor % buffer.data.size();
-			total -= to_copy;
-		} while(total > 0 && is_looped);
+			if (!looped && buffer.ring_end >= frames) break;
+
+			const u32 clip_frame = u32(buffer.ring_end % frames);
+			if (buffer.stream_pos != clip_frame)
+			{
+				buffer.stream->seek(clip_frame);
+				buffer.stream_pos = clip_frame;
+			}
+			const u32 ring_idx = u32(buffer.ring_end % STREAM_RING_FRAMES);
+			u32 chunk = STREAM_RING_FRAMES - u32(buffer.ring_end - buffer.ring_begin);
+			chunk = minimum(chunk, frames - clip_frame, STREAM_RING_FRAMES - ring_idx);
+
+			i16* out = &buffer.ring[ring_idx * channels];
+			const u32 read = buffer.stream->read(out, chunk);
+			// the stream ended sooner than expected, keep the timeline consistent
+			if (read < chunk) memset(out + read * channels, 0, (chunk - read) * channels * sizeof(i16));
+			buffer.stream_pos += chunk;
+			buffer.ring_end += chunk;
+		}
 	}
 
-	void play(BufferHandle buffer, bool looped) override 
+
+	static u32 resampleStream(Voice& voice, float* left, float* right, u32 frames)
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::PLAYING;
-		if(looped)
+		Buffer& buffer = *voice.stream;
+		if (buffer.stream_generation != voice.generation)
+		{
+			// started or the cursor was set from outside
+			buffer.stream_generation = voice.generation;
+			buffer.loop_base = 0;
+			buffer.ring_begin = buffer.ring_end = (u64)voice.cursor;
+		}
+
+		const double end = voice.frames;
+		const u32 channels = voice.channels;
+		u32 i = 0;
+		for (; i < frames; ++i)
+		{
+			while (voice.cursor >= end)
+			{
+				if (!voice.looped) return i;
+				voice.cursor -= end;
+				buffer.loop_base += voice.frames;
+			}
+			const u64 idx = buffer.loop_base + (u64)voice.cursor;
+			if (idx + 1 >= buffer.ring_end) refillStream(buffer, idx, voice.looped);
+			if (idx >= buffer.ring_end) break;
+
+			const float t = float(voice.cursor - (u64)voice.cursor);
+			const u64 next = idx + 1 < buffer.ring_end ? idx + 1 : idx;
+			const i16* a = &buffer.ring[u32(idx % STREAM_RING_FRAMES) * channels];
+			const i16* b = &buffer.ring[u32(next % STREAM_RING_FRAMES) * channels];
+			left[i] = a[0] + (b[0] - a[0]) * t;
+			if (channels == 2) right[i] = a[1] + (b[1] - a[1]) * t;
+			voice.cursor += voice.step;
+		}
+		return i;
+	}
+
+
+	static void accumulate(float* LUMIX_RESTRICT bus, const float* LUMIX_RESTRICT src, float gain, u32 count)
+	{
+		const float4 g = f4Splat(gain);
+		for (u32 i = 0; i < count; i += 4)
+		{
+			f4Store(bus + i, f4Add(f4Load(bus + i), f4Mul(f4Load(src + i), g)));
+		}
+	}
+
+
+	// mixes to interleaved stereo, frames <= MIX_FRAMES
+	void mix(i16* output, u32 frames)
+	{
+		ASSERT(frames <= MIX_FRAMES);
+		PROFILE_FUNCTION();
+		executeCommands();
+
+		u32 voices_count = 0;
+		for (u32 i = 0, c = m_buffers.size(); i < c; ++i)
+		{
+			Buffer& buffer = m_buffers[i];
+			if ((buffer.runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING) == 0) continue;
+			const bool looped = buffer.runtime_flags & (u8)Buffer::RuntimeFlags::LOOPED;
+			const u32 buffer_frames = buffer.getFramesCount();
+			if (buffer_frames == 0 || (!looped && buffer.cursor >= buffer_frames)) continue;
+
+			Voice& voice = m_voices[voices_count];
+			++voices_count;
+			voice.data = (const i16*)buffer.data.begin();
+			voice.frames = buffer_frames;
+			voice.channels = buffer.channels;
+			voice.cursor = buffer.cursor;
+			voice.step = buffer.frequency / m_output_rate;
+			voice.looped = looped;
+			voice.buffer = i;
+			voice.generation = buffer.generation;
+			voice.stream = buffer.stream ? &buffer : nullptr;
+			getGains(buffer, voice.gain_left, voice.gain_right);
+		}
+
+		memset(m_bus_left, 0, sizeof(m_bus_left));
+		memset(m_bus_right, 0, sizeof(m_bus_right));
+		const float to_float = 1 / 32768.f;
+		const u32 padded = (frames + 3) & ~3;
+		for (u32 v = 0; v < voices_count; ++v)
 		{
-			m_buffers[buffer].runtime_flags |= (u8)Buffer::RuntimeFlags::LOOPED;
+			Voice& voice = m_voices[v];
+			const u32 produced = voice.stream
+				? resampleStream(voice, m_voice_left, m_voice_right, frames)
+				: resample(voice, m_voice_left, m_voice_right, frames);
+			Buffer& buffer = m_buffers[voice.buffer];
+			buffer.cursor = voice.cursor;
+			buffer.published_cursor = (u32)voice.cursor;
+			if (produced == 0) continue;
+			for (u32 i = produced; i < padded; ++i)
+			{
+				m_voice_left[i] = 0;
+				m_voice_right[i] = 0;
+			}
+			const float* right_src = voice.channels == 1 ? m_voice_left : m_voice_right;
+			accumulate(m_bus_left, m_voice_left, voice.gain_left * to_float, padded);
+			accumulate(m_bus_right, right_src, voice.gain_right * to_float, padded);
 		}
-		else
+
+		const float4 min = f4Splat(-1);
+		const float4 max = f4Splat(1);
+		for (u32 i = 0; i < padded; i += 4)
 		{
-			m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::LOOPED;
+			f4Store(m_bus_left + i, f4Min(f4Max(f4Load(m_bus_left + i), min), max));
+			f4Store(m_bus_right + i, f4Min(f4Max(f4Load(m_bus_right + i), min), max));
 		}
+		for (u32 i = 0; i < frames; ++i)
+		{
+			output[i * 2] = i16(m_bus_left[i] * 32767);
+			output[i * 2 + 1] = i16(m_bus_right[i] * 32767);
+		}
+	}
+
+
+	void play(BufferHandle buffer, bool looped) override 
+	{
+		ASSERT(!m_buffers[buffer].free);
+		m_buffers[buffer].playing = true;
+		Command cmd;
+		cmd.type = Command::Type::PLAY;
+		cmd.buffer = buffer;
+		cmd.looped = looped;
+		pushCommand(cmd);
 	}
 
 
 	bool isPlaying(BufferHandle buffer) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::PLAYING;
+		ASSERT(!m_buffers[buffer].free);
+		return m_buffers[buffer].playing;
 	}
 
 
+	// releases the buffer, same as on other platforms
 	void stop(BufferHandle buffer) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
-		m_buffers[buffer].cursor = 0;
+		ASSERT(!m_buffers[buffer].free);
+		m_buffers[buffer].playing = false;
+		pushCommand(Command::Type::STOP, buffer);
 	}
 
 
+	// the cursor is published at the end of each mixed block, so this lags behind by up to MIX_FRAMES
 	bool isEnd(BufferHandle buffer) override
 	{ 
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		return m_buffers[buffer].cursor >= m_buffers[buffer].data.size();
+		ASSERT(!m_buffers[buffer].free);
+		return m_buffers[buffer].published_cursor >= m_buffers[buffer].getFramesCount();
 	}
 
 
 	void pause(BufferHandle buffer) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		m_buffers[buffer].runtime_flags &= ~(u8)Buffer::RuntimeFlags::PLAYING;
+		ASSERT(!m_buffers[buffer].free);
+		m_buffers[buffer].playing = false;
+		pushCommand(Command::Type::PAUSE, buffer);
 	}
 
 
 	void setMasterVolume(float volume) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		pushCommand(Command::Type::SET_MASTER_VOLUME, -1, volume);
 	}
 
 
 	void setVolume(BufferHandle buffer, float volume) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(!m_buffers[buffer].free);
+		pushCommand(Command::Type::SET_VOLUME, buffer, volume);
 	}
 
 
+	// same mapping as DSBFREQUENCY_MIN..DSBFREQUENCY_MAX on windows
 	void setFrequency(BufferHandle buffer, float frequency) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(!m_buffers[buffer].free);
+		pushCommand(Command::Type::SET_FREQUENCY, buffer, 100 + frequency * (200000 - 100));
 	}
 
 
 	void setCurrentTime(BufferHandle handle, float time_seconds) override 
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
+		ASSERT(!m_buffers[handle].free);
 		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		float rel = time_seconds / length;
-		buffer.cursor = rel * buffer.data.size();
-		buffer.cursor = clamp(buffer.cursor, 0, buffer.data.size());
+		const double cursor = clamp(double(time_seconds) * buffer.sample_rate, 0.0, (double)buffer.getFramesCount());
+		pushCommand(Command::Type::SET_CURSOR, handle, cursor);
 	}
 
 
 	float getCurrentTime(BufferHandle handle) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[handle].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		
+		ASSERT(!m_buffers[handle].free);
 		Buffer& buffer = m_buffers[handle];
-		float length = float(buffer.data.size() / double(buffer.sample_rate * 2 * buffer.channels));
-		return float(length * double(buffer.cursor) / buffer.data.size());
+		return float(buffer.published_cursor) / buffer.sample_rate;
 	}
 
 
 	void setListenerPosition(const DVec3& pos) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		Command cmd;
+		cmd.type = Command::Type::SET_LISTENER_POSITION;
+		cmd.buffer = -1;
+		cmd.position = pos;
+		pushCommand(cmd);
 	}
 
 
@@ -244,16 +610,23 @@ struct AudioDeviceImpl : AudioDevice
 		float up_y,
 		float up_z) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(false); // not implemented yet
+		Command cmd;
+		cmd.type = Command::Type::SET_LISTENER_ORIENTATION;
+		cmd.buffer = -1;
+		cmd.front = Vec3(front_x, front_y, front_z).normalized();
+		cmd.up = Vec3(up_x, up_y, up_z).normalized();
+		pushCommand(cmd);
 	}
 	
 
 	void setSourcePosition(BufferHandle buffer, const DVec3& pos) override
 	{
-		MutexGuard lock(m_mutex);
-		ASSERT(m_buffers[buffer].runtime_flags & (u8)Buffer::RuntimeFlags::READY);
-		ASSERT(false); // not implemented yet
+		ASSERT(!m_buffers[buffer].free);
+		Command cmd;
+		cmd.type = Command::Type::SET_SOURCE_POSITION;
+		cmd.buffer = buffer;
+		cmd.position = pos;
+		pushCommand(cmd);
 	}
 	
 	
@@ -270,8 +643,7 @@ struct AudioDeviceImpl : AudioDevice
 		m_buffers.reserve(MAX_BUFFERS_COUNT);
 		for (int i = 0; i < MAX_BUFFERS_COUNT; ++i)
 		{
-			Buffer& buffer = m_buffers.emplace(m_allocator);
-			buffer.runtime_flags = 0;
+			m_buffers.emplace(m_allocator);
 		}
 	}
 
@@ -284,6 +656,10 @@ struct AudioDeviceImpl : AudioDevice
 			m_task->destroy();
 			LUMIX_DELETE(m_allocator, m_task);
 		}
+		for (Buffer& buffer : m_buffers)
+		{
+			if (buffer.stream) buffer.stream->destroy();
+		}
 		if (m_device) m_api.snd_pcm_close(m_device);
 		if (m_alsa_lib) OS::unloadLibrary(m_alsa_lib);
 	}
@@ -337,7 +713,7 @@ struct AudioDeviceImpl : AudioDevice
 		if (!loadAlsa()) return false;
 		
 		unsigned int rate = 44100;
-		int channels = 1;
+		int channels = 2;
 		snd_pcm_hw_params_t* hw_params;
 		snd_pcm_uframes_t buffer_size = 1024;
 
@@ -356,6 +732,8 @@ struct AudioDeviceImpl : AudioDevice
 		res = m_api.snd_pcm_hw_params(m_device, hw_params);
 		if(res < 0) goto error;
 		
+		m_output_rate = rate;
+
 		res = m_api.snd_pcm_start(m_device);
 		if(res < 0) goto error;
 
@@ -400,16 +778,33 @@ struct AudioDeviceImpl : AudioDevice
 
 
 	static const int MAX_BUFFERS_COUNT = 256;
+	static const u32 MIX_FRAMES = 1024;
+	static const u32 STREAM_RING_FRAMES = 16384;
+	static const u32 COMMANDS_CAPACITY = 4096;
 
 
 	IAllocator& m_allocator;
 	Array<Buffer> m_buffers;
 	AudioTask* m_task = nullptr;
 	Engine& m_engine;
-	Mutex m_mutex;
+	Command m_commands[COMMANDS_CAPACITY];
+	volatile u32 m_commands_write = 0;
+	volatile u32 m_commands_read = 0;
 	void* m_alsa_lib = nullptr;
 	snd_pcm_t* m_device = nullptr;
 	API m_api;
+	u32 m_output_rate = 44100;
+
+	// used only by the mixing thread
+	float m_master_volume = 1;
+	DVec3 m_listener_pos = DVec3(0);
+	Vec3 m_listener_front = Vec3(0, 0, -1);
+	Vec3 m_listener_up = Vec3(0, 1, 0);
+	Voice m_voices[MAX_BUFFERS_COUNT];
+	alignas(16) float m_voice_left[MIX_FRAMES];
+	alignas(16) float m_voice_right[MIX_FRAMES];
+	alignas(16) float m_bus_left[MIX_FRAMES];
+	alignas(16) float m_bus_right[MIX_FRAMES];
 };
 
 
@@ -424,42 +819,33 @@ int AudioTask::task()
 {
 	while(!m_finished)
 	{
-		u16 buffer[2*1024];
-		int frames_avail = lengthOf(buffer);
-		m_device.mix(buffer, frames_avail * 2);
+		i16 buffer[AudioDeviceImpl::MIX_FRAMES * 2];
+		snd_pcm_sframes_t frames_avail = AudioDeviceImpl::MIX_FRAMES;
+		m_device.mix(buffer, (u32)frames_avail);
 
-		u16* iter = buffer;
-		while(frames_avail > 0)
+		i16* iter = buffer;
+		while(frames_avail > 0 && !m_finished)
 		{		
-			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
+			snd_pcm_sframes_t frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, iter, frames_avail);
 			if (frames_written < 0)
 			{
-				if (frames_written == -EAGAIN) continue;
-				if (frames_written == -EPIPE) 
+				if (frames_written == -EAGAIN)
 				{
-					int recover_result = m_device.m_api.snd_pcm_recover(m_device.m_device, frames_written, 1);
-					if (recover_result < 0)
-					{
-						handleError(recover_result);
-						break;
-					}
-
-					frames_written = m_device.m_api.snd_pcm_writei(m_device.m_device, buffer, frames_avail);
-					if (frames_written < 0)
-					{
-						handleError(recover_result);
-						break;
-					}
-				} 
-				else 
+					m_device.m_api.snd_pcm_wait(m_device.m_device, 10);
+					continue;
+				}
+				const int recover_result = m_device.m_api.snd_pcm_recover(m_device.m_device, (int)frames_written, 1);
+				if (recover_result < 0)
 				{
-					handleError(frames_written);
+					handleError(recover_result);
+					break;
 				}
 			}
 			else
 			{
 				frames_avail -= frames_written;
-				iter += frames_written;
+				// interleaved stereo
+				iter += frames_written * 2;
 			}
 		}
 	}
@@ -477,6 +863,15 @@ struct NullAudioDevice final : AudioDevice
 	{
 		return INVALID_BUFFER_HANDLE;
 	}
+	BufferHandle createStreamBuffer(IStream* stream,
+		u32 frames_count,
+		int channels,
+		int sample_rate,
+		int flags) override
+	{
+		stream->destroy();
+		return INVALID_BUFFER_HANDLE;
+	}
 	void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
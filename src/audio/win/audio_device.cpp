@@ -21,6 +21,8 @@ struct AudioDeviceImpl final : AudioDevice
 		LPDIRECTSOUND3DBUFFER8 handle_3d;
 		IDirectSoundBuffer8* handle8;
 		const void* data;
+		AudioDevice::IStream* stream;
+		DWORD block_align;
 		DWORD data_size;
 		DWORD written;
 		int sparse_idx;
@@ -142,6 +144,10 @@ struct AudioDeviceImpl final : AudioDevice
 
 	~AudioDeviceImpl()
 	{
+		for (int i = 0; i < m_buffer_count; ++i)
+		{
+			if (m_buffers[i].stream) m_buffers[i].stream->destroy();
+		}
 		if (m_listener) m_listener->Release();
 		if (m_primary_buffer) m_primary_buffer->Release();
 		if (m_direct_sound) m_direct_sound->Release();
@@ -149,11 +155,44 @@ struct AudioDeviceImpl final : AudioDevice
 	}
 
 
+	// zero fills whatever the stream does not provide
+	static void readStream(AudioDevice::IStream& stream, void* dst, DWORD size, DWORD block_align)
+	{
+		const u32 frames = stream.read((i16*)dst, size / block_align);
+		const DWORD read = frames * block_align;
+		if (read < size) ZeroMemory((u8*)dst + read, size - read);
+	}
+
+
 	BufferHandle createBuffer(const void* data,
 		int data_size,
 		int channels,
 		int sample_rate,
 		int flags) override
+	{
+		return createBuffer(data, nullptr, data_size, channels, sample_rate, flags);
+	}
+
+
+	// long streams are decoded in update() the same way long buffers are copied
+	BufferHandle createStreamBuffer(IStream* stream,
+		u32 frames_count,
+		int channels,
+		int sample_rate,
+		int flags) override
+	{
+		const BufferHandle handle = createBuffer(nullptr, stream, frames_count * channels * 2, channels, sample_rate, flags);
+		if (handle == INVALID_BUFFER_HANDLE) stream->destroy();
+		return handle;
+	}
+
+
+	BufferHandle createBuffer(const void* data,
+		IStream* stream,
+		int data_size,
+		int channels,
+		int sample_rate,
+		int flags)
 	{
 		if (m_buffer_count == MAX_PLAYING_SOUNDS) return INVALID_BUFFER_HANDLE;
 
@@ -189,7 +228,14 @@ struct AudioDeviceImpl final : AudioDevice
 			buffer->Release();
 			return INVALID_BUFFER_HANDLE;
 		}
-		memcpy(p1, data, s1);
+		if (stream)
+		{
+			readStream(*stream, p1, s1, wave_format.nBlockAlign);
+		}
+		else
+		{
+			memcpy(p1, data, s1);
+		}
 		result = SUCCEEDED(buffer->Unlock(p1, s1, p2, s2));
 		if (!result)
 		{
@@ -221,6 +267,8 @@ struct AudioDeviceImpl final : AudioDevice
 				handle = m_buffer_count;
 				m_buffers[m_buffer_count].handle = buffer;
 				m_buffers[m_buffer_count].data = data;
+				m_buffers[m_buffer_count].stream = stream;
+				m_buffers[m_buffer_count].block_align = wave_format.nBlockAlign;
 				m_buffers[m_buffer_count].data_size = data_size;
 				m_buffers[m_buffer_count].written = buffer_size;
 				m_buffers[m_buffer_count].sparse_idx = i;
@@ -403,6 +451,7 @@ struct AudioDeviceImpl final : AudioDevice
 		if (buffer.handle_3d) buffer.handle_3d->Release();
 		if (buffer.handle8) buffer.handle8->Release();
 		buffer.handle->Release();
+		if (buffer.stream) buffer.stream->destroy();
 
 		m_buffers[dense_idx] = m_buffers[m_buffer_count];
 		m_buffers[m_buffer_count].handle = nullptr;
@@ -469,7 +518,9 @@ struct AudioDeviceImpl final : AudioDevice
 			}
 			else
 			{
+				pos -= pos % format.nBlockAlign;
 				buffer.written = pos;
+				if (buffer.stream) buffer.stream->seek(pos / format.nBlockAlign);
 			}
 		}
 	}
@@ -484,16 +535,27 @@ struct AudioDeviceImpl final : AudioDevice
 		{
 			return;
 		}
-		auto updateBuffer = [&buffer](void* p, DWORD size) {
+		auto copy = [&buffer](void* dst, DWORD offset, DWORD size) {
+			if (buffer.stream)
+			{
+				if (offset == 0) buffer.stream->seek(0);
+				readStream(*buffer.stream, dst, size, buffer.block_align);
+			}
+			else
+			{
+				memcpy(dst, (u8*)buffer.data + offset, size);
+			}
+		};
+		auto updateBuffer = [&buffer, &copy](void* p, DWORD size) {
 			if (!p) return;
 			if (buffer.written + size > buffer.data_size)
 			{
-				memcpy(p, (u8*)buffer.data + buffer.written, buffer.data_size - buffer.written);
+				copy(p, buffer.written, buffer.data_size - buffer.written);
 				void* p_2 = (u8*)p + (buffer.data_size - buffer.written);
 				DWORD size_2 = size - (buffer.data_size - buffer.written);
 				if (buffer.looped)
 				{
-					memcpy(p_2, buffer.data, size_2);
+					copy(p_2, 0, size_2);
 				}
 				else
 				{
@@ -502,7 +564,7 @@ struct AudioDeviceImpl final : AudioDevice
 			}
 			else
 			{
-				memcpy(p, (u8*)buffer.data + buffer.written, size);
+				copy(p, buffer.written, size);
 			}
 			buffer.written += size;
 			buffer.written = buffer.written % buffer.data_size;
@@ -576,6 +638,15 @@ struct NullAudioDevice final : AudioDevice
 	{
 		return INVALID_BUFFER_HANDLE;
 	}
+	BufferHandle createStreamBuffer(IStream* stream,
+		u32 frames_count,
+		int channels,
+		int sample_rate,
+		int flags) override
+	{
+		stream->destroy();
+		return INVALID_BUFFER_HANDLE;
+	}
 	void setEcho(BufferHandle handle,
 		float wet_dry_mix,
 		float feedback,
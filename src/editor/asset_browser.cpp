@@ -39,10 +39,12 @@ AssetBrowser::AssetBrowser(StudioApp& app)
 	, m_history_index(-1)
 	, m_file_infos(app.getAllocator())
 	, m_filtered_file_infos(app.getAllocator())
+	, m_tile_requests(app.getAllocator())
 	, m_subdirs(app.getAllocator())
 {
 	IAllocator& allocator = app.getAllocator();
 	m_filter[0] = '\0';
+	m_last_filter[0] = '\0';
 
 	const char* base_path = app.getEngine().getFileSystem().getBasePath();
 
@@ -140,6 +142,8 @@ void AssetBrowser::changeDir(const char* path)
 		ri->unloadTexture(info.tex);
 	}
 	m_file_infos.clear();
+	m_tile_requests.clear();
+	m_last_filter[0] = '\0';
 
 	Path::normalize(path, Span(m_dir.data));
 	int len = stringLength(m_dir);
@@ -163,25 +167,20 @@ void AssetBrowser::changeDir(const char* path)
 	for (const AssetCompiler::ResourceItem& res : resources) {
 		if (res.dir_hash != dir_hash) continue;
 
-		FileInfo tile;
-		char filename[MAX_PATH_LENGTH];
+		FileInfo& tile = m_file_infos.emplace();
 		Span<const char> subres = getSubresource(res.path.c_str());
 		if (*subres.end()) {
-			copyNString(Span(filename), subres.begin(), subres.length());
-			catString(filename, ":");
-			const int tmp_len = stringLength(filename);
-			Path::getBasename(Span(filename + tmp_len, filename + sizeof(filename)), res.path.c_str());
+			copyNString(Span(tile.clamped_filename.data), subres.begin(), subres.length());
+			catString(tile.clamped_filename.data, ":");
+			const int tmp_len = stringLength(tile.clamped_filename);
+			Path::getBasename(Span(tile.clamped_filename.data + tmp_len, tile.clamped_filename.data + sizeof(tile.clamped_filename.data)), res.path.c_str());
 		}
 		else {
-			Path::getBasename(Span(filename), res.path.c_str());
+			Path::getBasename(Span(tile.clamped_filename.data), res.path.c_str());
 		}
-		clampText(filename, TILE_SIZE);
 
 		tile.file_path_hash = res.path.getHash();
 		tile.filepath = res.path.c_str();
-		tile.clamped_filename = filename;
-
-		m_file_infos.push(tile);
 	}
 	compiler.unlockResources();
 
@@ -247,9 +246,21 @@ void AssetBrowser::dirColumn()
 
 void AssetBrowser::doFilter()
 {
-	m_filtered_file_infos.clear();
-	if (!m_filter[0]) return;
+	PROFILE_FUNCTION();
+	// extended filter can only match a subset of previous results
+	const bool narrow = m_last_filter[0] && !m_filtered_file_infos.empty() && stristr(m_filter, m_last_filter);
+	copyString(m_last_filter, m_filter);
+	if (!m_filter[0]) {
+		m_filtered_file_infos.clear();
+		return;
+	}
 
+	if (narrow) {
+		m_filtered_file_infos.eraseItems([&](int i){ return !stristr(m_file_infos[i].filepath, m_filter); });
+		return;
+	}
+
+	m_filtered_file_infos.clear();
 	for (int i = 0, c = m_file_infos.size(); i < c; ++i)
 	{
 		if (stristr(m_file_infos[i].filepath, m_filter)) m_filtered_file_infos.push(i);
@@ -273,21 +284,51 @@ int AssetBrowser::getThumbnailIndex(int i, int j, int columns) const
 }
 
 
-void AssetBrowser::createTile(FileInfo& tile, const char* out_path)
+bool AssetBrowser::createTile(FileInfo& tile, const char* out_path)
 {
-	if (tile.create_called) return;
-	
 	logInfo("Editor") << "Creating tile for " << tile.filepath;
-	tile.create_called = true;
 	const AssetCompiler& compiler = m_app.getAssetCompiler();
+	const ResourceType type = compiler.getResourceType(tile.filepath);
 	for (IPlugin* plugin : m_plugins) {
-		ResourceType type = compiler.getResourceType(tile.filepath);
-		if (plugin->createTile(tile.filepath, out_path, type)) break;
+		if (plugin->createTile(tile.filepath, out_path, type)) return true;
 	}
+	return false;
 }
 
 
-void AssetBrowser::thumbnail(FileInfo& tile)
+void AssetBrowser::processTileRequests()
+{
+	PROFILE_FUNCTION();
+	RenderInterface* ri = m_app.getWorldEditor().getRenderInterface();
+	FileSystem& fs = m_app.getEngine().getFileSystem();
+	int processed = 0;
+	for (int idx : m_tile_requests) {
+		FileInfo& tile = m_file_infos[idx];
+		StaticString<MAX_PATH_LENGTH> path(".lumix/asset_tiles/", tile.file_path_hash, ".dds");
+		if (tile.tile_state == TileState::CREATING) {
+			// plugins create tiles asynchronously, poll until it's there
+			if (!fs.fileExists(path) || fs.getLastModified(path) < fs.getLastModified(tile.filepath)) continue;
+			tile.tex = ri->loadTexture(Path(path));
+			tile.tile_state = TileState::LOADED;
+			continue;
+		}
+
+		if (processed == MAX_TILE_REQUESTS_PER_FRAME) continue;
+		++processed;
+
+		if (fs.fileExists(path) && fs.getLastModified(path) >= fs.getLastModified(tile.filepath)) {
+			tile.tex = ri->loadTexture(Path(path));
+			tile.tile_state = TileState::LOADED;
+		}
+		else {
+			tile.tile_state = createTile(tile, path) ? TileState::CREATING : TileState::NO_TILE;
+		}
+	}
+	m_tile_requests.clear();
+}
+
+
+void AssetBrowser::thumbnail(FileInfo& tile, int idx)
 {
 	ImGui::BeginGroup();
 	ImVec2 img_size((float)TILE_SIZE, (float)TILE_SIZE);
@@ -305,23 +346,11 @@ void AssetBrowser::thumbnail(FileInfo& tile)
 	else
 	{
 		ImGui::Rect(img_size.x, img_size.y, 0xffffFFFF);
-		StaticString<MAX_PATH_LENGTH> path(".lumix/asset_tiles/", tile.file_path_hash, ".dds");
-		FileSystem& fs = m_app.getEngine().getFileSystem();
-		if (fs.fileExists(path))
-		{
-			if (fs.getLastModified(path) >= fs.getLastModified(tile.filepath))
-			{
-				tile.tex = ri->loadTexture(Path(path));
-			}
-			else
-			{
-				createTile(tile, path);
-			}
-		}
-		else
-		{
-			createTile(tile, path);
-		}
+		if (tile.tile_state != TileState::NO_TILE) m_tile_requests.push(idx);
+	}
+	if (!tile.is_clamped) {
+		clampText(tile.clamped_filename.data, TILE_SIZE);
+		tile.is_clamped = true;
 	}
 	ImVec2 text_size = ImGui::CalcTextSize(tile.clamped_filename);
 	ImVec2 pos = ImGui::GetCursorPos();
@@ -382,7 +411,7 @@ void AssetBrowser::fileColumn()
 					int idx = getThumbnailIndex(i, j, columns);
 					if (idx < 0) break;
 					FileInfo& tile = m_file_infos[idx];
-					thumbnail(tile);
+					thumbnail(tile, idx);
 					callbacks(tile, idx);
 				}
 			}
@@ -396,6 +425,7 @@ void AssetBrowser::fileColumn()
 			}
 		}
 	}
+	processTileRequests();
 
 	bool open_delete_popup = false;
 	FileSystem& fs = m_app.getEngine().getFileSystem();
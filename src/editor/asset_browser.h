@@ -66,21 +66,35 @@ public:
 	static const int TILE_SIZE = 64;
 
 private:
+	enum class TileState : u8
+	{
+		UNKNOWN,
+		CREATING,
+		LOADED,
+		NO_TILE
+	};
+
 	struct FileInfo
 	{
 		StaticString<MAX_PATH_LENGTH> clamped_filename;
 		StaticString<MAX_PATH_LENGTH> filepath;
 		u32 file_path_hash;
 		void* tex = nullptr;
-		bool create_called = false;
+		TileState tile_state = TileState::UNKNOWN;
+		// clamping needs ImGui font metrics, it's done when the tile is first displayed
+		bool is_clamped = false;
 	};
 
+	// tiles in unknown state are checked at most this many times per frame
+	static constexpr int MAX_TILE_REQUESTS_PER_FRAME = 8;
+
 private:
 	void dirColumn();
 	void fileColumn();
 	void detailsGUI();
-	void createTile(FileInfo& tile, const char* out_path);
-	void thumbnail(FileInfo& tile);
+	bool createTile(FileInfo& tile, const char* out_path);
+	void processTileRequests();
+	void thumbnail(FileInfo& tile, int idx);
 	int getThumbnailIndex(int i, int j, int columns) const;
 	void doFilter();
 	void breadcrumbs();
@@ -98,6 +112,9 @@ private:
 	Array<StaticString<MAX_PATH_LENGTH> > m_subdirs;
 	Array<FileInfo> m_file_infos;
 	Array<int> m_filtered_file_infos;
+	// visible tiles without thumbnail, gathered every frame, so tiles on screen are always processed first
+	Array<int> m_tile_requests;
+	char m_last_filter[128];
 	Array<Path> m_history;
 	int m_history_index;
 	HashMap<ResourceType, IPlugin*> m_plugins;
@@ -5,24 +5,53 @@
 #include "editor/log_ui.h"
 #include "editor/studio_app.h"
 #include "editor/world_editor.h"
+#include "engine/atomic.h"
+#include "engine/command_line_parser.h"
 #include "engine/crc32.h"
 #include "engine/engine.h"
+#include "engine/hash.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
-#include "engine/atomic.h"
+#include "engine/lz4.h"
 #include "engine/sync.h"
-#include "engine/thread.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
 {
 
 
+// smaller resources load faster without decompression
+static constexpr u32 MIN_COMPRESSED_SIZE = 4096;
+static constexpr u32 ASSET_CACHE_MAGIC = 0x4341414c; // == 'LAAC'
+static constexpr u32 FILE_RECORDS_MAGIC = 0x5246414c; // == 'LAFR'
+// file changes are processed once there is no new change for this long (in seconds),
+// so e.g. a checkout touching thousands of files is handled as a single batch
+static constexpr float CHANGES_DEBOUNCE_TIME = 0.3f;
+// continuous changes do not postpone processing indefinitely
+static constexpr float MAX_CHANGES_DELAY = 2.f;
+
+
+enum class AssetCacheVersion : u32 {
+	FIRST,
+
+	LATEST
+};
+
+
+enum class FileRecordsVersion : u32 {
+	FIRST,
+
+	LATEST
+};
+
+
 struct AssetCompilerImpl;
 
 
@@ -36,20 +65,6 @@ struct HashFunc<Path>
 };
 
 
-struct AssetCompilerTask : Thread
-{
-	AssetCompilerTask(AssetCompilerImpl& compiler, IAllocator& allocator) 
-		: Thread(allocator) 
-		 , m_compiler(compiler)
-	{}
-
-	int task() override;
-
-	AssetCompilerImpl& m_compiler;
-	volatile bool m_finished = false;
-};
-
-
 void AssetCompiler::IPlugin::addSubresources(AssetCompiler& compiler, const char* path)
 {
 	const ResourceType type = compiler.getResourceType(path);
@@ -84,10 +99,11 @@ struct AssetCompilerImpl : AssetCompiler
 		: m_app(app)
 		, m_load_hook(*this)
 		, m_plugins(app.getAllocator())
-		, m_task(*this, app.getAllocator())
 		, m_to_compile(app.getAllocator())
 		, m_compiled(app.getAllocator())
-		, m_semaphore(0, 0x7fFFffFF)
+		, m_in_progress(app.getAllocator())
+		, m_compile_outputs(app.getAllocator())
+		, m_files(app.getAllocator())
 		, m_registered_extensions(app.getAllocator())
 		, m_resources(app.getAllocator())
 		, m_to_compile_subresources(app.getAllocator())
@@ -97,10 +113,32 @@ struct AssetCompilerImpl : AssetCompiler
 		FileSystem& fs = app.getEngine().getFileSystem();
 		m_watcher = FileSystemWatcher::create(fs.getBasePath(), app.getAllocator());
 		m_watcher->getCallback().bind<&AssetCompilerImpl::onFileChanged>(this);
-		m_task.create("Asset compiler", true);
+		// worker 0 is the main thread, it does not compile so the editor stays responsive
+		const u32 workers_count = JobSystem::getWorkersCount();
+		m_max_jobs = workers_count > 1 ? workers_count - 1 : 1;
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-compile_jobs")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				u32 jobs;
+				if (fromCString(Span(tmp, stringLength(tmp)), Ref(jobs))) setMaxCompileJobs(jobs);
+			}
+			else if (parser.currentEquals("-shared_asset_cache")) {
+				if (!parser.next()) break;
+				char tmp[MAX_PATH_LENGTH];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				setSharedCachePath(tmp);
+			}
+		}
 		const char* base_path = m_app.getEngine().getFileSystem().getBasePath();
 		StaticString<MAX_PATH_LENGTH> path(base_path, ".lumix/assets");
 		OS::makePath(path);
+		const StaticString<MAX_PATH_LENGTH> cache_path(base_path, ".lumix/cache");
+		OS::makePath(cache_path);
 		ResourceManagerHub& rm = app.getEngine().getResourceManager();
 		rm.setLoadHook(&m_load_hook);
 	}
@@ -132,12 +170,10 @@ struct AssetCompilerImpl : AssetCompiler
 		else {
 			logError("Editor") << "Could not save .lumix/assets/_list.txt";
 		}
+		saveFileRecords();
 
 		ASSERT(m_plugins.empty());
-		m_task.m_finished = true;
-		m_to_compile.emplace();
-		m_semaphore.signal();
-		m_task.destroy();
+		stopCompileJobs();
 		ResourceManagerHub& rm = m_app.getEngine().getResourceManager();
 		rm.setLoadHook(nullptr);
 		FileSystemWatcher::destroy(m_watcher);
@@ -145,6 +181,7 @@ struct AssetCompilerImpl : AssetCompiler
 
 	bool copyCompile(const Path& src) override {
 		const StaticString<MAX_PATH_LENGTH> dst(".lumix/assets/", src.getHash(), ".res");
+		recordOutput(src.c_str(), src.getHash());
 
 		FileSystem& fs = m_app.getEngine().getFileSystem();
 		return fs.copyFile(src.c_str(), dst);
@@ -153,7 +190,8 @@ struct AssetCompilerImpl : AssetCompiler
 	bool writeCompiledResource(const char* locator, Span<u8> data) override {
 		char normalized[MAX_PATH_LENGTH];
 		Path::normalize(locator, Span(normalized));
-		const u32 hash = crc32(normalized);
+		const u32 hash = hash32(normalized);
+		recordOutput(getResourceFilePath(normalized), hash);
 		FileSystem& fs = m_app.getEngine().getFileSystem();
 		StaticString<MAX_PATH_LENGTH> out_path(".lumix/assets/", hash, ".res");
 		OS::OutputFile file;
@@ -161,7 +199,31 @@ struct AssetCompilerImpl : AssetCompiler
 			logError("Editor") << "Could not create " << out_path;
 			return false;
 		}
-		const bool written = file.write(data.begin(), data.length());
+
+		CompiledResourceHeader header;
+		header.decompressed_size = data.length();
+		OutputMemoryStream compressed(m_app.getAllocator());
+		if (data.length() >= MIN_COMPRESSED_SIZE) {
+			compressed.resize(lz4CompressBound(data.length()));
+			const u32 compressed_size = lz4Compress(data.begin(), data.length(), compressed.getMutableData(), (u32)compressed.getPos());
+			// not worth the decompression, e.g. already compressed textures
+			if (compressed_size > 0 && compressed_size < data.length() / 10 * 9) {
+				compressed.resize(compressed_size);
+				header.flags = CompiledResourceHeader::LZ4;
+			}
+		}
+
+		bool written;
+		if (header.flags & CompiledResourceHeader::LZ4) {
+			written = file.write(&header, sizeof(header)) && file.write(compressed.getData(), compressed.getPos());
+		}
+		else {
+			// data which would be mistaken for the header are stored behind a header
+			u32 magic = 0;
+			if (data.length() >= sizeof(magic)) memcpy(&magic, data.begin(), sizeof(magic));
+			written = magic != CompiledResourceHeader::MAGIC || file.write(&header, sizeof(header));
+			written = written && file.write(data.begin(), data.length());
+		}
 		if (!written) logError("Editor") << "Could not write " << out_path;
 		file.close();
 		return written;
@@ -232,7 +294,14 @@ struct AssetCompilerImpl : AssetCompiler
 	}
 
 	
-	void processDir(const char* dir, u64 list_last_modified)
+	struct ScannedFile {
+		Path path;
+		u64 last_modified;
+		u64 content_hash;
+	};
+
+
+	void collectFiles(const char* dir, Array<ScannedFile>& files)
 	{
 		FileSystem& fs = m_app.getEngine().getFileSystem();
 		auto* iter = fs.createFileIterator(dir);
@@ -241,34 +310,188 @@ struct AssetCompilerImpl : AssetCompiler
 		{
 			if (info.filename[0] == '.') continue;
 
-			if (info.is_directory)
-			{
-				char child_path[MAX_PATH_LENGTH];
-				copyString(child_path, dir);
-				if(dir[0]) catString(child_path, "/");
-				catString(child_path, info.filename);
-				processDir(child_path, list_last_modified);
+			char fullpath[MAX_PATH_LENGTH];
+			copyString(fullpath, dir);
+			if(dir[0]) catString(fullpath, "/");
+			catString(fullpath, info.filename);
+
+			if (info.is_directory) {
+				collectFiles(fullpath, files);
 			}
-			else
-			{
-				char fullpath[MAX_PATH_LENGTH];
-				copyString(fullpath, dir);
-				if(dir[0]) catString(fullpath, "/");
-				catString(fullpath, info.filename);
+			else {
+				ScannedFile& file = files.emplace();
+				file.path = fullpath[0] == '/' ? fullpath + 1 : fullpath;
+				file.last_modified = info.last_modified;
+				file.content_hash = 0;
+			}
+		}
 
-				if (fs.getLastModified(fullpath[0] == '/' ? fullpath + 1 : fullpath) > list_last_modified) {
-					addResource(fullpath);
-				}
-				else {
-					Path path(fullpath[0] == '/' ? fullpath + 1 : fullpath);
-					if (!m_resources.find(path.getHash()).isValid()) {
-						addResource(fullpath);
-					}
+		destroyFileIterator(iter);
+	}
+
+
+	// a file is dirty only if its content changed, touched but identical files are skipped
+	void processDir()
+	{
+		PROFILE_FUNCTION();
+		Array<ScannedFile> files(m_app.getAllocator());
+		collectFiles("", files);
+
+		for (FileRecord& record : m_files) record.seen = false;
+
+		Array<u32> changed(m_app.getAllocator());
+		for (u32 i = 0, c = files.size(); i < c; ++i) {
+			auto iter = m_files.find(files[i].path.getHash());
+			if (iter.isValid()) {
+				iter.value().seen = true;
+				if (iter.value().last_modified == files[i].last_modified) continue;
+			}
+			changed.push(i);
+		}
+		m_files.eraseIf([](const FileRecord& record){ return !record.seen; });
+
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		JobSystem::forEach(changed.size(), 0, [&](u32 from, u32 to){
+			PROFILE_BLOCK("hash sources");
+			Array<u8> content(m_app.getAllocator());
+			for (u32 i = from; i < to; ++i) {
+				ScannedFile& file = files[changed[i]];
+				content.clear();
+				if (fs.getContentSync(file.path, Ref(content))) {
+					file.content_hash = hash64(content.begin(), content.byte_size());
 				}
 			}
+		});
+
+		for (u32 idx : changed) {
+			const ScannedFile& file = files[idx];
+			auto iter = m_files.find(file.path.getHash());
+			if (iter.isValid() && iter.value().content_hash == file.content_hash) {
+				iter.value().last_modified = file.last_modified;
+				continue;
+			}
+			if (iter.isValid()) {
+				iter.value() = {file.last_modified, file.content_hash, false, true};
+			}
+			else {
+				m_files.insert(file.path.getHash(), {file.last_modified, file.content_hash, false, true});
+			}
+
+			if (Path::hasExtension(file.path.c_str(), "meta")) {
+				char tmp[MAX_PATH_LENGTH];
+				copyNString(Span(tmp), file.path.c_str(), file.path.length() - 5);
+				markDirty(Path(tmp));
+			}
+			else {
+				markDirty(file.path);
+			}
 		}
 
-		destroyFileIterator(iter);
+		for (const ScannedFile& file : files) {
+			if (!m_resources.find(file.path.getHash()).isValid()) addResource(file.path.c_str());
+		}
+	}
+
+
+	// also everything which depends on `path`, transitively
+	void markDirty(const Path& path)
+	{
+		setUpToDate(path, false);
+		addResource(path.c_str());
+		auto iter = m_dependencies.find(path);
+		if (!iter.isValid()) return;
+
+		const Array<Path> dependents(iter.value());
+		for (const Path& p : dependents) {
+			if (p == path) continue;
+			auto record = m_files.find(p.getHash());
+			if (record.isValid() && !record.value().up_to_date) continue;
+			markDirty(p);
+		}
+	}
+
+
+	void setUpToDate(const Path& path, bool up_to_date)
+	{
+		MutexGuard lock(m_files_mutex);
+		auto iter = m_files.find(path.getHash());
+		if (iter.isValid()) iter.value().up_to_date = up_to_date;
+	}
+
+
+	// called after `path` is compiled, so the next startup does not check it again
+	void updateFileRecord(const Path& path)
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> content(m_app.getAllocator());
+		if (!fs.getContentSync(path, Ref(content))) return;
+		const FileRecord record = {fs.getLastModified(path.c_str()), hash64(content.begin(), content.byte_size()), true, true};
+
+		MutexGuard lock(m_files_mutex);
+		auto iter = m_files.find(path.getHash());
+		if (iter.isValid()) {
+			iter.value() = record;
+		}
+		else {
+			m_files.insert(path.getHash(), record);
+		}
+	}
+
+
+	void loadFileRecords()
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> data(m_app.getAllocator());
+		if (!fs.fileExists(".lumix/assets/_files.bin")) return;
+		if (!fs.getContentSync(Path(".lumix/assets/_files.bin"), Ref(data))) return;
+
+		InputMemoryStream blob(data.begin(), data.byte_size());
+		u32 magic;
+		FileRecordsVersion version;
+		u32 count;
+		blob.read(magic);
+		blob.read(version);
+		blob.read(count);
+		if (magic != FILE_RECORDS_MAGIC || version > FileRecordsVersion::LATEST) {
+			logWarning("Editor") << ".lumix/assets/_files.bin has unsupported version, all files are checked";
+			return;
+		}
+
+		m_files.reserve(count);
+		for (u32 i = 0; i < count; ++i) {
+			u32 hash;
+			FileRecord record;
+			blob.read(hash);
+			blob.read(record.last_modified);
+			blob.read(record.content_hash);
+			blob.read(record.up_to_date);
+			record.seen = false;
+			m_files.insert(hash, record);
+		}
+	}
+
+
+	void saveFileRecords()
+	{
+		OutputMemoryStream blob(m_app.getAllocator());
+		blob.write(FILE_RECORDS_MAGIC);
+		blob.write(FileRecordsVersion::LATEST);
+		blob.write((u32)m_files.size());
+		for (auto iter = m_files.begin(), end = m_files.end(); iter != end; ++iter) {
+			blob.write(iter.key());
+			blob.write(iter.value().last_modified);
+			blob.write(iter.value().content_hash);
+			blob.write(iter.value().up_to_date);
+		}
+
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		OS::OutputFile file;
+		if (!fs.open(".lumix/assets/_files.bin", Ref(file))) {
+			logError("Editor") << "Could not save .lumix/assets/_files.bin";
+			return;
+		}
+		if (!file.write(blob.getData(), blob.getPos())) logError("Editor") << "Could not write .lumix/assets/_files.bin";
+		file.close();
 	}
 
 
@@ -351,30 +574,26 @@ struct AssetCompilerImpl : AssetCompiler
 			lua_close(L);
 		}
 
-		const u64 list_last_modified = OS::getLastModified(list_path);
-		processDir("", list_last_modified);
+		loadFileRecords();
+		processDir();
 
 		registerLuaAPI(m_app.getEngine().getState());
 	}
 
 
-	Array<Path> removeResource(const char* path)
+	// `files` are hashes of source paths, one pass for the whole batch
+	void removeResources(const HashMap<u32, bool, HashFuncDirect<u32>>& files, Array<Path>& removed)
 	{
-		Array<Path> res(m_app.getAllocator());
-
 		MutexGuard lock(m_resources_mutex);
 		m_resources.eraseIf([&](const ResourceItem& ri){
-			if (!equalStrings(getResourceFilePath(ri.path.c_str()), path)) return false;
-			res.push(ri.path);
+			if (!files.find(hash32(getResourceFilePath(ri.path.c_str()))).isValid()) return false;
+			removed.push(ri.path);
 			return true;
 		});
 
-		const Path path_obj(path);
 		for (Array<Path>& deps : m_dependencies) {
-			deps.eraseItems([&](const Path& p){ return p == path_obj; });
+			deps.eraseItems([&](const Path& p){ return files.find(p.getHash()).isValid(); });
 		}
-
-		return res;
 	}
 
 
@@ -391,7 +610,10 @@ struct AssetCompilerImpl : AssetCompiler
 	{
 		if (startsWith(path, ".lumix")) return;
 		
+		const u64 now = OS::Timer::getRawTimestamp();
 		MutexGuard lock(m_changed_mutex);
+		if (m_changed_files.empty()) m_first_change_time = now;
+		m_last_change_time = now;
 		m_changed_files.push(Path(path));
 	}
 
@@ -451,14 +673,294 @@ struct AssetCompilerImpl : AssetCompiler
 	{
 		char ext[16];
 		Path::getExtension(Span(ext), Span(src.c_str(), src.length()));
-		const u32 hash = crc32(ext);
-		MutexGuard lock(m_plugin_mutex);
-		auto iter = m_plugins.find(hash);
-		if (!iter.isValid()) {
+		IPlugin* plugin = getPlugin(ext);
+		if (!plugin) {
 			logError("Editor") << "Unknown resource type " << src;
 			return false;
 		}
-		return iter.value()->compile(src);
+
+		u64 cache_key;
+		bool cacheable = plugin->isCacheable(src) && getCacheKey(*plugin, src, Ref(cache_key));
+		if (cacheable) {
+			if (fetchFromCache(cache_key)) {
+				logInfo("Editor") << src << " fetched from asset cache";
+				return true;
+			}
+			MutexGuard lock(m_compile_outputs_mutex);
+			// the same source compiled twice at once, only one of them is recorded
+			cacheable = !m_compile_outputs.find(src.getHash()).isValid();
+			if (cacheable) m_compile_outputs.insert(src.getHash(), Array<u32>(m_app.getAllocator()));
+		}
+
+		bool compiled;
+		if (plugin->isThreadSafe()) {
+			compiled = plugin->compile(src);
+		}
+		else {
+			MutexGuard lock(m_serial_compile_mutex);
+			compiled = plugin->compile(src);
+		}
+
+		if (cacheable) {
+			Array<u32> outputs(m_app.getAllocator());
+			{
+				MutexGuard lock(m_compile_outputs_mutex);
+				auto iter = m_compile_outputs.find(src.getHash());
+				outputs = static_cast<Array<u32>&&>(iter.value());
+				m_compile_outputs.erase(iter);
+			}
+			if (compiled) storeToCache(cache_key, outputs);
+		}
+		if (compiled) updateFileRecord(src);
+		return compiled;
+	}
+
+
+	// remembers what a cacheable compilation of `src_path` produced
+	void recordOutput(const char* src_path, u32 output_hash)
+	{
+		const u32 src_hash = Path(src_path).getHash();
+		MutexGuard lock(m_compile_outputs_mutex);
+		auto iter = m_compile_outputs.find(src_hash);
+		if (!iter.isValid()) return;
+		if (iter.value().indexOf(output_hash) < 0) iter.value().push(output_hash);
+	}
+
+
+	void setSharedCachePath(const char* path) override
+	{
+		copyString(m_shared_cache_path, path);
+		const int len = stringLength(m_shared_cache_path);
+		if (len > 0 && m_shared_cache_path[len - 1] != '/' && m_shared_cache_path[len - 1] != '\\') {
+			catString(m_shared_cache_path, "/");
+		}
+		if (len > 0) OS::makePath(m_shared_cache_path);
+	}
+
+
+	// compiled data depend only on the source, its meta, its path and the plugin's version,
+	// so the key is the same on all machines
+	bool getCacheKey(IPlugin& plugin, const Path& src, Ref<u64> key)
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> content(m_app.getAllocator());
+		if (!fs.getContentSync(src, Ref(content))) return false;
+
+		OutputMemoryStream blob(m_app.getAllocator());
+		blob.write(AssetCacheVersion::LATEST);
+		blob.write(CompiledResourceHeader::Version::LATEST);
+		blob.write(plugin.getVersion());
+		blob.writeString(src.c_str());
+		blob.write(hash64(content.begin(), content.byte_size()));
+
+		const StaticString<MAX_PATH_LENGTH> meta_path(src.c_str(), ".meta");
+		content.clear();
+		if (fs.fileExists(meta_path) && fs.getContentSync(Path(meta_path), Ref(content))) {
+			blob.write(hash64(content.begin(), content.byte_size()));
+		}
+
+		key = hash64(blob.getData(), (u32)blob.getPos());
+		return true;
+	}
+
+
+	bool fetchFromCache(u64 key)
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		const StaticString<MAX_PATH_LENGTH> local_path(".lumix/cache/", key, ".lac");
+		Array<u8> data(m_app.getAllocator());
+		if (!fs.fileExists(local_path) || !fs.getContentSync(Path(local_path), Ref(data))) {
+			if (!m_shared_cache_path[0]) return false;
+
+			const StaticString<MAX_PATH_LENGTH> shared_path(m_shared_cache_path, key, ".lac");
+			OS::InputFile file;
+			if (!file.open(shared_path)) return false;
+			data.resize((int)file.size());
+			const bool read = file.read(data.begin(), data.byte_size());
+			file.close();
+			if (!read) return false;
+
+			OS::OutputFile local_file;
+			if (fs.open(local_path, Ref(local_file))) {
+				if (!local_file.write(data.begin(), data.byte_size())) logError("Editor") << "Could not write " << local_path;
+				local_file.close();
+			}
+		}
+
+		InputMemoryStream blob(data.begin(), data.byte_size());
+		u32 magic;
+		AssetCacheVersion version;
+		u32 count;
+		blob.read(magic);
+		blob.read(version);
+		blob.read(count);
+		if (magic != ASSET_CACHE_MAGIC || version > AssetCacheVersion::LATEST) return false;
+
+		for (u32 i = 0; i < count; ++i) {
+			u32 hash;
+			u64 size;
+			blob.read(hash);
+			blob.read(size);
+			if (blob.getPosition() + size > blob.size()) {
+				logError("Editor") << "Corrupted asset cache entry " << local_path;
+				return false;
+			}
+			const void* output = blob.skip(size);
+
+			const StaticString<MAX_PATH_LENGTH> out_path(".lumix/assets/", hash, ".res");
+			OS::OutputFile file;
+			if (!fs.open(out_path, Ref(file))) {
+				logError("Editor") << "Could not create " << out_path;
+				return false;
+			}
+			const bool written = file.write(output, size);
+			file.close();
+			if (!written) return false;
+		}
+		return true;
+	}
+
+
+	void storeToCache(u64 key, const Array<u32>& outputs)
+	{
+		if (outputs.empty()) return;
+
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		OutputMemoryStream blob(m_app.getAllocator());
+		blob.write(ASSET_CACHE_MAGIC);
+		blob.write(AssetCacheVersion::LATEST);
+		blob.write(outputs.size());
+		Array<u8> output(m_app.getAllocator());
+		for (u32 hash : outputs) {
+			const StaticString<MAX_PATH_LENGTH> out_path(".lumix/assets/", hash, ".res");
+			output.clear();
+			if (!fs.getContentSync(Path(out_path), Ref(output))) return;
+			blob.write(hash);
+			blob.write((u64)output.byte_size());
+			blob.write(output.begin(), output.byte_size());
+		}
+
+		const StaticString<MAX_PATH_LENGTH> local_path(".lumix/cache/", key, ".lac");
+		OS::OutputFile file;
+		if (fs.open(local_path, Ref(file))) {
+			if (!file.write(blob.getData(), blob.getPos())) logError("Editor") << "Could not write " << local_path;
+			file.close();
+		}
+
+		if (!m_shared_cache_path[0]) return;
+		
+		// written under a temporary name, so others never fetch a partial entry
+		const StaticString<MAX_PATH_LENGTH> shared_path(m_shared_cache_path, key, ".lac");
+		if (OS::fileExists(shared_path)) return;
+		const StaticString<MAX_PATH_LENGTH> tmp_path(shared_path, "_tmp");
+		OS::OutputFile shared_file;
+		if (!shared_file.open(tmp_path)) {
+			logError("Editor") << "Could not create " << tmp_path;
+			return;
+		}
+		const bool written = shared_file.write(blob.getData(), blob.getPos());
+		shared_file.close();
+		if (!written || !OS::moveFile(tmp_path, shared_path)) {
+			logError("Editor") << "Could not write " << shared_path;
+			OS::deleteFile(tmp_path);
+		}
+	}
+
+
+	IPlugin* getPlugin(const char* ext)
+	{
+		MutexGuard lock(m_plugin_mutex);
+		auto iter = m_plugins.find(crc32(ext));
+		return iter.isValid() ? iter.value() : nullptr;
+	}
+
+
+	bool isThreadSafe(const Path& path)
+	{
+		char ext[16];
+		Path::getExtension(Span(ext), Span(path.c_str(), path.length()));
+		IPlugin* plugin = getPlugin(ext);
+		return !plugin || plugin->isThreadSafe();
+	}
+
+
+	void setMaxCompileJobs(u32 count) override { m_max_jobs = maximum(count, 1u); }
+	u32 getMaxCompileJobs() const override { return m_max_jobs; }
+
+
+	// takes from the back, but skips thread unsafe resources while one of them is being compiled
+	Path popToCompile()
+	{
+		MutexGuard lock(m_to_compile_mutex);
+		for (i32 i = m_to_compile.size() - 1; i >= 0; --i) {
+			const bool thread_safe = isThreadSafe(m_to_compile[i]);
+			if (!thread_safe && m_serial_in_progress) continue;
+
+			const Path p = m_to_compile[i];
+			m_to_compile.erase(i);
+			m_in_progress.push({p, thread_safe});
+			if (!thread_safe) m_serial_in_progress = true;
+			return p;
+		}
+		return Path();
+	}
+
+
+	static void compileJob(void* data)
+	{
+		AssetCompilerImpl* compiler = (AssetCompilerImpl*)data;
+		while (!compiler->m_stop_jobs) {
+			const Path p = compiler->popToCompile();
+			if (!p.isValid()) break;
+
+			PROFILE_BLOCK("compile asset");
+			Profiler::pushString(p.c_str());
+			OS::Timer timer;
+			const bool compiled = compiler->compile(p);
+			const float ms = timer.getTimeSinceStart() * 1000.f;
+			if (compiled) {
+				logInfo("Editor") << "Compiled " << p << " in " << ms << " ms";
+			}
+			else {
+				logError("Editor") << "Failed to compile resource " << p;
+			}
+
+			{
+				MutexGuard lock(compiler->m_to_compile_mutex);
+				for (i32 i = 0; i < compiler->m_in_progress.size(); ++i) {
+					const InProgress& ip = compiler->m_in_progress[i];
+					if (ip.path != p) continue;
+					if (!ip.thread_safe) compiler->m_serial_in_progress = false;
+					compiler->m_in_progress.erase(i);
+					break;
+				}
+			}
+			MutexGuard lock(compiler->m_compiled_mutex);
+			compiler->m_compiled.push(p);
+		}
+		atomicDecrement(&compiler->m_running_jobs);
+	}
+
+
+	void startCompileJobs()
+	{
+		const u32 workers_count = JobSystem::getWorkersCount();
+		MutexGuard lock(m_to_compile_mutex);
+		const u32 wanted = minimum(m_max_jobs, (u32)m_to_compile.size());
+		while ((u32)m_running_jobs < wanted) {
+			const u8 worker = workers_count > 1 ? u8(1 + m_running_jobs % (workers_count - 1)) : 0;
+			atomicIncrement(&m_running_jobs);
+			JobSystem::runEx(this, &compileJob, &m_jobs_signal, JobSystem::INVALID_HANDLE, worker, JobSystem::Priority::BACKGROUND);
+		}
+	}
+
+
+	// waits for the running compilations, e.g. they can use a plugin which is being removed
+	void stopCompileJobs()
+	{
+		m_stop_jobs = true;
+		JobSystem::wait(m_jobs_signal);
+		m_stop_jobs = false;
 	}
 	
 
@@ -481,6 +983,12 @@ struct AssetCompilerImpl : AssetCompiler
 	ResourceManagerHub::LoadHook::Action onBeforeLoad(Resource& res)
 	{
 		const char* filepath = getResourceFilePath(res.getPath().c_str());
+		{
+			// checked at startup and nothing changed since
+			MutexGuard lock(m_files_mutex);
+			auto iter = m_files.find(Path(filepath).getHash());
+			if (iter.isValid() && iter.value().up_to_date) return ResourceManagerHub::LoadHook::Action::IMMEDIATE;
+		}
 
 		FileSystem& fs = m_app.getEngine().getFileSystem();
 		if (!fs.fileExists(filepath)) return ResourceManagerHub::LoadHook::Action::IMMEDIATE;
@@ -503,7 +1011,6 @@ struct AssetCompilerImpl : AssetCompiler
 				m_to_compile.push(path);
 				++m_compile_batch_count;
 				++m_batch_remaining_count;
-				m_semaphore.signal();
 				IAllocator& allocator = m_app.getAllocator();
 				m_to_compile_subresources.insert(path, Array<Resource*>(allocator));
 				iter = m_to_compile_subresources.find(path);
@@ -511,6 +1018,7 @@ struct AssetCompilerImpl : AssetCompiler
 			iter.value().push(&res);
 			return ResourceManagerHub::LoadHook::Action::DEFERRED;
 		}
+		setUpToDate(Path(filepath), true);
 		return ResourceManagerHub::LoadHook::Action::IMMEDIATE;
 	}
 
@@ -562,14 +1070,13 @@ struct AssetCompilerImpl : AssetCompiler
 			| ImGuiWindowFlags_NoSavedSettings;
 		ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 1);
 		if (ImGui::Begin("Resource compilation", nullptr, flags)) {
-			ImGui::Text("%s", "Compiling resources...");
-			ImGui::ProgressBar(((float)m_compile_batch_count - m_batch_remaining_count) / m_compile_batch_count);
-			StaticString<MAX_PATH_LENGTH> path;
-			{
-				MutexGuard lock(m_to_compile_mutex);
-				path = m_res_in_progress;
+			const u32 done = m_compile_batch_count - m_batch_remaining_count;
+			ImGui::Text("Compiling resources... %d / %d", done, m_compile_batch_count);
+			ImGui::ProgressBar((float)done / m_compile_batch_count);
+			MutexGuard lock(m_to_compile_mutex);
+			for (const InProgress& ip : m_in_progress) {
+				ImGui::TextWrapped("%s", ip.path.c_str());
 			}
-			ImGui::TextWrapped("%s", path.data);
 		}
 		ImGui::End();
 		ImGui::PopStyleVar();
@@ -590,43 +1097,75 @@ struct AssetCompilerImpl : AssetCompiler
 			m_to_compile_subresources.erase(p);
 		}
 
-		for (;;) {
-			Path path_obj;
-			{
-				MutexGuard lock(m_changed_mutex);
-				if (m_changed_files.empty()) break;
+		startCompileJobs();
 
-				m_changed_files.removeDuplicates();
-				path_obj = m_changed_files.back();
-				m_changed_files.pop();
+		Array<Path> changed(m_app.getAllocator());
+		{
+			MutexGuard lock(m_changed_mutex);
+			if (!m_changed_files.empty()) {
+				const u64 now = OS::Timer::getRawTimestamp();
+				const double freq = (double)OS::Timer::getFrequency();
+				if ((now - m_last_change_time) / freq > CHANGES_DEBOUNCE_TIME
+					|| (now - m_first_change_time) / freq > MAX_CHANGES_DELAY)
+				{
+					changed.swap(m_changed_files);
+				}
 			}
+		}
+		if (!changed.empty()) processChangedFiles(changed);
+	}
+
 
-			if (Path::hasExtension(path_obj.c_str(), "meta")) {
+	void processChangedFiles(const Array<Path>& changed)
+	{
+		PROFILE_FUNCTION();
+		IAllocator& allocator = m_app.getAllocator();
+		HashMap<u32, bool, HashFuncDirect<u32>> queued(allocator);
+		queued.reserve(changed.size() * 2);
+		Array<Path> batch(allocator);
+		batch.reserve(changed.size());
+		auto push = [&](const Path& path){
+			if (queued.find(path.getHash()).isValid()) return;
+			queued.insert(path.getHash(), true);
+			batch.push(path);
+		};
+
+		for (const Path& path : changed) {
+			if (Path::hasExtension(path.c_str(), "meta")) {
 				char tmp[MAX_PATH_LENGTH];
-				copyNString(Span(tmp), path_obj.c_str(), path_obj.length() - 5);
-				path_obj = tmp;
+				copyNString(Span(tmp), path.c_str(), path.length() - 5);
+				push(Path(tmp));
+			}
+			else {
+				push(path);
 			}
+		}
 
-			const Array<Path> removed_subresources = removeResource(path_obj.c_str());
-			addResource(path_obj.c_str());
-			reloadSubresources(removed_subresources);
+		// dependents are queued after what they depend on, transitively
+		for (u32 i = 0; i < (u32)batch.size(); ++i) {
+			auto iter = m_dependencies.find(batch[i]);
+			if (!iter.isValid()) continue;
+			for (const Path& dependent : iter.value()) push(dependent);
+			m_dependencies.erase(iter);
+		}
 
-			auto iter = m_dependencies.find(path_obj);
-			if (iter.isValid()) {
-				const Array<Path> tmp(iter.value());
-				m_dependencies.erase(iter);
-				for (Path& p : tmp) {
-					Array<Path> removed_subresources = removeResource(p.c_str());
-					addResource(p.c_str());
-					reloadSubresources(removed_subresources);
-				}
-			}
+		logInfo("Editor") << batch.size() << " changed files";
+		for (const Path& path : batch) {
+			setUpToDate(path, false);
+		}
+		Array<Path> removed_subresources(allocator);
+		removeResources(queued, removed_subresources);
+		for (const Path& path : batch) {
+			addResource(path.c_str());
 		}
+		// compilations triggered by reloading are counted in one batch, see onGUI
+		reloadSubresources(removed_subresources);
 	}
 
 
 	void removePlugin(IPlugin& plugin) override
 	{
+		stopCompileJobs();
 		MutexGuard lock(m_plugin_mutex);
 		bool removed;
 		do {
@@ -661,20 +1200,46 @@ struct AssetCompilerImpl : AssetCompiler
 		return m_resources;
 	}
 
-	Semaphore m_semaphore;
+	struct InProgress {
+		Path path;
+		bool thread_safe;
+	};
+
 	Mutex m_to_compile_mutex;
 	Mutex m_compiled_mutex;
 	Mutex m_plugin_mutex;
+	Mutex m_serial_compile_mutex;
+	Mutex m_compile_outputs_mutex;
+	struct FileRecord {
+		u64 last_modified;
+		u64 content_hash;
+		// compiled resources match the source, so loading does not check timestamps
+		bool up_to_date;
+		bool seen;
+	};
+	Mutex m_files_mutex;
+	// source path hash -> state at the last check, persisted in _files.bin
+	HashMap<u32, FileRecord, HashFuncDirect<u32>> m_files;
+	// source path hash -> hashes of compiled resources, only for cacheable compilations in progress
+	HashMap<u32, Array<u32>, HashFuncDirect<u32>> m_compile_outputs;
+	char m_shared_cache_path[MAX_PATH_LENGTH] = "";
 	Mutex m_changed_mutex;
 	HashMap<Path, Array<Resource*>> m_to_compile_subresources; 
 	HashMap<Path, Array<Path>> m_dependencies;
 	Array<Path> m_changed_files;
+	u64 m_first_change_time = 0;
+	u64 m_last_change_time = 0;
 	Array<Path> m_to_compile;
 	Array<Path> m_compiled;
+	Array<InProgress> m_in_progress;
+	bool m_serial_in_progress = false;
+	u32 m_max_jobs;
+	volatile i32 m_running_jobs = 0;
+	volatile bool m_stop_jobs = false;
+	JobSystem::SignalHandle m_jobs_signal = JobSystem::INVALID_HANDLE;
 	StudioApp& m_app;
 	LoadHook m_load_hook;
 	HashMap<u32, IPlugin*, HashFuncDirect<u32>> m_plugins;
-	AssetCompilerTask m_task;
 	FileSystemWatcher* m_watcher;
 	Mutex m_resources_mutex;
 	HashMap<u32, ResourceItem, HashFuncDirect<u32>> m_resources;
@@ -682,37 +1247,9 @@ struct AssetCompilerImpl : AssetCompiler
 
 	u32 m_compile_batch_count = 0;
 	u32 m_batch_remaining_count = 0;
-	StaticString<MAX_PATH_LENGTH> m_res_in_progress;
 };
 
 
-int AssetCompilerTask::task()
-{
-	while (!m_finished) {
-		m_compiler.m_semaphore.wait();
-		const Path p = [&]{
-			MutexGuard lock(m_compiler.m_to_compile_mutex);
-			Path p = m_compiler.m_to_compile.back();
-			m_compiler.m_res_in_progress = p.c_str();
-			m_compiler.m_to_compile.pop();
-			return p;
-		}();
-		if (p.isValid()) {
-			PROFILE_BLOCK("compile asset");
-			Profiler::pushString(p.c_str());
-			logInfo("Editor") << "Compiling " << p << "...";
-			const bool compiled = m_compiler.compile(p);
-			if (!compiled) {
-				logError("Editor") << "Failed to compile resource " << p;
-			}
-			MutexGuard lock(m_compiler.m_compiled_mutex);
-			m_compiler.m_compiled.push(p);
-		}
-	}
-	return 0;
-}
-
-
 AssetCompiler* AssetCompiler::create(StudioApp& app)
 {
 	return LUMIX_NEW(app.getAllocator(), AssetCompilerImpl)(app);
@@ -33,6 +33,12 @@ struct LUMIX_EDITOR_API AssetCompiler
 	{
 		virtual ~IPlugin() {}
 		virtual bool compile(const Path& src) = 0;
+		// thread safe plugins compile in parallel, others one resource at a time
+		virtual bool isThreadSafe() const { return false; }
+		// cacheable compilation writes only compiled resources and depends only on the source and its meta
+		virtual bool isCacheable(const Path& src) const { return false; }
+		// bump when compiled data change, cached outputs of older versions are not used
+		virtual u32 getVersion() const { return 0; }
 		virtual void addSubresources(AssetCompiler& compiler, const char* path);
 	};
 
@@ -53,6 +59,11 @@ struct LUMIX_EDITOR_API AssetCompiler
 	virtual void addPlugin(IPlugin& plugin, const char** extensions) = 0;
 	virtual void removePlugin(IPlugin& plugin) = 0;
 	virtual bool compile(const Path& path) = 0;
+	// number of jobs compiling at once, can be set by -compile_jobs on the command line
+	virtual void setMaxCompileJobs(u32 count) = 0;
+	virtual u32 getMaxCompileJobs() const = 0;
+	// compiled resources are also shared through this directory, can be set by -shared_asset_cache
+	virtual void setSharedCachePath(const char* path) = 0;
 	virtual bool getMeta(const Path& res, void* user_ptr, void (*callback)(void*, lua_State*)) const = 0;
 	virtual void updateMeta(const Path& res, const char* src) const = 0;
 	virtual const HashMap<u32, ResourceItem, HashFuncDirect<u32>>& lockResources() = 0;
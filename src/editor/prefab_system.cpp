@@ -14,12 +14,14 @@
 #include "engine/math.h"
 #include "engine/os.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/serializer.h"
 #include "engine/string.h"
 #include "engine/universe.h"
+#include "engine/universe_streaming.h"
 
 namespace Lumix
 {
@@ -52,6 +54,8 @@ struct AssetBrowserPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 
 	void onResourceUnloaded(Resource* resource) override {}
 	const char* getName() const override { return "Prefab"; }
@@ -305,20 +309,6 @@ public:
 	}
 
 
-	struct PropertyCloner : Reflection::ISimpleComponentVisitor {
-		void visitProperty(const Reflection::PropertyBase& prop) override {
-			stream->clear();
-			prop.getValue(src, -1, *stream);
-			InputMemoryStream tmp(*stream);
-			prop.setValue(dst, -1, tmp);
-		}
-
-		ComponentUID src;
-		ComponentUID dst;
-		OutputMemoryStream* stream;
-	};
-
-
 	EntityRef cloneEntity(Universe& src_u, EntityRef src_e, Universe& dst_u, EntityPtr dst_parent, Ref<Array<EntityRef>> entities) {
 		entities->push(src_e);
 		const EntityRef dst_e = dst_u.createEntity({0, 0, 0}, {0, 0, 0, 1});
@@ -347,15 +337,11 @@ public:
 		for (ComponentUID cmp = src_u.getFirstComponent(src_e); cmp.isValid(); cmp = src_u.getNextComponent(cmp)) {
 			dst_u.createComponent(cmp.type, dst_e);
 
-			const Reflection::ComponentBase* cmp_tpl = Reflection::getComponent(cmp.type);
-	
-			PropertyCloner property_cloner;
-			property_cloner.src = cmp;
-			property_cloner.dst.type = cmp.type;
-			property_cloner.dst.entity = dst_e;
-			property_cloner.dst.scene = dst_u.getScene(cmp.type);
-			property_cloner.stream = &tmp_stream;
-			cmp_tpl->visit(property_cloner);
+			ComponentUID dst_cmp;
+			dst_cmp.type = cmp.type;
+			dst_cmp.entity = dst_e;
+			dst_cmp.scene = dst_u.getScene(cmp.type);
+			Reflection::copyComponent(cmp, dst_cmp, tmp_stream);
 		}
 
 		return dst_e;
@@ -454,6 +440,111 @@ public:
 	}
 
 
+	bool saveStreamingCells(const char* dir, float cell_size) override
+	{
+		PROFILE_FUNCTION();
+		Engine& engine = m_editor.getEngine();
+		FileSystem& fs = engine.getFileSystem();
+		IAllocator& allocator = m_editor.getAllocator();
+		Universe& universe = *m_editor.getUniverse();
+		const Array<EntityRef>& selected = m_editor.getSelectedEntities();
+
+		// descendants of selected entities are moved with their ancestors
+		HashMap<EntityRef, bool> selected_map(allocator);
+		selected_map.reserve(selected.size());
+		for (EntityRef e : selected) selected_map.insert(e, true);
+		Array<EntityRef> roots(allocator);
+		for (EntityRef e : selected) {
+			EntityPtr parent = universe.getParent(e);
+			while (parent.isValid() && !selected_map.find((EntityRef)parent).isValid()) {
+				parent = universe.getParent((EntityRef)parent);
+			}
+			if (!parent.isValid()) roots.push(e);
+		}
+		if (roots.empty()) return false;
+
+		UniverseStreaming* streaming = UniverseStreaming::create(engine, universe);
+		streaming->setCellSize(cell_size);
+
+		struct Cell {
+			Cell(const IVec2& coord, IAllocator& allocator) : coord(coord), entities(allocator) {}
+			IVec2 coord;
+			Array<EntityRef> entities;
+		};
+		Array<Cell> cells(allocator);
+		HashMap<u64, u32> cells_map(allocator);
+		for (EntityRef e : roots) {
+			const IVec2 coord = streaming->getCell(universe.getPosition(e));
+			const u64 key = (u64(u32(coord.x)) << 32) | u32(coord.y);
+			auto iter = cells_map.find(key);
+			if (!iter.isValid()) {
+				cells_map.insert(key, cells.size());
+				cells.emplace(coord, allocator);
+				iter = cells_map.find(key);
+			}
+			cells[iter.value()].entities.push(e);
+		}
+
+		const StaticString<MAX_PATH_LENGTH> fullpath(fs.getBasePath(), dir);
+		if (!OS::makePath(fullpath)) {
+			logError("Editor") << "Failed to create " << fullpath;
+		}
+
+		bool success = true;
+		OutputMemoryStream blob(allocator);
+		Array<EntityRef> src_entities(allocator);
+		for (const Cell& cell : cells) {
+			// the cell root is in the corner of the cell, the same transform is used when it's instantiated
+			Universe& cell_universe = engine.createUniverse(false);
+			const DVec3 origin(cell.coord.x * (double)cell_size, 0, cell.coord.y * (double)cell_size);
+			const EntityRef cell_root = cell_universe.createEntity(origin, Quat::IDENTITY);
+			for (EntityRef e : cell.entities) {
+				const EntityRef clone = cloneEntity(universe, e, cell_universe, INVALID_ENTITY, Ref(src_entities));
+				cell_universe.setTransform(clone, universe.getTransform(e));
+				cell_universe.setParent(cell_root, clone);
+			}
+			blob.clear();
+			engine.serialize(cell_universe, blob);
+			engine.destroyUniverse(cell_universe);
+
+			const StaticString<MAX_PATH_LENGTH> path(dir, "/", cell.coord.x, "_", cell.coord.y, ".fab");
+			OS::OutputFile file;
+			if (!fs.open(path, Ref(file))) {
+				logError("Editor") << "Failed to create " << path;
+				success = false;
+				continue;
+			}
+			if (!file.write(blob.getData(), blob.getPos())) {
+				logError("Editor") << "Failed to write " << path;
+				success = false;
+			}
+			file.close();
+			streaming->addCell(cell.coord, Path(path));
+		}
+
+		blob.clear();
+		streaming->saveManifest(blob);
+		UniverseStreaming::destroy(*streaming);
+		const StaticString<MAX_PATH_LENGTH> manifest_path(dir, "/streaming.manifest");
+		OS::OutputFile file;
+		if (!fs.open(manifest_path, Ref(file))) {
+			logError("Editor") << "Failed to create " << manifest_path;
+			return false;
+		}
+		if (!file.write(blob.getData(), blob.getPos())) {
+			logError("Editor") << "Failed to write " << manifest_path;
+			success = false;
+		}
+		file.close();
+		if (!success) return false;
+
+		// streamed entities are not part of the universe anymore, can be undone
+		m_editor.destroyEntities(roots.begin(), roots.size());
+		logInfo("Editor") << roots.size() << " entities saved to " << cells.size() << " streaming cells in " << dir;
+		return true;
+	}
+
+
 	void recreateInstances(PrefabHandle prefab) {
 		for (PrefabHandle& p : m_entity_to_prefab) {
 			if (p != prefab) continue;
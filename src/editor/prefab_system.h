@@ -35,6 +35,8 @@ struct LUMIX_EDITOR_API PrefabSystem
 	virtual PrefabHandle getPrefab(EntityRef entity) const = 0;
 	virtual void setPrefab(EntityRef entity, PrefabHandle prefab) = 0;
 	virtual void savePrefab(const Path& path) = 0;
+	// moves selected entities to prefabs in `dir`, one per cell, and writes the manifest for UniverseStreaming
+	virtual bool saveStreamingCells(const char* dir, float cell_size) = 0;
 	virtual PrefabResource* getPrefabResource(EntityRef entity) = 0;
 };
 
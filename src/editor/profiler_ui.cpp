@@ -5,6 +5,7 @@
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
+#include "engine/hash.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
@@ -14,6 +15,8 @@
 #include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/string.h"
 #include "utils.h"
 
 
@@ -88,12 +91,167 @@ static const char* getContexSwitchReasonString(i8 reason)
 }
 
 
+// loaded from a file written by Profiler::startCapture
+struct ProfilerCapture
+{
+	struct Thread {
+		Thread(IAllocator& allocator) : buffer(allocator) {}
+
+		u32 thread_id = 0;
+		StaticString<64> name;
+		Array<u8> buffer;
+		bool show = true;
+	};
+
+	ProfilerCapture(IAllocator& allocator)
+		: allocator(allocator)
+		, threads(allocator)
+		, global(allocator)
+		, strings(allocator)
+		, counters(allocator)
+	{}
+
+	Thread& getThread(i32 idx) {
+		if (idx < 0) return global;
+		while (threads.size() <= idx) threads.emplace(allocator);
+		return threads[idx];
+	}
+
+	const char* getString(u32 offset) const { return strings.begin() + offset; }
+
+	IAllocator& allocator;
+	u64 frequency;
+	u64 end_time = 0;
+	Array<Thread> threads;
+	Thread global;
+	// zero terminated strings referenced by events and counters
+	Array<char> strings;
+	// offsets in `strings`
+	Array<u32> counters;
+};
+
+
+// either a locked live thread or a thread from a loaded capture
+struct ThreadView {
+	ThreadView(Profiler::GlobalState& global, ProfilerCapture* capture, int thread_idx)
+	{
+		if (capture) {
+			m_capture_thread = &capture->getThread(thread_idx);
+			buffer = m_capture_thread->buffer.begin();
+			buffer_size = m_capture_thread->buffer.size();
+			begin = 0;
+			end = buffer_size;
+			thread_id = m_capture_thread->thread_id;
+			name = m_capture_thread->name;
+			show = m_capture_thread->show;
+			return;
+		}
+
+		m_live = new (NewPlaceholder(), m_live_mem) Profiler::ThreadState(global, thread_idx);
+		buffer = m_live->buffer;
+		buffer_size = m_live->buffer_size;
+		begin = m_live->begin;
+		end = m_live->end;
+		thread_id = m_live->thread_id;
+		name = m_live->name;
+		show = m_live->show;
+	}
+
+	~ThreadView() {
+		if (m_live) {
+			m_live->show = show;
+			m_live->~ThreadState();
+		}
+		else {
+			m_capture_thread->show = show;
+		}
+	}
+
+	const u8* buffer;
+	u32 buffer_size;
+	u32 begin;
+	u32 end;
+	u32 thread_id;
+	const char* name;
+	bool show;
+
+private:
+	alignas(Profiler::ThreadState) u8 m_live_mem[sizeof(Profiler::ThreadState)];
+	Profiler::ThreadState* m_live = nullptr;
+	ProfilerCapture::Thread* m_capture_thread = nullptr;
+};
+
+
+// aggregated over all visible threads, only blocks starting in the analyzed range are counted
+struct ProfilerRangeStats
+{
+	enum class SortBy : u32 {
+		COUNT,
+		TOTAL,
+		SELF,
+		MAX
+	};
+
+	struct Block {
+		const char* name;
+		u32 name_hash;
+		u32 count;
+		u64 total;
+		u64 self;
+		u64 min;
+		u64 max;
+		u64 p50;
+		u64 p95;
+	};
+
+	// blocks with the same callstack are merged, regardless of thread or fiber
+	struct FlameNode {
+		const char* name;
+		u32 name_hash;
+		i32 parent;
+		i32 first_child;
+		i32 next_sibling;
+		u64 total;
+	};
+
+	struct Baseline {
+		u32 count;
+		u64 self;
+	};
+
+	ProfilerRangeStats(IAllocator& allocator)
+		: blocks(allocator)
+		, flame(allocator)
+		, baseline(allocator)
+	{}
+
+	bool dirty = true;
+	u64 from = 0;
+	u64 to = 0;
+	u32 frames = 0;
+	u32 flame_depth = 0;
+	float flame_width = 0;
+	SortBy sort_by = SortBy::SELF;
+	Array<Block> blocks;
+	// flame[0] is the root
+	Array<FlameNode> flame;
+	// keyed by name hash, so it survives closing the capture it was taken from
+	HashMap<u32, Baseline> baseline;
+	u32 baseline_frames = 0;
+	bool has_baseline = false;
+};
+
+
 struct ProfilerUIImpl final : ProfilerUI
 {
 	ProfilerUIImpl(Debug::Allocator* allocator, Engine& engine)
 		: m_main_allocator(allocator)
 		, m_resource_manager(engine.getResourceManager())
 		, m_engine(engine)
+		, m_counters(m_allocator)
+		, m_gpu_passes(m_allocator)
+		, m_gpu_passes_building(m_allocator)
+		, m_stats(m_allocator)
 	{
 		m_allocation_size_from = 0;
 		m_allocation_size_to = 1024 * 1024;
@@ -115,9 +273,22 @@ struct ProfilerUIImpl final : ProfilerUI
 
 		m_allocation_root->clear(m_allocator);
 		LUMIX_DELETE(m_allocator, m_allocation_root);
+		closeCapture();
 	}
 
 
+	void closeCapture()
+	{
+		LUMIX_DELETE(m_allocator, m_capture);
+		m_capture = nullptr;
+		m_stats.dirty = true;
+	}
+
+
+	bool loadCapture(const char* path);
+	u64 getFrequency() const { return m_capture ? m_capture->frequency : Profiler::frequency(); }
+
+
 	void onGUI() override
 	{
 		PROFILE_FUNCTION();
@@ -127,6 +298,7 @@ struct ProfilerUIImpl final : ProfilerUI
 		{
 			onGUICPUProfiler();
 			onGUIMemoryProfiler();
+			onGUIMemoryTags();
 			onGUIResources();
 		}
 		ImGui::End();
@@ -173,7 +345,13 @@ struct ProfilerUIImpl final : ProfilerUI
 
 
 	void onGUICPUProfiler();
+	void onGUIStatistics(Profiler::GlobalState& global, u64 from, u64 to);
+	void onGUIGPUPasses();
+	void computeStatistics(Profiler::GlobalState& global, u64 from, u64 to);
+	void sortStatistics();
+	void showFlameNode(ImDrawList* dl, i32 node_idx, float x, float y, float width);
 	void onGUIMemoryProfiler();
+	void onGUIMemoryTags();
 	void onGUIResources();
 	void onFrame();
 	void addToTree(Debug::Allocator::AllocationInfo* info);
@@ -207,9 +385,150 @@ struct ProfilerUIImpl final : ProfilerUI
 	i64 hovered_link = 0;
 	Profiler::GPUMemStatsBlock m_gpu_mem_stats;
 	bool m_is_gpu_mem_stats_valid = false;
+	struct Counter {
+		float value;
+		float max;
+		bool is_valid;
+	};
+	Array<Counter> m_counters;
+	struct GPUPass {
+		char name[32];
+		u32 level;
+		u64 duration;
+		bool has_stats;
+		Profiler::GPUStatsBlock stats;
+	};
+	// GPU blocks of the last frame resolved before m_end, in the order they ended
+	Array<GPUPass> m_gpu_passes;
+	Array<GPUPass> m_gpu_passes_building;
+	ProfilerCapture* m_capture = nullptr;
+	ProfilerRangeStats m_stats;
 };
 
 
+// replaces pointers in events with pointers to strings loaded from the capture
+static void patchCaptureStrings(ProfilerCapture& capture, ProfilerCapture::Thread& thread, const HashMap<u64, u32>& string_offsets)
+{
+	auto patch = [&](u8* ptr){
+		u64 value;
+		memcpy(&value, ptr, sizeof(value));
+		auto iter = string_offsets.find(value);
+		const char* str = iter.isValid() ? capture.getString(iter.value()) : "N/A";
+		memcpy(ptr, &str, sizeof(str));
+	};
+
+	static_assert(sizeof(const char*) == sizeof(u64));
+	u8* buf = thread.buffer.begin();
+	u32 p = 0;
+	while (p + sizeof(Profiler::EventHeader) <= (u32)thread.buffer.size()) {
+		Profiler::EventHeader header;
+		memcpy(&header, buf + p, sizeof(header));
+		if (header.size < sizeof(header) || p + header.size > (u32)thread.buffer.size()) {
+			// corrupted, drop the rest
+			thread.buffer.resize(p);
+			break;
+		}
+		switch (header.type) {
+			case Profiler::EventType::BEGIN_BLOCK: patch(buf + p + sizeof(header)); break;
+			case Profiler::EventType::INT: patch(buf + p + sizeof(header) + offsetof(Profiler::IntRecord, key)); break;
+			default: break;
+		}
+		capture.end_time = maximum(capture.end_time, header.time);
+		p += header.size;
+	}
+}
+
+
+bool ProfilerUIImpl::loadCapture(const char* path)
+{
+	OS::InputFile file;
+	if (!file.open(path)) {
+		logError("Editor") << "Failed to open " << path;
+		return false;
+	}
+	Array<u8> data(m_allocator);
+	data.resize((u32)file.size());
+	const bool read_success = file.read(data.begin(), data.byte_size());
+	file.close();
+	if (!read_success) {
+		logError("Editor") << "Failed to read " << path;
+		return false;
+	}
+
+	InputMemoryStream blob(data.begin(), data.byte_size());
+	Profiler::CaptureHeader header;
+	blob.read(&header, sizeof(header));
+	if (header.magic != Profiler::CaptureHeader::MAGIC || header.version > Profiler::CaptureHeader::Version::LATEST) {
+		logError("Editor") << path << " is not a supported profiler capture";
+		return false;
+	}
+
+	closeCapture();
+	m_capture = LUMIX_NEW(m_allocator, ProfilerCapture)(m_allocator);
+	m_capture->frequency = header.frequency;
+	HashMap<u64, u32> string_offsets(m_allocator);
+
+	// the last chunk can be incomplete if the app did not stop the capture
+	while (blob.getPosition() + sizeof(Profiler::CaptureChunkHeader) <= blob.size()) {
+		Profiler::CaptureChunkHeader chunk;
+		blob.read(&chunk, sizeof(chunk));
+		if (blob.getPosition() + chunk.size > blob.size()) break;
+
+		const u8* payload = (const u8*)blob.skip(chunk.size);
+		switch (chunk.type) {
+			case Profiler::CaptureChunkType::THREAD: {
+				i32 idx;
+				memcpy(&idx, payload, sizeof(idx));
+				ProfilerCapture::Thread& thread = m_capture->getThread(idx);
+				memcpy(&thread.thread_id, payload + sizeof(idx), sizeof(thread.thread_id));
+				const u32 name_offset = sizeof(idx) + sizeof(thread.thread_id);
+				thread.name = Span((const char*)payload + name_offset, chunk.size - name_offset - 1);
+				break;
+			}
+			case Profiler::CaptureChunkType::EVENTS: {
+				i32 idx;
+				memcpy(&idx, payload, sizeof(idx));
+				Array<u8>& buffer = m_capture->getThread(idx).buffer;
+				const u32 offset = buffer.size();
+				buffer.resize(offset + chunk.size - sizeof(idx));
+				memcpy(buffer.begin() + offset, payload + sizeof(idx), chunk.size - sizeof(idx));
+				break;
+			}
+			case Profiler::CaptureChunkType::STRING: {
+				u64 ptr;
+				memcpy(&ptr, payload, sizeof(ptr));
+				string_offsets.insert(ptr, m_capture->strings.size());
+				for (u32 i = sizeof(ptr); i < chunk.size; ++i) m_capture->strings.push(payload[i]);
+				break;
+			}
+			case Profiler::CaptureChunkType::COUNTER: {
+				u32 idx;
+				memcpy(&idx, payload, sizeof(idx));
+				while (m_capture->counters.size() <= idx) m_capture->counters.push(0);
+				m_capture->counters[idx] = m_capture->strings.size();
+				for (u32 i = sizeof(idx); i < chunk.size; ++i) m_capture->strings.push(payload[i]);
+				break;
+			}
+			default:
+				logWarning("Editor") << "Unknown chunk in profiler capture " << path;
+				break;
+		}
+	}
+	// counters without a name chunk point to an empty string
+	if (m_capture->strings.empty()) m_capture->strings.push(0);
+
+	patchCaptureStrings(*m_capture, m_capture->global, string_offsets);
+	for (ProfilerCapture::Thread& thread : m_capture->threads) {
+		patchCaptureStrings(*m_capture, thread, string_offsets);
+	}
+
+	m_counters.clear();
+	m_is_paused = true;
+	m_end = m_capture->end_time;
+	return true;
+}
+
+
 static const char* getResourceStateString(Resource::State state)
 {
 	switch (state)
@@ -404,6 +723,61 @@ void ProfilerUIImpl::showAllocationTree(AllocationStackNode* node, int column) c
 }
 
 
+void ProfilerUIImpl::onGUIMemoryTags()
+{
+	if (!ImGui::CollapsingHeader("Memory tags")) return;
+
+	TagAllocator* allocators[64];
+	const u32 count = minimum(TagAllocator::getAll(Span(allocators)), (u32)lengthOf(allocators));
+	if (count == 0) {
+		ImGui::TextUnformatted("No tagged allocators.");
+		return;
+	}
+
+	ImGui::Columns(6, "memtags");
+	ImGui::Text("Tag");
+	ImGui::NextColumn();
+	ImGui::Text("Live (MB)");
+	ImGui::NextColumn();
+	ImGui::Text("Peak (MB)");
+	ImGui::NextColumn();
+	ImGui::Text("Allocs / frame");
+	ImGui::NextColumn();
+	ImGui::Text("KB / frame");
+	ImGui::NextColumn();
+	ImGui::Text("Budget (MB)");
+	ImGui::NextColumn();
+	ImGui::Separator();
+	for (u32 i = 0; i < count; ++i) {
+		TagAllocator& a = *allocators[i];
+		ImGui::PushID(&a);
+		if (a.isOverBudget()) {
+			ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", a.getTag());
+		}
+		else {
+			ImGui::TextUnformatted(a.getTag());
+		}
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", a.getLiveBytes() / (1024.f * 1024.f));
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", a.getPeakBytes() / (1024.f * 1024.f));
+		ImGui::NextColumn();
+		ImGui::Text("%u", a.getLastFrameAllocations());
+		ImGui::NextColumn();
+		ImGui::Text("%.1f", a.getLastFrameAllocatedBytes() / 1024.f);
+		ImGui::NextColumn();
+		float budget = a.getBudget() / (1024.f * 1024.f);
+		ImGui::SetNextItemWidth(-1);
+		if (ImGui::DragFloat("##budget", &budget, 1, 0, FLT_MAX, "%.1f")) {
+			a.setBudget(u64(maximum(budget, 0.f) * 1024 * 1024));
+		}
+		ImGui::NextColumn();
+		ImGui::PopID();
+	}
+	ImGui::Columns(1);
+}
+
+
 void ProfilerUIImpl::onGUIMemoryProfiler()
 {
 	if (!ImGui::CollapsingHeader("Memory")) return;
@@ -426,7 +800,9 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 	}
 	const PageAllocator& page_allocator = m_engine.getPageAllocator();
 	const float reserved_pages_size = (page_allocator.getReservedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
-	ImGui::Text("Page allocator: %.3fMB", reserved_pages_size);
+	const float allocated_pages_size = (page_allocator.getAllocatedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
+	const float released_pages_size = (page_allocator.getReleasedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
+	ImGui::Text("Page allocator: %.3fMB (%.3fMB used, %.3fMB released)", reserved_pages_size, allocated_pages_size, released_pages_size);
 
 	if (m_is_gpu_mem_stats_valid) {
 		const float current = m_gpu_mem_stats.current / (1024.f * 1024.f);
@@ -449,7 +825,7 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 }
 
 template <typename T>
-static void read(Profiler::ThreadState& ctx, u32 p, T& value)
+static void read(const ThreadView& ctx, u32 p, T& value)
 {
 	const u8* buf = ctx.buffer;
 	const u32 buf_size = ctx.buffer_size;
@@ -464,7 +840,7 @@ static void read(Profiler::ThreadState& ctx, u32 p, T& value)
 }
 
 
-static void read(Profiler::ThreadState& ctx, u32 p, u8* ptr, int size)
+static void read(const ThreadView& ctx, u32 p, u8* ptr, int size)
 {
 	const u8* buf = ctx.buffer;
 	const u32 buf_size = ctx.buffer_size;
@@ -536,12 +912,38 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	if (ImGui::Checkbox("Pause", &m_is_paused)) {
 		Profiler::pause(m_is_paused);
 	}
-	if (!m_is_paused) {
+	if (!m_is_paused && !m_capture) {
 		m_end = OS::Timer::getRawTimestamp();
 	}
 
 	Profiler::GlobalState global;
-	const int contexts_count = global.threadsCount();
+	const int contexts_count = m_capture ? m_capture->threads.size() : global.threadsCount();
+	if (ImGui::BeginMenu("Capture")) {
+		if (Profiler::isCapturing()) {
+			if (ImGui::MenuItem("Stop")) Profiler::stopCapture();
+		}
+		else if (ImGui::MenuItem("Start")) {
+			char path[MAX_PATH_LENGTH];
+			if (OS::getSaveFilename(Span(path), "Profiler capture\0*.lpc\0", "lpc")) {
+				Profiler::startCapture(path);
+			}
+		}
+		if (ImGui::MenuItem("Load")) {
+			char path[MAX_PATH_LENGTH];
+			if (OS::getOpenFilename(Span(path), "Profiler capture\0*.lpc\0", nullptr)) {
+				loadCapture(path);
+			}
+		}
+		if (ImGui::MenuItem("Close", nullptr, false, m_capture != nullptr)) {
+			closeCapture();
+			m_counters.clear();
+		}
+		ImGui::EndMenu();
+	}
+	if (m_capture) {
+		ImGui::SameLine();
+		ImGui::TextUnformatted("Showing loaded capture");
+	}
 	if (ImGui::BeginMenu("Advanced")) {
 		ImGui::Checkbox("Show frames", &m_show_frames);
 		ImGui::Text("Zoom: %f", m_range / double(DEFAULT_RANGE));
@@ -555,11 +957,17 @@ void ProfilerUIImpl::onGUICPUProfiler()
 		}
 		if (ImGui::BeginMenu("Threads")) {
 			for (int i = 0; i < contexts_count; ++i) {
-				Profiler::ThreadState ctx(global, i);
+				ThreadView ctx(global, m_capture, i);
 				ImGui::Checkbox(ctx.name, &ctx.show);
 			}
 			ImGui::EndMenu();
 		}
+		bool hw_counters = Profiler::hwCountersEnabled();
+		if (ImGui::Checkbox("Hardware counters", &hw_counters)) {
+			if (!Profiler::enableHWCounters(hw_counters)) {
+				logError("Editor") << "Hardware counters are not available";
+			}
+		}
 		if (Profiler::contextSwitchesEnabled())
 		{
 			ImGui::Checkbox("Show context switches", &m_show_context_switches);
@@ -591,7 +999,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	bool hovered_signal_current_pos = false;
 
 	for (int i = 0; i < contexts_count; ++i) {
-		Profiler::ThreadState ctx(global, i);
+		ThreadView ctx(global, m_capture, i);
 		if (!ctx.show) continue;
 		
 		threads_records.insert(ctx.thread_id, { ImGui::GetCursorScreenPos().y, ctx.thread_id, ctx.name, 0});
@@ -608,6 +1016,10 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			u32 color;
 			i64 link;
 			Profiler::JobRecord job_info;
+			bool has_hw_begin;
+			bool has_hw_end;
+			Profiler::HWCountersRecord hw_begin;
+			Profiler::HWCountersRecord hw_end;
 		} open_blocks[64];
 		int level = -1;
 		u32 p = ctx.begin;
@@ -648,7 +1060,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 				dl->AddText(ImVec2(x_start + 2, block_y), 0xff000000, name);
 			}
 			if (ImGui::IsMouseHoveringRect(ra, rb)) {
-				const u64 freq = Profiler::frequency();
+				const u64 freq = getFrequency();
 				const float t = 1000 * float((to - from) / double(freq));
 				ImGui::BeginTooltip();
 				ImGui::Text("%s (%.3f ms)", name, t);
@@ -666,6 +1078,21 @@ void ProfilerUIImpl::onGUICPUProfiler()
 				if (open_blocks[level].job_info.precondition != JobSystem::INVALID_HANDLE) {
 					ImGui::Text("Precondition signal: %d", open_blocks[level].job_info.precondition);
 				}
+				if (open_blocks[level].has_hw_begin && open_blocks[level].has_hw_end) {
+					u64 deltas[(int)Profiler::HWCounter::COUNT];
+					for (u32 i = 0; i < (u32)Profiler::HWCounter::COUNT; ++i) {
+						deltas[i] = open_blocks[level].hw_end.values[i] - open_blocks[level].hw_begin.values[i];
+						const Profiler::HWCounter counter = (Profiler::HWCounter)i;
+						// availability of counters is not stored in captures
+						const bool available = m_capture ? deltas[i] != 0 : Profiler::isHWCounterAvailable(counter);
+						if (!available) continue;
+						ImGui::Text("%s: %" PRIu64, Profiler::getHWCounterName(counter), deltas[i]);
+					}
+					const u64 cycles = deltas[(int)Profiler::HWCounter::CYCLES];
+					if (deltas[(int)Profiler::HWCounter::INSTRUCTIONS] > 0 && cycles > 0) {
+						ImGui::Text("IPC: %.2f", deltas[(int)Profiler::HWCounter::INSTRUCTIONS] / double(cycles));
+					}
+				}
 				for (int i = 0; i < properties_count; ++i) {
 					if (properties[i].level != level) continue;
 
@@ -748,6 +1175,8 @@ void ProfilerUIImpl::onGUICPUProfiler()
 				open_blocks[level].color = 0xffDDddDD;
 				open_blocks[level].job_info.signal_on_finish = JobSystem::INVALID_HANDLE;
 				open_blocks[level].job_info.precondition = JobSystem::INVALID_HANDLE;
+				open_blocks[level].has_hw_begin = false;
+				open_blocks[level].has_hw_end = false;
 				lines = maximum(lines, level + 1);
 				y += 20.f;
 				break;
@@ -799,6 +1228,19 @@ void ProfilerUIImpl::onGUICPUProfiler()
 					read(ctx, p + sizeof(Profiler::EventHeader), open_blocks[level].color);
 				}
 				break;
+			case Profiler::EventType::HW_COUNTERS:
+				// first record right after begin, second right before end
+				if (level >= 0) {
+					if (open_blocks[level].has_hw_begin) {
+						read(ctx, p + sizeof(Profiler::EventHeader), open_blocks[level].hw_end);
+						open_blocks[level].has_hw_end = true;
+					}
+					else {
+						read(ctx, p + sizeof(Profiler::EventHeader), open_blocks[level].hw_begin);
+						open_blocks[level].has_hw_begin = true;
+					}
+				}
+				break;
 			default: ASSERT(false); break;
 			}
 			p += header.size;
@@ -857,7 +1299,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 	};
 
 	{
-		Profiler::ThreadState ctx(global, -1);
+		ThreadView ctx(global, m_capture, -1);
 
 		float before_gpu_y = ImGui::GetCursorScreenPos().y;
 
@@ -866,8 +1308,17 @@ void ProfilerUIImpl::onGUICPUProfiler()
 		float y = ImGui::GetCursorScreenPos().y;
 
 		u32 open_blocks[64];
+		Profiler::GPUStatsBlock open_stats[64];
+		bool has_open_stats[64];
+		u32 open_passes[64];
 		int level = -1;
 		u32 lines = 0;
+		m_gpu_passes_building.clear();
+
+		const int counters_count = m_capture ? m_capture->counters.size() : global.countersCount();
+		while (m_counters.size() < counters_count) {
+			m_counters.push({0, 0, false});
+		}
 
 		u32 p = ctx.begin;
 		const u32 end = ctx.end;
@@ -875,13 +1326,47 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			Profiler::EventHeader header;
 			read(ctx, p, header);
 			switch (header.type) {
+				case Profiler::EventType::COUNTER:
+					if (header.time <= m_end) {
+						Profiler::CounterRecord r;
+						read(ctx, p + sizeof(Profiler::EventHeader), r);
+						if (r.counter < (u32)m_counters.size()) {
+							Counter& c = m_counters[r.counter];
+							c.max = c.is_valid ? maximum(c.max, r.value) : r.value;
+							c.value = r.value;
+							c.is_valid = true;
+						}
+					}
+					break;
 				case Profiler::EventType::BEGIN_GPU_BLOCK:
 					++level;
 					ASSERT(level < (int)lengthOf(open_blocks));
 					open_blocks[level] = p;
+					has_open_stats[level] = false;
+					open_passes[level] = m_gpu_passes_building.size();
 					lines = maximum(lines, level + 1);
 					break;
+				case Profiler::EventType::GPU_STATS:
+					if (level >= 0) {
+						read(ctx, p + sizeof(Profiler::EventHeader), open_stats[level]);
+						has_open_stats[level] = true;
+					}
+					break;
 				case Profiler::EventType::END_GPU_BLOCK:
+					if (level >= 0 && header.time <= m_end) {
+						GPUPass pass;
+						u64 to;
+						read(ctx, p + sizeof(Profiler::EventHeader), to);
+						Profiler::GPUBlock data;
+						read(ctx, open_blocks[level] + sizeof(Profiler::EventHeader), data);
+						copyString(pass.name, data.name);
+						pass.level = level;
+						pass.duration = to > data.timestamp ? to - data.timestamp : 0;
+						pass.has_stats = has_open_stats[level];
+						if (pass.has_stats) pass.stats = open_stats[level];
+						// parent before its children
+						m_gpu_passes_building.insert(minimum(open_passes[level], m_gpu_passes_building.size()), pass);
+					}
 					if (level >= 0 && gpu_open) {
 						Profiler::EventHeader start_header;
 						read(ctx, open_blocks[level], start_header);
@@ -910,10 +1395,16 @@ void ProfilerUIImpl::onGUICPUProfiler()
 							dl->AddText(ImVec2(x_start + 2, block_y), 0xff000000, data.name);
 						}
 						if (ImGui::IsMouseHoveringRect(ra, rb)) {
-							const u64 freq = Profiler::frequency();
+							const u64 freq = getFrequency();
 							const float t = 1000 * float((to - from) / double(freq));
 							ImGui::BeginTooltip();
 							ImGui::Text("%s (%.3f ms)", data.name, t);
+							if (has_open_stats[level]) {
+								const Profiler::GPUStatsBlock& s = open_stats[level];
+								ImGui::Text("Draw calls: %u, dispatches: %u, state changes: %u", s.draw_calls, s.dispatches, s.state_changes);
+								ImGui::Text("Vertices: %" PRIu64 ", primitives: %" PRIu64, s.vertices, s.primitives);
+								ImGui::Text("Fragment invocations: %" PRIu64 ", compute invocations: %" PRIu64, s.fragment_invocations, s.compute_invocations);
+							}
 							if (data.profiler_link) {
 								ImGui::Text("Link: %" PRId64, data.profiler_link);
 								any_hovered_link = true;
@@ -927,6 +1418,10 @@ void ProfilerUIImpl::onGUICPUProfiler()
 					}
 					break;
 				case Profiler::EventType::GPU_FRAME:
+					if (header.time <= m_end && level < 0) {
+						m_gpu_passes.swap(m_gpu_passes_building);
+						m_gpu_passes_building.clear();
+					}
 					break;
 				case Profiler::EventType::GPU_MEM_STATS:
 					read(ctx, p + sizeof(Profiler::EventHeader), m_gpu_mem_stats);
@@ -961,6 +1456,25 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			ImGui::TreePop();
 		}
 
+		if (counters_count > 0 && ImGui::TreeNode("Counters")) {
+			for (int i = 0; i < counters_count; ++i) {
+				const Counter& c = m_counters[i];
+				const char* counter_name = m_capture ? m_capture->getString(m_capture->counters[i]) : global.getCounterName(i);
+				if (c.is_valid) {
+					ImGui::Text("%s: %.2f (max %.2f)", counter_name, c.value, c.max);
+				}
+				else {
+					ImGui::Text("%s: N/A", counter_name);
+				}
+			}
+			ImGui::TreePop();
+		}
+
+		if (!m_gpu_passes.empty() && ImGui::TreeNode("GPU passes")) {
+			onGUIGPUPasses();
+			ImGui::TreePop();
+		}
+
 		if (ImGui::IsMouseHoveringRect(ImVec2(from_x, from_y), ImVec2(to_x, ImGui::GetCursorScreenPos().y))) {
 			if (ImGui::IsMouseDragging()) {
 				m_end -= i64((ImGui::GetIO().MouseDelta.x / (to_x - from_x)) * m_range);
@@ -988,7 +1502,12 @@ void ProfilerUIImpl::onGUICPUProfiler()
 		}
 	}
 
-	if (m_autopause > 0 && !m_is_paused && Profiler::getLastFrameDuration() * 1000.f > m_autopause) {
+	if (ImGui::TreeNode("Statistics")) {
+		onGUIStatistics(global, view_start, m_end);
+		ImGui::TreePop();
+	}
+
+	if (m_autopause > 0 && !m_is_paused && !m_capture && Profiler::getLastFrameDuration() * 1000.f > m_autopause) {
 		m_is_paused = true;
 		Profiler::pause(m_is_paused);
 		m_end = OS::Timer::getRawTimestamp();
@@ -996,6 +1515,417 @@ void ProfilerUIImpl::onGUICPUProfiler()
 }
 
 
+void ProfilerUIImpl::computeStatistics(Profiler::GlobalState& global, u64 from, u64 to)
+{
+	PROFILE_FUNCTION();
+	m_stats.dirty = false;
+	m_stats.from = from;
+	m_stats.to = to;
+	m_stats.frames = 0;
+	m_stats.flame_depth = 0;
+	m_stats.blocks.clear();
+	m_stats.flame.clear();
+	m_stats.flame.push({"", 0, -1, -1, -1, 0});
+
+	struct Sample {
+		u32 block;
+		u64 duration;
+	};
+	Array<Sample> samples(m_allocator);
+	HashMap<const char*, u32> by_ptr(256, m_allocator);
+	HashMap<u32, u32> by_hash(256, m_allocator);
+
+	// the same string can live at several addresses, e.g. in different plugins
+	auto get_block = [&](const char* name) -> u32 {
+		auto iter = by_ptr.find(name);
+		if (iter.isValid()) return iter.value();
+
+		const u32 name_hash = hash32(name);
+		auto hash_iter = by_hash.find(name_hash);
+		if (hash_iter.isValid()) {
+			by_ptr.insert(name, hash_iter.value());
+			return hash_iter.value();
+		}
+
+		const u32 idx = m_stats.blocks.size();
+		m_stats.blocks.push({name, name_hash, 0, 0, 0, 0xffffFFFFffffFFFF, 0, 0, 0});
+		by_ptr.insert(name, idx);
+		by_hash.insert(name_hash, idx);
+		return idx;
+	};
+
+	auto get_flame_child = [&](i32 parent, u32 block_idx) -> i32 {
+		const ProfilerRangeStats::Block& block = m_stats.blocks[block_idx];
+		for (i32 i = m_stats.flame[parent].first_child; i >= 0; i = m_stats.flame[i].next_sibling) {
+			if (m_stats.flame[i].name_hash == block.name_hash) return i;
+		}
+		const i32 idx = m_stats.flame.size();
+		m_stats.flame.push({block.name, block.name_hash, parent, -1, -1, 0});
+		// keep the order of the first appearance
+		i32* link = &m_stats.flame[parent].first_child;
+		while (*link >= 0) link = &m_stats.flame[*link].next_sibling;
+		*link = idx;
+		return idx;
+	};
+
+	const int contexts_count = m_capture ? m_capture->threads.size() : global.threadsCount();
+	for (int i = 0; i < contexts_count; ++i) {
+		ThreadView ctx(global, m_capture, i);
+		if (!ctx.show) continue;
+
+		struct {
+			u32 block;
+			u64 start;
+			u64 children;
+			i32 flame;
+			bool resumed;
+		} open_blocks[64];
+		int level = -1;
+		// blocks begun right after a fiber switch are continuations of blocks interrupted by the switch
+		bool resuming = false;
+
+		auto close_block = [&](u64 time) {
+			auto& open = open_blocks[level];
+			const u64 duration = time > open.start ? time - open.start : 0;
+			if (level > 0) open_blocks[level - 1].children += duration;
+			if (open.start < from || open.start > to) return;
+
+			ProfilerRangeStats::Block& block = m_stats.blocks[open.block];
+			block.total += duration;
+			block.self += duration > open.children ? duration - open.children : 0;
+			m_stats.flame[open.flame].total += duration;
+			if (open.resumed) return;
+
+			++block.count;
+			block.min = minimum(block.min, duration);
+			block.max = maximum(block.max, duration);
+			samples.push({open.block, duration});
+		};
+
+		u32 p = ctx.begin;
+		const u32 end = ctx.end;
+		while (p != end) {
+			Profiler::EventHeader header;
+			read(ctx, p, header);
+			switch (header.type) {
+				case Profiler::EventType::BEGIN_BLOCK: {
+					++level;
+					if (level >= (int)lengthOf(open_blocks)) break;
+					const char* name;
+					read(ctx, p + sizeof(Profiler::EventHeader), name);
+					auto& open = open_blocks[level];
+					open.block = get_block(name);
+					open.start = header.time;
+					open.children = 0;
+					open.resumed = resuming;
+					// continuations are merged into the callstack they were interrupted in
+					const bool chain_start = resuming && (level == 0 || !open_blocks[level - 1].resumed);
+					const i32 parent = level == 0 || chain_start ? 0 : open_blocks[level - 1].flame;
+					open.flame = get_flame_child(parent, open.block);
+					u32 depth = 1;
+					for (i32 n = parent; n > 0; n = m_stats.flame[n].parent) ++depth;
+					m_stats.flame_depth = maximum(m_stats.flame_depth, depth);
+					break;
+				}
+				case Profiler::EventType::END_BLOCK:
+					if (level >= 0) {
+						if (level < (int)lengthOf(open_blocks)) close_block(header.time);
+						--level;
+					}
+					resuming = false;
+					break;
+				case Profiler::EventType::BEGIN_FIBER_WAIT:
+					// blocks leave the thread with the fiber, time spent waiting is not accounted
+					for (; level >= 0; --level) {
+						if (level < (int)lengthOf(open_blocks)) close_block(header.time);
+					}
+					resuming = false;
+					break;
+				case Profiler::EventType::END_FIBER_WAIT:
+					resuming = true;
+					break;
+				case Profiler::EventType::HW_COUNTERS:
+					break;
+				default:
+					resuming = false;
+					break;
+			}
+			p += header.size;
+		}
+	}
+
+	ProfilerRangeStats::FlameNode& root = m_stats.flame[0];
+	for (i32 i = root.first_child; i >= 0; i = m_stats.flame[i].next_sibling) {
+		root.total += m_stats.flame[i].total;
+	}
+
+	{
+		ThreadView ctx(global, m_capture, -1);
+		u32 p = ctx.begin;
+		const u32 end = ctx.end;
+		while (p != end) {
+			Profiler::EventHeader header;
+			read(ctx, p, header);
+			if (header.type == Profiler::EventType::FRAME && header.time >= from && header.time <= to) {
+				++m_stats.frames;
+			}
+			p += header.size;
+		}
+	}
+
+	qsort(samples.begin(), samples.size(), sizeof(samples[0]), [](const void* a, const void* b) -> int {
+		const Sample* sa = (const Sample*)a;
+		const Sample* sb = (const Sample*)b;
+		if (sa->block != sb->block) return sa->block < sb->block ? -1 : 1;
+		if (sa->duration == sb->duration) return 0;
+		return sa->duration < sb->duration ? -1 : 1;
+	});
+	for (u32 i = 0, c = samples.size(); i < c;) {
+		ProfilerRangeStats::Block& block = m_stats.blocks[samples[i].block];
+		const u32 count = block.count;
+		block.p50 = samples[i + count / 2].duration;
+		block.p95 = samples[i + count * 95 / 100].duration;
+		i += count;
+	}
+
+	m_stats.blocks.eraseItems([](const ProfilerRangeStats::Block& block){ return block.total == 0; });
+	sortStatistics();
+}
+
+
+void ProfilerUIImpl::sortStatistics()
+{
+	using Block = ProfilerRangeStats::Block;
+	int (*cmp)(const void*, const void*) = nullptr;
+	switch (m_stats.sort_by) {
+		case ProfilerRangeStats::SortBy::COUNT:
+			cmp = [](const void* a, const void* b) -> int {
+				const Block* ba = (const Block*)a;
+				const Block* bb = (const Block*)b;
+				if (ba->count == bb->count) return 0;
+				return ba->count < bb->count ? 1 : -1;
+			};
+			break;
+		case ProfilerRangeStats::SortBy::TOTAL:
+			cmp = [](const void* a, const void* b) -> int {
+				const Block* ba = (const Block*)a;
+				const Block* bb = (const Block*)b;
+				if (ba->total == bb->total) return 0;
+				return ba->total < bb->total ? 1 : -1;
+			};
+			break;
+		case ProfilerRangeStats::SortBy::SELF:
+			cmp = [](const void* a, const void* b) -> int {
+				const Block* ba = (const Block*)a;
+				const Block* bb = (const Block*)b;
+				if (ba->self == bb->self) return 0;
+				return ba->self < bb->self ? 1 : -1;
+			};
+			break;
+		case ProfilerRangeStats::SortBy::MAX:
+			cmp = [](const void* a, const void* b) -> int {
+				const Block* ba = (const Block*)a;
+				const Block* bb = (const Block*)b;
+				if (ba->max == bb->max) return 0;
+				return ba->max < bb->max ? 1 : -1;
+			};
+			break;
+	}
+	qsort(m_stats.blocks.begin(), m_stats.blocks.size(), sizeof(Block), cmp);
+}
+
+
+void ProfilerUIImpl::showFlameNode(ImDrawList* dl, i32 node_idx, float x, float y, float width)
+{
+	const ProfilerRangeStats::FlameNode& node = m_stats.flame[node_idx];
+	const u64 root_total = m_stats.flame[0].total;
+	if (node_idx > 0) {
+		const ImVec2 ra(x, y);
+		const ImVec2 rb(x + width, y + 19);
+		dl->AddRectFilled(ra, rb, 0xffDDddDD);
+		if (width > 2) dl->AddRect(ra, rb, ImGui::GetColorU32(ImGuiCol_Border));
+		if (ImGui::CalcTextSize(node.name).x + 2 < width) {
+			dl->AddText(ImVec2(x + 2, y), 0xff000000, node.name);
+		}
+		if (ImGui::IsMouseHoveringRect(ra, rb)) {
+			const double freq = (double)getFrequency();
+			ImGui::BeginTooltip();
+			ImGui::Text("%s", node.name);
+			ImGui::Text("Total: %.3f ms (%.1f %%)", 1000 * node.total / freq, 100.f * node.total / root_total);
+			if (m_stats.frames > 0) ImGui::Text("Per frame: %.3f ms", 1000 * node.total / freq / m_stats.frames);
+			ImGui::EndTooltip();
+		}
+		y += 20;
+	}
+
+	// blocks crossing the start of the range can make children longer than their parent
+	const float end_x = x + width;
+	for (i32 i = node.first_child; i >= 0 && x < end_x; i = m_stats.flame[i].next_sibling) {
+		const ProfilerRangeStats::FlameNode& child = m_stats.flame[i];
+		const float w = minimum(float(child.total / double(root_total)) * m_stats.flame_width, end_x - x);
+		if (w >= 1) showFlameNode(dl, i, x, y, w);
+		x += w;
+	}
+}
+
+
+void ProfilerUIImpl::onGUIGPUPasses()
+{
+	const double freq = (double)getFrequency();
+	ImGui::Columns(9, "gpu_passes");
+	const char* headers[] = { "Pass", "Time (ms)", "Draw calls", "Dispatches", "State changes", "Vertices", "Primitives", "Fragments", "Compute" };
+	for (const char* header : headers) {
+		ImGui::TextUnformatted(header);
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+	for (const GPUPass& pass : m_gpu_passes) {
+		ImGui::Indent(pass.level * 10.f + 1);
+		ImGui::TextUnformatted(pass.name);
+		ImGui::Unindent(pass.level * 10.f + 1);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", float(1000 * pass.duration / freq));
+		ImGui::NextColumn();
+		if (pass.has_stats) {
+			const Profiler::GPUStatsBlock& s = pass.stats;
+			ImGui::Text("%u", s.draw_calls);
+			ImGui::NextColumn();
+			ImGui::Text("%u", s.dispatches);
+			ImGui::NextColumn();
+			ImGui::Text("%u", s.state_changes);
+			ImGui::NextColumn();
+			ImGui::Text("%" PRIu64, s.vertices);
+			ImGui::NextColumn();
+			ImGui::Text("%" PRIu64, s.primitives);
+			ImGui::NextColumn();
+			ImGui::Text("%" PRIu64, s.fragment_invocations);
+			ImGui::NextColumn();
+			ImGui::Text("%" PRIu64, s.compute_invocations);
+			ImGui::NextColumn();
+		}
+		else {
+			for (u32 j = 0; j < 7; ++j) {
+				ImGui::TextUnformatted("N/A");
+				ImGui::NextColumn();
+			}
+		}
+	}
+	ImGui::Columns(1);
+}
+
+
+void ProfilerUIImpl::onGUIStatistics(Profiler::GlobalState& global, u64 from, u64 to)
+{
+	if (m_stats.dirty || m_stats.from != from || m_stats.to != to) {
+		computeStatistics(global, from, to);
+	}
+
+	const double freq = (double)getFrequency();
+	auto to_ms = [freq](u64 t) { return float(1000 * t / freq); };
+
+	ImGui::Text("Range: %.3f ms, %u frames", to_ms(to - from), m_stats.frames);
+	ImGui::SameLine();
+	if (ImGui::Button("Set as baseline")) {
+		m_stats.baseline.clear();
+		for (const ProfilerRangeStats::Block& block : m_stats.blocks) {
+			m_stats.baseline.insert(block.name_hash, {block.count, block.self});
+		}
+		m_stats.baseline_frames = m_stats.frames;
+		m_stats.has_baseline = true;
+	}
+	if (m_stats.has_baseline) {
+		ImGui::SameLine();
+		if (ImGui::Button("Clear baseline")) {
+			m_stats.baseline.clear();
+			m_stats.has_baseline = false;
+		}
+	}
+	ImGui::InputTextWithHint("##stats_filter", "Filter", m_filter, sizeof(m_filter));
+
+	if (ImGui::TreeNode("Flame graph")) {
+		ImDrawList* dl = ImGui::GetWindowDrawList();
+		const ImVec2 pos = ImGui::GetCursorScreenPos();
+		m_stats.flame_width = ImGui::GetContentRegionAvail().x;
+		if (m_stats.flame[0].total > 0) showFlameNode(dl, 0, pos.x, pos.y, m_stats.flame_width);
+		ImGui::Dummy(ImVec2(m_stats.flame_width, m_stats.flame_depth * 20.f));
+		ImGui::TreePop();
+	}
+
+	const bool show_baseline = m_stats.has_baseline;
+	// times are per frame when comparing, ranges of different lengths would not be comparable otherwise
+	const bool per_frame = show_baseline && m_stats.frames > 0 && m_stats.baseline_frames > 0;
+	ImGui::Columns(show_baseline ? 10 : 9, "profiler_stats");
+	ImGui::TextUnformatted("Name");
+	ImGui::NextColumn();
+	auto sort_header = [&](const char* label, ProfilerRangeStats::SortBy sort_by) {
+		if (ImGui::Selectable(label, m_stats.sort_by == sort_by)) {
+			m_stats.sort_by = sort_by;
+			sortStatistics();
+		}
+		ImGui::NextColumn();
+	};
+	sort_header("Count", ProfilerRangeStats::SortBy::COUNT);
+	sort_header("Total (ms)", ProfilerRangeStats::SortBy::TOTAL);
+	sort_header("Self (ms)", ProfilerRangeStats::SortBy::SELF);
+	ImGui::TextUnformatted("Min (ms)");
+	ImGui::NextColumn();
+	sort_header("Max (ms)", ProfilerRangeStats::SortBy::MAX);
+	ImGui::TextUnformatted("Median (ms)");
+	ImGui::NextColumn();
+	ImGui::TextUnformatted("95th (ms)");
+	ImGui::NextColumn();
+	ImGui::TextUnformatted("Avg (ms)");
+	ImGui::NextColumn();
+	if (show_baseline) {
+		ImGui::TextUnformatted(per_frame ? "Self/frame vs base" : "Self vs base");
+		ImGui::NextColumn();
+	}
+	ImGui::Separator();
+
+	for (const ProfilerRangeStats::Block& block : m_stats.blocks) {
+		if (m_filter[0] && !stristr(block.name, m_filter)) continue;
+
+		ImGui::TextUnformatted(block.name);
+		ImGui::NextColumn();
+		ImGui::Text("%u", block.count);
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", to_ms(block.total));
+		ImGui::NextColumn();
+		ImGui::Text("%.3f", to_ms(block.self));
+		ImGui::NextColumn();
+		if (block.count > 0) {
+			ImGui::Text("%.3f", to_ms(block.min));
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", to_ms(block.max));
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", to_ms(block.p50));
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", to_ms(block.p95));
+			ImGui::NextColumn();
+			ImGui::Text("%.3f", to_ms(block.total) / block.count);
+			ImGui::NextColumn();
+		}
+		else {
+			for (u32 i = 0; i < 5; ++i) {
+				ImGui::TextUnformatted("-");
+				ImGui::NextColumn();
+			}
+		}
+		if (show_baseline) {
+			auto iter = m_stats.baseline.find(block.name_hash);
+			const u64 base_self = iter.isValid() ? iter.value().self : 0;
+			const float delta = per_frame
+				? to_ms(block.self) / m_stats.frames - to_ms(base_self) / m_stats.baseline_frames
+				: to_ms(block.self) - to_ms(base_self);
+			const ImVec4 color = delta > 0 ? ImVec4(1, 0.3f, 0.3f, 1) : ImVec4(0.3f, 1, 0.3f, 1);
+			ImGui::TextColored(color, "%+.3f", delta);
+			ImGui::NextColumn();
+		}
+	}
+	ImGui::Columns(1);
+}
+
+
 ProfilerUI* ProfilerUI::create(Engine& engine)
 {
 	Debug::Allocator* allocator = engine.getAllocator().isDebug() ? static_cast<Debug::Allocator*>(&engine.getAllocator()) : nullptr;
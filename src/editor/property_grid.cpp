@@ -478,7 +478,7 @@ struct GridUIVisitor final : Reflection::IPropertyVisitor
 
 static bool componentTreeNode(StudioApp& app, ComponentType cmp_type, const EntityRef* entities, int entities_count)
 {
-	static const u32 ENABLED_HASH = crc32("Enabled");
+	static constexpr u32 ENABLED_HASH = StringHash("Enabled");
 	const Reflection::PropertyBase* enabled_prop = Reflection::getProperty(cmp_type, ENABLED_HASH);
 
 	ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_AllowItemOverlap;
@@ -221,6 +221,8 @@ bool Settings::load()
 	enableCrashReporting(m_is_crash_reporting_enabled && !m_force_no_crash_report);
 	m_mouse_sensitivity.x = getFloat(L, "mouse_sensitivity_x", 200.0f);
 	m_mouse_sensitivity.y = getFloat(L, "mouse_sensitivity_y", 200.0f);
+	m_autosave_interval = getFloat(L, "autosave_interval", 0);
+	m_streaming_cell_size = maximum(getFloat(L, "streaming_cell_size", 64), 1.f);
 	const float fov = degreesToRadians(getFloat(L, "fov", 60));
 	Viewport vp = m_editor->getView().getViewport();
 	vp.fov = fov;
@@ -336,6 +338,8 @@ bool Settings::save()
 	writeBool("error_reporting_enabled", m_is_crash_reporting_enabled);
 	file << "mouse_sensitivity_x = " << m_mouse_sensitivity.x << "\n";
 	file << "mouse_sensitivity_y = " << m_mouse_sensitivity.y << "\n";
+	file << "autosave_interval = " << m_autosave_interval << "\n";
+	file << "streaming_cell_size = " << m_streaming_cell_size << "\n";
 	file << "font_size = " << m_font_size << "\n";
 	file << "asset_browser_left_column_width = " << m_asset_browser_left_column_width << "\n";
 	
@@ -506,6 +510,8 @@ void Settings::onGUI()
 				}
 			}
 			ImGui::DragFloat2("Mouse sensitivity", &m_mouse_sensitivity.x, 0.1f, 500.0f);
+			ImGui::DragFloat("Autosave interval (minutes)", &m_autosave_interval, 0.1f, 0, 120);
+			ImGui::DragFloat("Streaming cell size", &m_streaming_cell_size, 1.f, 1, FLT_MAX);
 			Viewport vp = m_editor->getView().getViewport();
 			vp.fov = radiansToDegrees(vp.fov);
 			if (ImGui::SliderFloat("FOV", &vp.fov, 0, 180)) {
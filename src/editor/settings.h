@@ -44,6 +44,10 @@ struct LUMIX_EDITOR_API Settings
 	Vec2 m_mouse_sensitivity;
 	float m_mouse_sensitivity_y;
 	int m_font_size = 13;
+	// in minutes, 0 disables autosave
+	float m_autosave_interval = 0;
+	// size of cells created by "Save streaming cells"
+	float m_streaming_cell_size = 64;
 	WorldEditor* m_editor;
 
 	explicit Settings(StudioApp& app);
@@ -17,6 +17,7 @@
 #include "engine/engine.h"
 #include "engine/file_system.h"
 #include "engine/geometry.h"
+#include "engine/hash.h"
 #include "engine/input_system.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
@@ -179,10 +180,13 @@ struct StudioAppImpl final : StudioApp
 		, m_confirm_new(false)
 		, m_confirm_exit(false)
 		, m_exit_code(0)
+		, m_main_allocator(m_default_allocator)
 		, m_allocator(m_main_allocator)
 		, m_universes(m_allocator)
 		, m_events(m_allocator)
 		, m_windows(m_allocator)
+		, m_entity_list_rows(m_allocator)
+		, m_entity_list_open(m_allocator)
 	{
 		if (!JobSystem::init(OS::getCPUsCount(), m_allocator)) {
 			logError("Engine") << "Failed to initialize job system.";
@@ -846,6 +850,8 @@ struct StudioAppImpl final : StudioApp
 			m_editor->toggleGameMode();
 		}
 
+		autosave();
+
 		for (auto* plugin : m_gui_plugins) {
 			plugin->update(time_delta);
 		}
@@ -1052,6 +1058,22 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
+	// written next to the universe, so it does not overwrite the last explicit save
+	void autosave()
+	{
+		if (m_settings.m_autosave_interval <= 0) return;
+		if (m_autosave_timer.getTimeSinceTick() < m_settings.m_autosave_interval * 60) return;
+		m_autosave_timer.tick();
+
+		if (m_editor->isGameMode() || !m_editor->isUniverseChanged()) return;
+		const char* name = m_editor->getUniverse()->getName();
+		if (!name[0]) return;
+
+		const StaticString<MAX_PATH_LENGTH> basename(name, "_autosave");
+		m_editor->saveUniverseAsync(basename);
+	}
+
+
 	void save()
 	{
 		if (m_editor->isGameMode())
@@ -1232,6 +1254,18 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
+	void saveStreamingCells()
+	{
+		const char* universe_name = m_editor->getUniverse()->getName();
+		if (!universe_name[0]) {
+			logError("Editor") << "Save the universe before creating streaming cells";
+			return;
+		}
+		const StaticString<MAX_PATH_LENGTH> dir("universes/", universe_name, "/cells");
+		m_editor->getPrefabSystem().saveStreamingCells(dir, m_settings.m_streaming_cell_size);
+	}
+
+
 	void autosnapDown()
 	{
 		auto& gizmo = m_editor->getGizmo();
@@ -1373,6 +1407,7 @@ struct StudioAppImpl final : StudioApp
 		}
 		doMenuItem(*getAction("destroyEntity"), is_any_entity_selected);
 		doMenuItem(*getAction("savePrefab"), selected_entities.size() == 1);
+		doMenuItem(*getAction("saveStreamingCells"), is_any_entity_selected && m_editor->getUniverse()->getName()[0]);
 		doMenuItem(*getAction("makeParent"), selected_entities.size() == 2);
 		bool can_unparent =
 			selected_entities.size() == 1 && m_editor->getUniverse()->getParent(selected_entities[0]).isValid();
@@ -1580,18 +1615,91 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
-	void showHierarchy(EntityRef entity, const Array<EntityRef>& selected_entities)
+	struct EntityListRow {
+		EntityRef entity;
+		u32 depth;
+		bool has_children;
+		bool is_open;
+	};
+
+
+	void pushEntityListRows(EntityRef entity, u32 depth)
 	{
-		char buffer[1024];
 		Universe* universe = m_editor->getUniverse();
+		EntityListRow& row = m_entity_list_rows.emplace();
+		row.entity = entity;
+		row.depth = depth;
+		row.has_children = universe->getFirstChild(entity).isValid();
+		row.is_open = row.has_children && m_entity_list_open.find(entity).isValid();
+		if (!row.is_open) return;
+
+		for (EntityPtr e = universe->getFirstChild(entity); e.isValid(); e = universe->getNextSibling((EntityRef)e)) {
+			pushEntityListRows((EntityRef)e, depth + 1);
+		}
+	}
+
+
+	// rows are rebuilt only when the universe, the filter or an expanded node changes, not every frame
+	void updateEntityListRows(const char* filter)
+	{
+		Universe* universe = m_editor->getUniverse();
+		if (!m_entity_list_dirty
+			&& m_entity_list_universe == universe
+			&& m_entity_list_hierarchy_version == universe->getHierarchyVersion()
+			&& m_entity_list_entities_version == universe->getEntitiesVersion()
+			&& equalStrings(m_entity_list_filter, filter))
+		{
+			return;
+		}
+
+		PROFILE_FUNCTION();
+		if (m_entity_list_universe != universe) m_entity_list_open.clear();
+		m_entity_list_dirty = false;
+		m_entity_list_universe = universe;
+		m_entity_list_hierarchy_version = universe->getHierarchyVersion();
+		m_entity_list_entities_version = universe->getEntitiesVersion();
+		copyString(m_entity_list_filter, filter);
+		m_entity_list_rows.clear();
+
+		if (filter[0] == '\0') {
+			for (EntityPtr e = universe->getFirstEntity(); e.isValid(); e = universe->getNextEntity((EntityRef)e)) {
+				const EntityRef e_ref = (EntityRef)e;
+				if (!universe->getParent(e_ref).isValid()) pushEntityListRows(e_ref, 0);
+			}
+			return;
+		}
+
+		for (EntityPtr e = universe->getFirstEntity(); e.isValid(); e = universe->getNextEntity((EntityRef)e)) {
+			char buffer[1024];
+			getEntityListDisplayName(*m_editor, Span(buffer), e);
+			if (stristr(buffer, filter) == nullptr) continue;
+			EntityListRow& row = m_entity_list_rows.emplace();
+			row.entity = (EntityRef)e;
+			row.depth = 0;
+			row.has_children = false;
+			row.is_open = false;
+		}
+	}
+
+
+	void showEntityListRow(const EntityListRow& row, const Array<EntityRef>& selected_entities)
+	{
+		const EntityRef entity = row.entity;
+		char buffer[1024];
 		getEntityListDisplayName(*m_editor, Span(buffer), entity);
-		bool selected = selected_entities.indexOf(entity) >= 0;
+		const bool selected = selected_entities.indexOf(entity) >= 0;
 		ImGui::PushID(entity.index);
-		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
-		bool has_child = universe->getFirstChild(entity).isValid();
-		if (!has_child) flags = ImGuiTreeNodeFlags_Leaf;
+		if (row.depth > 0) ImGui::SetCursorPosX(ImGui::GetCursorPosX() + row.depth * ImGui::GetTreeNodeToLabelSpacing());
+		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+		if (!row.has_children) flags |= ImGuiTreeNodeFlags_Leaf;
 		if (selected) flags |= ImGuiTreeNodeFlags_Selected;
-		bool node_open = ImGui::TreeNodeEx(buffer, flags);
+		ImGui::SetNextItemOpen(row.is_open, ImGuiCond_Always);
+		const bool node_open = ImGui::TreeNodeEx(buffer, flags);
+		if (row.has_children && node_open != row.is_open) {
+			if (node_open) m_entity_list_open.insert(entity, true);
+			else m_entity_list_open.erase(entity);
+			m_entity_list_dirty = true;
+		}
 		if (ImGui::IsItemClicked(0)) m_editor->selectEntities(&entity, 1, true);
 		if (ImGui::IsMouseReleased(1) && ImGui::IsItemHovered()) ImGui::OpenPopup("entity_context_menu");
 		if (ImGui::BeginPopup("entity_context_menu"))
@@ -1619,27 +1727,10 @@ struct StudioAppImpl final : StudioApp
 			if (auto* payload = ImGui::AcceptDragDropPayload("entity"))
 			{
 				EntityRef dropped_entity = *(EntityRef*)payload->Data;
-				if (dropped_entity != entity)
-				{
-					m_editor->makeParent(entity, dropped_entity);
-					ImGui::EndDragDropTarget();
-					if (node_open) ImGui::TreePop();
-					return;
-				}
+				if (dropped_entity != entity) m_editor->makeParent(entity, dropped_entity);
 			}
-
 			ImGui::EndDragDropTarget();
 		}
-
-		if (node_open)
-		{
-			for (EntityPtr e_ptr = universe->getFirstChild(entity); e_ptr.isValid();
-				 e_ptr = universe->getNextSibling((EntityRef)e_ptr))
-			{
-				showHierarchy((EntityRef)e_ptr, selected_entities);
-			}
-			ImGui::TreePop();
-		}
 	}
 
 
@@ -1675,40 +1766,38 @@ struct StudioAppImpl final : StudioApp
 			if (ImGui::BeginChild("entities"))
 			{
 				ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x - ImGui::GetStyle().FramePadding.x);
+				updateEntityListRows(filter);
 				if (filter[0] == '\0')
 				{
-					for (EntityPtr e = universe->getFirstEntity(); e.isValid();
-						 e = universe->getNextEntity((EntityRef)e))
-					{
-						const EntityRef e_ref = (EntityRef)e;
-						if (!universe->getParent(e_ref).isValid())
-						{
-							showHierarchy(e_ref, entities);
+					ImGuiListClipper clipper(m_entity_list_rows.size());
+					while (clipper.Step()) {
+						for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+							showEntityListRow(m_entity_list_rows[i], entities);
 						}
 					}
 				}
 				else
 				{
-					for (EntityPtr e = universe->getFirstEntity(); e.isValid();
-						 e = universe->getNextEntity((EntityRef)e))
-					{
-						char buffer[1024];
-						getEntityListDisplayName(*m_editor, Span(buffer), e);
-						if (stristr(buffer, filter) == nullptr) continue;
-						ImGui::PushID(e.index);
-						const EntityRef e_ref = (EntityRef)e;
-						bool selected = entities.indexOf(e_ref) >= 0;
-						if (ImGui::Selectable(buffer, &selected))
-						{
-							m_editor->selectEntities(&e_ref, 1, true);
-						}
-						if (ImGui::BeginDragDropSource())
-						{
-							ImGui::Text("%s", buffer);
-							ImGui::SetDragDropPayload("entity", &e, sizeof(e));
-							ImGui::EndDragDropSource();
+					ImGuiListClipper clipper(m_entity_list_rows.size());
+					while (clipper.Step()) {
+						for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+							const EntityRef e_ref = m_entity_list_rows[i].entity;
+							char buffer[1024];
+							getEntityListDisplayName(*m_editor, Span(buffer), e_ref);
+							ImGui::PushID(e_ref.index);
+							bool selected = entities.indexOf(e_ref) >= 0;
+							if (ImGui::Selectable(buffer, &selected))
+							{
+								m_editor->selectEntities(&e_ref, 1, true);
+							}
+							if (ImGui::BeginDragDropSource())
+							{
+								ImGui::Text("%s", buffer);
+								ImGui::SetDragDropPayload("entity", &e_ref, sizeof(e_ref));
+								ImGui::EndDragDropSource();
+							}
+							ImGui::PopID();
 						}
-						ImGui::PopID();
 					}
 				}
 				ImGui::PopItemWidth();
@@ -2031,6 +2120,7 @@ struct StudioAppImpl final : StudioApp
 			OS::Keycode::INVALID,
 			OS::Keycode::INVALID);
 		addAction<&StudioAppImpl::savePrefab>(ICON_FA_FLOPPY_O "Save prefab", "Save selected entities as prefab", "savePrefab");
+		addAction<&StudioAppImpl::saveStreamingCells>(NO_ICON "Save streaming cells", "Move selected entities to streaming cells", "saveStreamingCells");
 		addAction<&StudioAppImpl::makeParent>(ICON_FA_OBJECT_GROUP "Make parent", "Make entity parent", "makeParent");
 		addAction<&StudioAppImpl::unparent>(ICON_FA_OBJECT_UNGROUP "Unparent", "Unparent entity", "unparent");
 
@@ -2682,7 +2772,6 @@ struct StudioAppImpl final : StudioApp
 	}
 
 
-#pragma pack(1)
 	struct PackFileInfo
 	{
 		u32 hash;
@@ -2691,7 +2780,6 @@ struct StudioAppImpl final : StudioApp
 
 		char path[MAX_PATH_LENGTH];
 	};
-#pragma pack()
 
 
 	void packDataScan(const char* dir_path, AssociativeArray<u32, PackFileInfo>& infos)
@@ -2707,7 +2795,7 @@ struct StudioAppImpl final : StudioApp
 				if (!includeDirInPack(normalized_path)) continue;
 
 				char dir[MAX_PATH_LENGTH] = {0};
-				if (dir_path[0] != '.') copyString(dir, dir_path);
+				if (!equalStrings(dir_path, "./")) copyString(dir, dir_path);
 				catString(dir, info.filename);
 				catString(dir, "/");
 				packDataScan(dir, infos);
@@ -2717,7 +2805,7 @@ struct StudioAppImpl final : StudioApp
 			if (!includeFileInPack(normalized_path)) continue;
 
 			StaticString<MAX_PATH_LENGTH> out_path;
-			if (dir_path[0] == '.')
+			if (equalStrings(dir_path, "./"))
 			{
 				copyString(out_path.data, normalized_path);
 			}
@@ -2726,7 +2814,7 @@ struct StudioAppImpl final : StudioApp
 				copyString(out_path.data, dir_path);
 				catString(out_path.data, normalized_path);
 			}
-			u32 hash = crc32(out_path.data);
+			u32 hash = hash32(out_path.data);
 			if (infos.find(hash) >= 0) continue;
 
 			auto& out_info = infos.emplace(hash);
@@ -2747,11 +2835,14 @@ struct StudioAppImpl final : StudioApp
 			const auto& resources = iter.value()->getResourceTable();
 			for (Resource* res : resources)
 			{
-				u32 hash = crc32(res->getPath().c_str());
+				// runtime loads compiled resources
+				const StaticString<MAX_PATH_LENGTH> res_path(".lumix/assets/", res->getPath().getHash(), ".res");
+				u32 hash = hash32(res_path);
+				if (infos.find(hash) >= 0) continue;
 				auto& out_info = infos.emplace(hash);
-				copyString(Span(out_info.path), res->getPath().c_str());
+				copyString(Span(out_info.path), res_path);
 				out_info.hash = hash;
-				out_info.size = OS::getFileSize(res->getPath().c_str());
+				out_info.size = OS::getFileSize(res_path);
 				out_info.offset = ~0UL;
 			}
 		}
@@ -2761,7 +2852,7 @@ struct StudioAppImpl final : StudioApp
 		packDataScan(unv_path, infos);
 		unv_path.data[0] = 0;
 		unv_path << "universes/" << m_editor->getUniverse()->getName() << ".unv";
-		u32 hash = crc32(unv_path);
+		u32 hash = hash32(unv_path);
 		auto& out_info = infos.emplace(hash);
 		copyString(Span(out_info.path), unv_path);
 		out_info.hash = hash;
@@ -2810,7 +2901,10 @@ struct StudioAppImpl final : StudioApp
 
 		switch (m_pack.mode)
 		{
-			case PackConfig::Mode::ALL_FILES: packDataScan("./", infos); break;
+			case PackConfig::Mode::ALL_FILES: 
+				packDataScan("./", infos);
+				packDataScan(".lumix/assets/", infos);
+				break;
 			case PackConfig::Mode::CURRENT_UNIVERSE: packDataScanResources(infos); break;
 			default: ASSERT(false); break;
 		}
@@ -2828,24 +2922,34 @@ struct StudioAppImpl final : StudioApp
 			return;
 		}
 
-		int count = infos.size();
-		file.write(&count, sizeof(count));
-		u64 offset = sizeof(count) + (sizeof(u32) + sizeof(u64) * 2) * count;
+		// infos are sorted by hash, so the index can be binary searched
+		PackHeader header;
+		header.count = infos.size();
+		file.write(&header, sizeof(header));
+		auto align = [](u64 offset) { return (offset + PackHeader::ALIGNMENT - 1) & ~u64(PackHeader::ALIGNMENT - 1); };
+		u64 offset = align(sizeof(header) + sizeof(PackEntry) * header.count);
 		for (auto& info : infos)
 		{
 			info.offset = offset;
-			offset += info.size;
+			offset = align(offset + info.size);
 		}
 
 		for (auto& info : infos)
 		{
-			file.write(&info.hash, sizeof(info.hash));
-			file.write(&info.offset, sizeof(info.offset));
-			file.write(&info.size, sizeof(info.size));
+			PackEntry entry;
+			entry.hash = info.hash;
+			entry.offset = info.offset;
+			entry.size = info.size;
+			file.write(&entry, sizeof(entry));
 		}
 
+		u64 pos = sizeof(header) + sizeof(PackEntry) * header.count;
 		for (auto& info : infos)
 		{
+			const u8 zeros[PackHeader::ALIGNMENT] = {};
+			file.write(zeros, info.offset - pos);
+			pos = info.offset + info.size;
+
 			OS::InputFile src;
 			size_t src_size = OS::getFileSize(info.path);
 			if (!m_editor->getEngine().getFileSystem().open(info.path, Ref(src)))
@@ -3097,7 +3201,8 @@ struct StudioAppImpl final : StudioApp
 		u32 counter;
 	};
 
-	DefaultAllocator m_main_allocator;
+	DefaultAllocator m_default_allocator;
+	SmallAllocator m_main_allocator;
 	#ifdef LUMIX_DEBUG
 		Debug::Allocator m_allocator;
 	#else
@@ -3131,10 +3236,20 @@ struct StudioAppImpl final : StudioApp
 	Array<OS::Event> m_events;
 	char m_template_name[100];
 	char m_open_filter[64];
+
+	Array<EntityListRow> m_entity_list_rows;
+	// expanded nodes
+	HashMap<EntityRef, bool> m_entity_list_open;
+	Universe* m_entity_list_universe = nullptr;
+	u32 m_entity_list_hierarchy_version = 0;
+	u32 m_entity_list_entities_version = 0;
+	char m_entity_list_filter[64] = "";
+	bool m_entity_list_dirty = true;
 	char m_component_filter[32];
 	float m_fps = 0;
 	OS::Timer m_fps_timer;
 	OS::Timer m_inactive_fps_timer;
+	OS::Timer m_autosave_timer;
 	u32 m_fps_frame = 0;
 
 	struct PackConfig
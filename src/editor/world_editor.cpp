@@ -24,6 +24,8 @@
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
+#include "engine/thread.h"
 #include "engine/universe.h"
 #include "render_interface.h"
 
@@ -544,6 +546,95 @@ struct PropertySerializeVisitor : Reflection::IPropertyVisitor {
 	int idx;
 };
 
+// copies properties from one live component to another, entity references are remapped
+struct PropertyCloneVisitor : Reflection::IPropertyVisitor {
+	PropertyCloneVisitor(ComponentUID src
+		, ComponentUID dst
+		, const HashMap<EntityPtr, u32>& map
+		, Span<const EntityRef> entities
+		, OutputMemoryStream& tmp)
+		: src(src)
+		, dst(dst)
+		, map(map)
+		, entities(entities)
+		, tmp(tmp)
+	{}
+
+	template <typename T> void clone(const Reflection::Property<T>& prop) {
+		if (prop.get && prop.set) {
+			prop.set(prop, dst, idx, prop.get(prop, src, idx));
+			return;
+		}
+		cloneThroughStream(prop);
+	}
+
+	void cloneThroughStream(const Reflection::PropertyBase& prop) {
+		tmp.clear();
+		prop.getValue(src, idx, tmp);
+		InputMemoryStream blob(tmp);
+		prop.setValue(dst, idx, blob);
+	}
+
+	void visit(const Reflection::Property<float>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<int>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<u32>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<Vec2>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<Vec3>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<IVec3>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<Vec4>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<bool>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<Path>& prop) override { clone(prop); }
+	void visit(const Reflection::Property<const char*>& prop) override { clone(prop); }
+	void visit(const Reflection::IEnumProperty& prop) override { cloneThroughStream(prop); }
+	void visit(const Reflection::IBlobProperty& prop) override { cloneThroughStream(prop); }
+
+	void visit(const Reflection::IDynamicProperties& prop) override {
+		prop.visit(src, idx, *this);
+	}
+
+	void visit(const Reflection::Property<EntityPtr>& prop) override {
+		EntityPtr value;
+		if (prop.get) {
+			value = prop.get(prop, src, idx);
+		}
+		else {
+			tmp.clear();
+			prop.getValue(src, idx, tmp);
+			InputMemoryStream blob(tmp);
+			blob.read(Ref(value));
+		}
+		auto iter = map.find(value);
+		if (iter.isValid()) value = entities[iter.value()];
+
+		if (prop.set) {
+			prop.set(prop, dst, idx, value);
+		}
+		else {
+			InputMemoryStream str(&value, sizeof(value));
+			prop.setValue(dst, idx, str);
+		}
+	}
+
+	void visit(const Reflection::IArrayProperty& prop) override {
+		ASSERT(prop.canAddRemove());
+		const int count = prop.getCount(src);
+		const int idx_backup = idx;
+		for (int i = 0; i < count; ++i) {
+			idx = i;
+			prop.addItem(dst, i);
+			prop.visit(*this);
+		}
+		idx = idx_backup;
+	}
+
+	ComponentUID src;
+	ComponentUID dst;
+	const HashMap<EntityPtr, u32>& map;
+	Span<const EntityRef> entities;
+	OutputMemoryStream& tmp;
+	int idx = -1;
+};
+
 static void load(ComponentUID cmp, int index, InputMemoryStream& blob)
 {
 	int count = blob.read<int>();
@@ -715,6 +806,7 @@ public:
 
 
 	const char* getType() override { return "move_entity"; }
+	u32 getMemorySize() override { return m_entities.byte_size() + m_new_positions.byte_size() * 2 + m_new_rotations.byte_size() * 2; }
 
 
 	bool merge(IEditorCommand& command) override
@@ -817,6 +909,7 @@ public:
 
 
 	const char* getType() override { return "local_move_entity"; }
+	u32 getMemorySize() override { return m_entities.byte_size() + m_new_positions.byte_size() * 2; }
 
 
 	bool merge(IEditorCommand& command) override
@@ -930,6 +1023,7 @@ public:
 
 
 	const char* getType() override { return "scale_entity"; }
+	u32 getMemorySize() override { return m_entities.byte_size() + m_new_scales.byte_size() * 2; }
 
 
 	bool merge(IEditorCommand& command) override
@@ -1066,6 +1160,7 @@ public:
 
 
 	const char* getType() override { return "remove_array_property_item"; }
+	u32 getMemorySize() override { return (u32)m_old_values.getPos(); }
 
 
 	bool merge(IEditorCommand&) override { return false; }
@@ -1152,14 +1247,25 @@ public:
 		auto& prefab_system = editor.getPrefabSystem();
 		m_entities.reserve(count);
 
+		OutputMemoryStream old_values(editor.getAllocator());
+		u64 first_size = 0;
 		for (int i = 0; i < count; ++i)
 		{
 			if (!m_editor.getUniverse()->getComponent(entities[i], m_component_type).isValid()) continue;
 			ComponentUID component = m_editor.getUniverse()->getComponent(entities[i], component_type);
-			m_property->getValue(component, index, m_old_value);
+			m_property->getValue(component, index, old_values);
+			if (m_entities.empty()) first_size = old_values.getPos();
 			m_entities.push(entities[i]);
 		}
 
+		// multiselection edits usually start from the same value, keep it only once
+		m_same_old_value = m_entities.size() > 1 && first_size * m_entities.size() == old_values.getPos();
+		const u8* old_data = old_values.getData();
+		for (int i = 1; m_same_old_value && i < m_entities.size(); ++i) {
+			m_same_old_value = memcmp(old_data, old_data + first_size * i, first_size) == 0;
+		}
+		if (old_values.getPos() > 0) m_old_value.write(old_data, m_same_old_value ? first_size : old_values.getPos());
+
 		m_index = index;
 		m_new_value.write(data, size);
 	}
@@ -1185,6 +1291,7 @@ public:
 		for (EntityPtr entity : m_entities) {
 			if (entity.isValid()) {
 				ComponentUID component = m_editor.getUniverse()->getComponent((EntityRef)entity, m_component_type);
+				if (m_same_old_value) blob.rewind();
 				m_property->setValue(component, m_index, blob);
 			}
 		}
@@ -1192,6 +1299,7 @@ public:
 
 
 	const char* getType() override { return "set_property_values"; }
+	u32 getMemorySize() override { return m_entities.byte_size() + (u32)m_new_value.getPos() + (u32)m_old_value.getPos(); }
 
 
 	bool merge(IEditorCommand& command) override
@@ -1220,6 +1328,7 @@ private:
 	Array<EntityPtr> m_entities;
 	OutputMemoryStream m_new_value;
 	OutputMemoryStream m_old_value;
+	bool m_same_old_value;
 	int m_index;
 	const Reflection::PropertyBase* m_property;
 };
@@ -1528,6 +1637,7 @@ private:
 
 
 		const char* getType() override { return "destroy_entities"; }
+		u32 getMemorySize() override { return m_entities.byte_size() + m_transformations.byte_size() + (u32)m_old_values.getPos() + m_resources.byte_size(); }
 
 
 	private:
@@ -1597,6 +1707,7 @@ private:
 
 
 		const char* getType() override { return "destroy_components"; }
+		u32 getMemorySize() override { return m_entities.byte_size() + (u32)m_old_values.getPos() + m_resources.byte_size(); }
 
 
 		bool execute() override
@@ -1766,6 +1877,10 @@ public:
 
 	~WorldEditorImpl()
 	{
+		m_universe_saver.finished = true;
+		m_universe_saver.semaphore.signal();
+		m_universe_saver.destroy();
+
 		destroyUniverse();
 
 		Gizmo::destroy(*m_gizmo);
@@ -1863,6 +1978,19 @@ public:
 		else {
 			logError("Editor") << "Failed to save universe " << basename;
 		}
+
+		const StaticString<MAX_PATH_LENGTH> manifest_path(dir, "/resources.manifest");
+		OutputMemoryStream manifest(m_allocator);
+		m_engine.getResourceManager().writeManifest(manifest);
+		if (file.open(manifest_path)) {
+			if (!file.write(manifest.getData(), manifest.getPos())) {
+				logError("Editor") << "Failed to save " << manifest_path;
+			}
+			file.close();
+		}
+		else {
+			logError("Editor") << "Failed to save " << manifest_path;
+		}
 		
 		m_is_universe_changed = false;
 
@@ -1870,29 +1998,56 @@ public:
 	}
 
 
-	void save(IOutputStream& file)
+	// header hash is left to the caller
+	void serializeUniverse(OutputMemoryStream& blob)
 	{
 		while (m_engine.getFileSystem().hasWork()) m_engine.getFileSystem().processCallbacks();
 
 		ASSERT(m_universe);
 
-		OutputMemoryStream blob(m_allocator);
 		blob.reserve(64 * 1024);
-
 		Header header = {0xffffFFFF, (int)SerializedVersion::LATEST, 0, 0};
 		blob.write(header);
-		int hashed_offset = sizeof(header);
 
 		header.engine_hash = m_engine.serialize(*m_universe, blob);
 		m_prefab_system->serialize(blob);
+		*(Header*)blob.getMutableData() = header;
+	}
+
+
+	void save(IOutputStream& file)
+	{
+		OutputMemoryStream blob(m_allocator);
+		serializeUniverse(blob);
+
+		Header& header = *(Header*)blob.getMutableData();
+		const int hashed_offset = sizeof(header);
 		header.hash = crc32((const u8*)blob.getData() + hashed_offset, (int)blob.getPos() - hashed_offset);
-		*(Header*)blob.getData() = header;
 		file.write(blob.getData(), blob.getPos());
 
 		logInfo("editor") << "Universe saved";
 	}
 
 
+	void saveUniverseAsync(const char* basename) override
+	{
+		PROFILE_FUNCTION();
+		SaveJob* job = LUMIX_NEW(m_allocator, SaveJob)(m_allocator);
+		job->dir << m_engine.getFileSystem().getBasePath() << "universes/" << basename;
+		OS::makePath(job->dir);
+		serializeUniverse(job->blob);
+		m_engine.getResourceManager().writeManifest(job->manifest);
+
+		{
+			MutexGuard guard(m_universe_saver.mutex);
+			// previous snapshot was not written yet, it's outdated anyway
+			if (m_universe_saver.pending) LUMIX_DELETE(m_allocator, m_universe_saver.pending);
+			m_universe_saver.pending = job;
+		}
+		m_universe_saver.semaphore.signal();
+	}
+
+
 	void setRenderInterface(struct RenderInterface* interface) override
 	{
 		m_render_interface = interface;
@@ -2127,7 +2282,7 @@ public:
 
 		if(m_undo_index >= 0)
 		{
-			static const u32 end_group_hash = crc32("end_group");
+			static constexpr u32 end_group_hash = StringHash("end_group");
 			if(crc32(m_undo_stack[m_undo_index]->getType()) == end_group_hash)
 			{
 				if(static_cast<EndGroupCommand*>(m_undo_stack[m_undo_index])->group_type == type)
@@ -2162,6 +2317,50 @@ public:
 		cmd->group_type = m_current_group_type;
 		m_undo_stack.push(cmd);
 		++m_undo_index;
+		trimUndoStack();
+	}
+
+
+	void setUndoMemoryBudget(u64 bytes) override
+	{
+		m_undo_memory_budget = bytes;
+		trimUndoStack();
+	}
+
+
+	// drops the oldest commands, groups are dropped as a whole, the last executed command is always kept
+	void trimUndoStack()
+	{
+		if (m_is_game_mode) return;
+
+		u64 total = 0;
+		for (IEditorCommand* cmd : m_undo_stack) total += cmd->getMemorySize();
+		if (total <= m_undo_memory_budget) return;
+
+		static constexpr u32 begin_group_hash = StringHash("begin_group");
+		static constexpr u32 end_group_hash = StringHash("end_group");
+		int drop = 0;
+		while (total > m_undo_memory_budget && drop < m_undo_index) {
+			int end = drop;
+			if (crc32(m_undo_stack[drop]->getType()) == begin_group_hash) {
+				while (end < m_undo_stack.size() && crc32(m_undo_stack[end]->getType()) != end_group_hash) ++end;
+				// group is still open
+				if (end == m_undo_stack.size()) break;
+			}
+			if (end >= m_undo_index) break;
+			for (int i = drop; i <= end; ++i) total -= m_undo_stack[i]->getMemorySize();
+			drop = end + 1;
+		}
+		if (drop == 0) return;
+
+		for (int i = 0; i < drop; ++i) {
+			LUMIX_DELETE(m_allocator, m_undo_stack[i]);
+		}
+		for (int i = drop; i < m_undo_stack.size(); ++i) {
+			m_undo_stack[i - drop] = m_undo_stack[i];
+		}
+		m_undo_stack.resize(m_undo_stack.size() - drop);
+		m_undo_index -= drop;
 	}
 
 	void registerCommand(const char* name, CommandCreator* creator) override {
@@ -2243,6 +2442,7 @@ public:
 			m_undo_stack.push(command);
 			if (m_is_game_mode) ++m_game_mode_commands;
 			++m_undo_index;
+			trimUndoStack();
 			return;
 		}
 		else {
@@ -2322,7 +2522,7 @@ public:
 	{
 		serializer.write(count);
 		for (int i = 0; i < count; ++i) {
-			m_copy_buffer.write(entities[i]);
+			serializer.write(entities[i]);
 		}
 		for (int i = 0; i < count; ++i) {
 			EntityRef entity = entities[i];
@@ -2346,6 +2546,30 @@ public:
 		}
 	}
 
+	// selected entities and their children
+	void gatherCopiedEntities(Array<EntityRef>& entities) const
+	{
+		HashMap<EntityRef, bool> set(m_allocator);
+		set.reserve(m_selected_entities.size());
+		entities.reserve(m_selected_entities.size());
+		for (EntityRef e : m_selected_entities) {
+			if (set.find(e).isValid()) continue;
+			set.insert(e, true);
+			entities.push(e);
+		}
+		for (int i = 0; i < entities.size(); ++i) {
+			for (EntityPtr child = m_universe->getFirstChild(entities[i]); 
+				child.isValid(); 
+				child = m_universe->getNextSibling((EntityRef)child)) 
+			{
+				const EntityRef c = (EntityRef)child;
+				if (set.find(c).isValid()) continue;
+				set.insert(c, true);
+				entities.push(c);
+			}
+		}
+	}
+
 	void copyEntities() override
 	{
 		if (m_selected_entities.empty()) return;
@@ -2353,15 +2577,7 @@ public:
 		m_copy_buffer.clear();
 
 		Array<EntityRef> entities(m_allocator);
-		entities = m_selected_entities;
-		for (EntityRef e : entities) {
-			for (EntityPtr child = m_universe->getFirstChild(e); 
-				child.isValid(); 
-				child = m_universe->getNextSibling((EntityRef)child)) 
-			{
-				if(entities.indexOf((EntityRef)child) < 0) entities.push((EntityRef)child);
-			}
-		}
+		gatherCopiedEntities(entities);
 		copyEntities(&entities[0], entities.size(), m_copy_buffer);
 	}
 
@@ -2398,10 +2614,14 @@ public:
 		createUniverse();
 		m_universe->setName(basename);
 		logInfo("Editor") << "Loading universe " << basename << "...";
-		OS::InputFile file;
-		const StaticString<MAX_PATH_LENGTH> path(m_engine.getFileSystem().getBasePath(), "universes/", basename, "/entities.unv");
-		if (file.open(path)) {
-			if (!load(file)) {
+		const StaticString<MAX_PATH_LENGTH> manifest_path("universes/", basename, "/resources.manifest");
+		m_engine.getResourceManager().prefetch(Path(manifest_path));
+		// parsed in place, without copying the whole file to memory first
+		OS::MappedFile file;
+		const StaticString<MAX_PATH_LENGTH> path("universes/", basename, "/entities.unv");
+		if (m_engine.getFileSystem().open(path, Ref(file))) {
+			InputMemoryStream blob(file.getData(), file.size());
+			if (!load(blob)) {
 				logError("Editor") << "Failed to parse " << path;
 				newUniverse();
 			}
@@ -2440,6 +2660,65 @@ public:
 	#pragma pack()
 
 
+	// universe snapshot made by saveUniverseAsync
+	struct SaveJob {
+		SaveJob(IAllocator& allocator) : blob(allocator), manifest(allocator) {}
+
+		StaticString<MAX_PATH_LENGTH> dir;
+		OutputMemoryStream blob;
+		OutputMemoryStream manifest;
+	};
+
+
+	// hashes and writes snapshots, so saving does not stall the main thread
+	struct UniverseSaver final : Thread {
+		UniverseSaver(IAllocator& allocator)
+			: Thread(allocator)
+			, semaphore(0, 0x7fffFFFF)
+		{}
+
+		int task() override {
+			for (;;) {
+				semaphore.wait();
+				SaveJob* job;
+				{
+					MutexGuard guard(mutex);
+					job = pending;
+					pending = nullptr;
+				}
+				if (job) {
+					PROFILE_BLOCK("save universe");
+					Header& header = *(Header*)job->blob.getMutableData();
+					header.hash = crc32((const u8*)job->blob.getData() + sizeof(header), (int)job->blob.getPos() - sizeof(header));
+					write(job->dir, "/entities.unv", job->blob);
+					write(job->dir, "/resources.manifest", job->manifest);
+					LUMIX_DELETE(getAllocator(), job);
+				}
+				if (finished) break;
+			}
+			return 0;
+		}
+
+		static void write(const char* dir, const char* filename, const OutputMemoryStream& data) {
+			const StaticString<MAX_PATH_LENGTH> path(dir, filename);
+			OS::OutputFile file;
+			if (!file.open(path)) {
+				logError("Editor") << "Failed to save " << path;
+				return;
+			}
+			if (!file.write(data.getData(), data.getPos())) {
+				logError("Editor") << "Failed to save " << path;
+			}
+			file.close();
+		}
+
+		Semaphore semaphore;
+		Mutex mutex;
+		SaveJob* pending = nullptr;
+		volatile bool finished = false;
+	};
+
+
 	bool load(IInputStream& file)
 	{
 		m_is_loading = true;
@@ -2542,6 +2821,7 @@ public:
         , m_game_mode_file(m_allocator)
 		, m_command_queue(m_allocator)
 		, m_view(*this)
+		, m_universe_saver(m_allocator)
 	{
 		logInfo("Editor") << "Initializing editor...";
 		m_view.m_viewport.is_ortho = false;
@@ -2560,6 +2840,7 @@ public:
 
 		m_gizmo = Gizmo::create(*this);
 		m_editor_icons = EditorIcons::create(*this);
+		m_universe_saver.create("Universe saver", false);
 	}
 
 
@@ -2702,6 +2983,8 @@ public:
 		m_view.m_is_orbit = false;
 		m_selected_entities.clear();
 		m_universe_created.invoke();
+		// resources used by the universe end up in its manifest, see saveUniverse
+		m_engine.getResourceManager().startRecording();
 	}
 
 
@@ -2721,8 +3004,8 @@ public:
 	{
 		if (m_is_game_mode) return;
 
-		static const u32 end_group_hash = crc32("end_group");
-		static const u32 begin_group_hash = crc32("begin_group");
+		static constexpr u32 end_group_hash = StringHash("end_group");
+		static constexpr u32 begin_group_hash = StringHash("begin_group");
 
 		if (m_undo_index >= m_undo_stack.size() || m_undo_index < 0) return;
 
@@ -2748,8 +3031,8 @@ public:
 	{
 		if (m_is_game_mode) return;
 
-		static const u32 end_group_hash = crc32("end_group");
-		static const u32 begin_group_hash = crc32("begin_group");
+		static constexpr u32 end_group_hash = StringHash("end_group");
+		static constexpr u32 begin_group_hash = StringHash("begin_group");
 
 		if (m_undo_index + 1 >= m_undo_stack.size()) return;
 
@@ -2817,6 +3100,8 @@ private:
 	Array<IEditorCommand*> m_undo_stack;
 	Array<IEditorCommand*> m_command_queue;
 	int m_undo_index;
+	u64 m_undo_memory_budget = 256 * 1024 * 1024;
+	UniverseSaver m_universe_saver;
 	u32 m_current_group_type;
 
 	Array<EntityRef> m_selected_entities;
@@ -2846,25 +3131,81 @@ public:
 		, m_editor(editor)
 		, m_position(editor.getCameraRaycastHit())
 		, m_entities(editor.getAllocator())
+		, m_src_entities(editor.getAllocator())
 		, m_map(editor.getAllocator())
 		, m_identity(identity)
 	{
 	}
 
 
+	// duplicates live entities without serializing them, the copy buffer is filled only when undone
+	PasteEntityCommand(WorldEditor& editor, Span<const EntityRef> src_entities)
+		: m_copy_buffer(editor.getAllocator())
+		, m_editor(editor)
+		, m_position(0)
+		, m_entities(editor.getAllocator())
+		, m_src_entities(editor.getAllocator())
+		, m_map(editor.getAllocator())
+		, m_identity(true)
+	{
+		m_src_entities.resize(src_entities.length());
+		memcpy(m_src_entities.begin(), src_entities.begin(), src_entities.length() * sizeof(EntityRef));
+	}
+
+
 	PasteEntityCommand(WorldEditor& editor, const DVec3& pos, const OutputMemoryStream& copy_buffer, bool identity = false)
 		: m_copy_buffer(copy_buffer)
 		, m_editor(editor)
 		, m_position(pos)
 		, m_entities(editor.getAllocator())
+		, m_src_entities(editor.getAllocator())
 		, m_map(editor.getAllocator())
 		, m_identity(identity)
 	{
 	}
 
 
+	void clone()
+	{
+		PROFILE_FUNCTION();
+		Universe& universe = *m_editor.getUniverse();
+		const int entity_count = m_src_entities.size();
+		m_entities.reserve(entity_count);
+		m_map.reserve(entity_count);
+		for (int i = 0; i < entity_count; ++i) {
+			m_entities.push(universe.createEntity(DVec3(0), Quat(0, 0, 0, 1)));
+			m_map.insert(m_src_entities[i], i);
+		}
+
+		OutputMemoryStream tmp(m_editor.getAllocator());
+		for (int i = 0; i < entity_count; ++i) {
+			const EntityRef src_e = m_src_entities[i];
+			const EntityRef new_entity = m_entities[i];
+			EntityPtr parent = universe.getParent(src_e);
+			auto iter = m_map.find(parent);
+			if (iter.isValid()) parent = m_entities[iter.value()];
+
+			universe.setTransform(new_entity, universe.getTransform(src_e));
+			universe.setParent(parent, new_entity);
+			for (ComponentUID src = universe.getFirstComponent(src_e); src.isValid(); src = universe.getNextComponent(src)) {
+				universe.createComponent(src.type, new_entity);
+
+				ComponentUID dst = src;
+				dst.entity = new_entity;
+				PropertyCloneVisitor visitor(src, dst, m_map, m_entities, tmp);
+				Reflection::getComponent(src.type)->visit(visitor);
+			}
+		}
+	}
+
+
 	bool execute() override
 	{
+		if (m_copy_buffer.empty()) {
+			clone();
+			return true;
+		}
+
 		InputMemoryStream blob(m_copy_buffer);
 
 		Universe& universe = *m_editor.getUniverse();
@@ -2896,6 +3237,9 @@ public:
 				m_map.insert(orig_e, i);
 			}
 		}
+		else {
+			blob.skip(entity_count * sizeof(EntityRef));
+		}
 		for (int i = 0; i < entity_count; ++i)
 		{
 			Transform tr;
@@ -2948,6 +3292,15 @@ public:
 
 	void undo() override
 	{
+		if (m_copy_buffer.empty()) {
+			// redo can not clone, sources might be changed by then
+			WorldEditorImpl& editor = static_cast<WorldEditorImpl&>(m_editor);
+			editor.copyEntities(m_entities.begin(), m_entities.size(), m_copy_buffer);
+			m_map.clear();
+			for (int i = 0; i < m_entities.size(); ++i) {
+				m_map.insert(m_entities[i], i);
+			}
+		}
 		for (auto entity : m_entities) {
 			m_editor.getUniverse()->destroyEntity(entity);
 		}
@@ -2955,6 +3308,7 @@ public:
 
 
 	const char* getType() override { return "paste_entity"; }
+	u32 getMemorySize() override { return (u32)m_copy_buffer.getPos() + m_entities.byte_size() + m_src_entities.byte_size(); }
 
 
 	bool merge(IEditorCommand& command) override
@@ -2972,6 +3326,7 @@ private:
 	WorldEditor& m_editor;
 	DVec3 m_position;
 	Array<EntityRef> m_entities;
+	Array<EntityRef> m_src_entities;
 	HashMap<EntityPtr, u32> m_map;
 	bool m_identity;
 };
@@ -2987,9 +3342,11 @@ void WorldEditorImpl::pasteEntities()
 
 void WorldEditorImpl::duplicateEntities()
 {
-	copyEntities();
+	if (m_selected_entities.empty()) return;
 
-	PasteEntityCommand* command = LUMIX_NEW(m_allocator, PasteEntityCommand)(*this, m_copy_buffer, true);
+	Array<EntityRef> entities(m_allocator);
+	gatherCopiedEntities(entities);
+	PasteEntityCommand* command = LUMIX_NEW(m_allocator, PasteEntityCommand)(*this, entities);
 	executeCommand(command);
 }
 
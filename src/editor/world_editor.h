@@ -45,6 +45,8 @@ struct IEditorCommand
 	virtual void undo() = 0;
 	virtual const char* getType() = 0;
 	virtual bool merge(IEditorCommand& command) = 0;
+	// approximate heap memory held by the command, used to limit the undo history
+	virtual u32 getMemorySize() { return 0; }
 };
 
 struct UniverseView {
@@ -128,6 +130,8 @@ struct LUMIX_EDITOR_API WorldEditor
 	virtual bool canRedo() const = 0;
 	virtual void undo() = 0;
 	virtual void redo() = 0;
+	// the oldest commands are dropped once the undo history takes more memory than this
+	virtual void setUndoMemoryBudget(u64 bytes) = 0;
 	virtual void addComponent(Span<const EntityRef> entities, ComponentType type) = 0;
 	virtual void destroyComponent(Span<const EntityRef> entities, ComponentType cmp_type) = 0;
 	virtual EntityRef addEntity() = 0;
@@ -166,6 +170,8 @@ struct LUMIX_EDITOR_API WorldEditor
 
 	virtual void loadUniverse(const char* basename) = 0;
 	virtual void saveUniverse(const char* basename, bool save_path) = 0;
+	// snapshots the universe in memory, files are written on a background thread
+	virtual void saveUniverseAsync(const char* basename) = 0;
 	virtual void newUniverse() = 0;
 	virtual void snapDown() = 0;
 	virtual void toggleGameMode() = 0;
@@ -1,6 +1,10 @@
 #include "engine/allocator.h"
 #include "engine/crt.h"
 #include "engine/atomic.h"
+#include "engine/log.h"
+#include "engine/math.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
 #ifndef _WIN32
 	#include <string.h>
 	#include <malloc.h>
@@ -69,7 +73,7 @@ namespace Lumix
 		if (newptr == nullptr) {
 			return nullptr;
 		}
-		memcpy(newptr, ptr, malloc_usable_size(ptr));
+		memcpy(newptr, ptr, minimum(malloc_usable_size(ptr), size));
 		free(ptr);
 		return newptr;
 	}
@@ -133,4 +137,564 @@ void* BaseProxyAllocator::reallocate(void* ptr, size_t size)
 }
 
 
+struct TagAllocator::Header {
+	u64 size;
+	// from the beginning of the source allocation to user data
+	u64 offset;
+};
+
+static struct {
+	Mutex mutex;
+	TagAllocator* first = nullptr;
+} g_tag_allocators;
+
+
+TagAllocator::TagAllocator(IAllocator& source, const char* tag_literal)
+	: m_source(source)
+	, m_tag(tag_literal)
+{
+	m_profiler_counter = Profiler::createCounter(tag_literal);
+	MutexGuard lock(g_tag_allocators.mutex);
+	m_next = g_tag_allocators.first;
+	if (m_next) m_next->m_prev = this;
+	g_tag_allocators.first = this;
+}
+
+
+TagAllocator::~TagAllocator()
+{
+	ASSERT(m_live_bytes == 0);
+	MutexGuard lock(g_tag_allocators.mutex);
+	if (m_prev) m_prev->m_next = m_next;
+	else g_tag_allocators.first = m_next;
+	if (m_next) m_next->m_prev = m_prev;
+}
+
+
+void TagAllocator::onAllocated(size_t size)
+{
+	const i64 live = atomicAdd(&m_live_bytes, (i64)size) + (i64)size;
+	atomicIncrement(&m_frame_allocations);
+	atomicAdd(&m_frame_allocated_bytes, (i64)size);
+	for (;;) {
+		const i64 peak = m_peak_bytes;
+		if (live <= peak || compareAndExchange64(&m_peak_bytes, live, peak)) break;
+	}
+}
+
+
+void TagAllocator::onDeallocated(size_t size)
+{
+	atomicSubtract(&m_live_bytes, (i64)size);
+}
+
+
+void* TagAllocator::allocate_aligned(size_t size, size_t align)
+{
+	// the header is in the padding before user data
+	align = maximum(align, (size_t)HEADER_ALIGN);
+	u8* mem = (u8*)m_source.allocate_aligned(size + align, align);
+	if (!mem) return nullptr;
+
+	static_assert(sizeof(Header) <= HEADER_ALIGN);
+	u8* ptr = mem + align;
+	Header* header = (Header*)ptr - 1;
+	header->size = size;
+	header->offset = align;
+	onAllocated(size);
+	return ptr;
+}
+
+
+void TagAllocator::deallocate_aligned(void* ptr)
+{
+	if (!ptr) return;
+	const Header* header = (Header*)ptr - 1;
+	onDeallocated(header->size);
+	m_source.deallocate_aligned((u8*)ptr - header->offset);
+}
+
+
+void* TagAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+
+	align = maximum(align, (size_t)HEADER_ALIGN);
+	const Header old = *((Header*)ptr - 1);
+	if (old.offset != align) {
+		void* new_ptr = allocate_aligned(size, align);
+		if (!new_ptr) return nullptr;
+		memcpy(new_ptr, ptr, minimum(old.size, (u64)size));
+		deallocate_aligned(ptr);
+		return new_ptr;
+	}
+
+	u8* mem = (u8*)m_source.reallocate_aligned((u8*)ptr - old.offset, size + align, align);
+	if (!mem) return nullptr;
+
+	u8* new_ptr = mem + align;
+	Header* header = (Header*)new_ptr - 1;
+	header->size = size;
+	onDeallocated(old.size);
+	onAllocated(size);
+	return new_ptr;
+}
+
+
+void TagAllocator::frame()
+{
+	MutexGuard lock(g_tag_allocators.mutex);
+	for (TagAllocator* a = g_tag_allocators.first; a; a = a->m_next) {
+		// exchange with 0 without losing allocations done meanwhile
+		const i32 allocations = a->m_frame_allocations;
+		atomicSubtract(&a->m_frame_allocations, allocations);
+		const i64 allocated_bytes = a->m_frame_allocated_bytes;
+		atomicSubtract(&a->m_frame_allocated_bytes, allocated_bytes);
+		a->m_last_frame_allocations = (u32)allocations;
+		a->m_last_frame_allocated_bytes = (u64)allocated_bytes;
+
+		Profiler::pushCounter(a->m_profiler_counter, float(a->getLiveBytes() / (1024.0 * 1024.0)));
+
+		const bool over_budget = a->isOverBudget();
+		if (over_budget && !a->m_budget_reported) {
+			logWarning("Engine") << "Memory budget of " << a->m_tag << " exceeded: " 
+				<< a->getLiveBytes() / 1024 << " KB used, " << a->m_budget / 1024 << " KB budget";
+		}
+		a->m_budget_reported = over_budget;
+	}
+}
+
+
+u32 TagAllocator::getAll(Span<TagAllocator*> out)
+{
+	MutexGuard lock(g_tag_allocators.mutex);
+	u32 count = 0;
+	for (TagAllocator* a = g_tag_allocators.first; a; a = a->m_next) {
+		if (count < out.length()) out[count] = a;
+		++count;
+	}
+	return count;
+}
+
+
+static constexpr u32 LINEAR_ALLOCATOR_COMMIT_STEP = 64 * 1024;
+static constexpr u32 FRAME_ALLOCATOR_RESERVE = 64 * 1024 * 1024;
+
+
+LinearAllocator::LinearAllocator(u32 reserved)
+	: m_reserved(reserved)
+{
+	m_mem = (u8*)OS::memReserve(reserved);
+}
+
+
+LinearAllocator::~LinearAllocator()
+{
+	OS::memRelease(m_mem);
+}
+
+
+void LinearAllocator::reset()
+{
+	m_end = 0;
+	memoryBarrier();
+}
+
+
+void* LinearAllocator::allocate_aligned(size_t size, size_t align)
+{
+	ASSERT(size <= m_reserved);
+	const uintptr base = (uintptr)m_mem;
+	u32 start;
+	u32 end;
+	for (;;) {
+		const i32 old_end = m_end;
+		// size of the allocation is stored just before it, so reallocate knows how much to copy
+		start = u32(((base + old_end + sizeof(u32) + align - 1) & ~uintptr(align - 1)) - base);
+		end = start + (u32)size;
+		if (compareAndExchange(&m_end, end, old_end)) break;
+	}
+	LUMIX_FATAL(end <= m_reserved);
+
+	if (end > (u32)m_commited) {
+		MutexGuard lock(m_mutex);
+		if (end > (u32)m_commited) {
+			const u32 commited = m_commited;
+			const u32 new_commited = minimum((end + LINEAR_ALLOCATOR_COMMIT_STEP - 1) / LINEAR_ALLOCATOR_COMMIT_STEP * LINEAR_ALLOCATOR_COMMIT_STEP, m_reserved);
+			OS::memCommit(m_mem + commited, new_commited - commited);
+			memoryBarrier();
+			m_commited = new_commited;
+		}
+	}
+
+	const u32 size32 = (u32)size;
+	memcpy(m_mem + start - sizeof(size32), &size32, sizeof(size32));
+	return m_mem + start;
+}
+
+
+void* LinearAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) return nullptr;
+
+	u32 old_size;
+	memcpy(&old_size, (u8*)ptr - sizeof(u32), sizeof(old_size));
+	if (size <= old_size) return ptr;
+
+	void* new_mem = allocate_aligned(size, align);
+	memcpy(new_mem, ptr, old_size);
+	return new_mem;
+}
+
+
+static constexpr u32 SMALL_ALLOCATOR_RESERVE = 256 * 1024 * 1024;
+static constexpr u32 SMALL_CHUNK_HEADER_SIZE = SmallAllocator::SMALL_ALIGN;
+static constexpr u32 MAX_CACHE_BATCH = 32;
+static constexpr u16 SMALL_SIZES[SmallAllocator::SIZE_CLASSES_COUNT] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024
+};
+// generation of the SmallAllocator which owns thread caches, 0 if there is none
+static volatile i32 g_small_cache_owner = 0;
+static volatile i32 g_small_generation = 0;
+
+
+struct SmallAllocator::SizeClass {
+	Mutex mutex;
+	void* free = nullptr;
+	u8* carve_pos = nullptr;
+	u8* carve_end = nullptr;
+};
+
+
+struct SmallAllocator::ThreadCache {
+	~ThreadCache() {
+		if (generation != 0 && generation == (u32)g_small_cache_owner) owner->flush(*this);
+	}
+
+	u32 generation = 0;
+	SmallAllocator* owner = nullptr;
+	void* free[SIZE_CLASSES_COUNT] = {};
+	u32 counts[SIZE_CLASSES_COUNT] = {};
+};
+
+
+static thread_local SmallAllocator::ThreadCache g_small_cache;
+
+
+static u32 getSizeClass(size_t size)
+{
+	ASSERT(size <= SmallAllocator::MAX_SMALL_SIZE);
+	if (size <= 128) return size == 0 ? 0 : u32((size - 1) >> 4);
+	u32 i = 8;
+	while (SMALL_SIZES[i] < size) ++i;
+	return i;
+}
+
+
+static u32 getCacheBatch(u32 size_class)
+{
+	return clamp(2048u / SMALL_SIZES[size_class], 1u, MAX_CACHE_BATCH);
+}
+
+
+static void*& nextFree(void* block)
+{
+	return *(void**)block;
+}
+
+
+SmallAllocator::SmallAllocator(IAllocator& source)
+	: m_source(source)
+{
+	m_reserved = (u8*)OS::memReserve(SMALL_ALLOCATOR_RESERVE + CHUNK_SIZE);
+	m_base = (u8*)(((uintptr)m_reserved + CHUNK_SIZE - 1) & ~uintptr(CHUNK_SIZE - 1));
+	m_chunks_count = SMALL_ALLOCATOR_RESERVE / CHUNK_SIZE;
+	m_size_classes = (SizeClass*)source.allocate_aligned(sizeof(SizeClass) * SIZE_CLASSES_COUNT, alignof(SizeClass));
+	for (u32 i = 0; i < SIZE_CLASSES_COUNT; ++i) {
+		new (NewPlaceholder(), m_size_classes + i) SizeClass;
+	}
+
+	const u32 generation = (u32)atomicIncrement(&g_small_generation);
+	if (compareAndExchange(&g_small_cache_owner, generation, 0)) m_generation = generation;
+}
+
+
+SmallAllocator::~SmallAllocator()
+{
+	if (m_generation != 0) g_small_cache_owner = 0;
+	for (u32 i = 0; i < SIZE_CLASSES_COUNT; ++i) {
+		m_size_classes[i].~SizeClass();
+	}
+	m_source.deallocate_aligned(m_size_classes);
+	OS::memRelease(m_reserved);
+}
+
+
+SmallAllocator::ThreadCache* SmallAllocator::getThreadCache()
+{
+	if (m_generation == 0) return nullptr;
+	ThreadCache& cache = g_small_cache;
+	if (cache.generation != m_generation) {
+		// anything left belongs to a destroyed allocator
+		memset(cache.free, 0, sizeof(cache.free));
+		memset(cache.counts, 0, sizeof(cache.counts));
+		cache.generation = m_generation;
+		cache.owner = this;
+	}
+	return &cache;
+}
+
+
+void SmallAllocator::flush(ThreadCache& cache)
+{
+	for (u32 i = 0; i < SIZE_CLASSES_COUNT; ++i) {
+		if (!cache.free[i]) continue;
+		void* last = cache.free[i];
+		while (nextFree(last)) last = nextFree(last);
+		SizeClass& size_class = m_size_classes[i];
+		MutexGuard lock(size_class.mutex);
+		nextFree(last) = size_class.free;
+		size_class.free = cache.free[i];
+		cache.free[i] = nullptr;
+		cache.counts[i] = 0;
+	}
+}
+
+
+// call only with size class mutex locked
+void* SmallAllocator::popCentral(u32 size_class_idx)
+{
+	SizeClass& size_class = m_size_classes[size_class_idx];
+	if (size_class.free) {
+		void* res = size_class.free;
+		size_class.free = nextFree(res);
+		return res;
+	}
+
+	const u32 size = SMALL_SIZES[size_class_idx];
+	if (size_class.carve_pos + size > size_class.carve_end) {
+		const u32 chunk_idx = atomicIncrement(&m_used_chunks) - 1;
+		if (chunk_idx >= m_chunks_count) return nullptr;
+
+		u8* chunk = m_base + chunk_idx * (uintptr)CHUNK_SIZE;
+		OS::memCommit(chunk, CHUNK_SIZE);
+		*chunk = (u8)size_class_idx;
+		size_class.carve_pos = chunk + SMALL_CHUNK_HEADER_SIZE;
+		size_class.carve_end = chunk + CHUNK_SIZE;
+	}
+	void* res = size_class.carve_pos;
+	size_class.carve_pos += size;
+	return res;
+}
+
+
+void* SmallAllocator::allocateSmall(u32 size)
+{
+	const u32 size_class_idx = getSizeClass(size);
+	SizeClass& size_class = m_size_classes[size_class_idx];
+	ThreadCache* cache = getThreadCache();
+	if (!cache) {
+		MutexGuard lock(size_class.mutex);
+		return popCentral(size_class_idx);
+	}
+
+	void*& free = cache->free[size_class_idx];
+	if (!free) {
+		const u32 batch = getCacheBatch(size_class_idx);
+		MutexGuard lock(size_class.mutex);
+		for (u32 i = 0; i < batch; ++i) {
+			void* block = popCentral(size_class_idx);
+			if (!block) break;
+			nextFree(block) = free;
+			free = block;
+			++cache->counts[size_class_idx];
+		}
+		if (!free) return nullptr;
+	}
+
+	void* res = free;
+	free = nextFree(res);
+	--cache->counts[size_class_idx];
+	return res;
+}
+
+
+void SmallAllocator::deallocateSmall(void* ptr)
+{
+	const u32 size_class_idx = *(u8*)((uintptr)ptr & ~uintptr(CHUNK_SIZE - 1));
+	SizeClass& size_class = m_size_classes[size_class_idx];
+	ThreadCache* cache = getThreadCache();
+	if (!cache) {
+		MutexGuard lock(size_class.mutex);
+		nextFree(ptr) = size_class.free;
+		size_class.free = ptr;
+		return;
+	}
+
+	void*& free = cache->free[size_class_idx];
+	nextFree(ptr) = free;
+	free = ptr;
+	++cache->counts[size_class_idx];
+
+	const u32 batch = getCacheBatch(size_class_idx);
+	if (cache->counts[size_class_idx] > batch * 2) {
+		MutexGuard lock(size_class.mutex);
+		for (u32 i = 0; i < batch; ++i) {
+			void* block = free;
+			free = nextFree(block);
+			nextFree(block) = size_class.free;
+			size_class.free = block;
+		}
+		cache->counts[size_class_idx] -= batch;
+	}
+}
+
+
+// align == 0 for memory from unaligned allocate
+void* SmallAllocator::reallocateSmall(void* ptr, size_t size, size_t align)
+{
+	if (size == 0) {
+		deallocateSmall(ptr);
+		return nullptr;
+	}
+
+	const u32 size_class_idx = *(u8*)((uintptr)ptr & ~uintptr(CHUNK_SIZE - 1));
+	const u32 old_size = SMALL_SIZES[size_class_idx];
+	if (size <= old_size && (size_class_idx == 0 || size > SMALL_SIZES[size_class_idx - 1])) return ptr;
+
+	void* new_mem = align == 0 ? allocate(size) : allocate_aligned(size, align);
+	memcpy(new_mem, ptr, minimum(size, (size_t)old_size));
+	deallocateSmall(ptr);
+	return new_mem;
+}
+
+
+void* SmallAllocator::allocate_aligned(size_t size, size_t align)
+{
+	if (size <= MAX_SMALL_SIZE && align <= SMALL_ALIGN) {
+		void* res = allocateSmall((u32)size);
+		if (res) return res;
+	}
+	return m_source.allocate_aligned(size, align);
+}
+
+
+void SmallAllocator::deallocate_aligned(void* ptr)
+{
+	if (!ptr) return;
+	if (isSmall(ptr)) deallocateSmall(ptr);
+	else m_source.deallocate_aligned(ptr);
+}
+
+
+void* SmallAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (isSmall(ptr)) return reallocateSmall(ptr, size, align);
+	return m_source.reallocate_aligned(ptr, size, align);
+}
+
+
+void* SmallAllocator::allocate(size_t size)
+{
+	if (size <= MAX_SMALL_SIZE) {
+		void* res = allocateSmall((u32)size);
+		if (res) return res;
+	}
+	return m_source.allocate(size);
+}
+
+
+void SmallAllocator::deallocate(void* ptr)
+{
+	if (!ptr) return;
+	if (isSmall(ptr)) deallocateSmall(ptr);
+	else m_source.deallocate(ptr);
+}
+
+
+void* SmallAllocator::reallocate(void* ptr, size_t size)
+{
+	if (!ptr) return allocate(size);
+	if (isSmall(ptr)) return reallocateSmall(ptr, size, 0);
+	return m_source.reallocate(ptr, size);
+}
+
+
+namespace {
+
+struct FrameAllocator {
+	FrameAllocator();
+	~FrameAllocator();
+
+	LinearAllocator allocator;
+	FrameAllocator* next = nullptr;
+	FrameAllocator* prev = nullptr;
+};
+
+struct FrameAllocators {
+	Mutex mutex;
+	FrameAllocator* first = nullptr;
+};
+
+} // anonymous namespace
+
+
+static FrameAllocators& getFrameAllocators()
+{
+	static FrameAllocators allocators;
+	return allocators;
+}
+
+
+FrameAllocator::FrameAllocator()
+	: allocator(FRAME_ALLOCATOR_RESERVE)
+{
+	FrameAllocators& allocators = getFrameAllocators();
+	MutexGuard lock(allocators.mutex);
+	next = allocators.first;
+	if (next) next->prev = this;
+	allocators.first = this;
+}
+
+
+FrameAllocator::~FrameAllocator()
+{
+	FrameAllocators& allocators = getFrameAllocators();
+	MutexGuard lock(allocators.mutex);
+	if (prev) prev->next = next;
+	else allocators.first = next;
+	if (next) next->prev = prev;
+}
+
+
+static thread_local FrameAllocator g_frame_allocator;
+
+
+IAllocator& getFrameAllocator()
+{
+	return g_frame_allocator.allocator;
+}
+
+
+void resetFrameAllocators()
+{
+	PROFILE_FUNCTION();
+	static const u32 counter = Profiler::createCounter("Frame allocators (KB)");
+	FrameAllocators& allocators = getFrameAllocators();
+	MutexGuard lock(allocators.mutex);
+	u32 total = 0;
+	for (FrameAllocator* i = allocators.first; i; i = i->next) {
+		total += i->allocator.getAllocatedSize();
+		i->allocator.reset();
+	}
+	Profiler::pushCounter(counter, total / 1024.f);
+}
+
+
 } // namespace Lumix
@@ -5,6 +5,7 @@
 	#include <new>
 #endif
 #include "engine/lumix.h"
+#include "engine/sync.h"
 
 #define LUMIX_NEW(allocator, ...) new (Lumix::NewPlaceholder(), (allocator).allocate_aligned(sizeof(__VA_ARGS__), alignof(__VA_ARGS__))) __VA_ARGS__
 #define LUMIX_DELETE(allocator, var) (allocator).deleteObject(var);
@@ -66,4 +67,198 @@ private:
 	volatile i32 m_allocation_count;
 };
 
+
+// proxy which tracks memory used by a subsystem, all instances are registered in a global list
+// adds a small header to each allocation, because sizes are needed on deallocation
+struct LUMIX_ENGINE_API TagAllocator final : IAllocator
+{
+public:
+	// `tag_literal` must outlive the allocator
+	TagAllocator(IAllocator& source, const char* tag_literal);
+	~TagAllocator();
+
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+	void* allocate(size_t size) override { return allocate_aligned(size, HEADER_ALIGN); }
+	void deallocate(void* ptr) override { deallocate_aligned(ptr); }
+	void* reallocate(void* ptr, size_t size) override { return reallocate_aligned(ptr, size, HEADER_ALIGN); }
+	IAllocator& getSourceAllocator() { return m_source; }
+
+	const char* getTag() const { return m_tag; }
+	u64 getLiveBytes() const { return (u64)m_live_bytes; }
+	u64 getPeakBytes() const { return (u64)m_peak_bytes; }
+	u32 getLastFrameAllocations() const { return m_last_frame_allocations; }
+	u64 getLastFrameAllocatedBytes() const { return m_last_frame_allocated_bytes; }
+	// 0 means no budget, exceeding the budget is reported once per crossing
+	void setBudget(u64 bytes) { m_budget = bytes; }
+	u64 getBudget() const { return m_budget; }
+	bool isOverBudget() const { return m_budget != 0 && getLiveBytes() > m_budget; }
+
+	// call once per frame from the main thread, updates per-frame stats and reports budgets
+	static void frame();
+	// fills `out`, returns the total number of tag allocators, call from the main thread
+	static u32 getAll(Span<TagAllocator*> out);
+
+private:
+	enum { HEADER_ALIGN = 16 };
+	struct Header;
+
+	void onAllocated(size_t size);
+	void onDeallocated(size_t size);
+
+	IAllocator& m_source;
+	const char* m_tag;
+	TagAllocator* m_next = nullptr;
+	TagAllocator* m_prev = nullptr;
+	volatile i64 m_live_bytes = 0;
+	volatile i64 m_peak_bytes = 0;
+	volatile i32 m_frame_allocations = 0;
+	volatile i64 m_frame_allocated_bytes = 0;
+	u32 m_last_frame_allocations = 0;
+	u64 m_last_frame_allocated_bytes = 0;
+	u64 m_budget = 0;
+	bool m_budget_reported = false;
+	u32 m_profiler_counter;
+};
+
+
+// bump allocator, deallocate does nothing, memory is reclaimed only by reset
+// thread safe, except reset which must not run concurrently with allocations
+struct LUMIX_ENGINE_API LinearAllocator final : IAllocator {
+	explicit LinearAllocator(u32 reserved);
+	~LinearAllocator();
+
+	void reset();
+	u32 getAllocatedSize() const { return m_end; }
+	u32 getCommitedSize() const { return m_commited; }
+
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override {}
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+	void* allocate(size_t size) override { return allocate_aligned(size, 8); }
+	void deallocate(void* ptr) override {}
+	void* reallocate(void* ptr, size_t size) override { return reallocate_aligned(ptr, size, 8); }
+
+private:
+	u8* m_mem = nullptr;
+	u32 m_reserved;
+	volatile i32 m_end = 0;
+	volatile i32 m_commited = 0;
+	Mutex m_mutex;
+};
+
+
+// allocations up to MAX_SMALL_SIZE are served from size class free lists in a reserved range,
+// the first instance also gets per-thread caches, bigger allocations go to source
+struct LUMIX_ENGINE_API SmallAllocator final : IAllocator {
+	enum {
+		MAX_SMALL_SIZE = 1024,
+		SMALL_ALIGN = 16,
+		CHUNK_SIZE = 64 * 1024,
+		SIZE_CLASSES_COUNT = 20
+	};
+
+	explicit SmallAllocator(IAllocator& source);
+	~SmallAllocator();
+
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	IAllocator& getSourceAllocator() { return m_source; }
+	u32 getUsedChunksCount() const { return u32(m_used_chunks) < m_chunks_count ? u32(m_used_chunks) : m_chunks_count; }
+
+	struct ThreadCache;
+	void flush(ThreadCache& cache);
+
+private:
+	struct SizeClass;
+
+	bool isSmall(const void* ptr) const { return ptr >= m_base && ptr < m_base + m_chunks_count * (uintptr)CHUNK_SIZE; }
+	void* allocateSmall(u32 size);
+	void deallocateSmall(void* ptr);
+	void* reallocateSmall(void* ptr, size_t size, size_t align);
+	void* popCentral(u32 size_class);
+	ThreadCache* getThreadCache();
+
+	IAllocator& m_source;
+	u8* m_reserved;
+	u8* m_base;
+	u32 m_chunks_count;
+	volatile i32 m_used_chunks = 0;
+	u32 m_generation = 0;
+	SizeClass* m_size_classes;
+};
+
+
+// typed free list allocator for hot objects, memory is allocated from source in blocks
+// and never returned until destruction, not thread safe
+template <typename T, u32 BLOCK_SIZE = 64>
+struct PoolAllocator {
+	explicit PoolAllocator(IAllocator& source) : m_source(source) {}
+	PoolAllocator(const PoolAllocator&) = delete;
+	void operator=(const PoolAllocator&) = delete;
+
+	~PoolAllocator() {
+		ASSERT(m_count == 0);
+		while (m_blocks) {
+			Block* next = m_blocks->next;
+			m_source.deallocate_aligned(m_blocks);
+			m_blocks = next;
+		}
+	}
+
+	template <typename... Args> T* create(Args&&... args) {
+		if (!m_free) {
+			Block* block = (Block*)m_source.allocate_aligned(sizeof(Block), alignof(Block));
+			block->next = m_blocks;
+			m_blocks = block;
+			for (u32 i = 0; i < BLOCK_SIZE; ++i) {
+				block->nodes[i].next = i + 1 < BLOCK_SIZE ? &block->nodes[i + 1] : nullptr;
+			}
+			m_free = block->nodes;
+		}
+		Node* node = m_free;
+		m_free = node->next;
+		++m_count;
+		return new (NewPlaceholder(), node->mem) T(static_cast<Args&&>(args)...);
+	}
+
+	void destroy(T* obj) {
+		if (!obj) return;
+		obj->~T();
+		Node* node = (Node*)obj;
+		node->next = m_free;
+		m_free = node;
+		--m_count;
+	}
+
+	u32 getCount() const { return m_count; }
+
+private:
+	union Node {
+		Node* next;
+		alignas(T) u8 mem[sizeof(T)];
+	};
+
+	struct Block {
+		Block* next;
+		Node nodes[BLOCK_SIZE];
+	};
+
+	IAllocator& m_source;
+	Block* m_blocks = nullptr;
+	Node* m_free = nullptr;
+	u32 m_count = 0;
+};
+
+
+// per-thread LinearAllocator, all of them are reset at the end of Engine::update,
+// so memory allocated from it must not be used after the current frame
+LUMIX_ENGINE_API IAllocator& getFrameAllocator();
+LUMIX_ENGINE_API void resetFrameAllocators();
+
 } // namespace Lumix
\ No newline at end of file
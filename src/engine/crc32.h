@@ -14,4 +14,28 @@ LUMIX_ENGINE_API u32 continueCrc32(u32 original_crc, const char* str);
 LUMIX_ENGINE_API u32 continueCrc32(u32 original_crc, const void* data, u32 length);
 
 
+// bitwise version of crc32, same results as the table driven one, meant for constant expressions
+constexpr u32 constCrc32(const char* str, u32 length)
+{
+	u32 crc = 0xffffFFFF;
+	for (u32 i = 0; i < length; ++i) {
+		crc ^= (u8)str[i];
+		for (int j = 0; j < 8; ++j) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+
+// crc32 of a string literal computed at compile time when used in a constant expression,
+// e.g. `constexpr u32 TYPE = StringHash("set_input");`, `case StringHash("sound"):` or as a template argument
+struct StringHash
+{
+	template <u32 N>
+	constexpr StringHash(const char (&str)[N]) : value(constCrc32(str, N - 1)) {}
+	constexpr operator u32() const { return value; }
+
+	u32 value;
+};
+
+
 } // namespace Lumix
\ No newline at end of file
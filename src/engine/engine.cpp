@@ -1,7 +1,9 @@
 #include <imgui/imgui.h>
 
 #include "engine/atomic.h"
+#include "engine/command_line_parser.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
@@ -18,6 +20,9 @@
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
+#include "engine/task_graph.h"
+#include "engine/thread.h"
 #include "engine/universe.h"
 
 
@@ -27,13 +32,44 @@ namespace Lumix
 void registerEngineAPI(lua_State* L, Engine* engine);
 
 static const u32 SERIALIZED_ENGINE_MAGIC = 0x5f4c454e; // == '_LEN'
+// smaller universes, e.g. most prefabs, are not worth the jobs overhead
+static const u64 PARALLEL_DESERIALIZE_MIN_SIZE = 64 * 1024;
+
+
+enum class SerializedEngineVersion : u32
+{
+	BASE,
+	SCENE_SECTIONS, // scenes are length-prefixed, so they can be deserialized in parallel
+	PATH_HASH, // paths are hashed with hash32 instead of crc32
+
+	LATEST
+};
+
+
+// -profiler_capture <path> records everything from the engine creation, e.g. to see the startup timeline
+static void startProfilerCapture()
+{
+	if (Profiler::isCapturing()) return;
+
+	char cmd_line[2048];
+	OS::getCommandLine(Span(cmd_line));
+	CommandLineParser parser(cmd_line);
+	while (parser.next()) {
+		if (!parser.currentEquals("-profiler_capture")) continue;
+		if (!parser.next()) break;
+		char path[MAX_PATH_LENGTH];
+		parser.getCurrent(path, lengthOf(path));
+		Profiler::startCapture(path);
+		break;
+	}
+}
 
 
 #pragma pack(1)
 struct SerializedEngineHeader
 {
 	u32 m_magic;
-	u32 m_reserved; // for crc
+	SerializedEngineVersion m_version;
 };
 #pragma pack()
 
@@ -59,8 +95,38 @@ struct PrefabResourceManager final : ResourceManager
 };
 
 
+struct EngineImpl;
+
+
+struct LogWriter final : Thread
+{
+	LogWriter(EngineImpl& engine, IAllocator& allocator)
+		: Thread(allocator)
+		, m_engine(engine)
+	{}
+
+	int task() override;
+
+	EngineImpl& m_engine;
+};
+
+
 struct EngineImpl final : Engine
 {
+	friend struct LogWriter;
+
+	// despawned instances of a prefab
+	struct PrefabPool {
+		PrefabPool(Universe& universe, u32 prefab_hash, IAllocator& allocator)
+			: universe(&universe)
+			, prefab_hash(prefab_hash)
+			, free(allocator)
+		{}
+
+		Universe* universe;
+		u32 prefab_hash;
+		Array<EntityRef> free;
+	};
 public:
 	void operator=(const EngineImpl&) = delete;
 	EngineImpl(const EngineImpl&) = delete;
@@ -77,42 +143,58 @@ public:
 		, m_time_multiplier(1.0f)
 		, m_paused(false)
 		, m_next_frame(false)
+		, m_scenes_graph(m_allocator)
+		, m_scenes_graph_data(m_allocator)
+		, m_log_pending(m_allocator)
+		, m_log_writing(m_allocator)
+		, m_log_writer(*this, m_allocator)
+		, m_prefab_pools(m_allocator)
 	{
+		startProfilerCapture();
+		PROFILE_BLOCK("create engine");
 		OS::init();
-		OS::InitWindowArgs init_win_args;
-		init_win_args.fullscreen = init_data.fullscreen;
-		init_win_args.handle_file_drops = init_data.handle_file_drops;
-		init_win_args.name = init_data.window_title;
-		m_window_handle = OS::createWindow(init_win_args);
-		if (m_window_handle == OS::INVALID_WINDOW) {
-			logError("Engine") << "Failed to create main window.";
+		m_headless = init_data.headless;
+		m_window_handle = OS::INVALID_WINDOW;
+		if (!m_headless) {
+			OS::InitWindowArgs init_win_args;
+			init_win_args.fullscreen = init_data.fullscreen;
+			init_win_args.handle_file_drops = init_data.handle_file_drops;
+			init_win_args.name = init_data.window_title;
+			m_window_handle = OS::createWindow(init_win_args);
+			if (m_window_handle == OS::INVALID_WINDOW) {
+				logError("Engine") << "Failed to create main window.";
+			}
 		}
 
 		m_is_log_file_open = m_log_file.open("lumix.log");
+		m_log_writer.create("Log writer", false);
 		
 		logInfo("Core") << "Creating engine...";
 		Profiler::setThreadName("Worker");
 		installUnhandledExceptionHandler();
 
-		getLogCallback().bind<&EngineImpl::logToFile>(this);
-		getLogCallback().bind<logToDebugOutput>();
+		getLogCallback().bind<&EngineImpl::log>(this);
 
 		OS::logVersion();
 
 		m_state = luaL_newstate();
 		luaL_openlibs(m_state);
+		lua_gc(m_state, LUA_GCSTOP, 0);
+		m_lua_gc_next_cycle_kb = maximum(lua_gc(m_state, LUA_GCCOUNT, 0) * 2, LUA_GC_MIN_CYCLE_KB);
 
 		registerEngineAPI(m_state, this);
 
 		if (init_data.working_dir) {
-			m_file_system = FileSystem::create(init_data.working_dir, m_allocator);
+			m_file_system = FileSystem::create(init_data.working_dir, init_data.file_system_threads, m_allocator);
 		}
 		else {
 			char current_dir[MAX_PATH_LENGTH];
 			OS::getCurrentDirectory(Span(current_dir)); 
-			m_file_system = FileSystem::create(current_dir, m_allocator);
+			m_file_system = FileSystem::create(current_dir, init_data.file_system_threads, m_allocator);
 		}
 
+		if (init_data.pack_path) m_file_system->mountPack(init_data.pack_path);
+
 		m_resource_manager.init(*m_file_system);
 		m_prefab_resource_manager.create(PrefabResource::TYPE, m_resource_manager);
 
@@ -146,36 +228,67 @@ public:
 		m_prefab_resource_manager.destroy();
 		lua_close(m_state);
 
-		getLogCallback().unbind<&EngineImpl::logToFile>(this);
+		getLogCallback().unbind<&EngineImpl::log>(this);
+		m_log_writer_finished = true;
+		m_log_writer.destroy();
+		flushLog();
 		m_log_file.close();
 		m_is_log_file_open = false;
 		PathManager::destroy(*m_path_manager);
-		OS::destroyWindow(m_window_handle);
+		if (m_window_handle != OS::INVALID_WINDOW) OS::destroyWindow(m_window_handle);
 	}
 
-	static void logToDebugOutput(LogLevel level, const char* system, const char* message)
+	// can be called from any thread, messages are only copied, LogWriter writes them
+	// errors are written immediately, so they are not lost if we crash
+	void log(LogLevel level, const char* system, const char* message)
 	{
-		if(level == LogLevel::ERROR) {
-			Debug::debugOutput("Error: ");
+		{
+			MutexGuard lock(m_log_mutex);
+			m_log_pending.write((u8)level);
+			m_log_pending.write(system, stringLength(system) + 1);
+			m_log_pending.write(message, stringLength(message) + 1);
 		}
-		Debug::debugOutput(system);
-		Debug::debugOutput(":: ");
-		Debug::debugOutput(message);
-		Debug::debugOutput("\n");
+		if (level == LogLevel::ERROR) flushLog();
 	}
 
-	void logToFile(LogLevel level, const char*, const char* message)
+	void flushLog()
 	{
-		if (!m_is_log_file_open) return;
-		if (level == LogLevel::ERROR) {
-			m_log_file.write("Error: ", stringLength("Error :"));
+		MutexGuard file_lock(m_log_file_mutex);
+		{
+			MutexGuard lock(m_log_mutex);
+			if (m_log_pending.empty()) return;
+			m_log_writing.write(m_log_pending.getData(), m_log_pending.getPos());
+			m_log_pending.clear();
+		}
+
+		const char* iter = (const char*)m_log_writing.getData();
+		const char* end = iter + m_log_writing.getPos();
+		while (iter < end) {
+			const LogLevel level = (LogLevel)*iter;
+			const char* system = iter + 1;
+			const char* message = system + stringLength(system) + 1;
+			iter = message + stringLength(message) + 1;
+			if (level == LogLevel::ERROR) {
+				Debug::debugOutput("Error: ");
+			}
+			Debug::debugOutput(system);
+			Debug::debugOutput(":: ");
+			Debug::debugOutput(message);
+			Debug::debugOutput("\n");
+
+			if (!m_is_log_file_open) continue;
+			if (level == LogLevel::ERROR) {
+				m_log_file.write("Error: ", stringLength("Error :"));
+			}
+			m_log_file.write(message, stringLength(message));
+			m_log_file.write("\n", 1);
 		}
-		m_log_file.write(message, stringLength(message));
-		m_log_file.write("\n", 1);
-		m_log_file.flush();
+		if (m_is_log_file_open) m_log_file.flush();
+		m_log_writing.clear();
 	}
 
 	OS::WindowHandle getWindowHandle() override { return m_window_handle; }
+	bool isHeadless() const override { return m_headless; }
 	IAllocator& getAllocator() override { return m_allocator; }
 	PageAllocator& getPageAllocator() override { return m_page_allocator; }
 
@@ -186,18 +299,124 @@ public:
 		float scale,
 		Ref<EntityMap> entity_map) override
 	{
-		ASSERT(prefab.isReady());
+		const Transform tr = {pos, rot, scale};
+		EntityRef root;
+		return instantiatePrefabs(universe, prefab, Span(&tr, 1), Span(&root, 1), Span(&entity_map.value, 1));
+	}
+
+	bool instantiatePrefabs(Universe& universe, const PrefabResource& prefab, Span<const Transform> transforms, Span<EntityRef> roots) override
+	{
+		Array<EntityMap> entity_maps(m_allocator);
+		entity_maps.reserve(transforms.length());
+		for (u32 i = 0; i < transforms.length(); ++i) entity_maps.emplace(m_allocator);
+		return instantiatePrefabs(universe, prefab, transforms, roots, Span(entity_maps.begin(), entity_maps.end()));
+	}
+
+	PrefabPool* getPrefabPool(Universe& universe, const PrefabResource& prefab)
+	{
+		const u32 hash = prefab.getPath().getHash();
+		for (PrefabPool& pool : m_prefab_pools) {
+			if (pool.universe == &universe && pool.prefab_hash == hash) return &pool;
+		}
+		return nullptr;
+	}
+
+	bool spawnPrefabs(Universe& universe, const PrefabResource& prefab, Span<const Transform> transforms, Span<EntityRef> roots) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(transforms.length() == roots.length());
+		PrefabPool* pool = getPrefabPool(universe, prefab);
+		const u32 reused = pool ? minimum((u32)pool->free.size(), transforms.length()) : 0;
+		if (reused > 0) {
+			const u32 first = pool->free.size() - reused;
+			memcpy(roots.begin(), &pool->free[first], reused * sizeof(EntityRef));
+			pool->free.resize(first);
+			// transforms are set while inactive, so scenes see the new transforms when the instances are activated
+			const Span<const EntityRef> reused_roots(roots.begin(), reused);
+			universe.setTransforms(reused_roots, Span(transforms.begin(), reused));
+			universe.setActive(reused_roots, true);
+		}
+		if (reused == transforms.length()) return true;
+		return instantiatePrefabs(universe, prefab, transforms.fromLeft(reused), roots.fromLeft(reused));
+	}
+
+	void despawnPrefabs(Universe& universe, const PrefabResource& prefab, Span<const EntityRef> roots) override
+	{
+		PROFILE_FUNCTION();
+		universe.setActive(roots, false);
+		PrefabPool* pool = getPrefabPool(universe, prefab);
+		if (!pool) pool = &m_prefab_pools.emplace(universe, prefab.getPath().getHash(), m_allocator);
+		for (EntityRef root : roots) pool->free.push(root);
+	}
+
+	// the first instance is fully deserialized, which also records where sections of `prefab.data` are
+	bool parsePrefab(Universe& universe, const PrefabResource& prefab, EntityMap& entity_map)
+	{
+		PROFILE_FUNCTION();
+		PrefabResource::Template& tpl = prefab.prefab_template;
+		tpl.is_parsed = true;
 		InputMemoryStream blob(prefab.data.begin(), prefab.data.byte_size());
-		if (!deserialize(universe, blob, entity_map)) {
+		if (!deserializeHeader(universe, blob)) return false;
+
+		m_path_manager->deserialize(blob);
+		tpl.universe_offset = (u32)blob.getPosition();
+		if (!universe.deserialize(blob, Ref(entity_map))) return false;
+		tpl.universe_size = u32(blob.getPosition() - tpl.universe_offset);
+
+		const i32 scene_count = blob.read<i32>();
+		tpl.scenes.reserve(scene_count);
+		for (i32 i = 0; i < scene_count; ++i) {
+			char tmp[32];
+			blob.readString(Span(tmp));
+			PrefabResource::Template::Scene& scene = tpl.scenes.emplace();
+			scene.name_hash = crc32(tmp);
+			scene.size = blob.read<u32>();
+			scene.offset = (u32)blob.getPosition();
+			blob.skip(scene.size);
+		}
+		tpl.is_valid = true;
+		return true;
+	}
+
+	bool instantiatePrefabs(Universe& universe, const PrefabResource& prefab, Span<const Transform> transforms, Span<EntityRef> roots, Span<EntityMap> entity_maps)
+	{
+		PROFILE_FUNCTION();
+		ASSERT(prefab.isReady());
+		ASSERT(transforms.length() == roots.length());
+		ASSERT(transforms.length() == entity_maps.length());
+		if (transforms.length() == 0) return true;
+
+		const PrefabResource::Template& tpl = prefab.prefab_template;
+		for (u32 i = 0; i < transforms.length(); ++i) {
+			if (!tpl.is_parsed) {
+				if (parsePrefab(universe, prefab, entity_maps[i])) continue;
+			}
+			else if (tpl.is_valid) {
+				InputMemoryStream blob(prefab.data.begin() + tpl.universe_offset, tpl.universe_size);
+				if (universe.deserialize(blob, Ref(entity_maps[i]))) continue;
+			}
 			logError("Engine") << "Failed to instantiate prefab " << prefab.getPath();
 			return false;
 		}
 
-		ASSERT(!entity_map->m_map.empty());
-		const EntityRef root = (EntityRef)entity_map->m_map[0];
-		ASSERT(!universe.getParent(root).isValid());
-		ASSERT(!universe.getNextSibling(root).isValid());
-		universe.setTransform(root, pos, rot, scale);
+		Array<SceneDeserializeData> scenes(m_allocator);
+		scenes.reserve(tpl.scenes.size());
+		u64 total_size = 0;
+		for (const PrefabResource::Template::Scene& scene : tpl.scenes) {
+			scenes.emplace(universe.getScene(scene.name_hash), prefab.data.begin() + scene.offset, scene.size, entity_maps);
+			total_size += scene.size * transforms.length();
+		}
+		deserializeScenes(scenes, total_size);
+		m_path_manager->clear();
+
+		for (u32 i = 0; i < transforms.length(); ++i) {
+			ASSERT(!entity_maps[i].m_map.empty());
+			const EntityRef root = (EntityRef)entity_maps[i].m_map[0];
+			ASSERT(!universe.getParent(root).isValid());
+			ASSERT(!universe.getNextSibling(root).isValid());
+			universe.setTransform(root, transforms[i]);
+			roots[i] = root;
+		}
 		return true;
 	}
 
@@ -228,6 +447,10 @@ public:
 
 	void destroyUniverse(Universe& universe) override
 	{
+		for (i32 i = m_prefab_pools.size() - 1; i >= 0; --i) {
+			if (m_prefab_pools[i].universe == &universe) m_prefab_pools.swapAndPop(i);
+		}
+
 		auto& scenes = universe.getScenes();
 		for (int i = scenes.size() - 1; i >= 0; --i)
 		{
@@ -238,6 +461,7 @@ public:
 		}
 		LUMIX_DELETE(m_allocator, &universe);
 		m_resource_manager.removeUnreferenced();
+		m_page_allocator.trim();
 	}
 
 
@@ -289,10 +513,51 @@ public:
 	}
 
 
+	void setFixedTimeDelta(float time_delta) override
+	{
+		m_fixed_time_delta = maximum(time_delta, 0.f);
+	}
+
+
+	void setLuaGCBudget(float milliseconds) override
+	{
+		m_lua_gc_budget = maximum(milliseconds, 0.f);
+	}
+
+
+	void stepLuaGC()
+	{
+		PROFILE_FUNCTION();
+		// a new cycle starts once the heap doubles since the last one, like the default pause of 200%
+		const int count_kb = lua_gc(m_state, LUA_GCCOUNT, 0);
+		if (!m_lua_gc_cycle_running && count_kb < m_lua_gc_next_cycle_kb) return;
+		m_lua_gc_cycle_running = true;
+
+		const u64 start = OS::Timer::getRawTimestamp();
+		const u64 budget = u64(m_lua_gc_budget * OS::Timer::getFrequency() / 1000);
+		for (;;)
+		{
+			if (lua_gc(m_state, LUA_GCSTEP, 0))
+			{
+				m_lua_gc_cycle_running = false;
+				m_lua_gc_next_cycle_kb = maximum(lua_gc(m_state, LUA_GCCOUNT, 0) * 2, LUA_GC_MIN_CYCLE_KB);
+				break;
+			}
+			if (OS::Timer::getRawTimestamp() - start < budget) continue;
+			// falling behind the allocations, the budget is ignored so the heap does not grow without limit
+			if (lua_gc(m_state, LUA_GCCOUNT, 0) < m_lua_gc_next_cycle_kb * 2) break;
+		}
+		// stepping rearms the automatic collector
+		lua_gc(m_state, LUA_GCSTOP, 0);
+	}
+
+
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
 		float dt = m_timer.tick() * m_time_multiplier;
+		if (m_fixed_time_delta > 0) dt = m_fixed_time_delta * m_time_multiplier;
+		if (m_input_system->isReplaying()) dt = m_input_system->getReplayTimeDelta();
 		if (m_next_frame)
 		{
 			m_paused = false;
@@ -301,10 +566,7 @@ public:
 		m_last_time_delta = dt;
 		{
 			PROFILE_BLOCK("update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->update(dt, m_paused);
-			}
+			updateScenes(context, dt);
 		}
 		{
 			PROFILE_BLOCK("late update scenes");
@@ -316,12 +578,68 @@ public:
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		m_file_system->processCallbacks();
+		m_resource_manager.update();
+		stepLuaGC();
 
 		if (m_next_frame)
 		{
 			m_paused = true;
 			m_next_frame = false;
 		}
+		TagAllocator::frame();
+		JobSystem::updateStats();
+		resetFrameAllocators();
+	}
+
+
+	struct SceneUpdateData {
+		EngineImpl* engine;
+		IScene* scene;
+	};
+
+
+	void buildScenesGraph(const Array<IScene*>& scenes)
+	{
+		m_scenes_graph.clear();
+		m_scenes_graph_data.clear();
+		m_scenes_graph_data.reserve(scenes.size());
+
+		for (IScene* scene : scenes) {
+			m_scenes_graph_data.push({this, scene});
+		}
+
+		for (SceneUpdateData& data : m_scenes_graph_data) {
+			const bool is_serial = data.scene->getUpdateAccess().flags & SceneUpdateAccess::SCRIPTS;
+			// main loop runs on worker 0, keep scenes which are not thread safe there
+			const u8 worker = is_serial ? 0 : JobSystem::ANY_WORKER;
+			m_scenes_graph.addNode("update scene", &data, [](void* ptr){
+				SceneUpdateData* data = (SceneUpdateData*)ptr;
+				data->scene->update(data->engine->m_last_time_delta, data->engine->m_paused);
+			}, worker);
+		}
+
+		// conflicting scenes are updated in the same order as before
+		for (i32 i = 0, c = scenes.size(); i < c; ++i) {
+			const SceneUpdateAccess access = scenes[i]->getUpdateAccess();
+			for (i32 j = i + 1; j < c; ++j) {
+				if (access.conflicts(scenes[j]->getUpdateAccess())) {
+					m_scenes_graph.addEdge(i, j);
+				}
+			}
+		}
+	}
+
+
+	void updateScenes(Universe& universe, float dt)
+	{
+		const Array<IScene*>& scenes = universe.getScenes();
+		bool is_graph_valid = m_scenes_graph_data.size() == scenes.size();
+		for (i32 i = 0, c = scenes.size(); i < c && is_graph_valid; ++i) {
+			is_graph_valid = m_scenes_graph_data[i].scene == scenes[i];
+		}
+		if (!is_graph_valid) buildScenesGraph(scenes);
+
+		m_scenes_graph.run(JobSystem::Priority::HIGH);
 	}
 
 
@@ -389,7 +707,7 @@ public:
 	{
 		SerializedEngineHeader header;
 		header.m_magic = SERIALIZED_ENGINE_MAGIC; // == '_LEN'
-		header.m_reserved = 0;
+		header.m_version = SerializedEngineVersion::LATEST;
 		serializer.write(header);
 		serializePluginList(serializer);
 		serializeSceneVersions(serializer, ctx);
@@ -400,14 +718,81 @@ public:
 		for (IScene* scene : ctx.getScenes())
 		{
 			serializer.writeString(scene->getPlugin().getName());
+			const u64 size_pos = serializer.getPos();
+			serializer.write((u32)0);
 			scene->serialize(serializer);
+			const u32 size = u32(serializer.getPos() - size_pos - sizeof(u32));
+			memcpy(serializer.getMutableData() + size_pos, &size, sizeof(size));
 		}
 		u32 crc = crc32((const u8*)serializer.getData() + pos, (int)serializer.getPos() - pos);
 		return crc;
 	}
 
 
-	bool deserialize(Universe& ctx, InputMemoryStream& serializer, Ref<EntityMap> entity_map) override
+	// the same data are deserialized once for each entity map
+	struct SceneDeserializeData {
+		SceneDeserializeData(IScene* scene, const void* data, u32 size, Span<const EntityMap> entity_maps)
+			: scene(scene)
+			, data(data)
+			, size(size)
+			, entity_maps(entity_maps)
+		{}
+
+		void deserialize() const {
+			for (const EntityMap& entity_map : entity_maps) {
+				InputMemoryStream blob(data, size);
+				scene->deserialize(blob, entity_map);
+			}
+		}
+
+		IScene* scene;
+		const void* data;
+		u32 size;
+		Span<const EntityMap> entity_maps;
+	};
+
+
+	void deserializeScenes(Array<SceneDeserializeData>& scenes, u64 total_size)
+	{
+		PROFILE_FUNCTION();
+		if (total_size < PARALLEL_DESERIALIZE_MIN_SIZE || JobSystem::getWorkersCount() < 2) {
+			for (SceneDeserializeData& data : scenes) {
+				data.deserialize();
+			}
+			return;
+		}
+
+		TaskGraph graph(m_allocator);
+		for (SceneDeserializeData& data : scenes) {
+			// main loop runs on worker 0
+			const u8 worker = data.scene->isDeserializeThreadSafe() ? JobSystem::ANY_WORKER : 0;
+			graph.addNode("deserialize scene", &data, [](void* ptr){
+				((SceneDeserializeData*)ptr)->deserialize();
+			}, worker);
+		}
+
+		i32 prev_serial = -1;
+		for (i32 i = 0, c = scenes.size(); i < c; ++i) {
+			IScene* scene = scenes[i].scene;
+			if (!scene->isDeserializeThreadSafe()) {
+				if (prev_serial >= 0) graph.addEdge(prev_serial, i);
+				prev_serial = i;
+			}
+			for (const char* dependency : scene->getDeserializeDependencies()) {
+				const u32 hash = crc32(dependency);
+				for (i32 j = 0; j < c; ++j) {
+					if (j != i && crc32(scenes[j].scene->getPlugin().getName()) == hash) {
+						graph.addEdge(j, i);
+					}
+				}
+			}
+		}
+
+		graph.run(JobSystem::Priority::HIGH);
+	}
+
+
+	bool deserializeHeader(Universe& ctx, InputMemoryStream& serializer)
 	{
 		SerializedEngineHeader header;
 		serializer.read(header);
@@ -416,20 +801,45 @@ public:
 			logError("Core") << "Wrong or corrupted file";
 			return false;
 		}
+		if (header.m_version > SerializedEngineVersion::LATEST)
+		{
+			logError("Core") << "Unsupported version " << (u32)header.m_version;
+			return false;
+		}
+		if (header.m_version < SerializedEngineVersion::PATH_HASH)
+		{
+			// stored path hashes can not be remapped
+			logError("Core") << "File was saved with crc32 path hashes, which are no longer supported";
+			return false;
+		}
 		if (!hasSerializedPlugins(serializer)) return false;
-		if (!hasSupportedSceneVersions(serializer, ctx)) return false;
+		return hasSupportedSceneVersions(serializer, ctx);
+	}
+
+
+	bool deserialize(Universe& ctx, InputMemoryStream& serializer, Ref<EntityMap> entity_map) override
+	{
+		PROFILE_FUNCTION();
+		if (!deserializeHeader(ctx, serializer)) return false;
 
 		m_path_manager->deserialize(serializer);
-		ctx.deserialize(serializer, entity_map);
+		if (!ctx.deserialize(serializer, entity_map)) return false;
 		i32 scene_count;
 		serializer.read(scene_count);
+		Array<SceneDeserializeData> scenes(m_allocator);
+		scenes.reserve(scene_count);
+		u64 total_size = 0;
 		for (int i = 0; i < scene_count; ++i)
 		{
 			char tmp[32];
 			serializer.readString(Span(tmp));
+			const u32 size = serializer.read<u32>();
+			const void* data = serializer.skip(size);
 			IScene* scene = ctx.getScene(crc32(tmp));
-			scene->deserialize(serializer, entity_map);
+			scenes.emplace(scene, data, size, Span<const EntityMap>(&entity_map.value, 1));
+			total_size += size;
 		}
+		deserializeScenes(scenes, total_size);
 		m_path_manager->clear();
 		return true;
 	}
@@ -484,20 +894,48 @@ private:
 	InputSystem* m_input_system;
 	OS::Timer m_timer;
 	float m_time_multiplier;
+	float m_fixed_time_delta = 0;
 	float m_last_time_delta;
 	bool m_is_game_running;
 	bool m_paused;
 	bool m_next_frame;
 	OS::WindowHandle m_window_handle;
+	bool m_headless = false;
 	PathManager* m_path_manager;
+	TaskGraph m_scenes_graph;
+	Array<SceneUpdateData> m_scenes_graph_data;
 	lua_State* m_state;
+	static constexpr int LUA_GC_MIN_CYCLE_KB = 4 * 1024;
+	float m_lua_gc_budget = 1.f;
+	int m_lua_gc_next_cycle_kb;
+	bool m_lua_gc_cycle_running = false;
 	OS::OutputFile m_log_file;
 	bool m_is_log_file_open = false;
+	Mutex m_log_mutex;
+	Mutex m_log_file_mutex;
+	// serialized messages - level, zero terminated system, zero terminated message
+	OutputMemoryStream m_log_pending;
+	OutputMemoryStream m_log_writing;
+	LogWriter m_log_writer;
+	volatile bool m_log_writer_finished = false;
+	Array<PrefabPool> m_prefab_pools;
 	HashMap<int, Resource*> m_lua_resources;
 	u32 m_last_lua_resource_idx;
 };
 
 
+int LogWriter::task()
+{
+	// messages are batched and written at most this often
+	static constexpr u32 FLUSH_PERIOD_MS = 50;
+	while (!m_engine.m_log_writer_finished) {
+		OS::sleep(FLUSH_PERIOD_MS);
+		m_engine.flushLog();
+	}
+	return 0;
+}
+
+
 Engine* Engine::create(const InitArgs& init_data, IAllocator& allocator)
 {
 	return LUMIX_NEW(allocator, EngineImpl)(init_data, allocator);
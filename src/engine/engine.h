@@ -18,6 +18,12 @@ public:
 		bool fullscreen = false;
 		bool handle_file_drops = false;
 		const char* window_title = "Lumix App";
+		// more threads keep more reads in flight, which helps on SSDs
+		u32 file_system_threads = 4;
+		// relative to working dir, files are loaded from this pack instead of loose files
+		const char* pack_path = nullptr;
+		// no window is created, plugins must not use the GPU, e.g. for dedicated servers
+		bool headless = false;
 	};
 
 	using LuaResourceHandle = u32;
@@ -31,6 +37,7 @@ public:
 	virtual struct Universe& createUniverse(bool is_main_universe) = 0;
 	virtual void destroyUniverse(Universe& context) = 0;
 	virtual OS::WindowHandle getWindowHandle() = 0;
+	virtual bool isHeadless() const = 0;
 
 	virtual struct PathManager& getPathManager() = 0;
 	virtual struct FileSystem& getFileSystem() = 0;
@@ -45,6 +52,18 @@ public:
 		const struct Quat& rot,
 		float scale,
 		Ref<struct EntityMap> entity_map) = 0;
+	// instantiates the prefab once for each transform, much faster than calling instantiatePrefab in a loop
+	virtual bool instantiatePrefabs(Universe& universe,
+		const struct PrefabResource& prefab,
+		Span<const struct Transform> transforms,
+		Span<EntityRef> roots) = 0;
+	// like instantiatePrefabs, but instances despawned by despawnPrefabs are reused first
+	virtual bool spawnPrefabs(Universe& universe,
+		const struct PrefabResource& prefab,
+		Span<const struct Transform> transforms,
+		Span<EntityRef> roots) = 0;
+	// instances are deactivated and kept with all their components, they must not be destroyed while pooled
+	virtual void despawnPrefabs(Universe& universe, const struct PrefabResource& prefab, Span<const EntityRef> roots) = 0;
 
 	virtual void startGame(Universe& context) = 0;
 	virtual void stopGame(Universe& context) = 0;
@@ -54,9 +73,13 @@ public:
 	virtual bool deserialize(Universe& ctx, struct InputMemoryStream& serializer, Ref<struct EntityMap> entity_map) = 0;
 	virtual float getLastTimeDelta() const = 0;
 	virtual void setTimeMultiplier(float multiplier) = 0;
+	// every update advances time by `time_delta` regardless of real time, 0 to use real time
+	virtual void setFixedTimeDelta(float time_delta) = 0;
 	virtual void pause(bool pause) = 0;
 	virtual void nextFrame() = 0;
 	virtual lua_State* getState() = 0;
+	// lua garbage collector runs only in update, for at most this long unless it falls behind
+	virtual void setLuaGCBudget(float milliseconds) = 0;
 
 	virtual struct Resource* getLuaResource(LuaResourceHandle idx) const = 0;
 	virtual LuaResourceHandle addLuaResource(const struct Path& path, struct ResourceType type) = 0;
@@ -2,9 +2,10 @@
 
 #include "engine/allocator.h"
 #include "engine/array.h"
-#include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/delegate_list.h"
 #include "engine/flag_set.h"
+#include "engine/hash.h"
 #include "engine/hash_map.h"
 #include "engine/log.h"
 #include "engine/sync.h"
@@ -20,23 +21,49 @@ namespace Lumix
 {
 
 
+// one read of a file, shared by all requests for the same path made before the read starts
 struct AsyncItem
 {
 	enum class Flags : u32 {
 		FAILED = 1 << 0,
-		CANCELED = 1 << 1,
+		IN_PROGRESS = 1 << 1,
 	};
 
-	AsyncItem(IAllocator& allocator) : data(allocator) {}
+	struct Request {
+		FileSystem::ContentCallback callback;
+		u32 id;
+		bool canceled;
+	};
+
+	AsyncItem(IAllocator& allocator) : data(allocator), requests(allocator) {}
 	
 	bool isFailed() const { return flags.isSet(Flags::FAILED); }
-	bool isCanceled() const { return flags.isSet(Flags::CANCELED); }
+	bool isInProgress() const { return flags.isSet(Flags::IN_PROGRESS); }
+	bool isCanceled() const {
+		for (const Request& req : requests) {
+			if (!req.canceled) return false;
+		}
+		return true;
+	}
 
-	FileSystem::ContentCallback callback;
 	OutputMemoryStream data;
+	// points to mounted pack, used instead of `data`
+	Span<const u8> pack_data;
+	Array<Request> requests;
 	StaticString<MAX_PATH_LENGTH> path;
+	u32 path_hash = 0;
+	// id of the first request
 	u32 id = 0;
+	FileSystem::Priority priority = FileSystem::Priority::NORMAL;
+	float order = 0;
 	FlagSet<Flags, u32> flags;
+
+	// in order of requests if priority and order are the same
+	bool isBefore(const AsyncItem& rhs) const {
+		if (priority != rhs.priority) return priority < rhs.priority;
+		if (order != rhs.order) return order < rhs.order;
+		return id < rhs.id;
+	}
 };
 
 
@@ -56,19 +83,18 @@ public:
 	~FSTask() = default;
 
 
-	void stop();
 	int task() override;
 
 private:
 	FileSystemImpl& m_fs;
-	bool m_finish = false;
 };
 
 
 struct FileSystemImpl final : FileSystem
 {
-	explicit FileSystemImpl(const char* base_path, IAllocator& allocator)
+	FileSystemImpl(const char* base_path, u32 threads_count, IAllocator& allocator)
 		: m_allocator(allocator)
+		, m_tasks(allocator)
 		, m_queue(allocator)	
 		, m_finished(allocator)	
 		, m_last_id(0)
@@ -76,23 +102,90 @@ struct FileSystemImpl final : FileSystem
 		, m_bundled(allocator)
 	{
 		setBasePath(base_path);
-		m_task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
-		m_task->create("Filesystem", true);
+		if (threads_count == 0) threads_count = 1;
+		m_tasks.reserve(threads_count);
+		for (u32 i = 0; i < threads_count; ++i) {
+			FSTask* task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
+			m_tasks.push(task);
+			task->create("Filesystem", true);
+		}
 	}
 
 
 	~FileSystemImpl()
 	{
-		m_task->stop();
-		m_task->destroy();
-		LUMIX_DELETE(m_allocator, m_task);
+		m_finish = true;
+		for (i32 i = 0; i < m_tasks.size(); ++i) m_semaphore.signal();
+		for (FSTask* task : m_tasks) {
+			task->destroy();
+			LUMIX_DELETE(m_allocator, task);
+		}
+		m_pack.close();
 	}
 
 
 	bool hasWork() override
 	{
 		MutexGuard lock(m_mutex);
-		return !m_queue.empty();
+		return !m_queue.empty() || !m_finished.empty();
+	}
+
+
+	bool mountPack(const char* path) override
+	{
+		ASSERT(!m_pack.getData());
+		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
+		if (!m_pack.open(full_path)) {
+			logError("Engine") << "Failed to open pack " << full_path;
+			return false;
+		}
+
+		const PackHeader* header = (const PackHeader*)m_pack.getData();
+		if (m_pack.size() < sizeof(PackHeader)
+			|| header->magic != PackHeader::MAGIC
+			|| header->version < PackHeader::Version::PATH_HASH
+			|| header->version > PackHeader::Version::LATEST
+			|| m_pack.size() < sizeof(PackHeader) + header->count * sizeof(PackEntry))
+		{
+			logError("Engine") << "Invalid pack " << full_path;
+			m_pack.close();
+			return false;
+		}
+
+		m_pack_entries = Span((const PackEntry*)(header + 1), header->count);
+		for (const PackEntry& entry : m_pack_entries) {
+			if (entry.offset + entry.size > m_pack.size()) {
+				logError("Engine") << "Invalid pack " << full_path;
+				m_pack_entries = {};
+				m_pack.close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	const PackEntry* findInPack(u32 hash) const
+	{
+		u32 lo = 0;
+		u32 hi = m_pack_entries.length();
+		while (lo < hi) {
+			const u32 mid = (lo + hi) / 2;
+			const PackEntry& entry = m_pack_entries[mid];
+			if (entry.hash == hash) return &entry;
+			if (entry.hash < hash) lo = mid + 1;
+			else hi = mid;
+		}
+		return nullptr;
+	}
+
+
+	const PackEntry* findInPack(const char* path) const
+	{
+		if (m_pack_entries.length() == 0) return nullptr;
+		char tmp[MAX_PATH_LENGTH];
+		Path::normalize(path, Span(tmp));
+		return findInPack(hash32(tmp));
 	}
 
 
@@ -109,6 +202,12 @@ struct FileSystemImpl final : FileSystem
 	}
 
 	bool getContentSync(const Path& path, Ref<Array<u8>> content) override {
+		if (const PackEntry* entry = findInPack(path.getHash())) {
+			content->resize((u32)entry->size);
+			memcpy(content->begin(), m_pack.getData() + entry->offset, entry->size);
+			return true;
+		}
+
 		OS::InputFile file;
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path.c_str());
 
@@ -123,37 +222,94 @@ struct FileSystemImpl final : FileSystem
 		return true;
 	}
 
-	AsyncHandle getContent(const Path& file, const ContentCallback& callback) override
+	AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority, float order) override
 	{
 		if (!file.isValid()) return AsyncHandle::invalid();
 
 		MutexGuard lock(m_mutex);
-		AsyncItem& item = m_queue.emplace(m_allocator);
 		++m_last_id;
 		if (m_last_id == 0) ++m_last_id;
+
+		const u32 hash = file.getHash();
+		if (const PackEntry* entry = findInPack(hash)) {
+			// already in memory, only the callback is deferred
+			AsyncItem& item = m_finished.emplace(m_allocator);
+			item.id = m_last_id;
+			item.path = file.c_str();
+			item.path_hash = hash;
+			item.pack_data = Span(m_pack.getData() + entry->offset, (u32)entry->size);
+			item.priority = priority;
+			item.order = order;
+			item.requests.push({callback, m_last_id, false});
+			return AsyncHandle(item.id);
+		}
+
+		for (AsyncItem& item : m_queue) {
+			// file could change while it's being read, e.g. when it's recompiled, so join only waiting reads
+			if (item.path_hash != hash || item.isInProgress()) continue;
+
+			item.requests.push({callback, m_last_id, false});
+			if (priority < item.priority) item.priority = priority;
+			if (order < item.order) item.order = order;
+			return AsyncHandle(m_last_id);
+		}
+
+		AsyncItem& item = m_queue.emplace(m_allocator);
 		item.id = m_last_id;
 		item.path = file.c_str();
-		item.callback = callback;
+		item.path_hash = hash;
+		item.priority = priority;
+		item.order = order;
+		item.requests.push({callback, m_last_id, false});
 		m_semaphore.signal();
 		return AsyncHandle(item.id);
 	}
 
 
-	void cancel(AsyncHandle async) override
-	{
-		MutexGuard lock(m_mutex);
-		for (AsyncItem& item : m_queue) {
-			if (item.id == async.value) {
-				item.flags.set(AsyncItem::Flags::CANCELED);
-				return;
+	static bool cancel(Array<AsyncItem>& items, AsyncHandle async) {
+		for (AsyncItem& item : items) {
+			for (AsyncItem::Request& req : item.requests) {
+				if (req.id == async.value) {
+					req.canceled = true;
+					return true;
+				}
 			}
 		}
-		for (AsyncItem& item : m_finished) {
-			if (item.id == async.value) {
-				item.flags.set(AsyncItem::Flags::CANCELED);
-				return;
+		return false;
+	}
+
+
+	static bool setPriority(Array<AsyncItem>& items, AsyncHandle async, Priority priority, float order) {
+		for (AsyncItem& item : items) {
+			for (const AsyncItem::Request& req : item.requests) {
+				if (req.id != async.value) continue;
+				// shared reads keep the most urgent priority
+				if (item.requests.size() == 1) {
+					item.priority = priority;
+					item.order = order;
+				}
+				else {
+					if (priority < item.priority) item.priority = priority;
+					if (order < item.order) item.order = order;
+				}
+				return true;
 			}
 		}
+		return false;
+	}
+
+
+	void setPriority(AsyncHandle async, Priority priority, float order) override
+	{
+		MutexGuard lock(m_mutex);
+		if (!setPriority(m_queue, async, priority, order)) setPriority(m_finished, async, priority, order);
+	}
+
+
+	void cancel(AsyncHandle async) override
+	{
+		MutexGuard lock(m_mutex);
+		if (!cancel(m_queue, async)) cancel(m_finished, async);
 	}
 
 
@@ -171,6 +327,13 @@ struct FileSystemImpl final : FileSystem
 	}
 
 
+	bool open(const char* path, Ref<OS::MappedFile> file) override
+	{
+		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
+		return file->open(full_path);
+	}
+
+
 	bool deleteFile(const char* path) override
 	{
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
@@ -196,6 +359,7 @@ struct FileSystemImpl final : FileSystem
 
 	bool fileExists(const char* path) override
 	{
+		if (findInPack(path)) return true;
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
 		return OS::fileExists(full_path);
 	}
@@ -240,6 +404,7 @@ struct FileSystemImpl final : FileSystem
 		PROFILE_FUNCTION();
 
 		OS::Timer timer;
+		u64 processed_bytes = 0;
 		for(;;) {
 			m_mutex.enter();
 			if (m_finished.empty()) {
@@ -247,49 +412,79 @@ struct FileSystemImpl final : FileSystem
 				break;
 			}
 
-			AsyncItem item = static_cast<AsyncItem&&>(m_finished[0]);
-			m_finished.erase(0);
+			i32 best = 0;
+			for (i32 i = 1, c = m_finished.size(); i < c; ++i) {
+				if (m_finished[i].isBefore(m_finished[best])) best = i;
+			}
+			AsyncItem item = static_cast<AsyncItem&&>(m_finished[best]);
+			m_finished.erase(best);
 
 			m_mutex.exit();
 
-			if(!item.isCanceled()) {
-				item.callback.invoke(item.data.getPos(), (const u8*)item.data.getData(), !item.isFailed());
+			const bool is_from_pack = item.pack_data.begin();
+			const u64 size = is_from_pack ? item.pack_data.length() : item.data.getPos();
+			const u8* mem = is_from_pack ? item.pack_data.begin() : (const u8*)item.data.getData();
+			for (const AsyncItem::Request& req : item.requests) {
+				if (req.canceled) continue;
+				req.callback.invoke(size, mem, !item.isFailed());
 			}
 
-			if (timer.getTimeSinceStart() > 0.1f) {
-				break;
-			}
+			processed_bytes += size;
+			if (m_callbacks_max_seconds > 0 && timer.getTimeSinceStart() > m_callbacks_max_seconds) break;
+			if (m_callbacks_max_bytes > 0 && processed_bytes >= m_callbacks_max_bytes) break;
 		}
 	}
 
+	void setCallbacksBudget(float max_seconds, u64 max_bytes) override
+	{
+		m_callbacks_max_seconds = max_seconds;
+		m_callbacks_max_bytes = max_bytes;
+	}
+
 	IAllocator& m_allocator;
-	FSTask* m_task;
+	Array<FSTask*> m_tasks;
 	StaticString<MAX_PATH_LENGTH> m_base_path;
 	Array<AsyncItem> m_queue;
 	Array<AsyncItem> m_finished;
 	Array<u8> m_bundled;
+	OS::MappedFile m_pack;
+	Span<const PackEntry> m_pack_entries;
 	Mutex m_mutex;
 	Semaphore m_semaphore;
 
 	u32 m_last_id;
+	volatile bool m_finish = false;
+	float m_callbacks_max_seconds = 0.1f;
+	u64 m_callbacks_max_bytes = 0;
 };
 
 
 int FSTask::task()
 {
-	while (!m_finish) {
+	while (!m_fs.m_finish) {
 		m_fs.m_semaphore.wait();
-		if (m_finish) break;
+		if (m_fs.m_finish) break;
 
 		StaticString<MAX_PATH_LENGTH> path;
+		u32 id;
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			ASSERT(!m_fs.m_queue.empty());
-			path = m_fs.m_queue[0].path;
-			if (m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_queue.erase(0);
+			// highest priority first
+			i32 best = -1;
+			for (i32 i = 0, c = m_fs.m_queue.size(); i < c; ++i) {
+				const AsyncItem& item = m_fs.m_queue[i];
+				if (item.isInProgress()) continue;
+				if (best < 0 || item.isBefore(m_fs.m_queue[best])) best = i;
+			}
+			ASSERT(best >= 0);
+			AsyncItem& item = m_fs.m_queue[best];
+			if (item.isCanceled()) {
+				m_fs.m_queue.erase(best);
 				continue;
 			}
+			item.flags.set(AsyncItem::Flags::IN_PROGRESS);
+			path = item.path;
+			id = item.id;
 		}
 
 		bool success = true;
@@ -312,30 +507,26 @@ int FSTask::task()
 
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			if (!m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(m_fs.m_queue[0]));
+			i32 idx = 0;
+			while (m_fs.m_queue[idx].id != id) ++idx;
+			AsyncItem& item = m_fs.m_queue[idx];
+			if (!item.isCanceled()) {
+				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(item));
 				m_fs.m_finished.back().data = static_cast<OutputMemoryStream&&>(data);
 				if(!success) {
 					m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
 				}
 			}
-			m_fs.m_queue.erase(0);
+			m_fs.m_queue.erase(idx);
 		}
 	}
 	return 0;
 }
 
 
-void FSTask::stop()
-{
-	m_finish = true;
-	m_fs.m_semaphore.signal();
-}
-
-
-FileSystem* FileSystem::create(const char* base_path, IAllocator& allocator)
+FileSystem* FileSystem::create(const char* base_path, u32 threads_count, IAllocator& allocator)
 {
-	return LUMIX_NEW(allocator, FileSystemImpl)(base_path, allocator);
+	return LUMIX_NEW(allocator, FileSystemImpl)(base_path, threads_count, allocator);
 }
 
 void FileSystem::destroy(FileSystem* fs)
@@ -11,13 +11,50 @@ namespace OS
 {
 	struct FileIterator;
 	struct InputFile;
+	struct MappedFile;
 	struct OutputFile;
 }
 
+// pack file layout: PackHeader, `count` PackEntry sorted by hash, file contents aligned to PackHeader::ALIGNMENT
+#pragma pack(1)
+struct PackHeader
+{
+	static constexpr u32 MAGIC = 0x4b50414c; // == 'LAPK'
+	static constexpr u32 ALIGNMENT = 16;
+
+	enum class Version : u32 {
+		FIRST,
+		PATH_HASH, // entries are keyed by hash32 instead of crc32
+
+		LATEST
+	};
+
+	u32 magic = MAGIC;
+	Version version = Version::LATEST;
+	u32 count = 0;
+};
+
+
+struct PackEntry
+{
+	u32 hash; // Path::getHash of path relative to base path
+	u64 offset;
+	u64 size;
+};
+#pragma pack()
+
+
 struct LUMIX_ENGINE_API FileSystem
 {
 	using ContentCallback = Delegate<void(u64, const u8*, bool)>;
 
+	// higher priority reads start and their callbacks run first
+	enum class Priority : u8 {
+		HIGH,
+		NORMAL,
+		LOW
+	};
+
 	struct LUMIX_ENGINE_API AsyncHandle {
 		static AsyncHandle invalid() { return AsyncHandle(0xffFFffFF); }
 		explicit AsyncHandle(u32 value) : value(value) {}
@@ -25,7 +62,8 @@ struct LUMIX_ENGINE_API FileSystem
 		bool isValid() const { return value != 0xffFFffFF; }
 	};
 
-	static FileSystem* create(const char* base_path, struct IAllocator& allocator);
+	// files are read by `threads_count` threads, so several reads can be in flight at once
+	static FileSystem* create(const char* base_path, u32 threads_count, struct IAllocator& allocator);
 	static void destroy(FileSystem* fs);
 
 	virtual ~FileSystem() {}
@@ -38,16 +76,25 @@ struct LUMIX_ENGINE_API FileSystem
 	virtual OS::FileIterator* createFileIterator(const char* dir) = 0;
 	virtual bool open(const char* path, Ref<OS::InputFile> file) = 0;
 	virtual bool open(const char* path, Ref<OS::OutputFile> file) = 0;
+	virtual bool open(const char* path, Ref<OS::MappedFile> file) = 0;
 
+	// files in the pack are read from it instead of the base path, path is relative to the base path
+	virtual bool mountPack(const char* path) = 0;
 	virtual void setBasePath(const char* path) = 0;
 	virtual const char* getBasePath() const = 0;
 	virtual void processCallbacks() = 0;
+	// limits the work done by one processCallbacks call, 0 means no limit, at least one callback is always processed
+	virtual void setCallbacksBudget(float max_seconds, u64 max_bytes) = 0;
 	virtual bool hasWork() = 0;
 	virtual void makeRelative(Span<char> relative, const char* absolute) const = 0;
 	virtual void makeAbsolute(Span<char> absolute, const char* relative) const = 0;
 
 	virtual bool getContentSync(const struct Path& file, Ref<Array<u8>> content) =  0;
-	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback) = 0;
+	// requests for the same file, which is not being read yet, share a single read
+	// requests with lower `order` go first within the same priority, e.g. distance to camera
+	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority = Priority::NORMAL, float order = 0) = 0;
+	// reprioritizes a request, which is not yet finished
+	virtual void setPriority(AsyncHandle handle, Priority priority, float order) = 0;
 	virtual void cancel(AsyncHandle handle) = 0;
 };
 
@@ -0,0 +1,45 @@
+#include "engine/hash.h"
+#include "engine/crt.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+namespace
+{
+	// all supported platforms are little endian
+	struct Loader
+	{
+		static u64 read64(const char* p) { u64 v; memcpy(&v, p, sizeof(v)); return v; }
+		static u32 read32(const char* p) { u32 v; memcpy(&v, p, sizeof(v)); return v; }
+	};
+}
+
+
+u64 hash64(const void* data, u32 length)
+{
+	return HashDetail::xxh64<Loader>((const char*)data, length);
+}
+
+
+u64 hash64(const char* str)
+{
+	return HashDetail::xxh64<Loader>(str, stringLength(str));
+}
+
+
+u32 hash32(const void* data, u32 length)
+{
+	return HashDetail::fold(hash64(data, length));
+}
+
+
+u32 hash32(const char* str)
+{
+	return HashDetail::fold(hash64(str));
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,110 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// xxHash64 with seed 0, much faster than crc32 on anything longer than a few bytes
+// stable across platforms and runs, so hashes can be stored in files
+LUMIX_ENGINE_API u64 hash64(const void* data, u32 length);
+LUMIX_ENGINE_API u64 hash64(const char* str);
+// folded hash64, used by Path
+LUMIX_ENGINE_API u32 hash32(const void* data, u32 length);
+LUMIX_ENGINE_API u32 hash32(const char* str);
+
+
+namespace HashDetail
+{
+
+
+static constexpr u64 PRIME1 = 11400714785074694791ULL;
+static constexpr u64 PRIME2 = 14029467366897019727ULL;
+static constexpr u64 PRIME3 = 1609587929392839161ULL;
+static constexpr u64 PRIME4 = 9650029242287828579ULL;
+static constexpr u64 PRIME5 = 2870177450012600261ULL;
+
+constexpr u64 rotl(u64 x, int r) { return (x << r) | (x >> (64 - r)); }
+constexpr u64 round(u64 acc, u64 input) { return rotl(acc + input * PRIME2, 31) * PRIME1; }
+constexpr u64 merge(u64 acc, u64 val) { return (acc ^ round(0, val)) * PRIME1 + PRIME4; }
+constexpr u32 fold(u64 h) { return u32(h ^ (h >> 32)); }
+
+// byte by byte little endian loads, usable in constant expressions
+struct ConstLoader
+{
+	static constexpr u64 read64(const char* p) {
+		u64 res = 0;
+		for (int i = 7; i >= 0; --i) res = (res << 8) | (u8)p[i];
+		return res;
+	}
+	static constexpr u32 read32(const char* p) {
+		u32 res = 0;
+		for (int i = 3; i >= 0; --i) res = (res << 8) | (u8)p[i];
+		return res;
+	}
+};
+
+template <typename Loader>
+constexpr u64 xxh64(const char* p, u32 length)
+{
+	const char* const end = p + length;
+	u64 h = 0;
+	if (length >= 32) {
+		u64 v1 = PRIME1 + PRIME2;
+		u64 v2 = PRIME2;
+		u64 v3 = 0;
+		u64 v4 = 0 - PRIME1;
+		const char* const limit = end - 32;
+		do {
+			v1 = round(v1, Loader::read64(p));
+			v2 = round(v2, Loader::read64(p + 8));
+			v3 = round(v3, Loader::read64(p + 16));
+			v4 = round(v4, Loader::read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(h, v1);
+		h = merge(h, v2);
+		h = merge(h, v3);
+		h = merge(h, v4);
+	}
+	else {
+		h = PRIME5;
+	}
+
+	h += length;
+	for (; p + 8 <= end; p += 8) {
+		h ^= round(0, Loader::read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h ^= u64(Loader::read32(p)) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; ++p) {
+		h ^= u64((u8)*p) * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+} // namespace HashDetail
+
+
+// compile-time versions, equal to hash64/hash32 of the literal without the terminating zero
+template <u32 N> constexpr u64 constHash64(const char (&str)[N]) { return HashDetail::xxh64<HashDetail::ConstLoader>(str, N - 1); }
+template <u32 N> constexpr u32 constHash32(const char (&str)[N]) { return HashDetail::fold(constHash64(str)); }
+
+
+} // namespace Lumix
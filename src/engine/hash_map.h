@@ -2,9 +2,15 @@
 
 
 #include "engine/allocator.h"
+#include "engine/crt.h"
 #include "engine/lumix.h"
 #include "engine/math.h"
 #include "engine/string.h"
+#if defined _WIN32
+	#include <intrin.h>
+#elif defined __SSE2__
+	#include <emmintrin.h>
+#endif
 
 
 namespace Lumix
@@ -127,14 +133,17 @@ struct HashFuncDirect {
 	static u32 get(T key) { return key; }
 };
 
+// open addressing with linear probing, control bytes are kept in a separate array
+// and probed 16 at a time, erase shifts following entries back so there are no tombstones
 template<typename Key, typename Value, typename Hasher = HashFunc<Key>>
 struct HashMap
 {
 private:
+	enum : u32 { GROUP_SIZE = 16 };
+	enum : u8 { EMPTY = 0x80 };
+
 	struct Slot {
-		u8 key_mem[sizeof(Key)];
-		bool valid;
-		//u8 padding[3];
+		alignas(Key) u8 key_mem[sizeof(Key)];
 	};
 
 	template <typename HM, typename K, typename V>
@@ -155,33 +164,26 @@ private:
 		}
 
 		void operator++() { 
-			const Slot* keys = hm->m_keys;
-			for(u32 i = idx + 1, c = hm->m_capacity; i < c; ++i) {
-				if(keys[i].valid) {
-					idx = i;
-					return;
-				}
-			}
-			idx = hm->m_capacity;
+			idx = hm->nextFull(idx + 1);
 		}
 
 		K& key() {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->isFull(idx));
 			return *((Key*)hm->m_keys[idx].key_mem);
 		}
 
 		const V& value() const {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->isFull(idx));
 			return hm->m_values[idx];
 		}
 
 		V& value() {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->isFull(idx));
 			return hm->m_values[idx];
 		}
 
 		V& operator*() {
-			ASSERT(hm->m_keys[idx].valid);
+			ASSERT(hm->isFull(idx));
 			return hm->m_values[idx];
 		}
 
@@ -195,56 +197,30 @@ public:
 	explicit HashMap(IAllocator& allocator) 
 		: m_allocator(allocator) 
 	{
-		init(8, true); 
+		init(GROUP_SIZE); 
 	}
 
 	HashMap(u32 size, IAllocator& allocator) 
 		: m_allocator(allocator) 
 	{
-		init(size, true); 
+		init(size); 
 	}
 
 	~HashMap()
 	{
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
-		m_allocator.deallocate(m_keys);
-		m_allocator.deallocate(m_values);
-	}
-
-	iterator begin() {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
-	}
-
-	const_iterator begin() const {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
+		destroyAll();
+		deallocate();
 	}
 
+	iterator begin() { return { this, nextFull(0) }; }
+	const_iterator begin() const { return { this, nextFull(0) }; }
 	iterator end() { return iterator { this, m_capacity }; }
 	const_iterator end() const { return const_iterator { this, m_capacity }; }
 
 	void clear() {
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
-		m_allocator.deallocate(m_keys);
-		m_allocator.deallocate(m_values);
-		init(8, true);
+		destroyAll();
+		deallocate();
+		init(GROUP_SIZE);
 	}
 
 	const_iterator find(const Key& key) const {
@@ -268,17 +244,13 @@ public:
 	}
 
 	Value& insert(const Key& key, Value&& value) {
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
+		const u32 hash = Hasher::get(key);
+		const u32 pos = findEmptySlot(hash);
 
 		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
-		new (NewPlaceholder(), &m_values[pos]) Value(value);
+		new (NewPlaceholder(), &m_values[pos]) Value(static_cast<Value&&>(value));
 		++m_size;
-		m_keys[pos].valid = true;
+		setCtrl(pos, getH2(hash));
 
 		if (m_size > m_capacity * 3 / 4) {
 			grow(m_capacity << 1);
@@ -289,20 +261,17 @@ public:
 	}
 
 	iterator insert(const Key& key, const Value& value) {
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
+		const u32 hash = Hasher::get(key);
+		const u32 pos = findEmptySlot(hash);
 
 		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
 		new (NewPlaceholder(), &m_values[pos]) Value(value);
 		++m_size;
-		m_keys[pos].valid = true;
+		setCtrl(pos, getH2(hash));
 
 		if (m_size > m_capacity * 3 / 4) {
 			grow(m_capacity << 1);
+			return find(key);
 		}
 
 		return { this, pos };
@@ -310,20 +279,10 @@ public:
 
 	template <typename F>
 	void eraseIf(F predicate) {
-		Slot* keys = m_keys;
 		for (u32 i = 0; i < m_capacity; ++i) {
-			if (!keys[i].valid) continue;
+			if (!isFull(i)) continue;
 			if (predicate(m_values[i])) {
-				((Key*)keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				keys[i].valid = false;
-				--m_size;
-
-				u32 pos = (i + 1) % m_capacity;
-				while (keys[pos].valid) {
-					rehash(pos);
-					pos = (pos + 1) % m_capacity;
-				}
+				eraseAt(i);
 				--i;
 			}
 		}
@@ -331,24 +290,12 @@ public:
 
 	void erase(const iterator& key) {
 		ASSERT(key.isValid());
-
-		Slot* keys = m_keys;
-		u32 pos = key.idx;
-		((Key*)keys[pos].key_mem)->~Key();
-		m_values[pos].~Value();
-		keys[pos].valid = false;
-		--m_size;
-
-		pos = (pos + 1) & m_mask;
-		while (keys[pos].valid) {
-			rehash(pos);
-			pos = (pos + 1) % m_capacity;
-		}
+		eraseAt(key.idx);
 	}
 
 	void erase(const Key& key) {
 		const u32 pos = findPos(key);
-		if (m_keys[pos].valid) erase({this, pos});
+		if (pos != m_capacity) eraseAt(pos);
 	}
 
 	bool empty() const { return m_size == 0; }
@@ -359,6 +306,63 @@ public:
 	}
 
 private:
+	static u8 getH2(u32 hash) { return u8(hash >> 25); }
+	
+	static u32 firstBit(u32 mask) {
+		ASSERT(mask != 0);
+		#ifdef _WIN32
+			unsigned long res;
+			_BitScanForward(&res, mask);
+			return res;
+		#else
+			return __builtin_ctz(mask);
+		#endif
+	}
+
+	// bit i is set if ctrl[i] == value, for i in [0, GROUP_SIZE)
+	static u32 matchGroup(const u8* ctrl, u8 value) {
+		#if defined _WIN32 || defined __SSE2__
+			const __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+			return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+		#else
+			u32 res = 0;
+			for (u32 i = 0; i < GROUP_SIZE; ++i) {
+				if (ctrl[i] == value) res |= 1 << i;
+			}
+			return res;
+		#endif
+	}
+
+	bool isFull(u32 pos) const { return (m_ctrl[pos] & EMPTY) == 0; }
+
+	void setCtrl(u32 pos, u8 value) {
+		m_ctrl[pos] = value;
+		// mirror the beginning so groups can be loaded past the end
+		if (pos < GROUP_SIZE - 1) m_ctrl[m_capacity + pos] = value;
+	}
+
+	u32 nextFull(u32 pos) const {
+		for (u32 c = m_capacity; pos < c; ++pos) {
+			if (isFull(pos)) return pos;
+		}
+		return m_capacity;
+	}
+
+	void destroyAll() {
+		for (u32 i = 0, c = m_capacity; i < c; ++i) {
+			if (isFull(i)) {
+				((Key*)m_keys[i].key_mem)->~Key();
+				m_values[i].~Value();
+			}
+		}
+	}
+
+	void deallocate() {
+		m_allocator.deallocate(m_ctrl);
+		m_allocator.deallocate(m_keys);
+		m_allocator.deallocate(m_values);
+	}
+
 	void grow(u32 new_capacity) {
 		HashMap<Key, Value, Hasher> tmp(new_capacity, m_allocator);
 		if (m_size > 0) {
@@ -370,67 +374,81 @@ private:
 		swap(m_capacity, tmp.m_capacity);
 		swap(m_size, tmp.m_size);
 		swap(m_mask, tmp.m_mask);
+		swap(m_ctrl, tmp.m_ctrl);
 		swap(m_keys, tmp.m_keys);
 		swap(m_values, tmp.m_values);
 	}
 
-	u32 findEmptySlot(const Key& key, u32 end_pos) const {
-		const u32 mask = m_mask;
-		u32 pos = Hasher::get(key) & mask;
-		while (m_keys[pos].valid && pos != end_pos) ++pos;
-		if (pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid && pos != end_pos) ++pos;
+	u32 findEmptySlot(u32 hash) const {
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u32 empty = matchGroup(m_ctrl + pos, EMPTY);
+			if (empty) return (pos + firstBit(empty)) & m_mask;
+			pos = (pos + GROUP_SIZE) & m_mask;
 		}
-		return pos;
-	}
-
-	void rehash(u32 pos) {
-		Key& key = *((Key*)m_keys[pos].key_mem);
-		const u32 rehashed_pos = findEmptySlot(key, pos);
-		if (rehashed_pos != pos) {
-			new (NewPlaceholder(), m_keys[rehashed_pos].key_mem) Key(static_cast<Key&&>(key));
-			new (NewPlaceholder(), &m_values[rehashed_pos]) Value(static_cast<Value&&>(m_values[pos]));
-			
-			((Key*)m_keys[pos].key_mem)->~Key();
-			m_values[pos].~Value();
-			m_keys[pos].valid = false;
-			m_keys[rehashed_pos].valid = true;
+	}
+
+	void eraseAt(u32 pos) {
+		ASSERT(isFull(pos));
+		((Key*)m_keys[pos].key_mem)->~Key();
+		m_values[pos].~Value();
+		setCtrl(pos, EMPTY);
+		--m_size;
+
+		// shift back entries which would not be reachable anymore
+		u32 hole = pos;
+		pos = (pos + 1) & m_mask;
+		while (isFull(pos)) {
+			Key& key = *((Key*)m_keys[pos].key_mem);
+			const u32 home = Hasher::get(key) & m_mask;
+			// move if home is not in (hole, pos]
+			if (((pos - home) & m_mask) >= ((pos - hole) & m_mask)) {
+				new (NewPlaceholder(), m_keys[hole].key_mem) Key(static_cast<Key&&>(key));
+				new (NewPlaceholder(), &m_values[hole]) Value(static_cast<Value&&>(m_values[pos]));
+				key.~Key();
+				m_values[pos].~Value();
+				setCtrl(hole, m_ctrl[pos]);
+				setCtrl(pos, EMPTY);
+				hole = pos;
+			}
+			pos = (pos + 1) & m_mask;
 		}
 	}
 
 	u32 findPos(const Key& key) const {
-		u32 pos = Hasher::get(key) & m_mask;
+		const u32 hash = Hasher::get(key);
+		const u8 h2 = getH2(hash);
 		const Slot* LUMIX_RESTRICT keys = m_keys;
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
-		}
-		if (pos != m_capacity) return m_capacity;
-		pos = 0;
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
+		u32 pos = hash & m_mask;
+		for (;;) {
+			const u32 empty = matchGroup(m_ctrl + pos, EMPTY);
+			u32 match = matchGroup(m_ctrl + pos, h2);
+			// entries after the first empty slot belong to other chains
+			if (empty) match &= (empty & (0 - empty)) - 1;
+			while (match) {
+				const u32 i = (pos + firstBit(match)) & m_mask;
+				if (*((Key*)keys[i].key_mem) == key) return i;
+				match &= match - 1;
+			}
+			if (empty) return m_capacity;
+			pos = (pos + GROUP_SIZE) & m_mask;
 		}
-		return m_capacity;
 	}
 
-	void init(u32 capacity, bool all_invalid) {
+	void init(u32 capacity) {
 		ASSERT(isPowOfTwo(capacity));
+		capacity = maximum(capacity, (u32)GROUP_SIZE);
 		m_size = 0;
 		m_mask = capacity - 1;
-		m_keys = (Slot*)m_allocator.allocate(sizeof(Slot) * (capacity + 1));
+		m_ctrl = (u8*)m_allocator.allocate(capacity + GROUP_SIZE - 1);
+		m_keys = (Slot*)m_allocator.allocate(sizeof(Slot) * capacity);
 		m_values = (Value*)m_allocator.allocate(sizeof(Value) * capacity);
 		m_capacity = capacity;
-		if (all_invalid) {
-			for(u32 i = 0; i < capacity; ++i) {
-				m_keys[i].valid = false;
-			}
-		}
-		m_keys[capacity].valid = false;
+		memset(m_ctrl, EMPTY, capacity + GROUP_SIZE - 1);
 	}
 
 	IAllocator& m_allocator;
+	u8* m_ctrl;
 	Slot* m_keys;
 	Value* m_values;
 	u32 m_capacity;
@@ -4,9 +4,11 @@
 #include "engine/delegate.h"
 #include "engine/delegate_list.h"
 #include "engine/engine.h"
+#include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/profiler.h"
 #include "engine/math.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
@@ -28,14 +30,36 @@ struct KeyboardDevice : InputSystem::Device
 };
 
 
+static constexpr u32 INPUT_RECORDING_MAGIC = 0x5250494c; // == 'LIPR'
+
+
+enum class InputRecordingVersion : u32
+{
+	FIRST,
+
+	LATEST
+};
+
+
 struct InputSystemImpl final : InputSystem
 {
+	// devices are pointers, so they are recorded by type and index
+	struct RecordedEvent {
+		u32 frame;
+		Event::Type type;
+		Device::Type device_type;
+		u32 device_index;
+		Event::EventData data;
+	};
+
 	explicit InputSystemImpl(Engine& engine)
 		: m_engine(engine)
 		, m_allocator(engine.getAllocator())
 		, m_events(m_allocator)
 		, m_devices(m_allocator)
 		, m_to_remove(m_allocator)
+		, m_recorded_events(m_allocator)
+		, m_recorded_time_deltas(m_allocator)
 	{
 		m_mouse_device = LUMIX_NEW(m_allocator, MouseDevice);
 		m_mouse_device->type = Device::MOUSE;
@@ -94,10 +118,130 @@ struct InputSystemImpl final : InputSystem
 			LUMIX_DELETE(m_allocator, device);
 		}
 
+		if (m_recording) recordFrame(dt);
 		m_events.clear();
 
 		for (Device* device : m_devices) device->update(dt);
 		ControllerDevice::frame(dt);
+
+		if (m_replaying) {
+			++m_replay_frame;
+			if (m_replay_frame < (u32)m_recorded_time_deltas.size()) {
+				replayFrame();
+			}
+			else {
+				logInfo("Engine") << "Input replay finished after " << m_replay_frame << " frames";
+				stopReplay();
+			}
+		}
+	}
+
+
+	// m_events are what this frame consumed
+	void recordFrame(float dt)
+	{
+		const u32 frame = m_recorded_time_deltas.size();
+		m_recorded_time_deltas.push(dt);
+		for (const Event& event : m_events) {
+			if (event.type == Event::DEVICE_ADDED || event.type == Event::DEVICE_REMOVED) continue;
+			RecordedEvent& rec = m_recorded_events.emplace();
+			rec.frame = frame;
+			rec.type = event.type;
+			rec.device_type = event.device->type;
+			rec.device_index = event.device->index;
+			rec.data = event.data;
+		}
+	}
+
+
+	void replayFrame()
+	{
+		while (m_replay_event < (u32)m_recorded_events.size() && m_recorded_events[m_replay_event].frame == m_replay_frame) {
+			const RecordedEvent& rec = m_recorded_events[m_replay_event];
+			++m_replay_event;
+
+			Device* device = nullptr;
+			for (Device* d : m_devices) {
+				if (d->type == rec.device_type && d->index == rec.device_index) device = d;
+			}
+			// e.g. a controller which was connected while recording
+			if (!device) continue;
+
+			Event event;
+			event.type = rec.type;
+			event.device = device;
+			event.data = rec.data;
+			m_events.push(event);
+		}
+	}
+
+
+	void startRecording() override
+	{
+		stopReplay();
+		m_recorded_events.clear();
+		m_recorded_time_deltas.clear();
+		m_recording = true;
+	}
+
+
+	void stopRecording(OutputMemoryStream& blob) override
+	{
+		m_recording = false;
+		blob.write(INPUT_RECORDING_MAGIC);
+		blob.write(InputRecordingVersion::LATEST);
+		blob.write(m_recorded_time_deltas.size());
+		blob.write(m_recorded_time_deltas.begin(), m_recorded_time_deltas.byte_size());
+		blob.write(m_recorded_events.size());
+		blob.write(m_recorded_events.begin(), m_recorded_events.byte_size());
+	}
+
+
+	bool isRecording() const override { return m_recording; }
+
+
+	bool startReplay(InputMemoryStream& blob) override
+	{
+		stopReplay();
+		m_recording = false;
+		m_recorded_events.clear();
+		m_recorded_time_deltas.clear();
+
+		const u32 magic = blob.read<u32>();
+		const InputRecordingVersion version = blob.read<InputRecordingVersion>();
+		if (magic != INPUT_RECORDING_MAGIC || version > InputRecordingVersion::LATEST) {
+			logError("Engine") << "Unsupported input recording";
+			return false;
+		}
+		m_recorded_time_deltas.resize(blob.read<u32>());
+		blob.read(m_recorded_time_deltas.begin(), m_recorded_time_deltas.byte_size());
+		m_recorded_events.resize(blob.read<u32>());
+		if (!blob.read(m_recorded_events.begin(), m_recorded_events.byte_size())) {
+			logError("Engine") << "Corrupted input recording";
+			m_recorded_events.clear();
+			m_recorded_time_deltas.clear();
+			return false;
+		}
+		if (m_recorded_time_deltas.empty()) return false;
+
+		m_replaying = true;
+		m_replay_frame = 0;
+		m_replay_event = 0;
+		// events which came before replay started are not part of it
+		m_events.clear();
+		replayFrame();
+		return true;
+	}
+
+
+	void stopReplay() override { m_replaying = false; }
+	bool isReplaying() const override { return m_replaying; }
+	u32 getReplayFramesCount() const override { return m_recorded_time_deltas.size(); }
+
+	float getReplayTimeDelta() const override
+	{
+		ASSERT(m_replaying);
+		return m_recorded_time_deltas[m_replay_frame];
 	}
 
 
@@ -152,6 +296,7 @@ struct InputSystemImpl final : InputSystem
 	
 	void injectEvent(const Event& event) override
 	{
+		if (m_replaying && event.type != Event::DEVICE_ADDED && event.type != Event::DEVICE_REMOVED) return;
 		m_events.push(event);
 	}
 
@@ -171,6 +316,12 @@ struct InputSystemImpl final : InputSystem
 	Array<Event> m_events;
 	Array<Device*> m_devices;
 	Array<Device*> m_to_remove;
+	Array<RecordedEvent> m_recorded_events;
+	Array<float> m_recorded_time_deltas;
+	bool m_recording = false;
+	bool m_replaying = false;
+	u32 m_replay_frame = 0;
+	u32 m_replay_event = 0;
 };
 
 
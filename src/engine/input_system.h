@@ -94,6 +94,19 @@ struct LUMIX_ENGINE_API InputSystem
 	virtual void removeDevice(Device* device) = 0;
 	virtual int getDevicesCount() const = 0;
 	virtual Device* getDevice(int index) = 0;
+
+	// events are recorded with the frame they are consumed in and time delta of each frame,
+	// so replay reproduces the session if simulation does not depend on anything else
+	virtual void startRecording() = 0;
+	virtual void stopRecording(struct OutputMemoryStream& blob) = 0;
+	virtual bool isRecording() const = 0;
+	// real input is ignored while replaying, replay stops after the last recorded frame
+	virtual bool startReplay(struct InputMemoryStream& blob) = 0;
+	virtual void stopReplay() = 0;
+	virtual bool isReplaying() const = 0;
+	virtual u32 getReplayFramesCount() const = 0;
+	// time delta of the replayed frame, engine uses it instead of the real one
+	virtual float getReplayTimeDelta() const = 0;
 };
 
 
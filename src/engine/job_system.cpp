@@ -6,6 +6,8 @@
 #include "engine/allocator.h"
 #include "engine/log.h"
 #include "engine/math.h"
+#include "engine/os.h"
+#include "engine/string.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/profiler.h"
@@ -23,6 +25,15 @@ enum {
 	HANDLE_GENERATION_MASK = 0xffFF0000 
 };
 
+static constexpr u32 PRIORITY_COUNT = (u32)Priority::COUNT;
+static constexpr u32 SIGNALS_PAGE_SIZE = 4096;
+static constexpr u32 MAX_SIGNAL_PAGES = (HANDLE_ID_MASK + 1) / SIGNALS_PAGE_SIZE;
+static constexpr u32 FIBERS_PAGE_SIZE = 256;
+static constexpr u32 MAX_FIBER_PAGES = 64;
+static constexpr u32 FIBER_STACK_SIZE = 64 * 1024;
+static constexpr u32 MIN_SPIN_LIMIT = 16;
+static constexpr u32 MAX_SPIN_PAUSES = 64;
+
 
 struct Job
 {
@@ -31,6 +42,9 @@ struct Job
 	SignalHandle dec_on_finish;
 	SignalHandle precondition;
 	u8 worker_index;
+	Priority priority;
+	// when the job became runnable
+	u64 push_time;
 };
 
 
@@ -45,6 +59,60 @@ struct Signal {
 struct WorkerTask;
 
 
+// Chase-Lev deque, only the owning worker pushes and pops at the bottom, 
+// other workers steal from the top
+struct WorkStealingQueue
+{
+	enum { CAPACITY = 2048, MASK = CAPACITY - 1 };
+
+	bool push(const Job& job)
+	{
+		const i32 b = m_bottom;
+		const i32 t = m_top;
+		if (b - t >= CAPACITY) return false;
+		m_jobs[b & MASK] = job;
+		memoryBarrier();
+		m_bottom = b + 1;
+		return true;
+	}
+
+	bool pop(Job* job)
+	{
+		const i32 b = m_bottom - 1;
+		m_bottom = b;
+		memoryBarrier();
+		const i32 t = m_top;
+		if (t > b) {
+			m_bottom = b + 1;
+			return false;
+		}
+		*job = m_jobs[b & MASK];
+		if (t != b) return true;
+		
+		// last job, race with stealers
+		const bool res = compareAndExchange(&m_top, t + 1, t);
+		m_bottom = b + 1;
+		return res;
+	}
+
+	bool steal(Job* job)
+	{
+		const i32 t = m_top;
+		memoryBarrier();
+		const i32 b = m_bottom;
+		if (t >= b) return false;
+		*job = m_jobs[t & MASK];
+		return compareAndExchange(&m_top, t + 1, t);
+	}
+
+	bool empty() const { return m_bottom <= m_top; }
+
+	volatile i32 m_top = 0;
+	volatile i32 m_bottom = 0;
+	Job m_jobs[CAPACITY];
+};
+
+
 struct FiberDecl
 {
 	int idx;
@@ -63,20 +131,22 @@ struct System
 	System(IAllocator& allocator) 
 		: m_allocator(allocator)
 		, m_workers(allocator)
-		, m_job_queue(allocator)
+		, m_job_queues{Array<Job>(allocator), Array<Job>(allocator), Array<Job>(allocator)}
 		, m_ready_fibers(allocator)
-		, m_signals_pool(allocator)
 		, m_free_queue(allocator)
 		, m_free_fibers(allocator)
 		, m_backup_workers(allocator)
 	{
-		m_signals_pool.resize(4096);
-		m_free_queue.resize(4096);
-		for(int i = 0; i < 4096; ++i) {
-			m_free_queue[i] = i;
-			m_signals_pool[i].sibling = JobSystem::INVALID_HANDLE;
-			m_signals_pool[i].generation = 0;
-		}
+		m_signals_hwm_counter = Profiler::createCounter("Job system signals high water mark");
+		m_fibers_hwm_counter = Profiler::createCounter("Job system fibers high water mark");
+		m_busy_counter = Profiler::createCounter("Job system busy (%)");
+		m_steal_counter = Profiler::createCounter("Job system stealing (%)");
+		m_queue_depth_counter = Profiler::createCounter("Job system queue depth");
+		m_avg_latency_counter = Profiler::createCounter("Job latency avg (us)");
+		m_max_latency_counter = Profiler::createCounter("Job latency max (us)");
+		m_fiber_switches_counter = Profiler::createCounter("Job system fiber switches");
+		memset(&m_stats, 0, sizeof(m_stats));
+		m_stats_timestamp = OS::Timer::getRawTimestamp();
 	}
 
 
@@ -84,19 +154,117 @@ struct System
 	Mutex m_job_queue_sync;
 	Array<WorkerTask*> m_workers;
 	Array<WorkerTask*> m_backup_workers;
-	Array<Job> m_job_queue;
-	Array<Signal> m_signals_pool;
-	FiberDecl m_fiber_pool[512];
+	Array<Job> m_job_queues[PRIORITY_COUNT];
+	// pages are never reallocated, so live signals and fibers do not move
+	Signal* m_signal_pages[MAX_SIGNAL_PAGES] = {};
+	u32 m_signal_pages_count = 0;
+	FiberDecl* m_fiber_pages[MAX_FIBER_PAGES] = {};
+	u32 m_fiber_pages_count = 0;
 	Array<FiberDecl*> m_free_fibers;
 	Array<FiberDecl*> m_ready_fibers;
 	IAllocator& m_allocator;
 	Array<u32> m_free_queue;
+	// number of jobs and fibers in mutex-protected queues
+	volatile i32 m_locked_jobs_count[PRIORITY_COUNT] = {};
+	volatile i32 m_locked_fibers_count = 0;
+	volatile i32 m_sleeping_workers = 0;
+	u32 m_max_spins = 2048;
+	u32 m_signals_used = 0;
+	u32 m_signals_hwm = 0;
+	u32 m_fibers_used = 0;
+	u32 m_fibers_hwm = 0;
+	u32 m_signals_hwm_counter;
+	u32 m_fibers_hwm_counter;
+	u32 m_busy_counter;
+	u32 m_steal_counter;
+	u32 m_queue_depth_counter;
+	u32 m_avg_latency_counter;
+	u32 m_max_latency_counter;
+	u32 m_fiber_switches_counter;
+	// accessed only in updateStats and getStats
+	Stats m_stats;
+	u64 m_stats_timestamp;
 };
 
 
 static System* g_system = nullptr;
 static thread_local WorkerTask* g_worker = nullptr;
 
+
+static LUMIX_FORCE_INLINE Signal& getSignal(SignalHandle handle)
+{
+	const u32 id = handle & HANDLE_ID_MASK;
+	return g_system->m_signal_pages[id / SIGNALS_PAGE_SIZE][id % SIGNALS_PAGE_SIZE];
+}
+
+
+// call only with m_sync locked
+static void addSignalsPage()
+{
+	LUMIX_FATAL(g_system->m_signal_pages_count < MAX_SIGNAL_PAGES);
+	
+	const u32 first_id = g_system->m_signal_pages_count * SIGNALS_PAGE_SIZE;
+	Signal* page = (Signal*)g_system->m_allocator.allocate(sizeof(Signal) * SIGNALS_PAGE_SIZE);
+	g_system->m_free_queue.reserve(g_system->m_free_queue.size() + SIGNALS_PAGE_SIZE);
+	for (u32 i = 0; i < SIGNALS_PAGE_SIZE; ++i) {
+		Signal& signal = page[i];
+		signal.value = 0;
+		signal.generation = 0;
+		signal.next_job.task = nullptr;
+		signal.sibling = JobSystem::INVALID_HANDLE;
+		// in reverse, so lower ids are used first
+		g_system->m_free_queue.push(first_id + SIGNALS_PAGE_SIZE - 1 - i);
+	}
+	g_system->m_signal_pages[g_system->m_signal_pages_count] = page;
+	++g_system->m_signal_pages_count;
+}
+
+
+// call only with m_sync locked
+static void addFibersPage()
+{
+	LUMIX_FATAL(g_system->m_fiber_pages_count < MAX_FIBER_PAGES);
+	
+	const u32 first_idx = g_system->m_fiber_pages_count * FIBERS_PAGE_SIZE;
+	FiberDecl* page = (FiberDecl*)g_system->m_allocator.allocate(sizeof(FiberDecl) * FIBERS_PAGE_SIZE);
+	g_system->m_free_fibers.reserve(g_system->m_free_fibers.size() + FIBERS_PAGE_SIZE);
+	for (u32 i = 0; i < FIBERS_PAGE_SIZE; ++i) {
+		FiberDecl* decl = new (NewPlaceholder(), &page[FIBERS_PAGE_SIZE - 1 - i]) FiberDecl;
+		decl->idx = first_idx + FIBERS_PAGE_SIZE - 1 - i;
+		g_system->m_free_fibers.push(decl);
+	}
+	g_system->m_fiber_pages[g_system->m_fiber_pages_count] = page;
+	++g_system->m_fiber_pages_count;
+}
+
+
+// call only with m_sync locked
+static FiberDecl* popFreeFiber()
+{
+	if (g_system->m_free_fibers.empty()) addFibersPage();
+
+	FiberDecl* fiber = g_system->m_free_fibers.back();
+	g_system->m_free_fibers.pop();
+	if (!Fiber::isValid(fiber->fiber)) {
+		fiber->fiber = Fiber::create(FIBER_STACK_SIZE, manage, fiber);
+	}
+	
+	++g_system->m_fibers_used;
+	if (g_system->m_fibers_used > g_system->m_fibers_hwm) {
+		g_system->m_fibers_hwm = g_system->m_fibers_used;
+		Profiler::pushCounter(g_system->m_fibers_hwm_counter, (float)g_system->m_fibers_hwm);
+	}
+	return fiber;
+}
+
+
+// call only with m_sync locked
+static void pushFreeFiber(FiberDecl* fiber)
+{
+	--g_system->m_fibers_used;
+	g_system->m_free_fibers.push(fiber);
+}
+
 #pragma optimize( "", off )
 WorkerTask* getWorker()
 {
@@ -105,14 +273,27 @@ WorkerTask* getWorker()
 #pragma optimize( "", on )
 
 
+// raw timestamps and totals since init, written only by the worker's thread
+struct WorkerCounters
+{
+	u64 idle_time = 0;
+	u64 steal_time = 0;
+	u64 jobs = 0;
+	u64 stolen_jobs = 0;
+	u64 fiber_switches = 0;
+	u64 latency_sum = 0;
+};
+
+
 struct WorkerTask : Thread
 {
 	WorkerTask(System& system, u8 worker_index) 
 		: Thread(system.m_allocator)
 		, m_system(system)
 		, m_worker_index(worker_index)
-		, m_job_queue(system.m_allocator)
+		, m_job_queues{Array<Job>(system.m_allocator), Array<Job>(system.m_allocator), Array<Job>(system.m_allocator)}
 		, m_ready_fibers(system.m_allocator)
+		, m_rng(u32((uintptr)this >> 4) | 1)
 	{
 	}
 
@@ -133,11 +314,7 @@ struct WorkerTask : Thread
 	#endif
 	{
 		g_system->m_sync.enter();
-		FiberDecl* fiber = g_system->m_free_fibers.back();
-		g_system->m_free_fibers.pop();
-		if (!Fiber::isValid(fiber->fiber)) {
-			fiber->fiber = Fiber::create(64 * 1024, manage, fiber);
-		}
+		FiberDecl* fiber = popFreeFiber();
 		getWorker()->m_current_fiber = fiber;
 		Fiber::switchTo(&getWorker()->m_primary_fiber, fiber->fiber);
 	}
@@ -147,8 +324,21 @@ struct WorkerTask : Thread
 	FiberDecl* m_current_fiber = nullptr;
 	Fiber::Handle m_primary_fiber;
 	System& m_system;
-	Array<Job> m_job_queue;
+	Array<Job> m_job_queues[PRIORITY_COUNT];
 	Array<FiberDecl*> m_ready_fibers;
+	WorkStealingQueue m_work_stealing_queues[PRIORITY_COUNT];
+	u32 m_rng;
+	u32 m_spin_limit = MIN_SPIN_LIMIT;
+	// protected by m_job_queue_sync
+	bool m_is_sleeping = false;
+	u64 m_wakeup_timestamp = 0;
+	WorkerCounters m_counters;
+	// 0 if the worker is not idle
+	volatile u64 m_idle_start = 0;
+	// reset in updateStats
+	volatile u64 m_max_latency = 0;
+	// m_counters at the previous updateStats, including the unfinished idle time
+	WorkerCounters m_prev_counters;
 	u8 m_worker_index;
 	bool m_is_enabled = false;
 	bool m_is_backup = false;
@@ -157,53 +347,92 @@ struct WorkerTask : Thread
 
 static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
 {
-	LUMIX_FATAL(!g_system->m_free_queue.empty());
+	if (g_system->m_free_queue.empty()) addSignalsPage();
 
 	const u32 handle = g_system->m_free_queue.back();
-	Signal& w = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+	Signal& w = getSignal(handle);
 	w.value = 1;
 	w.sibling = JobSystem::INVALID_HANDLE;
 	w.next_job.task = nullptr;
 	g_system->m_free_queue.pop();
 
+	++g_system->m_signals_used;
+	if (g_system->m_signals_used > g_system->m_signals_hwm) {
+		g_system->m_signals_hwm = g_system->m_signals_used;
+		Profiler::pushCounter(g_system->m_signals_hwm_counter, (float)g_system->m_signals_hwm);
+	}
+
 	return (handle & HANDLE_ID_MASK) | w.generation;
 }
 
 
-static void pushJob(const Job& job)
+// call only with m_job_queue_sync locked
+static void wakeup(WorkerTask* worker)
 {
+	if (worker->m_is_sleeping && worker->m_wakeup_timestamp == 0) {
+		worker->m_wakeup_timestamp = OS::Timer::getRawTimestamp();
+	}
+	worker->wakeup();
+}
+
+
+// call only with m_job_queue_sync locked
+static void wakeupWorkers()
+{
+	for (WorkerTask* worker : g_system->m_workers) {
+		wakeup(worker);
+	}
+}
+
+
+static void pushJob(Job job)
+{
+	const u32 priority = (u32)job.priority;
+	job.push_time = OS::Timer::getRawTimestamp();
+	if (job.worker_index == ANY_WORKER) {
+		WorkerTask* worker = getWorker();
+		if (worker && !worker->m_is_backup && worker->m_work_stealing_queues[priority].push(job)) {
+			memoryBarrier();
+			if (g_system->m_sleeping_workers > 0) {
+				MutexGuard lock(g_system->m_job_queue_sync);
+				wakeupWorkers();
+			}
+			return;
+		}
+	}
+
+	MutexGuard lock(g_system->m_job_queue_sync);
+	atomicIncrement(&g_system->m_locked_jobs_count[priority]);
 	if (job.worker_index != ANY_WORKER) {
 		WorkerTask* worker = g_system->m_workers[job.worker_index % g_system->m_workers.size()];
-		worker->m_job_queue.push(job);
-		worker->wakeup();
+		worker->m_job_queues[priority].push(job);
+		wakeup(worker);
 		return;
 	}
-	g_system->m_job_queue.push(job);
-	for (WorkerTask* worker : g_system->m_workers) {
-		worker->wakeup();
-	}
+	g_system->m_job_queues[priority].push(job);
+	wakeupWorkers();
 }
 
 
 void trigger(SignalHandle handle)
 {
-	LUMIX_FATAL((handle & HANDLE_ID_MASK) < 4096);
-
 	MutexGuard lock(g_system->m_sync);
+
+	LUMIX_FATAL((handle & HANDLE_ID_MASK) < g_system->m_signal_pages_count * SIGNALS_PAGE_SIZE);
 	
-	Signal& counter = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+	Signal& counter = getSignal(handle);
 	--counter.value;
 	if (counter.value > 0) return;
 
 	SignalHandle iter = handle;
 	while (isValid(iter)) {
-		Signal& signal = g_system->m_signals_pool[iter & HANDLE_ID_MASK];
+		Signal& signal = getSignal(iter);
 		if(signal.next_job.task) {
-			MutexGuard queue_lock(g_system->m_job_queue_sync);
 			pushJob(signal.next_job);
 		}
 		signal.generation = (((signal.generation >> 16) + 1) & 0xffFF) << 16;
 		g_system->m_free_queue.push((iter & HANDLE_ID_MASK) | signal.generation);
+		--g_system->m_signals_used;
 		signal.next_job.task = nullptr;
 		iter = signal.sibling;
 	}
@@ -218,7 +447,7 @@ static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle, bool lock)
 	const u32 id = handle & HANDLE_ID_MASK;
 	
 	if (lock) g_system->m_sync.enter();
-	Signal& counter = g_system->m_signals_pool[id];
+	Signal& counter = getSignal(id);
 	bool is_zero = counter.generation != gen || counter.value == 0;
 	if (lock) g_system->m_sync.exit();
 	return is_zero;
@@ -230,19 +459,21 @@ static LUMIX_FORCE_INLINE void runInternal(void* data
 	, SignalHandle precondition
 	, bool do_lock
 	, SignalHandle* on_finish
-	, u8 worker_index)
+	, u8 worker_index
+	, Priority priority)
 {
 	Job j;
 	j.data = data;
 	j.task = task;
 	j.worker_index = worker_index != ANY_WORKER ? worker_index % getWorkersCount() : worker_index;
 	j.precondition = precondition;
+	j.priority = priority;
 
 	if (do_lock) g_system->m_sync.enter();
 	j.dec_on_finish = [&]() -> SignalHandle {
 		if (!on_finish) return INVALID_HANDLE;
 		if (isValid(*on_finish) && !isSignalZero(*on_finish, false)) {
-			++g_system->m_signals_pool[*on_finish & HANDLE_ID_MASK].value;
+			++getSignal(*on_finish).value;
 			return *on_finish;
 		}
 		return allocateSignal();
@@ -250,14 +481,13 @@ static LUMIX_FORCE_INLINE void runInternal(void* data
 	if (on_finish) *on_finish = j.dec_on_finish;
 
 	if (!isValid(precondition) || isSignalZero(precondition, false)) {
-		MutexGuard lock(g_system->m_job_queue_sync);
 		pushJob(j);
 	}
 	else {
-		Signal& counter = g_system->m_signals_pool[precondition & HANDLE_ID_MASK];
+		Signal& counter = getSignal(precondition);
 		if(counter.next_job.task) {
 			const SignalHandle ch = allocateSignal();
-			Signal& c = g_system->m_signals_pool[ch & HANDLE_ID_MASK];
+			Signal& c = getSignal(ch);
 			c.next_job = j;
 			c.sibling = counter.sibling;
 			counter.sibling = ch;
@@ -297,13 +527,106 @@ void enableBackupWorker(bool enable)
 
 
 
+void setIdleSpinLimit(u32 max_spins)
+{
+	g_system->m_max_spins = max_spins;
+}
+
+
+void updateStats()
+{
+	PROFILE_FUNCTION();
+	const u64 now = OS::Timer::getRawTimestamp();
+	const u64 interval = now - g_system->m_stats_timestamp;
+	if (interval == 0) return;
+	g_system->m_stats_timestamp = now;
+
+	static StaticString<32> busy_names[Stats::MAX_WORKERS];
+	static u32 busy_counters[Stats::MAX_WORKERS];
+	static u32 busy_counters_count = 0;
+
+	const double freq = (double)OS::Timer::getFrequency();
+	Stats& stats = g_system->m_stats;
+	stats.interval = float(interval / freq);
+	stats.workers_count = minimum(g_system->m_workers.size(), (u32)Stats::MAX_WORKERS);
+	
+	u64 jobs = 0;
+	u64 latency_sum = 0;
+	u64 max_latency = 0;
+	u64 busy_sum = 0;
+	u64 steal_sum = 0;
+	u32 fiber_switches = 0;
+	i32 queue_depth = 0;
+	for (u32 i = 0; i < (u32)g_system->m_workers.size(); ++i) {
+		WorkerTask* worker = g_system->m_workers[i];
+		for (const WorkStealingQueue& queue : worker->m_work_stealing_queues) {
+			queue_depth += maximum(queue.m_bottom - queue.m_top, 0);
+		}
+		if (i >= stats.workers_count) continue;
+
+		WorkerCounters counters = worker->m_counters;
+		const u64 idle_start = worker->m_idle_start;
+		if (idle_start != 0 && idle_start < now) counters.idle_time += now - idle_start;
+		const WorkerCounters& prev = worker->m_prev_counters;
+		const u64 idle = minimum(counters.idle_time > prev.idle_time ? counters.idle_time - prev.idle_time : 0, interval);
+		const u64 steal = minimum(counters.steal_time - prev.steal_time, interval - idle);
+		const u64 busy = interval - idle - steal;
+
+		WorkerStats& ws = stats.workers[i];
+		ws.busy_time = float(busy / freq);
+		ws.idle_time = float(idle / freq);
+		ws.steal_time = float(steal / freq);
+		ws.jobs = u32(counters.jobs - prev.jobs);
+		ws.stolen_jobs = u32(counters.stolen_jobs - prev.stolen_jobs);
+		ws.fiber_switches = u32(counters.fiber_switches - prev.fiber_switches);
+
+		jobs += ws.jobs;
+		latency_sum += counters.latency_sum - prev.latency_sum;
+		// the worker can write a bigger value before we reset it, such max is lost
+		max_latency = maximum(max_latency, (u64)worker->m_max_latency);
+		worker->m_max_latency = 0;
+		busy_sum += busy;
+		steal_sum += steal;
+		fiber_switches += ws.fiber_switches;
+		worker->m_prev_counters = counters;
+
+		if (i == busy_counters_count) {
+			busy_names[i] << "Worker " << i << " busy (%)";
+			busy_counters[i] = Profiler::createCounter(busy_names[i]);
+			++busy_counters_count;
+		}
+		Profiler::pushCounter(busy_counters[i], 100.f * ws.busy_time / stats.interval);
+	}
+	for (i32 c : g_system->m_locked_jobs_count) queue_depth += c;
+
+	stats.queue_depth = (u32)queue_depth;
+	stats.avg_job_latency = jobs > 0 ? float(latency_sum / freq / jobs) : 0;
+	stats.max_job_latency = float(max_latency / freq);
+
+	if (stats.workers_count == 0) return;
+	const float total = float(interval) * stats.workers_count;
+	Profiler::pushCounter(g_system->m_busy_counter, 100.f * busy_sum / total);
+	Profiler::pushCounter(g_system->m_steal_counter, 100.f * steal_sum / total);
+	Profiler::pushCounter(g_system->m_queue_depth_counter, (float)stats.queue_depth);
+	Profiler::pushCounter(g_system->m_avg_latency_counter, stats.avg_job_latency * 1'000'000.f);
+	Profiler::pushCounter(g_system->m_max_latency_counter, stats.max_job_latency * 1'000'000.f);
+	Profiler::pushCounter(g_system->m_fiber_switches_counter, (float)fiber_switches);
+}
+
+
+Stats getStats()
+{
+	return g_system->m_stats;
+}
+
+
 void incSignal(SignalHandle* signal)
 {
 	ASSERT(signal);
 	MutexGuard lock(g_system->m_sync);
 	
 	if (isValid(*signal) && !isSignalZero(*signal, false)) {
-		++g_system->m_signals_pool[*signal & HANDLE_ID_MASK].value;
+		++getSignal(*signal).value;
 	}
 	else {
 		*signal = allocateSignal();
@@ -319,13 +642,139 @@ void decSignal(SignalHandle signal)
 
 void run(void* data, void(*task)(void*), SignalHandle* on_finished)
 {
-	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER);
+	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER, Priority::NORMAL);
+}
+
+
+void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index, Priority priority)
+{
+	runInternal(data, task, precondition, true, on_finished, worker_index, priority);
 }
 
 
-void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index)
+// call only with m_job_queue_sync locked
+static bool popReadyFiber(WorkerTask* worker, FiberDecl** fiber)
 {
-	runInternal(data, task, precondition, true, on_finished, worker_index);
+	if (!worker->m_ready_fibers.empty()) {
+		*fiber = worker->m_ready_fibers.back();
+		worker->m_ready_fibers.pop();
+	}
+	else if (!g_system->m_ready_fibers.empty()) {
+		*fiber = g_system->m_ready_fibers.back();
+		g_system->m_ready_fibers.pop();
+	}
+	else {
+		return false;
+	}
+	atomicDecrement(&g_system->m_locked_fibers_count);
+	return true;
+}
+
+
+// call only with m_job_queue_sync locked
+static bool popLockedJob(WorkerTask* worker, u32 priority, Job* job)
+{
+	Array<Job>& worker_queue = worker->m_job_queues[priority];
+	Array<Job>& global_queue = g_system->m_job_queues[priority];
+	if (!worker_queue.empty()) {
+		*job = worker_queue.back();
+		worker_queue.pop();
+	}
+	else if (!global_queue.empty()) {
+		*job = global_queue.back();
+		global_queue.pop();
+	}
+	else {
+		return false;
+	}
+	atomicDecrement(&g_system->m_locked_jobs_count[priority]);
+	return true;
+}
+
+
+static bool steal(WorkerTask* worker, u32 priority, Job* job)
+{
+	const u32 count = g_system->m_workers.size();
+	// xorshift
+	worker->m_rng ^= worker->m_rng << 13;
+	worker->m_rng ^= worker->m_rng >> 17;
+	worker->m_rng ^= worker->m_rng << 5;
+	const u32 offset = worker->m_rng % count;
+	// scanning empty queues is cheap, so only actual steal attempts are timed
+	u64 start = 0;
+	bool res = false;
+	for (u32 i = 0; i < count; ++i) {
+		WorkerTask* victim = g_system->m_workers[(i + offset) % count];
+		if (victim == worker) continue;
+		WorkStealingQueue& queue = victim->m_work_stealing_queues[priority];
+		if (queue.empty()) continue;
+		if (start == 0) start = OS::Timer::getRawTimestamp();
+		if (queue.steal(job)) {
+			++worker->m_counters.stolen_jobs;
+			res = true;
+			break;
+		}
+	}
+	// time spent stealing while idle is already counted as idle
+	if (start != 0 && worker->m_idle_start == 0) {
+		worker->m_counters.steal_time += OS::Timer::getRawTimestamp() - start;
+	}
+	return res;
+}
+
+
+// ready fibers first, then jobs by priority, locked queues are checked only if they are not empty,
+// unless m_job_queue_sync is already locked by caller
+static bool popNext(WorkerTask* worker, FiberDecl** fiber, Job* job, bool is_locked)
+{
+	if (is_locked || g_system->m_locked_fibers_count > 0) {
+		if (!is_locked) g_system->m_job_queue_sync.enter();
+		const bool popped = popReadyFiber(worker, fiber);
+		if (!is_locked) g_system->m_job_queue_sync.exit();
+		if (popped) return true;
+	}
+
+	for (u32 priority = 0; priority < PRIORITY_COUNT; ++priority) {
+		if (is_locked || g_system->m_locked_jobs_count[priority] > 0) {
+			if (!is_locked) g_system->m_job_queue_sync.enter();
+			const bool popped = popLockedJob(worker, priority, job);
+			if (!is_locked) g_system->m_job_queue_sync.exit();
+			if (popped) return true;
+		}
+		if (worker->m_work_stealing_queues[priority].pop(job)) return true;
+		if (steal(worker, priority, job)) return true;
+	}
+	return false;
+}
+
+
+// busy-wait with exponential backoff before the worker goes to sleep,
+// spin limit grows if spinning finds work and shrinks if it does not
+static bool spin(WorkerTask* worker, FiberDecl** fiber, Job* job)
+{
+	const u32 max_spins = g_system->m_max_spins;
+	if (max_spins == 0) return false;
+
+	PROFILE_BLOCK("spinning");
+	Profiler::blockColor(0xff, 0x7f, 0xff);
+	const u32 limit = minimum(worker->m_spin_limit, max_spins);
+	u32 pauses = 1;
+	for (u32 i = 0; i < limit; ++i) {
+		if (i < limit / 2) {
+			for (u32 j = 0; j < pauses; ++j) cpuRelax();
+			pauses = minimum(pauses * 2, MAX_SPIN_PAUSES);
+		}
+		else {
+			OS::yield();
+		}
+
+		if (popNext(worker, fiber, job, false)) {
+			worker->m_spin_limit = minimum(limit * 2, max_spins);
+			return true;
+		}
+	}
+	worker->m_spin_limit = maximum(limit / 2, MIN_SPIN_LIMIT);
+	return false;
 }
 
 
@@ -355,42 +804,45 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 		FiberDecl* fiber = nullptr;
 		Job job;
 		while (!worker->m_finished) {
-			MutexGuard lock(g_system->m_job_queue_sync);
+			if (popNext(worker, &fiber, &job, false)) break;
+			if (worker->m_idle_start == 0) worker->m_idle_start = OS::Timer::getRawTimestamp();
+			if (spin(worker, &fiber, &job)) break;
 
-			if (!worker->m_ready_fibers.empty()) {
-				fiber = worker->m_ready_fibers.back();
-				worker->m_ready_fibers.pop();
-				break;
-			}
-			if (!worker->m_job_queue.empty()) {
-				job = worker->m_job_queue.back();
-				worker->m_job_queue.pop();
-				break;
-			}
-			if (!g_system->m_ready_fibers.empty()) {
-				fiber = g_system->m_ready_fibers.back();
-				g_system->m_ready_fibers.pop();
-				break;
-			}
-			if(!g_system->m_job_queue.empty()) {
-				job = g_system->m_job_queue.back();
-				g_system->m_job_queue.pop();
+			MutexGuard lock(g_system->m_job_queue_sync);
+			atomicIncrement(&g_system->m_sleeping_workers);
+			memoryBarrier();
+			// recheck, a job could be pushed before we increment m_sleeping_workers
+			if (popNext(worker, &fiber, &job, true)) {
+				atomicDecrement(&g_system->m_sleeping_workers);
 				break;
 			}
 
 			PROFILE_BLOCK("sleeping");
 			Profiler::blockColor(0xff, 0, 0xff);
+			worker->m_is_sleeping = true;
+			worker->m_wakeup_timestamp = 0;
 			worker->sleep(g_system->m_job_queue_sync);
+			worker->m_is_sleeping = false;
+			if (worker->m_wakeup_timestamp != 0) {
+				const u64 latency = OS::Timer::getRawTimestamp() - worker->m_wakeup_timestamp;
+				Profiler::pushInt("wake latency (us)", int(latency * 1'000'000 / OS::Timer::getFrequency()));
+			}
+			atomicDecrement(&g_system->m_sleeping_workers);
+		}
+		if (worker->m_idle_start != 0) {
+			worker->m_counters.idle_time += OS::Timer::getRawTimestamp() - worker->m_idle_start;
+			worker->m_idle_start = 0;
 		}
 		if (worker->m_finished) break;
 
 		if (fiber) {
 			Profiler::endBlock();
 			worker->m_current_fiber = fiber;
+			++worker->m_counters.fiber_switches;
 
 			g_system->m_sync.enter();
             LUMIX_FATAL(!this_fiber->current_job.task);
-			g_system->m_free_fibers.push(this_fiber);
+			pushFreeFiber(this_fiber);
 			Fiber::switchTo(&this_fiber->fiber, fiber->fiber);
 			g_system->m_sync.exit();
 
@@ -405,6 +857,11 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 			if (isValid(job.dec_on_finish) || isValid(job.precondition)) { //-V614
 				Profiler::pushJobInfo(job.dec_on_finish, job.precondition);
 			}
+			const u64 now = OS::Timer::getRawTimestamp();
+			const u64 latency = now > job.push_time ? now - job.push_time : 0;
+			++worker->m_counters.jobs;
+			worker->m_counters.latency_sum += latency;
+			if (latency > worker->m_max_latency) worker->m_max_latency = latency;
 			this_fiber->current_job = job;
 			job.task(job.data);
             this_fiber->current_job.task = nullptr;
@@ -428,16 +885,9 @@ bool init(u8 workers_count, IAllocator& allocator)
 
 	g_system = LUMIX_NEW(allocator, System)(allocator);
 
-	g_system->m_free_fibers.reserve(lengthOf(g_system->m_fiber_pool));
-	for (FiberDecl& fiber : g_system->m_fiber_pool) {
-		g_system->m_free_fibers.push(&fiber);
-	}
-
-	const int fiber_num = lengthOf(g_system->m_fiber_pool);
-	for(int i = 0; i < fiber_num; ++i) { 
-		FiberDecl& decl = g_system->m_fiber_pool[i];
-		decl.idx = i;
-	}
+	addSignalsPage();
+	addFibersPage();
+	addFibersPage();
 
 	int count = maximum(1, int(workers_count));
 	for (int i = 0; i < count; ++i) {
@@ -495,11 +945,19 @@ void shutdown()
 		LUMIX_DELETE(allocator, task);
 	}
 
-	for (FiberDecl& fiber : g_system->m_fiber_pool)
-	{
-		if(Fiber::isValid(fiber.fiber)) {
-			Fiber::destroy(fiber.fiber);
+	for (u32 i = 0; i < g_system->m_fiber_pages_count; ++i) {
+		FiberDecl* page = g_system->m_fiber_pages[i];
+		for (u32 j = 0; j < FIBERS_PAGE_SIZE; ++j) {
+			if(Fiber::isValid(page[j].fiber)) {
+				Fiber::destroy(page[j].fiber);
+			}
+			page[j].~FiberDecl();
 		}
+		allocator.deallocate(page);
+	}
+	
+	for (u32 i = 0; i < g_system->m_signal_pages_count; ++i) {
+		allocator.deallocate(g_system->m_signal_pages[i]);
 	}
 
 	LUMIX_DELETE(allocator, g_system);
@@ -523,25 +981,21 @@ void wait(SignalHandle handle)
 	runInternal(this_fiber, [](void* data){
 		MutexGuard lock(g_system->m_job_queue_sync);
 		FiberDecl* fiber = (FiberDecl*)data;
+		atomicIncrement(&g_system->m_locked_fibers_count);
 		if (fiber->current_job.worker_index == ANY_WORKER) {
 			g_system->m_ready_fibers.push(fiber);
-			for (WorkerTask* worker : g_system->m_workers) {
-				worker->wakeup();
-			}
+			wakeupWorkers();
 		}
 		else {
 			WorkerTask* worker = g_system->m_workers[fiber->current_job.worker_index % g_system->m_workers.size()];
 			worker->m_ready_fibers.push(fiber);
-			worker->wakeup();
+			wakeup(worker);
 		}
-	}, handle, false, nullptr, 0);
+	}, handle, false, nullptr, 0, Priority::HIGH);
 	
 	const Profiler::FiberSwitchData& switch_data = Profiler::beginFiberWait(handle);
-	FiberDecl* new_fiber = g_system->m_free_fibers.back();
-	g_system->m_free_fibers.pop();
-	if (!Fiber::isValid(new_fiber->fiber)) {
-		new_fiber->fiber = Fiber::create(64 * 1024, manage, new_fiber);
-	}
+	++getWorker()->m_counters.fiber_switches;
+	FiberDecl* new_fiber = popFreeFiber();
 	getWorker()->m_current_fiber = new_fiber;
 	Fiber::switchTo(&this_fiber->fiber, new_fiber->fiber);
 	getWorker()->m_current_fiber = this_fiber;
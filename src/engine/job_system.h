@@ -1,5 +1,6 @@
 #pragma once
 #include "lumix.h"
+#include "atomic.h"
 
 namespace Lumix {
 
@@ -11,17 +12,59 @@ using SignalHandle = u32;
 constexpr u8 ANY_WORKER = 0xff;
 constexpr u32 INVALID_HANDLE = 0xffFFffFF;
 
+// workers always drain higher priority jobs first
+enum class Priority : u8 {
+	HIGH,		// frame-critical work
+	NORMAL,
+	BACKGROUND,	// streaming, asset compilation, ...
+
+	COUNT
+};
+
 LUMIX_ENGINE_API bool init(u8 workers_count, IAllocator& allocator);
 LUMIX_ENGINE_API void shutdown();
 LUMIX_ENGINE_API u8 getWorkersCount();
 
 LUMIX_ENGINE_API void enableBackupWorker(bool enable);
+// idle workers spin up to `max_spins` times before they go to sleep, 0 disables spinning
+LUMIX_ENGINE_API void setIdleSpinLimit(u32 max_spins);
+
+struct WorkerStats {
+	// seconds
+	float busy_time;
+	float idle_time;
+	// looking for and stealing jobs from other workers while not idle
+	float steal_time;
+	u32 jobs;
+	u32 stolen_jobs;
+	u32 fiber_switches;
+};
+
+struct Stats {
+	enum { MAX_WORKERS = 64 };
+
+	// seconds since the previous updateStats
+	float interval;
+	u32 workers_count;
+	WorkerStats workers[MAX_WORKERS];
+	// jobs which can run but did not start yet, when updateStats was called
+	u32 queue_depth;
+	// seconds from the job becoming runnable to its start
+	float avg_job_latency;
+	float max_job_latency;
+};
+
+// measures the interval since the previous call and pushes it to Profiler counters, called in Engine::update
+// values are approximate, workers are not stopped while they are read
+LUMIX_ENGINE_API void updateStats();
+// the last interval measured by updateStats
+LUMIX_ENGINE_API Stats getStats();
 
 LUMIX_ENGINE_API void incSignal(SignalHandle* signal);
 LUMIX_ENGINE_API void decSignal(SignalHandle signal);
 
 LUMIX_ENGINE_API void run(void* data, void(*task)(void*), SignalHandle* on_finish);
-LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index);
+LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index, Priority priority = Priority::NORMAL);
 LUMIX_ENGINE_API void wait(SignalHandle waitable);
 LUMIX_ENGINE_API inline bool isValid(SignalHandle waitable) { return waitable != INVALID_HANDLE; }
 
@@ -39,6 +82,50 @@ void runOnWorkers(const F& f)
 }
 
 
+// calls f(from, to) on index ranges [from, to) of at most `step` items;
+// step == 0 picks a grain size so each worker gets a few ranges to balance the load
+template <typename F>
+void forEach(u32 count, u32 step, const F& f)
+{
+	if (count == 0) return;
+
+	const u32 workers_count = getWorkersCount();
+	if (step == 0) {
+		step = (count + workers_count * 4 - 1) / (workers_count * 4);
+	}
+	if (count <= step) {
+		f(0, count);
+		return;
+	}
+
+	struct Data {
+		const F* f;
+		volatile i32 offset = 0;
+		u32 count;
+		u32 step;
+	} data;
+	data.count = count;
+	data.step = step;
+	data.f = &f;
+	
+	const u32 ranges_count = (count + step - 1) / step;
+	const u32 jobs_count = ranges_count < workers_count ? ranges_count : workers_count;
+	SignalHandle signal = JobSystem::INVALID_HANDLE;
+	for(u32 i = 0; i < jobs_count; ++i) {
+		JobSystem::run(&data, [](void* ptr){
+			Data& data = *(Data*)ptr;
+			for(;;) {
+				const u32 from = (u32)atomicAdd(&data.offset, data.step);
+				if(from >= data.count) break;
+				const u32 to = from + data.step < data.count ? from + data.step : data.count;
+				(*data.f)(from, to);
+			}
+		}, &signal);
+	}
+	wait(signal);
+}
+
+
 template <typename F>
 void forEach(u32 count, const F& f)
 {
@@ -50,8 +137,10 @@ void forEach(u32 count, const F& f)
 	data.count = count;
 	data.f = &f;
 	
+	const u32 workers_count = getWorkersCount();
+	const u32 jobs_count = count < workers_count ? count : workers_count;
 	SignalHandle signal = JobSystem::INVALID_HANDLE;
-	for(u32 i = 0; i < count; ++i) {
+	for(u32 i = 0; i < jobs_count; ++i) {
 		JobSystem::run(&data, [](void* ptr){
 			Data& data = *(Data*)ptr;
 			for(;;) {
@@ -21,12 +21,22 @@ i32 atomicDecrement(i32 volatile* value)
 
 i32 atomicAdd(i32 volatile* addend, i32 value)
 {
-	return __sync_fetch_and_add(addend, value) + value;
+	return __sync_fetch_and_add(addend, value);
 }
 
 i32 atomicSubtract(i32 volatile* addend, i32 value)
 {
-	return __sync_fetch_and_sub(addend, value) - value;
+	return __sync_fetch_and_sub(addend, value);
+}
+
+i64 atomicAdd(i64 volatile* addend, i64 value)
+{
+	return __sync_fetch_and_add(addend, value);
+}
+
+i64 atomicSubtract(i64 volatile* addend, i64 value)
+{
+	return __sync_fetch_and_sub(addend, value);
 }
 
 bool compareAndExchange(i32 volatile* dest, i32 exchange, i32 comperand)
@@ -46,4 +56,10 @@ LUMIX_ENGINE_API void memoryBarrier()
 }
 
 
+LUMIX_ENGINE_API void cpuRelax()
+{
+	__builtin_ia32_pause();
+}
+
+
 } // namespace Lumix
@@ -11,10 +11,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/utsname.h>
@@ -78,7 +82,6 @@ void init() {
 
 	XInitThreads();
 	G.display = XOpenDisplay(nullptr);
-	G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
 
 	struct {
 		KeySym x11;
@@ -264,6 +267,10 @@ void init() {
 		s_keycode_names[(u8)m.lumix] = m.name;
 	}
 
+	// headless, e.g. dedicated server without X
+	if (!G.display) return;
+
+	G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
     G.net_wm_state_atom = XInternAtom(G.display, "_NET_WM_STATE", False);
     G.net_wm_state_maximized_horz_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_HORZ", False);
     G.net_wm_state_maximized_vert_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_VERT", False);
@@ -378,6 +385,115 @@ bool InputFile::seek(u64 pos)
 }
 
 
+MappedFile::MappedFile()
+	: m_data(nullptr)
+	, m_size(0)
+{}
+
+
+MappedFile::~MappedFile()
+{
+	ASSERT(!m_data);
+}
+
+
+bool MappedFile::open(const char* path)
+{
+	ASSERT(!m_data);
+	const int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	m_size = st.st_size;
+	// empty files can not be mapped
+	if (m_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (data == MAP_FAILED) {
+		m_size = 0;
+		return false;
+	}
+	m_data = (const u8*)data;
+	return true;
+}
+
+
+void MappedFile::close()
+{
+	if (m_data) munmap((void*)m_data, m_size);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+
+OutputSocket::OutputSocket()
+	: m_socket((u64)-1)
+	, m_is_error(false)
+{}
+
+
+OutputSocket::~OutputSocket()
+{
+	ASSERT(m_socket == (u64)-1);
+}
+
+
+bool OutputSocket::connect(const char* ip, u16 port)
+{
+	ASSERT(m_socket == (u64)-1);
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) return false;
+
+	const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return false;
+	if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+		::close(fd);
+		return false;
+	}
+	m_socket = (u64)fd;
+	m_is_error = false;
+	return true;
+}
+
+
+void OutputSocket::close()
+{
+	if (m_socket == (u64)-1) return;
+	::close((int)m_socket);
+	m_socket = (u64)-1;
+}
+
+
+bool OutputSocket::write(const void* data, u64 size)
+{
+	ASSERT(m_socket != (u64)-1);
+	const u8* ptr = (const u8*)data;
+	while (size > 0 && !m_is_error) {
+		// MSG_NOSIGNAL so a closed connection does not kill the process with SIGPIPE
+		const ssize_t sent = ::send((int)m_socket, ptr, size, MSG_NOSIGNAL);
+		if (sent <= 0) {
+			if (sent < 0 && errno == EINTR) continue;
+			m_is_error = true;
+			break;
+		}
+		ptr += sent;
+		size -= sent;
+	}
+	return !m_is_error;
+}
+
+
 OutputFile& OutputFile::operator <<(const char* text)
 {
 	write(text, stringLength(text));
@@ -422,6 +538,7 @@ OutputFile& OutputFile::operator <<(float value)
 
 u32 getCPUsCount() { return sysconf(_SC_NPROCESSORS_ONLN); }
 void sleep(u32 milliseconds) { if (milliseconds) usleep(useconds_t(milliseconds * 1000)); }
+void yield() { sched_yield(); }
 ThreadID getCurrentThreadID() { return pthread_self(); }
 
 void logVersion() {
@@ -906,6 +1023,34 @@ void memRelease(void* ptr) {
 	free(ptr);
 }
 
+size_t getLargeMemPageSize() {
+	return 2 * 1024 * 1024;
+}
+
+void* memReserveLarge(size_t size) {
+	const size_t page_size = getLargeMemPageSize();
+	ASSERT(size % page_size == 0);
+	// explicit huge pages, available only if the admin reserved some (vm.nr_hugepages)
+	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mem != MAP_FAILED) return mem;
+
+	// otherwise ask for transparent huge pages, they need an aligned range
+	u8* unaligned = (u8*)mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (unaligned == MAP_FAILED) return nullptr;
+	u8* aligned = (u8*)(((uintptr)unaligned + page_size - 1) & ~(uintptr)(page_size - 1));
+	if (aligned != unaligned) munmap(unaligned, aligned - unaligned);
+	munmap(aligned + size, unaligned + page_size - aligned);
+	if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+		munmap(aligned, size);
+		return nullptr;
+	}
+	return aligned;
+}
+
+void memReleaseLarge(void* ptr, size_t size) {
+	munmap(ptr, size);
+}
+
 struct FileIterator {};
 
 FileIterator* createFileIterator(const char* path, IAllocator& allocator)
@@ -930,6 +1075,10 @@ bool getNextFile(FileIterator* iterator, FileInfo* info)
 
 	info->is_directory = dir_ent->d_type == DT_DIR;
 	Lumix::copyString(info->filename, dir_ent->d_name);
+	struct stat tmp;
+	info->last_modified = fstatat(dirfd(dir), dir_ent->d_name, &tmp, 0) == 0
+		? tmp.st_mtim.tv_sec * 1000 + Lumix::u64(tmp.st_mtim.tv_nsec / 1000000)
+		: 0;
 	return true;
 }
 
@@ -1035,9 +1184,8 @@ bool dirExists(const char* path)
 u64 getLastModified(const char* path)
 {
 	struct stat tmp;
-	Lumix::u64 ret = 0;
-	ret = tmp.st_mtim.tv_sec * 1000 + Lumix::u64(tmp.st_mtim.tv_nsec / 1000000);
-	return ret;
+	if (stat(path, &tmp) != 0) return 0;
+	return tmp.st_mtim.tv_sec * 1000 + Lumix::u64(tmp.st_mtim.tv_nsec / 1000000);
 }
 
 
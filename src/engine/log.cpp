@@ -24,6 +24,7 @@ struct Logger {
 };
 
 static Logger g_logger;
+static LogLevel g_log_level = LogLevel::INFO;
 
 struct Log {
 	Log(LogLevel level) 
@@ -40,6 +41,8 @@ thread_local Log g_log_warning(LogLevel::WARNING);
 thread_local Log g_log_error(LogLevel::ERROR);
 
 LogCallback& getLogCallback() { return g_logger.callback; }
+void setLogLevel(LogLevel level) { g_log_level = level; }
+LogLevel getLogLevel() { return g_log_level; }
 LogProxy logInfo(const char* system) { return LogProxy(&g_log_info, system); }
 LogProxy logWarning(const char* system) { return LogProxy(&g_log_warning, system); }
 LogProxy logError(const char* system) { return LogProxy(&g_log_error, system); }
@@ -47,12 +50,13 @@ LogProxy logError(const char* system) { return LogProxy(&g_log_error, system); }
 
 LogProxy::LogProxy(Log* log, const char* system)
 	: system(system)
-	, log(log)
+	, log(log->level < g_log_level ? nullptr : log)
 {
 }
 
 LogProxy::~LogProxy()
 {
+	if (!log) return;
 	g_logger.callback.invoke(log->level, system, log->message.c_str());
 	log->message = "";
 }
@@ -60,43 +64,43 @@ LogProxy::~LogProxy()
 
 LogProxy& LogProxy::operator<<(const char* message)
 {
-	log->message.cat(message);
+	if (log) log->message.cat(message);
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(float message)
 {
-	log->message.cat(message);
+	if (log) log->message.cat(message);
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(u32 message)
 {
-	log->message.cat(message);
+	if (log) log->message.cat(message);
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(u64 message)
 {
-	log->message.cat(message);
+	if (log) log->message.cat(message);
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(i32 message)
 {
-	log->message.cat(message);
+	if (log) log->message.cat(message);
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(const String& path)
 {
-	log->message.cat(path.c_str());
+	if (log) log->message.cat(path.c_str());
 	return *this;
 }
 
 LogProxy& LogProxy::operator<<(const Path& path)
 {
-	log->message.cat(path.c_str());
+	if (log) log->message.cat(path.c_str());
 	return *this;
 }
 
@@ -55,6 +55,9 @@ LUMIX_ENGINE_API LogProxy logInfo(const char* system);
 LUMIX_ENGINE_API LogProxy logWarning(const char* system);
 LUMIX_ENGINE_API LogProxy logError(const char* system);
 LUMIX_ENGINE_API LogCallback& getLogCallback();
+// messages with lower level are dropped before they are formatted
+LUMIX_ENGINE_API void setLogLevel(LogLevel level);
+LUMIX_ENGINE_API LogLevel getLogLevel();
 
 
 } // namespace Lumix
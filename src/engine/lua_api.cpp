@@ -771,6 +771,14 @@ static Vec3 LUA_getEntityDirection(Universe* universe, EntityRef entity)
 }
 
 static void LUA_setEntityPosition(Universe* univ, EntityRef entity, const DVec3& pos) { univ->setPosition(entity, pos); }
+
+// called through LuaJIT FFI, see Lumix.FFI, there is no lua stack involved
+static void FFI_getEntityPosition(Universe* univ, i32 entity, DVec3* out) { *out = univ->getPosition({entity}); }
+static void FFI_setEntityPosition(Universe* univ, i32 entity, double x, double y, double z) { univ->setPosition({entity}, DVec3(x, y, z)); }
+static void FFI_getEntityRotation(Universe* univ, i32 entity, Quat* out) { *out = univ->getRotation({entity}); }
+static void FFI_setEntityRotation(Universe* univ, i32 entity, float x, float y, float z, float w) { univ->setRotation({entity}, x, y, z, w); }
+static float FFI_getEntityScale(Universe* univ, i32 entity) { return univ->getScale({entity}); }
+static void FFI_setEntityScale(Universe* univ, i32 entity, float scale) { univ->setScale({entity}, scale); }
 static float LUA_getLastTimeDelta(Engine* engine) { return engine->getLastTimeDelta(); }
 static void LUA_unloadResource(Engine* engine, int resource_idx) { engine->unloadLuaResource(resource_idx); }
 static Universe* LUA_createUniverse(Engine* engine) { return &engine->createUniverse(false); }
@@ -924,6 +932,18 @@ void registerEngineAPI(lua_State* L, Engine* engine)
 
 	LuaWrapper::createSystemFunction(L, "LumixAPI", "loadUniverse", LUA_loadUniverse);
 
+	#define REGISTER_FFI_FUNCTION(name) \
+		LuaWrapper::createSystemVariable(L, "LumixAPI", "ffi_" #name, (void*)&FFI_##name)
+
+	REGISTER_FFI_FUNCTION(getEntityPosition);
+	REGISTER_FFI_FUNCTION(setEntityPosition);
+	REGISTER_FFI_FUNCTION(getEntityRotation);
+	REGISTER_FFI_FUNCTION(setEntityRotation);
+	REGISTER_FFI_FUNCTION(getEntityScale);
+	REGISTER_FFI_FUNCTION(setEntityScale);
+
+	#undef REGISTER_FFI_FUNCTION
+
 	#undef REGISTER_FUNCTION
 
 	#define REGISTER_FUNCTION(F) \
@@ -1119,6 +1139,35 @@ void registerEngineAPI(lua_State* L, Engine* engine)
 			end
 			return ent
 		end
+
+		-- direct calls for hot loops, universe is the lightuserdata in Entity._universe
+		-- getters return cdata, fields can be read without creating lua tables
+		local has_ffi, ffi = pcall(require, "ffi")
+		if has_ffi then
+			ffi.cdef[[
+				typedef struct { float x, y, z; } LumixVec3;
+				typedef struct { double x, y, z; } LumixDVec3;
+				typedef struct { float x, y, z, w; } LumixQuat;
+			]]
+			local getEntityPosition = ffi.cast("void (*)(void*, int, LumixDVec3*)", LumixAPI.ffi_getEntityPosition)
+			local getEntityRotation = ffi.cast("void (*)(void*, int, LumixQuat*)", LumixAPI.ffi_getEntityRotation)
+			Lumix.FFI = {
+				setEntityPosition = ffi.cast("void (*)(void*, int, double, double, double)", LumixAPI.ffi_setEntityPosition),
+				setEntityRotation = ffi.cast("void (*)(void*, int, float, float, float, float)", LumixAPI.ffi_setEntityRotation),
+				getEntityScale = ffi.cast("float (*)(void*, int)", LumixAPI.ffi_getEntityScale),
+				setEntityScale = ffi.cast("void (*)(void*, int, float)", LumixAPI.ffi_setEntityScale)
+			}
+			function Lumix.FFI.getEntityPosition(universe, entity)
+				local res = ffi.new("LumixDVec3")
+				getEntityPosition(universe, entity, res)
+				return res
+			end
+			function Lumix.FFI.getEntityRotation(universe, entity)
+				local res = ffi.new("LumixQuat")
+				getEntityRotation(universe, entity, res)
+				return res
+			end
+		end
 	)#";
 
 	#define TO_STR_HELPER(x) #x
@@ -78,9 +78,13 @@ struct EntityRef
 	operator EntityPtr() const { return {index}; }
 };
 
+#ifndef LUMIX_MAX_COMPONENT_TYPES
+	#define LUMIX_MAX_COMPONENT_TYPES 128
+#endif
+
 struct ComponentType
 {
-	enum { MAX_TYPES_COUNT = 64 };
+	enum { MAX_TYPES_COUNT = LUMIX_MAX_COMPONENT_TYPES };
 
 	int index;
 	bool operator==(const ComponentType& rhs) const { return rhs.index == index; }
@@ -89,6 +93,82 @@ struct ComponentType
 	bool operator!=(const ComponentType& rhs) const { return rhs.index != index; }
 };
 const ComponentType INVALID_COMPONENT_TYPE = {-1};
+
+// bit i is set for component type with index i
+struct ComponentMask
+{
+	static_assert(ComponentType::MAX_TYPES_COUNT % 64 == 0, "LUMIX_MAX_COMPONENT_TYPES must be multiple of 64");
+	enum { WORDS_COUNT = ComponentType::MAX_TYPES_COUNT / 64 };
+
+	static ComponentMask all() {
+		ComponentMask res;
+		for (u64& w : res.words) w = ~u64(0);
+		return res;
+	}
+
+	static ComponentMask of(ComponentType type) {
+		ComponentMask res = {};
+		res.add(type);
+		return res;
+	}
+
+	void add(ComponentType type) { words[type.index >> 6] |= u64(1) << (type.index & 63); }
+	void remove(ComponentType type) { words[type.index >> 6] &= ~(u64(1) << (type.index & 63)); }
+	bool has(ComponentType type) const { return (words[type.index >> 6] & (u64(1) << (type.index & 63))) != 0; }
+
+	bool intersects(const ComponentMask& rhs) const {
+		u64 res = 0;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res |= words[i] & rhs.words[i];
+		return res != 0;
+	}
+
+	bool contains(const ComponentMask& rhs) const {
+		u64 res = 0;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res |= rhs.words[i] & ~words[i];
+		return res == 0;
+	}
+
+	bool isEmpty() const {
+		u64 res = 0;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res |= words[i];
+		return res == 0;
+	}
+
+	// index of the first set bit >= `from`, -1 if there is none
+	int next(int from) const {
+		for (int i = from; i < ComponentType::MAX_TYPES_COUNT; ++i) {
+			const u64 word = words[i >> 6] >> (i & 63);
+			if (word == 0) {
+				i |= 63;
+				continue;
+			}
+			if (word & 1) return i;
+		}
+		return -1;
+	}
+
+	ComponentMask operator|(const ComponentMask& rhs) const {
+		ComponentMask res;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res.words[i] = words[i] | rhs.words[i];
+		return res;
+	}
+
+	ComponentMask operator&(const ComponentMask& rhs) const {
+		ComponentMask res;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res.words[i] = words[i] & rhs.words[i];
+		return res;
+	}
+
+	bool operator==(const ComponentMask& rhs) const {
+		u64 res = 0;
+		for (u32 i = 0; i < WORDS_COUNT; ++i) res |= words[i] ^ rhs.words[i];
+		return res == 0;
+	}
+
+	bool operator!=(const ComponentMask& rhs) const { return !(*this == rhs); }
+
+	u64 words[WORDS_COUNT];
+};
 const EntityPtr INVALID_ENTITY = {-1};
 
 template <typename T, u32 count> constexpr u32 lengthOf(const T (&)[count])
@@ -0,0 +1,163 @@
+#include "engine/crt.h"
+#include "engine/lz4.h"
+
+
+namespace Lumix
+{
+
+
+static constexpr u32 MIN_MATCH = 4;
+// the last match must start at least 12 bytes before the end of block
+static constexpr u32 MF_LIMIT = 12;
+// the last 5 bytes are always literals
+static constexpr u32 LAST_LITERALS = 5;
+static constexpr u32 MAX_DISTANCE = 0xffFF;
+static constexpr u32 HASH_BITS = 12;
+
+
+static u32 read32(const u8* ptr)
+{
+	u32 res;
+	memcpy(&res, ptr, sizeof(res));
+	return res;
+}
+
+
+static bool writeLength(u8*& op, const u8* op_end, u32 len)
+{
+	while (len >= 255) {
+		if (op >= op_end) return false;
+		*op++ = 255;
+		len -= 255;
+	}
+	if (op >= op_end) return false;
+	*op++ = (u8)len;
+	return true;
+}
+
+
+static bool writeLiterals(u8*& op, const u8* op_end, const u8* literals, u32 count, u32 match_len)
+{
+	if (op >= op_end) return false;
+	u8* token = op++;
+	*token = u8((count < 15 ? count : 15) << 4);
+	if (count >= 15 && !writeLength(op, op_end, count - 15)) return false;
+	if (count > u32(op_end - op)) return false;
+	if (count > 0) memcpy(op, literals, count);
+	op += count;
+	if (match_len != 0xffFFffFF) *token |= match_len < 15 ? match_len : 15;
+	return true;
+}
+
+
+u32 lz4CompressBound(u32 size)
+{
+	return size + size / 255 + 16;
+}
+
+
+u32 lz4Compress(const u8* src, u32 src_size, u8* dst, u32 dst_capacity)
+{
+	const u8* ip = src;
+	const u8* anchor = src;
+	const u8* end = src + src_size;
+	u8* op = dst;
+	const u8* op_end = dst + dst_capacity;
+
+	if (src_size > MF_LIMIT) {
+		u32 table[1 << HASH_BITS];
+		memset(table, 0xff, sizeof(table));
+
+		const u8* match_limit = end - MF_LIMIT;
+		const u8* match_end_limit = end - LAST_LITERALS;
+		while (ip < match_limit) {
+			const u32 seq = read32(ip);
+			const u32 h = (seq * 2654435761u) >> (32 - HASH_BITS);
+			const u32 ref_pos = table[h];
+			table[h] = u32(ip - src);
+			if (ref_pos == 0xffFFffFF || u32(ip - src) - ref_pos > MAX_DISTANCE || read32(src + ref_pos) != seq) {
+				++ip;
+				continue;
+			}
+
+			const u8* ref = src + ref_pos;
+			const u8* match_end = ip + MIN_MATCH;
+			ref += MIN_MATCH;
+			while (match_end < match_end_limit && *match_end == *ref) {
+				++match_end;
+				++ref;
+			}
+
+			const u32 match_len = u32(match_end - ip) - MIN_MATCH;
+			const u32 offset = u32(ip - src) - ref_pos;
+			if (!writeLiterals(op, op_end, anchor, u32(ip - anchor), match_len)) return 0;
+			if (op_end - op < 2) return 0;
+			*op++ = u8(offset);
+			*op++ = u8(offset >> 8);
+			if (match_len >= 15 && !writeLength(op, op_end, match_len - 15)) return 0;
+
+			ip = match_end;
+			anchor = ip;
+		}
+	}
+
+	if (!writeLiterals(op, op_end, anchor, u32(end - anchor), 0xffFFffFF)) return 0;
+	return u32(op - dst);
+}
+
+
+bool lz4Decompress(const u8* src, u32 src_size, u8* dst, u32 dst_size)
+{
+	const u8* ip = src;
+	const u8* ip_end = src + src_size;
+	u8* op = dst;
+	u8* op_end = dst + dst_size;
+
+	auto readLength = [&](u32& len) {
+		u8 b;
+		do {
+			if (ip >= ip_end) return false;
+			b = *ip++;
+			len += b;
+		} while (b == 255);
+		return true;
+	};
+
+	for (;;) {
+		if (ip >= ip_end) return false;
+		const u8 token = *ip++;
+
+		u32 literals = token >> 4;
+		if (literals == 15 && !readLength(literals)) return false;
+		if (literals > u32(ip_end - ip) || literals > u32(op_end - op)) return false;
+		if (literals > 0) memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+
+		// last sequence has only literals
+		if (ip == ip_end) return op == op_end;
+
+		if (ip_end - ip < 2) return false;
+		const u32 offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > u32(op - dst)) return false;
+
+		u32 len = token & 15;
+		if (len == 15 && !readLength(len)) return false;
+		len += MIN_MATCH;
+		if (len > u32(op_end - op)) return false;
+
+		const u8* match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+		}
+		else {
+			// overlapping match repeats the last `offset` bytes
+			for (u32 i = 0; i < len; ++i) op[i] = match[i];
+		}
+		op += len;
+	}
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,19 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// LZ4 block format, compatible with the reference implementation
+LUMIX_ENGINE_API u32 lz4CompressBound(u32 size);
+// returns compressed size or 0 if `dst_capacity` is not enough
+LUMIX_ENGINE_API u32 lz4Compress(const u8* src, u32 src_size, u8* dst, u32 dst_capacity);
+// `dst_size` must be exactly the decompressed size, returns false on corrupted data
+LUMIX_ENGINE_API bool lz4Decompress(const u8* src, u32 src_size, u8* dst, u32 dst_size);
+
+
+} // namespace Lumix
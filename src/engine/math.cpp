@@ -1004,4 +1004,193 @@ float randFloat(float from, float to)
 }
 
 
+namespace {
+
+// four items, component per register
+struct Vec3x4 { float4 x, y, z; };
+struct Quatx4 { float4 x, y, z, w; };
+
+
+LUMIX_FORCE_INLINE Vec3x4 loadVec3x4(const Vec3* v)
+{
+	alignas(16) float x[4], y[4], z[4];
+	for (u32 i = 0; i < 4; ++i) {
+		x[i] = v[i].x;
+		y[i] = v[i].y;
+		z[i] = v[i].z;
+	}
+	return {f4Load(x), f4Load(y), f4Load(z)};
+}
+
+
+LUMIX_FORCE_INLINE void storeVec3x4(Vec3* v, const Vec3x4& src)
+{
+	alignas(16) float x[4], y[4], z[4];
+	f4Store(x, src.x);
+	f4Store(y, src.y);
+	f4Store(z, src.z);
+	for (u32 i = 0; i < 4; ++i) v[i] = Vec3(x[i], y[i], z[i]);
+}
+
+
+LUMIX_FORCE_INLINE Quatx4 loadQuatx4(const Quat* q)
+{
+	Quatx4 res;
+	res.x = f4LoadUnaligned(&q[0]);
+	res.y = f4LoadUnaligned(&q[1]);
+	res.z = f4LoadUnaligned(&q[2]);
+	res.w = f4LoadUnaligned(&q[3]);
+	f4Transpose(res.x, res.y, res.z, res.w);
+	return res;
+}
+
+
+LUMIX_FORCE_INLINE void storeQuatx4(Quat* q, Quatx4 src)
+{
+	f4Transpose(src.x, src.y, src.z, src.w);
+	f4StoreUnaligned(&q[0], src.x);
+	f4StoreUnaligned(&q[1], src.y);
+	f4StoreUnaligned(&q[2], src.z);
+	f4StoreUnaligned(&q[3], src.w);
+}
+
+
+LUMIX_FORCE_INLINE Vec3x4 cross(const Vec3x4& a, const Vec3x4& b)
+{
+	return {
+		f4Sub(f4Mul(a.y, b.z), f4Mul(a.z, b.y)),
+		f4Sub(f4Mul(a.z, b.x), f4Mul(a.x, b.z)),
+		f4Sub(f4Mul(a.x, b.y), f4Mul(a.y, b.x))
+	};
+}
+
+
+// same as Quat::rotate
+LUMIX_FORCE_INLINE Vec3x4 rotate(const Quatx4& q, const Vec3x4& v)
+{
+	const Vec3x4 qvec = {q.x, q.y, q.z};
+	const Vec3x4 uv = cross(qvec, v);
+	const Vec3x4 uuv = cross(qvec, uv);
+	const float4 two = f4Splat(2);
+	const float4 w2 = f4Mul(q.w, two);
+	return {
+		f4Add(v.x, f4Add(f4Mul(uv.x, w2), f4Mul(uuv.x, two))),
+		f4Add(v.y, f4Add(f4Mul(uv.y, w2), f4Mul(uuv.y, two))),
+		f4Add(v.z, f4Add(f4Mul(uv.z, w2), f4Mul(uuv.z, two)))
+	};
+}
+
+
+// same as Quat::operator*
+LUMIX_FORCE_INLINE Quatx4 multiply(const Quatx4& a, const Quatx4& b)
+{
+	Quatx4 res;
+	res.x = f4Add(f4Add(f4Mul(a.w, b.x), f4Mul(b.w, a.x)), f4Sub(f4Mul(a.y, b.z), f4Mul(b.y, a.z)));
+	res.y = f4Add(f4Add(f4Mul(a.w, b.y), f4Mul(b.w, a.y)), f4Sub(f4Mul(a.z, b.x), f4Mul(b.z, a.x)));
+	res.z = f4Add(f4Add(f4Mul(a.w, b.z), f4Mul(b.w, a.z)), f4Sub(f4Mul(a.x, b.y), f4Mul(b.x, a.y)));
+	res.w = f4Sub(f4Sub(f4Mul(a.w, b.w), f4Mul(a.x, b.x)), f4Add(f4Mul(a.y, b.y), f4Mul(a.z, b.z)));
+	return res;
+}
+
+} // anonymous namespace
+
+
+void quatRotateBatch(const Quat* rots, const Vec3* vecs, Vec3* out, u32 count)
+{
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		storeVec3x4(out + i, rotate(loadQuatx4(rots + i), loadVec3x4(vecs + i)));
+	}
+	for (; i < count; ++i) out[i] = rots[i].rotate(vecs[i]);
+}
+
+
+void transformPoints(const Matrix& mtx, const Vec3* points, Vec3* out, u32 count)
+{
+	const float4 m11 = f4Splat(mtx.m11), m12 = f4Splat(mtx.m12), m13 = f4Splat(mtx.m13);
+	const float4 m21 = f4Splat(mtx.m21), m22 = f4Splat(mtx.m22), m23 = f4Splat(mtx.m23);
+	const float4 m31 = f4Splat(mtx.m31), m32 = f4Splat(mtx.m32), m33 = f4Splat(mtx.m33);
+	const float4 m41 = f4Splat(mtx.m41), m42 = f4Splat(mtx.m42), m43 = f4Splat(mtx.m43);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const Vec3x4 p = loadVec3x4(points + i);
+		const Vec3x4 res = {
+			f4Add(f4Add(f4Mul(m11, p.x), f4Mul(m21, p.y)), f4Add(f4Mul(m31, p.z), m41)),
+			f4Add(f4Add(f4Mul(m12, p.x), f4Mul(m22, p.y)), f4Add(f4Mul(m32, p.z), m42)),
+			f4Add(f4Add(f4Mul(m13, p.x), f4Mul(m23, p.y)), f4Add(f4Mul(m33, p.z), m43))
+		};
+		storeVec3x4(out + i, res);
+	}
+	for (; i < count; ++i) out[i] = mtx.transformPoint(points[i]);
+}
+
+
+void multiplyTransforms(const Vec3* a_pos,
+	const Quat* a_rot,
+	const Vec3* b_pos,
+	const Quat* b_rot,
+	Vec3* out_pos,
+	Quat* out_rot,
+	u32 count)
+{
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const Quatx4 ar = loadQuatx4(a_rot + i);
+		const Vec3x4 ap = loadVec3x4(a_pos + i);
+		const Vec3x4 rotated = rotate(ar, loadVec3x4(b_pos + i));
+		storeVec3x4(out_pos + i, {f4Add(rotated.x, ap.x), f4Add(rotated.y, ap.y), f4Add(rotated.z, ap.z)});
+		storeQuatx4(out_rot + i, multiply(ar, loadQuatx4(b_rot + i)));
+	}
+	for (; i < count; ++i) {
+		out_pos[i] = a_rot[i].rotate(b_pos[i]) + a_pos[i];
+		out_rot[i] = a_rot[i] * b_rot[i];
+	}
+}
+
+
+void toMatrices(const Vec3* pos, const Quat* rot, Vec4* out_rows, u32 count)
+{
+	u32 i = 0;
+	const float4 one = f4Splat(1);
+	for (; i + 4 <= count; i += 4) {
+		const Quatx4 q = loadQuatx4(rot + i);
+		const Vec3x4 p = loadVec3x4(pos + i);
+		// same as Quat::toMatrix
+		const float4 fx = f4Add(q.x, q.x);
+		const float4 fy = f4Add(q.y, q.y);
+		const float4 fz = f4Add(q.z, q.z);
+		const float4 fwx = f4Mul(fx, q.w);
+		const float4 fwy = f4Mul(fy, q.w);
+		const float4 fwz = f4Mul(fz, q.w);
+		const float4 fxx = f4Mul(fx, q.x);
+		const float4 fxy = f4Mul(fy, q.x);
+		const float4 fxz = f4Mul(fz, q.x);
+		const float4 fyy = f4Mul(fy, q.y);
+		const float4 fyz = f4Mul(fz, q.y);
+		const float4 fzz = f4Mul(fz, q.z);
+
+		// row per register after transpose
+		float4 r0[4] = { f4Sub(one, f4Add(fyy, fzz)), f4Sub(fxy, fwz), f4Add(fxz, fwy), p.x };
+		float4 r1[4] = { f4Add(fxy, fwz), f4Sub(one, f4Add(fxx, fzz)), f4Sub(fyz, fwx), p.y };
+		float4 r2[4] = { f4Sub(fxz, fwy), f4Add(fyz, fwx), f4Sub(one, f4Add(fxx, fyy)), p.z };
+		f4Transpose(r0[0], r0[1], r0[2], r0[3]);
+		f4Transpose(r1[0], r1[1], r1[2], r1[3]);
+		f4Transpose(r2[0], r2[1], r2[2], r2[3]);
+		for (u32 j = 0; j < 4; ++j) {
+			Vec4* rows = out_rows + (i + j) * 3;
+			f4StoreUnaligned(&rows[0], r0[j]);
+			f4StoreUnaligned(&rows[1], r1[j]);
+			f4StoreUnaligned(&rows[2], r2[j]);
+		}
+	}
+	for (; i < count; ++i) {
+		const Matrix m(pos[i], rot[i]);
+		Vec4* rows = out_rows + i * 3;
+		rows[0] = Vec4(m.m11, m.m21, m.m31, m.m41);
+		rows[1] = Vec4(m.m12, m.m22, m.m32, m.m42);
+		rows[2] = Vec4(m.m13, m.m23, m.m33, m.m43);
+	}
+}
+
+
 } // namespace Lumix
\ No newline at end of file
@@ -1093,6 +1093,24 @@ LUMIX_ENGINE_API bool getSphereTriangleIntersection(const Vec3& center,
 	const Vec3& v2);
 
 
+// batched versions of single object operations, SIMD processes four items at once
+// inputs and outputs are arrays of `count` items, outputs must not overlap inputs
+// out[i] = rots[i].rotate(vecs[i])
+LUMIX_ENGINE_API void quatRotateBatch(const Quat* rots, const Vec3* vecs, Vec3* out, u32 count);
+// out[i] = mtx.transformPoint(points[i])
+LUMIX_ENGINE_API void transformPoints(const Matrix& mtx, const Vec3* points, Vec3* out, u32 count);
+// same as LocalRigidTransform::operator*, transforms are split into positions and rotations, e.g. Pose
+LUMIX_ENGINE_API void multiplyTransforms(const Vec3* a_pos,
+	const Quat* a_rot,
+	const Vec3* b_pos,
+	const Quat* b_rot,
+	Vec3* out_pos,
+	Quat* out_rot,
+	u32 count);
+// writes three rows of each transposed Matrix(pos, rot), i.e. 3x4 matrices as used for bone palettes
+LUMIX_ENGINE_API void toMatrices(const Vec3* pos, const Quat* rot, Vec4* out_rows, u32 count);
+
+
 template <typename T> LUMIX_FORCE_INLINE void swap(T& a, T& b)
 {
 	T tmp = a;
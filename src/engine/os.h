@@ -128,6 +128,26 @@ private:
 };
 	
 
+// read-only view of a whole file, data can be parsed in place without copying it
+struct LUMIX_ENGINE_API MappedFile
+{
+public:
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const char* path);
+	void close();
+
+	const u8* getData() const { return m_data; }
+	u64 size() const { return m_size; }
+
+private:
+	const u8* m_data;
+	u64 m_size;
+};
+
+
 struct LUMIX_ENGINE_API OutputFile final : IOutputStream
 {
 public:
@@ -152,11 +172,34 @@ private:
 	void* m_handle;
     bool m_is_error;
 };
+
+
+// client side of a TCP connection
+struct LUMIX_ENGINE_API OutputSocket final : IOutputStream
+{
+public:
+	OutputSocket();
+	~OutputSocket();
+
+	// `ip` is a numeric IPv4 address
+	bool connect(const char* ip, u16 port);
+	void close();
+	bool isError() const { return m_is_error; }
+
+	// blocks until all data are sent
+	bool write(const void* data, u64 size) override;
+
+private:
+	u64 m_socket;
+	bool m_is_error;
+};
 	
 
 struct FileInfo {
 	bool is_directory;
 	char filename[MAX_PATH_LENGTH];
+	// same as getLastModified, but without another query per file where the platform allows it
+	u64 last_modified;
 };
 
 struct FileIterator;
@@ -170,12 +213,20 @@ LUMIX_ENGINE_API void init();
 LUMIX_ENGINE_API void logVersion();
 LUMIX_ENGINE_API u32 getCPUsCount();
 LUMIX_ENGINE_API void sleep(u32 milliseconds);
+// give the rest of the time slice to other threads
+LUMIX_ENGINE_API void yield();
 LUMIX_ENGINE_API ThreadID getCurrentThreadID();
 
 LUMIX_ENGINE_API void* memReserve(size_t size);
 LUMIX_ENGINE_API void memCommit(void* ptr, size_t size);
 LUMIX_ENGINE_API void memRelease(void* ptr);
 LUMIX_ENGINE_API u32 getMemPageSize();
+// 0 if large pages are not supported
+LUMIX_ENGINE_API size_t getLargeMemPageSize();
+// reserves and commits `size` bytes backed by large pages, aligned to getLargeMemPageSize()
+// `size` must be a multiple of getLargeMemPageSize(), returns nullptr if large pages can not be used
+LUMIX_ENGINE_API void* memReserveLarge(size_t size);
+LUMIX_ENGINE_API void memReleaseLarge(void* ptr, size_t size);
 
 LUMIX_ENGINE_API FileIterator* createFileIterator(const char* path, IAllocator& allocator);
 LUMIX_ENGINE_API void destroyFileIterator(FileIterator* iterator);
@@ -3,21 +3,55 @@
 #include "engine/atomic.h"
 #include "engine/page_allocator.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 
 
 namespace Lumix
 {
 
 
+static volatile i32 g_page_cache_counter = 0;
+static thread_local u32 g_page_cache_idx = 0xffFFffFF;
+
+
+static void*& nextPage(void* page)
+{
+	return *(void**)page;
+}
+
+
 PageAllocator::~PageAllocator()
 {
 	ASSERT(allocated_count == 0);
-	void* p = free_pages;
+	release(free_pages);
+	for (ThreadCache& cache : caches) {
+		release(cache.pages);
+	}
+	for (u32 i = 0; i < slabs_count; ++i) {
+		OS::memReleaseLarge(slabs[i], SLAB_SIZE);
+	}
+}
+
+
+void PageAllocator::release(void* pages)
+{
+	void* p = pages;
 	while (p) {
 		void* tmp = p;
-		memcpy(&p, p, sizeof(p)); //-V579
-		OS::memRelease(tmp);
+		p = nextPage(p);
+		// slabs are released as a whole in destructor
+		if (!isSlabPage(tmp)) OS::memRelease(tmp);
+	}
+}
+
+
+bool PageAllocator::isSlabPage(void* page) const
+{
+	void* slab = (void*)((uintptr)page & ~(uintptr)(SLAB_SIZE - 1));
+	for (u32 i = 0; i < slabs_count; ++i) {
+		if (slabs[i] == slab) return true;
 	}
+	return false;
 }
 
 
@@ -33,18 +67,126 @@ void PageAllocator::unlock()
 }
 
 
-void* PageAllocator::allocate(bool lock)
+PageAllocator::ThreadCache* PageAllocator::getThreadCache()
+{
+	if (g_page_cache_idx == 0xffFFffFF) g_page_cache_idx = atomicIncrement(&g_page_cache_counter) - 1;
+	if (g_page_cache_idx >= MAX_THREAD_CACHES) return nullptr;
+	return &caches[g_page_cache_idx];
+}
+
+
+// call only with mutex locked
+void* PageAllocator::popFree()
 {
-	if (lock) mutex.enter();
-	++allocated_count;
-	if (free_pages) {
-		void* tmp = free_pages;
-		memcpy(&free_pages, free_pages, sizeof(free_pages)); //-V579
-		if (lock) mutex.exit();
+	// large pages first, other pages can then be trimmed
+	if (free_slab_pages) {
+		void* tmp = free_slab_pages;
+		free_slab_pages = nextPage(tmp);
+		--free_count;
 		return tmp;
 	}
-	++reserved_count;
-	if (lock) mutex.exit();
+	return popReleasable();
+}
+
+
+// call only with mutex locked
+void* PageAllocator::popReleasable()
+{
+	if (!free_pages) return nullptr;
+	void* tmp = free_pages;
+	free_pages = nextPage(tmp);
+	--free_count;
+	return tmp;
+}
+
+
+// call only with mutex locked
+void PageAllocator::pushFree(void* mem)
+{
+	void*& list = isSlabPage(mem) ? free_slab_pages : free_pages;
+	nextPage(mem) = list;
+	list = mem;
+	++free_count;
+}
+
+
+// call only with mutex locked, returns the first page of the new slab, the rest goes to the free list
+void* PageAllocator::allocateSlab()
+{
+	if (large_pages_failed || slabs_count == MAX_SLABS) return nullptr;
+	if (OS::getLargeMemPageSize() == 0 || SLAB_SIZE % OS::getLargeMemPageSize() != 0) {
+		large_pages_failed = true;
+		return nullptr;
+	}
+
+	u8* slab = (u8*)OS::memReserveLarge(SLAB_SIZE);
+	if (!slab) {
+		large_pages_failed = true;
+		return nullptr;
+	}
+	ASSERT(((uintptr)slab & (SLAB_SIZE - 1)) == 0);
+
+	slabs[slabs_count] = slab;
+	++slabs_count;
+	atomicAdd(&reserved_count, SLAB_SIZE / PAGE_SIZE);
+	for (u32 i = 1; i < SLAB_SIZE / PAGE_SIZE; ++i) {
+		pushFree(slab + i * PAGE_SIZE);
+	}
+	return slab;
+}
+
+
+void PageAllocator::refill(ThreadCache& cache)
+{
+	MutexGuard guard(mutex);
+	while (cache.count < CACHE_BATCH) {
+		void* page = popFree();
+		if (!page) break;
+		nextPage(page) = cache.pages;
+		cache.pages = page;
+		++cache.count;
+	}
+}
+
+
+void* PageAllocator::allocate(bool lock)
+{
+	atomicIncrement(&allocated_count);
+	if (lock) {
+		ThreadCache* cache = getThreadCache();
+		if (cache) {
+			if (!cache->pages) refill(*cache);
+			if (cache->pages) {
+				void* page = cache->pages;
+				cache->pages = nextPage(page);
+				--cache->count;
+				return page;
+			}
+		}
+		else {
+			MutexGuard guard(mutex);
+			void* page = popFree();
+			if (page) return page;
+		}
+	}
+	else {
+		void* page = popFree();
+		if (page) return page;
+	}
+
+	if (lock) {
+		MutexGuard guard(mutex);
+		// another thread could have allocated a slab in the meantime
+		void* page = popFree();
+		if (!page) page = allocateSlab();
+		if (page) return page;
+	}
+	else {
+		void* page = allocateSlab();
+		if (page) return page;
+	}
+
+	atomicIncrement(&reserved_count);
 	void* mem = OS::memReserve(PAGE_SIZE);
 	OS::memCommit(mem, PAGE_SIZE);
 	return mem;
@@ -53,11 +195,65 @@ void* PageAllocator::allocate(bool lock)
 
 void PageAllocator::deallocate(void* mem, bool lock)
 {
-	if (lock) mutex.enter();
-	--allocated_count;
-	memcpy(mem, &free_pages, sizeof(free_pages));
-	free_pages = mem;
-	if (lock) mutex.exit();
+	atomicDecrement(&allocated_count);
+	if (!lock) {
+		pushFree(mem);
+		return;
+	}
+
+	ThreadCache* cache = getThreadCache();
+	if (cache) {
+		nextPage(mem) = cache->pages;
+		cache->pages = mem;
+		++cache->count;
+		if (cache->count <= CACHE_BATCH * 2) return;
+	}
+
+	void* to_release = nullptr;
+	{
+		MutexGuard guard(mutex);
+		if (cache) {
+			for (u32 i = 0; i < CACHE_BATCH; ++i) {
+				void* page = cache->pages;
+				cache->pages = nextPage(page);
+				pushFree(page);
+			}
+			cache->count -= CACHE_BATCH;
+		}
+		else {
+			pushFree(mem);
+		}
+
+		while (free_count > max_free_count && free_pages) {
+			void* page = popReleasable();
+			nextPage(page) = to_release;
+			to_release = page;
+			atomicDecrement(&reserved_count);
+			++released_count;
+		}
+	}
+	release(to_release);
+}
+
+
+u32 PageAllocator::trim(u32 max_free)
+{
+	PROFILE_FUNCTION();
+	void* to_release = nullptr;
+	u32 count = 0;
+	{
+		MutexGuard guard(mutex);
+		while (free_count > max_free && free_pages) {
+			void* page = popReleasable();
+			nextPage(page) = to_release;
+			to_release = page;
+			++count;
+		}
+		atomicSubtract(&reserved_count, count);
+		released_count += count;
+	}
+	release(to_release);
+	return count;
 }
 
 
@@ -12,23 +12,61 @@ namespace Lumix
 struct LUMIX_ENGINE_API PageAllocator final
 {
 public:
-	enum { PAGE_SIZE = 16384 };
+	enum {
+		PAGE_SIZE = 16384,
+		MAX_THREAD_CACHES = 64,
+		CACHE_BATCH = 8,
+		// pages are carved from slabs backed by large pages if the OS provides them
+		SLAB_SIZE = 2 * 1024 * 1024,
+		MAX_SLABS = 64
+	};
 
 	~PageAllocator();
-		
+	
+	// lock == false means the caller already holds the lock, thread cache is not used then
 	void* allocate(bool lock);
 	void deallocate(void* mem, bool lock);
 	u32 getAllocatedCount() const { return allocated_count; }
 	u32 getReservedCount() const { return reserved_count; }
+	u32 getFreeCount() const { return free_count; }
+	u32 getReleasedCount() const { return released_count; }
+
+	// releases free pages to the OS, keeps at most `max_free` of them; pages in thread caches are kept
+	// pages from large page slabs are never released before the allocator is destroyed
+	u32 trim(u32 max_free = 0);
+	// automatically trim when there are more than `max_free` free pages
+	void setMaxFreeCount(u32 max_free) { max_free_count = max_free; }
 
 	void lock();
 	void unlock();
 		
 private:
-	u32 allocated_count = 0;
-	u32 reserved_count = 0;
+	struct alignas(64) ThreadCache {
+		void* pages = nullptr;
+		u32 count = 0;
+	};
+
+	ThreadCache* getThreadCache();
+	void* popFree();
+	void* popReleasable();
+	void pushFree(void* mem);
+	void refill(ThreadCache& cache);
+	void release(void* pages);
+	bool isSlabPage(void* page) const;
+	void* allocateSlab();
+
+	volatile i32 allocated_count = 0;
+	volatile i32 reserved_count = 0;
+	u32 free_count = 0;
+	u32 released_count = 0;
+	u32 max_free_count = 0xffFFffFF;
 	void* free_pages = nullptr;
+	void* free_slab_pages = nullptr;
+	void* slabs[MAX_SLABS];
+	u32 slabs_count = 0;
+	bool large_pages_failed = false;
 	Mutex mutex;
+	ThreadCache caches[MAX_THREAD_CACHES];
 };
 
 
@@ -85,9 +123,9 @@ struct PagedList
 
 	T* push()
 	{
-		allocator.lock();
-		void* mem = allocator.allocate(false);
+		void* mem = allocator.allocate(true);
 		T* page = new (NewPlaceholder(), mem) T;
+		allocator.lock();
 		if(!begin) {
 			begin = end = page;
 		}
@@ -1,10 +1,12 @@
 #include "engine/lumix.h"
 #include "engine/path.h"
 
-#include "engine/associative_array.h"
-#include "engine/crc32.h"
+#include "engine/allocator.h"
+#include "engine/atomic.h"
+#include "engine/crt.h"
+#include "engine/hash.h"
+#include "engine/log.h"
 #include "engine/sync.h"
-#include "engine/path.h"
 #include "engine/stream.h"
 #include "engine/string.h"
 
@@ -16,99 +18,193 @@ struct PathManagerImpl;
 static PathManagerImpl* g_path_manager = nullptr;
 
 
+// interned paths, append-only, entries and strings never move, so lookups do not need to lock
 struct PathManagerImpl : PathManager
 {
+	struct Entry {
+		const char* path;
+		u32 hash;
+		u32 length;
+		// paths with zero references are kept, but not serialized
+		volatile i32 ref_count;
+	};
+
+	// open addressing, slots contain entry index + 1, 0 is empty
+	// old tables are kept alive until shutdown, since readers can still use them
+	struct Table {
+		Table* prev;
+		u32 capacity;
+		volatile i32 slots[1];
+	};
+
+	static constexpr u32 PAGE_SIZE_SHIFT = 12;
+	static constexpr u32 PAGE_SIZE = 1 << PAGE_SIZE_SHIFT;
+	static constexpr u32 MAX_PAGES = 1024;
+	static constexpr u32 STRING_CHUNK_SIZE = 64 * 1024;
+
 	PathManagerImpl(IAllocator& allocator)
-		: m_paths(allocator)
-		, m_allocator(allocator)
+		: m_allocator(allocator)
 	{
+		ASSERT(!g_path_manager);
 		g_path_manager = this;
+		m_table = allocTable(1024);
+		// empty path always has index 0 and hash 0
+		insert(0, "", 0);
 		m_empty_path = LUMIX_NEW(m_allocator, Path)();
 	}
 
 	~PathManagerImpl() override {
 		LUMIX_DELETE(m_allocator, m_empty_path);
-		ASSERT(m_paths.size() == 0);
+		#ifdef LUMIX_DEBUG
+			for (u32 i = 0; i < m_count; ++i) ASSERT(getEntry(i).ref_count == 0);
+		#endif
+		while (m_table) {
+			Table* prev = m_table->prev;
+			m_allocator.deallocate(m_table);
+			m_table = prev;
+		}
+		while (m_string_chunk) {
+			u8* prev = *(u8**)m_string_chunk;
+			m_allocator.deallocate(m_string_chunk);
+			m_string_chunk = prev;
+		}
+		for (u32 i = 0; i < MAX_PAGES && m_pages[i]; ++i) {
+			m_allocator.deallocate(m_pages[i]);
+		}
 		g_path_manager = nullptr;
 	}
 
 	void serialize(IOutputStream& serializer) override {
-		MutexGuard lock(m_mutex);
-		clear();
-		serializer.write((i32)m_paths.size());
-		for (int i = 0; i < m_paths.size(); ++i) {
-			serializer.writeString(m_paths.at(i)->m_path);
+		const u32 count = m_count;
+		i32 live_count = 0;
+		for (u32 i = 0; i < count; ++i) {
+			if (getEntry(i).ref_count > 0) ++live_count;
+		}
+		serializer.write(live_count);
+		for (u32 i = 0; i < count && live_count > 0; ++i) {
+			const Entry& entry = getEntry(i);
+			if (entry.ref_count == 0) continue;
+			serializer.writeString(entry.path);
+			--live_count;
 		}
 	}
 
 	void deserialize(IInputStream& serializer) override {
-		MutexGuard lock(m_mutex);
 		i32 size;
 		serializer.read(size);
 		for (int i = 0; i < size; ++i) {
 			char path[MAX_PATH_LENGTH];
 			serializer.readString(Span(path));
-			u32 hash = crc32(path);
-			PathInternal* internal = getPathMultithreadUnsafe(hash, path);
-			--internal->m_ref_count;
+			if (path[0]) intern(path, hash32(path));
 		}
 	}
 
-	void clear() override {
-		for (int i = m_paths.size() - 1; i >= 0; --i) {
-			if (m_paths.at(i)->m_ref_count == 0) {
-				LUMIX_DELETE(m_allocator, m_paths.at(i));
-				m_paths.eraseAt(i);
-			}
+	// unreferenced paths are kept interned
+	void clear() override {}
+
+	Entry& getEntry(u32 index) const {
+		ASSERT(index < m_count);
+		return m_pages[index >> PAGE_SIZE_SHIFT][index & (PAGE_SIZE - 1)];
+	}
+
+	Table* allocTable(u32 capacity) {
+		const size_t size = sizeof(Table) + sizeof(i32) * (capacity - 1);
+		Table* table = (Table*)m_allocator.allocate(size);
+		memset(table, 0, size);
+		table->capacity = capacity;
+		return table;
+	}
+
+	// lock free
+	i32 find(u32 hash) const {
+		const Table* table = m_table;
+		const u32 mask = table->capacity - 1;
+		for (u32 i = hash & mask;; i = (i + 1) & mask) {
+			const i32 slot = table->slots[i];
+			if (slot == 0) return -1;
+			if (getEntry(slot - 1).hash == hash) return slot - 1;
 		}
 	}
 
-	PathInternal* getPath(u32 hash, const char* path) {
+	u32 intern(const char* path, u32 hash) {
+		const i32 idx = find(hash);
+		if (idx >= 0) {
+			ASSERT(equalStrings(getEntry(idx).path, path));
+			return idx;
+		}
+
 		MutexGuard lock(m_mutex);
-		return getPathMultithreadUnsafe(hash, path);
+		// could be inserted by other thread while we were not locked
+		const i32 idx_locked = find(hash);
+		if (idx_locked >= 0) return idx_locked;
+		return insert(hash, path, stringLength(path));
 	}
 
-	PathInternal* getPath(u32 hash) {
-		MutexGuard lock(m_mutex);
-		int index = m_paths.find(hash);
-		if (index < 0) {
-			return nullptr;
+	u32 insert(u32 hash, const char* path, u32 length) {
+		const u32 index = m_count;
+		const u32 page = index >> PAGE_SIZE_SHIFT;
+		LUMIX_FATAL(page < MAX_PAGES);
+		if (!m_pages[page]) {
+			m_pages[page] = (Entry*)m_allocator.allocate(sizeof(Entry) * PAGE_SIZE);
 		}
-		++m_paths.at(index)->m_ref_count;
-		return m_paths.at(index);
+
+		Entry& entry = m_pages[page][index & (PAGE_SIZE - 1)];
+		entry.path = copyToChunk(path, length);
+		entry.hash = hash;
+		entry.length = length;
+		entry.ref_count = 0;
+
+		if ((index + 1) * 2 > m_table->capacity) grow();
+
+		// the entry must be complete before it's visible to readers
+		memoryBarrier();
+		m_count = index + 1;
+		memoryBarrier();
+		insertSlot(*m_table, hash, index);
+		return index;
 	}
 
-	PathInternal* getPathMultithreadUnsafe(u32 hash, const char* path) {
-		int index = m_paths.find(hash);
-		if (index < 0) {
-			PathInternal* internal = LUMIX_NEW(m_allocator, PathInternal);
-			internal->m_ref_count = 1;
-			internal->m_id = hash;
-			copyString(internal->m_path, path);
-			m_paths.insert(hash, internal);
-			return internal;
-		}
-		++m_paths.at(index)->m_ref_count;
-		return m_paths.at(index);
+	void insertSlot(Table& table, u32 hash, u32 index) {
+		const u32 mask = table.capacity - 1;
+		u32 i = hash & mask;
+		while (table.slots[i] != 0) i = (i + 1) & mask;
+		table.slots[i] = index + 1;
 	}
 
-	void incrementRefCount(PathInternal* path) {
-		MutexGuard lock(m_mutex);
-		++path->m_ref_count;
+	void grow() {
+		Table* table = allocTable(m_table->capacity * 2);
+		for (u32 i = 0; i < m_count; ++i) {
+			insertSlot(*table, getEntry(i).hash, i);
+		}
+		table->prev = m_table;
+		memoryBarrier();
+		m_table = table;
 	}
 
-	void decrementRefCount(PathInternal* path) {
-		MutexGuard lock(m_mutex);
-		--path->m_ref_count;
-		if (path->m_ref_count == 0) {
-			m_paths.erase(path->m_id);
-			LUMIX_DELETE(m_allocator, path);
+	const char* copyToChunk(const char* path, u32 length) {
+		if (!m_string_chunk || m_string_chunk_pos + length + 1 > STRING_CHUNK_SIZE) {
+			// first bytes of a chunk point to the previous chunk
+			u8* chunk = (u8*)m_allocator.allocate(STRING_CHUNK_SIZE);
+			*(u8**)chunk = m_string_chunk;
+			m_string_chunk = chunk;
+			m_string_chunk_pos = sizeof(u8*);
 		}
+		char* res = (char*)m_string_chunk + m_string_chunk_pos;
+		memcpy(res, path, length + 1);
+		m_string_chunk_pos += length + 1;
+		return res;
 	}
 
+	void incrementRefCount(u32 index) { atomicIncrement(&getEntry(index).ref_count); }
+	void decrementRefCount(u32 index) { atomicDecrement(&getEntry(index).ref_count); }
+
 	IAllocator& m_allocator;
-	AssociativeArray<u32, PathInternal*> m_paths;
 	Mutex m_mutex;
+	Entry* m_pages[MAX_PAGES] = {};
+	volatile u32 m_count = 0;
+	Table* volatile m_table = nullptr;
+	u8* m_string_chunk = nullptr;
+	u32 m_string_chunk_pos = 0;
 	Path* m_empty_path;
 };
 
@@ -131,96 +227,103 @@ const Path& PathManager::getEmptyPath()
 }
 
 
+static u32 internPath(const char* path)
+{
+	char tmp[MAX_PATH_LENGTH];
+	const size_t len = stringLength(path);
+	ASSERT(len < MAX_PATH_LENGTH);
+	Path::normalize(path, Span(tmp, (u32)len + 1));
+	if (tmp[0] == '\0') return 0;
+	return g_path_manager->intern(tmp, hash32(tmp));
+}
+
+
 Path::Path()
+	: m_index(0)
 {
-	m_data = g_path_manager->getPath(0, "");
+	g_path_manager->incrementRefCount(m_index);
 }
 
 
 Path::Path(u32 hash)
 {
-	m_data = g_path_manager->getPath(hash);
-	ASSERT(m_data);
+	const i32 index = g_path_manager->find(hash);
+	ASSERT(index >= 0);
+	m_index = index < 0 ? 0 : index;
+	g_path_manager->incrementRefCount(m_index);
 }
 
 
 Path::Path(const Path& rhs)
-	: m_data(rhs.m_data)
+	: m_index(rhs.m_index)
 {
-	g_path_manager->incrementRefCount(m_data);
+	g_path_manager->incrementRefCount(m_index);
 }
 
 
 Path::Path(const char* path)
+	: m_index(internPath(path))
 {
-	char tmp[MAX_PATH_LENGTH];
-	size_t len = stringLength(path);
-	ASSERT(len < MAX_PATH_LENGTH);
-	Path::normalize(path, Span(tmp, (u32)len + 1));
-	u32 hash = crc32(tmp);
-	m_data = g_path_manager->getPath(hash, tmp);
+	g_path_manager->incrementRefCount(m_index);
 }
 
 
 Path::~Path()
 {
-	g_path_manager->decrementRefCount(m_data);
+	g_path_manager->decrementRefCount(m_index);
 }
 
 
 int Path::length() const
 {
-	return stringLength(m_data->m_path);
+	return g_path_manager->getEntry(m_index).length;
 }
 
 
 void Path::operator =(const Path& rhs)
 {
-	g_path_manager->decrementRefCount(m_data);
-	m_data = rhs.m_data;
-	g_path_manager->incrementRefCount(m_data);
+	g_path_manager->incrementRefCount(rhs.m_index);
+	g_path_manager->decrementRefCount(m_index);
+	m_index = rhs.m_index;
 }
 
 
 void Path::operator =(const char* rhs)
 {
-	g_path_manager->decrementRefCount(m_data);
-	char tmp[MAX_PATH_LENGTH];
-	size_t len = stringLength(rhs);
-	ASSERT(len < MAX_PATH_LENGTH);
-	Path::normalize(rhs, Span(tmp, (u32)len + 1));
-	u32 hash = crc32(tmp);
-	m_data = g_path_manager->getPath(hash, tmp);
+	const u32 index = internPath(rhs);
+	g_path_manager->incrementRefCount(index);
+	g_path_manager->decrementRefCount(m_index);
+	m_index = index;
 }
 
 
 bool Path::operator==(const Path& rhs) const
 {
-	return m_data->m_id == rhs.m_data->m_id;
+	return m_index == rhs.m_index;
 }
 
 
 bool Path::operator!=(const Path& rhs) const
 {
-	return m_data->m_id != rhs.m_data->m_id;
+	return m_index != rhs.m_index;
 }
 
 
 u32 Path::getHash() const
 {
-	return m_data->m_id;
+	return g_path_manager->getEntry(m_index).hash;
 }
 
 
 const char* Path::c_str() const
 {
-	return m_data->m_path;
+	return g_path_manager->getEntry(m_index).path;
 }
 
 
 bool Path::isValid() const
 {
-	return m_data->m_path[0] != '\0';
+	return m_index != 0;
 }
 
 
@@ -1,4 +1,5 @@
 #include "engine/array.h"
+#include "engine/crc32.h"
 #include "engine/debug.h"
 #include "engine/delegate_list.h"
 #include "engine/engine.h"
@@ -9,6 +10,7 @@
 #include "engine/profiler.h"
 #include "engine/stream.h"
 #include "engine/string.h"
+#include "engine/task_graph.h"
 
 namespace Lumix
 {
@@ -68,12 +70,70 @@ namespace Lumix
 			}
 
 
+			struct PluginInitData {
+				IPlugin* plugin;
+				u64 start;
+				u64 end;
+			};
+
+
 			void initPlugins() override
 			{
 				PROFILE_FUNCTION();
-				for (int i = 0, c = m_plugins.size(); i < c; ++i)
-				{
-					m_plugins[i]->init();
+				Array<PluginInitData> inits(m_allocator);
+				inits.reserve(m_plugins.size());
+				for (IPlugin* plugin : m_plugins) inits.push({plugin, 0, 0});
+
+				auto init = [](void* ptr){
+					PluginInitData* data = (PluginInitData*)ptr;
+					data->start = OS::Timer::getRawTimestamp();
+					data->plugin->init();
+					data->end = OS::Timer::getRawTimestamp();
+				};
+
+				const u64 start = OS::Timer::getRawTimestamp();
+				if (JobSystem::getWorkersCount() < 2) {
+					for (PluginInitData& data : inits) init(&data);
+				}
+				else {
+					TaskGraph graph(m_allocator);
+					for (PluginInitData& data : inits) {
+						// main loop runs on worker 0
+						const u8 worker = data.plugin->isInitThreadSafe() ? JobSystem::ANY_WORKER : 0;
+						graph.addNode(data.plugin->getName(), &data, init, worker);
+					}
+
+					i32 prev_serial = -1;
+					for (i32 i = 0, c = inits.size(); i < c; ++i) {
+						IPlugin* plugin = inits[i].plugin;
+						if (!plugin->isInitThreadSafe()) {
+							if (prev_serial >= 0) graph.addEdge(prev_serial, i);
+							prev_serial = i;
+						}
+						for (const char* dependency : plugin->getInitDependencies()) {
+							const u32 hash = crc32(dependency);
+							for (i32 j = 0; j < c; ++j) {
+								if (j != i && crc32(inits[j].plugin->getName()) == hash) graph.addEdge(j, i);
+							}
+						}
+					}
+					graph.run(JobSystem::Priority::HIGH);
+				}
+				logStartupTimeline(inits, start);
+			}
+
+
+			// blocks are in the profiler too, this is for builds without it
+			static void logStartupTimeline(const Array<PluginInitData>& inits, u64 start)
+			{
+				const double to_ms = 1000.0 / OS::Timer::getFrequency();
+				const u64 end = OS::Timer::getRawTimestamp();
+				LogProxy log = logInfo("Core");
+				log << "Plugins initialized in " << float((end - start) * to_ms) << " ms";
+				for (const PluginInitData& data : inits) {
+					log << "\n\t" << data.plugin->getName()
+						<< ": " << float((data.start - start) * to_ms)
+						<< " - " << float((data.end - start) * to_ms) << " ms";
 				}
 			}
 
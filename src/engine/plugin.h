@@ -29,6 +29,40 @@ struct LUMIX_ENGINE_API PluginManager
 	virtual DelegateList<void(void*)>& libraryLoaded() = 0;
 };
 
+// what IScene::update accesses, engine updates scenes which do not conflict in parallel
+struct SceneUpdateAccess
+{
+	enum Flags : u32 {
+		READ_TRANSFORMS = 1 << 0,
+		WRITE_TRANSFORMS = 1 << 1,
+		// update calls scripts, which can access anything
+		SCRIPTS = 1 << 2
+	};
+
+	static ComponentMask mask(ComponentType type) { return ComponentMask::of(type); }
+
+	static SceneUpdateAccess all() {
+		SceneUpdateAccess res;
+		res.read_components = ComponentMask::all();
+		res.write_components = ComponentMask::all();
+		res.flags = READ_TRANSFORMS | WRITE_TRANSFORMS | SCRIPTS;
+		return res;
+	}
+
+	bool conflicts(const SceneUpdateAccess& rhs) const {
+		if ((flags | rhs.flags) & SCRIPTS) return true;
+		if ((flags & WRITE_TRANSFORMS) && (rhs.flags & (READ_TRANSFORMS | WRITE_TRANSFORMS))) return true;
+		if ((rhs.flags & WRITE_TRANSFORMS) && (flags & READ_TRANSFORMS)) return true;
+		if (write_components.intersects(rhs.read_components | rhs.write_components)) return true;
+		return rhs.write_components.intersects(read_components);
+	}
+
+	ComponentMask read_components = {};
+	ComponentMask write_components = {};
+	u32 flags = 0;
+};
+
+
 struct LUMIX_ENGINE_API IScene
 {
 	virtual ~IScene() {}
@@ -38,6 +72,13 @@ struct LUMIX_ENGINE_API IScene
 	virtual IPlugin& getPlugin() const = 0;
 	virtual void update(float time_delta, bool paused) = 0;
 	virtual void lateUpdate(float time_delta, bool paused) {}
+	// by default scene's update can access anything, so it's never run in parallel with other scenes
+	virtual SceneUpdateAccess getUpdateAccess() const { return SceneUpdateAccess::all(); }
+	// deserialize of thread safe scenes can run on any worker in parallel with other scenes,
+	// other scenes are deserialized on the main thread in their original order
+	virtual bool isDeserializeThreadSafe() const { return false; }
+	// names of plugins whose scenes must be deserialized before this scene
+	virtual Span<const char* const> getDeserializeDependencies() const { return {}; }
 	virtual struct Universe& getUniverse() = 0;
 	virtual void startGame() {}
 	virtual void stopGame() {}
@@ -51,6 +92,11 @@ struct LUMIX_ENGINE_API IPlugin
 	virtual ~IPlugin();
 
 	virtual void init() {}
+	// init of thread safe plugins can run on any worker in parallel with other plugins,
+	// other plugins are initialized on the main thread in their original order
+	virtual bool isInitThreadSafe() const { return false; }
+	// names of plugins which must be initialized before this plugin
+	virtual Span<const char* const> getInitDependencies() const { return {}; }
 	virtual void update(float) {}
 	virtual const char* getName() const = 0;
 	virtual void pluginAdded(IPlugin& plugin) {}
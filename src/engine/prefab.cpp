@@ -12,6 +12,7 @@ const ResourceType PrefabResource::TYPE("prefab");
 PrefabResource::PrefabResource(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
 	, data(allocator)
+	, prefab_template(allocator)
 {
 }
 
@@ -19,7 +20,13 @@ PrefabResource::PrefabResource(const Path& path, ResourceManager& resource_manag
 ResourceType PrefabResource::getType() const { return TYPE; }
 
 
-void PrefabResource::unload() { data.clear(); }
+void PrefabResource::unload()
+{
+	data.clear();
+	prefab_template.is_parsed = false;
+	prefab_template.is_valid = false;
+	prefab_template.scenes.clear();
+}
 
 
 bool PrefabResource::load(u64 size, const u8* mem)
@@ -24,8 +24,26 @@ struct LUMIX_ENGINE_API PrefabResource final : Resource
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 
+	// sections of `data`, filled by the engine when the prefab is instantiated for the first time
+	struct Template {
+		struct Scene {
+			u32 name_hash;
+			u32 offset;
+			u32 size;
+		};
+
+		Template(IAllocator& allocator) : scenes(allocator) {}
+
+		bool is_parsed = false;
+		bool is_valid = false;
+		u32 universe_offset = 0;
+		u32 universe_size = 0;
+		Array<Scene> scenes;
+	};
+
 	Array<u8> data;
 	u32 content_hash;
+	mutable Template prefab_template;
 	static const ResourceType TYPE;
 };
 
@@ -3,6 +3,10 @@
 	#define NOGDI 
 	#include <Windows.h>
 	#include <evntcons.h>
+#elif defined __linux__
+	#include <linux/perf_event.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
 #endif
 
 #include "engine/array.h"
@@ -10,6 +14,7 @@
 #include "engine/hash_map.h"
 #include "engine/allocator.h"
 #include "engine/atomic.h"
+#include "engine/log.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
@@ -43,6 +48,12 @@ struct ThreadContext
 	StaticString<64> name;
 	bool show_in_profiler = false;
 	u32 thread_id;
+	bool hw_counters_opened = false;
+	#ifdef __linux__
+		int hw_group_fd = -1;
+		// index of each counter in the group read, -1 if the counter could not be opened
+		i8 hw_read_idx[(int)HWCounter::COUNT];
+	#endif
 };
 
 #ifdef _WIN32
@@ -92,10 +103,45 @@ struct ThreadContext
 	void CloseTrace(int) {}
 #endif
 
+struct CaptureTask : Thread {
+	CaptureTask(IAllocator& allocator)
+		: Thread(allocator)
+		, threads(allocator)
+		, strings(allocator)
+		, staging(allocator)
+		, chunk(allocator)
+	{}
+
+	int task() override;
+	void flush();
+	void flushContext(ThreadContext& ctx, i32 thread_idx);
+	void writeChunk(CaptureChunkType type, const void* data, u32 size);
+	void writeString(const char* str);
+
+	struct CapturedThread {
+		u32 cursor = 0;
+		bool name_written = false;
+		StaticString<64> name;
+	};
+
+	OS::OutputFile file;
+	OS::OutputSocket socket;
+	IOutputStream* stream = nullptr;
+	// [0] is global context, [i + 1] is Instance::contexts[i]
+	Array<CapturedThread> threads;
+	HashMap<const char*, bool> strings;
+	Array<u8> staging;
+	Array<u8> chunk;
+	u32 counters_written = 0;
+	volatile bool finished = false;
+};
+
+
 static struct Instance
 {
 	Instance()
 		: contexts(allocator)
+		, counters(allocator)
 		, trace_task(allocator)
 		, global_context(allocator)
 	{
@@ -105,6 +151,7 @@ static struct Instance
 
 	~Instance()
 	{
+		stopCapture();
 		CloseTrace(trace_task.open_handle);
 		trace_task.destroy();
 	}
@@ -165,16 +212,20 @@ static struct Instance
 
 	DefaultAllocator allocator;
 	Array<ThreadContext*> contexts;
+	Array<const char*> counters;
 	Mutex mutex;
 	OS::Timer timer;
 	bool paused = false;
 	bool context_switches_enabled = false;
+	bool hw_counters_enabled = false;
+	u32 hw_counters_available = 0;
 	u64 paused_time = 0;
 	u64 last_frame_duration = 0;
 	u64 last_frame_time = 0;
 	volatile i32 fiber_wait_id = 0;
 	TraceTask trace_task;
 	ThreadContext global_context;
+	CaptureTask* capture_task = nullptr;
 } g_instance;
 
 
@@ -315,6 +366,311 @@ void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 	};
 #endif
 
+static void openHWCounters(ThreadContext& ctx)
+{
+	ctx.hw_counters_opened = true;
+	#ifdef _WIN32
+		g_instance.hw_counters_available = 1 << (u32)HWCounter::CYCLES;
+	#elif defined __linux__
+		static const struct { u32 type; u64 config; } events[] = {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		};
+		static_assert(lengthOf(events) == (int)HWCounter::COUNT);
+
+		u32 available = 0;
+		i8 read_idx = 0;
+		for (u32 i = 0; i < lengthOf(events); ++i) {
+			perf_event_attr attr = {};
+			attr.size = sizeof(attr);
+			attr.type = events[i].type;
+			attr.config = events[i].config;
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			const int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, ctx.hw_group_fd, 0);
+			if (fd < 0) {
+				ctx.hw_read_idx[i] = -1;
+				continue;
+			}
+			if (ctx.hw_group_fd < 0) ctx.hw_group_fd = fd;
+			ctx.hw_read_idx[i] = read_idx;
+			++read_idx;
+			available |= 1 << i;
+		}
+		g_instance.hw_counters_available = available;
+	#endif
+}
+
+
+static void writeHWCounters(ThreadContext& ctx)
+{
+	if (!ctx.hw_counters_opened) openHWCounters(ctx);
+
+	HWCountersRecord r = {};
+	#ifdef _WIN32
+		ULONG64 cycles;
+		if (QueryThreadCycleTime(GetCurrentThread(), &cycles)) r.values[(int)HWCounter::CYCLES] = cycles;
+	#elif defined __linux__
+		if (ctx.hw_group_fd < 0) return;
+		struct {
+			u64 count;
+			u64 values[(int)HWCounter::COUNT];
+		} data;
+		if (::read(ctx.hw_group_fd, &data, sizeof(data)) <= 0) return;
+		for (u32 i = 0; i < (u32)HWCounter::COUNT; ++i) {
+			const i8 idx = ctx.hw_read_idx[i];
+			if (idx >= 0 && (u64)idx < data.count) r.values[i] = data.values[idx];
+		}
+	#else
+		return;
+	#endif
+	write(ctx, EventType::HW_COUNTERS, r);
+}
+
+
+bool enableHWCounters(bool enable)
+{
+	if (enable) {
+		ThreadContext* ctx = g_instance.getThreadContext();
+		if (!ctx->hw_counters_opened) openHWCounters(*ctx);
+		if (g_instance.hw_counters_available == 0) return false;
+	}
+	g_instance.hw_counters_enabled = enable;
+	return true;
+}
+
+
+bool hwCountersEnabled()
+{
+	return g_instance.hw_counters_enabled;
+}
+
+
+bool isHWCounterAvailable(HWCounter counter)
+{
+	return g_instance.hw_counters_available & (1 << (u32)counter);
+}
+
+
+const char* getHWCounterName(HWCounter counter)
+{
+	switch (counter) {
+		case HWCounter::CYCLES: return "Cycles";
+		case HWCounter::INSTRUCTIONS: return "Instructions";
+		case HWCounter::LLC_MISSES: return "LLC misses";
+		case HWCounter::BRANCH_MISSES: return "Branch misses";
+		case HWCounter::COUNT: break;
+	}
+	ASSERT(false);
+	return "N/A";
+}
+
+
+static constexpr u32 CAPTURE_FLUSH_INTERVAL_MS = 50;
+
+
+int CaptureTask::task()
+{
+	CaptureHeader header;
+	header.frequency = frequency();
+	stream->write(&header, sizeof(header));
+	while (!finished) {
+		flush();
+		OS::sleep(CAPTURE_FLUSH_INTERVAL_MS);
+	}
+	flush();
+	return 0;
+}
+
+
+void CaptureTask::writeChunk(CaptureChunkType type, const void* data, u32 size)
+{
+	CaptureChunkHeader header;
+	header.type = type;
+	header.size = size;
+	stream->write(&header, sizeof(header));
+	stream->write(data, size);
+}
+
+
+void CaptureTask::writeString(const char* str)
+{
+	if (!str || strings.find(str).isValid()) return;
+	strings.insert(str, true);
+
+	const u64 ptr = (u64)str;
+	const u32 len = stringLength(str) + 1;
+	chunk.resize(sizeof(ptr) + len);
+	memcpy(chunk.begin(), &ptr, sizeof(ptr));
+	memcpy(chunk.begin() + sizeof(ptr), str, len);
+	writeChunk(CaptureChunkType::STRING, chunk.begin(), chunk.size());
+}
+
+
+void CaptureTask::flushContext(ThreadContext& ctx, i32 thread_idx)
+{
+	CapturedThread& thread = threads[thread_idx + 1];
+	u32 thread_id;
+	bool write_name = false;
+	{
+		// copy as fast as possible, everything else is done outside of the lock
+		MutexGuard lock(ctx.mutex);
+		if (!thread.name_written || thread.name != ctx.name) {
+			thread.name = ctx.name;
+			thread.name_written = true;
+			write_name = true;
+		}
+		thread_id = ctx.thread_id;
+
+		// ring buffer overwrote events we did not capture yet
+		if (i32(ctx.begin - thread.cursor) > 0) thread.cursor = ctx.begin;
+		const u32 size = ctx.end - thread.cursor;
+		staging.resize(size);
+		const u32 buf_size = ctx.buffer.size();
+		const u32 l = thread.cursor % buf_size;
+		if (l + size <= buf_size) {
+			memcpy(staging.begin(), ctx.buffer.begin() + l, size);
+		}
+		else {
+			memcpy(staging.begin(), ctx.buffer.begin() + l, buf_size - l);
+			memcpy(staging.begin() + buf_size - l, ctx.buffer.begin(), size - (buf_size - l));
+		}
+		thread.cursor = ctx.end;
+	}
+
+	if (write_name) {
+		const u32 len = stringLength(thread.name) + 1;
+		chunk.resize(sizeof(thread_idx) + sizeof(thread_id) + len);
+		memcpy(chunk.begin(), &thread_idx, sizeof(thread_idx));
+		memcpy(chunk.begin() + sizeof(thread_idx), &thread_id, sizeof(thread_id));
+		memcpy(chunk.begin() + sizeof(thread_idx) + sizeof(thread_id), thread.name.data, len);
+		writeChunk(CaptureChunkType::THREAD, chunk.begin(), chunk.size());
+	}
+
+	if (staging.empty()) return;
+
+	// events reference string literals, loader needs their content
+	u32 p = 0;
+	while (p < (u32)staging.size()) {
+		EventHeader header;
+		memcpy(&header, staging.begin() + p, sizeof(header));
+		if (header.size == 0) break;
+		switch (header.type) {
+			case EventType::BEGIN_BLOCK: {
+				const char* name;
+				memcpy(&name, staging.begin() + p + sizeof(header), sizeof(name));
+				writeString(name);
+				break;
+			}
+			case EventType::INT: {
+				IntRecord r;
+				memcpy(&r, staging.begin() + p + sizeof(header), sizeof(r));
+				writeString(r.key);
+				break;
+			}
+			default: break;
+		}
+		p += header.size;
+	}
+
+	chunk.resize(sizeof(thread_idx) + staging.size());
+	memcpy(chunk.begin(), &thread_idx, sizeof(thread_idx));
+	memcpy(chunk.begin() + sizeof(thread_idx), staging.begin(), staging.size());
+	writeChunk(CaptureChunkType::EVENTS, chunk.begin(), chunk.size());
+}
+
+
+void CaptureTask::flush()
+{
+	PROFILE_FUNCTION();
+	Array<ThreadContext*> contexts(g_instance.allocator);
+	{
+		MutexGuard lock(g_instance.mutex);
+		for (ThreadContext* ctx : g_instance.contexts) contexts.push(ctx);
+		for (u32 i = counters_written, c = g_instance.counters.size(); i < c; ++i) {
+			const char* name = g_instance.counters[i];
+			const u32 len = stringLength(name) + 1;
+			chunk.resize(sizeof(i) + len);
+			memcpy(chunk.begin(), &i, sizeof(i));
+			memcpy(chunk.begin() + sizeof(i), name, len);
+			writeChunk(CaptureChunkType::COUNTER, chunk.begin(), chunk.size());
+		}
+		counters_written = g_instance.counters.size();
+	}
+
+	// contexts are never destroyed, so it's safe to access them without g_instance.mutex
+	while (threads.size() < contexts.size() + 1) threads.emplace();
+	flushContext(g_instance.global_context, -1);
+	for (i32 i = 0; i < contexts.size(); ++i) {
+		flushContext(*contexts[i], i);
+	}
+}
+
+
+static bool startCaptureTask(CaptureTask* task)
+{
+	g_instance.capture_task = task;
+	if (!task->create("Profiler capture", true)) {
+		logError("Profiler") << "Failed to create capture thread";
+		LUMIX_DELETE(g_instance.allocator, task);
+		g_instance.capture_task = nullptr;
+		return false;
+	}
+	return true;
+}
+
+
+bool startCapture(const char* path)
+{
+	stopCapture();
+	CaptureTask* task = LUMIX_NEW(g_instance.allocator, CaptureTask)(g_instance.allocator);
+	if (!task->file.open(path)) {
+		logError("Profiler") << "Failed to create " << path;
+		LUMIX_DELETE(g_instance.allocator, task);
+		return false;
+	}
+	task->stream = &task->file;
+	return startCaptureTask(task);
+}
+
+
+bool startRemoteCapture(const char* ip, u16 port)
+{
+	stopCapture();
+	CaptureTask* task = LUMIX_NEW(g_instance.allocator, CaptureTask)(g_instance.allocator);
+	if (!task->socket.connect(ip, port)) {
+		logError("Profiler") << "Failed to connect to " << ip << ":" << (u32)port;
+		LUMIX_DELETE(g_instance.allocator, task);
+		return false;
+	}
+	task->stream = &task->socket;
+	return startCaptureTask(task);
+}
+
+
+void stopCapture()
+{
+	CaptureTask* task = g_instance.capture_task;
+	if (!task) return;
+
+	task->finished = true;
+	task->destroy();
+	if (task->stream == &task->file) task->file.close();
+	else task->socket.close();
+	LUMIX_DELETE(g_instance.allocator, task);
+	g_instance.capture_task = nullptr;
+}
+
+
+bool isCapturing()
+{
+	return g_instance.capture_task;
+}
+
+
 void pushInt(const char* key, int value)
 {
 	ThreadContext* ctx = g_instance.getThreadContext();
@@ -325,6 +681,23 @@ void pushInt(const char* key, int value)
 }
 
 
+u32 createCounter(const char* key_literal)
+{
+	MutexGuard lock(g_instance.mutex);
+	g_instance.counters.push(key_literal);
+	return g_instance.counters.size() - 1;
+}
+
+
+void pushCounter(u32 counter, float value)
+{
+	CounterRecord r;
+	r.counter = counter;
+	r.value = value;
+	write(g_instance.global_context, EventType::COUNTER, r);
+}
+
+
 void pushString(const char* value)
 {
 	ThreadContext* ctx = g_instance.getThreadContext();
@@ -345,6 +718,7 @@ void beginBlock(const char* name)
 	ThreadContext* ctx = g_instance.getThreadContext();
 	ctx->open_blocks.push(name);
 	write(*ctx, EventType::BEGIN_BLOCK, name);
+	if (g_instance.hw_counters_enabled) writeHWCounters(*ctx);
 }
 
 
@@ -365,6 +739,11 @@ void gpuMemStats(u64 total, u64 current, u64 dedicated) {
 	write(g_instance.global_context, EventType::GPU_MEM_STATS, data);
 }
 
+void gpuStats(const GPUStatsBlock& stats)
+{
+	write(g_instance.global_context, EventType::GPU_STATS, stats);
+}
+
 void endGPUBlock(u64 timestamp)
 {
 	write(g_instance.global_context, EventType::END_GPU_BLOCK, timestamp);
@@ -402,6 +781,7 @@ void beforeFiberSwitch()
 {
 	ThreadContext* ctx = g_instance.getThreadContext();
 	while(!ctx->open_blocks.empty()) {
+		if (g_instance.hw_counters_enabled) writeHWCounters(*ctx);
 		write(*ctx, EventType::END_BLOCK, 0);
 		ctx->open_blocks.pop();
 	}
@@ -460,6 +840,7 @@ void endBlock()
 	ThreadContext* ctx = g_instance.getThreadContext();
 	if(!ctx->open_blocks.empty()) {
 		ctx->open_blocks.pop();
+		if (g_instance.hw_counters_enabled) writeHWCounters(*ctx);
 		write(*ctx, EventType::END_BLOCK, 0);
 	}
 }
@@ -533,6 +914,18 @@ const char* GlobalState::getThreadName(int idx) const
 }
 
 
+int GlobalState::countersCount() const
+{
+	return g_instance.counters.size();
+}
+
+
+const char* GlobalState::getCounterName(int idx) const
+{
+	return g_instance.counters[idx];
+}
+
+
 ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 	: reader(reader)
 	, thread_idx(thread_idx)
@@ -17,10 +17,14 @@ LUMIX_ENGINE_API void frame();
 LUMIX_ENGINE_API void pushJobInfo(u32 signal_on_finish, u32 precondition);
 LUMIX_ENGINE_API void pushString(const char* value);
 LUMIX_ENGINE_API void pushInt(const char* key_literal, int value);
+LUMIX_ENGINE_API u32 createCounter(const char* key_literal);
+LUMIX_ENGINE_API void pushCounter(u32 counter, float value);
 
 LUMIX_ENGINE_API void beginGPUBlock(const char* name, u64 timestamp, i64 profiler_link);
 LUMIX_ENGINE_API void endGPUBlock(u64 timestamp);
 LUMIX_ENGINE_API void gpuMemStats(u64 total, u64 current, u64 dedicated);
+// stats of the innermost open GPU block, pushed right before the block's end
+LUMIX_ENGINE_API void gpuStats(const struct GPUStatsBlock& stats);
 LUMIX_ENGINE_API void gpuFrame();
 LUMIX_ENGINE_API void link(i64 link);
 LUMIX_ENGINE_API i64 createNewLinkID();
@@ -36,6 +40,30 @@ LUMIX_ENGINE_API FiberSwitchData beginFiberWait(u32 job_system_signal);
 LUMIX_ENGINE_API void endFiberWait(u32 job_system_signal, const FiberSwitchData& switch_data);
 LUMIX_ENGINE_API float getLastFrameDuration();
 
+enum class HWCounter : u8 {
+	CYCLES,
+	INSTRUCTIONS,
+	LLC_MISSES,
+	BRANCH_MISSES,
+
+	COUNT
+};
+
+// when enabled, each block records hardware counters at its begin and end
+// this costs a syscall per event on Linux, so it's off by default
+LUMIX_ENGINE_API bool enableHWCounters(bool enable);
+LUMIX_ENGINE_API bool hwCountersEnabled();
+LUMIX_ENGINE_API bool isHWCounterAvailable(HWCounter counter);
+LUMIX_ENGINE_API const char* getHWCounterName(HWCounter counter);
+
+// capture API
+// a background thread continuously writes all recorded events to a file or a TCP connection
+// events are lost if the writer can not keep up with the ring buffers
+LUMIX_ENGINE_API bool startCapture(const char* path);
+LUMIX_ENGINE_API bool startRemoteCapture(const char* ip, u16 port);
+LUMIX_ENGINE_API void stopCapture();
+LUMIX_ENGINE_API bool isCapturing();
+
 struct Scope
 {
 	explicit Scope(const char* name_literal) { beginBlock(name_literal); }
@@ -64,6 +92,13 @@ struct IntRecord
 };
 
 
+struct CounterRecord
+{
+	u32 counter;
+	float value;
+};
+
+
 struct JobRecord
 {
 	u32 signal_on_finish;
@@ -78,6 +113,12 @@ struct FiberWaitRecord
 };
 
 
+struct HWCountersRecord
+{
+	u64 values[(int)HWCounter::COUNT];
+};
+
+
 struct GPUBlock
 {
 	char name[32];
@@ -92,6 +133,18 @@ struct GPUMemStatsBlock
 	u64 dedicated;
 };
 
+// including nested blocks, pipeline statistics are 0 if the driver does not support them
+struct GPUStatsBlock
+{
+	u64 vertices;
+	u64 primitives;
+	u64 fragment_invocations;
+	u64 compute_invocations;
+	u32 draw_calls;
+	u32 dispatches;
+	u32 state_changes;
+};
+
 
 enum class EventType : u8
 {
@@ -109,7 +162,10 @@ enum class EventType : u8
 	END_GPU_BLOCK,
 	GPU_FRAME,
 	GPU_MEM_STATS,
-	LINK
+	LINK,
+	COUNTER,
+	HW_COUNTERS,
+	GPU_STATS
 };
 
 #pragma pack(1)
@@ -122,12 +178,52 @@ struct EventHeader
 #pragma pack()
 
 
+// capture is a CaptureHeader followed by chunks, each one a CaptureChunkHeader and `size` bytes of payload
+struct CaptureHeader
+{
+	enum { MAGIC = 0x5043504c }; // 'LPCP'
+	enum class Version : u32 {
+		FIRST,
+		GPU_STATS,
+		LATEST
+	};
+
+	u32 magic = MAGIC;
+	Version version = Version::LATEST;
+	u64 frequency;
+};
+
+
+enum class CaptureChunkType : u8
+{
+	// i32 thread index (-1 for global context), u32 thread id, zero terminated name
+	THREAD,
+	// i32 thread index, whole events as they are in the ring buffer
+	EVENTS,
+	// u64 pointer as used in events, zero terminated string
+	STRING,
+	// u32 counter index, zero terminated name
+	COUNTER
+};
+
+
+#pragma pack(1)
+struct CaptureChunkHeader
+{
+	CaptureChunkType type;
+	u32 size;
+};
+#pragma pack()
+
+
 struct LUMIX_ENGINE_API GlobalState {
 	GlobalState();
 	~GlobalState();
 	
 	int threadsCount() const;
 	const char* getThreadName(int idx) const;
+	int countersCount() const;
+	const char* getCounterName(int idx) const;
 
 	int local_readers_count = 0;
 };
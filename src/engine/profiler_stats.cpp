@@ -0,0 +1,176 @@
+#include "engine/crt.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
+#include "engine/profiler_stats.h"
+#include "engine/stream.h"
+
+
+namespace Lumix
+{
+
+
+// frame time itself is reported as a block with this name
+static const char* FRAME_BLOCK_NAME = "frame";
+
+
+ProfilerStats::ProfilerStats(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_blocks(allocator)
+	, m_block_map(allocator)
+	, m_threads(allocator)
+{}
+
+
+void ProfilerStats::clear()
+{
+	m_blocks.clear();
+	m_block_map.clear();
+	m_frames = 0;
+	m_last_frame = 0;
+	for (ThreadCursor& thread : m_threads) thread.depth = 0;
+}
+
+
+u32 ProfilerStats::getBlock(const char* name)
+{
+	auto iter = m_block_map.find(name);
+	if (iter.isValid()) return iter.value();
+
+	m_blocks.emplace(name, m_allocator);
+	m_block_map.insert(name, m_blocks.size() - 1);
+	return m_blocks.size() - 1;
+}
+
+
+template <typename T>
+static void read(const Profiler::ThreadState& ctx, u32 p, T& value)
+{
+	const u32 l = p % ctx.buffer_size;
+	if (l + sizeof(value) <= ctx.buffer_size) {
+		memcpy(&value, ctx.buffer + l, sizeof(value));
+		return;
+	}
+
+	memcpy(&value, ctx.buffer + l, ctx.buffer_size - l);
+	memcpy((u8*)&value + (ctx.buffer_size - l), ctx.buffer, sizeof(value) - (ctx.buffer_size - l));
+}
+
+
+void ProfilerStats::frame()
+{
+	const u64 now = OS::Timer::getRawTimestamp();
+	{
+		Profiler::GlobalState global;
+		const int threads_count = global.threadsCount();
+		while (m_threads.size() < threads_count) m_threads.emplace();
+
+		for (int i = 0; i < threads_count; ++i) {
+			Profiler::ThreadState ctx(global, i);
+			ThreadCursor& thread = m_threads[i];
+			// events from before the first frame are not part of the stats
+			if (!thread.initialized) {
+				thread.cursor = ctx.end;
+				thread.initialized = true;
+				continue;
+			}
+			if (i32(ctx.begin - thread.cursor) > 0) {
+				// lost events, open blocks can not be matched anymore
+				thread.cursor = ctx.begin;
+				thread.depth = 0;
+			}
+
+			u32 p = thread.cursor;
+			while (p != ctx.end) {
+				Profiler::EventHeader header;
+				read(ctx, p, header);
+				switch (header.type) {
+					case Profiler::EventType::BEGIN_BLOCK: {
+						const char* name;
+						read(ctx, p + sizeof(header), name);
+						if (thread.depth < lengthOf(thread.open)) {
+							thread.open[thread.depth].block = getBlock(name);
+							thread.open[thread.depth].start = header.time;
+						}
+						++thread.depth;
+						break;
+					}
+					case Profiler::EventType::END_BLOCK:
+						if (thread.depth == 0) break;
+						--thread.depth;
+						if (thread.depth < lengthOf(thread.open)) {
+							Block& block = m_blocks[thread.open[thread.depth].block];
+							block.frame_time += header.time - thread.open[thread.depth].start;
+							block.in_frame = true;
+						}
+						break;
+					default: break;
+				}
+				p += header.size;
+			}
+			thread.cursor = p;
+		}
+	}
+
+	const double to_ms = 1000.0 / Profiler::frequency();
+	if (m_last_frame != 0) {
+		Block& frame_block = m_blocks[getBlock(FRAME_BLOCK_NAME)];
+		frame_block.frame_time = now - m_last_frame;
+		frame_block.in_frame = true;
+		++m_frames;
+	}
+	m_last_frame = now;
+
+	for (Block& block : m_blocks) {
+		if (!block.in_frame) continue;
+		block.samples.push(float(block.frame_time * to_ms));
+		block.frame_time = 0;
+		block.in_frame = false;
+	}
+}
+
+
+static int compareFloats(const void* a, const void* b)
+{
+	const float fa = *(const float*)a;
+	const float fb = *(const float*)b;
+	return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+
+void ProfilerStats::writeJSON(IOutputStream& stream) const
+{
+	Array<float> sorted(m_allocator);
+	auto percentile = [&](float p) {
+		const u32 idx = minimum(u32(p * sorted.size()), sorted.size() - 1);
+		return sorted[idx];
+	};
+
+	stream << "{\n\t\"frames\": " << m_frames << ",\n\t\"blocks\": {";
+	bool first = true;
+	for (const Block& block : m_blocks) {
+		if (block.samples.empty()) continue;
+
+		sorted.resize(block.samples.size());
+		memcpy(sorted.begin(), block.samples.begin(), block.samples.byte_size());
+		qsort(sorted.begin(), sorted.size(), sizeof(sorted[0]), compareFloats);
+
+		stream << (first ? "\n" : ",\n");
+		first = false;
+		stream << "\t\t\"";
+		// names are string literals, e.g. __FUNCTION__, escape just in case
+		for (const char* c = block.name; *c; ++c) {
+			if (*c == '"' || *c == '\\') stream << "\\";
+			stream.write(c, 1);
+		}
+		stream << "\": { \"count\": " << sorted.size()
+			<< ", \"p50\": " << percentile(0.5f)
+			<< ", \"p95\": " << percentile(0.95f)
+			<< ", \"p99\": " << percentile(0.99f)
+			<< ", \"max\": " << sorted.back()
+			<< " }";
+	}
+	stream << "\n\t}\n}\n";
+}
+
+
+} // namespace Lumix
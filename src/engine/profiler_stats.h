@@ -0,0 +1,61 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/hash_map.h"
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+struct IOutputStream;
+
+
+// aggregates CPU time of profiler blocks per frame, e.g. to catch performance regressions
+// blocks with the same name are summed across all threads
+struct LUMIX_ENGINE_API ProfilerStats
+{
+	explicit ProfilerStats(IAllocator& allocator);
+
+	// consumes events recorded since the last call, call once per frame
+	// events not consumed before the ring buffers wrap around are lost
+	void frame();
+	void clear();
+	// {"frames": N, "blocks": {"name": {"count": N, "p50": ms, "p95": ms, "p99": ms, "max": ms}}}
+	void writeJSON(IOutputStream& stream) const;
+
+private:
+	struct Block {
+		Block(const char* name, IAllocator& allocator) : name(name), samples(allocator) {}
+
+		const char* name;
+		u64 frame_time = 0;
+		bool in_frame = false;
+		// milliseconds per frame, frames without this block are not included
+		Array<float> samples;
+	};
+
+	struct ThreadCursor {
+		u32 cursor = 0;
+		bool initialized = false;
+		u32 depth = 0;
+		struct {
+			u32 block;
+			u64 start;
+		} open[64];
+	};
+
+	u32 getBlock(const char* name);
+
+	IAllocator& m_allocator;
+	Array<Block> m_blocks;
+	HashMap<const char*, u32> m_block_map;
+	Array<ThreadCursor> m_threads;
+	u64 m_last_frame = 0;
+	u32 m_frames = 0;
+};
+
+
+} // namespace Lumix
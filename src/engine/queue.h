@@ -2,6 +2,7 @@
 
 
 #include "engine/allocator.h"
+#include "engine/atomic.h"
 
 
 namespace Lumix
@@ -84,4 +85,157 @@ namespace Lumix
 		T* m_buffer = (T*)m_mem;
 		alignas(T) u8 m_mem[sizeof(T) * COUNT];
 	};
+
+
+	// bounded, lock-free, any number of threads can push and pop
+	// push fails if the queue is full, pop fails if it's empty
+	template <typename T, u32 COUNT>
+	struct MPMCQueue
+	{
+		static_assert(COUNT && !(COUNT & (COUNT - 1)), "Is not power of 2");
+	public:
+		MPMCQueue()
+		{
+			for (u32 i = 0; i < COUNT; ++i) m_cells[i].sequence = i;
+		}
+
+		~MPMCQueue()
+		{
+			for (u32 pos = (u32)m_read; pos != (u32)m_write; ++pos) {
+				((T*)m_cells[pos & (COUNT - 1)].mem)->~T();
+			}
+		}
+
+		bool push(const T& item)
+		{
+			for (;;) {
+				const u32 pos = (u32)m_write;
+				Cell& cell = m_cells[pos & (COUNT - 1)];
+				// cell's sequence is `pos` if it's free for this lap, `pos + 1 - COUNT` if the last lap was not popped yet
+				const i32 diff = i32((u32)cell.sequence - pos);
+				if (diff == 0) {
+					if (compareAndExchange(&m_write, i32(pos + 1), i32(pos))) {
+						::new (NewPlaceholder(), cell.mem) T(item);
+						// full barrier, consumers see the item only after it's constructed
+						atomicIncrement(&cell.sequence);
+						return true;
+					}
+				}
+				else if (diff < 0) {
+					return false;
+				}
+			}
+		}
+
+		bool pop(T& item)
+		{
+			for (;;) {
+				const u32 pos = (u32)m_read;
+				Cell& cell = m_cells[pos & (COUNT - 1)];
+				const i32 diff = i32((u32)cell.sequence - (pos + 1));
+				if (diff == 0) {
+					if (compareAndExchange(&m_read, i32(pos + 1), i32(pos))) {
+						T* value = (T*)cell.mem;
+						item = static_cast<T&&>(*value);
+						value->~T();
+						// hand the cell over to the producer of the next lap
+						atomicAdd(&cell.sequence, COUNT - 1);
+						return true;
+					}
+				}
+				else if (diff < 0) {
+					return false;
+				}
+			}
+		}
+
+		// only a hint if other threads push or pop at the same time
+		u32 size() const { return u32(m_write - m_read); }
+
+	private:
+		struct Cell {
+			volatile i32 sequence;
+			alignas(T) u8 mem[sizeof(T)];
+		};
+
+		// producers and consumers should not fight over the same cache line
+		volatile i32 m_write = 0;
+		u8 m_write_padding[64 - sizeof(i32)];
+		volatile i32 m_read = 0;
+		u8 m_read_padding[64 - sizeof(i32)];
+		Cell m_cells[COUNT];
+	};
+
+
+	// unbounded, any number of threads can push, only one thread at a time can pop
+	// every push allocates a node, so pass a fast allocator if it's used a lot
+	// push never blocks, but pop can fail for a short while after a preempted push started on another thread
+	template <typename T>
+	struct MPSCQueue
+	{
+		static_assert(sizeof(void*) == sizeof(i64), "Requires 64bit pointers");
+	public:
+		explicit MPSCQueue(IAllocator& allocator)
+			: m_allocator(allocator)
+		{
+			// the node with the last popped item, its item is already destroyed
+			m_tail = LUMIX_NEW(m_allocator, Node);
+			m_head = m_tail;
+		}
+
+		~MPSCQueue()
+		{
+			while (m_tail->next) {
+				Node* next = m_tail->next;
+				((T*)next->mem)->~T();
+				LUMIX_DELETE(m_allocator, m_tail);
+				m_tail = next;
+			}
+			LUMIX_DELETE(m_allocator, m_tail);
+		}
+
+		void push(const T& item)
+		{
+			Node* node = LUMIX_NEW(m_allocator, Node);
+			::new (NewPlaceholder(), node->mem) T(item);
+			Node* prev;
+			for (;;) {
+				prev = m_head;
+				// full barrier, the item is constructed before the node is reachable
+				if (compareAndExchange64((i64 volatile*)&m_head, (i64)node, (i64)prev)) break;
+			}
+			// producers never touch `prev` after this, so the consumer can free it once it moves past
+			prev->next = node;
+		}
+
+		// consumer thread only
+		bool pop(T& item)
+		{
+			Node* next = m_tail->next;
+			if (!next) return false;
+
+			T* value = (T*)next->mem;
+			item = static_cast<T&&>(*value);
+			value->~T();
+			LUMIX_DELETE(m_allocator, m_tail);
+			m_tail = next;
+			return true;
+		}
+
+		// consumer thread only
+		bool empty() const { return !m_tail->next; }
+
+	private:
+		struct Node {
+			Node* volatile next = nullptr;
+			alignas(T) u8 mem[sizeof(T)];
+		};
+
+		IAllocator& m_allocator;
+		// last pushed node, shared by producers
+		Node* volatile m_head;
+		u8 m_head_padding[64 - sizeof(Node*)];
+		// owned by the consumer
+		Node* m_tail;
+	};
 }
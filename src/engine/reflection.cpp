@@ -187,6 +187,55 @@ const PropertyBase* getProperty(ComponentType cmp_type, const char* property)
 }
 
 
+struct ComponentCopier : ISimpleComponentVisitor
+{
+	template <typename T> void copy(const Property<T>& prop) {
+		if (prop.get && prop.set) {
+			prop.set(prop, dst, -1, prop.get(prop, src, -1));
+			return;
+		}
+		visitProperty(prop);
+	}
+
+	void visit(const Property<float>& prop) override { copy(prop); }
+	void visit(const Property<int>& prop) override { copy(prop); }
+	void visit(const Property<u32>& prop) override { copy(prop); }
+	void visit(const Property<EntityPtr>& prop) override { copy(prop); }
+	void visit(const Property<Vec2>& prop) override { copy(prop); }
+	void visit(const Property<Vec3>& prop) override { copy(prop); }
+	void visit(const Property<IVec3>& prop) override { copy(prop); }
+	void visit(const Property<Vec4>& prop) override { copy(prop); }
+	void visit(const Property<Path>& prop) override { copy(prop); }
+	void visit(const Property<bool>& prop) override { copy(prop); }
+	void visit(const Property<const char*>& prop) override { copy(prop); }
+
+	void visitProperty(const PropertyBase& prop) override {
+		tmp->clear();
+		prop.getValue(src, -1, *tmp);
+		InputMemoryStream blob(*tmp);
+		prop.setValue(dst, -1, blob);
+	}
+
+	ComponentUID src;
+	ComponentUID dst;
+	OutputMemoryStream* tmp;
+};
+
+
+void copyComponent(ComponentUID src, ComponentUID dst, OutputMemoryStream& tmp)
+{
+	ASSERT(src.type == dst.type);
+	const ComponentBase* cmp = getComponent(src.type);
+	if (!cmp) return;
+
+	ComponentCopier copier;
+	copier.src = src;
+	copier.dst = dst;
+	copier.tmp = &tmp;
+	cmp->visit(copier);
+}
+
+
 void registerComponent(const ComponentBase& desc)
 {
 	ComponentLink* link = LUMIX_NEW(*g_allocator, ComponentLink);
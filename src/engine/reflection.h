@@ -84,6 +84,8 @@ LUMIX_ENGINE_API const ComponentBase* getComponent(ComponentType cmp_type);
 LUMIX_ENGINE_API const PropertyBase* getProperty(ComponentType cmp_type, const char* property);
 LUMIX_ENGINE_API const PropertyBase* getProperty(ComponentType cmp_type, u32 property_name_hash);
 LUMIX_ENGINE_API const PropertyBase* getProperty(ComponentType cmp_type, const char* property, const char* subproperty);
+// copies all properties, typed accessors are used where available, others go through tmp
+LUMIX_ENGINE_API void copyComponent(ComponentUID src, ComponentUID dst, OutputMemoryStream& tmp);
 
 
 LUMIX_ENGINE_API ComponentType getComponentType(const char* id);
@@ -125,6 +127,7 @@ struct GetterProxy<R(C::*)(EntityRef, int)>
 		R value = (inst->*getter)(entity, index);
 		writeToStream(stream, value);
 	}
+	static R get(C* inst, Getter getter, EntityRef entity, int index) { return (inst->*getter)(entity, index); }
 };
 
 template <typename R, typename C>
@@ -136,6 +139,7 @@ struct GetterProxy<R(C::*)(EntityRef)>
 		R value = (inst->*getter)(entity);
 		writeToStream(stream, value);
 	}
+	static R get(C* inst, Getter getter, EntityRef entity, int index) { return (inst->*getter)(entity); }
 };
 
 
@@ -151,6 +155,7 @@ struct SetterProxy<void (C::*)(EntityRef, int, A)>
 		auto value = readFromStream<Value>(stream);
 		(inst->*setter)(entity, index, value);
 	}
+	template <typename T> static void set(C* inst, Setter setter, EntityRef entity, int index, const T& value) { (inst->*setter)(entity, index, value); }
 };
 
 template <typename C, typename A>
@@ -163,6 +168,7 @@ struct SetterProxy<void (C::*)(EntityRef, A)>
 		auto value = readFromStream<Value>(stream);
 		(inst->*setter)(entity, value);
 	}
+	template <typename T> static void set(C* inst, Setter setter, EntityRef entity, int index, const T& value) { (inst->*setter)(entity, value); }
 };
 
 
@@ -216,7 +222,15 @@ struct ColorAttribute : IAttribute
 };
 
 
-template <typename T> struct Property : PropertyBase {};
+template <typename T> struct Property : PropertyBase
+{
+	using Getter = T (*)(const PropertyBase& prop, ComponentUID cmp, int index);
+	using Setter = void (*)(const PropertyBase& prop, ComponentUID cmp, int index, const T& value);
+
+	// typed access without going through a stream, null if the property does not provide it (e.g. lua properties)
+	Getter get = nullptr;
+	Setter set = nullptr;
+};
 
 
 struct IBlobProperty : PropertyBase {};
@@ -464,6 +478,22 @@ struct VarProperty : Property<T>
 		stream.read(c.*ptr);
 	}
 
+	static T getDirect(const PropertyBase& prop, ComponentUID cmp, int index)
+	{
+		using C = typename ClassOf<CmpGetter>::Type;
+		const VarProperty& p = static_cast<const VarProperty&>(prop);
+		C* inst = static_cast<C*>(cmp.scene);
+		return (inst->*p.cmp_getter)((EntityRef)cmp.entity).*p.ptr;
+	}
+
+	static void setDirect(const PropertyBase& prop, ComponentUID cmp, int index, const T& value)
+	{
+		using C = typename ClassOf<CmpGetter>::Type;
+		const VarProperty& p = static_cast<const VarProperty&>(prop);
+		C* inst = static_cast<C*>(cmp.scene);
+		(inst->*p.cmp_getter)((EntityRef)cmp.entity).*p.ptr = value;
+	}
+
 	CmpGetter cmp_getter;
 	PtrType ptr;
 	Tuple<Attributes...> attributes;
@@ -492,6 +522,22 @@ struct CommonProperty : Property<T>
 		detail::SetterProxy<Setter>::invoke(stream, inst, setter, (EntityRef)cmp.entity, index);
 	}
 
+	static T getDirect(const PropertyBase& prop, ComponentUID cmp, int index)
+	{
+		using C = typename ClassOf<Getter>::Type;
+		const CommonProperty& p = static_cast<const CommonProperty&>(prop);
+		C* inst = static_cast<C*>(cmp.scene);
+		return detail::GetterProxy<Getter>::get(inst, p.getter, (EntityRef)cmp.entity, index);
+	}
+
+	static void setDirect(const PropertyBase& prop, ComponentUID cmp, int index, const T& value)
+	{
+		using C = typename ClassOf<Getter>::Type;
+		const CommonProperty& p = static_cast<const CommonProperty&>(prop);
+		C* inst = static_cast<C*>(cmp.scene);
+		detail::SetterProxy<Setter>::set(inst, p.setter, (EntityRef)cmp.entity, index, value);
+	}
+
 
 	Tuple<Attributes...> attributes;
 	Getter getter;
@@ -991,6 +1037,8 @@ auto var_property(const char* name, CmpGetter getter, PtrType ptr, Attributes...
 	p.cmp_getter = getter;
 	p.ptr = ptr;
 	p.name = name;
+	p.get = &decltype(p)::getDirect;
+	p.set = &decltype(p)::setDirect;
 	return p;
 }
 
@@ -1005,6 +1053,8 @@ auto property(const char* name, Getter getter, Setter setter, Attributes... attr
 	p.getter = getter;
 	p.setter = setter;
 	p.name = name;
+	p.get = &decltype(p)::getDirect;
+	p.set = &decltype(p)::setDirect;
 	return p;
 }
 
@@ -1,5 +1,6 @@
 #include "engine/resource.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
 #include "engine/path.h"
@@ -76,7 +77,36 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 {
 	m_async_op = FileSystem::AsyncHandle::invalid();
 	if (m_desired_state != State::READY) return;
-	
+
+	CompiledResourceHeader header;
+	if (success && size >= sizeof(header)) memcpy(&header, mem, sizeof(header));
+	if (!success || size < sizeof(header) || header.magic != CompiledResourceHeader::MAGIC) {
+		dataLoaded(size, mem, success);
+		return;
+	}
+
+	const Span<const u8> data(mem + sizeof(header), u32(size - sizeof(header)));
+	if (header.version > CompiledResourceHeader::Version::LATEST) {
+		logError("Core") << getPath() << " has unsupported version";
+		dataLoaded(0, nullptr, false);
+		return;
+	}
+
+	if (header.flags & CompiledResourceHeader::LZ4) {
+		// finishes in ResourceManagerHub::update
+		m_is_loading_async = true;
+		m_resource_manager.getOwner().decompress(*this, header, data);
+		return;
+	}
+
+	dataLoaded(data.length(), data.begin(), true);
+}
+
+
+void Resource::dataLoaded(u64 size, const u8* mem, bool success)
+{
+	if (m_desired_state != State::READY) return;
+
 	ASSERT(m_current_state != State::READY);
 	ASSERT(m_empty_dep_count == 1);
 
@@ -87,7 +117,13 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 		--m_empty_dep_count;
 		++m_failed_dep_count;
 		checkState();
-		m_async_op = FileSystem::AsyncHandle::invalid();
+		return;
+	}
+
+	if (isAsyncLoadSupported()) {
+		// finishes in ResourceManagerHub::update
+		m_is_loading_async = true;
+		m_resource_manager.getOwner().loadAsync(*this, Span(mem, (u32)size));
 		return;
 	}
 
@@ -98,7 +134,20 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 	ASSERT(m_empty_dep_count > 0);
 	--m_empty_dep_count;
 	checkState();
-	m_async_op = FileSystem::AsyncHandle::invalid();
+}
+
+
+void Resource::asyncLoaded(bool success)
+{
+	if (m_desired_state != State::READY) return;
+
+	if (!success || !finalize()) {
+		++m_failed_dep_count;
+	}
+
+	ASSERT(m_empty_dep_count > 0);
+	--m_empty_dep_count;
+	checkState();
 }
 
 
@@ -110,6 +159,10 @@ void Resource::doUnload()
 		fs.cancel(m_async_op);
 		m_async_op = FileSystem::AsyncHandle::invalid();
 	}
+	if (m_is_loading_async) {
+		m_resource_manager.getOwner().cancelAsyncLoad(*this);
+		m_is_loading_async = false;
+	}
 
 	m_desired_state = State::EMPTY;
 	unload();
@@ -148,7 +201,71 @@ void Resource::doLoad()
 	const u32 hash = m_path.getHash();
 	const StaticString<MAX_PATH_LENGTH> res_path(".lumix/assets/", hash, ".res");
 
-	m_async_op = fs.getContent(Path(res_path), cb);
+	m_async_op = fs.getContent(Path(res_path), cb, m_load_priority, m_load_order);
+}
+
+
+void Resource::doHotReload()
+{
+	if (!isReady()) {
+		doFullReload();
+		return;
+	}
+	if (m_async_op.isValid()) return;
+
+	FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
+	FileSystem::ContentCallback cb;
+	cb.bind<&Resource::hotReloadFileLoaded>(this);
+
+	const u32 hash = m_path.getHash();
+	const StaticString<MAX_PATH_LENGTH> res_path(".lumix/assets/", hash, ".res");
+
+	m_async_op = fs.getContent(Path(res_path), cb, m_load_priority, m_load_order);
+}
+
+
+void Resource::doFullReload()
+{
+	doUnload();
+	doLoad();
+}
+
+
+void Resource::hotReloadFileLoaded(u64 size, const u8* mem, bool success)
+{
+	m_async_op = FileSystem::AsyncHandle::invalid();
+	if (!isReady()) {
+		doFullReload();
+		return;
+	}
+
+	CompiledResourceHeader header;
+	if (success && size >= sizeof(header)) memcpy(&header, mem, sizeof(header));
+	if (success && size >= sizeof(header) && header.magic == CompiledResourceHeader::MAGIC) {
+		// compressed data are rare for hot reloadable types, let the full path decompress them
+		if (header.version > CompiledResourceHeader::Version::LATEST || (header.flags & CompiledResourceHeader::LZ4)) {
+			doFullReload();
+			return;
+		}
+		mem += sizeof(header);
+		size -= sizeof(header);
+	}
+
+	if (!success || !hotReload(size, mem)) {
+		logInfo("Core") << "Could not hot reload " << getPath() << ", reloading it fully";
+		doFullReload();
+	}
+}
+
+
+void Resource::setLoadPriority(FileSystem::Priority priority, float order)
+{
+	m_load_priority = priority;
+	m_load_order = order;
+	if (m_async_op.isValid()) {
+		FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
+		fs.setPriority(m_async_op, priority, order);
+	}
 }
 
 
@@ -23,6 +23,29 @@ inline bool isValid(ResourceType type) { return type.type != 0; }
 const ResourceType INVALID_RESOURCE_TYPE("");
 
 
+// compiled resources can start with this header, compressed data are decompressed on a worker before Resource::load(Async)
+#pragma pack(1)
+struct CompiledResourceHeader
+{
+	static constexpr u32 MAGIC = 0x5f52434c; // == 'LCR_'
+	enum class Version : u32 {
+		FIRST,
+
+		LATEST
+	};
+	enum Flags : u32 {
+		LZ4 = 1 << 0 // data are compressed, without this flag they are stored as they are
+	};
+
+	u32 magic = MAGIC;
+	Version version = Version::LATEST;
+	u32 flags = 0;
+	u32 reserved = 0;
+	u64 decompressed_size = 0;
+};
+#pragma pack()
+
+
 struct LUMIX_ENGINE_API Resource
 {
 public:
@@ -51,6 +74,10 @@ public:
 	size_t size() const { return m_size; }
 	const Path& getPath() const { return m_path; }
 	struct ResourceManager& getResourceManager() { return m_resource_manager; }
+	// orders reading and finalizing, lower `order` first within the same priority, e.g. distance to camera
+	void setLoadPriority(FileSystem::Priority priority, float order);
+	FileSystem::Priority getLoadPriority() const { return m_load_priority; }
+	float getLoadOrder() const { return m_load_order; }
 
 	template <auto Function, typename C> void onLoaded(C* instance)
 	{
@@ -68,6 +95,14 @@ protected:
 	virtual void onBeforeEmpty() {}
 	virtual void unload() = 0;
 	virtual bool load(u64 size, const u8* mem) = 0;
+	// two phase loading, if supported, loadAsync is called on a worker instead of load
+	// loadAsync must not create GPU objects or touch other resources, finalize does that on the main thread
+	virtual bool isAsyncLoadSupported() const { return false; }
+	virtual bool loadAsync(u64 size, const u8* mem) { ASSERT(false); return false; }
+	virtual bool finalize() { return true; }
+	// applies changed content to a ready resource in place, returning false falls back to full unload and load
+	virtual bool isHotReloadSupported() const { return false; }
+	virtual bool hotReload(u64 size, const u8* mem) { ASSERT(false); return false; }
 
 	void onCreated(State state);
 	void doUnload();
@@ -87,6 +122,11 @@ protected:
 private:
 	void doLoad();
 	void fileLoaded(u64 size, const u8* mem, bool success);
+	void dataLoaded(u64 size, const u8* mem, bool success);
+	void asyncLoaded(bool success);
+	void doHotReload();
+	void hotReloadFileLoaded(u64 size, const u8* mem, bool success);
+	void doFullReload();
 	void onStateChanged(State old_state, State new_state, Resource&);
 	u32 addRef() { return ++m_ref_count; }
 	u32 remRef() { return --m_ref_count; }
@@ -101,6 +141,12 @@ private:
 	u16 m_failed_dep_count;
 	State m_current_state;
 	FileSystem::AsyncHandle m_async_op;
+	// decompressed or loaded on a worker
+	bool m_is_loading_async = false;
+	// in ResourceManager's cache of unreferenced resources
+	bool m_is_cached = false;
+	FileSystem::Priority m_load_priority = FileSystem::Priority::NORMAL;
+	float m_load_order = 0;
 }; // struct Resource
 
 
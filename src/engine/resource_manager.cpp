@@ -1,7 +1,13 @@
+#include "engine/crt.h"
+#include "engine/file_system.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/lz4.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
 
 
 namespace Lumix
@@ -16,6 +22,7 @@ void ResourceManager::create(ResourceType type, ResourceManagerHub& owner)
 
 void ResourceManager::destroy()
 {
+	setCacheBudget(0);
 	for (auto iter = m_resources.begin(), end = m_resources.end(); iter != end; ++iter)
 	{
 		Resource* resource = iter.value();
@@ -43,6 +50,7 @@ Resource* ResourceManager::get(const Path& path)
 Resource* ResourceManager::load(const Path& path)
 {
 	if (!path.isValid()) return nullptr;
+	MutexGuard lock(m_load_mutex);
 	Resource* resource = get(path);
 
 	if(nullptr == resource)
@@ -51,6 +59,9 @@ Resource* ResourceManager::load(const Path& path)
 		m_resources.insert(path.getHash(), resource);
 	}
 
+	if (resource->m_is_cached) removeFromCache(*resource);
+	if (m_owner->m_is_recording) m_owner->record(*resource);
+
 	if(resource->isEmpty() && resource->m_desired_state == Resource::State::EMPTY)
 	{
 		if (m_owner->onBeforeLoad(*resource) == ResourceManagerHub::LoadHook::Action::DEFERRED)
@@ -74,7 +85,7 @@ void ResourceManager::removeUnreferenced()
 	Array<Resource*> to_remove(m_allocator);
 	for (auto* i : m_resources)
 	{
-		if (i->getRefCount() == 0) to_remove.push(i);
+		if (i->getRefCount() == 0 && !i->m_is_cached) to_remove.push(i);
 	}
 
 	for (auto* i : to_remove)
@@ -86,6 +97,8 @@ void ResourceManager::removeUnreferenced()
 
 void ResourceManager::load(Resource& resource)
 {
+	MutexGuard lock(m_load_mutex);
+	if (resource.m_is_cached) removeFromCache(resource);
 	if(resource.isEmpty() && resource.m_desired_state == Resource::State::EMPTY)
 	{
 		if (m_owner->onBeforeLoad(resource) == ResourceManagerHub::LoadHook::Action::DEFERRED)
@@ -109,12 +122,50 @@ void ResourceManager::unload(Resource& resource)
 {
 	int new_ref_count = resource.remRef();
 	ASSERT(new_ref_count >= 0);
-	if(new_ref_count == 0 && m_is_unload_enabled)
-	{
-		resource.doUnload();
+	if (new_ref_count != 0 || !m_is_unload_enabled) return;
+
+	if (m_cache_budget > 0 && resource.isReady() && resource.size() <= m_cache_budget) {
+		{
+			MutexGuard lock(m_load_mutex);
+			resource.m_is_cached = true;
+			m_cache.push(&resource);
+			m_cache_size += resource.size();
+		}
+		evictCache();
+		return;
+	}
+
+	resource.doUnload();
+}
+
+void ResourceManager::removeFromCache(Resource& resource)
+{
+	ASSERT(resource.m_is_cached);
+	m_cache.eraseItem(&resource);
+	m_cache_size -= resource.size();
+	resource.m_is_cached = false;
+}
+
+void ResourceManager::evictCache()
+{
+	for (;;) {
+		Resource* resource;
+		{
+			MutexGuard lock(m_load_mutex);
+			if (m_cache.empty() || (m_cache_budget > 0 && m_cache_size <= m_cache_budget)) return;
+			resource = m_cache[0];
+			removeFromCache(*resource);
+		}
+		resource->doUnload();
 	}
 }
 
+void ResourceManager::setCacheBudget(u64 bytes)
+{
+	m_cache_budget = bytes;
+	evictCache();
+}
+
 void ResourceManager::reload(const Path& path)
 {
 	Resource* resource = get(path);
@@ -123,6 +174,22 @@ void ResourceManager::reload(const Path& path)
 
 void ResourceManager::reload(Resource& resource)
 {
+	if (resource.m_is_cached) {
+		// nobody uses it, so there's no need to load it again
+		removeFromCache(resource);
+		resource.doUnload();
+		return;
+	}
+	if (resource.isReady() && resource.isHotReloadSupported()) {
+		// stays ready and keeps its GPU objects while the new content is applied
+		if (m_owner->onBeforeLoad(resource) == ResourceManagerHub::LoadHook::Action::DEFERRED) {
+			resource.addRef(); // for hook
+		}
+		else {
+			resource.doHotReload();
+		}
+		return;
+	}
 	resource.doUnload();
 	if (m_owner->onBeforeLoad(resource) == ResourceManagerHub::LoadHook::Action::DEFERRED)
 	{
@@ -142,7 +209,7 @@ void ResourceManager::enableUnload(bool enable)
 
 	for (auto* resource : m_resources)
 	{
-		if (resource->getRefCount() == 0)
+		if (resource->getRefCount() == 0 && !resource->m_is_cached)
 		{
 			resource->doUnload();
 		}
@@ -154,6 +221,7 @@ ResourceManager::ResourceManager(IAllocator& allocator)
 	, m_allocator(allocator)
 	, m_owner(nullptr)
 	, m_is_unload_enabled(true)
+	, m_cache(allocator)
 { }
 
 ResourceManager::~ResourceManager()
@@ -161,15 +229,178 @@ ResourceManager::~ResourceManager()
 	ASSERT(m_resources.empty());
 }
 
+static constexpr u32 RESOURCE_MANIFEST_MAGIC = 0x4d52414c; // == 'LARM'
+
+enum class ResourceManifestVersion : u32 {
+	FIRST,
+
+	LATEST
+};
+
+struct ResourceManagerHub::AsyncLoad
+{
+	AsyncLoad(Resource& resource, IAllocator& allocator)
+		: resource(&resource)
+		, src(allocator)
+		, dst(allocator)
+	{}
+
+	ResourceManagerHub* hub;
+	Resource* resource;
+	Array<u8> src;
+	Array<u8> dst;
+	// src is lz4 compressed, decompressed into dst
+	bool decompress = false;
+	// Resource::loadAsync is called on the worker, resource must not be unloaded while it runs
+	bool load = false;
+	bool decompress_failed = false;
+	bool success = false;
+	bool finished = false;
+	bool canceled = false;
+	JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+};
+
+
 ResourceManagerHub::ResourceManagerHub(IAllocator& allocator) 
 	: m_resource_managers(allocator)
 	, m_allocator(allocator)
 	, m_load_hook(nullptr)
 	, m_file_system(nullptr)
+	, m_async_loads(allocator)
+	, m_recorded(allocator)
+	, m_prefetched(allocator)
 {
 }
 
-ResourceManagerHub::~ResourceManagerHub() = default;
+ResourceManagerHub::~ResourceManagerHub()
+{
+	for (AsyncLoad* d : m_async_loads) {
+		JobSystem::wait(d->signal);
+		LUMIX_DELETE(m_allocator, d);
+	}
+}
+
+
+ResourceManagerHub::AsyncLoad& ResourceManagerHub::pushAsyncLoad(Resource& resource, Span<const u8> data)
+{
+	AsyncLoad* d = LUMIX_NEW(m_allocator, AsyncLoad)(resource, m_allocator);
+	d->hub = this;
+	d->load = resource.isAsyncLoadSupported();
+	// file system frees `data` after the callback returns
+	d->src.resize(data.length());
+	if (data.length() > 0) memcpy(d->src.begin(), data.begin(), data.length());
+	m_async_loads.push(d);
+	return *d;
+}
+
+
+void ResourceManagerHub::decompress(Resource& resource, const CompiledResourceHeader& header, Span<const u8> data)
+{
+	AsyncLoad& d = pushAsyncLoad(resource, data);
+	d.decompress = true;
+	d.dst.resize((u32)header.decompressed_size);
+	JobSystem::run(&d, &asyncLoadJob, &d.signal);
+}
+
+
+void ResourceManagerHub::loadAsync(Resource& resource, Span<const u8> data)
+{
+	AsyncLoad& d = pushAsyncLoad(resource, data);
+	ASSERT(d.load);
+	JobSystem::run(&d, &asyncLoadJob, &d.signal);
+}
+
+
+void ResourceManagerHub::asyncLoadJob(void* ptr)
+{
+	AsyncLoad* d = (AsyncLoad*)ptr;
+	bool success = true;
+	Span<const u8> data(d->src.begin(), d->src.size());
+	if (d->decompress) {
+		PROFILE_BLOCK("decompress resource");
+		success = lz4Decompress(d->src.begin(), d->src.size(), d->dst.begin(), d->dst.size());
+		data = Span<const u8>(d->dst.begin(), d->dst.size());
+	}
+	const bool decompress_failed = !success;
+	if (success && d->load) {
+		PROFILE_BLOCK("load resource");
+		success = d->resource->loadAsync(data.length(), data.begin());
+	}
+	MutexGuard lock(d->hub->m_async_loads_mutex);
+	d->decompress_failed = decompress_failed;
+	d->success = success;
+	d->finished = true;
+}
+
+
+void ResourceManagerHub::cancelAsyncLoad(Resource& resource)
+{
+	for (AsyncLoad* d : m_async_loads) {
+		if (d->resource != &resource) continue;
+		// loadAsync writes into the resource, so it must finish before the resource is unloaded
+		if (d->load) JobSystem::wait(d->signal);
+		d->canceled = true;
+	}
+}
+
+
+void ResourceManagerHub::update()
+{
+	if (!m_prefetched.empty()) releasePrefetched();
+	if (m_async_loads.empty()) return;
+
+	PROFILE_FUNCTION();
+	OS::Timer timer;
+	for (;;) {
+		i32 best = -1;
+		{
+			MutexGuard lock(m_async_loads_mutex);
+			for (i32 i = 0, c = m_async_loads.size(); i < c; ++i) {
+				const AsyncLoad* d = m_async_loads[i];
+				if (!d->finished) continue;
+				if (d->canceled) {
+					best = i;
+					break;
+				}
+				if (best < 0) {
+					best = i;
+					continue;
+				}
+				const Resource* a = d->resource;
+				const Resource* b = m_async_loads[best]->resource;
+				if (a->m_load_priority < b->m_load_priority
+					|| (a->m_load_priority == b->m_load_priority && a->m_load_order < b->m_load_order))
+				{
+					best = i;
+				}
+			}
+		}
+		if (best < 0) break;
+
+		AsyncLoad* d = m_async_loads[best];
+		m_async_loads.erase(best);
+		if (d->canceled) {
+			LUMIX_DELETE(m_allocator, d);
+			continue;
+		}
+
+		Resource* res = d->resource;
+		res->m_is_loading_async = false;
+		if (d->decompress_failed) {
+			logError("Core") << "Failed to decompress " << res->getPath();
+			res->dataLoaded(0, nullptr, false);
+		}
+		else if (d->load) {
+			res->asyncLoaded(d->success);
+		}
+		else {
+			res->dataLoaded(d->dst.size(), d->dst.begin(), true);
+		}
+		LUMIX_DELETE(m_allocator, d);
+
+		if (m_update_max_seconds > 0 && timer.getTimeSinceStart() > m_update_max_seconds) break;
+	}
+}
 
 
 void ResourceManagerHub::init(FileSystem& fs)
@@ -198,8 +429,13 @@ ResourceManager* ResourceManagerHub::get(ResourceType type)
 
 void ResourceManagerHub::LoadHook::continueLoad(Resource& resource)
 {
-	ASSERT(resource.isEmpty());
 	resource.remRef(); // release from hook
+	if (!resource.isEmpty() && resource.isHotReloadSupported()) {
+		// deferred hot reload, the resource could lose its readiness since then
+		resource.doHotReload();
+		return;
+	}
+	ASSERT(resource.isEmpty());
 	resource.m_desired_state = Resource::State::EMPTY;
 	resource.doLoad();
 }
@@ -241,6 +477,93 @@ void ResourceManagerHub::enableUnload(bool enable)
 	}
 }
 
+void ResourceManagerHub::startRecording()
+{
+	MutexGuard lock(m_recorded_mutex);
+	m_recorded.clear();
+	m_is_recording = true;
+}
+
+void ResourceManagerHub::stopRecording()
+{
+	m_is_recording = false;
+}
+
+void ResourceManagerHub::record(Resource& resource)
+{
+	MutexGuard lock(m_recorded_mutex);
+	const u32 hash = resource.getPath().getHash();
+	if (m_recorded.find(hash).isValid()) return;
+	m_recorded.insert(hash, {resource.getType().type, resource.getPath()});
+}
+
+void ResourceManagerHub::writeManifest(OutputMemoryStream& blob)
+{
+	MutexGuard lock(m_recorded_mutex);
+	blob.write(RESOURCE_MANIFEST_MAGIC);
+	blob.write(ResourceManifestVersion::LATEST);
+	const u64 count_pos = blob.getPos();
+	u32 count = 0;
+	blob.write(count);
+	for (const RecordedLoad& rec : m_recorded) {
+		auto manager_iter = m_resource_managers.find(rec.type);
+		if (!manager_iter.isValid()) continue;
+		auto res_iter = manager_iter.value()->getResourceTable().find(rec.path.getHash());
+		if (!res_iter.isValid() || res_iter.value()->getRefCount() == 0) continue;
+
+		blob.write(rec.type);
+		blob.writeString(rec.path.c_str());
+		++count;
+	}
+	memcpy((u8*)blob.getMutableData() + count_pos, &count, sizeof(count));
+}
+
+bool ResourceManagerHub::prefetch(const Path& manifest_path)
+{
+	PROFILE_FUNCTION();
+	Array<u8> data(m_allocator);
+	if (!m_file_system->getContentSync(manifest_path, Ref(data))) return false;
+
+	InputMemoryStream manifest(data.begin(), data.byte_size());
+	u32 magic;
+	ResourceManifestVersion version;
+	u32 count;
+	manifest.read(magic);
+	manifest.read(version);
+	manifest.read(count);
+	if (magic != RESOURCE_MANIFEST_MAGIC || version > ResourceManifestVersion::LATEST) {
+		logError("Engine") << "Unsupported resource manifest " << manifest_path;
+		return false;
+	}
+
+	m_prefetched.reserve(m_prefetched.size() + count);
+	for (u32 i = 0; i < count; ++i) {
+		ResourceType type;
+		char path[MAX_PATH_LENGTH];
+		manifest.read(type.type);
+		if (!manifest.readString(Span(path))) {
+			logError("Engine") << "Corrupted resource manifest " << manifest_path;
+			return false;
+		}
+		ResourceManager* manager = get(type);
+		if (!manager) continue;
+		Resource* res = manager->load(Path(path));
+		if (res) m_prefetched.push(res);
+	}
+	return true;
+}
+
+void ResourceManagerHub::releasePrefetched()
+{
+	for (Resource* res : m_prefetched) {
+		if (res->isEmpty()) return;
+	}
+	for (Resource* res : m_prefetched) {
+		res->getResourceManager().unload(*res);
+	}
+	m_prefetched.clear();
+}
+
 void ResourceManagerHub::reload(const Path& path)
 {
 	for (auto* manager : m_resource_managers)
@@ -1,7 +1,11 @@
 #pragma once
 
 
+#include "engine/array.h"
 #include "engine/hash_map.h"
+#include "engine/job_system.h"
+#include "engine/path.h"
+#include "engine/sync.h"
 
 
 namespace Lumix
@@ -31,6 +35,12 @@ public:
 	void reload(Resource& resource);
 	ResourceTable& getResourceTable() { return m_resources; }
 
+	// ready resources without references are kept loaded until their total size exceeds the budget,
+	// least recently used are unloaded first, 0 disables the cache
+	void setCacheBudget(u64 bytes);
+	u64 getCacheBudget() const { return m_cache_budget; }
+	u64 getCacheSize() const { return m_cache_size; }
+
 	explicit ResourceManager(IAllocator& allocator);
 	virtual ~ResourceManager();
 	ResourceManagerHub& getOwner() const { return *m_owner; }
@@ -40,12 +50,20 @@ protected:
 	virtual Resource* createResource(const Path& path) = 0;
 	virtual void destroyResource(Resource& resource) = 0;
 	Resource* get(const Path& path);
+	void removeFromCache(Resource& resource);
+	void evictCache();
 
 protected:
 	IAllocator& m_allocator;
 	ResourceTable m_resources;
 	ResourceManagerHub* m_owner;
+	// scenes load resources while they are deserialized in parallel
+	Mutex m_load_mutex;
 	bool m_is_unload_enabled;
+	// oldest first
+	Array<Resource*> m_cache;
+	u64 m_cache_size = 0;
+	u64 m_cache_budget = 0;
 };
 
 
@@ -67,6 +85,10 @@ public:
 	~ResourceManagerHub();
 
 	void init(struct FileSystem& fs);
+	// finishes loading of resources decompressed or loaded on workers, in order of their load priority
+	void update();
+	// limits time spent in one update, 0 means no limit, at least one resource is always finished
+	void setUpdateBudget(float max_seconds) { m_update_max_seconds = max_seconds; }
 
 	IAllocator& getAllocator() { return m_allocator; }
 	ResourceManager* get(ResourceType type);
@@ -88,14 +110,47 @@ public:
 	void removeUnreferenced();
 	void enableUnload(bool enable);
 
+	// remembers every resource requested while recording, including dependencies loaded by other resources
+	void startRecording();
+	void stopRecording();
+	// flat list of recorded resources which are still referenced
+	void writeManifest(struct OutputMemoryStream& blob);
+	// requests all resources from a manifest at once, instead of discovering dependencies one level at a time
+	// prefetched resources are held until all of them are loaded, returns false if there's no such manifest
+	bool prefetch(const Path& manifest_path);
+
 	FileSystem& getFileSystem() { return *m_file_system; }
 
 private:
+	friend struct Resource;
+	friend struct ResourceManager;
+	struct AsyncLoad;
+
+	struct RecordedLoad {
+		u32 type;
+		Path path;
+	};
+
 	Resource* load(ResourceManager& manager, const Path& path);
+	void decompress(Resource& resource, const struct CompiledResourceHeader& header, Span<const u8> data);
+	void loadAsync(Resource& resource, Span<const u8> data);
+	void cancelAsyncLoad(Resource& resource);
+	AsyncLoad& pushAsyncLoad(Resource& resource, Span<const u8> data);
+	static void asyncLoadJob(void* ptr);
+	void record(Resource& resource);
+	void releasePrefetched();
+
 	IAllocator& m_allocator;
 	ResourceManagerTable m_resource_managers;
 	FileSystem* m_file_system;
 	LoadHook* m_load_hook;
+	Array<AsyncLoad*> m_async_loads;
+	Mutex m_async_loads_mutex;
+	float m_update_max_seconds = 0;
+	HashMap<u32, RecordedLoad> m_recorded;
+	Mutex m_recorded_mutex;
+	volatile bool m_is_recording = false;
+	Array<Resource*> m_prefetched;
 };
 
 
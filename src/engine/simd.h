@@ -4,17 +4,23 @@
 #include "engine/lumix.h"
 
 
-#ifdef _WIN32
+// SSE is baseline on x64, NEON is baseline on arm64
+#if defined _WIN32 || defined __SSE2__
+	#define LUMIX_SIMD_SSE
 	#include <xmmintrin.h>
+#elif defined __aarch64__ && defined __ARM_NEON
+	#define LUMIX_SIMD_NEON
+	#include <arm_neon.h>
 #else
 	#include <math.h>
+	#include <string.h>
 #endif
 
 namespace Lumix
 {
 
 
-#ifdef _WIN32
+#if defined LUMIX_SIMD_SSE
 	using float4 = __m128;
 
 
@@ -42,6 +48,12 @@ namespace Lumix
 	}
 
 
+	LUMIX_FORCE_INLINE void f4StoreUnaligned(void* dest, float4 src)
+	{
+		_mm_storeu_ps((float*)dest, src);
+	}
+
+
 	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
 	{
 		return _mm_movemask_ps(a);
@@ -101,6 +113,145 @@ namespace Lumix
 		return _mm_max_ps(a, b);
 	}
 
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		return _mm_and_ps(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Xor(float4 a, float4 b)
+	{
+		return _mm_xor_ps(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+	}
+
+#elif defined LUMIX_SIMD_NEON
+	using float4 = float32x4_t;
+
+
+	LUMIX_FORCE_INLINE float4 f4LoadUnaligned(const void* src)
+	{
+		return vld1q_f32((const float*)src);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Load(const void* src)
+	{
+		return vld1q_f32((const float*)src);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Splat(float value)
+	{
+		return vdupq_n_f32(value);
+	}
+
+
+	LUMIX_FORCE_INLINE void f4Store(void* dest, float4 src)
+	{
+		vst1q_f32((float*)dest, src);
+	}
+
+
+	LUMIX_FORCE_INLINE void f4StoreUnaligned(void* dest, float4 src)
+	{
+		vst1q_f32((float*)dest, src);
+	}
+
+
+	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
+	{
+		const uint32x4_t signs = vshrq_n_u32(vreinterpretq_u32_f32(a), 31);
+		const int32x4_t shifts = {0, 1, 2, 3};
+		return (int)vaddvq_u32(vshlq_u32(signs, shifts));
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Add(float4 a, float4 b)
+	{
+		return vaddq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Sub(float4 a, float4 b)
+	{
+		return vsubq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Mul(float4 a, float4 b)
+	{
+		return vmulq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Div(float4 a, float4 b)
+	{
+		return vdivq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Rcp(float4 a)
+	{
+		// one Newton-Raphson step to get close to SSE's precision
+		const float4 estimate = vrecpeq_f32(a);
+		return vmulq_f32(estimate, vrecpsq_f32(a, estimate));
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Sqrt(float4 a)
+	{
+		return vsqrtq_f32(a);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Rsqrt(float4 a)
+	{
+		const float4 estimate = vrsqrteq_f32(a);
+		return vmulq_f32(estimate, vrsqrtsq_f32(vmulq_f32(a, estimate), estimate));
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Min(float4 a, float4 b)
+	{
+		return vminq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Max(float4 a, float4 b)
+	{
+		return vmaxq_f32(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Xor(float4 a, float4 b)
+	{
+		return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float32x4x2_t ab = vtrnq_f32(a, b);
+		const float32x4x2_t cd = vtrnq_f32(c, d);
+		a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+		b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+		c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+		d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+	}
+
 #else 
 	struct float4
 	{
@@ -132,6 +283,12 @@ namespace Lumix
 	}
 
 
+	LUMIX_FORCE_INLINE void f4StoreUnaligned(void* dest, float4 src)
+	{
+		(*(float4*)dest) = src;
+	}
+
+
 	LUMIX_FORCE_INLINE int f4MoveMask(float4 a)
 	{
 		return (a.w < 0 ? (1 << 3) : 0) | 
@@ -239,6 +396,41 @@ namespace Lumix
 		};
 	}
 
+
+	LUMIX_FORCE_INLINE float4 f4And(float4 a, float4 b)
+	{
+		u32 ua[4], ub[4];
+		memcpy(ua, &a, sizeof(a));
+		memcpy(ub, &b, sizeof(b));
+		for (u32 i = 0; i < 4; ++i) ua[i] &= ub[i];
+		memcpy(&a, ua, sizeof(a));
+		return a;
+	}
+
+
+	LUMIX_FORCE_INLINE float4 f4Xor(float4 a, float4 b)
+	{
+		u32 ua[4], ub[4];
+		memcpy(ua, &a, sizeof(a));
+		memcpy(ub, &b, sizeof(b));
+		for (u32 i = 0; i < 4; ++i) ua[i] ^= ub[i];
+		memcpy(&a, ua, sizeof(a));
+		return a;
+	}
+
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float4 ta = {a.x, b.x, c.x, d.x};
+		const float4 tb = {a.y, b.y, c.y, d.y};
+		const float4 tc = {a.z, b.z, c.z, d.z};
+		const float4 td = {a.w, b.w, c.w, d.w};
+		a = ta;
+		b = tb;
+		c = tc;
+		d = td;
+	}
+
 #endif
 
 
@@ -0,0 +1,157 @@
+#include "engine/atomic.h"
+#include "engine/profiler.h"
+#include "engine/task_graph.h"
+
+
+namespace Lumix
+{
+
+
+TaskGraph::TaskGraph(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_nodes(allocator)
+	, m_edges(allocator)
+	, m_successors(allocator)
+{}
+
+
+TaskGraph::NodeHandle TaskGraph::addNode(const char* name_literal, void* user_data, Task task, u8 worker_index)
+{
+	Node& node = m_nodes.emplace();
+	node.name = name_literal;
+	node.user_data = user_data;
+	node.task = task;
+	node.worker_index = worker_index;
+	node.dependencies_count = 0;
+	node.successors_offset = 0;
+	node.successors_count = 0;
+	node.pending = 0;
+	node.graph = this;
+	m_is_dirty = true;
+	return m_nodes.size() - 1;
+}
+
+
+void TaskGraph::addEdge(NodeHandle from, NodeHandle to)
+{
+	ASSERT(from < (u32)m_nodes.size());
+	ASSERT(to < (u32)m_nodes.size());
+	ASSERT(from != to);
+	m_edges.push({from, to});
+	m_is_dirty = true;
+}
+
+
+void TaskGraph::clear()
+{
+	ASSERT(!JobSystem::isValid(m_finished));
+	m_nodes.clear();
+	m_edges.clear();
+	m_successors.clear();
+	m_is_dirty = false;
+}
+
+
+void TaskGraph::compile()
+{
+	for (Node& node : m_nodes) {
+		node.dependencies_count = 0;
+		node.successors_count = 0;
+	}
+	m_successors.resize(m_edges.size());
+
+	for (const Edge& edge : m_edges) {
+		++m_nodes[edge.from].successors_count;
+		++m_nodes[edge.to].dependencies_count;
+	}
+	
+	u32 offset = 0;
+	for (Node& node : m_nodes) {
+		node.successors_offset = offset;
+		offset += node.successors_count;
+		node.successors_count = 0;
+	}
+
+	for (const Edge& edge : m_edges) {
+		Node& node = m_nodes[edge.from];
+		m_successors[node.successors_offset + node.successors_count] = edge.to;
+		++node.successors_count;
+	}
+
+	#ifdef LUMIX_DEBUG
+		// check there are no cycles, Kahn's algorithm
+		Array<u32> in_degree(m_allocator);
+		Array<NodeHandle> stack(m_allocator);
+		in_degree.resize(m_nodes.size());
+		for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+			in_degree[i] = m_nodes[i].dependencies_count;
+			if (in_degree[i] == 0) stack.push(i);
+		}
+		u32 visited = 0;
+		while (!stack.empty()) {
+			const Node& node = m_nodes[stack.back()];
+			stack.pop();
+			++visited;
+			for (u32 i = 0; i < node.successors_count; ++i) {
+				const NodeHandle s = m_successors[node.successors_offset + i];
+				--in_degree[s];
+				if (in_degree[s] == 0) stack.push(s);
+			}
+		}
+		ASSERT(visited == (u32)m_nodes.size());
+	#endif
+
+	m_is_dirty = false;
+}
+
+
+void TaskGraph::execute(void* data)
+{
+	Node& node = *(Node*)data;
+	TaskGraph& graph = *node.graph;
+	{
+		PROFILE_BLOCK(node.name);
+		node.task(node.user_data);
+	}
+
+	for (u32 i = 0; i < node.successors_count; ++i) {
+		Node& successor = graph.m_nodes[graph.m_successors[node.successors_offset + i]];
+		if (atomicDecrement(&successor.pending) == 0) {
+			graph.runNode(successor);
+		}
+	}
+}
+
+
+void TaskGraph::runNode(Node& node)
+{
+	// m_finished is not zero while any node is running, so this only increments it
+	JobSystem::runEx(&node, &execute, &m_finished, JobSystem::INVALID_HANDLE, node.worker_index, m_priority);
+}
+
+
+void TaskGraph::run(JobSystem::Priority priority)
+{
+	PROFILE_FUNCTION();
+	if (m_nodes.empty()) return;
+	if (m_is_dirty) compile();
+
+	ASSERT(!JobSystem::isValid(m_finished));
+	m_priority = priority;
+	for (Node& node : m_nodes) {
+		node.pending = node.dependencies_count;
+	}
+
+	// keep m_finished alive until all roots are started
+	JobSystem::incSignal(&m_finished);
+	for (Node& node : m_nodes) {
+		if (node.dependencies_count == 0) runNode(node);
+	}
+	JobSystem::decSignal(m_finished);
+
+	JobSystem::wait(m_finished);
+	m_finished = JobSystem::INVALID_HANDLE;
+}
+
+
+} // namespace Lumix
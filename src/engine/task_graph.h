@@ -0,0 +1,64 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/job_system.h"
+
+
+namespace Lumix
+{
+
+
+// Graph of tasks with dependencies, built once and run as many times as needed (e.g. every frame).
+// Nodes without dependencies start immediately, other nodes start as soon as all their dependencies finish.
+struct LUMIX_ENGINE_API TaskGraph
+{
+	using NodeHandle = u32;
+	using Task = void (*)(void* user_data);
+
+	explicit TaskGraph(IAllocator& allocator);
+	TaskGraph(const TaskGraph&) = delete;
+	void operator=(const TaskGraph&) = delete;
+
+	NodeHandle addNode(const char* name_literal, void* user_data, Task task, u8 worker_index = JobSystem::ANY_WORKER);
+	// `to` starts after `from` is finished
+	void addEdge(NodeHandle from, NodeHandle to);
+	void clear();
+	u32 getNodesCount() const { return m_nodes.size(); }
+
+	// runs all nodes and waits until they are finished, must be called from a job
+	void run(JobSystem::Priority priority = JobSystem::Priority::NORMAL);
+
+private:
+	struct Node {
+		const char* name;
+		void* user_data;
+		Task task;
+		u8 worker_index;
+		u32 dependencies_count;
+		u32 successors_offset;
+		u32 successors_count;
+		volatile i32 pending;
+		TaskGraph* graph;
+	};
+
+	struct Edge {
+		NodeHandle from;
+		NodeHandle to;
+	};
+
+	void compile();
+	void runNode(Node& node);
+	static void execute(void* data);
+
+	IAllocator& m_allocator;
+	Array<Node> m_nodes;
+	Array<Edge> m_edges;
+	Array<NodeHandle> m_successors;
+	JobSystem::SignalHandle m_finished = JobSystem::INVALID_HANDLE;
+	JobSystem::Priority m_priority = JobSystem::Priority::NORMAL;
+	bool m_is_dirty = false;
+};
+
+
+} // namespace Lumix
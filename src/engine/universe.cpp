@@ -1,9 +1,11 @@
 #include "universe.h"
 #include "engine/crc32.h"
+#include "engine/crt.h"
 #include "engine/plugin.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 
 
@@ -49,13 +51,21 @@ Universe::Universe(IAllocator& allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_destroyed(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
+	, m_is_transform_set(m_allocator)
+	, m_entities_activated(m_allocator)
+	, m_is_inactive(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
-	, m_transforms(m_allocator)
+	, m_positions(m_allocator)
+	, m_rotations(m_allocator)
+	, m_scales(m_allocator)
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
-	m_transforms.reserve(RESERVED_ENTITIES_COUNT);
+	m_positions.reserve(RESERVED_ENTITIES_COUNT);
+	m_rotations.reserve(RESERVED_ENTITIES_COUNT);
+	m_scales.reserve(RESERVED_ENTITIES_COUNT);
 }
 
 
@@ -98,13 +108,13 @@ void Universe::removeScene(IScene* scene)
 
 const DVec3& Universe::getPosition(EntityRef entity) const
 {
-	return m_transforms[entity.index].pos;
+	return m_positions[entity.index];
 }
 
 
 const Quat& Universe::getRotation(EntityRef entity) const
 {
-	return m_transforms[entity.index].rot;
+	return m_rotations[entity.index];
 }
 
 
@@ -112,6 +122,7 @@ void Universe::transformEntity(EntityRef entity, bool update_local)
 {
 	const int hierarchy_idx = m_entities[entity.index].hierarchy;
 	m_entity_moved.invoke(entity);
+	m_entities_moved.invoke(Span<const EntityRef>(&entity, 1));
 	if (hierarchy_idx >= 0) {
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
 		const Transform my_transform = getTransform(entity);
@@ -125,8 +136,7 @@ void Universe::transformEntity(EntityRef entity, bool update_local)
 		{
 			const Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
 			const Transform abs_tr = my_transform * child_h.local_transform;
-			Transform& child_data = m_transforms[child.index];
-			child_data = abs_tr;
+			setTransformData(child.index, abs_tr);
 			transformEntity((EntityRef)child, false);
 
 			child = child_h.next_sibling;
@@ -137,14 +147,14 @@ void Universe::transformEntity(EntityRef entity, bool update_local)
 
 void Universe::setRotation(EntityRef entity, const Quat& rot)
 {
-	m_transforms[entity.index].rot = rot;
+	m_rotations[entity.index] = rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setRotation(EntityRef entity, float x, float y, float z, float w)
 {
-	m_transforms[entity.index].rot.set(x, y, z, w);
+	m_rotations[entity.index].set(x, y, z, w);
 	transformEntity(entity, true);
 }
 
@@ -155,13 +165,50 @@ bool Universe::hasEntity(EntityRef entity) const
 }
 
 
+bool Universe::isActive(EntityRef entity) const
+{
+	return entity.index >= m_is_inactive.size() || !m_is_inactive[entity.index];
+}
+
+
+void Universe::setActive(Span<const EntityRef> entities, bool active)
+{
+	PROFILE_FUNCTION();
+	if (m_is_inactive.size() < m_entities.size()) {
+		const u32 old_size = m_is_inactive.size();
+		m_is_inactive.resize(m_entities.size());
+		for (u32 i = old_size; i < (u32)m_entities.size(); ++i) m_is_inactive[i] = false;
+	}
+
+	Array<EntityRef> changed(m_allocator);
+	changed.reserve(entities.length());
+	Array<EntityRef> stack(m_allocator);
+	for (EntityRef root : entities) {
+		stack.push(root);
+		while (!stack.empty()) {
+			const EntityRef e = stack.back();
+			stack.pop();
+			if (m_is_inactive[e.index] == active) {
+				m_is_inactive[e.index] = !active;
+				changed.push(e);
+			}
+			for (EntityPtr child = getFirstChild(e); child.isValid(); child = getNextSibling((EntityRef)child)) {
+				stack.push((EntityRef)child);
+			}
+		}
+	}
+
+	if (!changed.empty()) m_entities_activated.invoke(Span<const EntityRef>(changed.begin(), changed.end()), active);
+}
+
+
 void Universe::setTransformKeepChildren(EntityRef entity, const Transform& transform)
 {
-	Transform& tmp = m_transforms[entity.index];
-	tmp = transform;
+	setTransformData(entity.index, transform);
 	
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
 	entityTransformed().invoke(entity);
+	m_entities_moved.invoke(Span<const EntityRef>(&entity, 1));
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -186,56 +233,131 @@ void Universe::setTransformKeepChildren(EntityRef entity, const Transform& trans
 
 void Universe::setTransform(EntityRef entity, const Transform& transform)
 {
-	Transform& tmp = m_transforms[entity.index];
-	tmp = transform;
+	setTransformData(entity.index, transform);
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(EntityRef entity, const RigidTransform& transform)
 {
-	auto& tmp = m_transforms[entity.index];
-	tmp.pos = transform.pos;
-	tmp.rot = transform.rot;
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(EntityRef entity, const DVec3& pos, const Quat& rot, float scale)
 {
-	auto& tmp = m_transforms[entity.index];
-	tmp.pos = pos;
-	tmp.rot = rot;
-	tmp.scale = scale;
+	m_positions[entity.index] = pos;
+	m_rotations[entity.index] = rot;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
-const Transform& Universe::getTransform(EntityRef entity) const
+void Universe::propagateTransform(EntityRef entity, Array<EntityRef>& moved)
 {
-	return m_transforms[entity.index];
+	moved.push(entity);
+	const Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
+	const Transform my_transform = getTransform(entity);
+	EntityPtr child = h.first_child;
+	while (child.isValid()) {
+		Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
+		if (m_is_transform_set[child.index]) {
+			child_h.local_transform = my_transform.inverted() * getTransform((EntityRef)child);
+		}
+		else {
+			setTransformData(child.index, my_transform * child_h.local_transform);
+		}
+		propagateTransform((EntityRef)child, moved);
+		child = child_h.next_sibling;
+	}
+}
+
+
+void Universe::setTransforms(Span<const EntityRef> entities, Span<const Transform> transforms)
+{
+	PROFILE_FUNCTION();
+	ASSERT(entities.length() == transforms.length());
+	if (m_is_transform_set.size() < (u32)m_entities.size()) {
+		const u32 old_size = m_is_transform_set.size();
+		m_is_transform_set.resize(m_entities.size());
+		for (u32 i = old_size; i < (u32)m_entities.size(); ++i) m_is_transform_set[i] = false;
+	}
+
+	for (u32 i = 0, c = entities.length(); i < c; ++i) {
+		const EntityRef e = entities[i];
+		setTransformData(e.index, transforms[i]);
+		m_is_transform_set[e.index] = true;
+	}
+
+	Array<EntityRef> moved(getFrameAllocator());
+	moved.reserve(entities.length());
+	for (EntityRef e : entities) {
+		const int hierarchy_idx = m_entities[e.index].hierarchy;
+		if (hierarchy_idx < 0) {
+			moved.push(e);
+			continue;
+		}
+
+		// subtree is updated from the topmost ancestor which is in `entities`
+		const Hierarchy& h = m_hierarchy[hierarchy_idx];
+		bool is_top = true;
+		for (EntityPtr p = h.parent; p.isValid(); p = m_hierarchy[m_entities[p.index].hierarchy].parent) {
+			if (m_is_transform_set[p.index]) {
+				is_top = false;
+				break;
+			}
+		}
+		if (!is_top) continue;
+
+		if (h.parent.isValid()) {
+			const Transform parent_tr = getTransform((EntityRef)h.parent);
+			m_hierarchy[hierarchy_idx].local_transform = parent_tr.inverted() * getTransform(e);
+		}
+		propagateTransform(e, moved);
+	}
+	
+	for (EntityRef e : entities) m_is_transform_set[e.index] = false;
+
+	for (EntityRef e : moved) m_entity_moved.invoke(e);
+	m_entities_moved.invoke(Span<const EntityRef>(moved.begin(), moved.end()));
+}
+
+
+Transform Universe::getTransform(EntityRef entity) const
+{
+	return {m_positions[entity.index], m_rotations[entity.index], m_scales[entity.index]};
+}
+
+
+void Universe::setTransformData(i32 index, const Transform& transform)
+{
+	m_positions[index] = transform.pos;
+	m_rotations[index] = transform.rot;
+	m_scales[index] = transform.scale;
 }
 
 
 Matrix Universe::getRelativeMatrix(EntityRef entity, const DVec3& base_pos) const
 {
-	const Transform& transform = m_transforms[entity.index];
-	Matrix mtx = transform.rot.toMatrix();
-	mtx.setTranslation((transform.pos - base_pos).toFloat());
-	mtx.multiply3x3(transform.scale);
+	Matrix mtx = m_rotations[entity.index].toMatrix();
+	mtx.setTranslation((m_positions[entity.index] - base_pos).toFloat());
+	mtx.multiply3x3(m_scales[entity.index]);
 	return mtx;
 }
 
 
 void Universe::setPosition(EntityRef entity, const DVec3& pos)
 {
-	m_transforms[entity.index].pos = pos;
+	m_positions[entity.index] = pos;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setEntityName(EntityRef entity, const char* name)
 {
+	++m_entities_version;
 	int name_idx = m_entities[entity.index].name;
 	if (name_idx < 0)
 	{
@@ -243,10 +365,13 @@ void Universe::setEntityName(EntityRef entity, const char* name)
 		m_entities[entity.index].name = m_names.size();
 		EntityName& name_data = m_names.emplace();
 		name_data.entity = entity;
+		memset(name_data.name, 0, sizeof(name_data.name));
 		copyString(name_data.name, name);
 	}
 	else
 	{
+		// names are serialized as raw blocks, keep the padding deterministic
+		memset(m_names[name_idx].name, 0, sizeof(m_names[name_idx].name));
 		copyString(m_names[name_idx].name, name);
 	}
 }
@@ -296,13 +421,14 @@ void Universe::emplaceEntity(EntityRef entity)
 	while (m_entities.size() <= entity.index)
 	{
 		EntityData& data = m_entities.emplace();
-		Transform& tr = m_transforms.emplace();
+		m_positions.emplace();
+		m_rotations.emplace();
+		m_scales.push(-1);
 		data.valid = false;
 		data.prev = -1;
 		data.name = -1;
 		data.hierarchy = -1;
 		data.next = m_first_free_slot;
-		tr.scale = -1;
 		if (m_first_free_slot >= 0)
 		{
 			m_entities[m_first_free_slot].prev = m_entities.size() - 1;
@@ -322,14 +448,14 @@ void Universe::emplaceEntity(EntityRef entity)
 		m_entities[m_entities[entity.index].next].prev= m_entities[entity.index].prev;
 	}
 	EntityData& data = m_entities[entity.index];
-	Transform& tr = m_transforms[entity.index];
-	tr.pos = DVec3(0, 0, 0);
-	tr.rot.set(0, 0, 0, 1);
-	tr.scale = 1;
+	m_positions[entity.index] = DVec3(0, 0, 0);
+	m_rotations[entity.index].set(0, 0, 0, 1);
+	m_scales[entity.index] = 1;
 	data.name = -1;
 	data.hierarchy = -1;
-	data.components = 0;
+	data.components = {};
 	data.valid = true;
+	++m_entities_version;
 }
 
 
@@ -337,11 +463,9 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 {
 	EntityData* data;
 	EntityRef entity;
-	Transform* tr;
 	if (m_first_free_slot >= 0)
 	{
 		data = &m_entities[m_first_free_slot];
-		tr = &m_transforms[m_first_free_slot];
 		entity.index = m_first_free_slot;
 		if (data->next >= 0) m_entities[data->next].prev = -1;
 		m_first_free_slot = data->next;
@@ -350,15 +474,16 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 	{
 		entity.index = m_entities.size();
 		data = &m_entities.emplace();
-		tr = &m_transforms.emplace();
+		m_positions.emplace();
+		m_rotations.emplace();
+		m_scales.emplace();
 	}
-	tr->pos = position;
-	tr->rot = rotation;
-	tr->scale = 1;
+	setTransformData(entity.index, {position, rotation, 1});
 	data->name = -1;
 	data->hierarchy = -1;
-	data->components = 0;
+	data->components = {};
 	data->valid = true;
+	++m_entities_version;
 
 	return entity;
 }
@@ -368,6 +493,7 @@ void Universe::destroyEntity(EntityRef entity)
 {
 	EntityData& entity_data = m_entities[entity.index];
 	ASSERT(entity_data.valid);
+	++m_entities_version;
 	for (EntityPtr first_child = getFirstChild(entity); first_child.isValid(); first_child = getFirstChild(entity))
 	{
 		setParent(INVALID_ENTITY, (EntityRef)first_child);
@@ -375,18 +501,13 @@ void Universe::destroyEntity(EntityRef entity)
 	setParent(INVALID_ENTITY, entity);
 	
 
-	u64 mask = entity_data.components;
-	for (int i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i)
+	for (int i = entity_data.components.next(0); i >= 0; i = entity_data.components.next(i + 1))
 	{
-		if ((mask & ((u64)1 << i)) != 0)
-		{
-			auto original_mask = mask;
-			IScene* scene = m_component_type_map[i].scene;
-			auto destroy_method = m_component_type_map[i].destroy;
-			(scene->*destroy_method)(entity);
-			mask = entity_data.components;
-			ASSERT(original_mask != mask);
-		}
+		const ComponentMask original_mask = entity_data.components;
+		IScene* scene = m_component_type_map[i].scene;
+		auto destroy_method = m_component_type_map[i].destroy;
+		(scene->*destroy_method)(entity);
+		ASSERT(original_mask != entity_data.components);
 	}
 
 	entity_data.next = m_first_free_slot;
@@ -407,6 +528,7 @@ void Universe::destroyEntity(EntityRef entity)
 	}
 
 	m_first_free_slot = entity.index;
+	if (entity.index < m_is_inactive.size()) m_is_inactive[entity.index] = false;
 	m_entity_destroyed.invoke(entity);
 }
 
@@ -475,6 +597,7 @@ void Universe::setParent(EntityPtr new_parent, EntityRef child)
 		logError("Engine") << "Hierarchy can not contains a cycle.";
 		return;
 	}
+	++m_hierarchy_version;
 
 	auto collectGarbage = [this](EntityRef entity) {
 		Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
@@ -636,40 +759,60 @@ float Universe::getLocalScale(EntityRef entity) const
 }
 
 
+// old files start with the entity count, which can never be 0xffFFffFF
+static const u32 UNIVERSE_VERSION_MARKER = 0xffFFffFF;
+
+
+enum class UniverseVersion : u32
+{
+	BULK,
+
+	LATEST
+};
+
+
 void Universe::serialize(IOutputStream& serializer)
 {
-	serializer.write((u32)m_entities.size());
+	PROFILE_FUNCTION();
+	serializer.write(UNIVERSE_VERSION_MARKER);
+	serializer.write(UniverseVersion::LATEST);
 
+	Array<EntityRef> entities(m_allocator);
+	entities.reserve(m_entities.size());
 	for (u32 i = 0, c = m_entities.size(); i < c; ++i) {
-		if (!m_entities[i].valid) continue;
-		const EntityRef e = {(i32)i};
-		serializer.write(e);
-		serializer.write(m_transforms[i]);
+		if (m_entities[i].valid) entities.push({(i32)i});
 	}
-	serializer.write(INVALID_ENTITY);
 
-	serializer.write((u32)m_names.size());
-	for (const EntityName& name : m_names) {
-		serializer.write(name.entity);
-		serializer.writeString(name.name);
+	serializer.write((u32)m_entities.size());
+	serializer.write((u32)entities.size());
+	if (!entities.empty()) {
+		// no holes, entity list is implicit
+		if (entities.size() != m_entities.size()) serializer.write(entities.begin(), entities.byte_size());
+		Array<Transform> transforms(m_allocator);
+		transforms.resize(entities.size());
+		for (u32 i = 0, c = entities.size(); i < c; ++i) {
+			transforms[i] = getTransform(entities[i]);
+		}
+		serializer.write(transforms.begin(), transforms.byte_size());
 	}
 
+	serializer.write((u32)m_names.size());
+	if (!m_names.empty()) serializer.write(m_names.begin(), m_names.byte_size());
+
 	serializer.write((u32)m_hierarchy.size());
 	if (!m_hierarchy.empty()) serializer.write(&m_hierarchy[0], m_hierarchy.byte_size());
 }
 
 
-void Universe::deserialize(IInputStream& serializer, Ref<EntityMap> entity_map)
+void Universe::deserializeLegacy(IInputStream& serializer, u32 to_reserve, Ref<EntityMap> entity_map)
 {
-	u32 to_reserve;
-	serializer.read(to_reserve);
 	entity_map->reserve(to_reserve);
 
 	for (EntityPtr e = serializer.read<EntityPtr>(); e.isValid(); e = serializer.read<EntityPtr>()) {
 		EntityRef orig = (EntityRef)e;
 		const EntityRef new_e = createEntity({0, 0, 0}, {0, 0, 0, 1});
 		entity_map->set(orig, new_e);
-		serializer.read(m_transforms[new_e.index]);
+		setTransformData(new_e.index, serializer.read<Transform>());
 	}
 
 	u32 count;
@@ -682,76 +825,178 @@ void Universe::deserialize(IInputStream& serializer, Ref<EntityMap> entity_map)
 		m_entities[name.entity.index].name = m_names.size() - 1;
 	}
 
+	deserializeHierarchy(serializer, entity_map);
+}
+
+
+void Universe::deserializeHierarchy(IInputStream& serializer, Ref<EntityMap> entity_map)
+{
+	u32 count;
 	serializer.read(count);
 	const u32 old_count = m_hierarchy.size();
 	m_hierarchy.resize(count + old_count);
+	++m_hierarchy_version;
 	if (count > 0) {
 		serializer.read(&m_hierarchy[old_count], sizeof(m_hierarchy[0]) * count);
 
+		const EntityMap& map = entity_map.value;
 		for (u32 i = old_count; i < count + old_count; ++i) {
-			m_hierarchy[i].entity = entity_map->get(m_hierarchy[i].entity);
-			m_hierarchy[i].first_child = entity_map->get(m_hierarchy[i].first_child);
-			m_hierarchy[i].next_sibling = entity_map->get(m_hierarchy[i].next_sibling);
-			m_hierarchy[i].parent = entity_map->get(m_hierarchy[i].parent);
-			m_entities[m_hierarchy[i].entity.index].hierarchy = i;
+			Hierarchy& h = m_hierarchy[i];
+			h.entity = map.get(h.entity);
+			h.first_child = map.get(h.first_child);
+			h.next_sibling = map.get(h.next_sibling);
+			h.parent = map.get(h.parent);
+			m_entities[h.entity.index].hierarchy = i;
+		}
+	}
+}
+
+
+bool Universe::deserialize(IInputStream& serializer, Ref<EntityMap> entity_map)
+{
+	PROFILE_FUNCTION();
+	const u32 marker = serializer.read<u32>();
+	if (marker != UNIVERSE_VERSION_MARKER) {
+		deserializeLegacy(serializer, marker, entity_map);
+		return true;
+	}
+
+	const UniverseVersion version = serializer.read<UniverseVersion>();
+	if (version > UniverseVersion::LATEST) {
+		logError("Engine") << "Universe has unsupported version " << (u32)version;
+		return false;
+	}
+
+	const u32 src_size = serializer.read<u32>();
+	const u32 count = serializer.read<u32>();
+	const bool dense = count == src_size;
+
+	Array<EntityRef> src_entities(m_allocator);
+	if (!dense) {
+		src_entities.resize(count);
+		if (count > 0) serializer.read(src_entities.begin(), src_entities.byte_size());
+	}
+
+	Array<EntityPtr>& map = entity_map->m_map;
+	const u32 map_old_size = map.size();
+	if (map_old_size < src_size) {
+		map.resize(src_size);
+		for (u32 i = map_old_size; i < src_size; ++i) map[i] = INVALID_ENTITY;
+	}
+
+	if (m_entities.empty()) {
+		// fresh universe, keep the original indices so transforms are just copied and the map is identity
+		m_entities.resize(src_size);
+		m_positions.resize(src_size);
+		m_rotations.resize(src_size);
+		m_scales.resize(src_size);
+		for (EntityData& data : m_entities) {
+			data.valid = false;
+			data.name = -1;
+			data.hierarchy = -1;
+		}
+
+		if (dense) {
+			Array<Transform> transforms(m_allocator);
+			transforms.resize(count);
+			if (count > 0) serializer.read(transforms.begin(), transforms.byte_size());
+			for (u32 i = 0; i < count; ++i) {
+				setTransformData(i, transforms[i]);
+				m_entities[i].valid = true;
+				m_entities[i].components = {};
+				map[i] = EntityRef{(i32)i};
+			}
+		}
+		else {
+			for (EntityRef e : src_entities) {
+				setTransformData(e.index, serializer.read<Transform>());
+				m_entities[e.index].valid = true;
+				m_entities[e.index].components = {};
+				map[e.index] = e;
+			}
+
+			m_first_free_slot = -1;
+			for (i32 i = src_size - 1; i >= 0; --i) {
+				EntityData& data = m_entities[i];
+				if (data.valid) continue;
+				data.prev = -1;
+				data.next = m_first_free_slot;
+				if (m_first_free_slot >= 0) m_entities[m_first_free_slot].prev = i;
+				m_first_free_slot = i;
+				m_scales[i] = -1;
+			}
+		}
+	}
+	else {
+		m_entities.reserve(m_entities.size() + count);
+		m_positions.reserve(m_positions.size() + count);
+		m_rotations.reserve(m_rotations.size() + count);
+		m_scales.reserve(m_scales.size() + count);
+		for (u32 i = 0; i < count; ++i) {
+			const EntityRef orig = dense ? EntityRef{(i32)i} : src_entities[i];
+			const EntityRef new_e = createEntity({0, 0, 0}, {0, 0, 0, 1});
+			map[orig.index] = new_e;
+			setTransformData(new_e.index, serializer.read<Transform>());
 		}
 	}
+
+	const u32 names_count = serializer.read<u32>();
+	const u32 old_names_count = m_names.size();
+	m_names.resize(old_names_count + names_count);
+	if (names_count > 0) {
+		serializer.read(&m_names[old_names_count], sizeof(m_names[0]) * names_count);
+		for (u32 i = old_names_count; i < old_names_count + names_count; ++i) {
+			EntityName& name = m_names[i];
+			name.entity = entity_map->get(name.entity);
+			m_entities[name.entity.index].name = i;
+		}
+	}
+
+	deserializeHierarchy(serializer, entity_map);
+	return true;
 }
 
 
 void Universe::setScale(EntityRef entity, float scale)
 {
-	m_transforms[entity.index].scale = scale;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 float Universe::getScale(EntityRef entity) const
 {
-	return m_transforms[entity.index].scale;
+	return m_scales[entity.index];
 }
 
 
 ComponentUID Universe::getFirstComponent(EntityRef entity) const
 {
-	u64 mask = m_entities[entity.index].components;
-	for (int i = 0; i < ComponentType::MAX_TYPES_COUNT; ++i)
-	{
-		if ((mask & (u64(1) << i)) != 0)
-		{
-			IScene* scene = m_component_type_map[i].scene;
-			return ComponentUID(entity, {i}, scene);
-		}
-	}
-	return ComponentUID::INVALID;
+	const int i = m_entities[entity.index].components.next(0);
+	if (i < 0) return ComponentUID::INVALID;
+	IScene* scene = m_component_type_map[i].scene;
+	return ComponentUID(entity, {i}, scene);
 }
 
 
 ComponentUID Universe::getNextComponent(const ComponentUID& cmp) const
 {
-	u64 mask = m_entities[cmp.entity.index].components;
-	for (int i = cmp.type.index + 1; i < ComponentType::MAX_TYPES_COUNT; ++i)
-	{
-		if ((mask & (u64(1) << i)) != 0)
-		{
-			IScene* scene = m_component_type_map[i].scene;
-			return ComponentUID(cmp.entity, {i}, scene);
-		}
-	}
-	return ComponentUID::INVALID;
+	const int i = m_entities[cmp.entity.index].components.next(cmp.type.index + 1);
+	if (i < 0) return ComponentUID::INVALID;
+	IScene* scene = m_component_type_map[i].scene;
+	return ComponentUID(cmp.entity, {i}, scene);
 }
 
 
 ComponentUID Universe::getComponent(EntityRef entity, ComponentType component_type) const
 {
-	u64 mask = m_entities[entity.index].components;
-	if ((mask & (u64(1) << component_type.index)) == 0) return ComponentUID::INVALID;
+	if (!m_entities[entity.index].components.has(component_type)) return ComponentUID::INVALID;
 	IScene* scene = m_component_type_map[component_type.index].scene;
 	return ComponentUID(entity, component_type, scene);
 }
 
 
-u64 Universe::getComponentsMask(EntityRef entity) const
+const ComponentMask& Universe::getComponentsMask(EntityRef entity) const
 {
 	return m_entities[entity.index].components;
 }
@@ -759,18 +1004,16 @@ u64 Universe::getComponentsMask(EntityRef entity) const
 
 bool Universe::hasComponent(EntityRef entity, ComponentType component_type) const
 {
-	u64 mask = m_entities[entity.index].components;
-	return (mask & (u64(1) << component_type.index)) != 0;
+	return m_entities[entity.index].components.has(component_type);
 }
 
 
 void Universe::onComponentDestroyed(EntityRef entity, ComponentType component_type, IScene* scene)
 {
-	auto mask = m_entities[entity.index].components;
-	auto old_mask = mask;
-	mask &= ~((u64)1 << component_type.index);
-	ASSERT(old_mask != mask);
-	m_entities[entity.index].components = mask;
+	ComponentMask& mask = m_entities[entity.index].components;
+	ASSERT(mask.has(component_type));
+	mask.remove(component_type);
+	++m_entities_version;
 	m_component_destroyed.invoke(ComponentUID(entity, component_type, scene));
 }
 
@@ -794,7 +1037,9 @@ void Universe::destroyComponent(EntityRef entity, ComponentType type)
 void Universe::onComponentCreated(EntityRef entity, ComponentType component_type, IScene* scene)
 {
 	ComponentUID cmp(entity, component_type, scene);
-	m_entities[entity.index].components |= (u64)1 << component_type.index;
+	MutexGuard lock(m_component_added_mutex);
+	m_entities[entity.index].components.add(component_type);
+	++m_entities_version;
 	m_component_added.invoke(cmp);
 }
 
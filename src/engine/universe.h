@@ -7,6 +7,7 @@
 #include "engine/lumix.h"
 #include "engine/math.h"
 #include "engine/string.h"
+#include "engine/sync.h"
 
 
 namespace Lumix
@@ -53,7 +54,7 @@ public:
 		{
 			struct 
 			{
-				u64 components;
+				ComponentMask components;
 			};
 			struct
 			{
@@ -69,7 +70,10 @@ public:
 	~Universe();
 
 	IAllocator& getAllocator() { return m_allocator; }
-	const Transform* getTransforms() const { return m_transforms.begin(); }
+	// indexed by entity index, stored separately so loops which need only positions do not touch the rest
+	const DVec3* getPositions() const { return m_positions.begin(); }
+	const Quat* getRotations() const { return m_rotations.begin(); }
+	const float* getScales() const { return m_scales.begin(); }
 	void emplaceEntity(EntityRef entity);
 	EntityRef createEntity(const DVec3& position, const Quat& rotation);
 	void destroyEntity(EntityRef entity);
@@ -77,8 +81,8 @@ public:
 	void destroyComponent(EntityRef entity, ComponentType type);
 	void onComponentCreated(EntityRef entity, ComponentType component_type, IScene* scene);
 	void onComponentDestroyed(EntityRef entity, ComponentType component_type, IScene* scene);
-    u64 getComponentsMask(EntityRef entity) const;
-    bool hasComponent(EntityRef entity, ComponentType component_type) const;
+	const ComponentMask& getComponentsMask(EntityRef entity) const;
+	bool hasComponent(EntityRef entity, ComponentType component_type) const;
 	ComponentUID getComponent(EntityRef entity, ComponentType type) const;
 	ComponentUID getFirstComponent(EntityRef entity) const;
 	ComponentUID getNextComponent(const ComponentUID& cmp) const;
@@ -91,12 +95,23 @@ public:
 		m_component_type_map[type.index].destroy = static_cast<Destroy>(destroy);
 	}
 
+	// calls f(EntityRef) for every entity which has all components in `mask`
+	template <typename F> void forEachEntity(const ComponentMask& mask, F&& f) const {
+		for (int i = 0, c = m_entities.size(); i < c; ++i) {
+			const EntityData& data = m_entities[i];
+			if (data.valid && data.components.contains(mask)) f(EntityRef{i});
+		}
+	}
+
 	EntityPtr getFirstEntity() const;
 	EntityPtr getNextEntity(EntityRef entity) const;
 	const char* getEntityName(EntityRef entity) const;
 	EntityPtr findByName(EntityPtr parent, const char* name);
 	void setEntityName(EntityRef entity, const char* name);
 	bool hasEntity(EntityRef entity) const;
+	// inactive entities keep their components, but scenes do not simulate or render them, descendants are included
+	void setActive(Span<const EntityRef> entities, bool active);
+	bool isActive(EntityRef entity) const;
 
 	bool isDescendant(EntityRef ancestor, EntityRef descendant) const;
 	EntityPtr getParent(EntityRef entity) const;
@@ -105,6 +120,10 @@ public:
 	Transform getLocalTransform(EntityRef entity) const;
 	float getLocalScale(EntityRef entity) const;
 	void setParent(EntityPtr parent, EntityRef child);
+	// changes whenever any entity is reparented, so users can cache data derived from the hierarchy
+	u32 getHierarchyVersion() const { return m_hierarchy_version; }
+	// changes whenever an entity is created, destroyed, renamed or its components change
+	u32 getEntitiesVersion() const { return m_entities_version; }
 	void setLocalPosition(EntityRef entity, const DVec3& pos);
 	void setLocalRotation(EntityRef entity, const Quat& rot);
 	void setLocalTransform(EntityRef entity, const Transform& transform);
@@ -115,7 +134,10 @@ public:
 	void setTransform(EntityRef entity, const Transform& transform);
 	void setTransformKeepChildren(EntityRef entity, const Transform& transform);
 	void setTransform(EntityRef entity, const DVec3& pos, const Quat& rot, float scale);
-	const Transform& getTransform(EntityRef entity) const;
+	// sets global transforms of many entities, descendants are updated in a single pass and
+	// entitiesTransformed is invoked once with all moved entities, including descendants
+	void setTransforms(Span<const EntityRef> entities, Span<const Transform> transforms);
+	Transform getTransform(EntityRef entity) const;
 	void setRotation(EntityRef entity, float x, float y, float z, float w);
 	void setRotation(EntityRef entity, const Quat& rot);
 	void setPosition(EntityRef entity, const DVec3& pos);
@@ -130,12 +152,15 @@ public:
 	}
 
 	DelegateList<void(EntityRef)>& entityTransformed() { return m_entity_moved; }
+	DelegateList<void(Span<const EntityRef>)>& entitiesTransformed() { return m_entities_moved; }
 	DelegateList<void(EntityRef)>& entityDestroyed() { return m_entity_destroyed; }
+	// entities whose state changed, including descendants
+	DelegateList<void(Span<const EntityRef>, bool)>& entitiesActivated() { return m_entities_activated; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentAdded() { return m_component_added; }
 
 	void serialize(struct IOutputStream& serializer);
-	void deserialize(struct IInputStream& serializer, Ref<EntityMap> entity_map);
+	bool deserialize(struct IInputStream& serializer, Ref<EntityMap> entity_map);
 
 	IScene* getScene(ComponentType type) const;
 	IScene* getScene(u32 hash) const;
@@ -146,6 +171,10 @@ public:
 private:
 	void transformEntity(EntityRef entity, bool update_local);
 	void updateGlobalTransform(EntityRef entity);
+	void propagateTransform(EntityRef entity, Array<EntityRef>& moved);
+	void setTransformData(i32 index, const Transform& transform);
+	void deserializeLegacy(struct IInputStream& serializer, u32 to_reserve, Ref<EntityMap> entity_map);
+	void deserializeHierarchy(struct IInputStream& serializer, Ref<EntityMap> entity_map);
 
 	struct Hierarchy
 	{
@@ -167,15 +196,26 @@ private:
 	IAllocator& m_allocator;
 	ComponentTypeEntry m_component_type_map[ComponentType::MAX_TYPES_COUNT];
 	Array<IScene*> m_scenes;
-	Array<Transform> m_transforms;
+	Array<DVec3> m_positions;
+	Array<Quat> m_rotations;
+	Array<float> m_scales;
 	Array<EntityData> m_entities;
 	Array<Hierarchy> m_hierarchy;
 	Array<EntityName> m_names;
 	DelegateList<void(EntityRef)> m_entity_moved;
+	DelegateList<void(Span<const EntityRef>)> m_entities_moved;
+	Array<bool> m_is_transform_set;
 	DelegateList<void(EntityRef)> m_entity_destroyed;
+	DelegateList<void(Span<const EntityRef>, bool)> m_entities_activated;
+	// indexed by entity, can be smaller than m_entities
+	Array<bool> m_is_inactive;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
+	// scenes can be deserialized in parallel
+	Mutex m_component_added_mutex;
 	int m_first_free_slot;
+	u32 m_hierarchy_version = 0;
+	u32 m_entities_version = 0;
 	StaticString<64> m_name;
 };
 
@@ -0,0 +1,462 @@
+#include "engine/universe_snapshot.h"
+#include "engine/crt.h"
+#include "engine/hash.h"
+#include "engine/log.h"
+#include "engine/profiler.h"
+#include "engine/reflection.h"
+#include "engine/stream.h"
+#include "engine/universe.h"
+
+
+namespace Lumix
+{
+
+
+// 10 bits for each of the three smallest components, 2 bits for the index of the largest one
+static constexpr u32 ROTATION_COMPONENT_BITS = 10;
+static constexpr float ROTATION_COMPONENT_RANGE = 0.70710678f; // 1 / sqrt(2)
+
+
+namespace
+{
+
+	struct BitWriter
+	{
+		explicit BitWriter(OutputMemoryStream& stream) : stream(stream) {}
+
+		void write(u32 value, u32 bits_count)
+		{
+			ASSERT(bits_count <= 32);
+			const u64 mask = (u64(1) << bits_count) - 1;
+			bits |= (u64(value) & mask) << count;
+			count += bits_count;
+			while (count >= 8) {
+				stream.write(u8(bits));
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		// 7 bits per group, the highest bit of a group tells whether another group follows
+		void writeVarUint(u64 value)
+		{
+			do {
+				const u32 group = u32(value & 0x7f);
+				value >>= 7;
+				write(group | (value ? 0x80 : 0), 8);
+			} while (value);
+		}
+
+		void writeVarInt(i64 value) { writeVarUint((u64(value) << 1) ^ u64(value >> 63)); }
+
+		void flush()
+		{
+			if (count > 0) stream.write(u8(bits));
+			bits = 0;
+			count = 0;
+		}
+
+		OutputMemoryStream& stream;
+		u64 bits = 0;
+		u32 count = 0;
+	};
+
+
+	struct BitReader
+	{
+		BitReader(const u8* data, u64 size) : data(data), size(size) {}
+
+		u32 read(u32 bits_count)
+		{
+			ASSERT(bits_count <= 32);
+			u32 res = 0;
+			for (u32 i = 0; i < bits_count; ++i, ++pos) {
+				if ((pos >> 3) >= size) {
+					overflow = true;
+					return 0;
+				}
+				res |= u32((data[pos >> 3] >> (pos & 7)) & 1) << i;
+			}
+			return res;
+		}
+
+		u64 readVarUint()
+		{
+			u64 res = 0;
+			for (u32 shift = 0; shift < 64; shift += 7) {
+				const u32 group = read(8);
+				res |= u64(group & 0x7f) << shift;
+				if ((group & 0x80) == 0 || overflow) break;
+			}
+			return res;
+		}
+
+		i64 readVarInt()
+		{
+			const u64 v = readVarUint();
+			return i64(v >> 1) ^ -i64(v & 1);
+		}
+
+		u64 getBytesCount() const { return (pos + 7) >> 3; }
+
+		const u8* data;
+		u64 size;
+		u64 pos = 0;
+		bool overflow = false;
+	};
+
+} // anonymous namespace
+
+
+SnapshotBase::SnapshotBase(Universe& universe, IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_universe(universe)
+	, m_properties(allocator)
+	, m_states(allocator)
+{}
+
+
+bool SnapshotBase::trackProperty(ComponentType cmp_type, const char* property)
+{
+	if (m_properties.size() >= MAX_PROPERTIES) {
+		logError("Engine") << "Too many replicated properties";
+		return false;
+	}
+	const Reflection::PropertyBase* prop = Reflection::getProperty(cmp_type, property);
+	if (!prop) {
+		logError("Engine") << "Property " << property << " not found";
+		return false;
+	}
+	TrackedProperty& tracked = m_properties.emplace(m_allocator);
+	tracked.cmp_type = cmp_type;
+	tracked.prop = prop;
+	return true;
+}
+
+
+u32 SnapshotBase::packRotation(const Quat& rot)
+{
+	float q[] = { rot.x, rot.y, rot.z, rot.w };
+	u32 largest = 0;
+	for (u32 i = 1; i < 4; ++i) {
+		if (fabsf(q[i]) > fabsf(q[largest])) largest = i;
+	}
+	// q and -q are the same rotation, so the largest component can be assumed positive
+	const float sign = q[largest] < 0 ? -1.f : 1.f;
+	const u32 max_value = (1 << ROTATION_COMPONENT_BITS) - 1;
+	u32 res = largest;
+	u32 shift = 2;
+	for (u32 i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const float t = (q[i] * sign / ROTATION_COMPONENT_RANGE) * 0.5f + 0.5f;
+		const u32 v = u32(clamp(t, 0.f, 1.f) * max_value + 0.5f);
+		res |= v << shift;
+		shift += ROTATION_COMPONENT_BITS;
+	}
+	return res;
+}
+
+
+Quat SnapshotBase::unpackRotation(u32 packed)
+{
+	const u32 largest = packed & 3;
+	const u32 max_value = (1 << ROTATION_COMPONENT_BITS) - 1;
+	float q[4];
+	float sum = 0;
+	u32 shift = 2;
+	for (u32 i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		const u32 v = (packed >> shift) & max_value;
+		q[i] = (v / float(max_value) * 2 - 1) * ROTATION_COMPONENT_RANGE;
+		sum += q[i] * q[i];
+		shift += ROTATION_COMPONENT_BITS;
+	}
+	q[largest] = sqrtf(maximum(1 - sum, 0.f));
+	Quat res(q[0], q[1], q[2], q[3]);
+	res.normalize();
+	return res;
+}
+
+
+void SnapshotBase::quantize(const DVec3& pos, i64 (&res)[3]) const
+{
+	const double inv_precision = 1.0 / m_precision;
+	res[0] = i64(floor(pos.x * inv_precision + 0.5));
+	res[1] = i64(floor(pos.y * inv_precision + 0.5));
+	res[2] = i64(floor(pos.z * inv_precision + 0.5));
+}
+
+
+SnapshotEncoder::SnapshotEncoder(Universe& universe, IAllocator& allocator)
+	: SnapshotBase(universe, allocator)
+	, m_flags(allocator)
+	, m_dirty_properties(allocator)
+	, m_known(allocator)
+	, m_dirty(allocator)
+	, m_destroyed(allocator)
+{
+	universe.entityTransformed().bind<&SnapshotEncoder::onEntityTransformed>(this);
+	universe.entitiesTransformed().bind<&SnapshotEncoder::onEntitiesTransformed>(this);
+	universe.entityDestroyed().bind<&SnapshotEncoder::onEntityDestroyed>(this);
+}
+
+
+SnapshotEncoder::~SnapshotEncoder()
+{
+	m_universe.entityTransformed().unbind<&SnapshotEncoder::onEntityTransformed>(this);
+	m_universe.entitiesTransformed().unbind<&SnapshotEncoder::onEntitiesTransformed>(this);
+	m_universe.entityDestroyed().unbind<&SnapshotEncoder::onEntityDestroyed>(this);
+}
+
+
+void SnapshotEncoder::markDirty(EntityRef entity, u32 flags)
+{
+	while (m_flags.size() <= entity.index) {
+		m_flags.push(0);
+		m_dirty_properties.push(0);
+		m_known.push(false);
+	}
+	if (m_flags[entity.index] == 0) m_dirty.push(entity);
+	m_flags[entity.index] |= flags;
+}
+
+
+void SnapshotEncoder::onEntityTransformed(EntityRef entity)
+{
+	markDirty(entity, POSITION | ROTATION | SCALE);
+}
+
+
+void SnapshotEncoder::onEntitiesTransformed(Span<const EntityRef> entities)
+{
+	for (EntityRef e : entities) markDirty(e, POSITION | ROTATION | SCALE);
+}
+
+
+void SnapshotEncoder::onEntityDestroyed(EntityRef entity)
+{
+	if (entity.index >= m_known.size() || !m_known[entity.index]) return;
+	m_known[entity.index] = false;
+	m_destroyed.push(entity);
+}
+
+
+// entities created since the last encode are sent whole
+void SnapshotEncoder::refreshEntities()
+{
+	const u32 version = m_universe.getEntitiesVersion();
+	if (version == m_entities_version) return;
+	m_entities_version = version;
+
+	for (EntityPtr e = m_universe.getFirstEntity(); e.isValid(); e = m_universe.getNextEntity((EntityRef)e)) {
+		const EntityRef entity = (EntityRef)e;
+		if (entity.index < m_known.size() && m_known[entity.index]) continue;
+		markDirty(entity, NEW | POSITION | ROTATION | SCALE);
+		m_known[entity.index] = true;
+		while (m_states.size() <= entity.index) m_states.emplace();
+		m_states[entity.index] = {{0, 0, 0}, 0, 0};
+		for (TrackedProperty& prop : m_properties) {
+			if (entity.index < prop.hashes.size()) prop.hashes[entity.index] = 0;
+		}
+	}
+}
+
+
+void SnapshotEncoder::encode(OutputMemoryStream& blob)
+{
+	PROFILE_FUNCTION();
+	refreshEntities();
+
+	OutputMemoryStream tmp(m_allocator);
+	for (u32 i = 0, c = m_properties.size(); i < c; ++i) {
+		TrackedProperty& prop = m_properties[i];
+		ComponentUID cmp;
+		cmp.type = prop.cmp_type;
+		cmp.scene = m_universe.getScene(prop.cmp_type);
+		if (!cmp.scene) continue;
+		m_universe.forEachEntity(ComponentMask::of(prop.cmp_type), [&](EntityRef e){
+			cmp.entity = e;
+			tmp.clear();
+			prop.prop->getValue(cmp, -1, tmp);
+			const u64 hash = hash64(tmp.getData(), (u32)tmp.getPos());
+			while (prop.hashes.size() <= e.index) prop.hashes.push(0);
+			if (prop.hashes[e.index] == hash) return;
+			prop.hashes[e.index] = hash;
+			markDirty(e, PROPERTIES);
+			m_dirty_properties[e.index] |= 1u << i;
+		});
+	}
+
+	qsort(m_dirty.begin(), m_dirty.size(), sizeof(m_dirty[0]), [](const void* a, const void* b) -> int {
+		return ((const EntityRef*)a)->index - ((const EntityRef*)b)->index;
+	});
+	qsort(m_destroyed.begin(), m_destroyed.size(), sizeof(m_destroyed[0]), [](const void* a, const void* b) -> int {
+		return ((const EntityRef*)a)->index - ((const EntityRef*)b)->index;
+	});
+
+	struct Record {
+		EntityRef entity;
+		u32 flags;
+		i64 pos[3];
+		u32 rot;
+	};
+	Array<Record> records(m_allocator);
+	records.reserve(m_dirty.size());
+	for (EntityRef e : m_dirty) {
+		u32 flags = m_flags[e.index];
+		m_flags[e.index] = 0;
+		if (!m_known[e.index]) continue;
+
+		EntityState& state = m_states[e.index];
+		const Transform& tr = m_universe.getTransform(e);
+		Record r;
+		r.entity = e;
+		quantize(tr.pos, r.pos);
+		r.rot = packRotation(tr.rot);
+		if (!(flags & NEW)) {
+			if (r.pos[0] == state.pos[0] && r.pos[1] == state.pos[1] && r.pos[2] == state.pos[2]) flags &= ~POSITION;
+			if (r.rot == state.rot) flags &= ~ROTATION;
+			if (tr.scale == state.scale) flags &= ~SCALE;
+		}
+		if (flags == 0) continue;
+		r.flags = flags;
+		records.push(r);
+	}
+	m_dirty.clear();
+
+	BitWriter writer(blob);
+	writer.writeVarUint(m_destroyed.size());
+	i32 prev = -1;
+	for (EntityRef e : m_destroyed) {
+		writer.writeVarUint(e.index - prev);
+		prev = e.index;
+	}
+	m_destroyed.clear();
+
+	writer.writeVarUint(records.size());
+	prev = -1;
+	for (const Record& r : records) {
+		EntityState& state = m_states[r.entity.index];
+		writer.writeVarUint(r.entity.index - prev);
+		prev = r.entity.index;
+		writer.write(r.flags, FLAGS_BITS);
+		if (r.flags & POSITION) {
+			for (u32 i = 0; i < 3; ++i) {
+				writer.writeVarInt(r.pos[i] - state.pos[i]);
+				state.pos[i] = r.pos[i];
+			}
+		}
+		if (r.flags & ROTATION) {
+			writer.write(r.rot, 32);
+			state.rot = r.rot;
+		}
+		if (r.flags & SCALE) {
+			const float scale = m_universe.getScale(r.entity);
+			u32 scale_bits;
+			memcpy(&scale_bits, &scale, sizeof(scale_bits));
+			writer.write(scale_bits, 32);
+			state.scale = scale;
+		}
+		if (r.flags & PROPERTIES) {
+			const u32 props = m_dirty_properties[r.entity.index];
+			m_dirty_properties[r.entity.index] = 0;
+			writer.write(props, m_properties.size());
+			for (u32 i = 0, c = m_properties.size(); i < c; ++i) {
+				if ((props & (1u << i)) == 0) continue;
+				const TrackedProperty& prop = m_properties[i];
+				ComponentUID cmp(r.entity, prop.cmp_type, m_universe.getScene(prop.cmp_type));
+				tmp.clear();
+				prop.prop->getValue(cmp, -1, tmp);
+				writer.writeVarUint(tmp.getPos());
+				const u8* data = (const u8*)tmp.getData();
+				for (u64 j = 0; j < tmp.getPos(); ++j) writer.write(data[j], 8);
+			}
+		}
+	}
+	writer.flush();
+}
+
+
+SnapshotDecoder::SnapshotDecoder(Universe& universe, IAllocator& allocator)
+	: SnapshotBase(universe, allocator)
+{}
+
+
+bool SnapshotDecoder::decode(InputMemoryStream& blob)
+{
+	PROFILE_FUNCTION();
+	const u8* data = (const u8*)blob.getData() + blob.getPosition();
+	BitReader reader(data, blob.size() - blob.getPosition());
+
+	const u64 destroyed_count = reader.readVarUint();
+	i32 index = -1;
+	for (u64 i = 0; i < destroyed_count && !reader.overflow; ++i) {
+		index += (i32)reader.readVarUint();
+		const EntityRef e = {index};
+		if (m_universe.hasEntity(e)) m_universe.destroyEntity(e);
+	}
+
+	OutputMemoryStream tmp(m_allocator);
+	const u64 records_count = reader.readVarUint();
+	index = -1;
+	for (u64 i = 0; i < records_count && !reader.overflow; ++i) {
+		index += (i32)reader.readVarUint();
+		const EntityRef e = {index};
+		const u32 flags = reader.read(FLAGS_BITS);
+		while (m_states.size() <= index) m_states.emplace();
+		EntityState& state = m_states[index];
+		if (flags & NEW) {
+			if (!m_universe.hasEntity(e)) m_universe.emplaceEntity(e);
+			state = {{0, 0, 0}, 0, 0};
+		}
+		else if (!m_universe.hasEntity(e)) {
+			logError("Engine") << "Snapshot references unknown entity " << index;
+			return false;
+		}
+
+		Transform tr = m_universe.getTransform(e);
+		if (flags & POSITION) {
+			for (u32 j = 0; j < 3; ++j) state.pos[j] += reader.readVarInt();
+			tr.pos = DVec3(state.pos[0] * (double)m_precision, state.pos[1] * (double)m_precision, state.pos[2] * (double)m_precision);
+		}
+		if (flags & ROTATION) {
+			state.rot = reader.read(32);
+			tr.rot = unpackRotation(state.rot);
+		}
+		if (flags & SCALE) {
+			const u32 scale_bits = reader.read(32);
+			memcpy(&state.scale, &scale_bits, sizeof(state.scale));
+			tr.scale = state.scale;
+		}
+		if (flags & (POSITION | ROTATION | SCALE)) {
+			// descendants are in the snapshot too if they moved
+			m_universe.setTransformKeepChildren(e, tr);
+		}
+		if (flags & PROPERTIES) {
+			const u32 props = reader.read(m_properties.size());
+			for (u32 j = 0, c = m_properties.size(); j < c; ++j) {
+				if ((props & (1u << j)) == 0) continue;
+				const TrackedProperty& prop = m_properties[j];
+				const u64 size = reader.readVarUint();
+				tmp.clear();
+				for (u64 k = 0; k < size && !reader.overflow; ++k) tmp.write(u8(reader.read(8)));
+
+				IScene* scene = m_universe.getScene(prop.cmp_type);
+				if (!scene) continue;
+				if (!m_universe.hasComponent(e, prop.cmp_type)) m_universe.createComponent(prop.cmp_type, e);
+				InputMemoryStream value(tmp);
+				prop.prop->setValue(ComponentUID(e, prop.cmp_type, scene), -1, value);
+			}
+		}
+	}
+
+	if (reader.overflow) {
+		logError("Engine") << "Corrupted snapshot";
+		return false;
+	}
+	blob.skip(reader.getBytesCount());
+	return true;
+}
+
+
+} // namespace Lumix
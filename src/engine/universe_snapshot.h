@@ -0,0 +1,107 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/lumix.h"
+#include "engine/math.h"
+
+
+namespace Lumix
+{
+
+
+struct InputMemoryStream;
+struct OutputMemoryStream;
+struct Universe;
+namespace Reflection { struct PropertyBase; }
+
+
+// compact deltas of universe state, e.g. for network replication
+// positions are quantized to `precision` meters, rotations are packed as smallest three in 32 bits,
+// tracked reflected properties are sent only when their serialized value changes
+// encoder and decoder must track the same properties in the same order and use the same precision,
+// every encoded snapshot must be decoded, in order, since each one is a delta to the previous one
+struct LUMIX_ENGINE_API SnapshotBase
+{
+	SnapshotBase(Universe& universe, IAllocator& allocator);
+
+	// only simple (not array or blob) properties, at most MAX_PROPERTIES
+	bool trackProperty(ComponentType cmp_type, const char* property);
+	void setPositionPrecision(float precision) { m_precision = precision; }
+
+	static constexpr u32 MAX_PROPERTIES = 32;
+
+protected:
+	enum Flags : u32 {
+		NEW = 1 << 0,
+		POSITION = 1 << 1,
+		ROTATION = 1 << 2,
+		SCALE = 1 << 3,
+		PROPERTIES = 1 << 4,
+
+		FLAGS_BITS = 5
+	};
+
+	// last state sent to / received from the other side
+	struct EntityState {
+		i64 pos[3];
+		u32 rot;
+		float scale;
+	};
+
+	struct TrackedProperty {
+		TrackedProperty(IAllocator& allocator) : hashes(allocator) {}
+
+		ComponentType cmp_type;
+		const Reflection::PropertyBase* prop;
+		// hash of the last sent value, indexed by entity index
+		Array<u64> hashes;
+	};
+
+	static u32 packRotation(const Quat& rot);
+	static Quat unpackRotation(u32 packed);
+	void quantize(const DVec3& pos, i64 (&res)[3]) const;
+
+	IAllocator& m_allocator;
+	Universe& m_universe;
+	Array<TrackedProperty> m_properties;
+	Array<EntityState> m_states;
+	float m_precision = 1 / 256.f;
+};
+
+
+// tracks changes since the last encode through universe callbacks
+struct LUMIX_ENGINE_API SnapshotEncoder : SnapshotBase
+{
+	SnapshotEncoder(Universe& universe, IAllocator& allocator);
+	~SnapshotEncoder();
+
+	void encode(OutputMemoryStream& blob);
+
+private:
+	void onEntityTransformed(EntityRef entity);
+	void onEntitiesTransformed(Span<const EntityRef> entities);
+	void onEntityDestroyed(EntityRef entity);
+	void markDirty(EntityRef entity, u32 flags);
+	void refreshEntities();
+
+	// dirty flags, indexed by entity index
+	Array<u8> m_flags;
+	Array<u32> m_dirty_properties;
+	Array<bool> m_known;
+	Array<EntityRef> m_dirty;
+	Array<EntityRef> m_destroyed;
+	u32 m_entities_version = 0xffFFffFF;
+};
+
+
+// applies snapshots, missing entities and components are created
+struct LUMIX_ENGINE_API SnapshotDecoder : SnapshotBase
+{
+	SnapshotDecoder(Universe& universe, IAllocator& allocator);
+
+	bool decode(InputMemoryStream& blob);
+};
+
+
+} // namespace Lumix
@@ -0,0 +1,285 @@
+#include "engine/universe_streaming.h"
+#include "engine/array.h"
+#include "engine/engine.h"
+#include "engine/file_system.h"
+#include "engine/log.h"
+#include "engine/math.h"
+#include "engine/path.h"
+#include "engine/prefab.h"
+#include "engine/profiler.h"
+#include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/universe.h"
+
+
+namespace Lumix
+{
+
+
+static constexpr u32 STREAMING_MANIFEST_MAGIC = 0x4353554c; // == 'LUSC'
+// instantiating a cell is synchronous, more cells per update would cause hitches
+static constexpr u32 MAX_INSTANTIATIONS_PER_UPDATE = 1;
+
+
+enum class StreamingManifestVersion : u32
+{
+	FIRST,
+
+	LATEST
+};
+
+
+struct UniverseStreamingImpl final : UniverseStreaming
+{
+	enum class CellState : u8 {
+		UNLOADED,
+		LOADING,
+		LOADED,
+		FAILED
+	};
+
+	struct Cell {
+		IVec2 coord;
+		Path path;
+		PrefabResource* prefab = nullptr;
+		EntityPtr root = INVALID_ENTITY;
+		CellState state = CellState::UNLOADED;
+	};
+
+	UniverseStreamingImpl(Engine& engine, Universe& universe)
+		: m_engine(engine)
+		, m_universe(universe)
+		, m_allocator(engine.getAllocator())
+		, m_cells(engine.getAllocator())
+		, m_sources(engine.getAllocator())
+	{}
+
+	~UniverseStreamingImpl()
+	{
+		if (m_manifest_handle.isValid()) m_engine.getFileSystem().cancel(m_manifest_handle);
+		clearCells();
+	}
+
+	void clearCells()
+	{
+		for (Cell& cell : m_cells) unloadCell(cell);
+		m_cells.clear();
+	}
+
+	void loadManifest(const Path& path) override
+	{
+		FileSystem& fs = m_engine.getFileSystem();
+		if (m_manifest_handle.isValid()) fs.cancel(m_manifest_handle);
+		FileSystem::ContentCallback cb;
+		cb.bind<&UniverseStreamingImpl::manifestLoaded>(this);
+		m_manifest_handle = fs.getContent(path, cb);
+	}
+
+	void manifestLoaded(u64 size, const u8* mem, bool success)
+	{
+		m_manifest_handle = FileSystem::AsyncHandle::invalid();
+		if (!success) {
+			logError("Engine") << "Failed to read streaming manifest";
+			return;
+		}
+		InputMemoryStream blob(mem, size);
+		loadManifest(blob);
+	}
+
+	bool loadManifest(InputMemoryStream& blob) override
+	{
+		clearCells();
+		const u32 magic = blob.read<u32>();
+		const StreamingManifestVersion version = blob.read<StreamingManifestVersion>();
+		if (magic != STREAMING_MANIFEST_MAGIC || version > StreamingManifestVersion::LATEST) {
+			logError("Engine") << "Unsupported streaming manifest";
+			return false;
+		}
+		m_cell_size = blob.read<float>();
+		const u32 count = blob.read<u32>();
+		m_cells.reserve(count);
+		for (u32 i = 0; i < count; ++i) {
+			IVec2 coord;
+			blob.read(coord);
+			char path[MAX_PATH_LENGTH];
+			if (!blob.readString(Span(path))) {
+				logError("Engine") << "Corrupted streaming manifest";
+				clearCells();
+				return false;
+			}
+			addCell(coord, Path(path));
+		}
+		return true;
+	}
+
+	void saveManifest(OutputMemoryStream& blob) const override
+	{
+		blob.write(STREAMING_MANIFEST_MAGIC);
+		blob.write(StreamingManifestVersion::LATEST);
+		blob.write(m_cell_size);
+		blob.write(m_cells.size());
+		for (const Cell& cell : m_cells) {
+			blob.write(cell.coord);
+			blob.writeString(cell.path.c_str());
+		}
+	}
+
+	void setCellSize(float size) override
+	{
+		ASSERT(size > 0);
+		m_cell_size = size;
+	}
+
+	float getCellSize() const override { return m_cell_size; }
+
+	IVec2 getCell(const DVec3& pos) const override
+	{
+		return IVec2(int(floor(pos.x / m_cell_size)), int(floor(pos.z / m_cell_size)));
+	}
+
+	void addCell(const IVec2& coord, const Path& prefab) override
+	{
+		Cell& cell = m_cells.emplace();
+		cell.coord = coord;
+		cell.path = prefab;
+	}
+
+	void setRadius(float load_radius, float unload_radius) override
+	{
+		m_load_radius = load_radius;
+		m_unload_radius = maximum(load_radius, unload_radius);
+	}
+
+	void addSource(EntityRef entity) override { m_sources.push(entity); }
+	void removeSource(EntityRef entity) override { m_sources.eraseItem(entity); }
+
+	u32 getCellsCount() const override { return m_cells.size(); }
+
+	u32 getLoadedCellsCount() const override
+	{
+		u32 count = 0;
+		for (const Cell& cell : m_cells) {
+			if (cell.state == CellState::LOADED) ++count;
+		}
+		return count;
+	}
+
+	static void destroyHierarchy(Universe& universe, EntityRef entity)
+	{
+		for (EntityPtr child = universe.getFirstChild(entity); child.isValid(); child = universe.getFirstChild(entity)) {
+			destroyHierarchy(universe, (EntityRef)child);
+		}
+		universe.destroyEntity(entity);
+	}
+
+	void unloadCell(Cell& cell)
+	{
+		if (cell.root.isValid()) {
+			destroyHierarchy(m_universe, (EntityRef)cell.root);
+			cell.root = INVALID_ENTITY;
+		}
+		if (cell.prefab) {
+			cell.prefab->getResourceManager().unload(*cell.prefab);
+			cell.prefab = nullptr;
+		}
+		cell.state = CellState::UNLOADED;
+	}
+
+	void instantiateCell(Cell& cell)
+	{
+		const Transform tr = {DVec3(cell.coord.x * (double)m_cell_size, 0, cell.coord.y * (double)m_cell_size), Quat::IDENTITY, 1};
+		EntityRef root;
+		if (!m_engine.instantiatePrefabs(m_universe, *cell.prefab, Span(&tr, 1), Span(&root, 1))) {
+			cell.state = CellState::FAILED;
+			return;
+		}
+		cell.root = root;
+		cell.state = CellState::LOADED;
+	}
+
+	void update() override
+	{
+		PROFILE_FUNCTION();
+		if (m_cells.empty()) return;
+
+		m_sources.eraseItems([&](EntityRef e){ return !m_universe.hasEntity(e); });
+
+		Array<DVec3> positions(m_allocator);
+		positions.reserve(m_sources.size());
+		for (EntityRef e : m_sources) positions.push(m_universe.getPosition(e));
+
+		const double half_size = m_cell_size * 0.5;
+		const double load_radius2 = (double)m_load_radius * m_load_radius;
+		const double unload_radius2 = (double)m_unload_radius * m_unload_radius;
+		u32 instantiated = 0;
+		for (Cell& cell : m_cells) {
+			const double center_x = (cell.coord.x + 0.5) * m_cell_size;
+			const double center_z = (cell.coord.y + 0.5) * m_cell_size;
+			double dist2 = DBL_MAX;
+			for (const DVec3& pos : positions) {
+				// distance to the cell's square, so big cells are loaded before the source gets inside
+				const double dx = maximum(fabs(pos.x - center_x) - half_size, 0.0);
+				const double dz = maximum(fabs(pos.z - center_z) - half_size, 0.0);
+				dist2 = minimum(dist2, dx * dx + dz * dz);
+			}
+
+			switch (cell.state) {
+				case CellState::UNLOADED:
+					if (dist2 < load_radius2) {
+						ResourceManagerHub& rm = m_engine.getResourceManager();
+						cell.prefab = rm.load<PrefabResource>(cell.path);
+						// closer cells are read first
+						cell.prefab->setLoadPriority(FileSystem::Priority::NORMAL, float(dist2));
+						cell.state = CellState::LOADING;
+					}
+					break;
+				case CellState::LOADING:
+					if (dist2 > unload_radius2) {
+						unloadCell(cell);
+					}
+					else if (cell.prefab->isFailure()) {
+						logError("Engine") << "Failed to load streaming cell " << cell.path;
+						cell.state = CellState::FAILED;
+					}
+					else if (cell.prefab->isReady() && instantiated < MAX_INSTANTIATIONS_PER_UPDATE) {
+						++instantiated;
+						instantiateCell(cell);
+					}
+					break;
+				case CellState::LOADED:
+					if (dist2 > unload_radius2) unloadCell(cell);
+					break;
+				case CellState::FAILED:
+					// retried once the cell gets out of range
+					if (dist2 > unload_radius2) unloadCell(cell);
+					break;
+			}
+		}
+	}
+
+	Engine& m_engine;
+	Universe& m_universe;
+	IAllocator& m_allocator;
+	Array<Cell> m_cells;
+	Array<EntityRef> m_sources;
+	float m_cell_size = 64.f;
+	float m_load_radius = 128.f;
+	float m_unload_radius = 192.f;
+	FileSystem::AsyncHandle m_manifest_handle = FileSystem::AsyncHandle::invalid();
+};
+
+
+UniverseStreaming* UniverseStreaming::create(Engine& engine, Universe& universe)
+{
+	return LUMIX_NEW(engine.getAllocator(), UniverseStreamingImpl)(engine, universe);
+}
+
+
+void UniverseStreaming::destroy(UniverseStreaming& streaming)
+{
+	UniverseStreamingImpl& impl = (UniverseStreamingImpl&)streaming;
+	LUMIX_DELETE(impl.m_allocator, &impl);
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,46 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+struct Engine;
+struct InputMemoryStream;
+struct IVec2;
+struct OutputMemoryStream;
+struct Path;
+struct Universe;
+
+
+// a universe partitioned into square cells on the XZ plane, each cell is a prefab
+// cells around streaming sources are loaded through the resource manager and instantiated,
+// cells far from all sources are destroyed and their prefabs released
+struct LUMIX_ENGINE_API UniverseStreaming
+{
+	static UniverseStreaming* create(Engine& engine, Universe& universe);
+	static void destroy(UniverseStreaming& streaming);
+
+	virtual ~UniverseStreaming() {}
+	// asynchronously reads a manifest written by saveManifest, replaces existing cells
+	virtual void loadManifest(const Path& path) = 0;
+	virtual bool loadManifest(InputMemoryStream& blob) = 0;
+	virtual void saveManifest(OutputMemoryStream& blob) const = 0;
+	virtual void setCellSize(float size) = 0;
+	virtual float getCellSize() const = 0;
+	virtual IVec2 getCell(const struct DVec3& pos) const = 0;
+	virtual void addCell(const IVec2& cell, const Path& prefab) = 0;
+	// cells closer than `load_radius` to any source are loaded, cells farther than `unload_radius` from all sources are unloaded
+	virtual void setRadius(float load_radius, float unload_radius) = 0;
+	virtual void addSource(EntityRef entity) = 0;
+	virtual void removeSource(EntityRef entity) = 0;
+	virtual void update() = 0;
+	virtual u32 getCellsCount() const = 0;
+	virtual u32 getLoadedCellsCount() const = 0;
+};
+
+
+} // namespace Lumix
@@ -1,16 +1,22 @@
 #include "engine/allocator.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/math.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/string.h"
 #define UNICODE
+// must be included before Windows.h
+#include <WinSock2.h>
+#include <WS2tcpip.h>
 #pragma warning(push)
 #pragma warning(disable : 4091)
 #include <ShlObj.h>
 #pragma warning(pop)
 #include <Windows.h>
 
+#pragma comment(lib, "Ws2_32.lib")
+
 
 //Request high performace profiles from mobile chipsets
 extern "C" {
@@ -141,6 +147,129 @@ bool InputFile::seek(u64 pos)
 }
 
 
+MappedFile::MappedFile()
+	: m_data(nullptr)
+	, m_size(0)
+{}
+
+
+MappedFile::~MappedFile()
+{
+	ASSERT(!m_data);
+}
+
+
+bool MappedFile::open(const char* path)
+{
+	ASSERT(!m_data);
+	const HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size)) {
+		::CloseHandle(file);
+		return false;
+	}
+	m_size = size.QuadPart;
+	// empty files can not be mapped
+	if (m_size == 0) {
+		::CloseHandle(file);
+		return true;
+	}
+
+	const HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	::CloseHandle(file);
+	if (!mapping) {
+		m_size = 0;
+		return false;
+	}
+
+	// the view keeps the mapping alive
+	m_data = (const u8*)::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	::CloseHandle(mapping);
+	if (!m_data) m_size = 0;
+	return m_data != nullptr;
+}
+
+
+void MappedFile::close()
+{
+	if (m_data) ::UnmapViewOfFile(m_data);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+
+OutputSocket::OutputSocket()
+	: m_socket((u64)INVALID_SOCKET)
+	, m_is_error(false)
+{
+	static_assert(sizeof(m_socket) >= sizeof(SOCKET));
+}
+
+
+OutputSocket::~OutputSocket()
+{
+	ASSERT((SOCKET)m_socket == INVALID_SOCKET);
+}
+
+
+bool OutputSocket::connect(const char* ip, u16 port)
+{
+	ASSERT((SOCKET)m_socket == INVALID_SOCKET);
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) return false;
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+		WSACleanup();
+		return false;
+	}
+
+	const SOCKET s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == INVALID_SOCKET) {
+		WSACleanup();
+		return false;
+	}
+	if (::connect(s, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+		::closesocket(s);
+		WSACleanup();
+		return false;
+	}
+	m_socket = (u64)s;
+	m_is_error = false;
+	return true;
+}
+
+
+void OutputSocket::close()
+{
+	if ((SOCKET)m_socket == INVALID_SOCKET) return;
+	::closesocket((SOCKET)m_socket);
+	WSACleanup();
+	m_socket = (u64)INVALID_SOCKET;
+}
+
+
+bool OutputSocket::write(const void* data, u64 size)
+{
+	ASSERT((SOCKET)m_socket != INVALID_SOCKET);
+	const char* ptr = (const char*)data;
+	while (size > 0 && !m_is_error) {
+		const int sent = ::send((SOCKET)m_socket, ptr, (int)minimum(size, (u64)0x7fffFFFF), 0);
+		if (sent <= 0) {
+			m_is_error = true;
+			break;
+		}
+		ptr += sent;
+		size -= sent;
+	}
+	return !m_is_error;
+}
+
+
 OutputFile& OutputFile::operator <<(const char* text)
 {
 	write(text, stringLength(text));
@@ -230,6 +359,7 @@ struct WCharStr
 };
 
 void sleep(u32 milliseconds) { ::Sleep(milliseconds); }
+void yield() { ::SwitchToThread(); }
 
 static_assert(sizeof(ThreadID) == sizeof(::GetCurrentThreadId()), "Not matching");
 ThreadID getCurrentThreadID() { return ::GetCurrentThreadId(); }
@@ -782,6 +912,35 @@ void memRelease(void* ptr) {
 	VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+size_t getLargeMemPageSize() {
+	return GetLargePageMinimum();
+}
+
+// large pages need SeLockMemoryPrivilege, which must be granted to the user and enabled in the process token
+static bool enableLockMemoryPrivilege() {
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+	TOKEN_PRIVILEGES tp = {};
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool res = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr)
+		&& GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	return res;
+}
+
+void* memReserveLarge(size_t size) {
+	static const bool enabled = getLargeMemPageSize() != 0 && enableLockMemoryPrivilege();
+	if (!enabled) return nullptr;
+	ASSERT(size % getLargeMemPageSize() == 0);
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+}
+
+void memReleaseLarge(void* ptr, size_t size) {
+	VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
 struct FileIterator
 {
 	HANDLE handle;
@@ -819,6 +978,10 @@ bool getNextFile(FileIterator* iterator, FileInfo* info)
 
 	info->is_directory = (iterator->ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
 	fromWChar(Span(info->filename), iterator->ffd.cFileName);
+	ULARGE_INTEGER last_modified;
+	last_modified.LowPart = iterator->ffd.ftLastWriteTime.dwLowDateTime;
+	last_modified.HighPart = iterator->ffd.ftLastWriteTime.dwHighDateTime;
+	info->last_modified = last_modified.QuadPart;
 
 	iterator->is_valid = FindNextFile(iterator->handle, &iterator->ffd) != FALSE;
 	return true;
@@ -9,6 +9,7 @@
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
+#include "engine/file_system.h"
 #include "engine/geometry.h"
 #include "engine/log.h"
 #include "engine/math.h"
@@ -39,7 +40,7 @@ static const ComponentType GUI_BUTTON_TYPE = Reflection::getComponentType("gui_b
 static const ComponentType GUI_RENDER_TARGET_TYPE = Reflection::getComponentType("gui_render_target");
 
 
-struct SpritePlugin final : AssetBrowser::IPlugin
+struct SpritePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 {
 	SpritePlugin(StudioApp& app) 
 		: app(app) 
@@ -47,6 +48,21 @@ struct SpritePlugin final : AssetBrowser::IPlugin
 		app.getAssetCompiler().registerExtension("spr", Sprite::TYPE);
 	}
 
+	bool compile(const Path& src) override {
+		FileSystem& fs = app.getEngine().getFileSystem();
+		Array<u8> src_data(app.getAllocator());
+		if (!fs.getContentSync(src, Ref(src_data))) return false;
+
+		OutputMemoryStream compiled(app.getAllocator());
+		if (!Sprite::compile(Span<const u8>(src_data.begin(), src_data.size()), compiled)) {
+			logError("GUI") << "Failed to compile " << src;
+			return false;
+		}
+		return app.getAssetCompiler().writeCompiledResource(src.c_str(), Span(compiled.getMutableData(), (u32)compiled.getPos()));
+	}
+
+	bool isThreadSafe() const override { return true; }
+
 	bool canCreateResource() const override { return true; }
 	const char* getFileDialogFilter() const override { return "Sprite\0*.spr\0"; }
 	const char* getFileDialogExtensions() const override { return "spr"; }
@@ -785,6 +801,8 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_sprite_plugin = LUMIX_NEW(allocator, SpritePlugin)(m_app);
 		m_app.getAssetBrowser().addPlugin(*m_sprite_plugin);
+		const char* sprite_exts[] = { "spr", nullptr };
+		m_app.getAssetCompiler().addPlugin(*m_sprite_plugin, sprite_exts);
 	}
 
 
@@ -794,6 +812,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		m_app.removePlugin(*m_gui_editor);
 		LUMIX_DELETE(allocator, m_gui_editor);
 
+		m_app.getAssetCompiler().removePlugin(*m_sprite_plugin);
 		m_app.getAssetBrowser().removePlugin(*m_sprite_plugin);
 		LUMIX_DELETE(allocator, m_sprite_plugin);
 	}
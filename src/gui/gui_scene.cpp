@@ -3,14 +3,17 @@
 #include "engine/associative_array.h"
 #include "engine/crt.h"
 #include "engine/flag_set.h"
+#include "engine/hash_map.h"
 #include "engine/input_system.h"
 #include "engine/log.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/universe.h"
 #include "gui_scene.h"
 #include "gui_system.h"
+#include "renderer/draw2d.h"
 #include "renderer/font.h"
 #include "renderer/pipeline.h"
 #include "renderer/texture.h"
@@ -32,7 +35,7 @@ static gpu::TextureHandle EMPTY_RENDER_TARGET = gpu::INVALID_TEXTURE;
 
 struct GUIText
 {
-	GUIText(IAllocator& allocator) : text("", allocator) {}
+	GUIText(IAllocator& allocator) : text("", allocator), glyphs(allocator) {}
 	~GUIText() { setFontResource(nullptr); }
 
 
@@ -49,6 +52,7 @@ struct GUIText
 			m_font_resource->getResourceManager().unload(*m_font_resource);
 		}
 		m_font_resource = res;
+		glyphs_dirty = true;
 		if (res) res->onLoaded<&GUIText::onFontLoaded>(this);
 	}
 
@@ -61,11 +65,13 @@ struct GUIText
 			m_font = nullptr;
 		}
 		if (new_state == Resource::State::READY) m_font = m_font_resource->addRef(m_font_size);
+		glyphs_dirty = true;
 	}
 
 	void setFontSize(int value)
 	{
 		m_font_size = value;
+		glyphs_dirty = true;
 		if (m_font_resource && m_font_resource->isReady())
 		{
 			if(m_font) m_font_resource->removeRef(*m_font);
@@ -83,6 +89,13 @@ struct GUIText
 	GUIScene::TextHAlign horizontal_align = GUIScene::TextHAlign::LEFT;
 	u32 color = 0xff000000;
 
+	// laid out text, must be marked dirty when the text changes
+	Array<Draw2D::GlyphQuad> glyphs;
+	float glyphs_width = 0;
+	const Font* glyphs_font = nullptr;
+	u32 glyphs_atlas_version = 0;
+	bool glyphs_dirty = true;
+
 private:
 	int m_font_size = 13;
 	Font* m_font = nullptr;
@@ -142,11 +155,25 @@ struct GUIRect
 	GUIText* text = nullptr;
 	GUIInputField* input_field = nullptr;
 	gpu::TextureHandle* render_target = nullptr;
+
+	// absolute position on the canvas, recomputed only if the rect or its parent changed
+	GUIScene::Rect layout;
+	bool layout_dirty = true;
+	// cached geometry of the whole subtree, only children of the root have it
+	Draw2D* geometry = nullptr;
+	bool geometry_dirty = true;
 };
 
 
 struct GUISceneImpl final : GUIScene
 {
+	struct HitTarget {
+		GUIRect* rect;
+		bool is_button;
+		// the same target can be in more cells
+		u32 stamp;
+	};
+
 	GUISceneImpl(GUISystem& system, Universe& context, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_universe(context)
@@ -158,6 +185,12 @@ struct GUISceneImpl final : GUIScene
 		, m_button_clicked(allocator)
 		, m_buttons_down_count(0)
 		, m_canvas_size(800, 600)
+		, m_cached_draw(allocator)
+		, m_batched_draw(allocator)
+		, m_cached_textures(allocator)
+		, m_hit_targets(allocator)
+		, m_hit_cells(allocator)
+		, m_hit_cell_targets(allocator)
 	{
 		context.registerComponentType(GUI_RECT_TYPE
 			, this
@@ -186,11 +219,117 @@ struct GUISceneImpl final : GUIScene
 		m_font_manager = (FontManager*)system.getEngine().getResourceManager().get(FontResource::TYPE);
 	}
 
+	// returns the child of the root containing the rect, nullptr for the root itself
+	GUIRect* getGeometrySegment(const GUIRect& rect) const
+	{
+		if (!m_root || &rect == m_root) return nullptr;
+		EntityRef e = rect.entity;
+		for (;;)
+		{
+			const EntityPtr parent = m_universe.getParent(e);
+			if (!parent.isValid()) return nullptr;
+			if ((EntityRef)parent == m_root->entity) break;
+			e = (EntityRef)parent;
+		}
+		const int idx = m_rects.find(e);
+		return idx < 0 ? nullptr : m_rects.at(idx);
+	}
+
+
+	void invalidateGeometry(const GUIRect& rect)
+	{
+		GUIRect* segment = getGeometrySegment(rect);
+		if (segment) segment->geometry_dirty = true;
+		else m_geometry_dirty = true;
+	}
+
+
+	void invalidateLayout(GUIRect& rect)
+	{
+		rect.layout_dirty = true;
+		m_layout_dirty = true;
+		invalidateGeometry(rect);
+	}
+
+
+	GUIRect* editRect(EntityRef entity)
+	{
+		GUIRect* rect = m_rects[entity];
+		invalidateGeometry(*rect);
+		return rect;
+	}
+
+
+	GUIRect* editRectLayout(EntityRef entity)
+	{
+		GUIRect* rect = m_rects[entity];
+		invalidateLayout(*rect);
+		return rect;
+	}
+
+
+	// something used by the geometry is not loaded yet, try again next frame
+	void retryGeometry()
+	{
+		if (m_building_segment) m_building_segment->geometry_dirty = true;
+		else m_geometry_dirty = true;
+	}
+
+
+	void updateLayout(GUIRect& rect, const Rect& parent_rect, bool parent_changed)
+	{
+		if (!rect.flags.isSet(GUIRect::IS_VALID)) return;
+
+		const bool changed = parent_changed || rect.layout_dirty;
+		if (changed)
+		{
+			rect.layout = getRectOnCanvas(parent_rect, rect);
+			rect.layout_dirty = false;
+		}
+
+		for (EntityPtr child = m_universe.getFirstChild(rect.entity); child.isValid(); child = m_universe.getNextSibling((EntityRef)child))
+		{
+			const int idx = m_rects.find((EntityRef)child);
+			if (idx >= 0) updateLayout(*m_rects.at(idx), rect.layout, changed);
+		}
+	}
+
+
+	// only rects which changed and their subtrees are recomputed
+	void updateLayout()
+	{
+		if (!m_root) return;
+
+		const u32 hierarchy_version = m_universe.getHierarchyVersion();
+		if (m_layout_hierarchy_version != hierarchy_version
+			|| m_layout_canvas_size.x != m_canvas_size.x
+			|| m_layout_canvas_size.y != m_canvas_size.y)
+		{
+			m_layout_hierarchy_version = hierarchy_version;
+			m_layout_canvas_size = m_canvas_size;
+			m_root->layout_dirty = true;
+			m_layout_dirty = true;
+		}
+		if (!m_layout_dirty) return;
+
+		PROFILE_FUNCTION();
+		m_layout_dirty = false;
+		m_hit_index_dirty = true;
+		updateLayout(*m_root, { 0, 0, m_canvas_size.x, m_canvas_size.y }, false);
+	}
+
+
+	static bool isCursorVisible(const GUIInputField& input_field)
+	{
+		return input_field.anim <= CURSOR_BLINK_PERIOD * 0.5f;
+	}
+
+
 	void renderTextCursor(GUIRect& rect, Draw2D& draw, const Vec2& pos)
 	{
 		if (!rect.input_field) return;
 		if (m_focused_entity != rect.entity) return;
-		if (rect.input_field->anim > CURSOR_BLINK_PERIOD * 0.5f) return;
+		if (!isCursorVisible(*rect.input_field)) return;
 
 		const char* text = rect.text->text.c_str();
 		const char* text_end = text + rect.input_field->cursor;
@@ -203,18 +342,18 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
-	void renderRect(GUIRect& rect, Pipeline& pipeline, const Rect& parent_rect)
+	// uses the layout, so updateLayout must be called before
+	void renderRect(GUIRect& rect, Draw2D& draw, bool recursive)
 	{
 		if (!rect.flags.isSet(GUIRect::IS_VALID)) return;
 		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return;
 
-		float l = parent_rect.x + rect.left.points + parent_rect.w * rect.left.relative;
-		float r = parent_rect.x + rect.right.points + parent_rect.w * rect.right.relative;
-		float t = parent_rect.y + rect.top.points + parent_rect.h * rect.top.relative;
-		float b = parent_rect.y + rect.bottom.points + parent_rect.h * rect.bottom.relative;
-			 
-		Draw2D& draw = pipeline.getDraw2D();
-		if (rect.flags.isSet(GUIRect::IS_CLIP)) draw.pushClipRect({ l, t }, { r, b });
+		const float l = rect.layout.x;
+		const float r = rect.layout.x + rect.layout.w;
+		const float t = rect.layout.y;
+		const float b = rect.layout.y + rect.layout.h;
+
+		if (recursive && rect.flags.isSet(GUIRect::IS_CLIP)) draw.pushClipRect({ l, t }, { r, b });
 
 		if (rect.image && rect.image->flags.isSet(GUIImage::IS_ENABLED))
 		{
@@ -222,6 +361,11 @@ struct GUISceneImpl final : GUIScene
 			{
 				Sprite* sprite = rect.image->sprite;
 				Texture* tex = sprite->getTexture();
+				// size of the texture is not known yet
+				if (!tex->isReady()) retryGeometry();
+				auto iter = m_cached_textures.find(sprite);
+				if (iter.isValid()) iter.value() = tex;
+				else m_cached_textures.insert(sprite, tex);
 				if (sprite->type == Sprite::PATCH9)
 				{
 					struct Quad {
@@ -259,43 +403,62 @@ struct GUISceneImpl final : GUIScene
 			}
 			else
 			{
+				if (rect.image->sprite) retryGeometry();
 				draw.addRectFilled({ l, t }, { r, b }, *(Color*)&rect.image->color);
 			}
 		}
 
-		if (rect.render_target && rect.render_target->isValid())
+		if (rect.render_target)
 		{
-			draw.addImage(rect.render_target, { l, t }, { r, b }, {0, 0}, {1, 1});
+			if (rect.render_target->isValid()) {
+				draw.addImage(rect.render_target, { l, t }, { r, b }, {0, 0}, {1, 1});
+			}
+			else {
+				retryGeometry();
+			}
 		}
 
 		if (rect.text)
 		{
 			Font* font = rect.text->getFont();
 			if (font) {
-				const char* text_cstr = rect.text->text.c_str();
-				float font_size = (float)rect.text->getFontSize();
-				Vec2 text_size = measureTextA(*font, text_cstr, nullptr);
+				GUIText& text = *rect.text;
+				// glyphs are laid out from the origin, so alignment and rect size do not invalidate them
+				const u32 atlas_version = m_font_manager->getAtlasVersion();
+				if (text.glyphs_dirty || text.glyphs_font != font || text.glyphs_atlas_version != atlas_version) {
+					text.glyphs.clear();
+					text.glyphs_width = Draw2D::layoutText(*font, text.text.c_str(), text.glyphs);
+					text.glyphs_font = font;
+					text.glyphs_atlas_version = atlas_version;
+					text.glyphs_dirty = false;
+				}
+				float font_size = (float)text.getFontSize();
 				Vec2 text_pos(l, t + font_size);
 
-				switch (rect.text->horizontal_align)
+				switch (text.horizontal_align)
 				{
 					case TextHAlign::LEFT: break;
-					case TextHAlign::RIGHT: text_pos.x = r - text_size.x; break;
-					case TextHAlign::CENTER: text_pos.x = (r + l - text_size.x) * 0.5f; break;
+					case TextHAlign::RIGHT: text_pos.x = r - text.glyphs_width; break;
+					case TextHAlign::CENTER: text_pos.x = (r + l - text.glyphs_width) * 0.5f; break;
 				}
 
-				draw.addText(*font, text_pos, *(Color*)&rect.text->color, text_cstr);
+				draw.addGlyphs(text.glyphs, text_pos, *(Color*)&text.color);
 				renderTextCursor(rect, draw, text_pos);
 			}
+			else if (rect.text->getFontResource()) {
+				retryGeometry();
+			}
 		}
 
+		if (!recursive) return;
+
 		EntityPtr child = m_universe.getFirstChild(rect.entity);
 		while (child.isValid())
 		{
 			int idx = m_rects.find((EntityRef)child);
 			if (idx >= 0)
 			{
-				renderRect(*m_rects.at(idx), pipeline, { l, t, r - l, b - t });
+				renderRect(*m_rects.at(idx), draw, true);
 			}
 			child = m_universe.getNextSibling((EntityRef)child);
 		}
@@ -303,14 +466,137 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
+	// cached geometry points to textures of sprites, those can change when the sprite is reloaded
+	bool areCachedTexturesChanged() const
+	{
+		for (auto iter = m_cached_textures.begin(), end = m_cached_textures.end(); iter != end; ++iter) {
+			if (iter.key()->getTexture() != iter.value()) return true;
+			if (!iter.value()->isReady()) return true;
+		}
+		return false;
+	}
+
+
+	void releaseGeometry(GUIRect& rect)
+	{
+		LUMIX_DELETE(m_allocator, rect.geometry);
+		rect.geometry = nullptr;
+	}
+
+
+	// each child of the root caches geometry of its subtree, only subtrees which changed are rebuilt
 	void render(Pipeline& pipeline, const Vec2& canvas_size) override
 	{
 		if (!m_root) return;
 
+		PROFILE_FUNCTION();
+		const u32 hierarchy_version = m_universe.getHierarchyVersion();
+		const u32 atlas_version = m_font_manager->getAtlasVersion();
+		const bool rebuild_all = m_geometry_dirty
+			|| m_canvas_size.x != canvas_size.x
+			|| m_canvas_size.y != canvas_size.y
+			|| m_cached_hierarchy_version != hierarchy_version
+			|| m_cached_atlas_version != atlas_version
+			|| areCachedTexturesChanged();
+
 		m_canvas_size = canvas_size;
-		renderRect(*m_root, pipeline, {0, 0, canvas_size.x, canvas_size.y});
+		updateLayout();
+
+		Vec2 atlas_size(1, 1);
+		const Texture* atlas = m_font_manager->getAtlasTexture();
+		const bool atlas_ready = atlas && atlas->isReady();
+		if (atlas_ready) atlas_size.set((float)atlas->width, (float)atlas->height);
+
+		const bool is_root_visible = m_root->flags.isSet(GUIRect::IS_VALID) && m_root->flags.isSet(GUIRect::IS_ENABLED);
+		const bool is_root_clip = m_root->flags.isSet(GUIRect::IS_CLIP);
+		bool changed = rebuild_all || m_batched_draw_dirty;
+		if (rebuild_all)
+		{
+			PROFILE_BLOCK("rebuild");
+			m_geometry_dirty = !atlas_ready;
+			m_cached_hierarchy_version = hierarchy_version;
+			m_cached_atlas_version = atlas_version;
+			m_cached_textures.clear();
+
+			// rects moved in the hierarchy can hold geometry they do not need anymore
+			for (GUIRect* rect : m_rects)
+			{
+				rect->geometry_dirty = true;
+				if (rect->geometry && m_universe.getParent(rect->entity) != m_root->entity) releaseGeometry(*rect);
+			}
+
+			m_cached_draw.clear(atlas_size);
+			m_building_segment = nullptr;
+			renderRect(*m_root, m_cached_draw, false);
+		}
+
+		if (!is_root_visible) {
+			pipeline.getDraw2D().append(m_cached_draw);
+			return;
+		}
+
+		for (EntityPtr child = m_universe.getFirstChild(m_root->entity); child.isValid(); child = m_universe.getNextSibling((EntityRef)child))
+		{
+			const int idx = m_rects.find((EntityRef)child);
+			if (idx < 0) continue;
+
+			GUIRect& segment = *m_rects.at(idx);
+			if (segment.geometry_dirty)
+			{
+				PROFILE_BLOCK("rebuild subtree");
+				if (!segment.geometry) segment.geometry = LUMIX_NEW(m_allocator, Draw2D)(m_allocator);
+				segment.geometry_dirty = !atlas_ready;
+				segment.geometry->clear(atlas_size);
+				m_building_segment = &segment;
+				const Rect& root_rect = m_root->layout;
+				if (is_root_clip) segment.geometry->pushClipRect({ root_rect.x, root_rect.y }, { root_rect.x + root_rect.w, root_rect.y + root_rect.h });
+				renderRect(segment, *segment.geometry, true);
+				if (is_root_clip) segment.geometry->popClipRect();
+				m_building_segment = nullptr;
+				changed = true;
+			}
+		}
+
+		if (!m_batching_enabled) {
+			pipeline.getDraw2D().append(m_cached_draw);
+			forEachSegment([&](GUIRect& segment){ pipeline.getDraw2D().append(*segment.geometry); });
+			return;
+		}
+
+		// the whole canvas is batched, so sprites from different subtrees can share draw calls
+		if (changed) {
+			PROFILE_BLOCK("batch");
+			m_batched_draw_dirty = false;
+			m_batched_draw.clear(atlas_size);
+			m_batched_draw.append(m_cached_draw);
+			forEachSegment([&](GUIRect& segment){ m_batched_draw.append(*segment.geometry); });
+			m_batched_draw.batchByTexture();
+		}
+		pipeline.getDraw2D().append(m_batched_draw);
 	}
 
+	template <typename F>
+	void forEachSegment(const F& f)
+	{
+		for (EntityPtr child = m_universe.getFirstChild(m_root->entity); child.isValid(); child = m_universe.getNextSibling((EntityRef)child))
+		{
+			const int idx = m_rects.find((EntityRef)child);
+			if (idx < 0) continue;
+			GUIRect& segment = *m_rects.at(idx);
+			if (segment.geometry) f(segment);
+		}
+	}
+
+
+	void enableBatching(bool enable) override
+	{
+		m_batching_enabled = enable;
+		m_batched_draw_dirty = true;
+	}
+
+
+	bool isBatchingEnabled() const override { return m_batching_enabled; }
+
 
 	Vec4 getButtonNormalColorRGBA(EntityRef entity) override
 	{
@@ -336,7 +622,7 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
-	void enableImage(EntityRef entity, bool enable) override { m_rects[entity]->image->flags.set(GUIImage::IS_ENABLED, enable); }
+	void enableImage(EntityRef entity, bool enable) override { editRect(entity)->image->flags.set(GUIImage::IS_ENABLED, enable); }
 	bool isImageEnabled(EntityRef entity) override { return m_rects[entity]->image->flags.isSet(GUIImage::IS_ENABLED); }
 
 
@@ -378,9 +664,11 @@ struct GUISceneImpl final : GUIScene
 
 	void setImageSprite(EntityRef entity, const Path& path) override
 	{
-		GUIImage* image = m_rects[entity]->image;
+		GUIImage* image = editRect(entity)->image;
 		if (image->sprite)
 		{
+			// cached textures point to the sprite
+			m_geometry_dirty = true;
 			image->sprite->getResourceManager().unload(*image->sprite);
 		}
 		ResourceManagerHub& manager = m_system.getEngine().getResourceManager();
@@ -397,7 +685,7 @@ struct GUISceneImpl final : GUIScene
 
 	void setImageColorRGBA(EntityRef entity, const Vec4& color) override
 	{
-		GUIImage* image = m_rects[entity]->image;
+		GUIImage* image = editRect(entity)->image;
 		image->color = RGBAVec4ToABGRu32(color);
 	}
 
@@ -480,34 +768,34 @@ struct GUISceneImpl final : GUIScene
 		return { l, t, r - l, b - t };
 	}
 
-	void setRectClip(EntityRef entity, bool enable) override { m_rects[entity]->flags.set(GUIRect::IS_CLIP, enable); }
+	void setRectClip(EntityRef entity, bool enable) override { editRect(entity)->flags.set(GUIRect::IS_CLIP, enable); }
 	bool getRectClip(EntityRef entity) override { return m_rects[entity]->flags.isSet(GUIRect::IS_CLIP); }
-	void enableRect(EntityRef entity, bool enable) override { m_rects[entity]->flags.set(GUIRect::IS_ENABLED, enable); }
+	void enableRect(EntityRef entity, bool enable) override { editRectLayout(entity)->flags.set(GUIRect::IS_ENABLED, enable); }
 	bool isRectEnabled(EntityRef entity) override { return m_rects[entity]->flags.isSet(GUIRect::IS_ENABLED); }
 	float getRectLeftPoints(EntityRef entity) override { return m_rects[entity]->left.points; }
-	void setRectLeftPoints(EntityRef entity, float value) override { m_rects[entity]->left.points = value; }
+	void setRectLeftPoints(EntityRef entity, float value) override { editRectLayout(entity)->left.points = value; }
 	float getRectLeftRelative(EntityRef entity) override { return m_rects[entity]->left.relative; }
-	void setRectLeftRelative(EntityRef entity, float value) override { m_rects[entity]->left.relative = value; }
+	void setRectLeftRelative(EntityRef entity, float value) override { editRectLayout(entity)->left.relative = value; }
 
 	float getRectRightPoints(EntityRef entity) override { return m_rects[entity]->right.points; }
-	void setRectRightPoints(EntityRef entity, float value) override { m_rects[entity]->right.points = value; }
+	void setRectRightPoints(EntityRef entity, float value) override { editRectLayout(entity)->right.points = value; }
 	float getRectRightRelative(EntityRef entity) override { return m_rects[entity]->right.relative; }
-	void setRectRightRelative(EntityRef entity, float value) override { m_rects[entity]->right.relative = value; }
+	void setRectRightRelative(EntityRef entity, float value) override { editRectLayout(entity)->right.relative = value; }
 
 	float getRectTopPoints(EntityRef entity) override { return m_rects[entity]->top.points; }
-	void setRectTopPoints(EntityRef entity, float value) override { m_rects[entity]->top.points = value; }
+	void setRectTopPoints(EntityRef entity, float value) override { editRectLayout(entity)->top.points = value; }
 	float getRectTopRelative(EntityRef entity) override { return m_rects[entity]->top.relative; }
-	void setRectTopRelative(EntityRef entity, float value) override { m_rects[entity]->top.relative = value; }
+	void setRectTopRelative(EntityRef entity, float value) override { editRectLayout(entity)->top.relative = value; }
 
 	float getRectBottomPoints(EntityRef entity) override { return m_rects[entity]->bottom.points; }
-	void setRectBottomPoints(EntityRef entity, float value) override { m_rects[entity]->bottom.points = value; }
+	void setRectBottomPoints(EntityRef entity, float value) override { editRectLayout(entity)->bottom.points = value; }
 	float getRectBottomRelative(EntityRef entity) override { return m_rects[entity]->bottom.relative; }
-	void setRectBottomRelative(EntityRef entity, float value) override { m_rects[entity]->bottom.relative = value; }
+	void setRectBottomRelative(EntityRef entity, float value) override { editRectLayout(entity)->bottom.relative = value; }
 
 
 	void setTextFontSize(EntityRef entity, int value) override
 	{
-		GUIText* gui_text = m_rects[entity]->text;
+		GUIText* gui_text = editRect(entity)->text;
 		gui_text->setFontSize(value);
 	}
 	
@@ -528,7 +816,7 @@ struct GUISceneImpl final : GUIScene
 
 	void setTextColorRGBA(EntityRef entity, const Vec4& color) override
 	{
-		GUIText* gui_text = m_rects[entity]->text;
+		GUIText* gui_text = editRect(entity)->text;
 		gui_text->color = RGBAVec4ToABGRu32(color);
 	}
 
@@ -542,7 +830,7 @@ struct GUISceneImpl final : GUIScene
 
 	void setTextFontPath(EntityRef entity, const Path& path) override
 	{
-		GUIText* gui_text = m_rects[entity]->text;
+		GUIText* gui_text = editRect(entity)->text;
 		FontResource* res = path.isValid() ? m_font_manager->getOwner().load<FontResource>(path) : nullptr;
 		gui_text->setFontResource(res);
 	}
@@ -558,15 +846,16 @@ struct GUISceneImpl final : GUIScene
 
 	void setTextHAlign(EntityRef entity, TextHAlign value) override
 	{
-		GUIText* gui_text = m_rects[entity]->text;
+		GUIText* gui_text = editRect(entity)->text;
 		gui_text->horizontal_align = value;
 	}
 
 
 	void setText(EntityRef entity, const char* value) override
 	{
-		GUIText* gui_text = m_rects[entity]->text;
+		GUIText* gui_text = editRect(entity)->text;
 		gui_text->text = value;
+		gui_text->glyphs_dirty = true;
 	}
 
 
@@ -577,6 +866,15 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
+	bool isDeserializeThreadSafe() const override { return true; }
+
+	Span<const char* const> getDeserializeDependencies() const override {
+		// texts share font resources with renderer's text meshes
+		static const char* const deps[] = { "renderer" };
+		return Span(deps);
+	}
+
+
 	void clear() override
 	{
 		for (GUIRect* rect : m_rects)
@@ -584,10 +882,15 @@ struct GUISceneImpl final : GUIScene
 			LUMIX_DELETE(m_allocator, rect->input_field);
 			LUMIX_DELETE(m_allocator, rect->image);
 			LUMIX_DELETE(m_allocator, rect->text);
+			LUMIX_DELETE(m_allocator, rect->geometry);
 			LUMIX_DELETE(m_allocator, rect);
 		}
 		m_rects.clear();
+		m_cached_textures.clear();
 		m_buttons.clear();
+		m_hit_targets.clear();
+		m_hit_index_dirty = true;
+		m_geometry_dirty = true;
 	}
 
 
@@ -600,6 +903,7 @@ struct GUISceneImpl final : GUIScene
 
 		if (rect.image) rect.image->color = button.normal_color;
 		if (rect.text) rect.text->color = button.normal_color;
+		invalidateGeometry(rect);
 
 		m_rect_hovered_out.invoke(rect.entity);
 	}
@@ -614,29 +918,128 @@ struct GUISceneImpl final : GUIScene
 
 		if (rect.image) rect.image->color = button.hovered_color;
 		if (rect.text) rect.text->color = button.hovered_color;
+		invalidateGeometry(rect);
 
 		m_rect_hovered.invoke(rect.entity);
 	}
 
 
-	void handleMouseAxisEvent(const Rect& parent_rect, GUIRect& rect, const Vec2& mouse_pos, const Vec2& prev_mouse_pos)
+	void collectHitTargets(GUIRect& rect)
 	{
+		if (!rect.flags.isSet(GUIRect::IS_VALID)) return;
 		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return;
 
-		const Rect& r = getRectOnCanvas(parent_rect, rect);
-
-		bool is = contains(r, mouse_pos);
-		bool was = contains(r, prev_mouse_pos);
-		if (is != was && m_buttons.find(rect.entity) >= 0)
+		const bool is_button = m_buttons.find(rect.entity) >= 0;
+		if ((is_button || rect.input_field) && rect.layout.w >= 0 && rect.layout.h >= 0)
 		{
-			is ? hover(rect) : hoverOut(rect);
+			HitTarget& target = m_hit_targets.emplace();
+			target.rect = &rect;
+			target.is_button = is_button;
+			target.stamp = 0;
 		}
 
 		for (EntityPtr e = m_universe.getFirstChild(rect.entity); e.isValid(); e = m_universe.getNextSibling((EntityRef)e))
 		{
 			int idx = m_rects.find((EntityRef)e);
-			if (idx < 0) continue;
-			handleMouseAxisEvent(r, *m_rects.at(idx), mouse_pos, prev_mouse_pos);
+			if (idx >= 0) collectHitTargets(*m_rects.at(idx));
+		}
+	}
+
+
+	u32 getHitCell(float x, float y) const
+	{
+		const u32 cx = (u32)clamp(int(x / m_hit_cell_size.x), 0, HIT_GRID_SIZE - 1);
+		const u32 cy = (u32)clamp(int(y / m_hit_cell_size.y), 0, HIT_GRID_SIZE - 1);
+		return cx + cy * HIT_GRID_SIZE;
+	}
+
+
+	// buttons and input fields in hierarchy order, bucketed to a uniform grid over the canvas
+	void updateHitIndex()
+	{
+		updateLayout();
+		if (!m_hit_index_dirty) return;
+
+		PROFILE_FUNCTION();
+		m_hit_index_dirty = false;
+		m_hit_targets.clear();
+		if (m_root) collectHitTargets(*m_root);
+
+		m_hit_cell_size.x = maximum(m_canvas_size.x / HIT_GRID_SIZE, 1.f);
+		m_hit_cell_size.y = maximum(m_canvas_size.y / HIT_GRID_SIZE, 1.f);
+		m_hit_cells.resize(HIT_GRID_SIZE * HIT_GRID_SIZE + 1);
+		for (u32& offset : m_hit_cells) offset = 0;
+
+		auto forEachCell = [&](const Rect& r, auto f) {
+			const u32 from = getHitCell(r.x, r.y);
+			const u32 to = getHitCell(r.x + r.w, r.y + r.h);
+			for (u32 y = from / HIT_GRID_SIZE; y <= to / HIT_GRID_SIZE; ++y)
+			{
+				for (u32 x = from % HIT_GRID_SIZE; x <= to % HIT_GRID_SIZE; ++x) f(x + y * HIT_GRID_SIZE);
+			}
+		};
+
+		for (const HitTarget& target : m_hit_targets)
+		{
+			forEachCell(target.rect->layout, [&](u32 cell) { ++m_hit_cells[cell + 1]; });
+		}
+		for (u32 i = 1; i < (u32)m_hit_cells.size(); ++i) m_hit_cells[i] += m_hit_cells[i - 1];
+
+		m_hit_cell_targets.resize(m_hit_cells.back());
+		// reuses the offsets as insertion cursors, so targets stay in hierarchy order in each cell
+		for (u32 i = 0, c = m_hit_targets.size(); i < c; ++i)
+		{
+			forEachCell(m_hit_targets[i].rect->layout, [&](u32 cell) {
+				m_hit_cell_targets[m_hit_cells[cell]] = i;
+				++m_hit_cells[cell];
+			});
+		}
+		for (u32 i = (u32)m_hit_cells.size() - 1; i > 0; --i) m_hit_cells[i] = m_hit_cells[i - 1];
+		m_hit_cells[0] = 0;
+	}
+
+
+	Span<const u32> getHitCellTargets(u32 cell) const
+	{
+		return Span(m_hit_cell_targets.begin() + m_hit_cells[cell], m_hit_cell_targets.begin() + m_hit_cells[cell + 1]);
+	}
+
+
+	EntityPtr getInteractableAt(const Vec2& pos) override
+	{
+		updateHitIndex();
+		if (m_hit_targets.empty()) return INVALID_ENTITY;
+
+		const Span<const u32> targets = getHitCellTargets(getHitCell(pos.x, pos.y));
+		for (u32 i = targets.length(); i > 0; --i)
+		{
+			const GUIRect& rect = *m_hit_targets[targets[i - 1]].rect;
+			if (contains(rect.layout, pos)) return rect.entity;
+		}
+		return INVALID_ENTITY;
+	}
+
+
+	// only buttons in the cells under both positions can change their hover state
+	void handleMouseAxisEvent(const Vec2& mouse_pos, const Vec2& prev_mouse_pos)
+	{
+		if (m_hit_targets.empty()) return;
+
+		++m_hit_stamp;
+		const u32 cells[] = { getHitCell(mouse_pos.x, mouse_pos.y), getHitCell(prev_mouse_pos.x, prev_mouse_pos.y) };
+		for (u32 cell : cells)
+		{
+			for (u32 idx : getHitCellTargets(cell))
+			{
+				HitTarget& target = m_hit_targets[idx];
+				if (target.stamp == m_hit_stamp || !target.is_button) continue;
+				target.stamp = m_hit_stamp;
+
+				const bool is = contains(target.rect->layout, mouse_pos);
+				const bool was = contains(target.rect->layout, prev_mouse_pos);
+				if (is != was) is ? hover(*target.rect) : hoverOut(*target.rect);
+			}
+			if (cells[0] == cells[1]) break;
 		}
 	}
 
@@ -657,22 +1060,27 @@ struct GUISceneImpl final : GUIScene
 	}
 
 
-	void handleMouseButtonEvent(const Rect& parent_rect, GUIRect& rect, const InputSystem::Event& event)
+	void handleMouseButtonEvent(const InputSystem::Event& event)
 	{
-		if (!rect.flags.isSet(GUIRect::IS_ENABLED)) return;
+		if (m_hit_targets.empty()) return;
 		const bool is_up = !event.data.button.down;
 
 		Vec2 pos(event.data.button.x_abs, event.data.button.y_abs);
-		const Rect& r = getRectOnCanvas(parent_rect, rect);
-		
-		if (contains(r, pos) && contains(r, m_mouse_down_pos))
+		for (u32 idx : getHitCellTargets(getHitCell(pos.x, pos.y)))
 		{
-			if (m_buttons.find(rect.entity) >= 0)
+			const HitTarget& target = m_hit_targets[idx];
+			GUIRect& rect = *target.rect;
+			const Rect& r = rect.layout;
+			if (!contains(r, pos) || !contains(r, m_mouse_down_pos)) continue;
+
+			if (target.is_button)
 			{
 				if (is_up && isButtonDown(rect.entity))
 				{
-					m_focused_entity = INVALID_ENTITY;
+					setFocus(INVALID_ENTITY);
 					m_button_clicked.invoke(rect.entity);
+					// the callback can change the GUI, the index is not valid anymore
+					if (m_hit_index_dirty || m_layout_dirty) return;
 				}
 				if (!is_up)
 				{
@@ -690,7 +1098,7 @@ struct GUISceneImpl final : GUIScene
 			
 			if (rect.input_field && is_up)
 			{
-				m_focused_entity = rect.entity;
+				setFocus(rect.entity);
 				if (rect.text)
 				{
 					rect.input_field->cursor = rect.text->text.length();
@@ -698,13 +1106,18 @@ struct GUISceneImpl final : GUIScene
 				}
 			}
 		}
+	}
 
-		for (EntityPtr e = m_universe.getFirstChild(rect.entity); e.isValid(); e = m_universe.getNextSibling((EntityRef)e))
-		{
-			int idx = m_rects.find((EntityRef)e);
-			if (idx < 0) continue;
-			handleMouseButtonEvent(r, *m_rects.at(idx), event);
-		}
+
+	// the text cursor is drawn in the focused rect
+	void setFocus(EntityPtr e)
+	{
+		if (m_focused_entity == e) return;
+		GUIRect* prev = getInput(m_focused_entity);
+		if (prev) invalidateGeometry(*prev);
+		m_focused_entity = e;
+		GUIRect* rect = getInput(e);
+		if (rect) invalidateGeometry(*rect);
 	}
 
 
@@ -730,7 +1143,9 @@ struct GUISceneImpl final : GUIScene
 		char tmp[5] = {};
 		memcpy(tmp, &event.data.text.utf8, sizeof(event.data.text.utf8));
 		rect->text->text.insert(rect->input_field->cursor, tmp);
+		rect->text->glyphs_dirty = true;
 		++rect->input_field->cursor;
+		invalidateGeometry(*rect);
 	}
 
 
@@ -741,6 +1156,8 @@ struct GUISceneImpl final : GUIScene
 		if (!event.data.button.down) return;
 
 		rect->input_field->anim = 0;
+		rect->text->glyphs_dirty = true;
+		invalidateGeometry(*rect);
 
 		switch ((OS::Keycode)event.data.button.key_id)
 		{
@@ -772,6 +1189,7 @@ struct GUISceneImpl final : GUIScene
 	void handleInput()
 	{
 		if (!m_root) return;
+		updateHitIndex();
 		InputSystem& input = m_system.getEngine().getInputSystem();
 		const InputSystem::Event* events = input.getEvents();
 		int events_count = input.getEventsCount();
@@ -788,7 +1206,7 @@ struct GUISceneImpl final : GUIScene
 					{
 						Vec2 pos(event.data.axis.x_abs, event.data.axis.y_abs);
 						Vec2 old_pos = pos - Vec2(event.data.axis.x, event.data.axis.y);
-						handleMouseAxisEvent({0, 0,  m_canvas_size.x, m_canvas_size.y }, *m_root, pos, old_pos);
+						handleMouseAxisEvent(pos, old_pos);
 					}
 					break;
 				case InputSystem::Event::BUTTON:
@@ -799,7 +1217,7 @@ struct GUISceneImpl final : GUIScene
 							m_mouse_down_pos.x = event.data.button.x_abs;
 							m_mouse_down_pos.y = event.data.button.y_abs;
 						}
-						handleMouseButtonEvent({ 0, 0, m_canvas_size.x, m_canvas_size.y }, *m_root, event);
+						handleMouseButtonEvent(event);
 						if (!event.data.button.down) m_buttons_down_count = 0;
 					}
 					else if (event.device->type == InputSystem::Device::KEYBOARD)
@@ -820,8 +1238,10 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = getInput(m_focused_entity);
 		if (!rect) return;
 
+		const bool was_visible = isCursorVisible(*rect->input_field);
 		rect->input_field->anim += time_delta;
 		rect->input_field->anim = fmodf(rect->input_field->anim, CURSOR_BLINK_PERIOD);
+		if (was_visible != isCursorVisible(*rect->input_field)) invalidateGeometry(*rect);
 	}
 
 
@@ -850,8 +1270,11 @@ struct GUISceneImpl final : GUIScene
 		rect->entity = entity;
 		rect->flags.set(GUIRect::IS_VALID);
 		rect->flags.set(GUIRect::IS_ENABLED);
+		rect->layout_dirty = true;
+		m_layout_dirty = true;
+		m_geometry_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_RECT_TYPE, this);
-		m_root = findRoot();
+		setRoot(findRoot());
 	}
 
 
@@ -866,6 +1289,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect& rect = *m_rects.at(idx);
 		rect.text = LUMIX_NEW(m_allocator, GUIText)(m_allocator);
 
+		m_geometry_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_TEXT_TYPE, this);
 	}
 
@@ -879,6 +1303,7 @@ struct GUISceneImpl final : GUIScene
 			idx = m_rects.find(entity);
 		}
 		m_rects.at(idx)->render_target = &EMPTY_RENDER_TARGET;
+		m_geometry_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_RENDER_TARGET_TYPE, this);
 	}
 
@@ -898,6 +1323,8 @@ struct GUISceneImpl final : GUIScene
 			button.hovered_color = image->color;
 			button.normal_color = image->color;
 		}
+		m_geometry_dirty = true;
+		m_hit_index_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_BUTTON_TYPE, this);
 	}
 
@@ -913,6 +1340,8 @@ struct GUISceneImpl final : GUIScene
 		GUIRect& rect = *m_rects.at(idx);
 		rect.input_field = LUMIX_NEW(m_allocator, GUIInputField);
 
+		m_geometry_dirty = true;
+		m_hit_index_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_INPUT_FIELD_TYPE, this);
 	}
 
@@ -929,10 +1358,20 @@ struct GUISceneImpl final : GUIScene
 		rect.image = LUMIX_NEW(m_allocator, GUIImage);
 		rect.image->flags.set(GUIImage::IS_ENABLED);
 
+		m_geometry_dirty = true;
 		m_universe.onComponentCreated(entity, GUI_IMAGE_TYPE, this);
 	}
 
 
+	void setRoot(GUIRect* root)
+	{
+		m_root = root;
+		if (m_root) m_root->layout_dirty = true;
+		m_layout_dirty = true;
+		m_geometry_dirty = true;
+	}
+
+
 	GUIRect* findRoot()
 	{
 		if (m_rects.size() == 0) return nullptr;
@@ -953,16 +1392,20 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIRect* rect = m_rects[entity];
 		rect->flags.set(GUIRect::IS_VALID, false);
+		releaseGeometry(*rect);
+		const bool is_root = rect == m_root;
 		if (rect->image == nullptr && rect->text == nullptr && rect->input_field == nullptr)
 		{
 			LUMIX_DELETE(m_allocator, rect);
 			m_rects.erase(entity);
 			
 		}
-		if (rect == m_root)
+		if (is_root)
 		{
-			m_root = findRoot();
+			setRoot(findRoot());
 		}
+		m_layout_dirty = true;
+		m_geometry_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_RECT_TYPE, this);
 	}
 
@@ -970,6 +1413,8 @@ struct GUISceneImpl final : GUIScene
 	void destroyButton(EntityRef entity)
 	{
 		m_buttons.erase(entity);
+		m_geometry_dirty = true;
+		m_hit_index_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_BUTTON_TYPE, this);
 	}
 
@@ -978,6 +1423,7 @@ struct GUISceneImpl final : GUIScene
 	{
 		GUIRect* rect = m_rects[entity];
 		rect->render_target = nullptr;
+		m_geometry_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_RENDER_TARGET_TYPE, this);
 	}
 
@@ -987,6 +1433,8 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->input_field);
 		rect->input_field = nullptr;
+		m_geometry_dirty = true;
+		m_hit_index_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_INPUT_FIELD_TYPE, this);
 	}
 
@@ -996,6 +1444,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->image);
 		rect->image = nullptr;
+		m_geometry_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_IMAGE_TYPE, this);
 	}
 
@@ -1005,6 +1454,7 @@ struct GUISceneImpl final : GUIScene
 		GUIRect* rect = m_rects[entity];
 		LUMIX_DELETE(m_allocator, rect->text);
 		rect->text = nullptr;
+		m_geometry_dirty = true;
 		m_universe.onComponentDestroyed(entity, GUI_TEXT_TYPE, this);
 	}
 
@@ -1068,6 +1518,7 @@ struct GUISceneImpl final : GUIScene
 			serializer.read(rect->left);
 			m_rects.insert(rect->entity, rect);
 			if (rect->flags.isSet(GUIRect::IS_VALID)) {
+				m_geometry_dirty = true;
 				m_universe.onComponentCreated(rect->entity, GUI_RECT_TYPE, this);
 			}
 
@@ -1088,6 +1539,7 @@ struct GUISceneImpl final : GUIScene
 				}
 				serializer.read(rect->image->color);
 				serializer.read(rect->image->flags.base);
+				m_geometry_dirty = true;
 				m_universe.onComponentCreated(rect->entity, GUI_IMAGE_TYPE, this);
 
 			}
@@ -1095,6 +1547,7 @@ struct GUISceneImpl final : GUIScene
 			if (has_input_field)
 			{
 				rect->input_field = LUMIX_NEW(m_allocator, GUIInputField);
+				m_geometry_dirty = true;
 				m_universe.onComponentCreated(rect->entity, GUI_INPUT_FIELD_TYPE, this);
 			}
 			bool has_text = serializer.read<bool>();
@@ -1111,6 +1564,7 @@ struct GUISceneImpl final : GUIScene
 				serializer.read(text.text);
 				FontResource* res = tmp[0] == 0 ? nullptr : m_font_manager->getOwner().load<FontResource>(Path(tmp));
 				text.setFontResource(res);
+				m_geometry_dirty = true;
 				m_universe.onComponentCreated(rect->entity, GUI_TEXT_TYPE, this);
 			}
 		}
@@ -1123,13 +1577,13 @@ struct GUISceneImpl final : GUIScene
 			GUIButton& button = m_buttons.emplace(e);
 			serializer.read(button);
 		}
-		m_root = findRoot();
+		setRoot(findRoot());
 	}
 	
 
 	void setRenderTarget(EntityRef entity, gpu::TextureHandle* texture_handle) override
 	{
-		m_rects[entity]->render_target = texture_handle;
+		editRect(entity)->render_target = texture_handle;
 	}
 
 	
@@ -1167,6 +1621,27 @@ struct GUISceneImpl final : GUIScene
 	FontManager* m_font_manager = nullptr;
 	Vec2 m_canvas_size;
 	Vec2 m_mouse_down_pos;
+	Draw2D m_cached_draw;
+	Draw2D m_batched_draw;
+	bool m_batched_draw_dirty = true;
+	bool m_batching_enabled = true;
+	HashMap<Sprite*, Texture*> m_cached_textures;
+	GUIRect* m_building_segment = nullptr;
+	bool m_layout_dirty = true;
+	u32 m_layout_hierarchy_version = 0;
+	Vec2 m_layout_canvas_size = Vec2(0);
+	Array<HitTarget> m_hit_targets;
+	// m_hit_cells[i]..m_hit_cells[i + 1] is the range in m_hit_cell_targets
+	Array<u32> m_hit_cells;
+	Array<u32> m_hit_cell_targets;
+	Vec2 m_hit_cell_size = Vec2(1);
+	u32 m_hit_stamp = 0;
+	bool m_hit_index_dirty = true;
+
+	static constexpr int HIT_GRID_SIZE = 16;
+	bool m_geometry_dirty = true;
+	u32 m_cached_hierarchy_version = 0;
+	u32 m_cached_atlas_version = 0;
 	DelegateList<void(EntityRef)> m_button_clicked;
 	DelegateList<void(EntityRef)> m_rect_hovered;
 	DelegateList<void(EntityRef)> m_rect_hovered_out;
@@ -37,6 +37,11 @@ struct GUIScene : IScene
 	virtual Rect getRectOnCanvas(EntityPtr entity, const Vec2& canva_size) const = 0;
 	virtual Rect getRect(EntityRef entity) const = 0;
 	virtual EntityPtr getRectAt(const Vec2& pos, const Vec2& canvas_size) const = 0;
+	// topmost enabled button or input field, uses the layout of the last rendered or updated frame
+	virtual EntityPtr getInteractableAt(const Vec2& pos) = 0;
+	// reorders draws of the whole canvas by texture where they do not overlap
+	virtual void enableBatching(bool enable) = 0;
+	virtual bool isBatchingEnabled() const = 0;
 
 	virtual void enableRect(EntityRef entity, bool enable) = 0;
 	virtual bool isRectEnabled(EntityRef entity) = 0;
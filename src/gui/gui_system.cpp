@@ -25,6 +25,9 @@ namespace Lumix
 {
 
 
+static constexpr u32 GUI_HASH = StringHash("gui");
+
+
 struct GUISystemImpl;
 
 
@@ -204,7 +207,7 @@ struct GUISystemImpl final : GUISystem
 		if (!m_interface) return;
 
 		Pipeline* pipeline = m_interface->getPipeline();
-		auto* scene = (GUIScene*)pipeline->getScene()->getUniverse().getScene(crc32("gui"));
+		auto* scene = (GUIScene*)pipeline->getScene()->getUniverse().getScene(GUI_HASH);
 		Vec2 size = m_interface->getSize();
 		scene->render(*pipeline, size);
 	}
@@ -213,7 +216,7 @@ struct GUISystemImpl final : GUISystem
 	void renderNewUI()
 	{
 		Pipeline* pipeline = m_interface->getPipeline();
-		auto* scene = (GUIScene*)pipeline->getScene()->getUniverse().getScene(crc32("gui"));
+		auto* scene = (GUIScene*)pipeline->getScene()->getUniverse().getScene(GUI_HASH);
 		Vec2 size =  m_interface->getSize();
 		scene->render(*pipeline, size);
 	}
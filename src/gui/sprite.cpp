@@ -61,18 +61,54 @@ bool Sprite::save(TextSerializer& serializer)
 }
 
 
-bool Sprite::load(u64 size, const u8* mem)
+bool Sprite::compile(Span<const u8> src, OutputMemoryStream& dst)
 {
-	InputMemoryStream file(mem, size);
+	InputMemoryStream file(src.begin(), src.length());
 	TextDeserializer serializer(file);
 	char tmp[MAX_PATH_LENGTH];
 	serializer.read(Span(tmp));
-	type = equalStrings(tmp, "simple") ? SIMPLE : PATCH9; 
-	serializer.read(Ref(top));
-	serializer.read(Ref(bottom));
-	serializer.read(Ref(left));
-	serializer.read(Ref(right));
+	const Type type = equalStrings(tmp, "simple") ? SIMPLE : PATCH9;
+	i32 values[4];
+	for (i32& v : values) serializer.read(Ref(v));
 	serializer.read(Span(tmp));
+
+	dst.write(BINARY_MAGIC);
+	dst.write(BinaryVersion::LATEST);
+	dst.write((u8)type);
+	dst.write(values);
+	dst.writeString(tmp);
+	return true;
+}
+
+
+bool Sprite::load(u64 size, const u8* mem)
+{
+	InputMemoryStream file(mem, size);
+	char tmp[MAX_PATH_LENGTH];
+	// text is loaded only from resources compiled before the binary format was added
+	if (size >= sizeof(u32) * 2 && file.read<u32>() == BINARY_MAGIC) {
+		if (file.read<BinaryVersion>() > BinaryVersion::LATEST) {
+			logError("GUI") << "Unsupported sprite version " << getPath();
+			return false;
+		}
+		type = (Type)file.read<u8>();
+		file.read(top);
+		file.read(bottom);
+		file.read(left);
+		file.read(right);
+		file.readString(Span(tmp));
+	}
+	else {
+		file.rewind();
+		TextDeserializer serializer(file);
+		serializer.read(Span(tmp));
+		type = equalStrings(tmp, "simple") ? SIMPLE : PATCH9; 
+		serializer.read(Ref(top));
+		serializer.read(Ref(bottom));
+		serializer.read(Ref(left));
+		serializer.read(Ref(right));
+		serializer.read(Span(tmp));
+	}
 	ResourceManagerHub& mng = m_resource_manager.getOwner();
 	m_texture = tmp[0] != '\0' ? mng.load<Texture>(Path(tmp)) : nullptr;
 	return true;
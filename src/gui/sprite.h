@@ -16,6 +16,13 @@ public:
 		SIMPLE
 	};
 
+	static constexpr u32 BINARY_MAGIC = 0x5f535052; // == '_SPR'
+	enum class BinaryVersion : u32 {
+		FIRST,
+
+		LATEST
+	};
+
 	Sprite(const Path& path, ResourceManager& manager, IAllocator& allocator);
 
 	ResourceType getType() const override { return TYPE; }
@@ -23,6 +30,8 @@ public:
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	bool save(struct TextSerializer& serializer);
+	// converts text source to the binary format, which is what is loaded at runtime
+	static bool compile(Span<const u8> src, struct OutputMemoryStream& dst);
 	
 	void setTexture(const Path& path);
 	struct Texture* getTexture() const { return m_texture; }
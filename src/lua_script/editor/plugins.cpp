@@ -49,6 +49,8 @@ struct AssetPlugin : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 	
 	void onGUI(Span<Resource*> resources) override
 	{
@@ -350,6 +352,98 @@ struct ConsolePlugin final : StudioApp::GUIPlugin
 };
 
 
+struct ScriptProfilerPlugin final : StudioApp::GUIPlugin
+{
+	explicit ScriptProfilerPlugin(StudioApp& _app)
+		: app(_app)
+		, sorted(_app.getAllocator())
+	{
+		Action* action = LUMIX_NEW(app.getAllocator(), Action)("Script Profiler", "Toggle script profiler", "script_profiler");
+		action->func.bind<&ScriptProfilerPlugin::toggleOpen>(this);
+		action->is_selected.bind<&ScriptProfilerPlugin::isOpen>(this);
+		app.addWindowAction(action);
+	}
+
+	void onSettingsLoaded() override {
+		open = app.getSettings().getValue("is_script_profiler_open", false);
+	}
+
+	void onBeforeSettingsSaved() override {
+		app.getSettings().setValue("is_script_profiler_open", open);
+	}
+
+	const char* getName() const override { return "script_profiler"; }
+
+	bool isOpen() const { return open; }
+	void toggleOpen() { open = !open; }
+
+	void onWindowGUI() override
+	{
+		if (!open) return;
+		if (ImGui::Begin("Script profiler", &open))
+		{
+			Universe* universe = app.getWorldEditor().getUniverse();
+			auto* scene = static_cast<LuaScriptScene*>(universe->getScene(LUA_SCRIPT_TYPE));
+			const Span<const LuaScriptScene::ScriptProfile> profiles = scene->getScriptProfiles();
+			if (profiles.length() == 0)
+			{
+				ImGui::TextUnformatted("Scripts are profiled while the game is running");
+			}
+			else
+			{
+				ImGui::Checkbox("Sort by allocations", &sort_by_allocations);
+				sorted.clear();
+				for (const LuaScriptScene::ScriptProfile& profile : profiles) sorted.push(&profile);
+				qsort(sorted.begin(), sorted.size(), sizeof(sorted[0]), sort_by_allocations ? compareAllocated : compareTime);
+
+				ImGui::Columns(4);
+				ImGui::Text("Script");
+				ImGui::NextColumn();
+				ImGui::Text("Time (ms)");
+				ImGui::NextColumn();
+				ImGui::Text("Allocations");
+				ImGui::NextColumn();
+				ImGui::Text("Allocated (KB)");
+				ImGui::NextColumn();
+				ImGui::Separator();
+				for (const LuaScriptScene::ScriptProfile* profile : sorted)
+				{
+					ImGui::TextUnformatted(profile->path.c_str());
+					ImGui::NextColumn();
+					ImGui::Text("%.3f", profile->time);
+					ImGui::NextColumn();
+					ImGui::Text("%u", profile->allocations);
+					ImGui::NextColumn();
+					ImGui::Text("%.1f", profile->allocated / 1024.f);
+					ImGui::NextColumn();
+				}
+				ImGui::Columns();
+			}
+		}
+		ImGui::End();
+	}
+
+	static int compareTime(const void* a, const void* b)
+	{
+		const float ta = (*(const LuaScriptScene::ScriptProfile**)a)->time;
+		const float tb = (*(const LuaScriptScene::ScriptProfile**)b)->time;
+		return ta < tb ? 1 : (ta > tb ? -1 : 0);
+	}
+
+	static int compareAllocated(const void* a, const void* b)
+	{
+		const u64 aa = (*(const LuaScriptScene::ScriptProfile**)a)->allocated;
+		const u64 ab = (*(const LuaScriptScene::ScriptProfile**)b)->allocated;
+		return aa < ab ? 1 : (aa > ab ? -1 : 0);
+	}
+
+	StudioApp& app;
+	Array<const LuaScriptScene::ScriptProfile*> sorted;
+	bool open = false;
+	bool sort_by_allocations = false;
+};
+
+
 struct AddComponentPlugin final : StudioApp::IAddComponentPlugin
 {
 	explicit AddComponentPlugin(StudioApp& _app)
@@ -493,6 +587,9 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_console_plugin = LUMIX_NEW(allocator, ConsolePlugin)(m_app);
 		m_app.addPlugin(*m_console_plugin);
+
+		m_profiler_plugin = LUMIX_NEW(allocator, ScriptProfilerPlugin)(m_app);
+		m_app.addPlugin(*m_profiler_plugin);
 	}
 
 
@@ -509,6 +606,9 @@ struct StudioAppPlugin : StudioApp::IPlugin
 
 		m_app.removePlugin(*m_console_plugin);
 		LUMIX_DELETE(allocator, m_console_plugin);
+
+		m_app.removePlugin(*m_profiler_plugin);
+		LUMIX_DELETE(allocator, m_profiler_plugin);
 	}
 
 
@@ -517,6 +617,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 	GizmoPlugin* m_gizmo_plugin;
 	AssetPlugin* m_asset_plugin;
 	ConsolePlugin* m_console_plugin;
+	ScriptProfilerPlugin* m_profiler_plugin;
 };
 
 
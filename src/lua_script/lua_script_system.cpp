@@ -11,6 +11,7 @@
 #include "engine/plugin.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/os.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
@@ -67,9 +68,25 @@ namespace Lumix
 		const char* getName() const override { return "lua_script"; }
 		LuaScriptManager& getScriptManager() { return m_script_manager; }
 
+		// wraps the allocator of the engine's lua state to count what scripts allocate
+		static void* luaAlloc(void* ud, void* ptr, size_t osize, size_t nsize)
+		{
+			LuaScriptSystemImpl* system = (LuaScriptSystemImpl*)ud;
+			if (nsize > osize)
+			{
+				++system->m_lua_allocations;
+				system->m_lua_allocated += nsize - osize;
+			}
+			return system->m_lua_allocf(system->m_lua_allocf_ud, ptr, osize, nsize);
+		}
+
 		Engine& m_engine;
-		IAllocator& m_allocator;
+		TagAllocator m_allocator;
 		LuaScriptManager m_script_manager;
+		lua_Alloc m_lua_allocf;
+		void* m_lua_allocf_ud;
+		u32 m_lua_allocations = 0;
+		u64 m_lua_allocated = 0;
 	};
 
 
@@ -77,9 +94,74 @@ namespace Lumix
 	{
 		struct TimerData
 		{
-			float time;
+			// game time when the timer fires
+			double due;
 			lua_State* state;
+			// LUA_NOREF if the timer is cancelled
 			int func;
+			// profile of the script which set the timer
+			u32 profile;
+		};
+
+		// coroutine suspended by one of the wait functions
+		struct CoroutineWait
+		{
+			// game time or frame index, depending on the heap
+			double due;
+			lua_State* coroutine;
+			// registry reference keeping the coroutine alive, LUA_NOREF if cancelled
+			int thread;
+			// script instance which started the coroutine
+			lua_State* owner;
+			u32 profile;
+			u32 signal;
+		};
+
+		static constexpr u32 NO_PROFILE = 0xffFFffFF;
+
+		struct ProfileFrame
+		{
+			u64 ticks = 0;
+			u32 allocations = 0;
+			u64 allocated = 0;
+		};
+
+		// attributes time and lua allocations to a script, nested scopes are inclusive
+		struct ProfileScope
+		{
+			ProfileScope(LuaScriptSceneImpl& scene, u32 profile)
+				: scene(scene)
+				, profile(profile)
+				, prev_profile(scene.m_current_profile)
+			{
+				// time of a script calling itself is not counted twice
+				if (profile == prev_profile) this->profile = NO_PROFILE;
+				if (this->profile == NO_PROFILE) return;
+				Profiler::beginBlock("lua script");
+				Profiler::pushString(scene.m_script_profiles[profile].path.c_str());
+				scene.m_current_profile = profile;
+				allocations = scene.m_system.m_lua_allocations;
+				allocated = scene.m_system.m_lua_allocated;
+				start = OS::Timer::getRawTimestamp();
+			}
+
+			~ProfileScope()
+			{
+				if (profile == NO_PROFILE) return;
+				ProfileFrame& frame = scene.m_profile_frames[profile];
+				frame.ticks += OS::Timer::getRawTimestamp() - start;
+				frame.allocations += scene.m_system.m_lua_allocations - allocations;
+				frame.allocated += scene.m_system.m_lua_allocated - allocated;
+				scene.m_current_profile = prev_profile;
+				Profiler::endBlock();
+			}
+
+			LuaScriptSceneImpl& scene;
+			u32 profile;
+			u32 prev_profile;
+			u32 allocations;
+			u64 allocated;
+			u64 start;
 		};
 
 		struct CallbackData
@@ -87,6 +169,22 @@ namespace Lumix
 			LuaScript* script;
 			lua_State* state;
 			int environment;
+			// registry reference to the callback, resolved when the script starts
+			int func;
+		};
+
+		// all instances of a script defining updateBatch(instances, dt) are updated by a single call,
+		// instances is an array of their environments
+		struct BatchUpdate
+		{
+			BatchUpdate(IAllocator& allocator) : environments(allocator) {}
+
+			LuaScript* script;
+			// taken from environments[0]
+			int func;
+			// registry reference to the instances table, LUA_NOREF until built
+			int instances = LUA_NOREF;
+			Array<int> environments;
 		};
 
 		struct ScriptComponent;
@@ -141,8 +239,8 @@ namespace Lumix
 
 			void detectProperties(ScriptInstance& inst)
 			{
-				static const u32 INDEX_HASH = crc32("__index");
-				static const u32 THIS_HASH = crc32("this");
+				static constexpr u32 INDEX_HASH = StringHash("__index");
+				static constexpr u32 THIS_HASH = StringHash("this");
 				lua_State* L = inst.m_state;
 				lua_rawgeti(L, LUA_REGISTRYINDEX, inst.m_environment); // [env]
 				ASSERT(lua_type(L, -1) == LUA_TTABLE);
@@ -288,8 +386,18 @@ namespace Lumix
 			, m_universe(ctx)
 			, m_scripts(system.m_allocator)
 			, m_updates(system.m_allocator)
+			, m_batch_updates(system.m_allocator)
+			, m_script_profiles(system.m_allocator)
+			, m_profile_frames(system.m_allocator)
+			, m_profile_indices(system.m_allocator)
 			, m_input_handlers(system.m_allocator)
 			, m_timers(system.m_allocator)
+			, m_due_timers(system.m_allocator)
+			, m_time_waits(system.m_allocator)
+			, m_frame_waits(system.m_allocator)
+			, m_signal_waits(system.m_allocator)
+			, m_due_waits(system.m_allocator)
+			, m_coroutines(system.m_allocator)
 			, m_property_names(system.m_allocator)
 			, m_is_game_running(false)
 			, m_is_api_registered(false)
@@ -746,28 +854,215 @@ namespace Lumix
 
 		void cancelTimer(int timer_func)
 		{
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
+			for (TimerData& timer : m_timers)
 			{
-				if (m_timers[i].func == timer_func)
+				if (timer.func == timer_func)
 				{
-					m_timers.swapAndPop(i);
+					// stays in the heap until it is due
+					luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+					timer.func = LUA_NOREF;
 					break;
 				}
 			}
 		}
 
 
+		// binary min-heap ordered by `due`, so each frame touches only what is due
+		template <typename T>
+		static void pushHeap(Array<T>& heap, const T& value)
+		{
+			heap.push(value);
+			u32 i = heap.size() - 1;
+			while (i > 0)
+			{
+				const u32 parent = (i - 1) / 2;
+				if (heap[parent].due <= heap[i].due) break;
+				const T tmp = heap[parent];
+				heap[parent] = heap[i];
+				heap[i] = tmp;
+				i = parent;
+			}
+		}
+
+
+		template <typename T>
+		static T popHeap(Array<T>& heap)
+		{
+			const T res = heap[0];
+			heap[0] = heap.back();
+			heap.pop();
+			const u32 size = heap.size();
+			u32 i = 0;
+			for (;;)
+			{
+				const u32 left = i * 2 + 1;
+				const u32 right = left + 1;
+				u32 min = i;
+				if (left < size && heap[left].due < heap[min].due) min = left;
+				if (right < size && heap[right].due < heap[min].due) min = right;
+				if (min == i) break;
+				const T tmp = heap[min];
+				heap[min] = heap[i];
+				heap[i] = tmp;
+				i = min;
+			}
+			return res;
+		}
+
+
+		static int startCoroutine(lua_State* L)
+		{
+			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
+			if (!lua_isfunction(L, 2)) LuaWrapper::argError(L, 2, "function");
+
+			// coroutines started by a coroutine belong to the same script instance
+			auto iter = scene->m_coroutines.find(L);
+			lua_State* owner = iter.isValid() ? iter.value() : L;
+
+			lua_State* co = lua_newthread(L); // [thread]
+			lua_pushvalue(L, 2); // [thread, func]
+			lua_xmove(L, co, 1); // [thread]
+			scene->m_coroutines.insert(co, owner);
+			scene->runCoroutine(co, scene->m_current_profile);
+			lua_pop(L, 1); // []
+			return 0;
+		}
+
+
+		int yieldCoroutine(lua_State* L, Array<CoroutineWait>* heap, double due, u32 signal)
+		{
+			auto iter = m_coroutines.find(L);
+			if (!iter.isValid()) luaL_error(L, "only coroutines started by LuaScript.startCoroutine can wait");
+
+			CoroutineWait wait;
+			wait.due = due;
+			wait.coroutine = L;
+			wait.owner = iter.value();
+			wait.profile = m_current_profile;
+			wait.signal = signal;
+			lua_pushthread(L);
+			wait.thread = luaL_ref(L, LUA_REGISTRYINDEX);
+			if (heap) pushHeap(*heap, wait);
+			else m_signal_waits.push(wait);
+			m_coroutine_queued = true;
+			return lua_yield(L, 0);
+		}
+
+
+		static int wait(lua_State* L)
+		{
+			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
+			const float seconds = LuaWrapper::checkArg<float>(L, 2);
+			return scene->yieldCoroutine(L, &scene->m_time_waits, scene->m_time + seconds, 0);
+		}
+
+
+		static int waitFrames(lua_State* L)
+		{
+			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
+			const int frames = maximum(LuaWrapper::checkArg<int>(L, 2), 1);
+			return scene->yieldCoroutine(L, &scene->m_frame_waits, double(scene->m_frame + frames), 0);
+		}
+
+
+		static int waitUntil(lua_State* L)
+		{
+			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
+			const char* signal = LuaWrapper::checkArg<const char*>(L, 2);
+			return scene->yieldCoroutine(L, nullptr, 0, crc32(signal));
+		}
+
+
+		// resumes all coroutines waiting for the signal
+		static int signal(lua_State* L)
+		{
+			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
+			const u32 signal = crc32(LuaWrapper::checkArg<const char*>(L, 2));
+
+			Array<CoroutineWait> woken(scene->m_system.m_allocator);
+			for (int i = scene->m_signal_waits.size() - 1; i >= 0; --i)
+			{
+				if (scene->m_signal_waits[i].signal != signal) continue;
+				woken.push(scene->m_signal_waits[i]);
+				scene->m_signal_waits.swapAndPop(i);
+			}
+			for (const CoroutineWait& wait : woken) scene->resumeCoroutine(wait);
+			return 0;
+		}
+
+
+		void runCoroutine(lua_State* co, u32 profile)
+		{
+			ProfileScope profile_scope(*this, profile);
+			m_coroutine_queued = false;
+			const int res = lua_resume(co, 0);
+			if (res == LUA_YIELD)
+			{
+				if (m_coroutine_queued) return;
+				logError("Lua Script") << "Coroutines started by LuaScript.startCoroutine can yield only through LuaScript wait functions";
+			}
+			else if (res != 0)
+			{
+				logError("Lua Script") << lua_tostring(co, -1);
+			}
+			m_coroutines.erase(co);
+		}
+
+
+		void resumeCoroutine(const CoroutineWait& wait)
+		{
+			if (wait.thread == LUA_NOREF) return;
+
+			// the thread stays on the stack, so it can not be collected while it runs
+			lua_State* L = m_system.m_engine.getState();
+			lua_rawgeti(L, LUA_REGISTRYINDEX, wait.thread); // [thread]
+			luaL_unref(L, LUA_REGISTRYINDEX, wait.thread);
+			runCoroutine(wait.coroutine, wait.profile);
+			lua_pop(L, 1); // []
+		}
+
+
+		static void cancelWaits(lua_State* L, Array<CoroutineWait>& waits, lua_State* owner)
+		{
+			for (CoroutineWait& wait : waits)
+			{
+				if (wait.owner != owner) continue;
+				luaL_unref(L, LUA_REGISTRYINDEX, wait.thread);
+				wait.thread = LUA_NOREF;
+			}
+		}
+
+
+		void processWaits(Array<CoroutineWait>& heap, double now)
+		{
+			// collected first, so coroutines waiting again are not resumed twice in one frame
+			m_due_waits.clear();
+			while (!heap.empty() && heap[0].due <= now)
+			{
+				m_due_waits.push(popHeap(heap));
+			}
+			for (int i = 0; i < m_due_waits.size(); ++i)
+			{
+				const CoroutineWait wait = m_due_waits[i];
+				m_due_waits[i].thread = LUA_NOREF;
+				resumeCoroutine(wait);
+			}
+			m_due_waits.clear();
+		}
+
+
 		static int setTimer(lua_State* L)
 		{
 			auto* scene = LuaWrapper::checkArg<LuaScriptSceneImpl*>(L, 1);
 			float time = LuaWrapper::checkArg<float>(L, 2);
 			if (!lua_isfunction(L, 3)) LuaWrapper::argError(L, 3, "function");
-			TimerData& timer = scene->m_timers.emplace();
-			timer.time = time;
+			TimerData timer;
+			timer.due = scene->m_time + time;
 			timer.state = L;
+			timer.profile = scene->m_current_profile;
 			lua_pushvalue(L, 3);
 			timer.func = luaL_ref(L, LUA_REGISTRYINDEX);
-			lua_pop(L, 1);
+			pushHeap(scene->m_timers, timer);
 			LuaWrapper::push(L, timer.func);
 			return 1;
 		}
@@ -806,6 +1101,11 @@ namespace Lumix
 			#undef REGISTER_FUNCTION
 
 			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "setTimer", &LuaScriptSceneImpl::setTimer);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "startCoroutine", &LuaScriptSceneImpl::startCoroutine);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "wait", &LuaScriptSceneImpl::wait);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "waitFrames", &LuaScriptSceneImpl::waitFrames);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "waitUntil", &LuaScriptSceneImpl::waitUntil);
+			LuaWrapper::createSystemFunction(engine_state, "LuaScript", "signal", &LuaScriptSceneImpl::signal);
 		}
 
 
@@ -932,20 +1232,33 @@ namespace Lumix
 
 		void disableScript(ScriptInstance& inst)
 		{
-			for (int i = 0; i < m_timers.size(); ++i)
-			{
-				if (m_timers[i].state == inst.m_state)
+			auto cancel_timers = [&](Array<TimerData>& timers){
+				for (TimerData& timer : timers)
 				{
-					luaL_unref(m_timers[i].state, LUA_REGISTRYINDEX, m_timers[i].func);
-					m_timers.swapAndPop(i);
-					--i;
+					if (timer.state != inst.m_state) continue;
+					luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
+					timer.func = LUA_NOREF;
 				}
+			};
+			cancel_timers(m_timers);
+			cancel_timers(m_due_timers);
+
+			cancelWaits(inst.m_state, m_time_waits, inst.m_state);
+			cancelWaits(inst.m_state, m_frame_waits, inst.m_state);
+			cancelWaits(inst.m_state, m_due_waits, inst.m_state);
+			for (int i = m_signal_waits.size() - 1; i >= 0; --i)
+			{
+				if (m_signal_waits[i].owner != inst.m_state) continue;
+				luaL_unref(inst.m_state, LUA_REGISTRYINDEX, m_signal_waits[i].thread);
+				m_signal_waits.swapAndPop(i);
 			}
+			m_coroutines.eraseIf([&](lua_State* owner){ return owner == inst.m_state; });
 
 			for (int i = 0; i < m_updates.size(); ++i)
 			{
 				if (m_updates[i].state == inst.m_state)
 				{
+					luaL_unref(inst.m_state, LUA_REGISTRYINDEX, m_updates[i].func);
 					m_updates.swapAndPop(i);
 					break;
 				}
@@ -955,10 +1268,99 @@ namespace Lumix
 			{
 				if (m_input_handlers[i].state == inst.m_state)
 				{
+					luaL_unref(inst.m_state, LUA_REGISTRYINDEX, m_input_handlers[i].func);
 					m_input_handlers.swapAndPop(i);
 					break;
 				}
 			}
+
+			removeBatchUpdate(inst);
+		}
+
+
+		void addBatchUpdate(ScriptInstance& inst)
+		{
+			lua_State* L = inst.m_state; // [env, func]
+			for (BatchUpdate& batch : m_batch_updates)
+			{
+				if (batch.script != inst.m_script) continue;
+
+				lua_pop(L, 1); // [env]
+				batch.environments.push(inst.m_environment);
+				luaL_unref(L, LUA_REGISTRYINDEX, batch.instances);
+				batch.instances = LUA_NOREF;
+				return;
+			}
+
+			BatchUpdate& batch = m_batch_updates.emplace(m_system.m_allocator);
+			batch.script = inst.m_script;
+			batch.func = luaL_ref(L, LUA_REGISTRYINDEX); // [env]
+			batch.environments.push(inst.m_environment);
+		}
+
+
+		void removeBatchUpdate(ScriptInstance& inst)
+		{
+			lua_State* L = m_system.m_engine.getState();
+			for (int i = 0; i < m_batch_updates.size(); ++i)
+			{
+				BatchUpdate& batch = m_batch_updates[i];
+				if (batch.script != inst.m_script) continue;
+
+				const int idx = batch.environments.indexOf(inst.m_environment);
+				if (idx < 0) return;
+
+				batch.environments.swapAndPop(idx);
+				luaL_unref(L, LUA_REGISTRYINDEX, batch.instances);
+				batch.instances = LUA_NOREF;
+				if (batch.environments.empty())
+				{
+					luaL_unref(L, LUA_REGISTRYINDEX, batch.func);
+					m_batch_updates.swapAndPop(i);
+					return;
+				}
+
+				if (idx == 0)
+				{
+					// the function should not run in the environment of a destroyed instance
+					luaL_unref(L, LUA_REGISTRYINDEX, batch.func);
+					lua_rawgeti(L, LUA_REGISTRYINDEX, batch.environments[0]); // [env]
+					lua_getfield(L, -1, "updateBatch"); // [env, func]
+					batch.func = luaL_ref(L, LUA_REGISTRYINDEX); // [env]
+					lua_pop(L, 1); // []
+				}
+				return;
+			}
+		}
+
+
+		void updateBatches(float time_delta)
+		{
+			lua_State* L = m_system.m_engine.getState();
+			for (int i = 0; i < m_batch_updates.size(); ++i)
+			{
+				BatchUpdate& batch = m_batch_updates[i];
+				if (batch.instances == LUA_NOREF)
+				{
+					lua_createtable(L, batch.environments.size(), 0); // [instances]
+					for (int j = 0; j < batch.environments.size(); ++j)
+					{
+						lua_rawgeti(L, LUA_REGISTRYINDEX, batch.environments[j]); // [instances, env]
+						lua_rawseti(L, -2, j + 1); // [instances]
+					}
+					batch.instances = luaL_ref(L, LUA_REGISTRYINDEX); // []
+				}
+
+				ProfileScope profile_scope(*this, getProfile(*batch.script));
+				lua_rawgeti(L, LUA_REGISTRYINDEX, batch.func); // [func]
+				lua_rawgeti(L, LUA_REGISTRYINDEX, batch.instances); // [func, instances]
+				lua_pushnumber(L, time_delta); // [func, instances, dt]
+				if (lua_pcall(L, 2, 0, 0) != 0) // []
+				{
+					logError("Lua Script") << lua_tostring(L, -1);
+					lua_pop(L, 1);
+				}
+			}
 		}
 
 
@@ -1027,15 +1429,28 @@ namespace Lumix
 				lua_pop(instance.m_state, 1);
 				return;
 			}
-			lua_getfield(instance.m_state, -1, "update");
+			lua_getfield(instance.m_state, -1, "updateBatch");
 			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
 			{
-				auto& update_data = m_updates.emplace();
-				update_data.script = instance.m_script;
-				update_data.state = instance.m_state;
-				update_data.environment = instance.m_environment;
+				addBatchUpdate(instance);
+			}
+			else
+			{
+				lua_pop(instance.m_state, 1);
+				lua_getfield(instance.m_state, -1, "update");
+				if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
+				{
+					auto& update_data = m_updates.emplace();
+					update_data.script = instance.m_script;
+					update_data.state = instance.m_state;
+					update_data.environment = instance.m_environment;
+					update_data.func = luaL_ref(instance.m_state, LUA_REGISTRYINDEX);
+				}
+				else
+				{
+					lua_pop(instance.m_state, 1);
+				}
 			}
-			lua_pop(instance.m_state, 1);
 			lua_getfield(instance.m_state, -1, "onInputEvent");
 			if (lua_type(instance.m_state, -1) == LUA_TFUNCTION)
 			{
@@ -1043,8 +1458,12 @@ namespace Lumix
 				callback.script = instance.m_script;
 				callback.state = instance.m_state;
 				callback.environment = instance.m_environment;
+				callback.func = luaL_ref(instance.m_state, LUA_REGISTRYINDEX);
+			}
+			else
+			{
+				lua_pop(instance.m_state, 1);
 			}
-			lua_pop(instance.m_state, 1);
 
 			if (!is_restart)
 			{
@@ -1055,6 +1474,7 @@ namespace Lumix
 					return;
 				}
 
+				ProfileScope profile_scope(*this, getProfile(*instance.m_script));
 				if (lua_pcall(instance.m_state, 0, 0, 0) != 0)
 				{
 					logError("Lua Script") << lua_tostring(instance.m_state, -1);
@@ -1065,6 +1485,41 @@ namespace Lumix
 		}
 
 
+		u32 getProfile(const LuaScript& script)
+		{
+			const u32 hash = script.getPath().getHash();
+			auto iter = m_profile_indices.find(hash);
+			if (iter.isValid()) return iter.value();
+
+			ScriptProfile& profile = m_script_profiles.emplace();
+			profile.path = script.getPath();
+			profile.time = 0;
+			profile.allocations = 0;
+			profile.allocated = 0;
+			m_profile_frames.emplace();
+			m_profile_indices.insert(hash, m_script_profiles.size() - 1);
+			return m_script_profiles.size() - 1;
+		}
+
+
+		void publishProfiles()
+		{
+			const float to_ms = 1000.f / OS::Timer::getFrequency();
+			for (int i = 0; i < m_script_profiles.size(); ++i)
+			{
+				ScriptProfile& profile = m_script_profiles[i];
+				ProfileFrame& frame = m_profile_frames[i];
+				profile.time = frame.ticks * to_ms;
+				profile.allocations = frame.allocations;
+				profile.allocated = frame.allocated;
+				frame = {};
+			}
+		}
+
+
+		Span<const ScriptProfile> getScriptProfiles() const override { return m_script_profiles; }
+
+
 		void onButtonClicked(EntityRef e) { onGUIEvent(e, "onButtonClicked"); }
 		void onRectHovered(EntityRef e) { onGUIEvent(e, "onRectHovered"); }
 		void onRectHoveredOut(EntityRef e) { onGUIEvent(e, "onRectHoveredOut"); }
@@ -1107,9 +1562,32 @@ namespace Lumix
 			m_gui_scene = nullptr;
 			m_scripts_start_called = false;
 			m_is_game_running = false;
+			for (const CallbackData& cb : m_updates) luaL_unref(cb.state, LUA_REGISTRYINDEX, cb.func);
+			for (const CallbackData& cb : m_input_handlers) luaL_unref(cb.state, LUA_REGISTRYINDEX, cb.func);
+			lua_State* L = m_system.m_engine.getState();
+			for (const BatchUpdate& batch : m_batch_updates)
+			{
+				luaL_unref(L, LUA_REGISTRYINDEX, batch.func);
+				luaL_unref(L, LUA_REGISTRYINDEX, batch.instances);
+			}
+			m_batch_updates.clear();
 			m_updates.clear();
 			m_input_handlers.clear();
+			for (const TimerData& timer : m_timers) luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
 			m_timers.clear();
+			for (const CoroutineWait& wait : m_time_waits) luaL_unref(L, LUA_REGISTRYINDEX, wait.thread);
+			for (const CoroutineWait& wait : m_frame_waits) luaL_unref(L, LUA_REGISTRYINDEX, wait.thread);
+			for (const CoroutineWait& wait : m_signal_waits) luaL_unref(L, LUA_REGISTRYINDEX, wait.thread);
+			m_time_waits.clear();
+			m_frame_waits.clear();
+			m_signal_waits.clear();
+			m_coroutines.clear();
+			m_time = 0;
+			m_frame = 0;
+			m_script_profiles.clear();
+			m_profile_frames.clear();
+			m_profile_indices.clear();
+			m_current_profile = NO_PROFILE;
 			m_animation_scene = nullptr;
 		}
 
@@ -1331,47 +1809,42 @@ namespace Lumix
 		}
 
 
-		void updateTimers(float time_delta)
+		void updateTimers()
 		{
-			int timers_to_remove[1024];
-			u32 timers_to_remove_count = 0;
-			for (int i = 0, c = m_timers.size(); i < c; ++i)
+			// timers set by the callbacks fire next frame at the earliest
+			m_due_timers.clear();
+			while (!m_timers.empty() && m_timers[0].due <= m_time)
 			{
-				auto& timer = m_timers[i];
-				timer.time -= time_delta;
-				if (timer.time < 0)
-				{
-					lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
-					if (lua_type(timer.state, -1) != LUA_TFUNCTION)
-					{
-						ASSERT(false);
-					}
-
-					if (lua_pcall(timer.state, 0, 0, 0) != 0)
-					{
-						logError("Lua Script") << lua_tostring(timer.state, -1);
-						lua_pop(timer.state, 1);
-					}
-					timers_to_remove[timers_to_remove_count] = i;
-					++timers_to_remove_count;
-					if (timers_to_remove_count >= lengthOf(timers_to_remove))
-					{
-						logError("Lua Script") << "Too many lua timers in one frame, some are not executed";
-						break;
-					}
-				}
+				m_due_timers.push(popHeap(m_timers));
 			}
-			for (u32 i = timers_to_remove_count - 1; i != 0xffFFffFF; --i)
+
+			for (int i = 0; i < m_due_timers.size(); ++i)
 			{
-				auto& timer = m_timers[timers_to_remove[i]];
+				const TimerData timer = m_due_timers[i];
+				if (timer.func == LUA_NOREF) continue;
+				m_due_timers[i].func = LUA_NOREF;
+
+				lua_rawgeti(timer.state, LUA_REGISTRYINDEX, timer.func);
 				luaL_unref(timer.state, LUA_REGISTRYINDEX, timer.func);
-				m_timers.swapAndPop(timers_to_remove[i]);
+				if (lua_type(timer.state, -1) != LUA_TFUNCTION)
+				{
+					ASSERT(false);
+				}
+
+				ProfileScope profile_scope(*this, timer.profile);
+				if (lua_pcall(timer.state, 0, 0, 0) != 0)
+				{
+					logError("Lua Script") << lua_tostring(timer.state, -1);
+					lua_pop(timer.state, 1);
+				}
 			}
+			m_due_timers.clear();
 		}
 
 
 		void processInputEvent(const CallbackData& callback, const InputSystem::Event& event)
 		{
+			ProfileScope profile_scope(*this, getProfile(*callback.script));
 			lua_State* L = callback.state;
 			lua_newtable(L); // [lua_event]
 			LuaWrapper::push(L, (u32)event.type); // [lua_event, event.type]
@@ -1421,26 +1894,13 @@ namespace Lumix
 			}
 
 
-			lua_rawgeti(L, LUA_REGISTRYINDEX, callback.environment);
-			if (lua_type(L, -1) != LUA_TTABLE) // [lua_event, environment]
-			{
-				ASSERT(false);
-			}
-			lua_getfield(L, -1, "onInputEvent");
-			if (lua_type(L, -1) != LUA_TFUNCTION)  // [lua_event, environment, func]
-			{
-				lua_pop(L, 3); // []
-				return;
-			}
-
-			lua_pushvalue(L, -3); // [lua_event, environment, func, lua_event]
-			
-			if (lua_pcall(L, 1, 0, 0) != 0)// [lua_event, environment]
+			lua_rawgeti(L, LUA_REGISTRYINDEX, callback.func); // [lua_event, func]
+			lua_insert(L, -2); // [func, lua_event]
+			if (lua_pcall(L, 1, 0, 0) != 0) // []
 			{
 				logError("Lua Script") << lua_tostring(L, -1);
 				lua_pop(L, 1); // []
 			}
-			lua_pop(L, 2); // []
 		}
 
 
@@ -1468,32 +1928,28 @@ namespace Lumix
 
 			if (paused) return;
 
+			m_time += time_delta;
+			++m_frame;
+			publishProfiles();
 			processInputEvents();
-			updateTimers(time_delta);
+			updateTimers();
+			processWaits(m_time_waits, m_time);
+			processWaits(m_frame_waits, (double)m_frame);
 
 			for (int i = 0; i < m_updates.size(); ++i)
 			{
-				CallbackData update_item = m_updates[i];
-				lua_rawgeti(update_item.state, LUA_REGISTRYINDEX, update_item.environment);
-				if (lua_type(update_item.state, -1) != LUA_TTABLE)
-				{
-					ASSERT(false);
-				}
-				lua_getfield(update_item.state, -1, "update");
-				if (lua_type(update_item.state, -1) != LUA_TFUNCTION)
+				const CallbackData& update_item = m_updates[i];
+				lua_State* L = update_item.state;
+				ProfileScope profile_scope(*this, getProfile(*update_item.script));
+				lua_rawgeti(L, LUA_REGISTRYINDEX, update_item.func);
+				lua_pushnumber(L, time_delta);
+				if (lua_pcall(L, 1, 0, 0) != 0)
 				{
-					lua_pop(update_item.state, 2);
-					continue;
+					logError("Lua Script") << lua_tostring(L, -1);
+					lua_pop(L, 1);
 				}
-
-				lua_pushnumber(update_item.state, time_delta);
-				if (lua_pcall(update_item.state, 1, 0, 0) != 0)
-				{
-					logError("Lua Script") << lua_tostring(update_item.state, -1);
-					lua_pop(update_item.state, 1);
-				}
-				lua_pop(update_item.state, 1);
 			}
+			updateBatches(time_delta);
 
 			processAnimationEvents();
 		}
@@ -1503,38 +1959,20 @@ namespace Lumix
 		{
 			if (!m_animation_scene) return;
 
-			InputMemoryStream blob(m_animation_scene->getEventStream());
-			u32 lua_call_type = crc32("lua_call");
-			while (blob.getPosition() < blob.size())
-			{
-				u32 type;
-				u8 size;
-				EntityRef entity;
-				blob.read(type);
-				blob.read(entity);
-				blob.read(size);
-				if (type == lua_call_type)
-				{
-					char tmp[64];
-					if (size + 1 > sizeof(tmp))
-					{
-						blob.skip(size);
-						logError("Lua Script") << "Skipping lua_call animation event because it is too big.";
-					}
-					else
-					{
-						blob.read(tmp, size);
-						tmp[size] = 0;
-						ScriptComponent* scr = m_scripts[entity];
-						for (int i = 0, c = scr->m_scripts.size(); i < c; ++i)
-						{
-							if (beginFunctionCall(entity, i, tmp)) endFunctionCall();
-						}
-					}
+			const u8* data = m_animation_scene->getEventsData(AnimationEventType::LUA_CALL);
+			for (const AnimationEvent& event : m_animation_scene->getEvents(AnimationEventType::LUA_CALL)) {
+				char tmp[64];
+				if (event.size + 1 > sizeof(tmp)) {
+					logError("Lua Script") << "Skipping lua_call animation event because it is too big.";
+					continue;
 				}
-				else
-				{
-					blob.skip(size);
+				memcpy(tmp, data + event.offset, event.size);
+				tmp[event.size] = 0;
+				auto iter = m_scripts.find(event.entity);
+				if (!iter.isValid()) continue;
+				ScriptComponent* scr = iter.value();
+				for (int i = 0, c = scr->m_scripts.size(); i < c; ++i) {
+					if (beginFunctionCall(event.entity, i, tmp)) endFunctionCall();
 				}
 			}
 		}
@@ -1708,9 +2146,24 @@ namespace Lumix
 		Array<CallbackData> m_input_handlers;
 		Universe& m_universe;
 		Array<CallbackData> m_updates;
+		Array<BatchUpdate> m_batch_updates;
 		Array<TimerData> m_timers;
+		Array<TimerData> m_due_timers;
+		Array<CoroutineWait> m_time_waits;
+		Array<CoroutineWait> m_frame_waits;
+		Array<CoroutineWait> m_signal_waits;
+		Array<CoroutineWait> m_due_waits;
+		// coroutine -> script instance which started it
+		HashMap<lua_State*, lua_State*> m_coroutines;
+		bool m_coroutine_queued = false;
+		double m_time = 0;
+		u32 m_frame = 0;
 		FunctionCall m_function_call;
 		ScriptInstance* m_current_script_instance;
+		Array<ScriptProfile> m_script_profiles;
+		Array<ProfileFrame> m_profile_frames;
+		HashMap<u32, u32> m_profile_indices;
+		u32 m_current_profile = NO_PROFILE;
 		bool m_scripts_start_called = false;
 		bool m_is_api_registered = false;
 		bool m_is_game_running = false;
@@ -2004,11 +2457,15 @@ namespace Lumix
 
 	LuaScriptSystemImpl::LuaScriptSystemImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
+		, m_allocator(engine.getAllocator(), "lua")
 		, m_script_manager(m_allocator)
 	{
 		m_script_manager.create(LuaScript::TYPE, engine.getResourceManager());
 
+		lua_State* L = engine.getState();
+		m_lua_allocf = lua_getallocf(L, &m_lua_allocf_ud);
+		lua_setallocf(L, &luaAlloc, this);
+
 		using namespace Reflection;
 		
 		static auto lua_scene = scene("lua_script",
@@ -2025,6 +2482,7 @@ namespace Lumix
 
 	LuaScriptSystemImpl::~LuaScriptSystemImpl()
 	{
+		lua_setallocf(m_engine.getState(), m_lua_allocf, m_lua_allocf_ud);
 		m_script_manager.destroy();
 	}
 
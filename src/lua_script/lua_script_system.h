@@ -55,6 +55,16 @@ struct LuaScriptScene : IScene
 	};
 
 
+	// costs of a script in the last frame
+	struct ScriptProfile
+	{
+		Path path;
+		float time;
+		u32 allocations;
+		u64 allocated;
+	};
+
+
 	using lua_CFunction = int (*) (lua_State *L);
 
 	virtual Path getScriptPath(EntityRef entity, int scr_index) = 0;	
@@ -78,6 +88,8 @@ struct LuaScriptScene : IScene
 	virtual const char* getPropertyName(EntityRef entity, int scr_index, int prop_index) = 0;
 	virtual Property::Type getPropertyType(EntityRef entity, int scr_index, int prop_index) = 0;
 	virtual ResourceType getPropertyResourceType(EntityRef entity, int scr_index, int prop_index) = 0;
+	// only scripts called since the game started
+	virtual Span<const ScriptProfile> getScriptProfiles() const = 0;
 };
 
 
@@ -4,17 +4,21 @@
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/lumix.h"
 #include "engine/os.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/material.h"
 #include "renderer/model.h"
 #include "renderer/render_scene.h"
+#include "renderer/terrain.h"
+#include "renderer/texture.h"
 #include <DetourAlloc.h>
 #include <DetourCrowd.h>
 #include <DetourNavMesh.h>
@@ -42,20 +46,126 @@ static const ComponentType NAVMESH_AGENT_TYPE = Reflection::getComponentType("na
 static const ComponentType ANIMATOR_TYPE = Reflection::getComponentType("animator");
 static const int CELLS_PER_TILE_SIDE = 256;
 static const float CELL_SIZE = 0.3f;
+// agents reevaluate their LOD once per this many frames, spread over the frames
+static const u32 LOD_UPDATE_PERIOD = 8;
+// far agents only follow their corridor, without avoidance, separation and path optimizations
+static const u8 LOD_UPDATE_FLAGS[] = {
+	DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_OPTIMIZE_TOPO | DT_CROWD_OPTIMIZE_VIS,
+	DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OPTIMIZE_TOPO,
+	0
+};
+// in agent radii, smaller range means fewer neighbours to query
+static const float LOD_QUERY_RANGES[] = { 12.0f, 6.0f, 1.0f };
+
+
+struct PathQuery {
+	explicit PathQuery(IAllocator& allocator) : path(allocator) {}
+
+	u32 id;
+	EntityRef zone;
+	// zone space
+	Vec3 from;
+	Vec3 to;
+	Array<Vec3> path;
+	float length = 0;
+	bool started = false;
+	NavigationScene::PathQueryStatus status = NavigationScene::PathQueryStatus::PENDING;
+};
+
+
+// sliced searches keep their state in dtNavMeshQuery, so each slot runs one query at a time
+struct PathQuerySlot {
+	dtNavMeshQuery* navquery = nullptr;
+	PathQuery* query = nullptr;
+};
 
 
 struct RecastZone {
+	RecastZone(IAllocator& allocator) : agents(allocator), path_query_slots(allocator) {}
+
 	EntityRef entity;
 	NavmeshZone zone;
 
 	dtNavMeshQuery* navquery = nullptr;
-	rcPolyMeshDetail* detail_mesh = nullptr;
-	rcPolyMesh* polymesh = nullptr;
 	dtNavMesh* navmesh = nullptr;
 	rcCompactHeightfield* debug_compact_heightfield = nullptr;
 	rcHeightfield* debug_heightfield = nullptr;
 	rcContourSet* debug_contours = nullptr;
 	dtCrowd* crowd = nullptr;
+	// bumped when the navmesh is replaced, so tiles built for the old one are dropped
+	u32 navmesh_generation = 0;
+	Array<EntityRef> agents;
+	Array<PathQuerySlot> path_query_slots;
+};
+
+
+// triangles in zone space, 3 vertices and 1 area per triangle
+struct TileGeometry {
+	explicit TileGeometry(IAllocator& allocator) : verts(allocator), areas(allocator) {}
+
+	void push(const Vec3& a, const Vec3& b, const Vec3& c, u8 area) {
+		verts.push(a);
+		verts.push(b);
+		verts.push(c);
+		areas.push(area);
+	}
+
+	Array<Vec3> verts;
+	Array<u8> areas;
+};
+
+
+// model instance in zone space
+struct NavMeshInstance {
+	Model* model;
+	Matrix mtx;
+	AABB aabb;
+};
+
+
+// navmesh relevant meshes bucketed by tiles, built once per bake
+struct NavGeometryIndex {
+	explicit NavGeometryIndex(IAllocator& allocator)
+		: instances(allocator)
+		, tile_offsets(allocator)
+		, tile_instances(allocator)
+	{}
+
+	Array<NavMeshInstance> instances;
+	// instances of tile i are tile_instances[tile_offsets[i]] .. tile_instances[tile_offsets[i + 1] - 1]
+	Array<u32> tile_offsets;
+	Array<u32> tile_instances;
+};
+
+
+struct TileBuild {
+	int x;
+	int z;
+	Vec3 bmin;
+	Vec3 bmax;
+	u8* nav_data = nullptr;
+	int nav_data_size = 0;
+};
+
+
+// built on a worker from geometry gathered on the main thread, the tile is swapped on the main thread
+struct TileRebuildJob {
+	explicit TileRebuildJob(IAllocator& allocator) : geometry(allocator) {}
+
+	struct NavigationSceneImpl* scene;
+	EntityRef zone;
+	u32 navmesh_generation;
+	rcConfig config;
+	TileGeometry geometry;
+	TileBuild tile;
+	bool success;
+};
+
+
+struct TileRebuildRequest {
+	EntityRef zone;
+	int x;
+	int z;
 };
 
 
@@ -78,6 +188,7 @@ struct Agent
 	float speed = 0;
 	float yaw_diff = 0;
 	float stop_distance = 0;
+	u8 lod = 0;
 };
 
 
@@ -94,9 +205,15 @@ struct NavigationSceneImpl final : NavigationScene
 		, m_zones(m_allocator)
 		, m_script_scene(nullptr)
 		, m_on_update(m_allocator)
+		, m_tile_rebuild_queue(m_allocator)
+		, m_running_tile_jobs(m_allocator)
+		, m_finished_tile_jobs(m_allocator)
+		, m_path_queries(m_allocator)
+		, m_pending_path_queries(m_allocator)
+		, m_path_query_finished(m_allocator)
 	{
 		setGeneratorParams(0.3f, 0.1f, 0.3f, 2.0f, 60.0f, 0.3f);
-		m_universe.entityTransformed().bind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().bind<&NavigationSceneImpl::onEntitiesMoved>(this);
 		universe.registerComponentType(NAVMESH_AGENT_TYPE
 			, this
 			, &NavigationSceneImpl::createAgent
@@ -110,20 +227,30 @@ struct NavigationSceneImpl final : NavigationScene
 
 	~NavigationSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<&NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<&NavigationSceneImpl::onEntitiesMoved>(this);
+		waitForTileRebuilds();
 		for(RecastZone& zone : m_zones) {
 			clearNavmesh(zone);
 		}
+		for (PathQuery* query : m_path_queries) LUMIX_DELETE(m_allocator, query);
 	}
 
 
 	void clear() override
 	{
+		waitForTileRebuilds();
+		m_tile_rebuild_queue.clear();
 		m_agents.clear();
 		m_zones.clear();
 	}
 
 
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef entity : entities) onEntityMoved(entity);
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
 		auto iter = m_agents.find(entity);
@@ -150,15 +277,13 @@ struct NavigationSceneImpl final : NavigationScene
 
 	void clearNavmesh(RecastZone& zone) {
 		dtFreeNavMeshQuery(zone.navquery);
-		rcFreePolyMeshDetail(zone.detail_mesh);
-		rcFreePolyMesh(zone.polymesh);
 		dtFreeNavMesh(zone.navmesh);
 		rcFreeCompactHeightfield(zone.debug_compact_heightfield);
 		rcFreeHeightField(zone.debug_heightfield);
 		rcFreeContourSet(zone.debug_contours);
 		dtFreeCrowd(zone.crowd);
-		zone.detail_mesh = nullptr;
-		zone.polymesh = nullptr;
+		releasePathQuerySlots(zone);
+		++zone.navmesh_generation;
 		zone.navquery = nullptr;
 		zone.navmesh = nullptr;
 		zone.debug_compact_heightfield = nullptr;
@@ -168,14 +293,76 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
-	void rasterizeGeometry(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	// reads the universe and the render scene, so it can run on a worker only while the main thread waits
+	void gatherGeometry(const Transform& zone_tr, const AABB& aabb, TileGeometry& geom)
+	{
+		Array<NavMeshInstance> instances(m_allocator);
+		collectMeshInstances(zone_tr, instances);
+		for (const NavMeshInstance& instance : instances) {
+			if (instance.aabb.overlaps(aabb)) gatherMesh(instance, geom);
+		}
+		gatherTerrains(zone_tr, aabb, geom);
+	}
+
+
+	void gatherGeometry(const Transform& zone_tr, const NavGeometryIndex& index, u32 tile_idx, const AABB& aabb, TileGeometry& geom)
 	{
-		rasterizeMeshes(zone_tr, aabb, ctx, cfg, solid);
-		rasterizeTerrains(zone_tr, aabb, ctx, cfg, solid);
+		for (u32 i = index.tile_offsets[tile_idx], end = index.tile_offsets[tile_idx + 1]; i < end; ++i) {
+			gatherMesh(index.instances[index.tile_instances[i]], geom);
+		}
+		gatherTerrains(zone_tr, aabb, geom);
 	}
 
 
-	void rasterizeTerrains(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	// buckets instances by tiles, so each tile visits only meshes overlapping it
+	void buildGeometryIndex(const Transform& zone_tr, const RecastZone& zone, Span<const TileBuild> tiles, int tiles_x, int tiles_z, NavGeometryIndex& index)
+	{
+		PROFILE_FUNCTION();
+		collectMeshInstances(zone_tr, index.instances);
+
+		const float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		const Vec3 zone_min = -zone.zone.extents;
+		Array<u32> counts(m_allocator);
+		counts.resize(tiles.length() + 1);
+		memset(counts.begin(), 0, counts.byte_size());
+		// first pass counts, second one fills
+		for (u32 pass = 0; pass < 2; ++pass) {
+			for (u32 instance_idx = 0; instance_idx < (u32)index.instances.size(); ++instance_idx) {
+				const AABB& aabb = index.instances[instance_idx].aabb;
+				const int from_x = clamp(int(floorf((aabb.min.x - zone_min.x) / tile_size)) - 1, 0, tiles_x - 1);
+				const int to_x = clamp(int(floorf((aabb.max.x - zone_min.x) / tile_size)) + 1, 0, tiles_x - 1);
+				const int from_z = clamp(int(floorf((aabb.min.z - zone_min.z) / tile_size)) - 1, 0, tiles_z - 1);
+				const int to_z = clamp(int(floorf((aabb.max.z - zone_min.z) / tile_size)) + 1, 0, tiles_z - 1);
+				for (int z = from_z; z <= to_z; ++z) {
+					for (int x = from_x; x <= to_x; ++x) {
+						const u32 tile_idx = x + z * tiles_x;
+						const TileBuild& tile = tiles[tile_idx];
+						if (!aabb.overlaps(AABB(tile.bmin, tile.bmax))) continue;
+						if (pass == 0) {
+							++counts[tile_idx];
+						}
+						else {
+							index.tile_instances[index.tile_offsets[tile_idx] + counts[tile_idx]] = instance_idx;
+							++counts[tile_idx];
+						}
+					}
+				}
+			}
+			if (pass == 0) {
+				index.tile_offsets.resize(tiles.length() + 1);
+				u32 offset = 0;
+				for (u32 i = 0; i <= tiles.length(); ++i) {
+					index.tile_offsets[i] = offset;
+					offset += counts[i];
+					counts[i] = 0;
+				}
+				index.tile_instances.resize(offset);
+			}
+		}
+	}
+
+
+	void gatherTerrains(const Transform& zone_tr, const AABB& aabb, TileGeometry& geom)
 	{
 		PROFILE_FUNCTION();
 		const float walkable_threshold = cosf(degreesToRadians(60));
@@ -183,111 +370,145 @@ struct NavigationSceneImpl final : NavigationScene
 		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
 		if (!render_scene) return;
 
+		Array<Vec3> rows(m_allocator);
 		EntityPtr entity_ptr = render_scene->getFirstTerrain();
 		while (entity_ptr.isValid()) {
 			const EntityRef entity = (EntityRef)entity_ptr;
+			entity_ptr = render_scene->getNextTerrain(entity);
+
+			const Terrain* terrain = render_scene->getTerrain(entity);
+			const Texture* heightmap = terrain->getHeightmap();
+			if (!heightmap || !heightmap->getData()) continue;
+			ASSERT(heightmap->format == gpu::TextureFormat::R16);
+
 			const Transform terrain_tr = m_universe.getTransform(entity);
 			const Transform to_zone = zone_tr.inverted() * terrain_tr;
-			const IVec2 res = render_scene->getTerrainResolution(entity);
-			float scaleXZ = render_scene->getTerrainXZScale(entity);
-			for (int j = 0; j < res.y; ++j) {
-				for (int i = 0; i < res.x; ++i) {
-					float x = i * scaleXZ;
-					float z = j * scaleXZ;
-
-					const float h0 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p0 = to_zone.transform(Vec3(x, h0, z)).toFloat();
-
-					x = (i + 1) * scaleXZ;
-					z = j * scaleXZ;
-					const float h1 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p1 = to_zone.transform(Vec3(x, h1, z)).toFloat();
-
-					x = (i + 1) * scaleXZ;
-					z = (j + 1) * scaleXZ;
-					const float h2 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p2 = to_zone.transform(Vec3(x, h2, z)).toFloat();
-
-					x = i * scaleXZ;
-					z = (j + 1) * scaleXZ;
-					const float h3 = render_scene->getTerrainHeightAt(entity, x, z);
-					const Vec3 p3 = to_zone.transform(Vec3(x, h3, z)).toFloat();
+			const int width = terrain->getWidth();
+			const int height = terrain->getHeight();
+			const float scaleXZ = terrain->getXZScale();
+			const float scaleY = terrain->getYScale() / 65535.0f;
+			const u16* data = (const u16*)heightmap->getData();
+
+			// only quads overlapping the tile
+			DVec3 corners[8];
+			aabb.getCorners(to_zone.inverted(), corners);
+			double min_x = corners[0].x, max_x = corners[0].x;
+			double min_z = corners[0].z, max_z = corners[0].z;
+			for (const DVec3& c : corners) {
+				min_x = minimum(min_x, c.x);
+				max_x = maximum(max_x, c.x);
+				min_z = minimum(min_z, c.z);
+				max_z = maximum(max_z, c.z);
+			}
+			const int from_i = clamp(int(min_x / scaleXZ) - 1, 0, width);
+			const int to_i = clamp(int(max_x / scaleXZ) + 1, 0, width);
+			const int from_j = clamp(int(min_z / scaleXZ) - 1, 0, height);
+			const int to_j = clamp(int(max_z / scaleXZ) + 1, 0, height);
+			if (from_i >= to_i || from_j >= to_j) continue;
+
+			// vertices of two rows of quads' corners, heights are read from the heightmap directly
+			const int row_size = to_i - from_i + 1;
+			rows.resize(row_size * 2);
+			auto fillRow = [&](int j, Vec3* row){
+				const u16* texels = data + minimum(j, height - 1) * width;
+				for (int i = from_i; i <= to_i; ++i) {
+					const float h = texels[minimum(i, width - 1)] * scaleY;
+					row[i - from_i] = to_zone.transform(Vec3(i * scaleXZ, h, j * scaleXZ)).toFloat();
+				}
+			};
+			Vec3* row0 = rows.begin();
+			Vec3* row1 = rows.begin() + row_size;
+			fillRow(from_j, row0);
+			for (int j = from_j; j < to_j; ++j) {
+				fillRow(j + 1, row1);
+				for (int i = 0; i < row_size - 1; ++i) {
+					const Vec3& p0 = row0[i];
+					const Vec3& p1 = row0[i + 1];
+					const Vec3& p2 = row1[i + 1];
+					const Vec3& p3 = row1[i];
 
 					Vec3 n = crossProduct(p1 - p0, p0 - p2).normalized();
 					u8 area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
-					rcRasterizeTriangle(&ctx, &p0.x, &p1.x, &p2.x, area, solid);
+					geom.push(p0, p1, p2, area);
 
 					n = crossProduct(p2 - p0, p0 - p3).normalized();
 					area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
-					rcRasterizeTriangle(&ctx, &p0.x, &p2.x, &p3.x, area, solid);
+					geom.push(p0, p2, p3, area);
 				}
+				swap(row0, row1);
 			}
-			entity_ptr = render_scene->getNextTerrain(entity);
 		}
 	}
 
 
-	void rasterizeMeshes(const Transform& zone_tr, const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	void collectMeshInstances(const Transform& zone_tr, Array<NavMeshInstance>& instances)
 	{
 		PROFILE_FUNCTION();
-		const float walkable_threshold = cosf(degreesToRadians(45));
-
 		const Transform inv_zone_tr = zone_tr.inverted();
 
 		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
 		if (!render_scene) return;
 
-		u32 no_navigation_flag = Material::getCustomFlag("no_navigation");
-		u32 nonwalkable_flag = Material::getCustomFlag("nonwalkable");
 		for (EntityPtr model_instance = render_scene->getFirstModelInstance(); 
 			model_instance.isValid();
 			model_instance = render_scene->getNextModelInstance(model_instance))
 		{
 			const EntityRef entity = (EntityRef)model_instance;
 			auto* model = render_scene->getModelInstanceModel(entity);
-			if (!model) return;
+			if (!model) continue;
 			ASSERT(model->isReady());
 
 			const Transform tr = m_universe.getTransform(entity);
-			AABB model_aabb = model->getAABB();
+			NavMeshInstance& instance = instances.emplace();
 			const Transform rel_tr = inv_zone_tr * tr;
-			Matrix mtx = rel_tr.rot.toMatrix();
-			mtx.setTranslation(rel_tr.pos.toFloat());
-			mtx.multiply3x3(rel_tr.scale);
-			model_aabb.transform(mtx);
-			if (!model_aabb.overlaps(aabb)) continue;
-
-			auto lod = model->getLODMeshIndices(0);
-			for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
-				Mesh& mesh = model->getMesh(mesh_idx);
-				bool is16 = mesh.areIndices16();
-
-				if (mesh.material->isCustomFlag(no_navigation_flag)) continue;
-				bool is_walkable = !mesh.material->isCustomFlag(nonwalkable_flag);
-				auto* vertices = &mesh.vertices[0];
-				if (is16) {
-					const u16* indices16 = (const u16*)&mesh.indices[0];
-					for (int i = 0; i < mesh.indices.size() / 2; i += 3) {
-						Vec3 a = mtx.transformPoint(vertices[indices16[i]]);
-						Vec3 b = mtx.transformPoint(vertices[indices16[i + 1]]);
-						Vec3 c = mtx.transformPoint(vertices[indices16[i + 2]]);
-
-						Vec3 n = crossProduct(a - b, a - c).normalized();
-						u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
-						rcRasterizeTriangle(&ctx, &a.x, &b.x, &c.x, area, solid);
-					}
+			instance.model = model;
+			instance.mtx = rel_tr.rot.toMatrix();
+			instance.mtx.setTranslation(rel_tr.pos.toFloat());
+			instance.mtx.multiply3x3(rel_tr.scale);
+			instance.aabb = model->getAABB();
+			instance.aabb.transform(instance.mtx);
+		}
+	}
+
+
+	static void gatherMesh(const NavMeshInstance& instance, TileGeometry& geom)
+	{
+		const float walkable_threshold = cosf(degreesToRadians(45));
+		const u32 no_navigation_flag = Material::getCustomFlag("no_navigation");
+		const u32 nonwalkable_flag = Material::getCustomFlag("nonwalkable");
+		const Matrix& mtx = instance.mtx;
+		Model* model = instance.model;
+
+		auto lod = model->getLODMeshIndices(0);
+		for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
+			Mesh& mesh = model->getMesh(mesh_idx);
+			bool is16 = mesh.areIndices16();
+
+			if (mesh.material->isCustomFlag(no_navigation_flag)) continue;
+			bool is_walkable = !mesh.material->isCustomFlag(nonwalkable_flag);
+			auto* vertices = &mesh.vertices[0];
+			if (is16) {
+				const u16* indices16 = (const u16*)&mesh.indices[0];
+				for (int i = 0; i < mesh.indices.size() / 2; i += 3) {
+					Vec3 a = mtx.transformPoint(vertices[indices16[i]]);
+					Vec3 b = mtx.transformPoint(vertices[indices16[i + 1]]);
+					Vec3 c = mtx.transformPoint(vertices[indices16[i + 2]]);
+
+					Vec3 n = crossProduct(a - b, a - c).normalized();
+					u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
+					geom.push(a, b, c, area);
 				}
-				else {
-					const u32* indices32 = (const u32*)&mesh.indices[0];
-					for (int i = 0; i < mesh.indices.size() / 4; i += 3) {
-						Vec3 a = mtx.transformPoint(vertices[indices32[i]]);
-						Vec3 b = mtx.transformPoint(vertices[indices32[i + 1]]);
-						Vec3 c = mtx.transformPoint(vertices[indices32[i + 2]]);
-
-						Vec3 n = crossProduct(a - b, a - c).normalized();
-						u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
-						rcRasterizeTriangle(&ctx, &a.x, &b.x, &c.x, area, solid);
-					}
+			}
+			else {
+				const u32* indices32 = (const u32*)&mesh.indices[0];
+				for (int i = 0; i < mesh.indices.size() / 4; i += 3) {
+					Vec3 a = mtx.transformPoint(vertices[indices32[i]]);
+					Vec3 b = mtx.transformPoint(vertices[indices32[i + 1]]);
+					Vec3 c = mtx.transformPoint(vertices[indices32[i + 2]]);
+
+					Vec3 n = crossProduct(a - b, a - c).normalized();
+					u8 area = n.y > walkable_threshold && is_walkable ? RC_WALKABLE_AREA : 0;
+					geom.push(a, b, c, area);
 				}
 			}
 		}
@@ -333,41 +554,73 @@ struct NavigationSceneImpl final : NavigationScene
 		m_agents[entity].root_motion = root_motion;
 	}
 
-	void update(RecastZone& zone, float time_delta) {
-		if (!zone.crowd) return;
-		zone.crowd->update(time_delta, nullptr);
-
-		const Transform inv_tr = m_universe.getTransform(zone.entity).inverted();
-
-		for (auto& agent : m_agents) {
-			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
-			
-			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
-			//if (dt_agent->paused) continue;
+	struct AgentUpdate {
+		Agent* agent;
+		const RecastZone* zone;
+		Transform inv_zone_tr;
+	};
 
-			const Vec3 pos = inv_tr.transform(m_universe.getPosition(agent.entity)).toFloat();
-			const Quat rot = m_universe.getRotation(agent.entity);
-			const Vec3 diff = *(Vec3*)dt_agent->npos - pos;
-
-			const Vec3 velocity = *(Vec3*)dt_agent->nvel;
-			agent.speed = diff.length() / time_delta;
-			agent.yaw_diff = 0;
-			if (velocity.squaredLength() > 0) {
-				float wanted_yaw = atan2f(velocity.x, velocity.z);
-				float current_yaw = rot.toEuler().y;
-				agent.yaw_diff = angleDiff(wanted_yaw, current_yaw);
-			}
+	// runs on workers, so it only reads the universe and writes to the agent
+	void updateAgent(const AgentUpdate& update, float time_delta) {
+		Agent& agent = *update.agent;
+		const dtCrowdAgent* dt_agent = update.zone->crowd->getAgent(agent.agent);
+		//if (dt_agent->paused) continue;
+
+		const Transform& tr = m_universe.getTransform(agent.entity);
+		const Vec3 pos = update.inv_zone_tr.transform(tr.pos).toFloat();
+		const Vec3 diff = *(Vec3*)dt_agent->npos - pos;
+
+		const Vec3 velocity = *(Vec3*)dt_agent->nvel;
+		agent.speed = diff.length() / time_delta;
+		agent.yaw_diff = 0;
+		if (velocity.squaredLength() > 0) {
+			float wanted_yaw = atan2f(velocity.x, velocity.z);
+			const Vec3 dir = tr.rot.rotate(Vec3(0, 0, 1));
+			float current_yaw = atan2f(dir.x, dir.z);
+			agent.yaw_diff = angleDiff(wanted_yaw, current_yaw);
 		}
 	}
 
+	SceneUpdateAccess getUpdateAccess() const override {
+		// transforms are written and scripts are called only in lateUpdate
+		SceneUpdateAccess access;
+		access.flags = SceneUpdateAccess::READ_TRANSFORMS;
+		access.write_components = SceneUpdateAccess::mask(NAVMESH_ZONE_TYPE) | SceneUpdateAccess::mask(NAVMESH_AGENT_TYPE);
+		return access;
+	}
+
+	bool isDeserializeThreadSafe() const override { return true; }
+
 	void update(float time_delta, bool paused) override {
 		PROFILE_FUNCTION();
 		if (paused) return;
-		
+
+		updateTileRebuilds();
+		updatePathQueries();
+		updateAgentLODs();
+
+		Array<RecastZone*> zones(m_allocator);
+		Array<AgentUpdate> agents(m_allocator);
 		for (RecastZone& zone : m_zones) {
-			update(zone, time_delta);
+			if (!zone.crowd) continue;
+			zones.push(&zone);
+			const Transform inv_zone_tr = m_universe.getTransform(zone.entity).inverted();
+			for (EntityRef e : zone.agents) {
+				Agent& agent = m_agents[e];
+				if (agent.agent >= 0) agents.push({&agent, &zone, inv_zone_tr});
+			}
 		}
+
+		// crowds do not share anything, each one has its own navmesh and query
+		JobSystem::forEach(zones.size(), 1, [&](u32 from, u32 to){
+			PROFILE_BLOCK("crowd update");
+			for (u32 i = from; i < to; ++i) zones[i]->crowd->update(time_delta, nullptr);
+		});
+
+		JobSystem::forEach(agents.size(), 256, [&](u32 from, u32 to){
+			PROFILE_BLOCK("update agents");
+			for (u32 i = from; i < to; ++i) updateAgent(agents[i], time_delta);
+		});
 	}
 
 	void lateUpdate(RecastZone& zone, float time_delta) {
@@ -376,12 +629,12 @@ struct NavigationSceneImpl final : NavigationScene
 		const Transform zone_tr = m_universe.getTransform(zone.entity);
 		const Transform inv_zone_tr = zone_tr.inverted();
 
-		static const u32 ANIMATION_HASH = crc32("animation");
+		static constexpr u32 ANIMATION_HASH = StringHash("animation");
 		auto* anim_scene = (AnimationScene*)m_universe.getScene(ANIMATION_HASH);
 
-		for (Agent& agent : m_agents) {
+		for (EntityRef e : zone.agents) {
+			Agent& agent = m_agents[e];
 			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
 
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
@@ -403,9 +656,11 @@ struct NavigationSceneImpl final : NavigationScene
 
 		zone.crowd->doMove(time_delta);
 
-		for (auto& agent : m_agents) {
+		// scripts called from onPathFinished can destroy agents
+		for (i32 i = zone.agents.size() - 1; i >= 0; --i) {
+			if (i >= zone.agents.size()) continue;
+			Agent& agent = m_agents[zone.agents[i]];
 			if (agent.agent < 0) continue;
-			if (agent.zone != zone.entity) continue;
 
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
@@ -947,11 +1202,10 @@ struct NavigationSceneImpl final : NavigationScene
 	{
 		for (RecastZone& zone : m_zones) {
 			if (zone.crowd) {
-				for (Agent& agent : m_agents) {
-					if (agent.zone == zone.entity) {
-						zone.crowd->removeAgent(agent.agent);
-						agent.agent = -1;
-					}
+				for (EntityRef e : zone.agents) {
+					Agent& agent = m_agents[e];
+					if (agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
+					agent.agent = -1;
 				}
 				dtFreeCrowd(zone.crowd);
 				zone.crowd = nullptr;
@@ -985,6 +1239,11 @@ struct NavigationSceneImpl final : NavigationScene
 		const Vec3 min = -zone.zone.extents;
 		const Vec3 max = zone.zone.extents;
 
+		for (EntityRef e : zone.agents) {
+			Agent& agent = m_agents[e];
+			if (agent.agent < 0) addCrowdAgent(agent, zone);
+		}
+
 		for (auto iter = m_agents.begin(), end = m_agents.end(); iter != end; ++iter) {
 			Agent& agent = iter.value();
 			if (agent.zone.isValid()) continue;
@@ -994,6 +1253,7 @@ struct NavigationSceneImpl final : NavigationScene
 				&& pos.x < max.x && pos.y < max.y && pos.z < max.z)
 			{
 				agent.zone = zone.entity;
+				zone.agents.push(agent.entity);
 				addCrowdAgent(agent, zone);
 			}
 		}
@@ -1036,6 +1296,190 @@ struct NavigationSceneImpl final : NavigationScene
 	}
 
 
+	u32 queryPath(EntityRef zone_entity, const DVec3& from, const DVec3& to) override {
+		const Transform inv_zone_tr = m_universe.getTransform(zone_entity).inverted();
+		PathQuery* query = LUMIX_NEW(m_allocator, PathQuery)(m_allocator);
+		query->id = m_next_path_query_id++;
+		if (m_next_path_query_id == 0) m_next_path_query_id = 1;
+		query->zone = zone_entity;
+		query->from = inv_zone_tr.transform(from).toFloat();
+		query->to = inv_zone_tr.transform(to).toFloat();
+		m_path_queries.insert(query->id, query);
+		m_pending_path_queries.push(query);
+		return query->id;
+	}
+
+	PathQueryStatus getPathQueryStatus(u32 query) const override {
+		auto iter = m_path_queries.find(query);
+		return iter.isValid() ? iter.value()->status : PathQueryStatus::INVALID;
+	}
+
+	float getPathQueryLength(u32 query) const override {
+		auto iter = m_path_queries.find(query);
+		if (!iter.isValid() || iter.value()->status == PathQueryStatus::PENDING || iter.value()->status == PathQueryStatus::FAILURE) return -1;
+		return iter.value()->length;
+	}
+
+	u32 getPathQueryPoints(u32 query_id, Span<DVec3> points) const override {
+		auto iter = m_path_queries.find(query_id);
+		if (!iter.isValid()) return 0;
+		const PathQuery& query = *iter.value();
+		if (!m_zones.find(query.zone).isValid()) return 0;
+		const Transform zone_tr = m_universe.getTransform(query.zone);
+		for (u32 i = 0, c = minimum(points.length(), (u32)query.path.size()); i < c; ++i) {
+			points[i] = zone_tr.transform(query.path[i]);
+		}
+		return query.path.size();
+	}
+
+	void releasePathQuery(u32 query_id) override {
+		auto iter = m_path_queries.find(query_id);
+		if (!iter.isValid()) return;
+		PathQuery* query = iter.value();
+		m_pending_path_queries.eraseItem(query);
+		auto zone_iter = m_zones.find(query->zone);
+		if (zone_iter.isValid()) {
+			for (PathQuerySlot& slot : zone_iter.value().path_query_slots) {
+				if (slot.query == query) slot.query = nullptr;
+			}
+		}
+		m_path_queries.erase(iter);
+		LUMIX_DELETE(m_allocator, query);
+	}
+
+	void setPathQueryIterations(u32 iterations) override { m_path_query_iterations = iterations; }
+	u32 getPathQueryIterations() const override { return m_path_query_iterations; }
+	DelegateList<void(u32, PathQueryStatus)>& pathQueryFinished() override { return m_path_query_finished; }
+
+	void finishPathQuery(PathQuery& query, PathQueryStatus status) {
+		query.status = status;
+		m_path_query_finished.invoke(query.id, status);
+	}
+
+	void releasePathQuerySlots(RecastZone& zone) {
+		for (PathQuerySlot& slot : zone.path_query_slots) {
+			dtFreeNavMeshQuery(slot.navquery);
+			if (slot.query) finishPathQuery(*slot.query, PathQueryStatus::FAILURE);
+		}
+		zone.path_query_slots.clear();
+	}
+
+	PathQuerySlot* getFreePathQuerySlot(RecastZone& zone) {
+		for (PathQuerySlot& slot : zone.path_query_slots) {
+			if (!slot.query) return &slot;
+		}
+		if ((u32)zone.path_query_slots.size() >= JobSystem::getWorkersCount()) return nullptr;
+
+		dtNavMeshQuery* navquery = dtAllocNavMeshQuery();
+		if (!navquery || dtStatusFailed(navquery->init(zone.navmesh, 2048))) {
+			dtFreeNavMeshQuery(navquery);
+			logError("Navigation") << "Could not init Detour navmesh query";
+			return nullptr;
+		}
+		PathQuerySlot& slot = zone.path_query_slots.emplace();
+		slot.navquery = navquery;
+		return &slot;
+	}
+
+	// runs on a worker, touches only the slot and its query
+	static void updatePathQuery(PathQuerySlot& slot, u32 iterations) {
+		PathQuery& query = *slot.query;
+		dtNavMeshQuery& navquery = *slot.navquery;
+		dtQueryFilter filter;
+		static const float ext[] = { 1.0f, 20.0f, 1.0f };
+
+		if (!query.started) {
+			query.started = true;
+			dtPolyRef start_ref, end_ref;
+			navquery.findNearestPoly(&query.from.x, ext, &filter, &start_ref, nullptr);
+			navquery.findNearestPoly(&query.to.x, ext, &filter, &end_ref, nullptr);
+			if (!start_ref || !end_ref || dtStatusFailed(navquery.initSlicedFindPath(start_ref, end_ref, &query.from.x, &query.to.x, &filter))) {
+				query.status = PathQueryStatus::FAILURE;
+				return;
+			}
+		}
+
+		const dtStatus status = navquery.updateSlicedFindPath(iterations, nullptr);
+		if (dtStatusInProgress(status)) return;
+		if (dtStatusFailed(status)) {
+			query.status = PathQueryStatus::FAILURE;
+			return;
+		}
+
+		enum { MAX_PATH = 256 };
+		dtPolyRef polys[MAX_PATH];
+		int polys_count = 0;
+		const dtStatus final_status = navquery.finalizeSlicedFindPath(polys, &polys_count, MAX_PATH);
+		if (dtStatusFailed(final_status) || polys_count == 0) {
+			query.status = PathQueryStatus::FAILURE;
+			return;
+		}
+
+		// partial paths end in the polygon closest to the target
+		Vec3 end = query.to;
+		if (polys[polys_count - 1] != 0 && dtStatusDetail(final_status, DT_PARTIAL_RESULT)) {
+			navquery.closestPointOnPoly(polys[polys_count - 1], &query.to.x, &end.x, nullptr);
+		}
+
+		Vec3 points[MAX_PATH];
+		int points_count = 0;
+		if (dtStatusFailed(navquery.findStraightPath(&query.from.x, &end.x, polys, polys_count, &points[0].x, nullptr, nullptr, &points_count, MAX_PATH))) {
+			query.status = PathQueryStatus::FAILURE;
+			return;
+		}
+
+		query.path.resize(points_count);
+		query.length = 0;
+		for (int i = 0; i < points_count; ++i) {
+			query.path[i] = points[i];
+			if (i > 0) query.length += (points[i] - points[i - 1]).length();
+		}
+		query.status = dtStatusDetail(final_status, DT_PARTIAL_RESULT) ? PathQueryStatus::PARTIAL : PathQueryStatus::SUCCESS;
+	}
+
+	void updatePathQueries() {
+		if (m_path_queries.size() == 0) return;
+
+		PROFILE_FUNCTION();
+		for (u32 i = 0; i < (u32)m_pending_path_queries.size();) {
+			PathQuery* query = m_pending_path_queries[i];
+			auto iter = m_zones.find(query->zone);
+			if (!iter.isValid() || !iter.value().navmesh) {
+				m_pending_path_queries.erase(i);
+				finishPathQuery(*query, PathQueryStatus::FAILURE);
+				continue;
+			}
+			PathQuerySlot* slot = getFreePathQuerySlot(iter.value());
+			if (!slot) {
+				++i;
+				continue;
+			}
+			slot->query = query;
+			m_pending_path_queries.erase(i);
+		}
+
+		Array<PathQuerySlot*> active(m_allocator);
+		for (RecastZone& zone : m_zones) {
+			for (PathQuerySlot& slot : zone.path_query_slots) {
+				if (slot.query) active.push(&slot);
+			}
+		}
+
+		const u32 iterations = m_path_query_iterations;
+		JobSystem::forEach(active.size(), 1, [&](u32 from, u32 to){
+			PROFILE_BLOCK("path queries");
+			for (u32 i = from; i < to; ++i) updatePathQuery(*active[i], iterations);
+		});
+
+		for (PathQuerySlot* slot : active) {
+			// callbacks can release other queries
+			PathQuery* query = slot->query;
+			if (!query || query->status == PathQueryStatus::PENDING) continue;
+			slot->query = nullptr;
+			finishPathQuery(*query, query->status);
+		}
+	}
+
 	bool navigate(EntityRef entity, const DVec3& world_dest, float speed, float stop_distance) override
 	{
 		auto iter = m_agents.find(entity);
@@ -1113,155 +1557,388 @@ struct NavigationSceneImpl final : NavigationScene
 		return generateTile(zone, zone_entity, x, z, keep_data);
 	}
 
-	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data) {
-		PROFILE_FUNCTION();
-		if (!zone.navmesh) return false;
-
-		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), 0, 0);
+	struct TileData {
+		rcHeightfield* solid = nullptr;
+		rcCompactHeightfield* chf = nullptr;
+		rcContourSet* cset = nullptr;
+		rcPolyMesh* polymesh = nullptr;
+		rcPolyMeshDetail* detail_mesh = nullptr;
+
+		~TileData() {
+			rcFreeHeightField(solid);
+			rcFreeCompactHeightfield(chf);
+			rcFreeContourSet(cset);
+			rcFreePolyMesh(polymesh);
+			rcFreePolyMeshDetail(detail_mesh);
+		}
+	};
 
-		rcContext ctx;
+	void initTile(const RecastZone& zone, int x, int z, TileBuild& tile) const {
+		tile.x = x;
+		tile.z = z;
 		const Vec3 min = -zone.zone.extents;
 		const Vec3 max = zone.zone.extents;
-		Vec3 bmin(min.x + x * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs,
+		tile.bmin = Vec3(min.x + x * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs,
 			min.y,
 			min.z + z * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs);
-		Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs,
+		tile.bmax = Vec3(tile.bmin.x + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs,
 			max.y,
-			bmin.z + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs);
-		if (keep_data) m_debug_tile_origin = bmin;
-		rcVcopy(m_config.bmin, &bmin.x);
-		rcVcopy(m_config.bmax, &bmax.x);
-		rcHeightfield* solid = rcAllocHeightfield();
-		zone.debug_heightfield = keep_data ? solid : nullptr;
-		if (!solid) {
+			tile.bmin.z + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs);
+	}
+
+	// does not touch the scene, so tiles can be built in parallel
+	// debug data are moved to `debug` if it's not null
+	static bool buildTile(const rcConfig& config, const TileGeometry& geom, TileBuild& tile, TileData* debug) {
+		PROFILE_FUNCTION();
+		rcContext ctx(false);
+		rcConfig cfg = config;
+		const int x = tile.x;
+		const int z = tile.z;
+		rcVcopy(cfg.bmin, &tile.bmin.x);
+		rcVcopy(cfg.bmax, &tile.bmax.x);
+
+		TileData data;
+		data.solid = rcAllocHeightfield();
+		if (!data.solid) {
 			logError("Navigation") << "Could not generate navmesh: Out of memory 'solid'.";
 			return false;
 		}
 
-		if (!rcCreateHeightfield(
-				&ctx, *solid, m_config.width, m_config.height, m_config.bmin, m_config.bmax, m_config.cs, m_config.ch))
-		{
+		if (!rcCreateHeightfield(&ctx, *data.solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch)) {
 			logError("Navigation") << "Could not generate navmesh: Could not create solid heightfield.";
 			return false;
 		}
 
-		const Transform tr = m_universe.getTransform(zone_entity);
-		rasterizeGeometry(tr, AABB(bmin, bmax), ctx, m_config, *solid);
+		if (!geom.areas.empty()) {
+			rcRasterizeTriangles(&ctx, &geom.verts[0].x, geom.areas.begin(), geom.areas.size(), *data.solid);
+		}
 
-		rcFilterLowHangingWalkableObstacles(&ctx, m_config.walkableClimb, *solid);
-		rcFilterLedgeSpans(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid);
-		rcFilterWalkableLowHeightSpans(&ctx, m_config.walkableHeight, *solid);
+		rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *data.solid);
+		rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *data.solid);
+		rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *data.solid);
 
-		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
-		zone.debug_compact_heightfield = keep_data ? chf : nullptr;
-		if (!chf) {
+		data.chf = rcAllocCompactHeightfield();
+		if (!data.chf) {
 			logError("Navigation") << "Could not generate navmesh: Out of memory 'chf'.";
 			return false;
 		}
 
-		if (!rcBuildCompactHeightfield(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid, *chf)) {
+		if (!rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, *data.solid, *data.chf)) {
 			logError("Navigation") << "Could not generate navmesh: Could not build compact data.";
 			return false;
 		}
 
-		if (!zone.debug_heightfield) rcFreeHeightField(solid);
+		if (!debug) {
+			rcFreeHeightField(data.solid);
+			data.solid = nullptr;
+		}
 
-		if (!rcErodeWalkableArea(&ctx, m_config.walkableRadius, *chf)) {
+		if (!rcErodeWalkableArea(&ctx, cfg.walkableRadius, *data.chf)) {
 			logError("Navigation") << "Could not generate navmesh: Could not erode.";
 			return false;
 		}
 
-		if (!rcBuildDistanceField(&ctx, *chf)) {
+		if (!rcBuildDistanceField(&ctx, *data.chf)) {
 			logError("Navigation") << "Could not generate navmesh: Could not build distance field.";
 			return false;
 		}
 
-		if (!rcBuildRegions(&ctx, *chf, m_config.borderSize, m_config.minRegionArea, m_config.mergeRegionArea)) {
+		if (!rcBuildRegions(&ctx, *data.chf, cfg.borderSize, cfg.minRegionArea, cfg.mergeRegionArea)) {
 			logError("Navigation") << "Could not generate navmesh: Could not build regions.";
 			return false;
 		}
 
-		rcContourSet* cset = rcAllocContourSet();
-		zone.debug_contours = keep_data ? cset : nullptr;
-		if (!cset) {
-			ctx.log(RC_LOG_ERROR, "Could not generate navmesh: Out of memory 'cset'.");
+		data.cset = rcAllocContourSet();
+		if (!data.cset) {
+			logError("Navigation") << "Could not generate navmesh: Out of memory 'cset'.";
 			return false;
 		}
 
-		if (!rcBuildContours(&ctx, *chf, m_config.maxSimplificationError, m_config.maxEdgeLen, *cset)) {
+		if (!rcBuildContours(&ctx, *data.chf, cfg.maxSimplificationError, cfg.maxEdgeLen, *data.cset)) {
 			logError("Navigation") << "Could not generate navmesh: Could not create contours.";
 			return false;
 		}
 
-		zone.polymesh = rcAllocPolyMesh();
-		if (!zone.polymesh) {
+		data.polymesh = rcAllocPolyMesh();
+		if (!data.polymesh) {
 			logError("Navigation") << "Could not generate navmesh: Out of memory 'm_polymesh'.";
 			return false;
 		}
-		if (!rcBuildPolyMesh(&ctx, *cset, m_config.maxVertsPerPoly, *zone.polymesh)) {
+		if (!rcBuildPolyMesh(&ctx, *data.cset, cfg.maxVertsPerPoly, *data.polymesh)) {
 			logError("Navigation") << "Could not generate navmesh: Could not triangulate contours.";
 			return false;
 		}
 
-		zone.detail_mesh = rcAllocPolyMeshDetail();
-		if (!zone.detail_mesh) {
+		data.detail_mesh = rcAllocPolyMeshDetail();
+		if (!data.detail_mesh) {
 			logError("Navigation") << "Could not generate navmesh: Out of memory 'pmdtl'.";
 			return false;
 		}
 
 		if (!rcBuildPolyMeshDetail(
-				&ctx, *zone.polymesh, *chf, m_config.detailSampleDist, m_config.detailSampleMaxError, *zone.detail_mesh))
+				&ctx, *data.polymesh, *data.chf, cfg.detailSampleDist, cfg.detailSampleMaxError, *data.detail_mesh))
 		{
 			logError("Navigation") << "Could not generate navmesh: Could not build detail mesh.";
 			return false;
 		}
 
-		if (!zone.debug_compact_heightfield) rcFreeCompactHeightfield(chf);
-		if (!zone.debug_contours) rcFreeContourSet(cset);
-
-		unsigned char* nav_data = 0;
-		int nav_data_size = 0;
-
-		for (int i = 0; i < zone.polymesh->npolys; ++i) {
-			zone.polymesh->flags[i] = zone.polymesh->areas[i] == RC_WALKABLE_AREA ? 1 : 0;
+		rcPolyMesh& polymesh = *data.polymesh;
+		for (int i = 0; i < polymesh.npolys; ++i) {
+			polymesh.flags[i] = polymesh.areas[i] == RC_WALKABLE_AREA ? 1 : 0;
 		}
 
 		dtNavMeshCreateParams params = {};
-		params.verts = zone.polymesh->verts;
-		params.vertCount = zone.polymesh->nverts;
-		params.polys = zone.polymesh->polys;
-		params.polyAreas = zone.polymesh->areas;
-		params.polyFlags = zone.polymesh->flags;
-		params.polyCount = zone.polymesh->npolys;
-		params.nvp = zone.polymesh->nvp;
-		params.detailMeshes = zone.detail_mesh->meshes;
-		params.detailVerts = zone.detail_mesh->verts;
-		params.detailVertsCount = zone.detail_mesh->nverts;
-		params.detailTris = zone.detail_mesh->tris;
-		params.detailTriCount = zone.detail_mesh->ntris;
-		params.walkableHeight = m_config.walkableHeight * m_config.ch;
-		params.walkableRadius = m_config.walkableRadius * m_config.cs;
-		params.walkableClimb = m_config.walkableClimb * m_config.ch;
+		params.verts = polymesh.verts;
+		params.vertCount = polymesh.nverts;
+		params.polys = polymesh.polys;
+		params.polyAreas = polymesh.areas;
+		params.polyFlags = polymesh.flags;
+		params.polyCount = polymesh.npolys;
+		params.nvp = polymesh.nvp;
+		params.detailMeshes = data.detail_mesh->meshes;
+		params.detailVerts = data.detail_mesh->verts;
+		params.detailVertsCount = data.detail_mesh->nverts;
+		params.detailTris = data.detail_mesh->tris;
+		params.detailTriCount = data.detail_mesh->ntris;
+		params.walkableHeight = cfg.walkableHeight * cfg.ch;
+		params.walkableRadius = cfg.walkableRadius * cfg.cs;
+		params.walkableClimb = cfg.walkableClimb * cfg.ch;
 		params.tileX = x;
 		params.tileY = z;
-		rcVcopy(params.bmin, zone.polymesh->bmin);
-		rcVcopy(params.bmax, zone.polymesh->bmax);
-		params.cs = m_config.cs;
-		params.ch = m_config.ch;
+		rcVcopy(params.bmin, polymesh.bmin);
+		rcVcopy(params.bmax, polymesh.bmax);
+		params.cs = cfg.cs;
+		params.ch = cfg.ch;
 		params.buildBvTree = false;
 
-		if (!dtCreateNavMeshData(&params, &nav_data, &nav_data_size)) {
+		if (!dtCreateNavMeshData(&params, &tile.nav_data, &tile.nav_data_size)) {
 			logError("Navigation") << "Could not build Detour navmesh.";
 			return false;
 		}
 
-		if (dtStatusFailed(zone.navmesh->addTile(nav_data, nav_data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+		if (debug) {
+			debug->solid = data.solid;
+			debug->chf = data.chf;
+			debug->cset = data.cset;
+			data.solid = nullptr;
+			data.chf = nullptr;
+			data.cset = nullptr;
+		}
+		return true;
+	}
+
+	// custom flags are registered on the first use, do it before rasterization runs on workers
+	static void registerNavigationFlags() {
+		Material::getCustomFlag("no_navigation");
+		Material::getCustomFlag("nonwalkable");
+	}
+
+	bool addTile(RecastZone& zone, TileBuild& tile) {
+		if (dtStatusFailed(zone.navmesh->addTile(tile.nav_data, tile.nav_data_size, DT_TILE_FREE_DATA, 0, nullptr))) {
+			dtFree(tile.nav_data);
+			tile.nav_data = nullptr;
 			logError("Navigation") << "Could not add Detour tile.";
 			return false;
 		}
 		return true;
 	}
 
+	void queueTileRebuild(EntityRef zone_entity, const DVec3& min, const DVec3& max) override {
+		const RecastZone& zone = m_zones[zone_entity];
+		if (!zone.navmesh) return;
+
+		// tiles overlap by the border, so neighbours touched by the border are rebuilt too
+		const Transform inv_zone_tr = m_universe.getTransform(zone_entity).inverted();
+		float min_x = FLT_MAX, max_x = -FLT_MAX;
+		float min_z = FLT_MAX, max_z = -FLT_MAX;
+		for (u32 i = 0; i < 8; ++i) {
+			const DVec3 c(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+			const Vec3 p = inv_zone_tr.transform(c).toFloat();
+			min_x = minimum(min_x, p.x);
+			max_x = maximum(max_x, p.x);
+			min_z = minimum(min_z, p.z);
+			max_z = maximum(max_z, p.z);
+		}
+		const float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		const float border = (1 + m_config.borderSize) * m_config.cs;
+		const Vec3 zone_min = -zone.zone.extents;
+		int grid_width, grid_height;
+		rcCalcGridSize(&zone_min.x, &zone.zone.extents.x, CELL_SIZE, &grid_width, &grid_height);
+		const int tiles_x = (grid_width + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE;
+		const int tiles_z = (grid_height + CELLS_PER_TILE_SIDE - 1) / CELLS_PER_TILE_SIDE;
+		const int from_x = clamp(int(floorf((min_x - zone_min.x - border) / tile_size)), 0, tiles_x - 1);
+		const int to_x = clamp(int(floorf((max_x - zone_min.x + border) / tile_size)), 0, tiles_x - 1);
+		const int from_z = clamp(int(floorf((min_z - zone_min.z - border) / tile_size)), 0, tiles_z - 1);
+		const int to_z = clamp(int(floorf((max_z - zone_min.z + border) / tile_size)), 0, tiles_z - 1);
+
+		for (int z = from_z; z <= to_z; ++z) {
+			for (int x = from_x; x <= to_x; ++x) {
+				bool queued = false;
+				for (const TileRebuildRequest& req : m_tile_rebuild_queue) {
+					if (req.zone == zone_entity && req.x == x && req.z == z) {
+						queued = true;
+						break;
+					}
+				}
+				if (!queued) m_tile_rebuild_queue.push({zone_entity, x, z});
+			}
+		}
+	}
+
+	void setLODViewer(const DVec3& pos) override { m_lod_viewer = pos; }
+
+	void setLODDistances(float mid, float far) override {
+		m_lod_distances[0] = mid;
+		m_lod_distances[1] = far;
+		if (mid > 0 || far > 0) return;
+
+		for (RecastZone& zone : m_zones) {
+			if (!zone.crowd) continue;
+			for (EntityRef e : zone.agents) {
+				Agent& agent = m_agents[e];
+				if (agent.agent >= 0 && agent.lod != 0) setAgentLOD(agent, *zone.crowd, 0);
+			}
+		}
+	}
+
+	void setAgentLOD(Agent& agent, dtCrowd& crowd, u8 lod) {
+		dtCrowdAgentParams params = crowd.getAgent(agent.agent)->params;
+		params.updateFlags = LOD_UPDATE_FLAGS[lod];
+		params.collisionQueryRange = params.radius * LOD_QUERY_RANGES[lod];
+		crowd.updateAgentParameters(agent.agent, &params);
+		agent.lod = lod;
+	}
+
+	void updateAgentLODs() {
+		if (m_lod_distances[0] <= 0 && m_lod_distances[1] <= 0) return;
+
+		PROFILE_FUNCTION();
+		++m_lod_frame;
+		const float mid2 = m_lod_distances[0] > 0 ? m_lod_distances[0] * m_lod_distances[0] : FLT_MAX;
+		const float far2 = m_lod_distances[1] > 0 ? m_lod_distances[1] * m_lod_distances[1] : FLT_MAX;
+		for (RecastZone& zone : m_zones) {
+			if (!zone.crowd) continue;
+			for (u32 i = (m_lod_frame % LOD_UPDATE_PERIOD); i < (u32)zone.agents.size(); i += LOD_UPDATE_PERIOD) {
+				Agent& agent = m_agents[zone.agents[i]];
+				if (agent.agent < 0) continue;
+
+				const float dist2 = (float)(m_universe.getPosition(agent.entity) - m_lod_viewer).squaredLength();
+				const u8 lod = dist2 > far2 ? 2 : (dist2 > mid2 ? 1 : 0);
+				if (lod != agent.lod) setAgentLOD(agent, *zone.crowd, lod);
+			}
+		}
+	}
+
+	void setTileRebuildBudget(u32 tiles_per_frame) override { m_tile_rebuild_budget = tiles_per_frame; }
+	u32 getTileRebuildBudget() const override { return m_tile_rebuild_budget; }
+
+	bool isTileRebuilding(EntityRef zone, int x, int z) const {
+		for (const TileRebuildJob* job : m_running_tile_jobs) {
+			if (job->zone == zone && job->tile.x == x && job->tile.z == z) return true;
+		}
+		return false;
+	}
+
+	void waitForTileRebuilds() {
+		JobSystem::wait(m_tile_jobs_signal);
+		m_tile_jobs_signal = JobSystem::INVALID_HANDLE;
+		swapRebuiltTiles();
+	}
+
+	void swapRebuiltTiles() {
+		MutexGuard lock(m_tile_jobs_mutex);
+		for (TileRebuildJob* job : m_finished_tile_jobs) {
+			m_running_tile_jobs.swapAndPopItem(job);
+			auto iter = m_zones.find(job->zone);
+			if (job->success && iter.isValid() && iter.value().navmesh && iter.value().navmesh_generation == job->navmesh_generation) {
+				RecastZone& zone = iter.value();
+				// removing and adding on the same thread without a crowd update in between, agents never see a hole
+				zone.navmesh->removeTile(zone.navmesh->getTileRefAt(job->tile.x, job->tile.z, 0), 0, 0);
+				addTile(zone, job->tile);
+			}
+			else if (job->tile.nav_data) {
+				dtFree(job->tile.nav_data);
+			}
+			LUMIX_DELETE(m_allocator, job);
+		}
+		m_finished_tile_jobs.clear();
+	}
+
+	void updateTileRebuilds() {
+		if (m_tile_rebuild_queue.empty() && m_running_tile_jobs.empty()) return;
+
+		PROFILE_FUNCTION();
+		swapRebuiltTiles();
+
+		registerNavigationFlags();
+		u32 started = 0;
+		for (u32 i = 0; i < (u32)m_tile_rebuild_queue.size() && started < m_tile_rebuild_budget;) {
+			const TileRebuildRequest req = m_tile_rebuild_queue[i];
+			auto iter = m_zones.find(req.zone);
+			if (!iter.isValid() || !iter.value().navmesh) {
+				m_tile_rebuild_queue.erase(i);
+				continue;
+			}
+			// geometry could change after the running job gathered it, so keep the request for later
+			if (isTileRebuilding(req.zone, req.x, req.z)) {
+				++i;
+				continue;
+			}
+			m_tile_rebuild_queue.erase(i);
+			++started;
+
+			const RecastZone& zone = iter.value();
+			TileRebuildJob* job = LUMIX_NEW(m_allocator, TileRebuildJob)(m_allocator);
+			job->scene = this;
+			job->zone = req.zone;
+			job->navmesh_generation = zone.navmesh_generation;
+			job->config = m_config;
+			initTile(zone, req.x, req.z, job->tile);
+			gatherGeometry(m_universe.getTransform(req.zone), AABB(job->tile.bmin, job->tile.bmax), job->geometry);
+			m_running_tile_jobs.push(job);
+
+			JobSystem::runEx(job, [](void* data){
+				PROFILE_BLOCK("rebuild navmesh tile");
+				TileRebuildJob* job = (TileRebuildJob*)data;
+				job->success = buildTile(job->config, job->geometry, job->tile, nullptr);
+				NavigationSceneImpl* scene = job->scene;
+				MutexGuard lock(scene->m_tile_jobs_mutex);
+				scene->m_finished_tile_jobs.push(job);
+			}, &m_tile_jobs_signal, JobSystem::INVALID_HANDLE, JobSystem::ANY_WORKER, JobSystem::Priority::BACKGROUND);
+		}
+	}
+
+	bool generateTile(RecastZone& zone, EntityRef zone_entity, int x, int z, bool keep_data) {
+		PROFILE_FUNCTION();
+		if (!zone.navmesh) return false;
+
+		zone.navmesh->removeTile(zone.navmesh->getTileRefAt(x, z, 0), 0, 0);
+
+		registerNavigationFlags();
+		const Transform tr = m_universe.getTransform(zone_entity);
+		TileBuild tile;
+		initTile(zone, x, z, tile);
+		TileGeometry geom(m_allocator);
+		gatherGeometry(tr, AABB(tile.bmin, tile.bmax), geom);
+		TileData debug;
+		if (!buildTile(m_config, geom, tile, keep_data ? &debug : nullptr)) return false;
+
+		if (keep_data) {
+			m_debug_tile_origin = tile.bmin;
+			rcFreeHeightField(zone.debug_heightfield);
+			rcFreeCompactHeightfield(zone.debug_compact_heightfield);
+			rcFreeContourSet(zone.debug_contours);
+			zone.debug_heightfield = debug.solid;
+			zone.debug_compact_heightfield = debug.chf;
+			zone.debug_contours = debug.cset;
+			debug.solid = nullptr;
+			debug.chf = nullptr;
+			debug.cset = nullptr;
+		}
+
+		return addTile(zone, tile);
+	}
+
 
 	bool initNavmesh(RecastZone& zone) {
 		ASSERT(!zone.navmesh);
@@ -1312,14 +1989,38 @@ struct NavigationSceneImpl final : NavigationScene
 			return false;
 		}
 
+		registerNavigationFlags();
+		const Transform tr = m_universe.getTransform(zone_entity);
+		Array<TileBuild> tiles(m_allocator);
+		tiles.reserve(m_num_tiles_x * m_num_tiles_z);
 		for (int j = 0; j < m_num_tiles_z; ++j) {
 			for (int i = 0; i < m_num_tiles_x; ++i) {
-				if (!generateTile(zone, zone_entity, i, j, false)) {
-					return false;
-				}
+				initTile(zone, i, j, tiles.emplace());
 			}
 		}
-		return true;
+
+		NavGeometryIndex index(m_allocator);
+		buildGeometryIndex(tr, zone, tiles, m_num_tiles_x, m_num_tiles_z, index);
+
+		volatile i32 failed = 0;
+		JobSystem::forEach(tiles.size(), 1, [&](u32 from, u32 to){
+			TileGeometry geom(m_allocator);
+			for (u32 i = from; i < to; ++i) {
+				TileBuild& tile = tiles[i];
+				geom.verts.clear();
+				geom.areas.clear();
+				gatherGeometry(tr, index, i, AABB(tile.bmin, tile.bmax), geom);
+				if (!buildTile(m_config, geom, tile, nullptr)) failed = 1;
+			}
+		});
+
+		// detour navmesh is not thread safe, tiles are added on this thread
+		bool success = failed == 0;
+		for (TileBuild& tile : tiles) {
+			if (!tile.nav_data) continue;
+			if (!addTile(zone, tile)) success = false;
+		}
+		return success;
 	}
 
 
@@ -1333,35 +2034,36 @@ struct NavigationSceneImpl final : NavigationScene
 		params.height = agent.height;
 		params.maxAcceleration = 10.0f;
 		params.maxSpeed = 10.0f;
-		params.collisionQueryRange = params.radius * 12.0f;
+		params.collisionQueryRange = params.radius * LOD_QUERY_RANGES[0];
 		params.pathOptimizationRange = params.radius * 30.0f;
-		params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_OPTIMIZE_TOPO | DT_CROWD_OPTIMIZE_VIS;
+		params.updateFlags = LOD_UPDATE_FLAGS[0];
 		agent.agent = zone.crowd->addAgent(&pos.x, &params);
+		agent.lod = 0;
 		if (agent.agent < 0) {
 			logError("Navigation") << "Failed to create navigation actor";
 		}
 	}
 
 	void createZone(EntityRef entity) {
-		RecastZone zone;
+		RecastZone zone(m_allocator);
 		zone.zone.extents = Vec3(1);
 		zone.entity = entity;
-		m_zones.insert(entity, zone);
+		m_zones.insert(entity, static_cast<RecastZone&&>(zone));
 		m_universe.onComponentCreated(entity, NAVMESH_ZONE_TYPE, this);
 	}
 
 	void destroyZone(EntityRef entity) {
 		auto iter = m_zones.find(entity);
-		const RecastZone& zone = iter.value();
-		if (zone.crowd) {
-			for (Agent& agent : m_agents) {
-				if (agent.zone == zone.entity) {
-					zone.crowd->removeAgent(agent.agent);
-					agent.agent = -1;
-				}
-			}
-			dtFreeCrowd(zone.crowd);
+		RecastZone& zone = iter.value();
+		for (EntityRef e : zone.agents) {
+			Agent& agent = m_agents[e];
+			if (zone.crowd && agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
+			agent.agent = -1;
+			agent.zone = INVALID_ENTITY;
 		}
+		dtFreeCrowd(zone.crowd);
+		zone.crowd = nullptr;
+		releasePathQuerySlots(zone);
 
 		m_zones.erase(iter);
 		m_universe.onComponentDestroyed(entity, NAVMESH_ZONE_TYPE, this);
@@ -1378,6 +2080,7 @@ struct NavigationSceneImpl final : NavigationScene
 				&& pos.x < max.x && pos.y < max.y && pos.z < max.z)
 			{
 				agent.zone = zone.entity;
+				zone.agents.push(agent.entity);
 				if (zone.crowd) addCrowdAgent(agent, zone);
 				return;
 			}
@@ -1393,8 +2096,7 @@ struct NavigationSceneImpl final : NavigationScene
 		agent.agent = -1;
 		agent.flags = Agent::USE_ROOT_MOTION;
 		agent.is_finished = true;
-		m_agents.insert(entity, agent);
-		assignZone(agent);
+		assignZone(m_agents.insert(entity, agent).value());
 		m_universe.onComponentCreated(entity, NAVMESH_AGENT_TYPE, this);
 	}
 
@@ -1404,8 +2106,9 @@ struct NavigationSceneImpl final : NavigationScene
 		if (agent.zone.isValid()) {
 			RecastZone& zone = m_zones[(EntityRef)agent.zone];
 			if (zone.crowd && agent.agent >= 0) zone.crowd->removeAgent(agent.agent);
-			m_agents.erase(iter);
+			zone.agents.swapAndPopItem(entity);
 		}
+		m_agents.erase(iter);
 		m_universe.onComponentDestroyed(entity, NAVMESH_AGENT_TYPE, this);
 	}
 
@@ -1438,12 +2141,13 @@ struct NavigationSceneImpl final : NavigationScene
 		serializer.read(count);
 		m_zones.reserve(count + m_zones.size());
 		for (u32 i = 0; i < count; ++i) {
-			RecastZone zone;
+			RecastZone zone(m_allocator);
 			EntityRef e;
 			serializer.read(e);
 			e = entity_map.get(e);
 			serializer.read(zone.zone);
-			m_zones.insert(e, zone);
+			zone.entity = e;
+			m_zones.insert(e, static_cast<RecastZone&&>(zone));
 			m_universe.onComponentCreated(e, NAVMESH_ZONE_TYPE, this);
 		}
 
@@ -1536,6 +2240,20 @@ struct NavigationSceneImpl final : NavigationScene
 	rcConfig m_config;
 	int m_num_tiles_x;
 	int m_num_tiles_z;
+	Array<TileRebuildRequest> m_tile_rebuild_queue;
+	Array<TileRebuildJob*> m_running_tile_jobs;
+	Array<TileRebuildJob*> m_finished_tile_jobs;
+	Mutex m_tile_jobs_mutex;
+	JobSystem::SignalHandle m_tile_jobs_signal = JobSystem::INVALID_HANDLE;
+	u32 m_tile_rebuild_budget = 1;
+	HashMap<u32, PathQuery*> m_path_queries;
+	Array<PathQuery*> m_pending_path_queries;
+	DelegateList<void(u32, PathQueryStatus)> m_path_query_finished;
+	u32 m_next_path_query_id = 1;
+	u32 m_path_query_iterations = 256;
+	DVec3 m_lod_viewer = DVec3(0);
+	float m_lod_distances[2] = {};
+	u32 m_lod_frame = 0;
 	LuaScriptScene* m_script_scene;
 	DelegateList<void(float)> m_on_update;
 };
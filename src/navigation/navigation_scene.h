@@ -22,6 +22,16 @@ struct NavmeshZone {
 
 struct NavigationScene : IScene
 {
+	enum class PathQueryStatus : u32 {
+		PENDING,
+		SUCCESS,
+		// the target is not reachable, the path ends as close to it as possible
+		PARTIAL,
+		FAILURE,
+		INVALID
+	};
+
+
 	static NavigationScene* create(Engine& engine, IPlugin& system, Universe& universe, IAllocator& allocator);
 	static void destroy(NavigationScene& scene);
 
@@ -41,8 +51,29 @@ struct NavigationScene : IScene
 	virtual void setUseAgentRootMotion(EntityRef entity, bool use_root_motion) = 0;
 	virtual bool isGettingRootMotionFromAnim(EntityRef entity) = 0;
 	virtual void setIsGettingRootMotionFromAnim(EntityRef entity, bool is) = 0;
+	// agents further than `mid` from the viewer skip obstacle avoidance, agents further than `far` only follow their corridor
+	// 0 disables the distance, both 0 disable LODs
+	virtual void setLODDistances(float mid, float far) = 0;
+	virtual void setLODViewer(const struct DVec3& pos) = 0;
 	virtual bool generateNavmesh(EntityRef zone) = 0;
 	virtual bool generateTileAt(EntityRef zone, const DVec3& pos, bool keep_data) = 0;
+	// tiles overlapping the world space box are rebuilt on background workers, old tiles are used until then
+	virtual void queueTileRebuild(EntityRef zone, const DVec3& min, const DVec3& max) = 0;
+	// max number of tile rebuilds started per frame, geometry of each one is gathered on the main thread
+	virtual void setTileRebuildBudget(u32 tiles_per_frame) = 0;
+	virtual u32 getTileRebuildBudget() const = 0;
+	// paths are searched on workers with a limited number of iterations per frame, so results can take several frames
+	// queries are kept until released, finished ones are also reported by pathQueryFinished
+	virtual u32 queryPath(EntityRef zone, const struct DVec3& from, const struct DVec3& to) = 0;
+	virtual PathQueryStatus getPathQueryStatus(u32 query) const = 0;
+	// -1 if the query has no path
+	virtual float getPathQueryLength(u32 query) const = 0;
+	// returns the number of points, fills at most points.length() of them
+	virtual u32 getPathQueryPoints(u32 query, Span<struct DVec3> points) const = 0;
+	virtual void releasePathQuery(u32 query) = 0;
+	virtual void setPathQueryIterations(u32 iterations) = 0;
+	virtual u32 getPathQueryIterations() const = 0;
+	virtual DelegateList<void(u32, PathQueryStatus)>& pathQueryFinished() = 0;
 	virtual bool load(EntityRef zone_entity, const char* path) = 0;
 	virtual bool save(EntityRef zone_entity, const char* path) = 0;
 	virtual void debugDrawNavmesh(EntityRef zone, const DVec3& pos, bool inner_boundaries, bool outer_boundaries, bool portals) = 0;
@@ -180,6 +180,11 @@ static void registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(load);
 	REGISTER_FUNCTION(setGeneratorParams);
 	REGISTER_FUNCTION(getAgentSpeed);
+	REGISTER_FUNCTION(setLODDistances);
+	REGISTER_FUNCTION(setLODViewer);
+	REGISTER_FUNCTION(queryPath);
+	REGISTER_FUNCTION(getPathQueryLength);
+	REGISTER_FUNCTION(releasePathQuery);
 
 	#undef REGISTER_FUNCTION
 }
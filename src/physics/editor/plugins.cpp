@@ -9,14 +9,19 @@
 #include "editor/utils.h"
 #include "editor/world_editor.h"
 #include "engine/crc32.h"
+#include "engine/engine.h"
+#include "engine/file_system.h"
 #include "engine/geometry.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/path.h"
+#include "engine/plugin.h"
 #include "engine/reflection.h"
+#include "engine/stream.h"
 #include "engine/universe.h"
 #include "physics/physics_geometry.h"
 #include "physics/physics_scene.h"
+#include "physics/physics_system.h"
 #include "renderer/model.h"
 #include "renderer/render_scene.h"
 
@@ -36,7 +41,7 @@ const ComponentType HINGE_JOINT_TYPE = Reflection::getComponentType("hinge_joint
 const ComponentType SPHERICAL_JOINT_TYPE = Reflection::getComponentType("spherical_joint");
 const ComponentType D6_JOINT_TYPE = Reflection::getComponentType("d6_joint");
 const ComponentType RIGID_ACTOR_TYPE = Reflection::getComponentType("rigid_actor");
-const u32 RENDERER_HASH = crc32("renderer");
+constexpr u32 RENDERER_HASH = StringHash("renderer");
 
 
 Vec3 fromPhysx(const physx::PxVec3& v) { return Vec3(v.x, v.y, v.z); }
@@ -947,8 +952,22 @@ struct PhysicsUIPlugin final : StudioApp::GUIPlugin
 
 
 
-struct PhysicsGeometryPlugin final : AssetBrowser::IPlugin
+struct PhysicsGeometryPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 {
+	struct OutputStream final : physx::PxOutputStream
+	{
+		explicit OutputStream(OutputMemoryStream& blob) : blob(blob) {}
+
+		physx::PxU32 write(const void* src, physx::PxU32 count) override
+		{
+			blob.write(src, count);
+			return count;
+		}
+
+		OutputMemoryStream& blob;
+	};
+
+
 	explicit PhysicsGeometryPlugin(StudioApp& app)
 		: m_app(app)
 	{
@@ -956,6 +975,75 @@ struct PhysicsGeometryPlugin final : AssetBrowser::IPlugin
 	}
 
 
+	// cooking is slow, so it's done here and runtime only creates meshes from the cooked streams
+	bool compile(const Path& src) override
+	{
+		FileSystem& fs = m_app.getEngine().getFileSystem();
+		Array<u8> src_data(m_app.getAllocator());
+		if (!fs.getContentSync(src, Ref(src_data))) return false;
+
+		InputMemoryStream file(src_data.begin(), src_data.byte_size());
+		PhysicsGeometry::Header header;
+		file.read(&header, sizeof(header));
+		if (header.m_magic != PhysicsGeometry::HEADER_MAGIC) {
+			logError("Physics") << "Corrupted geometry " << src;
+			return false;
+		}
+		if (header.m_version >= (u32)PhysicsGeometry::Versions::COOKED) {
+			return m_app.getAssetCompiler().copyCompile(src);
+		}
+
+		i32 num_verts;
+		file.read(num_verts);
+		Array<Vec3> verts(m_app.getAllocator());
+		verts.resize(num_verts);
+		file.read(verts.begin(), verts.byte_size());
+
+		auto* system = (PhysicsSystem*)m_app.getEngine().getPluginManager().getPlugin("physics");
+		physx::PxCooking* cooking = system->getCooking();
+
+		OutputMemoryStream out(m_app.getAllocator());
+		header.m_version = (u32)PhysicsGeometry::Versions::COOKED;
+		out.write(header);
+		OutputStream write_buffer(out);
+		if (header.m_convex != 0) {
+			physx::PxConvexMeshDesc desc;
+			desc.points.count = verts.size();
+			desc.points.stride = sizeof(Vec3);
+			desc.points.data = verts.begin();
+			desc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
+			if (!cooking->cookConvexMesh(desc, write_buffer)) {
+				logError("Physics") << "Failed to cook " << src;
+				return false;
+			}
+		}
+		else {
+			u32 num_indices;
+			file.read(num_indices);
+			Array<u32> indices(m_app.getAllocator());
+			indices.resize(num_indices);
+			file.read(indices.begin(), indices.byte_size());
+
+			physx::PxTriangleMeshDesc desc;
+			desc.points.count = verts.size();
+			desc.points.stride = sizeof(Vec3);
+			desc.points.data = verts.begin();
+			desc.triangles.count = num_indices / 3;
+			desc.triangles.stride = 3 * sizeof(u32);
+			desc.triangles.data = indices.begin();
+			if (!cooking->cookTriangleMesh(desc, write_buffer)) {
+				logError("Physics") << "Failed to cook " << src;
+				return false;
+			}
+		}
+
+		return m_app.getAssetCompiler().writeCompiledResource(src.c_str(), Span((u8*)out.getData(), (i32)out.getPos()));
+	}
+
+
+	bool isCacheable(const Path& src) const override { return true; }
+
+
 	void onGUI(Span<Resource*> resources) override {}
 
 
@@ -998,6 +1086,8 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		m_app.addPlugin(*m_ui_plugin);
 		editor.addPlugin(*m_gizmo_plugin);
 		m_app.getAssetBrowser().addPlugin(*m_geom_plugin);
+		const char* geom_exts[] = {"phy", nullptr};
+		m_app.getAssetCompiler().addPlugin(*m_geom_plugin, geom_exts);
 	}
 
 
@@ -1006,6 +1096,7 @@ struct StudioAppPlugin : StudioApp::IPlugin
 		m_app.removePlugin(*m_ui_plugin);
 		m_app.getWorldEditor().removePlugin(*m_gizmo_plugin);
 		m_app.getAssetBrowser().removePlugin(*m_geom_plugin);
+		m_app.getAssetCompiler().removePlugin(*m_geom_plugin);
 
 		IAllocator& allocator = m_app.getAllocator();
 		LUMIX_DELETE(allocator, m_ui_plugin);
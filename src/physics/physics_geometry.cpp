@@ -51,7 +51,7 @@ struct OutputStream final : physx::PxOutputStream
 
 struct InputStream final : physx::PxInputStream
 {
-	InputStream(unsigned char* data, int size)
+	InputStream(const u8* data, int size)
 	{
 		this->data = data;
 		this->size = size;
@@ -78,7 +78,7 @@ struct InputStream final : physx::PxInputStream
 
 	int pos;
 	int size;
-	unsigned char* data;
+	const u8* data;
 };
 
 
@@ -114,6 +114,31 @@ bool PhysicsGeometry::load(u64 size, const u8* mem)
 		return false;
 	}
 
+	if (header.m_version >= (u32)Versions::COOKED)
+	{
+		InputStream readBuffer(mem + sizeof(header), int(size - sizeof(header)));
+		if (header.m_convex != 0)
+		{
+			convex_mesh = system.getPhysics()->createConvexMesh(readBuffer);
+			tri_mesh = nullptr;
+		}
+		else
+		{
+			tri_mesh = system.getPhysics()->createTriangleMesh(readBuffer);
+			convex_mesh = nullptr;
+		}
+		if (!convex_mesh && !tri_mesh)
+		{
+			logWarning("Physics") << "Failed to create geometry " << getPath().c_str();
+			return false;
+		}
+		m_size = size;
+		return true;
+	}
+
+	// not compiled by the asset compiler, cook it now
+	logWarning("Physics") << getPath().c_str() << " is not cooked, it's cooked at runtime";
+
 	i32 num_verts;
 	Array<Vec3> verts(allocator);
 	file.read(&num_verts, sizeof(num_verts));
@@ -34,6 +34,10 @@ struct PhysicsGeometry final : Resource
 		enum class Versions : u32
 		{
 			FIRST,
+			// raw vertices and indices, written by the importer and cooked by the asset compiler
+			SOURCE,
+			// PhysX streams
+			COOKED,
 
 			LAST
 		};
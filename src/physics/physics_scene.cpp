@@ -9,12 +9,12 @@
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/math.h"
-#include "engine/os.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "lua_script/lua_script_system.h"
 #include "physics/physics_geometry.h"
@@ -44,7 +44,7 @@ static const ComponentType SPHERICAL_JOINT_TYPE = Reflection::getComponentType("
 static const ComponentType D6_JOINT_TYPE = Reflection::getComponentType("d6_joint");
 static const ComponentType VEHICLE_TYPE = Reflection::getComponentType("vehicle");
 static const ComponentType WHEEL_TYPE = Reflection::getComponentType("wheel");
-static const u32 RENDERER_HASH = crc32("renderer");
+static constexpr u32 RENDERER_HASH = StringHash("renderer");
 
 
 enum class PhysicsSceneVersion
@@ -198,6 +198,23 @@ struct Vehicle
 };
 
 
+struct TriggerEvent
+{
+	EntityRef e1;
+	EntityRef e2;
+	bool touch_lost;
+};
+
+
+// pose of an awake actor at the last two fixed steps
+struct MovingActor
+{
+	RigidTransform prev;
+	RigidTransform cur;
+	u32 step;
+};
+
+
 struct Wheel
 {
 	float mass = 1;
@@ -229,22 +246,56 @@ struct Heightfield
 };
 
 
+// piece of a streamed heightfield, tiles share border samples
+struct HeightfieldTile
+{
+	EntityRef terrain;
+	PxRigidActor* actor = nullptr;
+	bool building = true;
+	u32 last_needed_frame;
+};
+
+
+// cooked on a worker, the actor is created on the main thread
+struct HeightfieldTileJob
+{
+	explicit HeightfieldTileJob(IAllocator& allocator) : cooked(allocator) {}
+
+	struct PhysicsSceneImpl* scene;
+	u64 key;
+	const Texture* heightmap;
+	u32 first_row;
+	u32 first_col;
+	u32 rows;
+	u32 cols;
+	OutputStream cooked;
+	bool success;
+};
+
+
 struct PhysicsSceneImpl final : PhysicsScene
 {
+	static constexpr u32 HEIGHTFIELD_TILE_SIZE = 128;
+
 	struct CPUDispatcher : physx::PxCpuDispatcher
 	{
 		void submitTask(PxBaseTask& task) override
 		{
-			JobSystem::run(&task,
+			// the step blocks the frame, so it must not wait behind render and streaming jobs
+			JobSystem::runEx(&task,
 				[](void* data) {
 					PxBaseTask* task = (PxBaseTask*)data;
-					PROFILE_FUNCTION();
+					PROFILE_BLOCK("physx task");
+					Profiler::pushString(task->getName());
 					task->run();
 					task->release();
 				},
-				nullptr);
+				nullptr,
+				JobSystem::INVALID_HANDLE,
+				JobSystem::ANY_WORKER,
+				JobSystem::Priority::HIGH);
 		}
-		PxU32 getWorkerCount() const override { return OS::getCPUsCount(); }
+		PxU32 getWorkerCount() const override { return JobSystem::getWorkersCount(); }
 	};
 
 
@@ -261,23 +312,36 @@ struct PhysicsSceneImpl final : PhysicsScene
 		}
 
 
+		// PhysX holds its locks while callbacks run, so events are only collected here
 		void onContact(const PxContactPairHeader& pairHeader, const PxContactPair* pairs, PxU32 nbPairs) override
 		{
+			const auto REMOVED_FLAGS = PxContactPairHeaderFlag::eREMOVED_ACTOR_0 | PxContactPairHeaderFlag::eREMOVED_ACTOR_1;
+			if (pairHeader.flags & REMOVED_FLAGS) return;
+
 			for (PxU32 i = 0; i < nbPairs; i++)
 			{
 				const auto& cp = pairs[i];
 
 				if (!(cp.events & PxPairFlag::eNOTIFY_TOUCH_FOUND)) continue;
+				if (cp.flags & (PxContactPairFlag::eREMOVED_SHAPE_0 | PxContactPairFlag::eREMOVED_SHAPE_1)) continue;
 
-				PxContactPairPoint contact;
-				cp.extractContacts(&contact, 1);
+				const u32 layers = cp.shapes[0]->getSimulationFilterData().word0 | cp.shapes[1]->getSimulationFilterData().word0;
+				if ((layers & m_scene.m_contact_layers_mask) == 0) continue;
 
-				ContactData contact_data;
-				contact_data.position = fromPhysx(contact.position);
+				PxContactPairPoint contacts[8];
+				const PxU32 count = cp.extractContacts(contacts, lengthOf(contacts));
+				if (count == 0) continue;
+
+				float impulse = 0;
+				for (PxU32 j = 0; j < count; ++j) impulse += contacts[j].impulse.magnitude();
+				if (impulse < m_scene.m_contact_min_impulse) continue;
+
+				ContactData& contact_data = m_scene.m_contacts.emplace();
+				contact_data.position = fromPhysx(contacts[0].position);
+				contact_data.normal = fromPhysx(contacts[0].normal);
+				contact_data.impulse = impulse;
 				contact_data.e1 = {(int)(intptr_t)(pairHeader.actors[0]->userData)};
 				contact_data.e2 = {(int)(intptr_t)(pairHeader.actors[1]->userData)};
-
-				m_scene.onContact(contact_data);
 			}
 		}
 
@@ -290,10 +354,10 @@ struct PhysicsSceneImpl final : PhysicsScene
 					PxTriggerPairFlag::eREMOVED_SHAPE_TRIGGER | PxTriggerPairFlag::eREMOVED_SHAPE_OTHER;
 				if (pairs[i].flags & REMOVED_FLAGS) continue;
 
-				EntityRef e1 = {(int)(intptr_t)(pairs[i].triggerActor->userData)};
-				EntityRef e2 = {(int)(intptr_t)(pairs[i].otherActor->userData)};
-
-				m_scene.onTrigger(e1, e2, pairs[i].status == PxPairFlag::eNOTIFY_TOUCH_LOST);
+				TriggerEvent& event = m_scene.m_triggers.emplace();
+				event.e1 = {(int)(intptr_t)(pairs[i].triggerActor->userData)};
+				event.e2 = {(int)(intptr_t)(pairs[i].otherActor->userData)};
+				event.touch_lost = pairs[i].status == PxPairFlag::eNOTIFY_TOUCH_LOST;
 			}
 		}
 
@@ -319,6 +383,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			, dynamic_type(DynamicType::STATIC)
 			, is_trigger(false)
 			, scale(1)
+			, is_active(true)
 		{
 		}
 
@@ -340,6 +405,8 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PhysicsSceneImpl& scene;
 		DynamicType dynamic_type;
 		bool is_trigger;
+		// inactive actors are not in the physx scene
+		bool is_active;
 
 	private:
 		void onStateChanged(Resource::State old_state, Resource::State new_state, Resource&);
@@ -354,17 +421,23 @@ struct PhysicsSceneImpl final : PhysicsScene
 		, m_vehicles(m_allocator)
 		, m_wheels(m_allocator)
 		, m_terrains(m_allocator)
-		, m_dynamic_actors(m_allocator)
+		, m_heightfield_tiles(m_allocator)
+		, m_heightfield_streaming_points(m_allocator)
+		, m_finished_heightfield_jobs(m_allocator)
+		, m_moving_actors(m_allocator)
 		, m_universe(context)
 		, m_is_game_running(false)
 		, m_contact_callback(*this)
 		, m_contact_callbacks(m_allocator)
+		, m_contacts(m_allocator)
+		, m_triggers(m_allocator)
+		, m_frame_contacts(m_allocator)
 		, m_layers_count(2)
 		, m_joints(m_allocator)
 		, m_script_scene(nullptr)
 		, m_debug_visualization_flags(0)
 		, m_is_updating_ragdoll(false)
-		, m_update_in_progress(nullptr)
+		, m_is_updating_dynamic_actors(false)
 		, m_vehicle_batch_query(nullptr)
 	{
 
@@ -378,10 +451,10 @@ struct PhysicsSceneImpl final : PhysicsScene
 			m_collision_filter[i] = 0xffffFFFF;
 		}
 
-		m_physics_cmps_mask = 0;
+		m_physics_cmps_mask = {};
 
 		#define REGISTER_COMPONENT(TYPE, COMPONENT)      \
-			m_physics_cmps_mask |= (u64)1 << TYPE.index; \
+			m_physics_cmps_mask.add(TYPE);               \
 			context.registerComponentType(TYPE,          \
 				this,                                    \
 				&PhysicsSceneImpl::create##COMPONENT,    \
@@ -444,6 +517,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	~PhysicsSceneImpl()
 	{
+		finishSimulation();
+		for (const Heightfield& terrain : m_terrains)
+		{
+			releaseHeightfieldTiles(terrain.m_entity);
+		}
 		m_vehicle_batch_query->release();
 		m_vehicle_frictions->release();
 		m_controller_manager->release();
@@ -454,10 +532,22 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 
 	int getVersion() const override { return (int)PhysicsSceneVersion::LATEST; }
+	bool isDeserializeThreadSafe() const override { return true; }
+
+	Span<const char* const> getDeserializeDependencies() const override {
+		// heightfields share heightmap textures with renderer's terrains
+		static const char* const deps[] = { "renderer" };
+		return Span(deps);
+	}
 
 
 	void clear() override
 	{
+		finishSimulation();
+		for (const Heightfield& terrain : m_terrains)
+		{
+			releaseHeightfieldTiles(terrain.m_entity);
+		}
 		for (auto& controller : m_controllers)
 		{
 			controller.m_controller->release();
@@ -484,7 +574,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			LUMIX_DELETE(m_allocator, actor);
 		}
 		m_actors.clear();
-		m_dynamic_actors.clear();
+		m_moving_actors.clear();
 
 		m_terrains.clear();
 	}
@@ -513,8 +603,36 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
+	// called after the step, when lua and gameplay can safely touch the scene
+	void dispatchEvents()
+	{
+		PROFILE_FUNCTION();
+		m_frame_contacts.clear();
+		m_frame_contacts.swap(m_contacts);
+
+		for (const TriggerEvent& event : m_triggers) onTrigger(event.e1, event.e2, event.touch_lost);
+		m_triggers.clear();
+
+		for (const ContactData& contact : m_frame_contacts) onContact(contact);
+	}
+
+
+	Span<const ContactData> getContacts() const override
+	{
+		return Span<const ContactData>(m_frame_contacts.begin(), m_frame_contacts.end());
+	}
+
+
+	void setContactFilter(u32 layers_mask, float min_impulse) override
+	{
+		m_contact_layers_mask = layers_mask;
+		m_contact_min_impulse = min_impulse;
+	}
+
+
 	void onContact(const ContactData& contact_data)
 	{
+		m_contact_callbacks.invoke(contact_data);
 		if (!m_script_scene) return;
 
 		auto send = [this](EntityRef e1, EntityRef e2, const Vec3& position) {
@@ -535,7 +653,6 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 		send(contact_data.e1, contact_data.e2, contact_data.position);
 		send(contact_data.e2, contact_data.e1, contact_data.position);
-		m_contact_callbacks.invoke(contact_data);
 	}
 
 
@@ -673,17 +790,10 @@ struct PhysicsSceneImpl final : PhysicsScene
 		auto& terrain = m_terrains[entity];
 		terrain.m_layer = layer;
 
-		if (terrain.m_actor)
+		if (terrain.m_actor) updateFilterData(terrain.m_actor, layer);
+		for (const HeightfieldTile& tile : m_heightfield_tiles)
 		{
-			PxFilterData data;
-			data.word0 = 1 << layer;
-			data.word1 = m_collision_filter[layer];
-			PxShape* shapes[8];
-			int shapes_count = terrain.m_actor->getShapes(shapes, lengthOf(shapes));
-			for (int i = 0; i < shapes_count; ++i)
-			{
-				shapes[i]->setSimulationFilterData(data);
-			}
+			if (tile.terrain == entity && tile.actor) updateFilterData(tile.actor, layer);
 		}
 	}
 
@@ -698,6 +808,12 @@ struct PhysicsSceneImpl final : PhysicsScene
 	{
 		PROFILE_FUNCTION();
 		Heightfield& terrain = m_terrains[entity];
+		if (m_heightfield_streaming_radius > 0)
+		{
+			// the heightmap is already updated, affected tiles are rebuilt from it
+			releaseHeightfieldTiles(entity, x, x + width, y, y + height);
+			return;
+		}
 
 		PxShape* shape;
 		terrain.m_actor->getShapes(&shape, 1);
@@ -1129,6 +1245,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	void destroyHeightfield(EntityRef entity)
 	{
+		releaseHeightfieldTiles(entity);
 		m_terrains.erase(entity);
 		m_universe.onComponentDestroyed(entity, HEIGHTFIELD_TYPE, this);
 	}
@@ -1177,7 +1294,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 		actor->setPhysxActor(nullptr);
 		LUMIX_DELETE(m_allocator, actor);
 		m_actors.erase(entity);
-		m_dynamic_actors.eraseItem(actor);
+		m_moving_actors.erase(entity);
 		m_universe.onComponentDestroyed(entity, RIGID_ACTOR_TYPE, this);
 		if (m_is_game_running)
 		{
@@ -1384,6 +1501,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			return;
 		}
 		RigidActor* actor = LUMIX_NEW(m_allocator, RigidActor)(*this, entity);
+		actor->is_active = m_universe.isActive(entity);
 		m_actors.insert(entity, actor);
 
 		Transform transform = m_universe.getTransform(entity);
@@ -1446,6 +1564,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 		auto* old_hm = terrain.m_heightmap;
 		if (old_hm)
 		{
+			releaseHeightfieldTiles(entity);
 			old_hm->getResourceManager().unload(*old_hm);
 			auto& cb = old_hm->getObserverCb();
 			cb.unbind<&Heightfield::heightmapLoaded>(&terrain);
@@ -1548,18 +1667,112 @@ struct PhysicsSceneImpl final : PhysicsScene
 	void updateDynamicActors()
 	{
 		PROFILE_FUNCTION();
-		for (auto* actor : m_dynamic_actors)
-		{
-			m_update_in_progress = actor;
-			PxTransform trans = actor->physx_actor->getGlobalPose();
-			m_universe.setTransform(actor->entity, fromPhysx(trans));
+		PxU32 count;
+		m_scene->getActiveActors(count);
+		Array<EntityRef> entities(getFrameAllocator());
+		Array<Transform> transforms(getFrameAllocator());
+		entities.reserve(count);
+		transforms.reserve(count);
+
+		auto push = [&](EntityRef entity, const PxTransform& px_trans){
+			const RigidTransform trans = fromPhysx(px_trans);
+			Transform& tr = transforms.emplace(m_universe.getTransform(entity));
+			tr.pos = trans.pos;
+			tr.rot = trans.rot;
+			entities.push(entity);
+		};
+
+		forEachActiveActor([&](EntityRef entity, PxRigidActor* px_actor){
+			push(entity, px_actor->getGlobalPose());
+		});
+
+		m_is_updating_dynamic_actors = true;
+		m_universe.setTransforms(Span<const EntityRef>(entities.begin(), entities.end()), Span<const Transform>(transforms.begin(), transforms.end()));
+		m_is_updating_dynamic_actors = false;
+	}
+
+
+	// sleeping actors do not move, so only dynamic actors and vehicles awake in the last step are visited
+	template <typename F>
+	void forEachActiveActor(F f)
+	{
+		PxU32 count;
+		PxActor** active_actors = m_scene->getActiveActors(count);
+		for (PxU32 i = 0; i < count; ++i) {
+			PxRigidActor* px_actor = active_actors[i]->is<PxRigidActor>();
+			if (!px_actor) continue;
+
+			// ragdoll bones and controllers share the entity, but they are not in m_actors / m_vehicles
+			const EntityRef entity = {(int)(intptr_t)px_actor->userData};
+			auto actor_iter = m_actors.find(entity);
+			if (actor_iter.isValid()) {
+				const RigidActor* actor = actor_iter.value();
+				if (actor->physx_actor == px_actor && actor->dynamic_type == DynamicType::DYNAMIC) f(entity, px_actor);
+				continue;
+			}
+
+			auto veh_iter = m_vehicles.find(entity);
+			if (veh_iter.isValid() && veh_iter.value().actor == px_actor) f(entity, px_actor);
 		}
-		m_update_in_progress = nullptr;
+	}
 
-		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) {
-			const PxTransform trans = iter.value().actor->getGlobalPose();
-			m_universe.setTransform(iter.key(), fromPhysx(trans));
+
+	// called after each fixed step, keeps the last two poses of moving actors
+	void updateMovingActors()
+	{
+		PROFILE_FUNCTION();
+		++m_step_counter;
+		forEachActiveActor([&](EntityRef entity, PxRigidActor* px_actor){
+			auto iter = m_moving_actors.find(entity);
+			MovingActor* moving;
+			if (iter.isValid()) {
+				moving = &iter.value();
+				moving->prev = moving->cur;
+			}
+			else {
+				// it has just woken up, so it was resting where we wrote it the last time
+				const RigidTransform tr = m_universe.getTransform(entity).getRigidPart();
+				moving = &m_moving_actors.insert(entity, {tr, tr, 0});
+			}
+			moving->cur = fromPhysx(px_actor->getGlobalPose());
+			moving->step = m_step_counter;
+		});
+	}
+
+
+	// fixed step counterpart of updateDynamicActors, blends the last two steps by the time left in the accumulator
+	void updateInterpolatedActors()
+	{
+		PROFILE_FUNCTION();
+		const float t = m_accumulator / m_fixed_timestep;
+		Array<EntityRef> entities(getFrameAllocator());
+		Array<Transform> transforms(getFrameAllocator());
+		Array<EntityRef> sleeping(getFrameAllocator());
+		entities.reserve(m_moving_actors.size());
+		transforms.reserve(m_moving_actors.size());
+
+		for (auto iter = m_moving_actors.begin(), end = m_moving_actors.end(); iter != end; ++iter) {
+			const EntityRef entity = iter.key();
+			const MovingActor& moving = iter.value();
+			Transform& tr = transforms.emplace(m_universe.getTransform(entity));
+			if (moving.step == m_step_counter) {
+				tr.pos = lerp(moving.prev.pos, moving.cur.pos, t);
+				tr.rot = nlerp(moving.prev.rot, moving.cur.rot, t);
+			}
+			else {
+				// fell asleep, so it stays exactly where physx has it
+				tr.pos = moving.cur.pos;
+				tr.rot = moving.cur.rot;
+				sleeping.push(entity);
+			}
+			entities.push(entity);
 		}
+
+		m_is_updating_dynamic_actors = true;
+		m_universe.setTransforms(Span<const EntityRef>(entities.begin(), entities.end()), Span<const Transform>(transforms.begin(), transforms.end()));
+		m_is_updating_dynamic_actors = false;
+
+		for (EntityRef entity : sleeping) m_moving_actors.erase(entity);
 	}
 
 
@@ -1574,6 +1787,14 @@ struct PhysicsSceneImpl final : PhysicsScene
 	{
 		PROFILE_FUNCTION();
 		m_scene->fetchResults(true);
+		m_is_simulating = false;
+	}
+
+
+	// blocks until the step kicked in update is done, results are not applied to the universe
+	void finishSimulation()
+	{
+		if (m_is_simulating) fetchResults();
 	}
 
 
@@ -1586,9 +1807,15 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
+	// PxController::move writes the controller's kinematic actor and PhysX does not allow concurrent scene writes,
+	// so moves stay serial; the transforms are written back in one batch
 	void updateControllers(float time_delta)
 	{
 		PROFILE_FUNCTION();
+		Array<EntityRef> entities(getFrameAllocator());
+		Array<Transform> transforms(getFrameAllocator());
+		entities.reserve(m_controllers.size());
+		transforms.reserve(m_controllers.size());
 		for (auto& controller : m_controllers)
 		{
 			Vec3 dif = controller.m_frame_change;
@@ -1621,8 +1848,15 @@ struct PhysicsSceneImpl final : PhysicsScene
 			controller.m_controller->move(toPhysx(dif), 0.001f, time_delta, filters);
 			PxExtendedVec3 p = controller.m_controller->getFootPosition();
 
-			m_universe.setPosition(controller.m_entity, {p.x, p.y, p.z});
+			Transform tr = m_universe.getTransform(controller.m_entity);
+			const DVec3 pos(p.x, p.y, p.z);
+			if (tr.pos.x == pos.x && tr.pos.y == pos.y && tr.pos.z == pos.z) continue;
+			tr.pos = pos;
+			transforms.push(tr);
+			entities.push(controller.m_entity);
 		}
+
+		m_universe.setTransforms(Span<const EntityRef>(entities.begin(), entities.end()), Span<const Transform>(transforms.begin(), transforms.end()));
 	}
 
 
@@ -2099,60 +2333,118 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void updateBone(const RigidTransform& root_transform, const RigidTransform& inv_root, RagdollBone* bone, Pose* pose)
+	// appends bones of the ragdoll without recursion, returns false if the whole ragdoll is asleep
+	static bool flattenRagdoll(RagdollBone* root, Array<RagdollBone*>& bones)
 	{
-		/*if (!bone) return;
-
-		if (bone->is_kinematic)
+		bool is_awake = false;
+		RagdollBone* bone = root;
+		while (bone)
 		{
-			RigidTransform bone_transform(DVec3(pose->positions[bone->pose_bone_idx]),
-		pose->rotations[bone->pose_bone_idx]); bone->actor->setKinematicTarget(toPhysx(root_transform * bone_transform *
-		bone->inv_bind_transform));
-		}
-		else
-		{
-			PxTransform bone_pose = bone->actor->getGlobalPose();
-			auto tr = inv_root * RigidTransform(DVec3(fromPhysx(bone_pose.p)), fromPhysx(bone_pose.q)) *
-		bone->bind_transform; pose->rotations[bone->pose_bone_idx] = tr.rot; pose->positions[bone->pose_bone_idx] =
-		tr.pos;
+			bones.push(bone);
+			// kinematic bones follow the animation
+			is_awake = is_awake || bone->is_kinematic || !bone->actor->isSleeping();
+			if (bone->child)
+			{
+				bone = bone->child;
+				continue;
+			}
+			while (bone && !bone->next) bone = bone->parent;
+			if (bone) bone = bone->next;
 		}
-
-		updateBone(root_transform, inv_root, bone->next, pose);
-		updateBone(root_transform, inv_root, bone->child, pose);*/
-
-		// TODO
+		return is_awake;
 	}
 
 
 	void updateRagdolls()
 	{
+		PROFILE_FUNCTION();
 		auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(RENDERER_HASH));
 		if (!render_scene) return;
 
+		struct Job
+		{
+			EntityRef entity;
+			Pose* pose;
+			RigidTransform inv_root;
+			u32 first_bone;
+			u32 bones_count;
+		};
+		Array<Job> jobs(getFrameAllocator());
+		Array<RagdollBone*> bones(getFrameAllocator());
+
+		// transforms and kinematic targets are written to the universe and the scene, so this part is serial
 		for (auto& ragdoll : m_ragdolls)
 		{
 			EntityRef entity = ragdoll.entity;
 
-			if (!render_scene->getUniverse().hasComponent(entity, MODEL_INSTANCE_TYPE)) continue;
+			if (!ragdoll.root) continue;
+			if (!m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) continue;
+
+			const u32 first_bone = bones.size();
+			if (!flattenRagdoll(ragdoll.root, bones))
+			{
+				bones.resize(first_bone);
+				continue;
+			}
+
 			Pose* pose = render_scene->lockPose(entity);
-			if (!pose) continue;
+			if (!pose)
+			{
+				bones.resize(first_bone);
+				continue;
+			}
 
 			RigidTransform root_transform;
 			root_transform.rot = m_universe.getRotation(ragdoll.entity);
 			root_transform.pos = m_universe.getPosition(ragdoll.entity);
 
-			if (ragdoll.root && !ragdoll.root->is_kinematic)
+			if (!ragdoll.root->is_kinematic)
 			{
 				PxTransform bone_pose = ragdoll.root->actor->getGlobalPose();
 				m_is_updating_ragdoll = true;
 
-				RigidTransform rigid_tr = fromPhysx(bone_pose) * ragdoll.root_transform;
-				m_universe.setTransform(ragdoll.entity, {rigid_tr.pos, rigid_tr.rot, 1.0f});
+				root_transform = fromPhysx(bone_pose) * ragdoll.root_transform;
+				m_universe.setTransform(ragdoll.entity, {root_transform.pos, root_transform.rot, 1.0f});
 
 				m_is_updating_ragdoll = false;
 			}
-			updateBone(root_transform, root_transform.inverted(), ragdoll.root, pose);
-			render_scene->unlockPose(entity, true);
+
+			for (u32 i = first_bone, c = bones.size(); i < c; ++i)
+			{
+				const RagdollBone* bone = bones[i];
+				if (!bone->is_kinematic) continue;
+				const RigidTransform bone_transform(DVec3(pose->positions[bone->pose_bone_idx]), pose->rotations[bone->pose_bone_idx]);
+				bone->actor->setKinematicTarget(toPhysx(root_transform * bone_transform * bone->inv_bind_transform));
+			}
+
+			Job& job = jobs.emplace();
+			job.entity = entity;
+			job.pose = pose;
+			job.inv_root = root_transform.inverted();
+			job.first_bone = first_bone;
+			job.bones_count = bones.size() - first_bone;
+		}
+
+		// only reads from the scene, every ragdoll has its own pose
+		JobSystem::forEach(jobs.size(), 1, [&](u32 from, u32 to){
+			PROFILE_BLOCK("update ragdoll poses");
+			for (u32 i = from; i < to; ++i)
+			{
+				const Job& job = jobs[i];
+				for (u32 j = job.first_bone, end = job.first_bone + job.bones_count; j < end; ++j)
+				{
+					const RagdollBone* bone = bones[j];
+					if (bone->is_kinematic) continue;
+					const RigidTransform tr = job.inv_root * fromPhysx(bone->actor->getGlobalPose()) * bone->bind_transform;
+					job.pose->positions[bone->pose_bone_idx] = tr.pos.toFloat();
+					job.pose->rotations[bone->pose_bone_idx] = tr.rot;
+				}
+			}
+		});
+
+		for (const Job& job : jobs)
+		{
+			render_scene->unlockPose(job.entity, true);
 		}
 	}
 
@@ -2178,20 +2470,95 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 	void update(float time_delta, bool paused) override
 	{
+		updateHeightfieldTiles();
 		if (!m_is_game_running || paused) return;
 
 		time_delta = minimum(1 / 20.0f, time_delta);
-		updateVehicles(time_delta);
-		simulateScene(time_delta);
-		fetchResults();
-		updateRagdolls();
-		updateDynamicActors();
+		if (m_fixed_timestep > 0) {
+			m_accumulator += time_delta;
+			u32 steps = u32(m_accumulator / m_fixed_timestep);
+			m_accumulator -= steps * m_fixed_timestep;
+			if (steps > m_max_substeps) {
+				// can not keep up, drop the time we are behind
+				steps = m_max_substeps;
+				m_accumulator = 0;
+			}
+			for (u32 i = 0; i < steps; ++i) {
+				if (m_is_simulating) {
+					fetchResults();
+					updateMovingActors();
+				}
+				updateVehicles(m_fixed_timestep);
+				simulateScene(m_fixed_timestep);
+				m_is_simulating = true;
+			}
+		}
+		else {
+			updateVehicles(time_delta);
+			simulateScene(time_delta);
+			m_is_simulating = true;
+		}
+
+		m_needs_apply = true;
+		if (!m_overlap_simulation) applyResults(time_delta);
+	}
+
+
+	// the step runs in worker threads while other scenes update, results are applied after all updates
+	void lateUpdate(float time_delta, bool paused) override
+	{
+		if (!m_needs_apply) return;
+		applyResults(minimum(1 / 20.0f, time_delta));
+	}
+
+
+	void applyResults(float time_delta)
+	{
+		m_needs_apply = false;
+		if (m_fixed_timestep > 0) {
+			if (m_is_simulating) {
+				fetchResults();
+				updateMovingActors();
+			}
+			updateRagdolls();
+			updateInterpolatedActors();
+		}
+		else {
+			fetchResults();
+			updateRagdolls();
+			updateDynamicActors();
+		}
 		updateControllers(time_delta);
+		dispatchEvents();
 
 		render();
 	}
 
 
+	void setFixedTimestep(float step, u32 max_substeps) override
+	{
+		finishSimulation();
+		m_fixed_timestep = step;
+		m_max_substeps = max_substeps;
+		m_accumulator = 0;
+		m_moving_actors.clear();
+	}
+
+
+	float getFixedTimestep() const override { return m_fixed_timestep; }
+	u32 getMaxSubsteps() const override { return m_max_substeps; }
+
+
+	void setOverlapSimulation(bool enable) override
+	{
+		finishSimulation();
+		m_overlap_simulation = enable;
+	}
+
+
+	bool isOverlapSimulation() const override { return m_overlap_simulation; }
+
+
 	DelegateList<void(const ContactData&)>& onContact() override { return m_contact_callbacks; }
 
 
@@ -2471,6 +2838,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 			chassis_data.mCMOffset = PxVec3(0, .02f, 0);
 
 			veh.actor = createVehicleActor(chassis_data);
+			veh.actor->userData = (void*)(intptr_t)entity.index;
 			m_scene->addActor(*veh.actor);
 
 			veh.drive = PxVehicleDrive4W::allocate(4);
@@ -2503,7 +2871,17 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void stopGame() override { m_is_game_running = false; }
+	void stopGame() override
+	{
+		finishSimulation();
+		m_contacts.clear();
+		m_frame_contacts.clear();
+		m_triggers.clear();
+		m_needs_apply = false;
+		m_accumulator = 0;
+		m_moving_actors.clear();
+		m_is_game_running = false;
+	}
 
 
 	float getControllerRadius(EntityRef entity) override { return m_controllers[entity].m_radius; }
@@ -2626,6 +3004,132 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
+	// each query is a table {origin = ..., dir = ..., distance = ..., layer = ..., ignore = ...}
+	// or {center = ..., radius = ..., layer = ..., ignore = ...}, optional fields default to everything
+	template <typename F>
+	static void forEachLuaQuery(lua_State* L, int idx, F f)
+	{
+		LuaWrapper::checkTableArg(L, idx);
+		const u32 count = (u32)lua_objlen(L, idx);
+		for (u32 i = 0; i < count; ++i) {
+			lua_rawgeti(L, idx, i + 1);
+			if (!lua_istable(L, -1)) luaL_argerror(L, idx, "array of tables expected");
+			f(i);
+			lua_pop(L, 1);
+		}
+	}
+
+
+	template <typename Query>
+	static void readLuaQueryCommon(lua_State* L, Query& q)
+	{
+		q.ignored = INVALID_ENTITY;
+		q.layer = -1;
+		LuaWrapper::checkField(L, -1, "ignore", &q.ignored);
+		LuaWrapper::checkField(L, -1, "layer", &q.layer);
+	}
+
+
+	template <typename Query>
+	static void readLuaRay(lua_State* L, int idx, Query& q)
+	{
+		readLuaQueryCommon(L, q);
+		q.distance = FLT_MAX;
+		LuaWrapper::checkField(L, -1, "distance", &q.distance);
+		if (!LuaWrapper::checkField(L, -1, "origin", &q.origin) || !LuaWrapper::checkField(L, -1, "dir", &q.dir)) {
+			luaL_argerror(L, idx, "origin and dir expected");
+		}
+	}
+
+
+	// pushes an array of results, false for queries without a hit
+	static void pushLuaHits(lua_State* L, Span<const RaycastHit> hits)
+	{
+		lua_createtable(L, hits.length(), 0);
+		for (u32 i = 0; i < hits.length(); ++i) {
+			const RaycastHit& hit = hits[i];
+			if (hit.entity.isValid()) {
+				lua_createtable(L, 0, 3);
+				LuaWrapper::push(L, hit.entity);
+				lua_setfield(L, -2, "entity");
+				LuaWrapper::push(L, hit.position);
+				lua_setfield(L, -2, "position");
+				LuaWrapper::push(L, hit.normal);
+				lua_setfield(L, -2, "normal");
+			}
+			else {
+				LuaWrapper::push(L, false);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+	}
+
+
+	static int LUA_raycastBatch(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsSceneImpl*>(L, 1);
+		Array<RaycastQuery> queries(scene->m_allocator);
+		forEachLuaQuery(L, 2, [&](u32){ readLuaRay(L, 2, queries.emplace()); });
+
+		Array<RaycastHit> hits(scene->m_allocator);
+		hits.resize(queries.size());
+		scene->raycastBatch(queries, hits);
+		pushLuaHits(L, hits);
+		return 1;
+	}
+
+
+	static int LUA_sweepSphereBatch(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsSceneImpl*>(L, 1);
+		Array<SweepQuery> queries(scene->m_allocator);
+		forEachLuaQuery(L, 2, [&](u32){
+			SweepQuery& q = queries.emplace();
+			readLuaRay(L, 2, q);
+			if (!LuaWrapper::checkField(L, -1, "radius", &q.radius)) luaL_argerror(L, 2, "radius expected");
+		});
+
+		Array<RaycastHit> hits(scene->m_allocator);
+		hits.resize(queries.size());
+		scene->sweepSphereBatch(queries, hits);
+		pushLuaHits(L, hits);
+		return 1;
+	}
+
+
+	// returns an array of arrays of overlapping entities
+	static int LUA_overlapSphereBatch(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsSceneImpl*>(L, 1);
+		const u32 max_hits = lua_gettop(L) > 2 ? minimum(LuaWrapper::checkArg<u32>(L, 3), MAX_OVERLAP_HITS) : MAX_OVERLAP_HITS;
+		Array<OverlapQuery> queries(scene->m_allocator);
+		forEachLuaQuery(L, 2, [&](u32){
+			OverlapQuery& q = queries.emplace();
+			readLuaQueryCommon(L, q);
+			if (!LuaWrapper::checkField(L, -1, "center", &q.center) || !LuaWrapper::checkField(L, -1, "radius", &q.radius)) {
+				luaL_argerror(L, 2, "center and radius expected");
+			}
+		});
+
+		Array<EntityRef> hits(scene->m_allocator);
+		Array<u32> hits_count(scene->m_allocator);
+		hits.resize(queries.size() * max_hits);
+		hits_count.resize(queries.size());
+		scene->overlapSphereBatch(queries, max_hits, hits, hits_count);
+
+		lua_createtable(L, queries.size(), 0);
+		for (u32 i = 0, c = queries.size(); i < c; ++i) {
+			lua_createtable(L, hits_count[i], 0);
+			for (u32 j = 0; j < hits_count[i]; ++j) {
+				LuaWrapper::push(L, hits[i * max_hits + j]);
+				lua_rawseti(L, -2, j + 1);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+
 	EntityPtr raycast(const Vec3& origin, const Vec3& dir, EntityPtr ignore_entity) override
 	{
 		RaycastHit hit;
@@ -2651,21 +3155,36 @@ struct PhysicsSceneImpl final : PhysicsScene
 				}
 			}
 			if (entity.index == (int)(intptr_t)actor->userData) return PxQueryHitType::eNONE;
-			return PxQueryHitType::eBLOCK;
+			return hit_type;
 		}
 
 
 		PxQueryHitType::Enum postFilter(const PxFilterData& filterData, const PxQueryHit& hit) override
 		{
-			return PxQueryHitType::eBLOCK;
+			return hit_type;
 		}
 
 		EntityPtr entity;
 		int layer;
 		PhysicsSceneImpl* scene;
+		// overlaps collect all touches
+		PxQueryHitType::Enum hit_type = PxQueryHitType::eBLOCK;
 	};
 
 
+	static void toRaycastHit(const PxLocationHit& hit, RaycastHit& result)
+	{
+		result.normal = fromPhysx(hit.normal);
+		result.position = fromPhysx(hit.position);
+		result.entity = INVALID_ENTITY;
+		if (hit.shape)
+		{
+			PxRigidActor* actor = hit.shape->getActor();
+			if (actor) result.entity = {(int)(intptr_t)actor->userData};
+		}
+	}
+
+
 	bool raycastEx(const Vec3& origin,
 		const Vec3& dir,
 		float distance,
@@ -2687,21 +3206,82 @@ struct PhysicsSceneImpl final : PhysicsScene
 		PxQueryFilterData filter_data;
 		filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
 		bool status = m_scene->raycast(physx_origin, unit_dir, max_distance, hit, flags, filter_data, &filter);
-		result.normal.x = hit.block.normal.x;
-		result.normal.y = hit.block.normal.y;
-		result.normal.z = hit.block.normal.z;
-		result.position.x = hit.block.position.x;
-		result.position.y = hit.block.position.y;
-		result.position.z = hit.block.position.z;
-		result.entity = INVALID_ENTITY;
-		if (hit.block.shape)
-		{
-			PxRigidActor* actor = hit.block.shape->getActor();
-			if (actor) result.entity = {(int)(intptr_t)actor->userData};
-		}
+		toRaycastHit(hit.block, result);
 		return status;
 	}
 
+
+	// scene queries only read the scene, so they can run on many workers at once, even while it simulates
+	void raycastBatch(Span<const RaycastQuery> queries, Span<RaycastHit> results) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(results.length() >= queries.length());
+		JobSystem::forEach(queries.length(), 0, [&](u32 from, u32 to){
+			PROFILE_BLOCK("raycast batch");
+			for (u32 i = from; i < to; ++i) {
+				const RaycastQuery& q = queries[i];
+				raycastEx(q.origin, q.dir, q.distance, results[i], q.ignored, q.layer);
+			}
+		});
+	}
+
+
+	void sweepSphereBatch(Span<const SweepQuery> queries, Span<RaycastHit> results) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(results.length() >= queries.length());
+		JobSystem::forEach(queries.length(), 0, [&](u32 from, u32 to){
+			PROFILE_BLOCK("sweep batch");
+			Filter filter;
+			filter.scene = this;
+			PxQueryFilterData filter_data;
+			filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
+			const PxHitFlags flags = PxHitFlag::ePOSITION | PxHitFlag::eNORMAL;
+			for (u32 i = from; i < to; ++i) {
+				const SweepQuery& q = queries[i];
+				filter.entity = q.ignored;
+				filter.layer = q.layer;
+				const PxSphereGeometry geom(q.radius);
+				const PxTransform pose(toPhysx(q.origin));
+				PxSweepBuffer hit;
+				m_scene->sweep(geom, pose, toPhysx(q.dir), q.distance, hit, flags, filter_data, &filter);
+				toRaycastHit(hit.block, results[i]);
+			}
+		});
+	}
+
+
+	void overlapSphereBatch(Span<const OverlapQuery> queries, u32 max_hits, Span<EntityRef> hits, Span<u32> hits_count) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(max_hits <= MAX_OVERLAP_HITS);
+		ASSERT(hits.length() >= queries.length() * max_hits);
+		ASSERT(hits_count.length() >= queries.length());
+		JobSystem::forEach(queries.length(), 0, [&](u32 from, u32 to){
+			PROFILE_BLOCK("overlap batch");
+			Filter filter;
+			filter.scene = this;
+			filter.hit_type = PxQueryHitType::eTOUCH;
+			PxQueryFilterData filter_data;
+			filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER | PxQueryFlag::eNO_BLOCK;
+			PxOverlapHit touches[MAX_OVERLAP_HITS];
+			for (u32 i = from; i < to; ++i) {
+				const OverlapQuery& q = queries[i];
+				filter.entity = q.ignored;
+				filter.layer = q.layer;
+				const PxSphereGeometry geom(q.radius);
+				const PxTransform pose(toPhysx(q.center));
+				PxOverlapBuffer buffer(touches, max_hits);
+				m_scene->overlap(geom, pose, buffer, filter_data, &filter);
+				const u32 count = buffer.getNbTouches();
+				for (u32 j = 0; j < count; ++j) {
+					hits[i * max_hits + j] = {(int)(intptr_t)touches[j].actor->userData};
+				}
+				hits_count[i] = count;
+			}
+		});
+	}
+
 	void onEntityDestroyed(EntityRef entity)
 	{
 		for (int i = 0, c = m_joints.size(); i < c; ++i)
@@ -2713,11 +3293,51 @@ struct PhysicsSceneImpl final : PhysicsScene
 		}
 	}
 
+	void onEntitiesActivated(Span<const EntityRef> entities, bool active)
+	{
+		PROFILE_FUNCTION();
+		bool is_finished = false;
+		for (EntityRef entity : entities) {
+			if (!m_universe.hasComponent(entity, RIGID_ACTOR_TYPE)) continue;
+			auto iter = m_actors.find(entity);
+			if (!iter.isValid()) continue;
+			RigidActor* actor = iter.value();
+			if (actor->is_active == active) continue;
+			actor->is_active = active;
+			if (!actor->physx_actor) continue;
+
+			if (!is_finished) {
+				// actors can not be added or removed while simulating
+				finishSimulation();
+				is_finished = true;
+			}
+			if (active) {
+				m_scene->addActor(*actor->physx_actor);
+				PxRigidDynamic* dynamic = actor->physx_actor->is<PxRigidDynamic>();
+				// respawned actors do not keep their old velocity
+				if (dynamic && actor->dynamic_type == DynamicType::DYNAMIC) {
+					dynamic->setLinearVelocity(PxVec3(0, 0, 0));
+					dynamic->setAngularVelocity(PxVec3(0, 0, 0));
+				}
+			}
+			else {
+				m_scene->removeActor(*actor->physx_actor);
+				m_moving_actors.erase(entity);
+			}
+		}
+	}
+
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		for (EntityRef entity : entities) {
+			if (!m_universe.getComponentsMask(entity).intersects(m_physics_cmps_mask)) continue;
+			onEntityMoved(entity);
+		}
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
-		const u64 cmp_mask = m_universe.getComponentsMask(entity);
-		if ((cmp_mask & m_physics_cmps_mask) == 0) return;
-		
 		if (m_universe.hasComponent(entity, CONTROLLER_TYPE)) {
 			int ctrl_idx = m_controllers.find(entity);
 			if (ctrl_idx >= 0)
@@ -2749,10 +3369,14 @@ struct PhysicsSceneImpl final : PhysicsScene
 			if (iter.isValid())
 			{
 				RigidActor* actor = iter.value();
-				if (actor->physx_actor && m_update_in_progress != actor)
+				// dynamic actors are the source of the transforms in updateDynamicActors
+				const bool is_from_physx = m_is_updating_dynamic_actors && actor->dynamic_type == DynamicType::DYNAMIC;
+				if (actor->physx_actor && !is_from_physx)
 				{
+					// teleported, do not blend it from the old position
+					m_moving_actors.erase(entity);
 					Transform trans = m_universe.getTransform(entity);
-					if (actor->dynamic_type == DynamicType::KINEMATIC)
+					if (actor->dynamic_type == DynamicType::KINEMATIC && actor->is_active)
 					{
 						auto* rigid_dynamic = (PxRigidDynamic*)actor->physx_actor;
 						rigid_dynamic->setKinematicTarget(toPhysx(trans.getRigidPart()));
@@ -2771,52 +3395,104 @@ struct PhysicsSceneImpl final : PhysicsScene
 	}
 
 
-	void heightmapLoaded(Heightfield& terrain)
+	// rows go along x and columns along z, heightmaps are stored transposed
+	static bool fillHeightfieldSamples(const Texture& heightmap, u32 first_row, u32 first_col, u32 rows, u32 cols, PxHeightFieldSample* out)
 	{
-		PROFILE_FUNCTION();
-		Array<PxHeightFieldSample> heights(m_allocator);
-
-		int width = terrain.m_heightmap->width;
-		int height = terrain.m_heightmap->height;
-		heights.resize(width * height);
-		if (terrain.m_heightmap->format == gpu::TextureFormat::R16)
+		const u32 stride = heightmap.height;
+		if (heightmap.format == gpu::TextureFormat::R16)
 		{
-			PROFILE_BLOCK("copyData");
-			const i16* LUMIX_RESTRICT data = (const i16*)terrain.m_heightmap->getData();
-			for (int j = 0; j < height; ++j)
+			const i16* LUMIX_RESTRICT data = (const i16*)heightmap.getData();
+			for (u32 r = 0; r < rows; ++r)
 			{
-				int idx = j * width;
-				for (int i = 0; i < width; ++i)
+				for (u32 c = 0; c < cols; ++c)
 				{
-					int idx2 = j + i * height;
-					heights[idx].height = PxI16((i32)data[idx2] - 0x7fff);
-					heights[idx].materialIndex0 = heights[idx].materialIndex1 = 0;
-					heights[idx].setTessFlag();
-					++idx;
+					PxHeightFieldSample& sample = out[r * cols + c];
+					sample.height = PxI16((i32)data[first_row + r + (first_col + c) * stride] - 0x7fff);
+					sample.materialIndex0 = sample.materialIndex1 = 0;
+					sample.setTessFlag();
 				}
 			}
+			return true;
 		}
-		else if (terrain.m_heightmap->format == gpu::TextureFormat::R8)
+		if (heightmap.format == gpu::TextureFormat::R8)
 		{
-			PROFILE_BLOCK("copyData");
-			const u8* data = terrain.m_heightmap->getData();
-			for (int j = 0; j < height; ++j)
+			const u8* LUMIX_RESTRICT data = heightmap.getData();
+			for (u32 r = 0; r < rows; ++r)
 			{
-				for (int i = 0; i < width; ++i)
+				for (u32 c = 0; c < cols; ++c)
 				{
-					int idx = i + j * width;
-					int idx2 = j + i * height;
-					heights[idx].height = PxI16((i32)data[idx2] - 0x7f);
-					heights[idx].materialIndex0 = heights[idx].materialIndex1 = 0;
-					heights[idx].setTessFlag();
+					PxHeightFieldSample& sample = out[r * cols + c];
+					sample.height = PxI16((i32)data[first_row + r + (first_col + c) * stride] - 0x7f);
+					sample.materialIndex0 = sample.materialIndex1 = 0;
+					sample.setTessFlag();
 				}
 			}
+			return true;
 		}
-		else {
-			logError("Physics") << "Unsupported physics heightmap format " << terrain.m_heightmap->getPath();
+		return false;
+	}
+
+
+	PxRigidActor* createHeightfieldActor(const Heightfield& terrain, PxHeightField* heightfield, u32 first_row, u32 first_col)
+	{
+		float height_scale = terrain.m_heightmap->format == gpu::TextureFormat::R16 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
+		PxHeightFieldGeometry hfGeom(heightfield,
+			PxMeshGeometryFlags(),
+			height_scale * terrain.m_y_scale,
+			terrain.m_xz_scale,
+			terrain.m_xz_scale);
+
+		PxTransform transform = toPhysx(m_universe.getTransform(terrain.m_entity).getRigidPart());
+		transform.p.y += terrain.m_y_scale * 0.5f;
+		transform = transform * PxTransform(PxVec3(first_row * terrain.m_xz_scale, 0, first_col * terrain.m_xz_scale));
+
+		PxRigidActor* actor = PxCreateStatic(*m_system->getPhysics(), transform, hfGeom, *m_default_material);
+		if (!actor)
+		{
+			logError("Physics") << "Could not create PhysX heightfield " << terrain.m_heightmap->getPath();
+			return nullptr;
+		}
+
+		actor->userData = (void*)(intptr_t)terrain.m_entity.index;
+		m_scene->addActor(*actor);
+		updateFilterData(actor, terrain.m_layer);
+		actor->setActorFlag(PxActorFlag::eVISUALIZATION, true);
+		return actor;
+	}
+
+
+	void heightmapLoaded(Heightfield& terrain)
+	{
+		PROFILE_FUNCTION();
+		if (terrain.m_actor)
+		{
+			PxRigidActor* actor = terrain.m_actor;
+			m_scene->removeActor(*actor);
+			actor->release();
+			terrain.m_actor = nullptr;
+		}
+
+		if (m_heightfield_streaming_radius > 0)
+		{
+			// tiles are rebuilt on demand
+			releaseHeightfieldTiles(terrain.m_entity);
 			return;
 		}
 
+		Array<PxHeightFieldSample> heights(m_allocator);
+
+		const u32 width = terrain.m_heightmap->width;
+		const u32 height = terrain.m_heightmap->height;
+		heights.resize(width * height);
+		{
+			PROFILE_BLOCK("copyData");
+			if (!fillHeightfieldSamples(*terrain.m_heightmap, 0, 0, height, width, heights.begin()))
+			{
+				logError("Physics") << "Unsupported physics heightmap format " << terrain.m_heightmap->getPath();
+				return;
+			}
+		}
+
 		{ // PROFILE_BLOCK scope
 			PROFILE_BLOCK("physX");
 			PxHeightFieldDesc hfDesc;
@@ -2828,47 +3504,208 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 			PxHeightField* heightfield = m_system->getCooking()->createHeightField(
 				hfDesc, m_system->getPhysics()->getPhysicsInsertionCallback());
-			float height_scale = terrain.m_heightmap->format == gpu::TextureFormat::R16 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
-			PxHeightFieldGeometry hfGeom(heightfield,
-				PxMeshGeometryFlags(),
-				height_scale * terrain.m_y_scale,
-				terrain.m_xz_scale,
-				terrain.m_xz_scale);
-			if (terrain.m_actor)
+			terrain.m_actor = createHeightfieldActor(terrain, heightfield, 0, 0);
+		}
+	}
+
+
+	static u64 getHeightfieldTileKey(EntityRef terrain, u32 row, u32 col)
+	{
+		return (u64(terrain.index) << 32) | (u64(row) << 16) | col;
+	}
+
+
+	void setHeightfieldStreaming(float radius) override
+	{
+		if (radius == m_heightfield_streaming_radius) return;
+		waitForHeightfieldTiles();
+		m_heightfield_streaming_radius = radius;
+		for (Heightfield& terrain : m_terrains)
+		{
+			if (terrain.m_heightmap && terrain.m_heightmap->isReady()) heightmapLoaded(terrain);
+			else releaseHeightfieldTiles(terrain.m_entity);
+		}
+	}
+
+
+	float getHeightfieldStreamingRadius() const override { return m_heightfield_streaming_radius; }
+
+
+	void setHeightfieldStreamingPoints(Span<const DVec3> points) override
+	{
+		m_heightfield_streaming_points.clear();
+		for (const DVec3& p : points) m_heightfield_streaming_points.push(p);
+	}
+
+
+	// jobs read heightmaps, so they must finish before a heightmap or its terrain goes away
+	void waitForHeightfieldTiles()
+	{
+		JobSystem::wait(m_heightfield_jobs_signal);
+		m_heightfield_jobs_signal = JobSystem::INVALID_HANDLE;
+		insertFinishedHeightfieldTiles();
+	}
+
+
+	// releases tiles touching samples [from_row, to_row] x [from_col, to_col]
+	void releaseHeightfieldTiles(EntityRef terrain, u32 from_row = 0, u32 to_row = 0xffFFffFF, u32 from_col = 0, u32 to_col = 0xffFFffFF)
+	{
+		waitForHeightfieldTiles();
+		Array<u64> released(getFrameAllocator());
+		for (auto iter = m_heightfield_tiles.begin(), end = m_heightfield_tiles.end(); iter != end; ++iter)
+		{
+			HeightfieldTile& tile = iter.value();
+			if (tile.terrain != terrain) continue;
+			const u32 first_row = u32((iter.key() >> 16) & 0xffFF) * HEIGHTFIELD_TILE_SIZE;
+			const u32 first_col = u32(iter.key() & 0xffFF) * HEIGHTFIELD_TILE_SIZE;
+			if (first_row > to_row || first_row + HEIGHTFIELD_TILE_SIZE < from_row) continue;
+			if (first_col > to_col || first_col + HEIGHTFIELD_TILE_SIZE < from_col) continue;
+			if (tile.actor)
 			{
-				PxRigidActor* actor = terrain.m_actor;
-				m_scene->removeActor(*actor);
-				actor->release();
-				terrain.m_actor = nullptr;
+				m_scene->removeActor(*tile.actor, false);
+				tile.actor->release();
 			}
+			released.push(iter.key());
+		}
+		for (u64 key : released) m_heightfield_tiles.erase(key);
+	}
+
 
-			PxTransform transform = toPhysx(m_universe.getTransform(terrain.m_entity).getRigidPart());
-			transform.p.y += terrain.m_y_scale * 0.5f;
+	void requestHeightfieldTile(const Heightfield& terrain, u32 row, u32 col)
+	{
+		const u64 key = getHeightfieldTileKey(terrain.m_entity, row, col);
+		auto iter = m_heightfield_tiles.find(key);
+		if (iter.isValid())
+		{
+			iter.value().last_needed_frame = m_heightfield_frame;
+			return;
+		}
 
-			PxRigidActor* actor = PxCreateStatic(*m_system->getPhysics(), transform, hfGeom, *m_default_material);
-			if (actor)
+		HeightfieldTile& tile = m_heightfield_tiles.insert(key, {});
+		tile.terrain = terrain.m_entity;
+		tile.last_needed_frame = m_heightfield_frame;
+
+		HeightfieldTileJob* job = LUMIX_NEW(m_allocator, HeightfieldTileJob)(m_allocator);
+		job->scene = this;
+		job->key = key;
+		job->heightmap = terrain.m_heightmap;
+		job->first_row = row * HEIGHTFIELD_TILE_SIZE;
+		job->first_col = col * HEIGHTFIELD_TILE_SIZE;
+		job->rows = minimum(HEIGHTFIELD_TILE_SIZE, terrain.m_heightmap->height - 1 - job->first_row) + 1;
+		job->cols = minimum(HEIGHTFIELD_TILE_SIZE, terrain.m_heightmap->width - 1 - job->first_col) + 1;
+		JobSystem::runEx(job, [](void* data){
+			PROFILE_BLOCK("cook heightfield tile");
+			HeightfieldTileJob* job = (HeightfieldTileJob*)data;
+			PhysicsSceneImpl* scene = job->scene;
+			Array<PxHeightFieldSample> heights(scene->m_allocator);
+			heights.resize(job->rows * job->cols);
+			job->success = fillHeightfieldSamples(*job->heightmap, job->first_row, job->first_col, job->rows, job->cols, heights.begin());
+			if (job->success)
 			{
-				actor->userData = (void*)(intptr_t)terrain.m_entity.index;
-				m_scene->addActor(*actor);
-				terrain.m_actor = actor;
+				PxHeightFieldDesc desc;
+				desc.format = PxHeightFieldFormat::eS16_TM;
+				desc.nbColumns = job->cols;
+				desc.nbRows = job->rows;
+				desc.samples.data = heights.begin();
+				desc.samples.stride = sizeof(PxHeightFieldSample);
+				job->success = scene->m_system->getCooking()->cookHeightField(desc, job->cooked);
+			}
+			MutexGuard lock(scene->m_heightfield_jobs_mutex);
+			scene->m_finished_heightfield_jobs.push(job);
+		}, &m_heightfield_jobs_signal, JobSystem::INVALID_HANDLE, JobSystem::ANY_WORKER, JobSystem::Priority::BACKGROUND);
+	}
 
-				PxFilterData data;
-				int terrain_layer = terrain.m_layer;
-				data.word0 = 1 << terrain_layer;
-				data.word1 = m_collision_filter[terrain_layer];
-				PxShape* shapes[8];
-				int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
-				for (int i = 0; i < shapes_count; ++i)
+
+	void insertFinishedHeightfieldTiles()
+	{
+		MutexGuard lock(m_heightfield_jobs_mutex);
+		for (HeightfieldTileJob* job : m_finished_heightfield_jobs)
+		{
+			auto iter = m_heightfield_tiles.find(job->key);
+			if (iter.isValid())
+			{
+				HeightfieldTile& tile = iter.value();
+				const Heightfield& terrain = m_terrains[tile.terrain];
+				tile.building = false;
+				if (job->success)
+				{
+					InputStream read_buffer(job->cooked.data, job->cooked.size);
+					PxHeightField* heightfield = m_system->getPhysics()->createHeightField(read_buffer);
+					if (heightfield) tile.actor = createHeightfieldActor(terrain, heightfield, job->first_row, job->first_col);
+				}
+				else
 				{
-					shapes[i]->setSimulationFilterData(data);
+					logError("Physics") << "Failed to cook heightfield tile of " << terrain.m_heightmap->getPath();
 				}
-				terrain.m_actor->setActorFlag(PxActorFlag::eVISUALIZATION, true);
 			}
-			else
+			LUMIX_DELETE(m_allocator, job);
+		}
+		m_finished_heightfield_jobs.clear();
+	}
+
+
+	// called at the frame boundary, while the scene is not simulating
+	void updateHeightfieldTiles()
+	{
+		if (m_heightfield_streaming_radius <= 0 || m_terrains.size() == 0) return;
+
+		PROFILE_FUNCTION();
+		insertFinishedHeightfieldTiles();
+
+		Array<DVec3> points(getFrameAllocator());
+		for (const DVec3& p : m_heightfield_streaming_points) points.push(p);
+		for (auto& controller : m_controllers) points.push(m_universe.getPosition(controller.m_entity));
+		for (auto iter = m_vehicles.begin(), end = m_vehicles.end(); iter != end; ++iter) points.push(m_universe.getPosition(iter.key()));
+		// sleeping actors are fine without tiles, removing a tile does not wake them up
+		if (m_is_game_running)
+		{
+			forEachActiveActor([&](EntityRef, PxRigidActor* px_actor){
+				points.push(DVec3(fromPhysx(px_actor->getGlobalPose().p)));
+			});
+		}
+
+		++m_heightfield_frame;
+		const double radius = m_heightfield_streaming_radius;
+		for (const Heightfield& terrain : m_terrains)
+		{
+			if (!terrain.m_heightmap || !terrain.m_heightmap->isReady()) continue;
+			const Texture& heightmap = *terrain.m_heightmap;
+			if (heightmap.width < 2 || heightmap.height < 2) continue;
+
+			const i32 tile_rows = i32((heightmap.height - 2) / HEIGHTFIELD_TILE_SIZE + 1);
+			const i32 tile_cols = i32((heightmap.width - 2) / HEIGHTFIELD_TILE_SIZE + 1);
+			const double tile_size = HEIGHTFIELD_TILE_SIZE * terrain.m_xz_scale;
+			const RigidTransform inv_terrain = m_universe.getTransform(terrain.m_entity).getRigidPart().inverted();
+			for (const DVec3& p : points)
+			{
+				const DVec3 local = inv_terrain.rot.rotate(p) + inv_terrain.pos;
+				const i32 from_row = maximum(0, i32(floor((local.x - radius) / tile_size)));
+				const i32 to_row = minimum(tile_rows - 1, i32(floor((local.x + radius) / tile_size)));
+				const i32 from_col = maximum(0, i32(floor((local.z - radius) / tile_size)));
+				const i32 to_col = minimum(tile_cols - 1, i32(floor((local.z + radius) / tile_size)));
+				for (i32 row = from_row; row <= to_row; ++row)
+				{
+					for (i32 col = from_col; col <= to_col; ++col)
+					{
+						requestHeightfieldTile(terrain, row, col);
+					}
+				}
+			}
+		}
+
+		Array<u64> released(getFrameAllocator());
+		for (auto iter = m_heightfield_tiles.begin(), end = m_heightfield_tiles.end(); iter != end; ++iter)
+		{
+			HeightfieldTile& tile = iter.value();
+			if (tile.building || tile.last_needed_frame == m_heightfield_frame) continue;
+			if (tile.actor)
 			{
-				logError("Physics") << "Could not create PhysX heightfield " << terrain.m_heightmap->getPath();
+				m_scene->removeActor(*tile.actor, false);
+				tile.actor->release();
 			}
+			released.push(iter.key());
 		}
+		for (u64 key : released) m_heightfield_tiles.erase(key);
 	}
 
 
@@ -2996,18 +3833,11 @@ struct PhysicsSceneImpl final : PhysicsScene
 
 		for (auto& terrain : m_terrains)
 		{
-			if (!terrain.m_actor) continue;
-
-			PxFilterData data;
-			int terrain_layer = terrain.m_layer;
-			data.word0 = 1 << terrain_layer;
-			data.word1 = m_collision_filter[terrain_layer];
-			PxShape* shapes[8];
-			int shapes_count = terrain.m_actor->getShapes(shapes, lengthOf(shapes));
-			for (int i = 0; i < shapes_count; ++i)
-			{
-				shapes[i]->setSimulationFilterData(data);
-			}
+			if (terrain.m_actor) updateFilterData(terrain.m_actor, terrain.m_layer);
+		}
+		for (const HeightfieldTile& tile : m_heightfield_tiles)
+		{
+			if (tile.actor) updateFilterData(tile.actor, m_terrains[tile.terrain].m_layer);
 		}
 	}
 
@@ -3283,14 +4113,7 @@ struct PhysicsSceneImpl final : PhysicsScene
 		if (actor->dynamic_type == new_value) return;
 
 		actor->dynamic_type = new_value;
-		if (new_value == DynamicType::DYNAMIC)
-		{
-			m_dynamic_actors.push(actor);
-		}
-		else
-		{
-			m_dynamic_actors.swapAndPopItem(actor);
-		}
+		m_moving_actors.erase(entity);
 		if (!actor->physx_actor) return;
 
 		PxTransform transform = toPhysx(m_universe.getTransform(actor->entity).getRigidPart());
@@ -3801,9 +4624,9 @@ struct PhysicsSceneImpl final : PhysicsScene
 			serializer.read(entity);
 			entity = entity_map.get(entity);
 			RigidActor* actor = LUMIX_NEW(m_allocator, RigidActor)(*this, entity);
+			actor->is_active = m_universe.isActive(entity);
 			serializer.read(actor->dynamic_type);
 			serializer.read(actor->is_trigger);
-			if (actor->dynamic_type == DynamicType::DYNAMIC) m_dynamic_actors.push(actor);
 			m_actors.insert(actor->entity, actor);
 			actor->layer = 0;
 			serializer.read(actor->layer);
@@ -4270,18 +5093,39 @@ struct PhysicsSceneImpl final : PhysicsScene
 	AssociativeArray<EntityRef, Joint> m_joints;
 	AssociativeArray<EntityRef, Controller> m_controllers;
 	HashMap<EntityRef, Heightfield> m_terrains;
+	HashMap<u64, HeightfieldTile> m_heightfield_tiles;
+	Array<DVec3> m_heightfield_streaming_points;
+	float m_heightfield_streaming_radius = 0;
+	u32 m_heightfield_frame = 0;
+	JobSystem::SignalHandle m_heightfield_jobs_signal = JobSystem::INVALID_HANDLE;
+	Mutex m_heightfield_jobs_mutex;
+	Array<HeightfieldTileJob*> m_finished_heightfield_jobs;
 	HashMap<EntityRef, Vehicle> m_vehicles;
 	HashMap<EntityRef, Wheel> m_wheels;
 	PxVehicleDrivableSurfaceToTireFrictionPairs* m_vehicle_frictions;
 	PxBatchQuery* m_vehicle_batch_query;
 	u8 m_vehicle_query_mem[sizeof(PxRaycastQueryResult) * 64 + sizeof(PxRaycastHit) * 64];
 	PxRaycastQueryResult* m_vehicle_results;
-	u64 m_physics_cmps_mask;
+	ComponentMask m_physics_cmps_mask;
 
-	Array<RigidActor*> m_dynamic_actors;
-	RigidActor* m_update_in_progress;
+	bool m_is_updating_dynamic_actors;
 	DelegateList<void(const ContactData&)> m_contact_callbacks;
+	// filled by PhysX callbacks during fetchResults
+	Array<ContactData> m_contacts;
+	Array<TriggerEvent> m_triggers;
+	Array<ContactData> m_frame_contacts;
+	u32 m_contact_layers_mask = 0xffFFffFF;
+	float m_contact_min_impulse = 0;
 	bool m_is_game_running;
+	bool m_is_simulating = false;
+	bool m_needs_apply = false;
+	bool m_overlap_simulation = true;
+	// 0 - variable step
+	float m_fixed_timestep = 0;
+	u32 m_max_substeps = 4;
+	float m_accumulator = 0;
+	u32 m_step_counter = 0;
+	HashMap<EntityRef, MovingActor> m_moving_actors;
 	bool m_is_updating_ragdoll;
 	u32 m_debug_visualization_flags;
 	u32 m_collision_filter[32];
@@ -4294,8 +5138,9 @@ struct PhysicsSceneImpl final : PhysicsScene
 PhysicsScene* PhysicsScene::create(PhysicsSystem& system, Universe& context, Engine& engine, IAllocator& allocator)
 {
 	PhysicsSceneImpl* impl = LUMIX_NEW(allocator, PhysicsSceneImpl)(context, allocator);
-	impl->m_universe.entityTransformed().bind<&PhysicsSceneImpl::onEntityMoved>(impl);
+	impl->m_universe.entitiesTransformed().bind<&PhysicsSceneImpl::onEntitiesMoved>(impl);
 	impl->m_universe.entityDestroyed().bind<&PhysicsSceneImpl::onEntityDestroyed>(impl);
+	impl->m_universe.entitiesActivated().bind<&PhysicsSceneImpl::onEntitiesActivated>(impl);
 	impl->m_engine = &engine;
 	PxSceneDesc sceneDesc(system.getPhysics()->getTolerancesScale());
 	sceneDesc.gravity = PxVec3(0.0f, -9.8f, 0.0f);
@@ -4303,6 +5148,7 @@ PhysicsScene* PhysicsScene::create(PhysicsSystem& system, Universe& context, Eng
 
 	sceneDesc.filterShader = impl->filterShader;
 	sceneDesc.simulationEventCallback = &impl->m_contact_callback;
+	sceneDesc.flags |= PxSceneFlag::eENABLE_ACTIVE_ACTORS | PxSceneFlag::eEXCLUDE_KINEMATICS_FROM_ACTIVE_ACTORS;
 
 	impl->m_scene = system.getPhysics()->createScene(sceneDesc);
 	if (!impl->m_scene)
@@ -4372,13 +5218,13 @@ void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor)
 {
 	if (physx_actor)
 	{
-		scene.m_scene->removeActor(*physx_actor);
+		if (is_active) scene.m_scene->removeActor(*physx_actor);
 		physx_actor->release();
 	}
 	physx_actor = actor;
 	if (actor)
 	{
-		scene.m_scene->addActor(*actor);
+		if (is_active) scene.m_scene->addActor(*actor);
 		actor->userData = (void*)(intptr_t)entity.index;
 		scene.updateFilterData(actor, layer);
 		scene.setIsTrigger({entity.index}, is_trigger);
@@ -4431,6 +5277,12 @@ void Heightfield::heightmapLoaded(Resource::State, Resource::State new_state, Re
 }
 
 
+// called through LuaJIT FFI, see Lumix.FFI
+static void FFI_getActorVelocity(PhysicsScene* scene, i32 entity, Vec3* out) { *out = scene->getActorVelocity({entity}); }
+static void FFI_applyForceToActor(PhysicsScene* scene, i32 entity, float x, float y, float z) { scene->applyForceToActor({entity}, Vec3(x, y, z)); }
+static void FFI_applyImpulseToActor(PhysicsScene* scene, i32 entity, float x, float y, float z) { scene->applyImpulseToActor({entity}, Vec3(x, y, z)); }
+
+
 void PhysicsScene::registerLuaAPI(lua_State* L)
 {
 #define REGISTER_FUNCTION(name) \
@@ -4451,8 +5303,33 @@ void PhysicsScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(addForceAtPos);
 
 	LuaWrapper::createSystemFunction(L, "Physics", "raycast", &PhysicsSceneImpl::LUA_raycast);
+	LuaWrapper::createSystemFunction(L, "Physics", "raycastBatch", &PhysicsSceneImpl::LUA_raycastBatch);
+	LuaWrapper::createSystemFunction(L, "Physics", "sweepSphereBatch", &PhysicsSceneImpl::LUA_sweepSphereBatch);
+	LuaWrapper::createSystemFunction(L, "Physics", "overlapSphereBatch", &PhysicsSceneImpl::LUA_overlapSphereBatch);
 
 #undef REGISTER_FUNCTION
+
+	LuaWrapper::createSystemVariable(L, "Physics", "ffi_getActorVelocity", (void*)&FFI_getActorVelocity);
+	LuaWrapper::createSystemVariable(L, "Physics", "ffi_applyForceToActor", (void*)&FFI_applyForceToActor);
+	LuaWrapper::createSystemVariable(L, "Physics", "ffi_applyImpulseToActor", (void*)&FFI_applyImpulseToActor);
+
+	// scene is the physics scene lightuserdata
+	const char* ffi_src = R"#(
+		if Lumix.FFI then
+			local ffi = require "ffi"
+			local getActorVelocity = ffi.cast("void (*)(void*, int, LumixVec3*)", Physics.ffi_getActorVelocity)
+			Lumix.FFI.applyForceToActor = ffi.cast("void (*)(void*, int, float, float, float)", Physics.ffi_applyForceToActor)
+			Lumix.FFI.applyImpulseToActor = ffi.cast("void (*)(void*, int, float, float, float)", Physics.ffi_applyImpulseToActor)
+			function Lumix.FFI.getActorVelocity(scene, entity)
+				local res = ffi.new("LumixVec3")
+				getActorVelocity(scene, entity, res)
+				return res
+			end
+		end
+	)#";
+	if (!LuaWrapper::execute(L, Span(ffi_src, stringLength(ffi_src)), "physics ffi", 0)) {
+		logError("Physics") << "Failed to init FFI API";
+	}
 }
 
 
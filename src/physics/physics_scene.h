@@ -48,6 +48,37 @@ struct RaycastHit
 };
 
 
+// layer < 0 hits every layer
+struct RaycastQuery
+{
+	Vec3 origin;
+	Vec3 dir;
+	float distance;
+	EntityPtr ignored;
+	int layer;
+};
+
+
+struct SweepQuery
+{
+	Vec3 origin;
+	Vec3 dir;
+	float distance;
+	float radius;
+	EntityPtr ignored;
+	int layer;
+};
+
+
+struct OverlapQuery
+{
+	Vec3 center;
+	float radius;
+	EntityPtr ignored;
+	int layer;
+};
+
+
 struct LUMIX_PHYSICS_API PhysicsScene : IScene
 {
 	enum class D6Motion : int
@@ -78,6 +109,9 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 	struct ContactData
 	{
 		Vec3 position;
+		Vec3 normal;
+		// sum of impulses of all contact points
+		float impulse;
 		EntityRef e1;
 		EntityRef e2;
 	};
@@ -88,13 +122,34 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 	static void destroy(PhysicsScene* scene);
 	static void registerLuaAPI(lua_State* L);
 
+	static constexpr u32 MAX_OVERLAP_HITS = 64;
+
 	virtual ~PhysicsScene() {}
 	virtual void render() = 0;
+	// simulation is kicked in update and its results are fetched in lateUpdate, so it runs in parallel
+	// with other scenes; until lateUpdate, queries see the previous step and actor changes are buffered by PhysX
+	virtual void setOverlapSimulation(bool enable) = 0;
+	virtual bool isOverlapSimulation() const = 0;
+	// step > 0 simulates in fixed steps, at most max_substeps per frame, and dynamic actors
+	// are interpolated between the last two steps; step == 0 simulates once per frame
+	virtual void setFixedTimestep(float step, u32 max_substeps) = 0;
+	virtual float getFixedTimestep() const = 0;
+	virtual u32 getMaxSubsteps() const = 0;
 	virtual EntityPtr raycast(const Vec3& origin, const Vec3& dir, EntityPtr ignore_entity) = 0;
 	virtual bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, EntityPtr ignored, int layer) = 0;
+	// batches run in parallel on workers, results[i] belongs to queries[i], entity is invalid if nothing is hit
+	virtual void raycastBatch(Span<const RaycastQuery> queries, Span<RaycastHit> results) = 0;
+	virtual void sweepSphereBatch(Span<const SweepQuery> queries, Span<RaycastHit> results) = 0;
+	// hits of queries[i] are hits[i * max_hits, i * max_hits + hits_count[i]), max_hits is at most MAX_OVERLAP_HITS
+	virtual void overlapSphereBatch(Span<const OverlapQuery> queries, u32 max_hits, Span<EntityRef> hits, Span<u32> hits_count) = 0;
 	virtual PhysicsSystem& getSystem() const = 0;
 
+	// contacts and triggers are collected during the step and dispatched after fetchResults, outside of PhysX callbacks
 	virtual DelegateList<void(const ContactData&)>& onContact() = 0;
+	// contacts of the last applied step, valid until the next one
+	virtual Span<const ContactData> getContacts() const = 0;
+	// contact is reported if any of the actors is in layers_mask and its impulse is at least min_impulse
+	virtual void setContactFilter(u32 layers_mask, float min_impulse) = 0;
 	virtual void setActorLayer(EntityRef entity, u32 layer) = 0;
 	virtual u32 getActorLayer(EntityRef entity) = 0;
 	virtual bool getIsTrigger(EntityRef entity) = 0;
@@ -111,6 +166,12 @@ struct LUMIX_PHYSICS_API PhysicsScene : IScene
 	virtual void setHeightmapYScale(EntityRef entity, float scale) = 0;
 	virtual u32 getHeightfieldLayer(EntityRef entity) = 0;
 	virtual void setHeightfieldLayer(EntityRef entity, u32 layer) = 0;
+	// radius > 0 splits heightfields into tiles which exist only in the radius around streaming points,
+	// controllers, vehicles and awake actors; tiles are cooked on workers and added at the start of update
+	virtual void setHeightfieldStreaming(float radius) = 0;
+	virtual float getHeightfieldStreamingRadius() const = 0;
+	// e.g. cameras, replaced every call
+	virtual void setHeightfieldStreamingPoints(Span<const DVec3> points) = 0;
 	virtual void updateHeighfieldData(EntityRef entity,
 		int x,
 		int y,
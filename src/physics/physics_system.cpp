@@ -203,15 +203,20 @@ namespace Lumix
 	struct PhysicsSystemImpl final : PhysicsSystem
 	{
 		explicit PhysicsSystemImpl(Engine& engine)
-			: m_allocator(engine.getAllocator())
+			: m_allocator(engine.getAllocator(), "physics")
 			, m_engine(engine)
-			, m_manager(*this, engine.getAllocator())
+			, m_manager(*this, m_allocator)
 			, m_physx_allocator(m_allocator)
 		{
 			registerProperties(engine.getAllocator());
 			m_manager.create(PhysicsGeometry::TYPE, engine.getResourceManager());
 			PhysicsScene::registerLuaAPI(m_engine.getState());
+		}
+
 
+		// PhysX does not use any engine state, so it's initialized in parallel with other plugins
+		void init() override
+		{
 			m_foundation = PxCreateFoundation(PX_PHYSICS_VERSION, m_physx_allocator, m_error_callback);
 
 			m_physics = PxCreatePhysics(PX_PHYSICS_VERSION, *m_foundation, physx::PxTolerancesScale());
@@ -230,6 +235,9 @@ namespace Lumix
 		}
 
 
+		bool isInitThreadSafe() const override { return true; }
+
+
 		~PhysicsSystemImpl()
 		{
 			physx::PxCloseVehicleSDK();
@@ -276,7 +284,7 @@ namespace Lumix
 			return false;
 		}
 
-		IAllocator& m_allocator;
+		TagAllocator m_allocator;
 		physx::PxPhysics* m_physics;
 		physx::PxFoundation* m_foundation;
 		physx::PxControllerManager* m_controller_manager;
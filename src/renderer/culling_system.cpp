@@ -12,6 +12,17 @@
 #include "engine/profiler.h"
 #include "engine/simd.h"
 
+#if defined __x86_64__ || defined _M_X64
+	#define LUMIX_CULLING_AVX2
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define LUMIX_AVX2_TARGET
+	#else
+		#define LUMIX_AVX2_TARGET __attribute__((target("avx2,fma")))
+	#endif
+#endif
+
 
 namespace Lumix
 {
@@ -51,17 +62,241 @@ struct alignas(4096) CellPage {
 		DVec3 origin;
 		CellIndices indices;
 		int count = 0;
+		i32 node = -1; // only used by octree
 	} header;
 
-	enum { MAX_COUNT = (PageAllocator::PAGE_SIZE - sizeof(header)) / (sizeof(Sphere) + sizeof(EntityPtr)) };
+	// multiple of 8 so culling kernels can always process whole groups of spheres
+	enum { MAX_COUNT = ((PageAllocator::PAGE_SIZE - sizeof(header)) / (4 * sizeof(float) + sizeof(EntityPtr))) & ~7 };
 
-	Sphere spheres[MAX_COUNT];
+	// positions are relative to header.origin
+	float xs[MAX_COUNT];
+	float ys[MAX_COUNT];
+	float zs[MAX_COUNT];
+	float radii[MAX_COUNT];
 	EntityPtr entities[MAX_COUNT];
 };
 
 static_assert(sizeof(CellPage) == PageAllocator::PAGE_SIZE);
 
 
+static u32 firstBit(u32 mask) {
+	ASSERT(mask != 0);
+	#ifdef _WIN32
+		unsigned long res;
+		_BitScanForward(&res, mask);
+		return res;
+	#else
+		return __builtin_ctz(mask);
+	#endif
+}
+
+
+// bit `j` of visible[i] is set if sphere `i * 8 + j` is not outside any plane
+static void cullSpheres(const CellPage& cell, const Frustum& frustum, u8* LUMIX_RESTRICT visible)
+{
+	const u32 count = cell.header.count;
+	for (u32 i = 0; i < count; i += 8) {
+		const float4 x0 = f4LoadUnaligned(&cell.xs[i]);
+		const float4 y0 = f4LoadUnaligned(&cell.ys[i]);
+		const float4 z0 = f4LoadUnaligned(&cell.zs[i]);
+		const float4 r0 = f4LoadUnaligned(&cell.radii[i]);
+		const float4 x1 = f4LoadUnaligned(&cell.xs[i + 4]);
+		const float4 y1 = f4LoadUnaligned(&cell.ys[i + 4]);
+		const float4 z1 = f4LoadUnaligned(&cell.zs[i + 4]);
+		const float4 r1 = f4LoadUnaligned(&cell.radii[i + 4]);
+		int culled = 0;
+		for (u32 p = 0; p < (u32)Frustum::Planes::COUNT; ++p) {
+			const float4 px = f4Splat(frustum.xs[p]);
+			const float4 py = f4Splat(frustum.ys[p]);
+			const float4 pz = f4Splat(frustum.zs[p]);
+			const float4 pd = f4Splat(frustum.ds[p]);
+
+			float4 t = f4Add(f4Mul(x0, px), f4Mul(y0, py));
+			t = f4Add(t, f4Mul(z0, pz));
+			t = f4Add(t, f4Add(pd, r0));
+			culled |= f4MoveMask(t);
+
+			t = f4Add(f4Mul(x1, px), f4Mul(y1, py));
+			t = f4Add(t, f4Mul(z1, pz));
+			t = f4Add(t, f4Add(pd, r1));
+			culled |= f4MoveMask(t) << 4;
+		}
+		visible[i / 8] = u8(~culled);
+	}
+}
+
+
+#ifdef LUMIX_CULLING_AVX2
+	static bool cpuSupportsAVX2()
+	{
+		#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			const bool osxsave = info[2] & (1 << 27);
+			const bool fma = info[2] & (1 << 12);
+			if (!osxsave || !fma) return false;
+			// OS must preserve ymm registers
+			if ((_xgetbv(0) & 6) != 6) return false;
+			__cpuidex(info, 7, 0);
+			return info[1] & (1 << 5);
+		#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		#endif
+	}
+
+
+	LUMIX_AVX2_TARGET static void cullSpheresAVX2(const CellPage& cell, const Frustum& frustum, u8* LUMIX_RESTRICT visible)
+	{
+		const u32 count = cell.header.count;
+		for (u32 i = 0; i < count; i += 8) {
+			const __m256 x = _mm256_loadu_ps(&cell.xs[i]);
+			const __m256 y = _mm256_loadu_ps(&cell.ys[i]);
+			const __m256 z = _mm256_loadu_ps(&cell.zs[i]);
+			const __m256 r = _mm256_loadu_ps(&cell.radii[i]);
+			// sign bit is set in lanes outside of any plane
+			__m256 culled = _mm256_setzero_ps();
+			for (u32 p = 0; p < (u32)Frustum::Planes::COUNT; ++p) {
+				__m256 t = _mm256_add_ps(_mm256_broadcast_ss(&frustum.ds[p]), r);
+				t = _mm256_fmadd_ps(x, _mm256_broadcast_ss(&frustum.xs[p]), t);
+				t = _mm256_fmadd_ps(y, _mm256_broadcast_ss(&frustum.ys[p]), t);
+				t = _mm256_fmadd_ps(z, _mm256_broadcast_ss(&frustum.zs[p]), t);
+				culled = _mm256_or_ps(culled, t);
+			}
+			visible[i / 8] = u8(~_mm256_movemask_ps(culled));
+		}
+	}
+#endif
+
+
+static void cullCell(const CellPage& cell
+	, const Frustum& frustum
+	, bool use_avx2
+	, CullResult*& results
+	, PagedList<CullResult>& list)
+{
+	PROFILE_FUNCTION();
+	const u32 count = cell.header.count;
+	Profiler::pushInt("objects", count);
+
+	u8 visible[CellPage::MAX_COUNT / 8];
+	#ifdef LUMIX_CULLING_AVX2
+		if (use_avx2) cullSpheresAVX2(cell, frustum, visible);
+		else cullSpheres(cell, frustum, visible);
+	#else
+		cullSpheres(cell, frustum, visible);
+	#endif
+
+	const u32 groups = (count + 7) / 8;
+	// lanes past `count` contain garbage
+	if (count % 8) visible[groups - 1] &= (1 << (count % 8)) - 1;
+
+	const EntityPtr* LUMIX_RESTRICT sphere_to_entity_map = cell.entities;
+	int cursor = results->header.count;
+	for (u32 g = 0; g < groups; ++g) {
+		u32 mask = visible[g];
+		while (mask) {
+			const u32 i = g * 8 + firstBit(mask);
+			mask &= mask - 1;
+
+			if(cursor == lengthOf(results->entities)) {
+				results->header.count = cursor;
+				results = list.push();
+				cursor = 0;
+			}
+
+			results->entities[cursor] = (EntityRef)sphere_to_entity_map[i];
+			++cursor;
+		}
+	}
+	results->header.count = cursor;
+}
+
+
+// cell is completely inside the frustum
+static void copyCell(const CellPage& cell, CullResult*& result, PagedList<CullResult>& list)
+{
+	int to_cpy = cell.header.count;
+	int src_offset = 0;
+	while (to_cpy > 0) {
+		if(result->header.count == lengthOf(result->entities)) {
+			result = list.push();
+		}
+		const int rem_space = lengthOf(result->entities) - result->header.count;
+		const int step = minimum(to_cpy, rem_space);
+		memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
+		src_offset += step;
+		result->header.count += step;
+		to_cpy -= step;
+	}
+}
+
+
+static bool rayIntersectsAABB(const DVec3& origin, const Vec3& inv_dir, const DVec3& min, const DVec3& max)
+{
+	double t0 = 0;
+	double t1 = DBL_MAX;
+	auto slab = [&](double o, double inv_d, double lo, double hi){
+		double a = (lo - o) * inv_d;
+		double b = (hi - o) * inv_d;
+		if (a > b) {
+			const double tmp = a;
+			a = b;
+			b = tmp;
+		}
+		t0 = a > t0 ? a : t0;
+		t1 = b < t1 ? b : t1;
+	};
+	slab(origin.x, inv_dir.x, min.x, max.x);
+	slab(origin.y, inv_dir.y, min.y, max.y);
+	slab(origin.z, inv_dir.z, min.z, max.z);
+	return t0 <= t1;
+}
+
+
+// `origin` is relative to the page, `dir` is normalized
+static void castRayPage(const CellPage& page, const Vec3& origin, const Vec3& dir, CullResult*& result, PagedList<CullResult>& list)
+{
+	for (i32 i = 0, c = page.header.count; i < c; ++i) {
+		const Vec3 rel = Vec3(page.xs[i], page.ys[i], page.zs[i]) - origin;
+		const float r2 = page.radii[i] * page.radii[i];
+		const float tca = dotProduct(rel, dir);
+		const float dist2 = dotProduct(rel, rel);
+		if (tca < 0 && dist2 > r2) continue;
+		if (dist2 - tca * tca > r2) continue;
+
+		if (!result) result = list.push();
+		if (result->header.count == lengthOf(result->entities)) result = list.push();
+		result->entities[result->header.count] = (EntityRef)page.entities[i];
+		++result->header.count;
+	}
+}
+
+
+static CellPage& getCell(const EntityPtr* slot)
+{
+	const intptr_t ptr = (intptr_t)slot;
+	const intptr_t page_ptr = ptr - (ptr % PageAllocator::PAGE_SIZE);
+	return *(CellPage*)page_ptr;
+}
+
+
+// re-adds everything to `dst`, used to switch backends
+static void transfer(const Array<EntityPtr*>& entity_to_cell, CullingSystem& dst)
+{
+	for (i32 i = 0, c = entity_to_cell.size(); i < c; ++i) {
+		const EntityPtr* slot = entity_to_cell[i];
+		if (!slot) continue;
+		const CellPage& cell = getCell(slot);
+		const u32 idx = u32(slot - cell.entities);
+		const DVec3 pos = cell.header.origin + Vec3(cell.xs[idx], cell.ys[idx], cell.zs[idx]);
+		dst.add((EntityRef)*slot, cell.header.indices.type, pos, cell.radii[idx]);
+	}
+}
+
+
 struct CullingSystemImpl final : CullingSystem
 {
 	CullingSystemImpl(IAllocator& allocator, PageAllocator& page_allocator) 
@@ -72,6 +307,9 @@ struct CullingSystemImpl final : CullingSystem
 		, m_cell_size(300.0f)
 		, m_page_allocator(page_allocator)
 	{
+		#ifdef LUMIX_CULLING_AVX2
+			m_use_avx2 = cpuSupportsAVX2();
+		#endif
 	}
 	
 	~CullingSystemImpl()
@@ -79,16 +317,25 @@ struct CullingSystemImpl final : CullingSystem
 		clear();
 	}
 	
-	Sphere* addToCell(CellPage& cell, EntityPtr entity, const DVec3& pos, float radius)
+	static void setSphere(CellPage& cell, u32 idx, const Vec3& rel_pos, float radius)
+	{
+		cell.xs[idx] = rel_pos.x;
+		cell.ys[idx] = rel_pos.y;
+		cell.zs[idx] = rel_pos.z;
+		cell.radii[idx] = radius;
+	}
+
+
+	EntityPtr* addToCell(CellPage& cell, EntityPtr entity, const DVec3& pos, float radius)
 	{
 		const Vec3 rel_pos = (pos - cell.header.origin).toFloat();
 		const int count = cell.header.count;
 
 		if(count < CellPage::MAX_COUNT - 1) {
-			cell.spheres[count] = {rel_pos, radius};
+			setSphere(cell, count, rel_pos, radius);
 			cell.entities[count] = entity;
 			++cell.header.count;
-			return &cell.spheres[count];
+			return &cell.entities[count];
 		}
 
 		void* mem = m_page_allocator.allocate(true);
@@ -104,11 +351,11 @@ struct CullingSystemImpl final : CullingSystem
 		m_cells.push(new_cell);
 		if(!new_cell->header.prev) m_cell_map[new_cell->header.indices] = new_cell;
 
-		new_cell->spheres[0] = {rel_pos, radius};
+		setSphere(*new_cell, 0, rel_pos, radius);
 		new_cell->entities[0] = entity;
 		new_cell->header.count = 1;
 
-		return &new_cell->spheres[0];
+		return &new_cell->entities[0];
 	}
 
 
@@ -136,8 +383,7 @@ struct CullingSystemImpl final : CullingSystem
 		}
 
 		CellPage& cell = *iter.value();
-		Sphere* sphere = addToCell(cell, entity, pos, radius);
-		m_entity_to_cell[entity.index] = sphere;
+		m_entity_to_cell[entity.index] = addToCell(cell, entity, pos, radius);
 		return;
 	}
 
@@ -146,10 +392,10 @@ struct CullingSystemImpl final : CullingSystem
 	{
 		if (m_entity_to_cell.size() <= entity.index) return;
 		
-		const Sphere* sphere = m_entity_to_cell[entity.index];
-		if (!sphere) return;
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		if (!slot) return;
 
-		CellPage& cell = getCell(*sphere);
+		CellPage& cell = getCell(slot);
 		if (cell.header.count == 1) {
 			if (!cell.header.prev) {
 				if (!cell.header.next) m_cell_map.erase(cell.header.indices);
@@ -162,69 +408,120 @@ struct CullingSystemImpl final : CullingSystem
 			m_page_allocator.deallocate(&cell, true);
 		}
 		else {
-			const int idx = int(sphere - cell.spheres);
-			EntityPtr last = cell.entities[cell.header.count - 1];
-			cell.entities[idx] = cell.entities[cell.header.count - 1];
-			cell.spheres[idx] = cell.spheres[cell.header.count - 1];
-			m_entity_to_cell[last.index] = &cell.spheres[idx];
+			const int idx = int(slot - cell.entities);
+			const int last_idx = cell.header.count - 1;
+			const EntityPtr last = cell.entities[last_idx];
+			cell.entities[idx] = last;
+			cell.xs[idx] = cell.xs[last_idx];
+			cell.ys[idx] = cell.ys[last_idx];
+			cell.zs[idx] = cell.zs[last_idx];
+			cell.radii[idx] = cell.radii[last_idx];
+			m_entity_to_cell[last.index] = &cell.entities[idx];
 			--cell.header.count;
 		}
 		m_entity_to_cell[entity.index] = nullptr;
 	}
 
 
-	CellPage& getCell(const Sphere& sphere) const
-	{
-		const intptr_t ptr = (intptr_t)&sphere;
-		const intptr_t page_ptr = ptr - (ptr % 16384);
-		return *(CellPage*)page_ptr;
-	}
-
-
 	void setPosition(EntityRef entity, const DVec3& pos) override
 	{
-		Sphere* sphere = m_entity_to_cell[entity.index];
-		CellPage& cell = getCell(*sphere);
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		CellPage& cell = getCell(slot);
+		const u32 idx = u32(slot - cell.entities);
 
 		const IVec3 new_indices(pos * (1 / m_cell_size));
 
 		if(new_indices == cell.header.indices.pos) {
-			sphere->position = (pos - cell.header.origin).toFloat();
+			setSphere(cell, idx, (pos - cell.header.origin).toFloat(), cell.radii[idx]);
 			return;
 		}
 
-		const float radius = sphere->radius;
+		const float radius = cell.radii[idx];
 		const u8 type = cell.header.indices.type;
 		remove(entity);
 		add(entity, type, pos, radius);
 	}
 
 
+	void setPositions(Span<const EntityRef> entities, const DVec3* positions) override
+	{
+		PROFILE_FUNCTION();
+		const float inv_cell_size = 1 / m_cell_size;
+		// moving between cells reorders spheres, so it's done after all in-place updates
+		Array<EntityRef> to_rebin(getFrameAllocator());
+		for (EntityRef entity : entities) {
+			EntityPtr* slot = m_entity_to_cell[entity.index];
+			CellPage& cell = getCell(slot);
+			const DVec3& pos = positions[entity.index];
+			const IVec3 new_indices(pos * inv_cell_size);
+			if (new_indices == cell.header.indices.pos) {
+				const u32 idx = u32(slot - cell.entities);
+				const Vec3 rel_pos = (pos - cell.header.origin).toFloat();
+				cell.xs[idx] = rel_pos.x;
+				cell.ys[idx] = rel_pos.y;
+				cell.zs[idx] = rel_pos.z;
+			}
+			else {
+				to_rebin.push(entity);
+			}
+		}
+
+		for (EntityRef entity : to_rebin) {
+			EntityPtr* slot = m_entity_to_cell[entity.index];
+			const CellPage& cell = getCell(slot);
+			const float radius = cell.radii[slot - cell.entities];
+			const u8 type = cell.header.indices.type;
+			remove(entity);
+			add(entity, type, positions[entity.index], radius);
+		}
+	}
+
+
 	float getRadius(EntityRef entity) override
 	{
-		return m_entity_to_cell[entity.index]->radius;
+		const EntityPtr* slot = m_entity_to_cell[entity.index];
+		const CellPage& cell = getCell(slot);
+		return cell.radii[slot - cell.entities];
+	}
+
+
+	u8 getType(EntityRef entity) override
+	{
+		const EntityPtr* slot = m_entity_to_cell[entity.index];
+		return getCell(slot).header.indices.type;
 	}
 
 	
 	void setRadius(EntityRef entity, float radius) override
 	{
-		Sphere* sphere = m_entity_to_cell[entity.index];
-		CellPage& cell = getCell(*sphere);
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		CellPage& cell = getCell(slot);
+		const u32 idx = u32(slot - cell.entities);
 		
 		const bool was_big = cell.header.indices.is_big;
 		const bool is_big = radius > m_cell_size;
 
 		if (was_big == is_big) {
-			sphere->radius = radius;
+			cell.radii[idx] = radius;
 			return;
 		}
 		const u8 type = cell.header.indices.type;
-		const DVec3 pos = cell.header.origin + sphere->position;
+		const DVec3 pos = cell.header.origin + Vec3(cell.xs[idx], cell.ys[idx], cell.zs[idx]);
 		remove(entity);
 		add(entity, type, pos, radius);
 	}
 
 
+	CullingBackend getBackend() const override { return CullingBackend::GRID; }
+
+
+	void moveTo(CullingSystem& dst) override
+	{
+		transfer(m_entity_to_cell, dst);
+		clear();
+	}
+
+
 	void clear() override
 	{
 		for(CellPage* page : m_cell_map) {
@@ -244,103 +541,78 @@ struct CullingSystemImpl final : CullingSystem
 	}
 
 
-	LUMIX_FORCE_INLINE void doCulling(const CellPage& cell
-		, const Frustum& frustum
-		, CullResult* LUMIX_RESTRICT results
-		, PagedList<CullResult>& list)
+	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
 	{
-		PROFILE_FUNCTION();
-		const Sphere* LUMIX_RESTRICT start = cell.spheres;
-		const Sphere* LUMIX_RESTRICT end = cell.spheres + cell.header.count;
-		const EntityPtr* LUMIX_RESTRICT sphere_to_entity_map = cell.entities;
-
-		Profiler::pushInt("objects", cell.header.count);
-		const float4 px = f4Load(frustum.xs);
-		const float4 py = f4Load(frustum.ys);
-		const float4 pz = f4Load(frustum.zs);
-		const float4 pd = f4Load(frustum.ds);
-		const float4 px2 = f4Load(&frustum.xs[4]);
-		const float4 py2 = f4Load(&frustum.ys[4]);
-		const float4 pz2 = f4Load(&frustum.zs[4]);
-		const float4 pd2 = f4Load(&frustum.ds[4]);
-		int cursor = results->header.count;
-	
-		int i = 0;
-		for (const Sphere *sphere = start; sphere < end; ++sphere, ++i) {
-			const float4 cx = f4Splat(sphere->position.x);
-			const float4 cy = f4Splat(sphere->position.y);
-			const float4 cz = f4Splat(sphere->position.z);
-			const float4 r = f4Splat(-sphere->radius);
-
-			float4 t = f4Mul(cx, px);
-			t = f4Add(t, f4Mul(cy, py));
-			t = f4Add(t, f4Mul(cz, pz));
-			t = f4Add(t, pd);
-			t = f4Sub(t, r);
-			if (f4MoveMask(t)) continue;
-
-			t = f4Mul(cx, px2);
-			t = f4Add(t, f4Mul(cy, py2));
-			t = f4Add(t, f4Mul(cz, pz2));
-			t = f4Add(t, pd2);
-			t = f4Sub(t, r);
-			if (f4MoveMask(t)) continue;
-
-			if(cursor == lengthOf(results->entities)) {
-				results->header.count = cursor;
-				results = list.push();
-				cursor = 0;
-			}
-
-			results->entities[cursor] = (EntityRef)sphere_to_entity_map[i];
-			++cursor;
-		}
-		results->header.count = cursor;
+		CullResult* result = nullptr;
+		cull(Span(&frustum, 1), type, Span(&result, 1));
+		return result;
 	}
 
 
-	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
+	void cull(Span<const ShiftedFrustum> frustums, u8 type, Span<CullResult*> results) override
 	{
 		PROFILE_FUNCTION();
-		if (m_cells.empty()) return nullptr;
+		ASSERT(frustums.length() == results.length());
+		ASSERT(frustums.length() <= MAX_CULL_FRUSTUMS);
+		for (CullResult*& result : results) result = nullptr;
+		if (m_cells.empty()) return;
 
+		const u32 frustums_count = frustums.length();
 		volatile i32 cell_idx = 0;
-		PagedList<CullResult> list(m_page_allocator);
+		alignas(PagedList<CullResult>) u8 lists_mem[sizeof(PagedList<CullResult>) * MAX_CULL_FRUSTUMS];
+		PagedList<CullResult>* lists = (PagedList<CullResult>*)lists_mem;
+		for (u32 i = 0; i < frustums_count; ++i) new (NewPlaceholder(), &lists[i]) PagedList<CullResult>(m_page_allocator);
 
 		JobSystem::runOnWorkers([&](){
 			PROFILE_BLOCK("cull_job");
 			const Vec3 v3_cell_size(m_cell_size);
 			const Vec3 v3_2_cell_size(2 * m_cell_size);
-			CullResult* result = nullptr;
+			CullResult* thread_results[MAX_CULL_FRUSTUMS] = {};
 			for(;;) {
 				const i32 idx = atomicIncrement(&cell_idx) - 1;
 				if (idx >= m_cells.size()) return;
 
 				CellPage& cell = *m_cells[idx];
 				if (cell.header.indices.type != type) continue;
-				if (!result) result = list.push();
-
-				if (frustum.containsAABB(cell.header.origin + v3_cell_size, v3_cell_size)) {
-					int to_cpy = cell.header.count;
-					int src_offset = 0;
-					while (to_cpy > 0) {
-						if(result->header.count == lengthOf(result->entities)) {
-							result = list.push();
-						}
-						const int rem_space = lengthOf(result->entities) - result->header.count;
-						const int step = minimum(to_cpy, rem_space);
-						memcpy(result->entities + result->header.count, cell.entities + src_offset, step * sizeof(cell.entities[0]));
-						src_offset += step;
-						result->header.count += step;
-						to_cpy -= step;
+
+				// each cell is loaded once and tested against all frustums while it's in cache
+				for (u32 f = 0; f < frustums_count; ++f) {
+					const ShiftedFrustum& frustum = frustums[f];
+					CullResult*& result = thread_results[f];
+					if (frustum.containsAABB(cell.header.origin + v3_cell_size, v3_cell_size)) {
+						if (!result) result = lists[f].push();
+						copyCell(cell, result, lists[f]);
+					}
+					else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
+						if (!result) result = lists[f].push();
+						cullCell(cell, frustum.getRelative(cell.header.origin), m_use_avx2, result, lists[f]);
 					}
-				}
-				else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list);
 				}
 			}
 		});
 
+		for (u32 i = 0; i < frustums_count; ++i) {
+			results[i] = lists[i].detach();
+			lists[i].~PagedList<CullResult>();
+		}
+	}
+
+
+	CullResult* castRay(const DVec3& origin, const Vec3& dir, u8 type) override
+	{
+		PROFILE_FUNCTION();
+		const Vec3 ndir = dir.normalized();
+		const Vec3 inv_dir(1 / ndir.x, 1 / ndir.y, 1 / ndir.z);
+		const Vec3 v3_cell_size(m_cell_size);
+		PagedList<CullResult> list(m_page_allocator);
+		CullResult* result = nullptr;
+		for (const CellPage* cell : m_cells) {
+			if (cell->header.indices.type != type) continue;
+			// same loose bounds as in cull
+			const DVec3& cell_origin = cell->header.origin;
+			if (!rayIntersectsAABB(origin, inv_dir, cell_origin - v3_cell_size, cell_origin + v3_cell_size)) continue;
+			castRayPage(*cell, (origin - cell_origin).toFloat(), ndir, result, list);
+		}
 		return list.detach();
 	}
 	
@@ -355,8 +627,469 @@ struct CullingSystemImpl final : CullingSystem
 	PageAllocator& m_page_allocator;
 	HashMap<CellIndices, CellPage*, CellIndicesHasher> m_cell_map;
 	Array<CellPage*> m_cells;
-	Array<Sphere*> m_entity_to_cell;
+	Array<EntityPtr*> m_entity_to_cell;
 	float m_cell_size;
+	bool m_use_avx2 = false;
+};
+
+
+// loose octree, a node's loose bounds are twice its size, so an object fits a node if its radius <= node's half size
+// leaves are split when their page is full, empty nodes are released
+struct OctreeCullingSystem final : CullingSystem
+{
+	static constexpr float ROOT_HALF_SIZE = 16384;
+	static constexpr float MIN_HALF_SIZE = 4;
+
+	struct Node {
+		DVec3 center;
+		float half_size;
+		i32 parent;
+		i32 children[8];
+		CellPage* pages;
+		bool is_split;
+	};
+
+	struct Work {
+		const CellPage* page;
+		u32 frustum;
+		bool inside;
+	};
+
+	OctreeCullingSystem(IAllocator& allocator, PageAllocator& page_allocator) 
+		: m_allocator(allocator)
+		, m_page_allocator(page_allocator)
+		, m_nodes(allocator)
+		, m_free_nodes(allocator)
+		, m_pages(allocator)
+		, m_entity_to_cell(allocator)
+	{
+		for (i32& root : m_roots) root = -1;
+		#ifdef LUMIX_CULLING_AVX2
+			m_use_avx2 = cpuSupportsAVX2();
+		#endif
+	}
+
+	~OctreeCullingSystem()
+	{
+		clear();
+	}
+
+
+	CullingBackend getBackend() const override { return CullingBackend::LOOSE_OCTREE; }
+
+
+	void moveTo(CullingSystem& dst) override
+	{
+		transfer(m_entity_to_cell, dst);
+		clear();
+	}
+
+
+	void clear() override
+	{
+		for (CellPage* page : m_pages) {
+			page->~CellPage();
+			m_page_allocator.deallocate(page, true);
+		}
+		m_pages.clear();
+		m_nodes.clear();
+		m_free_nodes.clear();
+		m_entity_to_cell.clear();
+		for (i32& root : m_roots) root = -1;
+	}
+
+
+	i32 allocNode(const DVec3& center, float half_size, i32 parent)
+	{
+		i32 idx;
+		if (m_free_nodes.empty()) {
+			idx = m_nodes.size();
+			m_nodes.emplace();
+		}
+		else {
+			idx = m_free_nodes.back();
+			m_free_nodes.pop();
+		}
+		Node& n = m_nodes[idx];
+		n.center = center;
+		n.half_size = half_size;
+		n.parent = parent;
+		for (i32& c : n.children) c = -1;
+		n.pages = nullptr;
+		n.is_split = false;
+		return idx;
+	}
+
+
+	static bool isInside(const Node& n, const DVec3& pos)
+	{
+		const double h = n.half_size;
+		return fabs(pos.x - n.center.x) <= h && fabs(pos.y - n.center.y) <= h && fabs(pos.z - n.center.z) <= h;
+	}
+
+
+	static bool fitsChild(const Node& n, const DVec3& pos, float radius)
+	{
+		const float child_half_size = n.half_size * 0.5f;
+		return child_half_size >= MIN_HALF_SIZE && radius <= child_half_size && isInside(n, pos);
+	}
+
+
+	static u32 getOctant(const Node& n, const DVec3& pos)
+	{
+		return (pos.x >= n.center.x ? 1 : 0) | (pos.y >= n.center.y ? 2 : 0) | (pos.z >= n.center.z ? 4 : 0);
+	}
+
+
+	i32 getChild(i32 node_idx, u32 octant)
+	{
+		const i32 child = m_nodes[node_idx].children[octant];
+		if (child >= 0) return child;
+
+		// allocNode can reallocate m_nodes
+		const Node n = m_nodes[node_idx];
+		const float child_half_size = n.half_size * 0.5f;
+		const DVec3 center = n.center + Vec3(
+			octant & 1 ? child_half_size : -child_half_size,
+			octant & 2 ? child_half_size : -child_half_size,
+			octant & 4 ? child_half_size : -child_half_size);
+		const i32 idx = allocNode(center, child_half_size, node_idx);
+		m_nodes[node_idx].children[octant] = idx;
+		return idx;
+	}
+
+
+	EntityPtr* addToNode(i32 node_idx, u8 type, EntityRef entity, const DVec3& pos, float radius)
+	{
+		Node& n = m_nodes[node_idx];
+		CellPage* page = n.pages;
+		if (!page || page->header.count >= CellPage::MAX_COUNT - 1) {
+			void* mem = m_page_allocator.allocate(true);
+			CellPage* new_page = new (NewPlaceholder(), mem) CellPage;
+			new_page->header.origin = n.center;
+			new_page->header.indices.type = type;
+			new_page->header.node = node_idx;
+			new_page->header.next = page;
+			if (page) page->header.prev = new_page;
+			n.pages = new_page;
+			m_pages.push(new_page);
+			page = new_page;
+		}
+
+		const u32 idx = page->header.count;
+		const Vec3 rel_pos = (pos - page->header.origin).toFloat();
+		page->xs[idx] = rel_pos.x;
+		page->ys[idx] = rel_pos.y;
+		page->zs[idx] = rel_pos.z;
+		page->radii[idx] = radius;
+		page->entities[idx] = entity;
+		++page->header.count;
+		return &page->entities[idx];
+	}
+
+
+	void split(i32 node_idx)
+	{
+		struct Sphere { EntityRef entity; DVec3 pos; float radius; };
+		Array<Sphere> to_move(m_allocator);
+
+		m_nodes[node_idx].is_split = true;
+		const Node& n = m_nodes[node_idx];
+		for (CellPage* page = n.pages; page; page = page->header.next) {
+			for (i32 i = 0; i < page->header.count; ++i) {
+				const DVec3 pos = page->header.origin + Vec3(page->xs[i], page->ys[i], page->zs[i]);
+				if (!fitsChild(n, pos, page->radii[i])) continue;
+				to_move.push({(EntityRef)page->entities[i], pos, page->radii[i]});
+			}
+		}
+
+		const u8 type = n.pages->header.indices.type;
+		for (const Sphere& s : to_move) {
+			removeFromPage(m_entity_to_cell[s.entity.index]);
+			m_entity_to_cell[s.entity.index] = insert(node_idx, type, s.entity, s.pos, s.radius);
+		}
+	}
+
+
+	EntityPtr* insert(i32 node_idx, u8 type, EntityRef entity, const DVec3& pos, float radius)
+	{
+		for (;;) {
+			const Node& n = m_nodes[node_idx];
+			if (!fitsChild(n, pos, radius)) break;
+			if (n.is_split) {
+				node_idx = getChild(node_idx, getOctant(n, pos));
+				continue;
+			}
+			if (n.pages && n.pages->header.count >= CellPage::MAX_COUNT - 1) {
+				split(node_idx);
+				continue;
+			}
+			break;
+		}
+		return addToNode(node_idx, type, entity, pos, radius);
+	}
+
+
+	void add(EntityRef entity, u8 type, const DVec3& pos, float radius) override
+	{
+		while (m_entity_to_cell.size() <= entity.index) m_entity_to_cell.push(nullptr);
+		if (m_roots[type] < 0) m_roots[type] = allocNode(DVec3(0), ROOT_HALF_SIZE, -1);
+		m_entity_to_cell[entity.index] = insert(m_roots[type], type, entity, pos, radius);
+	}
+
+
+	// does not release empty nodes
+	void removeFromPage(EntityPtr* slot)
+	{
+		CellPage& page = getCell(slot);
+		const EntityRef entity = (EntityRef)*slot;
+		if (page.header.count == 1) {
+			Node& n = m_nodes[page.header.node];
+			if (page.header.prev) page.header.prev->header.next = page.header.next;
+			else n.pages = page.header.next;
+			if (page.header.next) page.header.next->header.prev = page.header.prev;
+			m_pages.swapAndPopItem(&page);
+			page.~CellPage();
+			m_page_allocator.deallocate(&page, true);
+		}
+		else {
+			const int idx = int(slot - page.entities);
+			const int last_idx = page.header.count - 1;
+			const EntityPtr last = page.entities[last_idx];
+			page.entities[idx] = last;
+			page.xs[idx] = page.xs[last_idx];
+			page.ys[idx] = page.ys[last_idx];
+			page.zs[idx] = page.zs[last_idx];
+			page.radii[idx] = page.radii[last_idx];
+			m_entity_to_cell[last.index] = &page.entities[idx];
+			--page.header.count;
+		}
+		m_entity_to_cell[entity.index] = nullptr;
+	}
+
+
+	void releaseEmptyNodes(i32 node_idx)
+	{
+		for (;;) {
+			Node& n = m_nodes[node_idx];
+			if (n.parent < 0 || n.pages) return;
+			for (i32 c : n.children) {
+				if (c >= 0) return;
+			}
+			const i32 parent = n.parent;
+			Node& p = m_nodes[parent];
+			for (i32& c : p.children) {
+				if (c == node_idx) c = -1;
+			}
+			m_free_nodes.push(node_idx);
+			node_idx = parent;
+		}
+	}
+
+
+	void remove(EntityRef entity) override
+	{
+		if (m_entity_to_cell.size() <= entity.index) return;
+		
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		if (!slot) return;
+
+		const i32 node = getCell(slot).header.node;
+		removeFromPage(slot);
+		releaseEmptyNodes(node);
+	}
+
+
+	bool isAdded(EntityRef entity) override
+	{
+		return entity.index < m_entity_to_cell.size() && m_entity_to_cell[entity.index] != nullptr;
+	}
+
+
+	// objects stay in their node while their center is inside it, the root keeps even objects out of its bounds
+	void setPosition(EntityRef entity, const DVec3& pos) override
+	{
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		CellPage& page = getCell(slot);
+		const u32 idx = u32(slot - page.entities);
+		const Node& n = m_nodes[page.header.node];
+
+		if (n.parent < 0 || isInside(n, pos)) {
+			const Vec3 rel_pos = (pos - page.header.origin).toFloat();
+			page.xs[idx] = rel_pos.x;
+			page.ys[idx] = rel_pos.y;
+			page.zs[idx] = rel_pos.z;
+			return;
+		}
+
+		const float radius = page.radii[idx];
+		const u8 type = page.header.indices.type;
+		remove(entity);
+		add(entity, type, pos, radius);
+	}
+
+
+	void setPositions(Span<const EntityRef> entities, const DVec3* positions) override
+	{
+		PROFILE_FUNCTION();
+		for (EntityRef e : entities) {
+			setPosition(e, positions[e.index]);
+		}
+	}
+
+
+	float getRadius(EntityRef entity) override
+	{
+		const EntityPtr* slot = m_entity_to_cell[entity.index];
+		const CellPage& page = getCell(slot);
+		return page.radii[slot - page.entities];
+	}
+
+
+	u8 getType(EntityRef entity) override
+	{
+		const EntityPtr* slot = m_entity_to_cell[entity.index];
+		return getCell(slot).header.indices.type;
+	}
+
+
+	void setRadius(EntityRef entity, float radius) override
+	{
+		EntityPtr* slot = m_entity_to_cell[entity.index];
+		CellPage& page = getCell(slot);
+		const u32 idx = u32(slot - page.entities);
+		const Node& n = m_nodes[page.header.node];
+
+		if (n.parent < 0 || radius <= n.half_size) {
+			page.radii[idx] = radius;
+			return;
+		}
+
+		const u8 type = page.header.indices.type;
+		const DVec3 pos = page.header.origin + Vec3(page.xs[idx], page.ys[idx], page.zs[idx]);
+		remove(entity);
+		add(entity, type, pos, radius);
+	}
+
+
+	void gather(i32 node_idx, const ShiftedFrustum& frustum, u32 frustum_idx, bool inside, Array<Work>& work) const
+	{
+		const Node& n = m_nodes[node_idx];
+		// root is never rejected, it contains objects out of its bounds
+		if (!inside && n.parent >= 0) {
+			const Vec3 loose_half_size(2 * n.half_size);
+			if (!frustum.intersectsAABB(n.center - loose_half_size, loose_half_size * 2)) return;
+			inside = frustum.containsAABB(n.center - loose_half_size, loose_half_size * 2);
+		}
+
+		for (const CellPage* page = n.pages; page; page = page->header.next) {
+			work.push({page, frustum_idx, inside});
+		}
+		if (!n.is_split) return;
+		for (i32 c : n.children) {
+			if (c >= 0) gather(c, frustum, frustum_idx, inside, work);
+		}
+	}
+
+
+	void castRayNode(i32 node_idx, const DVec3& origin, const Vec3& dir, const Vec3& inv_dir, CullResult*& result, PagedList<CullResult>& list) const
+	{
+		const Node& n = m_nodes[node_idx];
+		// root is never rejected, it contains objects out of its bounds
+		if (n.parent >= 0) {
+			const Vec3 loose_half_size(2 * n.half_size);
+			if (!rayIntersectsAABB(origin, inv_dir, n.center - loose_half_size, n.center + loose_half_size)) return;
+		}
+
+		for (const CellPage* page = n.pages; page; page = page->header.next) {
+			castRayPage(*page, (origin - page->header.origin).toFloat(), dir, result, list);
+		}
+		if (!n.is_split) return;
+		for (i32 c : n.children) {
+			if (c >= 0) castRayNode(c, origin, dir, inv_dir, result, list);
+		}
+	}
+
+
+	CullResult* castRay(const DVec3& origin, const Vec3& dir, u8 type) override
+	{
+		PROFILE_FUNCTION();
+		if (m_roots[type] < 0) return nullptr;
+
+		const Vec3 ndir = dir.normalized();
+		const Vec3 inv_dir(1 / ndir.x, 1 / ndir.y, 1 / ndir.z);
+		PagedList<CullResult> list(m_page_allocator);
+		CullResult* result = nullptr;
+		castRayNode(m_roots[type], origin, ndir, inv_dir, result, list);
+		return list.detach();
+	}
+
+
+	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
+	{
+		CullResult* result = nullptr;
+		cull(Span(&frustum, 1), type, Span(&result, 1));
+		return result;
+	}
+
+
+	void cull(Span<const ShiftedFrustum> frustums, u8 type, Span<CullResult*> results) override
+	{
+		PROFILE_FUNCTION();
+		ASSERT(frustums.length() == results.length());
+		ASSERT(frustums.length() <= MAX_CULL_FRUSTUMS);
+		for (CullResult*& result : results) result = nullptr;
+		if (m_roots[type] < 0) return;
+
+		const u32 frustums_count = frustums.length();
+		Array<Work> work(m_allocator);
+		{
+			PROFILE_BLOCK("gather nodes");
+			for (u32 f = 0; f < frustums_count; ++f) {
+				gather(m_roots[type], frustums[f], f, false, work);
+			}
+		}
+		if (work.empty()) return;
+
+		volatile i32 work_idx = 0;
+		alignas(PagedList<CullResult>) u8 lists_mem[sizeof(PagedList<CullResult>) * MAX_CULL_FRUSTUMS];
+		PagedList<CullResult>* lists = (PagedList<CullResult>*)lists_mem;
+		for (u32 i = 0; i < frustums_count; ++i) new (NewPlaceholder(), &lists[i]) PagedList<CullResult>(m_page_allocator);
+
+		JobSystem::runOnWorkers([&](){
+			PROFILE_BLOCK("cull_job");
+			CullResult* thread_results[MAX_CULL_FRUSTUMS] = {};
+			for (;;) {
+				const i32 idx = atomicIncrement(&work_idx) - 1;
+				if (idx >= work.size()) return;
+
+				const Work& w = work[idx];
+				CullResult*& result = thread_results[w.frustum];
+				if (!result) result = lists[w.frustum].push();
+				if (w.inside) {
+					copyCell(*w.page, result, lists[w.frustum]);
+				}
+				else {
+					cullCell(*w.page, frustums[w.frustum].getRelative(w.page->header.origin), m_use_avx2, result, lists[w.frustum]);
+				}
+			}
+		});
+
+		for (u32 i = 0; i < frustums_count; ++i) {
+			results[i] = lists[i].detach();
+			lists[i].~PagedList<CullResult>();
+		}
+	}
+
+
+	IAllocator& m_allocator;
+	PageAllocator& m_page_allocator;
+	Array<Node> m_nodes;
+	Array<i32> m_free_nodes;
+	Array<CellPage*> m_pages;
+	Array<EntityPtr*> m_entity_to_cell;
+	i32 m_roots[256];
+	bool m_use_avx2 = false;
 };
 
 
@@ -372,14 +1105,26 @@ void CullResult::free(PageAllocator& allocator)
 }
 
 
-CullingSystem* CullingSystem::create(IAllocator& allocator, PageAllocator& page_allocator)
+CullingSystem* CullingSystem::create(IAllocator& allocator, PageAllocator& page_allocator, CullingBackend backend)
 {
-	return LUMIX_NEW(allocator, CullingSystemImpl)(allocator, page_allocator);
+	switch (backend) {
+		case CullingBackend::GRID: return LUMIX_NEW(allocator, CullingSystemImpl)(allocator, page_allocator);
+		case CullingBackend::LOOSE_OCTREE: return LUMIX_NEW(allocator, OctreeCullingSystem)(allocator, page_allocator);
+	}
+	ASSERT(false);
+	return nullptr;
 }
 
 
 void CullingSystem::destroy(CullingSystem& culling_system)
 {
-	LUMIX_DELETE(static_cast<CullingSystemImpl&>(culling_system).m_allocator, &culling_system);
+	switch (culling_system.getBackend()) {
+		case CullingBackend::GRID: 
+			LUMIX_DELETE(static_cast<CullingSystemImpl&>(culling_system).m_allocator, &culling_system);
+			break;
+		case CullingBackend::LOOSE_OCTREE:
+			LUMIX_DELETE(static_cast<OctreeCullingSystem&>(culling_system).m_allocator, &culling_system);
+			break;
+	}
 }
 }
\ No newline at end of file
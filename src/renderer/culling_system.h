@@ -44,26 +44,45 @@ struct CullResult {
 	EntityRef entities[(16384 - sizeof(header)) / sizeof(EntityRef)];
 };
 
+enum class CullingBackend : u8 {
+	// hash grid with fixed cell size
+	GRID,
+	// loose octree, nodes are split only where objects are dense
+	LOOSE_OCTREE
+};
+
 struct LUMIX_RENDERER_API CullingSystem
 {
 	CullingSystem() { }
 	virtual ~CullingSystem() { }
 
-	static CullingSystem* create(IAllocator& allocator, PageAllocator& page_allocator);
+	static CullingSystem* create(IAllocator& allocator, PageAllocator& page_allocator, CullingBackend backend = CullingBackend::GRID);
 	static void destroy(CullingSystem& culling_system);
 
+	virtual CullingBackend getBackend() const = 0;
+	// adds everything to `dst` and clears this
+	virtual void moveTo(CullingSystem& dst) = 0;
 	virtual void clear() = 0;
 
+	static constexpr u32 MAX_CULL_FRUSTUMS = 8;
+
 	virtual CullResult* cull(const ShiftedFrustum& frustum, u8 type) = 0;
+	// tests all frustums in a single traversal of the cells, results[i] is nullptr or the result of frustums[i]
+	virtual void cull(Span<const ShiftedFrustum> frustums, u8 type, Span<CullResult*> results) = 0;
+	// entities with a sphere hit by the ray, in no particular order
+	virtual CullResult* castRay(const DVec3& origin, const Vec3& dir, u8 type) = 0;
 
 	virtual bool isAdded(EntityRef entity) = 0;
 	virtual void add(EntityRef entity, u8 type, const DVec3& pos, float radius) = 0;
 	virtual void remove(EntityRef entity) = 0;
 
 	virtual void setPosition(EntityRef entity, const DVec3& pos) = 0;
+	// `positions` are indexed by entity index, e.g. Universe::getPositions()
+	virtual void setPositions(Span<const EntityRef> entities, const DVec3* positions) = 0;
 	virtual void setRadius(EntityRef entity, float radius) = 0;
 
 	virtual float getRadius(EntityRef entity) = 0;
+	virtual u8 getType(EntityRef entity) = 0;
 };
 
 } // namespace Lumix
@@ -1,12 +1,14 @@
 #include "draw2d.h"
 #include "font.h"
+#include "engine/profiler.h"
 
 
 namespace Lumix {
 
 
 Draw2D::Draw2D(IAllocator& allocator) 
-	: m_cmds(allocator)
+	: m_allocator(allocator)
+	, m_cmds(allocator)
 	, m_indices(allocator)
 	, m_vertices(allocator)
 	, m_clip_queue(allocator)
@@ -18,6 +20,7 @@ void Draw2D::clear(Vec2 atlas_size) {
 	m_cmds.clear();
 	m_indices.clear();
 	m_vertices.clear();
+	m_clip_queue.clear();
 	m_atlas_size = atlas_size;
 	Cmd& cmd = m_cmds.emplace();
 	cmd.texture = nullptr;
@@ -28,31 +31,20 @@ void Draw2D::clear(Vec2 atlas_size) {
 	m_clip_queue.push({{-1, -1}, {-1, -1}});
 }
 
-void Draw2D::pushClipRect(const Vec2& from, const Vec2& to) {
-	m_clip_queue.push({from, to});
-	Cmd& cmd = m_cmds.emplace();
-	cmd.texture = nullptr;
-	cmd.clip_pos = from;
-	cmd.clip_size = to;
-	cmd.indices_count = 0;
-	cmd.index_offset = m_indices.size();
-}
-
-void Draw2D::popClipRect() {
-	m_clip_queue.pop();
-	const Rect& r = m_clip_queue.back();
-	Cmd& cmd = m_cmds.emplace();
-	cmd.texture = nullptr;
-	cmd.clip_pos = r.from;
-	cmd.clip_size = r.to;
-	cmd.indices_count = 0;
-	cmd.index_offset = m_indices.size();
+void Draw2D::setClip(const Rect& r) {
+	Cmd* cmd = &m_cmds.back();
+	// consecutive push/pop without any geometry in between do not generate empty commands
+	if (cmd->indices_count != 0) cmd = &m_cmds.emplace();
+	cmd->texture = nullptr;
+	cmd->clip_pos = r.from;
+	cmd->clip_size = r.to;
+	cmd->indices_count = 0;
+	cmd->index_offset = m_indices.size();
 }
 
-void Draw2D::addLine(const Vec2& p0, const Vec2& p1, Color color, float width) {
+Draw2D::Cmd& Draw2D::getCmd(gpu::TextureHandle* texture) {
 	Cmd* cmd = &m_cmds.back();
-
-	if (cmd->texture != nullptr && cmd->indices_count != 0) {
+	if (cmd->texture != texture && cmd->indices_count != 0) {
 		cmd = &m_cmds.emplace();
 		const Rect& r = m_clip_queue.back();
 		cmd->clip_pos = r.from;
@@ -60,11 +52,46 @@ void Draw2D::addLine(const Vec2& p0, const Vec2& p1, Color color, float width) {
 		cmd->indices_count = 0;
 		cmd->index_offset = m_indices.size();
 	}
+	cmd->texture = texture;
+	return *cmd;
+}
+
+void Draw2D::pushClipRect(const Vec2& from, const Vec2& to) {
+	m_clip_queue.push({from, to});
+	setClip(m_clip_queue.back());
+}
+
+void Draw2D::popClipRect() {
+	m_clip_queue.pop();
+	setClip(m_clip_queue.back());
+}
+
+void Draw2D::append(const Draw2D& src) {
+	const u32 vertex_offset = m_vertices.size();
+	const u32 index_offset = m_indices.size();
+	const Array<Vertex>& src_vertices = src.getVertices();
+	const Array<u32>& src_indices = src.getIndices();
+	m_vertices.reserve(vertex_offset + src_vertices.size());
+	for (const Vertex& v : src_vertices) m_vertices.push(v);
+	m_indices.reserve(index_offset + src_indices.size());
+	for (u32 idx : src_indices) m_indices.push(idx + vertex_offset);
+
+	for (const Cmd& src_cmd : src.getCmds()) {
+		if (src_cmd.indices_count == 0) continue;
+		Cmd* cmd = &m_cmds.back();
+		if (cmd->indices_count != 0) cmd = &m_cmds.emplace();
+		*cmd = src_cmd;
+		cmd->index_offset += index_offset;
+	}
+	setClip(m_clip_queue.back());
+}
+
+void Draw2D::addLine(const Vec2& p0, const Vec2& p1, Color color, float width) {
+	Cmd* cmd = &getCmd(nullptr);
 	
 	Vec2 from = p0 + Vec2(0.5f);
 	Vec2 to = p1 + Vec2(0.5f);
 
-	cmd->texture = nullptr;
 	const Vec2 uv = Vec2(0.5f) / m_atlas_size;
 	const Vec2 dir = (to - from).normalized();
 	const Vec2 n = Vec2(dir.y, -dir.x) * (width * 0.5f);
@@ -97,18 +124,8 @@ void Draw2D::addRect(const Vec2& from, const Vec2& to, Color color, float width)
 }
 
 void Draw2D::addRectFilled(const Vec2& from, const Vec2& to, Color color) {
-	Cmd* cmd = &m_cmds.back();
-
-	if (cmd->texture != nullptr && cmd->indices_count != 0) {
-		cmd = &m_cmds.emplace();
-		const Rect& r = m_clip_queue.back();
-		cmd->clip_pos = r.from;
-		cmd->clip_size = r.to;
-		cmd->indices_count = 0;
-		cmd->index_offset = m_indices.size();
-	}
+	Cmd* cmd = &getCmd(nullptr);
 
-	cmd->texture = nullptr;
 	const u32 voff = m_vertices.size();
 	m_indices.push(voff);
 	m_indices.push(voff + 1);
@@ -129,18 +146,8 @@ void Draw2D::addRectFilled(const Vec2& from, const Vec2& to, Color color) {
 }
 
 void Draw2D::addImage(gpu::TextureHandle* tex, const Vec2& from, const Vec2& to, const Vec2& uv0, const Vec2& uv1) {
-	Cmd* cmd = &m_cmds.back();
+	Cmd* cmd = &getCmd(tex);
 
-	if (cmd->texture != tex && cmd->indices_count != 0) {
-		cmd = &m_cmds.emplace();
-		const Rect& r = m_clip_queue.back();
-		cmd->clip_pos = r.from;
-		cmd->clip_size = r.to;
-		cmd->indices_count = 0;
-		cmd->index_offset = m_indices.size();
-	}
-
-	cmd->texture = tex;
 	const u32 voff = m_vertices.size();
 	m_indices.push(voff);
 	m_indices.push(voff + 1);
@@ -162,26 +169,20 @@ void Draw2D::addImage(gpu::TextureHandle* tex, const Vec2& from, const Vec2& to,
 
 void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char* str) {
 	if (!*str) return;
-	Cmd* cmd = &m_cmds.back();
-
-	if (cmd->texture != nullptr && cmd->indices_count != 0) {
-		cmd = &m_cmds.emplace();
-		const Rect& r = m_clip_queue.back();
-		cmd->clip_pos = r.from;
-		cmd->clip_size = r.to;
-		cmd->indices_count = 0;
-		cmd->index_offset = m_indices.size();
-	}
-
-	cmd->texture = nullptr;
+	Cmd* cmd = &getCmd(nullptr);
 	
 	Vec2 p = pos;
-	for (const char* c = str; *c; ++c) {
-		const Glyph* glyph = findGlyph(font, *c);
+	for (const char* c = str; *c;) {
+		const Glyph* glyph = findGlyph(font, decodeUTF8(c));
 		if (!glyph) {
 			p.x += 16;
 			continue;
 		}
+		// e.g. space
+		if (glyph->x0 == glyph->x1) {
+			p.x += glyph->advance_x;
+			continue;
+		}
 	
 		const u32 voff = m_vertices.size();
 		m_indices.push(voff);
@@ -202,4 +203,157 @@ void Draw2D::addText(const Font& font, const Vec2& pos, Color color, const char*
 	}
 }
 
+void Draw2D::batchByTexture() {
+	PROFILE_FUNCTION();
+	// how many batches back a command can move, bounds the cost for long lists
+	static constexpr u32 MAX_LOOKBACK = 32;
+
+	struct Batch {
+		const Cmd* cmd;
+		Vec2 min;
+		Vec2 max;
+		u32 indices_count;
+	};
+
+	Array<Batch> batches(m_allocator);
+	Array<u32> cmd_batch(m_allocator);
+	cmd_batch.resize(m_cmds.size());
+	for (u32 i = 0, c = m_cmds.size(); i < c; ++i) {
+		const Cmd& cmd = m_cmds[i];
+		cmd_batch[i] = 0xffFFffFF;
+		if (cmd.indices_count == 0) continue;
+
+		Vec2 min(FLT_MAX);
+		Vec2 max(-FLT_MAX);
+		for (u32 j = cmd.index_offset, end = cmd.index_offset + cmd.indices_count; j < end; ++j) {
+			const Vec2 p = m_vertices[m_indices[j]].pos;
+			min.x = minimum(min.x, p.x);
+			min.y = minimum(min.y, p.y);
+			max.x = maximum(max.x, p.x);
+			max.y = maximum(max.y, p.y);
+		}
+
+		u32 target = 0xffFFffFF;
+		for (u32 k = batches.size(), lookback = 0; k > 0 && lookback < MAX_LOOKBACK; --k, ++lookback) {
+			const Batch& b = batches[k - 1];
+			const bool same_state = b.cmd->texture == cmd.texture
+				&& b.cmd->clip_pos.x == cmd.clip_pos.x
+				&& b.cmd->clip_pos.y == cmd.clip_pos.y
+				&& b.cmd->clip_size.x == cmd.clip_size.x
+				&& b.cmd->clip_size.y == cmd.clip_size.y;
+			if (same_state) {
+				target = k - 1;
+				break;
+			}
+			const bool overlaps = min.x <= b.max.x && max.x >= b.min.x && min.y <= b.max.y && max.y >= b.min.y;
+			if (overlaps) break;
+		}
+
+		if (target == 0xffFFffFF) {
+			target = batches.size();
+			Batch& b = batches.emplace();
+			b.cmd = &cmd;
+			b.min = min;
+			b.max = max;
+			b.indices_count = 0;
+		}
+		Batch& b = batches[target];
+		b.min.x = minimum(b.min.x, min.x);
+		b.min.y = minimum(b.min.y, min.y);
+		b.max.x = maximum(b.max.x, max.x);
+		b.max.y = maximum(b.max.y, max.y);
+		b.indices_count += cmd.indices_count;
+		cmd_batch[i] = target;
+	}
+	if (batches.size() + 1 >= m_cmds.size()) return;
+
+	// indices of each batch are placed in the original order of its commands
+	Array<u32> batch_offsets(m_allocator);
+	batch_offsets.resize(batches.size());
+	u32 offset = 0;
+	for (u32 i = 0, c = batches.size(); i < c; ++i) {
+		batch_offsets[i] = offset;
+		offset += batches[i].indices_count;
+	}
+
+	Array<u32> indices(m_allocator);
+	indices.resize(m_indices.size());
+	for (u32 i = 0, c = m_cmds.size(); i < c; ++i) {
+		if (cmd_batch[i] == 0xffFFffFF) continue;
+		const Cmd& cmd = m_cmds[i];
+		u32& dst = batch_offsets[cmd_batch[i]];
+		memcpy(&indices[dst], &m_indices[cmd.index_offset], cmd.indices_count * sizeof(indices[0]));
+		dst += cmd.indices_count;
+	}
+
+	Array<Cmd> cmds(m_allocator);
+	cmds.reserve(batches.size() + 1);
+	offset = 0;
+	for (const Batch& b : batches) {
+		Cmd& cmd = cmds.emplace();
+		cmd = *b.cmd;
+		cmd.index_offset = offset;
+		cmd.indices_count = b.indices_count;
+		offset += b.indices_count;
+	}
+	// keeps the current clip rect for whatever is added after
+	const Rect& clip = m_clip_queue.back();
+	Cmd& last = cmds.emplace();
+	last.texture = nullptr;
+	last.clip_pos = clip.from;
+	last.clip_size = clip.to;
+	last.indices_count = 0;
+	last.index_offset = offset;
+
+	m_indices.swap(indices);
+	m_cmds.swap(cmds);
+}
+
+float Draw2D::layoutText(const Font& font, const char* str, Array<GlyphQuad>& quads) {
+	float width = 0;
+	Vec2 p(0);
+	for (const char* c = str; *c;) {
+		const Glyph* glyph = findGlyph(font, decodeUTF8(c));
+		if (!glyph) {
+			p.x += 16;
+			continue;
+		}
+		width += glyph->advance_x;
+		if (glyph->x0 != glyph->x1) {
+			GlyphQuad& quad = quads.emplace();
+			quad.pos0 = p + Vec2(glyph->x0, glyph->y0);
+			quad.pos1 = p + Vec2(glyph->x1, glyph->y1);
+			quad.uv0 = { glyph->u0, glyph->v0 };
+			quad.uv1 = { glyph->u1, glyph->v1 };
+		}
+		p.x += glyph->advance_x;
+	}
+	return width;
+}
+
+void Draw2D::addGlyphs(Span<const GlyphQuad> quads, const Vec2& pos, Color color) {
+	if (quads.length() == 0) return;
+	Cmd* cmd = &getCmd(nullptr);
+
+	u32 voff = m_vertices.size();
+	m_vertices.reserve(voff + quads.length() * 4);
+	m_indices.reserve(m_indices.size() + quads.length() * 6);
+	for (const GlyphQuad& quad : quads) {
+		m_indices.push(voff);
+		m_indices.push(voff + 1);
+		m_indices.push(voff + 2);
+
+		m_indices.push(voff);
+		m_indices.push(voff + 2);
+		m_indices.push(voff + 3);
+
+		m_vertices.push({ pos + quad.pos0, quad.uv0, color });
+		m_vertices.push({ pos + Vec2(quad.pos1.x, quad.pos0.y), { quad.uv1.x, quad.uv0.y }, color });
+		m_vertices.push({ pos + quad.pos1, quad.uv1, color });
+		m_vertices.push({ pos + Vec2(quad.pos0.x, quad.pos1.y), { quad.uv0.x, quad.uv1.y }, color });
+		voff += 4;
+	}
+	cmd->indices_count += quads.length() * 6;
+}
+
 } // namespace Lumix
\ No newline at end of file
@@ -44,6 +44,14 @@ struct LUMIX_RENDERER_API Draw2D {
 		Color color; 
 	};
 
+	// relative to the text origin
+	struct GlyphQuad {
+		Vec2 pos0;
+		Vec2 pos1;
+		Vec2 uv0;
+		Vec2 uv1;
+	};
+
 	Draw2D(IAllocator& allocator);
 
 	void clear(Vec2 atlas_size);
@@ -54,6 +62,15 @@ struct LUMIX_RENDERER_API Draw2D {
 	void addRectFilled(const Vec2& from, const Vec2& to, Color color);
 	void addText(const Font& font, const Vec2& pos, Color color, const char* text);
 	void addImage(gpu::TextureHandle* tex, const Vec2& from, const Vec2& to, const Vec2& uv0, const Vec2& uv1);
+	// same as addText, but the quads can be cached; they are valid until the font atlas changes
+	// returns the width of the text as measureTextA does
+	static float layoutText(const Font& font, const char* str, Array<GlyphQuad>& quads);
+	void addGlyphs(Span<const GlyphQuad> quads, const Vec2& pos, Color color);
+	// merges commands with the same texture and clip rect, a command moves to an earlier one
+	// only over commands it does not overlap, so the result looks the same with fewer draw calls
+	void batchByTexture();
+	// copies geometry recorded in another Draw2D, e.g. cached static GUI, with its own clip rects
+	void append(const Draw2D& src);
 	const Array<Vertex>& getVertices() const { return m_vertices; }
 	const Array<u32>& getIndices() const { return m_indices; }
 	const Array<Cmd>& getCmds() const { return m_cmds; }
@@ -64,6 +81,10 @@ private:
 		Vec2 to;
 	};
 
+	void setClip(const Rect& r);
+	Cmd& getCmd(gpu::TextureHandle* texture);
+
+	IAllocator& m_allocator;
 	Vec2 m_atlas_size;
 	Array<Cmd> m_cmds;
 	Array<u32> m_indices;
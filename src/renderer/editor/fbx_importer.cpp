@@ -7,6 +7,9 @@
 #include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
+#include "engine/hash.h"
+#include "engine/hash_map.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/os.h"
@@ -344,13 +347,51 @@ void FBXImporter::writePackedVec3(const ofbx::Vec3& vec, const Matrix& mtx, Outp
 }
 
 
-static void writeUV(const ofbx::Vec2& uv, OutputMemoryStream* blob)
+static u16 toHalf(float value)
+{
+	u32 x;
+	memcpy(&x, &value, sizeof(x));
+	const u32 sign = (x >> 16) & 0x8000;
+	const i32 exponent = i32((x >> 23) & 0xff) - 127 + 15;
+	u32 mantissa = x & 0x7fFFff;
+	if (exponent <= 0) {
+		if (exponent < -10) return u16(sign);
+		mantissa |= 0x800000;
+		const u32 shift = 14 - exponent;
+		return u16(sign | ((mantissa + (1 << (shift - 1))) >> shift));
+	}
+	if (exponent >= 31) return u16(sign | 0x7c00);
+	// rounding can carry to the exponent, which is still correct
+	return u16(sign | (((u32)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+
+static void writeUV(const ofbx::Vec2& uv, bool half, OutputMemoryStream* blob)
 {
 	Vec2 tex_cooords = {(float)uv.x, 1 - (float)uv.y};
+	if (half) {
+		const u16 packed[] = { toHalf(tex_cooords.x), toHalf(tex_cooords.y) };
+		blob->write(packed);
+		return;
+	}
 	blob->write(tex_cooords);
 }
 
 
+// see decodePosition in common.glsl
+static Vec3 quantizePosition(const Vec3& pos, i16 exponent, OutputMemoryStream* blob)
+{
+	const float step = powf(2, exponent);
+	i16 packed[4];
+	for (u32 i = 0; i < 3; ++i) {
+		packed[i] = (i16)clamp(floor((&pos.x)[i] / step + 0.5), -32767.0, 32767.0);
+	}
+	packed[3] = exponent;
+	blob->write(packed);
+	return Vec3(packed[0], packed[1], packed[2]) * step;
+}
+
+
 static void writeColor(const ofbx::Vec4& color, OutputMemoryStream* blob)
 {
 	u8 rgba[4];
@@ -457,6 +498,457 @@ static bool doesFlipHandness(const Matrix& mtx) {
 	return z.z < 0;
 }
 
+static void getPositions(const FBXImporter::ImportMesh& mesh, int vertex_size, Array<Vec3>& out)
+{
+	const u32 vertex_count = u32(mesh.vertex_data.getPos() / vertex_size);
+	const u8* vertex_data = (const u8*)mesh.vertex_data.getData();
+	out.resize(vertex_count);
+	for (u32 i = 0; i < vertex_count; ++i) {
+		const u8* v = vertex_data + i * vertex_size;
+		if (mesh.quantized_positions) {
+			i16 p[4];
+			memcpy(p, v, sizeof(p));
+			out[i] = Vec3(p[0], p[1], p[2]) * powf(2, p[3]);
+		}
+		else {
+			memcpy(&out[i], v, sizeof(out[i]));
+		}
+	}
+}
+
+
+// Tom Forsyth's linear-speed vertex cache optimisation
+static void optimizeVertexCache(Array<int>& indices, u32 vertex_count, IAllocator& allocator)
+{
+	enum { CACHE_SIZE = 32 };
+	const u32 triangles_count = indices.size() / 3;
+
+	auto getVertexScore = [](i32 cache_pos, u32 valence) -> float {
+		if (valence == 0) return -1;
+		float score = 0;
+		if (cache_pos >= 0) {
+			// the last triangle's vertices get a fixed score, so the next triangle does not reuse all of them
+			if (cache_pos < 3) score = 0.75f;
+			else score = powf(1 - (cache_pos - 3) / float(CACHE_SIZE - 3), 1.5f);
+		}
+		return score + 2 * powf((float)valence, -0.5f);
+	};
+
+	// triangles using each vertex, emitted triangles are swapped to the end
+	Array<u32> valence(allocator);
+	Array<u32> adjacency_offset(allocator);
+	Array<u32> adjacency(allocator);
+	valence.resize(vertex_count);
+	adjacency_offset.resize(vertex_count);
+	adjacency.resize(indices.size());
+	memset(valence.begin(), 0, valence.byte_size());
+	for (int idx : indices) ++valence[idx];
+	u32 offset = 0;
+	for (u32 i = 0; i < vertex_count; ++i) {
+		adjacency_offset[i] = offset;
+		offset += valence[i];
+		valence[i] = 0;
+	}
+	for (u32 i = 0, c = indices.size(); i < c; ++i) {
+		const int idx = indices[i];
+		adjacency[adjacency_offset[idx] + valence[idx]] = i / 3;
+		++valence[idx];
+	}
+
+	Array<i32> cache_pos(allocator);
+	Array<float> vertex_score(allocator);
+	Array<float> triangle_score(allocator);
+	Array<bool> emitted(allocator);
+	cache_pos.resize(vertex_count);
+	vertex_score.resize(vertex_count);
+	triangle_score.resize(triangles_count);
+	emitted.resize(triangles_count);
+	for (u32 i = 0; i < vertex_count; ++i) {
+		cache_pos[i] = -1;
+		vertex_score[i] = getVertexScore(-1, valence[i]);
+	}
+	for (u32 i = 0; i < triangles_count; ++i) {
+		triangle_score[i] = vertex_score[indices[i * 3]] + vertex_score[indices[i * 3 + 1]] + vertex_score[indices[i * 3 + 2]];
+		emitted[i] = false;
+	}
+
+	Array<int> out(allocator);
+	out.reserve(indices.size());
+	int cache[CACHE_SIZE + 3];
+	u32 cache_count = 0;
+	u32 next_unemitted = 0;
+	i32 best = -1;
+	for (u32 n = 0; n < triangles_count; ++n) {
+		if (best < 0) {
+			while (emitted[next_unemitted]) ++next_unemitted;
+			best = next_unemitted;
+		}
+
+		emitted[best] = true;
+		const int* tri = &indices[best * 3];
+		int new_cache[CACHE_SIZE + 3];
+		u32 new_cache_count = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			const int v = tri[k];
+			out.push(v);
+			bool in_new_cache = false;
+			for (u32 j = 0; j < new_cache_count; ++j) in_new_cache = in_new_cache || new_cache[j] == v;
+			if (!in_new_cache) new_cache[new_cache_count++] = v;
+
+			u32* adj = &adjacency[adjacency_offset[v]];
+			for (u32 j = 0; j < valence[v]; ++j) {
+				if (adj[j] == (u32)best) {
+					adj[j] = adj[valence[v] - 1];
+					--valence[v];
+					break;
+				}
+			}
+		}
+		for (u32 j = 0; j < cache_count; ++j) {
+			const int v = cache[j];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache[new_cache_count++] = v;
+		}
+
+		// vertices pushed out of the cache are rescored too
+		for (u32 j = 0; j < new_cache_count; ++j) {
+			const int v = new_cache[j];
+			cache_pos[v] = j < CACHE_SIZE ? (i32)j : -1;
+			vertex_score[v] = getVertexScore(cache_pos[v], valence[v]);
+		}
+
+		best = -1;
+		float best_score = -1;
+		for (u32 j = 0; j < new_cache_count; ++j) {
+			const int v = new_cache[j];
+			const u32* adj = &adjacency[adjacency_offset[v]];
+			for (u32 a = 0; a < valence[v]; ++a) {
+				const u32 t = adj[a];
+				const float score = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+				triangle_score[t] = score;
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+
+		cache_count = minimum(new_cache_count, (u32)CACHE_SIZE);
+		memcpy(cache, new_cache, cache_count * sizeof(cache[0]));
+	}
+	indices.swap(out);
+}
+
+
+// splits cache optimized triangles to clusters where the cache restarts anyway and draws outward facing clusters first
+static void optimizeOverdraw(Array<int>& indices, const Array<Vec3>& positions, IAllocator& allocator)
+{
+	enum { CACHE_SIZE = 16, MIN_CLUSTER_TRIANGLES = 64 };
+	const u32 triangles_count = indices.size() / 3;
+	if (triangles_count <= MIN_CLUSTER_TRIANGLES) return;
+
+	struct Cluster {
+		float key;
+		u32 from;
+		u32 to;
+	};
+	Array<Cluster> clusters(allocator);
+
+	// fifo cache
+	Array<u32> timestamps(allocator);
+	timestamps.resize(positions.size());
+	memset(timestamps.begin(), 0, timestamps.byte_size());
+	u32 time = CACHE_SIZE + 1;
+	u32 cluster_start = 0;
+	for (u32 i = 0; i < triangles_count; ++i) {
+		u32 misses = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			const int v = indices[i * 3 + k];
+			if (time - timestamps[v] > CACHE_SIZE) {
+				timestamps[v] = time++;
+				++misses;
+			}
+		}
+		if (misses == 3 && i - cluster_start >= MIN_CLUSTER_TRIANGLES) {
+			clusters.push({0, cluster_start, i});
+			cluster_start = i;
+		}
+	}
+	clusters.push({0, cluster_start, triangles_count});
+	if (clusters.size() < 2) return;
+
+	Vec3 mesh_centroid(0);
+	for (const Vec3& p : positions) mesh_centroid += p;
+	mesh_centroid *= 1.f / maximum(positions.size(), 1);
+
+	for (Cluster& cluster : clusters) {
+		Vec3 centroid(0);
+		Vec3 normal(0);
+		float area = 0;
+		for (u32 i = cluster.from; i < cluster.to; ++i) {
+			const Vec3& a = positions[indices[i * 3]];
+			const Vec3& b = positions[indices[i * 3 + 1]];
+			const Vec3& c = positions[indices[i * 3 + 2]];
+			const Vec3 n = crossProduct(b - a, c - a);
+			const float tri_area = n.length();
+			centroid += (a + b + c) * (tri_area / 3);
+			normal += n;
+			area += tri_area;
+		}
+		if (area > 0) centroid *= 1 / area;
+		const float normal_len = normal.length();
+		if (normal_len > 0) normal *= 1 / normal_len;
+		cluster.key = dotProduct(centroid - mesh_centroid, normal);
+	}
+
+	qsort(clusters.begin(), clusters.size(), sizeof(clusters[0]), [](const void* a, const void* b) -> int {
+		const float ka = ((const Cluster*)a)->key;
+		const float kb = ((const Cluster*)b)->key;
+		return ka > kb ? -1 : (ka < kb ? 1 : 0);
+	});
+
+	Array<int> out(allocator);
+	out.reserve(indices.size());
+	for (const Cluster& cluster : clusters) {
+		for (u32 i = cluster.from * 3; i < cluster.to * 3; ++i) out.push(indices[i]);
+	}
+	indices.swap(out);
+}
+
+
+// vertices are stored in the order they are first used
+static void optimizeVertexFetch(FBXImporter::ImportMesh& mesh, int vertex_size, IAllocator& allocator)
+{
+	const u32 vertex_count = u32(mesh.vertex_data.getPos() / vertex_size);
+	Array<int> remap(allocator);
+	remap.resize(vertex_count);
+	for (int& i : remap) i = -1;
+
+	OutputMemoryStream vertex_data(allocator);
+	vertex_data.reserve(mesh.vertex_data.getPos());
+	const u8* src = (const u8*)mesh.vertex_data.getData();
+	int next = 0;
+	for (int& idx : mesh.indices) {
+		if (remap[idx] < 0) {
+			remap[idx] = next++;
+			vertex_data.write(src + idx * vertex_size, vertex_size);
+		}
+		idx = remap[idx];
+	}
+	mesh.vertex_data.clear();
+	mesh.vertex_data.write(vertex_data.getData(), vertex_data.getPos());
+}
+
+
+// symmetric 4x4 matrix of plane equations, error is the sum of squared distances to the planes
+struct Quadric
+{
+	static Quadric fromPlane(const Vec3& n, float d, float weight) {
+		Quadric q;
+		q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight; q.ad = n.x * d * weight;
+		q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+		q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+		q.d2 = d * d * weight;
+		return q;
+	}
+
+	void add(const Quadric& q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+	}
+
+	float error(const Vec3& p) const {
+		return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+			+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+			+ c2 * p.z * p.z + 2 * cd * p.z
+			+ d2;
+	}
+
+	float a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+};
+
+
+// quadric error edge collapses to existing vertices, until `target_indices_count` is reached or nothing can collapse
+// vertices on borders and attribute seams are locked, so they keep their position and attributes
+static void simplifyMesh(Array<int>& indices, const Array<Vec3>& positions, u32 target_indices_count, IAllocator& allocator)
+{
+	const u32 vertex_count = positions.size();
+
+	// vertices with the same position, e.g. on uv seams, are welded to the first of them
+	Array<u32> weld(allocator);
+	weld.resize(vertex_count);
+	HashMap<u64, u32> first_at_position(allocator);
+	for (u32 i = 0; i < vertex_count; ++i) {
+		const u64 key = hash64(&positions[i], sizeof(positions[i]));
+		auto iter = first_at_position.find(key);
+		if (!iter.isValid()) {
+			first_at_position.insert(key, i);
+			weld[i] = i;
+		}
+		else {
+			weld[i] = positions[iter.value()] == positions[i] ? iter.value() : i;
+		}
+	}
+
+	Array<bool> locked(allocator);
+	locked.resize(vertex_count);
+	for (u32 i = 0; i < vertex_count; ++i) locked[i] = false;
+	for (u32 i = 0; i < vertex_count; ++i) {
+		if (weld[i] != i) locked[i] = locked[weld[i]] = true;
+	}
+	// borders and non-manifold edges
+	HashMap<u64, u32> edges(allocator);
+	auto getEdgeKey = [&](int a, int b) {
+		const u64 wa = weld[a];
+		const u64 wb = weld[b];
+		return wa < wb ? (wa << 32) | wb : (wb << 32) | wa;
+	};
+	for (u32 i = 0, c = indices.size(); i < c; ++i) {
+		const u64 key = getEdgeKey(indices[i], indices[i - i % 3 + (i + 1) % 3]);
+		auto iter = edges.find(key);
+		if (iter.isValid()) ++iter.value();
+		else edges.insert(key, 1);
+	}
+	for (auto iter = edges.begin(), end = edges.end(); iter != end; ++iter) {
+		if (iter.value() == 2) continue;
+		locked[u32(iter.key() >> 32)] = true;
+		locked[u32(iter.key() & 0xffFFffFF)] = true;
+	}
+
+	Array<Quadric> quadrics(allocator);
+	quadrics.resize(vertex_count);
+	for (u32 i = 0, count = indices.size(); i < count; i += 3) {
+		const Vec3& a = positions[indices[i]];
+		const Vec3& b = positions[indices[i + 1]];
+		const Vec3& c = positions[indices[i + 2]];
+		Vec3 n = crossProduct(b - a, c - a);
+		const float area = n.length();
+		if (area == 0) continue;
+		n *= 1 / area;
+		const Quadric q = Quadric::fromPlane(n, -dotProduct(n, a), area);
+		for (u32 k = 0; k < 3; ++k) quadrics[weld[indices[i + k]]].add(q);
+	}
+
+	struct Collapse {
+		float cost;
+		int from;
+		int to;
+	};
+	Array<Collapse> collapses(allocator);
+	Array<u32> adjacency_offset(allocator);
+	Array<u32> adjacency_count(allocator);
+	Array<u32> adjacency(allocator);
+	Array<bool> touched(allocator);
+	Array<int> collapse_to(allocator);
+	adjacency_offset.resize(vertex_count);
+	adjacency_count.resize(vertex_count);
+	touched.resize(vertex_count);
+	collapse_to.resize(vertex_count);
+
+	while (indices.size() > target_indices_count) {
+		// triangles using each vertex
+		memset(adjacency_count.begin(), 0, adjacency_count.byte_size());
+		for (int i : indices) ++adjacency_count[weld[i]];
+		u32 offset = 0;
+		for (u32 i = 0; i < vertex_count; ++i) {
+			adjacency_offset[i] = offset;
+			offset += adjacency_count[i];
+			adjacency_count[i] = 0;
+		}
+		adjacency.resize(indices.size());
+		for (u32 i = 0, c = indices.size(); i < c; ++i) {
+			const u32 w = weld[indices[i]];
+			adjacency[adjacency_offset[w] + adjacency_count[w]] = i / 3;
+			++adjacency_count[w];
+		}
+
+		collapses.clear();
+		for (u32 i = 0, c = indices.size(); i < c; ++i) {
+			const int from = indices[i];
+			const int to = indices[i - i % 3 + (i + 1) % 3];
+			if (locked[from] || weld[from] == weld[to]) continue;
+			Quadric q = quadrics[from];
+			q.add(quadrics[weld[to]]);
+			collapses.push({q.error(positions[to]), from, to});
+		}
+		if (collapses.empty()) break;
+		qsort(collapses.begin(), collapses.size(), sizeof(collapses[0]), [](const void* a, const void* b) -> int {
+			const float ca = ((const Collapse*)a)->cost;
+			const float cb = ((const Collapse*)b)->cost;
+			return ca < cb ? -1 : (ca > cb ? 1 : 0);
+		});
+
+		for (u32 i = 0; i < vertex_count; ++i) {
+			touched[i] = false;
+			collapse_to[i] = i;
+		}
+
+		// collapses touching the same triangles are left for the next pass, their costs are stale
+		u32 indices_count = indices.size();
+		bool any_collapse = false;
+		for (const Collapse& collapse : collapses) {
+			if (indices_count <= target_indices_count) break;
+			const u32 w_from = collapse.from;
+			const u32 w_to = weld[collapse.to];
+			if (touched[w_from] || touched[w_to]) continue;
+
+			const u32* adj = &adjacency[adjacency_offset[w_from]];
+			const Vec3& new_pos = positions[collapse.to];
+			u32 removed_triangles = 0;
+			bool flips = false;
+			for (u32 j = 0; j < adjacency_count[w_from] && !flips; ++j) {
+				const int* tri = &indices[adj[j] * 3];
+				if (weld[tri[0]] == w_to || weld[tri[1]] == w_to || weld[tri[2]] == w_to) {
+					++removed_triangles;
+					continue;
+				}
+				bool neighbour_touched = false;
+				Vec3 p[3];
+				for (u32 k = 0; k < 3; ++k) {
+					neighbour_touched = neighbour_touched || (tri[k] != collapse.from && touched[weld[tri[k]]]);
+					p[k] = positions[tri[k]];
+				}
+				const Vec3 n_before = crossProduct(p[1] - p[0], p[2] - p[0]);
+				for (u32 k = 0; k < 3; ++k) {
+					if (tri[k] == collapse.from) p[k] = new_pos;
+				}
+				const Vec3 n_after = crossProduct(p[1] - p[0], p[2] - p[0]);
+				// folds over and degenerate triangles count as flipped
+				flips = neighbour_touched
+					|| dotProduct(n_before, n_after) <= 0.5f * n_before.length() * n_after.length()
+					|| n_after.squaredLength() < 1e-6f * n_before.squaredLength();
+			}
+			if (flips) continue;
+
+			collapse_to[collapse.from] = collapse.to;
+			quadrics[w_to].add(quadrics[w_from]);
+			touched[w_from] = touched[w_to] = true;
+			for (u32 j = 0; j < adjacency_count[w_from]; ++j) {
+				const int* tri = &indices[adj[j] * 3];
+				for (u32 k = 0; k < 3; ++k) touched[weld[tri[k]]] = true;
+			}
+			indices_count -= removed_triangles * 3;
+			any_collapse = true;
+		}
+		if (!any_collapse) break;
+
+		u32 dst = 0;
+		for (u32 i = 0, count = indices.size(); i < count; i += 3) {
+			const int a = collapse_to[indices[i]];
+			const int b = collapse_to[indices[i + 1]];
+			const int c = collapse_to[indices[i + 2]];
+			if (weld[a] == weld[b] || weld[b] == weld[c] || weld[a] == weld[c]) continue;
+			indices[dst] = a;
+			indices[dst + 1] = b;
+			indices[dst + 2] = c;
+			dst += 3;
+		}
+		indices.resize(dst);
+	}
+}
+
+
 void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 {
 	for (int mesh_idx = 0; mesh_idx < meshes.size(); ++mesh_idx)
@@ -489,6 +981,38 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 			logError("FBX") << "Mesh " << mesh.name << " in " << path << " flips handness. This is not supported and the mesh will not display correctly.";
 		}
 
+		auto getPosition = [&](int i){
+			// premultiply control points here, so we can have constantly-scaled meshes without scale in bones
+			const Vec3 pos = transform_matrix.transformPoint(toLumixVec3(vertices[i])) * cfg.mesh_scale * fbx_scale;
+			return fixOrientation(pos);
+		};
+
+		// compute skinning reads float positions
+		import_mesh.quantized_positions = cfg.quantize_vertices && !import_mesh.is_skinned;
+		import_mesh.half_uvs = false;
+		if (import_mesh.quantized_positions) {
+			float max_coord = 0;
+			for (int i = 0; i < vertex_count; ++i) {
+				const Vec3 pos = getPosition(i);
+				max_coord = maximum(max_coord, fabsf(pos.x), fabsf(pos.y), fabsf(pos.z));
+			}
+			// smallest power of two step which covers the mesh with 16 bits
+			i16 exponent = -24;
+			while (exponent < 15 && 32767 * powf(2, exponent) < max_coord) ++exponent;
+			import_mesh.position_exponent = exponent;
+
+			// half floats lose too much precision on tiled UVs
+			if (uvs) {
+				import_mesh.half_uvs = true;
+				for (int i = 0; i < vertex_count; ++i) {
+					if (fabs(uvs[i].x) > 2 || fabs(uvs[i].y) > 2) {
+						import_mesh.half_uvs = false;
+						break;
+					}
+				}
+			}
+		}
+
 		OutputMemoryStream blob(allocator);
 		int vertex_size = getVertexSize(import_mesh);
 		import_mesh.vertex_data.reserve(vertex_count * vertex_size);
@@ -519,11 +1043,13 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 			if (geom_materials && geom_materials[i / 3] != material_idx) continue;
 
 			blob.clear();
-			ofbx::Vec3 cp = vertices[i];
-			// premultiply control points here, so we can have constantly-scaled meshes without scale in bones
-			Vec3 pos = transform_matrix.transformPoint(toLumixVec3(cp)) * cfg.mesh_scale * fbx_scale;
-			pos = fixOrientation(pos);
-			blob.write(pos);
+			Vec3 pos = getPosition(i);
+			if (import_mesh.quantized_positions) {
+				pos = quantizePosition(pos, import_mesh.position_exponent, &blob);
+			}
+			else {
+				blob.write(pos);
+			}
 
 			float sq_len = pos.squaredLength();
 			radius_squared = maximum(radius_squared, sq_len);
@@ -536,7 +1062,7 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 			aabb.max.z = maximum(aabb.max.z, pos.z);
 
 			if (normals) writePackedVec3(normals[i], transform_matrix, &blob);
-			if (uvs) writeUV(uvs[i], &blob);
+			if (uvs) writeUV(uvs[i], import_mesh.half_uvs, &blob);
 			if (colors) writeColor(colors[i], &blob);
 			if (tangents) writePackedVec3(tangents[i], transform_matrix, &blob);
 			if (import_mesh.is_skinned) writeSkin(skinning[i], &blob);
@@ -559,6 +1085,16 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 
 		import_mesh.aabb = aabb;
 		import_mesh.radius_squared = radius_squared;
+
+		if (cfg.optimize_meshes && !import_mesh.indices.empty()) {
+			PROFILE_BLOCK("optimize mesh");
+			const u32 unique_vertex_count = u32(import_mesh.vertex_data.getPos() / vertex_size);
+			optimizeVertexCache(import_mesh.indices, unique_vertex_count, allocator);
+			Array<Vec3> positions(allocator);
+			getPositions(import_mesh, vertex_size, positions);
+			optimizeOverdraw(import_mesh.indices, positions, allocator);
+			optimizeVertexFetch(import_mesh, vertex_size, allocator);
+		}
 	}
 	for (int mesh_idx = meshes.size() - 1; mesh_idx >= 0; --mesh_idx)
 	{
@@ -567,6 +1103,59 @@ void FBXImporter::postprocessMeshes(const ImportConfig& cfg, const char* path)
 }
 
 
+void FBXImporter::generateLODs(const ImportConfig& cfg)
+{
+	for (const ImportMesh& mesh : meshes) {
+		if (mesh.lod > 0) return;
+	}
+
+	PROFILE_FUNCTION();
+	const u32 src_count = meshes.size();
+	for (u32 lod = 1; lod <= lengthOf(cfg.autolod_ratios); ++lod) {
+		const float ratio = cfg.autolod_ratios[lod - 1];
+		if (ratio <= 0) break;
+		if (cfg.lods_distances[lod - 1] < 0) {
+			logWarning("FBX") << "LOD " << lod - 1 << " has infinite distance, generated LOD " << lod << " is never used";
+		}
+
+		for (u32 i = 0; i < src_count; ++i) {
+			if (!meshes[i].import) continue;
+
+			ImportMesh& lod_mesh = meshes.emplace(allocator);
+			const ImportMesh& src = meshes[i];
+			lod_mesh.fbx = src.fbx;
+			lod_mesh.fbx_mat = src.fbx_mat;
+			lod_mesh.is_skinned = src.is_skinned;
+			lod_mesh.bone_idx = src.bone_idx;
+			lod_mesh.lod = lod;
+			lod_mesh.submesh = src.submesh;
+			lod_mesh.aabb = src.aabb;
+			lod_mesh.radius_squared = src.radius_squared;
+			lod_mesh.transform_matrix = src.transform_matrix;
+			lod_mesh.quantized_positions = src.quantized_positions;
+			lod_mesh.position_exponent = src.position_exponent;
+			lod_mesh.half_uvs = src.half_uvs;
+			lod_mesh.vertex_data.write(src.vertex_data.getData(), src.vertex_data.getPos());
+			lod_mesh.indices.reserve(src.indices.size());
+			for (int idx : src.indices) lod_mesh.indices.push(idx);
+
+			const int vertex_size = getVertexSize(lod_mesh);
+			Array<Vec3> positions(allocator);
+			getPositions(lod_mesh, vertex_size, positions);
+			const u32 target_indices_count = u32(src.indices.size() / 3 * ratio) * 3;
+			simplifyMesh(lod_mesh.indices, positions, maximum(target_indices_count, 3u), allocator);
+			if (cfg.optimize_meshes) {
+				optimizeVertexCache(lod_mesh.indices, positions.size(), allocator);
+				getPositions(lod_mesh, vertex_size, positions);
+				optimizeOverdraw(lod_mesh.indices, positions, allocator);
+			}
+			// drops vertices not used by the simplified mesh
+			optimizeVertexFetch(lod_mesh, vertex_size, allocator);
+		}
+	}
+}
+
+
 static int detectMeshLOD(const FBXImporter::ImportMesh& mesh)
 {
 	const char* node_name = mesh.fbx->name;
@@ -638,6 +1227,12 @@ FBXImporter::FBXImporter(StudioApp& app)
 }
 
 
+static void ofbxJobProcessor(ofbx::JobFunction fn, void*, void* data, u32 size, u32 count) {
+	JobSystem::forEach(count, [&](u32 idx){
+		fn((u8*)data + idx * size);
+	});
+}
+
 bool FBXImporter::setSource(const char* filename, bool ignore_geometry)
 {
 	out_file.reserve(1024 * 1024);
@@ -655,7 +1250,7 @@ bool FBXImporter::setSource(const char* filename, bool ignore_geometry)
 	if (!filesystem.getContentSync(Path(filename), Ref(data))) return false;
 	
 	const u64 flags = ignore_geometry ? (u64)ofbx::LoadFlags::IGNORE_GEOMETRY : (u64)ofbx::LoadFlags::TRIANGULATE;
-	scene = ofbx::load(&data[0], data.size(), flags);
+	scene = ofbx::load(&data[0], data.size(), flags, &ofbxJobProcessor, nullptr);
 	if (!scene)
 	{
 		logError("FBX") << "Failed to import \"" << filename << ": " << ofbx::getError() << "\n"
@@ -688,6 +1283,14 @@ bool FBXImporter::setSource(const char* filename, bool ignore_geometry)
 
 void FBXImporter::writeString(const char* str) { out_file.write(str, stringLength(str)); }
 
+
+void FBXImporter::writeBlobPadding()
+{
+	const u8 zeros[Model::BLOB_ALIGNMENT] = {};
+	const u64 pos = out_file.getPos();
+	write(zeros, ((pos + Model::BLOB_ALIGNMENT - 1) & ~u64(Model::BLOB_ALIGNMENT - 1)) - pos);
+}
+
 static Vec3 impostorToWorld(Vec2 uv) {
 	Vec3 position = Vec3(
 						0.0f + (uv.x - uv.y),
@@ -706,6 +1309,9 @@ static Vec3 impostorToWorld(Vec2 uv) {
 static constexpr u32 IMPOSTOR_TILE_SIZE = 512;
 static constexpr u32 IMPOSTOR_COLS = 9;
 
+// must match "Depth range" uniform in _impostor.mat
+static float getImpostorDepthRange(float bounding_radius) { return 2 * bounding_radius; }
+
 static void getBBProjection(const AABB& aabb, Ref<Vec2> out_min, Ref<Vec2> out_max) {
 	const float radius = (aabb.max - aabb.min).length() * 0.5f;
 	const Vec3 center = (aabb.min + aabb.max) * 0.5f;
@@ -744,6 +1350,7 @@ struct CaptureImpostorJob : Renderer::RenderJob {
 		, m_gb1(gb1)
 		, m_tile_size(size)
 		, m_drawcalls(allocator)
+		, m_allocator(allocator)
 	{
 	}
 
@@ -839,6 +1446,21 @@ struct CaptureImpostorJob : Renderer::RenderJob {
 		gpu::readTexture(staging, Span((u8*)m_gb1->begin(), m_gb1->byte_size()));
 		gpu::destroy(staging);
 
+		// depth replaces metallic in gb1.a, impostor.shd gets metallic from the material;
+		// stored as offset from the billboard plane in [-depth_range, depth_range] mapped to [0, 1]
+		Array<u32> depth(m_allocator);
+		depth.resize(m_gb0->size());
+		gpu::readTexture(gbs[2], Span((u8*)depth.begin(), depth.byte_size()));
+		const float depth_range = getImpostorDepthRange(m_radius);
+		for (u32 i = 0, c = depth.size(); i < c; ++i) {
+			// reversed z ortho projection with near = 0 and far = 5 * radius, camera is 2 * radius in front of the billboard
+			const float d = (depth[i] >> 8) / float(0xffFFff);
+			const float dist = 5 * m_radius * (1 - d);
+			const float offset = 2 * m_radius - dist;
+			const u32 encoded = u32(clamp(0.5f + 0.5f * offset / depth_range, 0.f, 1.f) * 255 + 0.5f);
+			m_gb1.value[i] = (m_gb1.value[i] & 0x00ffFFff) | (encoded << 24);
+		}
+
 		gpu::destroy(ub);
 		gpu::destroy(gbs[0]);
 		gpu::destroy(gbs[1]);
@@ -851,6 +1473,7 @@ struct CaptureImpostorJob : Renderer::RenderJob {
 		const Material::RenderData* material;
 	};
 
+	IAllocator& m_allocator;
 	Array<Drawcall> m_drawcalls;
 	AABB m_aabb;
 	float m_radius;
@@ -870,6 +1493,7 @@ bool FBXImporter::createImpostorTextures(Model* model, Ref<Array<u32>> gb0_rgba,
 	ASSERT(renderer);
 
 	IAllocator& allocator = renderer->getAllocator();
+	model->makeLODResident(0);
 	CaptureImpostorJob* job = LUMIX_NEW(allocator, CaptureImpostorJob)(gb0_rgba, gb1_rgba, size, allocator);
 	job->m_model = model;
 	job->m_capture_define = 1 << renderer->getShaderDefineIdx("DEFERRED");
@@ -957,6 +1581,11 @@ void FBXImporter::writeMaterials(const char* src, const ImportConfig& cfg)
 				f << "texture \"" << src_info.m_basename << "_impostor1.tga\"\n";
 				f << "defines { \"ALPHA_CUTOUT\" }\n";
 				f << "backface_culling(false)\n";
+				float radius_squared = 0;
+				for (const ImportMesh& mesh : meshes) {
+					if (mesh.import) radius_squared = maximum(radius_squared, mesh.radius_squared);
+				}
+				f << "uniform(\"Depth range\", " << getImpostorDepthRange(sqrtf(radius_squared) * bounding_shape_scale) << ")\n";
 				f.close();
 			}
 		}
@@ -984,14 +1613,15 @@ static void fillTimes(const ofbx::AnimationCurve* curve, Ref<Array<T>> out){
 			out->emplace().time = times[i];
 		}
 		else {
-			for (const T& k : out.value) {
-				if (k.time == times[i]) break;
-				if (times[i] < k.time) {
-					const u32 idx = u32(&k - out->begin());
-					out->emplaceAt(idx).time = times[i];
-					break;
-				}
+			// first key not before times[i], out is sorted
+			u32 lo = 0;
+			u32 hi = out->size();
+			while (lo < hi) {
+				const u32 mid = (lo + hi) >> 1;
+				if (out.value[mid].time < times[i]) lo = mid + 1;
+				else hi = mid;
 			}
+			if (out.value[lo].time != times[i]) out->emplaceAt(lo).time = times[i];
 		}
 	}
 };
@@ -1005,17 +1635,20 @@ static float evalCurve(i64 time, const ofbx::AnimationCurve& curve) {
 
 	time = clamp(time, times[0], times[count - 1]);
 
-	for (int i = 0; i < count; ++i) {
-		if (time == times[i]) return values[i];
-		if (time < times[i]) {
-			ASSERT(i > 0);
-			ASSERT(time > times[i - 1]);
-			const float t = float((time - times[i - 1]) / double(times[i] - times[i - 1]));
-			return values[i - 1] * (1 - t) + values[i] * t;
-		}
+	// first key not before time
+	int lo = 0;
+	int hi = count - 1;
+	while (lo < hi) {
+		const int mid = (lo + hi) >> 1;
+		if (times[mid] < time) lo = mid + 1;
+		else hi = mid;
 	}
-	ASSERT(false);
-	return 0.f;
+
+	if (time == times[lo]) return values[lo];
+	ASSERT(lo > 0);
+	ASSERT(time > times[lo - 1]);
+	const float t = float((time - times[lo - 1]) / double(times[lo] - times[lo - 1]));
+	return values[lo - 1] * (1 - t) + values[lo] * t;
 };
 
 // parent_scale - animated scale is not supported, but we can get rid of static scale if we ignore
@@ -1215,7 +1848,7 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 
 		Animation::Header header;
 		header.magic = Animation::HEADER_MAGIC;
-		header.version = 3;
+		header.version = (u32)Animation::FileVersion::LATEST;
 		header.length = Time::fromSeconds((float)anim_len);
 		header.frame_count = u32(anim_len * fps + 0.5f);
 		write(header);
@@ -1229,19 +1862,23 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 		};
 
 		all_keys.reserve(bones.size());
-		for (const ofbx::Object* bone : bones) {
-			Array<Key>& keys = all_keys.emplace(allocator);
-			fill(*bone, anim_len, *layer, Ref(keys));
-		}
+		for (u32 i = 0, c = bones.size(); i < c; ++i) all_keys.emplace(allocator);
 
-		for (const ofbx::Object*& bone : bones) {
-			Array<Key>& keys = all_keys[u32(&bone - bones.begin())];
+		// tracks are independent
+		JobSystem::forEach(bones.size(), [&](u32 idx){
+			PROFILE_BLOCK("compress track");
+			const ofbx::Object* bone = bones[idx];
+			Array<Key>& keys = all_keys[idx];
+			fill(*bone, anim_len, *layer, Ref(keys));
 			const float parent_scale = bone->getParent() ? (float)getScaleX(bone->getParent()->getGlobalTransform()) : 1;
 			// TODO skip curves which do not change anything
 			compressRotations(cfg.rotation_error, Ref(keys));
 			compressPositions(cfg.position_error, parent_scale, Ref(keys));
-		}
+		});
 
+		Array<u16> times(allocator);
+		Array<Vec3> positions(allocator);
+		Array<Quat> rotations(allocator);
 		const u64 stream_translations_count_pos = out_file.getPos();
 		u32 translation_curves_count = 0;
 		write(translation_curves_count);
@@ -1254,21 +1891,15 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 			if (count == 0) continue;
 			if (isBindPosePositionTrack(count, keys, *bone, cfg.position_error)) continue;
 			
-			const u32 name_hash = crc32(bone->name);
-			write(name_hash);
-			write(Animation::CurveType::KEYFRAMED);
-			write(count);
-
-			for (Key& key : keys) {
-				if ((key.flags & 1) == 0) {
-					write(fbx_to_anim_time(key.time));
-				}
-			}
+			times.clear();
+			positions.clear();
 			for (Key& key : keys) {
 				if ((key.flags & 1) == 0) {
-					write(fixOrientation(key.pos * cfg.mesh_scale * fbx_scale));
+					times.push(fbx_to_anim_time(key.time));
+					positions.push(fixOrientation(key.pos * cfg.mesh_scale * fbx_scale));
 				}
 			}
+			writeTranslationCurve(out_file, crc32(bone->name), Animation::CurveType::KEYFRAMED, times, positions, cfg.position_error * cfg.mesh_scale * fbx_scale);
 			++translation_curves_count;
 		}
 		memcpy(out_file.getMutableData() + stream_translations_count_pos, &translation_curves_count, sizeof(translation_curves_count));
@@ -1287,30 +1918,25 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 			if (count == 0) continue;
 
 			const u32 name_hash = crc32(bone->name);
-			write(name_hash);
-			if (shouldSample(count, float(anim_len), fps, sizeof(Quat))) {
+			times.clear();
+			rotations.clear();
+			if (shouldSample(count, float(anim_len), fps, sizeof(CompressedQuat))) {
 				++sampled_count;
-				write(Animation::CurveType::SAMPLED);
 				count = u32(anim_len * fps + 0.5f);
-				write(count);
 				for (u32 i = 0; i < count; ++i) {
 					const float t = float(anim_len * ((float)i / (count - 1)));
-					write(fixOrientation(sample(*bone, *layer, t).rot));
+					rotations.push(fixOrientation(sample(*bone, *layer, t).rot));
 				}
+				writeRotationCurve(out_file, name_hash, Animation::CurveType::SAMPLED, times, rotations, cfg.rotation_error);
 			}
 			else {
-				write(Animation::CurveType::KEYFRAMED);
-				write(count);
-				for (Key& key : keys) {
-					if ((key.flags & 2) == 0) {
-						write(fbx_to_anim_time(key.time));
-					}
-				}
 				for (Key& key : keys) {
 					if ((key.flags & 2) == 0) {
-						write(fixOrientation(key.rot));
+						times.push(fbx_to_anim_time(key.time));
+						rotations.push(fixOrientation(key.rot));
 					}
 				}
+				writeRotationCurve(out_file, name_hash, Animation::CurveType::KEYFRAMED, times, rotations, cfg.rotation_error);
 			}
 			++rotation_curves_count;
 		}
@@ -1323,10 +1949,10 @@ void FBXImporter::writeAnimations(const char* src, const ImportConfig& cfg)
 
 int FBXImporter::getVertexSize(const ImportMesh& mesh) const
 {
-	static const int POSITION_SIZE = sizeof(float) * 3;
+	const int POSITION_SIZE = mesh.quantized_positions ? sizeof(i16) * 4 : sizeof(float) * 3;
 	static const int NORMAL_SIZE = sizeof(u8) * 4;
 	static const int TANGENT_SIZE = sizeof(u8) * 4;
-	static const int UV_SIZE = sizeof(float) * 2;
+	const int UV_SIZE = mesh.half_uvs ? sizeof(u16) * 2 : sizeof(float) * 2;
 	static const int COLOR_SIZE = sizeof(u8) * 4;
 	static const int BONE_INDICES_WEIGHTS_SIZE = sizeof(float) * 4 + sizeof(u16) * 4;
 	int size = POSITION_SIZE;
@@ -1461,6 +2087,7 @@ void FBXImporter::writeImpostorVertices(const AABB& aabb)
 
 	const u32 vertex_data_size = sizeof(vertices);
 	write(vertex_data_size);
+	writeBlobPadding();
 	for (const Vertex& vertex : vertices) {
 		write(vertex.pos);
 		write(vertex.normal);
@@ -1483,6 +2110,7 @@ void FBXImporter::writeGeometry(int mesh_idx)
 		int index_size = sizeof(u16);
 		write(index_size);
 		write(import_mesh.indices.size());
+		writeBlobPadding();
 		for (int i : import_mesh.indices)
 		{
 			ASSERT(i <= (1 << 16));
@@ -1495,12 +2123,14 @@ void FBXImporter::writeGeometry(int mesh_idx)
 		int index_size = sizeof(import_mesh.indices[0]);
 		write(index_size);
 		write(import_mesh.indices.size());
+		writeBlobPadding();
 		write(&import_mesh.indices[0], sizeof(import_mesh.indices[0]) * import_mesh.indices.size());
 	}
 	aabb.merge(import_mesh.aabb);
 	radius_squared = maximum(radius_squared, import_mesh.radius_squared);
 
 	write((i32)import_mesh.vertex_data.getPos());
+	writeBlobPadding();
 	write(import_mesh.vertex_data.getData(), import_mesh.vertex_data.getPos());
 
 	write(sqrtf(radius_squared) * bounding_shape_scale);
@@ -1524,6 +2154,7 @@ void FBXImporter::writeGeometry(const ImportConfig& cfg)
 			int index_size = sizeof(u16);
 			write(index_size);
 			write(import_mesh.indices.size());
+			writeBlobPadding();
 			for (int i : import_mesh.indices)
 			{
 				ASSERT(i <= (1 << 16));
@@ -1536,6 +2167,7 @@ void FBXImporter::writeGeometry(const ImportConfig& cfg)
 			int index_size = sizeof(import_mesh.indices[0]);
 			write(index_size);
 			write(import_mesh.indices.size());
+			writeBlobPadding();
 			write(&import_mesh.indices[0], sizeof(import_mesh.indices[0]) * import_mesh.indices.size());
 		}
 		aabb.merge(import_mesh.aabb);
@@ -1548,6 +2180,7 @@ void FBXImporter::writeGeometry(const ImportConfig& cfg)
 		const u16 indices[] = {0, 1, 2, 0, 2, 3};
 		const u32 len = lengthOf(indices);
 		write(len);
+		writeBlobPadding();
 		write(indices, sizeof(indices));
 	}
 
@@ -1555,6 +2188,7 @@ void FBXImporter::writeGeometry(const ImportConfig& cfg)
 	{
 		if (!import_mesh.import) continue;
 		write((i32)import_mesh.vertex_data.getPos());
+		writeBlobPadding();
 		write(import_mesh.vertex_data.getData(), import_mesh.vertex_data.getPos());
 	}
 	if (cfg.create_impostor) {
@@ -1623,8 +2257,14 @@ void FBXImporter::writeMeshes(const char* src, int mesh_idx, const ImportConfig&
 		write(attribute_count);
 
 		write(Mesh::AttributeSemantic::POSITION);
-		write(gpu::AttributeType::FLOAT);
-		write((u8)3);
+		if (import_mesh.quantized_positions) {
+			write(gpu::AttributeType::I16);
+			write((u8)4);
+		}
+		else {
+			write(gpu::AttributeType::FLOAT);
+			write((u8)3);
+		}
 		const ofbx::Geometry* geom = mesh.getGeometry();
 		if (geom->getNormals()) {
 			write(Mesh::AttributeSemantic::NORMAL);
@@ -1634,7 +2274,7 @@ void FBXImporter::writeMeshes(const char* src, int mesh_idx, const ImportConfig&
 		}
 		if (geom->getUVs()) {
 			write(Mesh::AttributeSemantic::TEXCOORD0);
-			write(gpu::AttributeType::FLOAT);
+			write(import_mesh.half_uvs ? gpu::AttributeType::HALF : gpu::AttributeType::FLOAT);
 			write((u8)2);
 		}
 		if (geom->getColors() && import_vertex_colors) {
@@ -1727,6 +2367,90 @@ void FBXImporter::writeSkeleton(const ImportConfig& cfg)
 }
 
 
+// smaller meshes are not worth the per-meshlet culling
+static constexpr u32 MESHLETS_MIN_TRIANGLES = 8 * Meshlet::MAX_TRIANGLES;
+
+
+void FBXImporter::writeMeshlets(const ImportMesh& mesh, const ImportConfig& cfg)
+{
+	const u32 triangles_count = mesh.indices.size() / 3;
+	// skinned meshes are never culled on GPU
+	if (!cfg.meshlets || mesh.is_skinned || !mesh.import || triangles_count < MESHLETS_MIN_TRIANGLES) {
+		write((u32)0);
+		return;
+	}
+
+	PROFILE_FUNCTION();
+	Array<Vec3> positions(allocator);
+	getPositions(mesh, getVertexSize(mesh), positions);
+	const u32 vertex_count = positions.size();
+
+	Array<Meshlet> meshlets(allocator);
+	Array<u32> vertex_meshlet(allocator);
+	vertex_meshlet.resize(vertex_count);
+	for (u32& i : vertex_meshlet) i = 0xffFFffFF;
+	Array<int> meshlet_vertices(allocator);
+
+	auto finishMeshlet = [&](u32 from_triangle, u32 to_triangle) {
+		Meshlet& m = meshlets.emplace();
+		AABB aabb(positions[meshlet_vertices[0]], positions[meshlet_vertices[0]]);
+		for (int v : meshlet_vertices) aabb.addPoint(positions[v]);
+		m.center = (aabb.min + aabb.max) * 0.5f;
+		m.radius = 0;
+		for (int v : meshlet_vertices) m.radius = maximum(m.radius, (positions[v] - m.center).length());
+		m.first_index = from_triangle * 3;
+		m.indices_count = (to_triangle - from_triangle) * 3;
+
+		// counter clockwise triangles are front facing
+		auto getNormal = [&](u32 triangle) {
+			const int* idx = &mesh.indices[triangle * 3];
+			const Vec3 n = crossProduct(positions[idx[1]] - positions[idx[0]], positions[idx[2]] - positions[idx[0]]);
+			const float len = n.length();
+			return len > 0 ? n * (1 / len) : Vec3(0);
+		};
+		Vec3 axis(0);
+		for (u32 i = from_triangle; i < to_triangle; ++i) axis += getNormal(i);
+		const float axis_len = axis.length();
+		m.cone_axis = axis_len > 0 ? axis * (1 / axis_len) : Vec3(0, 0, 1);
+		float min_dot = 1;
+		for (u32 i = from_triangle; i < to_triangle; ++i) {
+			const Vec3 n = getNormal(i);
+			if (n.squaredLength() > 0) min_dot = minimum(min_dot, dotProduct(n, m.cone_axis));
+		}
+		// cutoff 1 never culls, wide cones are not worth testing
+		m.cone_cutoff = axis_len > 0 && min_dot > 0.1f ? sqrtf(1 - min_dot * min_dot) : 1;
+		meshlet_vertices.clear();
+	};
+
+	// greedy, triangles keep their order, so each meshlet is a range of the index buffer
+	u32 first_triangle = 0;
+	for (u32 tri = 0; tri < triangles_count; ++tri) {
+		const int* idx = &mesh.indices[tri * 3];
+		const u32 current = meshlets.size();
+		u32 new_vertices = 0;
+		for (u32 k = 0; k < 3; ++k) {
+			if (vertex_meshlet[idx[k]] == current) continue;
+			if (k > 0 && idx[0] == idx[k]) continue;
+			if (k > 1 && idx[1] == idx[k]) continue;
+			++new_vertices;
+		}
+		if (tri - first_triangle == Meshlet::MAX_TRIANGLES || meshlet_vertices.size() + new_vertices > Meshlet::MAX_VERTICES) {
+			finishMeshlet(first_triangle, tri);
+			first_triangle = tri;
+		}
+		for (u32 k = 0; k < 3; ++k) {
+			if (vertex_meshlet[idx[k]] == meshlets.size()) continue;
+			vertex_meshlet[idx[k]] = meshlets.size();
+			meshlet_vertices.push(idx[k]);
+		}
+	}
+	finishMeshlet(first_triangle, triangles_count);
+
+	write((u32)meshlets.size());
+	write(meshlets.begin(), meshlets.byte_size());
+}
+
+
 void FBXImporter::writeLODs(const ImportConfig& cfg)
 {
 	i32 lod_count = 1;
@@ -1795,7 +2519,7 @@ void FBXImporter::writePhysicsHeader(OS::OutputFile& file) const
 {
 	PhysicsGeometry::Header header;
 	header.m_magic = PhysicsGeometry::HEADER_MAGIC;
-	header.m_version = (u32)PhysicsGeometry::Versions::LAST;
+	header.m_version = (u32)PhysicsGeometry::Versions::SOURCE;
 	header.m_convex = (u32)make_convex;
 	file.write((const char*)&header, sizeof(header));
 }
@@ -1867,7 +2591,15 @@ bool FBXImporter::writePhysics(const char* basename, const char* output_dir)
 
 			for (int i = 0; i < vertex_count; ++i)
 			{
-				Vec3 v = *(Vec3*)(verts + i * vertex_size);
+				Vec3 v;
+				if (mesh.quantized_positions) {
+					i16 p[4];
+					memcpy(p, verts + i * vertex_size, sizeof(p));
+					v = Vec3(p[0], p[1], p[2]) * powf(2, p[3]);
+				}
+				else {
+					v = *(Vec3*)(verts + i * vertex_size);
+				}
 				file.write(&v, sizeof(v));
 			}
 		}
@@ -1895,7 +2627,7 @@ void FBXImporter::writePrefab(const char* src, const ImportConfig& cfg)
 	serializer.write("entity_count", count + 1);
 	char normalized_tmp_rel[MAX_PATH_LENGTH];
 	Path::normalize(tmp, Span(normalized_tmp_rel));
-	const u64 prefab = crc32(normalized_tmp_rel);
+	const u64 prefab = hash32(normalized_tmp_rel);
 
 	serializer.write("prefab", prefab);
 	serializer.write("parent", INVALID_ENTITY);
@@ -1963,6 +2695,8 @@ void FBXImporter::writeSubmodels(const char* src, const ImportConfig& cfg)
 		write(to_mesh);
 		write(factor);
 
+		writeMeshlets(meshes[i], cfg);
+
 		StaticString<MAX_PATH_LENGTH> resource_locator(name, ".fbx:", src);
 
 		compiler.writeCompiledResource(resource_locator, Span((u8*)out_file.getData(), (i32)out_file.getPos()));
@@ -1974,6 +2708,7 @@ void FBXImporter::writeModel(const char* src, const ImportConfig& cfg)
 {
 	PROFILE_FUNCTION();
 	postprocessMeshes(cfg, src);
+	generateLODs(cfg);
 
 	auto cmpMeshes = [](const void* a, const void* b) -> int {
 		auto a_mesh = static_cast<const ImportMesh*>(a);
@@ -1994,6 +2729,11 @@ void FBXImporter::writeModel(const char* src, const ImportConfig& cfg)
 	writeGeometry(cfg);
 	writeSkeleton(cfg);
 	writeLODs(cfg);
+	for (const ImportMesh& mesh : meshes) {
+		if (mesh.import) writeMeshlets(mesh, cfg);
+	}
+	// impostor
+	if (cfg.create_impostor) write((u32)0);
 
 	compiler.writeCompiledResource(src, Span((u8*)out_file.getData(), (i32)out_file.getPos()));
 }
@@ -27,7 +27,14 @@ struct FBXImporter
 		float mesh_scale;
 		Origin origin = Origin::SOURCE;
 		bool create_impostor = false;
+		bool quantize_vertices = false;
+		bool meshlets = false;
+		// vertex cache, overdraw and vertex fetch ordering of triangles and vertices
+		bool optimize_meshes = true;
 		float lods_distances[4] = {-10, -100, -1000, -10000};
+		// triangle ratio of generated LOD1..LOD3 relative to LOD0, <= 0 disables the LOD and all after it
+		// ignored if the fbx has its own LODs
+		float autolod_ratios[3] = {-0.5f, -0.25f, -0.125f};
 		float position_error = 0.02f;
 		float rotation_error = 0.001f;
 	};
@@ -114,6 +121,10 @@ struct FBXImporter
 		AABB aabb;
 		float radius_squared;
 		Matrix transform_matrix = Matrix::IDENTITY;
+		// positions are i16 xyz scaled by 2^position_exponent stored in w
+		bool quantized_positions = false;
+		i16 position_exponent = 0;
+		bool half_uvs = false;
 	};
 
 	FBXImporter(struct StudioApp& app);
@@ -141,12 +152,15 @@ private:
 	void gatherAnimations(const ofbx::IScene& scene);
 	void writePackedVec3(const ofbx::Vec3& vec, const Matrix& mtx, OutputMemoryStream* blob) const;
 	void postprocessMeshes(const ImportConfig& cfg, const char* path);
+	void generateLODs(const ImportConfig& cfg);
 	void gatherMeshes(ofbx::IScene* scene);
 	void insertHierarchy(Array<const ofbx::Object*>& bones, const ofbx::Object* node);
 	
 	template <typename T> void write(const T& obj) { out_file.write(&obj, sizeof(obj)); }
 	void write(const void* ptr, size_t size) { out_file.write(ptr, size); }
 	void writeString(const char* str);
+	// see Model::FileVersion::ALIGNED_BLOBS
+	void writeBlobPadding();
 	int getVertexSize(const ImportMesh& mesh) const;
 	void fillSkinInfo(Array<Skin>& skinning, const ImportMesh& mesh) const;
 	Vec3 fixOrientation(const Vec3& v) const;
@@ -158,6 +172,7 @@ private:
 	void writeMeshes(const char* src, int mesh_idx, const ImportConfig& cfg);
 	void writeSkeleton(const ImportConfig& cfg);
 	void writeLODs(const ImportConfig& cfg);
+	void writeMeshlets(const ImportMesh& mesh, const ImportConfig& cfg);
 	int getAttributeCount(const ImportMesh& mesh) const;
 	bool areIndices16Bit(const ImportMesh& mesh) const;
 	void writeModelHeader();
@@ -19,11 +19,12 @@ struct Error
 	Error() {}
 	Error(const char* msg) { s_message = msg; }
 
-	static const char* s_message;
+	// geometries are parsed on job processor's threads
+	static thread_local const char* s_message;
 };
 
 
-const char* Error::s_message = "";
+thread_local const char* Error::s_message = "";
 
 
 template <typename T> struct OptionalError
@@ -2641,7 +2642,92 @@ static void parseGlobalSettings(const Element& root, Scene* scene)
 }
 
 
-static bool parseObjects(const Element& root, Scene* scene, u64 flags)
+struct GeometryJob
+{
+	const Scene* scene;
+	const Element* element;
+	bool triangulate;
+	bool is_used = false;
+	bool is_error = false;
+	Object* geometry = nullptr;
+};
+
+
+static void parseGeometryJob(void* data)
+{
+	GeometryJob& job = *(GeometryJob*)data;
+	if (!job.is_used) return;
+	OptionalError<Object*> geom = parseGeometry(*job.scene, *job.element, job.triangulate);
+	job.is_error = geom.isError();
+	if (!job.is_error) job.geometry = geom.getValue();
+}
+
+
+// geometries are the bulk of the work (array decompression, triangulation, attributes remapping)
+// and they do not depend on each other, so they are parsed first, in parallel if possible;
+// geometries which are not connected to any model are skipped
+static bool parseGeometries(Scene* scene, bool triangulate, JobProcessor job_processor, void* job_user_ptr, std::unordered_map<u64, Object*>* out)
+{
+	std::vector<GeometryJob> jobs;
+	std::unordered_map<u64, u32> job_indices;
+	for (auto iter : scene->m_object_map)
+	{
+		if (iter.second.object == scene->m_root) continue;
+		if (!(iter.second.element->id == "Geometry")) continue;
+
+		Property* last_prop = iter.second.element->first_property;
+		while (last_prop->next) last_prop = last_prop->next;
+		if (!last_prop || !(last_prop->value == "Mesh")) continue;
+
+		job_indices[iter.first] = (u32)jobs.size();
+		GeometryJob job;
+		job.scene = scene;
+		job.element = iter.second.element;
+		job.triangulate = triangulate;
+		jobs.push_back(job);
+	}
+	if (jobs.empty()) return true;
+
+	for (const Scene::Connection& con : scene->m_connections)
+	{
+		auto job_iter = job_indices.find(con.from);
+		if (job_iter == job_indices.end()) continue;
+		auto to_iter = scene->m_object_map.find(con.to);
+		if (to_iter == scene->m_object_map.end() || !to_iter->second.element) continue;
+		if (to_iter->second.element->id == "Model") jobs[job_iter->second].is_used = true;
+	}
+
+	if (job_processor)
+	{
+		job_processor(&parseGeometryJob, job_user_ptr, &jobs[0], (u32)sizeof(jobs[0]), (u32)jobs.size());
+	}
+	else
+	{
+		for (GeometryJob& job : jobs) parseGeometryJob(&job);
+	}
+
+	bool res = true;
+	for (auto iter : job_indices)
+	{
+		GeometryJob& job = jobs[iter.second];
+		if (job.is_error)
+		{
+			// parse again on this thread, so the error is reported by getError()
+			if (res) parseGeometryJob(&job);
+			res = false;
+		}
+		(*out)[iter.first] = job.geometry;
+	}
+	if (!res)
+	{
+		for (auto iter : *out) delete iter.second;
+		out->clear();
+	}
+	return res;
+}
+
+
+static bool parseObjects(const Element& root, Scene* scene, u64 flags, JobProcessor job_processor, void* job_user_ptr)
 {
 	const bool triangulate = (flags & (u64)LoadFlags::TRIANGULATE) != 0;
 	const bool ignore_geometry = (flags & (u64)LoadFlags::IGNORE_GEOMETRY) != 0;
@@ -2666,6 +2752,9 @@ static bool parseObjects(const Element& root, Scene* scene, u64 flags)
 		object = object->sibling;
 	}
 
+	std::unordered_map<u64, Object*> geometries;
+	if (!ignore_geometry && !parseGeometries(scene, triangulate, job_processor, job_user_ptr, &geometries)) return false;
+
 	for (auto iter : scene->m_object_map)
 	{
 		OptionalError<Object*> obj = nullptr;
@@ -2674,12 +2763,8 @@ static bool parseObjects(const Element& root, Scene* scene, u64 flags)
 
 		if (iter.second.element->id == "Geometry")
 		{
-			Property* last_prop = iter.second.element->first_property;
-			while (last_prop->next) last_prop = last_prop->next;
-			if (last_prop && last_prop->value == "Mesh" && !ignore_geometry)
-			{
-				obj = parseGeometry(*scene, *iter.second.element, triangulate);
-			}
+			auto geom_iter = geometries.find(iter.first);
+			if (geom_iter != geometries.end()) obj = geom_iter->second;
 		}
 		else if (iter.second.element->id == "Material")
 		{
@@ -3136,7 +3221,7 @@ Object* Object::getParent() const
 }
 
 
-IScene* load(const u8* data, int size, u64 flags)
+IScene* load(const u8* data, int size, u64 flags, JobProcessor job_processor, void* job_user_ptr)
 {
 	std::unique_ptr<Scene> scene(new Scene());
 	scene->m_data.resize(size);
@@ -3169,7 +3254,7 @@ IScene* load(const u8* data, int size, u64 flags)
 	// if (parseTemplates(*root.getValue()).isError()) return nullptr;
 	if (!parseConnections(*root.getValue(), scene.get())) return nullptr;
 	if (!parseTakes(scene.get())) return nullptr;
-	if (!parseObjects(*root.getValue(), scene.get(), flags)) return nullptr;
+	if (!parseObjects(*root.getValue(), scene.get(), flags, job_processor, job_user_ptr)) return nullptr;
 	parseGlobalSettings(*root.getValue(), scene.get());
 
 	return scene.release();
@@ -469,7 +469,11 @@ protected:
 };
 
 
-IScene* load(const u8* data, int size, u64 flags);
+// calls fn(data + i * size) for i in [0, count), possibly in parallel, returns when all calls are finished
+typedef void (*JobFunction)(void* data);
+typedef void (*JobProcessor)(JobFunction fn, void* user_ptr, void* data, u32 size, u32 count);
+
+IScene* load(const u8* data, int size, u64 flags, JobProcessor job_processor = nullptr, void* job_user_ptr = nullptr);
 const char* getError();
 double fbxTimeToSeconds(i64 value);
 i64 secondsToFbxTime(double value);
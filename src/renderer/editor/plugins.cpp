@@ -25,6 +25,7 @@
 #include "engine/queue.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "fbx_importer.h"
 #include "game_view.h"
@@ -43,7 +44,6 @@
 #include "stb/stb_image.h"
 #include "stb/stb_image_resize.h"
 #include "terrain_editor.h"
-#include <cmft/cubemapfilter.h>
 #include <nvtt.h>
 
 
@@ -257,6 +257,8 @@ struct FontPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 	void onGUI(Span<Resource*> resources) override {}
 	void onResourceUnloaded(Resource* resource) override {}
 	const char* getName() const override { return "Font"; }
@@ -278,6 +280,8 @@ struct PipelinePlugin final : AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 	StudioApp& m_app;
 };
 
@@ -295,6 +299,8 @@ struct ParticleEmitterPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlug
 	{
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
+
+	bool isThreadSafe() const override { return true; }
 	
 	
 	void onGUI(Span<Resource*> resources) override {}
@@ -339,6 +345,8 @@ struct MaterialPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 
 	void saveMaterial(Material* material)
 	{
@@ -567,7 +575,7 @@ struct MaterialPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 					bool value = material->isDefined(i);
 
 					auto isBuiltinDefine = [](const char* define) {
-						const char* BUILTIN_DEFINES[] = {"HAS_SHADOWMAP", "ALPHA_CUTOUT", "SKINNED"};
+						const char* BUILTIN_DEFINES[] = {"HAS_SHADOWMAP", "ALPHA_CUTOUT", "SKINNED", "BINDLESS"};
 						for (const char* builtin_define : BUILTIN_DEFINES)
 						{
 							if (equalStrings(builtin_define, define)) return true;
@@ -602,7 +610,11 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		float scale = 1;
 		bool split = false;
 		bool create_impostor = false;
+		bool quantize_vertices = false;
+		bool meshlets = false;
+		bool optimize_meshes = true;
 		float lods_distances[4] = { -1, -1, -1, -1 };
+		float autolod_ratios[3] = { -0.5f, -0.25f, -0.125f };
 		float position_error = 0.02f;
 		float rotation_error = 0.001f;
 	};
@@ -615,6 +627,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		, m_is_mouse_captured(false)
 		, m_tile(app.getAllocator())
 		, m_fbx_importer(app)
+		, m_impostor_queue(app.getAllocator())
 	{
 		app.getAssetCompiler().registerExtension("fbx", Model::TYPE);
 		createPreviewUniverse();
@@ -629,7 +642,12 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	~ModelPlugin()
 	{
 		JobSystem::wait(m_subres_signal);
+		if (m_impostor_model) m_impostor_model->getResourceManager().unload(*m_impostor_model);
 		auto& engine = m_app.getEngine();
+		if (m_tile.readback != 0) {
+			Renderer* renderer = (Renderer*)engine.getPluginManager().getPlugin("renderer");
+			renderer->cancelTextureImageAsync(m_tile.readback);
+		}
 		engine.destroyUniverse(*m_universe);
 		Pipeline::destroy(m_pipeline);
 		engine.destroyUniverse(*m_tile.universe);
@@ -646,10 +664,16 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "scale", &meta.scale);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "split", &meta.split);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "create_impostor", &meta.create_impostor);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "quantize_vertices", &meta.quantize_vertices);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "meshlets", &meta.meshlets);
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "optimize_meshes", &meta.optimize_meshes);
 			
 			for (u32 i = 0; i < lengthOf(meta.lods_distances); ++i) {
 				LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, StaticString<32>("lod", i, "_distance"), &meta.lods_distances[i]);
 			}
+			for (u32 i = 0; i < lengthOf(meta.autolod_ratios); ++i) {
+				LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, StaticString<32>("autolod", i + 1, "_ratio"), &meta.autolod_ratios[i]);
+			}
 		});
 		return meta;
 	}
@@ -693,7 +717,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			}
 
 			LUMIX_DELETE(plugin->m_app.getAllocator(), data);
-		}, &m_subres_signal, JobSystem::INVALID_HANDLE, 2);			
+		}, &m_subres_signal, JobSystem::INVALID_HANDLE, 2, JobSystem::Priority::BACKGROUND);			
 	}
 
 	static const char* getResourceFilePath(const char* str)
@@ -713,7 +737,11 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		cfg.position_error = meta.position_error;
 		cfg.mesh_scale = meta.scale;
 		memcpy(cfg.lods_distances, meta.lods_distances, sizeof(meta.lods_distances));
+		memcpy(cfg.autolod_ratios, meta.autolod_ratios, sizeof(meta.autolod_ratios));
 		cfg.create_impostor = meta.create_impostor;
+		cfg.quantize_vertices = meta.quantize_vertices;
+		cfg.meshlets = meta.meshlets;
+		cfg.optimize_meshes = meta.optimize_meshes;
 		const PathInfo src_info(filepath);
 		m_fbx_importer.setSource(filepath, false);
 		if (m_fbx_importer.getMeshes().empty() && m_fbx_importer.getAnimations().empty()) {
@@ -736,6 +764,10 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		m_fbx_importer.writeModel(src.c_str(), cfg);
 		m_fbx_importer.writeMaterials(filepath, cfg);
 		m_fbx_importer.writeAnimations(filepath, cfg);
+		if (cfg.create_impostor) {
+			MutexGuard lock(m_impostor_mutex);
+			m_impostor_queue.push(src);
+		}
 		return true;
 	}
 
@@ -987,6 +1019,64 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		memcpy(gb1->begin(), tmp.begin(), tmp.byte_size());
 	}
 
+	void createImpostor(Model* model) {
+		FBXImporter importer(m_app);
+		IAllocator& allocator = m_app.getAllocator();
+		Array<u32> gb0(allocator); 
+		Array<u32> gb1(allocator); 
+		IVec2 tile_size;
+		importer.createImpostorTextures(model, Ref(gb0), Ref(gb1), Ref(tile_size));
+		postprocessImpostor(Ref(gb0), Ref(gb1), tile_size, allocator);
+		const PathInfo fi(model->getPath().c_str());
+		StaticString<MAX_PATH_LENGTH> img_path(fi.m_dir, fi.m_basename, "_impostor0.tga");
+		ASSERT(gb0.size() == tile_size.x * 9 * tile_size.y * 9);
+		
+		OS::OutputFile file;
+		if (file.open(img_path)) {
+			Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb0.begin(), true, Path(img_path), allocator);
+			file.close();
+		}
+		else {
+			logError("Renderer") << "Failed to open " << img_path;
+		}
+
+		img_path = fi.m_dir;
+		img_path << fi.m_basename << "_impostor1.tga";
+		if (file.open(img_path)) {
+			Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb1.begin(), true, Path(img_path), allocator);
+			file.close();
+		}
+		else {
+			logError("Renderer") << "Failed to open " << img_path;
+		}
+	}
+
+	// impostors need the compiled model on the gpu, so they are baked on the main thread once it's loaded
+	void updateImpostorQueue() {
+		if (m_impostor_model) {
+			if (m_impostor_model->isFailure()) {
+				logError("Renderer") << "Failed to create impostor for " << m_impostor_model->getPath();
+			}
+			else if (m_impostor_model->isReady()) {
+				createImpostor(m_impostor_model);
+			}
+			else {
+				return;
+			}
+			m_impostor_model->getResourceManager().unload(*m_impostor_model);
+			m_impostor_model = nullptr;
+		}
+
+		Path path;
+		{
+			MutexGuard lock(m_impostor_mutex);
+			if (m_impostor_queue.empty()) return;
+			path = m_impostor_queue.back();
+			m_impostor_queue.pop();
+		}
+		m_impostor_model = m_app.getEngine().getResourceManager().load<Model>(path);
+	}
+
 	void onGUI(Span<Resource*> resources) override
 	{
 		if (resources.length() > 1) return;
@@ -1099,6 +1189,12 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			ImGui::InputFloat("Scale", &m_meta.scale);
 			ImGui::Checkbox("Split", &m_meta.split);
 			ImGui::Checkbox("Create impostor", &m_meta.create_impostor);
+			ImGui::Checkbox("Quantize vertices", &m_meta.quantize_vertices);
+			if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", "16-bit positions and half float UVs, skinned meshes are not quantized");
+			ImGui::Checkbox("Optimize meshes", &m_meta.optimize_meshes);
+			if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", "Reorder triangles and vertices for vertex cache, overdraw and vertex fetch");
+			ImGui::Checkbox("Meshlets", &m_meta.meshlets);
+			if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", "Split dense static meshes into clusters culled on GPU");
 			for(u32 i = 0; i < lengthOf(m_meta.lods_distances); ++i) {
 				bool infinite = m_meta.lods_distances[i] <= 0;
 				if(ImGui::Checkbox(StaticString<32>("Infinite LOD ", i), &infinite)) {
@@ -1111,10 +1207,26 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 					ImGui::PopItemWidth();
 				}
 			}
+			for (u32 i = 0; i < lengthOf(m_meta.autolod_ratios); ++i) {
+				bool generate = m_meta.autolod_ratios[i] > 0;
+				if (ImGui::Checkbox(StaticString<32>("Generate LOD ", i + 1), &generate)) {
+					m_meta.autolod_ratios[i] *= -1;
+				}
+				if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", "Simplified from LOD 0, only if the source has no LODs");
+				if (m_meta.autolod_ratios[i] > 0) {
+					ImGui::SameLine();
+					ImGui::PushItemWidth(-1);
+					ImGui::SliderFloat(StaticString<32>("##autolod", i), &m_meta.autolod_ratios[i], 0.01f, 1.f, "%.2f triangles");
+					ImGui::PopItemWidth();
+				}
+			}
 			
 			if (ImGui::Button("Apply")) {
 				String src(m_app.getAllocator());
 				src.cat("create_impostor=").cat(m_meta.create_impostor ? "true" : "false")
+					.cat("\nquantize_vertices = ").cat(m_meta.quantize_vertices ? "true" : "false")
+					.cat("\nmeshlets = ").cat(m_meta.meshlets ? "true" : "false")
+					.cat("\noptimize_meshes = ").cat(m_meta.optimize_meshes ? "true" : "false")
 					.cat("\nposition_error = ").cat(m_meta.position_error)
 					.cat("\nrotation_error = ").cat(m_meta.rotation_error)
 					.cat("\nscale = ").cat(m_meta.scale)
@@ -1126,43 +1238,16 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 						src.cat("lod").cat(i).cat("_distance").cat(" = ").cat(m_meta.lods_distances[i]).cat("\n");
 					}
 				}
+				for (u32 i = 0; i < lengthOf(m_meta.autolod_ratios); ++i) {
+					src.cat("autolod").cat(i + 1).cat("_ratio").cat(" = ").cat(m_meta.autolod_ratios[i]).cat("\n");
+				}
 
 				compiler.updateMeta(model->getPath(), src.c_str());
 				if (compiler.compile(model->getPath())) {
 					model->getResourceManager().reload(*model);
 				}
 			}
-			if (ImGui::Button("Create impostor texture")) {
-				FBXImporter importer(m_app);
-				IAllocator& allocator = m_app.getAllocator();
-				Array<u32> gb0(allocator); 
-				Array<u32> gb1(allocator); 
-				IVec2 tile_size;
-				importer.createImpostorTextures(model, Ref(gb0), Ref(gb1), Ref(tile_size));
-				postprocessImpostor(Ref(gb0), Ref(gb1), tile_size, allocator);
-				const PathInfo fi(model->getPath().c_str());
-				StaticString<MAX_PATH_LENGTH> img_path(fi.m_dir, fi.m_basename, "_impostor0.tga");
-				ASSERT(gb0.size() == tile_size.x * 9 * tile_size.y * 9);
-				
-				OS::OutputFile file;
-				if (file.open(img_path)) {
-					Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb0.begin(), true, Path(img_path), allocator);
-					file.close();
-				}
-				else {
-					logError("Renderer") << "Failed to open " << img_path;
-				}
-
-				img_path = fi.m_dir;
-				img_path << fi.m_basename << "_impostor1.tga";
-				if (file.open(img_path)) {
-					Texture::saveTGA(&file, tile_size.x * 9, tile_size.y * 9, gpu::TextureFormat::RGBA8, (const u8*)gb1.begin(), true, Path(img_path), allocator);
-					file.close();
-				}
-				else {
-					logError("Renderer") << "Failed to open " << img_path;
-				}
-			}
+			if (ImGui::Button("Create impostor texture")) createImpostor(model);
 		}
 
 		showPreview(*model);
@@ -1214,8 +1299,19 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		universe.destroyEntity(e);
 	}
 
+	// main thread, frame_countdown keeps the entity alive for one more frame
+	static void onTileReadback(Span<const u8> data, void* user_ptr) {
+		ModelPlugin* plugin = (ModelPlugin*)user_ptr;
+		ASSERT(data.length() == plugin->m_tile.data.byte_size());
+		memcpy(plugin->m_tile.data.begin(), data.begin(), data.length());
+		plugin->m_tile.readback = 0;
+		plugin->m_tile.frame_countdown = 0;
+	}
+
 	void update() override
 	{
+		updateImpostorQueue();
+
 		if (m_tile.waiting) {
 			if (!m_app.getEngine().getFileSystem().hasWork()) {
 				renderPrefabSecondStage();
@@ -1338,9 +1434,9 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 		m_tile.data.resize(AssetBrowser::TILE_SIZE * AssetBrowser::TILE_SIZE * 4);
 		m_tile.texture = gpu::allocTextureHandle(); 
-		renderer->getTextureImage(m_tile.pipeline->getOutput(), AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE, gpu::TextureFormat::RGBA8,  Span(m_tile.data.begin(), m_tile.data.end()));
+		m_tile.readback = renderer->getTextureImageAsync(m_tile.pipeline->getOutput(), AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE, gpu::TextureFormat::RGBA8, &ModelPlugin::onTileReadback, this);
 		
-		m_tile.frame_countdown = 2;
+		m_tile.frame_countdown = -1;
 	}
 
 
@@ -1378,10 +1474,10 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 
 		m_tile.texture = gpu::allocTextureHandle(); 
 		m_tile.data.resize(AssetBrowser::TILE_SIZE * AssetBrowser::TILE_SIZE * 4);
-		renderer->getTextureImage(m_tile.pipeline->getOutput(), AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE, gpu::TextureFormat::RGBA8, Span(m_tile.data.begin(), m_tile.data.end()));
+		m_tile.readback = renderer->getTextureImageAsync(m_tile.pipeline->getOutput(), AssetBrowser::TILE_SIZE, AssetBrowser::TILE_SIZE, gpu::TextureFormat::RGBA8, &ModelPlugin::onTileReadback, this);
 		
 		m_tile.entity = mesh_entity;
-		m_tile.frame_countdown = 2;
+		m_tile.frame_countdown = -1;
 		m_tile.path_hash = model->getPath().getHash();
 		model->getResourceManager().unload(*model);
 	}
@@ -1421,6 +1517,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		Pipeline* pipeline = nullptr;
 		EntityPtr entity = INVALID_ENTITY;
 		int frame_countdown = -1;
+		u32 readback = 0;
 		u32 path_hash;
 		Array<u8> data;
 		gpu::TextureHandle texture = gpu::INVALID_TEXTURE;
@@ -1441,6 +1538,9 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 	int m_captured_mouse_y;
 	FBXImporter m_fbx_importer;
 	JobSystem::SignalHandle m_subres_signal = JobSystem::INVALID_HANDLE;
+	Mutex m_impostor_mutex;
+	Array<Path> m_impostor_queue;
+	Model* m_impostor_model = nullptr;
 };
 
 
@@ -1456,8 +1556,20 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			LINEAR,
 			POINT
 		};
+		// selects compression format, BC7 for color, BC5 for normals, BC4 for single channel masks
+		enum Usage : u32 {
+			COLOR,
+			NORMAL,
+			MASK
+		};
+		enum Quality : u32 {
+			FASTEST,
+			NORMAL_QUALITY,
+			PRODUCTION
+		};
 		bool srgb = false;
-		bool is_normalmap = false;
+		Usage usage = Usage::COLOR;
+		Quality quality = Quality::NORMAL_QUALITY;
 		float scale_coverage = -1;
 		bool convert_to_raw = false;
 		WrapMode wrap_mode_u = WrapMode::REPEAT;
@@ -1466,6 +1578,34 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		Filter filter = Filter::LINEAR;
 	};
 
+	// nvtt compresses blocks in tasks, this runs them on all workers
+	struct TaskDispatcher : nvtt::TaskDispatcher {
+		void dispatch(nvtt::Task* task, void* context, int count) override {
+			JobSystem::forEach(count, 0, [&](u32 from, u32 to){
+				PROFILE_BLOCK("compress blocks");
+				for (u32 i = from; i < to; ++i) task(context, i);
+			});
+		}
+	};
+
+	static nvtt::Format getFormat(const Meta& meta) {
+		switch (meta.usage) {
+			case Meta::Usage::NORMAL: return nvtt::Format_BC5;
+			case Meta::Usage::MASK: return nvtt::Format_BC4;
+			case Meta::Usage::COLOR: return nvtt::Format_BC7;
+			default: ASSERT(false); return nvtt::Format_BC7;
+		}
+	}
+
+	static nvtt::Quality getQuality(const Meta& meta) {
+		switch (meta.quality) {
+			case Meta::Quality::FASTEST: return nvtt::Quality_Fastest;
+			case Meta::Quality::NORMAL_QUALITY: return nvtt::Quality_Normal;
+			case Meta::Quality::PRODUCTION: return nvtt::Quality_Production;
+			default: ASSERT(false); return nvtt::Quality_Normal;
+		}
+	}
+
 	explicit TexturePlugin(StudioApp& app)
 		: m_app(app)
 		, m_composite(app.getAllocator())
@@ -1615,7 +1755,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			job->m_out_path = fs.getBasePath();
 			job->m_out_path << out_path;
 			JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
-			JobSystem::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, JobSystem::getWorkersCount() - 1);
+			JobSystem::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, JobSystem::getWorkersCount() - 1, JobSystem::Priority::BACKGROUND);
 			m_tile_signal = signal;
 			return true;
 		}
@@ -1818,8 +1958,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		nvtt::InputOptions input;
 		input.setMipmapGeneration(true);
 		input.setAlphaCoverageMipScale(meta.scale_coverage, 4);
-		input.setAlphaMode(nvtt::AlphaMode_Transparency);
-		input.setNormalMap(meta.is_normalmap);
+		input.setAlphaMode(meta.usage == Meta::Usage::COLOR ? nvtt::AlphaMode_Transparency : nvtt::AlphaMode_None);
+		input.setNormalMap(meta.usage == Meta::Usage::NORMAL);
 		input.setTextureLayout(nvtt::TextureType_Array, w, h, 1, tc.layers.size());
 		
 		Array<u8> out_data(allocator);
@@ -1863,9 +2003,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		output.setOutputHandler(&output_handler);
 
 		nvtt::CompressionOptions compression;
-		// TODO format
-		compression.setFormat(nvtt::Format_BC3);
-		compression.setQuality(nvtt::Quality_Fastest);
+		compression.setFormat(getFormat(meta));
+		compression.setQuality(getQuality(meta));
 
 		dst.write("dds", 3);
 		u32 flags = meta.srgb ? (u32)Texture::Flags::SRGB : 0;
@@ -1876,6 +2015,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		dst.write(&flags, sizeof(flags));
 
 		nvtt::Context context;
+		TaskDispatcher dispatcher;
+		context.setTaskDispatcher(&dispatcher);
 		if (!context.process(input, compression, output)) {
 			return false;
 		}
@@ -1924,19 +2065,23 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		dst.write(&flags, sizeof(flags));
 
 		nvtt::Context context;
+		TaskDispatcher dispatcher;
+		context.setTaskDispatcher(&dispatcher);
 		
-		const bool has_alpha = comps == 4;
+		const bool has_alpha = comps == 4 && meta.usage == Meta::Usage::COLOR;
 		nvtt::InputOptions input;
 		input.setMipmapGeneration(true);
-		input.setAlphaCoverageMipScale(meta.scale_coverage, comps == 4 ? 3 : 0);
+		input.setAlphaCoverageMipScale(meta.scale_coverage, has_alpha ? 3 : 0);
 		input.setAlphaMode(has_alpha ? nvtt::AlphaMode_Transparency : nvtt::AlphaMode_None);
-		input.setNormalMap(meta.is_normalmap);
+		input.setNormalMap(meta.usage == Meta::Usage::NORMAL);
 		input.setTextureLayout(nvtt::TextureType_2D, w, h);
 		input.setMipmapData(data, w, h);
 		stbi_image_free(data);
 		
 		nvtt::OutputOptions output;
 		output.setSrgbFlag(meta.srgb);
+		// BC7 needs dxgi format in the header
+		output.setContainer(nvtt::Container_DDS10);
 		struct : nvtt::OutputHandler {
 			bool writeData(const void * data, int size) override { return dst->write(data, size); }
 			void beginImage(int size, int width, int height, int depth, int face, int miplevel) override {}
@@ -1948,8 +2093,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		output.setOutputHandler(&output_handler);
 
 		nvtt::CompressionOptions compression;
-		compression.setFormat(meta.is_normalmap ? nvtt::Format_DXT5n : (has_alpha ? nvtt::Format_DXT5 : nvtt::Format_DXT1));
-		compression.setQuality(nvtt::Quality_Normal);
+		compression.setFormat(getFormat(meta));
+		compression.setQuality(getQuality(meta));
 
 		if (!context.process(input, compression, output)) {
 			return false;
@@ -1965,8 +2110,20 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "srgb", &meta.srgb);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "convert_to_raw", &meta.convert_to_raw);
 			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "mip_scale_coverage", &meta.scale_coverage);
-			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "normalmap", &meta.is_normalmap);
+			bool is_normalmap = false;
+			LuaWrapper::getOptionalField(L, LUA_GLOBALSINDEX, "normalmap", &is_normalmap);
+			if (is_normalmap) meta.usage = Meta::Usage::NORMAL;
 			char tmp[32];
+			if(LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "usage", Span(tmp))) {
+				if (stricmp(tmp, "normal") == 0) meta.usage = Meta::Usage::NORMAL;
+				else if (stricmp(tmp, "mask") == 0) meta.usage = Meta::Usage::MASK;
+				else meta.usage = Meta::Usage::COLOR;
+			}
+			if(LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "quality", Span(tmp))) {
+				if (stricmp(tmp, "fastest") == 0) meta.quality = Meta::Quality::FASTEST;
+				else if (stricmp(tmp, "production") == 0) meta.quality = Meta::Quality::PRODUCTION;
+				else meta.quality = Meta::Quality::NORMAL_QUALITY;
+			}
 			if(LuaWrapper::getOptionalStringField(L, LUA_GLOBALSINDEX, "filter", Span(tmp))) {
 				if (stricmp(tmp, "point") == 0) {
 					meta.filter = Meta::Filter::POINT;
@@ -2029,6 +2186,11 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().writeCompiledResource(src.c_str(), Span((u8*)out.getData(), (i32)out.getPos()));
 	}
 
+	bool isThreadSafe() const override { return true; }
+
+	// composites read other images
+	bool isCacheable(const Path& src) const override { return !Path::hasExtension(src.c_str(), "ltc"); }
+
 	const char* toString(Meta::Filter filter) {
 		switch (filter) {
 			case Meta::Filter::POINT: return "point";
@@ -2037,6 +2199,24 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		}
 	}
 
+	const char* toString(Meta::Usage usage) {
+		switch (usage) {
+			case Meta::Usage::COLOR: return "color";
+			case Meta::Usage::NORMAL: return "normal";
+			case Meta::Usage::MASK: return "mask";
+			default: ASSERT(false); return "color";
+		}
+	}
+
+	const char* toString(Meta::Quality quality) {
+		switch (quality) {
+			case Meta::Quality::FASTEST: return "fastest";
+			case Meta::Quality::NORMAL_QUALITY: return "normal";
+			case Meta::Quality::PRODUCTION: return "production";
+			default: ASSERT(false); return "normal";
+		}
+	}
+
 	const char* toString(Meta::WrapMode wrap) {
 		switch (wrap) {
 			case Meta::WrapMode::CLAMP: return "clamp";
@@ -2231,7 +2411,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			if (m_meta.scale_coverage >= 0) {
 				ImGui::SliderFloat("Coverage alpha ref", &m_meta.scale_coverage, 0, 1);
 			}
-			ImGui::Checkbox("Is normalmap", &m_meta.is_normalmap);
+			ImGui::Combo("Usage", (int*)&m_meta.usage, "Color (BC7)\0Normal map (BC5)\0Mask (BC4)\0");
+			ImGui::Combo("Compression quality", (int*)&m_meta.quality, "Fastest\0Normal\0Production\0");
 			ImGui::Combo("U Wrap mode", (int*)&m_meta.wrap_mode_u, "Repeat\0Clamp\0");
 			ImGui::Combo("V Wrap mode", (int*)&m_meta.wrap_mode_v, "Repeat\0Clamp\0");
 			ImGui::Combo("W Wrap mode", (int*)&m_meta.wrap_mode_w, "Repeat\0Clamp\0");
@@ -2241,7 +2422,8 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 				const StaticString<512> src("srgb = ", m_meta.srgb ? "true" : "false"
 					, "\nconvert_to_raw = ", m_meta.convert_to_raw ? "true" : "false"
 					, "\nmip_scale_coverage = ", m_meta.scale_coverage
-					, "\nnormalmap = ", m_meta.is_normalmap ? "true" : "false"
+					, "\nusage = \"", toString(m_meta.usage), "\""
+					, "\nquality = \"", toString(m_meta.quality), "\""
 					, "\nwrap_mode_u = \"", toString(m_meta.wrap_mode_u), "\""
 					, "\nwrap_mode_v = \"", toString(m_meta.wrap_mode_v), "\""
 					, "\nwrap_mode_w = \"", toString(m_meta.wrap_mode_w), "\""
@@ -2365,6 +2547,8 @@ struct ShaderPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 		return m_app.getAssetCompiler().copyCompile(src);
 	}
 
+	bool isThreadSafe() const override { return true; }
+
 
 	void onGUI(Span<Resource*> resources) override
 	{
@@ -2711,16 +2895,19 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		IAllocator& allocator = app.getAllocator();
 		PipelineResource* pres = engine.getResourceManager().load<PipelineResource>(Path("pipelines/main.pln"));
 		m_pipeline = Pipeline::create(*renderer, pres, "PROBE", allocator);
+		m_radiance_shader = engine.getResourceManager().load<Shader>(Path("pipelines/radiance_filter.shd"));
 	}
 
 
 	~EnvironmentProbePlugin()
 	{
+		m_radiance_shader->getResourceManager().unload(*m_radiance_shader);
 		Pipeline::destroy(m_pipeline);
 	}
 
 
-	bool saveCubemap(u64 probe_guid, const u8* data, int texture_size, const char* postfix, nvtt::Format format)
+	// data contains `mips` mips, each one with all 6 faces; missing mips are generated
+	bool saveCubemap(u64 probe_guid, const u8* data, int texture_size, u32 mips, const char* postfix, nvtt::Format format)
 	{
 		ASSERT(data);
 		const char* base_path = m_app.getEngine().getFileSystem().getBasePath();
@@ -2746,9 +2933,13 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		input.setAlphaMode(nvtt::AlphaMode_None);
 		input.setNormalMap(false);
 		input.setTextureLayout(nvtt::TextureType_Cube, texture_size, texture_size);
-		for (int i = 0; i < 6; ++i) {
-			const int step = texture_size * texture_size * 4;
-			input.setMipmapData(data + step * i, texture_size, texture_size, 1, i);
+		for (u32 mip = 0; mip < mips; ++mip) {
+			const int size = maximum(texture_size >> mip, 1);
+			const int step = size * size * 4;
+			for (int i = 0; i < 6; ++i) {
+				input.setMipmapData(data + step * i, size, size, 1, i, mip);
+			}
+			data += step * 6;
 		}
 		
 		nvtt::OutputOptions output;
@@ -2811,6 +3002,8 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		ProbeJob(EnvironmentProbePlugin& plugin, EntityRef& entity, IAllocator& allocator) 
 			: entity(entity)
 			, data(allocator)
+			, radiance_src(allocator)
+			, radiance(allocator)
 			, plugin(plugin)
 		{}
 		
@@ -2822,12 +3015,105 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 		bool fast_filter = false;
 
 		Array<Vec4> data;
+		// mip chains, see radiance_filter.shd
+		Array<Vec4> radiance_src;
+		Array<u32> radiance;
 		SphericalHarmonics sh;
 		bool render_dispatched = false;
+		bool filter_ready = false;
+		bool filter_dispatched = false;
 		bool done = false;
 		bool done_counted = false;
 	};
 
+	static constexpr u32 RADIANCE_SIZE = 128;
+	static constexpr u32 RADIANCE_MIPS = 8;
+	// probes are rendered in batches, their filtering and saving runs in background
+	static constexpr u32 PROBES_PER_UPDATE = 4;
+
+	static u32 getMipChainSize(u32 size, u32 mips) {
+		u32 res = 0;
+		for (u32 i = 0; i < mips; ++i) {
+			const u32 s = maximum(size >> i, 1u);
+			res += s * s * 6;
+		}
+		return res;
+	}
+
+	static void downsample(const Vec4* src, u32 src_size, Vec4* dst) {
+		const u32 dst_size = maximum(src_size >> 1, 1u);
+		for (u32 face = 0; face < 6; ++face) {
+			const Vec4* face_src = src + face * src_size * src_size;
+			Vec4* face_dst = dst + face * dst_size * dst_size;
+			if (src_size == 1) {
+				face_dst[0] = face_src[0];
+				continue;
+			}
+			for (u32 y = 0; y < dst_size; ++y) {
+				for (u32 x = 0; x < dst_size; ++x) {
+					const Vec4* s = face_src + x * 2 + y * 2 * src_size;
+					face_dst[x + y * dst_size] = (s[0] + s[1] + s[src_size] + s[src_size + 1]) * 0.25f;
+				}
+			}
+		}
+	}
+
+	// GGX prefiltered radiance, one roughness per mip, roughness = mip / 8 matches PBR_ComputeIndirectSpecular
+	struct RadianceFilterJob : Renderer::RenderJob {
+		void setup() override {}
+
+		void execute() override {
+			PROFILE_FUNCTION();
+			struct {
+				u32 output[4];
+				u32 source[4];
+				Vec4 params;
+			} dc;
+			static_assert(sizeof(dc) == 48, "must match Drawcall in radiance_filter.shd");
+
+			gpu::BufferHandle src = gpu::allocBufferHandle();
+			gpu::BufferHandle dst = gpu::allocBufferHandle();
+			gpu::BufferHandle ub = gpu::allocBufferHandle();
+			gpu::createBuffer(src, (u32)gpu::BufferFlags::IMMUTABLE, job->radiance_src.byte_size(), job->radiance_src.begin());
+			gpu::createBuffer(dst, 0, job->radiance.byte_size(), nullptr);
+			gpu::createBuffer(ub, (u32)gpu::BufferFlags::UNIFORM_BUFFER, sizeof(dc), nullptr);
+
+			gpu::useProgram(program);
+			gpu::bindShaderBuffer(src, 0);
+			gpu::bindShaderBuffer(dst, 1);
+			gpu::bindUniformBuffer(4, ub, sizeof(dc));
+			u32 offset = 0;
+			for (u32 mip = 0; mip < RADIANCE_MIPS; ++mip) {
+				const u32 size = maximum(RADIANCE_SIZE >> mip, 1u);
+				dc.output[0] = size;
+				dc.output[1] = offset;
+				dc.output[2] = mip;
+				dc.output[3] = 0;
+				dc.source[0] = RADIANCE_SIZE;
+				dc.source[1] = RADIANCE_MIPS;
+				dc.source[2] = dc.source[3] = 0;
+				dc.params = Vec4(mip / 8.f, job->fast_filter ? 32.f : 256.f, 0, 0);
+				gpu::update(ub, &dc, sizeof(dc));
+				gpu::dispatch((size * size * 6 + 63) / 64, 1, 1);
+				offset += size * size * 6;
+			}
+			gpu::memoryBarrier();
+			gpu::readBuffer(dst, Span((u8*)job->radiance.begin(), job->radiance.byte_size()));
+
+			gpu::destroy(src);
+			gpu::destroy(dst);
+			gpu::destroy(ub);
+
+			JobSystem::run(job, [](void* ptr) {
+				ProbeJob* pjob = (ProbeJob*)ptr;
+				pjob->plugin.saveRadiance(*pjob);
+			}, nullptr);
+		}
+
+		ProbeJob* job;
+		gpu::ProgramHandle program;
+	};
+
 	void render(ProbeJob& job) {
 		bool diffuse_only = job.probe.flags.isSet(EnvironmentProbe::DIFFUSE);
 		diffuse_only = diffuse_only && !job.probe.flags.isSet(EnvironmentProbe::SPECULAR);
@@ -2871,15 +3157,30 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 			m_done_counter = 0;
 		}
 
+		u32 rendered = 0;
 		for (ProbeJob* j : m_probes) {
 			if (!j->render_dispatched) {
 				j->render_dispatched = true;
 				render(*j);
-				break;
+				++rendered;
+				if (rendered == PROBES_PER_UPDATE) break;
 			}
 		}
 
 		memoryBarrier();
+		if (m_radiance_shader->isReady()) {
+			Renderer* renderer = static_cast<Renderer*>(m_app.getEngine().getPluginManager().getPlugin("renderer"));
+			for (ProbeJob* j : m_probes) {
+				if (!j->filter_ready || j->filter_dispatched) continue;
+
+				j->filter_dispatched = true;
+				RadianceFilterJob* rjob = LUMIX_NEW(renderer->getAllocator(), RadianceFilterJob);
+				rjob->job = j;
+				rjob->program = m_radiance_shader->getProgram(gpu::VertexDecl(), 0);
+				renderer->queue(rjob, 0);
+			}
+		}
+
 		for (ProbeJob* j : m_probes) {
 			if (j->done && !j->done_counted) {
 				j->done_counted = true;
@@ -2941,38 +3242,54 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 			job.sh.compute(data);
 		}
 
-		// TODO do not override mipmaps if slow filter is used
+		// TODO save reflection, careful, job.data is float
+		/*if (job.probe.flags.isSet(EnvironmentProbe::REFLECTION)) {
+			for (int i = 3; i < job.data.size(); i += 4) job.data[i] = 0xff; 
+			saveCubemap(job.probe.guid, &job.data[0], texture_size, 1, "", nvtt::Format_DXT1);
+		}*/
+
 		if (job.probe.flags.isSet(EnvironmentProbe::SPECULAR)) {
-			cmft::Image image;	
-			cmft::imageCreate(image, texture_size, texture_size, 0x303030ff, 1, 6, cmft::TextureFormat::RGBA32F);
-			memcpy(image.m_data, data.begin(), data.byte_size());
-			if (job.fast_filter) {
-				cmft::imageResize(image, 128, 128);
+			PROFILE_BLOCK("radiance source");
+			// source mip chain for the gpu filter, starting at RADIANCE_SIZE
+			Array<Vec4> tmp(m_app.getAllocator());
+			u32 size = texture_size;
+			const Vec4* src = data.begin();
+			while (size > RADIANCE_SIZE) {
+				Array<Vec4> half(m_app.getAllocator());
+				half.resize(6 * (size >> 1) * (size >> 1));
+				downsample(src, size, half.begin());
+				tmp.swap(half);
+				src = tmp.begin();
+				size >>= 1;
 			}
-			else {
-				PROFILE_BLOCK("radiance");
-				cmft::imageRadianceFilter(
-					image
-					, 128
-					, cmft::LightingModel::BlinnBrdf
-					, false
-					, 1
-					, 10
-					, 1
-					, cmft::EdgeFixup::None
-					, OS::getCPUsCount()
-				);
+			ASSERT(size == RADIANCE_SIZE);
+
+			job.radiance_src.resize(getMipChainSize(RADIANCE_SIZE, RADIANCE_MIPS));
+			job.radiance.resize(job.radiance_src.size());
+			memcpy(job.radiance_src.begin(), src, 6 * size * size * sizeof(Vec4));
+			Vec4* mip = job.radiance_src.begin();
+			for (u32 i = 1; i < RADIANCE_MIPS; ++i) {
+				downsample(mip, size, mip + 6 * size * size);
+				mip += 6 * size * size;
+				size = maximum(size >> 1, 1u);
 			}
-			cmft::imageFromRgba32f(image, cmft::TextureFormat::RGBA8);
-			saveCubemap(job.probe.guid, (u8*)image.m_data, 128, "_radiance", nvtt::Format_DXT1);
+
+			data.free();
+			memoryBarrier();
+			job.filter_ready = true;
+			return;
 		}
 
-		// TODO save reflection, careful, job.data is float
-		/*if (job.probe.flags.isSet(EnvironmentProbe::REFLECTION)) {
-			for (int i = 3; i < job.data.size(); i += 4) job.data[i] = 0xff; 
-			saveCubemap(job.probe.guid, &job.data[0], texture_size, "", nvtt::Format_DXT1);
-		}*/
+		data.free();
+		memoryBarrier();
+		job.done = true;
+	}
 
+	void saveRadiance(ProbeJob& job) {
+		PROFILE_FUNCTION();
+		saveCubemap(job.probe.guid, (const u8*)job.radiance.begin(), RADIANCE_SIZE, RADIANCE_MIPS, "_radiance", nvtt::Format_DXT1);
+		job.radiance_src.free();
+		job.radiance.free();
 		memoryBarrier();
 		job.done = true;
 	}
@@ -3005,6 +3322,7 @@ struct EnvironmentProbePlugin final : PropertyGrid::IPlugin
 
 	StudioApp& m_app;
 	Pipeline* m_pipeline;
+	Shader* m_radiance_shader;
 	
 	// TODO to be used with http://casual-effects.blogspot.com/2011/08/plausible-environment-lighting-in-two.html
 	Array<ProbeJob*> m_probes;
@@ -185,7 +185,8 @@ void SceneView::renderIcons()
 				const Model* model = (Model*)ri->getModel(rd.model);
 				if (!model || !model->isReady()) continue;
 
-				for (int i = 0; i <= model->getLODs()[0].to_mesh; ++i) {
+				const LODMeshIndices lod = model->requestLODMeshIndices(0);
+				for (int i = lod.from; i <= lod.to; ++i) {
 					const Mesh& mesh = model->getMesh(i);
 					Item& item = m_items.emplace();
 					item.mesh = mesh.render_data;
@@ -255,7 +256,8 @@ void SceneView::renderSelection()
 				const Model* model = scene->getModelInstanceModel(e);
 				if (!model || !model->isReady()) continue;
 
-				for (int i = 0; i <= model->getLODs()[0].to_mesh; ++i) {
+				const LODMeshIndices lod = model->requestLODMeshIndices(0);
+				for (int i = lod.from; i <= lod.to; ++i) {
 					const Mesh& mesh = model->getMesh(i);
 					Item& item = m_items.emplace();
 					item.mesh = mesh.render_data;
@@ -55,6 +55,8 @@ struct PaintTerrainCommand final : IEditorCommand
 		: m_world_editor(editor)
 		, m_new_data(editor.getAllocator())
 		, m_old_data(editor.getAllocator())
+		, m_tiles(editor.getAllocator())
+		, m_tiles_map(editor.getAllocator())
 		, m_items(editor.getAllocator())
 		, m_mask(editor.getAllocator())
 	{
@@ -79,6 +81,8 @@ struct PaintTerrainCommand final : IEditorCommand
 		, m_can_be_merged(can_be_merged)
 		, m_new_data(editor.getAllocator())
 		, m_old_data(editor.getAllocator())
+		, m_tiles(editor.getAllocator())
+		, m_tiles_map(editor.getAllocator())
 		, m_items(editor.getAllocator())
 		, m_action_type(action_type)
 		, m_textures_mask(textures_mask)
@@ -95,7 +99,6 @@ struct PaintTerrainCommand final : IEditorCommand
 			m_mask[i] = mask[i];
 		}
 
-		m_width = m_height = m_x = m_y = -1;
 		const Transform entity_transform = editor.getUniverse()->getTransform((EntityRef)terrain.entity).inverted();
 		DVec3 local_pos = entity_transform.transform(hit_pos);
 		float terrain_size = static_cast<RenderScene*>(terrain.scene)->getTerrainSize((EntityRef)terrain.entity).x;
@@ -112,17 +115,33 @@ struct PaintTerrainCommand final : IEditorCommand
 
 	bool execute() override
 	{
-		if (m_new_data.empty())
-		{
-			saveOldData();
-			generateNewData();
+		// merged commands are executed again, but they are already painted
+		if (m_is_applied) return true;
+		m_is_applied = true;
+
+		if (m_tiles.empty()) {
+			Texture* texture = getDestinationTexture();
+			for (Item& item : m_items) paintItem(texture, item);
+			return true;
 		}
-		applyData(m_new_data);
+		applyTiles(m_new_data);
 		return true;
 	}
 
 
-	void undo() override { applyData(m_old_data); }
+	void undo() override
+	{
+		if (!m_terrain.isValid()) return;
+
+		m_is_applied = false;
+		if (m_new_data.empty() && !m_old_data.empty()) {
+			// new data are needed only for redo, so they are captured on the first undo
+			Texture* texture = getDestinationTexture();
+			m_new_data.resize(m_old_data.size());
+			for (const UndoTile& tile : m_tiles) copyTile(texture, tile, m_new_data, false);
+		}
+		applyTiles(m_old_data);
+	}
 
 
 	const char* getType() override
@@ -131,6 +150,12 @@ struct PaintTerrainCommand final : IEditorCommand
 	}
 
 
+	u32 getMemorySize() override
+	{
+		return m_new_data.byte_size() + m_old_data.byte_size() + m_tiles.byte_size() + m_items.byte_size() + m_mask.byte_size();
+	}
+
+
 	bool merge(IEditorCommand& command) override
 	{
 		if (!m_can_be_merged)
@@ -142,8 +167,7 @@ struct PaintTerrainCommand final : IEditorCommand
 			m_textures_mask == my_command.m_textures_mask && m_layers_masks == my_command.m_layers_masks)
 		{
 			my_command.m_items.push(m_items.back());
-			my_command.resizeData();
-			my_command.rasterItem(getDestinationTexture(), my_command.m_new_data, m_items.back());
+			my_command.paintItem(getDestinationTexture(), m_items.back());
 			return true;
 		}
 		return false;
@@ -168,6 +192,16 @@ private:
 		Vec3 m_color;
 	};
 
+	// undo data is kept for touched tiles only
+	static constexpr int UNDO_TILE_SIZE = 64;
+
+	struct UndoTile
+	{
+		int x;
+		int y;
+		u32 offset;
+	};
+
 private:
 	Material* getMaterial()
 	{
@@ -234,9 +268,10 @@ private:
 	}
 
 
-	void rasterLayerItem(Texture* texture, Array<u8>& data, Item& item)
+	void rasterLayerItem(Texture* texture, Item& item)
 	{
 		int texture_size = texture->width;
+		u8* data = texture->getData();
 		Rectangle r = item.getBoundingRectangle(texture_size);
 
 		if (texture->format != gpu::TextureFormat::RGBA8)
@@ -265,7 +300,7 @@ private:
 				if (isMasked(fx, fy)) {
 					for (u32 layer = 0; layer < 2; ++layer) {
 						if ((m_layers_masks & (1 << layer)) == 0) continue;
-						const int offset = 4 * (i - m_x + (j - m_y) * m_width) + layer;
+						const int offset = 4 * (i + j * texture_size) + layer;
 						const float attenuation = getAttenuation(item, i, j, texture_size);
 						int add = int(attenuation * item.m_amount * 255);
 					
@@ -298,9 +333,10 @@ private:
 		}
 	}
 
-	void rasterGrassItem(Texture* texture, Array<u8>& data, Item& item, TerrainEditor::ActionType action_type)
+	void rasterGrassItem(Texture* texture, Item& item, TerrainEditor::ActionType action_type)
 	{
 		int texture_size = texture->width;
+		u8* data = texture->getData();
 		Rectangle r = item.getBoundingRectangle(texture_size);
 
 		if (texture->format != gpu::TextureFormat::RGBA8)
@@ -319,7 +355,7 @@ private:
 			{
 				if (isMasked(fx, fy))
 				{
-					int offset = 4 * (i - m_x + (j - m_y) * m_width) + 2;
+					int offset = 4 * (i + j * texture_size) + 2;
 					float attenuation = getAttenuation(item, i, j, texture_size);
 					int add = int(attenuation * item.m_amount * 255);
 					if (add > 0)
@@ -340,7 +376,7 @@ private:
 	}
 
 
-	void rasterSmoothHeightItem(Texture* texture, Array<u8>& data, Item& item)
+	void rasterSmoothHeightItem(Texture* texture, Item& item)
 	{
 		ASSERT(texture->format == gpu::TextureFormat::R16);
 
@@ -353,16 +389,14 @@ private:
 			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
 			{
 				float attenuation = getAttenuation(item, i, j, texture_size);
-				int offset = i - m_x + (j - m_y) * m_width;
-				u16 x = ((u16*)texture->getData())[(i + j * texture_size)];
+				u16& x = ((u16*)texture->getData())[(i + j * texture_size)];
 				x += u16((avg - x) * item.m_amount * attenuation);
-				((u16*)&data[0])[offset] = x;
 			}
 		}
 	}
 
 
-	void rasterFlatHeightItem(Texture* texture, Array<u8>& data, Item& item)
+	void rasterFlatHeightItem(Texture* texture, Item& item)
 	{
 		ASSERT(texture->format == gpu::TextureFormat::R16);
 
@@ -373,40 +407,39 @@ private:
 		{
 			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
 			{
-				int offset = i - m_x + (j - m_y) * m_width;
 				float dist = sqrtf(
 					(texture_size * item.m_local_pos.x - 0.5f - i) * (texture_size * item.m_local_pos.x - 0.5f - i) +
 					(texture_size * item.m_local_pos.z - 0.5f - j) * (texture_size * item.m_local_pos.z - 0.5f - j));
 				float t = (dist - texture_size * item.m_radius * item.m_amount) /
 						  (texture_size * item.m_radius * (1 - item.m_amount));
 				t = clamp(1 - t, 0.0f, 1.0f);
-				u16 old_value = ((u16*)&data[0])[offset];
-				((u16*)&data[0])[offset] = (u16)(m_flat_height * t + old_value * (1-t));
+				u16& value = ((u16*)texture->getData())[i + j * texture_size];
+				value = (u16)(m_flat_height * t + value * (1-t));
 			}
 		}
 	}
 
 
-	void rasterItem(Texture* texture, Array<u8>& data, Item& item)
+	void rasterItem(Texture* texture, Item& item)
 	{
 		if (m_action_type == TerrainEditor::LAYER)
 		{
-			rasterLayerItem(texture, data, item);
+			rasterLayerItem(texture, item);
 			return;
 		}
 		else if (m_action_type == TerrainEditor::ADD_GRASS || m_action_type == TerrainEditor::REMOVE_GRASS)
 		{
-			rasterGrassItem(texture, data, item, m_action_type);
+			rasterGrassItem(texture, item, m_action_type);
 			return;
 		}
 		else if (m_action_type == TerrainEditor::SMOOTH_HEIGHT)
 		{
-			rasterSmoothHeightItem(texture, data, item);
+			rasterSmoothHeightItem(texture, item);
 			return;
 		}
 		else if (m_action_type == TerrainEditor::FLAT_HEIGHT)
 		{
-			rasterFlatHeightItem(texture, data, item);
+			rasterFlatHeightItem(texture, item);
 			return;
 		}
 
@@ -423,83 +456,89 @@ private:
 			for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
 			{
 				float attenuation = getAttenuation(item, i, j, texture_size);
-				int offset = i - m_x + (j - m_y) * m_width;
 
 				int add = int(attenuation * amount);
-				u16 x = ((u16*)texture->getData())[(i + j * texture_size)];
+				u16& x = ((u16*)texture->getData())[(i + j * texture_size)];
 				x += m_action_type == TerrainEditor::RAISE_HEIGHT ? minimum(add, 0xFFFF - x)
 														   : maximum(-add, -x);
-				((u16*)&data[0])[offset] = x;
 			}
 		}
 	}
 
 
-	void generateNewData()
+	// saves undo data of tiles overlapping the item, paints it into the texture and uploads the changed region
+	void paintItem(Texture* texture, Item& item)
 	{
-		auto texture = getDestinationTexture();
+		PROFILE_FUNCTION();
+		Rectangle rect = item.getBoundingRectangle(texture->width);
+		rect.to_y = minimum(rect.to_y, (int)texture->height);
+		if (rect.from_x >= rect.to_x || rect.from_y >= rect.to_y) return;
+
 		const u32 bpp = gpu::getBytesPerPixel(texture->format);
-		Rectangle rect;
-		getBoundingRectangle(texture, rect);
-		m_new_data.resize(bpp * maximum(1, (rect.to_x - rect.from_x) * (rect.to_y - rect.from_y)));
-		if(m_old_data.size() > 0) {
-			memcpy(&m_new_data[0], &m_old_data[0], m_new_data.size());
+		const int tiles_per_row = (texture->width + UNDO_TILE_SIZE - 1) / UNDO_TILE_SIZE;
+		for (int ty = rect.from_y / UNDO_TILE_SIZE; ty <= (rect.to_y - 1) / UNDO_TILE_SIZE; ++ty) {
+			for (int tx = rect.from_x / UNDO_TILE_SIZE; tx <= (rect.to_x - 1) / UNDO_TILE_SIZE; ++tx) {
+				const u32 key = tx + ty * tiles_per_row;
+				if (m_tiles_map.find(key).isValid()) continue;
+
+				m_tiles_map.insert(key, m_tiles.size());
+				UndoTile& tile = m_tiles.emplace();
+				tile.x = tx;
+				tile.y = ty;
+				tile.offset = m_old_data.size();
+				m_old_data.resize(m_old_data.size() + UNDO_TILE_SIZE * UNDO_TILE_SIZE * bpp);
+				copyTile(texture, tile, m_old_data, false);
+
+				m_dirty.from_x = minimum(m_dirty.from_x, tx * UNDO_TILE_SIZE);
+				m_dirty.from_y = minimum(m_dirty.from_y, ty * UNDO_TILE_SIZE);
+				m_dirty.to_x = maximum(m_dirty.to_x, minimum((tx + 1) * UNDO_TILE_SIZE, (int)texture->width));
+				m_dirty.to_y = maximum(m_dirty.to_y, minimum((ty + 1) * UNDO_TILE_SIZE, (int)texture->height));
+			}
 		}
 
-		for (int item_index = 0; item_index < m_items.size(); ++item_index)
-		{
-			Item& item = m_items[item_index];
-			rasterItem(texture, m_new_data, item);
-		}
+		rasterItem(texture, item);
+		updateRegion(texture, rect);
 	}
 
 
-	void saveOldData()
+	// to_texture == false copies texture to data
+	void copyTile(Texture* texture, const UndoTile& tile, Array<u8>& data, bool to_texture) const
 	{
-		auto texture = getDestinationTexture();
 		const u32 bpp = gpu::getBytesPerPixel(texture->format);
-		Rectangle rect;
-		getBoundingRectangle(texture, rect);
-		m_x = rect.from_x;
-		m_y = rect.from_y;
-		m_width = rect.to_x - rect.from_x;
-		m_height = rect.to_y - rect.from_y;
-		m_old_data.resize(bpp * (rect.to_x - rect.from_x) * (rect.to_y - rect.from_y));
-
-		int index = 0;
-		for (int j = rect.from_y, end2 = rect.to_y; j < end2; ++j)
-		{
-			for (int i = rect.from_x, end = rect.to_x; i < end; ++i)
-			{
-				for (u32 k = 0; k < bpp; ++k)
-				{
-					m_old_data[index] = texture->getData()[(i + j * texture->width) * bpp + k];
-					++index;
-				}
-			}
+		const int x = tile.x * UNDO_TILE_SIZE;
+		const int y = tile.y * UNDO_TILE_SIZE;
+		const int w = minimum(UNDO_TILE_SIZE, (int)texture->width - x);
+		const int h = minimum(UNDO_TILE_SIZE, (int)texture->height - y);
+		u8* tile_data = &data[tile.offset];
+		u8* texture_data = texture->getData();
+		for (int j = 0; j < h; ++j) {
+			u8* tex_row = texture_data + ((y + j) * texture->width + x) * bpp;
+			u8* tile_row = tile_data + j * UNDO_TILE_SIZE * bpp;
+			if (to_texture) memcpy(tex_row, tile_row, w * bpp);
+			else memcpy(tile_row, tex_row, w * bpp);
 		}
 	}
 
 
-	void applyData(Array<u8>& data)
+	void applyTiles(Array<u8>& data)
 	{
 		if (!m_terrain.isValid()) return;
+		
+		Texture* texture = getDestinationTexture();
+		for (const UndoTile& tile : m_tiles) {
+			copyTile(texture, tile, data, true);
+		}
+		updateRegion(texture, m_dirty);
+	}
 
-		auto texture = getDestinationTexture();
-		const u32 bpp = gpu::getBytesPerPixel(texture->format);
 
-		for (int j = m_y; j < m_y + m_height; ++j)
-		{
-			for (int i = m_x; i < m_x + m_width; ++i)
-			{
-				int index = bpp * (i + j * texture->width);
-				for (u32 k = 0; k < bpp; ++k)
-				{
-					texture->getData()[index + k] = data[bpp * (i - m_x + (j - m_y) * m_width) + k];
-				}
-			}
-		}
-		texture->onDataUpdated(m_x, m_y, m_width, m_height);
+	void updateRegion(Texture* texture, const Rectangle& rect)
+	{
+		const int w = rect.to_x - rect.from_x;
+		const int h = rect.to_y - rect.from_y;
+		if (w <= 0 || h <= 0) return;
+
+		texture->onDataUpdated(rect.from_x, rect.from_y, w, h);
 		const EntityRef e = (EntityRef)m_terrain.entity;
 		static_cast<RenderScene*>(m_terrain.scene)->forceGrassUpdate(e);
 
@@ -511,88 +550,27 @@ private:
 			auto* phy_scene = static_cast<PhysicsScene*>(scene);
 			if (!scene->getUniverse().hasComponent(e, HEIGHTFIELD_TYPE)) return;
 
-			phy_scene->updateHeighfieldData(e, m_x, m_y, m_width, m_height, &data[0], bpp);
-		}
-	}
-
-
-	void resizeData()
-	{
-		Array<u8> new_data(m_world_editor.getAllocator());
-		Array<u8> old_data(m_world_editor.getAllocator());
-		auto texture = getDestinationTexture();
-		Rectangle rect;
-		getBoundingRectangle(texture, rect);
-
-		int new_w = rect.to_x - rect.from_x;
-		const u32 bpp = gpu::getBytesPerPixel(texture->format);
-		new_data.resize(bpp * new_w * (rect.to_y - rect.from_y));
-		old_data.resize(bpp * new_w * (rect.to_y - rect.from_y));
-
-		// original
-		for (int row = rect.from_y; row < rect.to_y; ++row)
-		{
-			memcpy(&new_data[(row - rect.from_y) * new_w * bpp],
-				&texture->getData()[row * bpp * texture->width + rect.from_x * bpp],
-				bpp * new_w);
-			memcpy(&old_data[(row - rect.from_y) * new_w * bpp],
-				&texture->getData()[row * bpp * texture->width + rect.from_x * bpp],
-				bpp * new_w);
-		}
-
-		// new
-		for (int row = 0; row < m_height; ++row)
-		{
-			memcpy(&new_data[((row + m_y - rect.from_y) * new_w + m_x - rect.from_x) * bpp],
-				&m_new_data[row * bpp * m_width],
-				bpp * m_width);
-			memcpy(&old_data[((row + m_y - rect.from_y) * new_w + m_x - rect.from_x) * bpp],
-				&m_old_data[row * bpp * m_width],
-				bpp * m_width);
-		}
-
-		m_x = rect.from_x;
-		m_y = rect.from_y;
-		m_height = rect.to_y - rect.from_y;
-		m_width = rect.to_x - rect.from_x;
-
-		m_new_data.swap(new_data);
-		m_old_data.swap(old_data);
-	}
-
-
-	void getBoundingRectangle(Texture* texture, Rectangle& rect)
-	{
-		int s = texture->width;
-		Item& item = m_items[0];
-		rect.from_x = maximum(int(s * (item.m_local_pos.x - item.m_radius) - 0.5f), 0);
-		rect.from_y = maximum(int(s * (item.m_local_pos.z - item.m_radius) - 0.5f), 0);
-		rect.to_x = minimum(1 + int(s * (item.m_local_pos.x + item.m_radius) + 0.5f), texture->width);
-		rect.to_y = minimum(1 + int(s * (item.m_local_pos.z + item.m_radius) + 0.5f), texture->height);
-		for (int i = 1; i < m_items.size(); ++i)
-		{
-			Item& item = m_items[i];
-			rect.from_x = minimum(int(s * (item.m_local_pos.x - item.m_radius) - 0.5f), rect.from_x);
-			rect.to_x = maximum(1 + int(s * (item.m_local_pos.x + item.m_radius) + 0.5f), rect.to_x);
-			rect.from_y = minimum(int(s * (item.m_local_pos.z - item.m_radius) - 0.5f), rect.from_y);
-			rect.to_y = maximum(1 + int(s * (item.m_local_pos.z + item.m_radius) + 0.5f), rect.to_y);
+			const u32 bpp = gpu::getBytesPerPixel(texture->format);
+			Array<u8> data(m_world_editor.getAllocator());
+			data.resize(w * h * bpp);
+			for (int j = 0; j < h; ++j) {
+				memcpy(&data[j * w * bpp], texture->getData() + ((rect.from_y + j) * texture->width + rect.from_x) * bpp, w * bpp);
+			}
+			phy_scene->updateHeighfieldData(e, rect.from_x, rect.from_y, w, h, &data[0], bpp);
 		}
-		rect.from_x = maximum(rect.from_x, 0);
-		rect.to_x = minimum(rect.to_x, texture->width);
-		rect.from_y = maximum(rect.from_y, 0);
-		rect.to_y = minimum(rect.to_y, texture->height);
 	}
 
 
 private:
 	Array<u8> m_new_data;
 	Array<u8> m_old_data;
+	Array<UndoTile> m_tiles;
+	HashMap<u32, u32> m_tiles_map;
+	// union of all tiles
+	Rectangle m_dirty = {0x7fffFFFF, 0x7fffFFFF, 0, 0};
+	bool m_is_applied = false;
 	u64 m_textures_mask;
 	u16 m_grass_mask;
-	int m_width;
-	int m_height;
-	int m_x;
-	int m_y;
 	TerrainEditor::ActionType m_action_type;
 	Array<Item> m_items;
 	ComponentUID m_terrain;
@@ -979,13 +957,12 @@ static bool isOBBCollision(RenderScene& scene,
 	radius_a_squared = radius_a_squared * radius_a_squared;
 	Universe& universe = scene.getUniverse();
 	const ModelInstance* model_instances = scene.getModelInstances();
-	const Transform* transforms = universe.getTransforms();
 	while(meshes) {
 		const EntityRef* entities = meshes->entities;
 		for (u32 i = 0, c = meshes->header.count; i < c; ++i) {
 			const EntityRef mesh = entities[i];
 			const ModelInstance& model_instance = model_instances[mesh.index];
-			const Transform& tr_b = transforms[mesh.index];
+			const Transform tr_b = universe.getTransform(mesh);
 			const float radius_b = model_instance.model->getBoundingRadius() * tr_b.scale;
 			const float radius_squared = radius_a_squared + radius_b * radius_b;
 			if ((model_tr.pos - tr_b.pos).squaredLength() < radius_squared) {
@@ -1011,7 +988,7 @@ void TerrainEditor::paintEntities(const DVec3& hit_pos)
 	if (m_selected_prefabs.empty()) return;
 	auto& prefab_system = m_world_editor.getPrefabSystem();
 
-	static const u32 PAINT_ENTITIES_HASH = crc32("paint_entities");
+	static constexpr u32 PAINT_ENTITIES_HASH = StringHash("paint_entities");
 	m_world_editor.beginCommandGroup(PAINT_ENTITIES_HASH);
 	{
 		RenderScene* scene = static_cast<RenderScene*>(m_component.scene);
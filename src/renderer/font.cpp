@@ -1,5 +1,6 @@
 #include "engine/log.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/stream.h"
 #include "font.h"
 #include "renderer/texture.h"
@@ -18,17 +19,53 @@ namespace Lumix
 {
 
 struct Font {
-	Font(IAllocator& allocator) : glyphs(allocator) {}
+	Font(IAllocator& allocator) : glyphs(allocator), missing(allocator) {}
 	FontResource* resource;
 	HashMap<u32, Glyph> glyphs;
+	// codepoints requested by findGlyph, FontManager::m_missing_mutex must be locked
+	Array<u32> missing;
 	u32 font_size = 0;
 	u32 ref = 0;
 };
 
+struct AtlasPacker {
+	AtlasPacker(IAllocator& allocator) : nodes(allocator) {
+		nodes.resize(FontManager::ATLAS_SIZE);
+		reset();
+	}
+
+	void reset() {
+		stbrp_init_target(&ctx, FontManager::ATLAS_SIZE, FontManager::ATLAS_SIZE, nodes.begin(), nodes.size());
+	}
+
+	stbrp_context ctx;
+	Array<stbrp_node> nodes;
+};
+
 const Glyph* findGlyph(const Font& font, u32 codepoint) {
 	auto iter = font.glyphs.find(codepoint);
-	if (!iter.isValid()) return nullptr;
-	return &iter.value();
+	if (iter.isValid()) return &iter.value();
+	FontManager& manager = (FontManager&)font.resource->getResourceManager();
+	manager.requestGlyph(const_cast<Font&>(font), codepoint);
+	return nullptr;
+}
+
+u32 decodeUTF8(const char*& str) {
+	const u8* c = (const u8*)str;
+	u32 len = 1;
+	u32 res = c[0];
+	if ((c[0] & 0xe0) == 0xc0) { len = 2; res = c[0] & 0x1f; }
+	else if ((c[0] & 0xf0) == 0xe0) { len = 3; res = c[0] & 0x0f; }
+	else if ((c[0] & 0xf8) == 0xf0) { len = 4; res = c[0] & 0x07; }
+	for (u32 i = 1; i < len; ++i) {
+		if ((c[i] & 0xc0) != 0x80) {
+			++str;
+			return c[0];
+		}
+		res = (res << 6) | (c[i] & 0x3f);
+	}
+	str += len;
+	return res;
 }
 
 Vec2 measureTextA(const Font& font, const char* str, const char* str_end) {
@@ -37,188 +74,235 @@ Vec2 measureTextA(const Font& font, const char* str, const char* str_end) {
 	res.y = (float)font.font_size;
 	const char* c = str;
 	while (*c && c != str_end) {
-		auto iter = font.glyphs.find(*c);
-		if (iter.isValid()) {
-			const Glyph& glyph = iter.value();
-			res.x += glyph.advance_x;
-		}
-		++c;
+		const Glyph* glyph = findGlyph(font, decodeUTF8(c));
+		if (glyph) res.x += glyph->advance_x;
 	}
 	return res;
 }
 
-struct ToChar {
-	Font* font;
-	u32 codepoint;
-	u32 bmp_offset;
-	u32 advance_x;
-};
+// Felzenszwalb & Huttenlocher, squared distance to the nearest zero in f
+static void distanceTransform1D(const float* f, u32 n, u32 stride, float* d, i32* v, float* z) {
+	static constexpr float INF = 1e20f;
+	i32 k = 0;
+	v[0] = 0;
+	z[0] = -INF;
+	z[1] = INF;
+	auto intersect = [&](i32 q, i32 p) {
+		return ((f[q * stride] + q * q) - (f[p * stride] + p * p)) / (2 * q - 2 * p);
+	};
+	for (i32 q = 1; q < (i32)n; ++q) {
+		float s = intersect(q, v[k]);
+		while (s <= z[k]) {
+			--k;
+			s = intersect(q, v[k]);
+		}
+		++k;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = INF;
+	}
+	k = 0;
+	for (i32 q = 0; q < (i32)n; ++q) {
+		while (z[k + 1] < q) ++k;
+		const i32 p = v[k];
+		d[q] = (q - p) * (q - p) + f[p * stride];
+	}
+}
 
-static void blit(FT_Bitmap* bitmap,  Array<u8>* out) {
-	ASSERT(bitmap->pixel_mode == FT_PIXEL_MODE_GRAY);
-	const u32 offset = out->size();
-    const u32 src_pitch = bitmap->pitch;
-	const u8* src = bitmap->buffer;
-	u8* dst = out->begin() + offset;
-	out->resize(out->size() + bitmap->width * bitmap->rows);
-    for (u32 y = 0; y < bitmap->rows; ++y, src += src_pitch, dst += bitmap->width) {
-        memcpy(dst, src, bitmap->width);
+static void distanceTransform(float* grid, u32 w, u32 h, Array<float>& tmp, Array<i32>& tmp_v) {
+	const u32 n = maximum(w, h);
+	tmp.resize(n * 2 + 1);
+	tmp_v.resize(n);
+	float* d = tmp.begin();
+	float* z = d + n;
+	for (u32 x = 0; x < w; ++x) {
+		distanceTransform1D(grid + x, h, w, d, tmp_v.begin(), z);
+		for (u32 y = 0; y < h; ++y) grid[x + y * w] = d[y];
+	}
+	for (u32 y = 0; y < h; ++y) {
+		distanceTransform1D(grid + y * w, w, 1, d, tmp_v.begin(), z);
+		memcpy(grid + y * w, d, w * sizeof(float));
 	}
 }
 
-static void blit(const ToChar& tc, const Array<u8>& src_bmp, const IVec2& size, Array<u32>* out) {
-	const Glyph& c = tc.font->glyphs[tc.codepoint];
-	const u8* src = &src_bmp[tc.bmp_offset];
-	const u32 u0 = u32(c.u0 * size.x + 0.5f);
-	const u32 v0 = u32(c.v0 * size.y + 0.5f);
-	const u32 u1 = u32(c.u1 * size.x + 0.5f);
-	const u32 v1 = u32(c.v1 * size.y + 0.5f);
-	const u32 w = u1 - u0;
-	const u32 h = v1 - v0;
-	u32* dst = &(*out)[u0 + v0 * size.x];
-	for (u32 y = 0; y < h; ++y, dst += size.x, src += w) {
+// coverage bitmap to signed distance, 0.5 is the edge, 1 is SDF_SPREAD pixels inside
+static void computeSDF(const FT_Bitmap& bitmap, u32 spread, u32 w, u32 h, Array<u8>& out, IAllocator& allocator) {
+	constexpr float INF = 1e20f;
+	Array<float> inside(allocator);
+	Array<float> outside(allocator);
+	Array<float> tmp(allocator);
+	Array<i32> tmp_v(allocator);
+	inside.resize(w * h);
+	outside.resize(w * h);
+	for (u32 y = 0; y < h; ++y) {
 		for (u32 x = 0; x < w; ++x) {
-			dst[x] = 0x00ffFFff | ((u32)src[x] << 24);
+			const i32 bx = i32(x) - spread;
+			const i32 by = i32(y) - spread;
+			u8 coverage = 0;
+			if (bx >= 0 && by >= 0 && bx < (i32)bitmap.width && by < (i32)bitmap.rows) {
+				coverage = bitmap.buffer[bx + by * bitmap.pitch];
+			}
+			const bool is_inside = coverage > 127;
+			inside[x + y * w] = is_inside ? 0 : INF;
+			outside[x + y * w] = is_inside ? INF : 0;
 		}
 	}
+	distanceTransform(inside.begin(), w, h, tmp, tmp_v);
+	distanceTransform(outside.begin(), w, h, tmp, tmp_v);
+
+	out.resize(w * h);
+	for (u32 i = 0; i < w * h; ++i) {
+		// edge is between the last inside and the first outside pixel
+		const float dist = outside[i] > 0 ? sqrtf(outside[i]) - 0.5f : 0.5f - sqrtf(inside[i]);
+		const float v = clamp(0.5f + 0.5f * dist / spread, 0.f, 1.f);
+		out[i] = u8(v * 255 + 0.5f);
+	}
 }
 
 Texture* FontManager::getAtlasTexture() {
-	if (m_dirty) build();
 	return m_atlas_texture;
 }
 
-bool FontManager::build()
-{
-	ASSERT(m_dirty);
-	for(Font* font : m_fonts) {
-		if (!font->resource->isReady()) return false;
-	}
-	m_dirty = false;
-	FT_MemoryRec_ memory_rec = {};
-	memory_rec.user = &m_allocator;
-	memory_rec.alloc = [](FT_Memory memory, long size) -> void* { 
-		IAllocator* alloc = (IAllocator*)memory->user;
-		return alloc->allocate(size);
-	};
-	memory_rec.free = [](FT_Memory memory, void* block) -> void { 
-		IAllocator* alloc = (IAllocator*)memory->user;
-		alloc->deallocate(block);
-	};
-	memory_rec.realloc = [](FT_Memory memory, long cur_size, long new_size, void* block) -> void* {
-		IAllocator* alloc = (IAllocator*)memory->user;
-		return alloc->reallocate(block, new_size);
-	};
-
-	FT_Library ft_library;
-	FT_Error error = FT_New_Library(&memory_rec, &ft_library);
-	if (error != 0) return false;
+void FontManager::requestGlyph(Font& font, u32 codepoint) {
+	MutexGuard lock(m_missing_mutex);
+	if (font.missing.indexOf(codepoint) < 0) font.missing.push(codepoint);
+}
 
-	FT_Add_Default_Modules(ft_library);
+void FontManager::resetAtlas() {
+	for (Font* font : m_fonts) font->glyphs.clear();
+	for (Resource* res : getResourceTable()) {
+		((FontResource*)res)->sdf_glyphs.clear();
+	}
+	m_packer->reset();
+	memset(m_atlas_data.begin(), 0, m_atlas_data.byte_size());
+	// texel used by solid shapes, see Draw2D
+	stbrp_rect solid = {};
+	solid.w = solid.h = 2;
+	stbrp_pack_rects(&m_packer->ctx, &solid, 1);
+	ASSERT(solid.x == 0 && solid.y == 0);
+	m_atlas_data[0] = m_atlas_data[1] = 0xff;
+	m_atlas_data[ATLAS_SIZE] = m_atlas_data[ATLAS_SIZE + 1] = 0xff;
+	++m_atlas_version;
+}
 
-	Array<u8> tmp_bmp(m_allocator);
-	tmp_bmp.reserve(1024 * 1024);
-	Array<stbrp_rect> rects(m_allocator);
-	Array<ToChar> to_char(m_allocator);
-	constexpr u32 PADDING = 1;
+const Glyph* FontManager::getSDFGlyph(FontResource& res, u32 codepoint) {
+	auto iter = res.sdf_glyphs.find(codepoint);
+	if (iter.isValid()) return &iter.value();
 
-	for(Font* font : m_fonts) {
+	if (!res.face) {
 		FT_Face face;
-		error = FT_New_Memory_Face(ft_library, font->resource->file_data.begin(), font->resource->file_data.byte_size(), 0, &face);
+		FT_Error error = FT_New_Memory_Face(m_ft_library, res.file_data.begin(), res.file_data.byte_size(), 0, &face);
 		if (error != 0) {
-			logError("Renderer") << "Failed to create font " << font->resource->getPath();
-			continue;
+			if (res.sdf_glyphs.empty()) logError("Renderer") << "Failed to create font " << res.getPath();
+			Glyph empty = {};
+			empty.codepoint = codepoint;
+			return &res.sdf_glyphs.insert(codepoint, empty).value();
 		}
-	
+		res.face = face;
+
 		FT_Size_RequestRec size_req;
-        size_req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
-        size_req.width = 0;
-        size_req.height = (u32)font->font_size * 64;
-        size_req.horiResolution = 0;
-        size_req.vertResolution = 0;
-        error = FT_Request_Size(face, &size_req);
+		size_req.type = FT_SIZE_REQUEST_TYPE_REAL_DIM;
+		size_req.width = 0;
+		size_req.height = SDF_FONT_SIZE * 64;
+		size_req.horiResolution = 0;
+		size_req.vertResolution = 0;
+		error = FT_Request_Size(face, &size_req);
 		if (error != 0) {
-			logError("Renderer") << "Failed to request font size " << font->font_size << " for " << font->resource->getPath();
-			continue;
+			logError("Renderer") << "Failed to request font size for " << res.getPath();
 		}
 
 		error = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
 		if (error != 0) {
-			logError("Renderer") << "Failed to select unicode charmap of font " << font->resource->getPath();
-			continue;
-		}
-		
-		for (Glyph& c : font->glyphs) {
-			c.u0 = c.v0 = 0;
-			c.u1 = c.v1 = 1;
-
-			const u32 glyph_index = FT_Get_Char_Index(face, c.codepoint);
-			if (glyph_index == 0) continue;
-
-			error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP);
-			if (error) continue;
-
-			FT_GlyphSlot slot = face->glyph;
-			error = FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-			if (error != 0) continue;
-
-			FT_Bitmap* ft_bitmap = &face->glyph->bitmap;
-			stbrp_rect& r = rects.emplace();
-			r.w = ft_bitmap->width + 2 * PADDING;
-			r.h = ft_bitmap->rows + 2 * PADDING;
-			to_char.push({font, c.codepoint, (u32)tmp_bmp.size(), static_cast<u32>(slot->advance.x)});
-			blit(ft_bitmap, &tmp_bmp);
-			c.x0 = float(slot->bitmap_left);
-			c.y0 = float(-slot->bitmap_top);
-			c.x1 = float(c.x0 + r.w - 2 * PADDING);
-			c.y1 = float(c.y0 + r.h - 2 * PADDING);
+			logError("Renderer") << "Failed to select unicode charmap of font " << res.getPath();
 		}
 	}
 
-	stbrp_context ctx;
-	Array<stbrp_node> nodes(m_allocator);
-	nodes.resize(2048);
-	stbrp_init_target(&ctx, 2048, 32 * 1024, nodes.begin(), nodes.size());
-	stbrp_pack_rects(&ctx, rects.begin(), rects.size());
-
-	u32 w = 2048;
-	u32 h = 1;
-	for (const stbrp_rect& r : rects) {
-		ASSERT(u32(r.x + r.w) <= w);
-		h = maximum(h, r.y + r.h);
+	FT_Face face = res.face;
+	Glyph glyph = {};
+	glyph.codepoint = codepoint;
+	// missing characters are rendered as .notdef glyph
+	const u32 glyph_index = FT_Get_Char_Index(face, codepoint);
+	if (FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP) != 0 || FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL) != 0) {
+		return &res.sdf_glyphs.insert(codepoint, glyph).value();
 	}
 
-	for (const stbrp_rect& r : rects) {
-		const ToChar& tc = to_char[int(&r - rects.begin())];
-		Glyph& c = tc.font->glyphs[tc.codepoint];
-		c.advance_x = float(((tc.advance_x + 63) & -64) / 64);
-		c.u0 = (r.x + PADDING) / (float)w;
-		c.v0 = (r.y + PADDING) / (float)h;
-		c.u1 = float(r.x + r.w - PADDING) / w;
-		c.v1 = float(r.y + r.h - PADDING) / h;
+	const FT_GlyphSlot slot = face->glyph;
+	const FT_Bitmap& bitmap = slot->bitmap;
+	ASSERT(bitmap.pixel_mode == FT_PIXEL_MODE_GRAY);
+	glyph.advance_x = slot->advance.x / 64.f;
+	if (bitmap.width == 0 || bitmap.rows == 0) {
+		return &res.sdf_glyphs.insert(codepoint, glyph).value();
 	}
 
-	Array<u32> pixels(m_allocator);
-	pixels.resize(w * h);
-	for (u32& p : pixels) p = 0;
-	for (const ToChar& tc : to_char) {
-		blit(tc, tmp_bmp, IVec2(w, h), &pixels);
-	}
-
-	pixels[0] = 0xffFFffFF;
-	if (m_atlas_texture) {
-		m_atlas_texture->destroy();
-	}
-	else {
-		auto& texture_manager = m_renderer.getTextureManager();
-		m_atlas_texture = LUMIX_NEW(m_allocator, Texture)(Path("draw2d_atlas"), texture_manager, m_renderer, m_allocator);
+	constexpr u32 PADDING = 1;
+	const u32 w = bitmap.width + 2 * SDF_SPREAD;
+	const u32 h = bitmap.rows + 2 * SDF_SPREAD;
+	stbrp_rect rect = {};
+	rect.w = w + PADDING;
+	rect.h = h + PADDING;
+	stbrp_pack_rects(&m_packer->ctx, &rect, 1);
+	if (!rect.was_packed) return nullptr;
+
+	Array<u8> sdf(m_allocator);
+	computeSDF(bitmap, SDF_SPREAD, w, h, sdf, m_allocator);
+	for (u32 y = 0; y < h; ++y) {
+		memcpy(&m_atlas_data[rect.x + (rect.y + y) * ATLAS_SIZE], &sdf[y * w], w);
 	}
-	m_atlas_texture->create(w, h, gpu::TextureFormat::RGBA8, pixels.begin(), pixels.byte_size());
 
-	FT_Done_Library(ft_library);
-	return true;
+	const Renderer::MemRef mem = m_renderer.copy(sdf.begin(), sdf.byte_size());
+	m_renderer.updateTexture(m_atlas_texture->handle, rect.x, rect.y, w, h, gpu::TextureFormat::R8, mem);
+
+	glyph.u0 = rect.x / (float)ATLAS_SIZE;
+	glyph.v0 = rect.y / (float)ATLAS_SIZE;
+	glyph.u1 = (rect.x + w) / (float)ATLAS_SIZE;
+	glyph.v1 = (rect.y + h) / (float)ATLAS_SIZE;
+	glyph.x0 = float(slot->bitmap_left) - SDF_SPREAD;
+	glyph.y0 = float(-slot->bitmap_top) - SDF_SPREAD;
+	glyph.x1 = glyph.x0 + w;
+	glyph.y1 = glyph.y0 + h;
+	return &res.sdf_glyphs.insert(codepoint, glyph).value();
 }
 
+void FontManager::update() {
+	PROFILE_FUNCTION();
+	// limits the stall if a lot of new text, e.g. CJK, appears at once
+	constexpr u32 MAX_GLYPHS_PER_UPDATE = 256;
+	if (!m_ft_library) return;
+	u32 processed = 0;
+	bool changed = false;
+	MutexGuard lock(m_missing_mutex);
+	for (Font* font : m_fonts) {
+		if (!font->resource->isReady()) continue;
+		while (!font->missing.empty() && processed < MAX_GLYPHS_PER_UPDATE) {
+			const u32 codepoint = font->missing.back();
+			font->missing.pop();
+			if (font->glyphs.find(codepoint).isValid()) continue;
+
+			++processed;
+			const Glyph* sdf = getSDFGlyph(*font->resource, codepoint);
+			if (!sdf) {
+				// glyphs which are still used are requested again
+				logInfo("Renderer") << "Font atlas is full, resetting it.";
+				resetAtlas();
+				const Renderer::MemRef mem = m_renderer.copy(m_atlas_data.begin(), m_atlas_data.byte_size());
+				m_renderer.updateTexture(m_atlas_texture->handle, 0, 0, ATLAS_SIZE, ATLAS_SIZE, gpu::TextureFormat::R8, mem);
+				for (Font* f : m_fonts) f->missing.clear();
+				return;
+			}
+
+			const float scale = font->font_size / (float)SDF_FONT_SIZE;
+			Glyph glyph = *sdf;
+			glyph.x0 *= scale;
+			glyph.y0 *= scale;
+			glyph.x1 *= scale;
+			glyph.y1 *= scale;
+			glyph.advance_x *= scale;
+			font->glyphs.insert(codepoint, glyph);
+			changed = true;
+		}
+	}
+	if (changed) ++m_atlas_version;
+}
 
 const ResourceType FontResource::TYPE("font");
 
@@ -226,6 +310,7 @@ const ResourceType FontResource::TYPE("font");
 FontResource::FontResource(const Path& path, ResourceManager& manager, IAllocator& allocator)
 	: Resource(path, manager, allocator)
 	, file_data(allocator)
+	, sdf_glyphs(allocator)
 {
 }
 
@@ -240,6 +325,22 @@ bool FontResource::load(u64 size, const u8* mem)
 }
 
 
+void FontResource::unload()
+{
+	auto& manager = (FontManager&)m_resource_manager;
+	// glyphs stay in the atlas until it's reset
+	sdf_glyphs.clear();
+	for (Font* font : manager.m_fonts) {
+		if (font->resource == this) font->glyphs.clear();
+	}
+	if (face) {
+		FT_Done_Face(face);
+		face = nullptr;
+	}
+	file_data.free();
+}
+
+
 Font* FontResource::addRef(int font_size)
 {
 	auto& manager = (FontManager&)m_resource_manager;
@@ -253,14 +354,12 @@ Font* FontResource::addRef(int font_size)
 	font->ref = 1;
 	font->resource = this;
 	font->font_size = font_size;
-	for(u32 cp = 0x20; cp < 0xff; ++cp) {
-		Glyph c;
-		c.codepoint = cp;
-		font->glyphs.insert(cp, c);
+	{
+		MutexGuard lock(manager.m_missing_mutex);
+		// latin is prepared right away, everything else when it's needed
+		for (u32 cp = 0x7e; cp >= 0x20; --cp) font->missing.push(cp);
 	}
 	manager.m_fonts.push(font);
-	manager.m_dirty = true;
-	if (isReady()) manager.build();
 	return font;
 }
 
@@ -271,10 +370,9 @@ void FontResource::removeRef(Font& font)
 	--font.ref;
 	if(font.ref == 0) {
 		auto& manager = (FontManager&)m_resource_manager;
-		LUMIX_DELETE(manager.m_allocator, &font);
+		MutexGuard lock(manager.m_missing_mutex);
 		manager.m_fonts.eraseItem(&font);
-		manager.m_dirty = true;
-		if (isReady()) manager.build();
+		LUMIX_DELETE(manager.m_allocator, &font);
 	}
 }
 
@@ -285,8 +383,40 @@ FontManager::FontManager(Renderer& renderer, IAllocator& allocator)
 	, m_renderer(renderer)
 	, m_atlas_texture(nullptr)
 	, m_fonts(allocator)
+	, m_atlas_data(allocator)
 {
-	build();
+	FT_MemoryRec_* memory_rec = LUMIX_NEW(m_allocator, FT_MemoryRec_);
+	memory_rec->user = &m_allocator;
+	memory_rec->alloc = [](FT_Memory memory, long size) -> void* { 
+		IAllocator* alloc = (IAllocator*)memory->user;
+		return alloc->allocate(size);
+	};
+	memory_rec->free = [](FT_Memory memory, void* block) -> void { 
+		IAllocator* alloc = (IAllocator*)memory->user;
+		alloc->deallocate(block);
+	};
+	memory_rec->realloc = [](FT_Memory memory, long cur_size, long new_size, void* block) -> void* {
+		IAllocator* alloc = (IAllocator*)memory->user;
+		return alloc->reallocate(block, new_size);
+	};
+
+	FT_Library ft_library;
+	m_ft_memory = memory_rec;
+	if (FT_New_Library(memory_rec, &ft_library) != 0) {
+		logError("Renderer") << "Failed to initialize FreeType";
+	}
+	else {
+		FT_Add_Default_Modules(ft_library);
+		m_ft_library = ft_library;
+	}
+
+	m_packer = LUMIX_NEW(m_allocator, AtlasPacker)(m_allocator);
+	m_atlas_data.resize(ATLAS_SIZE * ATLAS_SIZE);
+	resetAtlas();
+
+	auto& texture_manager = m_renderer.getTextureManager();
+	m_atlas_texture = LUMIX_NEW(m_allocator, Texture)(Path("draw2d_atlas"), texture_manager, m_renderer, m_allocator);
+	m_atlas_texture->create(ATLAS_SIZE, ATLAS_SIZE, gpu::TextureFormat::R8, m_atlas_data.begin(), m_atlas_data.byte_size());
 }
 
 
@@ -300,6 +430,10 @@ FontManager::~FontManager()
 		m_atlas_texture->destroy();
 		LUMIX_DELETE(m_allocator, m_atlas_texture);
 	}
+	LUMIX_DELETE(m_allocator, m_packer);
+
+	if (m_ft_library) FT_Done_Library(m_ft_library);
+	LUMIX_DELETE(m_allocator, m_ft_memory);
 }
 
 
@@ -5,13 +5,20 @@
 #include "engine/delegate_list.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/sync.h"
 #include "renderer/draw2d.h"
 
 
+struct FT_FaceRec_;
+struct FT_LibraryRec_;
+struct FT_MemoryRec_;
+
+
 namespace Lumix
 {
 
 
+struct AtlasPacker;
 struct Font;
 struct Renderer;
 struct Texture;
@@ -26,7 +33,10 @@ struct Glyph {
 
 
 LUMIX_RENDERER_API Vec2 measureTextA(const Font& font, const char* str, const char* str_end);
+// glyphs are rasterized on demand, nullptr if the glyph is not in the atlas yet, it's there in a frame or two
 LUMIX_RENDERER_API const Glyph* findGlyph(const Font& font, u32 codepoint);
+// returns the codepoint and moves str after it, invalid sequences are returned byte by byte
+LUMIX_RENDERER_API u32 decodeUTF8(const char*& str);
 
 
 struct LUMIX_RENDERER_API FontResource final : Resource
@@ -35,12 +45,15 @@ struct LUMIX_RENDERER_API FontResource final : Resource
 
 	ResourceType getType() const override { return TYPE; }
 
-	void unload() override { file_data.free(); }
+	void unload() override;
 	bool load(u64 size, const u8* mem) override;
 	Font* addRef(int font_size);
 	void removeRef(Font& font);
 
 	Array<u8> file_data;
+	// rasterized at FontManager::SDF_FONT_SIZE, shared by fonts of all sizes
+	HashMap<u32, Glyph> sdf_glyphs;
+	FT_FaceRec_* face = nullptr;
 	static const ResourceType TYPE;
 };
 
@@ -49,22 +62,40 @@ struct LUMIX_RENDERER_API FontManager final : ResourceManager
 {
 friend struct FontResource;
 public:
+	// glyphs are signed distance fields in a single channel atlas, so one glyph serves all font sizes
+	static constexpr u32 SDF_FONT_SIZE = 32;
+	static constexpr u32 SDF_SPREAD = 4;
+	static constexpr u32 ATLAS_SIZE = 2048;
+
 	FontManager(Renderer& renderer, IAllocator& allocator);
 	~FontManager();
 
 	Texture* getAtlasTexture();
+	// changes every time glyphs are added to the atlas or the atlas is reset
+	u32 getAtlasVersion() const { return m_atlas_version; }
+	// rasterizes glyphs requested by findGlyph, must not run while glyphs are read, i.e. during setup of render jobs
+	void update();
+	// thread safe, the glyph is rasterized in the next update
+	void requestGlyph(Font& font, u32 codepoint);
 
 private:
 	Resource* createResource(const Path& path) override;
 	void destroyResource(Resource& resource) override;
-	bool build();
+	const Glyph* getSDFGlyph(FontResource& resource, u32 codepoint);
+	void resetAtlas();
 
 private:
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
 	Texture* m_atlas_texture;
 	Array<Font*> m_fonts;
-	bool m_dirty = true;
+	FT_LibraryRec_* m_ft_library = nullptr;
+	FT_MemoryRec_* m_ft_memory = nullptr;
+	AtlasPacker* m_packer = nullptr;
+	Array<u8> m_atlas_data;
+	// protects Font::missing, findGlyph can be called from any thread
+	Mutex m_missing_mutex;
+	u32 m_atlas_version = 0;
 };
 
 
@@ -23,6 +23,7 @@ typedef const GLubyte* (APIENTRY* PFNGLGETSTRINGIPROC) (GLenum name, GLuint inde
 
 GPU_GL_IMPORT(PFNGLACTIVETEXTUREPROC, glActiveTexture);
 GPU_GL_IMPORT(PFNGLATTACHSHADERPROC, glAttachShader);
+GPU_GL_IMPORT(PFNGLBEGINQUERYPROC, glBeginQuery);
 GPU_GL_IMPORT(PFNGLBINDBUFFERPROC, glBindBuffer);
 GPU_GL_IMPORT(PFNGLBINDBUFFERRANGEPROC, glBindBufferRange);
 GPU_GL_IMPORT(PFNGLBINDBUFFERBASEPROC, glBindBufferBase);
@@ -44,6 +45,7 @@ GPU_GL_IMPORT(PFNGLCOMPRESSEDTEXIMAGE3DPROC, glCompressedTexImage3D);
 GPU_GL_IMPORT(PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC, glCompressedTexSubImage3D);
 GPU_GL_IMPORT(PFNGLCOMPRESSEDTEXTURESUBIMAGE3DPROC, glCompressedTextureSubImage3D);
 GPU_GL_IMPORT(PFNGLCOPYIMAGESUBDATAPROC, glCopyImageSubData);
+GPU_GL_IMPORT(PFNGLCOPYNAMEDBUFFERSUBDATAPROC, glCopyNamedBufferSubData);
 GPU_GL_IMPORT(PFNGLCREATEBUFFERSPROC, glCreateBuffers);
 GPU_GL_IMPORT(PFNGLCREATEFRAMEBUFFERSPROC, glCreateFramebuffers);
 GPU_GL_IMPORT(PFNGLCREATEPROGRAMPROC, glCreateProgram);
@@ -59,10 +61,12 @@ GPU_GL_IMPORT(PFNGLDELETESHADERPROC, glDeleteShader);
 GPU_GL_IMPORT(PFNGLDELETESYNCPROC, glDeleteSync);
 GPU_GL_IMPORT(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays);
 GPU_GL_IMPORT(PFNGLDISABLEVERTEXATTRIBARRAYPROC, glDisableVertexAttribArray);
+GPU_GL_IMPORT(PFNGLDISPATCHCOMPUTEPROC, glDispatchCompute);
 GPU_GL_IMPORT(PFNGLDRAWARRAYSINSTANCEDARBPROC, glDrawArraysInstanced);
 GPU_GL_IMPORT(PFNGLDRAWBUFFERSPROC, glDrawBuffers);
 GPU_GL_IMPORT(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced);
 GPU_GL_IMPORT(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray);
+GPU_GL_IMPORT(PFNGLENDQUERYPROC, glEndQuery);
 GPU_GL_IMPORT(PFNGLFENCESYNCPROC, glFenceSync);
 GPU_GL_IMPORT(PFNGLFLUSHMAPPEDNAMEDBUFFERRANGEPROC, glFlushMappedNamedBufferRange);
 GPU_GL_IMPORT(PFNGLFRAMEBUFFERRENDERBUFFERPROC, glFramebufferRenderbuffer);
@@ -76,6 +80,8 @@ GPU_GL_IMPORT(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays);
 GPU_GL_IMPORT(PFNGLGETACTIVEUNIFORMPROC, glGetActiveUniform);
 GPU_GL_IMPORT(PFNGLGETDEBUGMESSAGELOGPROC, glGetDebugMessageLog);
 GPU_GL_IMPORT(PFNGLGETFRAMEBUFFERATTACHMENTPARAMETERIVPROC, glGetFramebufferAttachmentParameteriv);
+GPU_GL_IMPORT(PFNGLGETNAMEDBUFFERSUBDATAPROC, glGetNamedBufferSubData);
+GPU_GL_IMPORT(PFNGLGETPROGRAMBINARYPROC, glGetProgramBinary);
 GPU_GL_IMPORT(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog);
 GPU_GL_IMPORT(PFNGLGETPROGRAMIVPROC, glGetProgramiv);
 GPU_GL_IMPORT(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v);
@@ -89,6 +95,7 @@ GPU_GL_IMPORT(PFNGLGETUNIFORMBLOCKINDEXPROC, glGetUniformBlockIndex);
 GPU_GL_IMPORT(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation);
 GPU_GL_IMPORT(PFNGLLINKPROGRAMPROC, glLinkProgram);
 GPU_GL_IMPORT(PFNGLMAPNAMEDBUFFERRANGEPROC, glMapNamedBufferRange);
+GPU_GL_IMPORT(PFNGLMEMORYBARRIERPROC, glMemoryBarrier);
 GPU_GL_IMPORT(PFNGLMULTIDRAWELEMENTSINDIRECTPROC, glMultiDrawElementsIndirect);
 GPU_GL_IMPORT(PFNGLNAMEDBUFFERSTORAGEPROC, glNamedBufferStorage);
 GPU_GL_IMPORT(PFNGLNAMEDBUFFERSUBDATAPROC, glNamedBufferSubData);
@@ -97,6 +104,8 @@ GPU_GL_IMPORT(PFNGLNAMEDFRAMEBUFFERTEXTURELAYERPROC, glNamedFramebufferTextureLa
 GPU_GL_IMPORT(PFNGLNAMEDFRAMEBUFFERTEXTUREPROC, glNamedFramebufferTexture);
 GPU_GL_IMPORT(PFNGLOBJECTLABELPROC, glObjectLabel);
 GPU_GL_IMPORT(PFNGLPOPDEBUGGROUPPROC, glPopDebugGroup);
+GPU_GL_IMPORT(PFNGLPROGRAMBINARYPROC, glProgramBinary);
+GPU_GL_IMPORT(PFNGLPROGRAMPARAMETERIPROC, glProgramParameteri);
 GPU_GL_IMPORT(PFNGLPUSHDEBUGGROUPPROC, glPushDebugGroup);
 GPU_GL_IMPORT(PFNGLQUERYCOUNTERPROC, glQueryCounter);
 GPU_GL_IMPORT(PFNGLSHADERSOURCEPROC, glShaderSource);
@@ -6,7 +6,9 @@
 #include "engine/math.h"
 #include "engine/sync.h"
 #include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/stream.h"
+#include "engine/string.h"
 #ifdef _WIN32
 	#include <Windows.h>
 #endif
@@ -59,14 +61,23 @@ struct Texture
 	GLenum format;
 	u32 width;
 	u32 height;
+	// resident bindless handle, 0 until getBindlessHandle is called
+	GLuint64 bindless;
 };
 
 
 struct Program
 {
 	enum { MAX_COUNT = 2048 };
+	enum { MAX_SHADERS = 16 };
 	GLuint handle;
 	VertexDecl decl;
+	// driver compiles in background, shaders are kept to log errors
+	bool pending;
+	u32 shaders_count;
+	GLuint shaders[MAX_SHADERS];
+	ShaderType types[MAX_SHADERS];
+	StaticString<64> name;
 };
 
 
@@ -131,9 +142,39 @@ static struct {
 	int max_vertex_attributes = 16;
 	ProgramHandle last_program = INVALID_PROGRAM;
 	u64 last_state = 0;
+	// false if GL state is unknown, e.g. after context switch
+	bool last_state_valid = false;
+	// shadow of GL bindings, INVALID_GL_NAME if unknown
+	struct {
+		GLuint textures[64];
+		GLuint vertex_buffers[2];
+		u32 vertex_buffer_offsets[2];
+		u32 vertex_buffer_strides[2];
+		GLuint index_buffer;
+		GLuint uniform_buffers[16];
+		size_t uniform_buffer_offsets[16];
+		size_t uniform_buffer_sizes[16];
+		GLuint shader_buffers[16];
+	} bindings;
+	u32 issued_calls = 0;
+	u32 skipped_calls = 0;
+	u32 issued_calls_counter;
+	u32 skipped_calls_counter;
+	// issued_calls of previous frames
+	u64 state_changes = 0;
+	u64 draw_calls = 0;
+	u64 dispatches = 0;
 	GLuint framebuffer = 0;
 	ProgramHandle default_program;
 	bool has_gpu_mem_info_ext = false;
+	bool has_program_binaries = false;
+	bool has_parallel_compile = false;
+	bool has_bindless = false;
+	bool has_pipeline_stats = false;
+	PFNGLGETTEXTUREHANDLEARBPROC glGetTextureHandleARB = nullptr;
+	PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glMakeTextureHandleResidentARB = nullptr;
+	PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glMakeTextureHandleNonResidentARB = nullptr;
+	StaticString<256> driver_version;
 } g_gpu;
 
 
@@ -449,6 +490,9 @@ static LoadInfo loadInfoATI1 = {
 static LoadInfo loadInfoATI2 = {
 	true, false, false, 16, GL_COMPRESSED_RG_RGTC2, GL_ZERO
 };
+static LoadInfo loadInfoBC7 = {
+	true, false, false, 16, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+};
 static LoadInfo loadInfoBGRA8 = {
 	false, false, false, 4, GL_RGBA8, GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE
 };
@@ -490,6 +534,16 @@ static LoadInfo* getDXT10LoadInfo(const Header& hdr, const DXT10Header& dxt10_hd
 		case DxgiFormat::BC3_UNORM:
 			return &loadInfoDXT5;
 			break;
+		case DxgiFormat::BC4_UNORM:
+			return &loadInfoATI1;
+			break;
+		case DxgiFormat::BC5_UNORM:
+			return &loadInfoATI2;
+			break;
+		case DxgiFormat::BC7_UNORM_SRGB:
+		case DxgiFormat::BC7_UNORM:
+			return &loadInfoBC7;
+			break;
 		default:
 			ASSERT(false);
 			return nullptr;
@@ -764,6 +818,7 @@ int getSize(AttributeType type)
 		case AttributeType::I8: return 1;
 		case AttributeType::U8: return 1;
 		case AttributeType::I16: return 2;
+		case AttributeType::HALF: return 2;
 		default: ASSERT(false); return 0;
 	}
 }
@@ -813,6 +868,7 @@ static void setVAO(const VertexDecl& decl) {
 			case AttributeType::FLOAT: gl_attr_type = GL_FLOAT; break;
 			case AttributeType::I8: gl_attr_type = GL_BYTE; break;
 			case AttributeType::U8: gl_attr_type = GL_UNSIGNED_BYTE; break;
+			case AttributeType::HALF: gl_attr_type = GL_HALF_FLOAT; break;
 			default: ASSERT(false); break;
 		}
 
@@ -837,11 +893,137 @@ static void setVAO(const VertexDecl& decl) {
 	}
 }
 
+static const char* shaderTypeToString(ShaderType type)
+{
+	switch(type) {
+		case ShaderType::GEOMETRY: return "geometry shader";		
+		case ShaderType::COMPUTE: return "compute shader";
+		case ShaderType::FRAGMENT: return "fragment shader";
+		case ShaderType::VERTEX: return "vertex shader";
+		default: return "unknown shader type";
+	}
+}
+
+
+// returns false while the driver still compiles the program
+static bool finishProgram(Program& p)
+{
+	if (!p.pending) return true;
+
+	GLint done = GL_FALSE;
+	CHECK_GL(glGetProgramiv(p.handle, GL_COMPLETION_STATUS_KHR, &done));
+	if (!done) return false;
+
+	p.pending = false;
+	GLint linked;
+	CHECK_GL(glGetProgramiv(p.handle, GL_LINK_STATUS, &linked));
+	if (linked == GL_FALSE) {
+		bool logged = false;
+		for (u32 i = 0; i < p.shaders_count; ++i) {
+			GLint compile_status;
+			CHECK_GL(glGetShaderiv(p.shaders[i], GL_COMPILE_STATUS, &compile_status));
+			if (compile_status == GL_TRUE) continue;
+
+			GLint log_len = 0;
+			CHECK_GL(glGetShaderiv(p.shaders[i], GL_INFO_LOG_LENGTH, &log_len));
+			if (log_len > 0) {
+				Array<char> log_buf(*g_gpu.allocator);
+				log_buf.resize(log_len);
+				CHECK_GL(glGetShaderInfoLog(p.shaders[i], log_len, &log_len, &log_buf[0]));
+				logError("Renderer") << p.name << " - " << shaderTypeToString(p.types[i]) << ": " << &log_buf[0];
+			}
+			else {
+				logError("Renderer") << "Failed to compile shader " << p.name << " - " << shaderTypeToString(p.types[i]);
+			}
+			logged = true;
+		}
+		if (!logged) {
+			GLint log_len = 0;
+			CHECK_GL(glGetProgramiv(p.handle, GL_INFO_LOG_LENGTH, &log_len));
+			if (log_len > 0) {
+				Array<char> log_buf(*g_gpu.allocator);
+				log_buf.resize(log_len);
+				CHECK_GL(glGetProgramInfoLog(p.handle, log_len, &log_len, &log_buf[0]));
+				logError("Renderer") << p.name << ": " << &log_buf[0];
+			}
+			else {
+				logError("Renderer") << "Failed to link program " << p.name;
+			}
+		}
+		CHECK_GL(glDeleteProgram(p.handle));
+		p.handle = 0;
+	}
+
+	for (u32 i = 0; i < p.shaders_count; ++i) {
+		CHECK_GL(glDeleteShader(p.shaders[i]));
+	}
+	p.shaders_count = 0;
+	return true;
+}
+
+
+static constexpr GLuint INVALID_GL_NAME = 0xffFFffFF;
+
+
+static void invalidateBindings()
+{
+	g_gpu.last_state_valid = false;
+	memset(&g_gpu.bindings, 0xff, sizeof(g_gpu.bindings));
+}
+
+
+// GL resets bindings of deleted objects in the current context, and the name can be reused by a new object
+static void forgetTexture(GLuint handle)
+{
+	for (GLuint& t : g_gpu.bindings.textures) {
+		if (t == handle) t = INVALID_GL_NAME;
+	}
+}
+
+
+static void releaseBindless(Texture& t)
+{
+	if (!t.bindless) return;
+	CHECK_GL(g_gpu.glMakeTextureHandleNonResidentARB(t.bindless));
+	t.bindless = 0;
+}
+
+
+static void forgetBuffer(GLuint handle)
+{
+	for (GLuint& b : g_gpu.bindings.vertex_buffers) {
+		if (b == handle) b = INVALID_GL_NAME;
+	}
+	for (GLuint& b : g_gpu.bindings.uniform_buffers) {
+		if (b == handle) b = INVALID_GL_NAME;
+	}
+	for (GLuint& b : g_gpu.bindings.shader_buffers) {
+		if (b == handle) b = INVALID_GL_NAME;
+	}
+	if (g_gpu.bindings.index_buffer == handle) g_gpu.bindings.index_buffer = INVALID_GL_NAME;
+}
+
+
 void useProgram(ProgramHandle handle)
 {
+	if (handle.isValid()) {
+		Program& prg = g_gpu.programs.values[handle.value];
+		if (prg.pending && !finishProgram(prg)) {
+			// placeholder until the driver finishes compiling, it draws nothing
+			CHECK_GL(glUseProgram(g_gpu.programs[g_gpu.default_program.value].handle));
+			setVAO(prg.decl);
+			g_gpu.last_program = INVALID_PROGRAM;
+			return;
+		}
+	}
+
 	const Program& prg = g_gpu.programs.values[handle.value];
 	const u32 prev = g_gpu.last_program.value;
-	if (prev != handle.value) {
+	if (prev == handle.value) {
+		++g_gpu.skipped_calls;
+	}
+	else {
+		++g_gpu.issued_calls;
 		g_gpu.last_program = handle;
 		if (!handle.isValid()) {
 			CHECK_GL(glUseProgram(0));
@@ -866,8 +1048,13 @@ void bindTextures(const TextureHandle* handles, u32 offset, u32 count)
 {
 	GLuint gl_handles[64];
 	ASSERT(count <= lengthOf(gl_handles));
+	ASSERT(offset + count <= lengthOf(g_gpu.bindings.textures));
 	ASSERT(handles);
 	
+	// only the range between the first and the last changed unit is bound
+	u32 first = count;
+	u32 last = 0;
+	GLuint* bound = g_gpu.bindings.textures + offset;
 	for(u32 i = 0; i < count; ++i) {
 		if (handles[i].isValid()) {
 			gl_handles[i] = g_gpu.textures[handles[i].value].handle;
@@ -875,22 +1062,42 @@ void bindTextures(const TextureHandle* handles, u32 offset, u32 count)
 		else {
 			gl_handles[i] = 0;
 		}
+		if (bound[i] != gl_handles[i]) {
+			if (first == count) first = i;
+			last = i;
+			bound[i] = gl_handles[i];
+		}
 	}
 
-	CHECK_GL(glBindTextures(offset, count, gl_handles));
+	if (first == count) {
+		++g_gpu.skipped_calls;
+		return;
+	}
+	++g_gpu.issued_calls;
+	CHECK_GL(glBindTextures(offset + first, last - first + 1, gl_handles + first));
 }
 
 
 void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u32 stride_offset) {
 	checkThread();
 	ASSERT(binding_idx < 2);
-	if(buffer.isValid()) {
-		const GLuint gl_handle = g_gpu.buffers[buffer.value].handle;
-		CHECK_GL(glBindVertexBuffer(binding_idx, gl_handle, buffer_offset, stride_offset));
-	}
-	else {
-		CHECK_GL(glBindVertexBuffer(binding_idx, 0, 0, 0));
+	const GLuint gl_handle = buffer.isValid() ? g_gpu.buffers[buffer.value].handle : 0;
+	if (!buffer.isValid()) {
+		buffer_offset = 0;
+		stride_offset = 0;
+	}
+	if (g_gpu.bindings.vertex_buffers[binding_idx] == gl_handle
+		&& g_gpu.bindings.vertex_buffer_offsets[binding_idx] == buffer_offset
+		&& g_gpu.bindings.vertex_buffer_strides[binding_idx] == stride_offset)
+	{
+		++g_gpu.skipped_calls;
+		return;
 	}
+	++g_gpu.issued_calls;
+	g_gpu.bindings.vertex_buffers[binding_idx] = gl_handle;
+	g_gpu.bindings.vertex_buffer_offsets[binding_idx] = buffer_offset;
+	g_gpu.bindings.vertex_buffer_strides[binding_idx] = stride_offset;
+	CHECK_GL(glBindVertexBuffer(binding_idx, gl_handle, buffer_offset, stride_offset));
 }
 
 
@@ -898,30 +1105,52 @@ void setState(u64 state)
 {
 	checkThread();
 	
-	if(state == g_gpu.last_state) return;
+	// each group of GL calls is issued only if its bits changed
+	const u64 changed = g_gpu.last_state_valid ? state ^ g_gpu.last_state : ~u64(0);
+	const u64 prev_state = g_gpu.last_state;
+	const bool prev_valid = g_gpu.last_state_valid;
 	g_gpu.last_state = state;
-
-	if (state & u64(StateFlags::DEPTH_TEST)) CHECK_GL(glEnable(GL_DEPTH_TEST));
-	else CHECK_GL(glDisable(GL_DEPTH_TEST));
-	
-	CHECK_GL(glDepthMask((state & u64(StateFlags::DEPTH_WRITE)) != 0));
+	g_gpu.last_state_valid = true;
 	
-	if (state & u64(StateFlags::SCISSOR_TEST)) CHECK_GL(glEnable(GL_SCISSOR_TEST));
-	else CHECK_GL(glDisable(GL_SCISSOR_TEST));
+	u32 issued = 0;
+	enum { STATE_GROUPS = 8 };
+
+	if (changed & u64(StateFlags::DEPTH_TEST)) {
+		++issued;
+		if (state & u64(StateFlags::DEPTH_TEST)) CHECK_GL(glEnable(GL_DEPTH_TEST));
+		else CHECK_GL(glDisable(GL_DEPTH_TEST));
+	}
 	
-	if (state & u64(StateFlags::CULL_BACK)) {
-		CHECK_GL(glEnable(GL_CULL_FACE));
-		CHECK_GL(glCullFace(GL_BACK));
+	if (changed & u64(StateFlags::DEPTH_WRITE)) {
+		++issued;
+		CHECK_GL(glDepthMask((state & u64(StateFlags::DEPTH_WRITE)) != 0));
 	}
-	else if(state & u64(StateFlags::CULL_FRONT)) {
-		CHECK_GL(glEnable(GL_CULL_FACE));
-		CHECK_GL(glCullFace(GL_FRONT));
+	
+	if (changed & u64(StateFlags::SCISSOR_TEST)) {
+		++issued;
+		if (state & u64(StateFlags::SCISSOR_TEST)) CHECK_GL(glEnable(GL_SCISSOR_TEST));
+		else CHECK_GL(glDisable(GL_SCISSOR_TEST));
 	}
-	else {
-		CHECK_GL(glDisable(GL_CULL_FACE));
+	
+	if (changed & u64(u64(StateFlags::CULL_BACK) | u64(StateFlags::CULL_FRONT))) {
+		++issued;
+		if (state & u64(StateFlags::CULL_BACK)) {
+			CHECK_GL(glEnable(GL_CULL_FACE));
+			CHECK_GL(glCullFace(GL_BACK));
+		}
+		else if(state & u64(StateFlags::CULL_FRONT)) {
+			CHECK_GL(glEnable(GL_CULL_FACE));
+			CHECK_GL(glCullFace(GL_FRONT));
+		}
+		else {
+			CHECK_GL(glDisable(GL_CULL_FACE));
+		}
 	}
 
-	CHECK_GL(glPolygonMode(GL_FRONT_AND_BACK, state & u64(StateFlags::WIREFRAME) ? GL_LINE : GL_FILL));
+	if (changed & u64(StateFlags::WIREFRAME)) {
+		++issued;
+		CHECK_GL(glPolygonMode(GL_FRONT_AND_BACK, state & u64(StateFlags::WIREFRAME) ? GL_LINE : GL_FILL));
+	}
 
 	auto to_gl = [&](BlendFactors factor) -> GLenum{
 		static const GLenum table[] = {
@@ -939,29 +1168,44 @@ void setState(u64 state)
 		return table[(int)factor];
 	};
 
-	u16 blend_bits = u16(state >> 6);
-
-	if (blend_bits) {
-		const BlendFactors src_rgb = (BlendFactors)(blend_bits & 0xf);
-		const BlendFactors dst_rgb = (BlendFactors)((blend_bits >> 4) & 0xf);
-		const BlendFactors src_a = (BlendFactors)((blend_bits >> 8) & 0xf);
-		const BlendFactors dst_a = (BlendFactors)((blend_bits >> 12) & 0xf);
-		glEnable(GL_BLEND);
-		glBlendFuncSeparate(to_gl(src_rgb), to_gl(dst_rgb), to_gl(src_a), to_gl(dst_a));
-	}
-	else {
-		glDisable(GL_BLEND);
+	if (changed & (u64(0xffFF) << 6)) {
+		++issued;
+		u16 blend_bits = u16(state >> 6);
+
+		if (blend_bits) {
+			const BlendFactors src_rgb = (BlendFactors)(blend_bits & 0xf);
+			const BlendFactors dst_rgb = (BlendFactors)((blend_bits >> 4) & 0xf);
+			const BlendFactors src_a = (BlendFactors)((blend_bits >> 8) & 0xf);
+			const BlendFactors dst_a = (BlendFactors)((blend_bits >> 12) & 0xf);
+			glEnable(GL_BLEND);
+			glBlendFuncSeparate(to_gl(src_rgb), to_gl(dst_rgb), to_gl(src_a), to_gl(dst_a));
+		}
+		else {
+			glDisable(GL_BLEND);
+		}
 	}
 	
-	glStencilMask(u8(state >> 22));
+	if (changed & (u64(0xff) << 22)) {
+		++issued;
+		glStencilMask(u8(state >> 22));
+	}
+
 	const StencilFuncs func = (StencilFuncs)((state >> 30) & 0xf);
+	const StencilFuncs prev_func = (StencilFuncs)((prev_state >> 30) & 0xf);
+	// func, ref, mask and ops are not set while the test is disabled, so they might not match the shadow bits
+	const bool was_enabled = prev_valid && prev_func != StencilFuncs::DISABLE;
+	const u64 stencil_changed = was_enabled ? changed : ~u64(0);
 	if (func == StencilFuncs::DISABLE) {
-		glDisable(GL_STENCIL_TEST);
+		if (stencil_changed & (u64(0xf) << 30)) {
+			++issued;
+			glDisable(GL_STENCIL_TEST);
+		}
 	}
-	else {
+	else if (stencil_changed & (u64(0xffffFFFF) << 30)) {
+		++issued;
 		const u8 ref = u8(state >> 34);
 		const u8 mask = u8(state >> 42);
-		glEnable(GL_STENCIL_TEST);
+		if (!was_enabled) glEnable(GL_STENCIL_TEST);
 		GLenum gl_func;
 		switch(func) {
 			case StencilFuncs::ALWAYS: gl_func = GL_ALWAYS; break;
@@ -969,7 +1213,7 @@ void setState(u64 state)
 			case StencilFuncs::NOT_EQUAL: gl_func = GL_NOTEQUAL; break;
 			default: ASSERT(false); break;
 		}
-		glStencilFunc(gl_func, ref, mask);
+		if (stencil_changed & (u64(0xfffff) << 30)) glStencilFunc(gl_func, ref, mask);
 		auto toGLOp = [](StencilOps op) {
 			const GLenum table[] = {
 				GL_KEEP,
@@ -983,24 +1227,30 @@ void setState(u64 state)
 			};
 			return table[(int)op];
 		};
-		const StencilOps sfail = StencilOps((state >> 50) & 0xf);
-		const StencilOps zfail = StencilOps((state >> 54) & 0xf);
-		const StencilOps zpass = StencilOps((state >> 58) & 0xf);
-		glStencilOp(toGLOp(sfail), toGLOp(zfail), toGLOp(zpass));
+		if (stencil_changed & (u64(0xfff) << 50)) {
+			const StencilOps sfail = StencilOps((state >> 50) & 0xf);
+			const StencilOps zfail = StencilOps((state >> 54) & 0xf);
+			const StencilOps zpass = StencilOps((state >> 58) & 0xf);
+			glStencilOp(toGLOp(sfail), toGLOp(zfail), toGLOp(zpass));
+		}
 	}
+
+	g_gpu.issued_calls += issued;
+	g_gpu.skipped_calls += STATE_GROUPS - issued;
 }
 
 
 void bindIndexBuffer(BufferHandle handle)
 {
 	checkThread();
-	if(handle.isValid()) {	
-		const GLuint ib = g_gpu.buffers[handle.value].handle;
-		CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib));
+	const GLuint ib = handle.isValid() ? g_gpu.buffers[handle.value].handle : 0;
+	if (g_gpu.bindings.index_buffer == ib) {
+		++g_gpu.skipped_calls;
 		return;
 	}
-
-	CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	++g_gpu.issued_calls;
+	g_gpu.bindings.index_buffer = ib;
+	CHECK_GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib));
 }
 
 
@@ -1024,6 +1274,7 @@ void drawElements(u32 offset, u32 count, PrimitiveType primitive_type, DataType
 		default: ASSERT(0); break;
 	}
 
+	++g_gpu.draw_calls;
 	CHECK_GL(glDrawElements(pt, count, t, (void*)(intptr_t)offset));
 }
 
@@ -1031,6 +1282,7 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 {
 	checkThread();
 	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	++g_gpu.draw_calls;
 	/*if (instances_count * indices_count > 4096) {
 		struct {
 			u32  indices_count;
@@ -1054,17 +1306,48 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 }
 
 
+void drawTrianglesIndirect(BufferHandle indirect_buffer, u32 offset, u32 count, u32 stride, DataType index_type)
+{
+	checkThread();
+	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	const GLuint buf = g_gpu.buffers[indirect_buffer.value].handle;
+	g_gpu.draw_calls += count;
+	CHECK_GL(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buf));
+	CHECK_GL(glMultiDrawElementsIndirect(GL_TRIANGLES, type, (const void*)(uintptr)offset, count, stride));
+	CHECK_GL(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+}
+
+
+void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z)
+{
+	checkThread();
+	// program is still compiling
+	if (!g_gpu.last_program.isValid()) return;
+	++g_gpu.dispatches;
+	CHECK_GL(glDispatchCompute(num_groups_x, num_groups_y, num_groups_z));
+}
+
+
+void memoryBarrier()
+{
+	checkThread();
+	CHECK_GL(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT));
+}
+
+
 void drawTriangles(u32 indices_count, DataType index_type)
 {
 	checkThread();
 
 	const GLenum type = index_type == DataType::U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	++g_gpu.draw_calls;
 	CHECK_GL(glDrawElements(GL_TRIANGLES, indices_count, type, 0));
 }
 
 
 void drawTriangleStripArraysInstanced(u32 indices_count, u32 instances_count)
 {
+	++g_gpu.draw_calls;
 	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, indices_count, instances_count);
 }
 
@@ -1082,27 +1365,67 @@ void drawArrays(u32 offset, u32 count, PrimitiveType type)
 		default: ASSERT(0); break;
 	}
 
+	++g_gpu.draw_calls;
 	CHECK_GL(glDrawArrays(pt, offset, count));
 }
 
+// size 0 means the whole buffer
+static bool isUniformBufferBound(u32 index, GLuint buf, size_t offset, size_t size) {
+	if (index >= lengthOf(g_gpu.bindings.uniform_buffers)) {
+		++g_gpu.issued_calls;
+		return false;
+	}
+	if (g_gpu.bindings.uniform_buffers[index] == buf
+		&& g_gpu.bindings.uniform_buffer_offsets[index] == offset
+		&& g_gpu.bindings.uniform_buffer_sizes[index] == size)
+	{
+		++g_gpu.skipped_calls;
+		return true;
+	}
+	++g_gpu.issued_calls;
+	g_gpu.bindings.uniform_buffers[index] = buf;
+	g_gpu.bindings.uniform_buffer_offsets[index] = offset;
+	g_gpu.bindings.uniform_buffer_sizes[index] = size;
+	return false;
+}
+
 void bindUniformBuffer(u32 index, BufferGroupHandle buffer, size_t element_index) {
 	checkThread();
 	if (buffer.isValid()) {
 		const BufferGroup& g = g_gpu.buffer_groups[buffer.value];
 		ASSERT(element_index < g.elements_count);
+		if (isUniformBufferBound(index, g.handle, g.element_size * element_index, g.element_size)) return;
 		CHECK_GL(glBindBufferRange(GL_UNIFORM_BUFFER, index, g.handle, g.element_size * element_index, g.element_size));
 		return;
 	}
+	if (isUniformBufferBound(index, 0, 0, 0)) return;
 	CHECK_GL(glBindBufferBase(GL_UNIFORM_BUFFER, index, 0));
 }
 
+void bindShaderBuffer(BufferHandle buffer, u32 binding_idx)
+{
+	checkThread();
+	const GLuint buf = buffer.isValid() ? g_gpu.buffers[buffer.value].handle : 0;
+	if (binding_idx < lengthOf(g_gpu.bindings.shader_buffers)) {
+		if (g_gpu.bindings.shader_buffers[binding_idx] == buf) {
+			++g_gpu.skipped_calls;
+			return;
+		}
+		g_gpu.bindings.shader_buffers[binding_idx] = buf;
+	}
+	++g_gpu.issued_calls;
+	CHECK_GL(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding_idx, buf));
+}
+
 void bindUniformBuffer(u32 index, BufferHandle buffer, size_t size) {
 	checkThread();
 	if (buffer.isValid()) {
 		const GLuint buf = g_gpu.buffers[buffer.value].handle;
+		if (isUniformBufferBound(index, buf, 0, 0)) return;
 		CHECK_GL(glBindBufferBase(GL_UNIFORM_BUFFER, index, buf));
 		return;
 	}
+	if (isUniformBufferBound(index, 0, 0, size)) return;
 	CHECK_GL(glBindBufferRange(GL_UNIFORM_BUFFER, index, 0, 0, size));
 }
 
@@ -1112,6 +1435,9 @@ void* map(BufferHandle buffer, size_t size)
 	checkThread();
 	const Buffer& b = g_gpu.buffers[buffer.value];
 	ASSERT((b.flags & (u32)BufferFlags::IMMUTABLE) == 0);
+	if (b.flags & (u32)BufferFlags::PERSISTENT) {
+		return glMapNamedBufferRange(b.handle, 0, size, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	}
 	const GLbitfield gl_flags = GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_WRITE_BIT;
 	return glMapNamedBufferRange(b.handle, 0, size, gl_flags);
 }
@@ -1267,6 +1593,8 @@ void setCurrentWindow(void* window_handle) {
 
 		wglMakeCurrent(ctx.device_context, ctx.hglrc);
 	#endif
+	// each context has its own state
+	invalidateBindings();
 	useProgram(INVALID_PROGRAM);
 }
 
@@ -1275,6 +1603,11 @@ void swapBuffers()
 {
 	checkThread();
 	glFinish();
+	Profiler::pushCounter(g_gpu.issued_calls_counter, (float)g_gpu.issued_calls);
+	Profiler::pushCounter(g_gpu.skipped_calls_counter, (float)g_gpu.skipped_calls);
+	g_gpu.state_changes += g_gpu.issued_calls;
+	g_gpu.issued_calls = 0;
+	g_gpu.skipped_calls = 0;
 	#ifdef _WIN32
 		for (const WindowContext& ctx : g_gpu.contexts) {
 			SwapBuffers(ctx.device_context);
@@ -1292,6 +1625,7 @@ void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data)
 	
 	GLbitfield gl_flags = 0;
 	if ((flags & (u32)BufferFlags::IMMUTABLE) == 0) gl_flags |= GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT;
+	if (flags & (u32)BufferFlags::PERSISTENT) gl_flags |= GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 	CHECK_GL(glNamedBufferStorage(buf, size, data, gl_flags));
 
 	g_gpu.buffers[buffer.value].handle = buf;
@@ -1322,6 +1656,11 @@ void destroy(ProgramHandle program)
 	Program& p = g_gpu.programs[program.value];
 	const GLuint handle = p.handle;
 	CHECK_GL(glDeleteProgram(handle));
+	for (u32 i = 0; i < p.shaders_count; ++i) {
+		CHECK_GL(glDeleteShader(p.shaders[i]));
+	}
+	p.shaders_count = 0;
+	p.pending = false;
 
 	MutexGuard lock(g_gpu.handle_mutex);
 	g_gpu.programs.dealloc(program.value);
@@ -1391,7 +1730,27 @@ void update(TextureHandle texture, u32 level, u32 x, u32 y, u32 w, u32 h, Textur
 }
 
 
-bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 flags, const char* debug_name)
+void update(TextureHandle texture, u32 level, u32 x, u32 y, u32 w, u32 h, TextureFormat format, BufferHandle buffer, u32 offset)
+{
+	checkThread();
+	const Texture& t = g_gpu.textures[texture.value];
+	const GLuint buf = g_gpu.buffers[buffer.value].handle;
+	for (int i = 0; i < sizeof(s_texture_formats) / sizeof(s_texture_formats[0]); ++i) {
+		if (s_texture_formats[i].format == format) {
+			const auto& f = s_texture_formats[i];
+			// with an unpack buffer bound, the pointer is an offset into it
+			CHECK_GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+			CHECK_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buf));
+			CHECK_GL(glTextureSubImage2D(t.handle, level, x, y, w, h, f.gl_format, f.type, (const void*)(uintptr)offset));
+			CHECK_GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+			return;
+		}
+	}
+	ASSERT(false);
+}
+
+
+bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 flags, u32 skip_mips, const char* debug_name)
 {
 	ASSERT(debug_name && debug_name[0]);
 	checkThread();
@@ -1457,8 +1816,13 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 
 	const GLenum texture_target = is_cubemap ? GL_TEXTURE_CUBE_MAP : layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
 	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
-	const GLenum internal_format = is_srgb ? li->internalSRGBFormat : li->internalFormat;
+	// formats without srgb variant, e.g. BC4 and BC5, are always linear
+	const GLenum internal_format = is_srgb && li->internalSRGBFormat != GL_ZERO ? li->internalSRGBFormat : li->internalFormat;
 	const u32 mipMapCount = (hdr.dwFlags & DDS::DDSD_MIPMAPCOUNT) ? hdr.dwMipMapCount : 1;
+	const u32 skip = minimum(skip_mips, mipMapCount - 1);
+	const u32 levels = mipMapCount - skip;
+	const u32 base_width = maximum(1u, hdr.dwWidth >> skip);
+	const u32 base_height = maximum(1u, hdr.dwHeight >> skip);
 
 	GLuint texture;
 	CHECK_GL(glCreateTextures(texture_target, 1, &texture));
@@ -1466,10 +1830,10 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 		return false;
 	}
 	if(layers > 1) {
-		CHECK_GL(glTextureStorage3D(texture, mipMapCount, internal_format, hdr.dwWidth, hdr.dwHeight, layers));
+		CHECK_GL(glTextureStorage3D(texture, levels, internal_format, base_width, base_height, layers));
 	}
 	else {
-		CHECK_GL(glTextureStorage2D(texture, mipMapCount, internal_format, hdr.dwWidth, hdr.dwHeight));
+		CHECK_GL(glTextureStorage2D(texture, levels, internal_format, base_width, base_height));
 	}
 	if (debug_name && debug_name[0]) {
 		CHECK_GL(glObjectLabel(GL_TEXTURE, texture, stringLength(debug_name), debug_name));
@@ -1489,16 +1853,22 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 				Array<u8> data(*g_gpu.allocator);
 				data.resize(size);
 				for (u32 mip = 0; mip < mipMapCount; ++mip) {
-					blob.read(&data[0], size);
-					if(layers > 1) {
-						CHECK_GL(glCompressedTextureSubImage3D(texture, mip, 0, 0, layer, width, height, 1, internal_format, size, &data[0]));
-					}
-					else if (is_cubemap) {
-						ASSERT(layer == 0);
-						CHECK_GL(glCompressedTextureSubImage3D(texture, mip, 0, 0, side, width, height, 1, internal_format, size, &data[0]));
+					if (mip < skip) {
+						blob.skip(size);
 					}
 					else {
-						CHECK_GL(glCompressedTextureSubImage2D(texture, mip, 0, 0, width, height, internal_format, size, &data[0]));
+						blob.read(&data[0], size);
+						const u32 level = mip - skip;
+						if(layers > 1) {
+							CHECK_GL(glCompressedTextureSubImage3D(texture, level, 0, 0, layer, width, height, 1, internal_format, size, &data[0]));
+						}
+						else if (is_cubemap) {
+							ASSERT(layer == 0);
+							CHECK_GL(glCompressedTextureSubImage3D(texture, level, 0, 0, side, width, height, 1, internal_format, size, &data[0]));
+						}
+						else {
+							CHECK_GL(glCompressedTextureSubImage2D(texture, level, 0, 0, width, height, internal_format, size, &data[0]));
+						}
 					}
 					CHECK_GL(glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
 					CHECK_GL(glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -1524,16 +1894,21 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 				unpacked.resize(size);
 				blob.read(palette, 4 * 256);
 				for (u32 mip = 0; mip < mipMapCount; ++mip) {
-					blob.read(&data[0], size);
-					for (u32 zz = 0; zz < size; ++zz) {
-						unpacked[zz] = palette[data[zz]];
-					}
-					//glPixelStorei(GL_UNPACK_ROW_LENGTH, height);
-					if(layers > 1) {
-						CHECK_GL(glTextureSubImage3D(texture, mip, 0, 0, layer, width, height, 1, li->externalFormat, li->type, &unpacked[0]));
+					if (mip < skip) {
+						blob.skip(size);
 					}
 					else {
-						CHECK_GL(glTextureSubImage2D(texture, mip, 0, 0, width, height, li->externalFormat, li->type, &unpacked[0]));
+						blob.read(&data[0], size);
+						for (u32 zz = 0; zz < size; ++zz) {
+							unpacked[zz] = palette[data[zz]];
+						}
+						//glPixelStorei(GL_UNPACK_ROW_LENGTH, height);
+						if(layers > 1) {
+							CHECK_GL(glTextureSubImage3D(texture, mip - skip, 0, 0, layer, width, height, 1, li->externalFormat, li->type, &unpacked[0]));
+						}
+						else {
+							CHECK_GL(glTextureSubImage2D(texture, mip - skip, 0, 0, width, height, li->externalFormat, li->type, &unpacked[0]));
+						}
 					}
 					width = maximum(1, width >> 1);
 					height = maximum(1, height >> 1);
@@ -1548,13 +1923,18 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 				Array<u8> data(*g_gpu.allocator);
 				data.resize(size);
 				for (u32 mip = 0; mip < mipMapCount; ++mip) {
-					blob.read(&data[0], size);
-					//glPixelStorei(GL_UNPACK_ROW_LENGTH, height);
-					if (layers > 1) {
-						CHECK_GL(glTextureSubImage3D(texture, mip, 0, 0, layer, width, height, 1, li->externalFormat, li->type, &data[0]));
+					if (mip < skip) {
+						blob.skip(size);
 					}
 					else {
-						CHECK_GL(glTextureSubImage2D(texture, mip, 0, 0, width, height, li->externalFormat, li->type, &data[0]));
+						blob.read(&data[0], size);
+						//glPixelStorei(GL_UNPACK_ROW_LENGTH, height);
+						if (layers > 1) {
+							CHECK_GL(glTextureSubImage3D(texture, mip - skip, 0, 0, layer, width, height, 1, li->externalFormat, li->type, &data[0]));
+						}
+						else {
+							CHECK_GL(glTextureSubImage2D(texture, mip - skip, 0, 0, width, height, li->externalFormat, li->type, &data[0]));
+						}
 					}
 					width = maximum(1, width >> 1);
 					height = maximum(1, height >> 1);
@@ -1562,7 +1942,7 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 				}
 				CHECK_GL(glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE));
 			}
-			CHECK_GL(glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, mipMapCount - 1));
+			CHECK_GL(glTextureParameteri(texture, GL_TEXTURE_MAX_LEVEL, levels - 1));
 		}
 	}
 
@@ -1574,11 +1954,18 @@ bool loadTexture(TextureHandle handle, const void* input, int input_size, u32 fl
 	CHECK_GL(glTextureParameteri(texture, GL_TEXTURE_WRAP_R, wrap_w));
 
 	Texture& t = g_gpu.textures[handle.value];
+	// reloaded with different mips, e.g. streamed, the handle stays the same
+	if (t.handle) {
+		releaseBindless(t);
+		forgetTexture(t.handle);
+		CHECK_GL(glDeleteTextures(1, &t.handle));
+	}
 	t.format = internal_format;
 	t.handle = texture;
+	t.bindless = 0;
 	t.target = is_cubemap ? GL_TEXTURE_CUBE_MAP : layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
-	t.width = hdr.dwWidth;
-	t.height = hdr.dwHeight;
+	t.width = base_width;
+	t.height = base_height;
 	return true;
 }
 
@@ -1596,6 +1983,8 @@ ProgramHandle allocProgramHandle()
 
 	Program& p = g_gpu.programs[id];
 	p.handle = 0;
+	p.pending = false;
+	p.shaders_count = 0;
 	return { (u32)id };
 }
 
@@ -1644,6 +2033,7 @@ TextureHandle allocTextureHandle()
 
 	Texture& t = g_gpu.textures[id];
 	t.handle = 0;
+	t.bindless = 0;
 	return { (u32)id };
 }
 
@@ -1656,6 +2046,8 @@ void createTextureView(TextureHandle view_handle, TextureHandle orig_handle)
 	Texture& view = g_gpu.textures[view_handle.value];
 
 	if (view.handle != 0) {
+		releaseBindless(view);
+		forgetTexture(view.handle);
 		CHECK_GL(glDeleteTextures(1, &view.handle));
 	}
 
@@ -1753,6 +2145,7 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 
 	Texture& t = g_gpu.textures[handle.value];
 	t.handle = texture;
+	t.bindless = 0;
 	t.target = target;
 	t.format = internal_format;
 	t.width = w;
@@ -1766,7 +2159,9 @@ void destroy(TextureHandle texture)
 {
 	checkThread();
 	Texture& t = g_gpu.textures[texture.value];
+	releaseBindless(t);
 	const GLuint handle = t.handle;
+	forgetTexture(handle);
 	CHECK_GL(glDeleteTextures(1, &handle));
 
 	MutexGuard lock(g_gpu.handle_mutex);
@@ -1778,6 +2173,7 @@ void destroy(BufferHandle buffer) {
 	
 	Buffer& t = g_gpu.buffers[buffer.value];
 	const GLuint handle = t.handle;
+	forgetBuffer(handle);
 	CHECK_GL(glDeleteBuffers(1, &handle));
 
 	MutexGuard lock(g_gpu.handle_mutex);
@@ -1789,19 +2185,22 @@ void destroy(BufferGroupHandle buffer) {
 	
 	BufferGroup& t = g_gpu.buffer_groups[buffer.value];
 	const GLuint handle = t.handle;
+	forgetBuffer(handle);
 	CHECK_GL(glDeleteBuffers(1, &handle));
 
 	MutexGuard lock(g_gpu.handle_mutex);
 	g_gpu.buffer_groups.dealloc(buffer.value);
 }
 
-void clear(u32 flags, const float* color, float depth)
+static void clear(u32 flags, const float* color, float depth, bool scissor)
 {
 	CHECK_GL(glUseProgram(0));
 	g_gpu.last_program = INVALID_PROGRAM;
-	CHECK_GL(glDisable(GL_SCISSOR_TEST));
+	if (scissor) CHECK_GL(glEnable(GL_SCISSOR_TEST));
+	else CHECK_GL(glDisable(GL_SCISSOR_TEST));
 	CHECK_GL(glDisable(GL_BLEND));
-	g_gpu.last_state &= ~u64(0xffFF << 6);
+	g_gpu.last_state &= ~(u64(0xffFF) << 6);
+	g_gpu.last_state &= ~u64(StateFlags::SCISSOR_TEST);
 	checkThread();
 	GLbitfield gl_flags = 0;
 	if (flags & (u32)ClearFlags::COLOR) {
@@ -1810,6 +2209,7 @@ void clear(u32 flags, const float* color, float depth)
 	}
 	if (flags & (u32)ClearFlags::DEPTH) {
 		CHECK_GL(glDepthMask(GL_TRUE));
+		g_gpu.last_state |= u64(StateFlags::DEPTH_WRITE);
 		CHECK_GL(glClearDepth(depth));
 		gl_flags |= GL_DEPTH_BUFFER_BIT;
 	}
@@ -1820,18 +2220,19 @@ void clear(u32 flags, const float* color, float depth)
 		gl_flags |= GL_STENCIL_BUFFER_BIT;
 	}
 	CHECK_GL(glClear(gl_flags));
+	if (scissor) CHECK_GL(glDisable(GL_SCISSOR_TEST));
 }
 
-static const char* shaderTypeToString(ShaderType type)
+void clear(u32 flags, const float* color, float depth)
 {
-	switch(type) {
-		case ShaderType::GEOMETRY: return "geometry shader";		
-		case ShaderType::FRAGMENT: return "fragment shader";
-		case ShaderType::VERTEX: return "vertex shader";
-		default: return "unknown shader type";
-	}
+	clear(flags, color, depth, false);
 }
 
+void clear(u32 flags, const float* color, float depth, u32 x, u32 y, u32 w, u32 h)
+{
+	CHECK_GL(glScissor(x, y, w, h));
+	clear(flags, color, depth, true);
+}
 
 bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs, const ShaderType* types, u32 num, const char** prefixes, u32 prefixes_count, const char* name)
 {
@@ -1853,11 +2254,15 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 		"#define _HAS_ATTR12\n"
 	};
 
-	const char* combined_srcs[32];
-	ASSERT(prefixes_count < lengthOf(combined_srcs) - 1); 
-	enum { MAX_SHADERS_PER_PROGRAM = 16 };
+	// xyz are integers, w is the exponent of their scale, see decodePosition in common.glsl
+	bool quantized_position = false;
+	for (u32 j = 0; j < decl.attributes_count; ++j) {
+		if (decl.attributes[j].idx == 0 && decl.attributes[j].type == AttributeType::I16) quantized_position = true;
+	}
 
-	if (num > MAX_SHADERS_PER_PROGRAM) {
+	const char* combined_srcs[32];
+	ASSERT(prefixes_count + decl.attributes_count + 3 <= lengthOf(combined_srcs));
+	if (num > Program::MAX_SHADERS) {
 		logError("Renderer") << "Too many shaders per program in " << name;
 		return false;
 	}
@@ -1873,27 +2278,43 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 			case ShaderType::GEOMETRY: shader_type = GL_GEOMETRY_SHADER; break;
 			case ShaderType::FRAGMENT: shader_type = GL_FRAGMENT_SHADER; break;
 			case ShaderType::VERTEX: shader_type = GL_VERTEX_SHADER; break;
+			case ShaderType::COMPUTE: shader_type = GL_COMPUTE_SHADER; break;
 			default: ASSERT(false); return false;
 		}
 		const GLuint shd = glCreateShader(shader_type);
-		combined_srcs[0] = R"#(
+		// shader storage buffers and atomics are not available in 140
+		combined_srcs[0] = types[i] == ShaderType::COMPUTE ? R"#(
+			#version 430
+			#define _ORIGIN_BOTTOM_LEFT
+		)#" : R"#(
 			#version 140
 			#extension GL_ARB_explicit_attrib_location : enable
 			#extension GL_ARB_shading_language_420pack : enable
 			#extension GL_ARB_separate_shader_objects : enable
 			#define _ORIGIN_BOTTOM_LEFT
 		)#";
-		combined_srcs[prefixes_count + decl.attributes_count + 1] = srcs[i];
+		u32 srcs_count = 1;
 		for (u32 j = 0; j < prefixes_count; ++j) {
-			combined_srcs[j + 1] = prefixes[j];
+			combined_srcs[srcs_count++] = prefixes[j];
 		}
 		for (u32 j = 0; j < decl.attributes_count; ++j) {
-			combined_srcs[j + prefixes_count + 1] = attr_defines[decl.attributes[j].idx];
+			combined_srcs[srcs_count++] = attr_defines[decl.attributes[j].idx];
 		}
+		if (quantized_position) combined_srcs[srcs_count++] = "#define _QUANTIZED_POSITION\n";
+		combined_srcs[srcs_count++] = srcs[i];
 
-		CHECK_GL(glShaderSource(shd, 2 + prefixes_count + decl.attributes_count, combined_srcs, 0));
+		CHECK_GL(glShaderSource(shd, srcs_count, combined_srcs, 0));
 		CHECK_GL(glCompileShader(shd));
 
+		if (g_gpu.has_parallel_compile) {
+			// status is checked in finishProgram, querying it now would wait for the compiler
+			Program& p = g_gpu.programs[prog.value];
+			p.shaders[i] = shd;
+			p.types[i] = types[i];
+			CHECK_GL(glAttachShader(prg, shd));
+			continue;
+		}
+
 		GLint compile_status;
 		CHECK_GL(glGetShaderiv(shd, GL_COMPILE_STATUS, &compile_status));
 		if (compile_status == GL_FALSE) {
@@ -1916,7 +2337,21 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 		CHECK_GL(glDeleteShader(shd));
 	}
 
+	if (g_gpu.has_program_binaries) {
+		CHECK_GL(glProgramParameteri(prg, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+	}
 	CHECK_GL(glLinkProgram(prg));
+
+	if (g_gpu.has_parallel_compile) {
+		Program& p = g_gpu.programs[prog.value];
+		p.handle = prg;
+		p.decl = decl;
+		p.pending = true;
+		p.shaders_count = num;
+		p.name = name ? name : "";
+		return true;
+	}
+
 	GLint linked;
 	CHECK_GL(glGetProgramiv(prg, GL_LINK_STATUS, &linked));
 
@@ -1943,6 +2378,68 @@ bool createProgram(ProgramHandle prog, const VertexDecl& decl, const char** srcs
 }
 
 
+bool isProgramReady(ProgramHandle program)
+{
+	checkThread();
+	return finishProgram(g_gpu.programs[program.value]);
+}
+
+
+bool getProgramBinary(ProgramHandle program, OutputMemoryStream& blob)
+{
+	checkThread();
+	if (!g_gpu.has_program_binaries) return false;
+	if (!finishProgram(g_gpu.programs[program.value])) return false;
+
+	const GLuint prg = g_gpu.programs[program.value].handle;
+	if (!prg) return false;
+	GLint size = 0;
+	CHECK_GL(glGetProgramiv(prg, GL_PROGRAM_BINARY_LENGTH, &size));
+	if (size <= 0) return false;
+
+	GLenum format;
+	const u64 offset = blob.getPos();
+	u8* data = (u8*)blob.skip(sizeof(u32) + size);
+	GLsizei len = 0;
+	glGetProgramBinary(prg, size, &len, &format, data + sizeof(u32));
+	if (len != size) {
+		blob.resize(offset);
+		return false;
+	}
+	memcpy(data, &format, sizeof(u32));
+	return true;
+}
+
+
+bool createProgramFromBinary(ProgramHandle program, const VertexDecl& decl, const void* blob, u64 size, const char* name)
+{
+	checkThread();
+	if (!g_gpu.has_program_binaries || size <= sizeof(u32)) return false;
+
+	u32 format;
+	memcpy(&format, blob, sizeof(format));
+	const GLuint prg = glCreateProgram();
+	if (name && name[0]) {
+		CHECK_GL(glObjectLabel(GL_PROGRAM, prg, stringLength(name), name));
+	}
+	glProgramBinary(prg, format, (const u8*)blob + sizeof(u32), GLsizei(size - sizeof(u32)));
+	GLint linked;
+	CHECK_GL(glGetProgramiv(prg, GL_LINK_STATUS, &linked));
+	// driver rejects binaries after updates, caller compiles from source
+	if (linked == GL_FALSE) {
+		CHECK_GL(glDeleteProgram(prg));
+		return false;
+	}
+
+	g_gpu.programs[program.value].handle = prg;
+	g_gpu.programs[program.value].decl = decl;
+	return true;
+}
+
+
+const char* getDriverVersion() { return g_gpu.driver_version; }
+
+
 void preinit(IAllocator& allocator)
 {
 	try_load_renderdoc();
@@ -1981,6 +2478,9 @@ bool init(void* window_handle, u32 init_flags)
 	
 	g_gpu.thread = OS::getCurrentThreadID();
 	g_gpu.contexts[0].window_handle = window_handle;
+	g_gpu.issued_calls_counter = Profiler::createCounter("GL state calls issued");
+	g_gpu.skipped_calls_counter = Profiler::createCounter("GL state calls skipped");
+	invalidateBindings();
 	#ifdef _WIN32
 		g_gpu.contexts[0].device_context = GetDC((HWND)window_handle);
 		if (!load_gl(g_gpu.contexts[0].device_context, init_flags)) return false;
@@ -1993,16 +2493,44 @@ bool init(void* window_handle, u32 init_flags)
 	int extensions_count;
 	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions_count);
 	g_gpu.has_gpu_mem_info_ext = false; 
+	g_gpu.has_parallel_compile = false;
 	for(int i = 0; i < extensions_count; ++i) {
 		const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
 		if (equalStrings(ext, "GL_NVX_gpu_memory_info")) {
 			g_gpu.has_gpu_mem_info_ext = true; 
-			break;
 		}
-		//OutputDebugString(ext);
-		//OutputDebugString("\n");
+		else if (equalStrings(ext, "GL_KHR_parallel_shader_compile") || equalStrings(ext, "GL_ARB_parallel_shader_compile")) {
+			g_gpu.has_parallel_compile = true;
+		}
+		else if (equalStrings(ext, "GL_ARB_bindless_texture")) {
+			g_gpu.has_bindless = true;
+		}
+		else if (equalStrings(ext, "GL_ARB_pipeline_statistics_query")) {
+			g_gpu.has_pipeline_stats = true;
+		}
 	}
-	//const unsigned char* version = glGetString(GL_VERSION);
+	if (g_gpu.has_bindless) {
+		g_gpu.glGetTextureHandleARB = (PFNGLGETTEXTUREHANDLEARBPROC)getGLFunc("glGetTextureHandleARB");
+		g_gpu.glMakeTextureHandleResidentARB = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)getGLFunc("glMakeTextureHandleResidentARB");
+		g_gpu.glMakeTextureHandleNonResidentARB = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)getGLFunc("glMakeTextureHandleNonResidentARB");
+		g_gpu.has_bindless = g_gpu.glGetTextureHandleARB && g_gpu.glMakeTextureHandleResidentARB && g_gpu.glMakeTextureHandleNonResidentARB;
+	}
+	if (g_gpu.has_parallel_compile) {
+		auto max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getGLFunc("glMaxShaderCompilerThreadsKHR");
+		if (!max_threads) max_threads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getGLFunc("glMaxShaderCompilerThreadsARB");
+		if (max_threads) {
+			max_threads(0xffFFffFF);
+		}
+		else {
+			g_gpu.has_parallel_compile = false;
+		}
+	}
+	g_gpu.driver_version = "";
+	g_gpu.driver_version << (const char*)glGetString(GL_VENDOR) << ";" << (const char*)glGetString(GL_RENDERER) << ";" << (const char*)glGetString(GL_VERSION);
+
+	GLint binary_formats_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binary_formats_count);
+	g_gpu.has_program_binaries = binary_formats_count > 0;
 
 	CHECK_GL(glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE));
 	CHECK_GL(glDepthFunc(GL_GREATER));
@@ -2045,6 +2573,36 @@ bool init(void* window_handle, u32 init_flags)
 bool isHomogenousDepth() { return false; }
 
 
+bool isBindlessSupported() { return g_gpu.has_bindless; }
+bool isPipelineStatsSupported() { return g_gpu.has_pipeline_stats; }
+
+
+DrawCounters getDrawCounters()
+{
+	DrawCounters res;
+	res.draw_calls = g_gpu.draw_calls;
+	res.dispatches = g_gpu.dispatches;
+	res.state_changes = g_gpu.state_changes + g_gpu.issued_calls;
+	return res;
+}
+
+
+u64 getBindlessHandle(TextureHandle texture)
+{
+	checkThread();
+	ASSERT(g_gpu.has_bindless);
+	if (!texture.isValid()) return 0;
+	Texture& t = g_gpu.textures[texture.value];
+	if (!t.handle) return 0;
+	if (!t.bindless) {
+		// sampler state of the texture can not change after this
+		t.bindless = g_gpu.glGetTextureHandleARB(t.handle);
+		CHECK_GL(g_gpu.glMakeTextureHandleResidentARB(t.bindless));
+	}
+	return t.bindless;
+}
+
+
 bool isOriginBottomLeft() { return true; }
 
 
@@ -2060,6 +2618,26 @@ void copy(TextureHandle dst_handle, TextureHandle src_handle) {
 	CHECK_GL(glCopyImageSubData(src.handle, src.target, 0, 0, 0, 0, dst.handle, dst.target, 0, 0, 0, 0, src.width, src.height, 1));
 }
 
+void copy(TextureHandle dst_handle, TextureHandle src_handle, u32 dst_x, u32 dst_y) {
+	checkThread();
+	Texture& dst = g_gpu.textures[dst_handle.value];
+	Texture& src = g_gpu.textures[src_handle.value];
+	ASSERT(src.target == GL_TEXTURE_2D);
+	ASSERT(src.target == dst.target);
+	ASSERT(src.format == dst.format);
+	ASSERT(dst_x + src.width <= dst.width);
+	ASSERT(dst_y + src.height <= dst.height);
+
+	CHECK_GL(glCopyImageSubData(src.handle, src.target, 0, 0, 0, 0, dst.handle, dst.target, 0, dst_x, dst_y, 0, src.width, src.height, 1));
+}
+
+void copy(BufferHandle dst, u32 dst_offset, BufferHandle src, u32 src_offset, u32 size) {
+	checkThread();
+	const GLuint dst_buf = g_gpu.buffers[dst.value].handle;
+	const GLuint src_buf = g_gpu.buffers[src.value].handle;
+	CHECK_GL(glCopyNamedBufferSubData(src_buf, dst_buf, src_offset, dst_offset, size));
+}
+
 void readTexture(TextureHandle texture, Span<u8> buf)
 {
 	checkThread();
@@ -2078,6 +2656,35 @@ void readTexture(TextureHandle texture, Span<u8> buf)
 }
 
 
+void readTexture(TextureHandle texture, BufferHandle buffer, u32 size)
+{
+	checkThread();
+
+	const Texture& t = g_gpu.textures[texture.value];
+	const GLuint buf = g_gpu.buffers[buffer.value].handle;
+
+	for (int i = 0; i < sizeof(s_texture_formats) / sizeof(s_texture_formats[0]); ++i) {
+		if (s_texture_formats[i].gl_internal == t.format) {
+			const auto& f = s_texture_formats[i];
+			// with a pack buffer bound, the pointer is an offset into it
+			CHECK_GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, buf));
+			CHECK_GL(glGetTextureImage(t.handle, 0, f.gl_format, f.type, size, nullptr));
+			CHECK_GL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+			return;
+		}
+	}
+	ASSERT(false);
+}
+
+
+void readBuffer(BufferHandle buffer, Span<u8> buf)
+{
+	checkThread();
+	const GLuint handle = g_gpu.buffers[buffer.value].handle;
+	CHECK_GL(glGetNamedBufferSubData(handle, 0, buf.length(), buf.begin()));
+}
+
+
 void popDebugGroup()
 {
 	checkThread();
@@ -2123,12 +2730,73 @@ void destroy(QueryHandle query)
 }
 
 
+FenceHandle createFence()
+{
+	checkThread();
+	return {glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+}
+
+
+void waitFence(FenceHandle fence)
+{
+	checkThread();
+	GLenum res = glClientWaitSync((GLsync)fence.value, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (res == GL_TIMEOUT_EXPIRED) {
+		res = glClientWaitSync((GLsync)fence.value, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000);
+	}
+	ASSERT(res != GL_WAIT_FAILED);
+}
+
+
+bool isFenceSignaled(FenceHandle fence)
+{
+	checkThread();
+	const GLenum res = glClientWaitSync((GLsync)fence.value, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	ASSERT(res != GL_WAIT_FAILED);
+	return res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED;
+}
+
+
+void destroy(FenceHandle fence)
+{
+	checkThread();
+	glDeleteSync((GLsync)fence.value);
+}
+
+
 void queryTimestamp(QueryHandle query)
 {
 	glQueryCounter(query.value, GL_TIMESTAMP);
 }
 
 
+static GLenum getQueryTarget(PipelineStat stat)
+{
+	switch (stat) {
+		case PipelineStat::VERTICES: return GL_VERTICES_SUBMITTED_ARB;
+		case PipelineStat::PRIMITIVES: return GL_PRIMITIVES_SUBMITTED_ARB;
+		case PipelineStat::FRAGMENT_INVOCATIONS: return GL_FRAGMENT_SHADER_INVOCATIONS_ARB;
+		case PipelineStat::COMPUTE_INVOCATIONS: return GL_COMPUTE_SHADER_INVOCATIONS_ARB;
+		default: ASSERT(false); return GL_VERTICES_SUBMITTED_ARB;
+	}
+}
+
+
+void beginQuery(QueryHandle query, PipelineStat stat)
+{
+	checkThread();
+	ASSERT(g_gpu.has_pipeline_stats);
+	CHECK_GL(glBeginQuery(getQueryTarget(stat), query.value));
+}
+
+
+void endQuery(PipelineStat stat)
+{
+	checkThread();
+	CHECK_GL(glEndQuery(getQueryTarget(stat)));
+}
+
+
 void setFramebuffer(TextureHandle* attachments, u32 num, u32 flags)
 {
 	checkThread();
@@ -2151,6 +2819,7 @@ void setFramebuffer(TextureHandle* attachments, u32 num, u32 flags)
 		const GLuint t = g_gpu.textures[attachments[i].value].handle;
 		GLint internal_format;
 		CHECK_GL(glBindTexture(GL_TEXTURE_2D, t));
+		g_gpu.bindings.textures[0] = INVALID_GL_NAME;
 		CHECK_GL(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format));
 		
 		switch(internal_format) {
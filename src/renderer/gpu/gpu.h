@@ -6,6 +6,7 @@
 namespace Lumix {
 
 struct IAllocator;
+struct OutputMemoryStream;
 
 namespace gpu {
 
@@ -15,12 +16,14 @@ struct BufferHandle { u32 value; bool isValid() const { return value != 0xFFffFF
 struct ProgramHandle { u32 value; bool isValid() const { return value != 0xFFffFFff; } };
 struct TextureHandle { u32 value; bool isValid() const { return value != 0xFFffFFff; } };
 struct QueryHandle { u32 value; bool isValid() const { return value != 0xFFffFFff; } };
+struct FenceHandle { void* value; bool isValid() const { return value != nullptr; } };
 
 const BufferGroupHandle INVALID_BUFFER_GROUP = { 0xffFFffFF };
 const BufferHandle INVALID_BUFFER = { 0xffFFffFF };
 const ProgramHandle INVALID_PROGRAM = { 0xffFFffFF };
 const TextureHandle INVALID_TEXTURE = { 0xffFFffFF };
 const QueryHandle INVALID_QUERY = { 0xffFFffFF };
+const FenceHandle INVALID_FENCE = { nullptr };
 
 enum class InitFlags : u32 {
 	DEBUG_OUTPUT,
@@ -55,7 +58,8 @@ enum class PrimitiveType : u32 {
 enum class ShaderType : u32 {
 	VERTEX,
 	FRAGMENT,
-	GEOMETRY
+	GEOMETRY,
+	COMPUTE
 };
 
 
@@ -103,7 +107,8 @@ enum class AttributeType : u8 {
 	U8,
 	FLOAT,
 	I16,
-	I8
+	I8,
+	HALF
 };
 
 
@@ -137,7 +142,9 @@ enum class TextureFlags : u32 {
 
 enum class BufferFlags : u32 {
 	IMMUTABLE = 1 << 0,
-	UNIFORM_BUFFER = 1 << 1
+	UNIFORM_BUFFER = 1 << 1,
+	// coherent mapping, stays valid until the buffer is destroyed
+	PERSISTENT = 1 << 2
 };
 
 enum class DataType {
@@ -145,6 +152,16 @@ enum class DataType {
 	U32
 };
 
+// ARB_pipeline_statistics_query
+enum class PipelineStat : u32 {
+	VERTICES,
+	PRIMITIVES,
+	FRAGMENT_INVOCATIONS,
+	COMPUTE_INVOCATIONS,
+
+	COUNT
+};
+
 #pragma pack(1)
 struct Attribute {
 	enum Flags {
@@ -188,12 +205,24 @@ struct MemoryStats {
 };
 
 
+// totals since init, diff two snapshots to get counts of a range of commands
+struct DrawCounters {
+	u64 draw_calls;
+	u64 dispatches;
+	// GL state and binding calls which were not skipped by state caching
+	u64 state_changes;
+};
+
+
 void preinit(IAllocator& allocator);
 bool init(void* window_handle, u32 flags);
 void setCurrentWindow(void* window_handle);
 bool getMemoryStats(Ref<MemoryStats> stats);
 void swapBuffers();
 bool isHomogenousDepth();
+bool isBindlessSupported();
+bool isPipelineStatsSupported();
+DrawCounters getDrawCounters();
 LUMIX_RENDERER_API bool isOriginBottomLeft();
 void checkThread();
 void shutdown();
@@ -203,6 +232,8 @@ int getSize(AttributeType type);
 
 
 void clear(u32 flags, const float* color, float depth);
+// clears only the rectangle, e.g. a tile of an atlas
+void clear(u32 flags, const float* color, float depth, u32 x, u32 y, u32 w, u32 h);
 
 void scissor(u32 x, u32 y, u32 w, u32 h);
 void viewport(u32 x, u32 y, u32 w, u32 h);
@@ -224,14 +255,23 @@ ProgramHandle allocProgramHandle();
 
 void setState(u64 state);
 bool createProgram(ProgramHandle program, const VertexDecl& decl, const char** srcs, const ShaderType* types, u32 num, const char** prefixes, u32 prefixes_count, const char* name);
+// binaries are driver specific, they can be reused only with the same getDriverVersion()
+bool getProgramBinary(ProgramHandle program, OutputMemoryStream& blob);
+// programs can be compiled in background by the driver, useProgram binds a placeholder until they are ready
+bool isProgramReady(ProgramHandle program);
+bool createProgramFromBinary(ProgramHandle program, const VertexDecl& decl, const void* blob, u64 size, const char* name);
+const char* getDriverVersion();
 void useProgram(ProgramHandle prg);
 
 void createBufferGroup(BufferGroupHandle handle, u32 flags, size_t element_size, size_t elements_count, const void* data);
 void createBuffer(BufferHandle handle, u32 flags, size_t size, const void* data);
 bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, u32 flags, const void* data, const char* debug_name);
 void createTextureView(TextureHandle view, TextureHandle texture);
-bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, const char* debug_name);
+// skip_mips highest mips are not uploaded, existing texture is replaced
+bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, u32 skip_mips, const char* debug_name);
 void update(TextureHandle texture, u32 level, u32 x, u32 y, u32 w, u32 h, TextureFormat format, void* buf);
+// pixels are read from `buffer` at `offset`, the driver does not need to copy them before it returns
+void update(TextureHandle texture, u32 level, u32 x, u32 y, u32 w, u32 h, TextureFormat format, BufferHandle buffer, u32 offset);
 QueryHandle createQuery();
 
 void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u32 stride_offset);
@@ -242,19 +282,39 @@ void* map(BufferHandle buffer, size_t size);
 void unmap(BufferHandle buffer);
 void bindUniformBuffer(u32 ub_index, BufferHandle buffer, size_t size);
 void bindUniformBuffer(u32 ub_index, BufferGroupHandle group, size_t element_index);
+void bindShaderBuffer(BufferHandle buffer, u32 binding_idx);
+// ARB_bindless_texture, the handle is resident until the texture is destroyed or replaced
+u64 getBindlessHandle(TextureHandle texture);
 void copy(TextureHandle dst, TextureHandle src);
+// whole src is copied to dst at dst_x, dst_y
+void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y);
+// on the gpu, works with immutable dst
+void copy(BufferHandle dst, u32 dst_offset, BufferHandle src, u32 src_offset, u32 size);
 void readTexture(TextureHandle texture, Span<u8> buf);
+// does not wait for the gpu, buffer can be read without a stall after a fence created after this call is signaled
+void readTexture(TextureHandle texture, BufferHandle buffer, u32 size);
+// blocks until the gpu writes the buffer, read data written a few frames ago to avoid stalls
+void readBuffer(BufferHandle buffer, Span<u8> buf);
 TextureInfo getTextureInfo(const void* data);
 void queryTimestamp(QueryHandle query);
+// only one query per stat can be active, a query must always be used with the same stat
+void beginQuery(QueryHandle query, PipelineStat stat);
+void endQuery(PipelineStat stat);
 u64 getQueryResult(QueryHandle query);
 u64 getQueryFrequency();
 bool isQueryReady(QueryHandle query);
+FenceHandle createFence();
+// blocks until gpu executes all commands issued before createFence
+void waitFence(FenceHandle fence);
+// nonblocking
+bool isFenceSignaled(FenceHandle fence);
 
 void destroy(ProgramHandle program);
 void destroy(BufferHandle buffer);
 void destroy(BufferGroupHandle buffer);
 void destroy(TextureHandle texture);
 void destroy(QueryHandle query);
+void destroy(FenceHandle fence);
 
 void bindIndexBuffer(BufferHandle handle);
 void drawTriangles(u32 indices_count, DataType index_type);
@@ -262,6 +322,11 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 void drawElements(u32 byte_offset, u32 count, PrimitiveType primitive_type, DataType index_type);
 void drawArrays(u32 offset, u32 count, PrimitiveType type);
 void drawTriangleStripArraysInstanced(u32 indices_count, u32 instances_count);
+// `count` commands in the layout of DrawElementsIndirectCommand, `stride` bytes apart, starting at `offset` in `indirect_buffer`
+void drawTrianglesIndirect(BufferHandle indirect_buffer, u32 offset, u32 count, u32 stride, DataType index_type);
+void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z);
+// makes shader buffer writes visible to following draws, including their indirect commands and vertex fetches, and to readBuffer
+void memoryBarrier();
 
 void pushDebugGroup(const char* msg);
 void popDebugGroup();
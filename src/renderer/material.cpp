@@ -133,10 +133,12 @@ void Material::unload()
 		tex = nullptr;
 	}
 	
+	if (m_render_data) m_renderer.destroyMaterialTableEntry(m_render_data->material_table_idx);
 	m_renderer.runInRenderThread(m_render_data, [](Renderer& renderer, void* ptr){
 		LUMIX_DELETE(renderer.getAllocator(), (RenderData*)ptr);
 	});
 	m_render_data = nullptr;
+	m_bindless_define_mask = 0;
 
 	setShader(nullptr);
 
@@ -381,25 +383,40 @@ void Material::onBeforeReady()
 void Material::updateRenderData(bool on_before_ready)
 {
 	if (!m_shader) return;
+	if (m_is_hot_reloading) return;
 	if (!on_before_ready && !isReady()) return;
 
 	if(m_render_data) {
 		m_renderer.destroyMaterialConstants(m_render_data->material_constants);
+		m_renderer.destroyMaterialTableEntry(m_render_data->material_table_idx);
 		m_renderer.runInRenderThread(m_render_data, [](Renderer& renderer, void* ptr){
 			LUMIX_DELETE(renderer.getAllocator(), (RenderData*)ptr);
 		});
 	}
 
 	m_render_data = LUMIX_NEW(m_renderer.getAllocator(), RenderData);
-	m_render_data->define_mask = m_define_mask;
 	m_render_data->render_states = m_render_states;
 	m_render_data->textures_count = m_texture_count;
+	for(u32 i = 0; i < m_texture_count; ++i) {
+		m_render_data->textures[i] = m_textures[i] ? m_textures[i]->handle : gpu::INVALID_TEXTURE;
+	}
+
+	// only shaders which declare BINDLESS can sample from the table
+	const u8 bindless_define = m_renderer.getShaderDefineIdx("BINDLESS");
+	m_render_data->material_table_idx = INVALID_MATERIAL_TABLE_IDX;
+	if (m_renderer.isBindless() && m_shader->hasDefine(bindless_define)) {
+		m_render_data->material_table_idx = m_renderer.createMaterialTableEntry(m_render_data->textures, m_texture_count);
+	}
+	const bool is_bindless = m_render_data->material_table_idx != INVALID_MATERIAL_TABLE_IDX;
+	m_bindless_define_mask = is_bindless ? 1 << bindless_define : 0;
+	m_render_data->define_mask = getDefineMask();
 	MaterialConsts cs = {};
 	static_assert(sizeof(cs) == 256, "Renderer::MaterialConstants must have 256B");
 	cs.color = m_color;
 	cs.emission = m_emission;
 	cs.metallic = m_metallic;
 	cs.roughness = m_roughness;
+	cs.material_table_idx = is_bindless ? m_render_data->material_table_idx : 0;
 	memset(cs.custom, 0, sizeof(cs.custom));
 	for (const Shader::Uniform& shader_uniform : m_shader->m_uniforms) {
 		for (Uniform& mat_uniform : m_uniforms) {
@@ -412,10 +429,6 @@ void Material::updateRenderData(bool on_before_ready)
 	}
 
 	m_render_data->material_constants = m_renderer.createMaterialConstants(cs);
-
-	for(u32 i = 0; i < m_texture_count; ++i) {
-		m_render_data->textures[i] = m_textures[i] ? m_textures[i]->handle : gpu::INVALID_TEXTURE;
-	}
 }
 
 
@@ -436,6 +449,15 @@ void Material::setShader(Shader* shader)
 }
 
 
+void Material::requestTextureSize(u32 size) const
+{
+	for (u32 i = 0; i < m_texture_count; ++i) {
+		Texture* texture = m_textures[i];
+		if (texture && texture->isStreamed()) texture->requestSize(size);
+	}
+}
+
+
 Texture* Material::getTextureByName(const char* name) const
 {
 	if (!m_shader) return nullptr;
@@ -699,6 +721,66 @@ bool Material::load(u64 size, const u8* mem)
 	return true;
 }
 
+bool Material::hotReload(u64 size, const u8* mem)
+{
+	PROFILE_FUNCTION();
+
+	// old shader and textures are released only after the script requests the new ones,
+	// so the unchanged ones stay loaded and only the changed constants are uploaded
+	Texture* old_textures[MAX_TEXTURE_COUNT];
+	memcpy(old_textures, m_textures, sizeof(old_textures));
+	const u32 old_texture_count = m_texture_count;
+	Shader* old_shader = m_shader;
+	for (Texture*& tex : m_textures) tex = nullptr;
+	m_texture_count = 0;
+	m_shader = nullptr;
+
+	m_is_hot_reloading = true;
+	m_uniforms.clear();
+	m_alpha_ref = DEFAULT_ALPHA_REF_VALUE;
+	m_color.set(1, 1, 1, 1);
+	m_custom_flags = 0;
+	m_define_mask = 0;
+	m_metallic = 1.0f;
+	m_roughness = 1.0f;
+	m_emission = 0.0f;
+	m_render_states = u64(gpu::StateFlags::CULL_BACK);
+
+	MaterialManager& mng = static_cast<MaterialManager&>(getResourceManager());
+	lua_State* L = mng.getState(*this);
+	const Span<const char> content((const char*)mem, (u32)size);
+	bool success = LuaWrapper::execute(L, content, getPath().c_str(), 0);
+	if (success && !m_shader) {
+		logError("Renderer") << "Material " << getPath() << " does not have a shader.";
+		success = false;
+	}
+
+	if (success && isReady() && m_shader->isReady()) {
+		for (u32 i = 0; i < m_shader->m_texture_slot_count; ++i) {
+			if (!m_textures[i] && m_shader->m_texture_slots[i].default_texture) setTexture(i, nullptr);
+		}
+	}
+
+	for (u32 i = 0; i < old_texture_count; ++i) {
+		if (old_textures[i]) {
+			removeDependency(*old_textures[i]);
+			old_textures[i]->getResourceManager().unload(*old_textures[i]);
+		}
+	}
+	if (old_shader) {
+		removeDependency(*old_shader);
+		old_shader->getResourceManager().unload(*old_shader);
+	}
+	m_is_hot_reloading = false;
+
+	if (!success) return false;
+
+	m_size = size;
+	// otherwise it's called once the new dependencies are ready
+	if (isReady()) onBeforeReady();
+	return true;
+}
+
 lua_State* MaterialManager::getState(Material& material) const {
 	lua_pushlightuserdata(m_state, &material);
 	lua_setfield(m_state, LUA_GLOBALSINDEX, "this");
@@ -24,7 +24,9 @@ struct  MaterialConsts {
 	float roughness;
 	float metallic;
 	float emission;
-	float custom[57];
+	// row of the bindless material table, see Renderer::isBindless
+	u32 material_table_idx;
+	float custom[56];
 };
 
 struct MaterialManager : ResourceManager {
@@ -46,6 +48,7 @@ struct LUMIX_RENDERER_API Material final : Resource
 friend struct MaterialManager;
 public:
 	static const int MAX_TEXTURE_COUNT = 16;
+	static constexpr u32 INVALID_MATERIAL_TABLE_IDX = 0xffFFffFF;
 
 	struct RenderData {
 		gpu::TextureHandle textures[MAX_TEXTURE_COUNT];
@@ -53,6 +56,8 @@ public:
 		u64 render_states;
 		u32 material_constants;
 		u32 define_mask;
+		// textures do not need to be bound if valid
+		u32 material_table_idx;
 	};
 
 	struct Uniform
@@ -100,6 +105,8 @@ public:
 	int getTextureCount() const { return m_texture_count; }
 	Texture* getTexture(u32 i) const { return i < m_texture_count ? m_textures[i] : nullptr; }
 	Texture* getTextureByName(const char* name) const;
+	// streaming feedback, see Texture::requestSize
+	void requestTextureSize(u32 size) const;
 	bool isTextureDefine(u8 define_idx) const;
 	void setTexture(u32 i, Texture* texture);
 	void setTexturePath(int i, const Path& path);
@@ -111,7 +118,8 @@ public:
 
 	void setDefine(u8 define_idx, bool enabled);
 	bool isDefined(u8 define_idx) const;
-	u32 getDefineMask() const { return m_define_mask; }
+	// includes BINDLESS if the material uses the bindless table
+	u32 getDefineMask() const { return m_define_mask | m_bindless_define_mask; }
 
 	void setCustomFlag(u32 flag) { m_custom_flags |= flag; }
 	void unsetCustomFlag(u32 flag) { m_custom_flags &= ~flag; }
@@ -130,6 +138,8 @@ private:
 	void onBeforeReady() override;
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
+	bool isHotReloadSupported() const override { return true; }
+	bool hotReload(u64 size, const u8* mem) override;
 
 	static int uniform(lua_State* L);
 
@@ -144,6 +154,7 @@ private:
 	Texture* m_textures[MAX_TEXTURE_COUNT];
 	u32 m_texture_count;
 	u32 m_define_mask;
+	u32 m_bindless_define_mask = 0;
 	u64 m_render_states;
 	RenderData* m_render_data;
 	u8 m_layer;
@@ -151,6 +162,8 @@ private:
 
 	Array<Uniform> m_uniforms;
 	u32 m_custom_flags;
+	// render data are created once at the end of hot reload, not after every changed property
+	bool m_is_hot_reloading = false;
 };
 
 } // namespace Lumix
@@ -2,6 +2,7 @@
 #include "renderer/model.h"
 
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/file_system.h"
@@ -21,7 +22,7 @@ namespace Lumix
 {
 
 
-u32 Mesh::s_last_sort_key = 0;
+volatile i32 Mesh::s_last_sort_key = 0;
 
 
 static LocalRigidTransform invert(const LocalRigidTransform& tr)
@@ -45,6 +46,9 @@ Mesh::Mesh(Material* mat,
 	, indices(allocator)
 	, vertices(allocator)
 	, skin(allocator)
+	, meshlets(allocator)
+	, bvh(allocator)
+	, bvh_triangles(allocator)
 	, vertex_decl(vertex_decl)
 {
 	render_data = LUMIX_NEW(renderer.getAllocator(), RenderData);
@@ -61,8 +65,122 @@ Mesh::Mesh(Material* mat,
 		}
 	}
 
-	sort_key = s_last_sort_key;
-	++s_last_sort_key;
+	sort_key = u32(atomicIncrement(&s_last_sort_key) - 1);
+}
+
+
+void Mesh::buildBVH(IAllocator& allocator)
+{
+	PROFILE_FUNCTION();
+	// leaves have at most this many triangles
+	static constexpr u32 LEAF_SIZE = 4;
+	// deeper nodes are split by the median, which bounds the depth for degenerate inputs
+	static constexpr u32 MAX_MIDPOINT_DEPTH = 48;
+
+	bvh.clear();
+	bvh_triangles.clear();
+	const bool is16 = areIndices16();
+	const u32 triangles_count = indices.size() / (is16 ? 6 : 12);
+	if (triangles_count == 0) return;
+
+	const u16* indices16 = (const u16*)indices.begin();
+	const u32* indices32 = (const u32*)indices.begin();
+	auto getIndex = [&](u32 i) -> u32 { return is16 ? indices16[i] : indices32[i]; };
+
+	Array<Vec3> centers(allocator);
+	centers.resize(triangles_count);
+	bvh_triangles.resize(triangles_count);
+	for (u32 i = 0; i < triangles_count; ++i) {
+		centers[i] = (vertices[getIndex(i * 3)] + vertices[getIndex(i * 3 + 1)] + vertices[getIndex(i * 3 + 2)]) * (1 / 3.f);
+		bvh_triangles[i] = i;
+	}
+
+	struct Key {
+		float value;
+		u32 triangle;
+	};
+	Array<Key> keys(allocator);
+
+	struct Work {
+		u32 node;
+		u32 depth;
+	};
+	Array<Work> stack(allocator);
+
+	BVHNode& root = bvh.emplace();
+	root.first = 0;
+	root.count = triangles_count;
+	stack.push({0, 0});
+	while (!stack.empty()) {
+		const Work work = stack.back();
+		stack.pop();
+		const u32 first = bvh[work.node].first;
+		const u32 count = bvh[work.node].count;
+
+		Vec3 min(FLT_MAX);
+		Vec3 max(-FLT_MAX);
+		Vec3 center_min(FLT_MAX);
+		Vec3 center_max(-FLT_MAX);
+		for (u32 i = first; i < first + count; ++i) {
+			const u32 tri = bvh_triangles[i];
+			for (u32 j = 0; j < 3; ++j) {
+				const Vec3& p = vertices[getIndex(tri * 3 + j)];
+				min = AABB::minCoords(min, p);
+				max = AABB::maxCoords(max, p);
+			}
+			center_min = AABB::minCoords(center_min, centers[tri]);
+			center_max = AABB::maxCoords(center_max, centers[tri]);
+		}
+		bvh[work.node].min = min;
+		bvh[work.node].max = max;
+		if (count <= LEAF_SIZE) continue;
+
+		const Vec3 extent = center_max - center_min;
+		const u32 axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		const float split = (&center_min.x)[axis] + (&extent.x)[axis] * 0.5f;
+
+		u32 mid = first;
+		if (work.depth < MAX_MIDPOINT_DEPTH) {
+			u32 end = first + count;
+			while (mid < end) {
+				if ((&centers[bvh_triangles[mid]].x)[axis] < split) {
+					++mid;
+				}
+				else {
+					--end;
+					const u32 tmp = bvh_triangles[mid];
+					bvh_triangles[mid] = bvh_triangles[end];
+					bvh_triangles[end] = tmp;
+				}
+			}
+		}
+		if (mid == first || mid == first + count) {
+			keys.resize(count);
+			for (u32 i = 0; i < count; ++i) {
+				const u32 tri = bvh_triangles[first + i];
+				keys[i] = {(&centers[tri].x)[axis], tri};
+			}
+			qsort(keys.begin(), count, sizeof(keys[0]), [](const void* a, const void* b){
+				const float va = ((const Key*)a)->value;
+				const float vb = ((const Key*)b)->value;
+				return va < vb ? -1 : (va > vb ? 1 : 0);
+			});
+			for (u32 i = 0; i < count; ++i) bvh_triangles[first + i] = keys[i].triangle;
+			mid = first + count / 2;
+		}
+
+		const u32 children = bvh.size();
+		bvh[work.node].first = children;
+		bvh[work.node].count = 0;
+		BVHNode& left = bvh.emplace();
+		left.first = first;
+		left.count = mid - first;
+		BVHNode& right = bvh.emplace();
+		right.first = mid;
+		right.count = first + count - mid;
+		stack.push({children, work.depth + 1});
+		stack.push({children + 1, work.depth + 1});
+	}
 }
 
 
@@ -92,10 +210,16 @@ Model::Model(const Path& path, ResourceManager& resource_manager, Renderer& rend
 	, m_allocator(allocator)
 	, m_bone_map(m_allocator)
 	, m_meshes(m_allocator)
+	, m_pending_meshes(m_allocator)
 	, m_bones(m_allocator)
 	, m_first_nonroot_bone_index(0)
 	, m_renderer(renderer)
+	, m_lod_count(0)
+	, m_resident_lods(0)
+	, m_requested_lods(0)
+	, m_lod_vertices(m_allocator)
 {
+	memset(m_lod_unused_frames, 0, sizeof(m_lod_unused_frames));
 	m_lods[0] = { 0, -1, FLT_MAX };
 	m_lods[1] = { 0, -1, FLT_MAX };
 	m_lods[2] = { 0, -1, FLT_MAX };
@@ -139,8 +263,112 @@ bool Model::isSkinned() const
 }
 
 
+static bool rayTriangle(const Vec3& origin, const Vec3& dir, const Vec3& p0, const Vec3& p1, const Vec3& p2, float& t)
+{
+	Vec3 normal = crossProduct(p1 - p0, p2 - p0);
+	float q = dotProduct(normal, dir);
+	if (q == 0)	return false;
+
+	float d = -dotProduct(normal, p0);
+	t = -(dotProduct(normal, origin) + d) / q;
+	if (t < 0) return false;
+
+	Vec3 hit_point = origin + dir * t;
+
+	Vec3 edge0 = p1 - p0;
+	Vec3 VP0 = hit_point - p0;
+	if (dotProduct(normal, crossProduct(edge0, VP0)) < 0) return false;
+
+	Vec3 edge1 = p2 - p1;
+	Vec3 VP1 = hit_point - p1;
+	if (dotProduct(normal, crossProduct(edge1, VP1)) < 0) return false;
+
+	Vec3 edge2 = p0 - p2;
+	Vec3 VP2 = hit_point - p2;
+	if (dotProduct(normal, crossProduct(edge2, VP2)) < 0) return false;
+
+	return true;
+}
+
+
+// distance to the box along the ray, negative if it's missed or further than max_t
+static float rayAABB(const Vec3& origin, const Vec3& inv_dir, const Vec3& min, const Vec3& max, float max_t)
+{
+	float t_min = 0;
+	float t_max = max_t;
+	for (int i = 0; i < 3; ++i) {
+		float t0 = ((&min.x)[i] - (&origin.x)[i]) * (&inv_dir.x)[i];
+		float t1 = ((&max.x)[i] - (&origin.x)[i]) * (&inv_dir.x)[i];
+		if (t0 > t1) {
+			const float tmp = t0;
+			t0 = t1;
+			t1 = tmp;
+		}
+		t_min = maximum(t_min, t0);
+		t_max = minimum(t_max, t1);
+		if (t_min > t_max) return -1;
+	}
+	return t_min;
+}
+
+
+static void castRayBVH(const Mesh& mesh, const Vec3& origin, const Vec3& dir, RayCastModelHit& hit)
+{
+	const bool is16 = mesh.areIndices16();
+	const u16* indices16 = (const u16*)mesh.indices.begin();
+	const u32* indices32 = (const u32*)mesh.indices.begin();
+	auto getIndex = [&](u32 i) -> u32 { return is16 ? indices16[i] : indices32[i]; };
+
+	// FLT_MAX instead of inf, so 0 * inv_dir is not NaN
+	const Vec3 inv_dir(dir.x == 0 ? FLT_MAX : 1 / dir.x, dir.y == 0 ? FLT_MAX : 1 / dir.y, dir.z == 0 ? FLT_MAX : 1 / dir.z);
+	u32 stack[128];
+	u32 stack_size = 0;
+	if (rayAABB(origin, inv_dir, mesh.bvh[0].min, mesh.bvh[0].max, hit.is_hit ? hit.t : FLT_MAX) < 0) return;
+	stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		const Mesh::BVHNode& node = mesh.bvh[stack[--stack_size]];
+		if (node.count > 0) {
+			for (u32 i = node.first; i < node.first + node.count; ++i) {
+				const u32 tri = mesh.bvh_triangles[i];
+				const Vec3& p0 = mesh.vertices[getIndex(tri * 3)];
+				const Vec3& p1 = mesh.vertices[getIndex(tri * 3 + 1)];
+				const Vec3& p2 = mesh.vertices[getIndex(tri * 3 + 2)];
+				float t;
+				if (rayTriangle(origin, dir, p0, p1, p2, t) && (!hit.is_hit || hit.t > t)) {
+					hit.is_hit = true;
+					hit.t = t;
+					hit.mesh = const_cast<Mesh*>(&mesh);
+				}
+			}
+			continue;
+		}
+
+		const float max_t = hit.is_hit ? hit.t : FLT_MAX;
+		const Mesh::BVHNode& a = mesh.bvh[node.first];
+		const Mesh::BVHNode& b = mesh.bvh[node.first + 1];
+		const float ta = rayAABB(origin, inv_dir, a.min, a.max, max_t);
+		const float tb = rayAABB(origin, inv_dir, b.min, b.max, max_t);
+		ASSERT(stack_size + 2 <= lengthOf(stack));
+		// push the closer child last so it's processed first
+		if (ta >= 0 && tb >= 0) {
+			if (ta < tb) {
+				stack[stack_size++] = node.first + 1;
+				stack[stack_size++] = node.first;
+			}
+			else {
+				stack[stack_size++] = node.first;
+				stack[stack_size++] = node.first + 1;
+			}
+		}
+		else if (ta >= 0) stack[stack_size++] = node.first;
+		else if (tb >= 0) stack[stack_size++] = node.first + 1;
+	}
+}
+
+
 RayCastModelHit Model::castRay(const Vec3& origin, const Vec3& dir, const Pose* pose)
 {
+	PROFILE_FUNCTION();
 	RayCastModelHit hit;
 	hit.is_hit = false;
 	if (!isReady()) return hit;
@@ -161,7 +389,13 @@ RayCastModelHit Model::castRay(const Vec3& origin, const Vec3& dir, const Pose*
 	for (int mesh_index = m_lods[0].from_mesh; mesh_index <= m_lods[0].to_mesh; ++mesh_index)
 	{
 		Mesh& mesh = m_meshes[mesh_index];
-		bool is_mesh_skinned = !mesh.skin.empty();
+		bool is_mesh_skinned = is_skinned && !mesh.skin.empty();
+		// bvh is built from bind pose, so it can not be used for posed skinned meshes
+		if (!is_mesh_skinned && !mesh.bvh.empty()) {
+			castRayBVH(mesh, origin, dir, hit);
+			continue;
+		}
+
 		u16* indices16 = (u16*)&mesh.indices[0];
 		u32* indices32 = (u32*)&mesh.indices[0];
 		bool is16 = mesh.flags.isSet(Mesh::Flags::INDICES_16_BIT);
@@ -194,28 +428,8 @@ RayCastModelHit Model::castRay(const Vec3& origin, const Vec3& dir, const Pose*
 				}
 			}
 
-
-			Vec3 normal = crossProduct(p1 - p0, p2 - p0);
-			float q = dotProduct(normal, dir);
-			if (q == 0)	continue;
-
-			float d = -dotProduct(normal, p0);
-			float t = -(dotProduct(normal, origin) + d) / q;
-			if (t < 0) continue;
-
-			Vec3 hit_point = origin + dir * t;
-
-			Vec3 edge0 = p1 - p0;
-			Vec3 VP0 = hit_point - p0;
-			if (dotProduct(normal, crossProduct(edge0, VP0)) < 0) continue;
-
-			Vec3 edge1 = p2 - p1;
-			Vec3 VP1 = hit_point - p1;
-			if (dotProduct(normal, crossProduct(edge1, VP1)) < 0) continue;
-
-			Vec3 edge2 = p0 - p2;
-			Vec3 VP2 = hit_point - p2;
-			if (dotProduct(normal, crossProduct(edge2, VP2)) < 0) continue;
+			float t;
+			if (!rayTriangle(origin, dir, p0, p1, p2, t)) continue;
 
 			if (!hit.is_hit || hit.t > t)
 			{
@@ -321,8 +535,9 @@ static bool parseVertexDecl(IInputStream& file, gpu::VertexDecl* vertex_decl, Me
 	vb_stride = offset;
 
 	if (!is_skinned) {
-		vertex_decl->addAttribute(4, 0, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
-		vertex_decl->addAttribute(5, 16, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
+		// MeshInstanceData
+		vertex_decl->addAttribute(4, 0, 4, gpu::AttributeType::I16, gpu::Attribute::INSTANCED | gpu::Attribute::NORMALIZED);
+		vertex_decl->addAttribute(5, 8, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
 		// TODO this is here because of grass, find a better solution
 		//vertex_decl->addAttribute(6, 32, 4, gpu::AttributeType::FLOAT, gpu::Attribute::INSTANCED);
 	}
@@ -342,6 +557,7 @@ void Model::onBeforeReady()
 
 bool Model::parseBones(InputMemoryStream& file)
 {
+	++m_bones_generation;
 	int bone_count;
 	file.read(bone_count);
 	if (bone_count < 0) return false;
@@ -431,16 +647,23 @@ static int getAttributeOffset(Mesh& mesh, Mesh::AttributeSemantic attr)
 }
 
 
+// blobs can be copied straight from the loaded data, without unaligned reads
+static void skipBlobPadding(InputMemoryStream& file, Model::FileVersion version)
+{
+	if (version <= Model::FileVersion::ALIGNED_BLOBS) return;
+	const u64 pos = file.getPosition();
+	file.skip(((pos + Model::BLOB_ALIGNMENT - 1) & ~u64(Model::BLOB_ALIGNMENT - 1)) - pos);
+}
+
+
 bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 {
 	int object_count = 0;
 	file.read(object_count);
 	if (object_count <= 0) return false;
 
-	char model_dir[MAX_PATH_LENGTH];
-	Path::getDir(Span(model_dir), getPath().c_str());
-
 	m_meshes.reserve(object_count);
+	m_pending_meshes.reserve(object_count);
 	for (int i = 0; i < object_count; ++i)
 	{
 		gpu::VertexDecl vertex_decl;
@@ -455,8 +678,6 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		if (mat_path_length + 1 > lengthOf(mat_path)) return false;
 		file.read(mat_path, mat_path_length);
 		mat_path[mat_path_length] = '\0';
-		
-		Material* material = m_resource_manager.getOwner().load<Material>(Path(mat_path));
 	
 		i32 str_size;
 		file.read(str_size);
@@ -464,8 +685,9 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		mesh_name[str_size] = 0;
 		file.read(mesh_name, str_size);
 
-		m_meshes.emplace(material, vertex_decl, vb_stride, mesh_name, semantics, m_renderer, m_allocator);
-		addDependency(*material);
+		// material is loaded in finalize
+		m_meshes.emplace(nullptr, vertex_decl, vb_stride, mesh_name, semantics, m_renderer, m_allocator);
+		m_pending_meshes.emplace(m_allocator).material = mat_path;
 	}
 
 	for (int i = 0; i < object_count; ++i)
@@ -479,11 +701,10 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		if (indices_count <= 0) return false;
 		mesh.indices.resize(index_size * indices_count);
 		mesh.render_data->indices_count = indices_count;
+		skipBlobPadding(file, version);
 		file.read(&mesh.indices[0], mesh.indices.size());
 
 		if (index_size == 2) mesh.flags.set(Mesh::Flags::INDICES_16_BIT);
-		const Renderer::MemRef mem = m_renderer.copy(&mesh.indices[0], mesh.indices.size());
-		mesh.render_data->index_buffer_handle = m_renderer.createBuffer(mem, (u32)gpu::BufferFlags::IMMUTABLE);
 		mesh.render_data->index_type = index_size == 2 ? gpu::DataType::U16 : gpu::DataType::U32;
 	}
 
@@ -492,19 +713,29 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 		Mesh& mesh = m_meshes[i];
 		int data_size;
 		file.read(data_size);
-		Renderer::MemRef vertices_mem = m_renderer.allocate(data_size);
-		file.read(vertices_mem.data, data_size);
+		skipBlobPadding(file, version);
+		if (data_size <= 0 || file.getPosition() + data_size > file.size()) return false;
+		PendingMesh& pending = m_pending_meshes[i];
+		pending.vertices_offset = (u32)file.getPosition();
+		pending.vertices_size = data_size;
+		// decoded in place, the blob is copied only once, in loadAsync
+		const u8* vertices = (const u8*)file.skip(data_size);
 
 		int position_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::POSITION);
 		int weights_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::WEIGHTS);
 		int bone_indices_attribute_offset = getAttributeOffset(mesh, Mesh::AttributeSemantic::INDICES);
 		bool keep_skin = hasAttribute(mesh, Mesh::AttributeSemantic::WEIGHTS) && hasAttribute(mesh, Mesh::AttributeSemantic::INDICES);
 
+		// see decodePosition in common.glsl
+		bool quantized_position = false;
+		for (u32 k = 0; k < mesh.vertex_decl.attributes_count; ++k) {
+			if (mesh.attributes_semantic[k] != Mesh::AttributeSemantic::POSITION) continue;
+			quantized_position = mesh.vertex_decl.attributes[k].type == gpu::AttributeType::I16;
+		}
 		int vertex_size = mesh.render_data->vb_stride;
 		int mesh_vertex_count = data_size / vertex_size;
 		mesh.vertices.resize(mesh_vertex_count);
 		if (keep_skin) mesh.skin.resize(mesh_vertex_count);
-		const u8* vertices = (const u8*)vertices_mem.data;
 		for (int j = 0; j < mesh_vertex_count; ++j)
 		{
 			int offset = j * vertex_size;
@@ -515,9 +746,15 @@ bool Model::parseMeshes(InputMemoryStream& file, FileVersion version)
 					&vertices[offset + bone_indices_attribute_offset],
 					sizeof(mesh.skin[j].indices));
 			}
-			mesh.vertices[j] = *(const Vec3*)&vertices[offset + position_attribute_offset];
+			if (quantized_position) {
+				i16 p[4];
+				memcpy(p, &vertices[offset + position_attribute_offset], sizeof(p));
+				mesh.vertices[j] = Vec3(p[0], p[1], p[2]) * powf(2, p[3]);
+			}
+			else {
+				mesh.vertices[j] = *(const Vec3*)&vertices[offset + position_attribute_offset];
+			}
 		}
-		mesh.render_data->vertex_buffer_handle = m_renderer.createBuffer(vertices_mem, (u32)gpu::BufferFlags::IMMUTABLE);
 	}
 	file.read(m_bounding_radius);
 	file.read(m_aabb);
@@ -540,11 +777,28 @@ bool Model::parseLODs(InputMemoryStream& file)
 		file.read(m_lods[i].distance);
 		m_lods[i].from_mesh = i > 0 ? m_lods[i - 1].to_mesh + 1 : 0;
 	}
+	m_lod_count = lod_count;
+	return true;
+}
+
+
+bool Model::parseMeshlets(InputMemoryStream& file)
+{
+	for (Mesh& mesh : m_meshes) {
+		u32 count;
+		file.read(count);
+		if (count == 0) continue;
+		mesh.meshlets.resize(count);
+		file.read(mesh.meshlets.begin(), mesh.meshlets.byte_size());
+		for (const Meshlet& m : mesh.meshlets) {
+			if (m.first_index + m.indices_count > (u32)mesh.render_data->indices_count) return false;
+		}
+	}
 	return true;
 }
 
 
-bool Model::load(u64 size, const u8* mem)
+bool Model::loadAsync(u64 size, const u8* mem)
 {
 	PROFILE_FUNCTION();
 	FileHeader header;
@@ -565,8 +819,32 @@ bool Model::load(u64 size, const u8* mem)
 
 	if (parseMeshes(file, (FileVersion)header.version)
 		&& parseBones(file)
-		&& parseLODs(file))
+		&& parseLODs(file)
+		&& (header.version <= (u32)FileVersion::MESHLETS || parseMeshlets(file)))
 	{
+		for (i32 i = m_lods[0].from_mesh; i <= m_lods[0].to_mesh; ++i) {
+			m_meshes[i].buildBVH(m_allocator);
+		}
+
+		// vertices are used only by GPU, headless keeps just indices and bones
+		if (!m_renderer.isHeadless()) {
+			// meshes before the coarsest LOD are created when they are requested
+			const i32 first_resident_mesh = isLODStreamed() ? m_lods[m_lod_count - 1].from_mesh : 0;
+			m_lod_vertices.reserve(first_resident_mesh);
+			for (i32 i = 0; i < m_meshes.size(); ++i) {
+				PendingMesh& pending = m_pending_meshes[i];
+				const u8* data = mem + pending.vertices_offset;
+				if (i < first_resident_mesh) {
+					Array<u8>& vertices = m_lod_vertices.emplace(m_allocator);
+					vertices.resize(pending.vertices_size);
+					memcpy(vertices.begin(), data, pending.vertices_size);
+				}
+				else {
+					// handed over to createBuffer in finalize, without another copy
+					pending.vertices = m_renderer.copy(data, pending.vertices_size);
+				}
+			}
+		}
 		m_size = file.size();
 		return true;
 	}
@@ -576,6 +854,122 @@ bool Model::load(u64 size, const u8* mem)
 }
 
 
+bool Model::finalize()
+{
+	PROFILE_FUNCTION();
+	ASSERT(m_pending_meshes.size() == m_meshes.size());
+	ResourceManagerHub& rm = m_resource_manager.getOwner();
+	const u32 coarsest_lod = m_lod_count - 1;
+	// meshes before the coarsest LOD are created when they are requested
+	const i32 first_resident_mesh = isLODStreamed() ? m_lods[coarsest_lod].from_mesh : 0;
+	m_resident_lods = isLODStreamed() ? 1 << coarsest_lod : (1 << m_lod_count) - 1;
+	m_requested_lods = 0;
+	memset(m_lod_unused_frames, 0, sizeof(m_lod_unused_frames));
+	for (i32 i = 0; i < m_meshes.size(); ++i) {
+		Mesh& mesh = m_meshes[i];
+		PendingMesh& pending = m_pending_meshes[i];
+		mesh.material = rm.load<Material>(Path(pending.material.c_str()));
+		addDependency(*mesh.material);
+
+		if (m_renderer.isHeadless() || i < first_resident_mesh) continue;
+
+		const Renderer::MemRef indices_mem = m_renderer.copy(mesh.indices.begin(), mesh.indices.byte_size());
+		mesh.render_data->index_buffer_handle = m_renderer.createBuffer(indices_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		mesh.render_data->vertex_buffer_handle = m_renderer.createBuffer(pending.vertices, (u32)gpu::BufferFlags::IMMUTABLE);
+		pending.vertices = {};
+	}
+	m_pending_meshes.clear();
+	return true;
+}
+
+
+u32 Model::getLODIndex(float squared_distance) const
+{
+	u32 i = 0;
+	while (squared_distance >= m_lods[i].distance) ++i;
+	return i;
+}
+
+
+u32 Model::selectLOD(float squared_distance, u32 current_lod, float hysteresis) const
+{
+	const u32 lod = getLODIndex(squared_distance);
+	if (lod == current_lod || current_lod >= m_lod_count) return lod;
+
+	// boundaries are squared distances
+	if (lod > current_lod) {
+		const float band = (1 + hysteresis) * (1 + hysteresis);
+		return squared_distance < m_lods[current_lod].distance * band ? current_lod : lod;
+	}
+	const float band = (1 - hysteresis) * (1 - hysteresis);
+	return squared_distance >= m_lods[current_lod - 1].distance * band ? current_lod : lod;
+}
+
+
+LODMeshIndices Model::requestLOD(u32 lod) const
+{
+	ASSERT(lod < m_lod_count);
+	const i32 bit = 1 << lod;
+	for (;;) {
+		const i32 prev = m_requested_lods;
+		if ((prev & bit) || compareAndExchange(&m_requested_lods, prev | bit, prev)) break;
+	}
+	while (lod + 1 < m_lod_count && !isLODResident(lod)) ++lod;
+	return {m_lods[lod].from_mesh, m_lods[lod].to_mesh};
+}
+
+
+void Model::makeLODResident(u32 lod)
+{
+	if (isLODResident(lod) || m_renderer.isHeadless()) return;
+
+	for (i32 i = m_lods[lod].from_mesh; i <= m_lods[lod].to_mesh; ++i) {
+		Mesh& mesh = m_meshes[i];
+		const Array<u8>& vertices = m_lod_vertices[i];
+		const Renderer::MemRef indices_mem = m_renderer.copy(mesh.indices.begin(), mesh.indices.byte_size());
+		mesh.render_data->index_buffer_handle = m_renderer.createBuffer(indices_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		const Renderer::MemRef vertices_mem = m_renderer.copy(vertices.begin(), vertices.byte_size());
+		mesh.render_data->vertex_buffer_handle = m_renderer.createBuffer(vertices_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+	}
+	m_resident_lods = m_resident_lods | (1 << lod);
+	m_lod_unused_frames[lod] = 0;
+}
+
+
+void Model::releaseLOD(u32 lod)
+{
+	ASSERT(lod + 1 < m_lod_count);
+	for (i32 i = m_lods[lod].from_mesh; i <= m_lods[lod].to_mesh; ++i) {
+		Mesh::RenderData* rd = m_meshes[i].render_data;
+		m_renderer.destroy(rd->index_buffer_handle);
+		m_renderer.destroy(rd->vertex_buffer_handle);
+		rd->index_buffer_handle = gpu::INVALID_BUFFER;
+		rd->vertex_buffer_handle = gpu::INVALID_BUFFER;
+	}
+	m_resident_lods = m_resident_lods & ~(1 << lod);
+}
+
+
+void Model::updateLODStreaming()
+{
+	if (!isReady() || !isLODStreamed()) return;
+
+	// requests from running pipelines would be lost, that's why this is called only when none is running
+	const i32 requested = m_requested_lods;
+	m_requested_lods = 0;
+	for (u32 lod = 0; lod + 1 < m_lod_count; ++lod) {
+		const i32 bit = 1 << lod;
+		if (requested & bit) {
+			m_lod_unused_frames[lod] = 0;
+			makeLODResident(lod);
+		}
+		else if ((m_resident_lods & bit) && ++m_lod_unused_frames[lod] > LOD_UNUSED_FRAMES) {
+			releaseLOD(lod);
+		}
+	}
+}
+
+
 static Vec3 getBonePosition(Model* model, int bone_index)
 {
 	return model->getBone(bone_index).transform.pos;
@@ -624,6 +1018,8 @@ void Model::unload()
 {
 	auto* material_manager = m_resource_manager.getOwner().get(Material::TYPE);
 	for (int i = 0; i < m_meshes.size(); ++i) {
+		// null if loadAsync failed
+		if (!m_meshes[i].material) continue;
 		removeDependency(*m_meshes[i].material);
 		material_manager->unload(*m_meshes[i].material);
 	}
@@ -637,7 +1033,16 @@ void Model::unload()
 		});
 	}
 	m_meshes.clear();
+	// finalize was not called
+	for (const PendingMesh& pending : m_pending_meshes) {
+		if (pending.vertices.own) m_renderer.free(pending.vertices);
+	}
+	m_pending_meshes.clear();
+	m_lod_vertices.clear();
 	m_bones.clear();
+	m_resident_lods = 0;
+	m_requested_lods = 0;
+	m_lod_count = 0;
 }
 
 
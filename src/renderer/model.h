@@ -39,6 +39,47 @@ struct LUMIX_RENDERER_API RayCastModelHit
 };
 
 
+// rotation in instance data of meshes, normalized i16 to keep instance buffers small
+struct PackedQuat
+{
+	PackedQuat() {}
+	explicit PackedQuat(const Quat& q)
+		: x(pack(q.x))
+		, y(pack(q.y))
+		, z(pack(q.z))
+		, w(pack(q.w))
+	{}
+
+	static i16 pack(float v) { return i16(clamp(v, -1.f, 1.f) * 32767.f + (v < 0 ? -0.5f : 0.5f)); }
+
+	i16 x, y, z, w;
+};
+
+
+// cluster of up to MAX_VERTICES vertices and MAX_TRIANGLES triangles, a contiguous range of mesh indices
+struct Meshlet
+{
+	enum { MAX_VERTICES = 64, MAX_TRIANGLES = 124 };
+
+	Vec3 center;
+	float radius;
+	// all triangles face away from a camera for which dot(center - camera, cone_axis) >= cone_cutoff * |center - camera| + radius
+	Vec3 cone_axis;
+	float cone_cutoff;
+	u32 first_index;
+	u32 indices_count;
+};
+
+
+// instance data of meshes rendered with INSTANCED define, see Mesh::vertex_decl
+struct MeshInstanceData
+{
+	PackedQuat rot;
+	Vec3 pos;
+	float scale;
+};
+
+
 struct LUMIX_RENDERER_API Mesh
 {
 	enum class AttributeSemantic : u8
@@ -91,6 +132,15 @@ struct LUMIX_RENDERER_API Mesh
 		INDICES_16_BIT = 1 << 0
 	};
 
+	struct BVHNode
+	{
+		Vec3 min;
+		// first child if count == 0, children are next to each other; first item in bvh_triangles otherwise
+		u32 first;
+		Vec3 max;
+		u32 count;
+	};
+
 	Mesh(Material* mat,
 		const gpu::VertexDecl& vertex_decl,
 		u8 vb_stride,
@@ -101,11 +151,18 @@ struct LUMIX_RENDERER_API Mesh
 
 	void setMaterial(Material* material, Model& model, Renderer& renderer);
 	bool areIndices16() const { return flags.isSet(Flags::INDICES_16_BIT); }
+	// bounding volume hierarchy of triangles in bind pose, used by raycasts
+	void buildBVH(IAllocator& allocator);
 
 	Type type;
 	Array<u8> indices;
 	Array<Vec3> vertices;
 	Array<Skin> skin;
+	// used only by gpu culling, empty for meshes imported without meshlets
+	Array<Meshlet> meshlets;
+	// built only for LOD 0
+	Array<BVHNode> bvh;
+	Array<u32> bvh_triangles;
 	FlagSet<Flags, u8> flags;
 	u32 sort_key;
 	u8 layer;
@@ -114,7 +171,8 @@ struct LUMIX_RENDERER_API Mesh
 	gpu::VertexDecl vertex_decl;
 	AttributeSemantic attributes_semantic[gpu::VertexDecl::MAX_ATTRIBUTES];
 	RenderData* render_data;
-	static u32 s_last_sort_key;
+	// meshes are created on workers
+	static volatile i32 s_last_sort_key;
 };
 
 
@@ -140,6 +198,10 @@ public:
 
 	enum class FileVersion : u32
 	{
+		MESHLETS,
+		// index and vertex blobs start at BLOB_ALIGNMENT aligned offsets
+		ALIGNED_BLOBS,
+
 		LATEST // keep this last
 	};
 
@@ -183,6 +245,19 @@ public:
 		return {m_lods[i].from_mesh, m_lods[i].to_mesh};
 	}
 
+	// keeps `current_lod` while `squared_distance` is within `hysteresis` (relative to the distance) of its boundaries,
+	// so instances near a boundary do not switch every frame
+	u32 selectLOD(float squared_distance, u32 current_lod, float hysteresis) const;
+	// meshes of the coarsest LOD are always on GPU, others are streamed in when requested
+	// returns the LOD for the distance if it's on GPU, otherwise the closest coarser one, thread safe
+	LODMeshIndices requestLODMeshIndices(float squared_distance) const { return requestLOD(getLODIndex(squared_distance)); }
+	LODMeshIndices requestLOD(u32 lod) const;
+	bool isLODResident(u32 lod) const { return (m_resident_lods & (1 << lod)) != 0; }
+	void makeLODResident(u32 lod);
+	// once per frame, when no pipeline is rendering
+	void updateLODStreaming();
+	bool isLODStreamed() const { return m_lod_count > 1; }
+
 	Mesh& getMesh(u32 index) { return m_meshes[index]; }
 	const Mesh& getMesh(u32 index) const { return m_meshes[index]; }
 	int getMeshCount() const { return m_meshes.size(); }
@@ -190,6 +265,8 @@ public:
 	const Bone& getBone(u32 i) const { return m_bones[i]; }
 	int getFirstNonrootBoneIndex() const { return m_first_nonroot_bone_index; }
 	BoneMap::const_iterator getBoneIndex(u32 hash) const { return m_bone_map.find(hash); }
+	// changes every time bones are loaded, so data derived from bone indices can detect reloads
+	u32 getBonesGeneration() const { return m_bones_generation; }
 	void getPose(Pose& pose);
 	void getRelativePose(Pose& pose);
 	float getBoundingRadius() const { return m_bounding_radius; }
@@ -205,6 +282,10 @@ public:
 public:
 	static const u32 FILE_MAGIC = 0x5f4c4d4f; // == '_LM2'
 	static const u32 MAX_LOD_COUNT = 4;
+	// frames without request before a LOD is removed from GPU
+	static const u32 LOD_UNUSED_FRAMES = 300;
+	// relative to the start of model data, i.e. right after the compiled resource header
+	static const u32 BLOB_ALIGNMENT = 16;
 
 private:
 	Model(const Model&);
@@ -213,19 +294,44 @@ private:
 	bool parseBones(InputMemoryStream& file);
 	bool parseMeshes(InputMemoryStream& file, FileVersion version);
 	bool parseLODs(InputMemoryStream& file);
+	bool parseMeshlets(InputMemoryStream& file);
 	int getBoneIdx(const char* name);
+	void releaseLOD(u32 lod);
+	u32 getLODIndex(float squared_distance) const;
 
 	void unload() override;
-	bool load(u64 size, const u8* mem) override;
+	bool load(u64 size, const u8* mem) override { return loadAsync(size, mem) && finalize(); }
+	bool isAsyncLoadSupported() const override { return true; }
+	bool loadAsync(u64 size, const u8* mem) override;
+	bool finalize() override;
 
 private:
+	// parsed in loadAsync, consumed by finalize
+	struct PendingMesh {
+		PendingMesh(IAllocator& allocator) : material(allocator) {}
+		String material;
+		// offset in the loaded data, copied once to `vertices` or m_lod_vertices after the whole file is parsed
+		u32 vertices_offset = 0;
+		u32 vertices_size = 0;
+		Renderer::MemRef vertices;
+	};
+
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
 	Array<Mesh> m_meshes;
+	Array<PendingMesh> m_pending_meshes;
 	Array<Bone> m_bones;
 	LOD m_lods[MAX_LOD_COUNT];
+	u32 m_lod_count;
+	// bit per LOD
+	volatile i32 m_resident_lods;
+	mutable volatile i32 m_requested_lods;
+	u32 m_lod_unused_frames[MAX_LOD_COUNT];
+	// vertices of meshes in streamed LODs, to create their buffers again
+	Array<Array<u8>> m_lod_vertices;
 	float m_bounding_radius;
 	BoneMap m_bone_map;
+	u32 m_bones_generation = 0;
 	AABB m_aabb;
 	int m_first_nonroot_bone_index;
 };
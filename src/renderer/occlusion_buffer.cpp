@@ -3,7 +3,10 @@
 
 #include "occlusion_buffer.h"
 #include "engine/array.h"
+#include "engine/atomic.h"
+#include "engine/crt.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
 #include "engine/universe.h"
@@ -19,63 +22,61 @@ static const int Z_SCALE = 1 << 30;
 static const int XY_SCALE = 1 << 16;
 static const int WIDTH = 384;
 static const int HEIGHT = 192;
+static const int TILE_HEIGHT = 16;
 
 
 OcclusionBuffer::OcclusionBuffer(IAllocator& allocator)
 	: m_mips(allocator)
+	, m_clip_vertices(allocator)
 	, m_allocator(allocator)
 {
 }
 
 
-void OcclusionBuffer::setCamera(const DVec3& pos, const Quat& rot, const Matrix& projection)
+void OcclusionBuffer::setCamera(const DVec3& pos, const Matrix& view, const Matrix& projection)
 {
-	m_view_projection_matrix = projection * rot.toMatrix();
+	m_view_projection_matrix = projection * view;
 	m_camera_pos = pos;
 }
 
 
+// depth is flipped, so closer is smaller
 static LUMIX_FORCE_INLINE Vec3 toViewport(const Vec4& v)
 {
-	float inv = 0.5f / v.w;
-	return { v.x * inv + 0.5f, v.y * inv + 0.5f, v.z * inv + 0.5f };
+	const float inv = 1 / v.w;
+	return { v.x * inv * 0.5f + 0.5f, v.y * inv * 0.5f + 0.5f, 1 - v.z * inv };
 }
 
 
-Vec3 OcclusionBuffer::transform(const Transform& world_transform, float x, float y, float z)
-{
-	Vec3 tmp = world_transform.scale * Vec3(x, y, z);
-	tmp = world_transform.rot.rotate(tmp);
-	tmp += (world_transform.pos - m_camera_pos).toFloat();
-	return m_view_projection_matrix.transformPoint(tmp);
-}
-
-
-bool OcclusionBuffer::isOccluded(const Transform& world_transform, const AABB& aabb)
+bool OcclusionBuffer::isOccluded(const Transform& world_transform, const AABB& aabb) const
 {
 	// TODO simd
-	const Vec3 vertices[] = {
-		transform(world_transform, aabb.min.x, aabb.min.y, aabb.min.z),
-		transform(world_transform, aabb.min.x, aabb.min.y, aabb.max.z),
-		transform(world_transform, aabb.min.x, aabb.max.y, aabb.min.z),
-		transform(world_transform, aabb.min.x, aabb.max.y, aabb.max.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.min.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.max.z),
-		transform(world_transform, aabb.max.x, aabb.max.y, aabb.min.z),
-		transform(world_transform, aabb.max.x, aabb.min.y, aabb.min.z)
-	};
-	
-	Vec3 min = vertices[0];
-	Vec3 max = vertices[0];
-
-	for (u32 i = 1; i < lengthOf(vertices); ++i)
-	{
-		min.x = minimum(vertices[i].x, min.x);
-		min.y = minimum(vertices[i].y, min.y);
-		min.z = minimum(vertices[i].z, min.z);
-
-		max.x = maximum(vertices[i].x, max.x);
-		max.y = maximum(vertices[i].y, max.y);
+	Vec3 corners[8];
+	for (u32 i = 0; i < 8; ++i) {
+		corners[i] = Vec3(i & 1 ? aabb.max.x : aabb.min.x
+			, i & 2 ? aabb.max.y : aabb.min.y
+			, i & 4 ? aabb.max.z : aabb.min.z);
+	}
+	Matrix mtx = world_transform.rot.toMatrix();
+	mtx.multiply3x3(world_transform.scale);
+	mtx.setTranslation((world_transform.pos - m_camera_pos).toFloat());
+	Vec3 points[8];
+	transformPoints(mtx, corners, points, 8);
+
+	Vec3 min(FLT_MAX);
+	Vec3 max(-FLT_MAX);
+	for (u32 i = 0; i < 8; ++i) {
+		const Vec4 clip = m_view_projection_matrix * Vec4(points[i], 1);
+		// in front of the near plane, could cover anything
+		if (clip.w <= 0 || clip.z > clip.w) return false;
+
+		const Vec3 v = toViewport(clip);
+		min.x = minimum(v.x, min.x);
+		min.y = minimum(v.y, min.y);
+		min.z = minimum(v.z, min.z);
+
+		max.x = maximum(v.x, max.x);
+		max.y = maximum(v.y, max.y);
 	}
 
 	if (max.x < 0) return false;
@@ -83,20 +84,30 @@ bool OcclusionBuffer::isOccluded(const Transform& world_transform, const AABB& a
 	if (min.x >= 1) return false;
 	if (min.y >= 1) return false;
 
-	const int min_x = maximum(0, int(min.x * (WIDTH - 1) + 0.5f));
-	const int max_x = minimum(WIDTH - 1, int(max.x * (WIDTH - 1) + 0.5f));
-	const int min_y = maximum(0, int(min.y * (HEIGHT - 1) + 0.5f));
-	const int max_y = minimum(HEIGHT - 1, int(max.y * (HEIGHT - 1) + 0.5f));
+	int min_x = maximum(0, int(min.x * (WIDTH - 1) + 0.5f));
+	int max_x = minimum(WIDTH - 1, int(max.x * (WIDTH - 1) + 0.5f));
+	int min_y = maximum(0, int(min.y * (HEIGHT - 1) + 0.5f));
+	int max_y = minimum(HEIGHT - 1, int(max.y * (HEIGHT - 1) + 0.5f));
 
 	const int z = int(min.z * Z_SCALE);
 
-	// TODO check whole hierarchy
-	const int* LUMIX_RESTRICT depth = &m_mips[0][0];
+	// coarser mips keep the farthest depth of their texels, so testing fewer of them is still conservative
+	int level = 0;
+	while (level + 1 < m_mips.size() && maximum(max_x - min_x, max_y - min_y) > 4) {
+		++level;
+		min_x >>= 1;
+		max_x >>= 1;
+		min_y >>= 1;
+		max_y >>= 1;
+	}
+
+	const int w = WIDTH >> level;
+	const int* LUMIX_RESTRICT depth = &m_mips[level][0];
 	for (int j = min_y; j <= max_y; ++j)
 	{
-		for (int i = min_x; i < max_x; ++i)
+		for (int i = min_x; i <= max_x; ++i)
 		{
-			if (depth[i + j * WIDTH] > z) return false;
+			if (depth[i + j * w] > z) return false;
 		}
 	}
 	return true;
@@ -147,7 +158,23 @@ void OcclusionBuffer::buildHierarchy()
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
+static LUMIX_FORCE_INLINE void rasterizeSpan(int* LUMIX_RESTRICT row, int from, int to, int z, int dz)
+{
+	if (from < 0) {
+		z -= from * dz;
+		from = 0;
+	}
+	to = minimum(to, WIDTH - 1);
+	for (int x = from; x <= to; ++x)
+	{
+		if (z < row[x]) row[x] = z;
+		z += dz;
+	}
+}
+
+
+// only rows in [min_y, max_y] are written, so tiles can be rasterized in parallel
+LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth, int min_y, int max_y)
 {
 	Vec3 n = crossProduct(v[1] - v[0], v[2] - v[0]);
 	bool is_backface = n.z <= 0;
@@ -166,6 +193,7 @@ LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
 	Point p2 = { int(v[2].x * (width - 1) + 0.5f), int(v[2].y * (height - 1) + 0.5f) };
 
 	if (p0.y == p2.y) return;
+	if (p2.y < min_y || p0.y > max_y) return;
 
 	float xdz = -n.x / n.z;
 	int xdz_int = int(xdz * Z_SCALE / WIDTH);
@@ -182,12 +210,8 @@ LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
 		int right = p0.x * XY_SCALE + (dr >> 1);
 		for (int y = p0.y; y <= p1.y; ++y)
 		{
-			int base = y * width + left / XY_SCALE;
-			int z = z_left;
-			for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
-			{
-				if (z < depth[base + x]) depth[base + x] = z;
-				z += xdz_int;
+			if (y >= min_y && y <= max_y) {
+				rasterizeSpan(depth + y * width, left / XY_SCALE, right / XY_SCALE, z_left, xdz_int);
 			}
 			left += dl;
 			right += dr;
@@ -208,12 +232,8 @@ LUMIX_FORCE_INLINE void rasterizeProjectedTriangle(Vec3(&v)[3], int* depth)
 	int z_left = int(v[2].z * Z_SCALE) + (dz_left >> 1);
 	for (int y = p2.y; y >= p1.y; --y)
 	{
-		int base = y * width + left / XY_SCALE;
-		int z = z_left;
-		for (int x = 0, n = right / XY_SCALE - left / XY_SCALE; x <= n; ++x)
-		{
-			if (z < depth[base + x]) depth[base + x] = z;
-			z += xdz_int;
+		if (y >= min_y && y <= max_y) {
+			rasterizeSpan(depth + y * width, left / XY_SCALE, right / XY_SCALE, z_left, xdz_int);
 		}
 		left += dl;
 		right += dr;
@@ -288,7 +308,7 @@ static void clipTriangles(const Vec4& plane, Vec4* vertices, bool* triangles, in
 }
 
 
-LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int* depth)
+LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int* depth, int min_y, int max_y)
 {
 	enum ClipMask
 	{
@@ -299,6 +319,7 @@ LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int
 		NEGATIVE_Z = 1 << 4,
 		POSITIVE_Z = 1 << 5
 	};
+	const bool is_homogenous_depth = gpu::isHomogenousDepth();
 	u32 triangle_mask = 0;
 	u32 and_mask = 0;
 	for (int i = 0; i < 3; ++i)
@@ -307,7 +328,7 @@ LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int
 		u32 vertex_mask = 0;
 		if (v.x < -v.w) vertex_mask |= NEGATIVE_X;
 		if (v.y < -v.w) vertex_mask |= NEGATIVE_Y;
-		if (v.z < -v.w) vertex_mask |= NEGATIVE_Z;
+		if (v.z < (is_homogenous_depth ? -v.w : 0)) vertex_mask |= NEGATIVE_Z;
 
 		if (v.x > v.w) vertex_mask |= POSITIVE_X;
 		if (v.y > v.w) vertex_mask |= POSITIVE_Y;
@@ -324,7 +345,7 @@ LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int
 	if (triangle_mask == 0)
 	{
 		Vec3 projected[] = { toViewport(vertices[0]), toViewport(vertices[1]), toViewport(vertices[2]) };
-		rasterizeProjectedTriangle(projected, depth);
+		rasterizeProjectedTriangle(projected, depth, min_y, max_y);
 	}
 	else
 	{
@@ -335,7 +356,6 @@ LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int
 		if (triangle_mask & POSITIVE_Y) clipTriangles(Vec4(0.0f, -1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
 		if (triangle_mask & NEGATIVE_Y) clipTriangles(Vec4(0.0f, 1.0f, 0.0f, 1.0f), vertices, triangles, triangles_count);
 		if (triangle_mask & POSITIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, -1.0f, 1.0f), vertices, triangles, triangles_count);
-		bool is_homogenous_depth = gpu::isHomogenousDepth();
 		if (triangle_mask & NEGATIVE_Z) clipTriangles(Vec4(0.0f, 0.0f, 1.0f, is_homogenous_depth ? 1.0f : 0.0f), vertices, triangles, triangles_count);
 
 		for (int i = 0; i < triangles_count; ++i)
@@ -343,25 +363,24 @@ LUMIX_FORCE_INLINE void rasterizeOccludingTriangle(Vec4 (&vertices)[64 * 3], int
 			if (!triangles[i]) continue;
 			int index = i * 3;
 			Vec3 projected[] = { toViewport(vertices[index]), toViewport(vertices[index + 1]), toViewport(vertices[index + 2]) };
-			rasterizeProjectedTriangle(projected, depth);
+			rasterizeProjectedTriangle(projected, depth, min_y, max_y);
 		}
 	}
 }
 
 
 template <typename IndexType>
-static void rasterizeOccludingTriangles(const Mesh* mesh, const Matrix& mvp_mtx, int* depth)
+static void rasterizeOccludingTriangles(const Mesh* mesh, const Vec4* LUMIX_RESTRICT vertices, int* depth, int min_y, int max_y)
 {
-	const Vec3* LUMIX_RESTRICT vertices = &mesh->vertices[0];
 	const IndexType* LUMIX_RESTRICT indices = (const IndexType*)&mesh->indices[0];
+	// clipping adds triangles at the end
+	Vec4 v[64 * 3];
 	for (int i = 0, n = mesh->indices.size() / sizeof(IndexType); i < n; i += 3)
 	{
-		Vec4 v[64*3] = {
-			mvp_mtx * Vec4(vertices[indices[i + 0]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 1]], 1),
-			mvp_mtx * Vec4(vertices[indices[i + 2]], 1)
-		};
-		rasterizeOccludingTriangle(v, depth);
+		v[0] = vertices[indices[i + 0]];
+		v[1] = vertices[indices[i + 1]];
+		v[2] = vertices[indices[i + 2]];
+		rasterizeOccludingTriangle(v, depth, min_y, max_y);
 	}
 }
 
@@ -370,23 +389,53 @@ void OcclusionBuffer::rasterize(Universe* universe, const Array<MeshInstance>& m
 {
 	PROFILE_FUNCTION();
 	if (m_mips.empty()) init();
-	int* depth = &m_mips[0][0];
-	for (const MeshInstance& mesh_instance : meshes) {
-		const Mesh* mesh = mesh_instance.mesh;
-		const Matrix mtx = m_view_projection_matrix * universe->getRelativeMatrix(mesh_instance.owner, m_camera_pos);
-		if (mesh->flags.isSet(Mesh::INDICES_16_BIT)) {
-			rasterizeOccludingTriangles<u16>(mesh, mtx, depth);
+
+	Array<u32> offsets(m_allocator);
+	offsets.resize(meshes.size());
+	u32 vertex_count = 0;
+	for (int i = 0; i < meshes.size(); ++i) {
+		offsets[i] = vertex_count;
+		vertex_count += meshes[i].mesh->vertices.size();
+	}
+	m_clip_vertices.resize(vertex_count);
+
+	JobSystem::forEach(meshes.size(), 0, [&](i32 from, i32 to){
+		PROFILE_BLOCK("transform occluders");
+		for (i32 i = from; i < to; ++i) {
+			const MeshInstance& mesh_instance = meshes[i];
+			const Matrix mtx = m_view_projection_matrix * universe->getRelativeMatrix(mesh_instance.owner, m_camera_pos);
+			const Vec3* LUMIX_RESTRICT src = mesh_instance.mesh->vertices.begin();
+			Vec4* LUMIX_RESTRICT dst = &m_clip_vertices[offsets[i]];
+			for (int j = 0, c = mesh_instance.mesh->vertices.size(); j < c; ++j) {
+				dst[j] = mtx * Vec4(src[j], 1);
+			}
 		}
-		else {
-			rasterizeOccludingTriangles<u32>(mesh, mtx, depth);
+	});
+
+	int* depth = &m_mips[0][0];
+	JobSystem::forEach(HEIGHT / TILE_HEIGHT, [&](i32 tile){
+		PROFILE_BLOCK("rasterize tile");
+		const int min_y = tile * TILE_HEIGHT;
+		const int max_y = min_y + TILE_HEIGHT - 1;
+		for (int i = 0; i < meshes.size(); ++i) {
+			const Mesh* mesh = meshes[i].mesh;
+			if (mesh->indices.empty()) continue;
+			const Vec4* vertices = &m_clip_vertices[offsets[i]];
+			if (mesh->flags.isSet(Mesh::INDICES_16_BIT)) {
+				rasterizeOccludingTriangles<u16>(mesh, vertices, depth, min_y, max_y);
+			}
+			else {
+				rasterizeOccludingTriangles<u32>(mesh, vertices, depth, min_y, max_y);
+			}
 		}
-	}
+	});
 }
 
 
 void OcclusionBuffer::clear()
 {
 	PROFILE_FUNCTION();
+	if (m_mips.empty()) init();
 	for (auto& mip : m_mips)
 	{
 		for (int& i : mip)
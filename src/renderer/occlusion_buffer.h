@@ -22,21 +22,24 @@ struct OcclusionBuffer
 public:
 	OcclusionBuffer(IAllocator& allocator);
 
-	bool isOccluded(const Transform& world_transform, const AABB& aabb);
+	// thread safe, can be called from multiple workers once the hierarchy is built
+	bool isOccluded(const Transform& world_transform, const AABB& aabb) const;
 	void clear();
-	void setCamera(const DVec3& pos, const Quat& rot, const Matrix& projection);
+	// `view` is relative to `pos`, projection uses reversed zero-to-one depth
+	void setCamera(const DVec3& pos, const Matrix& view, const Matrix& projection);
+	// transforms meshes and rasterizes horizontal tiles of the buffer on job system workers
 	void rasterize(Universe* universe, const Array<MeshInstance>& meshes);
 	void buildHierarchy();
 	const int* getMip(int level) { return &m_mips[level][0]; }
 
 private:
 	void init();
-	Vec3 transform(const Transform& world_transform, float x, float y, float z);
 
 	using Mip = Array<int>;
 
 	IAllocator& m_allocator;
 	Array<Mip> m_mips;
+	Array<Vec4> m_clip_vertices;
 	Matrix m_view_projection_matrix;
 	DVec3 m_camera_pos;
 };
@@ -1,4 +1,5 @@
 #include "particle_system.h"
+#include "engine/allocator.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/atomic.h"
@@ -14,6 +15,7 @@
 #include "editor/world_editor.h"
 #include "renderer/material.h"
 #include "renderer/render_scene.h"
+#include "renderer/renderer.h"
 #include "engine/universe.h"
 
 
@@ -30,7 +32,10 @@ ParticleEmitterResource::ParticleEmitterResource(const Path& path
 	, IAllocator& allocator)
 	: Resource(path, manager, allocator)
 	, m_bytecode(allocator)
+	, m_update_ops(allocator)
+	, m_output_ops(allocator)
 	, m_material(nullptr)
+	, m_renderer(renderer)
 {
 }
 
@@ -38,6 +43,14 @@ ParticleEmitterResource::ParticleEmitterResource(const Path& path
 void ParticleEmitterResource::unload()
 {
 	m_bytecode.clear();
+	m_update_ops.clear();
+	m_output_ops.clear();
+	for (gpu::ProgramHandle& program : m_gpu_programs) {
+		if (program.isValid()) m_renderer.destroy(program);
+		program = gpu::INVALID_PROGRAM;
+	}
+	m_gpu_capacity = 0;
+	m_emit_rate = 0;
 }
 
 
@@ -142,6 +155,30 @@ struct Compiler
 		return 0;
 	}
 
+	static int gpu(lua_State* L)
+	{
+		lua_getfield(L, LUA_GLOBALSINDEX, "emitter");
+		ParticleEmitterResource* res = (ParticleEmitterResource*)lua_touserdata(L, -1);
+		lua_pop(L, 1);
+		
+		const u32 capacity = LuaWrapper::checkArg<u32>(L, 1);
+		if (capacity == 0) luaL_argerror(L, 1, "capacity must be greater than 0");
+		res->setGPUCapacity(capacity);
+
+		return 0;
+	}
+
+	static int emitRate(lua_State* L)
+	{
+		lua_getfield(L, LUA_GLOBALSINDEX, "emitter");
+		ParticleEmitterResource* res = (ParticleEmitterResource*)lua_touserdata(L, -1);
+		lua_pop(L, 1);
+		
+		res->setEmitRate(LuaWrapper::checkArg<float>(L, 1));
+
+		return 0;
+	}
+
 	static int newChannel(lua_State* L)
 	{
 		Compiler* c = getCompiler(L);
@@ -270,6 +307,372 @@ struct Compiler
 };
 
 
+static void kernelMov(float* dst, const float* arg0, const float*, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Load(arg0 + i));
+}
+
+
+static void kernelSplat(float* dst, const float*, const float*, const float*, float constant, u32 count)
+{
+	const float4 v = f4Splat(constant);
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, v);
+}
+
+
+static void kernelAdd(float* dst, const float* arg0, const float* arg1, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Add(f4Load(arg0 + i), f4Load(arg1 + i)));
+}
+
+
+static void kernelAddConst(float* dst, const float* arg0, const float*, const float*, float constant, u32 count)
+{
+	const float4 v = f4Splat(constant);
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Add(f4Load(arg0 + i), v));
+}
+
+
+static void kernelSub(float* dst, const float* arg0, const float* arg1, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Sub(f4Load(arg0 + i), f4Load(arg1 + i)));
+}
+
+
+static void kernelSubConst(float* dst, const float* arg0, const float*, const float*, float constant, u32 count)
+{
+	const float4 v = f4Splat(constant);
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Sub(f4Load(arg0 + i), v));
+}
+
+
+static void kernelMul(float* dst, const float* arg0, const float* arg1, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Mul(f4Load(arg0 + i), f4Load(arg1 + i)));
+}
+
+
+static void kernelMulConst(float* dst, const float* arg0, const float*, const float*, float constant, u32 count)
+{
+	const float4 v = f4Splat(constant);
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Mul(f4Load(arg0 + i), v));
+}
+
+
+static void kernelMulAdd(float* dst, const float* arg0, const float* arg1, const float* arg2, float, u32 count)
+{
+	for (u32 i = 0; i < count; i += 4) {
+		f4Store(dst + i, f4Add(f4Mul(f4Load(arg0 + i), f4Load(arg1 + i)), f4Load(arg2 + i)));
+	}
+}
+
+
+static void kernelMulConstAdd(float* dst, const float* arg0, const float*, const float* arg2, float constant, u32 count)
+{
+	const float4 v = f4Splat(constant);
+	for (u32 i = 0; i < count; i += 4) f4Store(dst + i, f4Add(f4Mul(f4Load(arg0 + i), v), f4Load(arg2 + i)));
+}
+
+
+static void kernelSin(float* dst, const float* arg0, const float*, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; ++i) dst[i] = sinf(arg0[i]);
+}
+
+
+static void kernelCos(float* dst, const float* arg0, const float*, const float*, float, u32 count)
+{
+	for (u32 i = 0; i < count; ++i) dst[i] = cosf(arg0[i]);
+}
+
+
+static bool isReadBeforeWritten(const Array<ParticleEmitterResource::Op>& ops, u32 from, u8 stream)
+{
+	for (u32 i = from; i < ops.size(); ++i) {
+		const ParticleEmitterResource::Op& op = ops[i];
+		if (op.arg0 == stream || op.arg1 == stream || op.arg2 == stream) return true;
+		if (op.dst == stream) return false;
+	}
+	return false;
+}
+
+
+// `mul tmp, a, b; add dst, tmp, c` is fused to a single multiply-add if tmp is a register not read later
+static void fuseMultiplyAdd(Array<ParticleEmitterResource::Op>& ops, int channels_count)
+{
+	for (u32 i = 0; i + 1 < ops.size(); ++i) {
+		ParticleEmitterResource::Op& mul = ops[i];
+		const ParticleEmitterResource::Op& add = ops[i + 1];
+		if (mul.kernel != kernelMul && mul.kernel != kernelMulConst) continue;
+		if (add.kernel != kernelAdd) continue;
+		if (mul.dst < channels_count) continue;
+
+		u8 addend;
+		if (add.arg0 == mul.dst && add.arg1 != mul.dst) addend = add.arg1;
+		else if (add.arg1 == mul.dst && add.arg0 != mul.dst) addend = add.arg0;
+		else continue;
+		if (isReadBeforeWritten(ops, i + 2, mul.dst)) continue;
+
+		mul.kernel = mul.kernel == kernelMul ? kernelMulAdd : kernelMulConstAdd;
+		mul.dst = add.dst;
+		mul.arg2 = addend;
+		ops.erase(i + 1);
+	}
+}
+
+
+bool ParticleEmitterResource::lower(int offset, Array<Op>& ops) const
+{
+	InputMemoryStream blob((const u8*)m_bytecode.getData() + offset, m_bytecode.getPos() - offset);
+	
+	// returns false if the operand is a literal or a constant
+	auto readOperand = [&](Op& op, u8& stream) {
+		const auto type = blob.read<Compiler::DataStream::Type>();
+		switch (type) {
+			case Compiler::DataStream::CHANNEL: stream = blob.read<u8>(); return true;
+			case Compiler::DataStream::REGISTER: stream = u8(m_channels_count + blob.read<u8>()); return true;
+			case Compiler::DataStream::CONST: op.constant = blob.read<u8>(); return false;
+			case Compiler::DataStream::LITERAL: op.literal = blob.read<float>(); return false;
+		}
+		ASSERT(false);
+		return false;
+	};
+
+	for (;;) {
+		const Instructions instruction = blob.read<Instructions>();
+		Op op;
+		bool valid = true;
+		switch (instruction) {
+			case Instructions::END:
+				fuseMultiplyAdd(ops, m_channels_count);
+				return true;
+			case Instructions::MOV:
+				valid = readOperand(op, op.dst);
+				op.kernel = readOperand(op, op.arg0) ? kernelMov : kernelSplat;
+				break;
+			case Instructions::ADD:
+			case Instructions::SUB:
+			case Instructions::MUL: {
+				valid = readOperand(op, op.dst) && readOperand(op, op.arg0);
+				const bool is_stream = readOperand(op, op.arg1);
+				switch (instruction) {
+					case Instructions::ADD: op.kernel = is_stream ? kernelAdd : kernelAddConst; break;
+					case Instructions::SUB: op.kernel = is_stream ? kernelSub : kernelSubConst; break;
+					default: op.kernel = is_stream ? kernelMul : kernelMulConst; break;
+				}
+				break;
+			}
+			case Instructions::SIN:
+			case Instructions::COS:
+				valid = readOperand(op, op.dst) && readOperand(op, op.arg0);
+				op.kernel = instruction == Instructions::SIN ? kernelSin : kernelCos;
+				break;
+			case Instructions::OUTPUT:
+				valid = readOperand(op, op.arg0);
+				break;
+			default:
+				logError("Renderer") << getPath() << ": instruction " << (int)instruction << " is not supported in this program.";
+				return false;
+		}
+		if (!valid || (op.constant != Op::NONE && op.constant >= 16)) {
+			logError("Renderer") << getPath() << ": invalid operand.";
+			return false;
+		}
+		ops.push(op);
+	}
+}
+
+
+static bool writeGLSLOperand(IOutputStream& out, InputMemoryStream& blob)
+{
+	const auto type = blob.read<Compiler::DataStream::Type>();
+	switch (type) {
+		case Compiler::DataStream::CHANNEL: out << "CH(" << (u32)blob.read<u8>() << ")"; return true;
+		case Compiler::DataStream::REGISTER: out << "r" << (u32)blob.read<u8>(); return true;
+		case Compiler::DataStream::CONST: {
+			const u8 idx = blob.read<u8>();
+			if (idx >= 4) return false;
+			out << "u_constants[" << (u32)idx << "]";
+			return true;
+		}
+		case Compiler::DataStream::LITERAL: {
+			// bit exact, decimal printing would round
+			const float value = blob.read<float>();
+			u32 bits;
+			memcpy(&bits, &value, sizeof(bits));
+			out << "uintBitsToFloat(" << bits << "u)";
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// translates one program of the bytecode to the body of a compute shader
+static bool writeGLSLProgram(IOutputStream& out, InputMemoryStream& blob, int outputs_count)
+{
+	u32 output_idx = 0;
+	for (;;) {
+		const Instructions instruction = blob.read<Instructions>();
+		bool valid = true;
+		out << "\t\t";
+		switch (instruction) {
+			case Instructions::END: return true;
+			case Instructions::MOV:
+				valid = writeGLSLOperand(out, blob);
+				out << " = ";
+				valid = valid && writeGLSLOperand(out, blob);
+				break;
+			case Instructions::ADD:
+			case Instructions::SUB:
+			case Instructions::MUL: {
+				const char* op = instruction == Instructions::ADD ? " + " : instruction == Instructions::SUB ? " - " : " * ";
+				valid = writeGLSLOperand(out, blob);
+				out << " = ";
+				valid = valid && writeGLSLOperand(out, blob);
+				out << op;
+				valid = valid && writeGLSLOperand(out, blob);
+				break;
+			}
+			case Instructions::SIN:
+			case Instructions::COS:
+				valid = writeGLSLOperand(out, blob);
+				out << (instruction == Instructions::SIN ? " = sin(" : " = cos(");
+				valid = valid && writeGLSLOperand(out, blob);
+				out << ")";
+				break;
+			case Instructions::RAND:
+				valid = writeGLSLOperand(out, blob);
+				out << " = randFloat(";
+				valid = valid && writeGLSLOperand(out, blob);
+				out << ", ";
+				valid = valid && writeGLSLOperand(out, blob);
+				out << ")";
+				break;
+			case Instructions::OUTPUT:
+				out << "b_output[p * " << (u32)outputs_count << " + " << output_idx << "] = ";
+				++output_idx;
+				valid = writeGLSLOperand(out, blob);
+				break;
+			default: return false;
+		}
+		if (!valid) return false;
+		out << ";\n";
+	}
+}
+
+
+bool ParticleEmitterResource::generateComputeShader(OutputMemoryStream& src) const
+{
+	src << R"#(
+	layout(local_size_x = 256) in;
+
+	layout(std140, binding = 4) uniform ParticleState {
+		vec4 u_constants; // x = time delta, yzw = camera position
+		uvec4 u_state; // x = first emitted particle, y = emitted count, z = processed count, w = capacity
+		uvec4 u_seed;
+	};
+
+	// channel `i` of all particles is at [i * capacity, (i + 1) * capacity)
+	layout(std430, binding = 0) buffer Channels {
+		float b_channels[];
+	};
+
+	layout(std430, binding = 1) writeonly buffer Output {
+		float b_output[];
+	};
+
+	#define CH(i) b_channels[(i) * u_state.w + p]
+
+	uint g_rand_state;
+
+	// pcg hash
+	float randFloat(float from, float to) {
+		g_rand_state = g_rand_state * 747796405u + 2891336453u;
+		uint word = ((g_rand_state >> ((g_rand_state >> 28u) + 4u)) ^ g_rand_state) * 277803737u;
+		word = (word >> 22u) ^ word;
+		return mix(from, to, float(word) / 4294967295.0);
+	}
+
+	void main() {
+		uint idx = gl_GlobalInvocationID.x;
+		g_rand_state = (idx ^ u_seed.x) * 2654435769u;
+	)#";
+	for (int i = 0; i < m_registers_count; ++i) {
+		src << "\tfloat r" << i << " = 0;\n";
+	}
+
+	const u8* bytecode = (const u8*)m_bytecode.getData();
+	const u64 size = m_bytecode.getPos();
+	InputMemoryStream emit(bytecode + m_emit_byte_offset, size - m_emit_byte_offset);
+	InputMemoryStream update(bytecode, size);
+	InputMemoryStream output(bytecode + m_output_byte_offset, size - m_output_byte_offset);
+
+	src << "\t#if defined LUMIX_PARTICLE_EMIT\n"
+		"\t\tif (idx >= u_state.y) return;\n"
+		"\t\tuint p = (u_state.x + idx) % u_state.w;\n";
+	if (!writeGLSLProgram(src, emit, m_outputs_count)) return false;
+	src << "\n\t#elif defined LUMIX_PARTICLE_UPDATE\n"
+		"\t\tif (idx >= u_state.z) return;\n"
+		"\t\tuint p = idx;\n";
+	if (!writeGLSLProgram(src, update, m_outputs_count)) return false;
+	src << "\n\t#else\n"
+		"\t\tif (idx >= u_state.z) return;\n"
+		"\t\tuint p = idx;\n";
+	if (!writeGLSLProgram(src, output, m_outputs_count)) return false;
+	src << "\n\t#endif\n}\n";
+	src.write('\0');
+	return true;
+}
+
+
+void ParticleEmitterResource::createGPUPrograms()
+{
+	// simulated on CPU
+	if (m_renderer.isHeadless()) {
+		m_gpu_capacity = 0;
+		return;
+	}
+
+	struct Programs {
+		Programs(IAllocator& allocator) : src(allocator) {}
+		OutputMemoryStream src;
+		gpu::ProgramHandle programs[(int)GPUPass::COUNT];
+		StaticString<MAX_PATH_LENGTH> name;
+	};
+
+	Programs* data = LUMIX_NEW(m_renderer.getAllocator(), Programs)(m_renderer.getAllocator());
+	if (!generateComputeShader(data->src)) {
+		logError("Renderer") << getPath() << " can not be simulated on GPU, it uses unsupported instructions.";
+		LUMIX_DELETE(m_renderer.getAllocator(), data);
+		m_gpu_capacity = 0;
+		return;
+	}
+
+	data->name = getPath().c_str();
+	for (int i = 0; i < (int)GPUPass::COUNT; ++i) {
+		m_gpu_programs[i] = gpu::allocProgramHandle();
+		data->programs[i] = m_gpu_programs[i];
+	}
+
+	m_renderer.runInRenderThread(data, [](Renderer& renderer, void* ptr){
+		Programs* data = (Programs*)ptr;
+		const char* defines[] = {
+			"#define LUMIX_PARTICLE_EMIT\n",
+			"#define LUMIX_PARTICLE_UPDATE\n",
+			"#define LUMIX_PARTICLE_OUTPUT\n"
+		};
+		const char* src = (const char*)data->src.getData();
+		const gpu::ShaderType type = gpu::ShaderType::COMPUTE;
+		for (int i = 0; i < (int)GPUPass::COUNT; ++i) {
+			if (!data->programs[i].isValid()) continue;
+			gpu::createProgram(data->programs[i], gpu::VertexDecl(), &src, &type, 1, &defines[i], 1, data->name);
+		}
+		LUMIX_DELETE(renderer.getAllocator(), data);
+	});
+}
+
+
 void ParticleEmitterResource::setMaterial(const Path& path)
 {
 	Material* material = m_resource_manager.getOwner().load<Material>(path);
@@ -303,6 +706,8 @@ bool ParticleEmitterResource::load(u64 size, const u8* mem)
 		lua_setfield(L, LUA_GLOBALSINDEX, #name);
 
 	DEFINE_LUA_FUNC(material);
+	DEFINE_LUA_FUNC(gpu);
+	DEFINE_LUA_FUNC(emitRate);
 	DEFINE_LUA_FUNC(newChannel);
 	DEFINE_LUA_FUNC(newRegister);
 
@@ -393,10 +798,17 @@ bool ParticleEmitterResource::load(u64 size, const u8* mem)
 
 	lua_close(L);
 
+	if (m_channels_count > 16 || m_channels_count + m_registers_count > Op::MAX_STREAMS) {
+		logError("Renderer") << getPath() << " has too many channels and registers.";
+		return false;
+	}
+	if (!lower(0, m_update_ops) || !lower(m_output_byte_offset, m_output_ops)) return false;
+
 	if (!m_material) {
 		logError("Renderer") << getPath() << " has no material.";
 		return false;
 	}
+	if (isGPUSimulated()) createGPUPrograms();
 	return true;
 }
 
@@ -412,6 +824,7 @@ ParticleEmitter::ParticleEmitter(EntityPtr entity, IAllocator& allocator)
 
 ParticleEmitter::~ParticleEmitter()
 {
+	destroyGPUBuffers();
 	for (const Channel& c : m_channels) {
 		m_allocator.deallocate_aligned(c.data);
 	}
@@ -420,6 +833,7 @@ ParticleEmitter::~ParticleEmitter()
 
 void ParticleEmitter::setResource(ParticleEmitterResource* res)
 {
+	destroyGPUBuffers();
 	if (m_resource) {
 		m_resource->getResourceManager().unload(*m_resource);
 	}
@@ -427,6 +841,98 @@ void ParticleEmitter::setResource(ParticleEmitterResource* res)
 }
 
 
+void ParticleEmitter::destroyGPUBuffers()
+{
+	if (m_gpu.channels.isValid()) {
+		ASSERT(m_resource);
+		m_resource->getRenderer().destroy(m_gpu.channels);
+		m_resource->getRenderer().destroy(m_gpu.output);
+	}
+	m_gpu = {};
+	m_gpu_head = 0;
+	m_gpu_requested = 0;
+	m_gpu_emit_accum = 0;
+}
+
+
+void ParticleEmitter::updateGPUSimulation()
+{
+	const u32 capacity = m_resource->getGPUCapacity();
+	const gpu::ProgramHandle emit_program = m_resource->getGPUProgram(ParticleEmitterResource::GPUPass::EMIT);
+	if (capacity != m_gpu.capacity || emit_program.value != m_gpu.programs[0].value) {
+		// new or reloaded resource, simulation starts from scratch
+		const u32 requested = m_gpu_requested;
+		const float dt = m_gpu.dt;
+		destroyGPUBuffers();
+		m_gpu_requested = requested;
+		m_gpu.dt = dt;
+
+		Renderer& renderer = m_resource->getRenderer();
+		// zeroed, so particles are well defined even if the emit pass was skipped while compiling
+		const Renderer::MemRef channels_mem = renderer.allocate(maximum(1, m_resource->getChannelsCount()) * capacity * (u32)sizeof(float));
+		memset(channels_mem.data, 0, channels_mem.size);
+		const Renderer::MemRef output_mem = { maximum(1, m_resource->getOutputsCount()) * capacity * (u32)sizeof(float), nullptr, false };
+		m_gpu.channels = renderer.createBuffer(channels_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		m_gpu.output = renderer.createBuffer(output_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		for (int i = 0; i < (int)ParticleEmitterResource::GPUPass::COUNT; ++i) {
+			m_gpu.programs[i] = m_resource->getGPUProgram((ParticleEmitterResource::GPUPass)i);
+		}
+		m_gpu.capacity = capacity;
+	}
+
+	m_gpu_emit_accum += m_resource->getEmitRate() * m_gpu.dt;
+	const u32 rate_count = (u32)m_gpu_emit_accum;
+	m_gpu_emit_accum -= rate_count;
+	const u32 count = minimum(rate_count + m_gpu_requested, capacity);
+	m_gpu_requested = 0;
+
+	m_gpu.first_emitted = m_gpu_head;
+	m_gpu.emit_count = count;
+	m_gpu.update_count = m_gpu.alive;
+	// oldest particles are overwritten once the ring buffer is full
+	m_gpu.alive = minimum(m_gpu.alive + count, capacity);
+	m_gpu_head = (m_gpu_head + count) % capacity;
+	++m_gpu.seed;
+	m_instances_count = m_gpu.alive;
+}
+
+
+bool ParticleEmitter::dispatch(const GPUSimulation& sim, ParticleEmitterResource::GPUPass pass, const DVec3& cam_pos, gpu::BufferHandle ub)
+{
+	using GPUPass = ParticleEmitterResource::GPUPass;
+	const u32 count = pass == GPUPass::EMIT ? sim.emit_count : pass == GPUPass::UPDATE ? sim.update_count : sim.alive;
+	if (count == 0 || !sim.channels.isValid()) return false;
+	// passes depend on each other, partially compiled simulation is not run at all
+	for (gpu::ProgramHandle program : sim.programs) {
+		if (!gpu::isProgramReady(program)) return false;
+	}
+
+	struct {
+		Vec4 constants;
+		u32 first_emitted;
+		u32 emit_count;
+		u32 count;
+		u32 capacity;
+		u32 seed;
+		u32 padding[3];
+	} state;
+	state.constants = Vec4(sim.dt, (float)cam_pos.x, (float)cam_pos.y, (float)cam_pos.z);
+	state.first_emitted = sim.first_emitted;
+	state.emit_count = sim.emit_count;
+	state.count = count;
+	state.capacity = sim.capacity;
+	state.seed = sim.seed;
+
+	gpu::update(ub, &state, sizeof(state));
+	gpu::useProgram(sim.programs[(int)pass]);
+	gpu::bindShaderBuffer(sim.channels, 0);
+	gpu::bindShaderBuffer(sim.output, 1);
+	gpu::dispatch((count + 255) / 256, 1, 1);
+	gpu::memoryBarrier();
+	return true;
+}
+
+
 float ParticleEmitter::readSingleValue(InputMemoryStream& blob) const
 {
 	const auto type = blob.read<Compiler::DataStream::Type>();
@@ -447,6 +953,12 @@ float ParticleEmitter::readSingleValue(InputMemoryStream& blob) const
 
 void ParticleEmitter::emit(const float* args)
 {
+	if (isGPUSimulated()) {
+		// emit program runs on GPU, only the count is passed
+		++m_gpu_requested;
+		return;
+	}
+
 	const int channels_count = m_resource->getChannelsCount();
 	if (m_particles_count == m_capacity)
 	{
@@ -562,183 +1074,107 @@ void ParticleEmitter::execute(InputMemoryStream& blob, int particle_index)
 }
 
 
-static float4* getStream(const ParticleEmitter& emitter
-	, Compiler::DataStream::Type type
-	, int idx
-	, int particles_count
-	, float4* register_mem)
+void ParticleEmitter::run(const Array<ParticleEmitterResource::Op>& ops, u32 offset, u32 count, float* output)
 {
-	switch(type) {
-		case Compiler::DataStream::CHANNEL: return (float4*)emitter.getChannelData(idx); //-V1032
-		case Compiler::DataStream::REGISTER: return register_mem + particles_count * idx;
-		default: ASSERT(false); return nullptr;
+	using Op = ParticleEmitterResource::Op;
+	const int channels_count = m_resource->getChannelsCount();
+	const int registers_count = m_resource->getRegistersCount();
+	// registers are per range, channels are shared by all ranges
+	float* reg_mem = (float*)getFrameAllocator().allocate_aligned(registers_count * count * sizeof(float) + 16, 16);
+	float* streams[Op::MAX_STREAMS + 1];
+	for (int i = 0; i < channels_count; ++i) streams[i] = m_channels[i].data + offset;
+	for (int i = 0; i < registers_count; ++i) streams[channels_count + i] = reg_mem + count * i;
+	streams[Op::NONE] = nullptr;
+
+	const int stride = m_resource->getOutputsCount();
+	int output_idx = 0;
+	for (const Op& op : ops) {
+		if (op.kernel) {
+			const float constant = op.constant == Op::NONE ? op.literal : m_constants[op.constant].value;
+			op.kernel(streams[op.dst], streams[op.arg0], streams[op.arg1], streams[op.arg2], constant, count);
+			continue;
+		}
+
+		ASSERT(output);
+		const float* arg = streams[op.arg0];
+		float* dst = output + output_idx + offset * stride;
+		++output_idx;
+		for (u32 i = 0, j = 0; i < count; ++i, j += stride) {
+			dst[j] = arg[i];
+		}
 	}
 }
 
 
-void ParticleEmitter::update(float dt)
+void ParticleEmitter::simulate(float dt, u32 offset, u32 count)
+{
+	PROFILE_BLOCK("particle simulation");
+	run(m_resource->getUpdateOps(), offset, count, nullptr);
+}
+
+
+void ParticleEmitter::simulate(float dt)
 {
 	if (!m_resource || !m_resource->isReady()) return;
 
-	// TODO remove
-	static bool xx = [&]{
-		for (int i = 0; i < 450'000; ++i) {
-			emit(nullptr);
-		}
-		return true;
-	}();
+	if (m_resource->isGPUSimulated()) {
+		m_gpu.dt = dt;
+		return;
+	}
 
 	PROFILE_FUNCTION();
 	Profiler::pushInt("particle count", m_particles_count);
-	if (m_particles_count == 0) return;
-
 	m_emit_buffer.clear();
-	m_constants[0].value = dt;
-	const OutputMemoryStream& bytecode = m_resource->getBytecode();
-	InputMemoryStream blob(bytecode.getData(), bytecode.getPos());
-	// TODO
-	Array<float4> reg_mem(m_allocator);
-	reg_mem.resize(m_resource->getRegistersCount() * ((m_particles_count + 3) >> 2));
 	m_instances_count = m_particles_count;
+	if (m_particles_count == 0) return;
 
-	for (;;)
-	{
-		u8 instruction = blob.read<u8>();
-		switch ((Instructions)instruction)
-		{
-			case Instructions::END:
-				goto end;
-			case Instructions::MUL: {
-				const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-				const u8 dst_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg0_type = blob.read<Compiler::DataStream::Type>();
-				const u8 arg0_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg1_type = blob.read<Compiler::DataStream::Type>();
-				
-				const float4* arg0 = getStream(*this, arg0_type, arg0_idx, m_particles_count, reg_mem.begin());
-				float4* result = getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin());
-				const float4* const end = result + ((m_particles_count + 3) >> 2);
-
-				if(arg1_type == Compiler::DataStream::LITERAL) {
-					const float4 arg1 = f4Splat(blob.read<float>());
-
-					for (; result != end; ++result, ++arg0) {
-						*result = f4Mul(*arg0, arg1);
-					}
-				}
-				else {
-					const u8 arg1_idx = blob.read<u8>();
-					const float4* arg1 = getStream(*this, arg1_type, arg1_idx, m_particles_count, reg_mem.begin());
-					for (; result != end; ++result, ++arg0, ++arg1) {
-						*result = f4Mul(*arg0, *arg1);
-					}
-				}
-
-				break;
-			}
-			case Instructions::MOV: {
-				const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-				const u8 dst_idx = blob.read<u8>();
-				const Compiler::DataStream::Type src_type = blob.read<Compiler::DataStream::Type>();
-				const u8 src_idx = blob.read<u8>();
-				
-				float4* result = getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin());
-				const float4* const end = result + ((m_particles_count + 3) >> 2);
-				
-				if(src_type == Compiler::DataStream::CONST) {
-					ASSERT(src_idx == 0);
-					const float4 src = f4Splat(dt);
-					for (; result != end; ++result) {
-						*result = src;
-					}
-				}
-				else {
-					const float4* src = getStream(*this, src_type, src_idx, m_particles_count, reg_mem.begin());
-
-					for (; result != end; ++result, ++src) {
-						*result = *src;
-					}
-				}
-
-				break;
-			}
-			case Instructions::ADD: {
-				const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-				const u8 dst_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg0_type = blob.read<Compiler::DataStream::Type>();
-				const u8 arg0_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg1_type = blob.read<Compiler::DataStream::Type>();
-				const u8 arg1_idx = blob.read<u8>();
-				
-				// TODO
-				float4* result = getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin());
-				const float4* const end = result + ((m_particles_count + 3) >> 2);
-				const float4* arg0 = getStream(*this, arg0_type, arg0_idx, m_particles_count, reg_mem.begin());
-
-				if(arg1_type == Compiler::DataStream::CONST) { 
-					ASSERT(arg1_idx == 0);
-					const float4 arg1 = f4Splat(dt);
-
-					for (; result != end; ++result, ++arg0) {
-						*result = f4Add(*arg0, arg1);
-					}
-				}
-				else {
-					const float4* arg1 = getStream(*this, arg1_type, arg1_idx, m_particles_count, reg_mem.begin());
+	m_constants[0].value = dt;
+	const u32 count = (m_particles_count + 3) & ~3;
+	if (count <= SIMULATION_RANGE_SIZE) {
+		simulate(dt, 0, count);
+		return;
+	}
 
-					for (; result != end; ++result, ++arg0, ++arg1) {
-						*result = f4Add(*arg0, *arg1);
-					}
-				}
+	// huge emitters are split to ranges simulated on all workers
+	JobSystem::forEach(count, SIMULATION_RANGE_SIZE, [&](u32 from, u32 to){
+		simulate(dt, from, to - from);
+	});
+}
 
-				break;
-			}
-			case Instructions::COS: {
-				const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-				const u8 dst_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg_type = blob.read<Compiler::DataStream::Type>();
-				const u8 arg_idx = blob.read<u8>();
-				
-				const float* arg = (float*)getStream(*this, arg_type, arg_idx, m_particles_count, reg_mem.begin());
-				float* result = (float*)getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin());
-				const float* const end = result + ((m_particles_count + 3) & ~3);
 
-				for (; result != end; ++result, ++arg) {
-					*result = cosf(*arg);
-				}
-				break;
-			}
-			case Instructions::SIN: {
-				const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-				const u8 dst_idx = blob.read<u8>();
-				const Compiler::DataStream::Type arg_type = blob.read<Compiler::DataStream::Type>();
-				const u8 arg_idx = blob.read<u8>();
-				
-				const float* arg = (float*)getStream(*this, arg_type, arg_idx, m_particles_count, reg_mem.begin());
-				float* result = (float*)getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin());
-				const float* const end = result + ((m_particles_count + 3) & ~3);
+void ParticleEmitter::applyEmits()
+{
+	if (!m_resource || !m_resource->isReady()) return;
+	if (m_resource->isGPUSimulated()) {
+		updateGPUSimulation();
+		return;
+	}
 
-				for (; result != end; ++result, ++arg) {
-					*result = sinf(*arg);
-				}
-				break;
-			}
-			default:
-				ASSERT(false);
-				break;
+	// TODO remove
+	static bool xx = [&]{
+		for (int i = 0; i < 450'000; ++i) {
+			emit(nullptr);
 		}
+		return true;
+	}();
+
+	InputMemoryStream emit_buffer(m_emit_buffer);
+	while (emit_buffer.getPosition() < emit_buffer.size())
+	{
+		u8 count = emit_buffer.read<u8>();
+		float args[16];
+		ASSERT(count <= lengthOf(args));
+		emit_buffer.read(args, sizeof(args[0]) * count);
+		emit(args);
 	}
+	m_emit_buffer.clear();
+}
 
-	end:
-		InputMemoryStream emit_buffer(m_emit_buffer);
-		while (emit_buffer.getPosition() < emit_buffer.size())
-		{
-			u8 count = emit_buffer.read<u8>();
-			float args[16];
-			ASSERT(count <= lengthOf(args));
-			emit_buffer.read(args, sizeof(args[0]) * count);
-			emit(args);
-		}
+
+void ParticleEmitter::update(float dt)
+{
+	simulate(dt);
+	applyEmits();
 }
 
 
@@ -751,101 +1187,14 @@ int ParticleEmitter::getInstanceDataSizeBytes() const
 void ParticleEmitter::fillInstanceData(const DVec3& cam_pos, float* data)
 {
 	PROFILE_FUNCTION();
-	const OutputMemoryStream& bytecode = m_resource->getBytecode();
-	const int output_offset = m_resource->getOutputByteOffset();
-	
 	// TODO
 	m_constants[1].value = (float)cam_pos.x;
 	m_constants[2].value = (float)cam_pos.y;
 	m_constants[3].value = (float)cam_pos.z;
-	// TODO
-	Array<float4> reg_mem(m_allocator);
-	reg_mem.resize(m_resource->getRegistersCount() * ((m_particles_count + 3) >> 2));
 
 	auto sim = [&](u32 offset, u32 count){
 		PROFILE_BLOCK("particle simulation");
-		InputMemoryStream blob((u8*)bytecode.getData() + output_offset, bytecode.getPos());
-		int output_idx = 0;
-		for (;;) {
-			u8 instruction = blob.read<u8>();
-			switch ((Instructions)instruction) {
-				case Instructions::END:
-					return;
-				case Instructions::SIN: {
-					const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-					const u8 dst_idx = blob.read<u8>();
-					const Compiler::DataStream::Type arg_type = blob.read<Compiler::DataStream::Type>();
-					const u8 arg_idx = blob.read<u8>();
-				
-					const float* arg = (float*)getStream(*this, arg_type, arg_idx, m_particles_count, reg_mem.begin()) + offset;
-					float* result = (float*)getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin()) + offset;
-					const float* const end = result + count;
-
-					for (; result != end; ++result, ++arg) {
-						*result = sinf(*arg);
-					}
-					break;
-				}
-				case Instructions::COS: {
-					const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-					const u8 dst_idx = blob.read<u8>();
-					const Compiler::DataStream::Type arg_type = blob.read<Compiler::DataStream::Type>();
-					const u8 arg_idx = blob.read<u8>();
-				
-					const float* arg = (float*)getStream(*this, arg_type, arg_idx, m_particles_count, reg_mem.begin()) + offset;
-					float* result = (float*)getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin()) + offset;
-					const float* const end = result + count;
-
-					for (; result != end; ++result, ++arg) {
-						*result = cosf(*arg);
-					}
-					break;
-				}
-				case Instructions::MUL: {
-					const Compiler::DataStream::Type dst_type = blob.read<Compiler::DataStream::Type>();
-					const u8 dst_idx = blob.read<u8>();
-					const Compiler::DataStream::Type arg0_type = blob.read<Compiler::DataStream::Type>();
-					const u8 arg0_idx = blob.read<u8>();
-					const Compiler::DataStream::Type arg1_type = blob.read<Compiler::DataStream::Type>();
-				
-					float4* result = getStream(*this, dst_type, dst_idx, m_particles_count, reg_mem.begin()) + (offset >> 2);
-					const float4* arg0 = getStream(*this, arg0_type, arg0_idx, m_particles_count, reg_mem.begin()) + (offset >> 2);
-					const float4* const end = result + (count >> 2);
-					if(arg1_type == Compiler::DataStream::LITERAL) {
-						const float4 arg1 = f4Splat(blob.read<float>());
-
-						for (; result != end; ++result, ++arg0) {
-							*result = f4Mul(*arg0, arg1);
-						}
-					}
-					else {
-						const u8 arg1_idx = blob.read<u8>();
-						const float4* arg1 = getStream(*this, arg1_type, arg1_idx, m_particles_count, reg_mem.begin()) + (offset >> 2);
-
-						for (; result != end; ++result, ++arg0, ++arg1) {
-							*result = f4Mul(*arg0, *arg1);
-						}
-					}
-
-					break;
-				}
-				case Instructions::OUTPUT: {
-					const int stride = m_resource->getOutputsCount();
-					const Compiler::DataStream::Type arg_type = blob.read<Compiler::DataStream::Type>();
-					const u8 arg_idx = blob.read<u8>();
-					const float* arg = (float*)getStream(*this, arg_type, arg_idx, m_particles_count, reg_mem.begin()) + offset;
-					float* dst = data + output_idx + offset * stride;
-					++output_idx;
-					for (u32 i = 0, j = 0; i < count; ++i, j += stride) {
-						dst[j] =  arg[i];
-					}
-					break;
-				}
-				default:
-					ASSERT(false);
-					break;
-			}
-		}
+		run(m_resource->getOutputOps(), offset, count, data);
 	};
 	if(m_particles_count > 16 * 1024) {
 		volatile i32 counter = 0;
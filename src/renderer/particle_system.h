@@ -6,6 +6,7 @@
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "gpu/gpu.h"
 
 
 namespace Lumix
@@ -20,6 +21,34 @@ struct Renderer;
 struct ParticleEmitterResource final : Resource
 {
 public:
+	// update and output programs are lowered at load to ops with pre-resolved kernels and operands,
+	// so simulation does not decode bytecode for every range of particles
+	struct Op
+	{
+		// count is a multiple of 4, all streams are 16B aligned
+		using Kernel = void (*)(float* dst, const float* arg0, const float* arg1, const float* arg2, float constant, u32 count);
+		// streams are indexed channels first, then registers; NONE maps to nullptr
+		static constexpr u8 MAX_STREAMS = 64;
+		static constexpr u8 NONE = MAX_STREAMS;
+
+		Kernel kernel = nullptr; // nullptr for output
+		float literal = 0;
+		u8 constant = NONE; // emitter constant used instead of literal
+		u8 dst = NONE;
+		u8 arg0 = NONE;
+		u8 arg1 = NONE;
+		u8 arg2 = NONE;
+	};
+
+	// passes of GPU simulated emitters, each is a compute program generated from the script
+	enum class GPUPass : u8 {
+		EMIT,
+		UPDATE,
+		OUTPUT,
+
+		COUNT
+	};
+
 	static const ResourceType TYPE;
 
 	ParticleEmitterResource(const Path& path, ResourceManager& manager, Renderer& renderer, IAllocator& allocator);
@@ -33,17 +62,38 @@ public:
 	int getChannelsCount() const { return m_channels_count; }
 	int getRegistersCount() const { return m_registers_count; }
 	int getOutputsCount() const { return m_outputs_count; }
+	const Array<Op>& getUpdateOps() const { return m_update_ops; }
+	const Array<Op>& getOutputOps() const { return m_output_ops; }
 	Material* getMaterial() const { return m_material; }
 	void setMaterial(const Path& path);
+	// set by `gpu(capacity)` in the script, particles live in a ring buffer of `capacity` on GPU
+	bool isGPUSimulated() const { return m_gpu_capacity != 0; }
+	u32 getGPUCapacity() const { return m_gpu_capacity; }
+	void setGPUCapacity(u32 capacity) { m_gpu_capacity = capacity; }
+	// particles per second emitted by GPU simulated emitters, set by `emitRate(rate)` in the script
+	float getEmitRate() const { return m_emit_rate; }
+	void setEmitRate(float rate) { m_emit_rate = rate; }
+	gpu::ProgramHandle getGPUProgram(GPUPass pass) const { return m_gpu_programs[(int)pass]; }
+	Renderer& getRenderer() const { return m_renderer; }
 
 private:
+	bool lower(int offset, Array<Op>& ops) const;
+	bool generateComputeShader(OutputMemoryStream& src) const;
+	void createGPUPrograms();
+
 	OutputMemoryStream m_bytecode;
+	Array<Op> m_update_ops;
+	Array<Op> m_output_ops;
 	int m_emit_byte_offset;
 	int m_output_byte_offset;
 	int m_channels_count;
 	int m_registers_count;
 	int m_outputs_count;
 	Material* m_material;
+	Renderer& m_renderer;
+	u32 m_gpu_capacity = 0;
+	float m_emit_rate = 0;
+	gpu::ProgramHandle m_gpu_programs[(int)GPUPass::COUNT] = { gpu::INVALID_PROGRAM, gpu::INVALID_PROGRAM, gpu::INVALID_PROGRAM };
 };
 
 
@@ -55,12 +105,31 @@ struct ResourceManagerHub;
 struct LUMIX_RENDERER_API ParticleEmitter
 {
 public:
+	// snapshot of a GPU simulated emitter, handed to the render thread
+	struct GPUSimulation
+	{
+		gpu::BufferHandle channels = gpu::INVALID_BUFFER;
+		gpu::BufferHandle output = gpu::INVALID_BUFFER;
+		gpu::ProgramHandle programs[(int)ParticleEmitterResource::GPUPass::COUNT] = { gpu::INVALID_PROGRAM, gpu::INVALID_PROGRAM, gpu::INVALID_PROGRAM };
+		u32 capacity = 0;
+		u32 first_emitted = 0;
+		u32 emit_count = 0;
+		u32 update_count = 0; // particles alive before this frame's emit
+		u32 alive = 0;
+		u32 seed = 0;
+		float dt = 0;
+	};
+
 	ParticleEmitter(EntityPtr entity, IAllocator& allocator);
 	~ParticleEmitter();
 
 	void serialize(IOutputStream& blob);
 	void deserialize(IInputStream& blob, ResourceManagerHub& manager);
 	void update(float dt);
+	// thread safe, emitters can be simulated in parallel
+	void simulate(float dt);
+	// emits particles requested by simulate, uses global random generator so it's not thread safe
+	void applyEmits();
 	void emit(const float* args);
 	void fillInstanceData(const DVec3& cam_pos, float* data);
 	int getInstanceDataSizeBytes() const;
@@ -68,6 +137,10 @@ public:
 	void setResource(ParticleEmitterResource* res);
 	int getInstancesCount() const { return m_instances_count; }
 	float* getChannelData(int idx) const { return m_channels[idx].data; }
+	bool isGPUSimulated() const { return m_resource && m_resource->isReady() && m_resource->isGPUSimulated(); }
+	const GPUSimulation& getGPUSimulation() const { return m_gpu; }
+	// render thread, `ub` must be bound to uniform buffer binding 4, returns false if nothing was dispatched
+	static bool dispatch(const GPUSimulation& sim, ParticleEmitterResource::GPUPass pass, const DVec3& cam_pos, gpu::BufferHandle ub);
 	
 	EntityPtr m_entity;
 
@@ -84,9 +157,17 @@ private:
 		float value = 0;
 	};
 
+	// [offset, offset + count) of particles, both multiples of 4
+	static constexpr u32 SIMULATION_RANGE_SIZE = 16 * 1024;
+
+	void simulate(float dt, u32 offset, u32 count);
+	// output is nullptr for programs without outputs
+	void run(const Array<ParticleEmitterResource::Op>& ops, u32 offset, u32 count, float* output);
 	void execute(InputMemoryStream& blob, int particle_index);
 	void kill(int particle_index);
 	float readSingleValue(InputMemoryStream& blob) const;
+	void updateGPUSimulation();
+	void destroyGPUBuffers();
 
 	IAllocator& m_allocator;
 	OutputMemoryStream m_emit_buffer;
@@ -96,6 +177,10 @@ private:
 	int m_particles_count = 0;
 	int m_instances_count = 0;
 	ParticleEmitterResource* m_resource = nullptr;
+	GPUSimulation m_gpu;
+	u32 m_gpu_head = 0;
+	u32 m_gpu_requested = 0;
+	float m_gpu_emit_accum = 0;
 };
 
 
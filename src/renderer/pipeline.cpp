@@ -5,6 +5,7 @@
 #include "engine/engine.h"
 #include "engine/file_system.h"
 #include "engine/geometry.h"
+#include "engine/hash_map.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
@@ -21,6 +22,7 @@
 #include "font.h"
 #include "material.h"
 #include "model.h"
+#include "occlusion_buffer.h"
 #include "particle_system.h"
 #include "pipeline.h"
 #include "pose.h"
@@ -254,6 +256,8 @@ struct MTBucketArray
 
 static const float SHADOW_CAM_NEAR = 50.0f;
 static const float SHADOW_CAM_FAR = 5000.0f;
+static const float RENDER_SCALE_STEP = 0.05f;
+static const i32 MAX_RENDER_SCALE_STEPS = 10;
 
 
 ResourceType PipelineResource::TYPE("pipeline");
@@ -291,6 +295,414 @@ struct alignas(4096) CmdPage
 };
 
 
+// command in CmdPage, not a renderable type, draws meshes culled by gpu_cull.shd
+static constexpr RenderableTypes INDIRECT_MESH_COMMAND = RenderableTypes::COUNT;
+// skinned meshes playing a baked animation, instanced, see RenderScene::createBakedAnimation
+static constexpr RenderableTypes BAKED_SKINNED_COMMAND = RenderableTypes(u32(RenderableTypes::COUNT) + 1);
+
+
+// instance of BAKED_SKINNED_COMMAND, matches standard.shd
+struct BakedInstanceData
+{
+	Quat rot;
+	Vec3 pos;
+	float scale;
+	u32 first_frame;
+	u32 frames_count;
+	float fps;
+	float time_offset;
+};
+
+
+// DrawElementsIndirectCommand followed by data used by gpu_cull.shd
+struct IndirectCommand
+{
+	u32 indices_count;
+	u32 instances_count;
+	u32 first_index;
+	u32 base_vertex;
+	u32 base_instance;
+	u32 first_culled;
+	u32 padding[2];
+};
+
+
+// matches Bounds in gpu_cull.shd, negative radius for commands drawing whole meshes
+struct GPUCullBounds
+{
+	Vec3 center;
+	float radius;
+	Vec3 cone_axis;
+	float cone_cutoff;
+};
+
+
+// instances of models with many commands are split to chunks of this size, so each gpu thread culls a few of them
+static constexpr u32 GPU_CULL_MAX_INSTANCE_COMMANDS = 64;
+
+
+struct GPUCullInstance
+{
+	Quat rot;
+	Vec3 pos_hi;
+	float scale;
+	Vec3 pos_lo;
+	float radius;
+	u32 first_command;
+	u32 commands_count;
+	u32 padding[2];
+};
+
+
+struct GPUCullState
+{
+	Vec4 planes[(int)Frustum::Planes::COUNT];
+	Vec4 camera_hi;
+	Vec4 camera_lo;
+	u32 instances_count;
+	u32 padding[3];
+};
+
+
+// froxels the view is split into, local lights are assigned to them by light_clusters.shd
+static constexpr u32 LIGHT_CLUSTERS_X = 16;
+static constexpr u32 LIGHT_CLUSTERS_Y = 9;
+static constexpr u32 LIGHT_CLUSTERS_Z = 24;
+static constexpr u32 LIGHT_CLUSTERS_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+// matches MAX_CLUSTER_LIGHTS in light_clusters.glsl
+static constexpr u32 MAX_CLUSTER_LIGHTS = 127;
+
+
+// matches Drawcall in light_clusters.glsl
+struct LightClusterState
+{
+	u32 grid[4];
+	Vec4 depth;
+	u32 first_light[4];
+};
+
+
+// model instances with LODs or skinning are always culled on CPU
+static bool isGPUCullable(const ModelInstance& mi)
+{
+	return mi.flags.isSet(ModelInstance::STATIC) && !mi.model->isLODStreamed();
+}
+
+
+// static instances do not move, so what they render to a shadowmap can be reused in later frames
+static bool isShadowCacheable(const ModelInstance& mi)
+{
+	return mi.flags.isSet(ModelInstance::STATIC) && !mi.model->isSkinned();
+}
+
+
+// static casters rendered to a cascade are valid while all of this stays the same
+struct ShadowCacheKey
+{
+	bool operator ==(const ShadowCacheKey& rhs) const {
+		return valid && rhs.valid
+			&& center.x == rhs.center.x && center.y == rhs.center.y && center.z == rhs.center.z
+			&& light_rot.x == rhs.light_rot.x && light_rot.y == rhs.light_rot.y && light_rot.z == rhs.light_rot.z && light_rot.w == rhs.light_rot.w
+			&& radius == rhs.radius
+			&& static_version == rhs.static_version
+			&& texture.value == rhs.texture.value;
+	}
+
+	bool valid = false;
+	DVec3 center;
+	Quat light_rot;
+	float radius;
+	u32 static_version;
+	gpu::TextureHandle texture = gpu::INVALID_TEXTURE;
+};
+
+
+// square power of two tiles of the local lights' shadow atlas, quadtree in which a node is free, split in four or used
+struct ShadowAtlas
+{
+	// level 0 is the whole atlas
+	static constexpr u32 LEVELS = 6;
+	static constexpr u32 NODES_COUNT = 1365;
+
+	enum class Node : u8 {
+		FREE,
+		SPLIT,
+		USED
+	};
+
+	void init(u32 atlas_size) {
+		size = atlas_size;
+		memset(nodes, 0, sizeof(nodes));
+	}
+
+	// returns -1 if there's no free tile of the level
+	i32 alloc(u32 level) { return alloc(0, 0, level); }
+
+	i32 alloc(i32 node, u32 node_level, u32 level) {
+		if (nodes[node] == Node::USED) return -1;
+		if (node_level == level) {
+			if (nodes[node] != Node::FREE) return -1;
+			nodes[node] = Node::USED;
+			return node;
+		}
+		const bool was_free = nodes[node] == Node::FREE;
+		nodes[node] = Node::SPLIT;
+		for (i32 i = 0; i < 4; ++i) {
+			const i32 res = alloc(node * 4 + 1 + i, node_level + 1, level);
+			if (res >= 0) return res;
+		}
+		if (was_free) nodes[node] = Node::FREE;
+		return -1;
+	}
+
+	void free(i32 node) {
+		ASSERT(nodes[node] == Node::USED);
+		nodes[node] = Node::FREE;
+		while (node > 0) {
+			const i32 parent = (node - 1) / 4;
+			for (i32 i = 0; i < 4; ++i) {
+				if (nodes[parent * 4 + 1 + i] != Node::FREE) return;
+			}
+			nodes[parent] = Node::FREE;
+			node = parent;
+		}
+	}
+
+	// in texels
+	void getRect(i32 node, u32& x, u32& y, u32& tile_size) const {
+		u8 path[LEVELS];
+		u32 depth = 0;
+		for (; node > 0; node = (node - 1) / 4) path[depth++] = u8((node - 1) % 4);
+		x = y = 0;
+		tile_size = size;
+		while (depth > 0) {
+			const u8 child = path[--depth];
+			tile_size /= 2;
+			x += (child & 1) * tile_size;
+			y += (child >> 1) * tile_size;
+		}
+	}
+
+	u32 size = 0;
+	Node nodes[NODES_COUNT];
+};
+static_assert(ShadowAtlas::NODES_COUNT == ((1 << (2 * ShadowAtlas::LEVELS)) - 1) / 3, "Wrong nodes count");
+
+
+// same order and axes as in getLocalShadow in clustered_lights.shd, faces are in 3x2 grid in the light's tile
+static const Vec3 LOCAL_SHADOW_FACES[6][2] = {
+	{ Vec3(1, 0, 0), Vec3(0, 1, 0) },
+	{ Vec3(-1, 0, 0), Vec3(0, 1, 0) },
+	{ Vec3(0, 1, 0), Vec3(0, 0, 1) },
+	{ Vec3(0, -1, 0), Vec3(0, 0, 1) },
+	{ Vec3(0, 0, 1), Vec3(0, 1, 0) },
+	{ Vec3(0, 0, -1), Vec3(0, 1, 0) }
+};
+// getClosestShadowcastingPointLights returns at most 16 lights
+static constexpr u32 MAX_LOCAL_SHADOWS = 16;
+
+
+// gpu copy of static model instances, rebuilt when the scene changes them
+struct StaticInstances
+{
+	// a mesh with meshlets has a command per meshlet, all drawn by one multi draw
+	struct Draw {
+		const Mesh* mesh;
+		u32 first_command;
+		u32 commands_count;
+	};
+
+	StaticInstances(IAllocator& allocator)
+		: draws(allocator)
+		, commands(allocator)
+	{}
+
+	u32 version = 0xffFFffFF;
+	u32 instances_count = 0;
+	Array<Draw> draws;
+	Array<IndirectCommand> commands;
+	gpu::BufferHandle instances_buffer = gpu::INVALID_BUFFER;
+	gpu::BufferHandle commands_buffer = gpu::INVALID_BUFFER;
+	gpu::BufferHandle bounds_buffer = gpu::INVALID_BUFFER;
+	gpu::BufferHandle culled_buffer = gpu::INVALID_BUFFER;
+};
+
+
+// framebuffer set by setRenderTargets, commands drawing to other targets restore it
+struct RenderTargets
+{
+	void bind() const {
+		gpu::setFramebuffer(const_cast<gpu::TextureHandle*>(rbs), count, flags);
+		gpu::viewport(0, 0, w, h);
+	}
+
+	gpu::TextureHandle rbs[16];
+	u32 flags = 0;
+	u32 count = 0;
+	u32 w = 0;
+	u32 h = 0;
+};
+
+
+// virtual texture of a terrain, its pages are the splat and detail layers blended by terrain.shd,
+// composited into an atlas when the feedback written by visible pixels asks for them
+static constexpr u32 TERRAIN_VT_PAGE_TEXELS = 128;
+// so bilinear filtering does not need neighbouring pages
+static constexpr u32 TERRAIN_VT_BORDER = 4;
+static constexpr u32 TERRAIN_VT_SLOT_TEXELS = TERRAIN_VT_PAGE_TEXELS + 2 * TERRAIN_VT_BORDER;
+// per side of the atlas
+static constexpr u32 TERRAIN_VT_ATLAS_SLOTS = 16;
+// in mip 0, number of pages per side is limited by TERRAIN_VT_MAX_PAGES
+static constexpr float TERRAIN_VT_TEXELS_PER_UNIT = 32;
+static constexpr u32 TERRAIN_VT_MAX_PAGES = 256;
+static constexpr u32 TERRAIN_VT_MAX_COMPOSITES_PER_FRAME = 8;
+// feedback is read back when its buffer is reused, so the gpu is done with it and readback does not stall
+static constexpr u32 TERRAIN_VT_FEEDBACK_BUFFERS = 3;
+static constexpr u32 TERRAIN_VT_MAX_UNUSED_FRAMES = 300;
+
+
+// render thread only
+struct TerrainVirtualTexture
+{
+	static constexpr u32 INVALID_PAGE = 0xffFFffFF;
+
+	struct Slot {
+		u32 page = INVALID_PAGE;
+		u32 last_used = 0;
+		u32 mip;
+		u32 x;
+		u32 y;
+	};
+
+	// matches Drawcall in terrain.shd with VT_COMPOSITE
+	struct CompositeUB {
+		Vec4 page_uv;
+		Vec4 terrain_scale;
+		Vec2 hm_size;
+		float padding[2];
+	};
+
+	TerrainVirtualTexture(IAllocator& allocator)
+		: resident(allocator)
+		, feedback(allocator)
+		, zeros(allocator)
+	{}
+
+	void create(const Vec2& size) {
+		hm_size = size;
+		const float texels = maximum(size.x, size.y) * TERRAIN_VT_TEXELS_PER_UNIT;
+		pages = 1;
+		mips = 1;
+		while (pages < TERRAIN_VT_MAX_PAGES && pages * TERRAIN_VT_PAGE_TEXELS < texels) {
+			pages *= 2;
+			++mips;
+		}
+		u32 bits = 0;
+		for (u32 i = 0; i < mips; ++i) bits += (pages >> i) * (pages >> i);
+		feedback.resize((bits + 31) / 32);
+		zeros.resize(maximum(pages * pages, feedback.size()));
+		memset(zeros.begin(), 0, zeros.size() * sizeof(zeros[0]));
+
+		const u32 atlas_size = TERRAIN_VT_ATLAS_SLOTS * TERRAIN_VT_SLOT_TEXELS;
+		const u32 clamp_flags = (u32)gpu::TextureFlags::CLAMP_U | (u32)gpu::TextureFlags::CLAMP_V;
+		albedo = gpu::allocTextureHandle();
+		normal = gpu::allocTextureHandle();
+		page_table = gpu::allocTextureHandle();
+		gpu::createTexture(albedo, atlas_size, atlas_size, 1, gpu::TextureFormat::SRGBA, clamp_flags | (u32)gpu::TextureFlags::NO_MIPS, nullptr, "terrain_vt_albedo");
+		gpu::createTexture(normal, atlas_size, atlas_size, 1, gpu::TextureFormat::RGBA8, clamp_flags | (u32)gpu::TextureFlags::NO_MIPS, nullptr, "terrain_vt_normal");
+		gpu::createTexture(page_table, pages, pages, 1, gpu::TextureFormat::RGBA8, clamp_flags | (u32)gpu::TextureFlags::POINT_FILTER, nullptr, "terrain_vt_page_table");
+		for (gpu::BufferHandle& buffer : feedback_buffers) {
+			buffer = gpu::allocBufferHandle();
+			gpu::createBuffer(buffer, 0, feedback.size() * sizeof(feedback[0]), zeros.begin());
+		}
+		flush();
+	}
+
+	void destroy() {
+		gpu::destroy(albedo);
+		gpu::destroy(normal);
+		gpu::destroy(page_table);
+		for (gpu::BufferHandle buffer : feedback_buffers) gpu::destroy(buffer);
+	}
+
+	// content of the terrain changed, all pages must be composited again
+	void flush() {
+		for (u32 i = 0; i < mips; ++i) {
+			gpu::update(page_table, i, 0, 0, pages >> i, pages >> i, gpu::TextureFormat::RGBA8, zeros.begin());
+		}
+		for (Slot& slot : slots) slot = Slot();
+		resident.clear();
+	}
+
+	u32 getPage(u32 mip, u32 x, u32 y) const {
+		u32 page = 0;
+		for (u32 i = 0; i < mip; ++i) page += (pages >> i) * (pages >> i);
+		return page + x + y * (pages >> mip);
+	}
+
+	bool isRequested(u32 page) const { return feedback[page >> 5] & (1 << (page & 31)); }
+	void request(u32 page) { feedback[page >> 5] |= 1 << (page & 31); }
+
+	// swaps feedback buffers, parents of requested pages are requested too, so there's always something to sample
+	void readFeedback() {
+		const u32 idx = frame % TERRAIN_VT_FEEDBACK_BUFFERS;
+		const u32 size = feedback.size() * sizeof(feedback[0]);
+		if (frame >= TERRAIN_VT_FEEDBACK_BUFFERS) {
+			gpu::readBuffer(feedback_buffers[idx], Span((u8*)feedback.begin(), size));
+		}
+		else {
+			memset(feedback.begin(), 0, size);
+		}
+		gpu::update(feedback_buffers[idx], zeros.begin(), size);
+		
+		request(getPage(mips - 1, 0, 0));
+		u32 page = 0;
+		for (u32 mip = 0; mip + 1 < mips; ++mip) {
+			const u32 n = pages >> mip;
+			for (u32 y = 0; y < n; ++y) {
+				for (u32 x = 0; x < n; ++x) {
+					if (isRequested(page)) request(getPage(mip + 1, x >> 1, y >> 1));
+					++page;
+				}
+			}
+		}
+	}
+
+	// free slot or the least recently used one not requested this frame, -1 if all are requested
+	i32 findFreeSlot() const {
+		i32 lru = -1;
+		for (i32 i = 0; i < (i32)lengthOf(slots); ++i) {
+			const Slot& slot = slots[i];
+			if (slot.page == INVALID_PAGE) return i;
+			if (slot.last_used == frame) continue;
+			if (lru < 0 || slot.last_used < slots[lru].last_used) lru = i;
+		}
+		return lru;
+	}
+
+	void setPageTable(u32 mip, u32 x, u32 y, u32 value) {
+		gpu::update(page_table, mip, x, y, 1, 1, gpu::TextureFormat::RGBA8, &value);
+	}
+
+	Vec2 hm_size;
+	u32 pages = 0;
+	u32 mips = 0;
+	// incremented each time the terrain is drawn with the virtual texture
+	u32 frame = 0;
+	u32 last_used_frame = 0;
+	u32 textures_hash = 0;
+	u32 splatmap_version = 0;
+	Slot slots[TERRAIN_VT_ATLAS_SLOTS * TERRAIN_VT_ATLAS_SLOTS];
+	// page -> slot
+	HashMap<u32, u32> resident;
+	Array<u32> feedback;
+	Array<u32> zeros;
+	gpu::TextureHandle albedo;
+	gpu::TextureHandle normal;
+	gpu::TextureHandle page_table;
+	gpu::BufferHandle feedback_buffers[TERRAIN_VT_FEEDBACK_BUFFERS];
+};
+
 struct PipelineImpl final : Pipeline
 {
 	PipelineImpl(Renderer& renderer, PipelineResource* resource, const char* define, IAllocator& allocator)
@@ -298,19 +710,31 @@ struct PipelineImpl final : Pipeline
 		, m_renderer(renderer)
 		, m_resource(resource)
 		, m_lua_state(nullptr)
+		, m_recorded_functions(allocator)
 		, m_custom_commands_handlers(allocator)
 		, m_define(define)
 		, m_scene(nullptr)
 		, m_draw2d(allocator)
 		, m_output(-1)
 		, m_renderbuffers(allocator)
+		, m_virtual_renderbuffers(allocator)
+		, m_renderbuffer_aliases(allocator)
 		, m_shaders(allocator)
+		, m_static_instances(allocator)
+		, m_local_shadows(allocator)
+		, m_bone_palettes(allocator)
+		, m_terrain_vts(allocator)
+		, m_debug_triangles(allocator)
+		, m_debug_lines(allocator)
 	{
 		m_viewport.w = m_viewport.h = 800;
 		ResourceManagerHub& rm = renderer.getEngine().getResourceManager();
 		m_draw2d_shader = rm.load<Shader>(Path("pipelines/draw2d.shd"));
 		m_debug_shape_shader = rm.load<Shader>(Path("pipelines/debug_shape.shd"));
 		m_text_mesh_shader = rm.load<Shader>(Path("pipelines/text_mesh.shd"));
+		m_gpu_cull_shader = rm.load<Shader>(Path("pipelines/gpu_cull.shd"));
+		m_light_clusters_shader = rm.load<Shader>(Path("pipelines/light_clusters.shd"));
+		m_skinning_shader = rm.load<Shader>(Path("pipelines/skinning.shd"));
 		m_default_cubemap = rm.load<Texture>(Path("textures/common/default_probe.dds"));
 
 		m_draw2d.clear({1, 1});
@@ -346,6 +770,23 @@ struct PipelineImpl final : Pipeline
 		const Renderer::MemRef ib_mem = m_renderer.copy(cube_indices, sizeof(cube_indices));
 		m_cube_ib = m_renderer.createBuffer(ib_mem, (u32)gpu::BufferFlags::IMMUTABLE);
 
+		// vertex index is x + y * (TERRAIN_PATCH_CELLS + 1), terrain.shd computes the position from it
+		const Renderer::MemRef grid_mem = m_renderer.allocate(TERRAIN_PATCH_CELLS * TERRAIN_PATCH_CELLS * 6 * sizeof(u16));
+		u16* grid_indices = (u16*)grid_mem.data;
+		for (u16 y = 0; y < TERRAIN_PATCH_CELLS; ++y) {
+			for (u16 x = 0; x < TERRAIN_PATCH_CELLS; ++x) {
+				const u16 i00 = x + y * (TERRAIN_PATCH_CELLS + 1);
+				const u16 i01 = i00 + TERRAIN_PATCH_CELLS + 1;
+				*grid_indices++ = i00;
+				*grid_indices++ = i01;
+				*grid_indices++ = i00 + 1;
+				*grid_indices++ = i00 + 1;
+				*grid_indices++ = i01;
+				*grid_indices++ = i01 + 1;
+			}
+		}
+		m_terrain_grid_ib = m_renderer.createBuffer(grid_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+
 		m_resource->onLoaded<&PipelineImpl::onStateChanged>(this);
 
 		GlobalState global_state;
@@ -360,6 +801,9 @@ struct PipelineImpl final : Pipeline
 		const u32 dc_ub_flags = (u32)gpu::BufferFlags::UNIFORM_BUFFER;
 		m_drawcall_ub = m_renderer.createBuffer(dc_mem, dc_ub_flags);
 
+		const Renderer::MemRef cull_ub_mem = { sizeof(GPUCullState), nullptr, false };
+		m_gpu_cull_ub = m_renderer.createBuffer(cull_ub_mem, (u32)gpu::BufferFlags::UNIFORM_BUFFER);
+
 		m_base_vertex_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0);
 		m_base_vertex_decl.addAttribute(1, 12, 4, gpu::AttributeType::U8, gpu::Attribute::NORMALIZED);
 
@@ -372,6 +816,11 @@ struct PipelineImpl final : Pipeline
 		m_2D_decl.addAttribute(1, 8, 2, gpu::AttributeType::FLOAT, 0);
 		m_2D_decl.addAttribute(2, 16, 4, gpu::AttributeType::U8, gpu::Attribute::NORMALIZED);
 
+		m_2D_bindless_decl.addAttribute(0, 0, 2, gpu::AttributeType::FLOAT, 0);
+		m_2D_bindless_decl.addAttribute(1, 8, 2, gpu::AttributeType::FLOAT, 0);
+		m_2D_bindless_decl.addAttribute(2, 16, 4, gpu::AttributeType::U8, gpu::Attribute::NORMALIZED);
+		m_2D_bindless_decl.addAttribute(3, 20, 2, gpu::AttributeType::I16, gpu::Attribute::AS_INT);
+
 		m_3D_pos_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0);
 
 		m_text_mesh_decl.addAttribute(0, 0, 3, gpu::AttributeType::FLOAT, 0);
@@ -395,10 +844,14 @@ struct PipelineImpl final : Pipeline
 		m_renderer.frame();
 		m_renderer.frame();
 		m_renderer.frame();
+		releaseSharedCull();
 
 		m_draw2d_shader->getResourceManager().unload(*m_draw2d_shader);
 		m_debug_shape_shader->getResourceManager().unload(*m_debug_shape_shader);
 		m_text_mesh_shader->getResourceManager().unload(*m_text_mesh_shader);
+		m_gpu_cull_shader->getResourceManager().unload(*m_gpu_cull_shader);
+		m_light_clusters_shader->getResourceManager().unload(*m_light_clusters_shader);
+		m_skinning_shader->getResourceManager().unload(*m_skinning_shader);
 		m_default_cubemap->getResourceManager().unload(*m_default_cubemap);
 
 		for(ShaderRef& shader : m_shaders) {
@@ -407,10 +860,23 @@ struct PipelineImpl final : Pipeline
 		if (m_resource) m_resource->getResourceManager().unload(*m_resource);
 
 		m_renderer.destroy(m_cube_ib);
+		m_renderer.destroy(m_terrain_grid_ib);
 		m_renderer.destroy(m_cube_vb);
 		m_renderer.destroy(m_global_state_buffer);
 		m_renderer.destroy(m_pass_state_buffer);
 		m_renderer.destroy(m_drawcall_ub);
+		m_renderer.destroy(m_gpu_cull_ub);
+		if (m_skinned_vb.isValid()) m_renderer.destroy(m_skinned_vb);
+		if (m_draw2d_textures.isValid()) m_renderer.destroy(m_draw2d_textures);
+		if (m_light_clusters_buffer.isValid()) m_renderer.destroy(m_light_clusters_buffer);
+		for (TerrainVirtualTexture* vt : m_terrain_vts) {
+			m_renderer.runInRenderThread(vt, [](Renderer& renderer, void* ptr){
+				TerrainVirtualTexture* vt = (TerrainVirtualTexture*)ptr;
+				vt->destroy();
+				LUMIX_DELETE(renderer.getAllocator(), vt);
+			});
+		}
+		destroyStaticInstanceBuffers();
 
 		clearBuffers();
 		MTBucketArray<u64>::cleanupArrays();
@@ -444,6 +910,16 @@ struct PipelineImpl final : Pipeline
 		{
 			luaL_unref(m_renderer.getEngine().getState(), LUA_REGISTRYINDEX, m_lua_thread_ref);
 			luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_lua_env);
+			for (const RecordedFunction& f : m_recorded_functions) {
+				luaL_unref(m_lua_state, LUA_REGISTRYINDEX, f.original_ref);
+				luaL_unref(m_lua_state, LUA_REGISTRYINDEX, f.trampoline_ref);
+			}
+			m_recorded_functions.clear();
+			resetTape();
+			luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_tape_ref_meta);
+			luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_tape_resolve_meta);
+			m_tape_ref_meta = m_tape_resolve_meta = LUA_NOREF;
+			m_compiled = false;
 			m_lua_state = nullptr;
 		}
 	}
@@ -571,6 +1047,7 @@ struct PipelineImpl final : Pipeline
 
 	void clearBuffers() {
 		PROFILE_FUNCTION();
+		planRenderbufferAliasing();
 		for (Renderbuffer& rb : m_renderbuffers) {
 			++rb.frame_counter;
 		}
@@ -623,11 +1100,31 @@ struct PipelineImpl final : Pipeline
 				split_distances[slice + 1]);
 
 			const Sphere frustum_bounding_sphere = camera_frustum.computeBoundingSphere();
-			const float bb_size = frustum_bounding_sphere.radius;
+			float bb_size = frustum_bounding_sphere.radius;
 			const Vec3 light_forward = light_mtx.getZVector();
 
 			Vec3 shadow_cam_pos = frustum_bounding_sphere.position;
-			shadow_cam_pos = shadowmapTexelAlign(shadow_cam_pos, 0.5f * shadowmap_width - 2, bb_size, light_mtx);
+			ShadowCacheKey& cache_key = m_shadow_cache_keys[slice];
+			cache_key.valid = slice >= lengthOf(m_shadow_camera_params) - (int)m_cached_shadow_slices && bb_size > 0;
+			if (cache_key.valid) {
+				// cached cascades snap to a coarse grid in world space, so they change only after the camera moves
+				// by a quarter of the cascade; the margin keeps the camera frustum inside the cascade between snaps
+				const double step = bb_size * 0.25;
+				bb_size *= 1.25f;
+				const Quat light_rot = light.isValid() ? universe.getRotation((EntityRef)light) : Quat::IDENTITY;
+				DVec3 light_space = light_rot.conjugated().rotate(m_viewport.pos + frustum_bounding_sphere.position);
+				light_space.x = floor(light_space.x / step + 0.5) * step;
+				light_space.y = floor(light_space.y / step + 0.5) * step;
+				light_space.z = floor(light_space.z / step + 0.5) * step;
+				cache_key.center = light_rot.rotate(light_space);
+				cache_key.light_rot = light_rot;
+				cache_key.radius = bb_size;
+				cache_key.static_version = m_scene->getStaticModelInstancesVersion();
+				shadow_cam_pos = (cache_key.center - m_viewport.pos).toFloat();
+			}
+			else {
+				shadow_cam_pos = shadowmapTexelAlign(shadow_cam_pos, 0.5f * shadowmap_width - 2, bb_size, light_mtx);
+			}
 
 			Matrix projection_matrix;
 			projection_matrix.setOrtho(-bb_size, bb_size, -bb_size, bb_size, SHADOW_CAM_NEAR, SHADOW_CAM_FAR, gpu::isHomogenousDepth(), true);
@@ -687,6 +1184,9 @@ struct PipelineImpl final : Pipeline
 		}
 
 		clearBuffers();
+		m_gpu_culling_used = false;
+		updateRenderScale();
+		if (m_scene && !only_2d) m_scene->updateGrass(m_viewport.pos);
 
 		{
 			PROFILE_BLOCK("destroy renderbuffers");
@@ -712,8 +1212,8 @@ struct PipelineImpl final : Pipeline
 		global_state.camera_view_projection = projection * view;
 		global_state.camera_inv_view_projection = global_state.camera_view_projection.inverted();
 		global_state.time = m_timer.getTimeSinceStart();
-		global_state.framebuffer_size.x = m_viewport.w;
-		global_state.framebuffer_size.y = m_viewport.h;
+		global_state.framebuffer_size.x = int(getRenderScale() * m_viewport.w + 0.5f);
+		global_state.framebuffer_size.y = int(getRenderScale() * m_viewport.h + 0.5f);
 		global_state.cam_world_pos = Vec4(m_viewport.pos.toFloat(), 1);
 
 		if(m_scene) {
@@ -730,8 +1230,11 @@ struct PipelineImpl final : Pipeline
 			}
 		}
 
+		releaseSharedCull();
+		m_bone_palettes.clear();
 		if (!only_2d) {
 			prepareShadowCameras(global_state);
+			if (m_scene) startSharedCull(true);
 		}
 
 		struct StartPipelineJob : Renderer::RenderJob {
@@ -742,6 +1245,12 @@ struct PipelineImpl final : Pipeline
 				gpu::bindUniformBuffer(1, pass_state_buffer, sizeof(PassState));
 				gpu::bindUniformBuffer(4, pipeline->m_drawcall_ub, 32 * 1024);
 				pipeline->m_stats = {};
+				pipeline->m_skinned_vb_ready = false;
+				if (skinned_vertices) {
+					// all setups of the frame are finished, so every pass' skinned meshes are known
+					pipeline->dispatchSkinning(*skinned_vertices, skinning_program);
+					LUMIX_DELETE(pipeline->m_allocator, skinned_vertices);
+				}
 			}
 			void setup() override {}
 
@@ -750,9 +1259,21 @@ struct PipelineImpl final : Pipeline
 			PipelineImpl* pipeline;
 			GlobalState global_state;
 			PassState pass_state;
+			SkinnedVertices* skinned_vertices;
+			gpu::ProgramHandle skinning_program;
 		};
 
+		m_skinned_vertices = nullptr;
+		gpu::ProgramHandle skinning_program = gpu::INVALID_PROGRAM;
+		if (m_compute_skinning && m_scene && !only_2d && m_skinning_shader->isReady()) {
+			m_skinned_vertices = LUMIX_NEW(m_allocator, SkinnedVertices)(m_allocator);
+			skinning_program = m_skinning_shader->getProgram(gpu::VertexDecl(), 0);
+		}
+
+		m_global_state = global_state;
 		StartPipelineJob* start_job = LUMIX_NEW(m_renderer.getAllocator(), StartPipelineJob);
+		start_job->skinned_vertices = m_skinned_vertices;
+		start_job->skinning_program = skinning_program;
 		start_job->pipeline = this;
 		start_job->global_state = global_state;
 		start_job->global_state_buffer = m_global_state_buffer;
@@ -772,7 +1293,12 @@ struct PipelineImpl final : Pipeline
 		}
 		{
 			PROFILE_BLOCK("lua pipeline main");
-			LuaWrapper::pcall(m_lua_state, 0, 0);
+			if (!m_compiled) LuaWrapper::pcall(m_lua_state, 0, 0);
+			else if (m_compiled_dirty) recordMain();
+			else {
+				lua_pop(m_lua_state, 1);
+				replayMain();
+			}
 		}
 		lua_pop(m_lua_state, 1);
 
@@ -789,7 +1315,7 @@ struct PipelineImpl final : Pipeline
 		EndPipelineJob* end_job = LUMIX_NEW(m_renderer.getAllocator(), EndPipelineJob);
 		end_job->pipeline = this;
 		m_renderer.queue(end_job, 0);
-		m_renderer.waitForCommandSetup();
+		if (!m_renderer.isPipelinedSetup()) m_renderer.waitForCommandSetup();
 
 		return true;
 	}
@@ -804,9 +1330,7 @@ struct PipelineImpl final : Pipeline
 
 			void setup() override {
 				PROFILE_FUNCTION();
-				const Array<DebugTriangle>& tris = pipeline->m_scene->getDebugTriangles();
-				vb.size = 0;
-				if (tris.size() == 0) return;
+				const Array<DebugTriangle>& tris = pipeline->m_debug_triangles;
 
 				program = pipeline->m_debug_shape_shader->getProgram(pipeline->m_base_vertex_decl, 0);
 				vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * tris.size() * 3);
@@ -819,7 +1343,6 @@ struct PipelineImpl final : Pipeline
 					vertices[3 * i + 2].color = tris[i].color;
 					vertices[3 * i + 2].pos = (tris[i].p2 - viewport_pos).toFloat();
 				}
-				pipeline->m_scene->clearDebugTriangles();
 			}
 
 
@@ -849,8 +1372,8 @@ struct PipelineImpl final : Pipeline
 		};
 
 
-		const Array<DebugTriangle>& tris = m_scene->getDebugTriangles();
-		if (tris.empty() || !m_debug_shape_shader->isReady()) return;
+		m_scene->takeDebugTriangles(m_debug_triangles);
+		if (m_debug_triangles.empty() || !m_debug_shape_shader->isReady()) return;
 
 		IAllocator& allocator = m_renderer.getAllocator();
 		Cmd* cmd = LUMIX_NEW(allocator, Cmd);
@@ -870,9 +1393,7 @@ struct PipelineImpl final : Pipeline
 			void setup() override
 			{
 				PROFILE_FUNCTION();
-				const Array<DebugLine>& lines = pipeline->m_scene->getDebugLines();
-				vb.size = 0;
-				if (lines.size() == 0) return;
+				const Array<DebugLine>& lines = pipeline->m_debug_lines;
 
 				program = pipeline->m_debug_shape_shader->getProgram(pipeline->m_base_vertex_decl, 0);
 				vb = pipeline->m_renderer.allocTransient(sizeof(BaseVertex) * lines.size() * 2);
@@ -883,7 +1404,6 @@ struct PipelineImpl final : Pipeline
 					vertices[2 * i + 1].color = lines[i].color;
 					vertices[2 * i + 1].pos = (lines[i].to - viewport_pos).toFloat();
 				}
-				pipeline->m_scene->clearDebugLines();
 			}
 
 
@@ -913,8 +1433,8 @@ struct PipelineImpl final : Pipeline
 		};
 
 
-		const Array<DebugLine>& lines = m_scene->getDebugLines();
-		if (lines.empty() || !m_debug_shape_shader->isReady()) return;
+		m_scene->takeDebugLines(m_debug_lines);
+		if (m_debug_lines.empty() || !m_debug_shape_shader->isReady()) return;
 
 		IAllocator& allocator = m_renderer.getAllocator();
 		Cmd* cmd = LUMIX_NEW(allocator, Cmd);
@@ -924,8 +1444,70 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	void renderDebugGroups() {
+		struct Cmd : Renderer::RenderJob
+		{
+			struct Group {
+				Matrix mtx;
+				gpu::BufferHandle vertex_buffer;
+				u32 triangles_count;
+				u32 lines_count;
+			};
+
+			Cmd(IAllocator& allocator) : groups(allocator) {}
+
+			void setup() override {
+				program = pipeline->m_debug_shape_shader->getProgram(pipeline->m_base_vertex_decl, 0);
+			}
+
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::pushDebugGroup("debug groups");
+				gpu::useProgram(program);
+				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
+				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+				for (const Group& group : groups) {
+					gpu::update(pipeline->m_drawcall_ub, &group.mtx.m11, sizeof(Matrix));
+					gpu::bindVertexBuffer(0, group.vertex_buffer, 0, 16);
+					if (group.triangles_count > 0) {
+						gpu::setState(u64(gpu::StateFlags::DEPTH_TEST) | u64(gpu::StateFlags::DEPTH_WRITE) | u64(gpu::StateFlags::CULL_BACK));
+						gpu::drawArrays(0, group.triangles_count * 3, gpu::PrimitiveType::TRIANGLES);
+					}
+					if (group.lines_count > 0) {
+						gpu::setState(u64(gpu::StateFlags::DEPTH_TEST) | u64(gpu::StateFlags::DEPTH_WRITE));
+						gpu::drawArrays(group.triangles_count * 3, group.lines_count * 2, gpu::PrimitiveType::LINES);
+					}
+				}
+				gpu::popDebugGroup();
+			}
+
+			PipelineImpl* pipeline;
+			gpu::ProgramHandle program;
+			Array<Group> groups;
+		};
+
+		const Span<const DebugGroup> groups = m_scene->getDebugGroups();
+		if (groups.length() == 0 || !m_debug_shape_shader->isReady()) return;
+
+		IAllocator& allocator = m_renderer.getAllocator();
+		Cmd* cmd = LUMIX_NEW(allocator, Cmd)(allocator);
+		cmd->pipeline = this;
+		cmd->groups.reserve(groups.length());
+		for (const DebugGroup& group : groups) {
+			if (!group.vertex_buffer.isValid()) continue;
+			Cmd::Group& g = cmd->groups.emplace();
+			g.mtx = Matrix::IDENTITY;
+			g.mtx.setTranslation((group.origin - m_viewport.pos).toFloat());
+			g.vertex_buffer = group.vertex_buffer;
+			g.triangles_count = group.triangles_count;
+			g.lines_count = group.lines_count;
+		}
+		m_renderer.queue(cmd, m_profiler_link);
+	}
+
 	void renderDebugShapes()
 	{
+		renderDebugGroups();
 		renderDebugTriangles();
 		renderDebugLines();
 		//renderDebugPoints();
@@ -946,7 +1528,32 @@ struct PipelineImpl final : Pipeline
 
 		struct Cmd : Renderer::RenderJob
 		{
-			Cmd(IAllocator& allocator) : cmd_buffer(allocator) {}
+			// consecutive Draw2D commands merged into one draw call
+			struct Batch {
+				u32 index_offset;
+				u32 indices_count;
+				gpu::TextureHandle texture;
+				Vec2 clip_pos;
+				Vec2 clip_size;
+			};
+
+			// with bindless textures, every vertex knows its texture, so only clip rects split batches
+			struct BindlessVertex {
+				Draw2D::Vertex vertex;
+				i16 texture;
+				// 1 if the texture is the font atlas, i.e. it's a distance field
+				i16 is_atlas;
+			};
+
+			Cmd(IAllocator& allocator) : batches(allocator), textures(allocator), handles(allocator) {}
+
+			u32 getTextureIndex(gpu::TextureHandle texture) {
+				for (i32 i = textures.size() - 1; i >= 0; --i) {
+					if (textures[i].value == texture.value) return i;
+				}
+				textures.push(texture);
+				return textures.size() - 1;
+			}
 
 			void setup()
 			{
@@ -954,59 +1561,132 @@ struct PipelineImpl final : Pipeline
 				size.set((float)pipeline->m_viewport.w, (float)pipeline->m_viewport.h);
 
 				Draw2D& draw2d = pipeline->m_draw2d;
+				bindless = pipeline->m_renderer.isBindless();
+				const Array<Draw2D::Vertex>& vertices = draw2d.getVertices();
+				const Array<u32>& indices = draw2d.getIndices();
+
+				idx_buffer_mem = pipeline->m_renderer.allocTransient(indices.byte_size());
+				memcpy(idx_buffer_mem.ptr, indices.begin(), indices.byte_size());
+				if (bindless) {
+					vtx_buffer_mem = pipeline->m_renderer.allocTransient(vertices.size() * sizeof(BindlessVertex));
+					BindlessVertex* dst = (BindlessVertex*)vtx_buffer_mem.ptr;
+					for (u32 i = 0, c = vertices.size(); i < c; ++i) {
+						dst[i].vertex = vertices[i];
+						dst[i].texture = 0;
+						dst[i].is_atlas = 0;
+					}
+				}
+				else {
+					vtx_buffer_mem = pipeline->m_renderer.allocTransient(vertices.byte_size());
+					memcpy(vtx_buffer_mem.ptr, vertices.begin(), vertices.byte_size());
+				}
 
-				num_indices = draw2d.getIndices().size();
-				num_vertices = draw2d.getVertices().size();
+				for (const Draw2D::Cmd& cmd : draw2d.getCmds()) {
+					if (cmd.indices_count == 0) continue;
+
+					const gpu::TextureHandle texture = cmd.texture && cmd.texture->isValid() ? *cmd.texture : atlas_texture;
+					if (bindless) {
+						const i16 idx = (i16)getTextureIndex(texture);
+						const i16 is_atlas = texture.value == atlas_texture.value ? 1 : 0;
+						BindlessVertex* dst = (BindlessVertex*)vtx_buffer_mem.ptr;
+						for (u32 i = cmd.index_offset, end = cmd.index_offset + cmd.indices_count; i < end; ++i) {
+							dst[indices[i]].texture = idx;
+							dst[indices[i]].is_atlas = is_atlas;
+						}
+					}
+
+					if (!batches.empty()) {
+						Batch& prev = batches.back();
+						const bool same_clip = prev.clip_pos.x == cmd.clip_pos.x
+							&& prev.clip_pos.y == cmd.clip_pos.y
+							&& prev.clip_size.x == cmd.clip_size.x
+							&& prev.clip_size.y == cmd.clip_size.y;
+						if (same_clip && (bindless || prev.texture.value == texture.value) && prev.index_offset + prev.indices_count == cmd.index_offset) {
+							prev.indices_count += cmd.indices_count;
+							continue;
+						}
+					}
 
-				idx_buffer_mem = pipeline->m_renderer.allocTransient(draw2d.getIndices().byte_size());
-				vtx_buffer_mem = pipeline->m_renderer.allocTransient(draw2d.getVertices().byte_size());
-				memcpy(idx_buffer_mem.ptr, draw2d.getIndices().begin(), draw2d.getIndices().byte_size());
-				memcpy(vtx_buffer_mem.ptr, draw2d.getVertices().begin(), draw2d.getVertices().byte_size());
-				cmd_buffer.resize(draw2d.getCmds().size());
-				memcpy(&cmd_buffer[0], draw2d.getCmds().begin(), sizeof(cmd_buffer[0]) * cmd_buffer.size());
+					Batch& batch = batches.emplace();
+					batch.index_offset = cmd.index_offset;
+					batch.indices_count = cmd.indices_count;
+					batch.texture = texture;
+					batch.clip_pos = cmd.clip_pos;
+					batch.clip_size = cmd.clip_size;
+				}
 
 				draw2d.clear(pipeline->getAtlasSize());
 
-				program = pipeline->m_draw2d_shader->getProgram(pipeline->m_2D_decl, 0);
+				if (bindless) {
+					const u32 define_mask = 1 << pipeline->m_renderer.getShaderDefineIdx("BINDLESS");
+					program = pipeline->m_draw2d_shader->getProgram(pipeline->m_2D_bindless_decl, define_mask);
+				}
+				else {
+					program = pipeline->m_draw2d_shader->getProgram(pipeline->m_2D_decl, 0);
+				}
 			}
 
 			void execute()
 			{
 				PROFILE_FUNCTION();
 
-				if (cmd_buffer.empty()) return;
+				if (batches.empty()) return;
 
 				gpu::pushDebugGroup("draw2d");
 
-				gpu::update(pipeline->m_drawcall_ub, &size.x, sizeof(size));
-				u32 elem_offset = 0;
+				struct {
+					Vec2 canvas_size;
+					float is_atlas;
+					float padding;
+				} dc = { size, 0, 0 };
+				gpu::update(pipeline->m_drawcall_ub, &dc, sizeof(dc));
 				const u64 blend_state = gpu::getBlendStateBits(gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA, gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA);
-				gpu::setState(blend_state);
+				gpu::setState((u64)gpu::StateFlags::SCISSOR_TEST | blend_state);
 				gpu::useProgram(program);
 				gpu::bindIndexBuffer(idx_buffer_mem.buffer);
-				gpu::bindVertexBuffer(0, vtx_buffer_mem.buffer, vtx_buffer_mem.offset, 20);
+				gpu::bindVertexBuffer(0, vtx_buffer_mem.buffer, vtx_buffer_mem.offset, bindless ? sizeof(BindlessVertex) : sizeof(Draw2D::Vertex));
 				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
 
-				for (Draw2D::Cmd& cmd : cmd_buffer) {
-					if(cmd.clip_size.x < 0) {
-						gpu::scissor(0, 0, pipeline->m_viewport.w, pipeline->m_viewport.h);
+				if (bindless) {
+					const u32 handles_size = textures.size() * sizeof(u64);
+					if (handles_size > pipeline->m_draw2d_textures_size) {
+						if (pipeline->m_draw2d_textures.isValid()) gpu::destroy(pipeline->m_draw2d_textures);
+						pipeline->m_draw2d_textures_size = nextPow2(handles_size);
+						pipeline->m_draw2d_textures = gpu::allocBufferHandle();
+						gpu::createBuffer(pipeline->m_draw2d_textures, 0, pipeline->m_draw2d_textures_size, nullptr);
+					}
+					handles.resize(textures.size());
+					for (u32 i = 0, c = textures.size(); i < c; ++i) handles[i] = gpu::getBindlessHandle(textures[i]);
+					gpu::update(pipeline->m_draw2d_textures, handles.begin(), handles.byte_size());
+					gpu::bindShaderBuffer(pipeline->m_draw2d_textures, 0);
+				}
+
+				const u32 viewport_w = pipeline->m_viewport.w;
+				const u32 viewport_h = pipeline->m_viewport.h;
+				for (const Batch& batch : batches) {
+					// clip_size is the bottom right corner of the clip rect, negative if there's no clipping
+					if (batch.clip_size.x < 0) {
+						gpu::scissor(0, 0, viewport_w, viewport_h);
 					}
 					else {
-						gpu::scissor(u32(maximum(cmd.clip_pos.x, 0.0f)),
-							u32(maximum(cmd.clip_pos.x, 0.0f)),
-							u32(minimum(cmd.clip_size.x, 65535.0f)),
-							u32(minimum(cmd.clip_size.y, 65535.0f)));
+						const u32 x = u32(clamp(batch.clip_pos.x, 0.f, (float)viewport_w));
+						const u32 y = u32(clamp(batch.clip_pos.y, 0.f, (float)viewport_h));
+						const u32 w = u32(clamp(batch.clip_size.x - batch.clip_pos.x, 0.f, (float)(viewport_w - x)));
+						const u32 h = u32(clamp(batch.clip_size.y - batch.clip_pos.y, 0.f, (float)(viewport_h - y)));
+						gpu::scissor(x, gpu::isOriginBottomLeft() ? viewport_h - y - h : y, w, h);
 					}
-			
-					gpu::TextureHandle texture_id = atlas_texture;
-					if (cmd.texture) texture_id = *cmd.texture;
-					if (!texture_id.isValid()) texture_id = atlas_texture;
-
-					gpu::bindTextures(&texture_id, 0, 1);
-					gpu::drawElements(idx_buffer_mem.offset + elem_offset * sizeof(u32), num_indices, gpu::PrimitiveType::TRIANGLES, gpu::DataType::U32);
 
-					elem_offset += cmd.indices_count;
+					if (!bindless) {
+						const float is_atlas = batch.texture.value == atlas_texture.value ? 1.f : 0.f;
+						if (is_atlas != dc.is_atlas) {
+							dc.is_atlas = is_atlas;
+							gpu::update(pipeline->m_drawcall_ub, &dc, sizeof(dc));
+						}
+						gpu::bindTextures(&batch.texture, 0, 1);
+					}
+					gpu::drawElements(idx_buffer_mem.offset + batch.index_offset * sizeof(u32), batch.indices_count, gpu::PrimitiveType::TRIANGLES, gpu::DataType::U32);
 				}
+				if (bindless) gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0);
 
 				gpu::popDebugGroup();
 			}
@@ -1014,9 +1694,10 @@ struct PipelineImpl final : Pipeline
 			gpu::TextureHandle atlas_texture;
 			Renderer::TransientSlice idx_buffer_mem;
 			Renderer::TransientSlice vtx_buffer_mem;
-			int num_indices;
-			int num_vertices;
-			Array<Draw2D::Cmd> cmd_buffer;
+			Array<Batch> batches;
+			Array<gpu::TextureHandle> textures;
+			Array<u64> handles;
+			bool bindless;
 			Vec2 size;
 			PipelineImpl* pipeline;
 			gpu::ProgramHandle program;
@@ -1034,6 +1715,11 @@ struct PipelineImpl final : Pipeline
 		RenderScene* scene = universe ? (RenderScene*)universe->getScene(crc32("renderer")) : nullptr;
 		if (m_scene == scene) return;
 		m_scene = scene;
+		m_compiled_dirty = true;
+		m_shadow_atlas.init(m_shadow_atlas.size);
+		m_local_shadows.clear();
+		m_static_instances.version = 0xffFFffFF;
+		for (ShadowCacheKey& key : m_shadow_cache) key.valid = false;
 		if (m_lua_state && m_scene) callInitScene();
 	}
 
@@ -1080,17 +1766,76 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	// returned index is valid only in the current frame, the texture can be shared with renderbuffers
+	// created earlier in the frame, if they were not used after this one was created in the last frame
 	int createRenderbuffer(float w, float h, bool relative, const char* format_str, const char* debug_name)
 	{
 		PROFILE_FUNCTION();
+		if (relative) {
+			w *= getRenderScale();
+			h *= getRenderScale();
+		}
 		const u32 rb_w = u32(relative ? w * m_viewport.w + 0.5f : w);
 		const u32 rb_h = u32(relative ? h * m_viewport.h + 0.5f : h);
 		const gpu::TextureFormat format = getFormat(format_str);
 
-		for (int i = 0, n = m_renderbuffers.size(); i < n; ++i)
+		const u32 idx = m_virtual_renderbuffers.size();
+		VirtualRenderbuffer& vrb = m_virtual_renderbuffers.emplace();
+		vrb.width = rb_w;
+		vrb.height = rb_h;
+		vrb.format = format;
+		vrb.first_use = vrb.last_use = ++m_renderbuffer_uses;
+		vrb.physical = -1;
+		vrb.persistent = false;
+		if (idx < (u32)m_renderbuffer_aliases.size() && m_renderbuffer_aliases[idx] >= 0) {
+			const VirtualRenderbuffer& alias = m_virtual_renderbuffers[m_renderbuffer_aliases[idx]];
+			if (alias.width == rb_w && alias.height == rb_h && alias.format == format) vrb.physical = alias.physical;
+		}
+		if (vrb.physical < 0) vrb.physical = allocRenderbuffer(w, h, relative, rb_w, rb_h, format, debug_name, 0);
+		m_renderbuffers[vrb.physical].owner = idx;
+		return idx;
+	}
+
+
+	// keeps its content between frames, found by debug_name, its texture is never shared with other renderbuffers
+	int createPersistentRenderbuffer(float w, float h, const char* format_str, const char* debug_name)
+	{
+		PROFILE_FUNCTION();
+		const u32 rb_w = u32(w);
+		const u32 rb_h = u32(h);
+		const gpu::TextureFormat format = getFormat(format_str);
+		const u32 name_hash = crc32(debug_name);
+
+		const u32 idx = m_virtual_renderbuffers.size();
+		VirtualRenderbuffer& vrb = m_virtual_renderbuffers.emplace();
+		vrb.width = rb_w;
+		vrb.height = rb_h;
+		vrb.format = format;
+		vrb.first_use = ++m_renderbuffer_uses;
+		vrb.last_use = KEEP_RENDERBUFFER;
+		vrb.physical = -1;
+		vrb.persistent = true;
+		for (int i = 0, n = m_renderbuffers.size(); i < n; ++i) {
+			Renderbuffer& rb = m_renderbuffers[i];
+			if (rb.persistent_name != name_hash) continue;
+			if (rb.width != rb_w || rb.height != rb_h || rb.format != format) continue;
+			rb.frame_counter = 0;
+			vrb.physical = i;
+			break;
+		}
+		if (vrb.physical < 0) vrb.physical = allocRenderbuffer(w, h, false, rb_w, rb_h, format, debug_name, name_hash);
+		m_renderbuffers[vrb.physical].owner = idx;
+		return idx;
+	}
+
+
+	int allocRenderbuffer(float w, float h, bool relative, u32 rb_w, u32 rb_h, gpu::TextureFormat format, const char* debug_name, u32 persistent_name)
+	{
+		for (int i = 0, n = m_renderbuffers.size(); persistent_name == 0 && i < n; ++i)
 		{
 			Renderbuffer& rb = m_renderbuffers[i];
 			if (rb.frame_counter == 0) continue;
+			if (rb.persistent_name != 0) continue;
 			if (rb.width != rb_w) continue;
 			if (rb.height != rb_h) continue;
 			if (rb.format != format) continue;
@@ -1106,12 +1851,66 @@ struct PipelineImpl final : Pipeline
 		rb.width = rb_w;
 		rb.height = rb_h;
 		rb.format = format;
+		rb.persistent_name = persistent_name;
 		rb.handle = m_renderer.createTexture(rb_w, rb_h, 1, format, (u32)gpu::TextureFlags::NO_MIPS, {0, 0}, debug_name);
 
 		return m_renderbuffers.size() - 1;
 	}
 
 
+	// every use moves the end of the renderbuffer's lifetime
+	gpu::TextureHandle useRenderbuffer(int idx)
+	{
+		if (idx < 0 || idx >= m_virtual_renderbuffers.size()) {
+			logError("Renderer") << getPath() << ": invalid renderbuffer " << idx;
+			return gpu::INVALID_TEXTURE;
+		}
+		VirtualRenderbuffer& vrb = m_virtual_renderbuffers[idx];
+		if (vrb.last_use != KEEP_RENDERBUFFER) vrb.last_use = ++m_renderbuffer_uses;
+		// pipeline uses renderbuffers differently than in the last frame, this frame might be wrong, next one is planned with correct lifetimes
+		if (m_renderbuffers[vrb.physical].owner != idx) {
+			logWarning("Renderer") << getPath() << ": renderbuffer " << idx << " used after its texture was reused by renderbuffer " << m_renderbuffers[vrb.physical].owner;
+		}
+		return m_renderbuffers[vrb.physical].handle;
+	}
+
+
+	// greedy, each renderbuffer reuses the first texture of the same size and format whose last renderbuffer is not used anymore
+	void planRenderbufferAliasing()
+	{
+		PROFILE_FUNCTION();
+		struct Slot {
+			u32 width;
+			u32 height;
+			gpu::TextureFormat format;
+			u32 last_use;
+			i32 last_renderbuffer;
+		};
+		Array<Slot> slots(m_allocator);
+		m_renderbuffer_aliases.clear();
+		for (i32 i = 0, c = m_virtual_renderbuffers.size(); i < c; ++i) {
+			const VirtualRenderbuffer& vrb = m_virtual_renderbuffers[i];
+			i32 alias = -1;
+			if (vrb.persistent) {
+				m_renderbuffer_aliases.push(alias);
+				continue;
+			}
+			for (Slot& slot : slots) {
+				if (slot.width != vrb.width || slot.height != vrb.height || slot.format != vrb.format) continue;
+				if (slot.last_use >= vrb.first_use) continue;
+				alias = slot.last_renderbuffer;
+				slot.last_use = vrb.last_use;
+				slot.last_renderbuffer = i;
+				break;
+			}
+			if (alias < 0) slots.push({vrb.width, vrb.height, vrb.format, vrb.last_use, i});
+			m_renderbuffer_aliases.push(alias);
+		}
+		m_virtual_renderbuffers.clear();
+		m_renderbuffer_uses = 0;
+	}
+
+
 	static int renderTerrains(lua_State* L)
 	{
 		PROFILE_FUNCTION();
@@ -1137,6 +1936,11 @@ struct PipelineImpl final : Pipeline
 		cmd->m_render_state = state;
 		cmd->m_pipeline = pipeline;
 		cmd->m_camera_params = cp;
+		// only the gbuffer pass samples the virtual texture and writes its feedback
+		Renderer& renderer = pipeline->m_renderer;
+		cmd->m_virtual_texture = (cmd->m_define_mask & (1 << renderer.getShaderDefineIdx("DEFERRED"))) != 0;
+		cmd->m_vt_composite_define_mask = 1 << renderer.getShaderDefineIdx("VT_COMPOSITE");
+		cmd->m_render_targets = pipeline->m_render_targets;
 
 		pipeline->m_renderer.queue(cmd, pipeline->m_profiler_link);
 		return 0;
@@ -1169,7 +1973,7 @@ struct PipelineImpl final : Pipeline
 					byte_size += emitter->getInstanceDataSizeBytes();
 				}
 
-				byte_size += (sizeof(int) * 2 + sizeof(gpu::ProgramHandle) + sizeof(Vec3) + sizeof(Quat)) * emitters.size();
+				byte_size += (sizeof(int) * 2 + sizeof(gpu::ProgramHandle) + sizeof(Vec3) + sizeof(Quat) + sizeof(ParticleEmitter::GPUSimulation)) * emitters.size();
 				m_vb = m_pipeline->m_renderer.allocTransient(byte_size);
 
 				OutputMemoryStream str(m_vb.ptr, m_vb.size);
@@ -1179,8 +1983,10 @@ struct PipelineImpl final : Pipeline
 				for (ParticleEmitter* emitter : emitters) {
 					if (!emitter->getResource() || !emitter->getResource()->isReady()) continue;
 					
-					const int size = emitter->getInstanceDataSizeBytes();
-					if (size == 0) continue;
+					// GPU simulated emitters have no instance data on CPU, they are marked by zero size
+					const bool is_gpu = emitter->isGPUSimulated();
+					const int size = is_gpu ? 0 : emitter->getInstanceDataSizeBytes();
+					if (is_gpu ? emitter->getGPUSimulation().alive == 0 : size == 0) continue;
 
 					const Transform tr = universe.getTransform((EntityRef)emitter->m_entity);
 					const Vec3 lpos = (tr.pos - m_camera_params.pos).toFloat();
@@ -1191,6 +1997,10 @@ struct PipelineImpl final : Pipeline
 					str.write(material->getShader()->getProgram(decl, 0));
 					str.write(size);
 					str.write(emitter->getInstancesCount());
+					if (is_gpu) {
+						str.write(emitter->getGPUSimulation());
+						continue;
+					}
 					float* instance_data = (float*)str.skip(size);
 					emitter->fillInstanceData(m_camera_params.pos, instance_data);
 				}
@@ -1215,7 +2025,14 @@ struct PipelineImpl final : Pipeline
 					const int byte_size = blob.read<int>();
 					const int instances_count = blob.read<int>();
 
-					const u32 offset = (u32)blob.getPosition();
+					gpu::BufferHandle instance_buffer = m_vb.buffer;
+					u32 offset = m_vb.offset + (u32)blob.getPosition();
+					if (byte_size == 0) {
+						const ParticleEmitter::GPUSimulation sim = blob.read<ParticleEmitter::GPUSimulation>();
+						if (!ParticleEmitter::dispatch(sim, ParticleEmitterResource::GPUPass::OUTPUT, m_camera_params.pos, m_pipeline->m_drawcall_ub)) continue;
+						instance_buffer = sim.output;
+						offset = 0;
+					}
 					blob.skip(byte_size);
 
 					Matrix mtx = rot.toMatrix();
@@ -1224,7 +2041,7 @@ struct PipelineImpl final : Pipeline
 					gpu::useProgram(program);
 					gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
 					gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
-					gpu::bindVertexBuffer(1, m_vb.buffer, m_vb.offset + offset, 12);
+					gpu::bindVertexBuffer(1, instance_buffer, offset, 12);
 					gpu::drawTriangleStripArraysInstanced(4, instances_count);
 				}
 				gpu::popDebugGroup();
@@ -1257,36 +2074,377 @@ struct PipelineImpl final : Pipeline
 	};
 	
 
-	static CameraParams checkCameraParams(lua_State* L, int idx)
-	{
-		CameraParams cp;
+	struct BonePalette {
+		gpu::BufferHandle buffer;
+		u32 offset;
+	};
 
-		lua_getfield(L, idx, "view");
-		if (!lua_istable(L, -1)) {
-			lua_pop(L, 1);
-			luaL_error(L, "View matrix is not a table");
-		}
+	// tile of a local light in m_shadow_atlas
+	struct LocalShadow {
+		EntityRef entity;
+		i32 node = -1;
+		// can be bigger than wanted_level if the atlas is full
+		u32 level;
+		u32 wanted_level;
+		// in texels
+		u32 x, y, size;
+		DVec3 pos;
+		Quat rot;
+		float fov;
+		float range;
+		u32 static_version;
+		float importance;
+		u32 rendered_frame = 0;
+		// the tile contains the light's shadow, possibly outdated
+		bool rendered = false;
+		// the light changed since the tile was rendered
+		bool dirty = true;
+		bool used;
+	};
 
-		for (int i = 0; i < 16; ++i) {
-			lua_rawgeti(L, -1, i + 1);
-			if (!LuaWrapper::isType<float>(L, -1)) {
-				lua_pop(L, 2);
-				luaL_error(L, "View matrix must contain exactly 16 floats");
-			}
-			cp.view[i] = LuaWrapper::toType<float>(L, -1);
-			lua_pop(L, 1);
+	// copied to jobs, m_local_shadows can change before the jobs run
+	struct LocalShadowTile {
+		EntityRef entity;
+		// xy = origin, zw = face size, in uv
+		Vec4 rect;
+	};
+
+
+	// 3x4 skinning matrices are computed once per frame for each model instance and shared by all passes
+	BonePalette getBonePalette(EntityRef entity, const ModelInstance& mi)
+	{
+		{
+			MutexGuard lock(m_bone_palettes_mutex);
+			auto iter = m_bone_palettes.find(entity);
+			if (iter.isValid()) return iter.value();
 		}
-		lua_pop(L, 1);
 
-		lua_getfield(L, idx, "projection");
-		if (!lua_istable(L, -1)) {
-			lua_pop(L, 1);
-			luaL_error(L, "Projection matrix is not a table");
+		const Pose& pose = *mi.pose;
+		const Model& model = *mi.model;
+		const Renderer::TransientSlice slice = m_renderer.allocTransient(pose.count * sizeof(Vec4) * 3);
+		ASSERT(pose.count <= Model::Bone::MAX_COUNT);
+		Vec3 bind_pos[Model::Bone::MAX_COUNT];
+		Quat bind_rot[Model::Bone::MAX_COUNT];
+		for (int j = 0, c = pose.count; j < c; ++j) {
+			const Model::Bone& bone = model.getBone(j);
+			bind_pos[j] = bone.inv_bind_transform.pos;
+			bind_rot[j] = bone.inv_bind_transform.rot;
 		}
+		Vec3 bone_pos[Model::Bone::MAX_COUNT];
+		Quat bone_rot[Model::Bone::MAX_COUNT];
+		multiplyTransforms(pose.positions, pose.rotations, bind_pos, bind_rot, bone_pos, bone_rot, pose.count);
+		toMatrices(bone_pos, bone_rot, (Vec4*)slice.ptr, pose.count);
+
+		// another pass could compute the same palette meanwhile, the first one wins
+		MutexGuard lock(m_bone_palettes_mutex);
+		auto iter = m_bone_palettes.find(entity);
+		if (iter.isValid()) return iter.value();
+		const BonePalette palette = {slice.buffer, slice.offset};
+		m_bone_palettes.insert(entity, palette);
+		return palette;
+	}
 
-		for (int i = 0; i < 16; ++i) {
-			lua_rawgeti(L, -1, i + 1);
-			if (!LuaWrapper::isType<float>(L, -1)) {
+
+	// offsets and stride are in u32s, matches skinning.shd
+	struct SkinningLayout {
+		static constexpr u32 MISSING = 0xffFFffFF;
+
+		u32 stride;
+		u32 position;
+		u32 normal;
+		u32 tangent;
+		u32 indices;
+		u32 weights;
+		u32 packed; // bit 0 - normal is snorm8, bit 1 - tangent is snorm8
+		u32 padding = 0;
+	};
+
+
+	// meshes skinned by skinning.shd in one frame, passes draw them as rigid meshes
+	struct SkinnedVertices {
+		struct Mesh {
+			gpu::BufferHandle vertex_buffer;
+			BonePalette bones;
+			SkinningLayout layout;
+			u32 vertex_count;
+			u32 offset;
+		};
+
+		SkinnedVertices(IAllocator& allocator) 
+			: meshes(allocator)
+			, offsets(allocator)
+		{}
+
+		Array<Mesh> meshes;
+		// (entity index << 32 | mesh index) -> offset in m_skinned_vb
+		HashMap<u64, u32> offsets;
+		u32 size = 0;
+		Mutex mutex;
+	};
+
+
+	static bool getSkinningLayout(const Mesh& mesh, SkinningLayout& layout)
+	{
+		const u32 stride = mesh.render_data->vb_stride;
+		if (stride % 4 != 0) return false;
+
+		layout.stride = stride / 4;
+		layout.position = layout.normal = layout.tangent = layout.indices = layout.weights = SkinningLayout::MISSING;
+		layout.packed = 0;
+		for (u32 i = 0; i < mesh.vertex_decl.attributes_count; ++i) {
+			const gpu::Attribute& attr = mesh.vertex_decl.attributes[i];
+			if (attr.byte_offset % 4 != 0) continue;
+			const u32 offset = attr.byte_offset / 4;
+			switch (attr.idx) {
+				case 0:
+					if (attr.type != gpu::AttributeType::FLOAT || attr.components_count != 3) return false;
+					layout.position = offset;
+					break;
+				case 2:
+				case 3: {
+					const bool is_packed = attr.type == gpu::AttributeType::I8 && attr.components_count == 4;
+					if (!is_packed && (attr.type != gpu::AttributeType::FLOAT || attr.components_count != 3)) return false;
+					(attr.idx == 2 ? layout.normal : layout.tangent) = offset;
+					if (is_packed) layout.packed |= attr.idx == 2 ? 1 : 2;
+					break;
+				}
+				case 4:
+					if (attr.type != gpu::AttributeType::I16 || attr.components_count != 4) return false;
+					layout.indices = offset;
+					break;
+				case 5:
+					if (attr.type != gpu::AttributeType::FLOAT || attr.components_count != 4) return false;
+					layout.weights = offset;
+					break;
+			}
+		}
+		return layout.position != SkinningLayout::MISSING
+			&& layout.indices != SkinningLayout::MISSING
+			&& layout.weights != SkinningLayout::MISSING;
+	}
+
+
+	// called from setup, returns byte offset of skinned vertices in m_skinned_vb or SkinningLayout::MISSING
+	u32 getSkinnedVertices(EntityRef entity, u32 mesh_idx, const ModelInstance& mi)
+	{
+		if (!m_skinned_vertices) return SkinningLayout::MISSING;
+		
+		const Mesh& mesh = mi.meshes[mesh_idx];
+		SkinningLayout layout;
+		if (!getSkinningLayout(mesh, layout)) return SkinningLayout::MISSING;
+
+		const BonePalette bones = getBonePalette(entity, mi);
+		SkinnedVertices& sv = *m_skinned_vertices;
+		const u64 key = ((u64)entity.index << 32) | mesh_idx;
+		MutexGuard lock(sv.mutex);
+		auto iter = sv.offsets.find(key);
+		if (iter.isValid()) return iter.value();
+
+		SkinnedVertices::Mesh& m = sv.meshes.emplace();
+		m.vertex_buffer = mesh.render_data->vertex_buffer_handle;
+		m.bones = bones;
+		m.layout = layout;
+		m.vertex_count = mesh.vertices.size();
+		m.offset = sv.size;
+		sv.size += (m.vertex_count * mesh.render_data->vb_stride + 15) & ~15;
+		sv.offsets.insert(key, m.offset);
+		return m.offset;
+	}
+
+
+	// render thread
+	void dispatchSkinning(const SkinnedVertices& sv, gpu::ProgramHandle program)
+	{
+		if (sv.meshes.empty() || !gpu::isProgramReady(program)) return;
+
+		PROFILE_FUNCTION();
+		if (sv.size > m_skinned_vb_size) {
+			if (m_skinned_vb.isValid()) gpu::destroy(m_skinned_vb);
+			m_skinned_vb_size = nextPow2(sv.size);
+			m_skinned_vb = gpu::allocBufferHandle();
+			gpu::createBuffer(m_skinned_vb, (u32)gpu::BufferFlags::IMMUTABLE, m_skinned_vb_size, nullptr);
+		}
+
+		struct {
+			SkinningLayout layout;
+			u32 vertex_count;
+			u32 first_bone;
+			u32 first_output;
+			u32 padding;
+		} dc;
+
+		gpu::pushDebugGroup("skinning");
+		gpu::useProgram(program);
+		gpu::bindShaderBuffer(m_skinned_vb, 1);
+		for (const SkinnedVertices::Mesh& mesh : sv.meshes) {
+			dc.layout = mesh.layout;
+			dc.vertex_count = mesh.vertex_count;
+			dc.first_bone = mesh.bones.offset / sizeof(Vec4);
+			dc.first_output = mesh.offset / sizeof(u32);
+			dc.padding = 0;
+			void* mem = gpu::map(m_drawcall_ub, sizeof(dc));
+			memcpy(mem, &dc, sizeof(dc));
+			gpu::unmap(m_drawcall_ub);
+
+			gpu::bindShaderBuffer(mesh.vertex_buffer, 0);
+			gpu::bindShaderBuffer(mesh.bones.buffer, 2);
+			gpu::dispatch((mesh.vertex_count + 63) / 64, 1, 1);
+		}
+		gpu::memoryBarrier();
+		for (u32 i = 0; i < 3; ++i) gpu::bindShaderBuffer(gpu::INVALID_BUFFER, i);
+		gpu::popDebugGroup();
+		m_skinned_vb_ready = true;
+	}
+
+
+	// the camera and the shadow cascades are culled in a single traversal when the frame starts,
+	// prepareCommands with a matching frustum takes the results instead of culling again
+	struct SharedCull {
+		// slot 0 is the camera, the rest are shadow cascades
+		static constexpr u32 MAX_SLOTS = 5;
+
+		ShiftedFrustum frustums[MAX_SLOTS];
+		CullResult* results[MAX_SLOTS][(u32)RenderableTypes::COUNT] = {};
+		u32 slots_count = 0;
+		u32 culled_mask = 0;
+		u32 claimed_mask = 0;
+		// slots that prepareCommands asked for, only these are culled in the next frame
+		u32 requested_mask = 0;
+		u32 last_requested_mask = 0xffFFffFF;
+		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+	};
+
+
+	static bool isSameFrustum(const ShiftedFrustum& a, const ShiftedFrustum& b)
+	{
+		return a.origin.x == b.origin.x && a.origin.y == b.origin.y && a.origin.z == b.origin.z
+			&& memcmp(a.xs, b.xs, sizeof(a.xs)) == 0
+			&& memcmp(a.ys, b.ys, sizeof(a.ys)) == 0
+			&& memcmp(a.zs, b.zs, sizeof(a.zs)) == 0
+			&& memcmp(a.ds, b.ds, sizeof(a.ds)) == 0
+			&& memcmp(a.points, b.points, sizeof(a.points)) == 0;
+	}
+
+
+	void releaseSharedCull()
+	{
+		SharedCull& sc = m_shared_cull;
+		JobSystem::wait(sc.signal);
+		sc.signal = JobSystem::INVALID_HANDLE;
+		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
+		for (u32 slot = 0; slot < sc.slots_count; ++slot) {
+			if (sc.claimed_mask & (1 << slot)) continue;
+			for (CullResult* result : sc.results[slot]) {
+				if (result) result->free(page_allocator);
+			}
+		}
+		memset(sc.results, 0, sizeof(sc.results));
+		if (sc.slots_count > 0) sc.last_requested_mask = sc.requested_mask;
+		sc.slots_count = 0;
+		sc.culled_mask = 0;
+		sc.claimed_mask = 0;
+		sc.requested_mask = 0;
+	}
+
+
+	void startSharedCull(bool with_shadows)
+	{
+		SharedCull& sc = m_shared_cull;
+		ASSERT(sc.slots_count == 0);
+		sc.frustums[0] = m_viewport.getFrustum();
+		sc.slots_count = 1;
+		if (with_shadows) {
+			for (const CameraParams& cp : m_shadow_camera_params) {
+				sc.frustums[sc.slots_count] = cp.frustum;
+				++sc.slots_count;
+			}
+		}
+		// prepareCommands gets frustums through lua, which recomputes the planes
+		for (u32 i = 0; i < sc.slots_count; ++i) sc.frustums[i].setPlanesFromPoints();
+
+		sc.culled_mask = sc.last_requested_mask & ((1 << sc.slots_count) - 1);
+		if (!sc.culled_mask) return;
+
+		JobSystem::run(this, [](void* data){
+			PROFILE_BLOCK("shared cull");
+			PipelineImpl* pipeline = (PipelineImpl*)data;
+			SharedCull& sc = pipeline->m_shared_cull;
+			ShiftedFrustum frustums[SharedCull::MAX_SLOTS];
+			u32 slots[SharedCull::MAX_SLOTS];
+			u32 count = 0;
+			for (u32 slot = 0; slot < sc.slots_count; ++slot) {
+				if (!(sc.culled_mask & (1 << slot))) continue;
+				frustums[count] = sc.frustums[slot];
+				slots[count] = slot;
+				++count;
+			}
+
+			// grass is not in the culling system, it's handled by each prepareCommands
+			const RenderableTypes types[] = {
+				RenderableTypes::MESH,
+				RenderableTypes::MESH_GROUP,
+				RenderableTypes::SKINNED,
+				RenderableTypes::DECAL,
+				RenderableTypes::LOCAL_LIGHT
+			};
+			JobSystem::forEach(lengthOf(types), [&](int idx){
+				CullResult* results[SharedCull::MAX_SLOTS];
+				pipeline->m_scene->getRenderables(Span<const ShiftedFrustum>(frustums, count), types[idx], Span(results, count));
+				for (u32 i = 0; i < count; ++i) {
+					sc.results[slots[i]][(u32)types[idx]] = results[i];
+				}
+			});
+		}, &sc.signal);
+	}
+
+
+	// called from prepareCommands on main thread, returns -1 if the frustum is not shared
+	i32 claimSharedCull(const ShiftedFrustum& frustum)
+	{
+		SharedCull& sc = m_shared_cull;
+		for (u32 slot = 0; slot < sc.slots_count; ++slot) {
+			if (!isSameFrustum(frustum, sc.frustums[slot])) continue;
+			
+			const u32 bit = 1 << slot;
+			sc.requested_mask |= bit;
+			if (!(sc.culled_mask & bit) || (sc.claimed_mask & bit)) continue;
+			sc.claimed_mask |= bit;
+			return slot;
+		}
+		return -1;
+	}
+
+
+	static CameraParams checkCameraParams(lua_State* L, int idx)
+	{
+		CameraParams cp;
+
+		lua_getfield(L, idx, "view");
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			luaL_error(L, "View matrix is not a table");
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			lua_rawgeti(L, -1, i + 1);
+			if (!LuaWrapper::isType<float>(L, -1)) {
+				lua_pop(L, 2);
+				luaL_error(L, "View matrix must contain exactly 16 floats");
+			}
+			cp.view[i] = LuaWrapper::toType<float>(L, -1);
+			lua_pop(L, 1);
+		}
+		lua_pop(L, 1);
+
+		lua_getfield(L, idx, "projection");
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			luaL_error(L, "Projection matrix is not a table");
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			lua_rawgeti(L, -1, i + 1);
+			if (!LuaWrapper::isType<float>(L, -1)) {
 				lua_pop(L, 2);
 				luaL_error(L, "Projection matrix must contain exactly 16 floats");
 			}
@@ -1439,7 +2597,7 @@ struct PipelineImpl final : Pipeline
 			}
 
 			const int rb_idx = (int)lua_tointeger(L, -1);
-			cmd->m_textures_handles[cmd->m_textures_count] = pipeline->m_renderbuffers[rb_idx].handle;
+			cmd->m_textures_handles[cmd->m_textures_count] = pipeline->useRenderbuffer(rb_idx);
 			++cmd->m_textures_count;
 
 			lua_pop(L, 1);
@@ -1665,6 +2823,27 @@ struct PipelineImpl final : Pipeline
 		}
 		cmd->m_camera_params = cp;
 		cmd->m_pipeline = pipeline;
+		cmd->m_local_shadows_count = 0;
+		const float inv_atlas_size = pipeline->m_shadow_atlas.size > 0 ? 1.f / pipeline->m_shadow_atlas.size : 0;
+		for (const LocalShadow& s : pipeline->m_local_shadows) {
+			if (s.node < 0 || !s.rendered) continue;
+			const bool omni = s.fov >= PI;
+			LocalShadowTile& tile = cmd->m_local_shadows[cmd->m_local_shadows_count++];
+			tile.entity = s.entity;
+			tile.rect = Vec4(float(s.x), float(s.y), float(omni ? s.size / 3 : s.size), float(omni ? s.size / 2 : s.size)) * inv_atlas_size;
+		}
+		if (lua_isboolean(L, 3)) cmd->m_sort_per_bucket = lua_toboolean(L, 3) != 0;
+		if (lua_isstring(L, 4)) {
+			const char* filter = lua_tostring(L, 4);
+			if (equalIStrings(filter, "static")) cmd->m_static_filter = PrepareCommandsRenderJob::StaticFilter::STATIC;
+			else if (equalIStrings(filter, "dynamic")) cmd->m_static_filter = PrepareCommandsRenderJob::StaticFilter::DYNAMIC;
+		}
+		cmd->m_occlusion_culling = pipeline->m_occlusion_culling && !cp.is_shadow;
+		cmd->m_shared_cull_slot = pipeline->claimSharedCull(cp.frustum);
+		// static instance buffers are shared, so only one camera per frame can use them
+		if (pipeline->m_gpu_culling && !cp.is_shadow && !pipeline->m_gpu_culling_used && pipeline->m_scene) {
+			cmd->prepareGPUCulling();
+		}
 		const int num_cmd_sets = cmd->m_bucket_count;
 		pipeline->m_renderer.queue(cmd, pipeline->m_profiler_link);
 
@@ -1765,7 +2944,7 @@ struct PipelineImpl final : Pipeline
 				}
 
 				const int rb_idx = (int)lua_tointeger(L, -1);
-				cmd->m_textures_handles[cmd->m_textures_count] = pipeline->m_renderbuffers[rb_idx].handle;
+				cmd->m_textures_handles[cmd->m_textures_count] = pipeline->useRenderbuffer(rb_idx);
 				++cmd->m_textures_count;
 				lua_pop(L, 1);
 			}
@@ -1866,74 +3045,183 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	static CameraParams getLocalShadowCameraParams(const CameraParams& camera, const DVec3& pos, const Vec3& forward, const Vec3& up, float fov, float range) {
+		Matrix basis = Matrix::IDENTITY;
+		basis.setXVector(crossProduct(forward, up));
+		basis.setYVector(up);
+		basis.setZVector(-forward);
+
+		Viewport vp;
+		vp.is_ortho = false;
+		vp.fov = fov;
+		vp.w = vp.h = 1;
+		vp.pos = pos;
+		vp.rot = basis.getRotation();
+		vp.near = maximum(range * 0.01f, 0.02f);
+		vp.far = range;
+
+		CameraParams cp;
+		cp.pos = pos;
+		cp.frustum = vp.getFrustum();
+		cp.lod_multiplier = camera.lod_multiplier;
+		cp.is_shadow = true;
+		cp.view = vp.getView(cp.pos);
+		cp.projection = vp.getProjection(gpu::isHomogenousDepth());
+		return cp;
+	}
+
+	void updateLocalShadows(const CameraParams& cp, u32 atlas_size) {
+		if (atlas_size != m_shadow_atlas.size) {
+			m_shadow_atlas.init(atlas_size);
+			m_local_shadows.clear();
+		}
+
+		PointLight lights[MAX_LOCAL_SHADOWS];
+		const int count = m_scene->getClosestShadowcastingPointLights(cp.pos, lengthOf(lights), lights);
+		const Universe& universe = m_scene->getUniverse();
+		const u32 static_version = m_scene->getStaticModelInstancesVersion();
+
+		for (LocalShadow& s : m_local_shadows) s.used = false;
+		for (int i = 0; i < count; ++i) {
+			const PointLight& pl = lights[i];
+			LocalShadow* shadow = nullptr;
+			for (LocalShadow& s : m_local_shadows) {
+				if (s.entity == pl.entity) shadow = &s;
+			}
+			if (!shadow) {
+				shadow = &m_local_shadows.emplace();
+				shadow->entity = pl.entity;
+			}
+			shadow->used = true;
+
+			const Transform tr = universe.getTransform(pl.entity);
+			const bool same = shadow->pos.x == tr.pos.x && shadow->pos.y == tr.pos.y && shadow->pos.z == tr.pos.z
+				&& shadow->rot.x == tr.rot.x && shadow->rot.y == tr.rot.y && shadow->rot.z == tr.rot.z && shadow->rot.w == tr.rot.w
+				&& shadow->fov == pl.fov
+				&& shadow->range == pl.range
+				&& shadow->static_version == static_version;
+			if (!same) {
+				shadow->pos = tr.pos;
+				shadow->rot = tr.rot;
+				shadow->fov = pl.fov;
+				shadow->range = pl.range;
+				shadow->static_version = static_version;
+				shadow->dirty = true;
+			}
+			// > 1 if the camera is inside the light's range
+			shadow->importance = pl.range / maximum(float((tr.pos - cp.pos).length()), 0.01f);
+		}
+
+		// lights which are not among the closest anymore give their tiles to the others
+		m_local_shadows.eraseItems([&](const LocalShadow& s){
+			if (!s.used && s.node >= 0) m_shadow_atlas.free(s.node);
+			return !s.used;
+		});
+
+		for (i32 i = 1; i < m_local_shadows.size(); ++i) {
+			for (i32 j = i; j > 0 && m_local_shadows[j - 1].importance < m_local_shadows[j].importance; --j) {
+				swap(m_local_shadows[j - 1], m_local_shadows[j]);
+			}
+		}
+
+		// the biggest tile is a quarter of the atlas, shrinking has hysteresis so lights do not flip between two sizes
+		u32 levels[MAX_LOCAL_SHADOWS];
+		for (i32 i = 0; i < m_local_shadows.size(); ++i) {
+			LocalShadow& s = m_local_shadows[i];
+			const float wanted_size = minimum(s.importance, 1.f) * (atlas_size >> 2);
+			u32 level = 2;
+			while (level < ShadowAtlas::LEVELS - 1 && (atlas_size >> (level + 1)) >= wanted_size) ++level;
+			levels[i] = level;
+			if (s.node >= 0 && (level == s.wanted_level || level == s.wanted_level + 1)) continue;
+			if (s.node >= 0) m_shadow_atlas.free(s.node);
+			s.node = -1;
+		}
+
+		// more important lights allocate first, so they get smaller tiles than wanted only if the atlas is full
+		for (i32 i = 0; i < m_local_shadows.size(); ++i) {
+			LocalShadow& s = m_local_shadows[i];
+			if (s.node >= 0) continue;
+			s.wanted_level = levels[i];
+			for (u32 level = levels[i]; level < ShadowAtlas::LEVELS && s.node < 0; ++level) {
+				s.node = m_shadow_atlas.alloc(level);
+				s.level = level;
+			}
+			if (s.node >= 0) m_shadow_atlas.getRect(s.node, s.x, s.y, s.size);
+			s.rendered = false;
+			s.dirty = true;
+		}
+	}
+
+	void pushLocalShadowFaces(lua_State* L, const CameraParams& cp, LocalShadow& s, u32 frame, i32& face_idx) {
+		const bool omni = s.fov >= PI;
+		const u32 faces_count = omni ? 6 : 1;
+		const u32 face_w = omni ? s.size / 3 : s.size;
+		const u32 face_h = omni ? s.size / 2 : s.size;
+		for (u32 i = 0; i < faces_count; ++i) {
+			const Vec3 forward = omni ? LOCAL_SHADOW_FACES[i][0] : s.rot.rotate(Vec3(0, 0, 1));
+			const Vec3 up = omni ? LOCAL_SHADOW_FACES[i][1] : s.rot.rotate(Vec3(0, 1, 0));
+
+			lua_createtable(L, 0, 5);
+			LuaWrapper::setField(L, -1, "viewport_x", s.x + (i % 3) * face_w);
+			LuaWrapper::setField(L, -1, "viewport_y", s.y + (i / 3) * face_h);
+			LuaWrapper::setField(L, -1, "viewport_w", face_w);
+			LuaWrapper::setField(L, -1, "viewport_h", face_h);
+			pushCameraParams(L, getLocalShadowCameraParams(cp, s.pos, forward, up, omni ? PI * 0.5f : s.fov, s.range));
+			lua_setfield(L, -2, "camera_params");
+			lua_rawseti(L, -2, ++face_idx);
+		}
+		s.dirty = false;
+		s.rendered = true;
+		s.rendered_frame = frame;
+	}
+
+	// allocates tiles in a shadow atlas for the closest shadowcasting local lights and returns faces which should be rendered,
+	// {viewport_x, viewport_y, viewport_w, viewport_h, camera_params} each; a spot light has one face, a point light six;
+	// changed lights go first, the rest of `max_faces` refreshes the least recently rendered tiles,
+	// the most important changed light is returned even if it does not fit in the budget
 	static int prepareShadowcastingLocalLights(lua_State* L)
 	{
-		/*const int pipeline_idx = lua_upvalueindex(1);
+		PROFILE_FUNCTION();
+		const int pipeline_idx = lua_upvalueindex(1);
 		if (lua_type(L, pipeline_idx) != LUA_TLIGHTUSERDATA) {
 			LuaWrapper::argError<PipelineImpl*>(L, pipeline_idx);
 		}
 		PipelineImpl* pipeline = LuaWrapper::toType<PipelineImpl*>(L, pipeline_idx);
-		const Universe& universe = pipeline->m_scene->getUniverse();
+		LuaWrapper::checkTableArg(L, 1);
 		const CameraParams cp = checkCameraParams(L, 1);
-		const int shadowmap_width = LuaWrapper::checkArg<int>(L, 2);
-		const int shadowmap_height = LuaWrapper::checkArg<int>(L, 3);
-		const int tile_width = LuaWrapper::checkArg<int>(L, 4);
-		const int tile_height = LuaWrapper::checkArg<int>(L, 5);
-
-		const int cols = shadowmap_width / tile_width;
-		const int rows = shadowmap_height / tile_height;
-		PointLight lights[16];
-		const int max_count = maximum(lengthOf(lights), cols * rows);
-		const int count = pipeline->m_scene->getClosestShadowcastingPointLights(cp.pos, max_count, lights);
-
-		IAllocator& allocator = pipeline->m_renderer.getAllocator();
-		PageAllocator& page_allocator = pipeline->m_renderer.getEngine().getPageAllocator();
-
-		lua_createtable(L, count, 0);
-		for (int i = 0; i < count; ++i) {
-			PrepareCommandsRenderJob* cmd = LUMIX_NEW(allocator, PrepareCommandsRenderJob)(allocator, page_allocator);
-			cmd->m_bucket_count = 1;
+		const u32 atlas_size = LuaWrapper::checkArg<u32>(L, 2);
+		const u32 max_faces = LuaWrapper::checkArg<u32>(L, 3);
+		if (!isPowOfTwo(atlas_size)) return luaL_argerror(L, 2, "atlas size must be power of two");
+
+		lua_newtable(L);
+		if (!pipeline->m_scene) return 1;
+
+		pipeline->updateLocalShadows(cp, atlas_size);
+		const u32 frame = ++pipeline->m_local_shadows_frame;
+		u32 budget = max_faces;
+		i32 face_idx = 0;
+		auto getCost = [](const LocalShadow& s) -> u32 { return s.fov >= PI ? 6 : 1; };
+
+		for (LocalShadow& s : pipeline->m_local_shadows) {
+			if (s.node < 0 || !s.dirty) continue;
+			const u32 cost = getCost(s);
+			if (cost > budget && face_idx > 0) continue;
+			pipeline->pushLocalShadowFaces(L, cp, s, frame, face_idx);
+			budget -= minimum(cost, budget);
+		}
 
-			const bool ok = LuaWrapper::forEachArrayItem<const char*>(L, 6, nullptr, [&](const char* layer_name) {
-				const int layer = pipeline->m_renderer.getLayerIdx(layer_name);
-				cmd->m_bucket_map[layer] = 0;
-				});
-			if (!ok) {
-				LUMIX_DELETE(allocator, cmd);
-				return luaL_argerror(L, 2, "'layers' must be array of strings");
+		// even static lights are refreshed from time to time, dynamic objects cast shadows too
+		for (;;) {
+			LocalShadow* oldest = nullptr;
+			for (LocalShadow& s : pipeline->m_local_shadows) {
+				if (s.node < 0 || s.rendered_frame == frame) continue;
+				if (!oldest || s.rendered_frame < oldest->rendered_frame) oldest = &s;
 			}
-			CommandSet* cmd_set = LUMIX_NEW(allocator, CommandSet)(allocator);
-			pipeline->m_command_sets.push(cmd_set);
-			const PointLight& pl = lights[i];
-			cmd->m_command_sets[0] = cmd_set;
-
-			lua_createtable(L, 0, 6);
-			LuaWrapper::setField(L, -1, "entity", pl.entity.index);
-			LuaWrapper::setField(L, -1, "viewport_x", (i % cols) * tile_width);
-			LuaWrapper::setField(L, -1, "viewport_y", (i / cols) * tile_height);
-			LuaWrapper::setField(L, -1, "viewport_w", tile_width);
-			LuaWrapper::setField(L, -1, "viewport_h", tile_height);
-			LuaWrapper::setField(L, -1, "bucket", cmd_set);
-			lua_rawseti(L, -2, i + 1);
-			
-			// TODO light camera params
-			CameraParams shadow_cam = cp;
-			shadow_cam.pos = universe.getPosition(pl.entity);
-			const Quat rot = universe.getRotation(pl.entity);
-			const Vec3 dir = rot.rotate(Vec3(0, 0, 1));
-			const Vec3 up = rot.rotate(Vec3(0, 1, 0));
-			shadow_cam.frustum.computePerspective(shadow_cam.pos, dir, up, pl.fov, 1, 0.1f, pl.range);
-			shadow_cam.is_shadow = true;
-			cmd->m_camera_params = shadow_cam;
-			cmd->m_pipeline = pipeline;
-			const int num_cmd_sets = cmd->m_bucket_count;
-			pipeline->m_renderer.queue(cmd);
+			if (!oldest || getCost(*oldest) > budget) break;
+			budget -= getCost(*oldest);
+			pipeline->pushLocalShadowFaces(L, cp, *oldest, frame, face_idx);
 		}
-
-		return 1;*/
-		ASSERT(false);
-		// TODO
-		return 0;
+		return 1;
 	}
 
 
@@ -2024,13 +3312,13 @@ struct PipelineImpl final : Pipeline
 				const DVec3& pos = m_pipeline->m_viewport.pos;
 				const u32 count = m_pipeline->m_scene->getTextMeshesVerticesCount();
 				vb = m_pipeline->m_renderer.allocTransient(count * sizeof(TextMeshVertex));
-				m_pipeline->m_scene->getTextMeshesVertices((TextMeshVertex*)vb.ptr, pos, rot);
+				vertices_count = m_pipeline->m_scene->getTextMeshesVertices((TextMeshVertex*)vb.ptr, pos, rot);
 			}
 
 			void execute() override
 			{
 				PROFILE_FUNCTION();
-				if (vb.size == 0) return;
+				if (vertices_count == 0) return;
 
 				gpu::useProgram(m_program);
 				const u64 blend_state = gpu::getBlendStateBits(gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA, gpu::BlendFactors::SRC_ALPHA, gpu::BlendFactors::ONE_MINUS_SRC_ALPHA);
@@ -2039,10 +3327,11 @@ struct PipelineImpl final : Pipeline
 				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
 				gpu::bindVertexBuffer(0, vb.buffer, vb.offset, 24);
 				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
-				gpu::drawArrays(0, vb.size / sizeof(TextMeshVertex), gpu::PrimitiveType::TRIANGLES);
+				gpu::drawArrays(0, vertices_count, gpu::PrimitiveType::TRIANGLES);
 			}
 
 			Renderer::TransientSlice vb;
+			u32 vertices_count;
 			gpu::TextureHandle m_atlas;
 			gpu::ProgramHandle m_program;
 			PipelineImpl* m_pipeline;
@@ -2235,6 +3524,111 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	// local lights shaded in one fullscreen pass, each pixel loops over the lights assigned to its cluster,
+	// the pass costs about the same no matter how the lights overlap on the screen
+	void renderClusteredLights(int shader_idx, CmdPage* cmds)
+	{
+		struct RenderJob : Renderer::RenderJob
+		{
+			void setup() override {}
+
+			void execute() override
+			{
+				// inline in debug
+				#define READ(T, N) \
+					T N = *(T*)cmd; \
+					cmd += sizeof(T); \
+					do {} while(false)
+
+				PROFILE_FUNCTION();
+				PageAllocator& page_allocator = m_pipeline->m_renderer.getEngine().getPageAllocator();
+				const bool ready = gpu::isProgramReady(m_cluster_program) && gpu::isProgramReady(m_program);
+				if (ready && !m_pipeline->m_light_clusters_buffer.isValid()) {
+					m_pipeline->m_light_clusters_buffer = gpu::allocBufferHandle();
+					const u32 size = LIGHT_CLUSTERS_COUNT * (MAX_CLUSTER_LIGHTS + 1) * sizeof(u32);
+					gpu::createBuffer(m_pipeline->m_light_clusters_buffer, (u32)gpu::BufferFlags::IMMUTABLE, size, nullptr);
+				}
+
+				const u64 blend_state = gpu::getBlendStateBits(gpu::BlendFactors::ONE, gpu::BlendFactors::ONE, gpu::BlendFactors::ONE, gpu::BlendFactors::ONE);
+				CmdPage* page = m_cmds;
+				while (page) {
+					const u8* cmd = page->data;
+					const u8* cmd_end = page->data + page->header.size;
+					while (ready && cmd != cmd_end) {
+						READ(const RenderableTypes, type);
+						ASSERT(type == RenderableTypes::LOCAL_LIGHT);
+
+						READ(u32, total_count);
+						READ(u32, nonintersecting_count);
+						READ(const gpu::BufferHandle, buffer);
+						READ(const u32, offset);
+						(void)nonintersecting_count;
+
+						LightClusterState state;
+						state.grid[0] = LIGHT_CLUSTERS_X;
+						state.grid[1] = LIGHT_CLUSTERS_Y;
+						state.grid[2] = LIGHT_CLUSTERS_Z;
+						state.grid[3] = total_count;
+						state.depth = Vec4(m_near, m_far, logf(m_far / m_near), 0);
+						// slices are 16B aligned
+						state.first_light[0] = offset / sizeof(Vec4);
+						gpu::update(m_pipeline->m_drawcall_ub, &state, sizeof(state));
+
+						gpu::bindShaderBuffer(buffer, 0);
+						gpu::bindShaderBuffer(m_pipeline->m_light_clusters_buffer, 1);
+						gpu::useProgram(m_cluster_program);
+						gpu::dispatch((LIGHT_CLUSTERS_COUNT + 63) / 64, 1, 1);
+						gpu::memoryBarrier();
+
+						gpu::useProgram(m_program);
+						gpu::setState(blend_state);
+						gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
+						gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
+						gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+						gpu::drawArrays(0, 4, gpu::PrimitiveType::TRIANGLE_STRIP);
+						// next batch overwrites the clusters
+						gpu::memoryBarrier();
+						m_pipeline->m_stats.draw_call_count += 1;
+					}
+					CmdPage* next = page->header.next;
+					page_allocator.deallocate(page, true);
+					page = next;
+				}
+				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0);
+				gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 1);
+				#undef READ
+			}
+
+			gpu::ProgramHandle m_program;
+			gpu::ProgramHandle m_cluster_program;
+			PipelineImpl* m_pipeline;
+			CmdPage* m_cmds;
+			float m_near;
+			float m_far;
+		};
+
+		Shader* shader = [&]() -> Shader* {
+			for (const ShaderRef& s : m_shaders) {
+				if(s.id == shader_idx) {
+					return ((Shader*)s.res);
+				}
+			}
+			return nullptr;
+		}();
+
+		if (!shader || !shader->isReady() || !m_light_clusters_shader->isReady()) return;
+
+		RenderJob* job = LUMIX_NEW(m_renderer.getAllocator(), RenderJob);
+		job->m_pipeline = this;
+		job->m_cmds = cmds;
+		job->m_program = shader->getProgram(gpu::VertexDecl(), 0);
+		job->m_cluster_program = m_light_clusters_shader->getProgram(gpu::VertexDecl(), 0);
+		job->m_near = maximum(m_viewport.near, 0.01f);
+		job->m_far = maximum(m_viewport.far, job->m_near * 2);
+		m_renderer.queue(job, m_profiler_link);
+	}
+
+
 	static u64 getState(lua_State* L, int idx)
 	{
 		gpu::StencilFuncs stencil_func = gpu::StencilFuncs::DISABLE;
@@ -2308,6 +3702,8 @@ struct PipelineImpl final : Pipeline
 				const u64 render_states = m_render_state;
 				const gpu::BufferGroupHandle material_ub = renderer.getMaterialUniformBuffer();
 				u32 material_ub_idx = 0xffFFffFF;
+				// rebound in case a window switch changed the context
+				if (renderer.isBindless()) gpu::bindShaderBuffer(renderer.getMaterialTableBuffer(), 8);
 				CmdPage* page = m_cmds;
 				while (page) {
 					const u8* cmd = page->data;
@@ -2320,11 +3716,11 @@ struct PipelineImpl final : Pipeline
 								READ(Mesh::RenderData*, mesh);
 								READ(Material::RenderData*, material);
 								READ(gpu::ProgramHandle, program);
-								READ(u16, instances_count);
+								READ(u32, instances_count);
 								READ(gpu::BufferHandle, buffer);
 								READ(u32, offset);
 
-								gpu::bindTextures(material->textures, 0, material->textures_count);
+								if (material->material_table_idx == Material::INVALID_MATERIAL_TABLE_IDX) gpu::bindTextures(material->textures, 0, material->textures_count);
 								gpu::setState(material->render_states | render_states);
 								if (material_ub_idx != material->material_constants) {
 									gpu::bindUniformBuffer(2, material_ub, material->material_constants);
@@ -2335,7 +3731,7 @@ struct PipelineImpl final : Pipeline
 
 								gpu::bindIndexBuffer(mesh->index_buffer_handle);
 								gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
-								gpu::bindVertexBuffer(1, buffer, offset, 32);
+								gpu::bindVertexBuffer(1, buffer, offset, sizeof(MeshInstanceData));
 
 								gpu::drawTrianglesInstanced(mesh->indices_count, instances_count, mesh->index_type);
 								++stats.draw_call_count;
@@ -2343,6 +3739,34 @@ struct PipelineImpl final : Pipeline
 								stats.instance_count += instances_count;
 								break;
 							}
+							case INDIRECT_MESH_COMMAND: {
+								READ(Mesh::RenderData*, mesh);
+								READ(Material::RenderData*, material);
+								READ(gpu::ProgramHandle, program);
+								READ(gpu::BufferHandle, indirect_buffer);
+								READ(u32, indirect_offset);
+								READ(u32, commands_count);
+								READ(gpu::BufferHandle, buffer);
+								READ(u32, offset);
+
+								if (material->material_table_idx == Material::INVALID_MATERIAL_TABLE_IDX) gpu::bindTextures(material->textures, 0, material->textures_count);
+								gpu::setState(material->render_states | render_states);
+								if (material_ub_idx != material->material_constants) {
+									gpu::bindUniformBuffer(2, material_ub, material->material_constants);
+									material_ub_idx = material->material_constants;
+								}
+
+								gpu::useProgram(program);
+
+								gpu::bindIndexBuffer(mesh->index_buffer_handle);
+								gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+								gpu::bindVertexBuffer(1, buffer, offset, sizeof(MeshInstanceData));
+
+								// triangle and instance counts are known only on GPU
+								gpu::drawTrianglesIndirect(indirect_buffer, indirect_offset, commands_count, sizeof(IndirectCommand), mesh->index_type);
+								++stats.draw_call_count;
+								break;
+							}
 							case RenderableTypes::SKINNED: {
 								READ(Mesh::RenderData*, mesh);
 								READ(Material::RenderData*, material);
@@ -2350,15 +3774,22 @@ struct PipelineImpl final : Pipeline
 								READ(Vec3, pos);
 								READ(Quat, rot);
 								READ(float, scale);
-								READ(i32, bones_count);
-
-								Matrix* bones = (Matrix*)cmd;
-								cmd += sizeof(bones[0]) * bones_count;
+								READ(gpu::BufferHandle, bones_buffer);
+								READ(u32, bones_offset);
+								READ(gpu::ProgramHandle, rigid_program);
+								READ(u32, skinned_offset);
 
-								Matrix model_mtx(pos, rot);
-								model_mtx.multiply3x3(scale);
+								struct {
+									Matrix model_mtx;
+									u32 bones_offset[4];
+								} dc;
+								dc.model_mtx = Matrix(pos, rot);
+								dc.model_mtx.multiply3x3(scale);
+								dc.bones_offset[0] = bones_offset / sizeof(Vec4);
+								// skinned by skinning.shd, if it ran this frame
+								const bool is_precomputed = skinned_offset != SkinningLayout::MISSING && m_pipeline->m_skinned_vb_ready;
 
-								gpu::bindTextures(material->textures, 0, material->textures_count);
+								if (material->material_table_idx == Material::INVALID_MATERIAL_TABLE_IDX) gpu::bindTextures(material->textures, 0, material->textures_count);
 
 								gpu::setState(material->render_states | render_states);
 								if (material_ub_idx != material->material_constants) {
@@ -2366,15 +3797,20 @@ struct PipelineImpl final : Pipeline
 									material_ub_idx = material->material_constants;
 								}
 
-								u8* dc_mem = (u8*)gpu::map(m_pipeline->m_drawcall_ub, sizeof(Matrix) * (bones_count + 1));
-								memcpy(dc_mem, &model_mtx, sizeof(Matrix));
-								memcpy(dc_mem + sizeof(Matrix), bones, sizeof(Matrix) * bones_count);
+								void* dc_mem = gpu::map(m_pipeline->m_drawcall_ub, sizeof(dc));
+								memcpy(dc_mem, &dc, sizeof(dc));
 								gpu::unmap(m_pipeline->m_drawcall_ub);
 
-								gpu::useProgram(program);
-
 								gpu::bindIndexBuffer(mesh->index_buffer_handle);
-								gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+								if (is_precomputed) {
+									gpu::useProgram(rigid_program);
+									gpu::bindVertexBuffer(0, m_pipeline->m_skinned_vb, skinned_offset, mesh->vb_stride);
+								}
+								else {
+									gpu::bindShaderBuffer(bones_buffer, 4);
+									gpu::useProgram(program);
+									gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+								}
 								gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
 								gpu::drawTriangles(mesh->indices_count, mesh->index_type);
 								++stats.draw_call_count;
@@ -2382,22 +3818,57 @@ struct PipelineImpl final : Pipeline
 								++stats.instance_count;
 								break;
 							}
-							case RenderableTypes::DECAL: {
+							case BAKED_SKINNED_COMMAND: {
+								READ(Mesh::RenderData*, mesh);
 								READ(Material::RenderData*, material);
 								READ(gpu::ProgramHandle, program);
+								READ(u32, instances_count);
 								READ(gpu::BufferHandle, buffer);
 								READ(u32, offset);
-								READ(u32, count);
-								
-								gpu::bindTextures(material->textures, 0, material->textures_count);
-								
-								gpu::useProgram(program);
-								gpu::setState(material->render_states | render_states);
-								gpu::bindIndexBuffer(m_pipeline->m_cube_ib);
-								gpu::bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
-								gpu::bindVertexBuffer(1, buffer, offset, 44);
+								READ(gpu::BufferHandle, frames_buffer);
+								READ(u32, bones_count);
 
-								gpu::drawTrianglesInstanced(36, count, gpu::DataType::U16);
+								if (material->material_table_idx == Material::INVALID_MATERIAL_TABLE_IDX) gpu::bindTextures(material->textures, 0, material->textures_count);
+								gpu::setState(material->render_states | render_states);
+								if (material_ub_idx != material->material_constants) {
+									gpu::bindUniformBuffer(2, material_ub, material->material_constants);
+									material_ub_idx = material->material_constants;
+								}
+
+								// instances are read from a shader buffer, its offset is in vec4s
+								const u32 dc[4] = { u32(offset / sizeof(Vec4)), bones_count, 0, 0 };
+								void* dc_mem = gpu::map(m_pipeline->m_drawcall_ub, sizeof(dc));
+								memcpy(dc_mem, dc, sizeof(dc));
+								gpu::unmap(m_pipeline->m_drawcall_ub);
+
+								gpu::useProgram(program);
+								gpu::bindShaderBuffer(frames_buffer, 4);
+								gpu::bindShaderBuffer(buffer, 5);
+								gpu::bindIndexBuffer(mesh->index_buffer_handle);
+								gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
+								gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+								gpu::drawTrianglesInstanced(mesh->indices_count, instances_count, mesh->index_type);
+								++stats.draw_call_count;
+								stats.triangle_count += instances_count * mesh->indices_count / 3;
+								stats.instance_count += instances_count;
+								break;
+							}
+							case RenderableTypes::DECAL: {
+								READ(Material::RenderData*, material);
+								READ(gpu::ProgramHandle, program);
+								READ(gpu::BufferHandle, buffer);
+								READ(u32, offset);
+								READ(u32, count);
+								
+								gpu::bindTextures(material->textures, 0, material->textures_count);
+								
+								gpu::useProgram(program);
+								gpu::setState(material->render_states | render_states);
+								gpu::bindIndexBuffer(m_pipeline->m_cube_ib);
+								gpu::bindVertexBuffer(0, m_pipeline->m_cube_vb, 0, 12);
+								gpu::bindVertexBuffer(1, buffer, offset, 44);
+
+								gpu::drawTrianglesInstanced(36, count, gpu::DataType::U16);
 								++stats.draw_call_count;
 								stats.instance_count += count;
 								break;
@@ -2415,10 +3886,10 @@ struct PipelineImpl final : Pipeline
 								
 								renderer.beginProfileBlock("grass", 0);
 								gpu::useProgram(program);
-								gpu::bindTextures(material->textures, 0, material->textures_count);
+								if (material->material_table_idx == Material::INVALID_MATERIAL_TABLE_IDX) gpu::bindTextures(material->textures, 0, material->textures_count);
 								gpu::bindIndexBuffer(mesh->index_buffer_handle);
 								gpu::bindVertexBuffer(0, mesh->vertex_buffer_handle, 0, mesh->vb_stride);
-								gpu::bindVertexBuffer(1, buffer, offset, 48);
+								gpu::bindVertexBuffer(1, buffer, offset, sizeof(Terrain::GrassPatch::InstanceData));
 								if (material_ub_idx != material->material_constants) {
 									gpu::bindUniformBuffer(2, material_ub, material->material_constants);
 									material_ub_idx = material->material_constants;
@@ -2516,32 +3987,28 @@ struct PipelineImpl final : Pipeline
 			{
 				PROFILE_FUNCTION();
 			
-				gpu::setFramebuffer(rbs, count, flags);
-				gpu::viewport(0, 0, w, h);
+				targets.bind();
 			}
 
 			PipelineImpl* pipeline;
-			gpu::TextureHandle rbs[16];
-			u32 flags;
-			u32 count;
-			u32 w;
-			u32 h;
+			RenderTargets targets;
 		};
 
 		Cmd* cmd = LUMIX_NEW(pipeline->m_renderer.getAllocator(), Cmd);
 		for(u32 i = 0; i < rb_count; ++i) {
 			const int rb_idx = LuaWrapper::checkArg<int>(L, i + 1);
-			cmd->rbs[i] = pipeline->m_renderbuffers[rb_idx].handle;
+			cmd->targets.rbs[i] = pipeline->useRenderbuffer(rb_idx);
 		}
 
 		cmd->pipeline = pipeline;
-		cmd->count = rb_count;
-		cmd->flags = (u32)gpu::FramebufferFlags::SRGB;
+		cmd->targets.count = rb_count;
+		cmd->targets.flags = (u32)gpu::FramebufferFlags::SRGB;
 		if (readonly_ds) {
-			cmd->flags |= (u32)gpu::FramebufferFlags::READONLY_DEPTH_STENCIL;
+			cmd->targets.flags |= (u32)gpu::FramebufferFlags::READONLY_DEPTH_STENCIL;
 		}
-		cmd->w = pipeline->m_viewport.w;
-		cmd->h = pipeline->m_viewport.h;
+		cmd->targets.w = pipeline->m_viewport.w;
+		cmd->targets.h = pipeline->m_viewport.h;
+		pipeline->m_render_targets = cmd->targets;
 		pipeline->m_renderer.queue(cmd, pipeline->m_profiler_link);
 
 		return 0;
@@ -2555,18 +4022,98 @@ struct PipelineImpl final : Pipeline
 		return setRenderTargets(L, true);
 	}
 
+	// terrain is drawn as clipmap rings of grid patches, each patch is an instance of m_terrain_grid_ib
+	static constexpr u32 TERRAIN_PATCH_CELLS = 16;
+	// ring is RING_PATCHES x RING_PATCHES patches, with the previous ring in the middle
+	static constexpr i32 TERRAIN_RING_PATCHES = 8;
+	static constexpr u32 TERRAIN_MAX_RINGS = 32;
+
 	struct RenderTerrainsCommand : Renderer::RenderJob
 	{
 		RenderTerrainsCommand(IAllocator& allocator)
 			: m_allocator(allocator)
 			, m_instances(allocator)
+			, m_rings(allocator)
 		{
 		}
 
+		// matches Drawcall in terrain.shd
+		struct Ring
+		{
+			IVec4 from_to_sup;
+			Vec4 pos;
+			Vec4 lpos;
+			Vec4 terrain_scale;
+			IVec4 vt;
+			Vec2 hm_size;
+			float cell_size;
+			u32 patches_count;
+			IVec4 patches[TERRAIN_RING_PATCHES * TERRAIN_RING_PATCHES];
+		};
+
+		struct Instance
+		{
+			gpu::ProgramHandle program;
+			gpu::ProgramHandle composite_program;
+			Material::RenderData* material;
+			EntityRef entity;
+			Vec2 hm_size;
+			Vec3 scale;
+			u32 textures_hash;
+			u32 splatmap_version;
+			u32 first_ring;
+			u32 rings_count;
+		};
+
+		void addRings(Instance& inst, const Vec3& pos, const Quat& rot, const Vec3& scale, const Vec2& hm_size)
+		{
+			inst.first_ring = m_rings.size();
+			const Vec2 lpos = rot.conjugated().rotate(-pos).xz();
+			const IVec2 hm_cells_0 = IVec2(i32(ceil(hm_size.x * 16)), i32(ceil(hm_size.y * 16)));
+			IVec2 prev_center(0);
+			float s = 1 / 16.f;
+			for (u32 level = 0; level < TERRAIN_MAX_RINGS; ++level) {
+				const float patch_size = TERRAIN_PATCH_CELLS * s;
+				// in patches, even so the ring's border is on the next ring's grid
+				const IVec2 center = IVec2(i32(floor(lpos.x / (2 * patch_size) + 0.5f)), i32(floor(lpos.y / (2 * patch_size) + 0.5f))) * 2;
+				const IVec2 from = center - IVec2(TERRAIN_RING_PATCHES / 2);
+				const IVec2 to = center + IVec2(TERRAIN_RING_PATCHES / 2);
+				const IVec2 hole_from = prev_center / 2 - IVec2(TERRAIN_RING_PATCHES / 4);
+				const IVec2 hole_to = prev_center / 2 + IVec2(TERRAIN_RING_PATCHES / 4);
+				const IVec2 hm_cells = IVec2(hm_cells_0.x >> level, hm_cells_0.y >> level) + IVec2(1);
+
+				Ring& ring = m_rings.emplace();
+				ring.from_to_sup = IVec4(from * TERRAIN_PATCH_CELLS, to * TERRAIN_PATCH_CELLS);
+				ring.pos = Vec4(pos, 0);
+				ring.lpos = Vec4(lpos.x, 0, lpos.y, 0);
+				ring.terrain_scale = Vec4(scale, 0);
+				ring.vt = IVec4(IVec2(0), IVec2(0));
+				ring.hm_size = hm_size;
+				ring.cell_size = s;
+				ring.patches_count = 0;
+				for (i32 j = from.y; j < to.y; ++j) {
+					for (i32 i = from.x; i < to.x; ++i) {
+						if (level > 0 && i >= hole_from.x && i < hole_to.x && j >= hole_from.y && j < hole_to.y) continue;
+						const IVec2 cell = IVec2(i, j) * TERRAIN_PATCH_CELLS;
+						if (cell.x + (i32)TERRAIN_PATCH_CELLS <= 0 || cell.y + (i32)TERRAIN_PATCH_CELLS <= 0) continue;
+						if (cell.x >= hm_cells.x || cell.y >= hm_cells.y) continue;
+						ring.patches[ring.patches_count] = IVec4(cell, IVec2(0));
+						++ring.patches_count;
+					}
+				}
+				if (ring.patches_count == 0) m_rings.pop();
+
+				prev_center = center;
+				s *= 2;
+				if (from.x <= 0 && from.y <= 0 && to.x * patch_size >= hm_size.x && to.y * patch_size >= hm_size.y) break;
+			}
+			inst.rings_count = m_rings.size() - inst.first_ring;
+		}
+
 		void setup() override
 		{
 			PROFILE_FUNCTION();
-			Array<TerrainInfo> infos(m_allocator);
+			Array<TerrainInfo> infos(getFrameAllocator());
 			m_pipeline->m_scene->getTerrainInfos(m_camera_params.frustum, m_camera_params.pos, infos);
 			if(infos.empty()) return;
 
@@ -2576,13 +4123,130 @@ struct PipelineImpl final : Pipeline
 				if (!info.terrain->m_heightmap->isReady()) continue;
 				
 				Instance& inst = m_instances.emplace();
-				inst.pos = (info.position - m_camera_params.pos).toFloat();
-				inst.rot = info.rot;
-				inst.scale = info.terrain->getScale();
-				inst.hm_size = info.terrain->getSize();
 				inst.program = info.shader->getProgram(gpu::VertexDecl(), m_define_mask);
+				inst.composite_program = info.shader->getProgram(gpu::VertexDecl(), m_vt_composite_define_mask);
 				inst.material = info.terrain->m_material->getRenderData();
+				inst.entity = info.terrain->getEntity();
+				inst.hm_size = info.terrain->getSize();
+				inst.scale = info.terrain->getScale();
+				inst.textures_hash = crc32(inst.material->textures, inst.material->textures_count * sizeof(inst.material->textures[0]));
+				inst.splatmap_version = info.terrain->m_splatmap ? info.terrain->m_splatmap->data_version : 0;
+				const Vec3 pos = (info.position - m_camera_params.pos).toFloat();
+				addRings(inst, pos, info.rot, inst.scale, inst.hm_size);
+			}
+		}
+
+		TerrainVirtualTexture* getVirtualTexture(const Instance& inst)
+		{
+			Renderer& renderer = m_pipeline->m_renderer;
+			HashMap<EntityRef, TerrainVirtualTexture*>& vts = m_pipeline->m_terrain_vts;
+			auto iter = vts.find(inst.entity);
+			if (iter.isValid()) {
+				TerrainVirtualTexture* vt = iter.value();
+				if (vt->hm_size.x == inst.hm_size.x && vt->hm_size.y == inst.hm_size.y) return vt;
+				vt->destroy();
+				LUMIX_DELETE(renderer.getAllocator(), vt);
+				vts.erase(iter);
 			}
+
+			TerrainVirtualTexture* vt = LUMIX_NEW(renderer.getAllocator(), TerrainVirtualTexture)(renderer.getAllocator());
+			vt->create(inst.hm_size);
+			vts.insert(inst.entity, vt);
+			return vt;
+		}
+
+		// composites pages requested by feedback, coarse first so missing fine pages fall back to them
+		void updateVirtualTexture(const Instance& inst, TerrainVirtualTexture& vt)
+		{
+			PROFILE_FUNCTION();
+			if (vt.textures_hash != inst.textures_hash || vt.splatmap_version != inst.splatmap_version) {
+				vt.textures_hash = inst.textures_hash;
+				vt.splatmap_version = inst.splatmap_version;
+				vt.flush();
+			}
+			vt.last_used_frame = m_pipeline->m_terrain_vt_frame;
+			vt.readFeedback();
+
+			struct Missing { u32 page, mip, x, y; };
+			Missing missing[TERRAIN_VT_MAX_COMPOSITES_PER_FRAME];
+			u32 missing_count = 0;
+			for (i32 mip = vt.mips - 1; mip >= 0; --mip) {
+				const u32 n = vt.pages >> mip;
+				const u32 first = vt.getPage(mip, 0, 0);
+				for (u32 i = 0; i < n * n; ++i) {
+					const u32 page = first + i;
+					if (!vt.isRequested(page)) continue;
+
+					auto iter = vt.resident.find(page);
+					if (iter.isValid()) {
+						vt.slots[iter.value()].last_used = vt.frame;
+					}
+					else if (missing_count < lengthOf(missing)) {
+						missing[missing_count] = { page, (u32)mip, i % n, i / n };
+						++missing_count;
+					}
+				}
+			}
+
+			if (missing_count == 0 || !gpu::isProgramReady(inst.composite_program)) return;
+
+			const gpu::BufferGroupHandle material_ub = m_pipeline->m_renderer.getMaterialUniformBuffer();
+			gpu::TextureHandle atlas[] = { vt.albedo, vt.normal };
+			gpu::setFramebuffer(atlas, lengthOf(atlas), (u32)gpu::FramebufferFlags::SRGB);
+			gpu::useProgram(inst.composite_program);
+			gpu::bindUniformBuffer(2, material_ub, inst.material->material_constants);
+			gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
+			gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
+			gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
+			gpu::setState(0);
+
+			const float border = TERRAIN_VT_BORDER / (float)TERRAIN_VT_PAGE_TEXELS;
+			for (u32 i = 0; i < missing_count; ++i) {
+				const Missing& m = missing[i];
+				const i32 slot_idx = vt.findFreeSlot();
+				if (slot_idx < 0) break;
+
+				TerrainVirtualTexture::Slot& slot = vt.slots[slot_idx];
+				if (slot.page != TerrainVirtualTexture::INVALID_PAGE) {
+					vt.resident.erase(slot.page);
+					vt.setPageTable(slot.mip, slot.x, slot.y, 0);
+				}
+
+				const float n = float(vt.pages >> m.mip);
+				TerrainVirtualTexture::CompositeUB ub;
+				ub.page_uv = Vec4((m.x - border) / n, (m.y - border) / n, (1 + 2 * border) / n, (1 + 2 * border) / n);
+				ub.terrain_scale = Vec4(inst.scale, 0);
+				ub.hm_size = inst.hm_size;
+				gpu::update(m_pipeline->m_drawcall_ub, &ub, sizeof(ub));
+
+				const u32 slot_x = slot_idx % TERRAIN_VT_ATLAS_SLOTS;
+				const u32 slot_y = slot_idx / TERRAIN_VT_ATLAS_SLOTS;
+				gpu::viewport(slot_x * TERRAIN_VT_SLOT_TEXELS, slot_y * TERRAIN_VT_SLOT_TEXELS, TERRAIN_VT_SLOT_TEXELS, TERRAIN_VT_SLOT_TEXELS);
+				gpu::drawArrays(0, 3, gpu::PrimitiveType::TRIANGLES);
+				m_pipeline->m_stats.draw_call_count += 1;
+
+				slot.page = m.page;
+				slot.last_used = vt.frame;
+				slot.mip = m.mip;
+				slot.x = m.x;
+				slot.y = m.y;
+				vt.resident.insert(m.page, slot_idx);
+				vt.setPageTable(m.mip, m.x, m.y, slot_x | (slot_y << 8) | 0xff000000);
+			}
+
+			m_render_targets.bind();
+		}
+
+		void collectUnusedVirtualTextures()
+		{
+			Renderer& renderer = m_pipeline->m_renderer;
+			const u32 frame = m_pipeline->m_terrain_vt_frame;
+			m_pipeline->m_terrain_vts.eraseIf([&](TerrainVirtualTexture* vt){
+				if (frame - vt->last_used_frame < TERRAIN_VT_MAX_UNUSED_FRAMES) return false;
+				vt->destroy();
+				LUMIX_DELETE(renderer.getAllocator(), vt);
+				return true;
+			});
 		}
 
 		void execute() override
@@ -2590,106 +4254,69 @@ struct PipelineImpl final : Pipeline
 			PROFILE_FUNCTION();
 			
 			const gpu::BufferGroupHandle material_ub = m_pipeline->m_renderer.getMaterialUniformBuffer();
+			const u32 indices_count = TERRAIN_PATCH_CELLS * TERRAIN_PATCH_CELLS * 6;
+
+			if (m_virtual_texture) {
+				++m_pipeline->m_terrain_vt_frame;
+				collectUnusedVirtualTextures();
+			}
 
-			u64 state = m_render_state;
 			for (Instance& inst : m_instances) {
 				Renderer& renderer = m_pipeline->m_renderer;
 				renderer.beginProfileBlock("terrain", 0);
+				TerrainVirtualTexture* vt = nullptr;
+				IVec4 vt_params(IVec2(0), IVec2(0));
+				if (m_virtual_texture) {
+					vt = getVirtualTexture(inst);
+					updateVirtualTexture(inst, *vt);
+					vt_params = IVec4(IVec2(vt->pages, vt->mips), IVec2(TERRAIN_VT_ATLAS_SLOTS, 0));
+					const gpu::TextureHandle vt_textures[] = { vt->albedo, vt->normal, vt->page_table };
+					gpu::bindTextures(vt_textures, 6, lengthOf(vt_textures));
+					gpu::bindShaderBuffer(vt->feedback_buffers[vt->frame % TERRAIN_VT_FEEDBACK_BUFFERS], 0);
+				}
+
 				gpu::useProgram(inst.program);
 				gpu::bindUniformBuffer(2, material_ub, inst.material->material_constants);
 				
-				gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
+				gpu::bindIndexBuffer(m_pipeline->m_terrain_grid_ib);
 				gpu::bindVertexBuffer(0, gpu::INVALID_BUFFER, 0, 0);
 				gpu::bindVertexBuffer(1, gpu::INVALID_BUFFER, 0, 0);
-
-				struct {
-					IVec4 from_to;
-					IVec4 from_to_sup;
-					Vec4 pos;
-					Vec4 lpos;
-					Vec4 terrain_scale;
-					Vec2 hm_size;
-					float cell_size;
-				} dc_data;
-				dc_data.pos = Vec4(inst.pos, 0);
-				dc_data.lpos = Vec4(inst.rot.conjugated().rotate(-inst.pos), 0);
-				dc_data.hm_size = inst.hm_size;
-
 				gpu::bindTextures(inst.material->textures, 0, inst.material->textures_count);
+				gpu::setState(m_render_state);
 
-				gpu::setState(state);
-				IVec4 prev_from_to;
-
-				float s = 1 / 16.f;
-				bool first = true;
-				for (;;) {
-					// round 
-					IVec2 from = IVec2((dc_data.lpos.xz() + Vec2(0.5f * s)) / float(s)) - IVec2(first ? 128 : 64);
-					from.x = from.x & ~1;
-					from.y = from.y & ~1;
-					IVec2 to = from + IVec2(first ? 256 : 128);
-					// clamp
-					dc_data.from_to_sup = IVec4(from, to);
-					
-					from.x = clamp(from.x, 0, (int)ceil(inst.hm_size.x / s));
-					from.y = clamp(from.y, 0, (int)ceil(inst.hm_size.y / s));
-					to.x = clamp(to.x, 0, (int)ceil(inst.hm_size.x / s));
-					to.y = clamp(to.y, 0, (int)ceil(inst.hm_size.y / s));
-
-					auto draw_rect = [&](const IVec2& subfrom, const IVec2& subto){
-						if (subfrom.x >= subto.x || subfrom.y >= subto.y) return;
-						dc_data.from_to = IVec4(subfrom, subto);
-						dc_data.terrain_scale = Vec4(inst.scale, 0);
-						dc_data.cell_size = s;
-						gpu::update(m_pipeline->m_drawcall_ub, &dc_data, sizeof(dc_data));
-						gpu::drawTriangleStripArraysInstanced((subto.x - subfrom.x) * 2 + 2, subto.y - subfrom.y);
-						m_pipeline->m_stats.draw_call_count += 1;
-						m_pipeline->m_stats.instance_count += 1;
-						m_pipeline->m_stats.triangle_count += (subto.x - subfrom.x) * (subto.y - subfrom.y) * 2;
-					};
-
-					if (first) {
-						draw_rect(from, to);
-						first = false;
-					}
-					else {
-						draw_rect(from, IVec2(to.x, prev_from_to.y));
-						draw_rect(IVec2(from.x, prev_from_to.w), to);
-						
-						draw_rect(IVec2(prev_from_to.z, prev_from_to.y), IVec2(to.x, prev_from_to.w));
-						draw_rect(IVec2(from.x, prev_from_to.y), IVec2(prev_from_to.x, prev_from_to.w));
-					}
-					
-					if (from.x <= 0 && from.y <= 0 && to.x * s >= inst.hm_size.x && to.y * s >= inst.hm_size.y) break;
-
-					s *= 2;
-					prev_from_to = IVec4(from / 2, to / 2);
+				for (u32 i = inst.first_ring; i < inst.first_ring + inst.rings_count; ++i) {
+					Ring& ring = m_rings[i];
+					ring.vt = vt_params;
+					const u32 size = u32(sizeof(ring) - sizeof(ring.patches) + ring.patches_count * sizeof(ring.patches[0]));
+					gpu::update(m_pipeline->m_drawcall_ub, &ring, size);
+					gpu::drawTrianglesInstanced(indices_count, ring.patches_count, gpu::DataType::U16);
+					m_pipeline->m_stats.draw_call_count += 1;
+					m_pipeline->m_stats.instance_count += ring.patches_count;
+					m_pipeline->m_stats.triangle_count += ring.patches_count * TERRAIN_PATCH_CELLS * TERRAIN_PATCH_CELLS * 2;
 				}
 
-
-
+				if (vt) {
+					gpu::memoryBarrier();
+					gpu::bindShaderBuffer(gpu::INVALID_BUFFER, 0);
+					++vt->frame;
+				}
 				renderer.endProfileBlock();
 			}
 		}
 
-		struct Instance
-		{
-			Vec2 hm_size;
-			Vec3 pos;
-			Quat rot;
-			Vec3 scale;
-			gpu::ProgramHandle program;
-			Material::RenderData* material;
-		};
-
 		IAllocator& m_allocator;
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
 		u64 m_render_state;
 		Array<Instance> m_instances;
+		Array<Ring> m_rings;
 		gpu::TextureHandle m_global_textures[16];
 		int m_global_textures_count = 0;
 		u32 m_define_mask = 0;
+		u32 m_vt_composite_define_mask = 0;
+		bool m_virtual_texture = false;
+		// the virtual texture is composited to other targets, these are bound again after it
+		RenderTargets m_render_targets;
 
 	};
 
@@ -2701,6 +4328,13 @@ struct PipelineImpl final : Pipeline
 			DEPTH
 		};
 
+		enum class StaticFilter : u8 {
+			ALL,
+			// only instances accepted by isShadowCacheable
+			STATIC,
+			DYNAMIC
+		};
+
 
 		PrepareCommandsRenderJob(IAllocator& allocator, PageAllocator& page_allocator) 
 			: m_allocator(allocator)
@@ -2710,6 +4344,9 @@ struct PipelineImpl final : Pipeline
 		}
 
 
+		// below this, the serial scatter is faster than synchronizing workers
+		static constexpr u32 PARALLEL_SORT_THRESHOLD = 64 * 1024;
+
 		struct Histogram {
 			static constexpr u32 BITS = 11;
 			static constexpr u32 SIZE = 1 << BITS;
@@ -2758,13 +4395,186 @@ struct PipelineImpl final : Pipeline
 		};
 
 
+		// single threaded, used when many small arrays are sorted in parallel
+		// the result ends up in `keys` and `values`
+		static void radixSortSerial(u64* keys, u64* values, u32 size, u64* tmp_keys, u64* tmp_values)
+		{
+			u64* const out_keys = keys;
+			u64* const out_values = values;
+			u32 histogram[Histogram::SIZE];
+			for (u32 shift = 0; shift < 64; shift += Histogram::BITS) {
+				memset(histogram, 0, sizeof(histogram));
+				bool sorted = true;
+				for (u32 i = 0; i < size; ++i) {
+					++histogram[(keys[i] >> shift) & Histogram::BIT_MASK];
+					sorted = sorted && (i == 0 || keys[i - 1] <= keys[i]);
+				}
+				if (sorted) break;
+
+				u32 offset = 0;
+				bool single_digit = false;
+				for (u32 i = 0; i < Histogram::SIZE; ++i) {
+					const u32 count = histogram[i];
+					single_digit = single_digit || count == size;
+					histogram[i] = offset;
+					offset += count;
+				}
+				// all keys have the same digit, the pass would not change the order
+				if (single_digit) continue;
+
+				for (u32 i = 0; i < size; ++i) {
+					const u32 dest = histogram[(keys[i] >> shift) & Histogram::BIT_MASK]++;
+					tmp_keys[dest] = keys[i];
+					tmp_values[dest] = values[i];
+				}
+				swap(tmp_keys, keys);
+				swap(tmp_values, values);
+			}
+
+			if (keys != out_keys) {
+				memcpy(out_keys, keys, size * sizeof(keys[0]));
+				memcpy(out_values, values, size * sizeof(values[0]));
+			}
+		}
+
+
+		// every worker counts and scatters its own fixed range of keys, ranges are laid out
+		// in order within each digit, so the sort stays stable
+		void radixSortParallel(u64* _keys, u64* _values, u32 size)
+		{
+			PROFILE_FUNCTION();
+			const u32 ranges_count = clamp(size / Histogram::STEP, 1u, JobSystem::getWorkersCount() * 2u);
+			const u32 range_size = (size + ranges_count - 1) / ranges_count;
+
+			Array<u32> histograms(getFrameAllocator());
+			histograms.resize(ranges_count * Histogram::SIZE);
+			Array<u64> tmp_mem(getFrameAllocator());
+			tmp_mem.resize(size * 2);
+
+			u64* keys = _keys;
+			u64* values = _values;
+			u64* tmp_keys = tmp_mem.begin();
+			u64* tmp_values = &tmp_mem[size];
+
+			for (u32 shift = 0; shift < 64; shift += Histogram::BITS) {
+				volatile bool sorted = true;
+				JobSystem::forEach(ranges_count, 1, [&](u32 from, u32 to){
+					PROFILE_BLOCK("histogram");
+					for (u32 r = from; r < to; ++r) {
+						u32* histogram = &histograms[r * Histogram::SIZE];
+						memset(histogram, 0, sizeof(u32) * Histogram::SIZE);
+						const u32 begin = r * range_size;
+						const u32 end = minimum(size, begin + range_size);
+						bool range_sorted = true;
+						for (u32 i = begin; i < end; ++i) {
+							++histogram[(keys[i] >> shift) & Histogram::BIT_MASK];
+							range_sorted = range_sorted && (i == 0 || keys[i - 1] <= keys[i]);
+						}
+						if (!range_sorted) sorted = false;
+					}
+				});
+				if (sorted) break;
+
+				u32 offset = 0;
+				bool single_digit = false;
+				for (u32 digit = 0; digit < Histogram::SIZE; ++digit) {
+					const u32 digit_begin = offset;
+					for (u32 r = 0; r < ranges_count; ++r) {
+						u32& count = histograms[r * Histogram::SIZE + digit];
+						const u32 tmp = count;
+						count = offset;
+						offset += tmp;
+					}
+					single_digit = single_digit || offset - digit_begin == size;
+				}
+				if (single_digit) continue;
+
+				JobSystem::forEach(ranges_count, 1, [&](u32 from, u32 to){
+					PROFILE_BLOCK("scatter");
+					for (u32 r = from; r < to; ++r) {
+						u32* histogram = &histograms[r * Histogram::SIZE];
+						const u32 begin = r * range_size;
+						const u32 end = minimum(size, begin + range_size);
+						for (u32 i = begin; i < end; ++i) {
+							const u32 dest = histogram[(keys[i] >> shift) & Histogram::BIT_MASK]++;
+							tmp_keys[dest] = keys[i];
+							tmp_values[dest] = values[i];
+						}
+					}
+				});
+				swap(tmp_keys, keys);
+				swap(tmp_values, values);
+			}
+
+			if (keys != _keys) {
+				memcpy(_keys, keys, size * sizeof(keys[0]));
+				memcpy(_values, values, size * sizeof(values[0]));
+			}
+		}
+
+
+		// keys have the bucket in the top byte, so splitting by it first and sorting each bucket
+		// on its own gives the same order, buckets are smaller and are sorted in parallel
+		void radixSortPerBucket(u64* keys, u64* values, u32 size)
+		{
+			PROFILE_FUNCTION();
+			u32 offsets[257] = {};
+			for (u32 i = 0; i < size; ++i) {
+				++offsets[(keys[i] >> 56) + 1];
+			}
+			for (u32 i = 1; i < lengthOf(offsets); ++i) {
+				offsets[i] += offsets[i - 1];
+			}
+
+			Array<u64> tmp_mem(getFrameAllocator());
+			tmp_mem.resize(size * 2);
+			u64* tmp_keys = tmp_mem.begin();
+			u64* tmp_values = &tmp_mem[size];
+
+			u32 heads[256];
+			memcpy(heads, offsets, sizeof(heads));
+			for (u32 i = 0; i < size; ++i) {
+				const u32 dest = heads[keys[i] >> 56]++;
+				tmp_keys[dest] = keys[i];
+				tmp_values[dest] = values[i];
+			}
+			memcpy(keys, tmp_keys, size * sizeof(keys[0]));
+			memcpy(values, tmp_values, size * sizeof(values[0]));
+
+			u8 buckets[256];
+			u32 buckets_count = 0;
+			for (u32 i = 0; i < 256; ++i) {
+				if (offsets[i + 1] > offsets[i]) buckets[buckets_count++] = u8(i);
+			}
+
+			JobSystem::forEach(buckets_count, 1, [&](u32 from, u32 to){
+				PROFILE_BLOCK("sort bucket");
+				for (u32 b = from; b < to; ++b) {
+					const u32 begin = offsets[buckets[b]];
+					const u32 count = offsets[buckets[b] + 1] - begin;
+					radixSortSerial(keys + begin, values + begin, count, tmp_keys + begin, tmp_values + begin);
+				}
+			});
+		}
+
+
 		void radixSort(u64* _keys, u64* _values, int size)
 		{
 			PROFILE_FUNCTION();
 			Profiler::pushInt("count", size);
 			if(size == 0) return;
+			
+			if (m_sort_per_bucket) {
+				radixSortPerBucket(_keys, _values, size);
+				return;
+			}
+
+			if (size >= PARALLEL_SORT_THRESHOLD) {
+				radixSortParallel(_keys, _values, size);
+				return;
+			}
 
-			Array<u64> tmp_mem(m_allocator);
+			Array<u64> tmp_mem(getFrameAllocator());
 
 			u64* keys = _keys;
 			u64* values = _values;
@@ -2818,22 +4628,35 @@ struct PipelineImpl final : Pipeline
 		{
 			ASSERT(renderables);
 			if (renderables->header.count == 0 && !renderables->header.next) return;
+			const StaticFilter static_filter = m_static_filter;
+			if (static_filter == StaticFilter::STATIC && type != RenderableTypes::MESH && type != RenderableTypes::MESH_GROUP) return;
 			PagedListIterator<const CullResult> iterator(renderables);
 			
 			const u8 local_light_layer = m_pipeline->m_renderer.getLayerIdx("local_light");
 			const u8 local_light_bucket = m_bucket_map[local_light_layer];
+			const u8 baked_define = m_pipeline->m_renderer.getShaderDefineIdx("BAKED_ANIM");
 			
 			JobSystem::runOnWorkers([&](){
 				PROFILE_BLOCK("create keys");
 				int total = 0;
 				const auto* bucket_map = m_bucket_map;
 				RenderScene* scene = m_pipeline->m_scene;
-				const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
+				ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
 				const MeshSortData* LUMIX_RESTRICT mesh_data = scene->getMeshSortData();
 				MTBucketArray<u64>::Bucket result = sort_keys.begin();
-				const Transform* LUMIX_RESTRICT entity_data = scene->getUniverse().getTransforms();
+				const DVec3* LUMIX_RESTRICT positions = scene->getUniverse().getPositions();
+				const float* LUMIX_RESTRICT scales = scene->getUniverse().getScales();
 				const DVec3 camera_pos = m_camera_params.pos;
 				const u64 type_mask = (u64)type << 32;
+				const bool gpu_culling = m_gpu_culling;
+				// texture streaming feedback, texels needed to cover a mesh are estimated from its bounding sphere
+				const bool request_textures = !m_camera_params.is_shadow && m_pipeline->m_renderer.getTextureStreamingBudget() > 0;
+				const Viewport& vp = m_pipeline->m_viewport;
+				const float px_per_unit = vp.is_ortho ? vp.h / (2 * vp.ortho_size) : vp.h / (2 * tanf(vp.fov * 0.5f));
+				const float lod_multiplier = m_camera_params.lod_multiplier;
+				const float lod_hysteresis = scene->getLODHysteresis();
+				// shadows follow LODs selected by the camera
+				const bool update_lods = !m_camera_params.is_shadow;
 				
 				for(;;) {
 					const CullResult* page = iterator.next();
@@ -2860,6 +4683,7 @@ struct PipelineImpl final : Pipeline
 								ASSERT(terrain->m_grass_quads[0].size() < 0xffff);
 								for (u16 q = 0; q < terrain->m_grass_quads[0].size(); ++q) {
 									const Terrain::GrassQuad* quad = terrain->m_grass_quads[0][q];
+									if (!quad->isReady()) continue;
 									const DVec3 quad_pos = tr.transform(DVec3(quad->pos));
 									if (!m_camera_params.frustum.intersectsAABB(quad_pos - DVec3(quad->radius), Vec3(2 * quad->radius))) continue;
 
@@ -2902,11 +4726,20 @@ struct PipelineImpl final : Pipeline
 								const MeshSortData& mesh = mesh_data[e.index];
 								const u32 bucket = bucket_map[mesh.layer];
 								const u64 subrenderable = e.index | type_mask;
+								if (static_filter != StaticFilter::ALL && isShadowCacheable(model_instances[e.index]) != (static_filter == StaticFilter::STATIC)) continue;
+								if (request_textures) {
+									const ModelInstance& mi = model_instances[e.index];
+									const float diameter = 2 * mi.model->getBoundingRadius() * scales[e.index];
+									const float dist = vp.is_ortho ? 1 : maximum(float((positions[e.index] - camera_pos).length()), 0.01f);
+									const u32 texture_size = u32(diameter * px_per_unit / dist);
+									if (texture_size > 0) mi.meshes[0].material->requestTextureSize(texture_size);
+								}
+								if (bucket < 0xff && gpu_culling && isGPUCullable(model_instances[e.index])) continue;
 								if (bucket < 0xff) {
 									const u64 key = ((u64)mesh.sort_key << 32) | ((u64)bucket << 56);
 									result.push(key, subrenderable);
 								} else if (bucket < 0xffFF) {
-									const DVec3 pos = entity_data[e.index].pos;
+									const DVec3 pos = positions[e.index];
 									const DVec3 rel_pos = pos - camera_pos;
 									const float squared_length = float(rel_pos.x * rel_pos.x + rel_pos.y * rel_pos.y + rel_pos.z * rel_pos.z);
 									const u32 depth_bits = floatFlip(*(u32*)&squared_length);
@@ -2920,21 +4753,46 @@ struct PipelineImpl final : Pipeline
 						case RenderableTypes::MESH_GROUP: {
 							for (int i = 0, c = page->header.count; i < c; ++i) {
 								const EntityRef e = renderables[i];
-								const DVec3 pos = entity_data[e.index].pos;
+								const DVec3 pos = positions[e.index];
 								const ModelInstance& mi = model_instances[e.index];
+								if (static_filter != StaticFilter::ALL && isShadowCacheable(mi) != (static_filter == StaticFilter::STATIC)) continue;
 								const float squared_length = float((pos - camera_pos).squaredLength());
-								const LODMeshIndices lod = mi.model->getLODMeshIndices(squared_length);
+								// LOD distances are authored for the model's own size, projected size of an instance grows with its scale
+								const float scale = scales[e.index];
+								const u32 lod_idx = mi.model->selectLOD(squared_length * lod_multiplier / (scale * scale), mi.lod, lod_hysteresis);
+								if (update_lods) model_instances[e.index].lod = u8(lod_idx);
+								const LODMeshIndices lod = mi.model->requestLOD(lod_idx);
+								u32 texture_size = 0;
+								if (request_textures) {
+									const float diameter = 2 * mi.model->getBoundingRadius() * scales[e.index];
+									const float dist = vp.is_ortho ? 1 : maximum(sqrtf(squared_length), 0.01f);
+									texture_size = u32(diameter * px_per_unit / dist);
+								}
+								const bool gpu_culled = gpu_culling && type == RenderableTypes::MESH_GROUP && isGPUCullable(mi);
+								// instances playing the same baked animation end up next to each other and are drawn together
+								u32 baked_animation = BakedAnimation::INVALID;
+								if (type == RenderableTypes::SKINNED && mi.flags.isSet(ModelInstance::BAKED_ANIMATION)) {
+									const BakedAnimationInstance* baked = scene->getModelInstanceBakedAnimation(e);
+									const BakedAnimation* anim = baked ? scene->getBakedAnimation(baked->animation) : nullptr;
+									if (anim && anim->bones_count == (u32)mi.model->getBoneCount()) baked_animation = baked->animation;
+								}
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
 									const Mesh& mesh = mi.meshes[mesh_idx];
+									if (texture_size > 0) mesh.material->requestTextureSize(texture_size);
 									const u32 bucket = bucket_map[mesh.layer];
-									const RenderableTypes mesh_type = mesh.type == Mesh::RIGID ? RenderableTypes::MESH_GROUP : RenderableTypes::SKINNED;
+									if (gpu_culled && bucket < 0xff) continue;
+									RenderableTypes mesh_type = mesh.type == Mesh::RIGID ? RenderableTypes::MESH_GROUP : RenderableTypes::SKINNED;
+									if (mesh_type == RenderableTypes::SKINNED && baked_animation != BakedAnimation::INVALID && mesh.material->getShader()->hasDefine(baked_define)) {
+										mesh_type = BAKED_SKINNED_COMMAND;
+									}
 									const u64 type_mask = (u64)mesh_type << 32;
 									const u64 subrenderable = e.index | type_mask | ((u64)mesh_idx << 40);
 									if (bucket < 0xff) {
-										const u64 key = ((u64)mesh.sort_key << 32) | ((u64)bucket << 56);
+										const u64 baked_bits = mesh_type == BAKED_SKINNED_COMMAND ? baked_animation : 0;
+										const u64 key = ((u64)mesh.sort_key << 32) | ((u64)bucket << 56) | baked_bits;
 										result.push(key, subrenderable);
 									} else if (bucket < 0xffFF) {
-										const DVec3 pos = entity_data[e.index].pos;
+										const DVec3 pos = positions[e.index];
 										const DVec3 rel_pos = pos - camera_pos;
 										const float squared_length = float(rel_pos.x * rel_pos.x + rel_pos.y * rel_pos.y + rel_pos.z * rel_pos.z);
 										const u32 depth_bits = floatFlip(*(u32*)&squared_length);
@@ -2953,6 +4811,72 @@ struct PipelineImpl final : Pipeline
 		}
 
 
+		// removes meshes hidden behind model instances flagged as occluders
+		void cullOccluded(CullResult* meshes, CullResult* mesh_groups)
+		{
+			PROFILE_FUNCTION();
+			RenderScene* scene = m_pipeline->m_scene;
+			const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
+			const Universe& universe = scene->getUniverse();
+			const DVec3* LUMIX_RESTRICT positions = universe.getPositions();
+			const DVec3 camera_pos = m_camera_params.pos;
+
+			Array<MeshInstance> occluders(m_allocator);
+			auto gatherOccluders = [&](const CullResult* renderables){
+				if (!renderables) return;
+				renderables->forEach([&](EntityRef e){
+					const ModelInstance& mi = model_instances[e.index];
+					if (!mi.flags.isSet(ModelInstance::OCCLUDER)) return;
+					const float squared_length = float((positions[e.index] - camera_pos).squaredLength());
+					const LODMeshIndices lod = mi.model->getLODMeshIndices(squared_length);
+					for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
+						const Mesh& mesh = mi.meshes[mesh_idx];
+						if (mesh.type != Mesh::RIGID) continue;
+						occluders.push({e, &mesh, 0});
+					}
+				});
+			};
+			gatherOccluders(meshes);
+			gatherOccluders(mesh_groups);
+			Profiler::pushInt("occluders", occluders.size());
+			if (occluders.empty()) return;
+
+			OcclusionBuffer buffer(m_allocator);
+			buffer.setCamera(camera_pos, m_camera_params.view, m_camera_params.projection);
+			buffer.clear();
+			buffer.rasterize(&scene->getUniverse(), occluders);
+			buffer.buildHierarchy();
+
+			auto removeOccluded = [&](CullResult* renderables){
+				if (!renderables) return;
+				PagedListIterator<CullResult> iterator(renderables);
+				JobSystem::runOnWorkers([&](){
+					PROFILE_BLOCK("occlusion test");
+					u32 culled = 0;
+					for (;;) {
+						CullResult* page = iterator.next();
+						if (!page) break;
+						u32 count = 0;
+						for (u32 i = 0, c = page->header.count; i < c; ++i) {
+							const EntityRef e = page->entities[i];
+							const ModelInstance& mi = model_instances[e.index];
+							// occluders would hide themselves
+							if (mi.flags.isSet(ModelInstance::OCCLUDER) || !buffer.isOccluded(universe.getTransform(e), mi.model->getAABB())) {
+								page->entities[count] = e;
+								++count;
+							}
+						}
+						culled += page->header.count - count;
+						page->header.count = count;
+					}
+					Profiler::pushInt("culled", culled);
+				});
+			};
+			removeOccluded(meshes);
+			removeOccluded(mesh_groups);
+		}
+
+
 		void setup() override
 		{
 			PROFILE_FUNCTION();
@@ -2970,20 +4894,39 @@ struct PipelineImpl final : Pipeline
 				RenderableTypes::GRASS,
 				RenderableTypes::LOCAL_LIGHT
 			};
+			CullResult* cull_results[lengthOf(types)] = {};
+			const bool shared_cull = m_shared_cull_slot >= 0;
+			if (shared_cull) JobSystem::wait(m_pipeline->m_shared_cull.signal);
 			JobSystem::forEach(lengthOf(types), [&](int idx){
 				if (m_camera_params.is_shadow && types[idx] == RenderableTypes::GRASS) return;
-				CullResult* renderables = scene->getRenderables(m_camera_params.frustum, types[idx]);
-				if (renderables) {
-					createSortKeys(renderables, types[idx], *sort_keys);
-					renderables->free(m_pipeline->m_renderer.getEngine().getPageAllocator());
+				CullResult* renderables = shared_cull && types[idx] != RenderableTypes::GRASS
+					? m_pipeline->m_shared_cull.results[m_shared_cull_slot][(u32)types[idx]]
+					: scene->getRenderables(m_camera_params.frustum, types[idx]);
+				if (!renderables) return;
+				if (m_occlusion_culling) {
+					// keys are created after the occluded renderables are removed
+					cull_results[idx] = renderables;
+					return;
 				}
+				createSortKeys(renderables, types[idx], *sort_keys);
+				renderables->free(m_pipeline->m_renderer.getEngine().getPageAllocator());
 			});
+
+			if (m_occlusion_culling) {
+				cullOccluded(cull_results[0], cull_results[1]);
+				JobSystem::forEach(lengthOf(types), [&](int idx){
+					if (!cull_results[idx]) return;
+					createSortKeys(cull_results[idx], types[idx], *sort_keys);
+					cull_results[idx]->free(m_pipeline->m_renderer.getEngine().getPageAllocator());
+				});
+			}
 			sort_keys->merge();
 
 			if (sort_keys->size() > 0) {
 				radixSort(sort_keys->key_ptr(), sort_keys->value_ptr(), sort_keys->size());
 				createCommands(sort_keys->value_ptr(), sort_keys->key_ptr(), sort_keys->size());
 			}
+			if (m_gpu_culling) createIndirectCommands();
 
 			MTBucketArray<u64>::freeArray(sort_keys);
 		}
@@ -3012,7 +4955,9 @@ struct PipelineImpl final : Pipeline
 			RenderScene* scene = m_pipeline->m_scene;
 			const ShiftedFrustum frustum = m_camera_params.frustum;
 			const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
-			const Transform* LUMIX_RESTRICT entity_data = universe.getTransforms(); 
+			const DVec3* LUMIX_RESTRICT positions = universe.getPositions();
+			const Quat* LUMIX_RESTRICT rotations = universe.getRotations();
+			const float* LUMIX_RESTRICT scales = universe.getScales();
 			const DVec3 camera_pos = m_camera_params.pos;
 				
 			CmdPage* cmd_page = first_page;
@@ -3025,6 +4970,7 @@ struct PipelineImpl final : Pipeline
 			u32 instanced_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("INSTANCED"));
 			u32 skinned_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("SKINNED"));
 			u32 grass_define_mask = define_mask | (1 << renderer.getShaderDefineIdx("GRASS"));
+			const u32 baked_define = 1 << renderer.getShaderDefineIdx("BAKED_ANIM");
 
 			auto new_page = [&](u8 bucket){
 				cmd_page->header.size = int(out - cmd_page->data);
@@ -3059,21 +5005,17 @@ struct PipelineImpl final : Pipeline
 						while (i < c && (sort_keys[i] & instance_key_mask) == key) {
 							++i;
 						}
-						const u16 count = u16(i - start_i);
-						const Renderer::TransientSlice slice = renderer.allocTransient(count * sizeof(Vec4) * 2);
-						u8* instance_data = slice.ptr;
-						for (int j = start_i; j < start_i + count; ++j) {
+						const u32 count = u32(i - start_i);
+						const Renderer::TransientSlice slice = renderer.allocTransient(count * sizeof(MeshInstanceData));
+						MeshInstanceData* instance_data = (MeshInstanceData*)slice.ptr;
+						for (u32 j = start_i; j < start_i + count; ++j) {
 							const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
-							const Transform& tr = entity_data[e.index];
-							const Vec3 lpos = (tr.pos - camera_pos).toFloat();
-							memcpy(instance_data, &tr.rot, sizeof(tr.rot));
-							instance_data += sizeof(tr.rot);
-							memcpy(instance_data, &lpos, sizeof(lpos));
-							instance_data += sizeof(lpos);
-							memcpy(instance_data, &tr.scale, sizeof(tr.scale));
-							instance_data += sizeof(tr.scale);
+							instance_data->rot = PackedQuat(rotations[e.index]);
+							instance_data->pos = (positions[e.index] - camera_pos).toFloat();
+							instance_data->scale = scales[e.index];
+							++instance_data;
 						}
-						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 34) {
+						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 36) {
 							new_page(bucket);
 						}
 
@@ -3095,35 +5037,84 @@ struct PipelineImpl final : Pipeline
 					case RenderableTypes::SKINNED: {
 						const u32 mesh_idx = renderables[i] >> 40;
 						const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
-						const Transform& tr = entity_data[e.index];
-						const Vec3 rel_pos = (tr.pos - camera_pos).toFloat();
+						const Vec3 rel_pos = (positions[e.index] - camera_pos).toFloat();
 						const Mesh& mesh = mi->meshes[mesh_idx];
 						Shader* shader = mesh.material->getShader();
 						const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, skinned_define_mask | mesh.material->getDefineMask());
 
-						if (u32(cmd_page->data + sizeof(cmd_page->data) - out) < (u32)mi->pose->count * sizeof(Matrix) + 57) {
+						if (u32(cmd_page->data + sizeof(cmd_page->data) - out) < 69) {
 							new_page(bucket);
 						}
 
+						const BonePalette palette = m_pipeline->getBonePalette(e, *mi);
+						const u32 skinned_offset = m_pipeline->getSkinnedVertices(e, mesh_idx, *mi);
+						const gpu::ProgramHandle rigid_prog = skinned_offset != SkinningLayout::MISSING
+							? shader->getProgram(mesh.vertex_decl, define_mask | mesh.material->getDefineMask())
+							: gpu::INVALID_PROGRAM;
+
 						WRITE(type);
 						WRITE(mesh.render_data);
 						WRITE_FN(mesh.material->getRenderData());
 						WRITE(prog);
 						WRITE(rel_pos);
-						WRITE(tr.rot);
-						WRITE(tr.scale);
-						WRITE(mi->pose->count);
-
-						const Quat* rotations = mi->pose->rotations;
-						const Vec3* positions = mi->pose->positions;
-
-						Model& model = *mi->model;
-						for (int j = 0, c = mi->pose->count; j < c; ++j) {
-							const Model::Bone& bone = model.getBone(j);
-							const LocalRigidTransform tmp = {positions[j], rotations[j]};
-							const Matrix m = (tmp * bone.inv_bind_transform).toMatrix();
-							WRITE(m);
+						WRITE(rotations[e.index]);
+						WRITE(scales[e.index]);
+						WRITE(palette.buffer);
+						WRITE(palette.offset);
+						WRITE(rigid_prog);
+						WRITE(skinned_offset);
+						break;
+					}
+					case BAKED_SKINNED_COMMAND: {
+						const u32 mesh_idx = renderables[i] >> 40;
+						const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
+						const BakedAnimationInstance* baked = scene->getModelInstanceBakedAnimation(e);
+						const u32 animation = baked->animation;
+						const u64 key = sort_keys[i] & instance_key_mask;
+						const u64 subrenderable = renderables[i] & 0xffff'ffff'0000'0000;
+						int start_i = i;
+						while (i < c
+							&& (sort_keys[i] & instance_key_mask) == key
+							&& (renderables[i] & 0xffff'ffff'0000'0000) == subrenderable
+							&& scene->getModelInstanceBakedAnimation({int(renderables[i] & 0xFFffFFff)})->animation == animation)
+						{
+							++i;
 						}
+						const u32 count = u32(i - start_i);
+						const Renderer::TransientSlice slice = renderer.allocTransient(count * sizeof(BakedInstanceData));
+						BakedInstanceData* instance_data = (BakedInstanceData*)slice.ptr;
+						for (u32 j = start_i; j < start_i + count; ++j) {
+							const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
+							const BakedAnimationInstance* inst = scene->getModelInstanceBakedAnimation(e);
+							instance_data->rot = rotations[e.index];
+							instance_data->pos = (positions[e.index] - camera_pos).toFloat();
+							instance_data->scale = scales[e.index];
+							instance_data->first_frame = inst->clip.first_frame;
+							instance_data->frames_count = inst->clip.frames_count;
+							instance_data->fps = inst->clip.fps;
+							instance_data->time_offset = inst->time_offset;
+							++instance_data;
+						}
+						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 45) {
+							new_page(bucket);
+						}
+
+						const BakedAnimation* anim = scene->getBakedAnimation(animation);
+						const Mesh& mesh = mi->meshes[mesh_idx];
+						Shader* shader = mesh.material->getShader();
+						const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, skinned_define_mask | baked_define | mesh.material->getDefineMask());
+
+						WRITE(type);
+						WRITE(mesh.render_data);
+						WRITE_FN(mesh.material->getRenderData());
+						WRITE(prog);
+						WRITE(count);
+						WRITE(slice.buffer);
+						WRITE(slice.offset);
+						WRITE(anim->buffer);
+						WRITE(anim->bones_count);
+
+						--i;
 						break;
 					}
 					case RenderableTypes::DECAL: {
@@ -3150,12 +5141,11 @@ struct PipelineImpl final : Pipeline
 						u8* mem = slice.ptr;
 						for(u32 j = start_i; j < i; ++j) {
 							const EntityRef e = {int(renderables[j] & 0x00ffFFff)};
-							const Transform& tr = entity_data[e.index];
-							const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+							const Vec3 lpos = (positions[e.index] - camera_pos).toFloat();
 							memcpy(mem, &lpos, sizeof(lpos));
 							mem += sizeof(lpos);
-							memcpy(mem, &tr.rot, sizeof(tr.rot));
-							mem += sizeof(tr.rot);
+							memcpy(mem, &rotations[e.index], sizeof(rotations[e.index]));
+							mem += sizeof(rotations[e.index]);
 							const Vec3 half_extents = scene->getDecalHalfExtents(e);
 							memcpy(mem, &half_extents, sizeof(half_extents));
 							mem += sizeof(half_extents);
@@ -3170,7 +5160,9 @@ struct PipelineImpl final : Pipeline
 							++i;
 						}
 
-						const Renderer::TransientSlice slice = renderer.allocTransient((i - start_i) * sizeof(float) * 16);
+						// LightData of all lights, followed by a tile in the local shadow atlas for each light
+						const u32 lights_count = i - start_i;
+						const Renderer::TransientSlice slice = renderer.allocTransient(lights_count * (sizeof(float) * 16 + sizeof(Vec4)));
 						struct LightData {
 							Quat rot;
 							Vec3 pos;
@@ -3182,23 +5174,28 @@ struct PipelineImpl final : Pipeline
 						};
 
 						LightData* beg = (LightData*)slice.ptr;
-						LightData* end = (LightData*)(slice.ptr + slice.size - sizeof(LightData));
+						LightData* end = beg + lights_count - 1;
+						Vec4* shadow_tiles = (Vec4*)(beg + lights_count);
 
 						for (u32 j = start_i; j < i; ++j) {
 							const EntityRef e = {int(renderables[j] & 0x00ffFFff)};
-							const Transform& tr = entity_data[e.index];
-							const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+							const Vec3 lpos = (positions[e.index] - camera_pos).toFloat();
 							const PointLight& pl = scene->getPointLight(e);
-							const bool intersecting = frustum.intersectNearPlane(tr.pos, pl.range * SQRT3);
+							const bool intersecting = frustum.intersectNearPlane(positions[e.index], pl.range * SQRT3);
 							
 							LightData* iter = intersecting ? end : beg;
 							iter->pos = lpos;
-							iter->rot = tr.rot;
+							iter->rot = rotations[e.index];
 							iter->range = pl.range;
 							iter->attenuation = pl.attenuation_param;
 							iter->color = pl.color * pl.intensity;
-							iter->dir = tr.rot * Vec3(0, 0, 1);
+							iter->dir = rotations[e.index] * Vec3(0, 0, 1);
 							iter->fov = pl.fov;
+							Vec4& shadow_tile = shadow_tiles[iter - (LightData*)slice.ptr];
+							shadow_tile = Vec4(0);
+							for (u32 k = 0; k < m_local_shadows_count; ++k) {
+								if (m_local_shadows[k].entity == e) shadow_tile = m_local_shadows[k].rect;
+							}
 							intersecting ? --end : ++beg;
 						}
 						if ((cmd_page->data + sizeof(cmd_page->data) - out) < 9) {
@@ -3216,8 +5213,7 @@ struct PipelineImpl final : Pipeline
 						break;
 					}
 					case RenderableTypes::GRASS: {
-						const Transform& tr = entity_data[e.index];
-						const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+						const Vec3 lpos = (positions[e.index] - camera_pos).toFloat();
 
 						u32 start_i = i;
 						const u64 sort_key_mask = 0xffFFffFF;
@@ -3257,7 +5253,7 @@ struct PipelineImpl final : Pipeline
 						const gpu::ProgramHandle prg = shader->getProgram(mesh->vertex_decl, grass_define_mask | mesh->material->getDefineMask());
 
 						WRITE(type);
-						WRITE(tr.rot);
+						WRITE(rotations[e.index]);
 						WRITE(lpos);
 						WRITE(distance);
 						WRITE(mesh->render_data);
@@ -3286,14 +5282,12 @@ struct PipelineImpl final : Pipeline
 			const i32 steps = (size + STEP - 1) / STEP;
 			CmdPage* prev = nullptr;
 			CmdPage* first = nullptr;
-			m_page_allocator.lock();
 			for (i32 i = 0; i < steps; ++i) {
-				CmdPage* page = new (NewPlaceholder(), m_page_allocator.allocate(false)) CmdPage;
+				CmdPage* page = new (NewPlaceholder(), m_page_allocator.allocate(true)) CmdPage;
 				if (i == 0) first = page;
 				if (prev) prev->header.next_init = page;
 				prev = page;
 			}
-			m_page_allocator.unlock();
 	
 			volatile i32 counter = 0;
 			JobSystem::runOnWorkers([&](){
@@ -3329,7 +5323,112 @@ struct PipelineImpl final : Pipeline
 		}
 
 
-		void execute() override {}
+		// called on main thread, static instances are culled in execute()
+		void prepareGPUCulling()
+		{
+			Shader* shader = m_pipeline->m_gpu_cull_shader;
+			if (!shader->isReady()) return;
+
+			m_pipeline->updateStaticInstances();
+			const StaticInstances& si = m_pipeline->m_static_instances;
+			if (si.instances_count == 0) return;
+
+			m_gpu_culling = true;
+			m_pipeline->m_gpu_culling_used = true;
+			m_gpu_cull_program = shader->getProgram(gpu::VertexDecl(), 0);
+			m_indirect_commands = m_pipeline->m_renderer.copy(si.commands.begin(), si.commands.byte_size());
+			m_static_instances_buffer = si.instances_buffer;
+			m_indirect_buffer = si.commands_buffer;
+			m_bounds_buffer = si.bounds_buffer;
+			m_culled_buffer = si.culled_buffer;
+
+			const Frustum frustum = m_camera_params.frustum.getRelative(m_camera_params.pos);
+			for (u32 i = 0; i < lengthOf(m_cull_state.planes); ++i) {
+				m_cull_state.planes[i] = Vec4(frustum.xs[i], frustum.ys[i], frustum.zs[i], frustum.ds[i]);
+			}
+			const DVec3 pos = m_camera_params.pos;
+			const Vec3 pos_hi = pos.toFloat();
+			m_cull_state.camera_hi = Vec4(pos_hi, 0);
+			m_cull_state.camera_lo = Vec4(float(pos.x - pos_hi.x), float(pos.y - pos_hi.y), float(pos.z - pos_hi.z), 0);
+			m_cull_state.instances_count = si.instances_count;
+		}
+
+
+		// one draw per static mesh, instance counts are written by gpu_cull.shd
+		void createIndirectCommands()
+		{
+			PROFILE_FUNCTION();
+			Renderer& renderer = m_pipeline->m_renderer;
+			const StaticInstances& si = m_pipeline->m_static_instances;
+			const u32 instanced_define = 1 << renderer.getShaderDefineIdx("INSTANCED");
+			const u32 cmd_size = sizeof(RenderableTypes)
+				+ sizeof(Mesh::RenderData*)
+				+ sizeof(Material::RenderData*)
+				+ sizeof(gpu::ProgramHandle)
+				+ (sizeof(gpu::BufferHandle) + sizeof(u32)) * 2
+				+ sizeof(u32);
+
+			for (const StaticInstances::Draw& draw : si.draws) {
+				const Mesh& mesh = *draw.mesh;
+				const u32 bucket = m_bucket_map[mesh.layer];
+				if (bucket >= 0xff) continue;
+
+				CmdPage* page = m_command_sets[bucket];
+				if (sizeof(page->data) - page->header.size < cmd_size) {
+					CmdPage* new_page = new (NewPlaceholder(), m_page_allocator.allocate(true)) CmdPage;
+					new_page->header.bucket = (u8)bucket;
+					page->header.next = new_page;
+					m_command_sets[bucket] = new_page;
+					page = new_page;
+				}
+
+				Shader* shader = mesh.material->getShader();
+				const gpu::ProgramHandle prog = shader->getProgram(mesh.vertex_decl, m_define_mask[bucket] | instanced_define | mesh.material->getDefineMask());
+				const Material::RenderData* material = mesh.material->getRenderData();
+				const u32 indirect_offset = draw.first_command * sizeof(IndirectCommand);
+				const u32 culled_offset = si.commands[draw.first_command].first_culled * sizeof(MeshInstanceData);
+
+				u8* out = page->data + page->header.size;
+				auto write = [&](const auto& value) {
+					memcpy(out, &value, sizeof(value));
+					out += sizeof(value);
+				};
+				write(INDIRECT_MESH_COMMAND);
+				write(mesh.render_data);
+				write(material);
+				write(prog);
+				write(m_indirect_buffer);
+				write(indirect_offset);
+				write(draw.commands_count);
+				write(m_culled_buffer);
+				write(culled_offset);
+				page->header.size = int(out - page->data);
+			}
+		}
+
+
+		void execute() override
+		{
+			if (!m_gpu_culling) return;
+
+			PROFILE_FUNCTION();
+			gpu::pushDebugGroup("GPU culling");
+			// resets instance counts
+			gpu::update(m_indirect_buffer, m_indirect_commands.data, m_indirect_commands.size);
+			m_pipeline->m_renderer.free(m_indirect_commands);
+
+			gpu::update(m_pipeline->m_gpu_cull_ub, &m_cull_state, sizeof(m_cull_state));
+			gpu::bindUniformBuffer(3, m_pipeline->m_gpu_cull_ub, sizeof(m_cull_state));
+			gpu::bindShaderBuffer(m_static_instances_buffer, 0);
+			gpu::bindShaderBuffer(m_indirect_buffer, 1);
+			gpu::bindShaderBuffer(m_culled_buffer, 2);
+			gpu::bindShaderBuffer(m_bounds_buffer, 3);
+			gpu::useProgram(m_gpu_cull_program);
+			gpu::dispatch((m_cull_state.instances_count + 255) / 256, 1, 1);
+			gpu::memoryBarrier();
+			for (u32 i = 0; i < 4; ++i) gpu::bindShaderBuffer(gpu::INVALID_BUFFER, i);
+			gpu::popDebugGroup();
+		}
 
 		IAllocator& m_allocator;
 		PageAllocator& m_page_allocator;
@@ -3342,6 +5441,20 @@ struct PipelineImpl final : Pipeline
 		SortOrder m_bucket_sort_order[255] = {};
 		u32 m_define_mask[255];
 		u8 m_bucket_count;
+		LocalShadowTile m_local_shadows[MAX_LOCAL_SHADOWS];
+		u32 m_local_shadows_count = 0;
+		bool m_sort_per_bucket = false;
+		bool m_occlusion_culling = false;
+		StaticFilter m_static_filter = StaticFilter::ALL;
+		bool m_gpu_culling = false;
+		i32 m_shared_cull_slot = -1;
+		gpu::ProgramHandle m_gpu_cull_program;
+		GPUCullState m_cull_state;
+		Renderer::MemRef m_indirect_commands;
+		gpu::BufferHandle m_static_instances_buffer;
+		gpu::BufferHandle m_indirect_buffer;
+		gpu::BufferHandle m_bounds_buffer;
+		gpu::BufferHandle m_culled_buffer;
 	};
 
 
@@ -3366,6 +5479,74 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	void clearRect(u32 flags, int x, int y, int w, int h, float r, float g, float b, float a, float depth)
+	{
+		struct Cmd : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::clear(flags, &color.x, depth, x, y, w, h);
+			}
+			Vec4 color;
+			float depth;
+			u32 flags;
+			u32 x, y, w, h;
+		};
+
+		if (x < 0 || y < 0 || w <= 0 || h <= 0) return;
+		Cmd* cmd = LUMIX_NEW(m_renderer.getAllocator(), Cmd);
+		cmd->color.set(r, g, b, a);
+		cmd->flags = flags;
+		cmd->depth = depth;
+		cmd->x = x;
+		cmd->y = y;
+		cmd->w = w;
+		cmd->h = h;
+		m_renderer.queue(cmd, m_profiler_link);
+	}
+
+
+	void copyRenderbuffer(int dst_idx, int src_idx, int x, int y)
+	{
+		struct Cmd : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::copy(dst, src, x, y);
+			}
+			gpu::TextureHandle dst;
+			gpu::TextureHandle src;
+			u32 x, y;
+		};
+
+		const gpu::TextureHandle dst = useRenderbuffer(dst_idx);
+		const gpu::TextureHandle src = useRenderbuffer(src_idx);
+		if (!dst.isValid() || !src.isValid() || x < 0 || y < 0) return;
+
+		Cmd* cmd = LUMIX_NEW(m_renderer.getAllocator(), Cmd);
+		cmd->dst = dst;
+		cmd->src = src;
+		cmd->x = x;
+		cmd->y = y;
+		m_renderer.queue(cmd, m_profiler_link);
+	}
+
+
+	// returns true if static casters of the cascade must be rendered to rb_idx, false if rb_idx still has them
+	bool updateShadowCache(int slice, int rb_idx)
+	{
+		if (slice < 0 || slice >= lengthOf(m_shadow_cache)) {
+			logError("Renderer") << getPath() << ": invalid shadow slice " << slice;
+			return true;
+		}
+		ShadowCacheKey key = m_shadow_cache_keys[slice];
+		key.texture = useRenderbuffer(rb_idx);
+		if (key == m_shadow_cache[slice]) return false;
+		m_shadow_cache[slice] = key;
+		return true;
+	}
+
+
 	void viewport(int x, int y, int w, int h)
 	{
 		struct Cmd : Renderer::RenderJob {
@@ -3433,9 +5614,213 @@ struct PipelineImpl final : Pipeline
 	
 	void setOutput(int rb_index) 
 	{
-		m_output = rb_index;
+		m_output = -1;
+		if (rb_index < 0 || rb_index >= m_virtual_renderbuffers.size()) return;
+		// read after the frame, its texture is never reused
+		m_virtual_renderbuffers[rb_index].last_use = KEEP_RENDERBUFFER;
+		m_output = m_virtual_renderbuffers[rb_index].physical;
+	}
+
+	void setOcclusionCulling(bool enable) { m_occlusion_culling = enable; }
+	void setGPUCulling(bool enable) { m_gpu_culling = enable; }
+
+	// 0 disables dynamic resolution
+	void setDynamicResolution(float gpu_budget_ms) { m_gpu_budget = maximum(gpu_budget_ms, 0.f) * 0.001f; }
+
+	// relative renderbuffers and u_framebuffer_size are scaled by this until resetRenderScale
+	float getRenderScale() const { return m_render_scale_active ? 1 - m_render_scale_steps * RENDER_SCALE_STEP : 1; }
+
+	// the gpu time is a few frames old, so the scale moves one step at a time and waits for the result,
+	// it also keeps renderbuffers from being recreated every frame
+	void updateRenderScale() {
+		m_render_scale_active = m_gpu_budget > 0;
+		if (!m_render_scale_active) {
+			m_render_scale_steps = 0;
+			return;
+		}
+		if (m_render_scale_cooldown > 0) {
+			--m_render_scale_cooldown;
+			return;
+		}
+		const float gpu_time = m_renderer.getGPUFrameTime();
+		if (gpu_time <= 0) return;
+
+		i32 steps = m_render_scale_steps;
+		if (gpu_time > m_gpu_budget) ++steps;
+		else if (gpu_time < m_gpu_budget * 0.8f) --steps;
+		steps = clamp(steps, 0, MAX_RENDER_SCALE_STEPS);
+		if (steps != m_render_scale_steps) {
+			m_render_scale_steps = steps;
+			m_render_scale_cooldown = 8;
+		}
+	}
+
+	// call after the scaled image is upscaled, what follows is rendered in full resolution
+	void resetRenderScale() {
+		if (!m_render_scale_active) return;
+		m_render_scale_active = false;
+
+		struct Cmd : Renderer::RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::update(global_state_buffer, &global_state, sizeof(global_state));
+			}
+			gpu::BufferHandle global_state_buffer;
+			GlobalState global_state;
+		};
+
+		Cmd* cmd = LUMIX_NEW(m_renderer.getAllocator(), Cmd);
+		cmd->global_state = m_global_state;
+		cmd->global_state.framebuffer_size.x = m_viewport.w;
+		cmd->global_state.framebuffer_size.y = m_viewport.h;
+		cmd->global_state_buffer = m_global_state_buffer;
+		m_renderer.queue(cmd, m_profiler_link);
+	}
+	// the farthest count cascades are stabilized so static casters rendered to them can be cached
+	void setCachedShadowSlices(int count) { m_cached_shadow_slices = (u32)clamp(count, 0, (int)lengthOf(m_shadow_camera_params)); }
+	void setComputeSkinning(bool enable) { m_compute_skinning = enable; }
+
+
+	void destroyStaticInstanceBuffers()
+	{
+		StaticInstances& si = m_static_instances;
+		if (si.instances_buffer.isValid()) m_renderer.destroy(si.instances_buffer);
+		if (si.commands_buffer.isValid()) m_renderer.destroy(si.commands_buffer);
+		if (si.bounds_buffer.isValid()) m_renderer.destroy(si.bounds_buffer);
+		if (si.culled_buffer.isValid()) m_renderer.destroy(si.culled_buffer);
+		si.instances_buffer = gpu::INVALID_BUFFER;
+		si.commands_buffer = gpu::INVALID_BUFFER;
+		si.bounds_buffer = gpu::INVALID_BUFFER;
+		si.culled_buffer = gpu::INVALID_BUFFER;
 	}
 
+
+	// uploads static model instances again if the scene changed them
+	void updateStaticInstances()
+	{
+		StaticInstances& si = m_static_instances;
+		const u32 version = m_scene->getStaticModelInstancesVersion();
+		if (si.version == version) return;
+
+		PROFILE_FUNCTION();
+		si.version = version;
+		si.draws.clear();
+		si.commands.clear();
+		si.instances_count = 0;
+		destroyStaticInstanceBuffers();
+
+		struct ModelCommands {
+			u32 first_command;
+			u32 commands_count;
+			u32 instances_count;
+		};
+		HashMap<Model*, ModelCommands> models(m_allocator);
+		Array<GPUCullBounds> bounds(m_allocator);
+		const ModelInstance* model_instances = m_scene->getModelInstances();
+		for (EntityPtr e = m_scene->getFirstModelInstance(); e.isValid(); e = m_scene->getNextModelInstance(e)) {
+			const ModelInstance& mi = model_instances[e.index];
+			if (!mi.flags.isSet(ModelInstance::ENABLED) || !mi.model || !mi.model->isReady()) continue;
+			if (mi.model->isSkinned() || !isGPUCullable(mi)) continue;
+
+			auto iter = models.find(mi.model);
+			if (iter.isValid()) {
+				++iter.value().instances_count;
+				continue;
+			}
+
+			const Model::LOD& lod = mi.model->getLODs()[0];
+			ModelCommands mc;
+			mc.first_command = si.commands.size();
+			mc.instances_count = 1;
+			for (int i = lod.from_mesh; i <= lod.to_mesh; ++i) {
+				const Mesh& mesh = mi.model->getMesh(i);
+				StaticInstances::Draw& draw = si.draws.emplace();
+				draw.mesh = &mesh;
+				draw.first_command = si.commands.size();
+				if (mesh.meshlets.empty()) {
+					IndirectCommand& cmd = si.commands.emplace();
+					memset(&cmd, 0, sizeof(cmd));
+					cmd.indices_count = mesh.render_data->indices_count;
+					GPUCullBounds& b = bounds.emplace();
+					memset(&b, 0, sizeof(b));
+					b.radius = -1;
+				}
+				else {
+					// backfacing clusters can not be culled if the material draws back faces
+					const bool cull_back = mesh.material->getRenderStates() & (u64)gpu::StateFlags::CULL_BACK;
+					for (const Meshlet& meshlet : mesh.meshlets) {
+						IndirectCommand& cmd = si.commands.emplace();
+						memset(&cmd, 0, sizeof(cmd));
+						cmd.indices_count = meshlet.indices_count;
+						cmd.first_index = meshlet.first_index;
+						GPUCullBounds& b = bounds.emplace();
+						b.center = meshlet.center;
+						b.radius = meshlet.radius;
+						b.cone_axis = meshlet.cone_axis;
+						b.cone_cutoff = cull_back ? meshlet.cone_cutoff : 1;
+					}
+				}
+				draw.commands_count = si.commands.size() - draw.first_command;
+			}
+			mc.commands_count = si.commands.size() - mc.first_command;
+			models.insert(mi.model, mc);
+		}
+		if (si.commands.empty()) return;
+
+		// each command has room for all instances of its model
+		u32 culled_count = 0;
+		for (const ModelCommands& mc : models) {
+			for (u32 i = 0; i < mc.commands_count; ++i) {
+				si.commands[mc.first_command + i].first_culled = culled_count;
+				culled_count += mc.instances_count;
+			}
+		}
+		// commands of a draw share one instance data binding, base_instance selects their part of it
+		for (const StaticInstances::Draw& draw : si.draws) {
+			const u32 first_culled = si.commands[draw.first_command].first_culled;
+			for (u32 i = 0; i < draw.commands_count; ++i) {
+				IndirectCommand& cmd = si.commands[draw.first_command + i];
+				cmd.base_instance = cmd.first_culled - first_culled;
+			}
+		}
+
+		Array<GPUCullInstance> instances(m_allocator);
+		const Universe& universe = m_scene->getUniverse();
+		for (EntityPtr e = m_scene->getFirstModelInstance(); e.isValid(); e = m_scene->getNextModelInstance(e)) {
+			const ModelInstance& mi = model_instances[e.index];
+			if (!mi.model) continue;
+			auto iter = models.find(mi.model);
+			if (!iter.isValid()) continue;
+			if (!mi.flags.isSet(ModelInstance::ENABLED) || !isGPUCullable(mi)) continue;
+
+			const Transform tr = universe.getTransform((EntityRef)e);
+			const ModelCommands& mc = iter.value();
+			for (u32 i = 0; i < mc.commands_count; i += GPU_CULL_MAX_INSTANCE_COMMANDS) {
+				GPUCullInstance& inst = instances.emplace();
+				inst.rot = tr.rot;
+				inst.pos_hi = tr.pos.toFloat();
+				inst.pos_lo = Vec3(float(tr.pos.x - inst.pos_hi.x), float(tr.pos.y - inst.pos_hi.y), float(tr.pos.z - inst.pos_hi.z));
+				inst.scale = tr.scale;
+				inst.radius = mi.model->getBoundingRadius() * tr.scale;
+				inst.first_command = mc.first_command + i;
+				inst.commands_count = minimum(mc.commands_count - i, GPU_CULL_MAX_INSTANCE_COMMANDS);
+				inst.padding[0] = inst.padding[1] = 0;
+			}
+		}
+		si.instances_count = instances.size();
+
+		const Renderer::MemRef instances_mem = m_renderer.copy(instances.begin(), instances.byte_size());
+		si.instances_buffer = m_renderer.createBuffer(instances_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		const Renderer::MemRef commands_mem = m_renderer.copy(si.commands.begin(), si.commands.byte_size());
+		si.commands_buffer = m_renderer.createBuffer(commands_mem, 0);
+		const Renderer::MemRef bounds_mem = m_renderer.copy(bounds.begin(), bounds.byte_size());
+		si.bounds_buffer = m_renderer.createBuffer(bounds_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		const Renderer::MemRef culled_mem = { culled_count * u32(sizeof(MeshInstanceData)), nullptr, false };
+		si.culled_buffer = m_renderer.createBuffer(culled_mem, (u32)gpu::BufferFlags::IMMUTABLE);
+	}
+
+
 	bool environmentCastShadows() {
 		if (!m_scene) return false;
 		const EntityPtr env = m_scene->getActiveEnvironment();
@@ -3459,9 +5844,267 @@ struct PipelineImpl final : Pipeline
 	}
 
 
+	// compiled mode, a script calls setCompiled(true) to opt in
+	// one run of `main` records calls of the pipeline API into a tape, following frames replay the tape
+	// without running the script; results referenced by later calls (camera params, command pages)
+	// are remapped, other results are guarded and the tape is recorded again if they change
+	void setCompiled(bool compiled) {
+		m_compiled = compiled;
+		m_compiled_dirty = true;
+	}
+
+	void resetTape() {
+		luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_tape_ref);
+		luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_tape_slots_ref);
+		luaL_unref(m_lua_state, LUA_REGISTRYINDEX, m_tape_results_ref);
+		m_tape_ref = m_tape_slots_ref = m_tape_results_ref = LUA_NOREF;
+		m_tape_slots_count = 0;
+		m_compiled_dirty = true;
+	}
+
+	// pushes copy of the value at `idx` as it's stored in the tape, results of previous calls are replaced by references
+	void pushTapeValue(lua_State* L, int idx, u32 depth, bool& has_refs) {
+		const int type = lua_type(L, idx);
+		if (type == LUA_TTABLE || type == LUA_TLIGHTUSERDATA || type == LUA_TUSERDATA) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_slots_ref);
+			lua_pushvalue(L, idx);
+			lua_rawget(L, -2);
+			if (lua_type(L, -1) == LUA_TNUMBER) {
+				const int slot = (int)lua_tointeger(L, -1);
+				lua_pop(L, 2);
+				lua_createtable(L, 1, 0);
+				lua_pushinteger(L, slot);
+				lua_rawseti(L, -2, 1);
+				lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_ref_meta);
+				lua_setmetatable(L, -2);
+				has_refs = true;
+				return;
+			}
+			lua_pop(L, 2);
+		}
+		if (type != LUA_TTABLE || depth > 8) {
+			lua_pushvalue(L, idx);
+			return;
+		}
+
+		// copied, so changes made by the script after this call are not replayed
+		lua_newtable(L);
+		bool nested_refs = false;
+		lua_pushnil(L);
+		while (lua_next(L, idx)) {
+			lua_pushvalue(L, -2);
+			pushTapeValue(L, lua_gettop(L) - 1, depth + 1, nested_refs);
+			lua_rawset(L, -5);
+			lua_pop(L, 1);
+		}
+		if (nested_refs) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_resolve_meta);
+			lua_setmetatable(L, -2);
+			has_refs = true;
+		}
+	}
+
+	// inverse of pushTapeValue, pushes value at `idx` with references replaced by this frame's results
+	void pushReplayValue(lua_State* L, int idx) {
+		if (lua_type(L, idx) != LUA_TTABLE || !lua_getmetatable(L, idx)) {
+			lua_pushvalue(L, idx);
+			return;
+		}
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_ref_meta);
+		if (lua_rawequal(L, -1, -2)) {
+			lua_pop(L, 2);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_results_ref);
+			lua_rawgeti(L, idx, 1);
+			lua_rawget(L, -2);
+			lua_remove(L, -2);
+			return;
+		}
+		lua_pop(L, 1);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_tape_resolve_meta);
+		const bool resolve = lua_rawequal(L, -1, -2);
+		lua_pop(L, 2);
+		if (!resolve) {
+			lua_pushvalue(L, idx);
+			return;
+		}
+
+		lua_newtable(L);
+		lua_pushnil(L);
+		while (lua_next(L, idx)) {
+			lua_pushvalue(L, -2);
+			pushReplayValue(L, lua_gettop(L) - 1);
+			lua_rawset(L, -5);
+			lua_pop(L, 1);
+		}
+	}
+
+	// call is stored as {function index, arguments count, arguments..., s = {result index -> slot}, g = {result index -> value}}
+	static int recordCall(lua_State* L) {
+		PipelineImpl* pipeline = LuaWrapper::toType<PipelineImpl*>(L, lua_upvalueindex(1));
+		const int fn = (int)lua_tointeger(L, lua_upvalueindex(2));
+		const int nargs = lua_gettop(L);
+
+		lua_createtable(L, nargs + 2, 2);
+		const int call = nargs + 1;
+		lua_pushinteger(L, fn);
+		lua_rawseti(L, call, 1);
+		lua_pushinteger(L, nargs);
+		lua_rawseti(L, call, 2);
+		bool has_refs = false;
+		for (int i = 1; i <= nargs; ++i) {
+			pipeline->pushTapeValue(L, i, 0, has_refs);
+			lua_rawseti(L, call, i + 2);
+		}
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_ref);
+		lua_pushvalue(L, call);
+		lua_rawseti(L, -2, (int)lua_objlen(L, -2) + 1);
+		lua_pop(L, 1);
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_recorded_functions[fn].original_ref);
+		for (int i = 1; i <= nargs; ++i) lua_pushvalue(L, i);
+		lua_call(L, nargs, LUA_MULTRET);
+		const int nres = lua_gettop(L) - call;
+
+		for (int i = 1; i <= nres; ++i) {
+			const int res = call + i;
+			const int type = lua_type(L, res);
+			const bool is_ref = type == LUA_TTABLE || type == LUA_TLIGHTUSERDATA || type == LUA_TUSERDATA;
+			const char* field = is_ref ? "s" : "g";
+			lua_getfield(L, call, field);
+			if (lua_type(L, -1) != LUA_TTABLE) {
+				lua_pop(L, 1);
+				lua_newtable(L);
+				lua_pushvalue(L, -1);
+				lua_setfield(L, call, field);
+			}
+			if (is_ref) {
+				const int slot = ++pipeline->m_tape_slots_count;
+				lua_pushinteger(L, slot);
+				lua_rawseti(L, -2, i);
+				lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_slots_ref);
+				lua_pushvalue(L, res);
+				lua_pushinteger(L, slot);
+				lua_rawset(L, -3);
+				lua_pop(L, 1);
+			}
+			else {
+				// ref meta stands in for nil, nil can not be stored in a table
+				if (type == LUA_TNIL) lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_ref_meta);
+				else lua_pushvalue(L, res);
+				lua_rawseti(L, -2, i);
+			}
+			lua_pop(L, 1);
+		}
+		return nres;
+	}
+
+	static int replayTape(lua_State* L) {
+		PipelineImpl* pipeline = LuaWrapper::toType<PipelineImpl*>(L, 1);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_ref);
+		const int tape = lua_gettop(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_results_ref);
+		const int results = lua_gettop(L);
+		const int call = results + 1;
+		const int count = (int)lua_objlen(L, tape);
+		for (int c = 1; c <= count; ++c) {
+			lua_rawgeti(L, tape, c);
+			lua_rawgeti(L, call, 1);
+			lua_rawgeti(L, call, 2);
+			const int fn = (int)lua_tointeger(L, -2);
+			const int nargs = (int)lua_tointeger(L, -1);
+			lua_pop(L, 2);
+
+			lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_recorded_functions[fn].original_ref);
+			for (int i = 1; i <= nargs; ++i) {
+				lua_rawgeti(L, call, i + 2);
+				pipeline->pushReplayValue(L, lua_gettop(L));
+				lua_remove(L, -2);
+			}
+			lua_call(L, nargs, LUA_MULTRET);
+			const int nres = lua_gettop(L) - call;
+
+			lua_getfield(L, call, "s");
+			if (lua_type(L, -1) == LUA_TTABLE) {
+				lua_pushnil(L);
+				while (lua_next(L, -2)) {
+					const int i = (int)lua_tointeger(L, -2);
+					if (i <= nres) lua_pushvalue(L, call + i);
+					else lua_pushnil(L);
+					lua_rawseti(L, results, (int)lua_tointeger(L, -2));
+					lua_pop(L, 1);
+				}
+			}
+			lua_pop(L, 1);
+
+			lua_getfield(L, call, "g");
+			if (lua_type(L, -1) == LUA_TTABLE) {
+				lua_rawgeti(L, LUA_REGISTRYINDEX, pipeline->m_tape_ref_meta);
+				lua_insert(L, -2);
+				lua_pushnil(L);
+				while (lua_next(L, -2)) {
+					const int i = (int)lua_tointeger(L, -2);
+					const bool same = lua_rawequal(L, -1, -4)
+						? i > nres || lua_isnil(L, call + i)
+						: i <= nres && lua_rawequal(L, -1, call + i);
+					// the script could take a different branch, this frame is replayed as recorded
+					if (!same) pipeline->m_compiled_dirty = true;
+					lua_pop(L, 1);
+				}
+			}
+			lua_settop(L, results);
+		}
+		return 0;
+	}
+
+	// expects `main` on the stack
+	void recordMain() {
+		PROFILE_FUNCTION();
+		lua_State* L = m_lua_state;
+		resetTape();
+		lua_newtable(L);
+		m_tape_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		m_tape_slots_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		m_tape_results_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		auto swapFunctions = [&](bool record) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, m_lua_env);
+			for (const RecordedFunction& f : m_recorded_functions) {
+				lua_rawgeti(L, LUA_REGISTRYINDEX, record ? f.trampoline_ref : f.original_ref);
+				lua_setfield(L, -2, f.name);
+			}
+			lua_pop(L, 1);
+		};
+
+		swapFunctions(true);
+		const bool success = LuaWrapper::pcall(L, 0, 0);
+		swapFunctions(false);
+
+		// slots map keeps this frame's results alive
+		luaL_unref(L, LUA_REGISTRYINDEX, m_tape_slots_ref);
+		m_tape_slots_ref = LUA_NOREF;
+		m_compiled_dirty = !success;
+	}
+
+	void replayMain() {
+		PROFILE_FUNCTION();
+		lua_pushcfunction(m_lua_state, &PipelineImpl::replayTape);
+		lua_pushlightuserdata(m_lua_state, this);
+		if (lua_pcall(m_lua_state, 1, 0, 0) != 0) {
+			logError("Renderer") << lua_tostring(m_lua_state, -1);
+			lua_pop(m_lua_state, 1);
+			m_compiled_dirty = true;
+		}
+	}
+
+
 	void callLuaFunction(const char* function) override 
 	{
 		if (!m_lua_state) return;
+		// the function can change anything the script depends on
+		m_compiled_dirty = true;
 
 		lua_rawgeti(m_lua_state, LUA_REGISTRYINDEX, m_lua_env);
 		lua_getfield(m_lua_state, -1, function);
@@ -3482,44 +6125,36 @@ struct PipelineImpl final : Pipeline
 
 	void saveRenderbuffer(int render_buffer, const char* out_path)
 	{
-		struct Cmd : Renderer::RenderJob {
-			Cmd(IAllocator& allocator) : allocator(allocator) {}
-			void setup() override {}
-			void execute() override { 
-				PROFILE_FUNCTION();
-				Array<u32> pixels(allocator);
-				pixels.resize(w * h);
-				gpu::TextureHandle staging = gpu::allocTextureHandle();
-				const u32 flags = u32(gpu::TextureFlags::NO_MIPS) | u32(gpu::TextureFlags::READBACK);
-				gpu::createTexture(staging, w, h, 1, gpu::TextureFormat::RGBA8, flags, nullptr, "staging_buffer");
-				gpu::copy(staging, handle);
-				gpu::readTexture(staging, Span((u8*)pixels.begin(), pixels.byte_size()));
-				gpu::destroy(staging);
+		// saved on the main thread once the gpu finishes, so the render thread does not stall
+		struct Request {
+			Request(IAllocator& allocator) : allocator(allocator) {}
 
+			static void save(Span<const u8> data, void* ptr) {
+				PROFILE_FUNCTION();
+				Request* req = (Request*)ptr;
 				OS::OutputFile file;
-				if (fs->open(path, Ref(file))) {
-					Texture::saveTGA(&file, w, h, gpu::TextureFormat::RGBA8, (u8*)pixels.begin(), false, Path(path), allocator);
+				if (req->fs->open(req->path, Ref(file))) {
+					Texture::saveTGA(&file, req->w, req->h, gpu::TextureFormat::RGBA8, data.begin(), false, Path(req->path), req->allocator);
 					file.close();
 				}
 				else {
-					logError("Renderer") << "Failed to save " << path;
+					logError("Renderer") << "Failed to save " << req->path;
 				}
+				LUMIX_DELETE(req->allocator, req);
 			}
 
 			IAllocator& allocator;
 			u32 w, h;
-			gpu::TextureHandle handle;
 			FileSystem* fs;
 			StaticString<MAX_PATH_LENGTH> path;
 		};
 
-		Cmd* cmd = LUMIX_NEW(m_renderer.getAllocator(), Cmd)(m_renderer.getAllocator());
-		cmd->handle = m_renderbuffers[render_buffer].handle;
-		cmd->w = m_viewport.w;
-		cmd->h = m_viewport.h;
-		cmd->path = out_path;
-		cmd->fs = &m_renderer.getEngine().getFileSystem();
-		m_renderer.queue(cmd, m_profiler_link);
+		Request* req = LUMIX_NEW(m_renderer.getAllocator(), Request)(m_renderer.getAllocator());
+		req->w = m_viewport.w;
+		req->h = m_viewport.h;
+		req->path = out_path;
+		req->fs = &m_renderer.getEngine().getFileSystem();
+		m_renderer.getTextureImageAsync(useRenderbuffer(render_buffer), req->w, req->h, gpu::TextureFormat::RGBA8, &Request::save, req);
 	}
 
 
@@ -3530,7 +6165,17 @@ struct PipelineImpl final : Pipeline
 		auto registerCFunction = [L, this](const char* name, lua_CFunction function) {
 			lua_pushlightuserdata(L, this);
 			lua_pushcclosure(L, function, 1);
+			lua_pushvalue(L, -1);
 			lua_setfield(L, -3, name);
+
+			// trampoline is put in the env only while recording, see recordMain
+			RecordedFunction& f = m_recorded_functions.emplace();
+			f.name = name;
+			f.original_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+			lua_pushlightuserdata(L, this);
+			lua_pushinteger(L, m_recorded_functions.size() - 1);
+			lua_pushcclosure(L, &PipelineImpl::recordCall, 2);
+			f.trampoline_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 		};
 
 		auto registerConst = [L](const char* name, u32 value)
@@ -3547,19 +6192,40 @@ struct PipelineImpl final : Pipeline
 
 		REGISTER_FUNCTION(beginBlock);
 		REGISTER_FUNCTION(clear);
+		REGISTER_FUNCTION(clearRect);
+		REGISTER_FUNCTION(copyRenderbuffer);
+		REGISTER_FUNCTION(createPersistentRenderbuffer);
 		REGISTER_FUNCTION(createRenderbuffer);
 		REGISTER_FUNCTION(endBlock);
 		REGISTER_FUNCTION(environmentCastShadows);
 		REGISTER_FUNCTION(executeCustomCommand);
+		REGISTER_FUNCTION(getRenderScale);
 		REGISTER_FUNCTION(preloadShader);
 		REGISTER_FUNCTION(render2D);
 		REGISTER_FUNCTION(renderDebugShapes);
 		REGISTER_FUNCTION(renderLocalLights);
+		REGISTER_FUNCTION(renderClusteredLights);
 		REGISTER_FUNCTION(renderTextMeshes);
+		REGISTER_FUNCTION(resetRenderScale);
 		REGISTER_FUNCTION(saveRenderbuffer);
+		REGISTER_FUNCTION(setComputeSkinning);
+		REGISTER_FUNCTION(setCachedShadowSlices);
+		REGISTER_FUNCTION(setDynamicResolution);
+		REGISTER_FUNCTION(setGPUCulling);
+		REGISTER_FUNCTION(setOcclusionCulling);
 		REGISTER_FUNCTION(setOutput);
+		REGISTER_FUNCTION(updateShadowCache);
 		REGISTER_FUNCTION(viewport);
 
+		// not recorded, replaying it would record the tape again every frame
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, &LuaWrapper::wrapMethodClosure<&PipelineImpl::setCompiled>, 1);
+		lua_setfield(L, -2, "setCompiled");
+		lua_newtable(L);
+		m_tape_ref_meta = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		m_tape_resolve_meta = luaL_ref(L, LUA_REGISTRYINDEX);
+
 		registerConst("CLEAR_DEPTH", (u32)gpu::ClearFlags::DEPTH);
 		registerConst("CLEAR_COLOR", (u32)gpu::ClearFlags::COLOR);
 		registerConst("CLEAR_ALL", (u32)gpu::ClearFlags::COLOR | (u32)gpu::ClearFlags::DEPTH | (u32)gpu::ClearFlags::STENCIL);
@@ -3633,8 +6299,24 @@ struct PipelineImpl final : Pipeline
 		gpu::TextureFormat format;
 		gpu::TextureHandle handle;
 		int frame_counter;
+		// virtual renderbuffer using the texture in the current frame
+		i32 owner;
+		// crc32 of the name of a persistent renderbuffer, 0 for others
+		u32 persistent_name;
 	};
 
+	struct VirtualRenderbuffer {
+		u32 width;
+		u32 height;
+		gpu::TextureFormat format;
+		i32 physical;
+		u32 first_use;
+		u32 last_use;
+		bool persistent;
+	};
+
+	static constexpr u32 KEEP_RENDERBUFFER = 0xffFFffFF;
+
 	struct ShaderRef {
 		Lumix::Shader* res;
 		int id;
@@ -3647,6 +6329,22 @@ struct PipelineImpl final : Pipeline
 	lua_State* m_lua_state;
 	int m_lua_thread_ref;
 	int m_lua_env;
+	struct RecordedFunction {
+		const char* name;
+		int original_ref;
+		int trampoline_ref;
+	};
+	Array<RecordedFunction> m_recorded_functions;
+	bool m_compiled = false;
+	bool m_compiled_dirty = true;
+	int m_tape_ref = LUA_NOREF;
+	// result -> slot, only while recording
+	int m_tape_slots_ref = LUA_NOREF;
+	// slot -> result of the current frame
+	int m_tape_results_ref = LUA_NOREF;
+	int m_tape_slots_count = 0;
+	int m_tape_ref_meta = LUA_NOREF;
+	int m_tape_resolve_meta = LUA_NOREF;
 	StaticString<32> m_define;
 	RenderScene* m_scene;
 	Draw2D m_draw2d;
@@ -3655,26 +6353,77 @@ struct PipelineImpl final : Pipeline
 	Stats m_stats; // accessed from render thread
 	Viewport m_viewport;
 	int m_output;
+	bool m_occlusion_culling = false;
+	bool m_gpu_culling = false;
+	bool m_gpu_culling_used = false;
+	// seconds, 0 if dynamic resolution is disabled
+	float m_gpu_budget = 0;
+	i32 m_render_scale_steps = 0;
+	u32 m_render_scale_cooldown = 0;
+	bool m_render_scale_active = false;
+	GlobalState m_global_state;
+	StaticInstances m_static_instances;
+	gpu::BufferHandle m_gpu_cull_ub;
+	Shader* m_gpu_cull_shader;
+	Shader* m_light_clusters_shader;
+	// render thread, LIGHT_CLUSTERS_COUNT clusters, each is lights count and MAX_CLUSTER_LIGHTS indices
+	gpu::BufferHandle m_light_clusters_buffer = gpu::INVALID_BUFFER;
 	Shader* m_debug_shape_shader;
+	// taken from the scene on the main thread and read in setup; the scene reuses their memory in the next frame
+	Array<DebugTriangle> m_debug_triangles;
+	Array<DebugLine> m_debug_lines;
 	Shader* m_text_mesh_shader;
 	Texture* m_default_cubemap;
 	Array<CustomCommandHandler> m_custom_commands_handlers;
 	Array<Renderbuffer> m_renderbuffers;
+	// renderbuffers created by lua in the current frame, indices to m_renderbuffers are not exposed to lua
+	Array<VirtualRenderbuffer> m_virtual_renderbuffers;
+	// renderbuffer -> earlier renderbuffer it shares texture with, -1 if none; planned from the last frame's lifetimes
+	Array<i32> m_renderbuffer_aliases;
+	u32 m_renderbuffer_uses = 0;
 	Array<ShaderRef> m_shaders;
 	OS::Timer m_timer;
 	gpu::BufferHandle m_global_state_buffer;
 	gpu::BufferHandle m_pass_state_buffer;
 	gpu::VertexDecl m_base_vertex_decl;
 	gpu::VertexDecl m_2D_decl;
+	gpu::VertexDecl m_2D_bindless_decl;
 	gpu::VertexDecl m_decal_decl;
 	gpu::VertexDecl m_3D_pos_decl;
 	gpu::VertexDecl m_text_mesh_decl;
 	gpu::VertexDecl m_point_light_decl;
 	CameraParams m_shadow_camera_params[4];
+	u32 m_cached_shadow_slices = 0;
+	ShadowAtlas m_shadow_atlas;
+	// sorted by importance
+	Array<LocalShadow> m_local_shadows;
+	u32 m_local_shadows_frame = 0;
+	// computed for the current frame
+	ShadowCacheKey m_shadow_cache_keys[4];
+	// what cached renderbuffers contain
+	ShadowCacheKey m_shadow_cache[4];
+	SharedCull m_shared_cull;
+	HashMap<EntityRef, BonePalette> m_bone_palettes;
+	Mutex m_bone_palettes_mutex;
+	bool m_compute_skinning = false;
+	Shader* m_skinning_shader;
+	SkinnedVertices* m_skinned_vertices = nullptr;
+	// render thread
+	gpu::BufferHandle m_skinned_vb = gpu::INVALID_BUFFER;
+	u32 m_skinned_vb_size = 0;
+	bool m_skinned_vb_ready = false;
+	// bindless handles of textures used by draw2d, render thread
+	gpu::BufferHandle m_draw2d_textures = gpu::INVALID_BUFFER;
+	u32 m_draw2d_textures_size = 0;
 
 	gpu::BufferHandle m_cube_vb;
 	gpu::BufferHandle m_cube_ib;
+	gpu::BufferHandle m_terrain_grid_ib;
 	gpu::BufferHandle m_drawcall_ub = gpu::INVALID_BUFFER;
+	RenderTargets m_render_targets;
+	// render thread
+	HashMap<EntityRef, TerrainVirtualTexture*> m_terrain_vts;
+	u32 m_terrain_vt_frame = 0;
 };
 
 
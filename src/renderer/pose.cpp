@@ -1,7 +1,7 @@
 #include "renderer/pose.h"
 #include "engine/math.h"
 #include "engine/profiler.h"
-#include "engine/math.h"
+#include "engine/simd.h"
 #include "renderer/model.h"
 
 
@@ -9,6 +9,45 @@ namespace Lumix
 {
 
 
+void nlerp4(Quat* res, const Quat* a, const Quat* b, const float* t)
+{
+	// AoS -> SoA
+	float4 ax = f4LoadUnaligned(&a[0]);
+	float4 ay = f4LoadUnaligned(&a[1]);
+	float4 az = f4LoadUnaligned(&a[2]);
+	float4 aw = f4LoadUnaligned(&a[3]);
+	f4Transpose(ax, ay, az, aw);
+	float4 bx = f4LoadUnaligned(&b[0]);
+	float4 by = f4LoadUnaligned(&b[1]);
+	float4 bz = f4LoadUnaligned(&b[2]);
+	float4 bw = f4LoadUnaligned(&b[3]);
+	f4Transpose(bx, by, bz, bw);
+
+	const float4 tt = f4LoadUnaligned(t);
+	const float4 inv = f4Sub(f4Splat(1), tt);
+	const float4 dot = f4Add(f4Add(f4Mul(ax, bx), f4Mul(ay, by)), f4Add(f4Mul(az, bz), f4Mul(aw, bw)));
+	// shortest path, negate t where dot < 0
+	const float4 signed_t = f4Xor(tt, f4And(dot, f4Splat(-0.f)));
+
+	float4 ox = f4Add(f4Mul(ax, inv), f4Mul(bx, signed_t));
+	float4 oy = f4Add(f4Mul(ay, inv), f4Mul(by, signed_t));
+	float4 oz = f4Add(f4Mul(az, inv), f4Mul(bz, signed_t));
+	float4 ow = f4Add(f4Mul(aw, inv), f4Mul(bw, signed_t));
+	const float4 len_sq = f4Add(f4Add(f4Mul(ox, ox), f4Mul(oy, oy)), f4Add(f4Mul(oz, oz), f4Mul(ow, ow)));
+	const float4 inv_len = f4Div(f4Splat(1), f4Sqrt(len_sq));
+	ox = f4Mul(ox, inv_len);
+	oy = f4Mul(oy, inv_len);
+	oz = f4Mul(oz, inv_len);
+	ow = f4Mul(ow, inv_len);
+
+	f4Transpose(ox, oy, oz, ow);
+	f4StoreUnaligned(&res[0], ox);
+	f4StoreUnaligned(&res[1], oy);
+	f4StoreUnaligned(&res[2], oz);
+	f4StoreUnaligned(&res[3], ow);
+}
+
+
 Pose::Pose(IAllocator& allocator)
 	: allocator(allocator)
 {
@@ -31,10 +70,28 @@ void Pose::blend(Pose& rhs, float weight)
 	ASSERT(count == rhs.count);
 	if (weight <= 0.001f) return;
 	weight = clamp(weight, 0.0f, 1.0f);
-	float inv = 1.0f - weight;
-	for (int i = 0, c = count; i < c; ++i)
-	{
-		positions[i] = positions[i] * inv + rhs.positions[i] * weight;
+	const float inv = 1.0f - weight;
+
+	// positions are lerped as a flat float array
+	float* pos = &positions[0].x;
+	const float* rhs_pos = &rhs.positions[0].x;
+	const float4 w4 = f4Splat(weight);
+	const float4 inv4 = f4Splat(inv);
+	u32 i = 0;
+	for (const u32 c = count * 3; i + 4 <= c; i += 4) {
+		const float4 v = f4Add(f4Mul(f4LoadUnaligned(pos + i), inv4), f4Mul(f4LoadUnaligned(rhs_pos + i), w4));
+		f4StoreUnaligned(pos + i, v);
+	}
+	for (const u32 c = count * 3; i < c; ++i) {
+		pos[i] = pos[i] * inv + rhs_pos[i] * weight;
+	}
+
+	const float weights[4] = { weight, weight, weight, weight };
+	i = 0;
+	for (; i + 4 <= count; i += 4) {
+		nlerp4(&rotations[i], &rotations[i], &rhs.rotations[i], weights);
+	}
+	for (; i < count; ++i) {
 		rotations[i] = nlerp(rotations[i], rhs.rotations[i], weight);
 	}
 }
@@ -15,6 +15,10 @@ struct Quat;
 struct Vec3;
 
 
+// res[i] = nlerp(a[i], b[i], t[i]) for i in [0, 4), computed 4-wide; `res` can alias `a` or `b`
+LUMIX_RENDERER_API void nlerp4(Quat* res, const Quat* a, const Quat* b, const float* t);
+
+
 struct LUMIX_RENDERER_API Pose
 {
 	explicit Pose(IAllocator& allocator);
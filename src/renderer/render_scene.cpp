@@ -1,12 +1,15 @@
 #include "render_scene.h"
 
+#include "engine/allocator.h"
 #include "engine/array.h"
+#include "engine/atomic.h"
 #include "engine/associative_array.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
 #include "engine/geometry.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/math.h"
@@ -16,6 +19,7 @@
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/stream.h"
+#include "engine/sync.h"
 #include "engine/universe.h"
 #include "renderer/culling_system.h"
 #include "renderer/font.h"
@@ -156,9 +160,14 @@ public:
 
 	~RenderSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<&RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<&RenderSceneImpl::onEntitiesMoved>(this);
 		m_universe.entityDestroyed().unbind<&RenderSceneImpl::onEntityDestroyed>(this);
+		m_universe.entitiesActivated().unbind<&RenderSceneImpl::onEntitiesActivated>(this);
 		CullingSystem::destroy(*m_culling_system);
+		if (m_gpu_particles_ub.isValid()) m_renderer.destroy(m_gpu_particles_ub);
+		clearDebugGroups();
+		for (DebugBuffer* buffer : m_debug_buffers) LUMIX_DELETE(m_allocator, buffer);
+		for (BakedAnimationData& anim : m_baked_animations) m_renderer.destroy(anim.animation.buffer);
 	}
 
 
@@ -172,7 +181,7 @@ public:
 			while(e.isValid()) {
 				const float radius = m_decals[(EntityRef)e].half_extents.length();
 				const DVec3 pos = m_universe.getPosition((EntityRef)e);
-				m_culling_system->add((EntityRef)e, (u8)RenderableTypes::DECAL, pos, radius);
+				addToCulling((EntityRef)e, (u8)RenderableTypes::DECAL, pos, radius);
 				e = m_decals[(EntityRef)e].next_decal;
 			}
 			return;
@@ -182,7 +191,7 @@ public:
 			auto map_iter = m_material_decal_map.find(&material);
 			EntityPtr e = map_iter.value();
 			while(e.isValid()) {
-				m_culling_system->remove((EntityRef)e);
+				removeFromCulling((EntityRef)e);
 				e = m_decals[(EntityRef)e].next_decal;
 			}
 		}
@@ -231,7 +240,7 @@ public:
 
 		for (auto* emitter : m_particle_emitters)
 		{
-			LUMIX_DELETE(m_allocator, emitter);
+			m_particle_emitter_pool.destroy(emitter);
 		}
 		m_particle_emitters.clear();
 
@@ -240,7 +249,7 @@ public:
 			if (i.flags.isSet(ModelInstance::VALID) && i.model)
 			{
 				i.model->getResourceManager().unload(*i.model);
-				LUMIX_DELETE(m_allocator, i.pose);
+				m_pose_pool.destroy(i.pose);
 				i.pose = nullptr;
 			}
 		}
@@ -352,10 +361,11 @@ public:
 
 	float getCameraLODMultiplier(float fov, bool is_ortho) const override
 	{
-		if (is_ortho) return 1;
+		if (is_ortho) return m_lod_multiplier;
 
-		const float lod_multiplier = fov / degreesToRadians(60);
-		return lod_multiplier  * lod_multiplier;
+		// projected size is inversely proportional to tan(fov / 2), LOD distances are authored for 60 degrees
+		const float lod_multiplier = tanf(fov * 0.5f) / tanf(degreesToRadians(30));
+		return m_lod_multiplier * lod_multiplier * lod_multiplier;
 	}
 
 
@@ -573,19 +583,76 @@ public:
 	}
 
 
+	SceneUpdateAccess getUpdateAccess() const override
+	{
+		SceneUpdateAccess access;
+		access.write_components = SceneUpdateAccess::mask(PARTICLE_EMITTER_TYPE);
+		return access;
+	}
+
+
+	bool isDeserializeThreadSafe() const override { return true; }
+
+
 	void update(float dt, bool paused) override
 	{
 		PROFILE_FUNCTION();
 
 		m_time += dt;
 
-		if (m_is_game_running && !paused)
+		if (m_is_game_running && !paused && m_particle_emitters.size() > 0)
 		{
-			for (auto* emitter : m_particle_emitters)
-			{
-				emitter->update(dt);
+			PROFILE_BLOCK("particles");
+			Array<ParticleEmitter*> emitters(getFrameAllocator());
+			emitters.reserve(m_particle_emitters.size());
+			for (ParticleEmitter* emitter : m_particle_emitters) emitters.push(emitter);
+
+			// small emitters are batched together, huge ones are split further in simulate()
+			JobSystem::forEach(emitters.size(), 0, [&](u32 from, u32 to){
+				PROFILE_BLOCK("simulate emitters");
+				for (u32 i = from; i < to; ++i) emitters[i]->simulate(dt);
+			});
+			for (ParticleEmitter* emitter : emitters) emitter->applyEmits();
+			simulateGPUParticles(emitters);
+		}
+	}
+
+	// emit and update passes of GPU simulated emitters run once per frame, output pass is run by pipelines
+	void simulateGPUParticles(const Array<ParticleEmitter*>& emitters)
+	{
+		struct Cmd : Renderer::RenderJob {
+			Cmd(IAllocator& allocator) : simulations(allocator) {}
+
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::pushDebugGroup("particle simulation");
+				gpu::bindUniformBuffer(4, ub, 64);
+				for (const ParticleEmitter::GPUSimulation& sim : simulations) {
+					ParticleEmitter::dispatch(sim, ParticleEmitterResource::GPUPass::UPDATE, DVec3(0), ub);
+					ParticleEmitter::dispatch(sim, ParticleEmitterResource::GPUPass::EMIT, DVec3(0), ub);
+				}
+				gpu::popDebugGroup();
 			}
+
+			Array<ParticleEmitter::GPUSimulation> simulations;
+			gpu::BufferHandle ub;
+		};
+
+		Cmd* cmd = nullptr;
+		for (ParticleEmitter* emitter : emitters) {
+			if (!emitter->isGPUSimulated()) continue;
+			if (!cmd) cmd = LUMIX_NEW(m_renderer.getAllocator(), Cmd)(m_renderer.getAllocator());
+			cmd->simulations.push(emitter->getGPUSimulation());
+		}
+		if (!cmd) return;
+
+		if (!m_gpu_particles_ub.isValid()) {
+			const Renderer::MemRef mem = { 64, nullptr, false };
+			m_gpu_particles_ub = m_renderer.createBuffer(mem, (u32)gpu::BufferFlags::UNIFORM_BUFFER);
 		}
+		cmd->ub = m_gpu_particles_ub;
+		m_renderer.queue(cmd, 0);
 	}
 
 	void loadLightProbeGridData(LightProbeGrid& lp) const {
@@ -688,7 +755,7 @@ public:
 		return count;
 	}
 
-	void getTextMeshesVertices(TextMeshVertex* vertices, const DVec3& cam_pos, const Quat& cam_rot) override
+	u32 getTextMeshesVertices(TextMeshVertex* vertices, const DVec3& cam_pos, const Quat& cam_rot) override
 	{
 		const Vec3 cam_right = cam_rot * Vec3(1, 0, 0);
 		const Vec3 cam_up = cam_rot * Vec3(0, -1, 0);
@@ -713,8 +780,8 @@ public:
 			const Vec2 text_size = measureTextA(*font, str, nullptr);
 			base += right * text_size.x * -0.5f;
 			base += up * text_size.y * -0.5f;
-			for (int i = 0, n = text.text.length(); i < n; ++i) {
-				const Glyph* glyph = findGlyph(*font, str[i]);
+			for (const char* c = str; *c;) {
+				const Glyph* glyph = findGlyph(*font, decodeUTF8(c));
 				if (!glyph) continue;
 
 				const Vec3 x0y0 = base + right * float(glyph->x0) + up * float(glyph->y0);
@@ -734,6 +801,7 @@ public:
 				base += right * float(glyph->advance_x);
 			}
 		}
+		return idx;
 	}
 
 
@@ -986,7 +1054,7 @@ public:
 		const u32 count = serializer.read<u32>();
 		m_particle_emitters.reserve(count + m_particle_emitters.size());
 		for (u32 i = 0; i < count; ++i) {
-			ParticleEmitter* emitter = LUMIX_NEW(m_allocator, ParticleEmitter)(INVALID_ENTITY, m_allocator);
+			ParticleEmitter* emitter = m_particle_emitter_pool.create(INVALID_ENTITY, m_allocator);
 			emitter->deserialize(serializer, m_engine.getResourceManager());
 			emitter->m_entity = entity_map.get(emitter->m_entity);
 			if(emitter->m_entity.isValid()) {
@@ -994,7 +1062,7 @@ public:
 				m_universe.onComponentCreated((EntityRef)emitter->m_entity, PARTICLE_EMITTER_TYPE, this);
 			}
 			else {
-				LUMIX_DELETE(m_allocator, emitter);
+				m_particle_emitter_pool.destroy(emitter);
 			}
 		}
 	}
@@ -1069,6 +1137,7 @@ public:
 				r.pose = nullptr;
 				r.meshes = nullptr;
 				r.mesh_count = 0;
+				r.lod = 0;
 
 				u32 path;
 				serializer.read(path);
@@ -1094,7 +1163,7 @@ public:
 			light.entity = entity_map.get(light.entity);
 			m_point_lights.insert(light.entity, light);
 			const DVec3 pos = m_universe.getPosition(light.entity);
-			m_culling_system->add(light.entity, (u8)RenderableTypes::LOCAL_LIGHT, pos, light.range);
+			addToCulling(light.entity, (u8)RenderableTypes::LOCAL_LIGHT, pos, light.range);
 			m_universe.onComponentCreated(light.entity, POINT_LIGHT_TYPE, this);
 		}
 
@@ -1173,8 +1242,9 @@ public:
 	{
 		setModel(entity, nullptr);
 		auto& model_instance = m_model_instances[entity.index];
-		LUMIX_DELETE(m_allocator, model_instance.pose);
+		m_pose_pool.destroy(model_instance.pose);
 		model_instance.pose = nullptr;
+		m_baked_instances.erase(entity);
 		model_instance.flags.clear();
 		model_instance.flags.set(ModelInstance::VALID, false);
 		m_universe.onComponentDestroyed(entity, MODEL_INSTANCE_TYPE, this);
@@ -1203,7 +1273,7 @@ public:
 
 	void destroyDecal(EntityRef entity)
 	{
-		m_culling_system->remove(entity);
+		removeFromCulling(entity);
 		m_decals.erase(entity);
 		m_universe.onComponentDestroyed(entity, DECAL_TYPE, this);
 	}
@@ -1212,7 +1282,7 @@ public:
 	void destroyPointLight(EntityRef entity)
 	{
 		m_point_lights.erase(entity);
-		m_culling_system->remove(entity);
+		removeFromCulling(entity);
 		m_universe.onComponentDestroyed(entity, POINT_LIGHT_TYPE, this);
 	}
 
@@ -1247,7 +1317,7 @@ public:
 		auto* emitter = m_particle_emitters[entity];
 		m_universe.onComponentDestroyed((EntityRef)emitter->m_entity, PARTICLE_EMITTER_TYPE, this);
 		m_particle_emitters.erase((EntityRef)emitter->m_entity);
-		LUMIX_DELETE(m_allocator, emitter);
+		m_particle_emitter_pool.destroy(emitter);
 	}
 
 
@@ -1287,7 +1357,7 @@ public:
 
 	void createParticleEmitter(EntityRef entity)
 	{
-		m_particle_emitters.insert(entity, LUMIX_NEW(m_allocator, ParticleEmitter)(entity, m_allocator));
+		m_particle_emitters.insert(entity, m_particle_emitter_pool.create(entity, m_allocator));
 		m_universe.onComponentCreated(entity, PARTICLE_EMITTER_TYPE, this);
 	}
 
@@ -1387,6 +1457,12 @@ public:
 	}
 
 
+	ModelInstance* getModelInstances() override
+	{
+		return m_model_instances.empty() ? nullptr : &m_model_instances[0];
+	}
+
+
 	ModelInstance* getModelInstance(EntityRef entity) override
 	{
 		return &m_model_instances[entity.index];
@@ -1400,6 +1476,55 @@ public:
 	}
 
 
+	// inactive entities are kept out of the culling system, so they are not rendered
+	void addToCulling(EntityRef entity, u8 type, const DVec3& pos, float radius)
+	{
+		if (m_universe.isActive(entity)) {
+			m_culling_system->add(entity, type, pos, radius);
+			return;
+		}
+		m_inactive_culled.erase(entity);
+		m_inactive_culled.insert(entity, {type, radius});
+	}
+
+
+	void removeFromCulling(EntityRef entity)
+	{
+		if (m_culling_system->isAdded(entity)) m_culling_system->remove(entity);
+		m_inactive_culled.erase(entity);
+	}
+
+
+	void setCullingRadius(EntityRef entity, float radius)
+	{
+		if (m_culling_system->isAdded(entity)) {
+			m_culling_system->setRadius(entity, radius);
+			return;
+		}
+		auto iter = m_inactive_culled.find(entity);
+		if (iter.isValid()) iter.value().radius = radius;
+	}
+
+
+	void onEntitiesActivated(Span<const EntityRef> entities, bool active)
+	{
+		PROFILE_FUNCTION();
+		for (EntityRef entity : entities) {
+			if (active) {
+				auto iter = m_inactive_culled.find(entity);
+				if (!iter.isValid()) continue;
+				const InactiveCulled culled = iter.value();
+				m_inactive_culled.erase(iter);
+				m_culling_system->add(entity, culled.type, m_universe.getPosition(entity), culled.radius);
+			}
+			else if (m_culling_system->isAdded(entity)) {
+				m_inactive_culled.insert(entity, {m_culling_system->getType(entity), m_culling_system->getRadius(entity)});
+				m_culling_system->remove(entity);
+			}
+		}
+	}
+
+
 	void onEntityDestroyed(EntityRef entity)
 	{
 		for (auto& i : m_bone_attachments)
@@ -1413,30 +1538,49 @@ public:
 	}
 
 
-	void onEntityMoved(EntityRef entity)
+	void staticInstanceChanged(EntityRef entity)
 	{
-		const u64 cmp_mask = m_universe.getComponentsMask(entity);
-		if ((cmp_mask & m_render_cmps_mask) == 0) {
-			return;
-		}
+		if (m_model_instances[entity.index].flags.isSet(ModelInstance::STATIC)) ++m_static_instances_version;
+	}
 
-		if (m_culling_system->isAdded(entity)) {
-			if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
-			}
-			else if (m_universe.hasComponent(entity, DECAL_TYPE)) {
-				auto iter = m_decals.find(entity);
-				updateDecalInfo(iter.value());
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
-			}
-			else if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, pos);
+
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		Array<EntityRef> culled(getFrameAllocator());
+		for (EntityRef entity : entities) {
+			if (!m_universe.getComponentsMask(entity).intersects(m_render_cmps_mask)) continue;
+
+			if (m_culling_system->isAdded(entity)) {
+				if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
+					culled.push(entity);
+					staticInstanceChanged(entity);
+					const Model* model = m_model_instances[entity.index].model;
+					if (model && model->isReady()) {
+						const float radius = model->getBoundingRadius() * m_universe.getScale(entity);
+						if (m_culling_system->getRadius(entity) != radius) m_culling_system->setRadius(entity, radius);
+					}
+				}
+				else if (m_universe.hasComponent(entity, DECAL_TYPE)) {
+					auto iter = m_decals.find(entity);
+					updateDecalInfo(iter.value());
+					culled.push(entity);
+				}
+				else if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
+					culled.push(entity);
+				}
 			}
+
+			if (m_bone_attachments.size() > 0) updateMovedAttachments(entity);
+		}
+
+		if (!culled.empty()) {
+			m_culling_system->setPositions(Span<const EntityRef>(culled.begin(), culled.end()), m_universe.getPositions());
 		}
+	}
+
 
+	void updateMovedAttachments(EntityRef entity)
+	{
 		bool was_updating = m_is_updating_attachments;
 		m_is_updating_attachments = true;
 		for (auto& attachment : m_bone_attachments)
@@ -1542,7 +1686,7 @@ public:
 		Decal& decal = m_decals[entity];
 		decal.half_extents = value;
 		if (decal.material && decal.material->isReady()) {
-			m_culling_system->setRadius(entity, value.length());
+			setCullingRadius(entity, value.length());
 		}
 		updateDecalInfo(decal);
 	}
@@ -1569,7 +1713,7 @@ public:
 			if (decal.material->isReady()) {
 				const float radius = m_decals[entity].half_extents.length();
 				const DVec3 pos = m_universe.getPosition(entity);
-				m_culling_system->add(entity, (u8)RenderableTypes::DECAL, pos, radius);
+				addToCulling(entity, (u8)RenderableTypes::DECAL, pos, radius);
 			}
 		}
 		else {
@@ -1653,24 +1797,157 @@ public:
 	}
 
 
+	bool isModelInstanceOccluder(EntityRef entity) override
+	{
+		return m_model_instances[entity.index].flags.isSet(ModelInstance::OCCLUDER);
+	}
+
+
+	void setModelInstanceOccluder(EntityRef entity, bool occluder) override
+	{
+		m_model_instances[entity.index].flags.set(ModelInstance::OCCLUDER, occluder);
+	}
+
+
+	bool isModelInstanceStatic(EntityRef entity) override
+	{
+		return m_model_instances[entity.index].flags.isSet(ModelInstance::STATIC);
+	}
+
+
+	void setModelInstanceStatic(EntityRef entity, bool is_static) override
+	{
+		m_model_instances[entity.index].flags.set(ModelInstance::STATIC, is_static);
+		++m_static_instances_version;
+	}
+
+
+	u32 getStaticModelInstancesVersion() const override { return m_static_instances_version; }
+
+
+	struct BakedAnimationData {
+		BakedAnimationData(IAllocator& allocator) : clips(allocator) {}
+
+		BakedAnimation animation;
+		Array<BakedAnimationClip> clips;
+	};
+
+
+	u32 createBakedAnimation(const Model& model, Span<const BakedAnimationClip> clips, Span<const LocalRigidTransform> poses) override
+	{
+		PROFILE_FUNCTION();
+		const u32 bones_count = (u32)model.getBoneCount();
+		if (bones_count == 0 || poses.length() == 0 || poses.length() % bones_count != 0) {
+			logError("Renderer") << "Can not bake animation for " << model.getPath() << ", poses do not match bones";
+			return BakedAnimation::INVALID;
+		}
+		const u32 frames_count = poses.length() / bones_count;
+		for (const BakedAnimationClip& clip : clips) {
+			if (clip.frames_count == 0 || clip.first_frame + clip.frames_count > frames_count) {
+				logError("Renderer") << "Invalid baked animation clip for " << model.getPath();
+				return BakedAnimation::INVALID;
+			}
+		}
+
+		const Renderer::MemRef mem = m_renderer.allocate(poses.length() * sizeof(Vec4) * 3);
+		Vec4* LUMIX_RESTRICT rows = (Vec4*)mem.data;
+		for (u32 i = 0, c = poses.length(); i < c; ++i) {
+			const Model::Bone& bone = model.getBone(i % bones_count);
+			const Matrix m = (poses[i] * bone.inv_bind_transform).toMatrix();
+			rows[i * 3 + 0] = Vec4(m.m11, m.m21, m.m31, m.m41);
+			rows[i * 3 + 1] = Vec4(m.m12, m.m22, m.m32, m.m42);
+			rows[i * 3 + 2] = Vec4(m.m13, m.m23, m.m33, m.m43);
+		}
+
+		const u32 id = ++m_baked_animation_id;
+		BakedAnimationData& data = m_baked_animations.insert(id, BakedAnimationData(m_allocator));
+		data.animation.buffer = m_renderer.createBuffer(mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		data.animation.bones_count = bones_count;
+		data.animation.frames_count = frames_count;
+		for (const BakedAnimationClip& clip : clips) data.clips.push(clip);
+		return id;
+	}
+
+
+	void destroyBakedAnimation(u32 animation) override
+	{
+		auto iter = m_baked_animations.find(animation);
+		if (!iter.isValid()) {
+			ASSERT(false);
+			return;
+		}
+
+		for (auto inst = m_baked_instances.begin(); inst != m_baked_instances.end();) {
+			if (inst.value().animation == animation) {
+				const EntityRef e = inst.key();
+				++inst;
+				setModelInstanceBakedAnimation(e, BakedAnimation::INVALID, 0, 0);
+			}
+			else {
+				++inst;
+			}
+		}
+
+		m_renderer.destroy(iter.value().animation.buffer);
+		m_baked_animations.erase(iter);
+	}
+
+
+	const BakedAnimation* getBakedAnimation(u32 animation) const override
+	{
+		auto iter = m_baked_animations.find(animation);
+		return iter.isValid() ? &iter.value().animation : nullptr;
+	}
+
+
+	void setModelInstanceBakedAnimation(EntityRef entity, u32 animation, u32 clip, float time_offset) override
+	{
+		ModelInstance& mi = m_model_instances[entity.index];
+		auto iter = m_baked_animations.find(animation);
+		if (!iter.isValid() || clip >= (u32)iter.value().clips.size()) {
+			ASSERT(animation == BakedAnimation::INVALID);
+			m_baked_instances.erase(entity);
+			mi.flags.set(ModelInstance::BAKED_ANIMATION, false);
+			return;
+		}
+
+		BakedAnimationInstance inst;
+		inst.animation = animation;
+		inst.clip = iter.value().clips[clip];
+		inst.time_offset = time_offset;
+		auto inst_iter = m_baked_instances.find(entity);
+		if (inst_iter.isValid()) inst_iter.value() = inst;
+		else m_baked_instances.insert(entity, inst);
+		mi.flags.set(ModelInstance::BAKED_ANIMATION, true);
+	}
+
+
+	const BakedAnimationInstance* getModelInstanceBakedAnimation(EntityRef entity) const override
+	{
+		auto iter = m_baked_instances.find(entity);
+		return iter.isValid() ? &iter.value() : nullptr;
+	}
+
+
 	void enableModelInstance(EntityRef entity, bool enable) override
 	{
 		ModelInstance& model_instance = m_model_instances[entity.index];
 		model_instance.flags.set(ModelInstance::ENABLED, enable);
+		staticInstanceChanged(entity);
 		if (enable)
 		{
 			if (!model_instance.model || !model_instance.model->isReady()) return;
 
 			const DVec3 pos = m_universe.getPosition(entity);
-			const float radius = model_instance.model->getBoundingRadius();
+			const float radius = model_instance.model->getBoundingRadius() * m_universe.getScale(entity);
 			if (!m_culling_system->isAdded(entity)) {
 				const RenderableTypes type = getRenderableType(*model_instance.model);
-				m_culling_system->add(entity, (u8)type, pos, radius);
+				addToCulling(entity, (u8)type, pos, radius);
 			}
 		}
 		else
 		{
-			m_culling_system->remove(entity);
+			removeFromCulling(entity);
 		}
 	}
 
@@ -1806,6 +2083,14 @@ public:
 	}
 
 
+	static void LUA_setCullingBackend(RenderSceneImpl* scene, const char* backend)
+	{
+		if (equalIStrings(backend, "grid")) scene->setCullingBackend(CullingBackend::GRID);
+		else if (equalIStrings(backend, "octree")) scene->setCullingBackend(CullingBackend::LOOSE_OCTREE);
+		else logError("Renderer") << "Unknown culling backend " << backend;
+	}
+
+
 	static void LUA_makeScreenshot(RenderSceneImpl* scene, const char* path)
 	{
 		scene->m_renderer.makeScreenshot(Path(path));
@@ -1929,7 +2214,6 @@ public:
 				result->header.count = 0;
 				result->header.next = nullptr;
 				for (auto* terrain : m_terrains) {
-					terrain->updateGrass(0, frustum.origin);
 					if(iter->header.count == lengthOf(iter->entities)) {
 						iter->header.next = (CullResult*)page_allocator.allocate(true);
 						iter->header.next->header.next = nullptr;
@@ -1947,12 +2231,50 @@ public:
 	}
 
 
+	void updateGrass(const DVec3& camera_pos) override
+	{
+		if (!m_is_grass_enabled) return;
+		for (Terrain* terrain : m_terrains) {
+			terrain->updateGrass(0, camera_pos);
+		}
+	}
+
+
+	void getRenderables(Span<const ShiftedFrustum> frustums, RenderableTypes type, Span<CullResult*> results) const override
+	{
+		ASSERT(frustums.length() == results.length());
+		if (type == RenderableTypes::GRASS) {
+			for (u32 i = 0; i < frustums.length(); ++i) {
+				results[i] = getRenderables(frustums[i], type);
+			}
+			return;
+		}
+		m_culling_system->cull(frustums, static_cast<u8>(type), results);
+	}
+
+
+	void setCullingBackend(CullingBackend backend) override
+	{
+		if (m_culling_system->getBackend() == backend) return;
+
+		CullingSystem* culling_system = CullingSystem::create(m_allocator, m_engine.getPageAllocator(), backend);
+		m_culling_system->moveTo(*culling_system);
+		CullingSystem::destroy(*m_culling_system);
+		m_culling_system = culling_system;
+	}
+
+
+	CullingBackend getCullingBackend() const override { return m_culling_system->getBackend(); }
+
+
 	float getCameraScreenWidth(EntityRef camera) override { return m_cameras[camera].screen_width; }
 	float getCameraScreenHeight(EntityRef camera) override { return m_cameras[camera].screen_height; }
 
 
 	void setGlobalLODMultiplier(float multiplier) { m_lod_multiplier = multiplier; }
 	float getGlobalLODMultiplier() const { return m_lod_multiplier; }
+	void setLODHysteresis(float hysteresis) override { m_lod_hysteresis = clamp(hysteresis, 0.f, 0.99f); }
+	float getLODHysteresis() const override { return m_lod_hysteresis; }
 
 	Camera& getCamera(EntityRef entity) override { return m_cameras[entity]; }
 
@@ -1993,11 +2315,127 @@ public:
 		return Vec2(cam.screen_width, cam.screen_height);
 	}
 
-	void clearDebugLines() override { m_debug_lines.clear(); }
-	void clearDebugTriangles() override { m_debug_triangles.clear(); }
+	struct DebugBuffer {
+		DebugBuffer(OS::ThreadID thread_id, IAllocator& allocator)
+			: thread_id(thread_id)
+			, triangles(allocator)
+			, lines(allocator)
+		{}
+
+		OS::ThreadID thread_id;
+		Array<DebugTriangle> triangles;
+		Array<DebugLine> lines;
+	};
+
+	void clearDebugLines() override {
+		MutexGuard guard(m_debug_buffers_mutex);
+		for (DebugBuffer* buffer : m_debug_buffers) buffer->lines.clear();
+	}
+
+	void clearDebugTriangles() override {
+		MutexGuard guard(m_debug_buffers_mutex);
+		for (DebugBuffer* buffer : m_debug_buffers) buffer->triangles.clear();
+	}
 
-	const Array<DebugTriangle>& getDebugTriangles() const override { return m_debug_triangles; }
-	const Array<DebugLine>& getDebugLines() const override { return m_debug_lines; }
+	template <typename T>
+	static void takeDebugPrimitives(Array<T>& out, Array<T>& buffer) {
+		if (buffer.empty()) return;
+		// usually only one thread adds debug geometry, so swapping is enough
+		if (out.empty()) {
+			out.swap(buffer);
+			return;
+		}
+		const u32 offset = out.size();
+		out.resize(offset + buffer.size());
+		memcpy(&out[offset], buffer.begin(), buffer.size() * sizeof(T));
+		buffer.clear();
+	}
+
+	void takeDebugTriangles(Array<DebugTriangle>& triangles) override {
+		triangles.clear();
+		MutexGuard guard(m_debug_buffers_mutex);
+		for (DebugBuffer* buffer : m_debug_buffers) takeDebugPrimitives(triangles, buffer->triangles);
+	}
+
+	void takeDebugLines(Array<DebugLine>& lines) override {
+		lines.clear();
+		MutexGuard guard(m_debug_buffers_mutex);
+		for (DebugBuffer* buffer : m_debug_buffers) takeDebugPrimitives(lines, buffer->lines);
+	}
+
+	u32 createDebugGroup(const DVec3& origin, Span<const DebugTriangle> triangles, Span<const DebugLine> lines) override {
+		struct Vertex {
+			Vec3 pos;
+			u32 color;
+		};
+
+		DebugGroup& group = m_debug_groups.emplace();
+		group.id = ++m_debug_group_id;
+		group.origin = origin;
+		group.triangles_count = triangles.length();
+		group.lines_count = lines.length();
+		group.vertex_buffer = gpu::INVALID_BUFFER;
+
+		const u32 vertices_count = triangles.length() * 3 + lines.length() * 2;
+		if (vertices_count == 0) return group.id;
+
+		const Renderer::MemRef mem = m_renderer.allocate(vertices_count * sizeof(Vertex));
+		Vertex* v = (Vertex*)mem.data;
+		for (const DebugTriangle& tri : triangles) {
+			*v++ = { (tri.p0 - origin).toFloat(), tri.color };
+			*v++ = { (tri.p1 - origin).toFloat(), tri.color };
+			*v++ = { (tri.p2 - origin).toFloat(), tri.color };
+		}
+		for (const DebugLine& line : lines) {
+			*v++ = { (line.from - origin).toFloat(), line.color };
+			*v++ = { (line.to - origin).toFloat(), line.color };
+		}
+		group.vertex_buffer = m_renderer.createBuffer(mem, (u32)gpu::BufferFlags::IMMUTABLE);
+		return group.id;
+	}
+
+	void destroyDebugGroup(u32 id) override {
+		for (u32 i = 0; i < (u32)m_debug_groups.size(); ++i) {
+			if (m_debug_groups[i].id != id) continue;
+			if (m_debug_groups[i].vertex_buffer.isValid()) m_renderer.destroy(m_debug_groups[i].vertex_buffer);
+			m_debug_groups.swapAndPop(i);
+			return;
+		}
+		ASSERT(false);
+	}
+
+	void clearDebugGroups() override {
+		for (const DebugGroup& group : m_debug_groups) {
+			if (group.vertex_buffer.isValid()) m_renderer.destroy(group.vertex_buffer);
+		}
+		m_debug_groups.clear();
+	}
+
+	Span<const DebugGroup> getDebugGroups() const override {
+		return Span(m_debug_groups.begin(), m_debug_groups.size());
+	}
+
+	DebugBuffer& getDebugBuffer() {
+		struct Cache {
+			i32 scene_id;
+			DebugBuffer* buffer = nullptr;
+		};
+		static thread_local Cache cache;
+		if (cache.buffer && cache.scene_id == m_instance_id) return *cache.buffer;
+
+		const OS::ThreadID thread_id = OS::getCurrentThreadID();
+		MutexGuard guard(m_debug_buffers_mutex);
+		cache.scene_id = m_instance_id;
+		for (DebugBuffer* buffer : m_debug_buffers) {
+			if (buffer->thread_id == thread_id) {
+				cache.buffer = buffer;
+				return *buffer;
+			}
+		}
+		cache.buffer = LUMIX_NEW(m_allocator, DebugBuffer)(thread_id, m_allocator);
+		m_debug_buffers.push(cache.buffer);
+		return *cache.buffer;
+	}
 
 
 	void addDebugSphere(const DVec3& center,
@@ -2145,7 +2583,7 @@ public:
 		const DVec3& p2,
 		u32 color) override
 	{
-		DebugTriangle& tri = m_debug_triangles.emplace();
+		DebugTriangle& tri = getDebugBuffer().triangles.emplace();
 		tri.p0 = p0;
 		tri.p1 = p1;
 		tri.p2 = p2;
@@ -2452,7 +2890,7 @@ public:
 
 	void addDebugLine(const DVec3& from, const DVec3& to, u32 color) override 
 	{
-		DebugLine& line = m_debug_lines.emplace();
+		DebugLine& line = getDebugBuffer().lines.emplace();
 		line.from = from;
 		line.to = to;
 		line.color = ARGBToABGR(color);
@@ -2468,23 +2906,25 @@ public:
 
 	DebugTriangle* addDebugTriangles(int count) override
 	{
-		const u32 new_size = m_debug_triangles.size() + count;
-		if (new_size < m_debug_triangles.capacity()) {
-			m_debug_triangles.reserve(maximum(new_size, m_debug_triangles.capacity() * 3 / 2));
+		Array<DebugTriangle>& triangles = getDebugBuffer().triangles;
+		const u32 new_size = triangles.size() + count;
+		if (new_size > triangles.capacity()) {
+			triangles.reserve(maximum(new_size, triangles.capacity() * 3 / 2));
 		}
-		m_debug_triangles.resize(new_size);
-		return &m_debug_triangles[new_size - count];
+		triangles.resize(new_size);
+		return &triangles[new_size - count];
 	}
 
 
 	DebugLine* addDebugLines(int count) override
 	{
-		const u32 new_size = m_debug_lines.size() + count;
-		if (new_size < m_debug_lines.capacity()) {
-			m_debug_lines.reserve(maximum(new_size, m_debug_lines.capacity() * 3 / 2));
+		Array<DebugLine>& lines = getDebugBuffer().lines;
+		const u32 new_size = lines.size() + count;
+		if (new_size > lines.capacity()) {
+			lines.reserve(maximum(new_size, lines.capacity() * 3 / 2));
 		}
-		m_debug_lines.resize(new_size);
-		return &m_debug_lines[new_size - count];
+		lines.resize(new_size);
+		return &lines[new_size - count];
 	}
 
 
@@ -2508,32 +2948,56 @@ public:
 		PROFILE_FUNCTION();
 		RayCastModelHit hit;
 		hit.is_hit = false;
-		double cur_dist = DBL_MAX;
 		const Universe& universe = getUniverse();
-		for (int i = 0; i < m_model_instances.size(); ++i) {
-			auto& r = m_model_instances[i];
-			if (ignored_model_instance.index == i || !r.model) continue;
-			if (!r.flags.isSet(ModelInstance::ENABLED)) continue;
-
-			const EntityRef entity{i};
-			const DVec3& pos = universe.getPosition(entity);
-			float scale = universe.getScale(entity);
-			float radius = r.model->getBoundingRadius() * scale;
-			const double dist = (pos - origin).length();
-			if (dist - radius > cur_dist) continue;
-			
-			Vec3 intersection;
-			const Vec3 rel_pos = (origin - pos).toFloat();
-			if (getRaySphereIntersection(rel_pos, dir, Vec3::ZERO, radius, intersection)) {
-				RayCastModelHit new_hit = r.model->castRay(rel_pos / scale, dir, r.pose);
-				if (new_hit.is_hit && (!hit.is_hit || new_hit.t * scale < hit.t)) {
-					new_hit.entity = entity;
-					new_hit.component_type = MODEL_INSTANCE_TYPE;
-					hit = new_hit;
-					hit.t *= scale;
-					hit.is_hit = true;
-					cur_dist = dir.length() * hit.t;
-				}
+
+		// culling system is the broadphase, candidates are tested from the closest bounding sphere
+		struct Candidate {
+			EntityRef entity;
+			double dist;
+		};
+		Array<Candidate> candidates(m_allocator);
+		PageAllocator& page_allocator = m_engine.getPageAllocator();
+		const double dir_len = dir.length();
+		const RenderableTypes types[] = { RenderableTypes::MESH, RenderableTypes::MESH_GROUP, RenderableTypes::SKINNED };
+		for (RenderableTypes type : types) {
+			CullResult* result = m_culling_system->castRay(origin, dir, (u8)type);
+			if (!result) continue;
+			result->forEach([&](EntityRef entity){
+				if (ignored_model_instance.index == entity.index) return;
+				const ModelInstance& r = m_model_instances[entity.index];
+				if (!r.model || !r.model->isReady() || !r.flags.isSet(ModelInstance::ENABLED)) return;
+				const double radius = r.model->getBoundingRadius() * universe.getScale(entity);
+				const DVec3 rel = universe.getPosition(entity) - origin;
+				const double tca = (rel.x * dir.x + rel.y * dir.y + rel.z * dir.z) / dir_len;
+				const double d2 = rel.x * rel.x + rel.y * rel.y + rel.z * rel.z - tca * tca;
+				const double thc = sqrt(maximum(radius * radius - d2, 0.0));
+				candidates.push({entity, maximum(tca - thc, 0.0)});
+			});
+			result->free(page_allocator);
+		}
+
+		qsort(candidates.begin(), candidates.size(), sizeof(candidates[0]), [](const void* a, const void* b){
+			const double da = ((const Candidate*)a)->dist;
+			const double db = ((const Candidate*)b)->dist;
+			return da < db ? -1 : (da > db ? 1 : 0);
+		});
+
+		double cur_dist = DBL_MAX;
+		for (const Candidate& candidate : candidates) {
+			if (candidate.dist > cur_dist) break;
+
+			const EntityRef entity = candidate.entity;
+			const ModelInstance& r = m_model_instances[entity.index];
+			const float scale = universe.getScale(entity);
+			const Vec3 rel_pos = (origin - universe.getPosition(entity)).toFloat();
+			RayCastModelHit new_hit = r.model->castRay(rel_pos / scale, dir, r.pose);
+			if (new_hit.is_hit && (!hit.is_hit || new_hit.t * scale < hit.t)) {
+				new_hit.entity = entity;
+				new_hit.component_type = MODEL_INSTANCE_TYPE;
+				hit = new_hit;
+				hit.t *= scale;
+				hit.is_hit = true;
+				cur_dist = dir_len * hit.t;
 			}
 		}
 
@@ -2580,7 +3044,7 @@ public:
 	void setLightRange(EntityRef entity, float value) override
 	{
 		m_point_lights[entity].range = value;
-		m_culling_system->setRadius(entity, value);
+		setCullingRadius(entity, value);
 	}
 
 
@@ -2718,10 +3182,11 @@ public:
 		auto& r = m_model_instances[entity.index];
 		r.meshes = nullptr;
 		r.mesh_count = 0;
-		LUMIX_DELETE(m_allocator, r.pose);
+		m_pose_pool.destroy(r.pose);
 		r.pose = nullptr;
 
-		m_culling_system->remove(entity);
+		removeFromCulling(entity);
+		staticInstanceChanged(entity);
 	}
 
 
@@ -2735,12 +3200,12 @@ public:
 		const float radius = bounding_radius * scale;
 		if(r.flags.isSet(ModelInstance::ENABLED)) {
 			const RenderableTypes type = getRenderableType(*model);
-			m_culling_system->add(entity, (u8)type, pos, radius);
+			addToCulling(entity, (u8)type, pos, radius);
 		}
 		ASSERT(!r.pose);
 		if (model->getBoneCount() > 0)
 		{
-			r.pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
+			r.pose = m_pose_pool.create(m_allocator);
 			r.pose->resize(model->getBoneCount());
 			model->getPose(*r.pose);
 		}
@@ -2757,6 +3222,7 @@ public:
 		}
 		m_mesh_sort_data[entity.index].layer = r.meshes[0].layer;
 		m_mesh_sort_data[entity.index].sort_key = r.meshes[0].sort_key;
+		staticInstanceChanged(entity);
 	}
 
 
@@ -2877,14 +3343,15 @@ public:
 
 			if (old_model->isReady())
 			{
-				m_culling_system->remove(entity);
+				removeFromCulling(entity);
+				staticInstanceChanged(entity);
 			}
 			old_model->getResourceManager().unload(*old_model);
 		}
 		model_instance.model = model;
 		model_instance.meshes = nullptr;
 		model_instance.mesh_count = 0;
-		LUMIX_DELETE(m_allocator, model_instance.pose);
+		m_pose_pool.destroy(model_instance.pose);
 		model_instance.pose = nullptr;
 		if (model)
 		{
@@ -2894,6 +3361,15 @@ public:
 			{
 				modelLoaded(model, entity);
 			}
+			else if (model->isEmpty() && m_active_camera.isValid())
+			{
+				// models closer to camera are streamed first
+				const DVec3 cam_pos = m_universe.getPosition((EntityRef)m_active_camera);
+				const float dist_squared = (float)(m_universe.getPosition(entity) - cam_pos).squaredLength();
+				if (model->getLoadOrder() == 0 || dist_squared < model->getLoadOrder()) {
+					model->setLoadPriority(model->getLoadPriority(), dist_squared);
+				}
+			}
 		}
 	}
 
@@ -2944,7 +3420,7 @@ public:
 		light.range = 10;
 		const DVec3 pos = m_universe.getPosition(entity);
 		m_point_lights.insert(entity, light);
-		m_culling_system->add(entity, (u8)RenderableTypes::LOCAL_LIGHT, pos, light.range);
+		addToCulling(entity, (u8)RenderableTypes::LOCAL_LIGHT, pos, light.range);
 
 		m_universe.onComponentCreated(entity, POINT_LIGHT_TYPE, this);
 	}
@@ -3047,11 +3523,18 @@ public:
 
 private:
 	IAllocator& m_allocator;
+	PoolAllocator<ParticleEmitter> m_particle_emitter_pool;
+	PoolAllocator<Pose> m_pose_pool;
 	Universe& m_universe;
 	Renderer& m_renderer;
 	Engine& m_engine;
 	CullingSystem* m_culling_system;
-	u64 m_render_cmps_mask;
+	struct InactiveCulled {
+		u8 type;
+		float radius;
+	};
+	HashMap<EntityRef, InactiveCulled> m_inactive_culled;
+	ComponentMask m_render_cmps_mask;
 
 	EntityPtr m_active_global_light_entity;
 	HashMap<EntityRef, PointLight> m_point_lights;
@@ -3069,14 +3552,25 @@ private:
 	HashMap<EntityRef, Terrain*> m_terrains;
 	AssociativeArray<EntityRef, ParticleEmitter*> m_particle_emitters;
 
-	Array<DebugTriangle> m_debug_triangles;
-	Array<DebugLine> m_debug_lines;
+	// distinguishes scenes in the thread local cache of getDebugBuffer, even if a new scene reuses the address
+	static i32 s_instance_counter;
+	i32 m_instance_id;
+	Mutex m_debug_buffers_mutex;
+	Array<DebugBuffer*> m_debug_buffers;
+	Array<DebugGroup> m_debug_groups;
+	u32 m_debug_group_id = 0;
+	HashMap<u32, BakedAnimationData> m_baked_animations;
+	HashMap<EntityRef, BakedAnimationInstance> m_baked_instances;
+	u32 m_baked_animation_id = 0;
 
 	float m_time;
+	gpu::BufferHandle m_gpu_particles_ub = gpu::INVALID_BUFFER;
 	float m_lod_multiplier;
+	float m_lod_hysteresis = 0.1f;
 	bool m_is_updating_attachments;
 	bool m_is_grass_enabled;
 	bool m_is_game_running;
+	u32 m_static_instances_version = 0;
 
 	HashMap<Model*, EntityRef> m_model_entity_map;
 	HashMap<Material*, EntityRef> m_material_decal_map;
@@ -3112,6 +3606,9 @@ static struct
 
 #undef COMPONENT_TYPE
 
+i32 RenderSceneImpl::s_instance_counter = 0;
+
+
 RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	Engine& engine,
 	Universe& universe,
@@ -3120,6 +3617,8 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_universe(universe)
 	, m_renderer(renderer)
 	, m_allocator(allocator)
+	, m_particle_emitter_pool(m_allocator)
+	, m_pose_pool(m_allocator)
 	, m_model_entity_map(m_allocator)
 	, m_model_instances(m_allocator)
 	, m_cameras(m_allocator)
@@ -3128,8 +3627,11 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_point_lights(m_allocator)
 	, m_environments(m_allocator)
 	, m_decals(m_allocator)
-	, m_debug_triangles(m_allocator)
-	, m_debug_lines(m_allocator)
+	, m_inactive_culled(m_allocator)
+	, m_debug_buffers(m_allocator)
+	, m_debug_groups(m_allocator)
+	, m_baked_animations(m_allocator)
+	, m_baked_instances(m_allocator)
 	, m_active_global_light_entity(INVALID_ENTITY)
 	, m_active_camera(INVALID_ENTITY)
 	, m_is_grass_enabled(true)
@@ -3144,17 +3646,19 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_mesh_sort_data(m_allocator)
 	, m_light_probe_grids(m_allocator)
 {
+	m_instance_id = atomicIncrement(&s_instance_counter);
 
-	m_universe.entityTransformed().bind<&RenderSceneImpl::onEntityMoved>(this);
+	m_universe.entitiesTransformed().bind<&RenderSceneImpl::onEntitiesMoved>(this);
 	m_universe.entityDestroyed().bind<&RenderSceneImpl::onEntityDestroyed>(this);
+	m_universe.entitiesActivated().bind<&RenderSceneImpl::onEntitiesActivated>(this);
 	m_culling_system = CullingSystem::create(m_allocator, engine.getPageAllocator());
 	m_model_instances.reserve(5000);
 	m_mesh_sort_data.reserve(5000);
 
-	m_render_cmps_mask = 0;
+	m_render_cmps_mask = {};
 	for (auto& i : COMPONENT_INFOS)
 	{
-		m_render_cmps_mask |= (u64)1 << i.type.index;
+		m_render_cmps_mask.add(i.type);
 		universe.registerComponentType(i.type, this, i.creator, i.destroyer);
 	}
 }
@@ -3187,6 +3691,8 @@ void RenderScene::registerLuaAPI(lua_State* L)
 
 	REGISTER_FUNCTION(setGlobalLODMultiplier);
 	REGISTER_FUNCTION(getGlobalLODMultiplier);
+	REGISTER_FUNCTION(setLODHysteresis);
+	REGISTER_FUNCTION(getLODHysteresis);
 	REGISTER_FUNCTION(getActiveEnvironment);
 	REGISTER_FUNCTION(getModelInstanceModel);
 	REGISTER_FUNCTION(addDebugCross);
@@ -3214,6 +3720,7 @@ void RenderScene::registerLuaAPI(lua_State* L)
 	//REGISTER_FUNCTION(setModelInstancePath);
 	REGISTER_FUNCTION(getModelBoneIndex);
 	REGISTER_FUNCTION(makeScreenshot);
+	REGISTER_FUNCTION(setCullingBackend);
 	REGISTER_FUNCTION(compareTGA);
 	REGISTER_FUNCTION(getTerrainHeightAt);
 
@@ -17,6 +17,7 @@ namespace Lumix
 
 struct AABB;
 struct CullResult;
+enum class CullingBackend : u8;
 struct Engine;
 struct Frustum;
 struct IAllocator;
@@ -133,7 +134,13 @@ struct ModelInstance
 	{
 		IS_BONE_ATTACHMENT_PARENT = 1 << 0,
 		ENABLED = 1 << 1,
-		VALID = 1 << 2
+		VALID = 1 << 2,
+		// rasterized into the occlusion buffer when the pipeline uses occlusion culling
+		OCCLUDER = 1 << 3,
+		// culled and drawn on GPU when the pipeline uses GPU culling
+		STATIC = 1 << 4,
+		// skinned meshes play a baked animation on GPU, pose is not used
+		BAKED_ANIMATION = 1 << 5
 	};
 
 	Model* model;
@@ -143,6 +150,37 @@ struct ModelInstance
 	EntityPtr prev_model = INVALID_ENTITY;
 	FlagSet<Flags, u8> flags;
 	u8 mesh_count;
+	// LOD selected in the last non-shadow view, for LOD hysteresis
+	u8 lod = 0;
+};
+
+
+struct BakedAnimationClip
+{
+	u32 first_frame;
+	u32 frames_count;
+	float fps;
+};
+
+
+// skinning matrices of sampled clips, for GPU playback of crowds
+struct BakedAnimation
+{
+	static constexpr u32 INVALID = 0xffFFffFF;
+
+	// frames_count * bones_count 3x4 matrices, rows are stored, same as bone palettes
+	gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
+	u32 bones_count = 0;
+	u32 frames_count = 0;
+};
+
+
+struct BakedAnimationInstance
+{
+	u32 animation = BakedAnimation::INVALID;
+	BakedAnimationClip clip;
+	// in seconds, added to global time
+	float time_offset = 0;
 };
 
 
@@ -182,6 +220,18 @@ struct DebugLine
 };
 
 
+// retained debug geometry, lives until destroyDebugGroup
+// vertex buffer contains triangles followed by lines, vertices are Vec3 (relative to origin) + u32 color
+struct DebugGroup
+{
+	u32 id;
+	DVec3 origin;
+	gpu::BufferHandle vertex_buffer;
+	u32 triangles_count;
+	u32 lines_count;
+};
+
+
 enum class RenderableTypes : u8 {
 	MESH_GROUP,
 	MESH,
@@ -219,6 +269,9 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual	struct Viewport getCameraViewport(EntityRef camera) const = 0;
 	virtual float getCameraLODMultiplier(float fov, bool is_ortho) const = 0;
 	virtual float getCameraLODMultiplier(EntityRef entity) const = 0;
+	// relative distance around LOD boundaries in which instances keep their current LOD
+	virtual void setLODHysteresis(float hysteresis) = 0;
+	virtual float getLODHysteresis() const = 0;
 	virtual ShiftedFrustum getCameraFrustum(EntityRef entity) const = 0;
 	virtual ShiftedFrustum getCameraFrustum(EntityRef entity, const Vec2& a, const Vec2& b) const = 0;
 	virtual float getTime() const = 0;
@@ -235,6 +288,8 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual LightProbeGrid& getLightProbeGrid(EntityRef entity) = 0;
 	virtual Span<LightProbeGrid> getLightProbeGrids() = 0;
 
+	// add* debug functions can be called from any thread, every thread appends to its own buffer
+	// returned pointers are valid only until the calling job waits
 	virtual DebugTriangle* addDebugTriangles(int count) = 0;
 	virtual void addDebugTriangle(const DVec3& p0, const DVec3& p1, const DVec3& p2, u32 color) = 0;
 	virtual void addDebugCone(const DVec3& vertex, const Vec3& dir, const Vec3& axis0, const Vec3& axis1, u32 color) = 0;
@@ -263,8 +318,14 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 
 	virtual void clearDebugLines() = 0;
 	virtual void clearDebugTriangles() = 0;
-	virtual const Array<DebugTriangle>& getDebugTriangles() const = 0;
-	virtual const Array<DebugLine>& getDebugLines() const = 0;
+	// moves debug geometry from all threads' buffers to `triangles` / `lines`, must not run concurrently with add*
+	virtual void takeDebugTriangles(Array<DebugTriangle>& triangles) = 0;
+	virtual void takeDebugLines(Array<DebugLine>& lines) = 0;
+	// colors are not converted, same as in addDebugLines / addDebugTriangles
+	virtual u32 createDebugGroup(const DVec3& origin, Span<const DebugTriangle> triangles, Span<const DebugLine> lines) = 0;
+	virtual void destroyDebugGroup(u32 id) = 0;
+	virtual void clearDebugGroups() = 0;
+	virtual Span<const DebugGroup> getDebugGroups() const = 0;
 
 	virtual Camera& getCamera(EntityRef entity) = 0;
 	virtual Matrix getCameraProjection(EntityRef entity) = 0;
@@ -279,12 +340,31 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 
 	virtual void enableModelInstance(EntityRef entity, bool enable) = 0;
 	virtual bool isModelInstanceEnabled(EntityRef entity) = 0;
+	virtual void setModelInstanceOccluder(EntityRef entity, bool occluder) = 0;
+	virtual bool isModelInstanceOccluder(EntityRef entity) = 0;
+	virtual void setModelInstanceStatic(EntityRef entity, bool is_static) = 0;
+	virtual bool isModelInstanceStatic(EntityRef entity) = 0;
+	// `poses` are frames_count * bones_count object space bone transforms, frames of all clips follow each other
+	virtual u32 createBakedAnimation(const Model& model, Span<const BakedAnimationClip> clips, Span<const LocalRigidTransform> poses) = 0;
+	virtual void destroyBakedAnimation(u32 animation) = 0;
+	virtual const BakedAnimation* getBakedAnimation(u32 animation) const = 0;
+	// model instance plays `clip` entirely on GPU, BakedAnimation::INVALID switches back to the pose
+	virtual void setModelInstanceBakedAnimation(EntityRef entity, u32 animation, u32 clip, float time_offset) = 0;
+	virtual const BakedAnimationInstance* getModelInstanceBakedAnimation(EntityRef entity) const = 0;
+	// changes whenever a static model instance is added, removed, moved or its model is (un)loaded
+	virtual u32 getStaticModelInstancesVersion() const = 0;
 	virtual ModelInstance* getModelInstance(EntityRef entity) = 0;
 	virtual const MeshSortData* getMeshSortData() const = 0;
 	virtual const ModelInstance* getModelInstances() const = 0;
+	virtual ModelInstance* getModelInstances() = 0;
 	virtual Path getModelInstancePath(EntityRef entity) = 0;
 	virtual void setModelInstancePath(EntityRef entity, const Path& path) = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum, RenderableTypes type) const = 0;
+	// one traversal for all frustums, e.g. the camera and its shadow cascades
+	virtual void getRenderables(Span<const ShiftedFrustum> frustums, RenderableTypes type, Span<CullResult*> results) const = 0;
+	// moves all renderables to a new spatial structure, must not be called while a pipeline is culling
+	virtual void setCullingBackend(CullingBackend backend) = 0;
+	virtual CullingBackend getCullingBackend() const = 0;
 	virtual EntityPtr getFirstModelInstance() = 0;
 	virtual EntityPtr getNextModelInstance(EntityPtr entity) = 0;
 	virtual Model* getModelInstanceModel(EntityRef entity) = 0;
@@ -296,6 +376,8 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual Material* getDecalMaterial(EntityRef entity) const = 0;
 
 	virtual void forceGrassUpdate(EntityRef entity) = 0;
+	// main thread, before pipelines cull grass, generation of missing quads continues in background
+	virtual void updateGrass(const DVec3& camera_pos) = 0;
 	virtual Terrain* getTerrain(EntityRef entity) = 0;
 	virtual void getTerrainInfos(const ShiftedFrustum& frustum, const DVec3& lod_ref_point, Array<TerrainInfo>& infos) = 0;
 	virtual float getTerrainHeightAt(EntityRef entity, float x, float z) = 0;
@@ -359,7 +441,8 @@ struct LUMIX_RENDERER_API RenderScene : IScene
 	virtual void setTextMeshFontPath(EntityRef entity, const Path& path) = 0;
 	virtual bool isTextMeshCameraOriented(EntityRef entity) = 0;
 	virtual void setTextMeshCameraOriented(EntityRef entity, bool is_oriented) = 0;
-	virtual void getTextMeshesVertices(TextMeshVertex* vertices, const DVec3& cam_pos, const Quat& rot) = 0;
+	// returns number of written vertices, glyphs which are not in the font atlas yet are skipped
+	virtual u32 getTextMeshesVertices(TextMeshVertex* vertices, const DVec3& cam_pos, const Quat& rot) = 0;
 	virtual u32 getTextMeshesVerticesCount() const = 0;
 };
 
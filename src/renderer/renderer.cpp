@@ -34,15 +34,40 @@ namespace Lumix
 static const ComponentType MODEL_INSTANCE_TYPE = Reflection::getComponentType("model_instance");
 
 
+// persistently mapped, one per frame in flight, reused once gpu signals m_fence
 struct TransientBuffer {
 	static constexpr u32 INIT_SIZE = 1 * 1024 * 1024;
+	static constexpr u32 FLAGS = (u32)gpu::BufferFlags::PERSISTENT;
 	
-	void init() {
+	void init(u32 size = INIT_SIZE) {
 		m_buffer = gpu::allocBufferHandle();
 		m_offset = 0;
-		gpu::createBuffer(m_buffer, 0, INIT_SIZE, nullptr);
-		m_size = INIT_SIZE;
-		m_ptr = (u8*)gpu::map(m_buffer, INIT_SIZE);
+		gpu::createBuffer(m_buffer, FLAGS, size, nullptr);
+		m_size = size;
+		m_ptr = (u8*)gpu::map(m_buffer, size);
+	}
+
+	void destroy() {
+		waitFence();
+		if (!m_buffer.isValid()) return;
+		gpu::unmap(m_buffer);
+		gpu::destroy(m_buffer);
+	}
+
+	// does not overflow, returns null ptr once the buffer is full, so its size works as a budget
+	Renderer::TransientSlice tryAlloc(u32 size) {
+		Renderer::TransientSlice slice = {m_buffer, 0, 0, nullptr};
+		size = (size + 15) & ~15;
+		for (;;) {
+			const i32 offset = m_offset;
+			if (offset + size > m_size) return slice;
+			if (compareAndExchange(&m_offset, offset + size, offset)) {
+				slice.offset = offset;
+				slice.size = size;
+				slice.ptr = m_ptr + offset;
+				return slice;
+			}
+		}
 	}
 
 	Renderer::TransientSlice alloc(u32 size) {
@@ -56,6 +81,7 @@ struct TransientBuffer {
 			return slice;
 		}
 
+		// workers can not create gpu buffers, overflow is uploaded in prepareToRender
 		MutexGuard lock(m_mutex);
 		if (!m_overflow.buffer.isValid()) {
 			m_overflow.buffer = gpu::allocBufferHandle();
@@ -64,6 +90,7 @@ struct TransientBuffer {
 			m_overflow.commit = 0;
 		}
 		slice.ptr = m_overflow.data + m_overflow.size;
+		slice.offset = m_overflow.size;
 		m_overflow.size += size;
 		if (m_overflow.size > m_overflow.commit) {
 			const u32 page_size = OS::getMemPageSize();
@@ -75,33 +102,46 @@ struct TransientBuffer {
 	} 
 
 	void prepareToRender() {
-		gpu::unmap(m_buffer);
-		m_ptr = nullptr;
-
-		if (m_overflow.buffer.isValid()) {
-			gpu::createBuffer(m_overflow.buffer, 0, nextPow2(m_overflow.size + m_size), nullptr);
-			gpu::update(m_overflow.buffer, m_overflow.data, m_overflow.size);
-			OS::memRelease(m_overflow.data);
-			m_overflow.data = nullptr;
-			m_overflow.commit = 0;
-		}
+		if (!m_overflow.buffer.isValid()) return;
+
+		// overflow buffer replaces m_buffer in renderDone, so it's big enough for next frames
+		const u32 size = nextPow2(m_overflow.size + m_size);
+		gpu::createBuffer(m_overflow.buffer, FLAGS, size, nullptr);
+		m_overflow.ptr = (u8*)gpu::map(m_overflow.buffer, size);
+		memcpy(m_overflow.ptr, m_overflow.data, m_overflow.size);
+		OS::memRelease(m_overflow.data);
+		m_overflow.data = nullptr;
+		m_overflow.commit = 0;
+		m_overflow.size = size;
 	}
 
+	// called after all jobs using this buffer are executed
 	void renderDone() {
 		if (m_overflow.buffer.isValid()) {
-			m_size = nextPow2(m_overflow.size + m_size);
+			gpu::unmap(m_buffer);
 			gpu::destroy(m_buffer);
 			m_buffer = m_overflow.buffer;
+			m_ptr = m_overflow.ptr;
+			m_size = m_overflow.size;
 			m_overflow.buffer = gpu::INVALID_BUFFER;
+			m_overflow.ptr = nullptr;
 			m_overflow.size = 0;
 		}
 
-		ASSERT(!m_ptr);
-		m_ptr = (u8*)gpu::map(m_buffer, m_size);
+		ASSERT(!m_fence.isValid());
+		m_fence = gpu::createFence();
 		m_offset = 0;
 	}
 
+	void waitFence() {
+		if (!m_fence.isValid()) return;
+		gpu::waitFence(m_fence);
+		gpu::destroy(m_fence);
+		m_fence = gpu::INVALID_FENCE;
+	}
+
 	gpu::BufferHandle m_buffer = gpu::INVALID_BUFFER;
+	gpu::FenceHandle m_fence = gpu::INVALID_FENCE;
 	i32 m_offset = 0;
 	u32 m_size = 0;
 	u8* m_ptr = nullptr;
@@ -110,18 +150,29 @@ struct TransientBuffer {
 	struct {
 		gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
 		u8* data = nullptr;
+		u8* ptr = nullptr;
 		u32 size = 0;
 		u32 commit = 0;
 	} m_overflow;
 };
 
 
+// pixels stay in `mem` until they are uploaded
+struct TextureUpload {
+	gpu::TextureHandle handle;
+	u32 x, y, w, h;
+	gpu::TextureFormat format;
+	Renderer::MemRef mem;
+};
+
+
 struct FrameData {
 	FrameData(struct RendererImpl& renderer, IAllocator& allocator) 
 		: jobs(allocator)
 		, renderer(renderer)
 		, to_compile_shaders(allocator)
 		, material_updates(allocator)
+		, material_table_updates(allocator)
 	{}
 
 	struct ShaderToCompile {
@@ -137,9 +188,19 @@ struct FrameData {
 		MaterialConsts value;
 	};
 
+	// count == DESTROYED_MATERIAL_TABLE_ENTRY if the entry is no longer used
+	struct MaterialTableUpdate {
+		u32 idx;
+		u32 count;
+		gpu::TextureHandle textures[Material::MAX_TEXTURE_COUNT];
+	};
+
 	TransientBuffer transient_buffer;
+	// staging memory for texture and buffer uploads, its size is the per frame upload budget
+	TransientBuffer upload_buffer;
 
 	Array<MaterialUpdates> material_updates;
+	Array<MaterialTableUpdate> material_table_updates;
 	Array<Renderer::RenderJob*> jobs;
 	Mutex shader_mutex;
 	Array<ShaderToCompile> to_compile_shaders;
@@ -173,8 +234,246 @@ struct RenderResourceManager : ResourceManager
 };
 
 
+// creates GPU buffers of model LODs requested by pipelines and releases unused ones
+struct ModelManager final : RenderResourceManager<Model>
+{
+	ModelManager(Renderer& renderer, IAllocator& allocator)
+		: RenderResourceManager<Model>(renderer, allocator)
+	{}
+
+	void updateStreaming()
+	{
+		PROFILE_FUNCTION();
+		for (Resource* res : getResourceTable()) {
+			((Model*)res)->updateLODStreaming();
+		}
+	}
+};
+
+
+static constexpr u32 SHADER_PREWARM_MAGIC = 0x5750534c; // == 'LSPW'
+
+
+enum class ShaderPrewarmVersion : u32 {
+	FIRST,
+
+	LATEST
+};
+
+
+// programs compiled in previous runs are compiled again as soon as their shader is ready,
+// mostly from binaries cached by Shader::compile, so they do not hitch when first drawn
+struct ShaderManager final : RenderResourceManager<Shader>
+{
+	static constexpr u32 MAX_PREWARMS_PER_FRAME = 32;
+
+	struct Program {
+		Path path;
+		gpu::VertexDecl decl;
+		u32 defines;
+	};
+
+	ShaderManager(Renderer& renderer, IAllocator& allocator)
+		: RenderResourceManager<Shader>(renderer, allocator)
+		, m_prewarm(allocator)
+		, m_compiled(allocator)
+	{}
+
+	static u64 getProgramKey(const Path& path, const gpu::VertexDecl& decl, u32 defines) {
+		return (((u64)path.getHash() << 32) | decl.hash) ^ ((u64)defines * 0x9E3779B97F4A7C15);
+	}
+
+	// render thread
+	void programCompiled(const Shader& shader, const gpu::VertexDecl& decl, u32 defines) {
+		const u64 key = getProgramKey(shader.getPath(), decl, defines);
+		if (m_compiled.find(key).isValid()) return;
+		m_compiled.insert(key, {shader.getPath(), decl, defines});
+	}
+
+	void loadPrewarmList() {
+		FileSystem& fs = m_renderer.getEngine().getFileSystem();
+		Array<u8> data(m_allocator);
+		if (!fs.fileExists(".lumix/shader_cache/_prewarm.bin")) return;
+		if (!fs.getContentSync(Path(".lumix/shader_cache/_prewarm.bin"), Ref(data))) return;
+
+		InputMemoryStream blob(data.begin(), data.byte_size());
+		u32 magic;
+		ShaderPrewarmVersion version;
+		blob.read(magic);
+		blob.read(version);
+		if (magic != SHADER_PREWARM_MAGIC || version > ShaderPrewarmVersion::LATEST) {
+			logWarning("Renderer") << ".lumix/shader_cache/_prewarm.bin has unsupported version";
+			return;
+		}
+
+		// define indices depend on the order in which shaders were loaded, so they are remapped by name
+		u32 remap[Renderer::MAX_SHADER_DEFINES];
+		u32 defines_count;
+		blob.read(defines_count);
+		if (defines_count > lengthOf(remap)) return;
+		for (u32 i = 0; i < defines_count; ++i) {
+			char define[64];
+			if (!blob.readString(Span(define))) return;
+			remap[i] = m_renderer.getShaderDefineIdx(define);
+		}
+
+		u32 count;
+		blob.read(count);
+		m_prewarm.reserve(count);
+		for (u32 i = 0; i < count; ++i) {
+			char path[MAX_PATH_LENGTH];
+			u32 defines;
+			Program& p = m_prewarm.emplace();
+			blob.readString(Span(path));
+			blob.read(p.decl);
+			blob.read(defines);
+			p.path = path;
+			p.defines = 0;
+			for (u32 j = 0; j < defines_count; ++j) {
+				if (defines & (1 << j)) p.defines |= 1 << remap[j];
+			}
+		}
+	}
+
+	void savePrewarmList() {
+		OutputMemoryStream blob(m_allocator);
+		blob.write(SHADER_PREWARM_MAGIC);
+		blob.write(ShaderPrewarmVersion::LATEST);
+		const u32 defines_count = m_renderer.getShaderDefinesCount();
+		blob.write(defines_count);
+		for (u32 i = 0; i < defines_count; ++i) {
+			blob.writeString(m_renderer.getShaderDefine(i));
+		}
+		// programs which were not used in this run are kept for the next one
+		for (const Program& p : m_prewarm) {
+			const u64 key = getProgramKey(p.path, p.decl, p.defines);
+			if (!m_compiled.find(key).isValid()) m_compiled.insert(key, p);
+		}
+		blob.write((u32)m_compiled.size());
+		for (const Program& p : m_compiled) {
+			blob.writeString(p.path.c_str());
+			blob.write(p.decl);
+			blob.write(p.defines);
+		}
+
+		FileSystem& fs = m_renderer.getEngine().getFileSystem();
+		OS::OutputFile file;
+		if (!fs.open(".lumix/shader_cache/_prewarm.bin", Ref(file))) {
+			logError("Renderer") << "Could not save .lumix/shader_cache/_prewarm.bin";
+			return;
+		}
+		if (!file.write(blob.getData(), blob.getPos())) logError("Renderer") << "Could not write .lumix/shader_cache/_prewarm.bin";
+		file.close();
+	}
+
+	// main thread, before programs queued in this frame are registered in their shaders
+	void prewarm() {
+		if (m_prewarm.empty()) return;
+
+		PROFILE_FUNCTION();
+		u32 queued = 0;
+		for (i32 i = m_prewarm.size() - 1; i >= 0 && queued < MAX_PREWARMS_PER_FRAME; --i) {
+			const Program& p = m_prewarm[i];
+			Shader* shader = (Shader*)get(p.path);
+			if (!shader || shader->isEmpty()) continue;
+			if (shader->isReady()) {
+				shader->getProgram(p.decl, p.defines);
+				++queued;
+			}
+			else if (!shader->isFailure()) {
+				continue;
+			}
+			m_prewarm.swapAndPop(i);
+		}
+	}
+
+	Array<Program> m_prewarm;
+	HashMap<u64, Program> m_compiled;
+};
+
+
+// streams mips of textures according to sizes requested by pipelines, see Texture::requestSize
+struct TextureManager final : RenderResourceManager<Texture>
+{
+	// frames without any request before a texture drops to its lowest mips
+	static constexpr u32 UNUSED_FRAMES = 300;
+	static constexpr u32 MAX_UPLOADS_PER_FRAME = 4;
+
+	struct StreamRequest {
+		Texture* texture;
+		u32 mips;
+	};
+
+	TextureManager(Renderer& renderer, IAllocator& allocator)
+		: RenderResourceManager<Texture>(renderer, allocator)
+		, m_to_stream(allocator)
+	{}
+
+	void updateStreaming()
+	{
+		if (m_streaming_budget == 0) return;
+		PROFILE_FUNCTION();
+
+		u64 resident = 0;
+		m_to_stream.clear();
+		for (Resource* res : getResourceTable()) {
+			Texture* texture = (Texture*)res;
+			if (!texture->isReady() || !texture->isStreamed()) continue;
+
+			const i32 requested = texture->requested_size;
+			texture->requested_size = 0;
+			u32 wanted = texture->streamed_mips;
+			if (requested > 0) {
+				texture->unused_frames = 0;
+				wanted = texture->getStreamedMips(requested);
+			}
+			else if (++texture->unused_frames > UNUSED_FRAMES) {
+				wanted = texture->getMaxStreamedMips();
+			}
+			resident += texture->getGPUSize(texture->streamed_mips);
+			if (wanted != texture->streamed_mips) m_to_stream.push({texture, wanted});
+		}
+
+		u32 uploads = 0;
+		auto stream = [&](const StreamRequest& req){
+			resident -= req.texture->getGPUSize(req.texture->streamed_mips);
+			req.texture->stream(req.mips);
+			resident += req.texture->getGPUSize(req.mips);
+			++uploads;
+		};
+
+		for (const StreamRequest& req : m_to_stream) {
+			if (uploads >= MAX_UPLOADS_PER_FRAME) return;
+			if (req.texture->unused_frames > UNUSED_FRAMES) stream(req);
+		}
+
+		for (const StreamRequest& req : m_to_stream) {
+			Texture* texture = req.texture;
+			if (req.mips >= texture->streamed_mips) continue;
+
+			const u64 cost = texture->getGPUSize(req.mips) - texture->getGPUSize(texture->streamed_mips);
+			// evict mips which are not needed anymore only when we are out of budget
+			for (const StreamRequest& victim : m_to_stream) {
+				if (resident + cost <= m_streaming_budget || uploads >= MAX_UPLOADS_PER_FRAME) break;
+				if (victim.mips > victim.texture->streamed_mips) stream(victim);
+			}
+			if (uploads >= MAX_UPLOADS_PER_FRAME) return;
+			if (resident + cost <= m_streaming_budget) stream(req);
+		}
+	}
+
+	Array<StreamRequest> m_to_stream;
+	u64 m_streaming_budget = 0;
+};
+
+
 struct GPUProfiler
 {
+	struct StatsQueries
+	{
+		gpu::QueryHandle handles[(u32)gpu::PipelineStat::COUNT];
+	};
+
 	struct Query
 	{
 		StaticString<32> name;
@@ -183,12 +482,20 @@ struct GPUProfiler
 		i64 profiler_link;
 		bool is_end;
 		bool is_frame;
+		// measures the whole frame, not passed to Profiler
+		bool is_frame_time;
+		// pipeline stats of commands between the previous block begin or end and this query
+		bool has_stats;
+		StatsQueries stats;
+		gpu::DrawCounters counters;
 	};
 
 
 	GPUProfiler(IAllocator& allocator) 
 		: m_queries(allocator)
 		, m_pool(allocator)
+		, m_stats_pool(allocator)
+		, m_open_stats(allocator)
 		, m_gpu_to_cpu_offset(0)
 	{
 	}
@@ -226,17 +533,36 @@ struct GPUProfiler
 			m_gpu_to_cpu_offset = cpu_timestamp - u64(gpu_timestamp * (OS::Timer::getFrequency() / double(gpu::getQueryFrequency())));
 			gpu::destroy(q);
 		}
+		m_resolved_counters = gpu::getDrawCounters();
+	}
+
+
+	static void destroy(const StatsQueries& stats)
+	{
+		for (const gpu::QueryHandle h : stats.handles) gpu::destroy(h);
 	}
 
 
 	void clear()
 	{
+		if (m_stats_active) {
+			for (u32 i = 0; i < (u32)gpu::PipelineStat::COUNT; ++i) gpu::endQuery((gpu::PipelineStat)i);
+			destroy(m_active_stats);
+			m_stats_active = false;
+		}
+		for (const Query& q : m_queries) {
+			if (q.has_stats) destroy(q.stats);
+		}
 		m_queries.clear();
 
 		for(const gpu::QueryHandle h : m_pool) {
 			gpu::destroy(h);
 		}
 		m_pool.clear();
+		for (const StatsQueries& stats : m_stats_pool) destroy(stats);
+		m_stats_pool.clear();
+		m_open_stats.clear();
+		m_depth = 0;
 	}
 
 
@@ -251,6 +577,43 @@ struct GPUProfiler
 	}
 
 
+	// a query object is bound to a stat on first use, so each pooled item keeps one query per stat
+	StatsQueries allocStats()
+	{
+		if (!m_stats_pool.empty()) {
+			const StatsQueries res = m_stats_pool.back();
+			m_stats_pool.pop();
+			return res;
+		}
+		StatsQueries res;
+		for (gpu::QueryHandle& h : res.handles) h = gpu::createQuery();
+		return res;
+	}
+
+
+	// GL allows only one active query per stat, so the command stream is split into segments at block boundaries
+	// and each segment is accounted to the innermost block open during it
+	void splitStats(Query& q, int depth_after)
+	{
+		q.counters = gpu::getDrawCounters();
+		q.has_stats = m_stats_active;
+		if (m_stats_active) {
+			for (u32 i = 0; i < (u32)gpu::PipelineStat::COUNT; ++i) gpu::endQuery((gpu::PipelineStat)i);
+			q.stats = m_active_stats;
+			m_stats_active = false;
+		}
+		m_depth = depth_after;
+		// nothing between frames is accounted, so there's no need to measure it
+		if (m_depth > 0 && gpu::isPipelineStatsSupported()) {
+			m_active_stats = allocStats();
+			for (u32 i = 0; i < (u32)gpu::PipelineStat::COUNT; ++i) {
+				gpu::beginQuery(m_active_stats.handles[i], (gpu::PipelineStat)i);
+			}
+			m_stats_active = true;
+		}
+	}
+
+
 	void beginQuery(const char* name, i64 profiler_link)
 	{
 		MutexGuard lock(m_mutex);
@@ -259,8 +622,10 @@ struct GPUProfiler
 		q.name = name;
 		q.is_end = false;
 		q.is_frame = false;
+		q.is_frame_time = false;
 		q.handle = allocQuery();
 		gpu::queryTimestamp(q.handle);
+		splitStats(q, m_depth + 1);
 	}
 
 
@@ -270,11 +635,64 @@ struct GPUProfiler
 		Query& q = m_queries.emplace();
 		q.is_end = true;
 		q.is_frame = false;
+		q.is_frame_time = false;
+		q.handle = allocQuery();
+		gpu::queryTimestamp(q.handle);
+		splitStats(q, maximum(m_depth - 1, 0));
+	}
+
+
+	void frameTimeQuery(bool is_end)
+	{
+		MutexGuard lock(m_mutex);
+		Query& q = m_queries.emplace();
+		q.is_end = is_end;
+		q.is_frame = false;
+		q.is_frame_time = true;
+		q.has_stats = false;
 		q.handle = allocQuery();
 		gpu::queryTimestamp(q.handle);
 	}
 
 
+	float getFrameTime()
+	{
+		MutexGuard lock(m_mutex);
+		return m_frame_time;
+	}
+
+
+	bool isReady(const Query& q) const
+	{
+		if (!gpu::isQueryReady(q.handle)) return false;
+		if (!q.has_stats) return true;
+		for (const gpu::QueryHandle h : q.stats.handles) {
+			if (!gpu::isQueryReady(h)) return false;
+		}
+		return true;
+	}
+
+
+	void resolveStats(const Query& q)
+	{
+		const gpu::DrawCounters prev = m_resolved_counters;
+		m_resolved_counters = q.counters;
+		if (!m_open_stats.empty()) {
+			Profiler::GPUStatsBlock& s = m_open_stats.back();
+			s.draw_calls += u32(q.counters.draw_calls - prev.draw_calls);
+			s.dispatches += u32(q.counters.dispatches - prev.dispatches);
+			s.state_changes += u32(q.counters.state_changes - prev.state_changes);
+			if (q.has_stats) {
+				s.vertices += gpu::getQueryResult(q.stats.handles[(u32)gpu::PipelineStat::VERTICES]);
+				s.primitives += gpu::getQueryResult(q.stats.handles[(u32)gpu::PipelineStat::PRIMITIVES]);
+				s.fragment_invocations += gpu::getQueryResult(q.stats.handles[(u32)gpu::PipelineStat::FRAGMENT_INVOCATIONS]);
+				s.compute_invocations += gpu::getQueryResult(q.stats.handles[(u32)gpu::PipelineStat::COMPUTE_INVOCATIONS]);
+			}
+		}
+		if (q.has_stats) m_stats_pool.push(q.stats);
+	}
+
+
 	void frame()
 	{
 		PROFILE_FUNCTION();
@@ -290,15 +708,43 @@ struct GPUProfiler
 				continue;
 			}
 			
-			if (!gpu::isQueryReady(q.handle)) break;
+			if (!isReady(q)) break;
 
-			if (q.is_end) {
+			if (q.is_frame_time) {
+				const u64 timestamp = gpu::getQueryResult(q.handle);
+				if (q.is_end) {
+					m_frame_time = float(double(timestamp - m_frame_start) / gpu::getQueryFrequency());
+				}
+				else {
+					m_frame_start = timestamp;
+				}
+			}
+			else if (q.is_end) {
 				const u64 timestamp = toCPUTimestamp(gpu::getQueryResult(q.handle));
+				resolveStats(q);
+				if (!m_open_stats.empty()) {
+					const Profiler::GPUStatsBlock stats = m_open_stats.back();
+					m_open_stats.pop();
+					if (!m_open_stats.empty()) {
+						Profiler::GPUStatsBlock& parent = m_open_stats.back();
+						parent.vertices += stats.vertices;
+						parent.primitives += stats.primitives;
+						parent.fragment_invocations += stats.fragment_invocations;
+						parent.compute_invocations += stats.compute_invocations;
+						parent.draw_calls += stats.draw_calls;
+						parent.dispatches += stats.dispatches;
+						parent.state_changes += stats.state_changes;
+					}
+					Profiler::gpuStats(stats);
+				}
 				Profiler::endGPUBlock(timestamp);
 			}
 			else {
 				const u64 timestamp = toCPUTimestamp(gpu::getQueryResult(q.handle));
+				resolveStats(q);
 				Profiler::beginGPUBlock(q.name, timestamp, q.profiler_link);
+				Profiler::GPUStatsBlock& stats = m_open_stats.emplace();
+				memset(&stats, 0, sizeof(stats));
 			}
 			m_pool.push(q.handle);
 			m_queries.erase(0);
@@ -308,8 +754,18 @@ struct GPUProfiler
 
 	Array<Query> m_queries;
 	Array<gpu::QueryHandle> m_pool;
+	Array<StatsQueries> m_stats_pool;
+	// stats of blocks not yet resolved, innermost last
+	Array<Profiler::GPUStatsBlock> m_open_stats;
+	gpu::DrawCounters m_resolved_counters = {};
+	StatsQueries m_active_stats;
+	bool m_stats_active = false;
+	// blocks begun and not ended on the render thread, unlike m_open_stats which lag behind
+	int m_depth = 0;
 	Mutex m_mutex;
 	i64 m_gpu_to_cpu_offset;
+	u64 m_frame_start = 0;
+	float m_frame_time = 0;
 };
 
 
@@ -417,6 +873,8 @@ static void registerProperties(IAllocator& allocator)
 		),
 		component("model_instance",
 			property("Enabled", &RenderScene::isModelInstanceEnabled, &RenderScene::enableModelInstance),
+			property("Occluder", &RenderScene::isModelInstanceOccluder, &RenderScene::setModelInstanceOccluder),
+			property("Static", &RenderScene::isModelInstanceStatic, &RenderScene::setModelInstanceStatic),
 			property("Source", LUMIX_PROP(RenderScene, ModelInstancePath),
 				ResourceAttribute("Mesh (*.msh)", Model::TYPE))
 		),
@@ -481,9 +939,12 @@ static void registerProperties(IAllocator& allocator)
 
 struct RendererImpl final : Renderer
 {
+	static constexpr u32 MIN_FRAMES_IN_FLIGHT = 3;
+	static constexpr u32 MAX_FRAMES_IN_FLIGHT = 8;
+
 	explicit RendererImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
+		, m_allocator(engine.getAllocator(), "renderer")
 		, m_texture_manager(*this, m_allocator)
 		, m_pipeline_manager(*this, m_allocator)
 		, m_model_manager(*this, m_allocator)
@@ -495,13 +956,16 @@ struct RendererImpl final : Renderer
 		, m_profiler(m_allocator)
 		, m_layers(m_allocator)
 		, m_frames(m_allocator)
+		, m_pending_binaries(m_allocator)
+		, m_pending_uploads(m_allocator)
 		, m_material_buffer(m_allocator)
+		, m_material_table(m_allocator)
+		, m_pending_readbacks(m_allocator)
+		, m_finished_readbacks(m_allocator)
+		, m_live_readbacks(m_allocator)
 	{
 		m_shader_defines.reserve(32);
 		gpu::preinit(m_allocator);
-		m_frames.emplace(*this, m_allocator);
-		m_frames.emplace(*this, m_allocator);
-		m_frames.emplace(*this, m_allocator);
 	}
 
 
@@ -518,18 +982,31 @@ struct RendererImpl final : Renderer
 
 		frame();
 		waitForRender();
+		if (m_headless) {
+			dispatchReadbacks();
+			return;
+		}
+		m_shader_manager.savePrewarmList();
 		
 		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
 		JobSystem::runEx(this, [](void* data) {
 			RendererImpl* renderer = (RendererImpl*)data;
+			// owners of the callbacks might wait for them to free their data
+			renderer->checkReadbacks(true);
 			for (FrameData& frame : renderer->m_frames) {
-				gpu::destroy(frame.transient_buffer.m_buffer);
+				frame.transient_buffer.destroy();
+				frame.upload_buffer.destroy();
+			}
+			for (const TextureUpload& upload : renderer->m_pending_uploads) {
+				if (upload.mem.own) renderer->free(upload.mem);
 			}
 			gpu::destroy(renderer->m_material_buffer.buffer);
+			if (renderer->m_material_table.buffer.isValid()) gpu::destroy(renderer->m_material_table.buffer);
 			renderer->m_profiler.clear();
 			gpu::shutdown();
 		}, &signal, JobSystem::INVALID_HANDLE, 1);
 		JobSystem::wait(signal);
+		dispatchReadbacks();
 	}
 
 
@@ -542,6 +1019,7 @@ struct RendererImpl final : Renderer
 			RendererImpl* renderer;
 		} init_data;
 		init_data.renderer = this;
+		u32 frames_in_flight = 3;
 		
 		char cmd_line[4096];
 		OS::getCommandLine(Span(cmd_line));
@@ -553,10 +1031,56 @@ struct RendererImpl final : Renderer
 			else if (cmd_line_parser.currentEquals("-debug_opengl")) {
 				init_data.flags |= (u32)gpu::InitFlags::DEBUG_OUTPUT;
 			}
+			else if (cmd_line_parser.currentEquals("-texture_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, lengthOf(tmp));
+				u32 megabytes;
+				if (fromCString(Span(tmp, stringLength(tmp)), Ref(megabytes))) {
+					m_texture_manager.m_streaming_budget = u64(megabytes) << 20;
+				}
+			}
+			else if (cmd_line_parser.currentEquals("-texture_upload_budget")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, lengthOf(tmp));
+				u32 megabytes;
+				if (fromCString(Span(tmp, stringLength(tmp)), Ref(megabytes))) {
+					m_texture_upload_budget = megabytes << 20;
+				}
+			}
+			else if (cmd_line_parser.currentEquals("-frames_in_flight")) {
+				if (!cmd_line_parser.next()) break;
+				char tmp[32];
+				cmd_line_parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(frames_in_flight));
+			}
+			else if (cmd_line_parser.currentEquals("-pipelined_setup")) {
+				m_pipelined_setup = true;
+			}
+			else if (cmd_line_parser.currentEquals("-bindless")) {
+				m_bindless = true;
+			}
+		}
+
+		// render() releases a frame only after the next one is submitted, so at least 3 are needed
+		frames_in_flight = clamp(frames_in_flight, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+		m_frames.reserve(frames_in_flight);
+		for (u32 i = 0; i < frames_in_flight; ++i) {
+			m_frames.emplace(*this, m_allocator);
+		}
+
+		m_headless = m_engine.isHeadless();
+		if (m_headless) {
+			// resources still load, but only their CPU side data are created
+			logInfo("Renderer") << "Running headless, GPU is not used";
+			m_bindless = false;
+			m_cpu_frame = m_frames.begin();
+			m_gpu_frame = m_frames.begin();
 		}
 
 		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
-		JobSystem::runEx(&init_data, [](void* data) {
+		if (!m_headless) JobSystem::runEx(&init_data, [](void* data) {
 			PROFILE_BLOCK("init_render");
 			InitData* init_data = (InitData*)data;
 			RendererImpl& renderer = *(RendererImpl*)init_data->renderer;
@@ -577,6 +1101,7 @@ struct RendererImpl final : Renderer
 
 			for (FrameData& frame : renderer.m_frames) {
 				frame.transient_buffer.init();
+				if (renderer.m_texture_upload_budget > 0) frame.upload_buffer.init(renderer.m_texture_upload_budget);
 			}
 			renderer.m_cpu_frame = renderer.m_frames.begin();
 			renderer.m_gpu_frame = renderer.m_frames.begin();
@@ -584,27 +1109,49 @@ struct RendererImpl final : Renderer
 			renderer.m_profiler.init();
 
 			MaterialBuffer& mb = renderer.m_material_buffer;
-			mb.buffer = gpu::allocBufferGroupHandle();
 			mb.map.insert(0, 0);
-			mb.data.resize(400);
+			mb.data.resize(MaterialBuffer::INITIAL_CAPACITY);
 			mb.data[0].hash = 0;
 			mb.data[0].ref_count = 1;
 			mb.first_free = 1;
-			for (int i = 1; i < 400; ++i) {
+			mb.used = 1;
+			for (u32 i = 1; i < MaterialBuffer::INITIAL_CAPACITY; ++i) {
 				mb.data[i].ref_count = 0;
 				mb.data[i].next_free = i + 1;
 			}
 			mb.data.back().next_free = -1;
+
+			MaterialConsts default_mat = {};
+			default_mat.color = Vec4(1, 0, 1, 1);
+			mb.gpu_data.resize(MaterialBuffer::INITIAL_CAPACITY);
+			memset(mb.gpu_data.begin(), 0, mb.gpu_data.byte_size());
+			mb.gpu_data[0] = default_mat;
+			mb.buffer = gpu::allocBufferGroupHandle();
 			gpu::createBufferGroup(mb.buffer
 				, (u32)gpu::BufferFlags::UNIFORM_BUFFER
 				, sizeof(MaterialConsts)
-				, 400
-				, nullptr
+				, mb.gpu_data.size()
+				, mb.gpu_data.begin()
 			);
 
-			MaterialConsts default_mat;
-			default_mat.color = Vec4(1, 0, 1, 1);
-			gpu::update(mb.buffer, &default_mat, 0);
+			if (renderer.m_bindless && !gpu::isBindlessSupported()) {
+				logWarning("Renderer") << "Bindless textures are not supported, textures are bound per draw call";
+				renderer.m_bindless = false;
+			}
+			if (renderer.m_bindless) {
+				MaterialTable& mt = renderer.m_material_table;
+				mt.entries.resize(MaterialTable::MAX_ENTRIES);
+				mt.first_free = 0;
+				for (u32 i = 0; i < MaterialTable::MAX_ENTRIES; ++i) {
+					mt.entries[i].count = 0;
+					mt.entries[i].next_free = i + 1;
+				}
+				mt.entries.back().next_free = -1;
+				mt.gpu_data.resize(MaterialTable::MAX_ENTRIES * Material::MAX_TEXTURE_COUNT);
+				memset(mt.gpu_data.begin(), 0, mt.gpu_data.byte_size());
+				mt.buffer = gpu::allocBufferHandle();
+				gpu::createBuffer(mt.buffer, 0, mt.gpu_data.byte_size(), mt.gpu_data.begin());
+			}
 		}, &signal, JobSystem::INVALID_HANDLE, 1);
 		JobSystem::wait(signal);
 
@@ -615,6 +1162,9 @@ struct RendererImpl final : Renderer
 		m_material_manager.create(Material::TYPE, manager);
 		m_particle_emitter_manager.create(ParticleEmitterResource::TYPE, manager);
 		m_shader_manager.create(Shader::TYPE, manager);
+		const StaticString<MAX_PATH_LENGTH> shader_cache_path(m_engine.getFileSystem().getBasePath(), ".lumix/shader_cache");
+		OS::makePath(shader_cache_path);
+		if (!m_headless) m_shader_manager.loadPrewarmList();
 		m_font_manager = LUMIX_NEW(m_allocator, FontManager)(*this, m_allocator);
 		m_font_manager->create(FontResource::TYPE, manager);
 
@@ -667,6 +1217,12 @@ struct RendererImpl final : Renderer
 	}
 
 
+	float getGPUFrameTime() override
+	{
+		return m_profiler.getFrameTime();
+	}
+
+
 	void getTextureImage(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, Span<u8> data) override
 	{
 		struct Cmd : RenderJob {
@@ -700,58 +1256,222 @@ struct RendererImpl final : Renderer
 	}
 
 
+	u32 getTextureImageAsync(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, TextureImageCallback callback, void* user_ptr) override
+	{
+		struct Cmd : RenderJob {
+			void setup() override {}
+			void execute() override {
+				PROFILE_FUNCTION();
+				gpu::pushDebugGroup("get image data async");
+				Readback& r = renderer->m_pending_readbacks.emplace();
+				r.id = id;
+				r.callback = callback;
+				r.user_ptr = user_ptr;
+				r.size = w * h * gpu::getBytesPerPixel(out_format);
+				r.staging = gpu::allocTextureHandle();
+				const u32 flags = u32(gpu::TextureFlags::NO_MIPS) | u32(gpu::TextureFlags::READBACK);
+				gpu::createTexture(r.staging, w, h, 1, out_format, flags, nullptr, "staging_buffer");
+				gpu::copy(r.staging, handle);
+				r.buffer = gpu::allocBufferHandle();
+				gpu::createBuffer(r.buffer, 0, r.size, nullptr);
+				gpu::readTexture(r.staging, r.buffer, r.size);
+				r.fence = gpu::createFence();
+				gpu::popDebugGroup();
+			}
+
+			RendererImpl* renderer;
+			gpu::TextureHandle handle;
+			gpu::TextureFormat out_format;
+			u32 w;
+			u32 h;
+			TextureImageCallback callback;
+			void* user_ptr;
+			u32 id;
+		};
+
+		const u32 id = ++m_last_readback_id;
+		m_live_readbacks.push(id);
+		Cmd* cmd = LUMIX_NEW(m_allocator, Cmd);
+		cmd->id = id;
+		cmd->renderer = this;
+		cmd->handle = texture;
+		cmd->w = w;
+		cmd->h = h;
+		cmd->out_format = out_format;
+		cmd->callback = callback;
+		cmd->user_ptr = user_ptr;
+		queue(cmd, 0);
+		return id;
+	}
+
+
+	void cancelTextureImageAsync(u32 id) override {
+		m_live_readbacks.swapAndPopItem(id);
+	}
+
+
+	// render thread, moves data of signaled readbacks to main thread
+	void checkReadbacks(bool wait) {
+		for (i32 i = m_pending_readbacks.size() - 1; i >= 0; --i) {
+			Readback& r = m_pending_readbacks[i];
+			if (wait) gpu::waitFence(r.fence);
+			else if (!gpu::isFenceSignaled(r.fence)) continue;
+
+			FinishedReadback finished(m_allocator);
+			finished.id = r.id;
+			finished.callback = r.callback;
+			finished.user_ptr = r.user_ptr;
+			finished.data.resize(r.size);
+			gpu::readBuffer(r.buffer, Span(finished.data.begin(), finished.data.end()));
+			gpu::destroy(r.fence);
+			gpu::destroy(r.buffer);
+			gpu::destroy(r.staging);
+			m_pending_readbacks.swapAndPop(i);
+
+			MutexGuard lock(m_readbacks_mutex);
+			m_finished_readbacks.emplace(static_cast<FinishedReadback&&>(finished));
+		}
+	}
+
+
+	void dispatchReadbacks() {
+		Array<FinishedReadback> finished(m_allocator);
+		{
+			MutexGuard lock(m_readbacks_mutex);
+			if (m_finished_readbacks.empty()) return;
+			finished.swap(m_finished_readbacks);
+		}
+		for (const FinishedReadback& r : finished) {
+			const i32 live_idx = m_live_readbacks.indexOf(r.id);
+			if (live_idx < 0) continue;
+			m_live_readbacks.swapAndPop(live_idx);
+			r.callback(Span<const u8>(r.data.begin(), r.data.end()), r.user_ptr);
+		}
+	}
+
+
 	void updateTexture(gpu::TextureHandle handle, u32 x, u32 y, u32 w, u32 h, gpu::TextureFormat format, const MemRef& mem) override
 	{
+		if (m_headless) {
+			if (mem.own) free(mem);
+			return;
+		}
 		ASSERT(mem.size > 0);
 		ASSERT(handle.isValid());
 
 		struct Cmd : RenderJob {
-			void setup() override {}
+			void setup() override {
+				PROFILE_FUNCTION();
+				staging = stage(*frame, upload.mem);
+			}
 			void execute() override {
 				PROFILE_FUNCTION();
-				gpu::update(handle, 0, x, y, w, h, format, mem.data);
-				if (mem.own) {
-					renderer->free(mem);
-				}
+				renderer->upload(upload, staging);
 			}
 
-			gpu::TextureHandle handle;
-			u32 x, y, w, h;
-			gpu::TextureFormat format;
-			MemRef mem;
+			TextureUpload upload;
+			TransientSlice staging;
+			FrameData* frame;
 			RendererImpl* renderer;
 		};
 
 		Cmd* cmd = LUMIX_NEW(m_allocator, Cmd);
-		cmd->handle = handle;
-		cmd->x = x;
-		cmd->y = y;
-		cmd->w = w;
-		cmd->h = h;
-		cmd->format = format;
-		cmd->mem = mem;
+		cmd->upload = {handle, x, y, w, h, format, mem};
+		cmd->frame = m_cpu_frame;
 		cmd->renderer = this;
 
 		queue(cmd, 0);
 	}
 
 
-	gpu::TextureHandle loadTexture(const MemRef& memory, u32 flags, gpu::TextureInfo* info, const char* debug_name) override
+	// worker, copies pixels to the frame's staging memory, null ptr if they do not fit in the budget
+	static TransientSlice stage(FrameData& frame, const MemRef& mem) {
+		const TransientSlice slice = frame.upload_buffer.tryAlloc(mem.size);
+		if (slice.ptr) memcpy(slice.ptr, mem.data, mem.size);
+		return slice;
+	}
+
+
+	// render thread, uploads over the budget wait for next frames, in their original order
+	void upload(const TextureUpload& upload, const TransientSlice& staging) {
+		if (m_pending_uploads.empty()) {
+			if (staging.ptr) {
+				gpu::update(upload.handle, 0, upload.x, upload.y, upload.w, upload.h, upload.format, staging.buffer, staging.offset);
+				if (upload.mem.own) free(upload.mem);
+				return;
+			}
+			// would never fit
+			if (upload.mem.size > m_texture_upload_budget) {
+				gpu::update(upload.handle, 0, upload.x, upload.y, upload.w, upload.h, upload.format, upload.mem.data);
+				if (upload.mem.own) free(upload.mem);
+				return;
+			}
+		}
+		// memory not owned by us is valid only until this job is executed
+		TextureUpload& pending = m_pending_uploads.emplace(upload);
+		if (!upload.mem.own) pending.mem = copy(upload.mem.data, upload.mem.size);
+	}
+
+
+	// render thread, before the frame's jobs, so pending uploads are not overtaken by newer ones
+	void flushPendingUploads(FrameData& frame) {
+		if (m_pending_uploads.empty()) return;
+
+		PROFILE_FUNCTION();
+		u32 done = 0;
+		for (const TextureUpload& upload : m_pending_uploads) {
+			if (upload.mem.size > m_texture_upload_budget) {
+				gpu::update(upload.handle, 0, upload.x, upload.y, upload.w, upload.h, upload.format, upload.mem.data);
+			}
+			else {
+				const TransientSlice staging = stage(frame, upload.mem);
+				if (!staging.ptr) break;
+				gpu::update(upload.handle, 0, upload.x, upload.y, upload.w, upload.h, upload.format, staging.buffer, staging.offset);
+			}
+			if (upload.mem.own) free(upload.mem);
+			++done;
+		}
+		const u32 count = m_pending_uploads.size();
+		for (u32 i = done; i < count; ++i) m_pending_uploads[i - done] = m_pending_uploads[i];
+		m_pending_uploads.shrink(count - done);
+		Profiler::pushInt("pending texture uploads", m_pending_uploads.size());
+	}
+
+
+	gpu::TextureHandle loadTexture(const MemRef& memory, u32 flags, u32 skip_mips, gpu::TextureInfo* info, const char* debug_name) override
 	{
 		ASSERT(memory.size > 0);
 
+		if(info) {
+			*info = gpu::getTextureInfo(memory.data);
+		}
+
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_TEXTURE;
+		}
+
 		const gpu::TextureHandle handle = gpu::allocTextureHandle();
 		if (!handle.isValid()) return handle;
 
-		if(info) {
-			*info = gpu::getTextureInfo(memory.data);
+		reloadTexture(handle, memory, flags, skip_mips, debug_name);
+
+		return handle;
+	}
+
+
+	void reloadTexture(gpu::TextureHandle handle, const MemRef& memory, u32 flags, u32 skip_mips, const char* debug_name) override
+	{
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return;
 		}
 
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override {
 				PROFILE_FUNCTION();
-				gpu::loadTexture(handle, memory.data, memory.size, flags, debug_name);
+				gpu::loadTexture(handle, memory.data, memory.size, flags, skip_mips, debug_name);
 				if(memory.own) {
 					renderer->free(memory);
 				}
@@ -761,6 +1481,7 @@ struct RendererImpl final : Renderer
 			gpu::TextureHandle handle;
 			MemRef memory;
 			u32 flags;
+			u32 skip_mips;
 			RendererImpl* renderer; 
 		};
 
@@ -769,15 +1490,20 @@ struct RendererImpl final : Renderer
 		cmd->handle = handle;
 		cmd->memory = memory;
 		cmd->flags = flags;
+		cmd->skip_mips = skip_mips;
 		cmd->renderer = this;
 		queue(cmd, 0);
-
-		return handle;
 	}
 
 
+	void setTextureStreamingBudget(u64 bytes) override { m_texture_manager.m_streaming_budget = bytes; }
+	u64 getTextureStreamingBudget() const override { return m_texture_manager.m_streaming_budget; }
+
+
 	TransientSlice allocTransient(u32 size) override
 	{
+		ASSERT(!m_headless);
+		if (m_headless) return {gpu::INVALID_BUFFER, 0, 0, nullptr};
 		return m_cpu_frame->transient_buffer.alloc(size);
 	}
 	
@@ -786,6 +1512,7 @@ struct RendererImpl final : Renderer
 	}
 
 	u32 createMaterialConstants(const MaterialConsts& data) override {
+		if (m_headless) return 0;
 		const u32 hash = crc32(&data, sizeof(data));
 		auto iter = m_material_buffer.map.find(hash);
 		u32 idx;
@@ -793,23 +1520,78 @@ struct RendererImpl final : Renderer
 			idx = iter.value();
 		}
 		else {
-			if (m_material_buffer.first_free == -1) {
-				ASSERT(false);
-				++m_material_buffer.data[0].ref_count;
-				return 0;
-			}
+			if (m_material_buffer.first_free == -1) growMaterialBuffer();
 			idx = m_material_buffer.first_free;
 			m_material_buffer.first_free = m_material_buffer.data[m_material_buffer.first_free].next_free;
 			m_material_buffer.data[idx].ref_count = 0;
 			m_material_buffer.data[idx].hash = crc32(&data, sizeof(data));
 			m_material_buffer.map.insert(hash, idx);
+			++m_material_buffer.used;
 			m_cpu_frame->material_updates.push({idx, data});
 		}
 		++m_material_buffer.data[idx].ref_count;
 		return idx;
 	}
 
+	bool isBindless() const override { return m_bindless; }
+	bool isHeadless() const override { return m_headless; }
+
+	gpu::BufferHandle getMaterialTableBuffer() override { return m_material_table.buffer; }
+
+	u32 createMaterialTableEntry(const gpu::TextureHandle* textures, u32 count) override {
+		ASSERT(m_bindless);
+		ASSERT(count <= Material::MAX_TEXTURE_COUNT);
+		if (m_material_table.first_free < 0) {
+			logError("Renderer") << "Too many bindless materials";
+			return Material::INVALID_MATERIAL_TABLE_IDX;
+		}
+		const u32 idx = m_material_table.first_free;
+		m_material_table.first_free = m_material_table.entries[idx].next_free;
+		FrameData::MaterialTableUpdate& update = m_cpu_frame->material_table_updates.emplace();
+		update.idx = idx;
+		update.count = count;
+		memcpy(update.textures, textures, sizeof(textures[0]) * count);
+		return idx;
+	}
+
+	void destroyMaterialTableEntry(u32 idx) override {
+		if (idx == Material::INVALID_MATERIAL_TABLE_IDX) return;
+		m_material_table.entries[idx].next_free = m_material_table.first_free;
+		m_material_table.first_free = idx;
+		FrameData::MaterialTableUpdate& update = m_cpu_frame->material_table_updates.emplace();
+		update.idx = idx;
+		update.count = DESTROYED_MATERIAL_TABLE_ENTRY;
+	}
+
+	// textures can be replaced under the same handle, e.g. when streamed, so resident handles are checked every frame
+	void updateMaterialTable(FrameData& frame) {
+		PROFILE_FUNCTION();
+		MaterialTable& mt = m_material_table;
+		for (const FrameData::MaterialTableUpdate& update : frame.material_table_updates) {
+			MaterialTable::Entry& entry = mt.entries[update.idx];
+			entry.count = update.count == DESTROYED_MATERIAL_TABLE_ENTRY ? 0 : update.count;
+			memcpy(entry.textures, update.textures, sizeof(update.textures[0]) * entry.count);
+		}
+		frame.material_table_updates.clear();
+
+		bool dirty = false;
+		for (u32 i = 0, c = mt.entries.size(); i < c; ++i) {
+			const MaterialTable::Entry& entry = mt.entries[i];
+			u64* handles = &mt.gpu_data[i * Material::MAX_TEXTURE_COUNT];
+			for (u32 j = 0; j < entry.count; ++j) {
+				const u64 handle = gpu::getBindlessHandle(entry.textures[j]);
+				if (handles[j] == handle) continue;
+				handles[j] = handle;
+				dirty = true;
+			}
+		}
+		if (dirty) gpu::update(mt.buffer, mt.gpu_data.begin(), mt.gpu_data.byte_size());
+		// binding used by getMaterialTexture in shaders
+		gpu::bindShaderBuffer(mt.buffer, 8);
+	}
+
 	void destroyMaterialConstants(u32 idx) override {
+		if (m_headless) return;
 		--m_material_buffer.data[idx].ref_count;
 		if (m_material_buffer.data[idx].ref_count > 0) return;
 			
@@ -817,18 +1599,83 @@ struct RendererImpl final : Renderer
 		m_material_buffer.data[idx].next_free = m_material_buffer.first_free;
 		m_material_buffer.first_free = idx;
 		m_material_buffer.map.erase(hash);
+		--m_material_buffer.used;
+	}
+
+	// main thread, the gpu buffer grows on the render thread once it gets an update past its end
+	void growMaterialBuffer() {
+		MaterialBuffer& mb = m_material_buffer;
+		const u32 old_size = mb.data.size();
+		mb.data.resize(old_size * 2);
+		for (u32 i = old_size, c = mb.data.size(); i < c; ++i) {
+			mb.data[i].ref_count = 0;
+			mb.data[i].next_free = i + 1;
+		}
+		mb.data.back().next_free = -1;
+		mb.first_free = old_size;
+		logInfo("Renderer") << "Material constants buffer grown to " << mb.data.size() << " slots";
+	}
+
+	// render thread
+	void updateMaterialBuffer(FrameData& frame) {
+		MaterialBuffer& mb = m_material_buffer;
+		if (frame.material_updates.empty()) return;
+
+		u32 size = mb.gpu_data.size();
+		for (const auto& i : frame.material_updates) {
+			while (i.idx >= size) size *= 2;
+		}
+		if (size != (u32)mb.gpu_data.size()) {
+			PROFILE_BLOCK("grow material buffer");
+			const u32 old_size = mb.gpu_data.size();
+			mb.gpu_data.resize(size);
+			memset(&mb.gpu_data[old_size], 0, (size - old_size) * sizeof(MaterialConsts));
+			for (const auto& i : frame.material_updates) {
+				mb.gpu_data[i.idx] = i.value;
+			}
+			gpu::destroy(mb.buffer);
+			mb.buffer = gpu::allocBufferGroupHandle();
+			gpu::createBufferGroup(mb.buffer, (u32)gpu::BufferFlags::UNIFORM_BUFFER, sizeof(MaterialConsts), size, mb.gpu_data.begin());
+		}
+		else {
+			for (const auto& i : frame.material_updates) {
+				mb.gpu_data[i.idx] = i.value;
+				gpu::update(mb.buffer, &i.value, i.idx);
+			}
+		}
+		frame.material_updates.clear();
 	}
 
 
 	gpu::BufferHandle createBuffer(const MemRef& memory, u32 flags) override
 	{
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_BUFFER;
+		}
+
 		gpu::BufferHandle handle = gpu::allocBufferHandle();
 		if(!handle.isValid()) return handle;
 
+		// data are copied to staging memory on a worker, so the render thread does not memcpy
+		// and the driver does not need its own copy, buffers over the budget are created directly from `memory`
 		struct Cmd : RenderJob {
-			void setup() override {}
+			void setup() override {
+				PROFILE_FUNCTION();
+				if (!memory.data) return;
+				staging = stage(*frame, memory);
+				if (staging.ptr && memory.own) {
+					renderer->free(memory);
+					memory.data = nullptr;
+				}
+			}
 			void execute() override {
 				PROFILE_FUNCTION();
+				if (staging.ptr) {
+					gpu::createBuffer(handle, flags, memory.size, nullptr);
+					gpu::copy(handle, 0, staging.buffer, staging.offset, memory.size);
+					return;
+				}
 				gpu::createBuffer(handle, flags, memory.size, memory.data);
 				if (memory.own) {
 					renderer->free(memory);
@@ -838,13 +1685,15 @@ struct RendererImpl final : Renderer
 			gpu::BufferHandle handle;
 			MemRef memory;
 			u32 flags;
-			gpu::TextureFormat format;
+			TransientSlice staging = {};
+			FrameData* frame;
 			Renderer* renderer;
 		};
 
 		Cmd* cmd = LUMIX_NEW(m_allocator, Cmd);
 		cmd->handle = handle;
 		cmd->memory = memory;
+		cmd->frame = m_cpu_frame;
 		cmd->renderer = this;
 		cmd->flags = flags;
 		queue(cmd, 0);
@@ -878,6 +1727,12 @@ struct RendererImpl final : Renderer
 
 	void runInRenderThread(void* user_ptr, void (*fnc)(Renderer& renderer, void*)) override
 	{
+		// there is no render thread work to wait for
+		if (m_headless) {
+			fnc(*this, user_ptr);
+			return;
+		}
+
 		struct Cmd : RenderJob {
 			void setup() override {}
 			void execute() override { 
@@ -905,6 +1760,7 @@ struct RendererImpl final : Renderer
 			void setup() override {}
 			void execute() override { 
 				PROFILE_FUNCTION();
+				renderer->programDestroyed(program);
 				gpu::destroy(program); 
 			}
 
@@ -940,26 +1796,50 @@ struct RendererImpl final : Renderer
 
 	gpu::TextureHandle createTexture(u32 w, u32 h, u32 depth, gpu::TextureFormat format, u32 flags, const MemRef& memory, const char* debug_name) override
 	{
+		if (m_headless) {
+			if (memory.own) free(memory);
+			return gpu::INVALID_TEXTURE;
+		}
+
 		gpu::TextureHandle handle = gpu::allocTextureHandle();
 		if(!handle.isValid()) return handle;
 
 		struct Cmd : RenderJob {
-			void setup() override {}
+			// mips would have to be generated after the upload
+			bool isStaged() const { return memory.data && depth <= 1 && (flags & (u32)gpu::TextureFlags::NO_MIPS); }
+
+			void setup() override {
+				if (!isStaged()) return;
+				PROFILE_FUNCTION();
+				staging = stage(*frame, memory);
+			}
+
 			void execute() override
 			{
 				PROFILE_FUNCTION();
-				gpu::createTexture(handle, w, h, depth, format, flags, memory.data, debug_name);
-				if (memory.own) renderer->free(memory);
+				if (!isStaged()) {
+					gpu::createTexture(handle, w, h, depth, format, flags, memory.data, debug_name);
+					if (memory.own) renderer->free(memory);
+					return;
+				}
+				if (gpu::createTexture(handle, w, h, depth, format, flags, nullptr, debug_name)) {
+					renderer->upload({handle, 0, 0, w, h, format, memory}, staging);
+				}
+				else if (memory.own) {
+					renderer->free(memory);
+				}
 			}
 
 			StaticString<MAX_PATH_LENGTH> debug_name;
 			gpu::TextureHandle handle;
 			MemRef memory;
+			TransientSlice staging;
 			u32 w;
 			u32 h;
 			u32 depth;
 			gpu::TextureFormat format;
-			Renderer* renderer;
+			FrameData* frame;
+			RendererImpl* renderer;
 			u32 flags;
 		};
 
@@ -972,6 +1852,7 @@ struct RendererImpl final : Renderer
 		cmd->w = w;
 		cmd->h = h;
 		cmd->depth = depth;
+		cmd->frame = m_cpu_frame;
 		cmd->renderer = this;
 		queue(cmd, 0);
 
@@ -986,6 +1867,7 @@ struct RendererImpl final : Renderer
 			void setup() override {}
 			void execute() override { 
 				PROFILE_FUNCTION();
+				renderer->dropPendingUploads(texture);
 				gpu::destroy(texture); 
 			}
 
@@ -1002,15 +1884,20 @@ struct RendererImpl final : Renderer
 
 	void queue(RenderJob* cmd, i64 profiler_link) override
 	{
+		if (m_headless) {
+			LUMIX_DELETE(m_allocator, cmd);
+			return;
+		}
+
 		cmd->profiler_link = profiler_link;
 		
 		m_cpu_frame->jobs.push(cmd);
 
-		JobSystem::run(cmd, [](void* data){
+		JobSystem::runEx(cmd, [](void* data){
 			RenderJob* cmd = (RenderJob*)data;
 			PROFILE_BLOCK("setup_render_job");
 			cmd->setup();
-		}, &m_cpu_frame->setup_done);
+		}, &m_cpu_frame->setup_done, JobSystem::INVALID_HANDLE, JobSystem::ANY_WORKER, JobSystem::Priority::HIGH);
 	}
 
 
@@ -1032,6 +1919,7 @@ struct RendererImpl final : Renderer
 
 	gpu::ProgramHandle queueShaderCompile(Shader& shader, gpu::VertexDecl decl, u32 defines) override {
 		ASSERT(shader.isReady());
+		if (m_headless) return gpu::INVALID_PROGRAM;
 		MutexGuard lock(m_cpu_frame->shader_mutex);
 		
 		for (const auto& i : m_cpu_frame->to_compile_shaders) {
@@ -1096,6 +1984,15 @@ struct RendererImpl final : Renderer
 		queue(cmd, 0);
 	}
 
+	// render thread
+	void dropPendingUploads(gpu::TextureHandle texture) {
+		m_pending_uploads.eraseItems([&](const TextureUpload& upload){
+			if (upload.handle.value != texture.value) return false;
+			if (upload.mem.own) free(upload.mem);
+			return true;
+		});
+	}
+
 	void render() {
 		FrameData& frame = *m_gpu_frame;
 		frame.transient_buffer.prepareToRender();
@@ -1105,18 +2002,24 @@ struct RendererImpl final : Renderer
 			Profiler::gpuMemStats(mem_stats.total_available_mem, mem_stats.current_available_mem, mem_stats.dedicated_vidmem);
 		}
 
+		// compiled by the driver in background if it supports it
 		for (const auto& i : frame.to_compile_shaders) {
-			Shader::compile(i.program, i.decl, i.defines, i.sources, *this);
+			const u64 cache_key = Shader::compile(i.program, i.decl, i.defines, i.sources, *this);
+			if (cache_key != 0) m_pending_binaries.push({i.program, cache_key});
+			m_shader_manager.programCompiled(*i.shader, i.decl, i.defines);
 		}
+		saveReadyBinaries();
 		frame.to_compile_shaders.clear();
+		checkReadbacks(false);
 
-		for (const auto& i : frame.material_updates) {
-			gpu::update(m_material_buffer.buffer, &i.value, i.idx);
-		}
-		frame.material_updates.clear();
+		updateMaterialBuffer(frame);
+		if (m_bindless) updateMaterialTable(frame);
+
+		flushPendingUploads(frame);
 
 		gpu::useProgram(gpu::INVALID_PROGRAM);
 		gpu::bindIndexBuffer(gpu::INVALID_BUFFER);
+		m_profiler.frameTimeQuery(false);
 		for (RenderJob* job : frame.jobs) {
 			PROFILE_BLOCK("execute_render_job");
 			Profiler::blockColor(0xaa, 0xff, 0xaa);
@@ -1125,6 +2028,7 @@ struct RendererImpl final : Renderer
 			LUMIX_DELETE(m_allocator, job);
 		}
 		frame.jobs.clear();
+		m_profiler.frameTimeQuery(true);
 
 		PROFILE_BLOCK("swap buffers");
 		JobSystem::enableBackupWorker(true);
@@ -1135,13 +2039,44 @@ struct RendererImpl final : Renderer
 		m_profiler.frame();
 
 		frame.transient_buffer.renderDone();
-		
-		JobSystem::decSignal(frame.can_setup);
+		frame.upload_buffer.renderDone();
+
+		// cpu can fill a frame while gpu still renders the previous one
+		releasePendingFrame();
+		m_pending_frame = &frame;
 
 		++m_gpu_frame;
 		if (m_gpu_frame == m_frames.end()) m_gpu_frame = m_frames.begin();
 	}
 
+	// transient memory of the pending frame can be overwritten once gpu is done with it
+	void releasePendingFrame() {
+		if (!m_pending_frame) return;
+		m_pending_frame->transient_buffer.waitFence();
+		m_pending_frame->upload_buffer.waitFence();
+		JobSystem::decSignal(m_pending_frame->can_setup);
+		m_pending_frame = nullptr;
+	}
+
+	void setPipelinedSetup(bool enable) override { m_pipelined_setup = enable; }
+	bool isPipelinedSetup() const override { return m_pipelined_setup; }
+
+	// render thread
+	void saveReadyBinaries() {
+		for (i32 i = m_pending_binaries.size() - 1; i >= 0; --i) {
+			const PendingBinary& b = m_pending_binaries[i];
+			if (!gpu::isProgramReady(b.program)) continue;
+			Shader::saveBinary(b.program, b.cache_key, *this);
+			m_pending_binaries.swapAndPop(i);
+		}
+	}
+
+	void programDestroyed(gpu::ProgramHandle program) {
+		for (i32 i = m_pending_binaries.size() - 1; i >= 0; --i) {
+			if (m_pending_binaries[i].program.value == program.value) m_pending_binaries.swapAndPop(i);
+		}
+	}
+
 	void waitForCommandSetup() override
 	{
 		JobSystem::wait(m_cpu_frame->setup_done);
@@ -1149,6 +2084,12 @@ struct RendererImpl final : Renderer
 	}
 
 	void waitForRender() override {
+		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+		JobSystem::runEx(this, [](void* data) {
+			((RendererImpl*)data)->releasePendingFrame();
+		}, &signal, JobSystem::INVALID_HANDLE, 1);
+		JobSystem::wait(signal);
+
 		for(FrameData& f : m_frames) {
 			JobSystem::wait(f.can_setup);
 		}
@@ -1158,8 +2099,23 @@ struct RendererImpl final : Renderer
 	{
 		PROFILE_FUNCTION();
 		
+		if (m_headless) {
+			m_model_manager.updateStreaming();
+			m_texture_manager.updateStreaming();
+			m_font_manager->update();
+			dispatchReadbacks();
+			return;
+		}
+
 		JobSystem::wait(m_cpu_frame->setup_done);
 		m_cpu_frame->setup_done = JobSystem::INVALID_HANDLE;
+		// no pipeline is setting up now, so streaming can change what they use
+		m_model_manager.updateStreaming();
+		m_texture_manager.updateStreaming();
+		m_font_manager->update();
+		m_shader_manager.prewarm();
+		dispatchReadbacks();
+		Profiler::pushCounter(m_material_buffer.used_counter, (float)m_material_buffer.used);
 		for (const auto& i : m_cpu_frame->to_compile_shaders) {
 			const u64 key = i.defines | ((u64)i.decl.hash << 32);
 			i.shader->m_programs.insert(key, i.program);
@@ -1178,28 +2134,69 @@ struct RendererImpl final : Renderer
 	}
 
 	Engine& m_engine;
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
 	Array<StaticString<32>> m_shader_defines;
 	Mutex m_shader_defines_mutex;
 	Array<StaticString<32>> m_layers;
 	FontManager* m_font_manager;
 	MaterialManager m_material_manager;
-	RenderResourceManager<Model> m_model_manager;
+	ModelManager m_model_manager;
 	RenderResourceManager<ParticleEmitterResource> m_particle_emitter_manager;
 	RenderResourceManager<PipelineResource> m_pipeline_manager;
-	RenderResourceManager<Shader> m_shader_manager;
-	RenderResourceManager<Texture> m_texture_manager;
+	ShaderManager m_shader_manager;
+	TextureManager m_texture_manager;
 
 	Array<FrameData> m_frames;
+	struct PendingBinary {
+		gpu::ProgramHandle program;
+		u64 cache_key;
+	};
+	// render thread only
+	Array<PendingBinary> m_pending_binaries;
+	Array<TextureUpload> m_pending_uploads;
+	u32 m_texture_upload_budget = 8 * 1024 * 1024;
+	bool m_pipelined_setup = false;
+	bool m_bindless = false;
+	bool m_headless = false;
+
+	struct Readback {
+		u32 id;
+		gpu::TextureHandle staging;
+		gpu::BufferHandle buffer;
+		gpu::FenceHandle fence;
+		u32 size;
+		TextureImageCallback callback;
+		void* user_ptr;
+	};
+
+	struct FinishedReadback {
+		FinishedReadback(IAllocator& allocator) : data(allocator) {}
+		Array<u8> data;
+		u32 id;
+		TextureImageCallback callback;
+		void* user_ptr;
+	};
+
+	// render thread
+	Array<Readback> m_pending_readbacks;
+	Mutex m_readbacks_mutex;
+	Array<FinishedReadback> m_finished_readbacks;
+	// main thread, requests not canceled and not finished yet
+	Array<u32> m_live_readbacks;
+	u32 m_last_readback_id = 0;
 	FrameData* m_gpu_frame = nullptr;
+	FrameData* m_pending_frame = nullptr;
 	FrameData* m_cpu_frame = nullptr;
 
 	GPUProfiler m_profiler;
 
 	struct MaterialBuffer {
+		static constexpr u32 INITIAL_CAPACITY = 400;
+
 		MaterialBuffer(IAllocator& alloc) 
 			: map(alloc)
 			, data(alloc)
+			, gpu_data(alloc)
 		{}
 
 		struct Data {
@@ -1210,11 +2207,42 @@ struct RendererImpl final : Renderer
 			};
 		};
 
+		// render thread
 		gpu::BufferGroupHandle buffer = gpu::INVALID_BUFFER_GROUP;
+		Array<MaterialConsts> gpu_data;
+		// main thread
 		Array<Data> data;
 		int first_free;
+		u32 used = 0;
 		HashMap<u32, u32> map;
+		u32 used_counter = Profiler::createCounter("Material constants slots used");
 	} m_material_buffer;
+
+	static constexpr u32 DESTROYED_MATERIAL_TABLE_ENTRY = 0xffFFffFF;
+
+	// entry i is Material::MAX_TEXTURE_COUNT bindless texture handles at gpu_data[i * MAX_TEXTURE_COUNT]
+	struct MaterialTable {
+		static constexpr u32 MAX_ENTRIES = 400;
+
+		MaterialTable(IAllocator& alloc) 
+			: entries(alloc)
+			, gpu_data(alloc)
+		{}
+
+		struct Entry {
+			gpu::TextureHandle textures[Material::MAX_TEXTURE_COUNT];
+			u32 count;
+			// main thread
+			i32 next_free;
+		};
+
+		gpu::BufferHandle buffer = gpu::INVALID_BUFFER;
+		// render thread
+		Array<Entry> entries;
+		Array<u64> gpu_data;
+		// main thread
+		i32 first_free = -1;
+	} m_material_table;
 };
 
 
@@ -52,6 +52,12 @@ struct LUMIX_RENDERER_API Renderer : IPlugin
 	virtual void frame() = 0;
 	virtual void waitForRender() = 0;
 	virtual void waitForCommandSetup() = 0;
+	// pipelines do not wait for their setup jobs, frame() waits for all of them at once;
+	// universe must not change between Pipeline::render and frame()
+	virtual void setPipelinedSetup(bool enable) = 0;
+	virtual bool isPipelinedSetup() const = 0;
+	// engine is headless, GPU resources are not created and render jobs are dropped
+	virtual bool isHeadless() const = 0;
 	virtual void makeScreenshot(const Path& filename) = 0;
 	virtual u8 getShaderDefineIdx(const char* define) = 0;
 	virtual const char* getShaderDefine(int define_idx) const = 0;
@@ -63,6 +69,11 @@ struct LUMIX_RENDERER_API Renderer : IPlugin
 	virtual u32 createMaterialConstants(const MaterialConsts& data) = 0;
 	virtual void destroyMaterialConstants(u32 id) = 0;
 	virtual gpu::BufferGroupHandle getMaterialUniformBuffer() = 0;
+	// bindless materials sample textures through a table instead of binding them, see Material::RenderData::material_table_idx
+	virtual bool isBindless() const = 0;
+	virtual u32 createMaterialTableEntry(const gpu::TextureHandle* textures, u32 count) = 0;
+	virtual void destroyMaterialTableEntry(u32 idx) = 0;
+	virtual gpu::BufferHandle getMaterialTableBuffer() = 0;
 
 	virtual IAllocator& getAllocator() = 0;
 	virtual MemRef allocate(u32 size) = 0;
@@ -75,15 +86,28 @@ struct LUMIX_RENDERER_API Renderer : IPlugin
 	virtual void destroy(gpu::ProgramHandle program) = 0;
 	
 	virtual gpu::TextureHandle createTexture(u32 w, u32 h, u32 depth, gpu::TextureFormat format, u32 flags, const MemRef& memory, const char* debug_name) = 0;
-	virtual gpu::TextureHandle loadTexture(const MemRef& memory, u32 flags, gpu::TextureInfo* info, const char* debug_name) = 0;
+	virtual gpu::TextureHandle loadTexture(const MemRef& memory, u32 flags, u32 skip_mips, gpu::TextureInfo* info, const char* debug_name) = 0;
+	// replaces content of an existing texture, used to stream mips
+	virtual void reloadTexture(gpu::TextureHandle handle, const MemRef& memory, u32 flags, u32 skip_mips, const char* debug_name) = 0;
+	// GPU memory for streamed textures, 0 disables streaming of newly loaded textures
+	virtual void setTextureStreamingBudget(u64 bytes) = 0;
+	virtual u64 getTextureStreamingBudget() const = 0;
 	virtual void updateTexture(gpu::TextureHandle handle, u32 x, u32 y, u32 w, u32 h, gpu::TextureFormat format, const MemRef& memory) = 0;
+	// stalls render thread until gpu finishes all previous work
 	virtual void getTextureImage(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, Span<u8> data) = 0;
+	// callback is called from frame() on the main thread a few frames later, data are valid only during the call
+	// returns id for cancelTextureImageAsync, which must be called if user_ptr dies before the callback
+	using TextureImageCallback = void (*)(Span<const u8> data, void* user_ptr);
+	virtual u32 getTextureImageAsync(gpu::TextureHandle texture, u32 w, u32 h, gpu::TextureFormat out_format, TextureImageCallback callback, void* user_ptr) = 0;
+	virtual void cancelTextureImageAsync(u32 id) = 0;
 	virtual void destroy(gpu::TextureHandle tex) = 0;
 	
 	virtual void queue(RenderJob* cmd, i64 profiler_link) = 0;
 
 	virtual void beginProfileBlock(const char* name, i64 link) = 0;
 	virtual void endProfileBlock() = 0;
+	// seconds the gpu spent on the last measured frame, a few frames old, 0 until measured
+	virtual float getGPUFrameTime() = 0;
 	virtual void runInRenderThread(void* user_ptr, void (*fnc)(Renderer& renderer, void*)) = 0;
 
 	virtual u8 getLayerIdx(const char* name) = 0;
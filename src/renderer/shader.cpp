@@ -2,12 +2,15 @@
 #include "engine/crc32.h"
 #include "engine/file_system.h"
 #include "engine/engine.h"
+#include "engine/hash.h"
 #include "engine/lua_wrapper.h"
 #include "engine/log.h"
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "renderer/material.h"
 #include "renderer/renderer.h"
 #include "renderer/texture.h"
 #include <lua.hpp>
@@ -19,6 +22,8 @@ namespace Lumix
 
 
 const ResourceType Shader::TYPE("shader");
+// bump to invalidate all binaries in .lumix/shader_cache
+static constexpr u32 PROGRAM_CACHE_VERSION = 0;
 
 
 u32 Shader::Uniform::size() const {
@@ -61,7 +66,28 @@ bool Shader::hasDefine(u8 define) const {
 	return m_defines.indexOf(define) >= 0;
 }
 
-void Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer) {
+static void getCachePath(u64 key, Span<char> out) {
+	copyString(out, ".lumix/shader_cache/");
+	char tmp[32];
+	toCString(key, Span(tmp));
+	catString(out, tmp);
+	catString(out, ".bin");
+}
+
+void Shader::saveBinary(gpu::ProgramHandle program, u64 cache_key, Renderer& renderer) {
+	OutputMemoryStream blob(renderer.getAllocator());
+	if (!gpu::getProgramBinary(program, blob)) return;
+
+	char cache_path[MAX_PATH_LENGTH];
+	getCachePath(cache_key, Span(cache_path));
+	FileSystem& fs = renderer.getEngine().getFileSystem();
+	OS::OutputFile file;
+	if (!fs.open(cache_path, Ref(file))) return;
+	if (!file.write(blob.getData(), blob.getPos())) logWarning("Renderer") << "Could not write " << cache_path;
+	file.close();
+}
+
+u64 Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer) {
 	PROFILE_BLOCK("compile_shader");
 	static const char* shader_code_prefix = 
 		R"#(
@@ -104,21 +130,49 @@ void Shader::compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defin
 		codes[i] = &sources.stages[i].code[0];
 		types[i] = sources.stages[i].type;
 	}
-	const char* prefixes[35];
+	const char* prefixes[36];
 	StaticString<128> defines_code[32];
 	int defines_count = 0;
-	prefixes[0] = shader_code_prefix;
+	// extensions must precede any declaration
+	prefixes[0] = renderer.isBindless() ? "#extension GL_ARB_bindless_texture : require\n#extension GL_ARB_shader_storage_buffer_object : require\n" : "";
+	prefixes[1] = shader_code_prefix;
 	if (defines != 0) {
 		for(int i = 0; i < sizeof(defines) * 8; ++i) {
 			if((defines & (1 << i)) == 0) continue;
 			defines_code[defines_count] << "#define " << renderer.getShaderDefine(i) << "\n";
-			prefixes[1 + defines_count] = defines_code[defines_count];
+			prefixes[2 + defines_count] = defines_code[defines_count];
 			++defines_count;
 		}
 	}
-	prefixes[1 + defines_count] = sources.common.length() == 0 ? "" : sources.common.c_str();
+	prefixes[2 + defines_count] = sources.common.length() == 0 ? "" : sources.common.c_str();
+
+	// key covers everything the driver sees, including the driver itself
+	OutputMemoryStream key_data(renderer.getAllocator());
+	key_data.write(PROGRAM_CACHE_VERSION);
+	key_data.writeString(gpu::getDriverVersion());
+	key_data.write(decl.attributes_count);
+	key_data.write(decl.attributes, sizeof(decl.attributes[0]) * decl.attributes_count);
+	for (int i = 0; i < 3 + defines_count; ++i) key_data.writeString(prefixes[i]);
+	for (int i = 0; i < sources.stages.size(); ++i) {
+		key_data.write(types[i]);
+		key_data.writeString(codes[i]);
+	}
+	const u64 key = hash64(key_data.getData(), (u32)key_data.getPos());
+	char cache_path[MAX_PATH_LENGTH];
+	getCachePath(key, Span(cache_path));
+
+	FileSystem& fs = renderer.getEngine().getFileSystem();
+	OS::InputFile in_file;
+	if (fs.open(cache_path, Ref(in_file))) {
+		Array<u8> blob(renderer.getAllocator());
+		blob.resize((int)in_file.size());
+		const bool read = blob.empty() || in_file.read(blob.begin(), blob.byte_size());
+		in_file.close();
+		if (read && gpu::createProgramFromBinary(program, decl, blob.begin(), blob.byte_size(), sources.path.c_str())) return 0;
+	}
 
-	gpu::createProgram(program, decl, codes, types, sources.stages.size(), prefixes, 2 + defines_count, sources.path.c_str());
+	if (!gpu::createProgram(program, decl, codes, types, sources.stages.size(), prefixes, 3 + defines_count, sources.path.c_str())) return 0;
+	return key;
 }
 
 gpu::ProgramHandle Shader::getProgram(const gpu::VertexDecl& decl, u32 defines) {
@@ -336,6 +390,13 @@ int geometry_shader(lua_State* L)
 }
 
 
+int compute_shader(lua_State* L)
+{
+	source(L, gpu::ShaderType::COMPUTE);
+	return 0;
+}
+
+
 int include(lua_State* L)
 {
 	const char* path = LuaWrapper::checkArg<const char*>(L, 1);
@@ -365,12 +426,12 @@ int include(lua_State* L)
 } // namespace LuaAPI
 
 
-bool Shader::load(u64 size, const u8* mem)
+static bool runScript(Shader& shader, u64 size, const u8* mem)
 {
 	lua_State* L = luaL_newstate();
 	luaL_openlibs(L);
 
-	lua_pushlightuserdata(L, this);
+	lua_pushlightuserdata(L, &shader);
 	lua_setfield(L, LUA_GLOBALSINDEX, "this");
 	lua_pushcfunction(L, LuaAPI::common);
 	lua_setfield(L, LUA_GLOBALSINDEX, "common");
@@ -380,6 +441,8 @@ bool Shader::load(u64 size, const u8* mem)
 	lua_setfield(L, LUA_GLOBALSINDEX, "fragment_shader");
 	lua_pushcfunction(L, LuaAPI::geometry_shader);
 	lua_setfield(L, LUA_GLOBALSINDEX, "geometry_shader");
+	lua_pushcfunction(L, LuaAPI::compute_shader);
+	lua_setfield(L, LUA_GLOBALSINDEX, "compute_shader");
 	lua_pushcfunction(L, LuaAPI::include);
 	lua_setfield(L, LUA_GLOBALSINDEX, "include");
 	lua_pushcfunction(L, LuaAPI::texture_slot);
@@ -392,13 +455,84 @@ bool Shader::load(u64 size, const u8* mem)
 	lua_setfield(L, LUA_GLOBALSINDEX, "ignore_property");
 
 	const Span<const char> content((const char*)mem, (int)size);
-	if (!LuaWrapper::execute(L, content, getPath().c_str(), 0)) {
-		lua_close(L);
+	const bool res = LuaWrapper::execute(L, content, shader.getPath().c_str(), 0);
+	lua_close(L);
+	return res;
+}
+
+
+bool Shader::load(u64 size, const u8* mem)
+{
+	if (!runScript(*this, size, mem)) return false;
+
+	m_size = size;
+	return true;
+}
+
+
+// materials depend on texture slots and uniforms, they must be reloaded if these change
+bool Shader::hasSameInterface(const Shader& rhs) const
+{
+	if (m_texture_slot_count != rhs.m_texture_slot_count) return false;
+	if (m_uniforms.size() != rhs.m_uniforms.size()) return false;
+	if (m_defines.size() != rhs.m_defines.size()) return false;
+	if (m_ignored_properties != rhs.m_ignored_properties) return false;
+
+	for (u32 i = 0; i < m_texture_slot_count; ++i) {
+		const TextureSlot& a = m_texture_slots[i];
+		const TextureSlot& b = rhs.m_texture_slots[i];
+		if (!equalStrings(a.name, b.name)) return false;
+		if (a.define_idx != b.define_idx || a.default_texture != b.default_texture) return false;
+	}
+	for (int i = 0, c = m_uniforms.size(); i < c; ++i) {
+		const Uniform& a = m_uniforms[i];
+		const Uniform& b = rhs.m_uniforms[i];
+		if (a.name_hash != b.name_hash || a.type != b.type || a.offset != b.offset) return false;
+	}
+	for (int i = 0, c = m_defines.size(); i < c; ++i) {
+		if (m_defines[i] != rhs.m_defines[i]) return false;
+	}
+	return true;
+}
+
+
+static bool equalSources(const Shader::Sources& a, const Shader::Sources& b)
+{
+	if (!(a.common == b.common)) return false;
+	if (a.stages.size() != b.stages.size()) return false;
+	for (int i = 0, c = a.stages.size(); i < c; ++i) {
+		const Shader::Stage& sa = a.stages[i];
+		const Shader::Stage& sb = b.stages[i];
+		if (sa.type != sb.type || sa.code.size() != sb.code.size()) return false;
+		if (sa.code.size() > 0 && memcmp(sa.code.begin(), sb.code.begin(), sa.code.size()) != 0) return false;
+	}
+	return true;
+}
+
+
+bool Shader::hotReload(u64 size, const u8* mem)
+{
+	PROFILE_FUNCTION();
+	// parsed into a shader which is never registered in the manager, only to compare it with the loaded one
+	Shader tmp(getPath(), getResourceManager(), m_renderer, m_allocator);
+	if (!runScript(tmp, size, mem) || !hasSameInterface(tmp)) {
+		tmp.unload();
 		return false;
 	}
 
+	tmp.onBeforeReady();
+	if (!equalSources(m_sources, tmp.m_sources)) {
+		// only programs which are actually used again are recompiled, on demand in getProgram
+		for (gpu::ProgramHandle prg : m_programs) {
+			m_renderer.destroy(prg);
+		}
+		m_programs.clear();
+		m_sources.stages.swap(tmp.m_sources.stages);
+		m_sources.common = tmp.m_sources.common;
+	}
+
+	tmp.unload();
 	m_size = size;
-	lua_close(L);
 	return true;
 }
 
@@ -468,6 +602,7 @@ void Shader::onBeforeReady() {
 			float u_roughness;
 			float u_metallic;
 			float u_emission;
+			uint u_material_table_idx;
 		)#");
 
 	for (const Uniform& u : m_uniforms) {
@@ -480,6 +615,17 @@ void Shader::onBeforeReady() {
 	}
 
 	m_sources.common.cat("};\n");
+
+	// material textures are Material::MAX_TEXTURE_COUNT bindless handles per row of the table
+	static_assert(Material::MAX_TEXTURE_COUNT == 16, "update getMaterialTexture");
+	m_sources.common.cat(R"#(
+		#ifdef BINDLESS
+			layout (std430, binding = 8) readonly buffer MaterialTable {
+				uvec2 b_material_textures[];
+			};
+			#define getMaterialTexture(slot) sampler2D(b_material_textures[u_material_table_idx * 16 + (slot)])
+		#endif
+	)#");
 }
 
 
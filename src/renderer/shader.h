@@ -87,7 +87,9 @@ public:
 	bool isIgnored(Property value) const { return m_ignored_properties & (1 << (u32)value); }
 	
 	gpu::ProgramHandle getProgram(const gpu::VertexDecl& decl, u32 defines);
-	static void compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer);
+	// returns key of the binary to store with saveBinary once the program is ready, 0 if there's nothing to store
+	static u64 compile(gpu::ProgramHandle program, gpu::VertexDecl decl, u32 defines, const Sources& sources, Renderer& renderer);
+	static void saveBinary(gpu::ProgramHandle program, u64 cache_key, Renderer& renderer);
 
 	IAllocator& m_allocator;
 	Renderer& m_renderer;
@@ -105,6 +107,9 @@ public:
 private:
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
+	bool isHotReloadSupported() const override { return true; }
+	bool hotReload(u64 size, const u8* mem) override;
+	bool hasSameInterface(const Shader& rhs) const;
 	void onBeforeReady() override;
 };
 
@@ -1,4 +1,5 @@
 #include "terrain.h"
+#include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/crt.h"
 #include "engine/engine.h"
@@ -23,6 +24,8 @@ namespace Lumix
 
 static const float GRASS_QUAD_SIZE = 10.0f;
 static const float GRASS_QUAD_RADIUS = GRASS_QUAD_SIZE * 0.7072f;
+// generating all quads at once hitches when the camera moves fast
+static const u32 MAX_GRASS_JOBS_PER_UPDATE = 8;
 static const ComponentType TERRAIN_HASH = Reflection::getComponentType("terrain");
 
 struct Sample
@@ -45,10 +48,9 @@ Terrain::Terrain(Renderer& renderer, EntityPtr entity, RenderScene& scene, IAllo
 	, m_scene(scene)
 	, m_allocator(allocator)
 	, m_grass_quads(m_allocator)
-	, m_last_camera_position(m_allocator)
+	, m_last_grass_cell(m_allocator)
 	, m_grass_types(m_allocator)
 	, m_renderer(renderer)
-	, m_force_grass_update(false)
 {
 }
 
@@ -63,6 +65,7 @@ Terrain::GrassType::~GrassType()
 
 Terrain::~Terrain()
 {
+	JobSystem::wait(m_grass_jobs);
 	setMaterial(nullptr);
 	for (const Array<GrassQuad*>& quads : m_grass_quads) {
 		for (GrassQuad* quad : quads) {
@@ -197,7 +200,8 @@ void Terrain::setGrassTypePath(int index, const Path& path)
 
 void Terrain::forceGrassUpdate()
 {
-	m_force_grass_update = true;
+	JobSystem::wait(m_grass_jobs);
+	for (Vec2& cell : m_last_grass_cell) cell.set(FLT_MAX, FLT_MAX);
 	for (Array<GrassQuad*>& quads : m_grass_quads) {
 		for (GrassQuad* quad : quads) {
 			LUMIX_DELETE(m_allocator, quad);
@@ -213,7 +217,25 @@ Array<Terrain::GrassQuad*>& Terrain::getQuads(int view)
 }
 
 
-void Terrain::generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& terrain_tr, const Vec2& quad_pos)
+// quads are generated on workers, the global random generator is not thread safe
+struct GrassRandom
+{
+	explicit GrassRandom(u32 seed) : state(seed != 0 ? seed : 1) {}
+
+	// xorshift32
+	float get(float from, float to)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return from + (to - from) * (float)(state * (1.0 / 4294967296.0));
+	}
+
+	u32 state;
+};
+
+
+void Terrain::generateGrassTypeQuad(GrassPatch& patch, const Vec2& quad_pos)
 {
 	if (m_splatmap->data.empty()) return;
 
@@ -232,8 +254,7 @@ void Terrain::generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& ter
 	};
 
 	struct { float x, y; void* type; } hashed_patch = { quad_pos.x, quad_pos.y, patch.m_type };
-	const u32 hash = crc32(&hashed_patch, sizeof(hashed_patch));
-	seedRandom(hash);
+	GrassRandom rnd(crc32(&hashed_patch, sizeof(hashed_patch)));
 	const int max_idx = splat_map->width * splat_map->height;
 
 	const Vec2 step = quad_size * (1 / (float)patch.m_type->m_density);
@@ -254,8 +275,8 @@ void Terrain::generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& ter
 			const int ground_mask = (pixel_value >> 16) & 0xffff;
 			if ((ground_mask & (1 << patch.m_type->m_idx)) == 0) continue;
 
-			const float x = (quad_pos.x + dx + step.x * randFloat(-0.5f, 0.5f)) * m_scale.x;
-			const float z = (quad_pos.y + dy + step.y * randFloat(-0.5f, 0.5f)) * m_scale.z;
+			const float x = (quad_pos.x + dx + step.x * rnd.get(-0.5f, 0.5f)) * m_scale.x;
+			const float z = (quad_pos.y + dy + step.y * rnd.get(-0.5f, 0.5f)) * m_scale.z;
 			const Vec3 instance_rel_pos(x, getHeight(x, z), z);
 			Quat instance_rel_rot;
 			
@@ -263,20 +284,20 @@ void Terrain::generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& ter
 			{
 				case GrassType::RotationMode::Y_UP:
 				{
-					instance_rel_rot = Quat(Vec3(0, 1, 0), randFloat(0, PI * 2));
+					instance_rel_rot = Quat(Vec3(0, 1, 0), rnd.get(0, PI * 2));
 				}
 				break;
 				case GrassType::RotationMode::ALL_RANDOM:
 				{
-					const Vec3 random_axis(randFloat(-1, 1), randFloat(-1, 1), randFloat(-1, 1));
-					const float random_angle = randFloat(0, PI * 2);
+					const Vec3 random_axis(rnd.get(-1, 1), rnd.get(-1, 1), rnd.get(-1, 1));
+					const float random_angle = rnd.get(0, PI * 2);
 					instance_rel_rot = Quat(random_axis.normalized(), random_angle);
 				}
 				break;
 				case GrassType::RotationMode::ALIGN_WITH_NORMAL:
 				{
 					const Vec3 normal = getNormal(x, z);
-					const Quat random_base(Vec3(0, 1, 0), randFloat(0, PI * 2));
+					const Quat random_base(Vec3(0, 1, 0), rnd.get(0, PI * 2));
 					const Quat to_normal = Quat::vec3ToVec3({0, 1, 0}, normal);
 					instance_rel_rot = to_normal * random_base;
 				}
@@ -285,99 +306,139 @@ void Terrain::generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& ter
 			}
 
 			GrassPatch::InstanceData& instance_data = patch.instance_data.emplace();
-			instance_data.pos_scale.set(instance_rel_pos, randFloat(0.75f, 1.25f));
-			instance_data.rot = instance_rel_rot;
-			instance_data.normal = Vec4(getNormal(x, z), 0);
+			instance_data.pos_scale.set(instance_rel_pos, rnd.get(0.75f, 1.25f));
+			instance_data.rot = PackedQuat(instance_rel_rot);
 		}
 	}
 }
 
 
-void Terrain::updateGrass(int view, const DVec3& camera_pos)
+void Terrain::generateGrassQuad(GrassQuad& quad)
 {
 	PROFILE_FUNCTION();
-	if (!m_splatmap) return;
+	quad.m_patches.reserve(m_grass_types.size());
+
+	float min_y = FLT_MAX;
+	float max_y = -FLT_MAX;
+	for (GrassType& grass_type : m_grass_types) {
+		Model* model = grass_type.m_grass_model;
+		if (!model || !model->isReady()) continue;
+		GrassPatch& patch = quad.m_patches.emplace(m_allocator);
+		patch.m_type = &grass_type;
+
+		generateGrassTypeQuad(patch, {quad.pos.x / m_scale.x, quad.pos.z / m_scale.z});
+		for (const GrassPatch::InstanceData& instance_data : patch.instance_data) {
+			min_y = minimum(instance_data.pos_scale.y, min_y);
+			max_y = maximum(instance_data.pos_scale.y, max_y);
+		}
+	}
 
-	Universe& universe = m_scene.getUniverse();
+	if (min_y > max_y) min_y = max_y = 0;
+	quad.pos.y = (max_y + min_y) * 0.5f;
+	quad.radius = maximum((max_y - min_y) * 0.5f, GRASS_QUAD_SIZE) * SQRT2;
+	memoryBarrier();
+	quad.m_state = (i32)GrassQuad::State::READY;
+}
 
-	while (m_last_camera_position.size() <= view) m_last_camera_position.push({ DBL_MAX, DBL_MAX, DBL_MAX });
 
-	if ((m_last_camera_position[view] - camera_pos).length() <= FLT_MIN && !m_force_grass_update) return;
-	m_last_camera_position[view] = camera_pos;
+void Terrain::startGrassJobs(Array<GrassQuad*>& quads, const Vec3& local_camera_pos)
+{
+	// nearest pending quads first
+	GrassQuad* nearest[MAX_GRASS_JOBS_PER_UPDATE];
+	float nearest_dist[MAX_GRASS_JOBS_PER_UPDATE];
+	u32 count = 0;
+	for (GrassQuad* quad : quads) {
+		if (quad->m_state != (i32)GrassQuad::State::PENDING) continue;
+		const float dx = quad->pos.x + GRASS_QUAD_SIZE * 0.5f - local_camera_pos.x;
+		const float dz = quad->pos.z + GRASS_QUAD_SIZE * 0.5f - local_camera_pos.z;
+		const float dist = dx * dx + dz * dz;
+		if (count == MAX_GRASS_JOBS_PER_UPDATE && dist >= nearest_dist[count - 1]) continue;
 
-	m_force_grass_update = false;
+		u32 i = count < MAX_GRASS_JOBS_PER_UPDATE ? count++ : count - 1;
+		for (; i > 0 && nearest_dist[i - 1] > dist; --i) {
+			nearest[i] = nearest[i - 1];
+			nearest_dist[i] = nearest_dist[i - 1];
+		}
+		nearest[i] = quad;
+		nearest_dist[i] = dist;
+	}
+
+	for (u32 i = 0; i < count; ++i) {
+		nearest[i]->m_state = (i32)GrassQuad::State::GENERATING;
+		JobSystem::run(nearest[i], [](void* data){
+			GrassQuad* quad = (GrassQuad*)data;
+			quad->m_terrain.generateGrassQuad(*quad);
+		}, &m_grass_jobs);
+	}
+}
+
+
+void Terrain::updateGrass(int view, const DVec3& camera_pos)
+{
+	PROFILE_FUNCTION();
+	if (!m_splatmap) return;
+
+	Universe& universe = m_scene.getUniverse();
 	const RigidTransform terrain_tr = universe.getTransform(m_entity).getRigidPart();
 	const Vec3 local_camera_pos = terrain_tr.rot.conjugated() * (camera_pos - terrain_tr.pos).toFloat();
-	float cx = (int)(local_camera_pos.x / (GRASS_QUAD_SIZE)) * GRASS_QUAD_SIZE;
-	float cz = (int)(local_camera_pos.z / (GRASS_QUAD_SIZE)) * GRASS_QUAD_SIZE;
+	const Vec2 cell(
+		(int)(local_camera_pos.x / (GRASS_QUAD_SIZE)) * GRASS_QUAD_SIZE,
+		(int)(local_camera_pos.z / (GRASS_QUAD_SIZE)) * GRASS_QUAD_SIZE);
 	int grass_distance = 0;
 	for (auto& type : m_grass_types)
 	{
 		grass_distance = maximum(grass_distance, int(type.m_distance / GRASS_QUAD_RADIUS + 0.99f));
 	}
 
-	float from_quad_x = cx - grass_distance * GRASS_QUAD_SIZE;
-	float from_quad_z = cz - grass_distance * GRASS_QUAD_SIZE;
-	float to_quad_x = cx + grass_distance * GRASS_QUAD_SIZE;
-	float to_quad_z = cz + grass_distance * GRASS_QUAD_SIZE;
+	const float from_quad_x = cell.x - grass_distance * GRASS_QUAD_SIZE;
+	const float from_quad_z = cell.y - grass_distance * GRASS_QUAD_SIZE;
+	const float to_quad_x = cell.x + grass_distance * GRASS_QUAD_SIZE;
+	const float to_quad_z = cell.y + grass_distance * GRASS_QUAD_SIZE;
 
-	float old_bounds[4] = {FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
 	Array<GrassQuad*>& quads = getQuads(view);
 	for (int i = quads.size() - 1; i >= 0; --i)
 	{
 		GrassQuad* quad = quads[i];
-		old_bounds[0] = minimum(old_bounds[0], quad->pos.x);
-		old_bounds[1] = maximum(old_bounds[1], quad->pos.x);
-		old_bounds[2] = minimum(old_bounds[2], quad->pos.z);
-		old_bounds[3] = maximum(old_bounds[3], quad->pos.z);
 		if (quad->pos.x < from_quad_x || quad->pos.x > to_quad_x || quad->pos.z < from_quad_z ||
 			quad->pos.z > to_quad_z)
 		{
+			// job is still running, the quad is removed in a later update
+			if (quad->m_state == (i32)GrassQuad::State::GENERATING) continue;
 			LUMIX_DELETE(m_allocator, quads[i]);
 			quads.swapAndPop(i);
 		}
 	}
 
-	from_quad_x = maximum(0.0f, from_quad_x);
-	from_quad_z = maximum(0.0f, from_quad_z);
+	while (m_last_grass_cell.size() <= view) m_last_grass_cell.push({ FLT_MAX, FLT_MAX });
+	// camera rotation or movement inside the cell does not change anything
+	if (m_last_grass_cell[view].x != cell.x || m_last_grass_cell[view].y != cell.y) {
+		m_last_grass_cell[view] = cell;
+
+		const int side = 2 * grass_distance + 1;
+		Array<bool> exists(m_allocator);
+		exists.resize(side * side);
+		memset(exists.begin(), 0, exists.byte_size());
+		for (const GrassQuad* quad : quads) {
+			const int ix = int((quad->pos.x - from_quad_x) / GRASS_QUAD_SIZE + 0.5f);
+			const int iz = int((quad->pos.z - from_quad_z) / GRASS_QUAD_SIZE + 0.5f);
+			if (ix >= 0 && ix < side && iz >= 0 && iz < side) exists[ix + iz * side] = true;
+		}
 
-	for (float quad_z = from_quad_z; quad_z <= to_quad_z; quad_z += GRASS_QUAD_SIZE)
-	{
-		for (float quad_x = from_quad_x; quad_x <= to_quad_x; quad_x += GRASS_QUAD_SIZE)
-		{
-			if (quad_x >= old_bounds[0] && quad_x <= old_bounds[1] && quad_z >= old_bounds[2] &&
-				quad_z <= old_bounds[3])
-				continue;
-
-			PROFILE_BLOCK("generate quad");
-			GrassQuad* quad = LUMIX_NEW(m_allocator, GrassQuad)(m_allocator);
-			quads.push(quad);
-			quad->pos.x = quad_x;
-			quad->pos.z = quad_z;
-			quad->m_patches.reserve(m_grass_types.size());
-
-			float min_y = FLT_MAX;
-			float max_y = -FLT_MAX;
-			for (auto& grass_type : m_grass_types)
-			{
-				Model* model = grass_type.m_grass_model;
-				if (!model || !model->isReady()) continue;
-				GrassPatch& patch = quad->m_patches.emplace(m_allocator);
-				patch.m_type = &grass_type;
+		for (int iz = 0; iz < side; ++iz) {
+			const float quad_z = from_quad_z + iz * GRASS_QUAD_SIZE;
+			if (quad_z < 0) continue;
+			for (int ix = 0; ix < side; ++ix) {
+				const float quad_x = from_quad_x + ix * GRASS_QUAD_SIZE;
+				if (quad_x < 0 || exists[ix + iz * side]) continue;
 
-				generateGrassTypeQuad(patch, terrain_tr, {quad_x / m_scale.x, quad_z / m_scale.z});
-				for (auto instance_data : patch.instance_data)
-				{
-					min_y = minimum(instance_data.pos_scale.y, min_y);
-					max_y = maximum(instance_data.pos_scale.y, max_y);
-				}
+				GrassQuad* quad = LUMIX_NEW(m_allocator, GrassQuad)(*this, m_allocator);
+				quad->pos.set(quad_x, 0, quad_z);
+				quads.push(quad);
 			}
-
-			quad->pos.y = (max_y + min_y) * 0.5f;
-			quad->radius = maximum((max_y - min_y) * 0.5f, GRASS_QUAD_SIZE) * SQRT2;
-
 		}
 	}
+
+	startGrassJobs(quads, local_camera_pos);
 }
 
 
@@ -2,9 +2,11 @@
 
 
 #include "engine/array.h"
+#include "engine/job_system.h"
 #include "engine/math.h"
 #include "engine/resource.h"
 #include "gpu/gpu.h"
+#include "renderer/model.h"
 
 
 namespace Lumix
@@ -55,11 +57,11 @@ struct Terrain
 
 		struct GrassPatch
 		{
+			// uploaded as is, matches instanced attributes of grass meshes
 			struct InstanceData
 			{
-				Quat rot;
+				PackedQuat rot;
 				Vec4 pos_scale;
-				Vec4 normal;
 			};
 			explicit GrassPatch(IAllocator& allocator)
 				: instance_data(allocator)
@@ -71,13 +73,26 @@ struct Terrain
 
 		struct GrassQuad
 		{
-			explicit GrassQuad(IAllocator& allocator)
-				: m_patches(allocator)
+			// quads are generated by jobs, only ready quads can be read outside of the job
+			enum class State : i32
+			{
+				PENDING,
+				GENERATING,
+				READY
+			};
+
+			GrassQuad(Terrain& terrain, IAllocator& allocator)
+				: m_terrain(terrain)
+				, m_patches(allocator)
 			{}
 
+			bool isReady() const { return m_state == (i32)State::READY; }
+
+			Terrain& m_terrain;
 			Array<GrassPatch> m_patches;
 			Vec3 pos;
 			float radius;
+			volatile i32 m_state = (i32)State::PENDING;
 		};
 
 	public:
@@ -124,11 +139,14 @@ struct Terrain
 		void addGrassType(int index);
 		void removeGrassType(int index);
 		void forceGrassUpdate();
+		// main thread, prunes quads out of range and starts generation jobs for missing quads
 		void updateGrass(int view, const DVec3& position);
 
 	private: 
 		Array<Terrain::GrassQuad*>& getQuads(int view);
-		void generateGrassTypeQuad(GrassPatch& patch, const RigidTransform& terrain_tr, const Vec2& quad_pos_hm_space);
+		void startGrassJobs(Array<GrassQuad*>& quads, const Vec3& local_camera_pos);
+		void generateGrassQuad(GrassQuad& quad);
+		void generateGrassTypeQuad(GrassPatch& patch, const Vec2& quad_pos_hm_space);
 		void onMaterialLoaded(Resource::State, Resource::State new_state, Resource&);
 		void grassLoaded(Resource::State, Resource::State, Resource&);
 
@@ -146,8 +164,9 @@ struct Terrain
 		RenderScene& m_scene;
 		Array<GrassType> m_grass_types;
 		Array<Array<GrassQuad*> > m_grass_quads;
-		Array<DVec3> m_last_camera_position;
-		bool m_force_grass_update;
+		// camera cell of the last update, quads depend only on it
+		Array<Vec2> m_last_grass_cell;
+		JobSystem::SignalHandle m_grass_jobs = JobSystem::INVALID_HANDLE;
 		Renderer& m_renderer;
 };
 
@@ -1,3 +1,4 @@
+#include "engine/atomic.h"
 #include "engine/crt.h"
 #include "engine/file_system.h"
 #include "engine/log.h"
@@ -30,6 +31,11 @@ Texture::Texture(const Path& path, ResourceManager& resource_manager, Renderer&
 	, height(0)
 	, mips(0)
 	, renderer(renderer)
+	, stream_data(_allocator)
+	, streamed_mips(0)
+	, requested_size(0)
+	, unused_frames(0)
+	, data_version(0)
 {
 	flags = 0;
 	is_cubemap = false;
@@ -83,13 +89,58 @@ bool Texture::create(u32 w, u32 h, gpu::TextureFormat format, const void* data,
 	width = w;
 	height = h;
 
-	const bool isReady = handle.isValid();
+	const bool isReady = handle.isValid() || renderer.isHeadless();
 	onCreated(isReady ? State::READY : State::FAILURE);
 
 	return isReady;
 }
 
 
+void Texture::requestSize(u32 size)
+{
+	for (;;) {
+		const i32 prev = requested_size;
+		if (prev >= (i32)size) return;
+		if (compareAndExchange(&requested_size, (i32)size, prev)) return;
+	}
+}
+
+
+u32 Texture::getMaxStreamedMips() const
+{
+	u32 res = 0;
+	while (res + 1 < mips && (maximum(width, height) >> res) > STREAMING_MIN_SIZE) ++res;
+	return res;
+}
+
+
+u32 Texture::getStreamedMips(u32 size) const
+{
+	const u32 max_mips = getMaxStreamedMips();
+	u32 res = 0;
+	while (res < max_mips && (maximum(width, height) >> (res + 1)) >= size) ++res;
+	return res;
+}
+
+
+u64 Texture::getGPUSize(u32 mips_to_skip) const
+{
+	// each mip has a quarter of the previous one
+	return stream_data.getPos() >> (2 * mips_to_skip);
+}
+
+
+void Texture::stream(u32 mips_to_skip)
+{
+	ASSERT(isStreamed());
+	if (mips_to_skip == streamed_mips) return;
+
+	Renderer::MemRef mem = renderer.copy(stream_data.getData(), (u32)stream_data.getPos());
+	renderer.reloadTexture(handle, mem, getGPUFlags(), mips_to_skip, getPath().c_str());
+	streamed_mips = mips_to_skip;
+}
+
+
 u32 Texture::getPixelNearest(u32 x, u32 y) const
 {
 	if (data.empty() || x >= width || y >= height || x < 0 || y < 0 || format != gpu::TextureFormat::RGBA8) return 0;
@@ -316,6 +367,7 @@ void Texture::onDataUpdated(u32 x, u32 y, u32 w, u32 h)
 			bytes_per_pixel * w);
 	}
 	renderer.updateTexture(handle, x, y, w, h, format, mem);
+	++data_version;
 }
 
 
@@ -383,7 +435,7 @@ static bool loadRaw(Texture& texture, InputMemoryStream& file, IAllocator& alloc
 		, texture.getPath().c_str());
 	texture.mips = 1;
 	texture.is_cubemap = false;
-	return texture.handle.isValid();
+	return texture.handle.isValid() || texture.renderer.isHeadless();
 }
 
 
@@ -560,7 +612,7 @@ bool Texture::loadTGA(IInputStream& file)
 		, getPath().c_str());
 	depth = 1;
 	layers = 1;
-	return handle.isValid();
+	return handle.isValid() || renderer.isHeadless();
 }
 
 
@@ -591,18 +643,26 @@ static bool loadDDS(Texture& texture, IInputStream& file)
 		return false;
 	}
 
-	gpu::TextureInfo info;
 	const u8* data = (const u8*)file.getBuffer();
-	Renderer::MemRef mem = texture.renderer.copy(data + 7, (int)file.size() - 7);
-	texture.handle = texture.renderer.loadTexture(mem, texture.getGPUFlags(), &info, texture.getPath().c_str());
-	if (texture.handle.isValid()) {
-		texture.width = info.width;
-		texture.height = info.height;
-		texture.mips = info.mips;
-		texture.depth = info.depth;
-		texture.layers = info.layers;
-		texture.is_cubemap = info.is_cubemap;
-	}
+	const u32 size = (u32)file.size() - 7;
+	const gpu::TextureInfo info = gpu::getTextureInfo(data + 7);
+	texture.width = info.width;
+	texture.height = info.height;
+	texture.mips = info.mips;
+	texture.depth = info.depth;
+	texture.layers = info.layers;
+	texture.is_cubemap = info.is_cubemap;
+
+	texture.streamed_mips = 0;
+	const bool can_stream = info.layers == 1 && !info.is_cubemap && info.depth <= 1;
+	if (can_stream && texture.renderer.getTextureStreamingBudget() > 0) {
+		texture.streamed_mips = texture.getMaxStreamedMips();
+		if (texture.streamed_mips > 0) texture.stream_data.write(data + 7, size);
+	}
+
+	Renderer::MemRef mem = texture.renderer.copy(data + 7, size);
+	texture.handle = texture.renderer.loadTexture(mem, texture.getGPUFlags(), texture.streamed_mips, nullptr, texture.getPath().c_str());
+	if (!texture.handle.isValid()) texture.stream_data.clear();
 
 	return texture.handle.isValid();
 }
@@ -639,6 +699,12 @@ bool Texture::load(u64 size, const u8* mem)
 	if (!file.read(ext, 3)) return false;
 	if (!file.read(&flags, sizeof(flags))) return false;
 
+	// without GPU only textures accessed on CPU, e.g. heightmaps, are decoded
+	if (renderer.isHeadless() && data_reference == 0) {
+		m_size = file.size() - 3;
+		return true;
+	}
+
 	bool loaded = false;
 	if (equalIStrings(ext, "dds")) {
 		loaded = loadDDS(*this, file);
@@ -666,6 +732,10 @@ void Texture::unload()
 		handle = gpu::INVALID_TEXTURE;
 	}
 	data.clear();
+	stream_data.clear();
+	streamed_mips = 0;
+	requested_size = 0;
+	unused_frames = 0;
 }
 
 
@@ -85,6 +85,15 @@ public:
 	u32 getPixel(float x, float y) const;
 	u32 getGPUFlags() const;
 
+	// streamed textures start with mips up to STREAMING_MIN_SIZE and get more when requested
+	bool isStreamed() const { return !stream_data.empty(); }
+	// keeps at least `size` texels along the longer side for next streaming update, thread safe
+	void requestSize(u32 size);
+	u32 getMaxStreamedMips() const;
+	u32 getStreamedMips(u32 size) const;
+	u64 getGPUSize(u32 mips_to_skip) const;
+	void stream(u32 mips_to_skip);
+
 	static unsigned int compareTGA(IInputStream* file1, IInputStream* file2, int difference, IAllocator& allocator);
 	static bool saveTGA(IOutputStream* file,
 		int width,
@@ -96,6 +105,7 @@ public:
 		IAllocator& allocator);
 
 	static const ResourceType TYPE;
+	static constexpr u32 STREAMING_MIN_SIZE = 128;
 
 public:
 	u32 width;
@@ -111,6 +121,14 @@ public:
 	u32 data_reference;
 	OutputMemoryStream data;
 	Renderer& renderer;
+	// dds data of streamed texture, without ext and flags
+	OutputMemoryStream stream_data;
+	// number of highest mips not uploaded to GPU
+	u32 streamed_mips;
+	volatile i32 requested_size;
+	u32 unused_frames;
+	// incremented by onDataUpdated, lets data derived on the gpu notice edits
+	u32 data_version;
 
 private:
 	void unload() override;
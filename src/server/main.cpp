@@ -0,0 +1,180 @@
+#include "engine/allocator.h"
+#include "engine/command_line_parser.h"
+#include "engine/debug.h"
+#include "engine/engine.h"
+#include "engine/file_system.h"
+#include "engine/job_system.h"
+#include "engine/log.h"
+#include "engine/os.h"
+#include "engine/plugin.h"
+#include "engine/profiler.h"
+#include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include "engine/sync.h"
+#include "engine/universe.h"
+#include "renderer/renderer.h"
+
+using namespace Lumix;
+
+// dedicated server, runs the simulation without window, GPU and editor
+struct Server
+{
+	Server()
+		: m_main_allocator(m_default_allocator)
+		, m_allocator(m_main_allocator)
+	{
+		if (!JobSystem::init(OS::getCPUsCount(), m_allocator)) {
+			logError("Server") << "Failed to initialize job system.";
+		}
+	}
+	~Server() { ASSERT(!m_universe); }
+
+	void parseCommandLine() {
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-universe")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_universe_name.data, lengthOf(m_universe_name.data));
+			}
+			else if (parser.currentEquals("-tick_rate")) {
+				if (!parser.next()) break;
+				char tmp[16];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				u32 rate;
+				if (fromCString(Span(tmp, stringLength(tmp)), Ref(rate)) && rate > 0) m_tick_rate = rate;
+			}
+			else if (parser.currentEquals("-frames")) {
+				if (!parser.next()) break;
+				char tmp[16];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(m_max_frames));
+			}
+		}
+	}
+
+	void waitForLoading() {
+		while (m_engine->getFileSystem().hasWork()) {
+			OS::sleep(10);
+			m_engine->getFileSystem().processCallbacks();
+			m_engine->getResourceManager().update();
+		}
+	}
+
+	bool loadUniverse(const char* name) {
+		const StaticString<MAX_PATH_LENGTH> manifest_path("universes/", name, "/resources.manifest");
+		m_engine->getResourceManager().prefetch(Path(manifest_path));
+		const StaticString<MAX_PATH_LENGTH> path("universes/", name, "/entities.unv");
+		OS::MappedFile file;
+		if (!m_engine->getFileSystem().open(path, Ref(file))) {
+			logError("Server") << "Failed to open " << path;
+			return false;
+		}
+
+		InputMemoryStream blob(file.getData(), file.size());
+		// skip the header written by the editor, see WorldEditor::load
+		u32 hash = 0;
+		blob.read(hash);
+		blob.skip(hash == 0xffFFffFF ? 3 * sizeof(u32) : sizeof(u32));
+
+		EntityMap entity_map(m_allocator);
+		const bool res = m_engine->deserialize(*m_universe, blob, Ref(entity_map));
+		file.close();
+		if (!res) logError("Server") << "Failed to deserialize " << path;
+		return res;
+	}
+
+	bool init() {
+		parseCommandLine();
+		if (!m_universe_name[0]) {
+			logError("Server") << "No universe, use -universe <name>";
+			return false;
+		}
+
+		Engine::InitArgs init_data;
+		#ifdef LUMIXENGINE_PLUGINS
+			const char* plugins[] = { LUMIXENGINE_PLUGINS };
+			init_data.plugins = Span(plugins);
+		#endif
+		init_data.headless = true;
+		if (OS::fileExists("data.pak")) init_data.pack_path = "data.pak";
+		m_engine = Engine::create(init_data, m_allocator);
+		// physics, animation and navigation need render scene, it runs without GPU
+		m_renderer = static_cast<Renderer*>(m_engine->getPluginManager().getPlugin("renderer"));
+
+		m_universe = &m_engine->createUniverse(true);
+		if (!loadUniverse(m_universe_name)) return false;
+		waitForLoading();
+
+		// same simulation regardless of how long the ticks actually take
+		m_engine->setFixedTimeDelta(1.f / m_tick_rate);
+		m_engine->startGame(*m_universe);
+		m_is_game_running = true;
+		logInfo("Server") << "Running " << m_universe_name << " at " << m_tick_rate << " ticks per second";
+		return true;
+	}
+
+	void run() {
+		const float tick_duration = 1.f / m_tick_rate;
+		OS::Timer timer;
+		for (u32 frame = 0; m_max_frames == 0 || frame < m_max_frames; ++frame) {
+			timer.tick();
+			m_engine->update(*m_universe);
+			if (m_renderer) m_renderer->frame();
+			Profiler::frame();
+
+			// ticks which took too long are not caught up, the simulation just runs slower
+			const float remaining = tick_duration - timer.getTimeSinceTick();
+			if (remaining > 0.001f) OS::sleep(u32(remaining * 1000));
+		}
+	}
+
+	void shutdown() {
+		Profiler::stopCapture();
+		if (m_universe) {
+			if (m_is_game_running) m_engine->stopGame(*m_universe);
+			m_engine->destroyUniverse(*m_universe);
+			m_universe = nullptr;
+		}
+		if (m_engine) Engine::destroy(m_engine, m_allocator);
+		m_engine = nullptr;
+		m_renderer = nullptr;
+	}
+
+	DefaultAllocator m_default_allocator;
+	SmallAllocator m_main_allocator;
+	Debug::Allocator m_allocator;
+	Engine* m_engine = nullptr;
+	Renderer* m_renderer = nullptr;
+	Universe* m_universe = nullptr;
+	StaticString<MAX_PATH_LENGTH> m_universe_name;
+	bool m_is_game_running = false;
+	u32 m_tick_rate = 60;
+	// 0 runs until the process is killed
+	u32 m_max_frames = 0;
+};
+
+int main(int args, char* argv[])
+{
+	Server server;
+	Semaphore semaphore(0, 1);
+	struct Data {
+		Server* server;
+		Semaphore* semaphore;
+		bool result;
+	} data = {&server, &semaphore, false};
+	// main loop runs on worker 0, same as in the studio
+	JobSystem::runEx(&data, [](void* ptr) {
+		Data* data = (Data*)ptr;
+		data->result = data->server->init();
+		if (data->result) data->server->run();
+		data->server->shutdown();
+		data->semaphore->signal();
+	}, nullptr, JobSystem::INVALID_HANDLE, 0);
+	semaphore.wait();
+	JobSystem::shutdown();
+	return data.result ? 0 : 1;
+}